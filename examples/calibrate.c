@@ -0,0 +1,42 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ParTI.h>
+
+int main(int argc, char *argv[]) {
+    if(argc > 3) {
+        printf("Usage: %s [profile] [nthreads]\n", argv[0]);
+        printf("       writes the machine profile to the file, for PARTI_MACHINE_PROFILE, or to stdout\n\n");
+        return 1;
+    }
+    int nthreads = argc == 3 ? atoi(argv[2]) : 0;
+
+    sptMachineProfile profile;
+    sptAssert(sptCalibrateMachine(&profile, nthreads) == 0);
+
+    FILE *fo = argc >= 2 ? fopen(argv[1], "w") : stdout;
+    sptAssert(fo != NULL);
+    sptAssert(sptDumpMachineProfile(&profile, fo) == 0);
+    if(fo != stdout) {
+        fclose(fo);
+    }
+
+    return 0;
+}
@@ -28,6 +28,7 @@ int main(int argc, char * const argv[]) {
     sptSparseTensorHiCOO hitsr;
     sptElementIndex sb_bits;
     sptElementIndex sk_bits;
+    int binary = 0;
 
 
     for(;;) {
@@ -36,11 +37,12 @@ int main(int argc, char * const argv[]) {
             {"output", required_argument, 0, 'o'},
             {"bs", required_argument, 0, 'b'},
             {"ks", required_argument, 0, 'k'},
+            {"binary", no_argument, 0, 'B'},
             {0, 0, 0, 0}
         };
         int option_index = 0;
         int c = 1;
-        c = getopt_long(argc, argv, "i:o:b:k:", long_options, &option_index);
+        c = getopt_long(argc, argv, "i:o:b:k:B", long_options, &option_index);
         if(c == -1) {
             break;
         }
@@ -51,7 +53,7 @@ int main(int argc, char * const argv[]) {
             sptAssert(fi != NULL);
             break;
         case 'o':
-            fo = fopen(optarg, "w");
+            fo = fopen(optarg, "wb");
             sptAssert(fo != NULL);
             break;
         case 'b':
@@ -60,6 +62,9 @@ int main(int argc, char * const argv[]) {
         case 'k':
             sscanf(optarg, "%"PARTI_SCN_ELEMENT_INDEX, &sk_bits);
             break;
+        case 'B':
+            binary = 1;
+            break;
         default:
             abort();
         }
@@ -71,6 +76,7 @@ int main(int argc, char * const argv[]) {
         printf("         -o OUTPUT, --output=OUTPUT\n");
         printf("         -b BLOCKSIZE (bits), --blocksize=BLOCKSIZE (bits)\n");
         printf("         -k KERNELSIZE (bits), --kernelsize=KERNELSIZE (bits)\n");
+        printf("         -B, --binary (write a reloadable binary HiCOO file)\n");
         printf("\n");
         return 1;
     }
@@ -84,7 +90,11 @@ int main(int argc, char * const argv[]) {
     sptAssert(sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &tsr, sb_bits, sk_bits, 1) == 0);
     sptFreeSparseTensor(&tsr);
     sptSparseTensorStatusHiCOO(&hitsr, stdout);
-    sptAssert(sptDumpSparseTensorHiCOO(&hitsr, fo) == 0);
+    if(binary) {
+        sptAssert(sptDumpSparseTensorHiCOOBinary(&hitsr, fo) == 0);
+    } else {
+        sptAssert(sptDumpSparseTensorHiCOO(&hitsr, fo) == 0);
+    }
     fclose(fo);
 
     sptFreeSparseTensorHiCOO(&hitsr);
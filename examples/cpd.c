@@ -29,11 +29,17 @@ void print_usage(char ** argv) {
     printf("Usage: %s [options] \n\n", argv[0]);
     printf("Options: -i INPUT, --input=INPUT (.tns file)\n");
     printf("         -o OUTPUT, --output=OUTPUT (output file name)\n");
-    printf("         -d DEV_ID, --dev-id=DEV_ID (-2:sequential,default; -1:OpenMP parallel)\n");
+    printf("         -d DEV_ID, --dev-id=DEV_ID (-2:sequential,default; -1:OpenMP parallel; >=0:CUDA)\n");
     printf("         -r RANK (CPD rank, 16:default)\n");
+    printf("         -c CKPT, --checkpoint=CKPT (checkpoint every iteration, resume from CKPT if present)\n");
+    printf("         -w CKPT, --warm-start=CKPT (initial factors from a checkpoint file)\n");
     printf("         OpenMP options: \n");
     printf("         -t NTHREADS, --nt=NT (1:default)\n");
     printf("         -u use_reduce, --ur=use_reduce (use privatization or not)\n");
+    printf("         -m, --dimtree (memoize MTTKRP with a dimension tree)\n");
+    printf("         -x, --mixed (double-precision accumulation and solves over sptValue storage)\n");
+    printf("         CUDA options: \n");
+    printf("         -g NGPUS, --ngpus=NGPUS (1:default, split the tensor over GPUs 0..NGPUS-1)\n");
     printf("         --help\n");
     printf("\n");
 }
@@ -50,6 +56,10 @@ int main(int argc, char ** argv) {
     int dev_id = -2;
     int nthreads = 1;
     int use_reduce = 0;
+    int use_dimtree = 0;
+    int use_mixed = 0;
+    int ngpus = 1;
+    char const * warm_start = NULL;
 
     if(argc < 2) {
         print_usage(argv);
@@ -65,11 +75,16 @@ int main(int argc, char ** argv) {
             {"rank", optional_argument, 0, 'r'},
             {"nt", optional_argument, 0, 't'},
             {"use-reduce", optional_argument, 0, 'u'},
+            {"dimtree", no_argument, 0, 'm'},
+            {"mixed", no_argument, 0, 'x'},
+            {"ngpus", optional_argument, 0, 'g'},
+            {"checkpoint", required_argument, 0, 'c'},
+            {"warm-start", required_argument, 0, 'w'},
             {"help", no_argument, 0, 0},
             {0, 0, 0, 0}
         };
         int option_index = 0;
-        c = getopt_long(argc, argv, "i:o:d:r:t:u:", long_options, &option_index);
+        c = getopt_long(argc, argv, "i:o:d:r:t:u:mxg:c:w:", long_options, &option_index);
         if(c == -1) {
             break;
         }
@@ -88,14 +103,29 @@ int main(int argc, char ** argv) {
             sscanf(optarg, "%d", &dev_id);
             break;
         case 'r':
-            sscanf(optarg, "%u"PARTI_SCN_INDEX, &R);
+            sscanf(optarg, "%"PARTI_SCN_INDEX, &R);
             break;
         case 'u':
             sscanf(optarg, "%d", &use_reduce);
             break;
+        case 'm':
+            use_dimtree = 1;
+            break;
+        case 'x':
+            use_mixed = 1;
+            break;
         case 't':
             sscanf(optarg, "%d", &nthreads);
             break;
+        case 'g':
+            sscanf(optarg, "%d", &ngpus);
+            break;
+        case 'c':
+            sptAssert(sptSetCpdCheckpoint(optarg, 1) == 0);
+            break;
+        case 'w':
+            warm_start = optarg;
+            break;
         case '?':   /* invalid option */
         case 'h':
         default:
@@ -111,10 +141,18 @@ int main(int argc, char ** argv) {
     // sptDumpSparseTensor(&X, 0, stdout);  
 
     sptIndex nmodes = X.nmodes;
-    sptNewKruskalTensor(&ktensor, nmodes, X.ndims, R);
+    if(warm_start != NULL) {
+        sptAssert(sptLoadCpdCheckpoint(warm_start, &ktensor) == 0);
+        R = ktensor.rank;
+    } else {
+        sptNewKruskalTensor(&ktensor, nmodes, X.ndims, R);
+    }
 
     /* For warm-up caches, timing not included */
-    if(dev_id == -2) {
+    if(dev_id == -2 && use_mixed) {
+        nthreads = 1;
+        sptAssert(sptOmpCpdAlsMixed(&X, R, niters, tol, nthreads, &ktensor) == 0);
+    } else if(dev_id == -2) {
         nthreads = 1;
         sptAssert(sptCpdAls(&X, R, niters, tol, &ktensor) == 0);
     } else if(dev_id == -1) {
@@ -125,8 +163,27 @@ int main(int argc, char ** argv) {
         }
         printf("nthreads: %d\n", nthreads);
         printf("use_reduce: %d\n", use_reduce);
-        sptAssert(sptOmpCpdAls(&X, R, niters, tol, nthreads, use_reduce, &ktensor) == 0);
+        if(use_mixed) {
+            sptAssert(sptOmpCpdAlsMixed(&X, R, niters, tol, nthreads, &ktensor) == 0);
+        } else if(use_dimtree) {
+            sptCpdWorkspace ws;
+            sptAssert(sptNewCpdWorkspace(&ws, nmodes, X.ndims, R, nthreads, use_reduce) == 0);
+            sptAssert(sptCpdWorkspaceUseDimTree(&ws, &X) == 0);
+            sptAssert(sptOmpCpdAlsWorkspace(&X, R, niters, tol, &ws, &ktensor) == 0);
+            sptFreeCpdWorkspace(&ws);
+        } else {
+            sptAssert(sptOmpCpdAls(&X, R, niters, tol, nthreads, use_reduce, &ktensor) == 0);
+        }
     }
+#ifdef PARTI_USE_CUDA
+    else if(ngpus > 1) {
+        printf("ngpus: %d\n", ngpus);
+        sptAssert(sptCudaCpdAlsMultiGpu(&X, R, niters, tol, ngpus, &ktensor) == 0);
+    } else {
+        sptCudaSetDevice(dev_id);
+        sptAssert(sptCudaCpdAls(&X, R, niters, tol, &ktensor) == 0);
+    }
+#endif
 
 
     if(fo != NULL) {
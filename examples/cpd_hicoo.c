@@ -30,8 +30,10 @@ void print_usage(char ** argv) {
     printf("         -o OUTPUT, --output=OUTPUT (output file name)\n");
     printf("         -b BLOCKSIZE, --blocksize=BLOCKSIZE (in bits) (required)\n");
     printf("         -k KERNELSIZE, --kernelsize=KERNELSIZE (in bits) (required)\n");
+    printf("         -a PLAN, --plan=PLAN (load or autotune -b, -k and MTTKRP variants, instead of -b and -k)\n");
     printf("         -d DEV_ID, --dev-id=DEV_ID (-2:sequential,default; -1:OpenMP parallel)\n");
     printf("         -r RANK (CPD rank, 16:default)\n");
+    printf("         -p R_TILE, --rank-tile=R_TILE (rank-tiled CPD with R_TILE columns per panel, 0: default tile; implied for RANK > 255)\n");
     printf("         OpenMP options: \n");
     printf("         -t NTHREADS, --nt=NT (1:default)\n");
     printf("         --help\n");
@@ -46,10 +48,15 @@ int main(int argc, char ** argv) {
     sptSparseTensor tsr;
     sptSparseTensorHiCOO hitsr;
     sptRankKruskalTensor ktensor;
+    sptKruskalTensor tiled_ktensor;
     sptElementIndex sb_bits;
     sptElementIndex sk_bits;
+    char const * plan_path = NULL;
+    sptHiCOOPlan plan;
 
     sptIndex R = 16;
+    sptIndex R_tile = 0;
+    int rank_tiled = 0;
     int dev_id = -2;
     int nloops = 5;
     sptIndex niters = 5; // 50
@@ -67,16 +74,18 @@ int main(int argc, char ** argv) {
             {"input", required_argument, 0, 'i'},
             {"bs", required_argument, 0, 'b'},
             {"ks", required_argument, 0, 'k'},
+            {"plan", required_argument, 0, 'a'},
             {"output", optional_argument, 0, 'o'},
             {"dev-id", optional_argument, 0, 'd'},
             {"rank", optional_argument, 0, 'r'},
+            {"rank-tile", required_argument, 0, 'p'},
             {"nt", optional_argument, 0, 't'},
             {"help", no_argument, 0, 0},
             {0, 0, 0, 0}
         };
         int option_index = 0;
         int c = 0;
-        c = getopt_long(argc, argv, "i:b:k:o:d:r:t:", long_options, &option_index);
+        c = getopt_long(argc, argv, "i:b:k:a:o:d:r:p:t:", long_options, &option_index);
         if(c == -1) {
             break;
         }
@@ -95,12 +104,19 @@ int main(int argc, char ** argv) {
         case 'k':
             sscanf(optarg, "%"PARTI_SCN_ELEMENT_INDEX, &sk_bits);
             break;
+        case 'a':
+            plan_path = optarg;
+            break;
         case 'd':
             sscanf(optarg, "%d", &dev_id);
             break;
         case 'r':
             sscanf(optarg, "%"PARTI_SCN_INDEX, &R);
             break;
+        case 'p':
+            sscanf(optarg, "%"PARTI_SCN_INDEX, &R_tile);
+            rank_tiled = 1;
+            break;
         case 't':
             sscanf(optarg, "%d", &nt);
             break;
@@ -112,6 +128,9 @@ int main(int argc, char ** argv) {
         }
     }
     printf("dev_id: %d\n", dev_id);
+    if(R > 255) {
+        rank_tiled = 1;
+    }
 
     /* A sorting included in load tensor */
     sptAssert(sptLoadSparseTensor(&tsr, 1, fi) == 0);
@@ -119,6 +138,16 @@ int main(int argc, char ** argv) {
     sptSparseTensorStatus(&tsr, stdout);
     // sptAssert(sptDumpSparseTensor(&tsr, 0, stdout) == 0);
 
+    if(plan_path != NULL) {
+        if(dev_id == -2) {
+            nt = 1;
+        }
+        sptAssert(sptTuneHiCOOMTTKRPCached(&plan, plan_path, &tsr, R, 3, nt) == 0);
+        sb_bits = plan.sb_bits;
+        sk_bits = plan.sk_bits;
+        printf("plan: sb_bits %u, sk_bits %u\n", (unsigned) sb_bits, (unsigned) sk_bits);
+    }
+
     /* Convert to HiCOO tensor */
     sptNnzIndex max_nnzb = 0;
     sptTimer convert_timer;
@@ -135,13 +164,21 @@ int main(int argc, char ** argv) {
     // sptAssert(sptDumpSparseTensorHiCOO(&hitsr, stdout) == 0);
 
     sptIndex nmodes = hitsr.nmodes;
-    sptNewRankKruskalTensor(&ktensor, nmodes, tsr.ndims, R);
+    if(rank_tiled) {
+        sptNewKruskalTensor(&tiled_ktensor, nmodes, tsr.ndims, R);
+    } else {
+        sptNewRankKruskalTensor(&ktensor, nmodes, tsr.ndims, R);
+    }
     sptFreeSparseTensor(&tsr);
 
     /* For warm-up caches, timing not included */
     if(dev_id == -2) {
         nt = 1;
-        sptAssert(sptCpdAlsHiCOO(&hitsr, R, niters, tol, &ktensor) == 0);
+        if(rank_tiled) {
+            sptAssert(sptCpdAlsHiCOORankTiled(&hitsr, R, niters, tol, R_tile, &tiled_ktensor) == 0);
+        } else {
+            sptAssert(sptCpdAlsHiCOO(&hitsr, R, niters, tol, &ktensor) == 0);
+        }
     } else if(dev_id == -1) {
         omp_set_num_threads(nt);
         #pragma omp parallel
@@ -149,18 +186,35 @@ int main(int argc, char ** argv) {
             nt = omp_get_num_threads();
         }
         printf("nt: %d \n", nt);
-        sptAssert(sptOmpCpdAlsHiCOO(&hitsr, R, niters, tol, nt, &ktensor) == 0);
+        if(rank_tiled) {
+            sptAssert(sptOmpCpdAlsHiCOORankTiled(&hitsr, R, niters, tol, nt, R_tile, &tiled_ktensor) == 0);
+        } else if(plan_path != NULL && plan.nthreads == nt) {
+            sptAssert(sptOmpCpdAlsHiCOOPlan(&hitsr, R, niters, tol, &plan, &ktensor) == 0);
+        } else {
+            sptAssert(sptOmpCpdAlsHiCOO(&hitsr, R, niters, tol, nt, &ktensor) == 0);
+        }
     }
 
 
     if(fo != NULL) {
         // Dump ktensor to files
-        sptAssert( sptDumpRankKruskalTensor(&ktensor, fo) == 0 );
+        if(rank_tiled) {
+            sptAssert( sptDumpKruskalTensor(&tiled_ktensor, fo) == 0 );
+        } else {
+            sptAssert( sptDumpRankKruskalTensor(&ktensor, fo) == 0 );
+        }
         fclose(fo);
     }
 
+    if(plan_path != NULL) {
+        sptFreeHiCOOPlan(&plan);
+    }
     sptFreeSparseTensorHiCOO(&hitsr);
-    sptFreeRankKruskalTensor(&ktensor);
+    if(rank_tiled) {
+        sptFreeKruskalTensor(&tiled_ktensor);
+    } else {
+        sptFreeRankKruskalTensor(&ktensor);
+    }
 
     return 0;
 }
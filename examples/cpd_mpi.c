@@ -0,0 +1,87 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ParTI.h>
+
+#ifdef PARTI_USE_MPI
+
+int main(int argc, char ** argv) {
+    sptSparseTensor X;
+    sptKruskalTensor ktensor;
+    sptIndex R = 16;
+    sptIndex niters = 5;
+    double tol = 1e-5;
+    int nthreads = 1;
+
+    MPI_Init(&argc, &argv);
+    int myrank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+    if(argc < 2) {
+        if(myrank == 0) {
+            printf("Usage: mpirun -np P %s input.bin|input.tns [RANK] [NTHREADS] [output]\n\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if(argc > 2) {
+        sscanf(argv[2], "%"PARTI_SCN_INDEX, &R);
+    }
+    if(argc > 3) {
+        sscanf(argv[3], "%d", &nthreads);
+    }
+
+    size_t const len = strlen(argv[1]);
+    if(len > 4 && strcmp(argv[1] + len - 4, ".tns") == 0) {
+        sptAssert(sptMpiLoadSparseTensor(&X, 1, argv[1], nthreads, MPI_COMM_WORLD) == 0);
+    } else {
+        sptAssert(sptMpiLoadSparseTensorBinary(&X, argv[1], MPI_COMM_WORLD) == 0);
+    }
+    sptAssert(sptMpiRedistributeSparseTensor(&X, 0, NULL, MPI_COMM_WORLD) == 0);
+    sptIndex nmodes = X.nmodes;
+    sptAssert(sptNewKruskalTensor(&ktensor, nmodes, X.ndims, R) == 0);
+
+    sptCpdWorkspace ws;
+    sptAssert(sptNewCpdWorkspace(&ws, nmodes, X.ndims, R, nthreads, 0) == 0);
+    sptAssert(sptMpiCpdAls(&X, R, niters, tol, &ws, MPI_COMM_WORLD, &ktensor) == 0);
+    sptFreeCpdWorkspace(&ws);
+
+    if(myrank == 0 && argc > 4) {
+        FILE *fo = fopen(argv[4], "w");
+        sptAssert(fo != NULL);
+        sptAssert(sptDumpKruskalTensor(&ktensor, fo) == 0);
+        fclose(fo);
+    }
+
+    sptFreeSparseTensor(&X);
+    sptFreeKruskalTensor(&ktensor);
+    MPI_Finalize();
+
+    return 0;
+}
+
+#else
+
+int main(int argc, char ** argv) {
+    (void) argc;
+    printf("%s: ParTI was built without MPI, reconfigure with -DUSE_MPI=ON\n", argv[0]);
+    return 1;
+}
+
+#endif
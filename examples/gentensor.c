@@ -0,0 +1,157 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <ParTI.h>
+
+static void print_usage(char ** argv) {
+    printf("Usage: %s [options] -d I0xI1x... -z NNZ -o output\n\n", argv[0]);
+    printf("Options: -d DIMS, --dims=DIMS (mode sizes, e.g. 1000x1000x1000)\n");
+    printf("         -z NNZ, --nnz=NNZ (number of nonzeros, e.g. 1e9; duplicates are kept)\n");
+    printf("         -k KIND, --kind=KIND (uniform, powerlaw or kronecker, default uniform)\n");
+    printf("         -p PARAM, --param=PARAM (power-law exponent, default 1.5; Kronecker weight, default 0.57)\n");
+    printf("         -s SEED, --seed=SEED (default 1)\n");
+    printf("         -t NTHREADS, --nt=NTHREADS (default 1)\n");
+    printf("         -b, --binary (write the binary format instead of text)\n");
+    printf("         -o FILE, --output=FILE\n");
+    printf("         --help\n");
+    printf("\n");
+}
+
+int main(int argc, char ** argv) {
+    sptIndex ndims[63];
+    sptIndex nmodes = 0;
+    sptNnzIndex nnz = 0;
+    sptGeneratorKind kind = SPT_GEN_UNIFORM;
+    double param = -1;
+    uint64_t seed = 1;
+    int nt = 1;
+    int binary = 0;
+    char const * output = NULL;
+
+    int c;
+    for(;;) {
+        static struct option long_options[] = {
+            {"dims", required_argument, 0, 'd'},
+            {"nnz", required_argument, 0, 'z'},
+            {"kind", required_argument, 0, 'k'},
+            {"param", required_argument, 0, 'p'},
+            {"seed", required_argument, 0, 's'},
+            {"nt", required_argument, 0, 't'},
+            {"binary", no_argument, 0, 'b'},
+            {"output", required_argument, 0, 'o'},
+            {"help", no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long(argc, argv, "d:z:k:p:s:t:bo:h", long_options, &option_index);
+        if(c == -1) {
+            break;
+        }
+        switch(c) {
+        case 'd': {
+            char const * p = optarg;
+            nmodes = 0;
+            for(;;) {
+                char * end;
+                if(nmodes == 63) {
+                    fprintf(stderr, "too many modes\n");
+                    return 1;
+                }
+                ndims[nmodes++] = (sptIndex) strtoul(p, &end, 10);
+                if(*end != 'x') {
+                    break;
+                }
+                p = end + 1;
+            }
+            break;
+        }
+        case 'z':
+            nnz = (sptNnzIndex) strtod(optarg, NULL);
+            break;
+        case 'k':
+            if(strcmp(optarg, "uniform") == 0) {
+                kind = SPT_GEN_UNIFORM;
+            } else if(strcmp(optarg, "powerlaw") == 0) {
+                kind = SPT_GEN_POWERLAW;
+            } else if(strcmp(optarg, "kronecker") == 0) {
+                kind = SPT_GEN_KRONECKER;
+            } else {
+                fprintf(stderr, "unknown kind: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            param = atof(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            nt = atoi(optarg);
+            break;
+        case 'b':
+            binary = 1;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'h':
+        default:
+            print_usage(argv);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+    if(nmodes == 0 || nnz == 0 || output == NULL) {
+        print_usage(argv);
+        return 1;
+    }
+    if(param < 0) {
+        param = kind == SPT_GEN_KRONECKER ? 0.57 : 1.5;
+    }
+
+    sptSparseTensor X;
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+    sptAssert(sptGenerateSparseTensor(&X, nmodes, ndims, nnz, kind, param, seed, nt) == 0);
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "Generate SpTns");
+
+    FILE * fo = fopen(output, binary ? "wb" : "w");
+    if(fo == NULL) {
+        perror(output);
+        return 1;
+    }
+    sptStartTimer(timer);
+    if(binary) {
+        sptAssert(sptDumpSparseTensorBinary(&X, fo) == 0);
+    } else {
+        sptAssert(sptDumpSparseTensor(&X, 1, fo) == 0);
+    }
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "Write SpTns");
+    fclose(fo);
+
+    sptFreeTimer(timer);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -117,7 +117,7 @@ int main(int argc, char ** argv) {
             sscanf(optarg, "%d", &dev_id);
             break;
         case 'r':
-            sscanf(optarg, "%u"PARTI_SCN_INDEX, &R);
+            sscanf(optarg, "%"PARTI_SCN_INDEX, &R);
             break;
         case 'u':
             sscanf(optarg, "%d", &use_reduce);
@@ -34,7 +34,7 @@ void print_usage(int argc, char ** argv) {
     printf("         -d CUDA_DEV_ID, --cuda-dev-id=CUDA_DEV_ID (>=0:GPU device id)\n");
     printf("         -r RANK (the number of matrix columns, 16:default)\n");
     printf("         GPU options: \n");
-    printf("         -p IMPL_NUM, --impl-num=IMPL_NUM (11, 12, 15, where 15 should be the best case)\n");
+    printf("         -p IMPL_NUM, --impl-num=IMPL_NUM (11, 12, 15, 16, or 0:default to choose from the tensor and device)\n");
     printf("         --help\n");
     printf("\n");
 }
@@ -31,6 +31,7 @@ void print_usage(char ** argv) {
     printf("         -m MODE, --mode=MODE (default -1: loop all modes, or specify a mode, e.g., 0 or 1 or 2 for third-order tensors.)\n");
     printf("         -b BLOCKSIZE, --blocksize=BLOCKSIZE (in bits) (required)\n");
     printf("         -k KERNELSIZE, --kernelsize=KERNELSIZE (in bits) (required)\n");
+    printf("         -a PLAN, --plan=PLAN (load or autotune -b, -k and MTTKRP variants, instead of -b and -k)\n");
     printf("         -d DEV_ID, --dev-id=DEV_ID (-2:sequential,default; -1:OpenMP parallel)\n");
     printf("         -r RANK (the number of matrix columns, 16:default)\n");
     printf("         OpenMP options: \n");
@@ -47,6 +48,8 @@ int main(int argc, char ** argv) {
     sptSparseTensorHiCOO hitsr;
     sptElementIndex sb_bits;
     sptElementIndex sk_bits;
+    char const * plan_path = NULL;
+    sptHiCOOPlan plan;
 
     sptIndex mode = PARTI_INDEX_MAX;
     sptElementIndex R = 16;
@@ -67,6 +70,7 @@ int main(int argc, char ** argv) {
             {"input", required_argument, 0, 'i'},
             {"bs", required_argument, 0, 'b'},
             {"ks", required_argument, 0, 'k'},
+            {"plan", required_argument, 0, 'a'},
             {"mode", required_argument, 0, 'm'},
             {"output", optional_argument, 0, 'o'},
             {"dev-id", optional_argument, 0, 'd'},
@@ -77,7 +81,7 @@ int main(int argc, char ** argv) {
         };
         int option_index = 0;
         int c = 0;
-        c = getopt_long(argc, argv, "i:o:b:k:m:d:r:t:", long_options, &option_index);
+        c = getopt_long(argc, argv, "i:o:b:k:a:m:d:r:t:", long_options, &option_index);
         if(c == -1) {
             break;
         }
@@ -96,6 +100,9 @@ int main(int argc, char ** argv) {
         case 'k':
             sscanf(optarg, "%"PARTI_SCN_ELEMENT_INDEX, &sk_bits);
             break;
+        case 'a':
+            plan_path = optarg;
+            break;
         case 'm':
             sscanf(optarg, "%"PARTI_SCN_INDEX, &mode);
             break;
@@ -124,6 +131,13 @@ int main(int argc, char ** argv) {
     sptSparseTensorStatus(&tsr, stdout);
     // sptAssert(sptDumpSparseTensor(&tsr, 0, stdout) == 0);
 
+    if(plan_path != NULL) {
+        sptAssert(sptTuneHiCOOMTTKRPCached(&plan, plan_path, &tsr, R, niters, dev_id == -2 ? 1 : nt) == 0);
+        sb_bits = plan.sb_bits;
+        sk_bits = plan.sk_bits;
+        printf("plan: sb_bits %u, sk_bits %u\n", (unsigned) sb_bits, (unsigned) sk_bits);
+    }
+
     /* Convert to HiCOO tensor */
     sptNnzIndex max_nnzb = 0;
     sptTimer convert_timer;
@@ -177,12 +191,15 @@ int main(int argc, char ** argv) {
             /* determine niters or num_kernel_dim to be parallelized */
             sptIndex sk = (sptIndex)pow(2, hitsr.sk_bits);
             sptIndex num_kernel_dim = (hitsr.ndims[mode] + sk - 1) / sk;
-            printf("hitsr.nkiters[mode] / num_kernel_dim: %u (threshold: %u)\n", hitsr.nkiters[mode]/num_kernel_dim, PAR_DEGREE_REDUCE);
+            printf("hitsr.nkiters[mode] / num_kernel_dim: %"PARTI_PRI_INDEX" (threshold: %u)\n", hitsr.nkiters[mode]/num_kernel_dim, PAR_DEGREE_REDUCE);
             if(num_kernel_dim <= PAR_MIN_DEGREE * NUM_CORES && hitsr.nkiters[mode] / num_kernel_dim >= PAR_DEGREE_REDUCE) {
                 par_iters = 1;
             }
+            if(plan_path != NULL) {
+                par_iters = plan.variants[mode] == SPT_HICOO_MTTKRP_SCHEDULED_REDUCE;
+            }
             sptIndex num_tasks = (par_iters == 1) ? hitsr.nkiters[mode] : num_kernel_dim;
-            printf("par_iters: %d, num_tasks: %u\n", par_iters, num_tasks);
+            printf("par_iters: %d, num_tasks: %"PARTI_PRI_INDEX"\n", par_iters, num_tasks);
 
             /* Set zeros for temporary copy_U, for mode-"mode" */
             if(dev_id == -1 && par_iters == 1) {
@@ -213,7 +230,10 @@ int main(int argc, char ** argv) {
                 }
                 // printf("sptOmpMTTKRPHiCOO_MatrixTiling:\n");
                 // sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode, nt) == 0);
-                if(par_iters == 0) {
+                if(plan_path != NULL) {
+                    printf("sptMTTKRPHiCOOPlan:\n");
+                    sptAssert(sptMTTKRPHiCOOPlan(&hitsr, &plan, U, copy_U, mats_order, mode) == 0);
+                } else if(par_iters == 0) {
                     printf("sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled:\n");
                     sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&hitsr, U, mats_order, mode, nt) == 0);
                 } else {
@@ -232,7 +252,9 @@ int main(int argc, char ** argv) {
                     sptAssert(sptMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode) == 0);
                 } else if(dev_id == -1) {
                     // sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode, nt) == 0);
-                    if(par_iters == 0) {
+                    if(plan_path != NULL) {
+                        sptAssert(sptMTTKRPHiCOOPlan(&hitsr, &plan, U, copy_U, mats_order, mode) == 0);
+                    } else if(par_iters == 0) {
                         sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&hitsr, U, mats_order, mode, nt) == 0);
                     } else {
                         sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(&hitsr, U, copy_U, mats_order, mode, nt) == 0);
@@ -263,10 +285,13 @@ int main(int argc, char ** argv) {
         /* determine niters or num_kernel_dim to be parallelized */
         sptIndex sk = (sptIndex)pow(2, hitsr.sk_bits);
         sptIndex num_kernel_dim = (hitsr.ndims[mode] + sk - 1) / sk;
-        printf("num_kernel_dim: %u, hitsr.nkiters[mode] / num_kernel_dim: %u\n", num_kernel_dim, hitsr.nkiters[mode]/num_kernel_dim);
+        printf("num_kernel_dim: %"PARTI_PRI_INDEX", hitsr.nkiters[mode] / num_kernel_dim: %"PARTI_PRI_INDEX"\n", num_kernel_dim, hitsr.nkiters[mode]/num_kernel_dim);
         if(num_kernel_dim <= PAR_MIN_DEGREE * NUM_CORES && hitsr.nkiters[mode] / num_kernel_dim >= PAR_DEGREE_REDUCE) {
             par_iters = 1;
         }
+        if(plan_path != NULL) {
+            par_iters = plan.variants[mode] == SPT_HICOO_MTTKRP_SCHEDULED_REDUCE;
+        }
 
         /* Set zeros for temporary copy_U, for mode-"mode" */
         if(dev_id == -1 && par_iters == 1) {
@@ -294,7 +319,10 @@ int main(int argc, char ** argv) {
             printf("nt: %d \n", nt);
             // printf("sptOmpMTTKRPHiCOO_MatrixTiling:\n");
             // sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode, nt) == 0);
-            if(par_iters == 0) {
+            if(plan_path != NULL) {
+                printf("sptMTTKRPHiCOOPlan:\n");
+                sptAssert(sptMTTKRPHiCOOPlan(&hitsr, &plan, U, copy_U, mats_order, mode) == 0);
+            } else if(par_iters == 0) {
                 printf("sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled:\n");
                 sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&hitsr, U, mats_order, mode, nt) == 0);
             } else {
@@ -313,7 +341,9 @@ int main(int argc, char ** argv) {
                 sptAssert(sptMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode) == 0);
             } else if(dev_id == -1) {
                 // sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling(&hitsr, U, mats_order, mode, nt) == 0);
-                if(par_iters == 0) {
+                if(plan_path != NULL) {
+                    sptAssert(sptMTTKRPHiCOOPlan(&hitsr, &plan, U, copy_U, mats_order, mode) == 0);
+                } else if(par_iters == 0) {
                     sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&hitsr, U, mats_order, mode, nt) == 0);
                 } else {
                     sptAssert(sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(&hitsr, U, copy_U, mats_order, mode, nt) == 0);
@@ -328,7 +358,6 @@ int main(int argc, char ** argv) {
 
         if(fo != NULL) {
             sptAssert(sptDumpRankMatrix(U[nmodes], fo) == 0);
-            fclose(fo);
         }
     }   // End execute a specified mode
 
@@ -348,6 +377,9 @@ int main(int argc, char ** argv) {
     sptFreeRankMatrix(U[nmodes]);
     free(U);
     free(mats_order);
+    if(plan_path != NULL) {
+        sptFreeHiCOOPlan(&plan);
+    }
     sptFreeSparseTensorHiCOO(&hitsr);
 
     return 0;
@@ -0,0 +1,685 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <ParTI.h>
+#include "../src/sptensor/sptensor.h"
+
+/*
+ * parti-bench: one driver for the kernel benchmarks.
+ *
+ * Runs every combination of {tensor x format x kernel x variant x threads x
+ * rank x mode} that makes sense, with warm-up runs and repeated timed runs,
+ * and writes one record per combination with the timing statistics, the
+ * kernel's flop and traffic model, its arithmetic intensity and, given the
+ * machine's peaks, its position under the roofline.
+ */
+
+#define BENCH_MAX_LIST 32
+#define BENCH_MAX_TENSORS 64
+
+typedef struct {
+    char * name;         /// file name, or the synthetic spec
+    sptSparseTensor X;
+} bench_Tensor;
+
+typedef struct {
+    char const * tensor;
+    char const * format;
+    char const * kernel;
+    char const * variant;
+    int threads;
+    sptIndex rank;
+    sptIndex mode;
+    double min, median, mean, stddev;
+    double flops;
+    double bytes;
+} bench_Result;
+
+static void print_usage(char ** argv) {
+    printf("Usage: %s [options]\n\n", argv[0]);
+    printf("Options: -i INPUT, --input=INPUT (.tns file, may repeat)\n");
+    printf("         -g SPEC, --synthetic=SPEC (random tensor, e.g. 1000x1000x1000:1000000, may repeat)\n");
+    printf("         -f FORMATS, --formats=FORMATS (coo,hicoo; default coo)\n");
+    printf("         -k KERNELS, --kernels=KERNELS (mttkrp,ttm,sort; default mttkrp)\n");
+    printf("         -v VARIANTS, --variants=VARIANTS (seq,omp,reduce,lock; default seq,omp)\n");
+    printf("         -t THREADS, --threads=THREADS (list, default 1)\n");
+    printf("         -r RANKS, --ranks=RANKS (list, default 16)\n");
+    printf("         -m MODES, --modes=MODES (list, default all modes)\n");
+    printf("         -w WARMUP, --warmup=WARMUP (untimed runs, default 1)\n");
+    printf("         -n REPS, --reps=REPS (timed runs, default 5)\n");
+    printf("         -b BLOCKSIZE, --blocksize=BLOCKSIZE (HiCOO block bits, default 7)\n");
+    printf("         -P GFLOPS, --peak-gflops=GFLOPS (machine peak, for the roofline)\n");
+    printf("         -B GBS, --peak-gbs=GBS (machine bandwidth, for the roofline)\n");
+    printf("         -o OUTPUT, --output=OUTPUT (report file, default stdout)\n");
+    printf("         -F FORMAT, --report=FORMAT (json or csv, default json)\n");
+    printf("         -C BASELINE, --baseline=BASELINE (CSV report to compare against; recorded if missing)\n");
+    printf("         -T TOLERANCE, --tolerance=TOLERANCE (allowed slowdown of min_s, default 0.25)\n");
+    printf("         -S SECONDS, --slack=SECONDS (allowed absolute slowdown on top, default 2e-5)\n");
+    printf("         --help\n");
+    printf("\n");
+    printf("Variants: seq and omp for every kernel; reduce and lock for COO MTTKRP only.\n");
+    printf("Combinations that do not exist, such as HiCOO TTM, are skipped.\n");
+    printf("With a baseline the exit code is 2 on a regression, and 77 when the baseline was just recorded.\n");
+}
+
+/* Split a comma-separated list into at most max words, in place */
+static int split_list(char * s, char ** words, int max) {
+    int n = 0;
+    for(char * w = strtok(s, ","); w != NULL && n < max; w = strtok(NULL, ",")) {
+        words[n++] = w;
+    }
+    return n;
+}
+
+static int parse_int_list(char * s, long * values, int max) {
+    char * words[BENCH_MAX_LIST];
+    int const n = split_list(s, words, max < BENCH_MAX_LIST ? max : BENCH_MAX_LIST);
+    for(int i = 0; i < n; ++i) {
+        values[i] = strtol(words[i], NULL, 10);
+    }
+    return n;
+}
+
+static int has_word(char ** words, int n, char const * word) {
+    for(int i = 0; i < n; ++i) {
+        if(strcmp(words[i], word) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Uniform random tensor from "I0xI1x...:NNZ", seed 1, duplicates allowed */
+static int make_synthetic(sptSparseTensor * X, char const * spec) {
+    sptIndex ndims[16];
+    sptIndex nmodes = 0;
+    char const * p = spec;
+    while(nmodes < 16) {
+        char * end;
+        ndims[nmodes++] = (sptIndex) strtoul(p, &end, 10);
+        if(*end == 'x') {
+            p = end + 1;
+        } else if(*end == ':') {
+            p = end + 1;
+            break;
+        } else {
+            return -1;
+        }
+    }
+    sptNnzIndex const nnz = (sptNnzIndex) strtod(p, NULL);
+    if(nnz == 0) {
+        return -1;
+    }
+    return sptGenerateSparseTensor(X, nmodes, ndims, nnz, SPT_GEN_UNIFORM, 0, 1, 1);
+}
+
+static int compare_double(void const * a, void const * b) {
+    double const x = *(double const *) a;
+    double const y = *(double const *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(bench_Result * res, double * times, int reps) {
+    qsort(times, reps, sizeof *times, compare_double);
+    double sum = 0, sq = 0;
+    for(int i = 0; i < reps; ++i) {
+        sum += times[i];
+    }
+    res->mean = sum / reps;
+    for(int i = 0; i < reps; ++i) {
+        sq += (times[i] - res->mean) * (times[i] - res->mean);
+    }
+    res->stddev = reps > 1 ? sqrt(sq / (reps - 1)) : 0;
+    res->min = times[0];
+    res->median = reps % 2 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+}
+
+/* HiCOO MTTKRP traffic: the compressed tensor plus one access per factor and output row */
+static double hicoo_mttkrp_bytes(sptSparseTensorHiCOO const * hitsr, sptIndex R) {
+    double const nnz = (double) hitsr->nnz;
+    double const nb = (double) hitsr->binds[0].len;
+    return nnz * (sizeof (sptValue) + hitsr->nmodes * sizeof (sptElementIndex))
+        + nb * (hitsr->nmodes * sizeof (sptBlockIndex) + sizeof (sptNnzIndex))
+        + nnz * R * hitsr->nmodes * sizeof (sptValue);
+}
+
+typedef struct {
+    sptSparseTensor * X;
+    sptSparseTensorHiCOO * hitsr;
+    sptMatrix ** U;
+    sptMatrix ** copy_U;
+    sptMutexPool * locks;
+    sptIndex * mats_order;
+    sptIndex mode;
+    int nt;
+} bench_Args;
+
+typedef int (*bench_Kernel)(bench_Args * a);
+
+static int run_mttkrp_seq(bench_Args * a) {
+    return sptMTTKRP(a->X, a->U, a->mats_order, a->mode);
+}
+static int run_mttkrp_omp(bench_Args * a) {
+    return sptOmpMTTKRP(a->X, a->U, a->mats_order, a->mode, a->nt);
+}
+static int run_mttkrp_reduce(bench_Args * a) {
+    return sptOmpMTTKRP_Reduce(a->X, a->U, a->copy_U, a->mats_order, a->mode, a->nt);
+}
+static int run_mttkrp_lock(bench_Args * a) {
+    return sptOmpMTTKRP_Lock(a->X, a->U, a->mats_order, a->mode, a->nt, a->locks);
+}
+static int run_hicoo_mttkrp_seq(bench_Args * a) {
+    return sptMTTKRPHiCOO(a->hitsr, a->U, a->mats_order, a->mode);
+}
+static int run_hicoo_mttkrp_omp(bench_Args * a) {
+    return sptOmpMTTKRPHiCOO(a->hitsr, a->U, a->mats_order, a->mode, a->nt);
+}
+static int run_ttm(bench_Args * a, int omp) {
+    sptSemiSparseTensor Y;
+    int result = omp ? sptOmpSparseTensorMulMatrix(&Y, a->X, a->U[a->mode], a->mode)
+                     : sptSparseTensorMulMatrix(&Y, a->X, a->U[a->mode], a->mode);
+    if(result == 0) {
+        sptFreeSemiSparseTensor(&Y);
+    }
+    return result;
+}
+static int run_ttm_seq(bench_Args * a) {
+    return run_ttm(a, 0);
+}
+static int run_ttm_omp(bench_Args * a) {
+    return run_ttm(a, 1);
+}
+static int run_sort(bench_Args * a) {
+    /* Forced, so every run sorts; the first run leaves the data in order */
+    sptSparseTensorSortIndex(a->X, 1);
+    return 0;
+}
+
+/* The kernel of a combination, NULL if it does not exist */
+static bench_Kernel lookup_kernel(char const * format, char const * kernel, char const * variant) {
+    int const coo = strcmp(format, "coo") == 0;
+    int const hicoo = strcmp(format, "hicoo") == 0;
+    int const seq = strcmp(variant, "seq") == 0;
+    int const omp = strcmp(variant, "omp") == 0;
+    if(strcmp(kernel, "mttkrp") == 0) {
+        if(coo && seq) return run_mttkrp_seq;
+        if(coo && omp) return run_mttkrp_omp;
+        if(coo && strcmp(variant, "reduce") == 0) return run_mttkrp_reduce;
+        if(coo && strcmp(variant, "lock") == 0) return run_mttkrp_lock;
+        if(hicoo && seq) return run_hicoo_mttkrp_seq;
+        if(hicoo && omp) return run_hicoo_mttkrp_omp;
+    } else if(strcmp(kernel, "ttm") == 0) {
+        if(coo && seq) return run_ttm_seq;
+        if(coo && omp) return run_ttm_omp;
+    } else if(strcmp(kernel, "sort") == 0) {
+        /* Sorting is mode- and rank-independent; the radix engine is parallel either way */
+        if(coo && omp) return run_sort;
+    }
+    return NULL;
+}
+
+static void write_json_string(FILE * fo, char const * s) {
+    fputc('"', fo);
+    for(; *s != '\0'; ++s) {
+        if(*s == '"' || *s == '\\') {
+            fputc('\\', fo);
+        }
+        fputc(*s, fo);
+    }
+    fputc('"', fo);
+}
+
+/* Exit codes for baseline runs, 77 being what ctest's SKIP_RETURN_CODE expects by convention */
+#define BENCH_EXIT_REGRESSION 2
+#define BENCH_EXIT_RECORDED 77
+
+/* Column of name in a CSV header, -1 if absent */
+static int csv_column(char * header, char const * name) {
+    int col = 0;
+    for(char * w = strtok(header, ",\n"); w != NULL; w = strtok(NULL, ",\n"), ++col) {
+        if(strcmp(w, name) == 0) {
+            return col;
+        }
+    }
+    return -1;
+}
+
+/* The idx-th comma-separated field of line, copied into field */
+static void csv_field(char const * line, int idx, char * field, size_t size) {
+    for(int i = 0; i < idx && line != NULL; ++i) {
+        line = strchr(line, ',');
+        line = line ? line + 1 : NULL;
+    }
+    size_t n = 0;
+    if(line != NULL) {
+        while(line[n] != '\0' && line[n] != ',' && line[n] != '\n' && n + 1 < size) {
+            ++ n;
+        }
+        memcpy(field, line, n);
+    }
+    field[n] = '\0';
+}
+
+/*
+ * Compare min_s of every result with the baseline report's record of the
+ * same combination; combinations the baseline lacks are not compared.
+ * Returns the number of regressions, or -1 if the baseline cannot be read.
+ */
+static int compare_baseline(char const * path, bench_Result const * results, int nresults, double tolerance, double slack) {
+    FILE * fb = fopen(path, "r");
+    if(fb == NULL) {
+        return -1;
+    }
+    char line[4096], header[4096];
+    if(fgets(header, sizeof header, fb) == NULL) {
+        fclose(fb);
+        return -1;
+    }
+    static char const * const keys[] = { "tensor", "format", "kernel", "variant", "threads", "rank", "mode" };
+    int key_cols[7], min_col;
+    for(int k = 0; k < 7; ++k) {
+        strcpy(line, header);
+        key_cols[k] = csv_column(line, keys[k]);
+    }
+    strcpy(line, header);
+    min_col = csv_column(line, "min_s");
+    for(int k = 0; k < 7; ++k) {
+        if(key_cols[k] < 0 || min_col < 0) {
+            fclose(fb);
+            return -1;
+        }
+    }
+
+    int regressions = 0, matched = 0;
+    while(fgets(line, sizeof line, fb) != NULL) {
+        char f[7][256], value[64];
+        for(int k = 0; k < 7; ++k) {
+            csv_field(line, key_cols[k], f[k], sizeof f[k]);
+        }
+        csv_field(line, min_col, value, sizeof value);
+        double const base = atof(value);
+        for(int i = 0; i < nresults; ++i) {
+            bench_Result const * r = &results[i];
+            if(strcmp(f[0], r->tensor) != 0 || strcmp(f[1], r->format) != 0 || strcmp(f[2], r->kernel) != 0 ||
+               strcmp(f[3], r->variant) != 0 || atoi(f[4]) != r->threads || (sptIndex) atol(f[5]) != r->rank ||
+               (sptIndex) atol(f[6]) != r->mode) {
+                continue;
+            }
+            ++ matched;
+            if(r->min > base * (1 + tolerance) + slack) {
+                fprintf(stderr, "REGRESSION %s %s %s %s threads=%d rank=%"PARTI_PRI_INDEX" mode=%"PARTI_PRI_INDEX": %.6g s vs baseline %.6g s (+%.1f%%)\n",
+                    r->tensor, r->format, r->kernel, r->variant, r->threads, r->rank, r->mode, r->min, base, (r->min / base - 1) * 100);
+                ++ regressions;
+            }
+        }
+    }
+    fclose(fb);
+    fprintf(stderr, "%d of %d results compared with %s, %d regressions\n", matched, nresults, path, regressions);
+    return regressions;
+}
+
+static void write_report(FILE * fo, int csv, bench_Result const * results, int nresults, int warmup, int reps, double peak_gflops, double peak_gbs) {
+    if(csv) {
+        fprintf(fo, "tensor,format,kernel,variant,threads,rank,mode,warmup,reps,min_s,median_s,mean_s,stddev_s,flops,bytes,intensity,gflops,gbs,attainable_gflops,roofline_fraction,bound\n");
+    } else {
+        fprintf(fo, "{\n  \"warmup\": %d,\n  \"reps\": %d,\n", warmup, reps);
+        fprintf(fo, "  \"peak_gflops\": %.6g,\n  \"peak_gbs\": %.6g,\n  \"results\": [", peak_gflops, peak_gbs);
+    }
+    for(int i = 0; i < nresults; ++i) {
+        bench_Result const * r = &results[i];
+        double const ai = r->bytes > 0 ? r->flops / r->bytes : 0;
+        double const gflops = r->flops / r->median * 1e-9;
+        double const gbs = r->bytes / r->median * 1e-9;
+        /* Attainable performance under the roofline, when the peaks are known */
+        double attainable = 0, fraction = 0;
+        char const * bound = "unknown";
+        if(peak_gflops > 0 && peak_gbs > 0) {
+            attainable = ai * peak_gbs < peak_gflops ? ai * peak_gbs : peak_gflops;
+            bound = ai * peak_gbs < peak_gflops ? "memory" : "compute";
+            fraction = attainable > 0 ? gflops / attainable : gbs / peak_gbs;
+        }
+        if(csv) {
+            fprintf(fo, "%s,%s,%s,%s,%d,%"PARTI_PRI_INDEX",%"PARTI_PRI_INDEX",%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.6g,%.6g,%.6g,%.6g,%.6g,%s\n",
+                r->tensor, r->format, r->kernel, r->variant, r->threads, r->rank, r->mode, warmup, reps,
+                r->min, r->median, r->mean, r->stddev, r->flops, r->bytes, ai, gflops, gbs, attainable, fraction, bound);
+        } else {
+            fprintf(fo, i == 0 ? "\n    {\"tensor\": " : ",\n    {\"tensor\": ");
+            write_json_string(fo, r->tensor);
+            fprintf(fo, ", \"format\": \"%s\", \"kernel\": \"%s\", \"variant\": \"%s\", \"threads\": %d, \"rank\": %"PARTI_PRI_INDEX", \"mode\": %"PARTI_PRI_INDEX",",
+                r->format, r->kernel, r->variant, r->threads, r->rank, r->mode);
+            fprintf(fo, " \"min_s\": %.9g, \"median_s\": %.9g, \"mean_s\": %.9g, \"stddev_s\": %.9g,", r->min, r->median, r->mean, r->stddev);
+            fprintf(fo, " \"flops\": %.9g, \"bytes\": %.9g, \"intensity\": %.6g, \"gflops\": %.6g, \"gbs\": %.6g,", r->flops, r->bytes, ai, gflops, gbs);
+            fprintf(fo, " \"attainable_gflops\": %.6g, \"roofline_fraction\": %.6g, \"bound\": \"%s\"}", attainable, fraction, bound);
+        }
+    }
+    if(!csv) {
+        fprintf(fo, nresults > 0 ? "\n  ]\n}\n" : "]\n}\n");
+    }
+}
+
+int main(int argc, char ** argv) {
+    bench_Tensor tensors[BENCH_MAX_TENSORS];
+    int ntensors = 0;
+    char * formats[BENCH_MAX_LIST], * kernels[BENCH_MAX_LIST], * variants[BENCH_MAX_LIST];
+    char default_formats[] = "coo", default_kernels[] = "mttkrp", default_variants[] = "seq,omp";
+    char * formats_arg = default_formats, * kernels_arg = default_kernels, * variants_arg = default_variants;
+    long threads[BENCH_MAX_LIST] = { 1 }, ranks[BENCH_MAX_LIST] = { 16 }, modes[BENCH_MAX_LIST];
+    int nthreads_list = 1, nranks = 1, nmodes_list = 0;
+    int warmup = 1, reps = 5;
+    sptElementIndex sb_bits = 7;
+    double peak_gflops = 0, peak_gbs = 0;
+    FILE * fo = stdout;
+    int csv = 0;
+    char const * baseline = NULL;
+    double tolerance = 0.25, slack = 2e-5;
+
+    int c;
+    for(;;) {
+        static struct option long_options[] = {
+            {"input", required_argument, 0, 'i'},
+            {"synthetic", required_argument, 0, 'g'},
+            {"formats", required_argument, 0, 'f'},
+            {"kernels", required_argument, 0, 'k'},
+            {"variants", required_argument, 0, 'v'},
+            {"threads", required_argument, 0, 't'},
+            {"ranks", required_argument, 0, 'r'},
+            {"modes", required_argument, 0, 'm'},
+            {"warmup", required_argument, 0, 'w'},
+            {"reps", required_argument, 0, 'n'},
+            {"blocksize", required_argument, 0, 'b'},
+            {"peak-gflops", required_argument, 0, 'P'},
+            {"peak-gbs", required_argument, 0, 'B'},
+            {"output", required_argument, 0, 'o'},
+            {"report", required_argument, 0, 'F'},
+            {"baseline", required_argument, 0, 'C'},
+            {"tolerance", required_argument, 0, 'T'},
+            {"slack", required_argument, 0, 'S'},
+            {"help", no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long(argc, argv, "i:g:f:k:v:t:r:m:w:n:b:P:B:o:F:C:T:S:h", long_options, &option_index);
+        if(c == -1) {
+            break;
+        }
+        switch(c) {
+        case 'i':
+        case 'g':
+            if(ntensors == BENCH_MAX_TENSORS) {
+                fprintf(stderr, "too many tensors\n");
+                exit(1);
+            }
+            if(c == 'i') {
+                FILE * fi = fopen(optarg, "r");
+                if(fi == NULL) {
+                    perror(optarg);
+                    exit(1);
+                }
+                sptAssert(sptLoadSparseTensor(&tensors[ntensors].X, 1, fi) == 0);
+                fclose(fi);
+            } else if(make_synthetic(&tensors[ntensors].X, optarg) != 0) {
+                fprintf(stderr, "bad synthetic tensor spec: %s\n", optarg);
+                exit(1);
+            }
+            tensors[ntensors++].name = strdup(optarg);
+            break;
+        case 'f':
+            formats_arg = optarg;
+            break;
+        case 'k':
+            kernels_arg = optarg;
+            break;
+        case 'v':
+            variants_arg = optarg;
+            break;
+        case 't':
+            nthreads_list = parse_int_list(optarg, threads, BENCH_MAX_LIST);
+            break;
+        case 'r':
+            nranks = parse_int_list(optarg, ranks, BENCH_MAX_LIST);
+            break;
+        case 'm':
+            nmodes_list = parse_int_list(optarg, modes, BENCH_MAX_LIST);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'n':
+            reps = atoi(optarg);
+            break;
+        case 'b':
+            sscanf(optarg, "%"PARTI_SCN_ELEMENT_INDEX, &sb_bits);
+            break;
+        case 'P':
+            peak_gflops = atof(optarg);
+            break;
+        case 'B':
+            peak_gbs = atof(optarg);
+            break;
+        case 'o':
+            fo = fopen(optarg, "w");
+            if(fo == NULL) {
+                perror(optarg);
+                exit(1);
+            }
+            break;
+        case 'F':
+            csv = strcmp(optarg, "csv") == 0;
+            break;
+        case 'C':
+            baseline = optarg;
+            break;
+        case 'T':
+            tolerance = atof(optarg);
+            break;
+        case 'S':
+            slack = atof(optarg);
+            break;
+        case 'h':
+        default:
+            print_usage(argv);
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(ntensors == 0 || reps < 1 || warmup < 0) {
+        print_usage(argv);
+        exit(1);
+    }
+    int const nformats = split_list(formats_arg, formats, BENCH_MAX_LIST);
+    int const nkernels = split_list(kernels_arg, kernels, BENCH_MAX_LIST);
+    int const nvariants = split_list(variants_arg, variants, BENCH_MAX_LIST);
+
+    /* The report is the output; keep the library's timing lines out of it */
+    sptSetTelemetryPrint(0);
+
+    int nresults = 0, cap = 64;
+    bench_Result * results = malloc(cap * sizeof *results);
+    double * times = malloc(reps * sizeof *times);
+    sptAssert(results != NULL && times != NULL);
+
+    for(int ti = 0; ti < ntensors; ++ti) {
+        sptSparseTensor * X = &tensors[ti].X;
+        sptIndex const nmodes = X->nmodes;
+        sptSparseTensorHiCOO hitsr;
+        int have_hicoo = 0;
+        if(has_word(formats, nformats, "hicoo")) {
+            sptSparseTensor copy;
+            sptNnzIndex max_nnzb;
+            sptAssert(sptCopySparseTensor(&copy, X, 1) == 0);
+            sptAssert(sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &copy, sb_bits, sb_bits, 1) == 0);
+            sptFreeSparseTensor(&copy);
+            have_hicoo = 1;
+        }
+
+        for(int ri = 0; ri < nranks; ++ri) {
+            sptIndex const R = (sptIndex) ranks[ri];
+            sptIndex max_ndims = 0;
+            sptMatrix ** U = malloc((nmodes + 1) * sizeof *U);
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                U[m] = malloc(sizeof *U[m]);
+                sptAssert(sptNewMatrix(U[m], X->ndims[m], R) == 0);
+                sptAssert(sptConstantMatrix(U[m], 1) == 0);
+                if(X->ndims[m] > max_ndims) {
+                    max_ndims = X->ndims[m];
+                }
+            }
+            U[nmodes] = malloc(sizeof *U[nmodes]);
+            sptAssert(sptNewMatrix(U[nmodes], max_ndims, R) == 0);
+
+            int const nm = nmodes_list > 0 ? nmodes_list : (int) nmodes;
+            for(int mi = 0; mi < nm; ++mi) {
+                sptIndex const mode = nmodes_list > 0 ? (sptIndex) modes[mi] : (sptIndex) mi;
+                if(mode >= nmodes) {
+                    continue;
+                }
+                sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+                for(sptIndex i = 0; i < nmodes; ++i) {
+                    mats_order[i] = (mode + i) % nmodes;
+                }
+                U[nmodes]->nrows = X->ndims[mode];
+
+                for(int hi = 0; hi < nthreads_list; ++hi) {
+                    int const nt = (int) threads[hi];
+#ifdef PARTI_USE_OPENMP
+                    omp_set_num_threads(nt);
+#endif
+                    for(int fi = 0; fi < nformats; ++fi)
+                    for(int ki = 0; ki < nkernels; ++ki)
+                    for(int vi = 0; vi < nvariants; ++vi) {
+                        bench_Kernel const run = lookup_kernel(formats[fi], kernels[ki], variants[vi]);
+                        int const hicoo = strcmp(formats[fi], "hicoo") == 0;
+                        int const is_sort = strcmp(kernels[ki], "sort") == 0;
+                        int const seq = strcmp(variants[vi], "seq") == 0;
+                        /* Sequential kernels and sorting do not vary with some axes */
+                        if(run == NULL || (hicoo && !have_hicoo) || (seq && hi > 0) ||
+                           (is_sort && (ri > 0 || mi > 0))) {
+                            continue;
+                        }
+
+                        bench_Args args = { X, have_hicoo ? &hitsr : NULL, U, NULL, NULL, mats_order, mode, nt };
+                        if(strcmp(variants[vi], "reduce") == 0) {
+                            args.copy_U = malloc(nt * sizeof *args.copy_U);
+                            for(int t = 0; t < nt; ++t) {
+                                args.copy_U[t] = malloc(sizeof *args.copy_U[t]);
+                                sptAssert(sptNewMatrix(args.copy_U[t], X->ndims[mode], R) == 0);
+                            }
+                        } else if(strcmp(variants[vi], "lock") == 0) {
+                            args.locks = sptMutexAlloc();
+                        }
+
+                        for(int it = 0; it < warmup; ++it) {
+                            sptAssert(run(&args) == 0);
+                        }
+                        sptTimer timer;
+                        sptNewTimer(&timer, 0);
+                        for(int it = 0; it < reps; ++it) {
+                            sptStartTimer(timer);
+                            sptAssert(run(&args) == 0);
+                            sptStopTimer(timer);
+                            times[it] = sptElapsedTime(timer);
+                        }
+                        sptFreeTimer(timer);
+
+                        if(nresults == cap) {
+                            cap *= 2;
+                            results = realloc(results, cap * sizeof *results);
+                            sptAssert(results != NULL);
+                        }
+                        bench_Result * res = &results[nresults++];
+                        res->tensor = tensors[ti].name;
+                        res->format = formats[fi];
+                        res->kernel = kernels[ki];
+                        res->variant = variants[vi];
+                        res->threads = seq ? 1 : nt;
+                        res->rank = is_sort ? 0 : R;
+                        res->mode = is_sort ? 0 : mode;
+                        summarize(res, times, reps);
+                        if(strcmp(kernels[ki], "mttkrp") == 0) {
+                            res->flops = spt_MTTKRPFlops(X, R);
+                            res->bytes = hicoo ? hicoo_mttkrp_bytes(&hitsr, R) : spt_MTTKRPBytes(X, R);
+                        } else if(strcmp(kernels[ki], "ttm") == 0) {
+                            /* As in the kernel's own probe, with one output row per nonzero at most */
+                            res->flops = 2.0 * X->nnz * R;
+                            res->bytes = spt_SparseTensorBytes(X) + 2.0 * X->nnz * R * sizeof (sptValue);
+                        } else {
+                            res->flops = 0;
+                            res->bytes = 2.0 * spt_SparseTensorBytes(X);
+                        }
+
+                        if(args.copy_U != NULL) {
+                            for(int t = 0; t < nt; ++t) {
+                                sptFreeMatrix(args.copy_U[t]);
+                                free(args.copy_U[t]);
+                            }
+                            free(args.copy_U);
+                        }
+                        if(args.locks != NULL) {
+                            sptMutexFree(args.locks);
+                        }
+                    }
+                }
+                free(mats_order);
+            }
+
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptFreeMatrix(U[m]);
+                free(U[m]);
+            }
+            free(U);
+        }
+        if(have_hicoo) {
+            sptFreeSparseTensorHiCOO(&hitsr);
+        }
+    }
+
+    write_report(fo, csv, results, nresults, warmup, reps, peak_gflops, peak_gbs);
+    if(fo != stdout) {
+        fclose(fo);
+    }
+
+    int status = 0;
+    if(baseline != NULL) {
+        int const regressions = compare_baseline(baseline, results, nresults, tolerance, slack);
+        if(regressions < 0) {
+            /* No usable baseline yet: this run becomes it */
+            FILE * fb = fopen(baseline, "w");
+            if(fb == NULL) {
+                perror(baseline);
+                exit(1);
+            }
+            write_report(fb, 1, results, nresults, warmup, reps, peak_gflops, peak_gbs);
+            fclose(fb);
+            fprintf(stderr, "baseline recorded in %s\n", baseline);
+            status = BENCH_EXIT_RECORDED;
+        } else if(regressions > 0) {
+            status = BENCH_EXIT_REGRESSION;
+        }
+    }
+
+    free(times);
+    free(results);
+    for(int ti = 0; ti < ntensors; ++ti) {
+        sptFreeSparseTensor(&tensors[ti].X);
+        free(tensors[ti].name);
+    }
+    return status;
+}
@@ -0,0 +1,51 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ParTI.h>
+
+int main(int argc, char *argv[]) {
+    FILE *fi, *fo;
+    sptSparseTensor tsr;
+
+    if(argc != 3 && argc != 5) {
+        printf("Usage: %s input.tns output.bin [INDEX_BYTES VALUE_BYTES]\n", argv[0]);
+        printf("       INDEX_BYTES 2, 4, 8 or 0 for the smallest that fits; VALUE_BYTES 4 or 8\n\n");
+        return 1;
+    }
+    uint32_t index_width = sizeof(sptIndex), value_width = sizeof(sptValue);
+    if(argc == 5) {
+        index_width = (uint32_t) atoi(argv[3]);
+        value_width = (uint32_t) atoi(argv[4]);
+    }
+
+    fi = fopen(argv[1], "r");
+    sptAssert(fi != NULL);
+    sptAssert(sptLoadSparseTensor(&tsr, 1, fi) == 0);
+    fclose(fi);
+
+    fo = fopen(argv[2], "wb");
+    sptAssert(fo != NULL);
+    sptAssert(sptDumpSparseTensorBinaryWidths(&tsr, fo, index_width, value_width) == 0);
+    fclose(fo);
+
+    sptFreeSparseTensor(&tsr);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <ParTI.h>
+
+void print_usage(char ** argv) {
+    printf("Usage: %s [options] \n\n", argv[0]);
+    printf("Options: -i INPUT, --input=INPUT (.tns file)\n");
+    printf("         -o OUTPUT, --output=OUTPUT (output file name)\n");
+    printf("         -d DEV_ID, --dev-id=DEV_ID (-2:sequential,default; -1:OpenMP parallel; >=0:CUDA)\n");
+    printf("         -r RANK (Tucker rank of every mode, 8:default)\n");
+    printf("         -n NITERS, --niters=NITERS (5:default)\n");
+    printf("         -t NTHREADS, --nt=NT (1:default)\n");
+    printf("         --help\n");
+    printf("\n");
+}
+
+
+int main(int argc, char ** argv) {
+    FILE *fi = NULL, *fo = NULL;
+    sptSparseTensor X;
+    sptIndex R = 8;
+    sptIndex niters = 5;
+    double tol = 1e-5;
+    sptTuckerTensor ttensor;
+    int dev_id = -2;
+    int nthreads = 1;
+
+    if(argc < 2) {
+        print_usage(argv);
+        exit(1);
+    }
+
+    int c;
+    for(;;) {
+        static struct option long_options[] = {
+            {"input", required_argument, 0, 'i'},
+            {"output", optional_argument, 0, 'o'},
+            {"dev-id", optional_argument, 0, 'd'},
+            {"rank", optional_argument, 0, 'r'},
+            {"niters", optional_argument, 0, 'n'},
+            {"nt", optional_argument, 0, 't'},
+            {"help", no_argument, 0, 0},
+            {0, 0, 0, 0}
+        };
+        int option_index = 0;
+        c = getopt_long(argc, argv, "i:o:d:r:n:t:", long_options, &option_index);
+        if(c == -1) {
+            break;
+        }
+        switch(c) {
+        case 'i':
+            fi = fopen(optarg, "r");
+            sptAssert(fi != NULL);
+            printf("input file: %s\n", optarg); fflush(stdout);
+            break;
+        case 'o':
+            fo = fopen(optarg, "w");
+            sptAssert(fo != NULL);
+            printf("output file: %s\n", optarg); fflush(stdout);
+            break;
+        case 'd':
+            sscanf(optarg, "%d", &dev_id);
+            break;
+        case 'r':
+            sscanf(optarg, "%"PARTI_SCN_INDEX, &R);
+            break;
+        case 'n':
+            sscanf(optarg, "%"PARTI_SCN_INDEX, &niters);
+            break;
+        case 't':
+            sscanf(optarg, "%d", &nthreads);
+            break;
+        case '?':   /* invalid option */
+        case 'h':
+        default:
+            print_usage(argv);
+            exit(1);
+        }
+    }
+
+    sptAssert(sptLoadSparseTensor(&X, 1, fi) == 0);
+    fclose(fi);
+    sptSparseTensorStatus(&X, stdout);
+
+    sptIndex nmodes = X.nmodes;
+    sptIndex * ranks = malloc(nmodes * sizeof *ranks);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ranks[m] = R < X.ndims[m] ? R : X.ndims[m];
+    }
+    sptAssert(sptNewTuckerTensor(&ttensor, nmodes, X.ndims, ranks) == 0);
+    printf("dev_id: %d\n", dev_id);
+    if(dev_id == -2) {
+        sptAssert(sptTuckerHooi(&X, niters, tol, &ttensor) == 0);
+    } else if(dev_id == -1) {
+        printf("nthreads: %d\n", nthreads);
+        sptAssert(sptOmpTuckerHooi(&X, niters, tol, nthreads, &ttensor) == 0);
+    }
+#ifdef PARTI_USE_CUDA
+    else {
+        sptCudaSetDevice(dev_id);
+        sptAssert(sptCudaTuckerHooi(&X, niters, tol, &ttensor) == 0);
+    }
+#endif
+
+    if(fo != NULL) {
+        sptAssert( sptDumpTuckerTensor(&ttensor, fo) == 0 );
+        fclose(fo);
+    }
+
+    sptFreeTuckerTensor(&ttensor);
+    free(ranks);
+    sptFreeSparseTensor(&X);
+
+    return 0;
+}
@@ -0,0 +1,563 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * CPython bindings of ParTI!, see setup.py.
+ *
+ * Tensors wrap the caller's index and value arrays through the buffer
+ * protocol, so NumPy arrays (or anything else exporting contiguous buffers
+ * of the right item type) reach the kernels without a copy, and factor
+ * matrices are exported the same way the other direction, as strided
+ * (nrows, rank) views over the library's padded rows. The GIL is released
+ * while the library computes.
+ *
+ *     import numpy, parti
+ *     X = parti.SparseTensor(shape, [i.astype(numpy.uint32) for i in subs], vals)
+ *     K = parti.cpd_als(X, 16, threads=8)
+ *     A = [numpy.asarray(f) for f in K.factors]
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <ParTI.h>
+#include <string.h>
+
+#define SPT_PY_DEFAULT_SB_BITS 7
+#define SPT_PY_DEFAULT_SK_BITS 20
+
+
+/* Whether a buffer format is an unsigned integer (kind 'u') or a float (kind 'f') of itemsize bytes */
+static int spt_PyFormatIs(char const * format, char const kind) {
+    if(format == NULL) {
+        format = "B";
+    }
+    if(*format == '@' || *format == '=' || *format == '<' || *format == '>' || *format == '!') {
+        ++ format;
+    }
+    if(format[0] == '\0' || format[1] != '\0') {
+        return 0;
+    }
+    return kind == 'u' ? strchr("BHILQN", format[0]) != NULL : strchr("fd", format[0]) != NULL;
+}
+
+/* Get a writable, contiguous, one-dimensional view of obj with items like one of what */
+static int spt_PyGetArray(PyObject * obj, Py_buffer * view, char const kind, Py_ssize_t const itemsize, char const * what) {
+    if(PyObject_GetBuffer(obj, view, PyBUF_ND | PyBUF_WRITABLE | PyBUF_FORMAT) != 0) {
+        return -1;
+    }
+    if(view->ndim != 1 || !PyBuffer_IsContiguous(view, 'C') || view->itemsize != itemsize || !spt_PyFormatIs(view->format, kind)) {
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous 1-D array of %zd-byte %s", what, itemsize,
+            kind == 'u' ? "unsigned integers" : "floats");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject * spt_PyLibraryError(char const * name, int const result) {
+    PyErr_Format(PyExc_RuntimeError, "%s failed with ParTI! error %d", name, result);
+    return NULL;
+}
+
+
+/*
+ * parti._View: a buffer over memory another object owns, a factor matrix or
+ * the weights of a Kruskal tensor
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject * owner;
+    void * data;
+    int ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} spt_PyView;
+
+static void spt_PyViewDealloc(spt_PyView * self) {
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int spt_PyViewGetBuffer(spt_PyView * self, Py_buffer * view, int flags) {
+    (void) flags;
+    view->buf = self->data;
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->len = self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1) * (Py_ssize_t) sizeof (sptValue);
+    view->readonly = 0;
+    view->itemsize = sizeof (sptValue);
+    view->format = sizeof (sptValue) == sizeof (double) ? "d" : "f";
+    view->ndim = self->ndim;
+    view->shape = self->shape;
+    view->strides = self->strides;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs spt_PyViewBuffer = {
+    (getbufferproc) spt_PyViewGetBuffer,
+    NULL,
+};
+
+static PyTypeObject spt_PyViewType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "parti._View",
+    .tp_basicsize = sizeof (spt_PyView),
+    .tp_dealloc = (destructor) spt_PyViewDealloc,
+    .tp_as_buffer = &spt_PyViewBuffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "A matrix or vector of ParTI! memory, for numpy.asarray",
+};
+
+static PyObject * spt_PyNewView(PyObject * owner, void * data, Py_ssize_t const nrows, Py_ssize_t const ncols, Py_ssize_t const stride) {
+    spt_PyView * view = PyObject_New(spt_PyView, &spt_PyViewType);
+    if(view == NULL) {
+        return NULL;
+    }
+    Py_INCREF(owner);
+    view->owner = owner;
+    view->data = data;
+    view->ndim = ncols < 0 ? 1 : 2;
+    view->shape[0] = nrows;
+    view->shape[1] = ncols;
+    view->strides[0] = (ncols < 0 ? 1 : stride) * (Py_ssize_t) sizeof (sptValue);
+    view->strides[1] = sizeof (sptValue);
+    return (PyObject *) view;
+}
+
+
+/*
+ * parti.SparseTensor: a COO tensor over the caller's arrays
+ */
+typedef struct {
+    PyObject_HEAD
+    sptSparseTensor tsr;
+    Py_buffer * views;  /// nmodes index arrays, then the values
+    sptIndex nviews;
+} spt_PySparseTensor;
+
+static void spt_PySparseTensorRelease(spt_PySparseTensor * self) {
+    if(self->views == NULL) {
+        return;
+    }
+    if(self->nviews == self->tsr.nmodes + 1) {
+        sptUnwrapSparseTensor(&self->tsr);
+    }
+    for(sptIndex i = 0; i < self->nviews; ++i) {
+        PyBuffer_Release(&self->views[i]);
+    }
+    PyMem_Free(self->views);
+    self->views = NULL;
+    self->nviews = 0;
+}
+
+static void spt_PySparseTensorDealloc(spt_PySparseTensor * self) {
+    spt_PySparseTensorRelease(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int spt_PySparseTensorInit(spt_PySparseTensor * self, PyObject * args, PyObject * kwds) {
+    static char * kwlist[] = { "shape", "inds", "values", NULL };
+    PyObject * shape, * inds, * values;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OOO", kwlist, &shape, &inds, &values)) {
+        return -1;
+    }
+    spt_PySparseTensorRelease(self);
+    shape = PySequence_Fast(shape, "shape must be a sequence");
+    if(shape == NULL) {
+        return -1;
+    }
+    inds = PySequence_Fast(inds, "inds must be a sequence of arrays");
+    if(inds == NULL) {
+        Py_DECREF(shape);
+        return -1;
+    }
+    Py_ssize_t const nmodes = PySequence_Fast_GET_SIZE(shape);
+    sptIndex * ndims = PyMem_Malloc((nmodes + 1) * sizeof *ndims);
+    sptIndex ** ind_data = PyMem_Malloc((nmodes + 1) * sizeof *ind_data);
+    self->views = PyMem_Calloc(nmodes + 1, sizeof *self->views);
+    int ok = ndims != NULL && ind_data != NULL && self->views != NULL;
+    if(!ok) {
+        PyErr_NoMemory();
+    } else if(nmodes < 1 || PySequence_Fast_GET_SIZE(inds) != nmodes) {
+        PyErr_SetString(PyExc_ValueError, "shape and inds must have one entry per mode");
+        ok = 0;
+    }
+    for(Py_ssize_t m = 0; ok && m < nmodes; ++m) {
+        unsigned long long const dim = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(shape, m));
+        if(PyErr_Occurred() || dim == 0 || dim > (sptIndex) -1) {
+            PyErr_Clear();
+            PyErr_SetString(PyExc_ValueError, "dimensions must be positive and fit sptIndex");
+            ok = 0;
+            break;
+        }
+        ndims[m] = (sptIndex) dim;
+        ok = spt_PyGetArray(PySequence_Fast_GET_ITEM(inds, m), &self->views[m], 'u', sizeof (sptIndex), "inds[m]") == 0;
+        self->nviews += ok;
+        if(ok) {
+            ind_data[m] = self->views[m].buf;
+        }
+    }
+    if(ok) {
+        ok = spt_PyGetArray(values, &self->views[nmodes], 'f', sizeof (sptValue), "values") == 0;
+        self->nviews += ok;
+    }
+    Py_ssize_t const nnz = ok ? self->views[nmodes].shape[0] : 0;
+    for(Py_ssize_t m = 0; ok && m < nmodes; ++m) {
+        if(self->views[m].shape[0] != nnz) {
+            PyErr_SetString(PyExc_ValueError, "inds and values must have the same length");
+            ok = 0;
+        }
+    }
+    if(ok) {
+        int const result = sptWrapSparseTensor(&self->tsr, (sptIndex) nmodes, ndims, (sptNnzIndex) nnz, ind_data, self->views[nmodes].buf);
+        if(result != 0) {
+            PyErr_SetString(PyExc_ValueError, "indices out of the shape");
+            ok = 0;
+        }
+    }
+    Py_DECREF(shape);
+    Py_DECREF(inds);
+    PyMem_Free(ndims);
+    PyMem_Free(ind_data);
+    if(!ok) {
+        /* Release the views without unwrapping a tensor never made */
+        for(sptIndex i = 0; self->views != NULL && i <= (sptIndex) nmodes; ++i) {
+            if(self->views[i].obj != NULL) {
+                PyBuffer_Release(&self->views[i]);
+            }
+        }
+        PyMem_Free(self->views);
+        self->views = NULL;
+        self->nviews = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject * spt_PySparseTensorShape(spt_PySparseTensor * self, void * closure) {
+    (void) closure;
+    PyObject * shape = PyTuple_New(self->views != NULL ? self->tsr.nmodes : 0);
+    for(sptIndex m = 0; shape != NULL && self->views != NULL && m < self->tsr.nmodes; ++m) {
+        PyTuple_SET_ITEM(shape, m, PyLong_FromUnsignedLongLong(self->tsr.ndims[m]));
+    }
+    return shape;
+}
+
+static PyObject * spt_PySparseTensorNnz(spt_PySparseTensor * self, void * closure) {
+    (void) closure;
+    return PyLong_FromUnsignedLongLong(self->views != NULL ? self->tsr.nnz : 0);
+}
+
+static PyGetSetDef spt_PySparseTensorGetSet[] = {
+    { "shape", (getter) spt_PySparseTensorShape, NULL, "dimensions of the modes", NULL },
+    { "nnz", (getter) spt_PySparseTensorNnz, NULL, "number of nonzeros", NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject spt_PySparseTensorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "parti.SparseTensor",
+    .tp_basicsize = sizeof (spt_PySparseTensor),
+    .tp_dealloc = (destructor) spt_PySparseTensorDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "SparseTensor(shape, inds, values)\n\n"
+        "A COO sparse tensor over writable contiguous arrays without copying them:\n"
+        "one array of zero-based unsigned indices per mode, of the library's index\n"
+        "width, and one of values. Kernels that sort the tensor reorder the arrays\n"
+        "in place; the tensor keeps them alive.",
+    .tp_getset = spt_PySparseTensorGetSet,
+    .tp_init = (initproc) spt_PySparseTensorInit,
+    .tp_new = PyType_GenericNew,
+};
+
+static spt_PySparseTensor * spt_PyCheckTensor(PyObject * obj) {
+    if(!PyObject_TypeCheck(obj, &spt_PySparseTensorType) || ((spt_PySparseTensor *) obj)->views == NULL) {
+        PyErr_SetString(PyExc_TypeError, "expected an initialized parti.SparseTensor");
+        return NULL;
+    }
+    return (spt_PySparseTensor *) obj;
+}
+
+
+/*
+ * parti.KruskalTensor: the result of a CP decomposition, owning its factors
+ */
+typedef struct {
+    PyObject_HEAD
+    int has_rank_factors;       /// whether it holds sptRankKruskalTensor, from HiCOO
+    sptKruskalTensor ktsr;
+    sptRankKruskalTensor rktsr;
+} spt_PyKruskalTensor;
+
+static void spt_PyKruskalTensorDealloc(spt_PyKruskalTensor * self) {
+    if(self->has_rank_factors) {
+        if(self->rktsr.ndims != NULL) {
+            sptFreeRankKruskalTensor(&self->rktsr);
+        }
+    } else if(self->ktsr.ndims != NULL) {
+        sptFreeKruskalTensor(&self->ktsr);
+    }
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject * spt_PyKruskalTensorFactors(spt_PyKruskalTensor * self, void * closure) {
+    (void) closure;
+    sptIndex const nmodes = self->has_rank_factors ? self->rktsr.nmodes : self->ktsr.nmodes;
+    int const ready = self->has_rank_factors ? self->rktsr.factors != NULL : self->ktsr.factors != NULL;
+    PyObject * factors = PyTuple_New(ready ? nmodes : 0);
+    for(sptIndex m = 0; factors != NULL && ready && m < nmodes; ++m) {
+        PyObject * view;
+        if(self->has_rank_factors) {
+            sptRankMatrix const * A = self->rktsr.factors[m];
+            view = spt_PyNewView((PyObject *) self, A->values, A->nrows, A->ncols, A->stride);
+        } else {
+            sptMatrix const * A = self->ktsr.factors[m];
+            view = spt_PyNewView((PyObject *) self, A->values, A->nrows, A->ncols, A->stride);
+        }
+        if(view == NULL) {
+            Py_DECREF(factors);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(factors, m, view);
+    }
+    return factors;
+}
+
+static PyObject * spt_PyKruskalTensorWeights(spt_PyKruskalTensor * self, void * closure) {
+    (void) closure;
+    if(self->has_rank_factors) {
+        return spt_PyNewView((PyObject *) self, self->rktsr.lambda, self->rktsr.rank, -1, 1);
+    }
+    return spt_PyNewView((PyObject *) self, self->ktsr.lambda, self->ktsr.rank, -1, 1);
+}
+
+static PyObject * spt_PyKruskalTensorFit(spt_PyKruskalTensor * self, void * closure) {
+    (void) closure;
+    return PyFloat_FromDouble(self->has_rank_factors ? self->rktsr.fit : self->ktsr.fit);
+}
+
+static PyGetSetDef spt_PyKruskalTensorGetSet[] = {
+    { "factors", (getter) spt_PyKruskalTensorFactors, NULL, "(nrows, rank) views of the factor matrices", NULL },
+    { "weights", (getter) spt_PyKruskalTensorWeights, NULL, "view of the column weights, lambda", NULL },
+    { "fit", (getter) spt_PyKruskalTensorFit, NULL, "fit to the decomposed tensor", NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject spt_PyKruskalTensorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "parti.KruskalTensor",
+    .tp_basicsize = sizeof (spt_PyKruskalTensor),
+    .tp_dealloc = (destructor) spt_PyKruskalTensorDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "A CP decomposition from parti.cpd_als and friends. Its factors and\n"
+        "weights are views of the library's memory; numpy.asarray takes them\n"
+        "without copying, and writing to them changes a warm start.",
+    .tp_getset = spt_PyKruskalTensorGetSet,
+};
+
+static spt_PyKruskalTensor * spt_PyNewKruskalTensor(void) {
+    spt_PyKruskalTensor * self = PyObject_New(spt_PyKruskalTensor, &spt_PyKruskalTensorType);
+    if(self != NULL) {
+        self->has_rank_factors = 0;
+        memset(&self->ktsr, 0, sizeof self->ktsr);
+        memset(&self->rktsr, 0, sizeof self->rktsr);
+    }
+    return self;
+}
+
+
+/*
+ * Decompositions
+ */
+
+static PyObject * spt_PyCpdAls(PyObject * module, PyObject * args, PyObject * kwds) {
+    static char * kwlist[] = { "tensor", "rank", "niters", "tol", "threads", "use_reduce", "init", NULL };
+    PyObject * tensor_obj, * init = Py_None;
+    unsigned int rank, niters = 50;
+    double tol = 1e-5;
+    int threads = 0, use_reduce = 0;
+    (void) module;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OI|IdipO", kwlist, &tensor_obj, &rank, &niters, &tol, &threads, &use_reduce, &init)) {
+        return NULL;
+    }
+    spt_PySparseTensor * X = spt_PyCheckTensor(tensor_obj);
+    if(X == NULL) {
+        return NULL;
+    }
+    spt_PyKruskalTensor * K;
+    if(init != Py_None) {
+        if(!PyObject_TypeCheck(init, &spt_PyKruskalTensorType) || ((spt_PyKruskalTensor *) init)->has_rank_factors ||
+            ((spt_PyKruskalTensor *) init)->ktsr.nmodes != X->tsr.nmodes || ((spt_PyKruskalTensor *) init)->ktsr.rank != rank) {
+            PyErr_SetString(PyExc_ValueError, "init must be a KruskalTensor of cpd_als with the tensor's order and rank");
+            return NULL;
+        }
+        K = (spt_PyKruskalTensor *) init;
+        Py_INCREF(K);
+    } else {
+        K = spt_PyNewKruskalTensor();
+        if(K == NULL || sptNewKruskalTensor(&K->ktsr, X->tsr.nmodes, X->tsr.ndims, rank) != 0) {
+            Py_XDECREF(K);
+            return PyErr_NoMemory();
+        }
+    }
+    Py_INCREF(X);
+    int const tk = threads > 0 ? threads : sptExecThreads(0);
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = sptOmpCpdAls(&X->tsr, rank, niters, tol, tk, use_reduce, &K->ktsr);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(X);
+    if(result != 0) {
+        Py_DECREF(K);
+        return spt_PyLibraryError("sptOmpCpdAls", result);
+    }
+    return (PyObject *) K;
+}
+
+static PyObject * spt_PyCpdAlsHiCOO(PyObject * module, PyObject * args, PyObject * kwds) {
+    static char * kwlist[] = { "tensor", "rank", "niters", "tol", "threads", "sb_bits", "sk_bits", NULL };
+    PyObject * tensor_obj;
+    unsigned int rank, niters = 50;
+    double tol = 1e-5;
+    int threads = 0;
+    unsigned char sb_bits = SPT_PY_DEFAULT_SB_BITS, sk_bits = SPT_PY_DEFAULT_SK_BITS;
+    (void) module;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OI|IdibB", kwlist, &tensor_obj, &rank, &niters, &tol, &threads, &sb_bits, &sk_bits)) {
+        return NULL;
+    }
+    spt_PySparseTensor * X = spt_PyCheckTensor(tensor_obj);
+    if(X == NULL) {
+        return NULL;
+    }
+    if(rank == 0 || rank > (sptElementIndex) -1 || sb_bits > sk_bits) {
+        PyErr_SetString(PyExc_ValueError, "HiCOO needs 0 < rank < 256 and sb_bits <= sk_bits");
+        return NULL;
+    }
+    spt_PyKruskalTensor * K = spt_PyNewKruskalTensor();
+    if(K == NULL) {
+        return NULL;
+    }
+    K->has_rank_factors = 1;
+    Py_INCREF(X);
+    int const tk = threads > 0 ? threads : sptExecThreads(0);
+    int result;
+    char const * failed = "sptSparseTensorToHiCOO";
+    Py_BEGIN_ALLOW_THREADS
+    sptSparseTensorHiCOO hitsr;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X->tsr, sb_bits, sk_bits, tk);
+    if(result == 0) {
+        result = sptNewRankKruskalTensor(&K->rktsr, X->tsr.nmodes, X->tsr.ndims, (sptElementIndex) rank);
+        if(result == 0) {
+            failed = "sptOmpCpdAlsHiCOO";
+            result = sptOmpCpdAlsHiCOO(&hitsr, rank, niters, tol, tk, &K->rktsr);
+        }
+        sptFreeSparseTensorHiCOO(&hitsr);
+    }
+    Py_END_ALLOW_THREADS
+    Py_DECREF(X);
+    if(result != 0) {
+        Py_DECREF(K);
+        return spt_PyLibraryError(failed, result);
+    }
+    return (PyObject *) K;
+}
+
+static PyObject * spt_PyCpdAlsCuda(PyObject * module, PyObject * args, PyObject * kwds) {
+    static char * kwlist[] = { "tensor", "rank", "niters", "tol", NULL };
+    PyObject * tensor_obj;
+    unsigned int rank, niters = 50;
+    double tol = 1e-5;
+    (void) module;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OI|Id", kwlist, &tensor_obj, &rank, &niters, &tol)) {
+        return NULL;
+    }
+    spt_PySparseTensor * X = spt_PyCheckTensor(tensor_obj);
+    if(X == NULL) {
+        return NULL;
+    }
+#ifdef PARTI_USE_CUDA
+    spt_PyKruskalTensor * K = spt_PyNewKruskalTensor();
+    if(K == NULL || sptNewKruskalTensor(&K->ktsr, X->tsr.nmodes, X->tsr.ndims, rank) != 0) {
+        Py_XDECREF(K);
+        return PyErr_NoMemory();
+    }
+    Py_INCREF(X);
+    int result;
+    Py_BEGIN_ALLOW_THREADS
+    result = sptCudaCpdAls(&X->tsr, rank, niters, tol, &K->ktsr);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(X);
+    if(result != 0) {
+        Py_DECREF(K);
+        return spt_PyLibraryError("sptCudaCpdAls", result);
+    }
+    return (PyObject *) K;
+#else
+    (void) rank;
+    PyErr_SetString(PyExc_NotImplementedError, "the bindings were built without CUDA, see setup.py");
+    return NULL;
+#endif
+}
+
+static PyMethodDef spt_PyMethods[] = {
+    { "cpd_als", (PyCFunction) (void (*)(void)) spt_PyCpdAls, METH_VARARGS | METH_KEYWORDS,
+        "cpd_als(tensor, rank, niters=50, tol=1e-5, threads=0, use_reduce=False, init=None)\n\n"
+        "OpenMP CP-ALS of a SparseTensor, sptOmpCpdAls. threads=0 uses all; init, a\n"
+        "KruskalTensor of an earlier call, is the initial guess and is updated." },
+    { "cpd_als_hicoo", (PyCFunction) (void (*)(void)) spt_PyCpdAlsHiCOO, METH_VARARGS | METH_KEYWORDS,
+        "cpd_als_hicoo(tensor, rank, niters=50, tol=1e-5, threads=0, sb_bits=7, sk_bits=20)\n\n"
+        "OpenMP CP-ALS in HiCOO, sptOmpCpdAlsHiCOO, after converting the tensor,\n"
+        "which sorts its arrays in place. rank must be below 256." },
+    { "cpd_als_cuda", (PyCFunction) (void (*)(void)) spt_PyCpdAlsCuda, METH_VARARGS | METH_KEYWORDS,
+        "cpd_als_cuda(tensor, rank, niters=50, tol=1e-5)\n\n"
+        "CP-ALS on the current CUDA device, sptCudaCpdAls." },
+    { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef spt_PyModule = {
+    PyModuleDef_HEAD_INIT,
+    "parti",
+    "Zero-copy bindings of the ParTI! sparse tensor library",
+    -1,
+    spt_PyMethods,
+    NULL, NULL, NULL, NULL,
+};
+
+PyMODINIT_FUNC PyInit_parti(void) {
+    if(PyType_Ready(&spt_PyViewType) < 0 || PyType_Ready(&spt_PySparseTensorType) < 0 ||
+        PyType_Ready(&spt_PyKruskalTensorType) < 0) {
+        return NULL;
+    }
+    PyObject * module = PyModule_Create(&spt_PyModule);
+    if(module == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&spt_PySparseTensorType);
+    Py_INCREF(&spt_PyKruskalTensorType);
+    if(PyModule_AddObject(module, "SparseTensor", (PyObject *) &spt_PySparseTensorType) < 0 ||
+        PyModule_AddObject(module, "KruskalTensor", (PyObject *) &spt_PyKruskalTensorType) < 0 ||
+        PyModule_AddIntConstant(module, "INDEX_BYTES", sizeof (sptIndex)) < 0 ||
+        PyModule_AddIntConstant(module, "VALUE_BYTES", sizeof (sptValue)) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+
+# This file is part of ParTI!.
+#
+# ParTI! is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation, either version 3 of
+# the License, or (at your option) any later version.
+#
+# ParTI! is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with ParTI!.
+# If not, see <http://www.gnu.org/licenses/>.
+
+# Build the `parti` extension against a shared ParTI! build:
+#
+#     PARTI_BUILD_DIR=../../build python3 setup.py build_ext --inplace
+#
+# The type widths and CUDA must match the library's CMake configuration;
+# set PARTI_INDEX_TYPEWIDTH, PARTI_VALUE_TYPEWIDTH and PARTI_USE_CUDA=1
+# when they differ from the defaults.
+
+import os
+from setuptools import setup, Extension
+
+here = os.path.dirname(os.path.abspath(__file__))
+build_dir = os.path.abspath(os.environ.get('PARTI_BUILD_DIR', os.path.join(here, '..', '..', 'build')))
+
+macros = [
+    ('_GNU_SOURCE', None),
+    ('PARTI_USE_OPENMP', None),
+    ('PARTI_INDEX_TYPEWIDTH', os.environ.get('PARTI_INDEX_TYPEWIDTH', '32')),
+    ('PARTI_VALUE_TYPEWIDTH', os.environ.get('PARTI_VALUE_TYPEWIDTH', '64')),
+]
+if os.environ.get('PARTI_USE_CUDA', '0') == '1':
+    macros.append(('PARTI_USE_CUDA', None))
+
+parti = Extension(
+    'parti',
+    sources=[os.path.join(here, 'partimodule.c')],
+    include_dirs=[os.path.join(here, '..', '..', 'include')],
+    define_macros=macros,
+    library_dirs=[build_dir],
+    runtime_library_dirs=[build_dir],
+    libraries=['ParTI'],
+    extra_compile_args=['-fopenmp'],
+    extra_link_args=['-fopenmp'],
+)
+
+setup(
+    name='parti',
+    version='1.0.0',
+    description='Zero-copy Python bindings of the ParTI! sparse tensor library',
+    ext_modules=[parti],
+)
@@ -40,12 +40,13 @@ extern "C" {
 /*************************************************
  * TYPES
  *************************************************/
-#ifdef PARTI_INDEX_TYPEWIDTH
-    #undef PARTI_INDEX_TYPEWIDTH
+/* Widths in bits, set by the build (PARTI_INDEX_TYPEWIDTH and
+ * PARTI_VALUE_TYPEWIDTH in CMake); code using the library must be compiled
+ * with the same values. */
+#ifndef PARTI_INDEX_TYPEWIDTH
     #define PARTI_INDEX_TYPEWIDTH 32
 #endif
-#ifdef PARTI_VALUE_TYPEWIDTH
-    #undef PARTI_VALUE_TYPEWIDTH
+#ifndef PARTI_VALUE_TYPEWIDTH
     #define PARTI_VALUE_TYPEWIDTH 64
 #endif
 
@@ -81,6 +82,8 @@ extern "C" {
 #include "includes/sptensors.h"
 /* Semi-sparse tensor functions */
 #include "includes/ssptensors.h"
+/* Dense tensor functions */
+#include "includes/dtensors.h"
 /* Kruskal tensor functions */
 #include "includes/ktensors.h"
 /* CPD functions */
@@ -0,0 +1,635 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_HPP
+#define PARTI_HPP
+
+/*
+ * Header-only C++17 layer over the C interface.
+ *
+ * Owners, such as parti::SparseTensor, hold one C structure each, free it
+ * when destroyed and can be moved but not copied; deep copies are explicit,
+ * with clone(). Views, parti::Span and the *View classes, point into an
+ * owner's arrays without owning them and are valid while it lives and is
+ * not resized or sorted. get() hands the C structure to the C functions.
+ * A failing C call throws parti::Error with its error code.
+ */
+
+#include <ParTI.h>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace parti {
+
+/// A failed C call
+class Error : public std::runtime_error {
+public:
+    Error(int code, std::string const & what) :
+        std::runtime_error(what + " failed with error " + std::to_string(code)), code_(code) {}
+    int code() const noexcept { return code_; }
+private:
+    int code_;
+};
+
+inline void check(int result, char const * what) {
+    if(result != 0) {
+        throw Error(result, what);
+    }
+}
+
+/// A non-owning view of n contiguous elements
+template <typename T>
+class Span {
+public:
+    Span() noexcept : data_(nullptr), size_(0) {}
+    Span(T * data, std::size_t size) noexcept : data_(data), size_(size) {}
+    T * data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    T & operator[](std::size_t i) const noexcept { return data_[i]; }
+    T * begin() const noexcept { return data_; }
+    T * end() const noexcept { return data_ + size_; }
+    Span subspan(std::size_t offset, std::size_t count) const noexcept { return Span(data_ + offset, count); }
+private:
+    T * data_;
+    std::size_t size_;
+};
+
+/// A non-owning view of a dense matrix, row major with a padded stride
+template <typename Mtx>
+class BasicMatrixView {
+public:
+    using value_type = std::conditional_t<std::is_const_v<Mtx>, sptValue const, sptValue>;
+    explicit BasicMatrixView(Mtx * mtx) noexcept : mtx_(mtx) {}
+    sptIndex nrows() const noexcept { return mtx_->nrows; }
+    sptIndex ncols() const noexcept { return mtx_->ncols; }
+    sptIndex stride() const noexcept { return mtx_->stride; }
+    Span<value_type> row(sptIndex i) const noexcept { return Span<value_type>(mtx_->values + (std::size_t) i * mtx_->stride, mtx_->ncols); }
+    value_type & operator()(sptIndex i, sptIndex j) const noexcept { return mtx_->values[(std::size_t) i * mtx_->stride + j]; }
+    /// All rows, padding included
+    Span<value_type> values() const noexcept { return Span<value_type>(mtx_->values, (std::size_t) mtx_->nrows * mtx_->stride); }
+    Mtx * get() const noexcept { return mtx_; }
+private:
+    Mtx * mtx_;
+};
+using MatrixView = BasicMatrixView<sptMatrix>;
+using ConstMatrixView = BasicMatrixView<sptMatrix const>;
+
+/// A non-owning view of the nonzeros begin to end of a COO tensor
+class SparseTensorView {
+public:
+    SparseTensorView(sptSparseTensor const * tsr, sptNnzIndex begin, sptNnzIndex end) noexcept :
+        tsr_(tsr), begin_(begin), end_(end) {}
+    sptIndex nmodes() const noexcept { return tsr_->nmodes; }
+    Span<sptIndex const> ndims() const noexcept { return Span<sptIndex const>(tsr_->ndims, tsr_->nmodes); }
+    sptNnzIndex nnz() const noexcept { return end_ - begin_; }
+    /// Position of the first nonzero in the viewed tensor
+    sptNnzIndex offset() const noexcept { return begin_; }
+    Span<sptIndex> inds(sptIndex mode) const noexcept { return Span<sptIndex>(tsr_->inds[mode].data + begin_, end_ - begin_); }
+    Span<sptValue> values() const noexcept { return Span<sptValue>(tsr_->values.data + begin_, end_ - begin_); }
+private:
+    sptSparseTensor const * tsr_;
+    sptNnzIndex begin_;
+    sptNnzIndex end_;
+};
+
+/// A COO tensor over arrays it does not own, such as a view, for the C functions
+class WrappedSparseTensor {
+public:
+    explicit WrappedSparseTensor(SparseTensorView const & view) {
+        std::vector<sptIndex *> inds(view.nmodes());
+        for(sptIndex m = 0; m < view.nmodes(); ++m) {
+            inds[m] = view.inds(m).data();
+        }
+        check(sptWrapSparseTensor(&tsr_, view.nmodes(), view.ndims().data(), view.nnz(), inds.data(), view.values().data()),
+            "sptWrapSparseTensor");
+        live_ = true;
+    }
+    WrappedSparseTensor(WrappedSparseTensor && other) noexcept : tsr_(other.tsr_), live_(std::exchange(other.live_, false)) {}
+    WrappedSparseTensor & operator=(WrappedSparseTensor && other) noexcept {
+        if(this != &other) {
+            reset();
+            tsr_ = other.tsr_;
+            live_ = std::exchange(other.live_, false);
+        }
+        return *this;
+    }
+    WrappedSparseTensor(WrappedSparseTensor const &) = delete;
+    WrappedSparseTensor & operator=(WrappedSparseTensor const &) = delete;
+    ~WrappedSparseTensor() { reset(); }
+    sptSparseTensor * get() noexcept { return &tsr_; }
+    sptSparseTensor const * get() const noexcept { return &tsr_; }
+private:
+    void reset() noexcept {
+        if(live_) {
+            sptUnwrapSparseTensor(&tsr_);
+            live_ = false;
+        }
+    }
+    sptSparseTensor tsr_;
+    bool live_ = false;
+};
+
+/*
+ * The owners below share one shape: a C structure, whether it holds
+ * anything, move operations that leave the source empty, and a destructor
+ * calling the C free function.
+ */
+#define PARTI_HPP_MOVE_ONLY(Class, CType, free_fn)                              \
+public:                                                                         \
+    Class(Class && other) noexcept : obj_(other.obj_), live_(std::exchange(other.live_, false)) {} \
+    Class & operator=(Class && other) noexcept {                                \
+        if(this != &other) {                                                    \
+            reset();                                                            \
+            obj_ = other.obj_;                                                  \
+            live_ = std::exchange(other.live_, false);                          \
+        }                                                                       \
+        return *this;                                                           \
+    }                                                                           \
+    Class(Class const &) = delete;                                              \
+    Class & operator=(Class const &) = delete;                                  \
+    ~Class() { reset(); }                                                       \
+    CType * get() noexcept { return &obj_; }                                    \
+    CType const * get() const noexcept { return &obj_; }                        \
+    explicit operator bool() const noexcept { return live_; }                   \
+    void reset() noexcept {                                                     \
+        if(live_) {                                                             \
+            free_fn(&obj_);                                                     \
+            live_ = false;                                                      \
+        }                                                                       \
+    }                                                                           \
+private:                                                                        \
+    CType obj_;                                                                 \
+    bool live_ = false;                                                         \
+    struct adopt_t {};                                                          \
+    Class(adopt_t) noexcept {}                                                  \
+    void adopted() noexcept { live_ = true; }                                   \
+public:
+
+namespace expr {
+template <typename E> struct is_node : std::false_type {};
+}
+
+/// Owner of a COO sparse tensor
+class SparseTensor {
+    PARTI_HPP_MOVE_ONLY(SparseTensor, sptSparseTensor, sptFreeSparseTensor)
+
+    SparseTensor() noexcept {}
+    SparseTensor(sptIndex nmodes, sptIndex const ndims[]) {
+        check(sptNewSparseTensor(&obj_, nmodes, ndims), "sptNewSparseTensor");
+        adopted();
+    }
+    explicit SparseTensor(std::vector<sptIndex> const & ndims) : SparseTensor((sptIndex) ndims.size(), ndims.data()) {}
+    /// Evaluate a lazy element-wise expression in one pass, see parti::expr
+    template <typename E, typename = std::enable_if_t<expr::is_node<E>::value>>
+    SparseTensor(E const & e);
+
+    static SparseTensor load(FILE * fp, sptIndex start_index) {
+        SparseTensor tsr{adopt_t{}};
+        check(sptLoadSparseTensor(&tsr.obj_, start_index, fp), "sptLoadSparseTensor");
+        tsr.adopted();
+        return tsr;
+    }
+    /// A deep copy, with tk threads or the default count
+    SparseTensor clone(int tk = 0) const {
+        SparseTensor tsr{adopt_t{}};
+        check(sptCopySparseTensor(&tsr.obj_, &obj_, tk > 0 ? tk : sptExecThreads(0)), "sptCopySparseTensor");
+        tsr.adopted();
+        return tsr;
+    }
+
+    sptIndex nmodes() const noexcept { return obj_.nmodes; }
+    Span<sptIndex const> ndims() const noexcept { return Span<sptIndex const>(obj_.ndims, obj_.nmodes); }
+    sptNnzIndex nnz() const noexcept { return obj_.nnz; }
+    Span<sptIndex> inds(sptIndex mode) noexcept { return Span<sptIndex>(obj_.inds[mode].data, obj_.nnz); }
+    Span<sptIndex const> inds(sptIndex mode) const noexcept { return Span<sptIndex const>(obj_.inds[mode].data, obj_.nnz); }
+    Span<sptValue> values() noexcept { return Span<sptValue>(obj_.values.data, obj_.nnz); }
+    Span<sptValue const> values() const noexcept { return Span<sptValue const>(obj_.values.data, obj_.nnz); }
+
+    /// Nonzeros begin to end, in storage order
+    SparseTensorView view(sptNnzIndex begin, sptNnzIndex end) const noexcept { return SparseTensorView(&obj_, begin, end); }
+    SparseTensorView view() const noexcept { return view(0, obj_.nnz); }
+    /**
+     * The nonzeros whose index in mode lies in [low, high), for a tensor
+     * sorted with mode first, such as by sptSparseTensorSortIndexCustomOrder
+     */
+    SparseTensorView slice(sptIndex mode, sptIndex low, sptIndex high) const {
+        if(obj_.nmodes == 0 || obj_.sortorder[0] != mode) {
+            throw Error(SPTERR_VALUE_ERROR, "SparseTensor::slice on a tensor not sorted by the mode");
+        }
+        sptIndex const * ind = obj_.inds[mode].data;
+        sptNnzIndex const begin = std::lower_bound(ind, ind + obj_.nnz, low) - ind;
+        sptNnzIndex const end = std::lower_bound(ind + begin, ind + obj_.nnz, high) - ind;
+        return view(begin, end);
+    }
+    SparseTensorView slice(sptIndex mode, sptIndex index) const { return slice(mode, index, index + 1); }
+};
+
+/// Owner of a HiCOO sparse tensor
+class SparseTensorHiCOO {
+    PARTI_HPP_MOVE_ONLY(SparseTensorHiCOO, sptSparseTensorHiCOO, sptFreeSparseTensorHiCOO)
+
+    SparseTensorHiCOO() noexcept {}
+    /// Convert tsr, which is sorted in place, with tk threads or the default count
+    static SparseTensorHiCOO from(SparseTensor & tsr, sptElementIndex sb_bits, sptElementIndex sk_bits, int tk = 0) {
+        SparseTensorHiCOO hitsr{adopt_t{}};
+        sptNnzIndex max_nnzb = 0;
+        check(sptSparseTensorToHiCOO(&hitsr.obj_, &max_nnzb, tsr.get(), sb_bits, sk_bits, tk > 0 ? tk : sptExecThreads(0)),
+            "sptSparseTensorToHiCOO");
+        hitsr.adopted();
+        return hitsr;
+    }
+    SparseTensorHiCOO clone() const {
+        SparseTensorHiCOO hitsr{adopt_t{}};
+        check(sptCopySparseTensorHiCOO(&hitsr.obj_, &obj_), "sptCopySparseTensorHiCOO");
+        hitsr.adopted();
+        return hitsr;
+    }
+
+    sptIndex nmodes() const noexcept { return obj_.nmodes; }
+    Span<sptIndex const> ndims() const noexcept { return Span<sptIndex const>(obj_.ndims, obj_.nmodes); }
+    sptNnzIndex nnz() const noexcept { return obj_.nnz; }
+    Span<sptValue> values() noexcept { return Span<sptValue>(obj_.values.data, obj_.nnz); }
+    Span<sptValue const> values() const noexcept { return Span<sptValue const>(obj_.values.data, obj_.nnz); }
+};
+
+/// Owner of a dense matrix
+class Matrix {
+    PARTI_HPP_MOVE_ONLY(Matrix, sptMatrix, sptFreeMatrix)
+
+    Matrix() noexcept {}
+    Matrix(sptIndex nrows, sptIndex ncols) {
+        check(sptNewMatrix(&obj_, nrows, ncols), "sptNewMatrix");
+        adopted();
+    }
+    Matrix clone() const {
+        Matrix mtx{adopt_t{}};
+        check(sptCopyMatrix(&mtx.obj_, &obj_), "sptCopyMatrix");
+        mtx.adopted();
+        return mtx;
+    }
+
+    MatrixView view() noexcept { return MatrixView(&obj_); }
+    ConstMatrixView view() const noexcept { return ConstMatrixView(&obj_); }
+    sptIndex nrows() const noexcept { return obj_.nrows; }
+    sptIndex ncols() const noexcept { return obj_.ncols; }
+    sptValue & operator()(sptIndex i, sptIndex j) noexcept { return view()(i, j); }
+    sptValue operator()(sptIndex i, sptIndex j) const noexcept { return view()(i, j); }
+};
+
+/// Owner of a Kruskal tensor, the result of a CP decomposition
+class KruskalTensor {
+    PARTI_HPP_MOVE_ONLY(KruskalTensor, sptKruskalTensor, sptFreeKruskalTensor)
+
+    KruskalTensor() noexcept {}
+    /// Factors are left to the decomposition, which fills them
+    KruskalTensor(sptIndex nmodes, sptIndex const ndims[], sptIndex rank) {
+        check(sptNewKruskalTensor(&obj_, nmodes, ndims, rank), "sptNewKruskalTensor");
+        adopted();
+    }
+    KruskalTensor(std::vector<sptIndex> const & ndims, sptIndex rank) : KruskalTensor((sptIndex) ndims.size(), ndims.data(), rank) {}
+
+    sptIndex nmodes() const noexcept { return obj_.nmodes; }
+    sptIndex rank() const noexcept { return obj_.rank; }
+    double fit() const noexcept { return obj_.fit; }
+    bool has_factors() const noexcept { return obj_.factors != nullptr; }
+    MatrixView factor(sptIndex mode) noexcept { return MatrixView(obj_.factors[mode]); }
+    ConstMatrixView factor(sptIndex mode) const noexcept { return ConstMatrixView(obj_.factors[mode]); }
+    Span<sptValue> lambda() noexcept { return Span<sptValue>(obj_.lambda, obj_.rank); }
+    Span<sptValue const> lambda() const noexcept { return Span<sptValue const>(obj_.lambda, obj_.rank); }
+};
+
+#undef PARTI_HPP_MOVE_ONLY
+
+/*
+ * Lazy element-wise expressions.
+ *
+ * Arithmetic on SparseTensor builds an expression instead of a tensor:
+ * x * y and x / y are element-wise, on the intersection of the patterns like
+ * sptSparseTensorDotMul, x + y and x - y on their union like
+ * sptSparseTensorAdd, and a * x, x * a, x / a and -x scale by a scalar. The
+ * expression is evaluated when it becomes a SparseTensor,
+ *
+ *     SparseTensor z = alpha * (x * y) + w;
+ *
+ * in one parallel merge over all its tensors, with no intermediate tensor:
+ * a counting pass reads the indices, a second pass reads indices and values
+ * and writes z once. Operands must have the same shape and be sorted, see
+ * sptSparseTensorSortIndex; z is sorted. Entries that cancel are kept as
+ * explicit zeros. An expression refers to its tensors, which must outlive it.
+ */
+/// Base of the expression nodes, which brings the operators below into their lookup
+struct Expression {};
+
+namespace expr {
+
+/// The merge position of every distinct tensor of an expression
+struct Cursor {
+    sptSparseTensor const * const * tensors;
+    sptNnzIndex const * pos;
+    bool const * present;
+};
+
+/// A tensor operand
+class Leaf : public Expression {
+public:
+    explicit Leaf(sptSparseTensor const * tsr) noexcept : tsr_(tsr), slot_(0) {}
+    void bind(std::vector<sptSparseTensor const *> & tensors) {
+        auto const found = std::find(tensors.begin(), tensors.end(), tsr_);
+        slot_ = found - tensors.begin();
+        if(found == tensors.end()) {
+            tensors.push_back(tsr_);
+        }
+    }
+    bool present(Cursor const & c) const noexcept { return c.present[slot_]; }
+    sptValue value(Cursor const & c) const noexcept { return c.tensors[slot_]->values.data[c.pos[slot_]]; }
+private:
+    sptSparseTensor const * tsr_;
+    std::size_t slot_;
+};
+
+struct Plus { static sptValue apply(sptValue a, sptValue b) noexcept { return a + b; } };
+struct Minus { static sptValue apply(sptValue a, sptValue b) noexcept { return a - b; } };
+struct Times { static sptValue apply(sptValue a, sptValue b) noexcept { return a * b; } };
+struct Divides { static sptValue apply(sptValue a, sptValue b) noexcept { return a / b; } };
+
+/// x + y or x - y, present where either operand is, the other counting as zero
+template <typename L, typename R, typename Op>
+class Union : public Expression {
+public:
+    Union(L const & l, R const & r) : l_(l), r_(r) {}
+    void bind(std::vector<sptSparseTensor const *> & tensors) { l_.bind(tensors); r_.bind(tensors); }
+    bool present(Cursor const & c) const noexcept { return l_.present(c) || r_.present(c); }
+    sptValue value(Cursor const & c) const noexcept {
+        return Op::apply(l_.present(c) ? l_.value(c) : 0, r_.present(c) ? r_.value(c) : 0);
+    }
+private:
+    L l_;
+    R r_;
+};
+
+/// x * y or x / y, present where both operands are
+template <typename L, typename R, typename Op>
+class Intersection : public Expression {
+public:
+    Intersection(L const & l, R const & r) : l_(l), r_(r) {}
+    void bind(std::vector<sptSparseTensor const *> & tensors) { l_.bind(tensors); r_.bind(tensors); }
+    bool present(Cursor const & c) const noexcept { return l_.present(c) && r_.present(c); }
+    sptValue value(Cursor const & c) const noexcept { return Op::apply(l_.value(c), r_.value(c)); }
+private:
+    L l_;
+    R r_;
+};
+
+/// a * x, or x / a as x * (1 / a)
+template <typename E>
+class Scaled : public Expression {
+public:
+    Scaled(sptValue a, E const & e) : a_(a), e_(e) {}
+    void bind(std::vector<sptSparseTensor const *> & tensors) { e_.bind(tensors); }
+    bool present(Cursor const & c) const noexcept { return e_.present(c); }
+    sptValue value(Cursor const & c) const noexcept { return a_ * e_.value(c); }
+private:
+    sptValue a_;
+    E e_;
+};
+
+template <> struct is_node<Leaf> : std::true_type {};
+template <typename L, typename R, typename Op> struct is_node<Union<L, R, Op>> : std::true_type {};
+template <typename L, typename R, typename Op> struct is_node<Intersection<L, R, Op>> : std::true_type {};
+template <typename E> struct is_node<Scaled<E>> : std::true_type {};
+
+/// Tensors and expression nodes, the operands of the operators below
+template <typename T> struct is_operand : is_node<T> {};
+template <> struct is_operand<SparseTensor> : std::true_type {};
+
+inline Leaf node(SparseTensor const & tsr) noexcept { return Leaf(tsr.get()); }
+template <typename E, typename = std::enable_if_t<is_node<E>::value>>
+E const & node(E const & e) noexcept { return e; }
+
+template <typename T>
+using node_t = std::decay_t<decltype(node(std::declval<T const &>()))>;
+
+/// Lexicographic order of nonzero i of x and nonzero j of y
+inline int compare(sptSparseTensor const * x, sptNnzIndex i, sptSparseTensor const * y, sptNnzIndex j) noexcept {
+    for(sptIndex m = 0; m < x->nmodes; ++m) {
+        sptIndex const a = x->inds[m].data[i];
+        sptIndex const b = y->inds[m].data[j];
+        if(a != b) {
+            return a < b ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/// First nonzero of x not ordered before nonzero j of key
+inline sptNnzIndex lower_bound(sptSparseTensor const * x, sptSparseTensor const * key, sptNnzIndex j) noexcept {
+    sptNnzIndex begin = 0, end = x->nnz;
+    while(begin < end) {
+        sptNnzIndex const mid = begin + (end - begin) / 2;
+        if(compare(x, mid, key, j) < 0) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+/*
+ * Merge the nonzeros of thread tid's range of every tensor; with out NULL,
+ * count the output and check the order, else write the output from base.
+ */
+template <typename E>
+sptNnzIndex merge(E const & e, std::vector<sptSparseTensor const *> const & tensors,
+    std::vector<sptNnzIndex> const & bounds, int tid, sptSparseTensor * out, sptNnzIndex base, bool & unsorted)
+{
+    std::size_t const k = tensors.size();
+    std::vector<sptNnzIndex> pos(k), end(k);
+    std::unique_ptr<bool[]> present(new bool[k]);
+    for(std::size_t s = 0; s < k; ++s) {
+        pos[s] = bounds[tid * k + s];
+        end[s] = bounds[(tid + 1) * k + s];
+        if(out == nullptr && pos[s] > 0 && pos[s] < end[s] && compare(tensors[s], pos[s] - 1, tensors[s], pos[s]) > 0) {
+            unsorted = true;
+        }
+    }
+    Cursor const cursor = { tensors.data(), pos.data(), present.get() };
+    sptIndex const nmodes = tensors[0]->nmodes;
+    sptNnzIndex count = 0;
+    for(;;) {
+        std::size_t lead = k;
+        for(std::size_t s = 0; s < k; ++s) {
+            if(pos[s] < end[s] && (lead == k || compare(tensors[s], pos[s], tensors[lead], pos[lead]) < 0)) {
+                lead = s;
+            }
+        }
+        if(lead == k) {
+            break;
+        }
+        for(std::size_t s = 0; s < k; ++s) {
+            present[s] = pos[s] < end[s] && (s == lead || compare(tensors[s], pos[s], tensors[lead], pos[lead]) == 0);
+        }
+        if(e.present(cursor)) {
+            if(out != nullptr) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    out->inds[m].data[base + count] = tensors[lead]->inds[m].data[pos[lead]];
+                }
+                out->values.data[base + count] = e.value(cursor);
+            }
+            ++ count;
+        }
+        for(std::size_t s = 0; s < k; ++s) {
+            if(present[s]) {
+                ++ pos[s];
+                if(out == nullptr && pos[s] < end[s] && compare(tensors[s], pos[s] - 1, tensors[s], pos[s]) > 0) {
+                    unsorted = true;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+/// Evaluate e into a new sorted tensor
+template <typename E>
+SparseTensor evaluate(E const & expression) {
+    E e = expression;
+    std::vector<sptSparseTensor const *> tensors;
+    e.bind(tensors);
+    std::size_t const k = tensors.size();
+    sptSparseTensor const * largest = tensors[0];
+    for(sptSparseTensor const * t : tensors) {
+        bool same = t->nmodes == tensors[0]->nmodes;
+        for(sptIndex m = 0; same && m < t->nmodes; ++m) {
+            same = t->ndims[m] == tensors[0]->ndims[m];
+        }
+        if(!same) {
+            throw Error(SPTERR_SHAPE_MISMATCH, "parti::expr::evaluate");
+        }
+        if(t->nnz > largest->nnz) {
+            largest = t;
+        }
+    }
+
+    /* Split the largest tensor evenly, and the others at the same coordinates */
+    int const nt = largest->nnz < 4096 ? 1 : sptExecThreads(0);
+    std::vector<sptNnzIndex> bounds((nt + 1) * k), offsets(nt + 1, 0);
+    for(std::size_t s = 0; s < k; ++s) {
+        bounds[s] = 0;
+        bounds[nt * k + s] = tensors[s]->nnz;
+    }
+    for(int t = 1; t < nt; ++t) {
+        sptNnzIndex const split = largest->nnz * t / nt;
+        for(std::size_t s = 0; s < k; ++s) {
+            bounds[t * k + s] = lower_bound(tensors[s], largest, split);
+        }
+    }
+
+    bool unsorted = false;
+    #pragma omp parallel for num_threads(nt) schedule(static) reduction(||:unsorted)
+    for(int t = 0; t < nt; ++t) {
+        offsets[t + 1] = merge(e, tensors, bounds, t, nullptr, 0, unsorted);
+    }
+    if(unsorted) {
+        throw Error(SPTERR_VALUE_ERROR, "parti::expr::evaluate on unsorted operands");
+    }
+    for(int t = 0; t < nt; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+
+    SparseTensor z(tensors[0]->nmodes, tensors[0]->ndims);
+    sptSparseTensor * out = z.get();
+    for(sptIndex m = 0; m < out->nmodes; ++m) {
+        check(sptResizeIndexVector(&out->inds[m], offsets[nt]), "sptResizeIndexVector");
+    }
+    check(sptResizeValueVector(&out->values, offsets[nt]), "sptResizeValueVector");
+    out->nnz = offsets[nt];
+    #pragma omp parallel for num_threads(nt) schedule(static)
+    for(int t = 0; t < nt; ++t) {
+        bool ignored = false;
+        merge(e, tensors, bounds, t, out, offsets[t], ignored);
+    }
+    return z;
+}
+
+template <typename L, typename R>
+using enable_operands = std::enable_if_t<is_operand<L>::value && is_operand<R>::value>;
+template <typename T>
+using enable_operand = std::enable_if_t<is_operand<T>::value>;
+/* Any arithmetic scalar, so that a double matches exactly whatever sptValue is */
+template <typename S, typename T>
+using enable_scaling = std::enable_if_t<std::is_arithmetic<S>::value && is_operand<T>::value>;
+
+}
+
+template <typename E, typename>
+SparseTensor::SparseTensor(E const & e) : SparseTensor(expr::evaluate(e)) {}
+
+/* Rvalue tensors would be gone before the expression is evaluated */
+template <typename R> void operator+(SparseTensor &&, R const &) = delete;
+template <typename L> void operator+(L const &, SparseTensor &&) = delete;
+template <typename R> void operator-(SparseTensor &&, R const &) = delete;
+template <typename L> void operator-(L const &, SparseTensor &&) = delete;
+template <typename R> void operator*(SparseTensor &&, R const &) = delete;
+template <typename L> void operator*(L const &, SparseTensor &&) = delete;
+template <typename R> void operator/(SparseTensor &&, R const &) = delete;
+template <typename L> void operator/(L const &, SparseTensor &&) = delete;
+
+template <typename L, typename R, typename = expr::enable_operands<L, R>>
+expr::Union<expr::node_t<L>, expr::node_t<R>, expr::Plus> operator+(L const & l, R const & r) {
+    return { expr::node(l), expr::node(r) };
+}
+template <typename L, typename R, typename = expr::enable_operands<L, R>>
+expr::Union<expr::node_t<L>, expr::node_t<R>, expr::Minus> operator-(L const & l, R const & r) {
+    return { expr::node(l), expr::node(r) };
+}
+template <typename L, typename R, typename = expr::enable_operands<L, R>>
+expr::Intersection<expr::node_t<L>, expr::node_t<R>, expr::Times> operator*(L const & l, R const & r) {
+    return { expr::node(l), expr::node(r) };
+}
+template <typename L, typename R, typename = expr::enable_operands<L, R>>
+expr::Intersection<expr::node_t<L>, expr::node_t<R>, expr::Divides> operator/(L const & l, R const & r) {
+    return { expr::node(l), expr::node(r) };
+}
+template <typename S, typename E, typename = expr::enable_scaling<S, E>>
+expr::Scaled<expr::node_t<E>> operator*(S a, E const & e) {
+    return { static_cast<sptValue>(a), expr::node(e) };
+}
+template <typename E, typename S, typename = expr::enable_scaling<S, E>>
+expr::Scaled<expr::node_t<E>> operator*(E const & e, S a) {
+    return { static_cast<sptValue>(a), expr::node(e) };
+}
+template <typename E, typename S, typename = expr::enable_scaling<S, E>>
+expr::Scaled<expr::node_t<E>> operator/(E const & e, S a) {
+    return { 1 / static_cast<sptValue>(a), expr::node(e) };
+}
+template <typename E, typename = expr::enable_operand<E>>
+expr::Scaled<expr::node_t<E>> operator-(E const & e) {
+    return { -1, expr::node(e) };
+}
+
+}
+
+#endif
@@ -23,6 +23,53 @@
 /**
  * CP-ALS
  */
+int sptSetCpdCheckpoint(char const * path, sptIndex const every);
+int sptSaveCpdCheckpoint(char const * path, sptKruskalTensor const * ktensor);
+int sptLoadCpdCheckpoint(char const * path, sptKruskalTensor * ktensor);
+int sptSetCpdLineSearch(int const enable);
+int sptSetCpdDeadline(double const seconds);
+int sptSetCpdProgress(sptCpdProgress const progress, void * arg);
+int sptSetCpdInit(sptCpdInit const init);
+int sptCpdInitFactors(sptKruskalTensor * ktensor, sptSparseTensor const * const X, sptIndex const rank, sptCpdInit const init, int const tk);
+int sptNewCpdWorkspace(
+  sptCpdWorkspace * ws,
+  sptIndex const nmodes,
+  sptIndex const ndims[],
+  sptIndex const rank,
+  int const tk,
+  int const use_reduce);
+void sptFreeCpdWorkspace(sptCpdWorkspace * ws);
+int sptCpdWorkspaceUseDimTree(sptCpdWorkspace * ws, sptSparseTensor const * const X);
+int sptCpdWorkspaceUseRowPartition(sptCpdWorkspace * ws, sptSparseTensor const * const X);
+int sptCpdWorkspaceUseHotRows(sptCpdWorkspace * ws, sptSparseTensor const * const X, size_t const budget);
+int sptCpdWorkspaceUseTiling(sptCpdWorkspace * ws, sptSparseTensor * X, sptElementIndex const tile_bits);
+int sptCpdWorkspaceSetFitEvery(sptCpdWorkspace * ws, sptIndex const every);
+int sptCpdWorkspaceUseLayouts(sptCpdWorkspace * ws, sptSparseTensor const * const X, size_t const budget);
+int sptSetCpdLayoutBudget(size_t const bytes);
+int sptNewCpdLayouts(
+  sptCpdLayouts * layouts,
+  sptSparseTensor const * const X,
+  sptIndex const rank,
+  int const tk,
+  size_t const budget);
+int sptNewCpdLayoutsHiCOO(
+  sptCpdLayouts * layouts,
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  int const tk,
+  size_t const budget);
+void sptFreeCpdLayouts(sptCpdLayouts * layouts);
+int sptEstimateCpdMemory(
+  sptMemoryEstimate * est,
+  sptSparseTensor const * const X,
+  sptIndex const rank,
+  int const tk,
+  int const use_reduce);
+int sptEstimateCpdMemoryHiCOO(
+  sptMemoryEstimate * est,
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  int const tk);
 int sptCpdAls(
   sptSparseTensor const * const spten,
   sptIndex const rank,
@@ -37,12 +84,220 @@ int sptOmpCpdAls(
   const int tk,
   const int use_reduce,
   sptKruskalTensor * ktensor);
+int sptOmpCpdAlsBudget(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  size_t const budget,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsWorkspace(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsMixed(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdNnHals(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsSparseFactors(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptValue const l1,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsJacobi(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdGaussNewton(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCmtfAls(
+  sptSparseTensor const * const spten,
+  sptSparseMatrix const * const spmat,
+  sptIndex const coupled,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor,
+  sptMatrix * side);
+int sptOmpCompletionSgd(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  sptIndex const nepochs,
+  sptValue const step,
+  sptValue const reg,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptCudaCompletionSgd(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  sptIndex const nepochs,
+  sptValue const step,
+  sptValue const reg,
+  double const tol,
+  uint64_t const seed,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsBatched(
+  sptSparseTensor const * const spten,
+  sptIndex const nmodels,
+  sptIndex const ranks[],
+  uint64_t const seeds[],
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor ktensors[]);
+int sptOmpCpdAlsSampled(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptNnzIndex const nsamples,
+  sptIndex const niters,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsMultilevel(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const nlevels,
+  sptIndex const coarse_iters,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptCpdAlsAuto(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  int tk,
+  sptDispatchPlan * plan,
+  sptKruskalTensor * ktensor);
+int sptDenseCpdAls(
+  sptDenseTensor const * const X,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
 int sptCudaCpdAls(
   sptSparseTensor const * const spten,
   sptIndex const rank,
   sptIndex const niters,
   double const tol,
   sptKruskalTensor * ktensor);
+int sptCudaCpdGaussNewton(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor * ktensor);
+int sptCudaCpdAlsBatched(
+  sptSparseTensor const * const tensors[],
+  sptIndex const ntensors,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor ktensors[]);
+int sptCudaCpdAlsMultiGpu(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  int const ndevices,
+  sptKruskalTensor * ktensor);
+int sptCudaCpdAlsHybrid(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptCpdAlsStream(
+  const char * filename,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptNnzIndex const shard_nnz,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptCpdAlsSymmetric(
+  sptSymmSparseTensor const * const S,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor);
+int sptSetStreamQueueDepth(int const depth);
+int sptSetStreamPrefetchDistance(sptIndex const distance);
+int sptSetStreamIoUring(int const enable);
+int sptNewOnlineCpd(
+  sptOnlineCpd * state,
+  sptKruskalTensor * ktensor,
+  sptIndex const time_mode,
+  double const forget);
+int sptOnlineCpdUpdate(
+  sptOnlineCpd * state,
+  sptSparseTensor const * const slice,
+  int const tk,
+  sptKruskalTensor * ktensor);
+void sptFreeOnlineCpd(sptOnlineCpd * state);
+
+#ifdef PARTI_USE_MPI
+int sptMpiCpdAls(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor);
+int sptMpiCpdAlsOwned(
+  sptSparseTensor const * const spten,
+  sptRowOwnership const * own,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor);
+int sptMpiCudaCpdAls(
+  sptDeviceSparseTensor const * const dX,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor);
+#endif
+
 int sptCpdAlsHiCOO(
   sptSparseTensorHiCOO const * const hitsr,
   sptIndex const rank,
@@ -56,5 +311,97 @@ int sptOmpCpdAlsHiCOO(
   double const tol,
   const int tk,
   sptRankKruskalTensor * ktensor);
+int sptCpdAlsHiCOORankTiled(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptIndex const R_tile,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsHiCOORankTiled(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptIndex const R_tile,
+  sptKruskalTensor * ktensor);
+int sptOmpCpdAlsHiCOOPlan(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptHiCOOPlan const * const plan,
+  sptRankKruskalTensor * ktensor);
+int sptOmpCpdAlsHiCOOBudget(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  size_t const budget,
+  sptRankKruskalTensor * ktensor);
+int sptOmpCpdNnHalsHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptRankKruskalTensor * ktensor);
+int sptStartCpdAlsHiCOOPipeline(
+  sptCpdPipeline * pipe,
+  const char * filename,
+  sptIndex const start_index,
+  sptElementIndex const sb_bits,
+  sptElementIndex const sk_bits,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk);
+sptPipelineStage sptCpdPipelineStage(sptCpdPipeline pipe);
+int sptWaitCpdPipeline(
+  sptCpdPipeline pipe,
+  sptSparseTensorHiCOO * hitsr,
+  sptRankKruskalTensor * ktensor);
+
+
+/**
+ * Tucker-HOOI
+ */
+int sptTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  sptTuckerTensor * ttensor);
+int sptOmpTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptTuckerTensor * ttensor);
+int sptCudaTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  sptTuckerTensor * ttensor);
+#ifdef PARTI_USE_MPI
+int sptMpiTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  MPI_Comm comm,
+  sptTuckerTensor * ttensor);
+#endif
+
+
+/**
+ * Tensor train, TT-SVD
+ */
+int sptOmpTensorTrainSvd(
+  sptSparseTensor * const spten,
+  double const eps,
+  const int tk,
+  sptTensorTrain * tt);
 
 #endif
\ No newline at end of file
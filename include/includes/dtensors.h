@@ -0,0 +1,45 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_DTENSORS_H
+#define PARTI_DTENSORS_H
+
+/* Dense tensor */
+int sptNewDenseTensor(sptDenseTensor *tsr, sptIndex nmodes, const sptIndex ndims[]);
+void sptFreeDenseTensor(sptDenseTensor *tsr);
+int sptLoadDenseTensor(sptDenseTensor *tsr, FILE *fp);
+int sptSparseTensorToDense(sptDenseTensor *dest, const sptSparseTensor *src);
+double sptDenseTensorFrobeniusNormSquared(sptDenseTensor const * const tsr);
+
+/**
+ * Dense tensor times a dense matrix (TTM)
+ * Input: dense tensor X[I][J][K], dense matrix U[J][R], mode n=1
+ * Output: dense tensor Y[I][R][K]
+ */
+int sptDenseTensorMulMatrix(sptDenseTensor *Y, const sptDenseTensor *X, const sptMatrix *U, sptIndex const mode, int const tk);
+
+/**
+ * Dense tensor MTTKRP, mats[nmodes] receives the result
+ */
+int sptDenseMTTKRP(
+    sptDenseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mode,
+    int const tk);
+
+#endif
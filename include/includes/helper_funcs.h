@@ -32,6 +32,9 @@ void spt_Panic(const char *file, unsigned line, const char *expr);
 /* Helper function for pure C module */
 int sptCudaSetDevice(int device);
 int sptCudaGetLastError(void);
+int sptCudaReleasePool(void);
+int sptCudaReleaseHandles(void);
+void * sptCudaStream(int const i);
 
 /* Timer functions, using either CPU or GPU timer */
 int sptNewTimer(sptTimer *timer, int use_cuda);
@@ -42,9 +45,106 @@ double sptPrintElapsedTime(const sptTimer timer, const char *name);
 double sptPrintAverageElapsedTime(const sptTimer timer, const int niters, const char *name);
 int sptFreeTimer(sptTimer timer);
 
+/* Telemetry: named timers and counters, recorded per thread */
+void sptTelemetryRecordTime(char const * name, double const seconds);
+void sptTelemetryAddCounter(char const * name, double const amount);
+void sptSetTelemetryHook(sptTelemetryHook hook, void * ctx);
+void sptSetTelemetryPrint(int const enable);
+int spt_TelemetryPrinting(void);
+size_t sptTelemetrySnapshot(sptTelemetryRecord * records, size_t const max);
+int sptTelemetryExport(FILE * fp, sptTelemetryFormat const format);
+void sptTelemetryReset(void);
+
+/* Timeline tracing, exported as Chrome trace JSON */
+void sptSetTracing(int const enable);
+int sptTracingEnabled(void);
+double sptTraceBegin(void);
+void sptTraceEnd(char const * name, int64_t const arg, double const begin);
+int sptTraceExport(FILE * fp);
+void sptTraceReset(void);
+double spt_TraceNow(void);
+void spt_TraceSpan(char const * track, char const * name, int64_t const arg, double const ts, double const dur);
+
+/* Hardware counters around kernels, Linux perf events */
+void sptSetHardwareCounters(int const enable);
+int sptHardwareCountersEnabled(void);
+spt_KernelProbe * spt_KernelProbeStart(int const nthreads);
+double spt_KernelProbeStop(spt_KernelProbe * probe, sptTimer const timer, char const * name, double const flops, double const bytes);
+
 /* Base functions */
 char * sptBytesString(uint64_t const bytes);
 sptValue sptRandomValue(void);
+void sptSetRandomSeed(uint64_t const seed);
+uint64_t spt_RandomReserve(uint64_t const count);
+uint64_t spt_RandomBits(uint64_t const counter);
+sptValue spt_RandomValueOf(uint64_t const bits);
+
+/* NUMA placement */
+void sptFirstTouchZero(void * ptr, size_t const bytes);
+void sptNumaInterleave(void * ptr, size_t const bytes);
+
+/* Memory allocation */
+void sptSetAllocator(sptAllocator const * allocator);
+void sptSetHugePages(sptMemBacking const backing);
+char const * sptMemBackingString(sptMemBacking const backing);
+void * sptMallocBacked(size_t const bytes, sptMemBacking request);
+void * sptMalloc(size_t const bytes);
+void * spt_MallocFileBacked(size_t const bytes, char const * path);
+sptMemBacking sptMemBackingOf(void const * ptr);
+sptMemBacking spt_MemRequestOf(void const * ptr);
+void * spt_Realloc(void * ptr, size_t const used, size_t const bytes, sptMemBacking request);
+void sptFree(void * ptr);
+void * spt_ScratchAlloc(size_t const bytes);
+void spt_ScratchFree(void * ptr);
+void sptFreeScratch(void);
+
+/* High-bandwidth memory placement */
+void sptSetHbmPlacement(size_t const capacity);
+int sptHbmAvailable(void);
+size_t sptHbmBytesInUse(void);
+sptMemBacking spt_HbmBacking(size_t const bytes, int const streamed);
+void * spt_HbmAlloc(size_t const bytes);
+void spt_HbmFree(void * ptr, size_t const bytes);
+
+/* Capacity-tier memory placement */
+int sptSetDataPlacement(sptDataClass const cls, sptMemBacking const backing);
+sptMemBacking sptDataPlacement(sptDataClass const cls);
+int sptCapacityTierAvailable(void);
+size_t sptCapacityBytesInUse(void);
+int spt_CapacityTierHasNode(int const node);
+void * spt_CapacityAlloc(size_t const bytes);
+void spt_CapacityFree(void * ptr, size_t const bytes);
+
+/* Parallel text output: rows formatted per thread, written in order */
+typedef void (*spt_FormatRow)(spt_TextBuffer * buf, void const * ctx, sptNnzIndex const row);
+int spt_TextPrintf(spt_TextBuffer * buf, char const * fmt, ...);
+int spt_DumpRows(FILE * fp, sptNnzIndex const nrows, size_t const row_bytes, spt_FormatRow format, void const * ctx, int const tk);
+
+/* Execution contexts: thread count, cores, allocator and CUDA device of a caller's parallel work */
+int sptNewExecContext(sptExecContext * ctx, int const nthreads);
+sptExecContext const * sptSetExecContext(sptExecContext const * ctx);
+sptExecContext const * sptGetExecContext(void);
+int sptExecThreads(int const tk);
+sptExecContext const * spt_ExecPushThreads(sptExecContext * scope, int const tk);
+void * spt_ExecCudaStream(void);
+
+/* Machine calibration, run once and kept in the file PARTI_MACHINE_PROFILE names */
+int sptCalibrateMachine(sptMachineProfile * profile, int tk);
+sptMachineProfile const * sptGetMachineProfile(void);
+void sptSetMachineProfile(sptMachineProfile const * profile);
+int sptDumpMachineProfile(sptMachineProfile const * profile, FILE * fp);
+int sptLoadMachineProfile(sptMachineProfile * profile, FILE * fp);
+uint64_t sptMachineProfileFingerprint(sptMachineProfile const * profile);
+
+/* Machine parameters of the backend dispatcher, see sptPlanMTTKRP */
+sptMachineModel const * sptGetMachineModel(void);
+void sptSetMachineModel(sptMachineModel const * model);
+
+/* Machine topology and thread pinning */
+sptTopology const * sptGetTopology(void);
+int const * sptPinOrder(sptPinPolicy const policy, int const socket, int * ncores);
+int sptSetPinPolicy(sptPinPolicy const policy);
+sptPinPolicy spt_PinPolicy(void);
 
 
 /**
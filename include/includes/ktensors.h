@@ -22,13 +22,40 @@
 /* Kruskal tensor */
 int sptNewKruskalTensor(sptKruskalTensor *ktsr, sptIndex nmodes, const sptIndex ndims[], sptIndex rank);
 void sptKruskalTensorInverseShuffleIndices(sptKruskalTensor * ktsr, sptIndex ** map_inds);
+int sptKruskalTensorExpandRows(sptKruskalTensor * ktsr, const sptIndex ndims[]);
 void sptFreeKruskalTensor(sptKruskalTensor *ktsr);
 int sptDumpKruskalTensor(sptKruskalTensor *ktsr, FILE *fp);
+int sptDumpKruskalTensorBinary(sptKruskalTensor const * ktsr, FILE * fp);
+int sptLoadKruskalTensorBinary(sptKruskalTensor * ktensor, FILE * fp);
 double sptKruskalTensorFit(
   sptSparseTensor const * const spten,
   sptValue const * const __restrict lambda,
   sptMatrix ** mats,
   sptMatrix ** ata);
+double sptKruskalTensorFitNorm(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** mats,
+  sptMatrix ** ata);
+double sptKruskalTensorFitGram(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** ata);
+double sptKruskalTensorFitFromNorms(
+  double const spten_normsq,
+  double const norm_mats,
+  double const inner);
+double sptKruskalTensorFitSampled(
+  sptSparseTensor const * const spten,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** mats,
+  sptMatrix ** ata,
+  sptNnzIndex const nsamples,
+  uint64_t const seed,
+  double * bound);
 double sptKruskalTensorFrobeniusNormSquared(
   sptIndex const nmodes,
   sptValue const * const __restrict lambda,
@@ -37,6 +64,46 @@ double sptSparseKruskalTensorInnerProduct(
   sptIndex const nmodes,
   sptValue const * const __restrict lambda,
   sptMatrix ** mats);
+int sptKruskalTensorScore(
+  sptKruskalTensor const * ktsr,
+  sptIndex * const coords[],
+  sptNnzIndex const n,
+  sptValue * out,
+  int const tk);
+
+/* Top-k retrieval over the factor of one mode */
+int sptNewKruskalIndex(
+  sptKruskalIndex * idx,
+  sptKruskalTensor const * ktsr,
+  sptIndex const mode,
+  sptIndex const nlists,
+  uint64_t const seed,
+  int const tk);
+int sptKruskalIndexTopK(
+  sptKruskalIndex const * idx,
+  sptKruskalTensor const * ktsr,
+  sptIndex const coords[],
+  sptIndex const k,
+  sptIndex const nprobe,
+  sptIndex * top_inds,
+  sptValue * top_vals);
+void sptFreeKruskalIndex(sptKruskalIndex * idx);
+
+/* Kruskal tensor on a CUDA device */
+int sptDeviceUploadKruskalTensor(sptDeviceKruskalTensor *dktsr, sptKruskalTensor const * ktsr);
+int sptDeviceKruskalTensorScore(sptDeviceKruskalTensor *dktsr, sptIndex * const coords[], sptNnzIndex const n, sptValue * out);
+void sptFreeDeviceKruskalTensor(sptDeviceKruskalTensor *dktsr);
+
+
+/* Tucker tensor */
+int sptNewTuckerTensor(sptTuckerTensor *ttsr, sptIndex nmodes, const sptIndex ndims[], const sptIndex ranks[]);
+void sptFreeTuckerTensor(sptTuckerTensor *ttsr);
+int sptDumpTuckerTensor(sptTuckerTensor *ttsr, FILE *fp);
+
+/* Tensor train */
+int sptNewTensorTrain(sptTensorTrain *tt, sptIndex nmodes, const sptIndex ndims[], const sptIndex max_ranks[]);
+void sptFreeTensorTrain(sptTensorTrain *tt);
+double sptTensorTrainValue(sptTensorTrain const *tt, const sptIndex inds[]);
 
 
 /* Rank Kruskal tensor, ncols = small rank (<= 256)  */
@@ -44,11 +111,27 @@ int sptNewRankKruskalTensor(sptRankKruskalTensor *ktsr, sptIndex nmodes, const s
 void sptRankKruskalTensorInverseShuffleIndices(sptRankKruskalTensor * ktsr, sptIndex ** map_inds);
 void sptFreeRankKruskalTensor(sptRankKruskalTensor *ktsr);
 int sptDumpRankKruskalTensor(sptRankKruskalTensor *ktsr, FILE *fp);
+int sptDumpRankKruskalTensorBinary(sptRankKruskalTensor const * ktsr, FILE * fp);
 double sptKruskalTensorFitHiCOO(
   sptSparseTensorHiCOO const * const hitsr,
   sptValue const * const __restrict lambda,
   sptRankMatrix ** mats,
   sptRankMatrix ** ata);
+double sptKruskalTensorFitNormRank(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptRankMatrix ** mats,
+  sptRankMatrix ** ata);
+double sptKruskalTensorFitSampledHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptRankMatrix ** mats,
+  sptRankMatrix ** ata,
+  sptNnzIndex const nsamples,
+  uint64_t const seed,
+  double * bound);
 double sptKruskalTensorFrobeniusNormSquaredRank(
   sptIndex const nmodes,
   sptValue const * const __restrict lambda,
@@ -35,11 +35,118 @@
 #define PARTI_DEFAULT_LOCK_PAD_SIZE 16
 #endif
 
+/* Alignment of vector buffers, a cache line */
+#ifndef PARTI_VECTOR_ALIGN
+#define PARTI_VECTOR_ALIGN 64
+#endif
+
+/* Buffers from this size on get huge pages once sptSetHugePages is enabled */
+#ifndef PARTI_HUGE_PAGE_BYTES
+#define PARTI_HUGE_PAGE_BYTES (2 << 20)
+#endif
+
+/* Initial size of each thread's scratch arena, see spt_ScratchAlloc */
+#ifndef PARTI_SCRATCH_BYTES
+#define PARTI_SCRATCH_BYTES (256 << 10)
+#endif
+
+/* Rows of a dense factor processed as one cache-resident block, see sptOmpMatrixGram */
+#ifndef PARTI_ROW_BLOCK_BYTES
+#define PARTI_ROW_BLOCK_BYTES (64 << 10)
+#endif
+
+/* Bytes of per-thread MTTKRP output rows privatized by default, see sptNewMttkrpHotRows */
+#ifndef PARTI_MTTKRP_PRIVATE_BYTES
+#define PARTI_MTTKRP_PRIVATE_BYTES (256 << 20)
+#endif
+
+/* Bytes of mode-specific tensor copies CP-ALS may keep by default, see sptNewCpdLayouts */
+#ifndef PARTI_CPD_LAYOUT_BYTES
+#define PARTI_CPD_LAYOUT_BYTES (256 << 20)
+#endif
+
+/* Bytes of factor rows one MTTKRP tile touches across all modes by default, see sptNewMttkrpTiling */
+#ifndef PARTI_MTTKRP_TILE_BYTES
+#define PARTI_MTTKRP_TILE_BYTES (1 << 20)
+#endif
+
+/* Position sptSparseTensorLookupFind returns for a coordinate with no nonzero */
+#define PARTI_NOT_FOUND ((sptNnzIndex) -1)
+
+/* Private slot of an MTTKRP output row that is updated atomically instead */
+#define PARTI_HOT_ROW_NONE ((sptIndex) -1)
+
+/* Nonzeros per block of sptPackedSparseTensor, a multiple of 64 */
+#define PARTI_PACKED_BLOCK 128
+
+/* Fill from which a HiCOO block is stored dense by default, see sptSparseTensorToHiCOODense */
+#ifndef PARTI_HICOO_DENSE_FILL
+#define PARTI_HICOO_DENSE_FILL 0.5
+#endif
+
+/* Fewest nonzeros a GPU work unit is allowed to hold, see spt_SplitHeavySegments */
+#ifndef PARTI_CUDA_UNIT_NNZ
+#define PARTI_CUDA_UNIT_NNZ 32
+#endif
+
+/* Most leaves of a B-CSF work unit by default, see sptSparseTensorToBCSF */
+#ifndef PARTI_BCSF_UNIT_NNZ
+#define PARTI_BCSF_UNIT_NNZ 128
+#endif
+
+/* Largest CP-ALS problems sptOmpCpdAls runs single-threaded with no setup, see spt_CpdAlsSmall */
+#ifndef PARTI_CPD_SMALL_NNZ
+#define PARTI_CPD_SMALL_NNZ 16384
+#endif
+#ifndef PARTI_CPD_SMALL_RANK
+#define PARTI_CPD_SMALL_RANK 32
+#endif
+
+/* Most strata per epoch of sptOmpCompletionSgd; its P blocks per mode shrink until P^(nmodes-1) fits */
+#ifndef PARTI_COMPLETION_MAX_STRATA
+#define PARTI_COMPLETION_MAX_STRATA 4096
+#endif
+
+/* Last-level cache the dispatch cost model assumes when calibration finds none, see sptGetMachineModel */
+#ifndef PARTI_DISPATCH_CACHE_BYTES
+#define PARTI_DISPATCH_CACHE_BYTES (32 << 20)
+#endif
+
+/* impl_num of the CUDA MTTKRP and TTM kernels that picks one from the tensor, rank and device */
+#define PARTI_CUDA_IMPL_AUTO 0
+
+/* Buffers from this size on are first touched in parallel, see sptFirstTouchZero */
+#ifndef PARTI_FIRST_TOUCH_MIN_BYTES
+#define PARTI_FIRST_TOUCH_MIN_BYTES (1 << 20)
+#endif
+
+/* Smaller buffers stay in DDR under sptSetHbmPlacement */
+#ifndef PARTI_HBM_MIN_BYTES
+#define PARTI_HBM_MIN_BYTES (256 << 10)
+#endif
+
 /**
  * An opaque data type to store a specific time point, using either CPU or GPU clock.
  */
 typedef struct sptTagTimer *sptTimer;
 
+/**
+ * An opaque handle of a CP-ALS running in the background from a file, see
+ * sptStartCpdAlsHiCOOPipeline.
+ */
+typedef struct sptTagCpdPipeline *sptCpdPipeline;
+
+/**
+ * Hardware counters and a rate model around one kernel call, see
+ * spt_KernelProbeStart. Opaque.
+ */
+typedef struct spt_TagKernelProbe spt_KernelProbe;
+
+/**
+ * A growable per-thread text buffer of spt_DumpRows. Opaque.
+ */
+typedef struct spt_TagTextBuffer spt_TextBuffer;
+
 typedef enum {
     SPTERR_NO_ERROR       = 0,
     SPTERR_UNKNOWN        = 1,
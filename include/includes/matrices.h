@@ -24,6 +24,11 @@ static inline sptNnzIndex sptGetMatrixLength(const sptMatrix *mtx) {
     return mtx->nrows * mtx->stride;
 }
 int sptNewMatrix(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols);
+int sptNewMatrixWithBacking(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols, sptMemBacking const backing);
+int sptPlaceMatrix(sptMatrix *mtx, sptMemBacking const backing);
+int sptNewMatrixOutOfCore(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols, char const *path);
+int sptMatrixPrefetchRows(sptMatrix *mtx, sptIndex const begin, sptIndex const end);
+int sptMatrixEvictRows(sptMatrix *mtx, sptIndex const begin, sptIndex const end);
 int sptRandomizeMatrix(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols);
 int sptIdentityMatrix(sptMatrix *mtx);
 int sptConstantMatrix(sptMatrix * const mtx, sptValue const val);
@@ -34,6 +39,12 @@ int sptResizeMatrix(sptMatrix *mtx, sptIndex const new_nrows);
 void sptFreeMatrix(sptMatrix *mtx);
 int sptDumpMatrix(sptMatrix *mtx, FILE *fp);
 
+/* Dense matrix resident on a CUDA device */
+int sptNewDeviceMatrix(sptDeviceMatrix *dU, sptIndex const nrows, sptIndex const ncols);
+int sptDeviceUploadMatrix(sptDeviceMatrix *dU, const sptMatrix *U);
+int sptDeviceDownloadMatrix(sptMatrix *U, const sptDeviceMatrix *dU);
+void sptFreeDeviceMatrix(sptDeviceMatrix *dU);
+
 /* Dense matrix operations */
 int sptMatrixDotMul(sptMatrix const * A, sptMatrix const * B, sptMatrix const * C);
 int sptMatrixDotMulSeq(sptIndex const mode, sptIndex const nmodes, sptMatrix ** mats);
@@ -63,8 +74,51 @@ int sptMatrixSolveNormals(
   sptIndex const nmodes,
   sptMatrix ** aTa,
   sptMatrix * rhs);
+int sptOmpMatrixGram(sptMatrix const * const A, sptMatrix * const ata, int const tk);
+int sptMatrixKhatriRaoMul(sptMatrix *C, const sptMatrix *A, const sptMatrix *B, int const tk);
+int sptOmpMatrixSolveNormalsGram(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix const * const rhs,
+  sptMatrix * const A,
+  sptValue * const lambda,
+  int const use_max,
+  int const tk);
+int sptMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs);
+int sptOmpMatrixSolveFormedNormalsGram(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix const * const rhs,
+  sptMatrix * const A,
+  sptValue * const lambda,
+  int const use_max,
+  int const tk);
+int sptOmpMatrixSolveNormals(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs,
+  int const tk);
+int sptOmpMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs,
+  int const tk);
 int sptSparseTensorToMatrix(sptMatrix *dest, const sptSparseTensor *src);
 
+/* Hadamard products of Gram matrices kept across a CP-ALS sweep */
+int sptNewGramHadamard(sptGramHadamard * gh, sptIndex const nmodes, sptIndex const rank, sptIndex const stride);
+void sptFreeGramHadamard(sptGramHadamard * gh);
+int sptGramHadamardBeginSweep(sptGramHadamard * gh, sptValue * const * ata);
+int sptGramHadamardForm(sptGramHadamard * gh, sptIndex const mode, sptValue * const * ata, sptValue * out);
+int sptGramHadamardAdvance(sptGramHadamard * gh, sptIndex const mode, sptValue * const * ata);
+double sptGramHadamardKruskalNorm(sptGramHadamard * gh, sptValue const * const lambda, sptValue * const * ata);
+
 /* Dense Rank matrix, ncols = small rank (<= 256) */
 int sptNewRankMatrix(sptRankMatrix *mtx, sptIndex const nrows, sptElementIndex const ncols);
 int sptRandomizeRankMatrix(sptRankMatrix *mtx, sptIndex const nrows, sptElementIndex const ncols);
@@ -87,10 +141,36 @@ int sptRankMatrixSolveNormals(
   sptIndex const nmodes,
   sptRankMatrix ** aTa,
   sptRankMatrix * rhs);
+int sptRankMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs);
+int sptOmpRankMatrixSolveNormals(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs,
+  int const tk);
+int sptOmpRankMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs,
+  int const tk);
 
 /* Sparse matrix, COO format */
 int sptNewSparseMatrix(sptSparseMatrix *mtx, sptIndex const nrows, sptIndex const ncols);
 int sptCopySparseMatrix(sptSparseMatrix *dest, const sptSparseMatrix *src);
 void sptFreeSparseMatrix(sptSparseMatrix *mtx);
 
+/* Sparse matrix, CSR format */
+int sptNewSparseMatrixCSR(sptSparseMatrixCSR *mtx, sptIndex const nrows, sptIndex const ncols, sptNnzIndex const nnz);
+void sptFreeSparseMatrixCSR(sptSparseMatrixCSR *mtx);
+int sptSparseMatrixToCSR(sptSparseMatrixCSR *dest, const sptSparseMatrix *src, int const transpose);
+int sptSparseMatrixCSRSpMV(sptValueVector *y, const sptSparseMatrixCSR *A, const sptValueVector *x, int const tk);
+int sptSparseMatrixCSRSpMM(sptMatrix *C, const sptSparseMatrixCSR *A, const sptMatrix *B, int const tk);
+int sptSparseMatrixCSRFromMatrix(sptSparseMatrixCSR *dest, const sptMatrix *src, sptValue const threshold, int const tk);
+int sptSparseMatrixCSRToMatrix(sptMatrix *dest, const sptSparseMatrixCSR *src);
+int sptSparseMatrixCSRGram(sptMatrix *ata, const sptSparseMatrixCSR *A, int const tk);
+int sptCudaSparseMatrixCSRSpMM(sptMatrix *C, const sptSparseMatrixCSR *A, const sptMatrix *B);
+
 #endif
\ No newline at end of file
@@ -21,15 +21,111 @@
 
 /* Sparse tensor */
 int sptNewSparseTensor(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndims[]);
+int sptNewSparseTensorWithBacking(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndims[], sptMemBacking const backing);
+int sptPlaceSparseTensor(sptSparseTensor *tsr, sptMemBacking const backing);
 int sptCopySparseTensor(sptSparseTensor *dest, const sptSparseTensor *src, int const nt);
+int sptSparseTensorFirstTouch(sptSparseTensor *tsr, int const nt);
 void sptFreeSparseTensor(sptSparseTensor *tsr);
+void sptSparseTensorDropCache(sptSparseTensor *tsr);
+int sptSparseTensorKeepSortedCopies(sptSparseTensor *tsr, int const enable);
 double SparseTensorFrobeniusNormSquared(sptSparseTensor const * const spten);
+uint64_t sptSparseTensorFingerprint(sptSparseTensor const * const tsr);
+uint64_t sptSparseTensorFingerprintSampled(sptSparseTensor const * const tsr, sptNnzIndex nsamples);
 int sptLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, FILE *fp);
+int sptOmpLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk);
 int sptDumpSparseTensor(const sptSparseTensor *tsr, sptIndex start_index, FILE *fp);
+int sptDumpSparseTensorBinary(const sptSparseTensor *tsr, FILE *fp);
+int sptDumpSparseTensorBinaryWidths(const sptSparseTensor *tsr, FILE *fp, uint32_t index_width, uint32_t const value_width);
+int sptLoadSparseTensorBinary(sptSparseTensor *tsr, FILE *fp);
+int sptLoadWidthSparseTensorBinary(sptWidthSparseTensor *tsr, FILE *fp, uint32_t const index_width);
+void sptFreeWidthSparseTensor(sptWidthSparseTensor *tsr);
+FILE * sptOpenZstdStream(const char *filename, const char *mode, int level);
+int sptLoadSparseTensorZstd(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk);
+int sptNewSparseTensorSharding(sptSparseTensorSharding *sh, sptSparseTensor *tsr, sptIndex const mode, sptIndex const nshards);
+void sptFreeSparseTensorSharding(sptSparseTensorSharding *sh);
+int sptSparseTensorShardView(sptSparseTensor *view, sptSparseTensor const *tsr, sptSparseTensorSharding const *sh, sptIndex const s);
+void sptFreeSparseTensorShardView(sptSparseTensor *view);
+int sptHypergraphPartition(int *part, sptRowOwnership *own, sptSparseTensor const *tsr, int const nparts, double const imbalance);
+int sptNewRowOwnershipBlock(sptRowOwnership *own, sptIndex const nmodes, sptIndex const ndims[], int const nparts);
+void sptFreeRowOwnership(sptRowOwnership *own);
+sptNnzIndex sptRowOwnershipVolume(sptRowOwnership const *own, sptSparseTensor const *tsr, int const *part);
+int sptDumpPartitionedSparseTensor(sptSparseTensor const *tsr, int const *part, sptRowOwnership const *own, char const *prefix);
+int sptDumpRowOwnership(sptRowOwnership const *own, FILE *fp);
+int sptLoadRowOwnership(sptRowOwnership *own, FILE *fp);
+#ifdef PARTI_USE_MPI
+int sptMpiLoadSparseTensorBinary(sptSparseTensor *tsr, const char *filename, MPI_Comm comm);
+int sptMpiLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk, MPI_Comm comm);
+int sptMpiRedistributeSparseTensor(sptSparseTensor *tsr, sptIndex const mode, sptRowOwnership const *own, MPI_Comm comm);
+int sptMpiSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode, sptRowOwnership const *own, MPI_Comm comm);
+int sptMpiScatterSparseTensor(sptSparseTensor *local, sptSparseTensor *tsr, sptIndex const mode, int const root, MPI_Comm comm);
+#endif
+int sptGenerateSparseTensor(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndims[], sptNnzIndex nnz, sptGeneratorKind const kind, double const param, uint64_t const seed, int const nt);
+int sptMmapSparseTensor(sptSparseTensor *tsr, const char *filename);
+void sptUnmapSparseTensor(sptSparseTensor *tsr);
+int sptPublishSparseTensor(const sptSparseTensor *tsr, const char *name);
+int sptAttachSparseTensor(sptSparseTensor *tsr, const char *name);
+int sptUnpublishTensor(const char *name);
+int sptWrapSparseTensor(
+    sptSparseTensor *tsr,
+    sptIndex const nmodes,
+    const sptIndex ndims[],
+    sptNnzIndex const nnz,
+    sptIndex * const inds[],
+    sptValue * const values);
+void sptUnwrapSparseTensor(sptSparseTensor *tsr);
+int sptImportArrowSparseTensor(
+    sptSparseTensor *tsr,
+    struct ArrowSchema const * schema,
+    struct ArrowArray const * array,
+    sptIndex const nmodes,
+    sptIndex const start_index,
+    const sptIndex ndims[],
+    int const tk);
+void sptUnwrapArrowSparseTensor(sptSparseTensor *tsr, struct ArrowArray const * array);
+int sptNewPackedSparseTensor(sptPackedSparseTensor *P, const sptSparseTensor *X, int const tk);
+void sptFreePackedSparseTensor(sptPackedSparseTensor *P);
+int sptUnpackSparseTensor(sptSparseTensor *X, const sptPackedSparseTensor *P, int const tk);
+int sptDumpPackedSparseTensor(const sptPackedSparseTensor *P, FILE *fp);
+int sptLoadPackedSparseTensor(sptPackedSparseTensor *P, FILE *fp);
+int sptNewRecordSparseTensor(sptRecordSparseTensor *R, const sptSparseTensor *X, int const tk);
+void sptFreeRecordSparseTensor(sptRecordSparseTensor *R);
+int sptSparseTensorFromRecords(sptSparseTensor *X, const sptRecordSparseTensor *R, int const tk);
+int sptNewSymmSparseTensor(sptSymmSparseTensor *S, sptIndex const nmodes, sptIndex const ndim);
+void sptFreeSymmSparseTensor(sptSymmSparseTensor *S);
+int sptAppendSymmSparseTensor(sptSymmSparseTensor *S, const sptIndex coords[], sptValue const value);
+int sptSymmSparseTensorFromSparseTensor(sptSymmSparseTensor *S, const sptSparseTensor *X, int const tk);
+int sptSparseTensorFromSymmSparseTensor(sptSparseTensor *X, const sptSymmSparseTensor *S, int const tk);
+double sptSymmSparseTensorNormSquared(const sptSymmSparseTensor *S, int const tk);
+int sptSparseTensorIsPattern(const sptSparseTensor *tsr);
+int sptSparseTensorDropValues(sptSparseTensor *tsr);
+int sptSparseTensorRestoreValues(sptSparseTensor *tsr);
+int sptSparseTensorCoalesce(sptSparseTensor *tsr, sptCoalesceOp const op, int tk);
+int sptSetLoadCoalesce(sptCoalesceOp const op);
+int sptSparseTensorThreshold(sptSparseTensor *tsr, sptValue const threshold, int tk);
+int sptSparseTensorTopK(sptSparseTensor *tsr, sptIndex const mode, sptIndex const k, int tk);
+int sptSparseTensorReduceModes(
+    sptSparseTensor *Y,
+    const sptSparseTensor *X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    sptReduceOp const op,
+    int tk);
+int sptCudaSparseTensorReduceModes(
+    sptSparseTensor *Y,
+    const sptSparseTensor *X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    sptReduceOp const op);
 int sptMatricize(sptSparseTensor const * const X,
     sptIndex const m,
     sptSparseMatrix * const A,
     int const transpose);
+/* With transpose 0, sptSparseMatrixCSRSpMM(Y, A, U) gives the TTM along m, one row per linearized fiber */
+int sptMatricizeCSR(sptSparseTensor const * const X,
+    sptIndex const m,
+    sptSparseMatrixCSR * const A,
+    int const transpose,
+    int const tk);
 void sptGetBestModeOrder(
     sptIndex * mode_order,
     sptIndex const mode,
@@ -42,16 +138,29 @@ void sptGetWorstModeOrder(
     sptIndex const nmodes);
 void sptGetRandomShuffleElements(sptSparseTensor *tsr);
 void sptGetRandomShuffledIndices(sptSparseTensor *tsr, sptIndex ** map_inds);
+int sptGetLexiOrderShuffledIndices(const sptSparseTensor *tsr, sptIndex ** map_inds, int const niters);
+int sptGetBfsShuffledIndices(const sptSparseTensor *tsr, sptIndex ** map_inds, int const reverse);
 void sptSparseTensorShuffleIndices(sptSparseTensor *tsr, sptIndex ** map_inds);
+int sptSparseTensorCompactIndices(sptSparseTensor *tsr, sptIndex ** map_inds, int tk);
+int sptSparseTensorPermuteModes(sptSparseTensor *tsr, sptIndex const perm[], int const resort, int tk);
+int sptSparseTensorConcat(sptSparseTensor *dest, const sptSparseTensor *src, sptIndex const mode, int tk);
 void sptSparseTensorSortIndex(sptSparseTensor *tsr, int force);
+int sptSetSortAdaptive(int const enable);
 void sptSparseTensorSortIndexAtMode(sptSparseTensor *tsr, sptIndex const mode, int force);
 void sptSparseTensorSortIndexCustomOrder(sptSparseTensor *tsr, sptIndex const *  mode_order, int force);
+int sptCudaSparseTensorSortIndexCustomOrder(sptSparseTensor *tsr, sptIndex const order[]);
 void sptSparseTensorSortIndexMorton(
     sptSparseTensor *tsr, 
     int force,
     const sptNnzIndex begin,
     const sptNnzIndex end,
     const sptElementIndex sb_bits);
+int sptSparseTensorSortIndexHilbert(
+    sptSparseTensor *tsr,
+    int force,
+    const sptNnzIndex begin,
+    const sptNnzIndex end,
+    int const tk);
 void sptSparseTensorSortIndexRowBlock(
     sptSparseTensor *tsr, 
     int force,
@@ -74,10 +183,33 @@ int sptSparseTensorSortPartialIndex(
 void sptSparseTensorCalcIndexBounds(sptIndex inds_low[], sptIndex inds_high[], const sptSparseTensor *tsr);
 int spt_ComputeSliceSizes(
     sptNnzIndex * slice_nnzs, 
-    sptSparseTensor * const tsr,
+    sptSparseTensor const * const tsr,
     sptIndex const mode);
+int spt_SplitHeavySegments(
+    sptNnzIndexVector * unit_seg,
+    sptNnzIndexVector * unit_ptr,
+    sptNnzIndex const * ptr,
+    sptNnzIndex const nsegs,
+    sptNnzIndex max_nnz);
+int spt_PartitionSegments(
+    sptNnzIndex * bounds,
+    sptNnzIndex const * ptr,
+    sptNnzIndex const nsegs,
+    int const nparts);
 void sptSparseTensorStatus(sptSparseTensor *tsr, FILE *fp);
 double sptSparseTensorDensity(sptSparseTensor const * const tsr);
+int sptSparseTensorStatistics(
+    sptSparseTensorStats *st,
+    sptSparseTensor const * const tsr,
+    sptNnzIndex const nsamples,
+    int const tk);
+void sptFreeSparseTensorStats(sptSparseTensorStats *st);
+void sptSparseTensorStatsPrint(sptSparseTensorStats const * const st, FILE *fp);
+int sptRecommendFormat(
+    sptFormatAdvice *advice,
+    sptSparseTensorStats const * const st,
+    int const tk);
+void sptFreeFormatAdvice(sptFormatAdvice *advice);
 
 /* Sparse tensor HiCOO */
 int sptNewSparseTensorHiCOO(
@@ -88,6 +220,16 @@ int sptNewSparseTensorHiCOO(
     const sptElementIndex sb_bits,
     const sptElementIndex sk_bits,
     const sptElementIndex sc_bits);
+int sptNewSparseTensorHiCOOWithBacking(
+    sptSparseTensorHiCOO *hitsr, 
+    const sptIndex nmodes, 
+    const sptIndex ndims[],
+    const sptNnzIndex nnz,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    const sptElementIndex sc_bits,
+    sptMemBacking const backing);
+int sptPlaceSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr, sptMemBacking const backing);
 int sptNewSparseTensorHiCOO_NoNnz(
     sptSparseTensorHiCOO *hitsr, 
     const sptIndex nmodes, 
@@ -96,6 +238,20 @@ int sptNewSparseTensorHiCOO_NoNnz(
     const sptElementIndex sk_bits,
     const sptElementIndex sc_bits);
 void sptFreeSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr);
+int sptSparseTensorToCompactHiCOO(
+    sptCompactHiCOO *ch,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk);
+void sptFreeCompactHiCOO(sptCompactHiCOO *ch);
+size_t sptCompactHiCOOIndexBytes(sptCompactHiCOO const * const ch);
+int sptOmpMTTKRPCompactHiCOO(sptCompactHiCOO const * const ch,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
 int sptSparseTensorToHiCOO(
     sptSparseTensorHiCOO *hitsr, 
     sptNnzIndex *max_nnzb,
@@ -103,47 +259,317 @@ int sptSparseTensorToHiCOO(
     const sptElementIndex sb_bits,
     const sptElementIndex sk_bits,
     int const tk);
+int sptSparseTensorToHiCOOAdaptive(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_min,
+    const sptElementIndex sb_max,
+    const sptElementIndex sk_bits,
+    sptNnzIndex const nnzb_target,
+    int const tk);
+int sptSparseTensorToHiCOODense(
+    sptSparseTensorHiCOO *hitsr,
+    sptHiCOODenseBlocks *dense,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    double fill,
+    int const tk);
+int sptCudaSparseTensorToHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor const *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk);
+void sptFreeHiCOODenseBlocks(sptHiCOODenseBlocks *dense);
+int sptNewHiCOOBuilder(
+    sptHiCOOBuilder *bld,
+    const sptIndex nmodes,
+    const sptIndex ndims[],
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    sptNnzIndex const chunk_nnz);
+int sptHiCOOBuilderAppend(sptHiCOOBuilder *bld, const sptIndex coords[], sptValue const value);
+int sptHiCOOBuilderFinish(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptHiCOOBuilder *bld,
+    int const tk);
+void sptFreeHiCOOBuilder(sptHiCOOBuilder *bld);
+int sptEstimateHiCOOMemory(
+    sptMemoryEstimate * est,
+    sptSparseTensor const * const tsr,
+    sptElementIndex const sb_bits,
+    sptElementIndex const sk_bits,
+    int const tk);
+int sptLoadSparseTensorHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptIndex start_index,
+    FILE *fp,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk);
+int sptNewMutableHiCOO(
+    sptMutableHiCOO *mh,
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex const max_nnzb,
+    sptNnzIndex const compact_nnz,
+    int const tk);
+void sptFreeMutableHiCOO(sptMutableHiCOO *mh);
+int sptMutableHiCOOAdd(sptMutableHiCOO *mh, const sptIndex coords[], sptValue const value);
+int sptMutableHiCOOCompact(sptMutableHiCOO *mh, int const tk);
 int sptDumpSparseTensorHiCOO(sptSparseTensorHiCOO * const hitsr, FILE *fp);
+int sptDumpSparseTensorHiCOOBinary(sptSparseTensorHiCOO const * const hitsr, FILE *fp);
+int sptLoadSparseTensorHiCOOBinary(sptSparseTensorHiCOO *hitsr, FILE *fp);
+int sptPublishSparseTensorHiCOO(sptSparseTensorHiCOO const * const hitsr, const char *name);
+int sptAttachSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr, const char *name);
+void sptDetachSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr);
 void sptSparseTensorStatusHiCOO(sptSparseTensorHiCOO *hitsr, FILE *fp);
 double sptSparseTensorFrobeniusNormSquaredHiCOO(sptSparseTensorHiCOO const * const hitsr);
+uint64_t sptSparseTensorHiCOOFingerprint(sptSparseTensorHiCOO const * const hitsr);
+int sptCopySparseTensorHiCOO(sptSparseTensorHiCOO *dest, sptSparseTensorHiCOO const * const src);
+int sptSparseTensorHiCOOPermuteModes(sptSparseTensorHiCOO *hitsr, sptIndex const perm[]);
+
+/* HiCOO scalar and same-pattern element-wise operations */
+int sptOmpSparseTensorMulScalarHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const a);
+int sptOmpSparseTensorDivScalarHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const a);
+int sptOmpSparseTensorAddEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y);
+int sptOmpSparseTensorSubEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y);
+int sptOmpSparseTensorDotMulEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y);
+int sptOmpSparseTensorDotDivEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y);
+int sptSparseTensorThresholdHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const threshold, int tk);
+int sptSparseTensorTopKHiCOO(sptSparseTensorHiCOO *hitsr, sptIndex const mode, sptIndex const k, int tk);
+
+/* HiCOO TTM and TTV */
+int sptOmpSparseTensorMulMatrixHiCOO(
+    sptSemiSparseTensor *Y,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix const * const U,
+    sptIndex const mode,
+    int const tk);
+int sptOmpSparseTensorMulVectorHiCOO(
+    sptSemiSparseTensor *Y,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptValueVector const * const V,
+    sptIndex const mode,
+    int const tk);
+
+/* Record (array-of-structs COO) TTM and TTV */
+int sptOmpRecordSparseTensorMulMatrix(
+    sptSemiSparseTensor *Y,
+    sptRecordSparseTensor const * const R,
+    sptMatrix const * const U,
+    sptIndex const mode,
+    int const tk);
+int sptOmpRecordSparseTensorMulVector(
+    sptSemiSparseTensor *Y,
+    sptRecordSparseTensor const * const R,
+    sptValueVector const * const V,
+    sptIndex const mode,
+    int const tk);
+
+/* HiCOO MTTKRP autotuning */
+int sptTuneHiCOOMTTKRP(
+    sptHiCOOPlan *plan,
+    sptSparseTensor *tsr,
+    sptIndex const rank,
+    int const niters,
+    int const nt);
+int sptTuneHiCOOMTTKRPCached(
+    sptHiCOOPlan *plan,
+    char const * const plan_path,
+    sptSparseTensor *tsr,
+    sptIndex const rank,
+    int const niters,
+    int const nt);
+void sptFreeHiCOOPlan(sptHiCOOPlan *plan);
+int sptDumpHiCOOPlan(sptHiCOOPlan const * const plan, FILE *fp);
+int sptLoadHiCOOPlan(sptHiCOOPlan *plan, FILE *fp);
+
+/* Plan and layout cache in the directory PARTI_PLAN_CACHE names */
+char * sptPlanCachePath(sptSparseTensor const * const tsr, sptMachineProfile const * const profile, char const * const kind);
+int sptSparseTensorToHiCOOCached(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk);
+
 int sptSetKernelPointers(
     sptNnzIndexVector *kptr,
     sptSparseTensor *tsr, 
     const sptElementIndex sk_bits);
 
+/* Sparse tensor CSF */
+void sptFreeSparseTensorCSF(sptSparseTensorCSF *csf);
+int sptSparseTensorCSFPermuteModes(sptSparseTensorCSF *csf, sptIndex const perm[]);
+int sptSparseTensorToCSF(
+    sptSparseTensorCSF *csf,
+    sptSparseTensor const * const tsr,
+    sptIndex const * const mode_order,
+    int const tk);
+int sptCudaSparseTensorToCSF(
+    sptSparseTensorCSF *csf,
+    sptSparseTensor const * const tsr,
+    sptIndex const * const mode_order);
+
+/* Sparse tensor B-CSF */
+void sptFreeSparseTensorBCSF(sptSparseTensorBCSF *bcsf);
+int sptSparseTensorToBCSF(
+    sptSparseTensorBCSF *bcsf,
+    sptSparseTensor const * const tsr,
+    sptIndex const mode,
+    sptNnzIndex max_unit_nnz,
+    int const tk);
+
+/* Coordinate lookup index */
+int sptNewSparseTensorLookup(sptSparseTensorLookup *lk, sptSparseTensor const *tsr, int tk);
+void sptFreeSparseTensorLookup(sptSparseTensorLookup *lk);
+sptNnzIndex sptSparseTensorLookupFind(sptSparseTensorLookup const *lk, sptIndex const coords[]);
+int sptSparseTensorLookupRange(
+    sptNnzIndexVector *out,
+    sptSparseTensorLookup const *lk,
+    sptIndex const lo[],
+    sptIndex const hi[]);
+
+/* Sparse tensor ALTO */
+void sptFreeSparseTensorALTO(sptSparseTensorALTO *alto);
+int sptSparseTensorToALTO(
+    sptSparseTensorALTO *alto,
+    sptSparseTensor const * const tsr,
+    int const tk);
+
 
 /* Sparse tensor unary operations */
 int sptSparseTensorMulScalar(sptSparseTensor *X, sptValue const a);
 int sptSparseTensorDivScalar(sptSparseTensor *X, sptValue const a);
+int sptOmpSparseTensorMulScalar(sptSparseTensor *X, sptValue const a);
+int sptOmpSparseTensorDivScalar(sptSparseTensor *X, sptValue const a);
+int sptCudaSparseTensorMulScalar(sptSparseTensor *X, sptValue const a);
+int sptCudaSparseTensorDivScalar(sptSparseTensor *X, sptValue const a);
 
 /* Sparse tensor binary operations */
 int sptSparseTensorAdd(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptSparseTensorSub(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptSparseTensorAddOMP(sptSparseTensor *Y, sptSparseTensor *X, int const nthreads);
 int sptSparseTensorSubOMP(sptSparseTensor *Y, sptSparseTensor *X, int const nthreads);
+int sptCudaSparseTensorAdd(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+int sptCudaSparseTensorSub(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 
 int sptSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+int sptOmpSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+int sptCudaSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptSparseTensorDotMulEq(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptOmpSparseTensorDotMulEq(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptCudaSparseTensorDotMulEq(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 int sptSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+int sptOmpSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+int sptCudaSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
 
 int sptSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode);
 int sptOmpSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode);
 int sptCudaSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode);
 int sptCudaSparseTensorMulMatrixOneKernel(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode, sptIndex const impl_num, sptNnzIndex const smen_size);
+int sptOmpSparseTensorMulSparseMatrix(sptSparseTensor *Y, sptSparseTensor *X, const sptSparseMatrixCSR *U, sptIndex const mode, int tk);
+int sptCudaSparseTensorMulSparseMatrix(sptSparseTensor *Y, sptSparseTensor *X, const sptSparseMatrixCSR *U, sptIndex const mode);
+int sptOmpSparseTensorMulMatrixPruned(sptSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode, sptValue const epsilon, sptIndex const topk, int tk);
 int sptSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptValueVector *V, sptIndex const mode);
+int sptOmpSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptValueVector *V, sptIndex const mode);
+int sptCudaSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptValueVector *V, sptIndex const mode);
+int sptSparseTensorMulVectors(
+    sptSparseTensor *Y,
+    sptSparseTensor *X,
+    const sptValueVector * const V[],
+    sptIndex const modes[],
+    sptIndex const nvecs,
+    int const tk);
+int sptSparseTensorMulVectorsExcept(
+    sptValueVector *y,
+    sptSparseTensor const *X,
+    const sptValueVector * const V[],
+    sptIndex const mode,
+    int const tk);
+int sptCudaSparseTensorMulVectorsExcept(
+    sptValueVector *y,
+    sptSparseTensor const *X,
+    const sptValueVector * const V[],
+    sptIndex const mode);
+int sptSparseTensorPowerMethod(
+    sptValue *lambda,
+    sptValueVector * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol,
+    int const tk);
+int sptCudaSparseTensorPowerMethod(
+    sptValue *lambda,
+    sptValueVector * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol);
+int sptSparseTensorPowerMethodBatched(
+    sptValue *lambda,
+    sptMatrix * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol,
+    int const tk);
+int sptSparseTensorMulMatricesExcept(
+    sptMatrix *Y,
+    sptSparseTensor *X,
+    sptMatrix * const U[],
+    sptIndex const mode,
+    int const tk);
+int sptCudaSparseTensorMulMatricesExcept(
+    sptMatrix *Y,
+    sptSparseTensor *X,
+    sptMatrix * const U[],
+    sptIndex const mode);
+int sptSparseTensorMulMatrices(
+    sptSemiSparseTensorGeneral *Y,
+    sptSparseTensor *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[],
+    int const tk);
+int sptCudaSparseTensorMulMatrices(
+    sptSemiSparseTensorGeneral *Y,
+    sptSparseTensor *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[]);
+int sptSparseTensorContract(
+    sptSparseTensor *Z,
+    sptSparseTensor *X,
+    sptSparseTensor *Y,
+    sptIndex const cmodes_x[],
+    sptIndex const cmodes_y[],
+    sptIndex const ncmodes,
+    int const tk);
 
 
 /**
  * Kronecker product
  */
 int sptSparseTensorKroneckerMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B);
+int sptOmpSparseTensorKroneckerMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B, int const tk);
 
 /**
  * Khatri-Rao product
  */
 int sptSparseTensorKhatriRaoMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B);
+int sptOmpSparseTensorKhatriRaoMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B, int const tk);
 
 
 /**
@@ -166,24 +592,245 @@ int sptOmpMTTKRP_Reduce(sptSparseTensor const * const X,
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int tk);
+int sptOmpMTTKRP_Gather(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
+int sptSetMTTKRPPrefetchDistance(sptIndex const distance);
+int sptOmpMTTKRPPacked(sptPackedSparseTensor const * const P,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
+int sptOmpMTTKRPRecords(sptRecordSparseTensor const * const R,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
+int sptOmpSymmMTTKRP(sptSymmSparseTensor const * const S,
+    sptMatrix const * const U,
+    sptMatrix * const M,
+    const int tk);
+int sptOmpSymmTTV(sptSymmSparseTensor const * const S,
+    sptValueVector const * const v,
+    sptValueVector * const y,
+    const int tk);
+int sptOmpMTTKRPSparseFactors(sptSparseTensor const * const X,
+    sptSparseMatrixCSR * const factors[],
+    sptIndex const mode,
+    sptMatrix * const M,
+    const int tk);
+int sptNewHalfValueVector(sptHalfValueVector *hv, const sptSparseTensor *tsr, sptHalfFormat const format, int const tk);
+void sptFreeHalfValueVector(sptHalfValueVector *hv);
+sptValue sptHalfValueAt(const sptHalfValueVector *hv, sptNnzIndex const z);
+int sptOmpMTTKRPHalf(sptSparseTensor const * const X,
+    sptHalfValueVector const * const hv,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    int const half_factors,
+    const int tk);
+int sptOmpWidthMTTKRP(sptWidthSparseTensor const * const X,
+    void * const mats[],    // value_width rows of ndims[m] x stride; mats[nmodes] is the output.
+    uint64_t const stride,
+    uint64_t const R,
+    uint32_t const mode,
+    const int tk);
+int sptNewDictValueVector(sptDictValueVector *dv, const sptSparseTensor *tsr, int const tk);
+void sptFreeDictValueVector(sptDictValueVector *dv);
+sptValue sptDictValueAt(const sptDictValueVector *dv, sptNnzIndex const z);
+int sptDictDecodeValues(sptSparseTensor *tsr, const sptDictValueVector *dv, int const tk);
+double sptDictValueNormSquared(const sptDictValueVector *dv);
+int sptOmpLoadSparseTensorDict(sptSparseTensor *tsr, sptDictValueVector *dv, sptIndex start_index, const char *filename, int const tk);
+int sptOmpMTTKRPDict(sptSparseTensor const * const X,
+    sptDictValueVector const * const dv,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
+int sptOmpMTTKRP_RankParallel(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk);
 int sptOmpMTTKRP_Lock(sptSparseTensor const * const X,
     sptMatrix * mats[],     // mats[nmodes] as temporary space.
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int tk,
     sptMutexPool * lock_pool);
+int sptNewMttkrpRowPartition(
+    sptMttkrpRowPartition * part,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk);
+void sptFreeMttkrpRowPartition(sptMttkrpRowPartition * part);
+int sptOmpMTTKRP_Owner(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpRowPartition * part);
+int sptOmpMTTKRPOutOfCore(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex block_rows,
+    int const tk);
+int sptNewMttkrpHotRows(
+    sptMttkrpHotRows * hot,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    size_t const budget);
+void sptFreeMttkrpHotRows(sptMttkrpHotRows * hot);
+int sptOmpMTTKRP_HotRows(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpHotRows * hot);
+int sptNewMttkrpTiling(
+    sptMttkrpTiling * tl,
+    sptSparseTensor * X,
+    sptIndex const rank,
+    sptElementIndex const tile_bits,
+    int const tk);
+void sptFreeMttkrpTiling(sptMttkrpTiling * tl);
+int sptOmpMTTKRP_Tiled(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpTiling const * tl,
+    const int tk);
+int sptOmpMTTKRPMulti(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const nout,
+    sptIndex const modes[],     // the nout distinct modes to compute
+    sptMatrix * outs[],         // outs[k] receives the MTTKRP of modes[k]
+    const int tk);
+int sptMTTKRPMatricized(sptSparseTensor const * const X,
+    sptSparseMatrixCSR const * const A,     // sptMatricizeCSR of X at mode, transpose 1
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    const int tk);
+int sptOmpMTTKRPWorkspace(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    sptCpdWorkspace * ws);
+int sptNewMttkrpDimTree(
+    sptMttkrpDimTree * tree,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk);
+void sptFreeMttkrpDimTree(sptMttkrpDimTree * tree);
+void sptMttkrpDimTreeInvalidate(sptMttkrpDimTree * tree, sptIndex const mode);
+int sptOmpMTTKRPDimTree(
+    sptMttkrpDimTree * tree,
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    int const tk);
+int sptMTTKRPCSF(
+    sptSparseTensorCSF const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode);
+int sptOmpMTTKRPCSF(
+    sptSparseTensorCSF const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    const int tk);
+int sptOmpMTTKRPALTO(
+    sptSparseTensorALTO const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    const int tk);
 int sptCudaMTTKRP(
     sptSparseTensor const * const X,
     sptMatrix * mats[],     // mats[nmodes] as temporary space.
     sptIndex * const mats_order,    // Correspond to the mode order of X.
     sptIndex const mode,
     sptIndex const impl_num);
+int sptPlanMTTKRP(
+    sptDispatchPlan * plan,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    sptIndex const mode,
+    sptNnzIndex const ncalls,
+    int const tk);
+int sptMTTKRPAuto(
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    int tk);
+int sptCudaPrefetchMTTKRP(sptSparseTensor const * X, sptMatrix * const mats[], sptIndex const mode, sptMatrix const * out);
 int sptCudaMTTKRPOneKernel(
     sptSparseTensor const * const X,
     sptMatrix ** const mats,     // mats[nmodes] as temporary space.
     sptIndex * const mats_order,    // Correspond to the mode order of X.
     sptIndex const mode,
     sptIndex const impl_num);
+int sptCudaMTTKRPBCSF(
+    sptSparseTensorBCSF const * const X,
+    sptMatrix ** const mats,
+    sptIndex const mode);
+int sptCudaMTTKRPSegmented(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode);
+int sptCudaMTTKRPStream(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode,
+    sptNnzIndex batch_nnz,
+    int const nstreams);
+int sptCudaNewMttkrpMultiGpu(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptSparseTensor const * const X,
+    sptIndex const part_mode,
+    sptIndex const rank,
+    int const ndevices,
+    int const * const devices);
+void sptCudaFreeMttkrpMultiGpu(sptCudaMttkrpMultiGpu * ctx);
+int sptCudaMttkrpMultiGpuSetFactor(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptMatrix const * const A,
+    sptIndex const mode);
+int sptCudaMTTKRPMultiGpu(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptMatrix ** const mats,
+    sptIndex const mode);
+int sptCudaNewMttkrpHybrid(
+    sptCudaMttkrpHybrid * hybrid,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    double const gpu_share);
+void sptCudaFreeMttkrpHybrid(sptCudaMttkrpHybrid * hybrid);
+int sptCudaMTTKRPHybrid(
+    sptCudaMttkrpHybrid * hybrid,
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex * const mats_order,    // Correspond to the mode order of X.
+    sptIndex const mode);
+
+/**
+ * Sparse tensor resident on a CUDA device, for chaining GPU operations
+ * without a host round trip between them
+ */
+int sptDeviceUploadSparseTensor(sptDeviceSparseTensor *dX, const sptSparseTensor *X);
+int sptDeviceDownloadSparseTensor(sptSparseTensor *X, const sptDeviceSparseTensor *dX);
+void sptFreeDeviceSparseTensor(sptDeviceSparseTensor *dX);
+int sptDeviceLoadSparseTensorBinary(sptDeviceSparseTensor *dX, const char *filename);
+int sptDeviceSparseTensorSortIndex(sptDeviceSparseTensor *dX);
+int sptDeviceSparseTensorDotMulEq(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY);
+int sptDeviceSparseTensorDotMul(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY);
+int sptDeviceSparseTensorAdd(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY);
+int sptDeviceSparseTensorSub(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY);
+int sptDeviceSparseTensorMulMatrix(sptDeviceSemiSparseTensor *dY, sptDeviceSparseTensor *dX, const sptDeviceMatrix *dU, sptIndex const mode);
+int sptDeviceMTTKRP(sptDeviceSparseTensor const * const dX, sptDeviceMatrix * const mats[], sptIndex const mode);
 
 
 
@@ -206,6 +853,13 @@ int sptOmpMTTKRPHiCOO(
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int nt);
+int sptOmpMTTKRPHiCOOMulti(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],
+    sptIndex const nout,
+    sptIndex const modes[],     // the nout distinct modes to compute
+    sptMatrix * outs[],         // outs[k] receives the MTTKRP of modes[k]
+    const int tk);
 int sptOmpMTTKRPHiCOO_MatrixTiling(
     sptSparseTensorHiCOO const * const hitsr,
     sptRankMatrix * mats[],     // mats[nmodes] as temporary space.
@@ -225,6 +879,42 @@ int sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int nt);
+int sptOmpMTTKRPMutableHiCOO(
+    sptMutableHiCOO const * const mh,
+    sptRankMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk);
+int sptOmpMTTKRPHiCOODense(
+    sptHiCOODenseBlocks const * const dense,
+    sptRankMatrix * mats[],     // mats[nmodes] receives the sum.
+    sptIndex const mode,
+    const int tk);
+int sptMTTKRPHiCOO_RankTiled(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex const R_tile);
+int sptOmpMTTKRPHiCOO_RankTiled(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex const R_tile,
+    const int nt);
+int sptMTTKRPHiCOOPlan(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptHiCOOPlan const * const plan,
+    sptRankMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptRankMatrix * copy_mats[],    // nthreads temporary matrices, only for SPT_HICOO_MTTKRP_SCHEDULED_REDUCE
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode);
+int sptCudaMTTKRPHiCOO(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode);
 
 
 #endif
\ No newline at end of file
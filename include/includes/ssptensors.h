@@ -48,4 +48,19 @@ int sptSemiSparseTensorSetIndices(sptSemiSparseTensor *dest, sptNnzIndexVector *
  */
 int sptSemiSparseTensorMulMatrix(sptSemiSparseTensor *Y, const sptSemiSparseTensor *X, const sptMatrix *U, sptIndex mode);
 int sptCudaSemiSparseTensorMulMatrix(sptSemiSparseTensor *Y, const sptSemiSparseTensor *X, const sptMatrix *U, sptIndex mode);
+
+/**
+ * Semi-sparse tensor resident on a CUDA device, see sptDeviceSparseTensorMulMatrix
+ */
+int sptDeviceUploadSemiSparseTensor(sptDeviceSemiSparseTensor *dX, const sptSemiSparseTensor *X);
+int sptDeviceDownloadSemiSparseTensor(sptSemiSparseTensor *X, const sptDeviceSemiSparseTensor *dX);
+void sptFreeDeviceSemiSparseTensor(sptDeviceSemiSparseTensor *dX);
+int sptDeviceSemiSparseTensorMulMatrix(sptDeviceSemiSparseTensor *dY, const sptDeviceSemiSparseTensor *dX, const sptDeviceMatrix *dU, sptIndex const mode);
+
+/**
+ * General semi-sparse tensor times a dense matrix on a sparse mode, which
+ * becomes its last dense mode; see sptSparseTensorMulMatrices to start a chain
+ */
+int sptSemiSparseTensorGeneralMulMatrix(sptSemiSparseTensorGeneral *Y, const sptSemiSparseTensorGeneral *X, const sptMatrix *U, sptIndex const mode, int const tk);
+int sptCudaSemiSparseTensorGeneralMulMatrix(sptSemiSparseTensorGeneral *Y, const sptSemiSparseTensorGeneral *X, const sptMatrix *U, sptIndex const mode);
 #endif
\ No newline at end of file
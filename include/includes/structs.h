@@ -21,6 +21,153 @@
 
 
 
+/**
+ * Memory backing of library buffers, requested or obtained, see sptMallocBacked
+ */
+typedef enum {
+    SPT_MEM_DEFAULT  = 0, /// request: the process default; obtained: the heap
+    SPT_MEM_HUGE_2MB = 1, /// explicit 2MB huge pages
+    SPT_MEM_HUGE_1GB = 2, /// explicit 1GB huge pages
+    SPT_MEM_THP      = 3, /// obtained: transparent huge pages, the fallback for the two above
+    SPT_MEM_CUSTOM   = 4, /// obtained: from the allocator set with sptSetAllocator
+    SPT_MEM_FILE     = 5, /// obtained: pages of a mapped file, see sptMmapSparseTensor and sptNewMatrixOutOfCore
+    SPT_MEM_PINNED   = 6, /// page-locked host memory from CUDA, for full-bandwidth async copies
+    SPT_MEM_HBM      = 7, /// high-bandwidth memory such as MCDRAM, see sptSetHbmPlacement
+    SPT_MEM_MANAGED  = 8, /// CUDA managed memory, paged to the device on demand, see sptCudaPrefetchMTTKRP
+    SPT_MEM_CAPACITY = 9, /// capacity-tier memory such as CXL-attached memory or PMEM, see sptSetDataPlacement
+} sptMemBacking;
+
+/**
+ * Classes of library data placed across memory tiers, see sptSetDataPlacement
+ */
+typedef enum {
+    SPT_DATA_COO_INDICES   = 0, /// the index arrays of COO tensors, read in order by the kernels
+    SPT_DATA_COO_VALUES    = 1, /// the values of COO tensors
+    SPT_DATA_HICOO_INDICES = 2, /// the block and element indices of HiCOO tensors
+    SPT_DATA_HICOO_VALUES  = 3, /// the values of HiCOO tensors
+    SPT_DATA_MATRICES      = 4, /// dense matrices: factor matrices and MTTKRP outputs, gathered at random
+    SPT_NDATA_CLASSES      = 5,
+} sptDataClass;
+
+/**
+ * Pluggable allocator for library buffers, see sptSetAllocator
+ */
+typedef struct {
+    void * (*alloc)(size_t bytes, void * ctx);            /// returns PARTI_VECTOR_ALIGN-aligned memory or NULL
+    void (*release)(void * ptr, size_t bytes, void * ctx); /// releases what alloc returned, bytes as requested
+    void * ctx;                                            /// passed through to both
+} sptAllocator;
+
+/**
+ * Thread pinning policies, see sptPinOrder
+ */
+typedef enum {
+    SPT_PIN_NONE    = 0, /// leave placement to the OS and OMP_PROC_BIND
+    SPT_PIN_COMPACT = 1, /// fill the hardware threads of a core, then the cores of a socket
+    SPT_PIN_SCATTER = 2, /// one thread per core first, alternating sockets
+    SPT_PIN_SOCKET  = 3, /// the cores of one socket, compactly, for one team per socket
+} sptPinPolicy;
+
+/**
+ * How sptSparseTensorCoalesce merges nonzeros sharing a coordinate
+ */
+typedef enum {
+    SPT_COALESCE_NONE = 0, /// keep duplicates, see sptSetLoadCoalesce
+    SPT_COALESCE_SUM  = 1, /// add them up
+    SPT_COALESCE_MAX  = 2, /// keep the largest
+    SPT_COALESCE_LAST = 3, /// keep the one stored last, such as the last line of a file
+} sptCoalesceOp;
+
+/**
+ * How sptSparseTensorReduceModes combines the nonzeros collapsed together
+ */
+typedef enum {
+    SPT_REDUCE_SUM   = 0, /// add them up
+    SPT_REDUCE_MAX   = 1, /// the largest stored value
+    SPT_REDUCE_MIN   = 2, /// the smallest stored value
+    SPT_REDUCE_COUNT = 3, /// how many nonzeros there are
+} sptReduceOp;
+
+/**
+ * Stages of a background CP-ALS, see sptCpdPipelineStage
+ */
+typedef enum {
+    SPT_PIPELINE_LOADING     = 0, /// parsing the file and binning nonzeros by kernel
+    SPT_PIPELINE_CONVERTING  = 1, /// sorting and converting kernels to HiCOO
+    SPT_PIPELINE_DECOMPOSING = 2, /// running CP-ALS
+    SPT_PIPELINE_DONE        = 3, /// finished, successfully or not
+} sptPipelineStage;
+
+/**
+ * Logical CPUs of the machine the process may run on, see sptGetTopology
+ */
+typedef struct {
+    int ncpus;                /// # logical CPUs
+    int ncores;               /// # physical cores among them
+    int nsockets;             /// # sockets among them
+    int const * cpus;         /// CPU ids, socket by socket and core by core
+    int const * socket_of;    /// socket of each entry of cpus, numbered from 0
+    int const * socket_begin; /// first entry of cpus of each socket, nsockets+1 entries
+} sptTopology;
+
+/**
+ * Called by the CP-ALS drivers after every iteration with the iterations done,
+ * the last evaluated fit and the seconds since the decomposition started;
+ * a nonzero return stops the run with the best factors seen, see sptSetCpdProgress
+ */
+typedef int (*sptCpdProgress)(sptIndex it, double fit, double seconds, void * arg);
+
+/**
+ * Resources one caller's parallel work may use, see sptSetExecContext
+ */
+typedef struct {
+    int nthreads;                    /// # OpenMP threads, 0 for the count the thread had before any context
+    int const * cores;               /// CPU ids the threads are pinned to round-robin, NULL to leave affinity alone
+    int ncores;                      /// # entries of cores
+    sptAllocator const * allocator;  /// allocator for buffers made under the context, NULL for sptSetAllocator's
+    sptMemBacking backing;           /// backing of buffers without a request, SPT_MEM_DEFAULT for sptSetHugePages'
+    int cuda_device;                 /// CUDA device, -1 to keep the current one
+    void * cuda_stream;              /// cudaStream_t the CUDA work is ordered on, NULL for the default stream
+    char const * cpd_checkpoint;     /// CP-ALS checkpoint file of runs under the context, NULL for sptSetCpdCheckpoint's
+    sptIndex cpd_checkpoint_every;   /// interval in iterations of cpd_checkpoint, 0 to only write when done
+    double cpd_deadline;             /// CP-ALS budget in seconds of runs under the context, 0 for sptSetCpdDeadline's
+    sptCpdProgress cpd_progress;     /// CP-ALS progress callback of runs under the context, NULL for sptSetCpdProgress's
+    void * cpd_progress_arg;         /// passed through to cpd_progress
+} sptExecContext;
+
+/**
+ * Kind of a telemetry entry, see sptTelemetryRecordTime and sptTelemetryAddCounter
+ */
+typedef enum {
+    SPT_TELEMETRY_TIMER   = 0, /// samples are elapsed seconds
+    SPT_TELEMETRY_COUNTER = 1, /// samples are amounts, such as bytes moved
+} sptTelemetryKind;
+
+/**
+ * Output formats of sptTelemetryExport
+ */
+typedef enum {
+    SPT_TELEMETRY_JSON = 0,
+    SPT_TELEMETRY_CSV  = 1,
+} sptTelemetryFormat;
+
+/**
+ * A named telemetry entry, aggregated over all threads
+ */
+typedef struct {
+    char const * name;     /// owned by the registry, valid for the life of the process
+    sptTelemetryKind kind;
+    uint64_t count;        /// number of samples
+    double total;          /// sum of the samples
+    double min;            /// smallest sample, 0 if none
+    double max;            /// largest sample, 0 if none
+} sptTelemetryRecord;
+
+/**
+ * Called with every telemetry sample, on the recording thread
+ */
+typedef void (*sptTelemetryHook)(char const * name, sptTelemetryKind kind, double value, void * ctx);
+
 /**
  * Dense dynamic array of specified type of scalars
  */
@@ -81,6 +228,49 @@ typedef struct {
     sptValue *values; /// values, length cap*stride
 } sptRankMatrix;
 
+/**
+ * Running Hadamard products of the Gram matrices over a CP-ALS sweep, see sptNewGramHadamard
+ */
+typedef struct {
+    sptIndex nmodes;    /// # modes
+    sptIndex rank;      /// # columns of the Gram matrices
+    sptIndex stride;    /// row stride of the Gram matrices
+    sptIndex next;      /// the mode the sweep is at, beyond nmodes when out of step
+    sptValue *prefix;   /// product of the Gram matrices of modes before next, as updated
+    sptValue *suffix;   /// nmodes blocks, block m the product of those after m at the sweep start
+    sptValue *scratch;  /// a product formed from scratch when out of step
+} sptGramHadamard;
+
+/**
+ * 16-bit floating-point formats of sptHalfValueVector
+ */
+typedef enum {
+    SPT_HALF_BF16 = 0, /// bfloat16, the exponent of float with 8 mantissa bits
+    SPT_HALF_FP16 = 1, /// IEEE binary16
+} sptHalfFormat;
+
+/**
+ * Sparse tensor values stored in 16 bits, see sptNewHalfValueVector
+ */
+typedef struct {
+    sptHalfFormat format; /// encoding of data
+    sptNnzIndex len;      /// length
+    uint16_t * data;      /// encoded values, length len
+} sptHalfValueVector;
+
+/**
+ * Sparse tensor values stored as 8- or 16-bit codes into a table of their
+ * distinct values, see sptNewDictValueVector
+ */
+typedef struct {
+    sptNnzIndex len;      /// length
+    uint32_t ntable;      /// # distinct values
+    uint32_t width;       /// bits per code, 8 or 16
+    sptValue * table;     /// the distinct values, ascending, length ntable
+    sptNnzIndex * counts; /// occurrences of each distinct value, length ntable
+    void * codes;         /// uint8_t or uint16_t codes, length len
+} sptDictValueVector;
+
 /**
  * Sparse matrix type, COO format
  */
@@ -117,8 +307,102 @@ typedef struct {
     sptNnzIndex nnz;         /// # non-zeros
     sptIndexVector * inds;       /// indices of each element, length [nmodes][nnz]
     sptValueVector values;      /// non-zero values, length nnz
+    struct spt_SparseTensorCache * cache; /// derived data such as fiber indices and sorted copies, owned; NULL until built
 } sptSparseTensor;
 
+/**
+ * Sparse tensor, COO format, with its index and value widths chosen at run
+ * time rather than fixed to sptIndex and sptValue. See sptLoadWidthSparseTensorBinary.
+ */
+typedef struct {
+    uint32_t nmodes;        /// # modes
+    uint32_t index_width;   /// bytes per index, 2, 4 or 8
+    uint32_t value_width;   /// bytes per value, 4 (float) or 8 (double)
+    uint64_t * ndims;       /// size of each mode, length nmodes
+    uint64_t nnz;           /// # non-zeros
+    void ** inds;           /// indices of each mode, length [nmodes][nnz] of index_width bytes
+    void * values;          /// non-zero values, length nnz of value_width bytes
+} sptWidthSparseTensor;
+
+
+/**
+ * A split of a sparse tensor into shards of whole slices of one mode with
+ * about equal nonzeros, see sptNewSparseTensorSharding
+ */
+typedef struct {
+    sptIndex mode;          /// the mode the tensor is split along
+    sptIndex nshards;       /// # shards
+    sptIndex * slice_ptr;   /// shard s holds slices [slice_ptr[s], slice_ptr[s+1]) of mode, length nshards+1
+    sptNnzIndex * nnz_ptr;  /// and nonzeros [nnz_ptr[s], nnz_ptr[s+1]) of the sorted tensor, length nshards+1
+} sptSparseTensorSharding;
+
+
+/**
+ * The rank owning each factor row in distributed CP-ALS, see sptHypergraphPartition
+ */
+typedef struct {
+    sptIndex nmodes;        /// # modes
+    int nparts;             /// # ranks
+    sptIndex * ndims;       /// size of each mode, length nmodes
+    int ** owner;           /// owner rank of each row, [nmodes][ndims[m]]
+} sptRowOwnership;
+
+/**
+ * Sparse tensor type, COO with block-compressed indices, see sptNewPackedSparseTensor.
+ * Each block of PARTI_PACKED_BLOCK nonzeros stores, in each mode, its first
+ * index and the zigzag-encoded deltas between consecutive indices, bit-packed
+ * at the width of the largest one.
+ */
+typedef struct {
+    sptIndex nmodes;      /// # modes
+    sptIndex * sortorder; /// the order the nonzeros were sorted in when packed
+    sptIndex * ndims;     /// size of each mode, length nmodes
+    sptNnzIndex nnz;      /// # non-zeros
+    sptNnzIndex nblocks;  /// # blocks, the last one possibly partial
+    sptIndex * firsts;    /// first index of each block in each mode, length [nblocks][nmodes]
+    uint8_t * widths;     /// delta bits of each block in each mode, length [nblocks][nmodes]
+    uint64_t * offsets;   /// first word of each block, length nblocks+1
+    uint64_t * words;     /// packed deltas, the modes of a block one after another, length offsets[nblocks]
+    sptValueVector values; /// non-zero values, length nnz
+    uint64_t fingerprint; /// sptSparseTensorFingerprint of the tensor packed
+} sptPackedSparseTensor;
+
+/**
+ * Sparse tensor type, COO as an array of structs, see sptNewRecordSparseTensor.
+ * Each nonzero is one record, its value then its indices, padded to a power
+ * of two of at least 16 bytes.
+ */
+typedef struct {
+    sptIndex nmodes;      /// # modes
+    sptIndex * sortorder; /// the order the nonzeros were sorted in when copied
+    sptIndex * ndims;     /// size of each mode, length nmodes
+    sptNnzIndex nnz;      /// # non-zeros
+    size_t record_bytes;  /// bytes per record, 16 for up to 2 modes, 32 for up to 6
+    char * records;       /// the records, PARTI_VECTOR_ALIGN-aligned, length nnz * record_bytes
+} sptRecordSparseTensor;
+
+/**
+ * Supersymmetric sparse tensor, see sptNewSymmSparseTensor: every mode has
+ * the same size and every permutation of a coordinate the same value, so
+ * only coordinates sorted in ascending order are stored.
+ */
+typedef struct {
+    sptIndex nmodes;      /// # modes
+    sptIndex ndim;        /// size of every mode
+    sptNnzIndex nnz;      /// # stored entries, each inds[0][z] <= inds[1][z] <= ... <= inds[nmodes-1][z]
+    sptIndexVector * inds; /// indices of each mode, length nmodes
+    sptValueVector values; /// value of each stored entry, shared by all its permutations
+} sptSymmSparseTensor;
+
+/**
+ * Index distributions of sptGenerateSparseTensor
+ */
+typedef enum {
+    SPT_GEN_UNIFORM   = 0, /// every index equally likely
+    SPT_GEN_POWERLAW  = 1, /// index i drawn with weight (i+1)^-param in each mode independently
+    SPT_GEN_KRONECKER = 2, /// stochastic Kronecker (R-MAT) recursion, param is the weight of the all-low quadrant
+} sptGeneratorKind;
+
 
 /**
  * Sparse tensor type, Hierarchical COO format (HiCOO)
@@ -137,6 +421,7 @@ typedef struct {
 
     /* Scheduling information */
     sptNnzIndexVector         kptr;      /// Nonzero kernel pointers in 1-D array, indexing blocks. sptIndexVector may be enough
+    sptElementIndexVector     kbits;     /// Block size in bits of each kernel, empty when all kernels use sb_bits
     sptIndexVector            **kschr;    /// Kernel scheduler
     sptIndex                  *nkiters;
     sptNnzIndexVector         cptr;      /// Chunk pointers to evenly split or combine blocks in a group, indexing blocks. sptIndexVector may be enough
@@ -148,6 +433,186 @@ typedef struct {
     sptValueVector            values;      /// non-zero values, length nnz
 } sptSparseTensorHiCOO;
 
+/**
+ * Sparse tensor type, HiCOO with runtime-width element indices and
+ * delta-encoded block indices, see sptSparseTensorToCompactHiCOO.
+ * Element indices take ewidth bytes, 1 for sb_bits up to 8 and 2 up to 16.
+ * Each block stores, per mode, the zigzag varint of its block index minus
+ * that of the previous block of its kernel, the first block of a kernel minus
+ * zero.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptNnzIndex         nnz;         /// # non-zeros
+    sptElementIndex     sb_bits;     /// block size by nnz, at most 16
+    sptElementIndex     sk_bits;     /// kernel size by nnz
+    uint8_t             ewidth;      /// bytes per element index, 1 or 2
+    sptNnzIndexVector   kptr;        /// kernel pointers, indexing blocks
+    sptNnzIndexVector   kbytes;      /// kernel pointers into bdeltas
+    sptNnzIndexVector   bptr;        /// block pointers to all nonzeros
+    uint8_t             *bdeltas;    /// block index deltas, nmodes varints per block
+    uint8_t             **einds;     /// per mode, nnz element indices of ewidth bytes
+    sptValueVector      values;      /// non-zero values, length nnz
+} sptCompactHiCOO;
+
+
+/**
+ * Dense HiCOO blocks split off a sparse tensor by sptSparseTensorToHiCOODense
+ * Each block is stored in full, row-major with the last mode fastest; blocks
+ * at the tensor edge are clipped to the tensor.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptElementIndex     sb_bits;     /// block size in bits
+    sptNnzIndex         nblocks;     /// # dense blocks
+    sptNnzIndex         nnz;         /// # non-zeros of the tensor stored in the blocks
+    sptIndexVector      *corners;    /// first index of each block in each mode, nmodes vectors of length nblocks
+    sptIndex            *extents;    /// size of each block in each mode, nblocks * nmodes
+    sptNnzIndexVector   vptr;        /// first value of each block, length nblocks+1
+    sptValueVector      values;      /// block values, zeros included
+} sptHiCOODenseBlocks;
+
+
+/**
+ * Streaming HiCOO builder, see sptNewHiCOOBuilder. Nonzeros are binned by
+ * kernel as they arrive, each bin a list of fixed-size buffers holding the
+ * coordinates local to the kernel, so no COO image of the tensor is kept.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptIndex            *kdims;      /// # kernels in each mode, length nmodes
+    sptElementIndex     sb_bits;     /// block size in bits
+    sptElementIndex     sk_bits;     /// kernel size in bits
+    sptNnzIndex         nnz;         /// # non-zeros appended so far
+    sptNnzIndex         chunk_nnz;   /// # non-zeros per buffer
+    unsigned            coord_bytes; /// bytes of each local coordinate, 1, 2 or 4
+    sptNnzIndex         nbins;       /// # non-empty kernels
+    sptNnzIndex         bins_cap;    /// allocated bins
+    struct spt_HiCOOBin *bins;       /// one bin per non-empty kernel, in arrival order
+    sptNnzIndex         nslots;      /// size of the table, a power of 2
+    sptNnzIndex         *slots;      /// open-addressing table from kernel to bin+1, 0 if empty
+} sptHiCOOBuilder;
+
+
+/**
+ * HiCOO tensor taking updates, see sptNewMutableHiCOO. New nonzeros wait in a
+ * small COO delta, which MTTKRP adds to the HiCOO base, until
+ * sptMutableHiCOOCompact merges them into the kernels they fall in.
+ */
+typedef struct {
+    sptSparseTensorHiCOO base;          /// compacted nonzeros
+    sptSparseTensor      delta;         /// pending nonzeros, added to base
+    sptNnzIndex          max_nnzb;      /// max # non-zeros per block of base
+    sptNnzIndex          compact_nnz;   /// delta size that triggers a compaction, 0 for none
+    int                  tk;            /// # threads of triggered compactions
+} sptMutableHiCOO;
+
+
+/**
+ * HiCOO MTTKRP implementations a tuning plan can choose from, per mode
+ */
+typedef enum {
+    SPT_HICOO_MTTKRP_TILING           = 0,  /// sptOmpMTTKRPHiCOO_MatrixTiling (sequential if nthreads == 1)
+    SPT_HICOO_MTTKRP_SCHEDULED        = 1,  /// sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled
+    SPT_HICOO_MTTKRP_SCHEDULED_REDUCE = 2,  /// sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce
+} sptHiCOOMttkrpVariant;
+
+/**
+ * Tuned HiCOO parameters and MTTKRP variants for one tensor, rank and thread count
+ */
+typedef struct {
+    uint64_t            fingerprint; /// sptSparseTensorFingerprint of the tuned tensor
+    sptIndex            nmodes;      /// # modes
+    sptIndex            rank;        /// rank the plan was tuned for
+    int                 nthreads;    /// # threads the plan was tuned for
+    sptElementIndex     sb_bits;     /// block size by nnz
+    sptElementIndex     sk_bits;     /// kernel size by nnz
+    sptHiCOOMttkrpVariant *variants; /// MTTKRP variant of each mode, length nmodes
+    double              *seconds;    /// measured time of one MTTKRP of each mode, length nmodes
+} sptHiCOOPlan;
+
+
+/**
+ * Sparse tensor type, Compressed Sparse Fiber format (CSF)
+ * Level l stores the nodes of mode mode_order[l]; the last level holds one node per nonzero.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *mode_order; /// the mode stored at each level, length nmodes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptNnzIndex         nnz;         /// # non-zeros
+
+    sptNnzIndex         *nfibs;      /// # nodes at each level, length nmodes
+    sptNnzIndexVector   *fptr;       /// children of each node, levels 0..nmodes-2, length nfibs[l]+1
+    sptIndexVector      *fids;       /// mode index of each node, length nfibs[l]
+    sptValueVector      values;      /// non-zero values, length nnz
+} sptSparseTensorCSF;
+
+
+/**
+ * Sparse tensor type, balanced CSF (B-CSF) for GPU MTTKRP on one mode
+ * A CSF tree rooted at the output mode, flattened to its fibers, the nodes of
+ * the last internal level. Fibers with more than max_unit_nnz leaves are
+ * split, and the consecutive fibers of a slice are grouped into units of at
+ * most max_unit_nnz leaves, so that every GPU warp gets a bounded share of
+ * work however skewed the slices and fibers are.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptNnzIndex         nnz;         /// # non-zeros
+    sptIndex            *mode_order; /// the mode of each level, mode_order[0] is the output mode
+    sptNnzIndex         nfibs;       /// # fibers after splitting
+    sptIndexVector      *fids;       /// index of each fiber at levels 0..nmodes-2, nmodes-1 vectors of length nfibs
+    sptNnzIndexVector   fptr;        /// leaves of each fiber, length nfibs+1
+    sptIndexVector      leaf_ids;    /// index of each leaf in mode_order[nmodes-1], length nnz
+    sptValueVector      values;      /// non-zero values, length nnz
+    sptNnzIndex         nunits;      /// # work units
+    sptNnzIndexVector   unit_ptr;    /// fibers of each unit, within one slice, length nunits+1
+} sptSparseTensorBCSF;
+
+
+/**
+ * Sparse tensor type, adaptive linearized format (ALTO)
+ * The coordinates of each nonzero are bit-interleaved into one key of at most
+ * 128 bits, using only as many bits per mode as its size needs; a mode stops
+ * taking part in the interleaving once its bits run out. Nonzeros are sorted
+ * by key once and serve every mode.
+ */
+typedef struct {
+    sptIndex            nmodes;      /// # modes
+    sptIndex            *ndims;      /// size of each mode, length nmodes
+    sptNnzIndex         nnz;         /// # non-zeros
+    unsigned            nbits;       /// # significant key bits
+    uint64_t            *mask_lo;    /// bits of each mode in the low key word, length nmodes
+    uint64_t            *mask_hi;    /// bits of each mode in the high key word, length nmodes
+    uint64_t            *keys;       /// low key words in increasing key order, length nnz
+    uint64_t            *keys_hi;    /// high key words, NULL if nbits <= 64
+    sptValueVector      values;      /// non-zero values, length nnz
+    int                 nparts;      /// # contiguous nonzero ranges, one per thread
+    sptNnzIndex         *part_ptr;   /// range boundaries, length nparts+1
+    sptIndex            *part_lo;    /// smallest index of each mode in each range, nparts * nmodes
+    sptIndex            *part_hi;    /// largest index of each mode in each range, nparts * nmodes
+} sptSparseTensorALTO;
+
+/**
+ * Coordinate lookup index over a COO sparse tensor, see sptNewSparseTensorLookup
+ * The tensor itself is left in place: perm orders its nonzeros lexicographically,
+ * mode 0 first, for range queries, and an open-addressing hash over the
+ * coordinates answers point queries. Valid while the tensor is unchanged.
+ */
+typedef struct {
+    sptSparseTensor const *tsr;    /// the indexed tensor
+    sptNnzIndex         nnz;       /// tsr->nnz when built
+    sptNnzIndex         *perm;     /// nonzero positions in coordinate order, length nnz
+    sptNnzIndex         *slices;   /// start in perm of each mode-0 slice, length ndims[0]+1
+    sptNnzIndex         mask;      /// # hash slots - 1, a power of two minus one
+    sptNnzIndex         *slots;    /// nonzero position held by each hash slot, or PARTI_NOT_FOUND
+} sptSparseTensorLookup;
+
 
 
 /**
@@ -170,19 +635,33 @@ typedef struct {
 
 /**
  * General Semi-sparse tensor type
+ * Several modes are dense: each stored block holds every entry of the dense
+ * modes for one index of the sparse modes, e.g. the result of multiplying
+ * two or more modes of a sparse tensor by matrices. A block is row-major over
+ * dmodes in their given order, the last one padded to its stride.
  */
 typedef struct {
     sptIndex nmodes; /// # Modes, must >= 2
     sptIndex *ndims; /// size of each mode, length nmodes
-    sptIndex ndmodes;
-    sptIndex *dmodes;   /// the mode where data is stored in dense format, allocate nmodes sized space
-    sptNnzIndex nnz;    /// # non-zero fibers
-    sptIndexVector *inds;  /// indices of each dense fiber, length [nmodes][nnz], the mode-th value is ignored
-    sptIndex *strides; /// ndims[mode] rounded up to 8
-    sptMatrix     values; /// dense fibers, size nnz*ndims[mode]
+    sptIndex ndmodes;   /// # dense modes, 1 to nmodes
+    sptIndex *dmodes;   /// the modes stored in dense format, length ndmodes, in block order
+    sptNnzIndex nnz;    /// # non-zero blocks
+    sptIndexVector *inds;  /// indices of each block, length [nmodes-ndmodes][nnz], for the sparse modes in increasing order
+    sptIndex *strides; /// ndims[dmodes[d]] rounded up to 8; only the last dense mode is padded in a block
+    sptMatrix     values; /// dense blocks, one per row, nnz rows of prod_{d<ndmodes-1} ndims[dmodes[d]] * strides[ndmodes-1]
 } sptSemiSparseTensorGeneral;
 
 
+/**
+ * Dense tensor type, every entry stored, row-major with the last mode fastest
+ */
+typedef struct {
+    sptIndex nmodes;       /// # modes
+    sptIndex *ndims;       /// size of each mode, length nmodes
+    sptValueVector values; /// entries, length prod(ndims)
+} sptDenseTensor;
+
+
 /**
  * Kruskal tensor type, for CP decomposition result
  */
@@ -196,6 +675,68 @@ typedef struct {
 } sptKruskalTensor;
 
 
+/**
+ * Maximum-inner-product index over the factor of one mode of a Kruskal tensor,
+ * see sptNewKruskalIndex. The rows are clustered by k-means into lists stored
+ * contiguously; a list is skipped when its bound cannot beat the k-th best.
+ */
+typedef struct {
+    sptIndex mode;         /// the indexed mode
+    sptIndex nrows;        /// # rows of the indexed factor
+    sptIndex rank;         /// # columns of the indexed factor
+    sptIndex stride;       /// rank rounded up to 8, as in sptMatrix
+    sptIndex nlists;       /// # clusters
+    sptIndex * list_ptr;   /// rows of list l are list_ptr[l] .. list_ptr[l+1]-1, length nlists+1
+    sptIndex * row_ids;    /// factor row of every stored row, length nrows
+    sptValue * rows;       /// the factor rows in list order, nrows*stride
+    sptValue * centroids;  /// list centroids, nlists*stride
+    sptValue * radius;     /// largest distance of a row of each list to its centroid, length nlists
+} sptKruskalIndex;
+
+
+/**
+ * Online CP-ALS state for a Kruskal tensor that grows along one time mode
+ */
+typedef struct {
+    sptIndex nmodes;       /// # modes
+    sptIndex rank;         /// CPD rank
+    sptIndex time_mode;    /// the mode new slices are appended to
+    double forget;         /// weight of the history at each update, in (0, 1]
+    sptMatrix ** ata;      /// Gram matrix of every factor, length nmodes+1, the last one is scratch
+    sptMatrix * slice_ata; /// Gram matrix of the newest time rows
+    sptMatrix ** p;        /// accumulated MTTKRP of each non-time mode, ndims[m] x rank
+    sptMatrix ** q;        /// accumulated normal matrix of each non-time mode, rank x rank
+    sptMatrix * mttkrp;    /// MTTKRP output of a slice
+    sptMatrix * rows;      /// time rows of the latest slice
+} sptOnlineCpd;
+
+
+/**
+ * Tucker tensor type, for Tucker decomposition result
+ */
+typedef struct {
+  sptIndex nmodes;
+  sptIndex * ndims;
+  sptIndex * ranks;
+  double fit;
+  sptMatrix ** factors;  /// ndims[m] x ranks[m], orthonormal columns
+  sptValue * core;       /// dense, row-major over ranks[0] x ... x ranks[nmodes-1]
+} sptTuckerTensor;
+
+
+/**
+ * Tensor train type, for TT decomposition result:
+ * X(i_0, .., i_{N-1}) = G_0(i_0) G_1(i_1) .. G_{N-1}(i_{N-1}), G_k(i_k) a ranks[k] x ranks[k+1] matrix
+ */
+typedef struct {
+  sptIndex nmodes;
+  sptIndex * ndims;
+  sptIndex * ranks;      /// nmodes + 1 TT ranks, ranks[0] = ranks[nmodes] = 1
+  double fit;
+  sptValue ** cores;     /// core k dense, row-major over ranks[k] x ndims[k] x ranks[k+1]
+} sptTensorTrain;
+
+
 /**
  * Kruskal tensor type, for CP decomposition result. 
  * ncols = small rank (<= 256)
@@ -231,4 +772,390 @@ typedef struct
 } sptMutexPool;
 #endif
 
+/**
+ * Two-way dimension tree memoizing MTTKRP partial products of a COO tensor
+ * Half 0 holds modes [0, nsplit), half 1 holds modes [nsplit, nmodes).
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptIndex nsplit;             /// first mode of half 1
+    sptIndex rank;               /// # columns of the partial products
+    sptIndex stride;             /// row stride of the partial products
+    sptNnzIndex nnz;             /// # non-zeros of the tensor the tree was built for
+    sptNnzIndex ngroups[2];      /// # distinct index tuples of each half
+    sptNnzIndexVector gptr[2];   /// group pointers into perm, length ngroups+1
+    sptNnzIndexVector perm[2];   /// nonzeros ordered by the indices of each half
+    sptIndexVector * ginds[2];   /// index of each group on each mode of the half
+    sptValueVector partial[2];   /// tensor contracted with the other half's factors, ngroups * stride
+    int valid[2];                /// whether partial[s] matches the current factors
+} sptMttkrpDimTree;
+
+/**
+ * Ownership partition of MTTKRP output rows among threads
+ * For each mode, nonzeros are ordered by their index in that mode and cut into
+ * tk contiguous ranges; only rows cut between two ranges are shared.
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptNnzIndex nnz;             /// # non-zeros of the tensor the partition was built for
+    int tk;                      /// # threads
+    sptIndex rank;               /// # columns of the factor matrices
+    sptNnzIndexVector * perm;    /// per mode, nonzeros ordered by their index in that mode
+    sptNnzIndexVector * bounds;  /// per mode, tk+1 range boundaries into perm
+    sptValueVector scratch;      /// per-thread row accumulators
+    sptIndex stride;             /// row stride of scratch
+} sptMttkrpRowPartition;
+
+/**
+ * Privatization of the most frequent MTTKRP output rows under a byte budget
+ * For each mode, the rows with the most nonzeros get a private accumulator in
+ * every thread; all other rows are updated atomically. A mode whose output
+ * fits the budget in full is privatized entirely.
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptNnzIndex nnz;             /// # non-zeros of the tensor the rows were picked for
+    int tk;                      /// # threads
+    sptIndex rank;               /// # columns of the factor matrices
+    sptIndex stride;             /// row stride of the private accumulators
+    sptIndex * nhot;             /// per mode, # privatized rows
+    sptIndexVector * slot;       /// per mode, the private slot of each row, PARTI_HOT_ROW_NONE if none
+    sptIndexVector * rows;       /// per mode, the row of each private slot
+    sptValueVector priv;         /// per-thread accumulators, tk * max nhot * stride
+    sptValueVector scratch;      /// per-thread row buffers, tk * stride
+} sptMttkrpHotRows;
+
+/**
+ * Coarse tiles of a COO tensor sorted by sptNewMttkrpTiling
+ * Tile t holds the nonzeros [tptr[t], tptr[t+1]), which share their index
+ * >> tile_bits on every mode. Per mode, the tiles are grouped by that tile
+ * index: group g of mode m is gtiles[m][gptr[m][g] .. gptr[m][g+1]).
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptNnzIndex nnz;             /// # non-zeros of the tensor the tiles were built for
+    sptElementIndex tile_bits;   /// log2 of the tile edge
+    sptNnzIndexVector tptr;      /// tile pointers, # tiles + 1
+    sptNnzIndexVector * gptr;    /// per mode, group pointers into gtiles
+    sptNnzIndexVector * gtiles;  /// per mode, the tiles ordered by group
+} sptMttkrpTiling;
+
+/**
+ * How the modes of a CP-ALS run share the tensor layout, see sptNewCpdLayouts
+ */
+typedef enum {
+    SPT_CPD_LAYOUT_SHARED,    /// every mode reads the input tensor
+    SPT_CPD_LAYOUT_HYBRID,    /// the longest modes read copies of their own, the others the input
+    SPT_CPD_LAYOUT_PER_MODE,  /// every mode reads a copy of its own
+} sptCpdLayoutPolicy;
+
+/**
+ * Mode-specific COO copies of a tensor for CP-ALS. The copy of a mode is
+ * sorted with that mode leading, so its MTTKRP hands each thread whole
+ * output rows and needs neither atomics nor private copies.
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptCpdLayoutPolicy policy;   /// which modes have copies
+    int tk;                      /// # threads
+    sptIndex rank;               /// # columns of the factor matrices
+    sptSparseTensor ** copies;   /// per mode, the copy sorted with the mode leading, NULL where the mode reads the input
+    sptNnzIndexVector * bounds;  /// per mode with a copy, tk+1 slice boundaries of the threads' ranges
+    sptValueVector scratch;      /// per-thread row accumulators
+    sptIndex stride;             /// row stride of scratch
+    sptValue ** factors;         /// nmodes factor values of the MTTKRP being run
+    size_t bytes;                /// bytes of the copies and their slice pointers
+} sptCpdLayouts;
+
+/**
+ * COO tensor distributed across several GPUs for MTTKRP
+ * Nonzeros are cut into contiguous slice ranges of part_mode, one per device.
+ * Each device keeps its nonzeros and the factor rows they touch resident.
+ */
+typedef struct {
+    int ndevices;                /// # devices
+    int * devices;               /// CUDA device ids, length ndevices
+    sptIndex nmodes;             /// # modes
+    sptIndex * ndims;            /// global size of each mode
+    sptIndex rank;               /// # columns of the factor matrices
+    sptIndex stride;             /// row stride of the factor matrices
+    sptIndex part_mode;          /// the mode whose slices are split among devices
+    sptNnzIndex * nnz;           /// # non-zeros on each device
+    sptIndex * inds_low;         /// lowest index of each mode on each device, ndevices * nmodes
+    sptIndex * inds_high;        /// one past the highest index, ndevices * nmodes
+    sptIndex ** dev_ndims;       /// per device, local index range of each mode
+    sptIndex ** dev_inds_low;    /// per device, inds_low on the device
+    sptIndex *** dev_inds;       /// per device, local nonzero indices
+    sptValue ** dev_vals;        /// per device, local nonzero values
+    sptIndex ** dev_mats_order;  /// per device, Khatri-Rao product order
+    sptValue *** mats_header;    /// per device, factor row blocks and local MTTKRP output
+    sptValue *** dev_mats;       /// per device, device copy of mats_header
+    sptValue ** dev_scratch;     /// per device, nnz * stride products
+    sptValue * dev_full;         /// on devices[0], the reduced MTTKRP output
+    sptValue * dev_stage;        /// on devices[0], a peer device's partial output
+} sptCudaMttkrpMultiGpu;
+
+/**
+ * MTTKRP shared between the host cores and the current GPU, see sptCudaMTTKRPHybrid.
+ * The first gpu_share of the nonzeros go to the GPU, the rest to OpenMP; the
+ * share follows the throughput both sides measured in the last call.
+ */
+typedef struct {
+    double gpu_share;   /// fraction of the nonzeros given to the GPU
+    double gpu_rate;    /// nonzeros per second the GPU part last reached, 0 if not yet measured
+    double cpu_rate;    /// nonzeros per second the host part last reached, 0 if not yet measured
+    int tk;             /// # host threads, one of them drives the GPU
+    sptMatrix gpu_out;  /// the GPU part's MTTKRP output, added row-wise to mats[nmodes]
+} sptCudaMttkrpHybrid;
+
+/**
+ * Dense matrix resident on the current CUDA device, see sptDeviceUploadMatrix.
+ * Operations on device handles read and write device memory only, so a chain
+ * of GPU steps pays for one upload and one download.
+ */
+typedef struct {
+    sptIndex nrows;   /// # rows
+    sptIndex ncols;   /// # columns
+    sptIndex stride;  /// ncols rounded up to 8, as in sptMatrix
+    sptValue *values; /// device values, length nrows*stride
+} sptDeviceMatrix;
+
+/**
+ * Sparse tensor resident on the current CUDA device, see sptDeviceUploadSparseTensor.
+ * The indices are kept mode after mode, as the device sorts lay them out.
+ */
+typedef struct {
+    sptIndex nmodes;   /// # modes
+    sptIndex *ndims;   /// size of each mode, length nmodes, on the host
+    sptNnzIndex nnz;   /// # non-zeros
+    sptIndex *inds;    /// device indices, inds[m * nnz + z]
+    sptValue *values;  /// device values, length nnz
+} sptDeviceSparseTensor;
+
+/**
+ * Semi-sparse tensor resident on the current CUDA device, see sptDeviceUploadSemiSparseTensor.
+ */
+typedef struct {
+    sptIndex nmodes;   /// # modes
+    sptIndex *ndims;   /// size of each mode, length nmodes, on the host
+    sptIndex mode;     /// the dense mode
+    sptNnzIndex nnz;   /// # fibers
+    sptIndex stride;   /// ndims[mode] rounded up to 8
+    sptIndex *inds;    /// device fiber indices, inds[m * nnz + f], the mode-th run unused
+    sptValue *values;  /// device fibers, length nnz*stride
+} sptDeviceSemiSparseTensor;
+
+/**
+ * Kruskal tensor resident on the current CUDA device, see sptDeviceUploadKruskalTensor.
+ * The factors are stacked in one buffer, and the coordinate and output buffers
+ * of sptDeviceKruskalTensorScore are kept and grown, so a batch costs no allocation.
+ */
+typedef struct {
+    sptIndex nmodes;   /// # modes
+    sptIndex rank;     /// # columns of every factor
+    sptIndex stride;   /// rank rounded up to 8, as in sptMatrix
+    sptIndex *ndims;   /// size of each mode, length nmodes, on the host
+    sptIndex *rowoff;  /// device first row of each factor in values, length nmodes
+    sptValue *values;  /// device factors, (sum of ndims) * stride
+    sptValue *lambda;  /// device weights, length rank
+    sptNnzIndex cap;   /// # queries the buffers below hold
+    sptIndex *inds;    /// device query coordinates, inds[m * cap + q]
+    sptValue *out;     /// device query results, length cap
+} sptDeviceKruskalTensor;
+
+/**
+ * Backends sptMTTKRPAuto and sptCpdAlsAuto choose among
+ */
+typedef enum {
+    SPT_BACKEND_OMP_COO   = 0, /// OpenMP on the COO tensor
+    SPT_BACKEND_OMP_HICOO = 1, /// OpenMP on a HiCOO copy of the tensor
+    SPT_BACKEND_CUDA      = 2, /// the current CUDA device
+    SPT_BACKEND_HYBRID    = 3, /// the current CUDA device and the host cores together
+} sptBackend;
+
+#define SPT_NUM_BACKENDS 4
+
+/* Bins of the log2 histograms of sptSparseTensorStats, and the largest block bits it measures */
+#define SPT_STATS_BINS 64
+#define SPT_STATS_SB_BITS 8
+
+/**
+ * Shape, skew and locality of a sparse tensor, see sptSparseTensorStatistics.
+ * Counts of slices, fibers and blocks are estimated when taken from a sample;
+ * the histograms are of the sample itself. Per-mode arrays are length nmodes,
+ * the histograms nmodes * SPT_STATS_BINS: bin b of mode m counts the groups of
+ * 2^b to 2^(b+1)-1 sampled nonzeros.
+ */
+typedef struct {
+    sptIndex nmodes;             /// # modes
+    sptNnzIndex nnz;             /// # non-zeros
+    sptNnzIndex nsampled;        /// # non-zeros the statistics were taken from
+    sptIndex max_dim;            /// size of the largest mode
+    double density;              /// nnz over the product of the mode sizes
+    double * nslices;            /// per mode, # nonempty slices
+    double * max_slice;          /// per mode, nonzeros of the largest slice
+    double * slice_skew;         /// per mode, the largest slice over the mean nonempty one
+    sptNnzIndex * slice_hist;    /// per mode, slices by log2 of their nonzeros
+    double * nfibers;            /// per mode, # nonempty fibers along the mode
+    sptNnzIndex * fiber_hist;    /// per mode, fibers by log2 of their nonzeros
+    double * reuse;              /// per mode, share of nonzeros with the index of the one stored before
+    double * near;               /// per mode, share within 2^SPT_STATS_SB_BITS of the index before
+    double block_fill[SPT_STATS_SB_BITS + 1]; /// mean nonzeros per nonempty block of 2^b per mode
+} sptSparseTensorStats;
+
+/**
+ * Formats sptRecommendFormat chooses among
+ */
+typedef enum {
+    SPT_FORMAT_COO   = 0, /// sptSparseTensor
+    SPT_FORMAT_HICOO = 1, /// sptSparseTensorHiCOO
+    SPT_FORMAT_CSF   = 2, /// sptSparseTensorCSF
+} sptTensorFormat;
+
+#define SPT_NUM_FORMATS 3
+
+/**
+ * A format and its parameters, with the estimates behind the choice, see sptRecommendFormat
+ */
+typedef struct {
+    sptTensorFormat format;               /// the format recommended
+    double index_bytes[SPT_NUM_FORMATS];  /// estimated index bytes per nonzero of each format
+    sptElementIndex sb_bits;              /// HiCOO block bits
+    sptElementIndex sk_bits;              /// HiCOO kernel bits
+    sptIndex * mode_order;                /// CSF level order, length nmodes
+} sptFormatAdvice;
+
+/* Working sets of the gather latencies of sptMachineProfile: 2^(SPT_PROFILE_MIN_SET_BITS + i) bytes */
+#define SPT_PROFILE_MIN_SET_BITS 13
+#define SPT_PROFILE_NUM_SETS 14
+
+/**
+ * Measured machine parameters the tuners and cost models read, see sptCalibrateMachine
+ */
+typedef struct {
+    int nthreads;                                 /// host threads the parallel benchmarks ran with
+    double stream_bandwidth;                      /// parallel triad bandwidth, bytes per second
+    double gather_latency[SPT_PROFILE_NUM_SETS];  /// seconds per dependent random load, by working set
+    size_t l1_bytes;                              /// largest working set as fast as the smallest one
+    size_t llc_bytes;                             /// largest working set well below memory latency
+    double atomic_private;                        /// atomic adds per second, each thread on its own value
+    double atomic_shared;                         /// atomic adds per second, all threads on one value
+    double gemm_flops;                            /// square GEMM flops per second, 0 without BLAS
+    double syrk_flops;                            /// tall-matrix SYRK flops per second, 0 without BLAS
+    int has_device;                               /// whether a CUDA device was current
+    double h2d_bandwidth;                         /// pinned host to device copies, bytes per second
+    double d2h_bandwidth;                         /// device to pinned host copies, bytes per second
+    double device_bandwidth;                      /// device to device copies, bytes per second
+    size_t device_memory;                         /// device memory, bytes
+    size_t device_cache;                          /// device L2 cache, bytes
+} sptMachineProfile;
+
+/**
+ * Machine parameters of the dispatch cost model, see sptGetMachineModel
+ */
+typedef struct {
+    int ncores;               /// # host threads a parallel call gets
+    double host_bandwidth;    /// host memory bandwidth, bytes per second
+    size_t host_cache;        /// last-level cache bytes factor rows may stay in
+    int has_device;           /// whether a CUDA device is current
+    double device_bandwidth;  /// device memory bandwidth, bytes per second
+    double pcie_bandwidth;    /// host to device copy bandwidth, bytes per second
+    size_t device_memory;     /// device memory, bytes
+} sptMachineModel;
+
+/**
+ * A dispatch decision with the tensor features and predicted times behind it, see sptPlanMTTKRP
+ */
+typedef struct {
+    sptBackend backend;                /// the backend chosen
+    double seconds[SPT_NUM_BACKENDS];  /// predicted seconds of each backend, DBL_MAX where it cannot run
+    double slice_skew;                 /// nonzeros of the largest slice of the mode over the mean slice
+    double block_density;              /// estimated nonzeros per HiCOO block
+} sptDispatchPlan;
+
+/**
+ * Reusable CP-ALS/MTTKRP scratch space for one tensor shape, rank and thread count
+ */
+typedef struct {
+    sptIndex nmodes;           /// # modes
+    sptIndex rank;             /// CPD rank
+    int tk;                    /// # threads the buffers are sized for
+    sptIndex * mats_order;     /// Khatri-Rao product order, length nmodes
+    sptMatrix * mttkrp;        /// MTTKRP output, max_dim * rank
+    sptMatrix ** ata;          /// Gram matrices, length nmodes+1
+    sptMatrix ** copy_mats;    /// per-thread reduction buffers, length tk, NULL if not privatized
+    sptValueVector scratch;    /// per-thread row buffers, tk * scratch_stride
+    sptIndex scratch_stride;   /// padded row buffer length
+    sptIndex fit_every;        /// CP-ALS evaluates the fit every fit_every iterations and at the last
+    sptMttkrpDimTree * dimtree; /// memoized MTTKRP for CP-ALS, NULL if not used
+    sptMttkrpRowPartition * rowpart; /// row ownership for MTTKRP, NULL if not used
+    sptMttkrpHotRows * hotrows; /// per-mode privatized rows for MTTKRP, NULL if not used
+    sptMttkrpTiling * tiling;  /// cache tiles for MTTKRP, NULL if not used
+    sptCpdLayouts * layouts;   /// mode-specific tensor copies for MTTKRP, NULL if not used
+#ifdef PARTI_USE_OPENMP
+    sptMutexPool * lock_pool;  /// row locks, NULL if not used
+#endif
+} sptCpdWorkspace;
+
+/**
+ * How the CP-ALS drivers start when given no factors, see sptSetCpdInit
+ */
+typedef enum {
+    SPT_CPD_INIT_RANDOM = 0,   /// uniform random factors
+    SPT_CPD_INIT_RANGE = 1,    /// bases of MTTKRPs with Gaussian factors
+    SPT_CPD_INIT_HOSVD = 2,    /// truncated HOSVD from the range bases
+    SPT_CPD_INIT_SAMPLED = 3,  /// a few randomized CP-ALS iterations
+} sptCpdInit;
+
+/**
+ * Predicted bytes of a planned run at its peak, by what holds them
+ */
+typedef struct {
+    size_t tensor;      /// the sparse tensor, and the one it is converted into if any
+    size_t factors;     /// factor matrices, lambda, MTTKRP output and Gram matrices
+    size_t scratch;     /// per-thread rows, sort buffers and line search copies
+    size_t privatized;  /// per-thread copies of output rows, or row locks
+    size_t peak;        /// the sum of the above
+} sptMemoryEstimate;
+
+/*
+ * Arrow C Data Interface, see https://arrow.apache.org/docs/format/CDataInterface.html.
+ * The definitions are those of the specification, so any Arrow library
+ * (pyarrow, Arrow C++, DuckDB, ...) can hand its columns to
+ * sptImportArrowSparseTensor without ParTI! linking against it.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
 #endif
\ No newline at end of file
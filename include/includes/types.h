@@ -19,6 +19,7 @@
 #ifndef PARTI_TYPES_H
 #define PARTI_TYPES_H
 
+#include <float.h>
 #include <stdint.h>
 
 /**
@@ -38,7 +39,7 @@
   typedef uint64_t sptIndex;
   typedef uint64_t sptBlockIndex;
   #define PARTI_INDEX_MAX UINT64_MAX
-  #define PARTI_PFI_INDEX PRIu64
+  #define PARTI_PRI_INDEX PRIu64
   #define PARTI_SCN_INDEX SCNu64
   #define PARTI_PRI_BLOCK_INDEX PRIu64
   #define PARTI_SCN_BLOCK_INDEX SCNu64
@@ -50,14 +51,29 @@
   typedef float sptValue;
   #define PARTI_PRI_VALUE "f"
   #define PARTI_SCN_VALUE "f"
+  #define PARTI_VALUE_EPSILON FLT_EPSILON
 #elif PARTI_VALUE_TYPEWIDTH == 64
   typedef double sptValue;
   #define PARTI_PRI_VALUE "lf"
   #define PARTI_SCN_VALUE "lf"
+  #define PARTI_VALUE_EPSILON DBL_EPSILON
 #else
   #error "Unrecognized PARTI_VALUE_TYPEWIDTH."
 #endif
 
+#ifdef PARTI_USE_MPI
+  #if PARTI_VALUE_TYPEWIDTH == 32
+    #define PARTI_MPI_VALUE MPI_FLOAT
+  #else
+    #define PARTI_MPI_VALUE MPI_DOUBLE
+  #endif
+  #if PARTI_INDEX_TYPEWIDTH == 32
+    #define PARTI_MPI_INDEX MPI_UINT32_T
+  #else
+    #define PARTI_MPI_INDEX MPI_UINT64_T
+  #endif
+#endif
+
 #if PARTI_ELEMENT_INDEX_TYPEWIDTH == 8
   typedef uint8_t sptElementIndex;
   typedef uint16_t sptBlockMatrixIndex;  // R < 256
@@ -68,14 +84,14 @@
 #elif PARTI_ELEMENT_INDEX_TYPEWIDTH == 16
   typedef uint16_t sptElementIndex;
   typedef uint32_t sptBlockMatrixIndex;
-  #define PARTI_PFI_ELEMENT_INDEX PRIu16
+  #define PARTI_PRI_ELEMENT_INDEX PRIu16
   #define PARTI_SCN_ELEMENT_INDEX SCNu16
   #define PARTI_PRI_BLOCKMATRIX_INDEX PRIu32
   #define PARTI_SCN_BLOCKMATRIX_INDEX SCNu32
 #elif PARTI_ELEMENT_INDEX_TYPEWIDTH == 32
   typedef uint32_t sptElementIndex;
   typedef uint32_t sptBlockMatrixIndex;
-  #define PARTI_PFI_ELEMENT_INDEX PRIu32
+  #define PARTI_PRI_ELEMENT_INDEX PRIu32
   #define PARTI_SCN_ELEMENT_INDEX SCNu32
   #define PARTI_PRI_BLOCKMATRIX_INDEX PRIu32
   #define PARTI_SCN_BLOCKMATRIX_INDEX SCNu32
@@ -89,7 +105,7 @@ typedef sptBlockIndex sptBlockNnzIndex;
 
 typedef uint64_t sptNnzIndex;
 #define PARTI_PRI_NNZ_INDEX PRIu64
-#define PARTI_SCN_NNZ_INDEX PRIu64
+#define PARTI_SCN_NNZ_INDEX SCNu64
 
 typedef unsigned __int128 sptMortonIndex;
 // typedef __uint128_t sptMortonIndex;
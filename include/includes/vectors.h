@@ -33,6 +33,8 @@ int sptConstantValueVector(sptValueVector * const vec, sptValue const val);
 int sptCopyValueVector(sptValueVector *dest, const sptValueVector *src, int const nt);
 int sptAppendValueVector(sptValueVector *vec, sptValue const value);
 int sptAppendValueVectorWithVector(sptValueVector *vec, const sptValueVector *append_vec);
+int sptReserveValueVector(sptValueVector *vec, sptNnzIndex const cap);
+int sptAppendValueVectorN(sptValueVector *vec, const sptValue *values, sptNnzIndex const n);
 int sptResizeValueVector(sptValueVector *vec, sptNnzIndex const size);
 void sptFreeValueVector(sptValueVector *vec);
 int sptDumpValueIndexVector(sptValueVector *vec, FILE *fp);
@@ -43,6 +45,8 @@ int sptConstantIndexVector(sptIndexVector * const vec, sptIndex const num);
 int sptCopyIndexVector(sptIndexVector *dest, const sptIndexVector *src, int const nt);
 int sptAppendIndexVector(sptIndexVector *vec, sptIndex const value);
 int sptAppendIndexVectorWithVector(sptIndexVector *vec, const sptIndexVector *append_vec);
+int sptReserveIndexVector(sptIndexVector *vec, sptNnzIndex const cap);
+int sptAppendIndexVectorN(sptIndexVector *vec, const sptIndex *values, sptNnzIndex const n);
 int sptResizeIndexVector(sptIndexVector *vec, sptNnzIndex const size);
 void sptFreeIndexVector(sptIndexVector *vec);
 int sptDumpIndexVector(sptIndexVector *vec, FILE *fp);
@@ -53,6 +57,8 @@ int sptConstantElementIndexVector(sptElementIndexVector * const vec, sptElementI
 int sptCopyElementIndexVector(sptElementIndexVector *dest, const sptElementIndexVector *src);
 int sptAppendElementIndexVector(sptElementIndexVector *vec, sptElementIndex const value);
 int sptAppendElementIndexVectorWithVector(sptElementIndexVector *vec, const sptElementIndexVector *append_vec);
+int sptReserveElementIndexVector(sptElementIndexVector *vec, sptNnzIndex const cap);
+int sptAppendElementIndexVectorN(sptElementIndexVector *vec, const sptElementIndex *values, sptNnzIndex const n);
 int sptResizeElementIndexVector(sptElementIndexVector *vec, sptNnzIndex const size);
 void sptFreeElementIndexVector(sptElementIndexVector *vec);
 int sptDumpElementIndexVector(sptElementIndexVector *vec, FILE *fp);
@@ -63,6 +69,8 @@ int sptConstantBlockIndexVector(sptBlockIndexVector * const vec, sptBlockIndex c
 int sptCopyBlockIndexVector(sptBlockIndexVector *dest, const sptBlockIndexVector *src);
 int sptAppendBlockIndexVector(sptBlockIndexVector *vec, sptBlockIndex const value);
 int sptAppendBlockIndexVectorWithVector(sptBlockIndexVector *vec, const sptBlockIndexVector *append_vec);
+int sptReserveBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex const cap);
+int sptAppendBlockIndexVectorN(sptBlockIndexVector *vec, const sptBlockIndex *values, sptNnzIndex const n);
 int sptResizeBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex const size);
 void sptFreeBlockIndexVector(sptBlockIndexVector *vec);
 int sptDumpBlockIndexVector(sptBlockIndexVector *vec, FILE *fp);
@@ -73,6 +81,8 @@ int sptConstantNnzIndexVector(sptNnzIndexVector * const vec, sptNnzIndex const n
 int sptCopyNnzIndexVector(sptNnzIndexVector *dest, const sptNnzIndexVector *src);
 int sptAppendNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const value);
 int sptAppendNnzIndexVectorWithVector(sptNnzIndexVector *vec, const sptNnzIndexVector *append_vec);
+int sptReserveNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const cap);
+int sptAppendNnzIndexVectorN(sptNnzIndexVector *vec, const sptNnzIndex *values, sptNnzIndex const n);
 int sptResizeNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const size);
 void sptFreeNnzIndexVector(sptNnzIndexVector *vec);
 int sptDumpNnzIndexVector(sptNnzIndexVector *vec, FILE *fp);
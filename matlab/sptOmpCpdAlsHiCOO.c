@@ -0,0 +1,71 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "matrix.h"
+#include "mex.h"
+#include "sptmx.h"
+
+/*
+ * [factors, lambda, fit] = sptOmpCpdAlsHiCOO(hitsr, rank, niters, tol, tk)
+ *
+ * factors is a 1-by-nmodes cell of ndims(m)-by-rank double matrices.
+ */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    spt_mxCheckArgs("sptOmpCpdAlsHiCOO", 3, "Three", 5, "Five");
+
+    sptSparseTensorHiCOO *hitsr = spt_mxGetPointer(prhs[0], 0);
+    size_t rank = mxGetScalar(prhs[1]);
+    size_t niters = mxGetScalar(prhs[2]);
+    double tol = mxGetScalar(prhs[3]);
+    int tk = mxGetScalar(prhs[4]);
+    if(rank == 0 || rank > 255) {
+        mexErrMsgIdAndTxt("ParTI:sptOmpCpdAlsHiCOO", "rank should be between 1 and 255");
+    }
+
+    sptRankKruskalTensor ktensor;
+    if(sptNewRankKruskalTensor(&ktensor, hitsr->nmodes, hitsr->ndims, (sptElementIndex) rank) != 0) {
+        mexErrMsgIdAndTxt("ParTI:sptOmpCpdAlsHiCOO", "Cannot allocate the Kruskal tensor.");
+    }
+    if(sptOmpCpdAlsHiCOO(hitsr, rank, niters, tol, tk, &ktensor) != 0) {
+        sptFreeRankKruskalTensor(&ktensor);
+        mexErrMsgIdAndTxt("ParTI:sptOmpCpdAlsHiCOO", "CP-ALS failed.");
+    }
+
+    /* Factors are row major with a padded stride, MATLAB matrices column major */
+    plhs[0] = mxCreateCellMatrix(1, hitsr->nmodes);
+    size_t m, i, r;
+    for(m = 0; m < hitsr->nmodes; ++m) {
+        sptRankMatrix const *A = ktensor.factors[m];
+        mxArray *cell = mxCreateDoubleMatrix(A->nrows, rank, mxREAL);
+        double *data = mxGetPr(cell);
+        for(i = 0; i < A->nrows; ++i) {
+            for(r = 0; r < rank; ++r) {
+                data[r * A->nrows + i] = A->values[i * A->stride + r];
+            }
+        }
+        mxSetCell(plhs[0], m, cell);
+    }
+    plhs[1] = mxCreateDoubleMatrix(1, rank, mxREAL);
+    for(r = 0; r < rank; ++r) {
+        mxGetPr(plhs[1])[r] = ktensor.lambda[r];
+    }
+    plhs[2] = mxCreateDoubleScalar(ktensor.fit);
+    sptFreeRankKruskalTensor(&ktensor);
+}
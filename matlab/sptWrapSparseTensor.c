@@ -0,0 +1,95 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "matrix.h"
+#include "mex.h"
+#include "sptmx.h"
+
+spt_DefineCastArray(spt_mxArrayToIndex, sptIndex)
+spt_DefineCastArray(spt_mxArrayToValue, sptValue)
+
+/*
+ * X = sptWrapSparseTensor(ndims, inds, values[, start_idx])
+ *
+ * inds is an nnz-by-nmodes matrix, one column per mode, values an nnz
+ * vector. Arrays already of the class of sptIndex and sptValue, with
+ * start_idx 0, are used in place, without a copy; others are converted.
+ * In-place arrays must outlive X and not be shared with another variable,
+ * as sorting X, which CP-ALS does, reorders them.
+ */
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+    if(nrhs == 3) {
+        spt_mxCheckArgs("sptWrapSparseTensor", 1, "One", 3, "Three");
+    } else {
+        spt_mxCheckArgs("sptWrapSparseTensor", 1, "One", 4, "Four");
+    }
+
+    size_t nmodes = mxGetNumberOfElements(prhs[0]);
+    size_t nnz = mxGetM(prhs[1]);
+    size_t start_idx = nrhs == 4 ? (size_t) mxGetScalar(prhs[3]) : 0;
+    if(mxGetN(prhs[1]) != nmodes || mxGetNumberOfElements(prhs[2]) != nnz) {
+        mexErrMsgIdAndTxt("ParTI:sptWrapSparseTensor", "inds should be nnz-by-nmodes and values of length nnz");
+    }
+    if(!mxIsNumeric(prhs[1]) || !mxIsNumeric(prhs[2]) || mxIsComplex(prhs[1]) || mxIsComplex(prhs[2])) {
+        mexErrMsgIdAndTxt("ParTI:sptWrapSparseTensor", "inds and values should be real numeric arrays");
+    }
+
+    spt_mxWrappedTensor *wrapped = malloc(sizeof *wrapped);
+    sptIndex *ndims = spt_mxArrayToIndex(prhs[0]);
+    sptIndex **inds = malloc(nmodes * sizeof *inds);
+    sptValue *values;
+    wrapped->owned_inds = NULL;
+    wrapped->owned_values = NULL;
+    if(mxGetClassID(prhs[1]) == spt_mxIndexClass() && start_idx == 0) {
+        sptIndex *data = mxGetData(prhs[1]);
+        size_t m;
+        for(m = 0; m < nmodes; ++m) {
+            inds[m] = data + m * nnz;
+        }
+    } else {
+        wrapped->owned_inds = spt_mxArrayToIndex(prhs[1]);
+        size_t i, m;
+        for(i = 0; i < nnz * nmodes; ++i) {
+            wrapped->owned_inds[i] -= start_idx;
+        }
+        for(m = 0; m < nmodes; ++m) {
+            inds[m] = wrapped->owned_inds + m * nnz;
+        }
+    }
+    if(mxGetClassID(prhs[2]) == spt_mxValueClass()) {
+        values = mxGetData(prhs[2]);
+    } else {
+        wrapped->owned_values = spt_mxArrayToValue(prhs[2]);
+        values = wrapped->owned_values;
+    }
+
+    int result = sptWrapSparseTensor(&wrapped->tsr, nmodes, ndims, nnz, inds, values);
+    free(inds);
+    free(ndims);
+    if(result) {
+        free(wrapped->owned_inds);
+        free(wrapped->owned_values);
+        free(wrapped);
+        wrapped = NULL;
+    }
+
+    mexCallMATLAB(nlhs, plhs, 0, NULL, "sptSparseTensor");
+    spt_mxSetPointer(plhs[0], 0, wrapped);
+}
@@ -173,3 +173,40 @@ static inline void spt_mxSetPointer(mxArray *pa, mwIndex idx, void *ptr) {
     mxSetProperty(pa, idx, "ptr", mxptr);
     mxDestroyArray(mxptr);
 }
+
+/*
+ * A tensor made by sptWrapSparseTensor: tsr points at the MATLAB arrays
+ * when their class matches sptIndex and sptValue, else at owned_inds and
+ * owned_values, converted copies freed by sptUnwrapSparseTensor.
+ */
+typedef struct {
+    sptSparseTensor tsr;
+    sptIndex *owned_inds;
+    sptValue *owned_values;
+} spt_mxWrappedTensor;
+
+/* The MATLAB class storing sptIndex as is, or mxUNKNOWN_CLASS */
+static inline mxClassID spt_mxIndexClass(void) {
+    switch(sizeof (sptIndex)) {
+    case 2:
+        return mxUINT16_CLASS;
+    case 4:
+        return mxUINT32_CLASS;
+    case 8:
+        return mxUINT64_CLASS;
+    default:
+        return mxUNKNOWN_CLASS;
+    }
+}
+
+/* The MATLAB class storing sptValue as is, or mxUNKNOWN_CLASS */
+static inline mxClassID spt_mxValueClass(void) {
+    switch(sizeof (sptValue)) {
+    case 4:
+        return mxSINGLE_CLASS;
+    case 8:
+        return mxDOUBLE_CLASS;
+    default:
+        return mxUNKNOWN_CLASS;
+    }
+}
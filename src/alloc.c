@@ -0,0 +1,486 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+#if defined(__GNUC__)
+    #define SPT_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define SPT_THREAD_LOCAL _Thread_local
+#endif
+
+/* MEMCHECK_MODE gives every temporary its own allocation for the memory checker */
+#if defined(SPT_THREAD_LOCAL) && !defined(MEMCHECK_MODE)
+    #define SPT_USE_SCRATCH_ARENA
+#endif
+
+/* Buffers from sptMalloc are preceded by this header, padded to PARTI_VECTOR_ALIGN */
+typedef struct {
+    uint64_t magic;         /// SPT_ALLOC_MAGIC, tells library buffers from mapped files
+    size_t bytes;           /// bytes obtained, header included
+    sptMemBacking request;  /// backing asked for, kept when the buffer is regrown
+    sptMemBacking backing;  /// backing obtained
+    sptAllocator owner;     /// the allocator for custom buffers
+} spt_AllocHeader;
+
+#define SPT_ALLOC_MAGIC UINT64_C(0x5061725449416c63)
+#define SPT_ALLOC_HEADER_BYTES ((sizeof (spt_AllocHeader) + PARTI_VECTOR_ALIGN - 1) / PARTI_VECTOR_ALIGN * PARTI_VECTOR_ALIGN)
+
+#ifdef PARTI_USE_CUDA
+/* Page-locked host memory and managed memory, in cudawrap.cu */
+void * spt_CudaHostAlloc(size_t bytes);
+void spt_CudaHostFree(void * ptr);
+void * spt_CudaManagedAlloc(size_t bytes);
+void spt_CudaManagedFree(void * ptr);
+#endif
+
+static sptAllocator spt_allocator = { NULL, NULL, NULL };
+static sptMemBacking spt_default_backing = SPT_MEM_DEFAULT;
+
+/**
+ * Route the library's vector and matrix buffers and scratch memory through a
+ * custom allocator, or back to the default one with NULL.
+ *
+ * `alloc` must return memory aligned to PARTI_VECTOR_ALIGN. Buffers remember
+ * the allocator they came from, so switching does not break existing ones,
+ * but it is not thread-safe and should happen before work starts.
+ */
+void sptSetAllocator(sptAllocator const * allocator) {
+    if(allocator != NULL && allocator->alloc != NULL) {
+        spt_allocator = *allocator;
+    } else {
+        spt_allocator.alloc = NULL;
+        spt_allocator.release = NULL;
+        spt_allocator.ctx = NULL;
+    }
+}
+
+/**
+ * Set the backing of buffers allocated without an explicit request:
+ * SPT_MEM_DEFAULT for the heap, SPT_MEM_HUGE_2MB or SPT_MEM_HUGE_1GB for huge
+ * pages, SPT_MEM_PINNED for page-locked memory, SPT_MEM_MANAGED for CUDA
+ * managed memory. See sptMallocBacked.
+ */
+void sptSetHugePages(sptMemBacking const backing) {
+    spt_default_backing = backing;
+}
+
+/* Name of a backing, for status reports */
+char const * sptMemBackingString(sptMemBacking const backing) {
+    switch(backing) {
+    case SPT_MEM_HUGE_2MB:
+        return "2MB huge pages";
+    case SPT_MEM_HUGE_1GB:
+        return "1GB huge pages";
+    case SPT_MEM_THP:
+        return "transparent huge pages";
+    case SPT_MEM_CUSTOM:
+        return "custom allocator";
+    case SPT_MEM_FILE:
+        return "mapped file";
+    case SPT_MEM_PINNED:
+        return "pinned host memory";
+    case SPT_MEM_HBM:
+        return "high-bandwidth memory";
+    case SPT_MEM_MANAGED:
+        return "CUDA managed memory";
+    case SPT_MEM_CAPACITY:
+        return "capacity-tier memory";
+    default:
+        return "heap";
+    }
+}
+
+#ifdef __linux__
+/*
+ * Anonymous mapping of *bytes with huge pages of the requested size, rounded
+ * up to them; transparent huge pages if none are reserved. NULL on failure.
+ */
+static void * spt_MapHugePages(size_t * const bytes, sptMemBacking * const backing) {
+    size_t page = PARTI_HUGE_PAGE_BYTES;
+    int flags = 0;
+#ifdef MAP_HUGETLB
+    flags = MAP_HUGETLB;
+#if defined(MAP_HUGE_1GB) && defined(MAP_HUGE_2MB)
+    if(*backing == SPT_MEM_HUGE_1GB && *bytes >= ((size_t) 1 << 30)) {
+        page = (size_t) 1 << 30;
+        flags |= MAP_HUGE_1GB;
+    } else {
+        *backing = SPT_MEM_HUGE_2MB;
+        flags |= MAP_HUGE_2MB;
+    }
+#else
+    *backing = SPT_MEM_HUGE_2MB;
+#endif
+#endif
+    void * base = MAP_FAILED;
+    size_t len = (*bytes + page - 1) / page * page;
+    if(flags != 0) {
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    }
+    if(base == MAP_FAILED) {
+        len = (*bytes + PARTI_HUGE_PAGE_BYTES - 1) / PARTI_HUGE_PAGE_BYTES * PARTI_HUGE_PAGE_BYTES;
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(base, len, MADV_HUGEPAGE);
+#endif
+        *backing = SPT_MEM_THP;
+    }
+    *bytes = len;
+    return base;
+}
+#endif
+
+/**
+ * Allocate bytes aligned to PARTI_VECTOR_ALIGN, backed as requested.
+ *
+ * SPT_MEM_HUGE_2MB and SPT_MEM_HUGE_1GB map buffers of PARTI_HUGE_PAGE_BYTES
+ * or more with explicit huge pages, and fall back to transparent huge pages
+ * when none are reserved; smaller buffers and other systems use the heap.
+ * SPT_MEM_PINNED page-locks the buffer with CUDA so copies to and from the
+ * device run at full bandwidth; without CUDA it uses the heap.
+ * SPT_MEM_MANAGED takes CUDA managed memory, which CUDA kernels read in
+ * place and the driver pages between host and device, so a tensor somewhat
+ * larger than device memory still runs there; without CUDA it uses the heap.
+ * SPT_MEM_HBM takes high-bandwidth memory from memkind or its NUMA nodes,
+ * and the heap once there is none left, see hbm.c. SPT_MEM_CAPACITY takes
+ * capacity-tier memory, CXL-attached or PMEM, else the heap, see tier.c.
+ * SPT_MEM_DEFAULT follows the execution context, else sptSetHugePages. A
+ * custom allocator, the context's or sptSetAllocator's, takes every
+ * request. The request sticks to the buffer, see spt_Realloc, and
+ * sptMemBackingOf reports what was obtained. Release with sptFree. NULL on
+ * failure.
+ */
+void * sptMallocBacked(size_t const bytes, sptMemBacking request) {
+    /* The calling thread's execution context comes before the process-wide settings */
+    sptExecContext const * const exec = sptGetExecContext();
+    sptAllocator const allocator = exec != NULL && exec->allocator != NULL && exec->allocator->alloc != NULL ?
+        *exec->allocator : spt_allocator;
+    if(request == SPT_MEM_DEFAULT) {
+        request = exec != NULL && exec->backing != SPT_MEM_DEFAULT ? exec->backing : spt_default_backing;
+    }
+    size_t total = SPT_ALLOC_HEADER_BYTES + bytes;
+    spt_AllocHeader * header = NULL;
+    sptMemBacking backing = SPT_MEM_DEFAULT;
+    if(allocator.alloc != NULL) {
+        header = allocator.alloc(total, allocator.ctx);
+        backing = SPT_MEM_CUSTOM;
+    } else {
+#ifdef __linux__
+        if((request == SPT_MEM_HUGE_2MB || request == SPT_MEM_HUGE_1GB) && bytes >= PARTI_HUGE_PAGE_BYTES) {
+            backing = request;
+            header = spt_MapHugePages(&total, &backing);
+        }
+#endif
+#ifdef PARTI_USE_CUDA
+        if(request == SPT_MEM_PINNED) {
+            backing = SPT_MEM_PINNED;
+            header = spt_CudaHostAlloc(total);
+        }
+        if(request == SPT_MEM_MANAGED) {
+            backing = SPT_MEM_MANAGED;
+            header = spt_CudaManagedAlloc(total);
+        }
+#endif
+        if(request == SPT_MEM_HBM) {
+            backing = SPT_MEM_HBM;
+            header = spt_HbmAlloc(total);
+        }
+        if(request == SPT_MEM_CAPACITY) {
+            backing = SPT_MEM_CAPACITY;
+            header = spt_CapacityAlloc(total);
+        }
+        if(header == NULL) {
+            backing = SPT_MEM_DEFAULT;
+#if _POSIX_C_SOURCE >= 200112L
+            if(posix_memalign((void **) &header, PARTI_VECTOR_ALIGN, total) != 0) {
+                header = NULL;
+            }
+#else
+            header = malloc(total);
+#endif
+        }
+    }
+    if(header == NULL) {
+        return NULL;
+    }
+    header->magic = SPT_ALLOC_MAGIC;
+    header->bytes = total;
+    header->request = request;
+    header->backing = backing;
+    header->owner = allocator;
+    return (char *) header + SPT_ALLOC_HEADER_BYTES;
+}
+
+/**
+ * Allocate bytes aligned to PARTI_VECTOR_ALIGN with the default backing,
+ * see sptMallocBacked. Release with sptFree. NULL on failure.
+ */
+void * sptMalloc(size_t const bytes) {
+    return sptMallocBacked(bytes, SPT_MEM_DEFAULT);
+}
+
+/**
+ * Allocate bytes aligned to PARTI_VECTOR_ALIGN in a shared mapping of a file,
+ * so the kernel pages them in on touch and writes them back under memory
+ * pressure, for buffers far larger than memory.
+ *
+ * The file at path is created or truncated and keeps the buffer, behind its
+ * header, once released; with a NULL path an unnamed file in $TMPDIR, or
+ * /tmp, backs it and disappears with it. sptMemBackingOf reports
+ * SPT_MEM_FILE. Release with sptFree. NULL with errno set on failure.
+ */
+void * spt_MallocFileBacked(size_t const bytes, char const * path) {
+#ifdef __linux__
+    int fd;
+    if(path != NULL) {
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    } else {
+        char const * dir = getenv("TMPDIR");
+        char name[4096];
+        snprintf(name, sizeof name, "%s/parti_XXXXXX", dir != NULL && dir[0] != '\0' ? dir : "/tmp");
+        fd = mkstemp(name);
+        if(fd >= 0) {
+            unlink(name);
+        }
+    }
+    if(fd < 0) {
+        return NULL;
+    }
+    size_t const total = SPT_ALLOC_HEADER_BYTES + bytes;
+    void * base = MAP_FAILED;
+    if(ftruncate(fd, (off_t) total) == 0) {
+        base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(base == MAP_FAILED) {
+        return NULL;
+    }
+    spt_AllocHeader * const header = base;
+    header->magic = SPT_ALLOC_MAGIC;
+    header->bytes = total;
+    header->request = SPT_MEM_DEFAULT;
+    header->backing = SPT_MEM_FILE;
+    header->owner.alloc = NULL;
+    header->owner.release = NULL;
+    header->owner.ctx = NULL;
+    return (char *) header + SPT_ALLOC_HEADER_BYTES;
+#else
+    (void) bytes;
+    (void) path;
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
+/* Header of a buffer from sptMalloc */
+static spt_AllocHeader * spt_AllocHeaderOf(void const * ptr) {
+    return (spt_AllocHeader *) ((char *) ptr - SPT_ALLOC_HEADER_BYTES);
+}
+
+/**
+ * The backing a vector or matrix buffer got; SPT_MEM_DEFAULT for the heap or
+ * NULL, SPT_MEM_FILE for the arrays of a tensor from sptMmapSparseTensor and
+ * buffers from spt_MallocFileBacked.
+ */
+sptMemBacking sptMemBackingOf(void const * ptr) {
+    if(ptr == NULL) {
+        return SPT_MEM_DEFAULT;
+    }
+    spt_AllocHeader const * const header = spt_AllocHeaderOf(ptr);
+    return header->magic == SPT_ALLOC_MAGIC ? header->backing : SPT_MEM_FILE;
+}
+
+/* The backing requested for a buffer from sptMalloc, SPT_MEM_DEFAULT for NULL or a mapped file */
+sptMemBacking spt_MemRequestOf(void const * ptr) {
+    if(ptr == NULL || spt_AllocHeaderOf(ptr)->magic != SPT_ALLOC_MAGIC) {
+        return SPT_MEM_DEFAULT;
+    }
+    return spt_AllocHeaderOf(ptr)->request;
+}
+
+/*
+ * Move the first used bytes of a buffer from sptMalloc, or NULL, to a new one
+ * of bytes. It keeps the backing requested for the old buffer unless request
+ * is given. NULL on failure with ptr left alone.
+ */
+void * spt_Realloc(void * ptr, size_t const used, size_t const bytes, sptMemBacking request) {
+    if(request == SPT_MEM_DEFAULT) {
+        request = spt_MemRequestOf(ptr);
+    }
+    void * newptr = sptMallocBacked(bytes, request);
+    if(newptr != NULL && ptr != NULL) {
+        memcpy(newptr, ptr, used < bytes ? used : bytes);
+        sptFree(ptr);
+    }
+    return newptr;
+}
+
+/**
+ * Release a buffer from sptMalloc back to where it came from; NULL is ignored.
+ */
+void sptFree(void * ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    spt_AllocHeader * const header = spt_AllocHeaderOf(ptr);
+    header->magic = 0;
+    switch(header->backing) {
+    case SPT_MEM_CUSTOM:
+        header->owner.release(header, header->bytes, header->owner.ctx);
+        break;
+#ifdef __linux__
+    case SPT_MEM_HUGE_2MB:
+    case SPT_MEM_HUGE_1GB:
+    case SPT_MEM_THP:
+    case SPT_MEM_FILE:
+        munmap(header, header->bytes);
+        break;
+#endif
+#ifdef PARTI_USE_CUDA
+    case SPT_MEM_PINNED:
+        spt_CudaHostFree(header);
+        break;
+    case SPT_MEM_MANAGED:
+        spt_CudaManagedFree(header);
+        break;
+#endif
+    case SPT_MEM_HBM:
+        spt_HbmFree(header, header->bytes);
+        break;
+    case SPT_MEM_CAPACITY:
+        spt_CapacityFree(header, header->bytes);
+        break;
+    default:
+        free(header);
+    }
+}
+
+
+/* Scratch blocks are stacked in a per-thread arena, each behind this header */
+typedef struct spt_ScratchHeader {
+    struct spt_ScratchHeader * prev; /// the block below, NULL for the first
+    int freed;                       /// released but not yet popped
+    int in_arena;                    /// 0 if the arena was full and it came from sptMalloc
+} spt_ScratchHeader;
+
+#define SPT_SCRATCH_HEADER_BYTES ((sizeof (spt_ScratchHeader) + PARTI_VECTOR_ALIGN - 1) / PARTI_VECTOR_ALIGN * PARTI_VECTOR_ALIGN)
+
+typedef struct {
+    char * base;                /// arena buffer, from sptMalloc
+    size_t cap;                 /// its size
+    size_t top;                 /// bytes in use
+    spt_ScratchHeader * last;   /// topmost block, NULL when empty
+    size_t want;                /// size to grow to the next time it is empty
+} spt_ScratchArena;
+
+#ifdef SPT_USE_SCRATCH_ARENA
+static SPT_THREAD_LOCAL spt_ScratchArena spt_scratch = { NULL, 0, 0, NULL, PARTI_SCRATCH_BYTES };
+#endif
+
+/**
+ * Allocate a temporary from the calling thread's scratch arena, aligned to
+ * PARTI_VECTOR_ALIGN. Meant for short-lived per-call buffers, so that kernels
+ * called in a loop, or from many threads at once, stop going through malloc.
+ * Release with spt_ScratchFree in any order; space is reused once the blocks
+ * above are released too. Requests the arena cannot hold fall back to
+ * sptMalloc and grow it for next time. NULL on failure.
+ */
+void * spt_ScratchAlloc(size_t const bytes) {
+    size_t const need = SPT_SCRATCH_HEADER_BYTES + (bytes + PARTI_VECTOR_ALIGN - 1) / PARTI_VECTOR_ALIGN * PARTI_VECTOR_ALIGN;
+    spt_ScratchHeader * header;
+#ifdef SPT_USE_SCRATCH_ARENA
+    spt_ScratchArena * const arena = &spt_scratch;
+    if(arena->last == NULL && arena->want > arena->cap) {
+        sptFree(arena->base);
+        arena->base = sptMalloc(arena->want);
+        arena->cap = arena->base != NULL ? arena->want : 0;
+        arena->top = 0;
+    }
+    if(arena->top + need <= arena->cap) {
+        header = (spt_ScratchHeader *) (arena->base + arena->top);
+        header->prev = arena->last;
+        header->freed = 0;
+        header->in_arena = 1;
+        arena->last = header;
+        arena->top += need;
+        return (char *) header + SPT_SCRATCH_HEADER_BYTES;
+    }
+    if(arena->want < 2 * (arena->top + need)) {
+        arena->want = 2 * (arena->top + need);
+    }
+#endif
+    header = sptMalloc(need);
+    if(header == NULL) {
+        return NULL;
+    }
+    header->in_arena = 0;
+    return (char *) header + SPT_SCRATCH_HEADER_BYTES;
+}
+
+/**
+ * Release a temporary from spt_ScratchAlloc, on the thread that allocated it;
+ * NULL is ignored.
+ */
+void spt_ScratchFree(void * ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    spt_ScratchHeader * const header = (spt_ScratchHeader *) ((char *) ptr - SPT_SCRATCH_HEADER_BYTES);
+    if(!header->in_arena) {
+        sptFree(header);
+        return;
+    }
+#ifdef SPT_USE_SCRATCH_ARENA
+    spt_ScratchArena * const arena = &spt_scratch;
+    header->freed = 1;
+    while(arena->last != NULL && arena->last->freed) {
+        arena->top = (size_t) ((char *) arena->last - arena->base);
+        arena->last = arena->last->prev;
+    }
+#endif
+}
+
+/**
+ * Return the calling thread's scratch arena to the allocator. Temporaries
+ * still held keep it alive until they are released.
+ */
+void sptFreeScratch(void) {
+#ifdef SPT_USE_SCRATCH_ARENA
+    spt_ScratchArena * const arena = &spt_scratch;
+    if(arena->last == NULL) {
+        sptFree(arena->base);
+        arena->base = NULL;
+        arena->cap = 0;
+        arena->top = 0;
+        arena->want = PARTI_SCRATCH_BYTES;
+    }
+#endif
+}
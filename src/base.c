@@ -39,12 +39,3 @@ char * sptBytesString(uint64_t const bytes)
   return ret;
 }
 
-
-sptValue sptRandomValue(void)
-{
-  sptValue v =  3.0 * ((sptValue) rand() / (sptValue) RAND_MAX);
-  if(rand() % 2 == 0) {
-    v *= -1;
-  }
-  return v;
-}
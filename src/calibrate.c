@@ -0,0 +1,495 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <float.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error/error.h"
+#include "matrix/lapack.h"
+#include "sptensor/sptensor.h"
+
+/*
+ * Machine calibration.
+ *
+ * A handful of micro-benchmarks measure what the tuners and cost models
+ * would otherwise take from compile-time constants: a parallel triad's
+ * bandwidth, the latency of dependent random loads over working sets from
+ * 8 KiB to 64 MiB (and from it the sizes of the fastest and the last cache
+ * level), atomic adds with and without contention, GEMM and SYRK rates and,
+ * with CUDA, copy bandwidths over PCIe and on the device. The whole run
+ * takes well under a second.
+ *
+ * sptGetMachineProfile calibrates on first use, or reads the profile from
+ * the file PARTI_MACHINE_PROFILE names, writing it there after calibrating
+ * when the file does not exist yet, so each machine of a fleet pays for it
+ * once.
+ */
+
+#ifdef PARTI_USE_CUDA
+/* Device copy bandwidths and sizes, in cudawrap.cu */
+int spt_CudaCalibrate(sptMachineProfile * profile);
+#endif
+
+static sptMachineProfile spt_profile;
+static int spt_profile_ready = 0;
+
+/* Start timing one run of a benchmark */
+static sptTimer spt_CalibrateStart(void) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+    return timer;
+}
+
+/* Stop timing a run, keeping the fastest run's seconds in best */
+static void spt_CalibrateStop(sptTimer timer, double * best) {
+    sptStopTimer(timer);
+    double const seconds = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+    if(seconds > 0 && seconds < *best) {
+        *best = seconds;
+    }
+}
+
+
+/* Bytes per second of a parallel triad over arrays well past the caches */
+static double spt_CalibrateTriad(int const tk) {
+    size_t const n = (size_t) 1 << 22;
+    double * a = malloc(3 * n * sizeof *a);
+    if(a == NULL) {
+        return 0;
+    }
+    double * const b = a + n;
+    double * const c = b + n;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(size_t i = 0; i < n; ++i) {
+        a[i] = 0;
+        b[i] = (double) i;
+        c[i] = 1;
+    }
+    double best = DBL_MAX;
+    for(int rep = 0; rep < 4; ++rep) {
+        sptTimer const timer = spt_CalibrateStart();
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(size_t i = 0; i < n; ++i) {
+            a[i] = b[i] + 3 * c[i];
+        }
+        spt_CalibrateStop(timer, &best);
+    }
+    volatile double sink = a[n - 1];
+    (void) sink;
+    free(a);
+    return best < DBL_MAX ? 3 * n * sizeof (double) / best : 0;
+}
+
+
+/*
+ * Seconds per load of a pointer chase through the cache lines of each
+ * working set in random order; the loads depend on each other, so this is
+ * latency, not bandwidth.
+ */
+static void spt_CalibrateGather(double latency[]) {
+    size_t const line = 64 / sizeof (size_t);
+    size_t const max_len = ((size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + SPT_PROFILE_NUM_SETS - 1)) / sizeof (size_t);
+    size_t const steps = (size_t) 1 << 16;
+    size_t * next = malloc(max_len * sizeof *next);
+    size_t * order = malloc(max_len / line * sizeof *order);
+    for(int s = 0; s < SPT_PROFILE_NUM_SETS; ++s) {
+        latency[s] = 0;
+    }
+    if(next == NULL || order == NULL) {
+        free(next);
+        free(order);
+        return;
+    }
+    uint64_t state = UINT64_C(88172645463325252);
+    size_t sink = 0;
+    for(int s = 0; s < SPT_PROFILE_NUM_SETS; ++s) {
+        size_t const nlines = ((size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + s)) / (line * sizeof (size_t));
+        for(size_t i = 0; i < nlines; ++i) {
+            order[i] = i;
+        }
+        for(size_t i = nlines - 1; i > 0; --i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            size_t const j = (size_t) (state % (i + 1));
+            size_t const t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        /* One cycle through all lines in shuffled order */
+        for(size_t i = 0; i < nlines; ++i) {
+            next[order[i] * line] = order[(i + 1) % nlines] * line;
+        }
+        size_t p = order[0] * line;
+        for(size_t k = 0; k < (nlines < steps ? nlines : steps); ++k) {
+            p = next[p];
+        }
+        double best = DBL_MAX;
+        for(int rep = 0; rep < 2; ++rep) {
+            sptTimer const timer = spt_CalibrateStart();
+            for(size_t k = 0; k < steps; ++k) {
+                p = next[p];
+            }
+            spt_CalibrateStop(timer, &best);
+        }
+        sink += p;
+        latency[s] = best < DBL_MAX ? best / steps : 0;
+    }
+    volatile size_t keep = sink;
+    (void) keep;
+    free(order);
+    free(next);
+}
+
+
+/* Atomic adds per second of all threads, each on its own cache line or all on one value */
+static void spt_CalibrateAtomics(int const tk, double * atomic_private, double * atomic_shared) {
+    size_t const per_thread = ((size_t) 1 << 21) / tk;
+    double * slots = calloc((size_t) tk * 8 + 1, sizeof *slots);
+    *atomic_private = *atomic_shared = 0;
+    if(slots == NULL) {
+        return;
+    }
+    double best = DBL_MAX;
+    for(int rep = 0; rep < 2; ++rep) {
+        sptTimer const timer = spt_CalibrateStart();
+        #pragma omp parallel num_threads(tk)
+        {
+#ifdef PARTI_USE_OPENMP
+            double * const slot = slots + 8 * omp_get_thread_num();
+#else
+            double * const slot = slots;
+#endif
+            for(size_t i = 0; i < per_thread; ++i) {
+                #pragma omp atomic update
+                *slot += 1;
+            }
+        }
+        spt_CalibrateStop(timer, &best);
+    }
+    *atomic_private = best < DBL_MAX ? per_thread * tk / best : 0;
+    double * const shared = slots + 8 * tk;
+    best = DBL_MAX;
+    for(int rep = 0; rep < 2; ++rep) {
+        sptTimer const timer = spt_CalibrateStart();
+        #pragma omp parallel num_threads(tk)
+        {
+            for(size_t i = 0; i < per_thread; ++i) {
+                #pragma omp atomic update
+                *shared += 1;
+            }
+        }
+        spt_CalibrateStop(timer, &best);
+    }
+    *atomic_shared = best < DBL_MAX ? per_thread * tk / best : 0;
+    free(slots);
+}
+
+
+/* Flops per second of a square GEMM and of the tall SYRK CP-ALS forms its Gram matrices with */
+static void spt_CalibrateBlas(double * gemm_flops, double * syrk_flops) {
+    *gemm_flops = *syrk_flops = 0;
+#ifdef PARTI_USE_BLAS
+    integer const n = 384, rank = 64, nrows = 1 << 15;
+    size_t const len = (size_t) nrows * rank > (size_t) 3 * n * n ? (size_t) nrows * rank : (size_t) 3 * n * n;
+    sptValue * buf = malloc(len * sizeof *buf);
+    if(buf == NULL) {
+        return;
+    }
+    for(size_t i = 0; i < len; ++i) {
+        buf[i] = (sptValue) ((i % 17) + 1) / 17;
+    }
+    char notrans = 'N', uplo = 'L';
+    sptValue alpha = 1, beta = 0;
+    integer m = n, ld = n;
+    sptValue * const a = buf, * const b = buf + n * n, * const c = buf + 2 * n * n;
+    double best = DBL_MAX;
+    for(int rep = 0; rep < 3; ++rep) {
+        sptTimer const timer = spt_CalibrateStart();
+        spt_gemm_(&notrans, &notrans, &m, &m, &m, &alpha, a, &ld, b, &ld, &beta, c, &ld);
+        spt_CalibrateStop(timer, &best);
+    }
+    *gemm_flops = best < DBL_MAX ? 2.0 * n * n * n / best : 0;
+
+    sptValue * const ata = malloc((size_t) rank * rank * sizeof *ata);
+    if(ata != NULL) {
+        integer r = rank, rows = nrows, ldr = rank;
+        best = DBL_MAX;
+        for(int rep = 0; rep < 3; ++rep) {
+            sptTimer const timer = spt_CalibrateStart();
+            spt_syrk_(&uplo, &notrans, &r, &rows, &alpha, buf, &ldr, &beta, ata, &ldr);
+            spt_CalibrateStop(timer, &best);
+        }
+        *syrk_flops = best < DBL_MAX ? (double) nrows * rank * (rank + 1) / best : 0;
+        free(ata);
+    }
+    free(buf);
+#endif
+}
+
+
+/*
+ * Cache sizes from the latency curve: the fastest level ends where latency
+ * passes 1.5 times that of the smallest working set, the last level where it
+ * passes half of the largest set's, if that one reached memory at all.
+ */
+static void spt_CalibrateCaches(sptMachineProfile * profile) {
+    double const * const lat = profile->gather_latency;
+    int const last = SPT_PROFILE_NUM_SETS - 1;
+    profile->l1_bytes = 0;
+    profile->llc_bytes = 0;
+    if(lat[0] <= 0) {
+        return;
+    }
+    int s = 0;
+    while(s < last && lat[s + 1] <= 1.5 * lat[0]) {
+        ++s;
+    }
+    profile->l1_bytes = (size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + s);
+    if(lat[last] < 3 * lat[0]) {
+        profile->llc_bytes = (size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + last);
+        return;
+    }
+    s = 0;
+    while(s < last && lat[s + 1] <= 0.5 * lat[last]) {
+        ++s;
+    }
+    profile->llc_bytes = (size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + s);
+}
+
+
+/**
+ * Run the calibration micro-benchmarks
+ * @param[out] profile the measured parameters
+ * @param[in]  tk      the number of threads of the parallel benchmarks, 0 for the default
+ */
+int sptCalibrateMachine(sptMachineProfile * profile, int tk) {
+    tk = sptExecThreads(tk);
+    memset(profile, 0, sizeof *profile);
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    profile->nthreads = tk;
+    profile->stream_bandwidth = spt_CalibrateTriad(tk);
+    spt_CalibrateGather(profile->gather_latency);
+    spt_CalibrateCaches(profile);
+    spt_CalibrateAtomics(tk, &profile->atomic_private, &profile->atomic_shared);
+    spt_CalibrateBlas(&profile->gemm_flops, &profile->syrk_flops);
+#ifdef PARTI_USE_CUDA
+    if(spt_CudaCalibrate(profile) != 0) {
+        profile->has_device = 0;
+    }
+#endif
+
+    sptStopTimer(timer);
+    sptTelemetryRecordTime("Calibrate machine", sptElapsedTime(timer));
+    sptFreeTimer(timer);
+    if(spt_TelemetryPrinting()) {
+        printf("[Calibrate machine] %d threads: triad %.1f GB/s, L1 %zu KiB, LLC %zu KiB, %.0f / %.0f ns latency, atomics %.3g / %.3g per s, GEMM %.1f GFLOP/s, SYRK %.1f GFLOP/s\n",
+            tk, profile->stream_bandwidth * 1e-9, profile->l1_bytes >> 10, profile->llc_bytes >> 10,
+            profile->gather_latency[0] * 1e9, profile->gather_latency[SPT_PROFILE_NUM_SETS - 1] * 1e9,
+            profile->atomic_private, profile->atomic_shared, profile->gemm_flops * 1e-9, profile->syrk_flops * 1e-9);
+    }
+    return 0;
+}
+
+
+typedef enum {
+    SPT_PROFILE_INT,
+    SPT_PROFILE_DOUBLE,
+    SPT_PROFILE_SIZE,
+} spt_ProfileFieldType;
+
+/* The scalar fields of a profile file; gather_latency lines carry their working set too */
+static struct {
+    char const * name;
+    size_t offset;
+    spt_ProfileFieldType type;
+} const spt_profile_fields[] = {
+    { "nthreads", offsetof(sptMachineProfile, nthreads), SPT_PROFILE_INT },
+    { "stream_bandwidth", offsetof(sptMachineProfile, stream_bandwidth), SPT_PROFILE_DOUBLE },
+    { "l1_bytes", offsetof(sptMachineProfile, l1_bytes), SPT_PROFILE_SIZE },
+    { "llc_bytes", offsetof(sptMachineProfile, llc_bytes), SPT_PROFILE_SIZE },
+    { "atomic_private", offsetof(sptMachineProfile, atomic_private), SPT_PROFILE_DOUBLE },
+    { "atomic_shared", offsetof(sptMachineProfile, atomic_shared), SPT_PROFILE_DOUBLE },
+    { "gemm_flops", offsetof(sptMachineProfile, gemm_flops), SPT_PROFILE_DOUBLE },
+    { "syrk_flops", offsetof(sptMachineProfile, syrk_flops), SPT_PROFILE_DOUBLE },
+    { "has_device", offsetof(sptMachineProfile, has_device), SPT_PROFILE_INT },
+    { "h2d_bandwidth", offsetof(sptMachineProfile, h2d_bandwidth), SPT_PROFILE_DOUBLE },
+    { "d2h_bandwidth", offsetof(sptMachineProfile, d2h_bandwidth), SPT_PROFILE_DOUBLE },
+    { "device_bandwidth", offsetof(sptMachineProfile, device_bandwidth), SPT_PROFILE_DOUBLE },
+    { "device_memory", offsetof(sptMachineProfile, device_memory), SPT_PROFILE_SIZE },
+    { "device_cache", offsetof(sptMachineProfile, device_cache), SPT_PROFILE_SIZE },
+};
+
+#define SPT_PROFILE_NUM_FIELDS (sizeof spt_profile_fields / sizeof spt_profile_fields[0])
+
+/**
+ * Write a machine profile as "name value" lines
+ */
+int sptDumpMachineProfile(sptMachineProfile const * profile, FILE * fp) {
+    int iores = fprintf(fp, "# ParTI! machine profile\n");
+    spt_CheckOSError(iores < 0, "Profile Dump");
+    for(size_t f = 0; f < SPT_PROFILE_NUM_FIELDS; ++f) {
+        char const * const field = (char const *) profile + spt_profile_fields[f].offset;
+        switch(spt_profile_fields[f].type) {
+        case SPT_PROFILE_INT:
+            iores = fprintf(fp, "%s %d\n", spt_profile_fields[f].name, *(int const *) field);
+            break;
+        case SPT_PROFILE_DOUBLE:
+            iores = fprintf(fp, "%s %.17g\n", spt_profile_fields[f].name, *(double const *) field);
+            break;
+        default:
+            iores = fprintf(fp, "%s %zu\n", spt_profile_fields[f].name, *(size_t const *) field);
+        }
+        spt_CheckOSError(iores < 0, "Profile Dump");
+    }
+    for(int s = 0; s < SPT_PROFILE_NUM_SETS; ++s) {
+        iores = fprintf(fp, "gather_latency %zu %.17g\n", (size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + s), profile->gather_latency[s]);
+        spt_CheckOSError(iores < 0, "Profile Dump");
+    }
+    return 0;
+}
+
+/**
+ * Read a machine profile written by sptDumpMachineProfile; fields the file
+ * lacks are zero, lines it has that this version does not know are skipped
+ */
+int sptLoadMachineProfile(sptMachineProfile * profile, FILE * fp) {
+    memset(profile, 0, sizeof *profile);
+    char name[64];
+    while(fscanf(fp, " %63s", name) == 1) {
+        int ok = 1;
+        if(strcmp(name, "gather_latency") == 0) {
+            size_t bytes;
+            double seconds;
+            ok = fscanf(fp, "%zu %lf", &bytes, &seconds) == 2;
+            int s = 0;
+            while(ok && s < SPT_PROFILE_NUM_SETS && ((size_t) 1 << (SPT_PROFILE_MIN_SET_BITS + s)) != bytes) {
+                ++s;
+            }
+            if(ok && s < SPT_PROFILE_NUM_SETS) {
+                profile->gather_latency[s] = seconds;
+            }
+        } else {
+            size_t f = 0;
+            while(f < SPT_PROFILE_NUM_FIELDS && strcmp(name, spt_profile_fields[f].name) != 0) {
+                ++f;
+            }
+            if(f < SPT_PROFILE_NUM_FIELDS) {
+                char * const field = (char *) profile + spt_profile_fields[f].offset;
+                switch(spt_profile_fields[f].type) {
+                case SPT_PROFILE_INT:
+                    ok = fscanf(fp, "%d", (int *) field) == 1;
+                    break;
+                case SPT_PROFILE_DOUBLE:
+                    ok = fscanf(fp, "%lf", (double *) field) == 1;
+                    break;
+                default:
+                    ok = fscanf(fp, "%zu", (size_t *) field) == 1;
+                }
+            }
+        }
+        if(!ok) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "Profile Load", name);
+        }
+        /* The rest of the line: comments and fields of newer versions */
+        int c;
+        while((c = fgetc(fp)) != EOF && c != '\n') {
+        }
+    }
+    if(profile->nthreads <= 0 || profile->stream_bandwidth <= 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Profile Load", "no thread count or bandwidth");
+    }
+    return 0;
+}
+
+
+/**
+ * A 64-bit fingerprint of a machine profile, the machine part of the keys of
+ * sptPlanCachePath. Only the thread count, cache sizes and device sizes go
+ * in, not the measured rates, so calibrating the same machine again gives
+ * the same fingerprint.
+ */
+uint64_t sptMachineProfileFingerprint(sptMachineProfile const * profile) {
+    uint64_t h = spt_GenMix(0x9e3779b97f4a7c15ULL ^ (uint64_t) profile->nthreads);
+    h = spt_GenMix(h ^ profile->l1_bytes);
+    h = spt_GenMix(h ^ profile->llc_bytes);
+    h = spt_GenMix(h ^ (uint64_t) profile->has_device);
+    h = spt_GenMix(h ^ profile->device_memory);
+    return spt_GenMix(h ^ profile->device_cache);
+}
+
+
+/**
+ * The machine profile, calibrated with the default thread count on first
+ * use or read from the file PARTI_MACHINE_PROFILE names; a calibration is
+ * written to that file if it could not be read.
+ */
+sptMachineProfile const * sptGetMachineProfile(void) {
+    if(!spt_profile_ready) {
+        #pragma omp critical(spt_machine_profile)
+        {
+            if(!spt_profile_ready) {
+                sptMachineProfile profile;
+                char const * const path = getenv("PARTI_MACHINE_PROFILE");
+                int loaded = 0;
+                if(path != NULL && path[0] != '\0') {
+                    FILE * fp = fopen(path, "r");
+                    if(fp != NULL) {
+                        loaded = sptLoadMachineProfile(&profile, fp) == 0;
+                        fclose(fp);
+                    }
+                }
+                if(!loaded) {
+                    sptCalibrateMachine(&profile, 0);
+                    if(path != NULL && path[0] != '\0') {
+                        FILE * fp = fopen(path, "w");
+                        if(fp != NULL) {    // The file only saves time, a run does not depend on it
+                            sptDumpMachineProfile(&profile, fp);
+                            fclose(fp);
+                        }
+                    }
+                }
+                spt_profile = profile;
+                spt_profile_ready = 1;
+            }
+        }
+    }
+    return &spt_profile;
+}
+
+/**
+ * Replace the machine profile, or calibrate (or read) it again on next use
+ * with NULL. Not thread-safe; set it before work starts, and before the
+ * first sptGetMachineModel, which derives from it.
+ */
+void sptSetMachineProfile(sptMachineProfile const * profile) {
+    if(profile != NULL) {
+        spt_profile = *profile;
+        spt_profile_ready = 1;
+    } else {
+        spt_profile_ready = 0;
+    }
+}
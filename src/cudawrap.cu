@@ -18,8 +18,13 @@
 
 #include <ParTI.h>
 #include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "error/error.h"
 #include "cudawrap.h"
+#include <cublas_v2.h>
 #include <cusparse.h>
 #include <cusolverSp.h>
 
@@ -31,24 +36,509 @@ int sptCudaGetLastError(void) {
     return (int) cudaGetLastError();
 }
 
-int spt_cusparseCreate(cusparseHandle_t *handle) {
-    static cusparseHandle_t h = NULL;
+/*
+ * Caching device allocator. Blocks are rounded up to a size class, a power of
+ * two below 1MB and a multiple of 2MB above, and a freed block is kept for the
+ * next request of its class on its device instead of going back to the driver.
+ * Every block is its own cudaMalloc, so cudaFree on one is still safe.
+ *
+ * A freed block may still be read by queued work. Its event, recorded on the
+ * execution context's stream or else the legacy default stream, which waits
+ * for all blocking streams, is waited for before the block is handed out
+ * again, as cudaFree would have done.
+ * PARTI_CUDA_POOL=0 turns caching off.
+ */
+namespace {
+
+struct spt_CudaBlock {
+    size_t bytes;
+    int device;
+    cudaEvent_t released;
+};
+
+struct spt_CudaPool {
+    std::mutex lock;
+    std::multimap<std::pair<int, size_t>, void *> cached;   // (device, bytes) -> block
+    std::unordered_map<void *, spt_CudaBlock> blocks;       // every block, cached or live
+    int enabled = -1;
+};
+
+spt_CudaPool & spt_GetCudaPool() {
+    static spt_CudaPool * pool = new spt_CudaPool;   // Never destroyed, frees may come from atexit
+    return *pool;
+}
+
+size_t spt_CudaPoolClass(size_t bytes) {
+    size_t const large = (size_t) 1 << 20;
+    if(bytes >= large) {
+        size_t const step = (size_t) 2 << 20;
+        return (bytes + step - 1) / step * step;
+    }
+    size_t c = 512;
+    while(c < bytes) {
+        c <<= 1;
+    }
+    return c;
+}
+
+/* Give every cached block back to the driver; the caller holds the lock */
+int spt_CudaPoolTrim(spt_CudaPool & pool) {
+    int device;
+    cudaGetDevice(&device);
     int result = 0;
-    if(!h) {
-        result = cusparseCreate(&h);
+    for(auto const & it : pool.cached) {
+        spt_CudaBlock & block = pool.blocks[it.second];
+        cudaSetDevice(block.device);
+        cudaEventDestroy(block.released);
+        if(cudaFree(it.second) != cudaSuccess) {
+            result = -1;
+        }
+        pool.blocks.erase(it.second);
+    }
+    pool.cached.clear();
+    cudaSetDevice(device);
+    return result;
+}
+
+}
+
+int spt_CudaPoolAlloc(void **ptr, size_t size) {
+    spt_CudaPool & pool = spt_GetCudaPool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    if(pool.enabled < 0) {
+        char const * env = getenv("PARTI_CUDA_POOL");
+        pool.enabled = !(env != NULL && env[0] == '0');
+    }
+    if(!pool.enabled) {
+        return (int) cudaMalloc(ptr, size);
+    }
+
+    int device;
+    int result = cudaGetDevice(&device);
+    if(result != cudaSuccess) {
+        return result;
+    }
+    size_t const bytes = spt_CudaPoolClass(size);
+    auto it = pool.cached.find(std::make_pair(device, bytes));
+    if(it != pool.cached.end()) {
+        *ptr = it->second;
+        pool.cached.erase(it);
+        return (int) cudaEventSynchronize(pool.blocks[*ptr].released);
+    }
+
+    result = cudaMalloc(ptr, bytes);
+    if(result == cudaErrorMemoryAllocation) {
+        /* Cached blocks of other classes may be what is missing */
+        cudaGetLastError();
+        spt_CudaPoolTrim(pool);
+        result = cudaMalloc(ptr, bytes);
+    }
+    if(result != cudaSuccess) {
+        return result;
+    }
+    spt_CudaBlock block = { bytes, device, NULL };
+    result = cudaEventCreateWithFlags(&block.released, cudaEventDisableTiming);
+    if(result != cudaSuccess) {
+        cudaFree(*ptr);
+        return result;
+    }
+    pool.blocks[*ptr] = block;
+    return 0;
+}
+
+int spt_CudaPoolFree(void *ptr) {
+    if(ptr == NULL) {
+        return 0;
+    }
+    spt_CudaPool & pool = spt_GetCudaPool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    auto it = pool.blocks.find(ptr);
+    if(it == pool.blocks.end()) {
+        return (int) cudaFree(ptr);
+    }
+    spt_CudaBlock const & block = it->second;
+    int device;
+    cudaGetDevice(&device);
+    if(device != block.device) {
+        cudaSetDevice(block.device);
+    }
+    int result = cudaEventRecord(block.released, (cudaStream_t) spt_ExecCudaStream());
+    if(device != block.device) {
+        cudaSetDevice(device);
     }
-    *handle = h;
+    pool.cached.insert(std::make_pair(std::make_pair(block.device, block.bytes), ptr));
     return result;
 }
 
+/**
+ * Return the device memory cached by the library's allocator to the driver,
+ * e.g. before handing the GPU to another library.
+ */
+int sptCudaReleasePool(void) {
+    spt_CudaPool & pool = spt_GetCudaPool();
+    std::lock_guard<std::mutex> guard(pool.lock);
+    int result = spt_CudaPoolTrim(pool);
+    spt_CheckCudaError(result != 0, "sptCudaReleasePool");
+    return 0;
+}
+
+/* Page-locked host memory for sptMallocBacked, NULL on failure */
+void * spt_CudaHostAlloc(size_t bytes) {
+    void * ptr = NULL;
+    if(cudaHostAlloc(&ptr, bytes, cudaHostAllocPortable) != cudaSuccess) {
+        cudaGetLastError();
+        return NULL;
+    }
+    return ptr;
+}
+
+void spt_CudaHostFree(void * ptr) {
+    cudaFreeHost(ptr);
+}
+
+/* Managed memory for sptMallocBacked, NULL on failure */
+void * spt_CudaManagedAlloc(size_t bytes) {
+    void * ptr = NULL;
+    if(cudaMallocManaged(&ptr, bytes, cudaMemAttachGlobal) != cudaSuccess) {
+        cudaGetLastError();
+        return NULL;
+    }
+    return ptr;
+}
+
+void spt_CudaManagedFree(void * ptr) {
+    cudaFree(ptr);
+}
+
+/*
+ * Advise the driver on bytes of managed memory at ptr and start moving them
+ * to device on stream: read-mostly inputs get a copy there and keep theirs
+ * on the host, the output prefers the device. Not managed memory is left
+ * alone.
+ */
+static int spt_CudaAdviseManaged(void const * ptr, size_t bytes, int output, int device, cudaStream_t stream) {
+    if(ptr == NULL || bytes == 0 || sptMemBackingOf(ptr) != SPT_MEM_MANAGED) {
+        return 0;
+    }
+    int result;
+    if(output) {
+        cudaMemAdvise(ptr, bytes, cudaMemAdviseUnsetReadMostly, device);
+        result = cudaMemAdvise(ptr, bytes, cudaMemAdviseSetPreferredLocation, device);
+    } else {
+        result = cudaMemAdvise(ptr, bytes, cudaMemAdviseSetReadMostly, device);
+    }
+    if(result != cudaSuccess) {
+        return result;
+    }
+    return (int) cudaMemPrefetchAsync(ptr, bytes, device, stream);
+}
+
+/**
+ * Prepare the managed buffers of an MTTKRP for the current device: X and
+ * the factors mats[m], m != mode, become read-mostly, out prefers the
+ * device, and all of them start moving there on the execution context's
+ * stream, so the kernel does not stall on page faults. Buffers that are not
+ * SPT_MEM_MANAGED are skipped. Call it ahead of the MTTKRP, e.g. while the
+ * previous mode runs.
+ * @param[in] X    the sparse tensor
+ * @param[in] mats the nmodes factor matrices
+ * @param[in] mode the mode of the MTTKRP
+ * @param[in] out  the output matrix
+ */
+int sptCudaPrefetchMTTKRP(sptSparseTensor const * X, sptMatrix * const mats[], sptIndex const mode, sptMatrix const * out) {
+    int device;
+    int result = cudaGetDevice(&device);
+    spt_CheckCudaError(result != 0, "CUDA Prefetch MTTKRP");
+    cudaStream_t const stream = (cudaStream_t) spt_ExecCudaStream();
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        result = spt_CudaAdviseManaged(X->inds[m].data, X->nnz * sizeof (sptIndex), 0, device, stream);
+        spt_CheckCudaError(result != 0, "CUDA Prefetch MTTKRP");
+    }
+    result = spt_CudaAdviseManaged(X->values.data, X->nnz * sizeof (sptValue), 0, device, stream);
+    spt_CheckCudaError(result != 0, "CUDA Prefetch MTTKRP");
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(m != mode && mats[m] != out) {
+            result = spt_CudaAdviseManaged(mats[m]->values, (size_t) mats[m]->nrows * mats[m]->stride * sizeof (sptValue), 0, device, stream);
+            spt_CheckCudaError(result != 0, "CUDA Prefetch MTTKRP");
+        }
+    }
+    result = spt_CudaAdviseManaged(out->values, (size_t) out->nrows * out->stride * sizeof (sptValue), 1, device, stream);
+    spt_CheckCudaError(result != 0, "CUDA Prefetch MTTKRP");
+    return 0;
+}
+
+/*
+ * Library handles. Creating a cuBLAS, cuSPARSE or cuSOLVER handle costs
+ * milliseconds, so each is made once and kept. A handle is not safe to use
+ * from two threads at once, so a thread leases a set of the three per device
+ * on its first call there, and gives it back when it exits; the next thread
+ * to need one on that device takes it over. Each lease carries a workspace
+ * that only grows. Every fetch binds the handle to the execution context's
+ * stream, or the default stream without one.
+ *
+ * Each device also keeps SPT_CUDA_NSTREAMS non-blocking streams, shared by
+ * all threads, for contexts that want their work off the default stream.
+ */
+#define SPT_CUDA_NSTREAMS 8
+
+namespace {
+
+struct spt_CudaLibs {
+    cublasHandle_t blas;
+    cusparseHandle_t sparse;
+    cusolverSpHandle_t solver;
+    void * workspace;
+    size_t workspace_bytes;
+};
+
+struct spt_CudaLibCache {
+    std::mutex lock;
+    std::multimap<int, spt_CudaLibs *> idle;          // device -> a set no thread holds
+    std::map<int, std::vector<cudaStream_t> > streams; // device -> its streams
+};
+
+spt_CudaLibCache & spt_GetCudaLibCache() {
+    static spt_CudaLibCache * cache = new spt_CudaLibCache;   // Never destroyed, threads return leases at exit
+    return *cache;
+}
+
+/* The sets the calling thread holds, one per device, returned at thread exit */
+struct spt_CudaLibLease {
+    std::unordered_map<int, spt_CudaLibs *> held;
+    ~spt_CudaLibLease() {
+        spt_CudaLibCache & cache = spt_GetCudaLibCache();
+        std::lock_guard<std::mutex> guard(cache.lock);
+        for(auto const & it : held) {
+            cache.idle.insert(std::make_pair(it.first, it.second));
+        }
+    }
+};
+
+thread_local spt_CudaLibLease spt_cuda_lease;
+
+/* The calling thread's set on the current device, NULL on failure */
+spt_CudaLibs * spt_CudaGetLibs() {
+    int device;
+    if(cudaGetDevice(&device) != cudaSuccess) {
+        return NULL;
+    }
+    auto held = spt_cuda_lease.held.find(device);
+    if(held != spt_cuda_lease.held.end()) {
+        return held->second;
+    }
+    spt_CudaLibs * libs = NULL;
+    {
+        spt_CudaLibCache & cache = spt_GetCudaLibCache();
+        std::lock_guard<std::mutex> guard(cache.lock);
+        auto it = cache.idle.find(device);
+        if(it != cache.idle.end()) {
+            libs = it->second;
+            cache.idle.erase(it);
+        }
+    }
+    if(libs == NULL) {
+        libs = new spt_CudaLibs;
+        libs->blas = NULL;
+        libs->sparse = NULL;
+        libs->solver = NULL;
+        libs->workspace = NULL;
+        libs->workspace_bytes = 0;
+    }
+    spt_cuda_lease.held[device] = libs;
+    return libs;
+}
+
+}
+
+/**
+ * Non-blocking CUDA stream i of the current device, taken modulo the
+ * number kept per device, to put in sptExecContext::cuda_stream. The
+ * streams are made on first use and shared by all threads. NULL, the
+ * default stream, if they cannot be made.
+ */
+void * sptCudaStream(int const i) {
+    int device;
+    if(cudaGetDevice(&device) != cudaSuccess) {
+        return NULL;
+    }
+    spt_CudaLibCache & cache = spt_GetCudaLibCache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    std::vector<cudaStream_t> & streams = cache.streams[device];
+    if(streams.empty()) {
+        for(int s = 0; s < SPT_CUDA_NSTREAMS; ++s) {
+            cudaStream_t stream;
+            if(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking) != cudaSuccess) {
+                for(cudaStream_t made : streams) {
+                    cudaStreamDestroy(made);
+                }
+                streams.clear();
+                return NULL;
+            }
+            streams.push_back(stream);
+        }
+    }
+    int const n = (int) streams.size();
+    return streams[(i % n + n) % n];
+}
+
+/**
+ * Destroy the library handles and workspaces no thread holds, e.g. before
+ * handing the GPU to another library. Threads still running keep theirs.
+ */
+int sptCudaReleaseHandles(void) {
+    spt_CudaLibCache & cache = spt_GetCudaLibCache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    int device;
+    cudaGetDevice(&device);
+    for(auto const & it : cache.idle) {
+        spt_CudaLibs * libs = it.second;
+        cudaSetDevice(it.first);
+        if(libs->blas) {
+            cublasDestroy(libs->blas);
+        }
+        if(libs->sparse) {
+            cusparseDestroy(libs->sparse);
+        }
+        if(libs->solver) {
+            cusolverSpDestroy(libs->solver);
+        }
+        spt_CudaPoolFree(libs->workspace);
+        delete libs;
+    }
+    cache.idle.clear();
+    cudaSetDevice(device);
+    return 0;
+}
+
+int spt_cublasHandle(cublasHandle_t *handle) {
+    spt_CudaLibs * libs = spt_CudaGetLibs();
+    if(libs == NULL) {
+        return -1;
+    }
+    int result = 0;
+    if(!libs->blas) {
+        result = cublasCreate(&libs->blas);
+        if(result != CUBLAS_STATUS_SUCCESS) {
+            libs->blas = NULL;
+            return result;
+        }
+    }
+    *handle = libs->blas;
+    return cublasSetStream(libs->blas, (cudaStream_t) spt_ExecCudaStream());
+}
+
+int spt_cusparseCreate(cusparseHandle_t *handle) {
+    spt_CudaLibs * libs = spt_CudaGetLibs();
+    if(libs == NULL) {
+        return -1;
+    }
+    int result = 0;
+    if(!libs->sparse) {
+        result = cusparseCreate(&libs->sparse);
+        if(result != CUSPARSE_STATUS_SUCCESS) {
+            libs->sparse = NULL;
+            return result;
+        }
+    }
+    *handle = libs->sparse;
+    return cusparseSetStream(libs->sparse, (cudaStream_t) spt_ExecCudaStream());
+}
+
 int spt_cusolverSpCreate(cusolverSpHandle_t *handle) {
-    static cusolverSpHandle_t h = NULL;
+    spt_CudaLibs * libs = spt_CudaGetLibs();
+    if(libs == NULL) {
+        return -1;
+    }
     int result = 0;
-    if(!h) {
-        result = cusolverSpCreate(&h);
+    if(!libs->solver) {
+        result = cusolverSpCreate(&libs->solver);
+        if(result != CUSOLVER_STATUS_SUCCESS) {
+            libs->solver = NULL;
+            return result;
+        }
     }
-    *handle = h;
-    return result;
+    *handle = libs->solver;
+    return cusolverSpSetStream(libs->solver, (cudaStream_t) spt_ExecCudaStream());
+}
+
+int spt_CudaWorkspace(void **ptr, size_t bytes) {
+    spt_CudaLibs * libs = spt_CudaGetLibs();
+    if(libs == NULL) {
+        return -1;
+    }
+    if(bytes > libs->workspace_bytes) {
+        spt_CudaPoolFree(libs->workspace);
+        libs->workspace = NULL;
+        libs->workspace_bytes = 0;
+        int result = spt_CudaPoolAlloc(&libs->workspace, bytes);
+        if(result != 0) {
+            return result;
+        }
+        libs->workspace_bytes = bytes;
+    }
+    *ptr = libs->workspace;
+    return 0;
+}
+
+/* Seconds of one copy, timed with events on the default stream; 0 if it failed */
+static double spt_CudaTimeCopy(void * dst, void const * src, size_t bytes, cudaMemcpyKind kind) {
+    cudaEvent_t start, stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+    cudaMemcpy(dst, src, bytes, kind);
+    cudaEventRecord(start, 0);
+    cudaMemcpyAsync(dst, src, bytes, kind, 0);
+    cudaEventRecord(stop, 0);
+    float ms = 0;
+    if(cudaEventSynchronize(stop) != cudaSuccess || cudaEventElapsedTime(&ms, start, stop) != cudaSuccess) {
+        ms = 0;
+    }
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    return ms * 1e-3;
+}
+
+/* Device part of the machine calibration, see sptCalibrateMachine; nonzero without a device */
+int spt_CudaCalibrate(sptMachineProfile * profile) {
+    cudaDeviceProp prop;
+    int device;
+    int result = cudaGetDevice(&device);
+    if(result == cudaSuccess) {
+        result = cudaGetDeviceProperties(&prop, device);
+    }
+    if(result != cudaSuccess) {
+        cudaGetLastError();
+        return -1;
+    }
+    profile->has_device = 1;
+    profile->device_memory = prop.totalGlobalMem;
+    profile->device_cache = prop.l2CacheSize;
+    /* Until measured: double data rate, two transfers of busWidth bits per memory clock, given in kHz */
+    profile->device_bandwidth = 2.0 * prop.memoryClockRate * 1e3 * (prop.memoryBusWidth / 8);
+    profile->h2d_bandwidth = profile->d2h_bandwidth = 12e9;
+
+    size_t const bytes = (size_t) 32 << 20;
+    void * host = spt_CudaHostAlloc(bytes);
+    void * dev = NULL;
+    if(host != NULL && cudaMalloc(&dev, 2 * bytes) == cudaSuccess) {
+        double seconds = spt_CudaTimeCopy(dev, host, bytes, cudaMemcpyHostToDevice);
+        if(seconds > 0) {
+            profile->h2d_bandwidth = bytes / seconds;
+        }
+        seconds = spt_CudaTimeCopy(host, dev, bytes, cudaMemcpyDeviceToHost);
+        if(seconds > 0) {
+            profile->d2h_bandwidth = bytes / seconds;
+        }
+        /* A device copy reads and writes every byte */
+        seconds = spt_CudaTimeCopy((char *) dev + bytes, dev, bytes, cudaMemcpyDeviceToDevice);
+        if(seconds > 0) {
+            profile->device_bandwidth = 2 * bytes / seconds;
+        }
+        cudaFree(dev);
+    }
+    cudaGetLastError();
+    spt_CudaHostFree(host);
+    return 0;
 }
 
 int spt_CudaDuplicateMemoryGenerics(void **dest, const void *src, size_t size, int direction) {
@@ -56,7 +546,7 @@ int spt_CudaDuplicateMemoryGenerics(void **dest, const void *src, size_t size, i
     switch(direction) {
     case cudaMemcpyHostToDevice:
     case cudaMemcpyDeviceToDevice:
-        result = cudaMalloc(dest, size);
+        result = spt_CudaPoolAlloc(dest, size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemory");
         break;
     case cudaMemcpyDeviceToHost:
@@ -77,7 +567,7 @@ int spt_CudaDuplicateMemoryGenericsAsync(void **dest, const void *src, size_t si
     switch(direction) {
     case cudaMemcpyHostToDevice:
     case cudaMemcpyDeviceToDevice:
-        result = cudaMalloc(dest, size);
+        result = spt_CudaPoolAlloc(dest, size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemory");
         break;
     case cudaMemcpyDeviceToHost:
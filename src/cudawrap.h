@@ -27,13 +27,34 @@
 #include "error/error.h"
 
 
+#ifdef PARTI_USE_HIP
+/* The HIP libraries' handles are not opaque struct pointers to declare ahead */
+#include <cublas_v2.h>
+#include <cusparse.h>
+#include <cusolverSp.h>
+#else
+typedef struct cublasContext *cublasHandle_t;
 typedef struct cusparseContext *cusparseHandle_t;
 typedef struct cusolverSpContext *cusolverSpHandle_t;
+#endif
 
 extern "C" {
 
+/* The calling thread's cached library handles on the current device, bound to the context's stream */
+int spt_cublasHandle(cublasHandle_t *handle);
 int spt_cusparseCreate(cusparseHandle_t *handle);
 int spt_cusolverSpCreate(cusolverSpHandle_t *handle);
+/* The calling thread's device workspace of at least size bytes, valid until its next call */
+int spt_CudaWorkspace(void **ptr, size_t size);
+
+/* Device memory from the caching allocator; spt_CudaPoolFree takes any device pointer */
+int spt_CudaPoolAlloc(void **ptr, size_t size);
+int spt_CudaPoolFree(void *ptr);
+
+void * spt_CudaHostAlloc(size_t bytes);
+void spt_CudaHostFree(void * ptr);
+void * spt_CudaManagedAlloc(size_t bytes);
+void spt_CudaManagedFree(void * ptr);
 
 int spt_CudaDuplicateMemoryGenerics(void **dest, const void *src, size_t size, int direction);
 int spt_CudaDuplicateMemoryGenericsAsync(void **dest, const void *src, size_t size, int direction, cudaStream_t stream);
@@ -46,8 +67,8 @@ static inline int sptCudaDuplicateMemory(T **dest, const T *src, size_t size, in
 }
 
 template <class T>
-static inline int sptCudaDuplicateMemoryAsync(T **dest, const T *src, size_t size, int direction) {
-    return spt_CudaDuplicateMemoryGenericsAsync((void **) dest, src, size, direction);
+static inline int sptCudaDuplicateMemoryAsync(T **dest, const T *src, size_t size, int direction, cudaStream_t stream) {
+    return spt_CudaDuplicateMemoryGenericsAsync((void **) dest, src, size, direction, stream);
 }
 
 static size_t spt_cudaGetAlignedSize(size_t size, bool on_gpu) {
@@ -77,7 +98,7 @@ inline int sptCudaDuplicateMemoryIndirect(T ***dest, const T *const *src, size_t
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc((void **) &head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -148,7 +169,7 @@ inline int sptCudaDuplicateMemoryIndirect(T ***dest, const T *const *src, size_t
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc(&head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -218,7 +239,7 @@ inline int sptCudaDuplicateMemoryIndirect(T ***dest, const T *const *src, sptInd
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc((void **) &head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -291,7 +312,7 @@ inline int sptCudaDuplicateMemoryIndirect(T ***dest, const T *const *src, sptInd
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc(&head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -362,7 +383,7 @@ inline int sptCudaDuplicateMemoryIndirectAsync(T ***dest, const T *const *src, s
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc((void **) &head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -433,7 +454,7 @@ inline int sptCudaDuplicateMemoryIndirectAsync(T ***dest, const T *const *src, s
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc(&head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
@@ -507,7 +528,7 @@ inline int sptCudaDuplicateMemoryIndirect(T ***dest, const T *const *src, size_t
 
     switch(direction) {
     case cudaMemcpyHostToDevice:
-        result = cudaMalloc(&head, total_size);
+        result = spt_CudaPoolAlloc((void **) &head, total_size);
         spt_CheckCudaError(result != 0, "sptCudaDuplicateMemoryIndirect");
         body = (T *) ((char *) head + head_size);
 
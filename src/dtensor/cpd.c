@@ -0,0 +1,155 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "dtensor.h"
+#include "../sptensor/sptensor.h"
+
+
+static double DenseCpdAlsStep(
+  sptDenseTensor const * const X,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = X->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+  }
+
+  double const normsq = sptDenseTensorFrobeniusNormSquared(X);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+      sptAssert (sptDenseMTTKRP(X, mats, m, tk) == 0);
+      memcpy(mats[m]->values, tmp_mat->values, mats[m]->nrows * stride * sizeof(sptValue));
+
+      /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
+      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
+
+      /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
+      if (it == 0 ) {
+        sptMatrix2Norm(mats[m], lambda);
+      } else {
+        sptMatrixMaxNorm(mats[m], lambda);
+      }
+
+      sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+    } // Loop nmodes
+
+    fit = sptKruskalTensorFitNorm(nmodes, normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+
+  return fit;
+}
+
+
+/**
+ * CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for
+ * dense tensors. The MTTKRP is sptDenseMTTKRP; the Gram matrices, normal
+ * equation solver and fit are the ones of the sparse CP-ALS.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  X the dense tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptDenseCpdAls(
+  sptDenseTensor const * const X,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = X->nmodes;
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(X->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, X->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], X->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeMatrix(mats[m], X->ndims[m], rank) == 0);
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = DenseCpdAlsStep(X, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  DTns CPD-ALS");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
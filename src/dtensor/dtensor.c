@@ -0,0 +1,176 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dtensor.h"
+#include "../matrix/lapack.h"
+
+
+sptNnzIndex spt_DenseTensorSpan(sptIndex const ndims[], sptIndex const begin, sptIndex const end) {
+    sptNnzIndex span = 1;
+    for(sptIndex m = begin; m < end; ++m) {
+        span *= ndims[m];
+    }
+    return span;
+}
+
+
+void spt_DenseGemm(
+    int const transa,
+    sptNnzIndex const m,
+    sptNnzIndex const n,
+    sptNnzIndex const k,
+    sptValue const * const A,
+    sptNnzIndex const lda,
+    sptValue const * const B,
+    sptNnzIndex const ldb,
+    sptValue const beta,
+    sptValue * const C,
+    sptNnzIndex const ldc,
+    int const tk)
+{
+    if(m == 0 || n == 0) {
+        return;
+    }
+#ifdef PARTI_USE_BLAS
+    (void) tk;
+    /* Row-major operands are column-major transposes: C^T = B^T op(A)^T */
+    char notrans = 'N', transa_ = transa ? 'T' : 'N';
+    integer m_ = (integer) n, n_ = (integer) m, k_ = (integer) k;
+    integer ldb_ = (integer) ldb, lda_ = (integer) lda, ldc_ = (integer) ldc;
+    sptValue alpha = 1, beta_ = beta;
+    spt_gemm_(&notrans, &transa_, &m_, &n_, &k_, &alpha, (sptValue *) B, &ldb_,
+        (sptValue *) A, &lda_, &beta_, C, &ldc_);
+#else
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex i = 0; i < m; ++i) {
+        sptValue * const restrict crow = C + i * ldc;
+        for(sptNnzIndex j = 0; j < n; ++j) {
+            crow[j] = beta == 0 ? 0 : beta * crow[j];
+        }
+        for(sptNnzIndex p = 0; p < k; ++p) {
+            sptValue const a = transa ? A[p * lda + i] : A[i * lda + p];
+            sptValue const * const restrict brow = B + p * ldb;
+            for(sptNnzIndex j = 0; j < n; ++j) {
+                crow[j] += a * brow[j];
+            }
+        }
+    }
+#endif
+}
+
+
+/**
+ * Create a new dense tensor with all entries zero
+ * @param tsr    a pointer to an uninitialized dense tensor
+ * @param nmodes number of modes the tensor will have
+ * @param ndims  the dimension of each mode the tensor will have
+ */
+int sptNewDenseTensor(sptDenseTensor *tsr, sptIndex nmodes, const sptIndex ndims[]) {
+    int result;
+    if(nmodes < 1) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DTns New", "nmodes < 1");
+    }
+    tsr->nmodes = nmodes;
+    tsr->ndims = malloc(nmodes * sizeof *tsr->ndims);
+    spt_CheckOSError(!tsr->ndims, "DTns New");
+    memcpy(tsr->ndims, ndims, nmodes * sizeof *tsr->ndims);
+    sptNnzIndex const len = spt_DenseTensorSpan(ndims, 0, nmodes);
+    result = sptNewValueVector(&tsr->values, len, len);
+    spt_CheckError(result, "DTns New", NULL);
+    return 0;
+}
+
+
+/**
+ * Release any memory the dense tensor is holding
+ * @param tsr the tensor to release
+ */
+void sptFreeDenseTensor(sptDenseTensor *tsr) {
+    free(tsr->ndims);
+    sptFreeValueVector(&tsr->values);
+    tsr->nmodes = 0;
+}
+
+
+/**
+ * Load the contents of a dense tensor from a text file: the number of modes,
+ * the size of each mode, then every entry in row-major order
+ * @param tsr a pointer to an uninitialized dense tensor
+ * @param fp  file pointer
+ */
+int sptLoadDenseTensor(sptDenseTensor *tsr, FILE *fp) {
+    int iores, result;
+    sptIndex nmodes;
+    iores = fscanf(fp, "%"PARTI_SCN_INDEX, &nmodes);
+    spt_CheckOSError(iores != 1, "DTns Load");
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "DTns Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        iores = fscanf(fp, "%"PARTI_SCN_INDEX, &ndims[m]);
+        spt_CheckOSError(iores != 1, "DTns Load");
+    }
+    result = sptNewDenseTensor(tsr, nmodes, ndims);
+    free(ndims);
+    spt_CheckError(result, "DTns Load", NULL);
+    for(sptNnzIndex i = 0; i < tsr->values.len; ++i) {
+        double value;
+        iores = fscanf(fp, "%lf", &value);
+        if(iores != 1) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "DTns Load", "fewer entries than the shape holds");
+        }
+        tsr->values.data[i] = (sptValue) value;
+    }
+    return 0;
+}
+
+
+/**
+ * Expand a sparse tensor into a dense one, summing duplicate coordinates
+ * @param dest a pointer to an uninitialized dense tensor
+ * @param src  the sparse tensor
+ */
+int sptSparseTensorToDense(sptDenseTensor *dest, const sptSparseTensor *src) {
+    int result = sptNewDenseTensor(dest, src->nmodes, src->ndims);
+    spt_CheckError(result, "SpTns -> DTns", NULL);
+    sptValue * const vals = dest->values.data;
+    for(sptNnzIndex x = 0; x < src->nnz; ++x) {
+        sptNnzIndex off = 0;
+        for(sptIndex m = 0; m < src->nmodes; ++m) {
+            off = off * src->ndims[m] + src->inds[m].data[x];
+        }
+        vals[off] += src->values.data[x];
+    }
+    return 0;
+}
+
+
+/**
+ * The squared Frobenius norm of a dense tensor
+ */
+double sptDenseTensorFrobeniusNormSquared(sptDenseTensor const * const tsr) {
+    sptValue const * const vals = tsr->values.data;
+    double normsq = 0;
+    #pragma omp parallel for reduction(+:normsq)
+    for(sptNnzIndex i = 0; i < tsr->values.len; ++i) {
+        normsq += (double) vals[i] * vals[i];
+    }
+    return normsq;
+}
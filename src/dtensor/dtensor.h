@@ -0,0 +1,51 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_DTENSOR_H
+#define PARTI_DTENSOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ParTI.h>
+#include "../error/error.h"
+
+/* Product of ndims[begin, end) */
+sptNnzIndex spt_DenseTensorSpan(sptIndex const ndims[], sptIndex const begin, sptIndex const end);
+
+/* Row-major C (m x n) = op(A) B + beta C, op(A) = A (m x k) or A^T for A (k x m) */
+void spt_DenseGemm(
+    int const transa,
+    sptNnzIndex const m,
+    sptNnzIndex const n,
+    sptNnzIndex const k,
+    sptValue const * const A,
+    sptNnzIndex const lda,
+    sptValue const * const B,
+    sptNnzIndex const ldb,
+    sptValue const beta,
+    sptValue * const C,
+    sptNnzIndex const ldc,
+    int const tk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dtensor.h"
+
+
+/* Khatri-Rao product of the factors of modes [mbegin, mend) into packed rows of R values, last mode fastest */
+static void spt_DenseKhatriRao(
+    sptValue * const kr,
+    sptMatrix * mats[],
+    sptIndex const mbegin,
+    sptIndex const mend,
+    sptIndex const R)
+{
+    sptNnzIndex len = 1;
+    for(sptIndex r = 0; r < R; ++r) {
+        kr[r] = 1;
+    }
+    for(sptIndex m = mbegin; m < mend; ++m) {
+        sptIndex const e = mats[m]->nrows;
+        sptIndex const stride = mats[m]->stride;
+        sptValue const * const rows = mats[m]->values;
+        /* Expand in place from the back, so no row is overwritten before it is read */
+        for(sptNnzIndex i = len; i-- > 0; ) {
+            for(sptIndex j = e; j-- > 0; ) {
+                sptValue const * const src = kr + i * R;
+                sptValue * const dst = kr + (i * e + j) * R;
+                for(sptIndex r = 0; r < R; ++r) {
+                    dst[r] = src[r] * rows[(size_t) j * stride + r];
+                }
+            }
+        }
+        len *= e;
+    }
+}
+
+
+/**
+ * Dense tensor MTTKRP in two steps. With X viewed as L x I x T, where L and T
+ * are the products of the sizes before and after the mode, one GEMM contracts
+ * the larger of the two sides with its Khatri-Rao product, leaving a small
+ * intermediate; a row-wise weighted sum (a GEMV per rank column) contracts
+ * the other side. The GEMM uses BLAS when PARTI_USE_BLAS is set.
+ * @param[in]  X    the dense tensor input X
+ * @param[out] mats (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ * @param[in]  tk   the number of threads
+ */
+int sptDenseMTTKRP(
+    sptDenseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mode,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  DTns MTTKRP", "mode >= nmodes");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(mats[m]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  DTns MTTKRP", "mats[m]->ncols != mats[nmodes]->ncols");
+        }
+        if(mats[m]->nrows != X->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  DTns MTTKRP", "mats[m]->nrows != ndims[m]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[nmodes]->stride;
+    sptNnzIndex const L = spt_DenseTensorSpan(X->ndims, 0, mode);
+    sptNnzIndex const I = X->ndims[mode];
+    sptNnzIndex const T = spt_DenseTensorSpan(X->ndims, mode+1, nmodes);
+    sptValue const * const xvals = X->values.data;
+    sptValue * const out = mats[nmodes]->values;
+
+    sptValue * kr_left = malloc(L * R * sizeof *kr_left);
+    sptValue * kr_right = malloc(T * R * sizeof *kr_right);
+    spt_CheckOSError(!kr_left || !kr_right, "CPU  DTns MTTKRP");
+    spt_DenseKhatriRao(kr_left, mats, 0, mode, R);
+    spt_DenseKhatriRao(kr_right, mats, mode+1, nmodes, R);
+
+    if(T >= L) {
+        if(L == 1) {
+            spt_DenseGemm(0, I, R, T, xvals, T, kr_right, R, 0, out, stride, tk);
+        } else {
+            /* W (L*I x R) = X (L*I x T) KR_right, then out(i) = sum_l KR_left(l) .* W(l, i) */
+            sptValue * W = malloc(L * I * R * sizeof *W);
+            spt_CheckOSError(!W, "CPU  DTns MTTKRP");
+            spt_DenseGemm(0, L * I, R, T, xvals, T, kr_right, R, 0, W, R, tk);
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptNnzIndex i = 0; i < I; ++i) {
+                sptValue * const restrict orow = out + i * stride;
+                memset(orow, 0, stride * sizeof *orow);
+                for(sptNnzIndex l = 0; l < L; ++l) {
+                    sptValue const * const restrict krow = kr_left + l * R;
+                    sptValue const * const restrict wrow = W + (l * I + i) * R;
+                    for(sptIndex r = 0; r < R; ++r) {
+                        orow[r] += krow[r] * wrow[r];
+                    }
+                }
+            }
+            free(W);
+        }
+    } else {
+        if(T == 1) {
+            spt_DenseGemm(1, I, R, L, xvals, I, kr_left, R, 0, out, stride, tk);
+        } else {
+            /* W (I*T x R) = X^T KR_left with X as L x (I*T), then out(i) = sum_t W(i, t) .* KR_right(t) */
+            sptValue * W = malloc(I * T * R * sizeof *W);
+            spt_CheckOSError(!W, "CPU  DTns MTTKRP");
+            spt_DenseGemm(1, I * T, R, L, xvals, I * T, kr_left, R, 0, W, R, tk);
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptNnzIndex i = 0; i < I; ++i) {
+                sptValue * const restrict orow = out + i * stride;
+                memset(orow, 0, stride * sizeof *orow);
+                for(sptNnzIndex t = 0; t < T; ++t) {
+                    sptValue const * const restrict krow = kr_right + t * R;
+                    sptValue const * const restrict wrow = W + (i * T + t) * R;
+                    for(sptIndex r = 0; r < R; ++r) {
+                        orow[r] += krow[r] * wrow[r];
+                    }
+                }
+            }
+            free(W);
+        }
+    }
+
+    free(kr_left);
+    free(kr_right);
+    return 0;
+}
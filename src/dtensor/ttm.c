@@ -0,0 +1,74 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "dtensor.h"
+
+/**
+ * Dense tensor times a dense matrix along one mode, Y = X x_mode U^T.
+ * With X viewed as L x I x T, every one of the L slabs is a GEMM
+ * Y_l (R x T) = U^T (R x I) X_l (I x T); the last mode is a single GEMM.
+ * @param[out] Y    an uninitialized dense tensor, ndims[mode] becomes U->ncols
+ * @param[in]  X    the dense tensor
+ * @param[in]  U    the matrix, X->ndims[mode] x R
+ * @param[in]  mode the mode to multiply along
+ * @param[in]  tk   the number of threads
+ */
+int sptDenseTensorMulMatrix(sptDenseTensor *Y, const sptDenseTensor *X, const sptMatrix *U, sptIndex const mode, int const tk) {
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  DTns * Mtx", "shape mismatch");
+    }
+    if(X->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  DTns * Mtx", "shape mismatch");
+    }
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "CPU  DTns * Mtx");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ndims[m] = X->ndims[m];
+    }
+    ndims[mode] = U->ncols;
+    result = sptNewDenseTensor(Y, nmodes, ndims);
+    free(ndims);
+    spt_CheckError(result, "CPU  DTns * Mtx", NULL);
+
+    sptNnzIndex const R = U->ncols;
+    sptNnzIndex const L = spt_DenseTensorSpan(X->ndims, 0, mode);
+    sptNnzIndex const I = X->ndims[mode];
+    sptNnzIndex const T = spt_DenseTensorSpan(X->ndims, mode+1, nmodes);
+    sptValue const * const xvals = X->values.data;
+    sptValue * const yvals = Y->values.data;
+
+    if(T == 1) {
+        spt_DenseGemm(0, L, R, I, xvals, I, U->values, U->stride, 0, yvals, R, tk);
+        return 0;
+    }
+    /* A threaded BLAS parallelizes every GEMM, the fallback loop the slabs */
+#ifdef PARTI_USE_BLAS
+    int const outer = 1, inner = tk;
+#else
+    int const outer = tk, inner = 1;
+#endif
+    #pragma omp parallel for schedule(static) num_threads(outer)
+    for(sptNnzIndex l = 0; l < L; ++l) {
+        spt_DenseGemm(1, R, T, I, U->values, U->stride, xvals + l * I * T, T, 0, yvals + l * R * T, T, inner);
+    }
+    return 0;
+}
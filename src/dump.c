@@ -0,0 +1,121 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error/error.h"
+
+/* Bytes of text a thread formats before its turn to write */
+#define SPT_DUMP_BLOCK_BYTES ((size_t) 1 << 20)
+
+struct spt_TagTextBuffer {
+    char * data;
+    size_t len;
+    size_t cap;
+    int failed;     /// out of memory or an encoding error, the block is lost
+};
+
+/**
+ * Append formatted text to a buffer of spt_DumpRows, growing it as needed.
+ */
+int spt_TextPrintf(spt_TextBuffer * buf, char const * fmt, ...) {
+    for(;;) {
+        va_list args;
+        va_start(args, fmt);
+        int const n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+        if(n < 0) {
+            buf->failed = 1;
+            return -1;
+        }
+        if((size_t) n < buf->cap - buf->len) {
+            buf->len += (size_t) n;
+            return n;
+        }
+        size_t const cap = 2 * buf->cap + (size_t) n + 1;
+        char * data = realloc(buf->data, cap);
+        if(data == NULL) {
+            buf->failed = 1;
+            return -1;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+}
+
+/**
+ * Write nrows lines of text formatted by a callback, in parallel.
+ *
+ * Threads format blocks of about a megabyte each into their own buffers and
+ * write them to fp in row order, so the output is the same as a sequential
+ * loop calling fprintf, while formatting, the dominant cost, scales.
+ *
+ * @param fp        the stream, headers written before are kept in front
+ * @param nrows     the number of rows
+ * @param row_bytes a guess of the bytes of one row, to size the blocks
+ * @param format    appends row `row` to the buffer with spt_TextPrintf
+ * @param ctx       passed to format
+ * @param tk        the number of threads, 0 for the default
+ */
+int spt_DumpRows(FILE * fp, sptNnzIndex const nrows, size_t const row_bytes, spt_FormatRow format, void const * ctx, int const tk) {
+    if(nrows == 0) {
+        return 0;
+    }
+    sptNnzIndex block = SPT_DUMP_BLOCK_BYTES / (row_bytes > 0 ? row_bytes : 1);
+    if(block == 0) block = 1;
+    sptNnzIndex const nblocks = (nrows + block - 1) / block;
+    int nt = sptExecThreads(tk);
+    if((sptNnzIndex) nt > nblocks) nt = (int) nblocks;
+    int error = 0;
+
+    #pragma omp parallel num_threads(nt)
+    {
+        spt_TextBuffer buf = { NULL, 0, 0, 0 };
+        buf.cap = block * row_bytes + 64;
+        buf.data = malloc(buf.cap);
+        buf.failed = buf.data == NULL;
+        #pragma omp for ordered schedule(static, 1)
+        for(sptNnzIndex b = 0; b < nblocks; ++b) {
+            sptNnzIndex const end = (b + 1) * block < nrows ? (b + 1) * block : nrows;
+            buf.len = 0;
+            for(sptNnzIndex i = b * block; i < end && !buf.failed; ++i) {
+                format(&buf, ctx, i);
+            }
+            #pragma omp ordered
+            {
+                if(error == 0) {
+                    if(buf.failed) {
+                        error = ENOMEM;
+                    } else if(fwrite(buf.data, 1, buf.len, fp) != buf.len) {
+                        error = errno != 0 ? errno : EIO;
+                    }
+                }
+            }
+        }
+        free(buf.data);
+    }
+
+    if(error != 0) {
+        errno = error;
+        spt_CheckOSError(1, "Dump Rows");
+    }
+    return 0;
+}
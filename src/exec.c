@@ -0,0 +1,200 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <string.h>
+#include "error/error.h"
+#if defined(__linux__) && defined(PARTI_USE_OPENMP)
+    #include <sched.h>
+    #define SPT_EXEC_AFFINITY
+#endif
+
+#if defined(__GNUC__)
+    #define SPT_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define SPT_THREAD_LOCAL _Thread_local
+#endif
+
+/*
+ * Execution contexts.
+ *
+ * A context belongs to the thread that set it, so callers running
+ * decompositions side by side, each from its own thread, each keep their own
+ * thread count, cores, allocator and CUDA device. The thread count is
+ * applied with omp_set_num_threads, whose setting is private to the calling
+ * thread; the library's drivers install a derived context for their `tk`
+ * and put the caller's back when they return, instead of leaving it changed.
+ */
+
+typedef struct {
+    sptExecContext const * ctx;  /// the context set, NULL for none
+    int base_threads;            /// the thread count before any context, 0 until saved
+#ifdef SPT_EXEC_AFFINITY
+    int pinned;                  /// whether the team was pinned by a context
+    cpu_set_t base_cores;        /// the affinity before any context
+#endif
+} spt_ExecState;
+
+#ifdef SPT_THREAD_LOCAL
+static SPT_THREAD_LOCAL spt_ExecState spt_exec;
+#else
+static spt_ExecState spt_exec;
+#endif
+
+
+/**
+ * A context that only sets the thread count; fill in the other fields to
+ * choose cores, an allocator or a CUDA device and stream.
+ * @param[out] ctx      the context
+ * @param[in]  nthreads the number of OpenMP threads, 0 to keep the caller's
+ */
+int sptNewExecContext(sptExecContext * ctx, int const nthreads) {
+    if(nthreads < 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "ExecContext", "nthreads < 0");
+    }
+    ctx->nthreads = nthreads;
+    ctx->cores = NULL;
+    ctx->ncores = 0;
+    ctx->allocator = NULL;
+    ctx->backing = SPT_MEM_DEFAULT;
+    ctx->cuda_device = -1;
+    ctx->cuda_stream = NULL;
+    ctx->cpd_checkpoint = NULL;
+    ctx->cpd_checkpoint_every = 0;
+    ctx->cpd_deadline = 0;
+    ctx->cpd_progress = NULL;
+    ctx->cpd_progress_arg = NULL;
+    return 0;
+}
+
+
+#ifdef SPT_EXEC_AFFINITY
+/* Pin thread i of a team of nthreads to cores[i % ncores], or give all of them mask */
+static void spt_ExecPin(int const nthreads, int const * cores, int const ncores, cpu_set_t const * mask) {
+    #pragma omp parallel num_threads(nthreads)
+    {
+        cpu_set_t set;
+        if(cores != NULL) {
+            CPU_ZERO(&set);
+            CPU_SET(cores[omp_get_thread_num() % ncores], &set);
+        } else {
+            set = *mask;
+        }
+        sched_setaffinity(0, sizeof set, &set);
+    }
+}
+#endif
+
+
+/**
+ * Make ctx the calling thread's execution context, or go back to none with
+ * NULL. The context must stay alive while it is set. Returns the previous
+ * one, so that a caller can put it back when done.
+ *
+ * Parallel regions the thread starts use ctx->nthreads threads; with a core
+ * set they are pinned round-robin to it, and unpinned again when a context
+ * without one is set. Buffers the thread allocates come from ctx's allocator
+ * or backing; those allocated by the team's other threads do not. The CUDA
+ * device is made current and the stream is the one the device memory pool
+ * orders released blocks on.
+ */
+sptExecContext const * sptSetExecContext(sptExecContext const * ctx) {
+    spt_ExecState * const state = &spt_exec;
+    sptExecContext const * const prev = state->ctx;
+#ifdef PARTI_USE_OPENMP
+    if(state->base_threads == 0) {
+        state->base_threads = omp_get_max_threads();
+#ifdef SPT_EXEC_AFFINITY
+        sched_getaffinity(0, sizeof state->base_cores, &state->base_cores);
+#endif
+    }
+    int const nthreads = ctx != NULL && ctx->nthreads > 0 ? ctx->nthreads : state->base_threads;
+    omp_set_num_threads(nthreads);
+#ifdef SPT_EXEC_AFFINITY
+    if(ctx != NULL && ctx->cores != NULL && ctx->ncores > 0) {
+        spt_ExecPin(nthreads, ctx->cores, ctx->ncores, NULL);
+        state->pinned = 1;
+    } else if(state->pinned) {
+        spt_ExecPin(nthreads, NULL, 0, &state->base_cores);
+        state->pinned = 0;
+    }
+#endif
+#endif
+#ifdef PARTI_USE_CUDA
+    if(ctx != NULL && ctx->cuda_device >= 0) {
+        sptCudaSetDevice(ctx->cuda_device);
+    }
+#endif
+    state->ctx = ctx;
+    return prev;
+}
+
+
+/**
+ * The calling thread's execution context, NULL if it has none
+ */
+sptExecContext const * sptGetExecContext(void) {
+    return spt_exec.ctx;
+}
+
+
+/**
+ * The number of threads for a parallel call: tk when positive, otherwise the
+ * execution context's, otherwise all the calling thread would get.
+ */
+int sptExecThreads(int const tk) {
+    if(tk > 0) {
+        return tk;
+    }
+    sptExecContext const * const ctx = spt_exec.ctx;
+    if(ctx != NULL && ctx->nthreads > 0) {
+        return ctx->nthreads;
+    }
+#ifdef PARTI_USE_OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+
+/*
+ * Set scope, a copy of the current context with tk threads, for the
+ * duration of a driver with an explicit thread count; returns what to pass
+ * to sptSetExecContext when it ends. Without cores of its own the scope is
+ * pinned as sptSetPinPolicy says.
+ */
+sptExecContext const * spt_ExecPushThreads(sptExecContext * scope, int const tk) {
+    if(spt_exec.ctx != NULL) {
+        *scope = *spt_exec.ctx;
+        if(tk > 0) {
+            scope->nthreads = tk;
+        }
+    } else {
+        sptNewExecContext(scope, tk > 0 ? tk : 0);
+    }
+    if(scope->cores == NULL || scope->ncores <= 0) {
+        scope->cores = sptPinOrder(spt_PinPolicy(), 0, &scope->ncores);
+    }
+    return sptSetExecContext(scope);
+}
+
+
+/* The CUDA stream of the calling thread's context, NULL for the default one */
+void * spt_ExecCudaStream(void) {
+    return spt_exec.ctx != NULL ? spt_exec.ctx->cuda_stream : NULL;
+}
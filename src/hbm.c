@@ -0,0 +1,223 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#ifdef PARTI_USE_MEMKIND
+    #include <hbwmalloc.h>
+#endif
+#ifdef PARTI_USE_NUMA
+    #include <numa.h>
+#endif
+
+/*
+ * High-bandwidth memory, MCDRAM on Knights Landing or HBM next to DDR.
+ *
+ * It is small, so only data that MTTKRP reads over and over is worth a
+ * place: factor matrices and the MTTKRP output, gathered at random every
+ * iteration, come first, and the element indices of HiCOO, streamed once
+ * per MTTKRP, only get what is left beyond a reserve kept for the former.
+ * Buffers come from memkind when built with it, else from the NUMA nodes
+ * without CPUs, or those PARTI_HBM_NODES lists, through libnuma.
+ */
+
+/* Share of the capacity streamed data leaves to randomly accessed data */
+#define SPT_HBM_STREAM_RESERVE 4
+
+enum {
+    SPT_HBM_UNKNOWN = -1,
+    SPT_HBM_NONE = 0,
+    SPT_HBM_MEMKIND = 1,
+    SPT_HBM_NUMA = 2,
+};
+
+static int spt_hbm_source = SPT_HBM_UNKNOWN;
+static long long spt_hbm_capacity = -1;
+static size_t spt_hbm_used = 0;
+#ifdef PARTI_USE_NUMA
+static struct bitmask * spt_hbm_nodes = NULL;
+static size_t spt_hbm_node_bytes = 0;
+#endif
+
+#ifdef PARTI_USE_NUMA
+/* The memory-only NUMA nodes, or those PARTI_HBM_NODES lists; NULL if none */
+static struct bitmask * spt_HbmFindNodes(size_t * const bytes) {
+    *bytes = 0;
+    if(numa_available() < 0) {
+        return NULL;
+    }
+    char const * env = getenv("PARTI_HBM_NODES");
+    struct bitmask * nodes = env != NULL ? numa_parse_nodestring(env) : numa_allocate_nodemask();
+    if(nodes == NULL) {
+        return NULL;
+    }
+    struct bitmask * cpus = numa_allocate_cpumask();
+    int const max_node = numa_max_node();
+    for(int node = 0; node <= max_node; ++node) {
+        long long const node_bytes = numa_node_size64(node, NULL);
+        /* CXL and PMEM nodes are CPU-less too, but slower than DRAM */
+        if(env == NULL && node_bytes > 0 && numa_node_to_cpus(node, cpus) == 0 && numa_bitmask_weight(cpus) == 0 &&
+            !spt_CapacityTierHasNode(node)) {
+            numa_bitmask_setbit(nodes, (unsigned) node);
+        }
+        if(numa_bitmask_isbitset(nodes, (unsigned) node) && node_bytes > 0) {
+            *bytes += (size_t) node_bytes;
+        }
+    }
+    numa_free_cpumask(cpus);
+    if(*bytes == 0) {
+        numa_free_nodemask(nodes);
+        return NULL;
+    }
+    return nodes;
+}
+#endif
+
+/* Where high-bandwidth memory comes from, found on first use */
+static int spt_HbmSource(void) {
+    if(spt_hbm_source != SPT_HBM_UNKNOWN) {
+        return spt_hbm_source;
+    }
+    #pragma omp critical(spt_hbm)
+    {
+        if(spt_hbm_source == SPT_HBM_UNKNOWN) {
+            int source = SPT_HBM_NONE;
+#ifdef PARTI_USE_MEMKIND
+            if(hbw_check_available() == 0) {
+                source = SPT_HBM_MEMKIND;
+            }
+#endif
+#ifdef PARTI_USE_NUMA
+            spt_hbm_nodes = spt_HbmFindNodes(&spt_hbm_node_bytes);
+            if(source == SPT_HBM_NONE && spt_hbm_nodes != NULL) {
+                source = SPT_HBM_NUMA;
+            }
+#endif
+            spt_hbm_source = source;
+        }
+    }
+    return spt_hbm_source;
+}
+
+/* Bytes of high-bandwidth memory hot data may take, from PARTI_HBM_BYTES or the NUMA nodes found */
+static size_t spt_HbmCapacity(void) {
+    if(spt_hbm_capacity < 0) {
+        char const * env = getenv("PARTI_HBM_BYTES");
+        long long capacity = 0;
+        if(env != NULL) {
+            capacity = atoll(env);
+        } else if(spt_HbmSource() != SPT_HBM_NONE) {
+#ifdef PARTI_USE_NUMA
+            capacity = (long long) spt_hbm_node_bytes;
+#endif
+        }
+        spt_hbm_capacity = capacity > 0 ? capacity : 0;
+    }
+    return (size_t) spt_hbm_capacity;
+}
+
+/**
+ * Let the library place its hot data, factor matrices and MTTKRP outputs,
+ * then the element indices of HiCOO tensors, in high-bandwidth memory, up
+ * to capacity bytes; 0 turns the placement off. Buffers asked for with
+ * SPT_MEM_HBM are not limited by it.
+ * Defaults to the PARTI_HBM_BYTES environment variable, else the size of
+ * the memory-only NUMA nodes when built with libnuma, else off.
+ * @param capacity  bytes of high-bandwidth memory to use
+ */
+void sptSetHbmPlacement(size_t const capacity) {
+    spt_hbm_capacity = (long long) capacity;
+}
+
+/* Whether buffers asked for with SPT_MEM_HBM can get high-bandwidth memory */
+int sptHbmAvailable(void) {
+    return spt_HbmSource() != SPT_HBM_NONE;
+}
+
+/* Bytes of high-bandwidth memory the library holds */
+size_t sptHbmBytesInUse(void) {
+    size_t used;
+    #pragma omp atomic read
+    used = spt_hbm_used;
+    return used;
+}
+
+/*
+ * The backing for a new buffer of bytes under the placement policy:
+ * SPT_MEM_HBM if it is large enough to matter and fits, else
+ * SPT_MEM_DEFAULT. Streamed data leaves a quarter of the capacity free.
+ */
+sptMemBacking spt_HbmBacking(size_t const bytes, int const streamed) {
+    size_t capacity = spt_HbmCapacity();
+    if(capacity == 0 || bytes < PARTI_HBM_MIN_BYTES || spt_HbmSource() == SPT_HBM_NONE) {
+        return SPT_MEM_DEFAULT;
+    }
+    if(streamed) {
+        capacity -= capacity / SPT_HBM_STREAM_RESERVE;
+    }
+    size_t const used = sptHbmBytesInUse();
+    return used <= capacity && bytes <= capacity - used ? SPT_MEM_HBM : SPT_MEM_DEFAULT;
+}
+
+/* bytes of high-bandwidth memory aligned to PARTI_VECTOR_ALIGN, NULL if there is none left */
+void * spt_HbmAlloc(size_t const bytes) {
+    void * ptr = NULL;
+    switch(spt_HbmSource()) {
+#ifdef PARTI_USE_MEMKIND
+    case SPT_HBM_MEMKIND:
+        if(hbw_posix_memalign(&ptr, PARTI_VECTOR_ALIGN, bytes) != 0) {
+            ptr = NULL;
+        }
+        break;
+#endif
+#ifdef PARTI_USE_NUMA
+    case SPT_HBM_NUMA:
+        /* Page-aligned, and spread over the nodes when there are several */
+        ptr = numa_alloc_interleaved_subset(bytes, spt_hbm_nodes);
+        break;
+#endif
+    default:
+        break;
+    }
+    if(ptr != NULL) {
+        #pragma omp atomic update
+        spt_hbm_used += bytes;
+    }
+    return ptr;
+}
+
+/* Release bytes from spt_HbmAlloc */
+void spt_HbmFree(void * ptr, size_t const bytes) {
+    switch(spt_hbm_source) {
+#ifdef PARTI_USE_MEMKIND
+    case SPT_HBM_MEMKIND:
+        hbw_free(ptr);
+        break;
+#endif
+#ifdef PARTI_USE_NUMA
+    case SPT_HBM_NUMA:
+        numa_free(ptr, bytes);
+        break;
+#endif
+    default:
+        (void) ptr;
+        break;
+    }
+    #pragma omp atomic update
+    spt_hbm_used -= bytes;
+}
@@ -0,0 +1,165 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_HIP_COMPAT_H
+#define PARTI_HIP_COMPAT_H
+
+/*
+ * The HIP backend (USE_HIP) compiles the *.cu sources unchanged with hipcc.
+ * This header is force-included into each of them and maps the CUDA runtime,
+ * cuBLAS, cuSPARSE and cuSOLVER names they use onto HIP, hipBLAS, hipSPARSE
+ * and hipSOLVER, whose APIs mirror them call for call. The headers next to it
+ * stand in for <cuda_runtime.h>, <cusparse.h> and the rest, so the sources'
+ * own includes resolve here too. A name a source starts using must be added
+ * below, or the HIP build fails to compile it.
+ */
+
+#include <hip/hip_runtime.h>
+#include <hipblas/hipblas.h>
+#include <hipsparse/hipsparse.h>
+#include <hipsolver/hipsolver.h>
+
+/* Runtime */
+#define cudaDeviceCanAccessPeer         hipDeviceCanAccessPeer
+#define cudaDeviceEnablePeerAccess      hipDeviceEnablePeerAccess
+#define cudaDeviceProp                  hipDeviceProp_t
+#define cudaDeviceSynchronize           hipDeviceSynchronize
+#define cudaError_t                     hipError_t
+#define cudaErrorMemoryAllocation       hipErrorOutOfMemory
+#define cudaEventCreate                 hipEventCreate
+#define cudaEventCreateWithFlags        hipEventCreateWithFlags
+#define cudaEventDestroy                hipEventDestroy
+#define cudaEventDisableTiming          hipEventDisableTiming
+#define cudaEventElapsedTime            hipEventElapsedTime
+#define cudaEventRecord                 hipEventRecord
+#define cudaEventSynchronize            hipEventSynchronize
+#define cudaEvent_t                     hipEvent_t
+#define cudaFree                        hipFree
+#define cudaFreeHost                    hipHostFree
+#define cudaGetDevice                   hipGetDevice
+#define cudaGetDeviceProperties         hipGetDeviceProperties
+#define cudaGetErrorString              hipGetErrorString
+#define cudaGetLastError                hipGetLastError
+#define cudaGraphDestroy                hipGraphDestroy
+#define cudaGraphExecDestroy            hipGraphExecDestroy
+#define cudaGraphExec_t                 hipGraphExec_t
+#define cudaGraphInstantiate            hipGraphInstantiate
+#define cudaGraphLaunch                 hipGraphLaunch
+#define cudaGraph_t                     hipGraph_t
+#define cudaHostAlloc                   hipHostMalloc
+#define cudaHostAllocPortable           hipHostMallocPortable
+#define cudaHostRegister                hipHostRegister
+#define cudaHostRegisterDefault         hipHostRegisterDefault
+#define cudaHostUnregister              hipHostUnregister
+#define cudaMalloc                      hipMalloc
+#define cudaMemGetInfo                  hipMemGetInfo
+#define cudaMemcpy                      hipMemcpy
+#define cudaMemcpyAsync                 hipMemcpyAsync
+#define cudaMemcpyDeviceToDevice        hipMemcpyDeviceToDevice
+#define cudaMemcpyDeviceToHost          hipMemcpyDeviceToHost
+#define cudaMemcpyHostToDevice          hipMemcpyHostToDevice
+#define cudaMemcpyKind                  hipMemcpyKind
+#define cudaMemcpyPeer                  hipMemcpyPeer
+#define cudaMemset                      hipMemset
+#define cudaMemsetAsync                 hipMemsetAsync
+#define cudaSetDevice                   hipSetDevice
+#define cudaStreamBeginCapture          hipStreamBeginCapture
+#define cudaStreamCaptureModeThreadLocal hipStreamCaptureModeThreadLocal
+#define cudaStreamCreate                hipStreamCreate
+#define cudaStreamCreateWithFlags       hipStreamCreateWithFlags
+#define cudaStreamDestroy               hipStreamDestroy
+#define cudaStreamEndCapture            hipStreamEndCapture
+#define cudaStreamNonBlocking           hipStreamNonBlocking
+#define cudaStreamSynchronize           hipStreamSynchronize
+#define cudaStream_t                    hipStream_t
+#define cudaSuccess                     hipSuccess
+#define cudaThreadSynchronize           hipDeviceSynchronize
+
+/* The runtime version gates features such as graphs; HIP has all of them */
+#ifndef CUDART_VERSION
+#define CUDART_VERSION                  10000
+#endif
+
+/* Library data types */
+#define CUDA_R_32F                      HIP_R_32F
+#define CUDA_R_64F                      HIP_R_64F
+
+/* cuBLAS */
+#define CUBLAS_OP_N                     HIPBLAS_OP_N
+#define CUBLAS_STATUS_SUCCESS           HIPBLAS_STATUS_SUCCESS
+#define cublasCreate                    hipblasCreate
+#define cublasDestroy                   hipblasDestroy
+#define cublasDgemm                     hipblasDgemm
+#define cublasDsyrk                     hipblasDsyrk
+#define cublasHandle_t                  hipblasHandle_t
+#define cublasSetStream                 hipblasSetStream
+#define cublasSgemm                     hipblasSgemm
+#define cublasSsyrk                     hipblasSsyrk
+
+/*
+ * The sources pass CUBLAS_FILL_MODE_LOWER to cuBLAS and cuSOLVER alike, as
+ * CUDA shares the enum; hipBLAS and hipSOLVER each have their own.
+ */
+struct spt_HipFillModeLower {
+    operator hipblasFillMode_t() const { return HIPBLAS_FILL_MODE_LOWER; }
+    operator hipsolverFillMode_t() const { return HIPSOLVER_FILL_MODE_LOWER; }
+};
+#define CUBLAS_FILL_MODE_LOWER          spt_HipFillModeLower()
+
+/* cuSPARSE */
+#define CUSPARSE_INDEX_64I              HIPSPARSE_INDEX_64I
+#define CUSPARSE_INDEX_BASE_ZERO        HIPSPARSE_INDEX_BASE_ZERO
+#define CUSPARSE_OPERATION_NON_TRANSPOSE HIPSPARSE_OPERATION_NON_TRANSPOSE
+#define CUSPARSE_ORDER_ROW              HIPSPARSE_ORDER_ROW
+#define CUSPARSE_SPMM_ALG_DEFAULT       HIPSPARSE_SPMM_ALG_DEFAULT
+#define CUSPARSE_STATUS_SUCCESS         HIPSPARSE_STATUS_SUCCESS
+#define cusparseCreate                  hipsparseCreate
+#define cusparseCreateCsr               hipsparseCreateCsr
+#define cusparseCreateDnMat             hipsparseCreateDnMat
+#define cusparseDestroy                 hipsparseDestroy
+#define cusparseDestroyDnMat            hipsparseDestroyDnMat
+#define cusparseDestroySpMat            hipsparseDestroySpMat
+#define cusparseDnMatDescr_t            hipsparseDnMatDescr_t
+#define cusparseGetErrorString          hipsparseGetErrorString
+#define cusparseHandle_t                hipsparseHandle_t
+#define cusparseSetStream               hipsparseSetStream
+#define cusparseSpMM                    hipsparseSpMM
+#define cusparseSpMM_bufferSize         hipsparseSpMM_bufferSize
+#define cusparseSpMatDescr_t            hipsparseSpMatDescr_t
+#define cusparseStatus_t                hipsparseStatus_t
+
+/* cuSOLVER */
+#define CUSOLVER_STATUS_SUCCESS         HIPSOLVER_STATUS_SUCCESS
+#define cusolverDnCreate                hipsolverDnCreate
+#define cusolverDnDestroy               hipsolverDnDestroy
+#define cusolverDnDpotrf                hipsolverDnDpotrf
+#define cusolverDnDpotrfBatched         hipsolverDnDpotrfBatched
+#define cusolverDnDpotrf_bufferSize     hipsolverDnDpotrf_bufferSize
+#define cusolverDnDpotrs                hipsolverDnDpotrs
+#define cusolverDnHandle_t              hipsolverDnHandle_t
+#define cusolverDnSetStream             hipsolverDnSetStream
+#define cusolverDnSpotrf                hipsolverDnSpotrf
+#define cusolverDnSpotrfBatched         hipsolverDnSpotrfBatched
+#define cusolverDnSpotrf_bufferSize     hipsolverDnSpotrf_bufferSize
+#define cusolverDnSpotrs                hipsolverDnSpotrs
+#define cusolverSpCreate                hipsolverSpCreate
+#define cusolverSpDestroy               hipsolverSpDestroy
+#define cusolverSpHandle_t              hipsolverSpHandle_t
+#define cusolverSpSetStream             hipsolverSpSetStream
+
+#endif
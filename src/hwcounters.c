@@ -0,0 +1,227 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+#endif
+
+/*
+ * Per-kernel hardware counters.
+ *
+ * When enabled, a probe opens one perf event per counter on every thread
+ * of the kernel's team, counting user space only, and adds them up when
+ * the kernel ends. Counters the machine or its permissions do not offer are
+ * left out. Next to the elapsed time the probe reports the GFLOP/s and GB/s
+ * of the kernel's own operation and traffic model, so a run shows how far a
+ * variant is from the compute and bandwidth limits even where no hardware
+ * events are available, e.g. in most virtual machines.
+ */
+
+typedef enum {
+    SPT_HW_CACHE_MISSES = 0,
+    SPT_HW_DTLB_MISSES,
+    SPT_HW_INSTRUCTIONS,
+    SPT_HW_CYCLES,
+    SPT_HW_PAGE_FAULTS,
+    SPT_HW_NCOUNTERS
+} spt_HardwareCounter;
+
+static char const * const spt_hw_names[SPT_HW_NCOUNTERS] = {
+    "LLC misses", "dTLB misses", "instructions", "cycles", "page faults"
+};
+
+struct spt_TagKernelProbe {
+    int nthreads;
+    int * fds;              /// nthreads * SPT_HW_NCOUNTERS, -1 where not opened
+    struct timespec start;  /// for kernels without their own timer
+};
+
+static int spt_hw_enabled = -1;
+
+/**
+ * Turn per-kernel hardware counters and rate reports on or off. They are
+ * off unless the environment sets PARTI_HW_COUNTERS=1. Not thread-safe.
+ */
+void sptSetHardwareCounters(int const enable) {
+    spt_hw_enabled = enable != 0;
+}
+
+int sptHardwareCountersEnabled(void) {
+    if(spt_hw_enabled < 0) {
+        char const * env = getenv("PARTI_HW_COUNTERS");
+        spt_hw_enabled = env != NULL && strcmp(env, "0") != 0;
+    }
+    return spt_hw_enabled;
+}
+
+#ifdef __linux__
+static int spt_OpenCounter(spt_HardwareCounter const counter) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    switch(counter) {
+    case SPT_HW_CACHE_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case SPT_HW_DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case SPT_HW_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case SPT_HW_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    default:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+        break;
+    }
+    /* The calling thread, on any CPU */
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/**
+ * Start counting for a kernel run by nthreads OpenMP threads.
+ * @return NULL when hardware counters are off, or on failure
+ */
+spt_KernelProbe * spt_KernelProbeStart(int const nthreads) {
+    if(!sptHardwareCountersEnabled()) {
+        return NULL;
+    }
+    spt_KernelProbe * probe = malloc(sizeof *probe);
+    if(probe == NULL) {
+        return NULL;
+    }
+    probe->nthreads = nthreads > 0 ? nthreads : 1;
+    probe->fds = malloc((size_t) probe->nthreads * SPT_HW_NCOUNTERS * sizeof *probe->fds);
+    if(probe->fds == NULL) {
+        free(probe);
+        return NULL;
+    }
+    for(int i = 0; i < probe->nthreads * SPT_HW_NCOUNTERS; ++i) {
+        probe->fds[i] = -1;
+    }
+#ifdef __linux__
+    /* Events follow the thread that opens them, so each team member opens its own */
+    #pragma omp parallel num_threads(probe->nthreads)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        for(int c = 0; c < SPT_HW_NCOUNTERS; ++c) {
+            probe->fds[tid * SPT_HW_NCOUNTERS + c] = spt_OpenCounter((spt_HardwareCounter) c);
+        }
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &probe->start);
+    return probe;
+}
+
+/**
+ * Finish a kernel: record its time and, when probed, its hardware counters
+ * and the rates of its model in the telemetry, as "<name> flops",
+ * "<name> bytes" and "<name> LLC misses" and so on, and print them on one
+ * line with the elapsed time.
+ *
+ * Without a probe this is sptPrintElapsedTime, or nothing if timer is NULL
+ * too. With a probe and no timer, the time since spt_KernelProbeStart is used.
+ *
+ * @param probe the probe from spt_KernelProbeStart, freed here; may be NULL
+ * @param timer the kernel's stopped timer; may be NULL
+ * @param name  the kernel's timer name
+ * @param flops floating-point operations of the kernel's model
+ * @param bytes memory traffic of the kernel's model
+ * @return the elapsed time
+ */
+double spt_KernelProbeStop(spt_KernelProbe * probe, sptTimer const timer, char const * name, double const flops, double const bytes) {
+    if(probe == NULL) {
+        return timer != NULL ? sptPrintElapsedTime(timer, name) : 0;
+    }
+    double elapsed;
+    if(timer != NULL) {
+        elapsed = sptElapsedTime(timer);
+    } else {
+        struct timespec stop;
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        elapsed = stop.tv_sec - probe->start.tv_sec + (stop.tv_nsec - probe->start.tv_nsec) * 1e-9;
+    }
+
+    int have[SPT_HW_NCOUNTERS];
+    double counts[SPT_HW_NCOUNTERS];
+    for(int c = 0; c < SPT_HW_NCOUNTERS; ++c) {
+        have[c] = 0;
+        counts[c] = 0;
+        for(int t = 0; t < probe->nthreads; ++t) {
+            int const fd = probe->fds[t * SPT_HW_NCOUNTERS + c];
+            uint64_t value;
+            if(fd >= 0 && read(fd, &value, sizeof value) == (ssize_t) sizeof value) {
+                have[c] = 1;
+                counts[c] += (double) value;
+            }
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    free(probe->fds);
+    free(probe);
+
+    char entry[256];
+    sptTelemetryRecordTime(name, elapsed);
+    snprintf(entry, sizeof entry, "%s flops", name);
+    sptTelemetryAddCounter(entry, flops);
+    snprintf(entry, sizeof entry, "%s bytes", name);
+    sptTelemetryAddCounter(entry, bytes);
+    for(int c = 0; c < SPT_HW_NCOUNTERS; ++c) {
+        if(have[c]) {
+            snprintf(entry, sizeof entry, "%s %s", name, spt_hw_names[c]);
+            sptTelemetryAddCounter(entry, counts[c]);
+        }
+    }
+
+    if(spt_TelemetryPrinting()) {
+        double const seconds = elapsed > 0 ? elapsed : 1e-9;
+        fprintf(stdout, "[%s]: %.9lf s, %.3lf GFLOP/s, %.3lf GB/s", name, elapsed, flops / seconds * 1e-9, bytes / seconds * 1e-9);
+        for(int c = 0; c < SPT_HW_NCOUNTERS; ++c) {
+            if(have[c]) {
+                fprintf(stdout, ", %s %.0lf", spt_hw_names[c], counts[c]);
+            }
+        }
+        if(have[SPT_HW_CACHE_MISSES]) {
+            fprintf(stdout, " (%.3lf GB/s from LLC)", counts[SPT_HW_CACHE_MISSES] * 64 / seconds * 1e-9);
+        }
+        fprintf(stdout, "\n");
+    }
+    return elapsed;
+}
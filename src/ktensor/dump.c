@@ -40,13 +40,14 @@ int sptDumpKruskalTensor(sptKruskalTensor *ktsr, FILE *fp)
 
     iores = fprintf(fp, "fit: %lf\n", ktsr->fit);
     fprintf(fp, "lambda:\n");    
-    for(mode = 0; mode < ktsr->nmodes; ++mode) {
-        iores = fprintf(fp, "%"PARTI_PRI_VALUE " ", ktsr->lambda[mode]);
+    for(sptIndex r = 0; r < ktsr->rank; ++r) {
+        iores = fprintf(fp, "%"PARTI_PRI_VALUE " ", ktsr->lambda[r]);
         spt_CheckOSError(iores < 0, "KruskalTns Dump");
     }
 
+    fputs("\n", fp);
     fprintf(fp, "Factor matrices:\n");
-    for(mode=0; mode < ktsr->nmodes+1; ++mode) {
+    for(mode=0; mode < ktsr->nmodes; ++mode) {
         iores = sptDumpMatrix(ktsr->factors[mode], fp);
         spt_CheckOSError(iores != 0, "KruskalTns Dump");
     }
@@ -74,13 +75,14 @@ int sptDumpRankKruskalTensor(sptRankKruskalTensor *ktsr, FILE *fp)
 
     iores = fprintf(fp, "fit: %lf\n", ktsr->fit);
     fprintf(fp, "lambda:\n");    
-    for(mode = 0; mode < ktsr->nmodes; ++mode) {
-        iores = fprintf(fp, "%"PARTI_PRI_VALUE " ", ktsr->lambda[mode]);
+    for(sptIndex r = 0; r < ktsr->rank; ++r) {
+        iores = fprintf(fp, "%"PARTI_PRI_VALUE " ", ktsr->lambda[r]);
         spt_CheckOSError(iores < 0, "KruskalTns Dump");
     }
 
+    fputs("\n", fp);
     fprintf(fp, "Factor matrices:\n");
-    for(mode=0; mode < ktsr->nmodes+1; ++mode) {
+    for(mode=0; mode < ktsr->nmodes; ++mode) {
         iores = sptDumpRankMatrix(ktsr->factors[mode], fp);
         spt_CheckOSError(iores != 0, "KruskalTns Dump");
     }
@@ -0,0 +1,219 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include "../error/error.h"
+#include "../sptensor/sptensor.h"
+#include "../sptensor/hicoo/hicoo.h"
+
+/*
+ * Estimated fit: the inner product of the tensor with the model is a sum
+ * over the nonzeros, so it is estimated from nstrata nonzeros, one drawn
+ * uniformly from each of nstrata equal runs of the storage order. Sorted
+ * storage makes the runs slices or blocks, so each stratum covers a part of
+ * the tensor. The squared norms of the tensor and the model are exact, the
+ * latter from the Gram matrices, so the only error is in the inner product.
+ * Its variance is estimated by collapsing the strata in pairs, which is why
+ * nstrata is even.
+ */
+
+/* The number of strata for nsamples draws over nnz nonzeros; nnz means every nonzero once */
+static sptNnzIndex spt_FitStrata(sptNnzIndex const nnz, sptNnzIndex const nsamples)
+{
+    sptNnzIndex const nstrata = nsamples < 2 ? 2 : nsamples + (nsamples & 1);
+    return nstrata >= nnz ? nnz : nstrata;
+}
+
+/* The nonzero drawn from stratum h of nstrata over nnz, and the stratum's size */
+static inline sptNnzIndex spt_FitDraw(sptNnzIndex const nnz, sptNnzIndex const nstrata, sptNnzIndex const h,
+    uint64_t const seed, sptNnzIndex * size)
+{
+    sptNnzIndex const lo = (sptNnzIndex) ((double) nnz * h / nstrata);
+    sptNnzIndex const hi = (sptNnzIndex) ((double) nnz * (h + 1) / nstrata);
+    uint64_t state = spt_GenMix(seed ^ spt_GenMix(h + 1));
+    *size = hi - lo;
+    sptNnzIndex const z = lo + (sptNnzIndex) (spt_GenUniform(&state) * (hi - lo));
+    return z < hi ? z : hi - 1;
+}
+
+/* The fit from the estimated inner product and its variance, with the half width of the two-sigma interval */
+static double spt_FitFromEstimate(double const spten_normsq, double const norm_mats,
+    double const inner, double const variance, double * bound)
+{
+    double const fit = sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner);
+    if(bound != NULL) {
+        double const sigma2 = 2 * sqrt(variance);
+        double const up = sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner + sigma2) - fit;
+        double const down = fit - sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner - sigma2);
+        *bound = up > down ? up : down;
+    }
+    return fit;
+}
+
+
+/**
+ * Estimate the fit of a Kruskal tensor to a sparse tensor from a stratified
+ * sample of its nonzeros, for convergence checks that should not pay a pass
+ * over the whole tensor; sptKruskalTensorFitNorm gives the exact fit.
+ *
+ * The nonzeros are split into nsamples runs of their storage order and one
+ * nonzero is drawn from each, so a tensor sorted by sptSparseTensorSortIndex
+ * is sampled across all of its slices. The model norm is exact, from ata.
+ * With nsamples at least spten->nnz every nonzero is used once and the fit
+ * is exact. The cost is O(nsamples * nmodes * rank).
+ *
+ * @param[in] spten         a COO sparse tensor
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] lambda  the weight array
+ * @param[in] mats    factor matrices, mats[0..nmodes-1]
+ * @param[in] ata    the results of ATA, A is a factor matrix, with ata[nmodes] as scratch
+ * @param[in] nsamples  the number of nonzeros to sample, rounded up to an even number
+ * @param[in] seed      the seed of the sample
+ * @param[out] bound    if not NULL, the half width of an approximate 95% interval around the fit
+ * @return fit  a double-precision float-point value
+ */
+double sptKruskalTensorFitSampled(
+  sptSparseTensor const * const spten,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** mats,
+  sptMatrix ** ata,
+  sptNnzIndex const nsamples,
+  uint64_t const seed,
+  double * bound)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const rank = mats[0]->ncols;
+  sptIndex const stride = mats[0]->stride;
+  sptNnzIndex const nnz = spten->nnz;
+  sptNnzIndex const nstrata = spt_FitStrata(nnz, nsamples);
+  int const exact = nstrata == nnz;
+  double inner = 0, variance = 0;
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for schedule(static) reduction(+:inner,variance)
+#endif
+  for(sptNnzIndex p=0; p < (nstrata + 1) / 2; ++p) {
+    double t[2] = { 0, 0 };
+    for(int k=0; k < 2; ++k) {
+      sptNnzIndex const h = 2 * p + k;
+      if(h >= nstrata) continue;
+      sptNnzIndex size = 1;
+      sptNnzIndex const z = exact ? h : spt_FitDraw(nnz, nstrata, h, seed, &size);
+      double model = 0;
+      for(sptIndex r=0; r < rank; ++r) {
+        double prod = lambda[r];
+        for(sptIndex m=0; m < nmodes; ++m) {
+          prod *= mats[m]->values[(size_t) spten->inds[m].data[z] * stride + r];
+        }
+        model += prod;
+      }
+      t[k] = (double) size * spten->values.data[z] * model;
+    }
+    inner += t[0] + t[1];
+    if(!exact) {
+      variance += (t[0] - t[1]) * (t[0] - t[1]);
+    }
+  }
+
+  double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata);
+  return spt_FitFromEstimate(spten_normsq, norm_mats, inner, variance, bound);
+}
+
+
+/**
+ * Estimate the fit of a Kruskal tensor (with sptElementIndex as the columns
+ * of their factor matrices) to a HiCOO sparse tensor, as
+ * sptKruskalTensorFitSampled does for COO. The strata are runs of the
+ * nonzeros in block order, so they follow the kernels and blocks.
+ *
+ * @param[in] hitsr         a HiCOO sparse tensor
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] lambda  the weight array
+ * @param[in] mats    factor matrices, mats[0..nmodes-1]
+ * @param[in] ata    the results of ATA, A is a factor matrix, with ata[nmodes] as scratch
+ * @param[in] nsamples  the number of nonzeros to sample, rounded up to an even number
+ * @param[in] seed      the seed of the sample
+ * @param[out] bound    if not NULL, the half width of an approximate 95% interval around the fit
+ * @return fit  a double-precision float-point value
+ */
+double sptKruskalTensorFitSampledHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptRankMatrix ** mats,
+  sptRankMatrix ** ata,
+  sptNnzIndex const nsamples,
+  uint64_t const seed,
+  double * bound)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptElementIndex const rank = mats[0]->ncols;
+  sptElementIndex const stride = mats[0]->stride;
+  sptNnzIndex const nnz = hitsr->nnz;
+  sptNnzIndex const nblocks = hitsr->bptr.len - 1;
+  sptNnzIndex const nkernels = hitsr->kptr.len - 1;
+  sptNnzIndex const nstrata = spt_FitStrata(nnz, nsamples);
+  int const exact = nstrata == nnz;
+  double inner = 0, variance = 0;
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for schedule(static) reduction(+:inner,variance)
+#endif
+  for(sptNnzIndex p=0; p < (nstrata + 1) / 2; ++p) {
+    double t[2] = { 0, 0 };
+    for(int k=0; k < 2; ++k) {
+      sptNnzIndex const h = 2 * p + k;
+      if(h >= nstrata) continue;
+      sptNnzIndex size = 1;
+      sptNnzIndex const z = exact ? h : spt_FitDraw(nnz, nstrata, h, seed, &size);
+      /* The block holding z, then its kernel for the block size */
+      sptNnzIndex lo = 0, hi = nblocks;
+      while(hi - lo > 1) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(hitsr->bptr.data[mid] <= z) lo = mid; else hi = mid;
+      }
+      sptNnzIndex const b = lo;
+      lo = 0, hi = nkernels;
+      while(hi - lo > 1) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(hitsr->kptr.data[mid] <= b) lo = mid; else hi = mid;
+      }
+      sptElementIndex const bits = spt_HiCOOKernelBits(hitsr, lo);
+      double model = 0;
+      for(sptElementIndex r=0; r < rank; ++r) {
+        double prod = lambda[r];
+        for(sptIndex m=0; m < nmodes; ++m) {
+          sptIndex const i = ((sptIndex) hitsr->binds[m].data[b] << bits) + hitsr->einds[m].data[z];
+          prod *= mats[m]->values[(size_t) i * stride + r];
+        }
+        model += prod;
+      }
+      t[k] = (double) size * hitsr->values.data[z] * model;
+    }
+    inner += t[0] + t[1];
+    if(!exact) {
+      variance += (t[0] - t[1]) * (t[0] - t[1]);
+    }
+  }
+
+  double const norm_mats = sptKruskalTensorFrobeniusNormSquaredRank(nmodes, lambda, ata);
+  return spt_FitFromEstimate(spten_normsq, norm_mats, inner, variance, bound);
+}
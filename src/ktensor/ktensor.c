@@ -39,6 +39,7 @@ int sptNewKruskalTensor(sptKruskalTensor *ktsr, sptIndex nmodes, const sptIndex
         ktsr->ndims[i] = ndims[i];
     ktsr->lambda = (sptValue*)malloc(rank*sizeof(sptValue));
     ktsr->fit = 0.0;
+    ktsr->factors = NULL;
     
 	return 0;
 }
@@ -57,7 +58,7 @@ void sptKruskalTensorInverseShuffleIndices(sptKruskalTensor * ktsr, sptIndex **
     for(sptIndex m=0; m < ktsr->nmodes; ++m) {
         sptMatrix * mtx = ktsr->factors[m];
         sptIndex * mode_map_inds = map_inds[m];
-        sptValue * tmp_values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
+        sptValue * tmp_values = sptMallocBacked(mtx->cap * mtx->stride * sizeof (sptValue), spt_MemRequestOf(mtx->values));
 
         for(sptIndex i=0; i<mtx->nrows; ++i) {
             new_i = mode_map_inds[i];
@@ -65,11 +66,38 @@ void sptKruskalTensorInverseShuffleIndices(sptKruskalTensor * ktsr, sptIndex **
                 tmp_values[i * mtx->stride + j] = mtx->values[new_i * mtx->stride + j];
             }
         }
-        free(mtx->values);
+        sptFree(mtx->values);
         mtx->values = tmp_values;
     }    
 }
 
+/**
+ * Grow the factors of a Kruskal tensor to more rows, the new rows zero, e.g.
+ * to take a decomposition of a tensor compacted by
+ * sptSparseTensorCompactIndices back to the old mode sizes before
+ * sptKruskalTensorInverseShuffleIndices.
+ *
+ * @param[in,out] ktsr Kruskal tensor
+ * @param[in] ndims the new mode sizes, none below the current ones
+ *
+ */
+int sptKruskalTensorExpandRows(sptKruskalTensor * ktsr, const sptIndex ndims[])
+{
+    for(sptIndex m=0; m < ktsr->nmodes; ++m) {
+        sptMatrix * mtx = ktsr->factors[m];
+        sptIndex const old_nrows = mtx->nrows;
+        if(ndims[m] < old_nrows) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "Kruskal Expand", "cannot shrink a factor");
+        }
+        int result = sptResizeMatrix(mtx, ndims[m]);
+        spt_CheckError(result, "Kruskal Expand", NULL);
+        memset(mtx->values + (size_t) old_nrows * mtx->stride, 0,
+            (size_t) (ndims[m] - old_nrows) * mtx->stride * sizeof (sptValue));
+        ktsr->ndims[m] = ndims[m];
+    }
+    return 0;
+}
+
 /**
  * Free a new Kruskal tensor.
  *
@@ -82,9 +110,12 @@ void sptFreeKruskalTensor(sptKruskalTensor *ktsr)
 	ktsr->fit = 0.0;
 	free(ktsr->ndims);
 	free(ktsr->lambda);
-	for(sptIndex i=0; i<ktsr->nmodes; ++i)
-		sptFreeMatrix(ktsr->factors[i]);
+	if(ktsr->factors != NULL) {
+		for(sptIndex i=0; i<ktsr->nmodes; ++i)
+			sptFreeMatrix(ktsr->factors[i]);
+	}
     free(ktsr->factors);
+    ktsr->factors = NULL;
 	ktsr->nmodes = 0;
 }
 
@@ -105,9 +136,30 @@ double sptKruskalTensorFit(
   sptMatrix ** mats,
   sptMatrix ** ata) 
 {
-  sptIndex const nmodes = spten->nmodes;
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  return sptKruskalTensorFitNorm(spten->nmodes, spten_normsq, lambda, mats, ata);
+}
 
-  double spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+
+/**
+ * Compute the fit of a Kruskal tensor to a sparse tensor whose squared norm is already known.
+ * Iterative solvers compute the norm once, since the tensor values do not change between iterations.
+ *
+ * @param[in] nmodes        the number of modes
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] lambda  the weight array
+ * @param[in] mats    factor matrices
+ * @param[in] ata    the results of ATA, A is a factor matrix
+ * @return fit  a double-precision float-point value
+ *
+ */
+double sptKruskalTensorFitNorm(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** mats,
+  sptMatrix ** ata)
+{
   double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata);
   double const inner = sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats);
   double residual = spten_normsq + norm_mats - 2 * inner;
@@ -120,6 +172,49 @@ double sptKruskalTensorFit(
 }
 
 
+/**
+ * The fit right after an ALS sweep, from the Gram matrices alone.
+ * Once the last mode is an exact least-squares solution against the MTTKRP,
+ * the inner product of the tensor with the model equals the squared norm of
+ * the model, so no pass over the MTTKRP output is needed.
+ *
+ * @param[in] nmodes        the number of modes
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] lambda  the weight array
+ * @param[in] ata    the results of ATA, A is a factor matrix, with ata[nmodes] as scratch
+ * @return fit  a double-precision float-point value
+ */
+double sptKruskalTensorFitGram(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptMatrix ** ata)
+{
+  double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata);
+  return sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, norm_mats);
+}
+
+
+/**
+ * The fit from the squared norms of the sparse and Kruskal tensors and their
+ * inner product, for solvers that keep the Kruskal norm themselves, e.g. with
+ * sptGramHadamardKruskalNorm.
+ *
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] norm_mats     the squared Frobenius norm of the Kruskal tensor
+ * @param[in] inner         the inner product of the two
+ * @return fit  a double-precision float-point value
+ */
+double sptKruskalTensorFitFromNorms(
+  double const spten_normsq,
+  double const norm_mats,
+  double const inner)
+{
+  double const residual = spten_normsq + norm_mats - 2 * inner;
+  return 1 - sqrt(residual > 0 ? residual : 0) / sqrt(spten_normsq);
+}
+
+
 
 // Column-major. 
 /* Compute a Kruskal tensor's norm is compute on "ata"s. Check Tammy's sparse  */
@@ -148,7 +243,7 @@ double sptKruskalTensorFrobeniusNormSquared(
 #endif
     for(sptIndex i=0; i < rank; ++i) {
         for(sptIndex j=i; j < rank; ++j) {
-            tmp_atavals[j * stride + i] *= atavals[j * stride + i];
+            tmp_atavals[i * stride + j] *= atavals[i * stride + j];
         }
     }
   }
@@ -160,7 +255,7 @@ double sptKruskalTensorFrobeniusNormSquared(
   for(sptIndex i=0; i < rank; ++i) {
     norm_mats += tmp_atavals[i+(i*stride)] * lambda[i] * lambda[i];
     for(sptIndex j=i+1; j < rank; ++j) {
-      norm_mats += tmp_atavals[i+(j*stride)] * lambda[i] * lambda[j] * 2;
+      norm_mats += tmp_atavals[j+(i*stride)] * lambda[i] * lambda[j] * 2;
     }
   }
 
@@ -186,7 +281,7 @@ double sptSparseKruskalTensorInnerProduct(
 
   double inner = 0;
 
-  double * const __restrict accum = (double *) malloc(rank*sizeof(*accum));
+  double * const __restrict accum = spt_ScratchAlloc(rank*sizeof(*accum));
 
 #ifdef PARTI_USE_OPENMP
   #pragma omp parallel for
@@ -201,7 +296,7 @@ double sptSparseKruskalTensorInnerProduct(
     int const nthreads = omp_get_num_threads();
     #pragma omp master
     {
-      buffer_accum = (sptValue *)malloc(nthreads * rank * sizeof(sptValue));
+      buffer_accum = spt_ScratchAlloc(nthreads * rank * sizeof(sptValue));
       for(sptIndex j=0; j < nthreads * rank; ++j)
           buffer_accum[j] = 0.0;
     }
@@ -249,9 +344,9 @@ double sptSparseKruskalTensorInnerProduct(
   }
 
 #ifdef PARTI_USE_OPENMP
-  free(buffer_accum);
+  spt_ScratchFree(buffer_accum);
 #endif
 
-  free(accum);
+  spt_ScratchFree(accum);
   return inner;
 }
@@ -39,6 +39,7 @@ int sptNewRankKruskalTensor(sptRankKruskalTensor *ktsr, sptIndex nmodes, const s
         ktsr->ndims[i] = ndims[i];
     ktsr->lambda = (sptValue*)malloc(rank*sizeof(sptValue));
     ktsr->fit = 0.0;
+    ktsr->factors = NULL;
     
 	return 0;
 }
@@ -56,7 +57,7 @@ void sptRankKruskalTensorInverseShuffleIndices(sptRankKruskalTensor * ktsr, sptI
     for(sptIndex m=0; m < ktsr->nmodes; ++m) {
         sptRankMatrix * mtx = ktsr->factors[m];
         sptIndex * mode_map_inds = map_inds[m];
-        sptValue * tmp_values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
+        sptValue * tmp_values = sptMallocBacked(mtx->cap * mtx->stride * sizeof (sptValue), spt_MemRequestOf(mtx->values));
 
         for(sptIndex i=0; i<mtx->nrows; ++i) {
             new_i = mode_map_inds[i];
@@ -64,7 +65,7 @@ void sptRankKruskalTensorInverseShuffleIndices(sptRankKruskalTensor * ktsr, sptI
                 tmp_values[i * mtx->stride + j] = mtx->values[new_i * mtx->stride + j];
             }
         }
-        free(mtx->values);
+        sptFree(mtx->values);
         mtx->values = tmp_values;
     }    
 }
@@ -81,9 +82,12 @@ void sptFreeRankKruskalTensor(sptRankKruskalTensor *ktsr)
 	ktsr->fit = 0.0;
 	free(ktsr->ndims);
 	free(ktsr->lambda);
-	for(sptIndex i=0; i<ktsr->nmodes; ++i)
-		sptFreeRankMatrix(ktsr->factors[i]);
+	if(ktsr->factors != NULL) {
+		for(sptIndex i=0; i<ktsr->nmodes; ++i)
+			sptFreeRankMatrix(ktsr->factors[i]);
+	}
     free(ktsr->factors);
+    ktsr->factors = NULL;
 	ktsr->nmodes = 0;
 }
 
@@ -104,9 +108,29 @@ double sptKruskalTensorFitHiCOO(
   sptRankMatrix ** mats,
   sptRankMatrix ** ata) 
 {
-  sptIndex const nmodes = hitsr->nmodes;
+  double const spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
+  return sptKruskalTensorFitNormRank(hitsr->nmodes, spten_normsq, lambda, mats, ata);
+}
+
 
-  double spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
+/**
+ * Compute the fit of a Kruskal tensor (with sptElementIndex as the columns of their factor matrices) to a sparse tensor whose squared norm is already known.
+ *
+ * @param[in] nmodes        the number of modes
+ * @param[in] spten_normsq  the squared Frobenius norm of the sparse tensor
+ * @param[in] lambda  the weight array
+ * @param[in] mats    factor matrices
+ * @param[in] ata    the results of ATA, A is a factor matrix
+ * @return fit  a double-precision float-point value
+ *
+ */
+double sptKruskalTensorFitNormRank(
+  sptIndex const nmodes,
+  double const spten_normsq,
+  sptValue const * const __restrict lambda,
+  sptRankMatrix ** mats,
+  sptRankMatrix ** ata)
+{
   double const norm_mats = sptKruskalTensorFrobeniusNormSquaredRank(nmodes, lambda, ata);
   double const inner = sptSparseKruskalTensorInnerProductRank(nmodes, lambda, mats);
   double residual = spten_normsq + norm_mats - 2 * inner;
@@ -146,7 +170,7 @@ double sptKruskalTensorFrobeniusNormSquaredRank(
 #endif
     for(sptElementIndex i=0; i < rank; ++i) {
         for(sptElementIndex j=i; j < rank; ++j) {
-            tmp_atavals[j * stride + i] *= atavals[j * stride + i];
+            tmp_atavals[i * stride + j] *= atavals[i * stride + j];
         }
     }
   }
@@ -158,7 +182,7 @@ double sptKruskalTensorFrobeniusNormSquaredRank(
   for(sptElementIndex i=0; i < rank; ++i) {
     norm_mats += tmp_atavals[i+(i*stride)] * lambda[i] * lambda[i];
     for(sptElementIndex j=i+1; j < rank; ++j) {
-      norm_mats += tmp_atavals[i+(j*stride)] * lambda[i] * lambda[j] * 2;
+      norm_mats += tmp_atavals[j+(i*stride)] * lambda[i] * lambda[j] * 2;
     }
   }
 
@@ -184,7 +208,7 @@ double sptSparseKruskalTensorInnerProductRank(
 
   double inner = 0;
 
-  double * const __restrict accum = (double *) malloc(rank*sizeof(*accum));
+  double * const __restrict accum = spt_ScratchAlloc(rank*sizeof(*accum));
 
 #ifdef PARTI_USE_OPENMP
   #pragma omp parallel for schedule(static)
@@ -199,7 +223,7 @@ double sptSparseKruskalTensorInnerProductRank(
     int const nthreads = omp_get_num_threads();
     #pragma omp master
     {
-      buffer_accum = (sptValue *)malloc(nthreads * rank * sizeof(sptValue));
+      buffer_accum = spt_ScratchAlloc(nthreads * rank * sizeof(sptValue));
       for(sptIndex j=0; j < (sptIndex)nthreads * rank; ++j)
           buffer_accum[j] = 0.0;
     }
@@ -247,8 +271,9 @@ double sptSparseKruskalTensorInnerProductRank(
   }
 
 #ifdef PARTI_USE_OPENMP
-  free(buffer_accum);
+  spt_ScratchFree(buffer_accum);
 #endif
 
+  spt_ScratchFree(accum);
   return inner;
 }
\ No newline at end of file
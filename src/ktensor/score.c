@@ -0,0 +1,124 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "../error/error.h"
+#include "../matrix/simd.h"
+#include "../sptensor/sptensor.h"
+
+/* Queries of one chunk a thread takes at a time */
+#define SPT_SCORE_CHUNK 256
+
+/*
+ * The model entry of one query: lambda .* row_0 .* ... .* row_{N-2}, dotted
+ * with row_{N-1}. The products run over whole rows with the SIMD kernels, so
+ * the cost per query is N streams of rank values and no per-element branch.
+ */
+static sptValue spt_KruskalScoreOne(
+    sptKruskalTensor const * ktsr,
+    sptIndex * const coords[],
+    sptNnzIndex const q,
+    sptValue * tmp)
+{
+    sptIndex const nmodes = ktsr->nmodes;
+    sptIndex const rank = ktsr->rank;
+    sptIndex const stride = ktsr->factors[0]->stride;
+    spt_SimdKernels const * simd = spt_Simd();
+    sptValue const * last = ktsr->factors[nmodes-1]->values + (size_t) coords[nmodes-1][q] * stride;
+    sptValue s = 0;
+
+    if(nmodes == 1) {
+        #pragma omp simd reduction(+:s)
+        for(sptIndex r = 0; r < rank; ++r) {
+            s += ktsr->lambda[r] * last[r];
+        }
+        return s;
+    }
+    simd->hadamard(tmp, ktsr->lambda, ktsr->factors[0]->values + (size_t) coords[0][q] * stride, rank);
+    for(sptIndex m = 1; m < nmodes - 1; ++m) {
+        simd->mul(tmp, ktsr->factors[m]->values + (size_t) coords[m][q] * stride, rank);
+    }
+    #pragma omp simd reduction(+:s)
+    for(sptIndex r = 0; r < rank; ++r) {
+        s += tmp[r] * last[r];
+    }
+    return s;
+}
+
+/**
+ * Evaluate a Kruskal tensor at a batch of coordinates,
+ * out[q] = sum_r lambda[r] * prod_m factors[m](coords[m][q], r).
+ * The factor rows of the queries a few ahead are prefetched while the current
+ * one is scored, so random coordinates pay little of the gather latency.
+ *
+ * @param[in]  ktsr   the Kruskal tensor
+ * @param[in]  coords nmodes index arrays of length n, laid out as the inds of a COO tensor
+ * @param[in]  n      the number of queries
+ * @param[out] out    the model values, length n
+ * @param[in]  tk     the number of threads
+ */
+int sptKruskalTensorScore(
+    sptKruskalTensor const * ktsr,
+    sptIndex * const coords[],
+    sptNnzIndex const n,
+    sptValue * out,
+    int const tk)
+{
+    sptIndex const nmodes = ktsr->nmodes;
+    sptIndex const rank = ktsr->rank;
+    sptIndex const stride = ktsr->factors[0]->stride;
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
+    int bad = 0;
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(ktsr->factors[m]->ncols != rank || ktsr->factors[m]->stride != stride) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "Kruskal Score", "factor shapes do not match the rank");
+        }
+        sptIndex const ndim = ktsr->ndims[m];
+        sptIndex const * inds = coords[m];
+        #pragma omp parallel for schedule(static) reduction(|:bad) num_threads(tk)
+        for(sptNnzIndex q = 0; q < n; ++q) {
+            bad |= inds[q] >= ndim;
+        }
+    }
+    if(bad) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Kruskal Score", "coordinate out of range");
+    }
+
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    #pragma omp parallel num_threads(tk)
+    {
+        sptValue * tmp = (sptValue *) malloc(stride * sizeof *tmp);
+        #pragma omp for schedule(static, SPT_SCORE_CHUNK)
+        for(sptNnzIndex q = 0; q < n; ++q) {
+            if(pd != 0 && q + pd < n) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    spt_PrefetchRow(ktsr->factors[m]->values + (size_t) coords[m][q + pd] * stride, rank);
+                }
+            }
+            out[q] = spt_KruskalScoreOne(ktsr, coords, q, tmp);
+        }
+        free(tmp);
+    }
+    spt_KernelProbeStop(probe, NULL, "Kruskal Score",
+        (double) n * nmodes * rank,
+        (double) n * (nmodes * (sizeof (sptIndex) + rank * sizeof (sptValue)) + sizeof (sptValue)));
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "../error/error.h"
+#include "../cudawrap.h"
+
+#define PARTI_CUDA_SCORE_NTHREADS 256
+/* The factor rows of a query are held in registers */
+#define PARTI_CUDA_SCORE_MAX_MODES 8
+
+/* out[q] = sum_r lambda[r] * prod_m A(rowoff[m] + inds[m * cap + q], r), one thread per query */
+__global__ static void spt_KruskalScoreKernel(
+    sptIndex const *inds, sptNnzIndex const cap, sptNnzIndex const n,
+    sptIndex const nmodes, sptIndex const rank, sptIndex const stride,
+    sptIndex const *rowoff, sptValue const *A, sptValue const *lambda,
+    sptValue *out)
+{
+    sptNnzIndex const q = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(q >= n) {
+        return;
+    }
+    sptValue const *rows[PARTI_CUDA_SCORE_MAX_MODES];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        rows[m] = A + (size_t) (rowoff[m] + inds[m * cap + q]) * stride;
+    }
+    sptValue s = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+        sptValue p = lambda[r];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            p *= rows[m][r];
+        }
+        s += p;
+    }
+    out[q] = s;
+}
+
+/**
+ * Copy a Kruskal tensor to the current CUDA device, to be scored by sptDeviceKruskalTensorScore
+ * @param[out] dktsr an uninitialized device Kruskal tensor
+ * @param[in]  ktsr  the host Kruskal tensor, of at most PARTI_CUDA_SCORE_MAX_MODES modes
+ */
+int sptDeviceUploadKruskalTensor(sptDeviceKruskalTensor *dktsr, sptKruskalTensor const * ktsr) {
+    char const * const module = "DevKruskal Upload";
+    sptIndex const nmodes = ktsr->nmodes;
+    if(nmodes > PARTI_CUDA_SCORE_MAX_MODES) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "too many modes");
+    }
+    sptIndex const stride = ktsr->factors[0]->stride;
+    sptIndex rowoff[PARTI_CUDA_SCORE_MAX_MODES + 1];
+    rowoff[0] = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(ktsr->factors[m]->ncols != ktsr->rank || ktsr->factors[m]->stride != stride) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "factor shapes do not match the rank");
+        }
+        rowoff[m+1] = rowoff[m] + ktsr->ndims[m];
+    }
+
+    dktsr->nmodes = nmodes;
+    dktsr->rank = ktsr->rank;
+    dktsr->stride = stride;
+    dktsr->ndims = (sptIndex *) malloc(nmodes * sizeof (sptIndex));
+    spt_CheckOSError(!dktsr->ndims, module);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        dktsr->ndims[m] = ktsr->ndims[m];
+    }
+    dktsr->cap = 0;
+    dktsr->inds = NULL;
+    dktsr->out = NULL;
+
+    int result = sptCudaDuplicateMemory(&dktsr->rowoff, rowoff, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = sptCudaDuplicateMemory(&dktsr->lambda, ktsr->lambda, ktsr->rank * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &dktsr->values, (size_t) rowoff[nmodes] * stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = cudaMemcpy(dktsr->values + (size_t) rowoff[m] * stride, ktsr->factors[m]->values,
+            (size_t) ktsr->ndims[m] * stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+    }
+    return 0;
+}
+
+/**
+ * Evaluate a device Kruskal tensor at a batch of coordinates, see sptKruskalTensorScore.
+ * The coordinates go up and the results come back in one copy each; the
+ * device buffers grow to the largest batch seen and are reused after.
+ * @param[in,out] dktsr  the device Kruskal tensor
+ * @param[in]     coords nmodes host index arrays of length n
+ * @param[in]     n      the number of queries
+ * @param[out]    out    the host model values, length n
+ */
+int sptDeviceKruskalTensorScore(sptDeviceKruskalTensor *dktsr, sptIndex * const coords[], sptNnzIndex const n, sptValue * out) {
+    char const * const module = "DevKruskal Score";
+    sptIndex const nmodes = dktsr->nmodes;
+    if(n == 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        for(sptNnzIndex q = 0; q < n; ++q) {
+            if(coords[m][q] >= dktsr->ndims[m]) {
+                spt_CheckError(SPTERR_VALUE_ERROR, module, "coordinate out of range");
+            }
+        }
+    }
+
+    int result;
+    if(n > dktsr->cap) {
+        cudaFree(dktsr->inds);
+        cudaFree(dktsr->out);
+        dktsr->inds = NULL;
+        dktsr->out = NULL;
+        dktsr->cap = 0;
+        result = cudaMalloc((void **) &dktsr->inds, (size_t) nmodes * n * sizeof (sptIndex));
+        spt_CheckCudaError(result != 0, module);
+        result = cudaMalloc((void **) &dktsr->out, n * sizeof (sptValue));
+        spt_CheckCudaError(result != 0, module);
+        dktsr->cap = n;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = cudaMemcpy(dktsr->inds + (size_t) m * dktsr->cap, coords[m], n * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+    }
+
+    sptNnzIndex const nblocks = (n + PARTI_CUDA_SCORE_NTHREADS - 1) / PARTI_CUDA_SCORE_NTHREADS;
+    spt_KruskalScoreKernel<<<nblocks, PARTI_CUDA_SCORE_NTHREADS>>>(
+        dktsr->inds, dktsr->cap, n, nmodes, dktsr->rank, dktsr->stride,
+        dktsr->rowoff, dktsr->values, dktsr->lambda, dktsr->out);
+    result = cudaGetLastError();
+    spt_CheckCudaError(result != 0, module);
+
+    result = cudaMemcpy(out, dktsr->out, n * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, module);
+    return 0;
+}
+
+/**
+ * Release a device Kruskal tensor
+ * @param dktsr a valid device Kruskal tensor
+ */
+void sptFreeDeviceKruskalTensor(sptDeviceKruskalTensor *dktsr) {
+    cudaFree(dktsr->rowoff);
+    cudaFree(dktsr->values);
+    cudaFree(dktsr->lambda);
+    cudaFree(dktsr->inds);
+    cudaFree(dktsr->out);
+    free(dktsr->ndims);
+    dktsr->ndims = NULL;
+    dktsr->cap = 0;
+    dktsr->nmodes = 0;
+}
@@ -0,0 +1,110 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../error/error.h"
+
+/**
+ * Assign a new tensor train without cores, to be filled by a TT decomposition.
+ *
+ * @param[out] tt tensor train
+ * @param[in] nmodes the number of dimensions/modes/tensor order, at least 2
+ * @param[in] ndims the mode sizes
+ * @param[in] max_ranks the nmodes - 1 largest TT ranks allowed between consecutive modes
+ *
+ */
+int sptNewTensorTrain(sptTensorTrain *tt, sptIndex nmodes, const sptIndex ndims[], const sptIndex max_ranks[])
+{
+    if(nmodes < 2) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "TTTns New", "nmodes must be at least 2");
+    }
+    tt->nmodes = nmodes;
+    tt->fit = 0.0;
+    tt->ndims = malloc(nmodes * sizeof *tt->ndims);
+    tt->ranks = malloc((nmodes + 1) * sizeof *tt->ranks);
+    tt->cores = calloc(nmodes, sizeof *tt->cores);
+    spt_CheckOSError(!tt->ndims || !tt->ranks || !tt->cores, "TTTns New");
+    memcpy(tt->ndims, ndims, nmodes * sizeof *tt->ndims);
+    tt->ranks[0] = 1;
+    tt->ranks[nmodes] = 1;
+    for(sptIndex m = 1; m < nmodes; ++m) {
+        if(max_ranks[m-1] == 0) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "TTTns New", "ranks must be positive");
+        }
+        tt->ranks[m] = max_ranks[m-1];
+    }
+    return 0;
+}
+
+/**
+ * Free a tensor train.
+ *
+ * @param[in] tt tensor train
+ *
+ */
+void sptFreeTensorTrain(sptTensorTrain *tt)
+{
+    for(sptIndex m = 0; m < tt->nmodes; ++m) {
+        free(tt->cores[m]);
+    }
+    free(tt->cores);
+    free(tt->ranks);
+    free(tt->ndims);
+    tt->fit = 0.0;
+    tt->nmodes = 0;
+}
+
+/**
+ * One element of a tensor train, the product of the core slices at its indices.
+ *
+ * @param[in] tt tensor train with its cores
+ * @param[in] inds the nmodes indices of the element
+ *
+ */
+double sptTensorTrainValue(sptTensorTrain const *tt, const sptIndex inds[])
+{
+    sptIndex maxrank = 1;
+    for(sptIndex m = 0; m <= tt->nmodes; ++m) {
+        maxrank = tt->ranks[m] > maxrank ? tt->ranks[m] : maxrank;
+    }
+    double * row = malloc(2 * (size_t) maxrank * sizeof *row);
+    sptAssert(row != NULL);
+    double * next = row + maxrank;
+    row[0] = 1;
+    for(sptIndex m = 0; m < tt->nmodes; ++m) {
+        sptIndex const rin = tt->ranks[m], rout = tt->ranks[m+1];
+        sptValue const * const core = tt->cores[m];
+        for(sptIndex b = 0; b < rout; ++b) {
+            next[b] = 0;
+        }
+        for(sptIndex a = 0; a < rin; ++a) {
+            sptValue const * const slice = core + ((size_t) a * tt->ndims[m] + inds[m]) * rout;
+            for(sptIndex b = 0; b < rout; ++b) {
+                next[b] += row[a] * slice[b];
+            }
+        }
+        double * const t = row;
+        row = next;
+        next = t;
+    }
+    double const value = row[0];
+    free(row < next ? row : next);
+    return value;
+}
@@ -0,0 +1,370 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../error/error.h"
+#include "../matrix/simd.h"
+#include "../sptensor/sptensor.h"
+
+/*
+ * IVF index for maximum inner product: the rows of the factor are clustered
+ * by k-means, and for a row x of list l with centroid c and radius R,
+ * q.x = q.c + q.(x - c) <= q.c + |q| R. Lists are scanned in decreasing order
+ * of that bound and the scan stops once the bound falls below the k-th best
+ * score found, so the result is exact while most lists are never read.
+ */
+
+/* k-means is trained on at most this many sampled rows per list */
+#define SPT_INDEX_SAMPLES_PER_LIST 256
+#define SPT_INDEX_KMEANS_ITERS 10
+
+static sptValue spt_IndexDot(sptValue const * a, sptValue const * b, sptIndex const n) {
+    sptValue s = 0;
+    #pragma omp simd reduction(+:s)
+    for(sptIndex r = 0; r < n; ++r) {
+        s += a[r] * b[r];
+    }
+    return s;
+}
+
+/* The list whose centroid is closest to x: argmin |c|^2 - 2 x.c */
+static sptIndex spt_IndexNearestList(
+    sptValue const * x,
+    sptValue const * centroids,
+    sptValue const * cnorms,
+    sptIndex const nlists,
+    sptIndex const rank,
+    sptIndex const stride)
+{
+    sptIndex best = 0;
+    sptValue best_d = INFINITY;
+    for(sptIndex l = 0; l < nlists; ++l) {
+        sptValue const d = cnorms[l] - 2 * spt_IndexDot(x, centroids + (size_t) l * stride, rank);
+        if(d < best_d) {
+            best_d = d;
+            best = l;
+        }
+    }
+    return best;
+}
+
+static void spt_IndexCentroidNorms(sptKruskalIndex const * idx, sptValue * cnorms) {
+    for(sptIndex l = 0; l < idx->nlists; ++l) {
+        sptValue const * c = idx->centroids + (size_t) l * idx->stride;
+        cnorms[l] = spt_IndexDot(c, c, idx->rank);
+    }
+}
+
+/* Lloyd iterations on the sampled rows; a list left empty keeps its centroid */
+static void spt_IndexKMeans(
+    sptKruskalIndex * idx,
+    sptValue const * A,
+    sptIndex const * sample,
+    sptIndex const nsample,
+    sptValue * cnorms,
+    int const tk)
+{
+    sptIndex const nlists = idx->nlists, rank = idx->rank, stride = idx->stride;
+    sptIndex * assign = (sptIndex *) malloc(nsample * sizeof *assign);
+    sptValue * sums = (sptValue *) malloc((size_t) nlists * stride * sizeof *sums);
+    sptIndex * counts = (sptIndex *) malloc(nlists * sizeof *counts);
+
+    for(sptIndex it = 0; it < SPT_INDEX_KMEANS_ITERS; ++it) {
+        spt_IndexCentroidNorms(idx, cnorms);
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptIndex i = 0; i < nsample; ++i) {
+            assign[i] = spt_IndexNearestList(A + (size_t) sample[i] * stride, idx->centroids, cnorms, nlists, rank, stride);
+        }
+        memset(sums, 0, (size_t) nlists * stride * sizeof *sums);
+        memset(counts, 0, nlists * sizeof *counts);
+        for(sptIndex i = 0; i < nsample; ++i) {
+            sptValue * sum = sums + (size_t) assign[i] * stride;
+            sptValue const * x = A + (size_t) sample[i] * stride;
+            for(sptIndex r = 0; r < rank; ++r) {
+                sum[r] += x[r];
+            }
+            ++counts[assign[i]];
+        }
+        for(sptIndex l = 0; l < nlists; ++l) {
+            if(counts[l] == 0) {
+                continue;
+            }
+            for(sptIndex r = 0; r < rank; ++r) {
+                idx->centroids[(size_t) l * stride + r] = sums[(size_t) l * stride + r] / counts[l];
+            }
+        }
+    }
+
+    free(counts);
+    free(sums);
+    free(assign);
+}
+
+/**
+ * Build a maximum-inner-product index over the factor of one mode of a Kruskal tensor.
+ * The index copies the rows, so it answers for the factor as it was built; rebuild it after the factor changes.
+ * Queries only read the index, so several of them may run on it at once.
+ *
+ * @param[out] idx    an uninitialized index
+ * @param[in]  ktsr   the Kruskal tensor
+ * @param[in]  mode   the mode whose rows are retrieved
+ * @param[in]  nlists the number of clusters, about the square root of the number of rows is a fair choice
+ * @param[in]  seed   the seed of the k-means sample and initial centroids
+ * @param[in]  tk     the number of threads
+ */
+int sptNewKruskalIndex(
+    sptKruskalIndex * idx,
+    sptKruskalTensor const * ktsr,
+    sptIndex const mode,
+    sptIndex const nlists,
+    uint64_t const seed,
+    int const tk)
+{
+    char const * const module = "Kruskal Index New";
+    if(mode >= ktsr->nmodes) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "mode out of range");
+    }
+    sptMatrix const * const U = ktsr->factors[mode];
+    sptIndex const nrows = U->nrows, rank = U->ncols, stride = U->stride;
+    if(nlists == 0 || nlists > nrows) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "nlists must be in [1, nrows]");
+    }
+
+    idx->mode = mode;
+    idx->nrows = nrows;
+    idx->rank = rank;
+    idx->stride = stride;
+    idx->nlists = nlists;
+    idx->list_ptr = (sptIndex *) malloc((nlists + 1) * sizeof *idx->list_ptr);
+    idx->row_ids = (sptIndex *) malloc(nrows * sizeof *idx->row_ids);
+    idx->rows = (sptValue *) malloc((size_t) nrows * stride * sizeof *idx->rows);
+    idx->centroids = (sptValue *) calloc((size_t) nlists * stride, sizeof *idx->centroids);
+    idx->radius = (sptValue *) malloc(nlists * sizeof *idx->radius);
+    spt_CheckOSError(!idx->list_ptr || !idx->row_ids || !idx->rows || !idx->centroids || !idx->radius, module);
+
+    /* Train on a sample; its first nlists rows are the initial centroids */
+    sptIndex const nsample = (uint64_t) nlists * SPT_INDEX_SAMPLES_PER_LIST < nrows ?
+        nlists * SPT_INDEX_SAMPLES_PER_LIST : nrows;
+    sptIndex * sample = (sptIndex *) malloc(nsample * sizeof *sample);
+    sptValue * cnorms = (sptValue *) malloc(nlists * sizeof *cnorms);
+    spt_CheckOSError(!sample || !cnorms, module);
+    uint64_t state = spt_GenMix(seed);
+    for(sptIndex i = 0; i < nsample; ++i) {
+        sample[i] = nsample == nrows ? i : (sptIndex) (spt_GenNext(&state) % nrows);
+    }
+    for(sptIndex i = nsample; i > 1; --i) {
+        sptIndex const j = (sptIndex) (spt_GenNext(&state) % i);
+        sptIndex const t = sample[i-1];
+        sample[i-1] = sample[j];
+        sample[j] = t;
+    }
+    for(sptIndex l = 0; l < nlists; ++l) {
+        memcpy(idx->centroids + (size_t) l * stride, U->values + (size_t) sample[l] * stride, rank * sizeof (sptValue));
+    }
+    spt_IndexKMeans(idx, U->values, sample, nsample, cnorms, tk);
+    free(sample);
+
+    /* Every row to its list, the lists stored one after another */
+    sptIndex * list_of = (sptIndex *) malloc(nrows * sizeof *list_of);
+    spt_CheckOSError(!list_of, module);
+    spt_IndexCentroidNorms(idx, cnorms);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex i = 0; i < nrows; ++i) {
+        list_of[i] = spt_IndexNearestList(U->values + (size_t) i * stride, idx->centroids, cnorms, nlists, rank, stride);
+    }
+    memset(idx->list_ptr, 0, (nlists + 1) * sizeof *idx->list_ptr);
+    for(sptIndex i = 0; i < nrows; ++i) {
+        ++idx->list_ptr[list_of[i] + 1];
+    }
+    for(sptIndex l = 0; l < nlists; ++l) {
+        idx->list_ptr[l + 1] += idx->list_ptr[l];
+    }
+    sptIndex * pos = (sptIndex *) malloc(nlists * sizeof *pos);
+    spt_CheckOSError(!pos, module);
+    memcpy(pos, idx->list_ptr, nlists * sizeof *pos);
+    for(sptIndex i = 0; i < nrows; ++i) {
+        sptIndex const p = pos[list_of[i]]++;
+        idx->row_ids[p] = i;
+        memcpy(idx->rows + (size_t) p * stride, U->values + (size_t) i * stride, stride * sizeof (sptValue));
+    }
+    free(pos);
+    free(list_of);
+    free(cnorms);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptIndex l = 0; l < nlists; ++l) {
+        sptValue const * c = idx->centroids + (size_t) l * stride;
+        sptValue r2 = 0;
+        for(sptIndex p = idx->list_ptr[l]; p < idx->list_ptr[l + 1]; ++p) {
+            sptValue const * x = idx->rows + (size_t) p * stride;
+            sptValue d = 0;
+            #pragma omp simd reduction(+:d)
+            for(sptIndex r = 0; r < rank; ++r) {
+                d += (x[r] - c[r]) * (x[r] - c[r]);
+            }
+            r2 = d > r2 ? d : r2;
+        }
+        idx->radius[l] = sqrt(r2);
+    }
+
+    return 0;
+}
+
+typedef struct {
+    sptValue bound;
+    sptIndex list;
+} spt_IndexProbe;
+
+static int spt_CompareProbeDescending(void const * a, void const * b) {
+    sptValue const x = ((spt_IndexProbe const *) a)->bound;
+    sptValue const y = ((spt_IndexProbe const *) b)->bound;
+    return (x < y) - (x > y);
+}
+
+/* Restore the min-heap of the first n entries below position i */
+static void spt_TopKSiftDown(sptValue * vals, sptIndex * inds, sptIndex i, sptIndex const n) {
+    for(;;) {
+        sptIndex c = 2 * i + 1;
+        if(c >= n) {
+            return;
+        }
+        if(c + 1 < n && vals[c + 1] < vals[c]) {
+            ++c;
+        }
+        if(vals[i] <= vals[c]) {
+            return;
+        }
+        sptValue const v = vals[i]; vals[i] = vals[c]; vals[c] = v;
+        sptIndex const t = inds[i]; inds[i] = inds[c]; inds[c] = t;
+        i = c;
+    }
+}
+
+/**
+ * The k rows of the indexed factor with the largest model values at the given
+ * coordinates of the other modes, i.e. the top k of
+ * sum_r lambda[r] * prod_{m != mode} factors[m](coords[m], r) * factors[mode](i, r).
+ *
+ * @param[in]  idx      the index, built from ktsr
+ * @param[in]  ktsr     the Kruskal tensor, for lambda and the factors of the other modes
+ * @param[in]  coords   the coordinate of every mode, length nmodes; the indexed mode's is ignored
+ * @param[in]  k        the number of rows wanted, at most the number of rows
+ * @param[in]  nprobe   0 for the exact top k; otherwise scan at most the nprobe most promising lists, and more only until k rows are seen
+ * @param[out] top_inds the row indices, best first, length k
+ * @param[out] top_vals their model values, length k
+ */
+int sptKruskalIndexTopK(
+    sptKruskalIndex const * idx,
+    sptKruskalTensor const * ktsr,
+    sptIndex const coords[],
+    sptIndex const k,
+    sptIndex const nprobe,
+    sptIndex * top_inds,
+    sptValue * top_vals)
+{
+    char const * const module = "Kruskal Index TopK";
+    sptIndex const rank = idx->rank, stride = idx->stride, nlists = idx->nlists;
+    if(ktsr->rank != rank || ktsr->ndims[idx->mode] != idx->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "the index was built from another Kruskal tensor");
+    }
+    if(k == 0 || k > idx->nrows) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "k must be in [1, nrows]");
+    }
+    for(sptIndex m = 0; m < ktsr->nmodes; ++m) {
+        if(m != idx->mode && coords[m] >= ktsr->ndims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, module, "coordinate out of range");
+        }
+    }
+
+    /* The query: lambda .* the rows of the other modes */
+    sptValue * q = (sptValue *) malloc(stride * sizeof *q);
+    spt_IndexProbe * probes = (spt_IndexProbe *) malloc(nlists * sizeof *probes);
+    spt_CheckOSError(!q || !probes, module);
+    memcpy(q, ktsr->lambda, rank * sizeof *q);
+    for(sptIndex m = 0; m < ktsr->nmodes; ++m) {
+        if(m != idx->mode) {
+            spt_Simd()->mul(q, ktsr->factors[m]->values + (size_t) coords[m] * ktsr->factors[m]->stride, rank);
+        }
+    }
+    sptValue const qnorm = sqrt(spt_IndexDot(q, q, rank));
+    for(sptIndex l = 0; l < nlists; ++l) {
+        probes[l].bound = spt_IndexDot(q, idx->centroids + (size_t) l * stride, rank) + qnorm * idx->radius[l];
+        probes[l].list = l;
+    }
+    qsort(probes, nlists, sizeof *probes, spt_CompareProbeDescending);
+
+    /* top_vals[0 .. filled) is a min-heap of the best scores so far */
+    sptIndex filled = 0;
+    for(sptIndex j = 0; j < nlists; ++j) {
+        if(filled == k && (probes[j].bound < top_vals[0] || (nprobe != 0 && j >= nprobe))) {
+            break;
+        }
+        sptIndex const l = probes[j].list;
+        for(sptIndex p = idx->list_ptr[l]; p < idx->list_ptr[l + 1]; ++p) {
+            sptValue const s = spt_IndexDot(q, idx->rows + (size_t) p * stride, rank);
+            if(filled < k) {
+                /* Sift the new entry up */
+                sptIndex i = filled++;
+                while(i > 0 && top_vals[(i - 1) / 2] > s) {
+                    top_vals[i] = top_vals[(i - 1) / 2];
+                    top_inds[i] = top_inds[(i - 1) / 2];
+                    i = (i - 1) / 2;
+                }
+                top_vals[i] = s;
+                top_inds[i] = idx->row_ids[p];
+            } else if(s > top_vals[0]) {
+                top_vals[0] = s;
+                top_inds[0] = idx->row_ids[p];
+                spt_TopKSiftDown(top_vals, top_inds, 0, k);
+            }
+        }
+    }
+
+    /* Heap sort: the smallest goes to the back, leaving the best first */
+    for(sptIndex n = k; n > 1; --n) {
+        sptValue const v = top_vals[0]; top_vals[0] = top_vals[n - 1]; top_vals[n - 1] = v;
+        sptIndex const t = top_inds[0]; top_inds[0] = top_inds[n - 1]; top_inds[n - 1] = t;
+        spt_TopKSiftDown(top_vals, top_inds, 0, n - 1);
+    }
+
+    free(probes);
+    free(q);
+    return 0;
+}
+
+/**
+ * Release an index
+ * @param idx a valid index
+ */
+void sptFreeKruskalIndex(sptKruskalIndex * idx) {
+    free(idx->list_ptr);
+    free(idx->row_ids);
+    free(idx->rows);
+    free(idx->centroids);
+    free(idx->radius);
+    idx->list_ptr = NULL;
+    idx->row_ids = NULL;
+    idx->rows = NULL;
+    idx->centroids = NULL;
+    idx->radius = NULL;
+    idx->nrows = 0;
+    idx->nlists = 0;
+}
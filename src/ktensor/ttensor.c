@@ -0,0 +1,112 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../error/error.h"
+
+/**
+ * Assign a new Tucker tensor, with zeroed factor matrices and core.
+ *
+ * @param[out] ttsr Tucker tensor
+ * @param[in] nmodes the number of dimensions/modes/tensor order
+ * @param[in] ndims the mode sizes
+ * @param[in] ranks the multilinear ranks, or the number of columns of each factor matrix
+ *
+ */
+int sptNewTuckerTensor(sptTuckerTensor *ttsr, sptIndex nmodes, const sptIndex ndims[], const sptIndex ranks[])
+{
+    int result;
+    ttsr->nmodes = nmodes;
+    ttsr->fit = 0.0;
+    ttsr->ndims = malloc(nmodes * sizeof *ttsr->ndims);
+    ttsr->ranks = malloc(nmodes * sizeof *ttsr->ranks);
+    ttsr->factors = malloc(nmodes * sizeof *ttsr->factors);
+    spt_CheckOSError(!ttsr->ndims || !ttsr->ranks || !ttsr->factors, "TuckerTns New");
+    memcpy(ttsr->ndims, ndims, nmodes * sizeof *ttsr->ndims);
+    memcpy(ttsr->ranks, ranks, nmodes * sizeof *ttsr->ranks);
+    size_t ncore = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ttsr->factors[m] = malloc(sizeof *ttsr->factors[m]);
+        spt_CheckOSError(!ttsr->factors[m], "TuckerTns New");
+        result = sptNewMatrix(ttsr->factors[m], ndims[m], ranks[m]);
+        spt_CheckError(result, "TuckerTns New", NULL);
+        memset(ttsr->factors[m]->values, 0, (size_t) ttsr->factors[m]->cap * ttsr->factors[m]->stride * sizeof (sptValue));
+        ncore *= ranks[m];
+    }
+    ttsr->core = calloc(ncore, sizeof *ttsr->core);
+    spt_CheckOSError(!ttsr->core, "TuckerTns New");
+    return 0;
+}
+
+/**
+ * Free a Tucker tensor.
+ *
+ * @param[in] ttsr Tucker tensor
+ *
+ */
+void sptFreeTuckerTensor(sptTuckerTensor *ttsr)
+{
+    for(sptIndex m = 0; m < ttsr->nmodes; ++m) {
+        sptFreeMatrix(ttsr->factors[m]);
+        free(ttsr->factors[m]);
+    }
+    free(ttsr->factors);
+    free(ttsr->ranks);
+    free(ttsr->ndims);
+    free(ttsr->core);
+    ttsr->fit = 0.0;
+    ttsr->nmodes = 0;
+}
+
+int sptDumpTuckerTensor(sptTuckerTensor *ttsr, FILE *fp)
+{
+    int iores;
+    sptIndex mode;
+
+    iores = fprintf(fp, "nmodes: %"PARTI_PRI_INDEX "\n", ttsr->nmodes);
+    spt_CheckOSError(iores < 0, "TuckerTns Dump");
+    size_t ncore = 1;
+    for(mode = 0; mode < ttsr->nmodes; ++mode) {
+        iores = fprintf(fp, mode != 0 ? " %"PARTI_PRI_INDEX : "%"PARTI_PRI_INDEX, ttsr->ndims[mode]);
+        spt_CheckOSError(iores < 0, "TuckerTns Dump");
+    }
+    fputs("\nranks:", fp);
+    for(mode = 0; mode < ttsr->nmodes; ++mode) {
+        iores = fprintf(fp, " %"PARTI_PRI_INDEX, ttsr->ranks[mode]);
+        spt_CheckOSError(iores < 0, "TuckerTns Dump");
+        ncore *= ttsr->ranks[mode];
+    }
+    fputs("\n", fp);
+
+    iores = fprintf(fp, "fit: %lf\n", ttsr->fit);
+    spt_CheckOSError(iores < 0, "TuckerTns Dump");
+    fprintf(fp, "core:\n");
+    for(size_t i = 0; i < ncore; ++i) {
+        iores = fprintf(fp, "%"PARTI_PRI_VALUE " ", ttsr->core[i]);
+        spt_CheckOSError(iores < 0, "TuckerTns Dump");
+    }
+    fputs("\n", fp);
+    fprintf(fp, "Factor matrices:\n");
+    for(mode = 0; mode < ttsr->nmodes; ++mode) {
+        iores = sptDumpMatrix(ttsr->factors[mode], fp);
+        spt_CheckOSError(iores != 0, "TuckerTns Dump");
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "../error/error.h"
+#include <cuda_runtime.h>
+
+/**
+ * Create a zero dense matrix on the current CUDA device
+ * @param[out] dU    an uninitialized device matrix
+ * @param[in]  nrows the number of rows
+ * @param[in]  ncols the number of columns
+ */
+int sptNewDeviceMatrix(sptDeviceMatrix *dU, sptIndex const nrows, sptIndex const ncols) {
+    dU->nrows = nrows;
+    dU->ncols = ncols;
+    dU->stride = ((ncols-1)/8+1)*8;
+    size_t const bytes = ((size_t) nrows * dU->stride + 1) * sizeof (sptValue);
+    int result = cudaMalloc((void **) &dU->values, bytes);
+    spt_CheckCudaError(result != 0, "DevMtx New");
+    result = cudaMemset(dU->values, 0, bytes);
+    spt_CheckCudaError(result != 0, "DevMtx New");
+    return 0;
+}
+
+/**
+ * Copy a dense matrix to the current CUDA device
+ * @param[out] dU an uninitialized device matrix
+ * @param[in]  U  the host matrix
+ */
+int sptDeviceUploadMatrix(sptDeviceMatrix *dU, const sptMatrix *U) {
+    int result = sptNewDeviceMatrix(dU, U->nrows, U->ncols);
+    spt_CheckError(result, "DevMtx Upload", NULL);
+    result = cudaMemcpy(dU->values, U->values, (size_t) U->nrows * U->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "DevMtx Upload");
+    return 0;
+}
+
+/**
+ * Copy a device matrix back to the host
+ * @param[out] U  an uninitialized host matrix
+ * @param[in]  dU the device matrix
+ */
+int sptDeviceDownloadMatrix(sptMatrix *U, const sptDeviceMatrix *dU) {
+    int result = sptNewMatrix(U, dU->nrows, dU->ncols);
+    spt_CheckError(result, "DevMtx Download", NULL);
+    result = cudaMemcpy(U->values, dU->values, (size_t) dU->nrows * dU->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "DevMtx Download");
+    return 0;
+}
+
+/**
+ * Release a device matrix
+ * @param dU a valid device matrix
+ */
+void sptFreeDeviceMatrix(sptDeviceMatrix *dU) {
+    cudaFree(dU->values);
+    dU->values = NULL;
+    dU->nrows = 0;
+    dU->ncols = 0;
+}
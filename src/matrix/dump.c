@@ -24,9 +24,27 @@
 #include "../error/error.h"
 
 
+static void spt_FormatMatrixRow(spt_TextBuffer *buf, void const *ctx, sptNnzIndex const i) {
+    sptMatrix const * const mtx = ctx;
+    for(sptIndex j=0; j < mtx->ncols; ++j) {
+        spt_TextPrintf(buf, "%.2"PARTI_PRI_VALUE "\t", mtx->values[i * mtx->stride + j]);
+    }
+    spt_TextPrintf(buf, "\n");
+}
+
+static void spt_FormatRankMatrixRow(spt_TextBuffer *buf, void const *ctx, sptNnzIndex const i) {
+    sptRankMatrix const * const mtx = ctx;
+    for(sptElementIndex j=0; j < mtx->ncols; ++j) {
+        spt_TextPrintf(buf, "%.2"PARTI_PRI_VALUE "\t", mtx->values[i * mtx->stride + j]);
+    }
+    spt_TextPrintf(buf, "\n");
+}
+
 /**
  * Dum a dense matrix to file
  *
+ * The rows are formatted in parallel and written in order.
+ *
  * @param mtx   a valid pointer to a sptMatrix variable
  * @param fp a file pointer
  *
@@ -35,17 +53,12 @@ int sptDumpMatrix(sptMatrix *mtx, FILE *fp) {
     int iores;
     sptIndex nrows = mtx->nrows;
     sptIndex ncols = mtx->ncols;
-    sptIndex stride = mtx->stride;
     iores = fprintf(fp, "%"PARTI_PRI_INDEX " x %"PARTI_PRI_INDEX " matrix\n", nrows, ncols);
     spt_CheckOSError(iores < 0, "Mtx Dump");
-    for(sptIndex i=0; i < nrows; ++i) {
-      for(sptIndex j=0; j < ncols; ++j) {
-          iores = fprintf(fp, "%.2"PARTI_PRI_VALUE "\t", mtx->values[i * stride + j]);
-          spt_CheckOSError(iores < 0, "Mtx Dump");
-      }
-      iores = fprintf(fp, "\n");
-    }
+    iores = spt_DumpRows(fp, nrows, 8 * (size_t) ncols + 1, spt_FormatMatrixRow, mtx, 0);
+    spt_CheckError(iores, "Mtx Dump", NULL);
     iores = fprintf(fp, "\n");
+    spt_CheckOSError(iores < 0, "Mtx Dump");
     return 0;
 }
 
@@ -53,6 +66,8 @@ int sptDumpMatrix(sptMatrix *mtx, FILE *fp) {
 /**
  * Dum a dense rank matrix to file
  *
+ * The rows are formatted in parallel and written in order.
+ *
  * @param mtx   a valid pointer to a sptMatrix variable
  * @param fp a file pointer
  *
@@ -61,16 +76,11 @@ int sptDumpRankMatrix(sptRankMatrix *mtx, FILE *fp) {
     int iores;
     sptIndex nrows = mtx->nrows;
     sptElementIndex ncols = mtx->ncols;
-    sptElementIndex stride = mtx->stride;
     iores = fprintf(fp, "%"PARTI_PRI_INDEX " x %"PARTI_PRI_ELEMENT_INDEX " matrix\n", nrows, ncols);
     spt_CheckOSError(iores < 0, "RankMtx Dump");
-    for(sptIndex i=0; i < nrows; ++i) {
-      for(sptElementIndex j=0; j < ncols; ++j) {
-          iores = fprintf(fp, "%.2"PARTI_PRI_VALUE "\t", mtx->values[i * stride + j]);
-          spt_CheckOSError(iores < 0, "RankMtx Dump");
-      }
-      iores = fprintf(fp, "\n");
-    }
+    iores = spt_DumpRows(fp, nrows, 8 * (size_t) ncols + 1, spt_FormatRankMatrixRow, mtx, 0);
+    spt_CheckError(iores, "RankMtx Dump", NULL);
     iores = fprintf(fp, "\n");
+    spt_CheckOSError(iores < 0, "RankMtx Dump");
     return 0;
 }
@@ -0,0 +1,312 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../error/error.h"
+#include "lapack.h"
+#include "simd.h"
+
+
+/* Rows handled together, so a block stays in cache while each row of the Gram partial sweeps it */
+static sptIndex spt_GramBlockRows(sptIndex const stride)
+{
+    size_t const rows = PARTI_ROW_BLOCK_BYTES / ((size_t) stride * sizeof(sptValue));
+    return rows > 0 ? (sptIndex) rows : 1;
+}
+
+/* g += X^T * X for the nrows rows of X, upper triangle of the row-major rank x rank g */
+static inline void spt_GramAccBlock(spt_SimdKernels const * simd, sptValue * const g, sptValue const * const X, sptIndex const nrows, sptIndex const rank, sptIndex const stride)
+{
+    for(sptIndex r=0; r < rank; ++r) {
+        sptValue * const gr = g + (size_t) r * stride + r;
+        for(sptIndex i=0; i < nrows; ++i) {
+            sptValue const * const row = X + (size_t) i * stride;
+            if(row[r] != 0) {
+                simd->axpy(gr, row[r], row + r, rank - r);
+            }
+        }
+    }
+}
+
+/* Pairwise reduction of the per-thread buffers parts[t * len] into parts[0], called by every thread of a team */
+static void spt_TreeReduce(spt_SimdKernels const * simd, sptValue * const parts, size_t const len, int const use_max)
+{
+#ifdef PARTI_USE_OPENMP
+    int const tid = omp_get_thread_num();
+    int const nthreads = omp_get_num_threads();
+    for(int step=1; step < nthreads; step *= 2) {
+        if(tid % (2 * step) == 0 && tid + step < nthreads) {
+            if(use_max) {
+                simd->maxacc(parts + tid * len, parts + (tid + step) * len, (sptIndex) len);
+            } else {
+                simd->axpy(parts + tid * len, 1, parts + (tid + step) * len, (sptIndex) len);
+            }
+        }
+        #pragma omp barrier
+    }
+#else
+    (void) simd; (void) parts; (void) len; (void) use_max;
+#endif
+}
+
+
+/**
+ * Gram matrix A^T A of a tall-skinny row-major matrix, the rows split across threads.
+ * Each thread accumulates a rank x rank partial with vector kernels, and the
+ * partials are reduced pairwise. The result is the upper triangle of ata in
+ * row-major order, the layout the CP-ALS drivers get from ?syrk, without
+ * depending on a threaded BLAS.
+ * @param[in]  A    the row-major input matrix
+ * @param[out] ata  a ncols x ncols matrix with the stride of A
+ * @param[in]  tk   the number of threads
+ */
+int sptOmpMatrixGram(sptMatrix const * const A, sptMatrix * const ata, int const tk)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const rank = A->ncols;
+    sptIndex const stride = A->stride;
+    spt_CheckError(ata->stride != stride || ata->ncols != rank ? SPTERR_SHAPE_MISMATCH : 0, "OMP Gram", "ata does not match A");
+    size_t const len = (size_t) rank * stride;
+    sptIndex const block = spt_GramBlockRows(stride);
+    int const nparts = tk > 0 ? tk : 1;
+    sptValue * const parts = calloc((size_t) nparts * len, sizeof *parts);
+    spt_CheckOSError(!parts, "OMP Gram");
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel num_threads(nparts)
+#endif
+    {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const g = parts + omp_get_thread_num() * len;
+        #pragma omp for schedule(static)
+#else
+        sptValue * const g = parts;
+#endif
+        for(sptIndex begin=0; begin < A->nrows; begin += block) {
+            sptIndex const n = A->nrows - begin < block ? A->nrows - begin : block;
+            spt_GramAccBlock(simd, g, A->values + (size_t) begin * stride, n, rank, stride);
+        }
+        spt_TreeReduce(simd, parts, len, 0);
+    }
+
+    memcpy(ata->values, parts, len * sizeof *parts);
+    free(parts);
+    return 0;
+}
+
+
+/**
+ * One fused CP-ALS update of factor A: solve against the MTTKRP output, normalize,
+ * and form the Gram matrix, touching each row of A once for the solve and once
+ * for the scaling. Rows go in blocks of PARTI_ROW_BLOCK_BYTES: a block is solved
+ * with the precomputed Cholesky factor and its norms and Gram contribution are
+ * accumulated while it is in cache. The Gram matrix is accumulated on the
+ * unnormalized rows and rescaled by the column norms afterwards.
+ * Falls back to sptMatrixSolveNormals and separate passes when the normal
+ * equations are not positive definite.
+ * @param[in]     mode     the mode of A
+ * @param[in]     nmodes   the number of modes
+ * @param[in,out] aTa      the Gram matrices, aTa[nmodes] as scratch; aTa[mode] is updated
+ * @param[in]     rhs      the row-major MTTKRP output for this mode
+ * @param[out]    A        the factor of this mode
+ * @param[out]    lambda   the column norms taken out of A
+ * @param[in]     use_max  1 for the max norm of sptMatrixMaxNorm, 0 for the 2-norm
+ * @param[in]     tk       the number of threads
+ */
+int sptOmpMatrixSolveNormalsGram(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix const * const rhs,
+  sptMatrix * const A,
+  sptValue * const lambda,
+  int const use_max,
+  int const tk)
+{
+  sptMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+  return sptOmpMatrixSolveFormedNormalsGram(mode, nmodes, aTa, rhs, A, lambda, use_max, tk);
+}
+
+
+/**
+ * sptOmpMatrixSolveNormalsGram with aTa[nmodes] already holding the Hadamard
+ * product of the other modes' Gram matrices in full, e.g. from
+ * sptGramHadamardForm. aTa[nmodes] is overwritten.
+ */
+int sptOmpMatrixSolveFormedNormalsGram(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix const * const rhs,
+  sptMatrix * const A,
+  sptValue * const lambda,
+  int const use_max,
+  int const tk)
+{
+  spt_SimdKernels const * const simd = spt_Simd();
+  sptIndex const rank = A->ncols;
+  sptIndex const stride = A->stride;
+  sptIndex const nrows = A->nrows;
+  size_t const len = (size_t) rank * stride;
+
+  sptValue * const neqs = aTa[nmodes]->values;
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+  int info;
+  /* potrf only writes the diagonal and one triangle; keep the diagonal to undo it */
+  sptValue * const diag = malloc(rank * sizeof *diag);
+  spt_CheckOSError(!diag, "OMP Solve Normals");
+  for(sptIndex r=0; r < rank; ++r) {
+    diag[r] = neqs[(size_t) r * stride + r];
+  }
+  spt_potrf_(&uplo, &blas_rank, neqs, &blas_stride, &info);
+  if(info) {
+    for(sptIndex r=0; r < rank; ++r) {
+      neqs[(size_t) r * stride + r] = diag[r];
+      for(sptIndex c=0; c < r; ++c) {
+        neqs[(size_t) c * stride + r] = neqs[(size_t) r * stride + c];
+      }
+    }
+    free(diag);
+    memcpy(A->values, rhs->values, (size_t) nrows * stride * sizeof(sptValue));
+    sptMatrixSolveFormedNormals(nmodes, aTa, A);
+    if(use_max) {
+      sptMatrixMaxNorm(A, lambda);
+    } else {
+      sptMatrix2Norm(A, lambda);
+    }
+    return sptOmpMatrixGram(A, aTa[mode], tk);
+  }
+  free(diag);
+
+  /* The Cholesky factor L of column-major neqs, copied so its rows are contiguous */
+  sptValue * const lrows = malloc((size_t) rank * rank * sizeof *lrows);
+  int const nparts = tk > 0 ? tk : 1;
+  size_t const plen = len + stride;   /// a Gram partial and a norm partial per thread
+  sptIndex const block = spt_GramBlockRows(stride);
+  sptValue * const parts = calloc((size_t) nparts * plen, sizeof *parts);
+  spt_CheckOSError(!lrows || !parts, "OMP Solve Normals");
+  for(sptIndex r=0; r < rank; ++r) {
+    for(sptIndex s=0; s <= r; ++s) {
+      lrows[(size_t) r * rank + s] = neqs[(size_t) s * stride + r];
+    }
+  }
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel num_threads(nparts)
+#endif
+  {
+#ifdef PARTI_USE_OPENMP
+    sptValue * const g = parts + omp_get_thread_num() * plen;
+#else
+    sptValue * const g = parts;
+#endif
+    sptValue * const nrm = g + len;
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for(sptIndex begin=0; begin < nrows; begin += block) {
+      sptIndex const n = nrows - begin < block ? nrows - begin : block;
+      sptValue * const xb = A->values + (size_t) begin * stride;
+      for(sptIndex i=0; i < n; ++i) {
+        sptValue const * const b = rhs->values + (size_t) (begin + i) * stride;
+        sptValue * const x = xb + (size_t) i * stride;
+        /* L y = b, then L^T x = y */
+        for(sptIndex r=0; r < rank; ++r) {
+          sptValue const * const l = lrows + (size_t) r * rank;
+          sptValue v = b[r];
+          for(sptIndex s=0; s < r; ++s) {
+            v -= l[s] * x[s];
+          }
+          x[r] = v / l[r];
+        }
+        for(sptIndex r=rank; r-- > 0; ) {
+          sptValue const * const lt = neqs + (size_t) r * stride;
+          sptValue v = x[r];
+          for(sptIndex s=r+1; s < rank; ++s) {
+            v -= lt[s] * x[s];
+          }
+          x[r] = v / lt[r];
+        }
+        if(use_max) {
+          simd->maxacc(nrm, x, rank);
+        } else {
+          simd->sqacc(nrm, x, rank);
+        }
+      }
+      /* The block is still in cache for its Gram contribution */
+      spt_GramAccBlock(simd, g, xb, n, rank, stride);
+    }
+
+    /* Norms reduce by max or sum, the Gram partials by sum */
+#ifdef PARTI_USE_OPENMP
+    int const tid = omp_get_thread_num();
+    int const nthreads = omp_get_num_threads();
+    for(int step=1; step < nthreads; step *= 2) {
+      if(tid % (2 * step) == 0 && tid + step < nthreads) {
+        sptValue const * const other = parts + (tid + step) * plen;
+        simd->axpy(g, 1, other, (sptIndex) len);
+        if(use_max) {
+          simd->maxacc(nrm, other + len, rank);
+        } else {
+          simd->axpy(nrm, 1, other + len, rank);
+        }
+      }
+      #pragma omp barrier
+    }
+    #pragma omp single
+#endif
+    {
+      for(sptIndex r=0; r < rank; ++r) {
+        sptValue const n = parts[len + r];
+        lambda[r] = use_max ? (n < 1 ? 1 : n) : (sptValue) sqrt(n);
+      }
+    }
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp for schedule(static) nowait
+#endif
+    for(sptIndex begin=0; begin < nrows; begin += block) {
+      /* Same blocks on the same threads as the solve, so the last ones are still in cache */
+      sptIndex const end = nrows - begin < block ? nrows : begin + block;
+      for(sptIndex i=begin; i < end; ++i) {
+        simd->div(A->values + (size_t) i * stride, lambda, rank);
+      }
+    }
+#ifdef PARTI_USE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for(sptIndex r=0; r < rank; ++r) {
+      sptValue * const out = aTa[mode]->values + (size_t) r * stride;
+      for(sptIndex s=r; s < rank; ++s) {
+        out[s] = parts[(size_t) r * stride + s] / (lambda[r] * lambda[s]);
+      }
+    }
+  }
+
+  free(parts);
+  free(lrows);
+  return 0;
+}
@@ -0,0 +1,217 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../error/error.h"
+#include "simd.h"
+
+/*
+ * Hadamard products of the Gram matrices kept across a CP-ALS sweep.
+ *
+ * Solving mode m needs the product of the Gram matrices of all other modes:
+ * those before m as updated earlier in the sweep, those after m as they were
+ * when it began. sptMatrixDotMulSeqTriangle forms it from scratch, N - 1
+ * products per mode and O(N^2 R^2) per sweep. Here the products of the modes
+ * after each m are taken once when the sweep begins, and the product of the
+ * modes before it grows by one Gram matrix as each mode is updated, O(N R^2)
+ * per sweep. Once all modes are updated the prefix is the product of every
+ * Gram matrix, which is all the norm of the Kruskal tensor needs.
+ *
+ * Products keep the upper triangle of row-major rank x rank matrices with the
+ * stride of the Gram matrices, as sptMatrixDotMulSeqTriangle does.
+ */
+
+/* out = 1 on the upper triangle */
+static void spt_HadamardOnes(sptValue * const out, sptIndex const rank, sptIndex const stride)
+{
+    for(sptIndex i=0; i < rank; ++i) {
+        for(sptIndex j=i; j < rank; ++j) {
+            out[i * stride + j] = 1;
+        }
+    }
+}
+
+/* out = a .* b on the upper triangle, or out .*= b with a NULL */
+static void spt_HadamardMul(
+    spt_SimdKernels const * const simd,
+    sptValue * const out,
+    sptValue const * const a,
+    sptValue const * const b,
+    sptIndex const rank,
+    sptIndex const stride)
+{
+    for(sptIndex i=0; i < rank; ++i) {
+        size_t const row = (size_t) i * stride + i;
+        if(a != NULL) {
+            memcpy(out + row, a + row, (rank - i) * sizeof *out);
+        }
+        simd->mul(out + row, b + row, rank - i);
+    }
+}
+
+/* Product of the Gram matrices of all modes but skip (nmodes for none) into out */
+static void spt_HadamardFromScratch(
+    sptGramHadamard const * const gh,
+    sptIndex const skip,
+    sptValue * const * ata,
+    sptValue * const out)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    spt_HadamardOnes(out, gh->rank, gh->stride);
+    for(sptIndex m=0; m < gh->nmodes; ++m) {
+        if(m != skip) {
+            spt_HadamardMul(simd, out, NULL, ata[m], gh->rank, gh->stride);
+        }
+    }
+}
+
+
+/**
+ * Create the running products for CP-ALS sweeps over nmodes Gram matrices
+ * @param gh     an uninitialized Hadamard product set
+ * @param nmodes the number of modes
+ * @param rank   the number of columns of the Gram matrices
+ * @param stride the row stride of the Gram matrices
+ */
+int sptNewGramHadamard(sptGramHadamard * gh, sptIndex const nmodes, sptIndex const rank, sptIndex const stride)
+{
+    if(nmodes == 0 || stride < rank) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "Gram Hadamard", "no modes or stride < rank");
+    }
+    size_t const len = (size_t) rank * stride;
+    gh->nmodes = nmodes;
+    gh->rank = rank;
+    gh->stride = stride;
+    gh->next = nmodes + 1;
+    gh->prefix = malloc(len * sizeof *gh->prefix);
+    gh->suffix = malloc(nmodes * len * sizeof *gh->suffix);
+    gh->scratch = malloc(len * sizeof *gh->scratch);
+    spt_CheckOSError(!gh->prefix || !gh->suffix || !gh->scratch, "Gram Hadamard");
+    return 0;
+}
+
+
+/**
+ * Release the running products of sptNewGramHadamard
+ */
+void sptFreeGramHadamard(sptGramHadamard * gh)
+{
+    free(gh->prefix);
+    free(gh->suffix);
+    free(gh->scratch);
+    gh->prefix = gh->suffix = gh->scratch = NULL;
+    gh->nmodes = 0;
+}
+
+
+/**
+ * Start a sweep over modes 0, 1, ..., nmodes-1 from the current Gram matrices
+ * @param gh  the running products
+ * @param ata the upper triangles of the Gram matrices of all modes
+ */
+int sptGramHadamardBeginSweep(sptGramHadamard * gh, sptValue * const * ata)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = gh->nmodes;
+    size_t const len = (size_t) gh->rank * gh->stride;
+    spt_HadamardOnes(gh->suffix + (nmodes - 1) * len, gh->rank, gh->stride);
+    for(sptIndex m=nmodes-1; m > 0; --m) {
+        spt_HadamardMul(simd, gh->suffix + (m - 1) * len, gh->suffix + m * len, ata[m], gh->rank, gh->stride);
+    }
+    spt_HadamardOnes(gh->prefix, gh->rank, gh->stride);
+    gh->next = 0;
+    return 0;
+}
+
+
+/**
+ * Form the normal equations of a mode: the Hadamard product of the Gram
+ * matrices of all other modes, in full, as sptMatrixDotMulSeqTriangle does.
+ * In step with the sweep this is one product; otherwise it is formed from
+ * scratch from ata.
+ * @param gh   the running products
+ * @param mode the mode to solve
+ * @param ata  the upper triangles of the current Gram matrices
+ * @param out  rank x stride values for the product, e.g. aTa[nmodes]->values
+ */
+int sptGramHadamardForm(sptGramHadamard * gh, sptIndex const mode, sptValue * const * ata, sptValue * out)
+{
+    sptIndex const rank = gh->rank;
+    sptIndex const stride = gh->stride;
+    if(mode == gh->next) {
+        spt_HadamardMul(spt_Simd(), out, gh->prefix, gh->suffix + (size_t) mode * rank * stride, rank, stride);
+    } else {
+        spt_HadamardFromScratch(gh, mode, ata, out);
+    }
+    for(sptIndex i=0; i < rank; ++i) {
+        for(sptIndex j=0; j < i; ++j) {
+            out[i * stride + j] = out[j * stride + i];
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Take the updated Gram matrix of a mode into the prefix. A mode out of
+ * order puts the products out of step until the next sweep begins.
+ * @param gh   the running products
+ * @param mode the mode just updated
+ * @param ata  the upper triangles of the current Gram matrices
+ */
+int sptGramHadamardAdvance(sptGramHadamard * gh, sptIndex const mode, sptValue * const * ata)
+{
+    if(mode != gh->next) {
+        gh->next = gh->nmodes + 1;
+        return 0;
+    }
+    spt_HadamardMul(spt_Simd(), gh->prefix, NULL, ata[mode], gh->rank, gh->stride);
+    ++gh->next;
+    return 0;
+}
+
+
+/**
+ * The squared norm of the Kruskal tensor of lambda and the factors behind
+ * ata, lambda^T (the product of all Gram matrices) lambda. Right after a
+ * sweep the product is the prefix; otherwise it is formed from scratch.
+ * @param gh     the running products
+ * @param lambda the weights
+ * @param ata    the upper triangles of the current Gram matrices
+ */
+double sptGramHadamardKruskalNorm(sptGramHadamard * gh, sptValue const * const lambda, sptValue * const * ata)
+{
+    sptIndex const rank = gh->rank;
+    sptIndex const stride = gh->stride;
+    sptValue const * h = gh->prefix;
+    if(gh->next != gh->nmodes) {
+        spt_HadamardFromScratch(gh, gh->nmodes, ata, gh->scratch);
+        h = gh->scratch;
+    }
+    double norm = 0;
+    for(sptIndex i=0; i < rank; ++i) {
+        double row = 0;
+        for(sptIndex j=i+1; j < rank; ++j) {
+            row += h[i * stride + j] * lambda[j];
+        }
+        norm += lambda[i] * (h[i * stride + i] * lambda[i] + 2 * row);
+    }
+    return norm;
+}
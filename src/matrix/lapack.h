@@ -0,0 +1,57 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_LAPACK_H
+#define PARTI_LAPACK_H
+
+#include <ParTI.h>
+#ifdef PARTI_USE_MAGMA
+  #include "magma_v2.h"
+  #include "magma_lapack.h"
+#else
+  #include "clapack.h"
+#endif
+
+/* BLAS/LAPACK routines for the precision of sptValue */
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_syrk_ ssyrk_
+  #define spt_gemm_ sgemm_
+  #define spt_potrf_ spotrf_
+  #define spt_potrs_ spotrs_
+  #define spt_gesv_ sgesv_
+#else
+  #define spt_syrk_ dsyrk_
+  #define spt_gemm_ dgemm_
+  #define spt_potrf_ dpotrf_
+  #define spt_potrs_ dpotrs_
+  #define spt_gesv_ dgesv_
+#endif
+
+/* Threaded Cholesky solve of row-major right-hand sides, see matrix_solver.c */
+int spt_OmpSolveFormedNormals(
+  sptValue * const neqs,
+  sptIndex const rank,
+  sptIndex const stride,
+  sptValue * const X,
+  sptIndex const nrows,
+  int const tk);
+
+/* Eigenpairs of a symmetric column-major matrix in place, ascending, see tucker.c */
+int spt_TuckerEigen(integer n, double * const g, double * const w);
+
+#endif
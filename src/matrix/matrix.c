@@ -23,6 +23,7 @@
 #include <time.h>
 #include <math.h>
 #include "../error/error.h"
+#include "simd.h"
 
 /**
  * Initialize a new dense matrix
@@ -35,23 +36,34 @@
  * rounded up to multiples of 8
  */
 int sptNewMatrix(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols) {
+    return sptNewMatrixWithBacking(mtx, nrows, ncols, SPT_MEM_DEFAULT);
+}
+
+/**
+ * Initialize a new dense matrix whose values get the requested backing, e.g.
+ * SPT_MEM_HUGE_2MB for large factor matrices gathered at random; see
+ * sptMallocBacked. SPT_MEM_DEFAULT takes the backing sptSetDataPlacement
+ * sets for matrices, and if that is SPT_MEM_DEFAULT too puts the values in
+ * high-bandwidth memory while sptSetHbmPlacement leaves room.
+ *
+ * @param mtx     a valid pointer to an uninitialized sptMatrix variable
+ * @param nrows   the number of rows
+ * @param ncols   the number of columns
+ * @param backing the backing to request
+ */
+int sptNewMatrixWithBacking(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols, sptMemBacking const backing) {
     mtx->nrows = nrows;
     mtx->ncols = ncols;
     mtx->cap = nrows != 0 ? nrows : 1;
     mtx->stride = ((ncols-1)/8+1)*8;
-#ifdef _ISOC11_SOURCE
-    mtx->values = aligned_alloc(8 * sizeof (sptValue), mtx->cap * mtx->stride * sizeof (sptValue));
-#elif _POSIX_C_SOURCE >= 200112L
-    {
-        int result = posix_memalign((void **) &mtx->values, 8 * sizeof (sptValue), mtx->cap * mtx->stride * sizeof (sptValue));
-        if(result != 0) {
-            mtx->values = NULL;
-        }
-    }
-#else
-    mtx->values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
-#endif
+    size_t const bytes = mtx->cap * mtx->stride * sizeof (sptValue);
+    sptMemBacking const placed = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_MATRICES);
+    mtx->values = sptMallocBacked(bytes, placed != SPT_MEM_DEFAULT ? placed : spt_HbmBacking(bytes, 0));
     spt_CheckOSError(!mtx->values, "Mtx New");
+    if(sptMemBackingOf(mtx->values) != SPT_MEM_HBM) {
+        sptNumaInterleave(mtx->values, bytes);
+    }
+    sptFirstTouchZero(mtx->values, bytes);
     return 0;
 }
 
@@ -62,14 +74,16 @@ int sptNewMatrix(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols) {
  * @param nrows fill the specified number of rows
  * @param ncols fill the specified number of columns
  *
- * The matrix is filled with uniform distributed pseudorandom number in [0, 1]
- * The random number will have a precision of 31 bits out of 51 bits
+ * The matrix is filled with values uniform in [-3, 3], see sptRandomValue, from
+ * the library random stream: the same for a seed given to sptSetRandomSeed
+ * whatever the thread count, each entry drawn on its own so rows fill in parallel.
  */
 int sptRandomizeMatrix(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols) {
-  srand(time(NULL));
+  uint64_t const base = spt_RandomReserve((uint64_t) nrows * ncols);
+  #pragma omp parallel for schedule(static) num_threads(sptExecThreads(0))
   for(sptIndex i=0; i<nrows; ++i)
     for(sptIndex j=0; j<ncols; ++j) {
-      mtx->values[i * mtx->stride + j] = sptRandomValue();
+      mtx->values[(size_t) i * mtx->stride + j] = spt_RandomValueOf(spt_RandomBits(base + (uint64_t) i * ncols + j));
     }
   return 0;
 }
@@ -122,7 +136,7 @@ int sptConstantMatrix(sptMatrix *mtx, sptValue const val) {
 void sptMatrixInverseShuffleIndices(sptMatrix *mtx, sptIndex * mode_map_inds) {
     /* Renumber matrix rows */
     sptIndex new_i;
-    sptValue * tmp_values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
+    sptValue * tmp_values = sptMallocBacked(mtx->cap * mtx->stride * sizeof (sptValue), spt_MemRequestOf(mtx->values));
 
     for(sptIndex i=0; i<mtx->nrows; ++i) {
         new_i = mode_map_inds[i];
@@ -131,7 +145,7 @@ void sptMatrixInverseShuffleIndices(sptMatrix *mtx, sptIndex * mode_map_inds) {
         }
     }
 
-    free(mtx->values);
+    sptFree(mtx->values);
     mtx->values = tmp_values;
 }
 
@@ -165,22 +179,8 @@ int sptAppendMatrix(sptMatrix *mtx, const sptValue values[]) {
 #else
         sptIndex newcap = mtx->nrows+1;
 #endif
-        sptValue *newdata;
-#ifdef _ISOC11_SOURCE
-        newdata = aligned_alloc(8 * sizeof (sptValue), newcap * mtx->stride * sizeof (sptValue));
-#elif _POSIX_C_SOURCE >= 200112L
-        {
-            int result = posix_memalign((void **) &newdata, 8 * sizeof (sptValue), newcap * mtx->stride * sizeof (sptValue));
-            if(result != 0) {
-                newdata = NULL;
-            }
-        }
-#else
-        newdata = malloc(newcap * mtx->stride * sizeof (sptValue));
-#endif
+        sptValue *newdata = spt_Realloc(mtx->values, mtx->nrows * mtx->stride * sizeof (sptValue), newcap * mtx->stride * sizeof (sptValue), SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "Mtx Append");
-        memcpy(newdata, mtx->values, mtx->nrows * mtx->stride * sizeof (sptValue));
-        free(mtx->values);
         mtx->cap = newcap;
         mtx->values = newdata;
     }
@@ -198,28 +198,38 @@ int sptAppendMatrix(sptMatrix *mtx, const sptValue values[]) {
  * @param new_nrows the new number of rows `mtx` will have
  */
 int sptResizeMatrix(sptMatrix *mtx, sptIndex const new_nrows) {
-    sptValue *newdata;
-#ifdef _ISOC11_SOURCE
-    newdata = aligned_alloc(8 * sizeof (sptValue), new_nrows * mtx->stride * sizeof (sptValue));
-#elif _POSIX_C_SOURCE >= 200112L
-    {
-        int result = posix_memalign((void **) &newdata, 8 * sizeof (sptValue), new_nrows * mtx->stride * sizeof (sptValue));
-        if(result != 0) {
-            newdata = NULL;
-        }
-    }
-#else
-    newdata = malloc(new_nrows * mtx->stride * sizeof (sptValue));
-#endif
+    sptValue *newdata = spt_Realloc(mtx->values, mtx->nrows * mtx->stride * sizeof (sptValue), new_nrows * mtx->stride * sizeof (sptValue), SPT_MEM_DEFAULT);
     spt_CheckOSError(!newdata, "Mtx Resize");
-    memcpy(newdata, mtx->values, mtx->nrows * mtx->stride * sizeof (sptValue));
-    free(mtx->values);
     mtx->nrows = new_nrows;
     mtx->cap = new_nrows;
     mtx->values = newdata;
     return 0;
 }
 
+/**
+ * Move the values of a dense matrix to the requested backing, which they
+ * keep as they grow; SPT_MEM_DEFAULT moves them to the backing
+ * sptSetDataPlacement sets for matrices. Values already there are left alone.
+ * @param mtx     the matrix to move
+ * @param backing the backing to request
+ */
+int sptPlaceMatrix(sptMatrix *mtx, sptMemBacking const backing) {
+    sptMemBacking const placed = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_MATRICES);
+    if(spt_MemRequestOf(mtx->values) == placed) {
+        return 0;
+    }
+    if(sptMemBackingOf(mtx->values) == SPT_MEM_FILE) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Mtx Place", "values not from sptMalloc");
+    }
+    size_t const bytes = (size_t) mtx->cap * mtx->stride * sizeof (sptValue);
+    sptValue * values = sptMallocBacked(bytes, placed);
+    spt_CheckOSError(!values, "Mtx Place");
+    memcpy(values, mtx->values, bytes);
+    sptFree(mtx->values);
+    mtx->values = values;
+    return 0;
+}
+
 /**
  * Release the memory buffer a dense matrix is holding
  *
@@ -229,7 +239,7 @@ int sptResizeMatrix(sptMatrix *mtx, sptIndex const new_nrows) {
  * should not be used anymore prior to another initialization
  */
 void sptFreeMatrix(sptMatrix *mtx) {
-    free(mtx->values);
+    sptFree(mtx->values);
     mtx->nrows = 0;
     mtx->ncols = 0;
     mtx->cap = 0;
@@ -340,6 +350,7 @@ int sptMatrixDotMulSeqCol(sptIndex const mode, sptIndex const nmodes, sptMatrix
 /* mats (aTa) only stores upper triangle elements. */
 int sptMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, sptMatrix ** mats)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = mats[0]->nrows;
     sptIndex const ncols = mats[0]->ncols;
     sptIndex const stride = mats[0]->stride;
@@ -366,8 +377,8 @@ int sptMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, sptMa
     #pragma omp parallel for schedule(static)
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptIndex j=i; j < ncols; ++j) {
-                ovals[i * stride + j] *= vals[i * stride + j];
+            if(i < ncols) {
+                simd->mul(ovals + i * stride + i, vals + i * stride + i, ncols - i);
             }
         }
     }
@@ -389,6 +400,7 @@ int sptMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, sptMa
 // Row-major
 int sptMatrix2Norm(sptMatrix * const A, sptValue * const lambda)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = A->nrows;
     sptIndex const ncols = A->ncols;
     sptIndex const stride = A->stride;
@@ -422,9 +434,7 @@ int sptMatrix2Norm(sptMatrix * const A, sptValue * const lambda)
 
         #pragma omp for
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptIndex j=0; j < ncols; ++j) {
-                loc_lambda[j] += vals[i*stride + j] * vals[i*stride + j];
-            }
+            simd->sqacc(loc_lambda, vals + i*stride, ncols);
         }
 
         #pragma omp for
@@ -438,9 +448,7 @@ int sptMatrix2Norm(sptMatrix * const A, sptValue * const lambda)
 #else
 
     for(sptIndex i=0; i < nrows; ++i) {
-        for(sptIndex j=0; j < ncols; ++j) {
-            lambda[j] += vals[i*stride + j] * vals[i*stride + j];
-        }
+        simd->sqacc(lambda, vals + i*stride, ncols);
     }
 
 #endif
@@ -456,9 +464,7 @@ int sptMatrix2Norm(sptMatrix * const A, sptValue * const lambda)
         #pragma omp parallel for
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptIndex j=0; j < ncols; ++j) {
-                vals[i*stride + j] /= lambda[j];
-            }
+            simd->div(vals + i*stride, lambda, ncols);
         }
 
     
@@ -472,6 +478,7 @@ int sptMatrix2Norm(sptMatrix * const A, sptValue * const lambda)
 // Row-major
 int sptMatrixMaxNorm(sptMatrix * const A, sptValue * const lambda)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = A->nrows;
     sptIndex const ncols = A->ncols;
     sptIndex const stride = A->stride;
@@ -505,10 +512,7 @@ int sptMatrixMaxNorm(sptMatrix * const A, sptValue * const lambda)
 
         #pragma omp for
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptIndex j=0; j < ncols; ++j) {
-                if(vals[i*stride + j] > loc_lambda[j])
-                    loc_lambda[j] = vals[i*stride + j];
-            }
+            simd->maxacc(loc_lambda, vals + i*stride, ncols);
         }
 
         #pragma omp for
@@ -522,10 +526,7 @@ int sptMatrixMaxNorm(sptMatrix * const A, sptValue * const lambda)
 
 #else
     for(sptIndex i=0; i < nrows; ++i) {
-        for(sptIndex j=0; j < ncols; ++j) {
-            if(vals[i*stride + j] > lambda[j])
-                lambda[j] = vals[i*stride + j];
-        }
+        simd->maxacc(lambda, vals + i*stride, ncols);
     }
 #endif
 
@@ -541,9 +542,7 @@ int sptMatrixMaxNorm(sptMatrix * const A, sptValue * const lambda)
         #pragma omp parallel for
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptIndex j=0; j < ncols; ++j) {
-                vals[i*stride + j] /= lambda[j];
-            }
+            simd->div(vals + i*stride, lambda, ncols);
         }
 
 #ifdef PARTI_USE_OPENMP
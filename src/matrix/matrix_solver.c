@@ -23,32 +23,49 @@
 #include <time.h>
 #include <math.h>
 #include "../error/error.h"
-#ifdef PARTI_USE_MAGMA
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
+#include "lapack.h"
+#include "simd.h"
 
 int sptMatrixSolveNormals(
   sptIndex const mode,
   sptIndex const nmodes,
   sptMatrix ** aTa,
   sptMatrix * rhs)
+{
+  sptMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+  return sptMatrixSolveFormedNormals(nmodes, aTa, rhs);
+}
+
+
+/**
+ * sptMatrixSolveNormals with aTa[nmodes] already holding the Hadamard product of
+ * the other modes' Gram matrices in full, e.g. from sptGramHadamardForm.
+ * aTa[nmodes] is overwritten.
+ */
+int sptMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs)
 {
   int rank = (int)(aTa[0]->ncols);
   int stride = (int)(aTa[0]->stride);
 
-  sptMatrixDotMulSeqTriangle(mode, nmodes, aTa);
-
   int info;
   char uplo = 'L';
   int nrhs = (int) rhs->nrows;
   sptValue * const neqs = aTa[nmodes]->values;
 
+  /* potrf only writes the diagonal and one triangle; keep the diagonal to undo it */
+  sptValue * const diag = (sptValue *)malloc(rank * sizeof(sptValue));
+  spt_CheckOSError(!diag, "Solve Normals");
+  for(int r=0; r < rank; ++r) {
+    diag[r] = neqs[r * stride + r];
+  }
+
   /* Cholesky factorization */
   bool is_spd = true;
   // lapackf77_spotrf(&uplo, &rank, neqs, &stride, &info);
-  spotrf_(&uplo, &rank, neqs, &stride, &info);
+  spt_potrf_(&uplo, &rank, neqs, &stride, &info);
   if(info) {
     printf("Gram matrix is not SPD. Trying `gesv`.\n");
     is_spd = false;
@@ -58,7 +75,7 @@ int sptMatrixSolveNormals(
   if(is_spd) {
     /* Solve against rhs */
     // lapackf77_spotrs(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
-    spotrs_(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
+    spt_potrs_(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
     if(info) {
       printf("DPOTRS returned %d\n", info);
     }
@@ -66,18 +83,190 @@ int sptMatrixSolveNormals(
   else {
     int * ipiv = (int*)malloc(rank * sizeof(int));  
 
-    /* restore gram matrix */
-    sptMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+    /* restore gram matrix from the untouched triangle */
+    for(int r=0; r < rank; ++r) {
+      neqs[r * stride + r] = diag[r];
+      for(int c=0; c < r; ++c) {
+        neqs[c * stride + r] = neqs[r * stride + c];
+      }
+    }
 
-    sgesv_(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
+    spt_gesv_(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
     // lapackf77_sgesv(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
     // magma_sgesv(rank, nrhs, neqs, stride, ipiv, rhs->values, stride, &info);
     if(info) {
-      printf("sgesv_ returned %d\n", info);
+      printf("gesv returned %d\n", info);
     }
 
     free(ipiv);
   }
 
+  free(diag);
   return 0;
 }
+
+
+/* Rows solved together: a block and its transpose stay in cache through all rank substitution steps */
+static sptIndex spt_SolveBlockRows(sptIndex const stride)
+{
+  size_t const rows = PARTI_ROW_BLOCK_BYTES / ((size_t) stride * sizeof(sptValue));
+  return rows > 0 ? (sptIndex) rows : 1;
+}
+
+/*
+ * Solve x L L^T = b in place for a block of n rows of X, L given by rows.
+ * The block is transposed so each substitution step is an axpy over the
+ * n rows of one column, rather than a short dot product per row.
+ */
+static void spt_CholeskySolveBlock(
+  spt_SimdKernels const * const simd,
+  sptValue const * const lrows,
+  sptValue * const X,
+  sptValue * const T,
+  sptIndex const n,
+  sptIndex const rank,
+  sptIndex const stride)
+{
+  for(sptIndex i=0; i < n; ++i) {
+    for(sptIndex r=0; r < rank; ++r) {
+      T[(size_t) r * n + i] = X[(size_t) i * stride + r];
+    }
+  }
+  /* L y = b */
+  for(sptIndex r=0; r < rank; ++r) {
+    sptValue const * const l = lrows + (size_t) r * rank;
+    sptValue * const t = T + (size_t) r * n;
+    for(sptIndex s=0; s < r; ++s) {
+      simd->axpy(t, -l[s], T + (size_t) s * n, n);
+    }
+    sptValue const inv = 1 / l[r];
+    for(sptIndex i=0; i < n; ++i) {
+      t[i] *= inv;
+    }
+  }
+  /* L^T x = y */
+  for(sptIndex r=rank; r-- > 0; ) {
+    sptValue * const t = T + (size_t) r * n;
+    for(sptIndex s=r+1; s < rank; ++s) {
+      simd->axpy(t, -lrows[(size_t) s * rank + r], T + (size_t) s * n, n);
+    }
+    sptValue const inv = 1 / lrows[(size_t) r * rank + r];
+    for(sptIndex i=0; i < n; ++i) {
+      t[i] *= inv;
+    }
+  }
+  for(sptIndex i=0; i < n; ++i) {
+    for(sptIndex r=0; r < rank; ++r) {
+      X[(size_t) i * stride + r] = T[(size_t) r * n + i];
+    }
+  }
+}
+
+
+/**
+ * Solve the nrows rows of X against the full rank x rank normal equations
+ * neqs in place, with one Cholesky factorization and the substitutions on
+ * row blocks across tk threads, so a threaded BLAS is not needed. Falls back
+ * to a sequential gesv when neqs is not SPD. neqs is overwritten.
+ */
+int spt_OmpSolveFormedNormals(
+  sptValue * const neqs,
+  sptIndex const rank,
+  sptIndex const stride,
+  sptValue * const X,
+  sptIndex const nrows,
+  int const tk)
+{
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+  int info;
+  char uplo = 'L';
+
+  sptValue * const diag = malloc(rank * sizeof *diag);
+  spt_CheckOSError(!diag, "OMP Solve Normals");
+  for(sptIndex r=0; r < rank; ++r) {
+    diag[r] = neqs[(size_t) r * stride + r];
+  }
+  spt_potrf_(&uplo, &blas_rank, neqs, &blas_stride, &info);
+  if(info) {
+    printf("Gram matrix is not SPD. Trying `gesv`.\n");
+    for(sptIndex r=0; r < rank; ++r) {
+      neqs[(size_t) r * stride + r] = diag[r];
+      for(sptIndex c=0; c < r; ++c) {
+        neqs[(size_t) c * stride + r] = neqs[(size_t) r * stride + c];
+      }
+    }
+    free(diag);
+    int nrhs = (int) nrows;
+    int * ipiv = malloc(rank * sizeof *ipiv);
+    spt_CheckOSError(!ipiv, "OMP Solve Normals");
+    spt_gesv_(&blas_rank, &nrhs, neqs, &blas_stride, ipiv, X, &blas_stride, &info);
+    if(info) {
+      printf("gesv returned %d\n", info);
+    }
+    free(ipiv);
+    return 0;
+  }
+  free(diag);
+
+  /* The Cholesky factor L of column-major neqs, copied so its rows are contiguous */
+  spt_SimdKernels const * const simd = spt_Simd();
+  sptIndex const block = spt_SolveBlockRows(stride);
+  int const nparts = tk > 0 ? tk : 1;
+  sptValue * const lrows = malloc((size_t) rank * rank * sizeof *lrows);
+  sptValue * const scratch = malloc((size_t) nparts * rank * block * sizeof *scratch);
+  spt_CheckOSError(!lrows || !scratch, "OMP Solve Normals");
+  for(sptIndex r=0; r < rank; ++r) {
+    for(sptIndex s=0; s <= r; ++s) {
+      lrows[(size_t) r * rank + s] = neqs[(size_t) s * stride + r];
+    }
+  }
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel num_threads(nparts)
+#endif
+  {
+#ifdef PARTI_USE_OPENMP
+    sptValue * const T = scratch + (size_t) omp_get_thread_num() * rank * block;
+    #pragma omp for schedule(static)
+#else
+    sptValue * const T = scratch;
+#endif
+    for(sptIndex begin=0; begin < nrows; begin += block) {
+      sptIndex const n = nrows - begin < block ? nrows - begin : block;
+      spt_CholeskySolveBlock(simd, lrows, X + (size_t) begin * stride, T, n, rank, stride);
+    }
+  }
+
+  free(scratch);
+  free(lrows);
+  return 0;
+}
+
+
+/**
+ * sptMatrixSolveNormals with the substitutions on row blocks across tk threads
+ */
+int sptOmpMatrixSolveNormals(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs,
+  int const tk)
+{
+  sptMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+  return sptOmpMatrixSolveFormedNormals(nmodes, aTa, rhs, tk);
+}
+
+
+/**
+ * sptMatrixSolveFormedNormals with the substitutions on row blocks across tk threads
+ */
+int sptOmpMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptMatrix ** aTa,
+  sptMatrix * rhs,
+  int const tk)
+{
+  return spt_OmpSolveFormedNormals(aTa[nmodes]->values, aTa[0]->ncols, aTa[0]->stride, rhs->values, rhs->nrows, tk);
+}
@@ -0,0 +1,116 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdint.h>
+#include "../error/error.h"
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
+/*
+ * Factor matrices too large for memory live in a shared mapping of a file.
+ * Rows are paged in when touched; a kernel that sweeps the rows block by
+ * block prefetches the next block and evicts the finished one, so only a few
+ * blocks stay resident however tall the matrix is.
+ */
+
+/**
+ * Initialize a dense matrix whose values live in a file instead of memory,
+ * for modes with hundreds of millions of rows.
+ *
+ * The values start zeroed. With a path, the file is created or truncated and
+ * keeps the values after sptFreeMatrix; with NULL, an unnamed temporary file
+ * backs them. Every matrix operation works on it, paging rows in as touched;
+ * see sptMatrixPrefetchRows and sptMatrixEvictRows to bound what stays
+ * resident, and sptOmpMTTKRPOutOfCore for a kernel that does so.
+ *
+ * @param mtx   a valid pointer to an uninitialized sptMatrix variable
+ * @param nrows the number of rows
+ * @param ncols the number of columns
+ * @param path  the backing file, or NULL
+ */
+int sptNewMatrixOutOfCore(sptMatrix *mtx, sptIndex const nrows, sptIndex const ncols, char const *path) {
+    mtx->nrows = nrows;
+    mtx->ncols = ncols;
+    mtx->cap = nrows != 0 ? nrows : 1;
+    mtx->stride = ((ncols-1)/8+1)*8;
+    mtx->values = spt_MallocFileBacked((size_t) mtx->cap * mtx->stride * sizeof (sptValue), path);
+    spt_CheckOSError(!mtx->values, "Mtx OutOfCore");
+    return 0;
+}
+
+#ifdef __linux__
+/* The whole pages covering rows [begin, end), or inside them when inner is set; 0 if there are none */
+static size_t spt_RowPages(sptMatrix const *mtx, sptIndex begin, sptIndex end, int const inner, char ** start) {
+    if(end > mtx->nrows) end = mtx->nrows;
+    if(begin >= end) {
+        return 0;
+    }
+    uintptr_t const page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t) (mtx->values + (size_t) begin * mtx->stride);
+    uintptr_t hi = (uintptr_t) (mtx->values + (size_t) end * mtx->stride);
+    if(inner) {
+        lo = (lo + page - 1) / page * page;
+        hi = hi / page * page;
+    } else {
+        lo = lo / page * page;
+        hi = (hi + page - 1) / page * page;
+    }
+    *start = (char *) lo;
+    return hi > lo ? hi - lo : 0;
+}
+#endif
+
+/**
+ * Start reading rows [begin, end) of an out-of-core matrix into memory ahead
+ * of use. Matrices in memory are left alone.
+ */
+int sptMatrixPrefetchRows(sptMatrix *mtx, sptIndex const begin, sptIndex const end) {
+#if defined(__linux__) && defined(MADV_WILLNEED)
+    char * start;
+    size_t len;
+    if(sptMemBackingOf(mtx->values) == SPT_MEM_FILE && (len = spt_RowPages(mtx, begin, end, 0, &start)) != 0) {
+        spt_CheckOSError(madvise(start, len, MADV_WILLNEED) != 0, "Mtx Prefetch");
+    }
+#else
+    (void) mtx; (void) begin; (void) end;
+#endif
+    return 0;
+}
+
+/**
+ * Write rows [begin, end) of an out-of-core matrix back to its file and drop
+ * them from memory; they are read back when touched again. Only pages lying
+ * wholly inside the rows are dropped, so neighbouring rows in use are safe.
+ * Matrices in memory are left alone.
+ */
+int sptMatrixEvictRows(sptMatrix *mtx, sptIndex const begin, sptIndex const end) {
+#ifdef __linux__
+    char * start;
+    size_t len;
+    if(sptMemBackingOf(mtx->values) == SPT_MEM_FILE && (len = spt_RowPages(mtx, begin, end, 1, &start)) != 0) {
+        spt_CheckOSError(msync(start, len, MS_SYNC) != 0, "Mtx Evict");
+        spt_CheckOSError(madvise(start, len, MADV_DONTNEED) != 0, "Mtx Evict");
+    }
+#else
+    (void) mtx; (void) begin; (void) end;
+#endif
+    return 0;
+}
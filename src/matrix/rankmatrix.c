@@ -23,6 +23,7 @@
 #include <time.h>
 #include <math.h>
 #include "../error/error.h"
+#include "simd.h"
 
 
 /**
@@ -33,26 +34,23 @@
  * @param ncols the number of columns
  *
  * The memory layout of this dense matrix is a flat 2D array, with `ncols`
- * rounded up to multiples of 8
+ * rounded up to multiples of 8. The values get the backing
+ * sptSetDataPlacement sets for matrices, else go to high-bandwidth memory
+ * while sptSetHbmPlacement leaves room.
  */
 int sptNewRankMatrix(sptRankMatrix *mtx, sptIndex const nrows, sptElementIndex const ncols) {
     mtx->nrows = nrows;
     mtx->ncols = ncols;
     mtx->cap = nrows != 0 ? nrows : 1;
     mtx->stride = ((ncols-1)/8+1)*8;
-#ifdef _ISOC11_SOURCE
-    mtx->values = aligned_alloc(8 * sizeof (sptValue), mtx->cap * mtx->stride * sizeof (sptValue));
-#elif _POSIX_C_SOURCE >= 200112L
-    {
-        int result = posix_memalign((void **) &mtx->values, 8 * sizeof (sptValue), mtx->cap * mtx->stride * sizeof (sptValue));
-        if(result != 0) {
-            mtx->values = NULL;
-        }
-    }
-#else
-    mtx->values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
-#endif
+    size_t const bytes = mtx->cap * mtx->stride * sizeof (sptValue);
+    sptMemBacking const placed = sptDataPlacement(SPT_DATA_MATRICES);
+    mtx->values = sptMallocBacked(bytes, placed != SPT_MEM_DEFAULT ? placed : spt_HbmBacking(bytes, 0));
     spt_CheckOSError(!mtx->values, "RankMtx New");
+    if(sptMemBackingOf(mtx->values) != SPT_MEM_HBM) {
+        sptNumaInterleave(mtx->values, bytes);
+    }
+    sptFirstTouchZero(mtx->values, bytes);
     return 0;
 }
 
@@ -64,15 +62,17 @@ int sptNewRankMatrix(sptRankMatrix *mtx, sptIndex const nrows, sptElementIndex c
  * @param nrows fill the specified number of rows
  * @param ncols fill the specified number of columns
  *
- * The matrix is filled with uniform distributed pseudorandom number in [0, 1]
- * The random number will have a precision of 31 bits out of 51 bits
+ * The matrix is filled with values uniform in [-3, 3], see sptRandomValue, from
+ * the library random stream: the same for a seed given to sptSetRandomSeed
+ * whatever the thread count, each entry drawn on its own so rows fill in parallel.
  */
 int sptRandomizeRankMatrix(sptRankMatrix *mtx, sptIndex const nrows, sptElementIndex const ncols) 
 {
-  srand(time(NULL));
+  uint64_t const base = spt_RandomReserve((uint64_t) nrows * ncols);
+  #pragma omp parallel for schedule(static) num_threads(sptExecThreads(0))
   for(sptIndex i=0; i<nrows; ++i)
     for(sptElementIndex j=0; j<ncols; ++j) {
-      mtx->values[i * mtx->stride + j] = sptRandomValue();
+      mtx->values[(size_t) i * mtx->stride + j] = spt_RandomValueOf(spt_RandomBits(base + (uint64_t) i * ncols + j));
     }
   return 0;
 }
@@ -102,7 +102,7 @@ int sptConstantRankMatrix(sptRankMatrix *mtx, sptValue const val) {
 void sptRankMatrixInverseShuffleIndices(sptRankMatrix *mtx, sptIndex * mode_map_inds) {
     /* Renumber matrix rows */
     sptIndex new_i;
-    sptValue * tmp_values = malloc(mtx->cap * mtx->stride * sizeof (sptValue));
+    sptValue * tmp_values = sptMallocBacked(mtx->cap * mtx->stride * sizeof (sptValue), spt_MemRequestOf(mtx->values));
 
     for(sptIndex i=0; i<mtx->nrows; ++i) {
         new_i = mode_map_inds[i];
@@ -111,7 +111,7 @@ void sptRankMatrixInverseShuffleIndices(sptRankMatrix *mtx, sptIndex * mode_map_
         }
     }
 
-    free(mtx->values);
+    sptFree(mtx->values);
     mtx->values = tmp_values;
 }
 
@@ -125,7 +125,7 @@ void sptRankMatrixInverseShuffleIndices(sptRankMatrix *mtx, sptIndex * mode_map_
  * should not be used anymore prior to another initialization
  */
 void sptFreeRankMatrix(sptRankMatrix *mtx) {
-    free(mtx->values);
+    sptFree(mtx->values);
     mtx->nrows = 0;
     mtx->ncols = 0;
     mtx->cap = 0;
@@ -136,6 +136,7 @@ void sptFreeRankMatrix(sptRankMatrix *mtx) {
 /* mats (aTa) only stores upper triangle elements. */
 int sptRankMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, sptRankMatrix ** mats)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = mats[0]->nrows;
     sptElementIndex const ncols = mats[0]->ncols;
     sptElementIndex const stride = mats[0]->stride;
@@ -162,8 +163,8 @@ int sptRankMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, s
     #pragma omp parallel for schedule(static)
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptElementIndex j=i; j < ncols; ++j) {
-                ovals[i * stride + j] *= vals[i * stride + j];
+            if(i < ncols) {
+                simd->mul(ovals + i * stride + i, vals + i * stride + i, ncols - i);
             }
         }
     }
@@ -185,6 +186,7 @@ int sptRankMatrixDotMulSeqTriangle(sptIndex const mode, sptIndex const nmodes, s
 // Row-major
 int sptRankMatrix2Norm(sptRankMatrix * const A, sptValue * const lambda)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = A->nrows;
     sptElementIndex const ncols = A->ncols;
     sptElementIndex const stride = A->stride;
@@ -221,9 +223,7 @@ int sptRankMatrix2Norm(sptRankMatrix * const A, sptValue * const lambda)
 
         #pragma omp for
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptElementIndex j=0; j < ncols; ++j) {
-                loc_lambda[j] += vals[i*stride + j] * vals[i*stride + j];
-            }
+            simd->sqacc(loc_lambda, vals + i*stride, ncols);
         }
 
         #pragma omp for schedule(static)
@@ -237,9 +237,7 @@ int sptRankMatrix2Norm(sptRankMatrix * const A, sptValue * const lambda)
 #else
 
     for(sptIndex i=0; i < nrows; ++i) {
-        for(sptElementIndex j=0; j < ncols; ++j) {
-            lambda[j] += vals[i*stride + j] * vals[i*stride + j];
-        }
+        simd->sqacc(lambda, vals + i*stride, ncols);
     }
 
 #endif
@@ -255,9 +253,7 @@ int sptRankMatrix2Norm(sptRankMatrix * const A, sptValue * const lambda)
         #pragma omp parallel for
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptElementIndex j=0; j < ncols; ++j) {
-                vals[i*stride + j] /= lambda[j];
-            }
+            simd->div(vals + i*stride, lambda, ncols);
         }
 
     
@@ -272,6 +268,7 @@ int sptRankMatrix2Norm(sptRankMatrix * const A, sptValue * const lambda)
 // Row-major
 int sptRankMatrixMaxNorm(sptRankMatrix * const A, sptValue * const lambda)
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nrows = A->nrows;
     sptElementIndex const ncols = A->ncols;
     sptElementIndex const stride = A->stride;
@@ -308,10 +305,7 @@ int sptRankMatrixMaxNorm(sptRankMatrix * const A, sptValue * const lambda)
 
         #pragma omp for
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptElementIndex j=0; j < ncols; ++j) {
-                if(vals[i*stride + j] > loc_lambda[j])
-                    loc_lambda[j] = vals[i*stride + j];
-            }
+            simd->maxacc(loc_lambda, vals + i*stride, ncols);
         }
 
         #pragma omp for schedule(static)
@@ -325,10 +319,7 @@ int sptRankMatrixMaxNorm(sptRankMatrix * const A, sptValue * const lambda)
 
 #else
     for(sptIndex i=0; i < nrows; ++i) {
-        for(sptElementIndex j=0; j < ncols; ++j) {
-            if(vals[i*stride + j] > lambda[j])
-                lambda[j] = vals[i*stride + j];
-        }
+        simd->maxacc(lambda, vals + i*stride, ncols);
     }
 #endif
 
@@ -344,9 +335,7 @@ int sptRankMatrixMaxNorm(sptRankMatrix * const A, sptValue * const lambda)
         #pragma omp parallel for
 #endif
         for(sptIndex i=0; i < nrows; ++i) {
-            for(sptElementIndex j=0; j < ncols; ++j) {
-                vals[i*stride + j] /= lambda[j];
-            }
+            simd->div(vals + i*stride, lambda, ncols);
         }
 
 #ifdef PARTI_USE_OPENMP
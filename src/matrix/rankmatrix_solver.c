@@ -23,32 +23,48 @@
 #include <time.h>
 #include <math.h>
 #include "../error/error.h"
-#ifdef PARTI_USE_MAGMA
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
+#include "lapack.h"
 
 int sptRankMatrixSolveNormals(
   sptIndex const mode,
   sptIndex const nmodes,
   sptRankMatrix ** aTa,
   sptRankMatrix * rhs)
+{
+  sptRankMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+  return sptRankMatrixSolveFormedNormals(nmodes, aTa, rhs);
+}
+
+
+/**
+ * sptRankMatrixSolveNormals with aTa[nmodes] already holding the Hadamard product of
+ * the other modes' Gram matrices in full, e.g. from sptGramHadamardForm.
+ * aTa[nmodes] is overwritten.
+ */
+int sptRankMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs)
 {
   int rank = (int)(aTa[0]->ncols);
   int stride = (int)(aTa[0]->stride);
 
-  sptRankMatrixDotMulSeqTriangle(mode, nmodes, aTa);
-
   int info;
   char uplo = 'L';
   int nrhs = (int) rhs->nrows;
   sptValue * const neqs = aTa[nmodes]->values;
 
+  /* potrf only writes the diagonal and one triangle; keep the diagonal to undo it */
+  sptValue * const diag = (sptValue *)malloc(rank * sizeof(sptValue));
+  spt_CheckOSError(!diag, "Solve Normals");
+  for(int r=0; r < rank; ++r) {
+    diag[r] = neqs[r * stride + r];
+  }
+
   /* Cholesky factorization */
   bool is_spd = true;
   // lapackf77_spotrf(&uplo, &rank, neqs, &stride, &info);
-  spotrf_(&uplo, &rank, neqs, &stride, &info);
+  spt_potrf_(&uplo, &rank, neqs, &stride, &info);
   if(info) {
     printf("Gram matrix is not SPD. Trying `gesv`.\n");
     is_spd = false;
@@ -58,7 +74,7 @@ int sptRankMatrixSolveNormals(
   if(is_spd) {
     /* Solve against rhs */
     // lapackf77_spotrs(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
-    spotrs_(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
+    spt_potrs_(&uplo, &rank, &nrhs, neqs, &stride, rhs->values, &stride, &info);
     if(info) {
       printf("DPOTRS returned %d\n", info);
     }
@@ -66,10 +82,15 @@ int sptRankMatrixSolveNormals(
   else {
     int * ipiv = (int*)malloc(rank * sizeof(int));  
 
-    /* restore gram matrix */
-    sptRankMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+    /* restore gram matrix from the untouched triangle */
+    for(int r=0; r < rank; ++r) {
+      neqs[r * stride + r] = diag[r];
+      for(int c=0; c < r; ++c) {
+        neqs[c * stride + r] = neqs[r * stride + c];
+      }
+    }
 
-    sgesv_(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
+    spt_gesv_(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
     // lapackf77_sgesv(&rank, &nrhs, neqs, &stride, ipiv, rhs->values, &stride, &info);
     // magma_sgesv(rank, nrhs, neqs, stride, ipiv, rhs->values, stride, &info);
     if(info) {
@@ -79,5 +100,34 @@ int sptRankMatrixSolveNormals(
     free(ipiv);
   }
 
+  free(diag);
   return 0;
 }
+
+
+/**
+ * sptRankMatrixSolveNormals with the substitutions on row blocks across tk threads
+ */
+int sptOmpRankMatrixSolveNormals(
+  sptIndex const mode,
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs,
+  int const tk)
+{
+  sptRankMatrixDotMulSeqTriangle(mode, nmodes, aTa);
+  return sptOmpRankMatrixSolveFormedNormals(nmodes, aTa, rhs, tk);
+}
+
+
+/**
+ * sptRankMatrixSolveFormedNormals with the substitutions on row blocks across tk threads
+ */
+int sptOmpRankMatrixSolveFormedNormals(
+  sptIndex const nmodes,
+  sptRankMatrix ** aTa,
+  sptRankMatrix * rhs,
+  int const tk)
+{
+  return spt_OmpSolveFormedNormals(aTa[nmodes]->values, aTa[0]->ncols, aTa[0]->stride, rhs->values, rhs->nrows, tk);
+}
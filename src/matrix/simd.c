@@ -0,0 +1,447 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "simd.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPT_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SPT_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+
+/**** Plain C ****/
+
+static void spt_SimdMul_generic(sptValue * restrict y, sptValue const * restrict x, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] *= x[i];
+    }
+}
+
+static void spt_SimdScale_generic(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] = a * x[i];
+    }
+}
+
+static void spt_SimdSqAcc_generic(sptValue * restrict y, sptValue const * restrict x, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] += x[i] * x[i];
+    }
+}
+
+static void spt_SimdMaxAcc_generic(sptValue * restrict y, sptValue const * restrict x, sptIndex const n) {
+    for(sptIndex i = 0; i < n; ++i) {
+        if(x[i] > y[i])
+            y[i] = x[i];
+    }
+}
+
+static void spt_SimdDiv_generic(sptValue * restrict y, sptValue const * restrict d, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] /= d[i];
+    }
+}
+
+static void spt_SimdAxpy_generic(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+static void spt_SimdHadamard_generic(sptValue * restrict y, sptValue const * restrict a, sptValue const * restrict b, sptIndex const n) {
+    #pragma omp simd
+    for(sptIndex i = 0; i < n; ++i) {
+        y[i] = a[i] * b[i];
+    }
+}
+
+static void spt_SimdScatterAdd_generic(sptValue * y, sptIndex const stride, sptIndex const * restrict idx, sptValue const * restrict x, sptIndex const n) {
+    for(sptIndex k = 0; k < n; ++k) {
+        y[(sptNnzIndex) idx[k] * stride] += x[k];
+    }
+}
+
+static void spt_SimdGatherMul_generic(sptValue * restrict y, sptValue const * restrict v, sptIndex const stride, sptIndex const * restrict idx, sptIndex const n) {
+    for(sptIndex k = 0; k < n; ++k) {
+        y[k] *= v[(sptNnzIndex) idx[k] * stride];
+    }
+}
+
+static sptValue spt_SimdGatherDot_generic(sptValue const * restrict x, sptValue const * restrict v, sptIndex const * restrict idx, sptIndex const n) {
+    sptValue sum = 0;
+    for(sptIndex k = 0; k < n; ++k) {
+        sum += x[k] * v[idx[k]];
+    }
+    return sum;
+}
+
+static spt_SimdKernels const spt_SimdKernels_generic = {
+    "generic",
+    spt_SimdMul_generic,
+    spt_SimdScale_generic,
+    spt_SimdSqAcc_generic,
+    spt_SimdMaxAcc_generic,
+    spt_SimdDiv_generic,
+    spt_SimdAxpy_generic,
+    spt_SimdHadamard_generic,
+    0,
+    spt_SimdScatterAdd_generic,
+    spt_SimdGatherMul_generic,
+    spt_SimdGatherDot_generic
+};
+
+
+#ifdef SPT_SIMD_X86
+
+/**** AVX-512F, masked tails ****/
+
+/*
+ * The indexed kernels. Offsets idx[k] * stride are formed in 64 bits, so
+ * factors past 2^32 values are fine. A scatter-add first folds the lanes
+ * that repeat an index: AVX-512CD gives each lane the nearest earlier lane
+ * with its index, and pointer jumping along those chains leaves every lane
+ * with the sum of itself and its earlier repeats. The last repeat, whose
+ * store lands last in the scatter, then carries the total.
+ */
+#define SPT_SIMD_INDEXED_TARGET __attribute__((target("avx512f,avx512cd")))
+#if PARTI_INDEX_TYPEWIDTH == 64
+/* Eight 64-bit indices fill a vector; their offsets need the full 64-bit product */
+  #define SPT_VIDX8(p) _mm512_loadu_si512(p)
+  #define SPT_VIDXOFF(vi, vs) _mm512_add_epi64(_mm512_mul_epu32(vi, vs), \
+      _mm512_slli_epi64(_mm512_add_epi64(_mm512_mul_epu32(_mm512_srli_epi64(vi, 32), vs), \
+          _mm512_mul_epu32(vi, _mm512_srli_epi64(vs, 32))), 32))
+#else
+  #define SPT_VIDX8(p) _mm512_cvtepu32_epi64(_mm256_loadu_si256((__m256i const *) (p)))
+  #define SPT_VIDXOFF(vi, vs) _mm512_mul_epu32(vi, vs)
+#endif
+#if PARTI_VALUE_TYPEWIDTH == 32 && PARTI_INDEX_TYPEWIDTH == 32
+
+/* 16 nonzeros per vector, vpconflictd; gathers and scatters go in two halves of 8 */
+static SPT_SIMD_INDEXED_TARGET void spt_SimdScatterAddavx512(sptValue * y, sptIndex const stride, sptIndex const * restrict idx, sptValue const * restrict x, sptIndex const n)
+{
+    __m512i const vstride = _mm512_set1_epi64(stride);
+    __m512i const none = _mm512_set1_epi32(-1);
+    __m512i const top = _mm512_set1_epi32(31);
+    sptIndex k = 0;
+    for(; k + 16 <= n; k += 16) {
+        __m512i const vi = _mm512_loadu_si512(idx + k);
+        __m512 acc = _mm512_loadu_ps(x + k);
+        __m512i const cd = _mm512_conflict_epi32(vi);
+        __mmask16 todo = _mm512_test_epi32_mask(cd, cd);
+        if(todo) {
+            __m512i prev = _mm512_sub_epi32(top, _mm512_lzcnt_epi32(cd));
+            do {
+                acc = _mm512_mask_add_ps(acc, todo, acc, _mm512_permutexvar_ps(prev, acc));
+                prev = _mm512_mask_permutexvar_epi32(prev, todo, prev, prev);
+                todo = _mm512_mask_cmpneq_epi32_mask(todo, prev, none);
+            } while(todo);
+        }
+        __m512i const off_lo = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(vi)), vstride);
+        __m512i const off_hi = _mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(vi, 1)), vstride);
+        /* Both halves are gathered before either is scattered, so a repeat across them is counted once */
+        __m256 const old_lo = _mm512_i64gather_ps(off_lo, y, 4);
+        __m256 const old_hi = _mm512_i64gather_ps(off_hi, y, 4);
+        _mm512_i64scatter_ps(y, off_lo, _mm256_add_ps(old_lo, _mm512_castps512_ps256(acc)), 4);
+        _mm512_i64scatter_ps(y, off_hi, _mm256_add_ps(old_hi, _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1))), 4);
+    }
+    for(; k < n; ++k) {
+        y[(sptNnzIndex) idx[k] * stride] += x[k];
+    }
+}
+
+static SPT_SIMD_INDEXED_TARGET void spt_SimdGatherMulavx512(sptValue * restrict y, sptValue const * restrict v, sptIndex const stride, sptIndex const * restrict idx, sptIndex const n)
+{
+    __m512i const vstride = _mm512_set1_epi64(stride);
+    sptIndex k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m512i const off = SPT_VIDXOFF(SPT_VIDX8(idx + k), vstride);
+        _mm256_storeu_ps(y + k, _mm256_mul_ps(_mm256_loadu_ps(y + k), _mm512_i64gather_ps(off, v, 4)));
+    }
+    for(; k < n; ++k) {
+        y[k] *= v[(sptNnzIndex) idx[k] * stride];
+    }
+}
+
+static SPT_SIMD_INDEXED_TARGET sptValue spt_SimdGatherDotavx512(sptValue const * restrict x, sptValue const * restrict v, sptIndex const * restrict idx, sptIndex const n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    sptIndex k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m512i const off = SPT_VIDX8(idx + k);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm512_i64gather_ps(off, v, 4)));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    sptValue sum = 0;
+    for(int l = 0; l < 8; ++l) {
+        sum += lanes[l];
+    }
+    for(; k < n; ++k) {
+        sum += x[k] * v[idx[k]];
+    }
+    return sum;
+}
+
+#define SPT_VINDEXED 16
+#elif PARTI_VALUE_TYPEWIDTH == 64
+
+/* 8 nonzeros per vector, vpconflictq on the (widened) indices */
+static SPT_SIMD_INDEXED_TARGET void spt_SimdScatterAddavx512(sptValue * y, sptIndex const stride, sptIndex const * restrict idx, sptValue const * restrict x, sptIndex const n)
+{
+    __m512i const vstride = _mm512_set1_epi64(stride);
+    __m512i const none = _mm512_set1_epi64(-1);
+    __m512i const top = _mm512_set1_epi64(63);
+    sptIndex k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m512i const vi = SPT_VIDX8(idx + k);
+        __m512d acc = _mm512_loadu_pd(x + k);
+        __m512i const cd = _mm512_conflict_epi64(vi);
+        __mmask8 todo = _mm512_test_epi64_mask(cd, cd);
+        if(todo) {
+            __m512i prev = _mm512_sub_epi64(top, _mm512_lzcnt_epi64(cd));
+            do {
+                acc = _mm512_mask_add_pd(acc, todo, acc, _mm512_permutexvar_pd(prev, acc));
+                prev = _mm512_mask_permutexvar_epi64(prev, todo, prev, prev);
+                todo = _mm512_mask_cmpneq_epi64_mask(todo, prev, none);
+            } while(todo);
+        }
+        __m512i const off = SPT_VIDXOFF(vi, vstride);
+        _mm512_i64scatter_pd(y, off, _mm512_add_pd(_mm512_i64gather_pd(off, y, 8), acc), 8);
+    }
+    for(; k < n; ++k) {
+        y[(sptNnzIndex) idx[k] * stride] += x[k];
+    }
+}
+
+static SPT_SIMD_INDEXED_TARGET void spt_SimdGatherMulavx512(sptValue * restrict y, sptValue const * restrict v, sptIndex const stride, sptIndex const * restrict idx, sptIndex const n)
+{
+    __m512i const vstride = _mm512_set1_epi64(stride);
+    sptIndex k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m512i const off = SPT_VIDXOFF(SPT_VIDX8(idx + k), vstride);
+        _mm512_storeu_pd(y + k, _mm512_mul_pd(_mm512_loadu_pd(y + k), _mm512_i64gather_pd(off, v, 8)));
+    }
+    for(; k < n; ++k) {
+        y[k] *= v[(sptNnzIndex) idx[k] * stride];
+    }
+}
+
+static SPT_SIMD_INDEXED_TARGET sptValue spt_SimdGatherDotavx512(sptValue const * restrict x, sptValue const * restrict v, sptIndex const * restrict idx, sptIndex const n)
+{
+    __m512d acc = _mm512_setzero_pd();
+    sptIndex k = 0;
+    for(; k + 8 <= n; k += 8) {
+        __m512i const off = SPT_VIDX8(idx + k);
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(x + k), _mm512_i64gather_pd(off, v, 8), acc);
+    }
+    sptValue sum = _mm512_reduce_add_pd(acc);
+    for(; k < n; ++k) {
+        sum += x[k] * v[idx[k]];
+    }
+    return sum;
+}
+
+#define SPT_VINDEXED 8
+#endif
+/* Float values with 64-bit indices keep the plain C indexed kernels */
+#undef SPT_VIDX8
+#undef SPT_VIDXOFF
+#undef SPT_SIMD_INDEXED_TARGET
+
+#define SPT_SIMD(name) name##avx512
+#define SPT_SIMD_NAME "avx512"
+#define SPT_SIMD_TARGET __attribute__((target("avx512f")))
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define SPT_VEC __m512
+  #define SPT_VLANES 16
+  #define SPT_VMASK_T __mmask16
+  #define SPT_VMASK(r) ((__mmask16) ((1u << (r)) - 1))
+  #define SPT_VLOAD(p) _mm512_loadu_ps(p)
+  #define SPT_VSTORE(p, v) _mm512_storeu_ps(p, v)
+  #define SPT_VMLOAD(m, p) _mm512_maskz_loadu_ps(m, p)
+  #define SPT_VMLOADOR(s, m, p) _mm512_mask_loadu_ps(s, m, p)
+  #define SPT_VMSTORE(p, m, v) _mm512_mask_storeu_ps(p, m, v)
+  #define SPT_VSET1(a) _mm512_set1_ps(a)
+  #define SPT_VMUL(a, b) _mm512_mul_ps(a, b)
+  #define SPT_VFMA(a, b, c) _mm512_fmadd_ps(a, b, c)
+  #define SPT_VMAX(a, b) _mm512_max_ps(a, b)
+  #define SPT_VDIV(a, b) _mm512_div_ps(a, b)
+#else
+  #define SPT_VEC __m512d
+  #define SPT_VLANES 8
+  #define SPT_VMASK_T __mmask8
+  #define SPT_VMASK(r) ((__mmask8) ((1u << (r)) - 1))
+  #define SPT_VLOAD(p) _mm512_loadu_pd(p)
+  #define SPT_VSTORE(p, v) _mm512_storeu_pd(p, v)
+  #define SPT_VMLOAD(m, p) _mm512_maskz_loadu_pd(m, p)
+  #define SPT_VMLOADOR(s, m, p) _mm512_mask_loadu_pd(s, m, p)
+  #define SPT_VMSTORE(p, m, v) _mm512_mask_storeu_pd(p, m, v)
+  #define SPT_VSET1(a) _mm512_set1_pd(a)
+  #define SPT_VMUL(a, b) _mm512_mul_pd(a, b)
+  #define SPT_VFMA(a, b, c) _mm512_fmadd_pd(a, b, c)
+  #define SPT_VMAX(a, b) _mm512_max_pd(a, b)
+  #define SPT_VDIV(a, b) _mm512_div_pd(a, b)
+#endif
+#include "simd_impl.h"
+#undef SPT_VINDEXED
+#undef SPT_SIMD
+#undef SPT_SIMD_NAME
+#undef SPT_SIMD_TARGET
+#undef SPT_VEC
+#undef SPT_VLANES
+#undef SPT_VMASK_T
+#undef SPT_VMASK
+#undef SPT_VLOAD
+#undef SPT_VSTORE
+#undef SPT_VMLOAD
+#undef SPT_VMLOADOR
+#undef SPT_VMSTORE
+#undef SPT_VSET1
+#undef SPT_VMUL
+#undef SPT_VFMA
+#undef SPT_VMAX
+#undef SPT_VDIV
+
+
+/**** AVX2 + FMA, scalar tails ****/
+
+#define SPT_SIMD(name) name##avx2
+#define SPT_SIMD_NAME "avx2"
+#define SPT_SIMD_TARGET __attribute__((target("avx2,fma")))
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define SPT_VEC __m256
+  #define SPT_VLANES 8
+  #define SPT_VLOAD(p) _mm256_loadu_ps(p)
+  #define SPT_VSTORE(p, v) _mm256_storeu_ps(p, v)
+  #define SPT_VSET1(a) _mm256_set1_ps(a)
+  #define SPT_VMUL(a, b) _mm256_mul_ps(a, b)
+  #define SPT_VFMA(a, b, c) _mm256_fmadd_ps(a, b, c)
+  #define SPT_VMAX(a, b) _mm256_max_ps(a, b)
+  #define SPT_VDIV(a, b) _mm256_div_ps(a, b)
+#else
+  #define SPT_VEC __m256d
+  #define SPT_VLANES 4
+  #define SPT_VLOAD(p) _mm256_loadu_pd(p)
+  #define SPT_VSTORE(p, v) _mm256_storeu_pd(p, v)
+  #define SPT_VSET1(a) _mm256_set1_pd(a)
+  #define SPT_VMUL(a, b) _mm256_mul_pd(a, b)
+  #define SPT_VFMA(a, b, c) _mm256_fmadd_pd(a, b, c)
+  #define SPT_VMAX(a, b) _mm256_max_pd(a, b)
+  #define SPT_VDIV(a, b) _mm256_div_pd(a, b)
+#endif
+#include "simd_impl.h"
+#undef SPT_SIMD
+#undef SPT_SIMD_NAME
+#undef SPT_SIMD_TARGET
+#undef SPT_VEC
+#undef SPT_VLANES
+#undef SPT_VLOAD
+#undef SPT_VSTORE
+#undef SPT_VSET1
+#undef SPT_VMUL
+#undef SPT_VFMA
+#undef SPT_VMAX
+#undef SPT_VDIV
+
+#endif  // SPT_SIMD_X86
+
+
+#ifdef SPT_SIMD_NEON
+
+/**** NEON (always present on AArch64), scalar tails ****/
+
+#define SPT_SIMD(name) name##neon
+#define SPT_SIMD_NAME "neon"
+#define SPT_SIMD_TARGET
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define SPT_VEC float32x4_t
+  #define SPT_VLANES 4
+  #define SPT_VLOAD(p) vld1q_f32(p)
+  #define SPT_VSTORE(p, v) vst1q_f32(p, v)
+  #define SPT_VSET1(a) vdupq_n_f32(a)
+  #define SPT_VMUL(a, b) vmulq_f32(a, b)
+  #define SPT_VFMA(a, b, c) vfmaq_f32(c, a, b)
+  #define SPT_VMAX(a, b) vmaxq_f32(a, b)
+  #define SPT_VDIV(a, b) vdivq_f32(a, b)
+#else
+  #define SPT_VEC float64x2_t
+  #define SPT_VLANES 2
+  #define SPT_VLOAD(p) vld1q_f64(p)
+  #define SPT_VSTORE(p, v) vst1q_f64(p, v)
+  #define SPT_VSET1(a) vdupq_n_f64(a)
+  #define SPT_VMUL(a, b) vmulq_f64(a, b)
+  #define SPT_VFMA(a, b, c) vfmaq_f64(c, a, b)
+  #define SPT_VMAX(a, b) vmaxq_f64(a, b)
+  #define SPT_VDIV(a, b) vdivq_f64(a, b)
+#endif
+#include "simd_impl.h"
+
+#endif  // SPT_SIMD_NEON
+
+
+static spt_SimdKernels const * spt_SimdSelected = NULL;
+static pthread_once_t spt_SimdOnce = PTHREAD_ONCE_INIT;
+
+static void spt_SimdSelect(void) {
+    /* Candidates from the widest down, NULL-terminated */
+    spt_SimdKernels const * candidates[5];
+    int ncandidates = 0;
+#if defined(SPT_SIMD_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd")) {
+        candidates[ncandidates++] = &spt_SimdKernels_avx512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        candidates[ncandidates++] = &spt_SimdKernels_avx2;
+    }
+#elif defined(SPT_SIMD_NEON)
+    candidates[ncandidates++] = &spt_SimdKernels_neon;
+#endif
+    candidates[ncandidates++] = &spt_SimdKernels_generic;
+    candidates[ncandidates] = NULL;
+
+    spt_SimdSelected = candidates[0];
+    char const * const env_PARTI_SIMD = getenv("PARTI_SIMD");
+    if(env_PARTI_SIMD) {
+        for(int i = 0; candidates[i] != NULL; ++i) {
+            if(!strcmp(env_PARTI_SIMD, candidates[i]->name)) {
+                spt_SimdSelected = candidates[i];
+            }
+        }
+    }
+}
+
+/**
+ * The vector kernels for this CPU, selected on the first call.
+ */
+spt_SimdKernels const * spt_Simd(void) {
+    pthread_once(&spt_SimdOnce, spt_SimdSelect);
+    return spt_SimdSelected;
+}
@@ -0,0 +1,72 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_SIMD_H
+#define PARTI_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ParTI.h>
+
+/**
+ * Vector kernels over rows of sptValue, chosen once per process for the
+ * best instruction set the CPU supports: AVX-512F+CD, AVX2+FMA, NEON or plain C.
+ * PARTI_SIMD=generic|avx2|avx512|neon in the environment picks a narrower
+ * set, if the CPU supports it.
+ * Inputs and outputs must not overlap.
+ *
+ * The indexed kernels run across nonzeros rather than along a row, for
+ * ranks too small to fill a vector. Only AVX-512 vectorizes them, resolving
+ * repeated indices within a vector with its conflict detection; the other
+ * sets use plain C and report indexed_lanes = 0.
+ */
+typedef struct {
+    char const * name;
+    /* y[i] *= x[i] */
+    void (*mul)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n);
+    /* y[i] = a * x[i] */
+    void (*scale)(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n);
+    /* y[i] += x[i] * x[i] */
+    void (*sqacc)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n);
+    /* y[i] = max(y[i], x[i]) */
+    void (*maxacc)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n);
+    /* y[i] /= d[i] */
+    void (*div)(sptValue * restrict y, sptValue const * restrict d, sptIndex const n);
+    /* y[i] += a * x[i] */
+    void (*axpy)(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n);
+    /* y[i] = a[i] * b[i] */
+    void (*hadamard)(sptValue * restrict y, sptValue const * restrict a, sptValue const * restrict b, sptIndex const n);
+    /* Nonzeros per vector of the indexed kernels, 0 if they are scalar */
+    sptIndex indexed_lanes;
+    /* y[idx[k] * stride] += x[k], idx may repeat */
+    void (*scatter_add)(sptValue * y, sptIndex const stride, sptIndex const * restrict idx, sptValue const * restrict x, sptIndex const n);
+    /* y[k] *= v[idx[k] * stride] */
+    void (*gather_mul)(sptValue * restrict y, sptValue const * restrict v, sptIndex const stride, sptIndex const * restrict idx, sptIndex const n);
+    /* sum of x[k] * v[idx[k]] */
+    sptValue (*gather_dot)(sptValue const * restrict x, sptValue const * restrict v, sptIndex const * restrict idx, sptIndex const n);
+} spt_SimdKernels;
+
+spt_SimdKernels const * spt_Simd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
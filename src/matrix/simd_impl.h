@@ -0,0 +1,178 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* One set of spt_SimdKernels, included by simd.c once per instruction set
+ * with SPT_SIMD(name), SPT_SIMD_TARGET and the SPT_V* vector macros defined.
+ * If SPT_VMASK is defined the tails use masked loads and stores, otherwise
+ * they fall back to scalar code. If SPT_VINDEXED is defined it is the lane
+ * count of the indexed kernels SPT_SIMD(spt_SimdScatterAdd) etc., defined by
+ * simd.c beforehand; otherwise the plain C ones are used. */
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdMul)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n)
+{
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VMUL(SPT_VLOAD(y + i), SPT_VLOAD(x + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VMUL(SPT_VMLOAD(m, y + i), SPT_VMLOAD(m, x + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] *= x[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdScale)(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n)
+{
+    SPT_VEC const va = SPT_VSET1(a);
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VMUL(va, SPT_VLOAD(x + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VMUL(va, SPT_VMLOAD(m, x + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] = a * x[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdSqAcc)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n)
+{
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VEC const vx = SPT_VLOAD(x + i);
+        SPT_VSTORE(y + i, SPT_VFMA(vx, vx, SPT_VLOAD(y + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VEC const vx = SPT_VMLOAD(m, x + i);
+        SPT_VMSTORE(y + i, m, SPT_VFMA(vx, vx, SPT_VMLOAD(m, y + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] += x[i] * x[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdMaxAcc)(sptValue * restrict y, sptValue const * restrict x, sptIndex const n)
+{
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VMAX(SPT_VLOAD(y + i), SPT_VLOAD(x + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VMAX(SPT_VMLOAD(m, y + i), SPT_VMLOAD(m, x + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        if(x[i] > y[i])
+            y[i] = x[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdDiv)(sptValue * restrict y, sptValue const * restrict d, sptIndex const n)
+{
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VDIV(SPT_VLOAD(y + i), SPT_VLOAD(d + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        /* Masked-off divisor lanes read as 1 so no spurious division by zero is raised */
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VDIV(SPT_VMLOAD(m, y + i), SPT_VMLOADOR(SPT_VSET1(1), m, d + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] /= d[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdAxpy)(sptValue * restrict y, sptValue const a, sptValue const * restrict x, sptIndex const n)
+{
+    SPT_VEC const va = SPT_VSET1(a);
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VFMA(va, SPT_VLOAD(x + i), SPT_VLOAD(y + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VFMA(va, SPT_VMLOAD(m, x + i), SPT_VMLOAD(m, y + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+#endif
+}
+
+static SPT_SIMD_TARGET void SPT_SIMD(spt_SimdHadamard)(sptValue * restrict y, sptValue const * restrict a, sptValue const * restrict b, sptIndex const n)
+{
+    sptIndex i = 0;
+    for(; i + SPT_VLANES <= n; i += SPT_VLANES) {
+        SPT_VSTORE(y + i, SPT_VMUL(SPT_VLOAD(a + i), SPT_VLOAD(b + i)));
+    }
+#ifdef SPT_VMASK
+    if(i < n) {
+        SPT_VMASK_T const m = SPT_VMASK(n - i);
+        SPT_VMSTORE(y + i, m, SPT_VMUL(SPT_VMLOAD(m, a + i), SPT_VMLOAD(m, b + i)));
+    }
+#else
+    for(; i < n; ++i) {
+        y[i] = a[i] * b[i];
+    }
+#endif
+}
+
+static spt_SimdKernels const SPT_SIMD(spt_SimdKernels_) = {
+    SPT_SIMD_NAME,
+    SPT_SIMD(spt_SimdMul),
+    SPT_SIMD(spt_SimdScale),
+    SPT_SIMD(spt_SimdSqAcc),
+    SPT_SIMD(spt_SimdMaxAcc),
+    SPT_SIMD(spt_SimdDiv),
+    SPT_SIMD(spt_SimdAxpy),
+    SPT_SIMD(spt_SimdHadamard),
+#ifdef SPT_VINDEXED
+    SPT_VINDEXED,
+    SPT_SIMD(spt_SimdScatterAdd),
+    SPT_SIMD(spt_SimdGatherMul),
+    SPT_SIMD(spt_SimdGatherDot)
+#else
+    0,
+    spt_SimdScatterAdd_generic,
+    spt_SimdGatherMul_generic,
+    spt_SimdGatherDot_generic
+#endif
+};
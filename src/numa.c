@@ -0,0 +1,107 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef PARTI_USE_NUMA
+    #include <numa.h>
+#endif
+
+/**
+ * Zero a freshly allocated buffer so that its pages are first touched by the
+ * threads that will work on them.
+ *
+ * The buffer is split into equal contiguous parts, one per OpenMP thread, the
+ * same way `schedule(static)` splits a loop over its elements. Under Linux'
+ * first-touch policy each part then lives on the NUMA node of the thread that
+ * streams it later. Small buffers, and calls from inside a parallel region,
+ * are zeroed by the calling thread.
+ */
+void sptFirstTouchZero(void * ptr, size_t const bytes)
+{
+    if(bytes < PARTI_FIRST_TOUCH_MIN_BYTES) {
+        memset(ptr, 0, bytes);
+        return;
+    }
+#ifdef PARTI_USE_OPENMP
+    if(omp_in_parallel()) {
+        memset(ptr, 0, bytes);
+        return;
+    }
+    #pragma omp parallel
+    {
+        size_t const nthreads = (size_t) omp_get_num_threads();
+        size_t const tid = (size_t) omp_get_thread_num();
+        size_t const begin = bytes / nthreads * tid + (tid < bytes % nthreads ? tid : bytes % nthreads);
+        size_t const len = bytes / nthreads + (tid < bytes % nthreads ? 1 : 0);
+        memset((char *) ptr + begin, 0, len);
+    }
+#else
+    memset(ptr, 0, bytes);
+#endif
+}
+
+
+/**
+ * Spread the pages of a buffer round-robin over all NUMA nodes, or over the
+ * nodes of the cores the calling thread's execution context pins its team
+ * to.
+ *
+ * Meant for data every thread gathers from at random, such as factor
+ * matrices in MTTKRP, where no thread is a natural owner. Must be called
+ * before the buffer is first touched. Without libnuma it does nothing.
+ */
+void sptNumaInterleave(void * ptr, size_t const bytes)
+{
+#ifdef PARTI_USE_NUMA
+    if(bytes < PARTI_FIRST_TOUCH_MIN_BYTES || numa_available() < 0 || numa_num_configured_nodes() < 2) {
+        return;
+    }
+    /* The policy applies to whole pages inside the buffer */
+    uintptr_t const page = (uintptr_t) numa_pagesize();
+    uintptr_t const begin = ((uintptr_t) ptr + page - 1) / page * page;
+    uintptr_t const end = ((uintptr_t) ptr + bytes) / page * page;
+    if(end <= begin) {
+        return;
+    }
+    struct bitmask * nodes = numa_all_nodes_ptr;
+    sptExecContext const * const ctx = sptGetExecContext();
+    if(ctx != NULL && ctx->cores != NULL && ctx->ncores > 0) {
+        int const ncores = ctx->nthreads > 0 && ctx->nthreads < ctx->ncores ? ctx->nthreads : ctx->ncores;
+        nodes = numa_allocate_nodemask();
+        for(int i = 0; i < ncores; ++i) {
+            int const node = numa_node_of_cpu(ctx->cores[i]);
+            if(node >= 0) {
+                numa_bitmask_setbit(nodes, (unsigned) node);
+            }
+        }
+        if(numa_bitmask_weight(nodes) == 0) {
+            numa_free_nodemask(nodes);
+            nodes = numa_all_nodes_ptr;
+        }
+    }
+    numa_interleave_memory((void *) begin, end - begin, nodes);
+    if(nodes != numa_all_nodes_ptr) {
+        numa_free_nodemask(nodes);
+    }
+#else
+    (void) ptr;
+    (void) bytes;
+#endif
+}
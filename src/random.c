@@ -0,0 +1,94 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sptensor/sptensor.h"
+
+/*
+ * Counter-based random numbers.
+ *
+ * Draw number c of the library stream is the splitmix64 output
+ * mix(seed + (c+1) * golden), so any draw is computed on its own. A caller
+ * reserves a range of counters with one atomic add and fills an array in
+ * parallel, entry k from counter base + k: the result depends on the seed
+ * and the order of the calls only, not on the thread count, and no thread
+ * touches shared state per draw as rand() does.
+ */
+
+static uint64_t spt_random_seed;
+static uint64_t spt_random_next;
+static int spt_random_seeded = 0;
+
+/* The seed comes from PARTI_SEED, or the clock as the rand() stream did, until sptSetRandomSeed */
+static void spt_RandomInit(void) {
+    #pragma omp critical(spt_random)
+    {
+        if(!spt_random_seeded) {
+            char const * env = getenv("PARTI_SEED");
+            spt_random_seed = env != NULL ? strtoull(env, NULL, 10) : (uint64_t) time(NULL);
+            spt_random_next = 0;
+            spt_random_seeded = 1;
+        }
+    }
+}
+
+/**
+ * Restart the library random stream, used by sptRandomValue, sptRandomizeMatrix,
+ * sptRandomizeRankMatrix and the random shuffles, from a seed, so that the
+ * same calls give the same numbers whatever the thread count.
+ * Defaults to the PARTI_SEED environment variable, or the clock.
+ * @param seed  the seed
+ */
+void sptSetRandomSeed(uint64_t const seed) {
+    #pragma omp critical(spt_random)
+    {
+        spt_random_seed = seed;
+        spt_random_next = 0;
+        spt_random_seeded = 1;
+    }
+}
+
+/* Reserve count draws of the stream; returns the counter of the first */
+uint64_t spt_RandomReserve(uint64_t const count) {
+    if(!spt_random_seeded) {
+        spt_RandomInit();
+    }
+    uint64_t base;
+    #pragma omp atomic capture
+    { base = spt_random_next; spt_random_next += count; }
+    return base;
+}
+
+/* The 64 random bits of draw `counter` */
+uint64_t spt_RandomBits(uint64_t const counter) {
+    return spt_GenMix(spt_random_seed + (counter + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+/* A value in [-3, 3] from 64 random bits: the magnitude from the high 53, the sign from the lowest */
+sptValue spt_RandomValueOf(uint64_t const bits) {
+    sptValue const v = 3.0 * (sptValue) ((double) (bits >> 11) * (1.0 / 9007199254740992.0));
+    return (bits & 1) ? -v : v;
+}
+
+
+sptValue sptRandomValue(void)
+{
+    return spt_RandomValueOf(spt_RandomBits(spt_RandomReserve(1)));
+}
@@ -0,0 +1,378 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "../error/error.h"
+#ifdef PARTI_USE_MKL
+  #include <mkl_spblas.h>
+  #if PARTI_VALUE_TYPEWIDTH == 32
+    #define spt_mkl_sparse_create_csr mkl_sparse_s_create_csr
+    #define spt_mkl_sparse_mv mkl_sparse_s_mv
+    #define spt_mkl_sparse_mm mkl_sparse_s_mm
+  #else
+    #define spt_mkl_sparse_create_csr mkl_sparse_d_create_csr
+    #define spt_mkl_sparse_mv mkl_sparse_d_mv
+    #define spt_mkl_sparse_mm mkl_sparse_d_mm
+  #endif
+#endif
+
+/**
+ * Initialize a new CSR sparse matrix with room for nnz non-zeros
+ *
+ * @param mtx   a valid pointer to an uninitialized sptSparseMatrixCSR variable
+ * @param nrows the number of rows
+ * @param ncols the number of columns
+ * @param nnz   the number of non-zeros
+ */
+int sptNewSparseMatrixCSR(sptSparseMatrixCSR *mtx, sptIndex const nrows, sptIndex const ncols, sptNnzIndex const nnz) {
+    int result;
+    mtx->nrows = nrows;
+    mtx->ncols = ncols;
+    mtx->nnz = nnz;
+    result = sptNewNnzIndexVector(&mtx->rowptr, (sptNnzIndex) nrows + 1, (sptNnzIndex) nrows + 1);
+    spt_CheckError(result, "SpMtx CSR New", NULL);
+    result = sptNewIndexVector(&mtx->colind, nnz, nnz);
+    spt_CheckError(result, "SpMtx CSR New", NULL);
+    result = sptNewValueVector(&mtx->values, nnz, nnz);
+    spt_CheckError(result, "SpMtx CSR New", NULL);
+    return 0;
+}
+
+/**
+ * Release the memory buffer a CSR sparse matrix is holding
+ *
+ * @param mtx a pointer to a valid CSR sparse matrix
+ */
+void sptFreeSparseMatrixCSR(sptSparseMatrixCSR *mtx) {
+    sptFreeNnzIndexVector(&mtx->rowptr);
+    sptFreeIndexVector(&mtx->colind);
+    sptFreeValueVector(&mtx->values);
+    mtx->nrows = 0;
+    mtx->ncols = 0;
+    mtx->nnz = 0;
+}
+
+
+/**
+ * Convert a COO sparse matrix to CSR, or its transpose with transpose = 1,
+ * by a counting sort on the row index. Non-zeros of a row keep their COO
+ * order; duplicates are kept and summed by the CSR kernels.
+ *
+ * @param dest      a pointer to an uninitialized CSR sparse matrix
+ * @param src       the COO sparse matrix
+ * @param transpose 1 to store src^T
+ */
+int sptSparseMatrixToCSR(sptSparseMatrixCSR *dest, const sptSparseMatrix *src, int const transpose) {
+    sptIndex const nrows = transpose ? src->ncols : src->nrows;
+    sptIndex const ncols = transpose ? src->nrows : src->ncols;
+    sptIndex const * const rows = transpose ? src->colind.data : src->rowind.data;
+    sptIndex const * const cols = transpose ? src->rowind.data : src->colind.data;
+    int result = sptNewSparseMatrixCSR(dest, nrows, ncols, src->nnz);
+    spt_CheckError(result, "SpMtx To CSR", NULL);
+    sptNnzIndex * const rowptr = dest->rowptr.data;
+    memset(rowptr, 0, ((size_t) nrows + 1) * sizeof *rowptr);
+    for(sptNnzIndex i = 0; i < src->nnz; ++i) {
+        ++rowptr[rows[i] + 1];
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        rowptr[i+1] += rowptr[i];
+    }
+    /* rowptr[i] runs ahead to the end of row i, then moves back */
+    for(sptNnzIndex i = 0; i < src->nnz; ++i) {
+        sptNnzIndex const at = rowptr[rows[i]]++;
+        dest->colind.data[at] = cols[i];
+        dest->values.data[at] = src->values.data[i];
+    }
+    for(sptIndex i = nrows; i > 0; --i) {
+        rowptr[i] = rowptr[i-1];
+    }
+    rowptr[0] = 0;
+    return 0;
+}
+
+
+#ifdef PARTI_USE_MKL
+/* An MKL handle over A; MKL_INT copies of the index arrays are returned for the caller to free */
+static int spt_MklCSRHandle(sparse_matrix_t *handle, MKL_INT **rowptr, MKL_INT **colind, const sptSparseMatrixCSR *A) {
+    *rowptr = malloc(((size_t) A->nrows + 1) * sizeof **rowptr);
+    *colind = malloc((A->nnz > 0 ? A->nnz : 1) * sizeof **colind);
+    spt_CheckOSError(!*rowptr || !*colind, "SpMtx CSR MKL");
+    for(sptNnzIndex i = 0; i <= A->nrows; ++i) {
+        (*rowptr)[i] = (MKL_INT) A->rowptr.data[i];
+    }
+    for(sptNnzIndex i = 0; i < A->nnz; ++i) {
+        (*colind)[i] = (MKL_INT) A->colind.data[i];
+    }
+    sparse_status_t const status = spt_mkl_sparse_create_csr(handle, SPARSE_INDEX_BASE_ZERO,
+        (MKL_INT) A->nrows, (MKL_INT) A->ncols, *rowptr, *rowptr + 1, *colind, A->values.data);
+    if(status != SPARSE_STATUS_SUCCESS) {
+        spt_CheckError(SPTERR_UNKNOWN, "SpMtx CSR MKL", "mkl_sparse_create_csr failed");
+    }
+    return 0;
+}
+#endif
+
+
+/**
+ * CSR sparse matrix times a dense vector, y = A x, one row per output value.
+ * Rows are split between threads by non-zero count. Uses MKL sparse BLAS when
+ * PARTI_USE_MKL is set.
+ *
+ * @param y  a vector of length A->nrows, overwritten
+ * @param A  the CSR matrix
+ * @param x  a vector of length A->ncols
+ * @param tk the number of threads
+ */
+int sptSparseMatrixCSRSpMV(sptValueVector *y, const sptSparseMatrixCSR *A, const sptValueVector *x, int const tk) {
+    if(x->len < A->ncols || y->len < A->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpMtx CSR SpMV", "vector lengths do not match the matrix");
+    }
+#ifdef PARTI_USE_MKL
+    (void) tk;
+    sparse_matrix_t handle;
+    MKL_INT *rowptr, *colind;
+    int result = spt_MklCSRHandle(&handle, &rowptr, &colind, A);
+    spt_CheckError(result, "SpMtx CSR SpMV", NULL);
+    struct matrix_descr descr = { .type = SPARSE_MATRIX_TYPE_GENERAL };
+    sparse_status_t const status = spt_mkl_sparse_mv(SPARSE_OPERATION_NON_TRANSPOSE, 1, handle, descr, x->data, 0, y->data);
+    mkl_sparse_destroy(handle);
+    free(rowptr);
+    free(colind);
+    if(status != SPARSE_STATUS_SUCCESS) {
+        spt_CheckError(SPTERR_UNKNOWN, "SpMtx CSR SpMV", "mkl_sparse_mv failed");
+    }
+#else
+    sptNnzIndex const * const rowptr = A->rowptr.data;
+    sptIndex const * const colind = A->colind.data;
+    sptValue const * const vals = A->values.data;
+    sptValue const * const xv = x->data;
+    sptValue * const yv = y->data;
+    sptNnzIndex * bounds = malloc(((size_t) tk + 1) * sizeof *bounds);
+    spt_CheckOSError(!bounds, "SpMtx CSR SpMV");
+    int result = spt_PartitionSegments(bounds, rowptr, A->nrows, tk);
+    spt_CheckError(result, "SpMtx CSR SpMV", NULL);
+
+    #pragma omp parallel for schedule(static, 1) num_threads(tk)
+    for(int t = 0; t < tk; ++t) {
+        for(sptNnzIndex i = bounds[t]; i < bounds[t+1]; ++i) {
+            sptValue sum = 0;
+            for(sptNnzIndex j = rowptr[i]; j < rowptr[i+1]; ++j) {
+                sum += vals[j] * xv[colind[j]];
+            }
+            yv[i] = sum;
+        }
+    }
+    free(bounds);
+#endif
+    return 0;
+}
+
+
+/**
+ * CSR sparse matrix times a dense matrix, C = A B, both dense matrices
+ * row-major. Each row of C is the sum of the rows of B picked by one row of
+ * A, so a thread owns its output rows and no atomics are needed; rows are
+ * split between threads by non-zero count. Uses MKL sparse BLAS when
+ * PARTI_USE_MKL is set.
+ *
+ * @param C  a dense matrix with at least A->nrows rows and B->ncols columns, overwritten
+ * @param A  the CSR matrix
+ * @param B  a dense matrix with A->ncols rows
+ * @param tk the number of threads
+ */
+int sptSparseMatrixCSRSpMM(sptMatrix *C, const sptSparseMatrixCSR *A, const sptMatrix *B, int const tk) {
+    if(B->nrows != A->ncols || C->cap < A->nrows || C->ncols != B->ncols) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpMtx CSR SpMM", "shape mismatch");
+    }
+    sptIndex const R = B->ncols;
+#ifdef PARTI_USE_MKL
+    (void) tk;
+    sparse_matrix_t handle;
+    MKL_INT *rowptr, *colind;
+    int result = spt_MklCSRHandle(&handle, &rowptr, &colind, A);
+    spt_CheckError(result, "SpMtx CSR SpMM", NULL);
+    struct matrix_descr descr = { .type = SPARSE_MATRIX_TYPE_GENERAL };
+    sparse_status_t const status = spt_mkl_sparse_mm(SPARSE_OPERATION_NON_TRANSPOSE, 1, handle, descr,
+        SPARSE_LAYOUT_ROW_MAJOR, B->values, (MKL_INT) R, (MKL_INT) B->stride, 0, C->values, (MKL_INT) C->stride);
+    mkl_sparse_destroy(handle);
+    free(rowptr);
+    free(colind);
+    if(status != SPARSE_STATUS_SUCCESS) {
+        spt_CheckError(SPTERR_UNKNOWN, "SpMtx CSR SpMM", "mkl_sparse_mm failed");
+    }
+#else
+    sptNnzIndex const * const rowptr = A->rowptr.data;
+    sptIndex const * const colind = A->colind.data;
+    sptValue const * const vals = A->values.data;
+    sptNnzIndex * bounds = malloc(((size_t) tk + 1) * sizeof *bounds);
+    spt_CheckOSError(!bounds, "SpMtx CSR SpMM");
+    int result = spt_PartitionSegments(bounds, rowptr, A->nrows, tk);
+    spt_CheckError(result, "SpMtx CSR SpMM", NULL);
+
+    #pragma omp parallel for schedule(static, 1) num_threads(tk)
+    for(int t = 0; t < tk; ++t) {
+        for(sptNnzIndex i = bounds[t]; i < bounds[t+1]; ++i) {
+            sptValue * const restrict crow = C->values + i * C->stride;
+            memset(crow, 0, C->stride * sizeof *crow);
+            for(sptNnzIndex j = rowptr[i]; j < rowptr[i+1]; ++j) {
+                sptValue const v = vals[j];
+                sptValue const * const restrict brow = B->values + (sptNnzIndex) colind[j] * B->stride;
+                #pragma omp simd
+                for(sptIndex r = 0; r < R; ++r) {
+                    crow[r] += v * brow[r];
+                }
+            }
+        }
+    }
+    free(bounds);
+#endif
+    return 0;
+}
+
+
+/**
+ * Compress a dense row-major matrix to CSR, keeping the entries larger than
+ * threshold in magnitude. Columns of a row come out sorted. Rows are counted
+ * in parallel, then filled in parallel after a prefix sum.
+ *
+ * @param dest      a pointer to an uninitialized CSR sparse matrix
+ * @param src       the dense matrix
+ * @param threshold entries with |v| <= threshold are dropped; 0 drops exact zeros only
+ * @param tk        the number of threads
+ */
+int sptSparseMatrixCSRFromMatrix(sptSparseMatrixCSR *dest, const sptMatrix *src, sptValue const threshold, int const tk) {
+    sptIndex const nrows = src->nrows;
+    sptIndex const ncols = src->ncols;
+    sptNnzIndex * const counts = malloc(((size_t) nrows + 1) * sizeof *counts);
+    spt_CheckOSError(!counts, "SpMtx CSR From Dense");
+    counts[0] = 0;
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex i = 0; i < nrows; ++i) {
+        sptValue const * const row = src->values + (size_t) i * src->stride;
+        sptNnzIndex n = 0;
+        for(sptIndex c = 0; c < ncols; ++c) {
+            n += fabs(row[c]) > threshold;
+        }
+        counts[i+1] = n;
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        counts[i+1] += counts[i];
+    }
+
+    int result = sptNewSparseMatrixCSR(dest, nrows, ncols, counts[nrows]);
+    spt_CheckError(result, "SpMtx CSR From Dense", NULL);
+    memcpy(dest->rowptr.data, counts, ((size_t) nrows + 1) * sizeof *counts);
+    free(counts);
+
+    sptNnzIndex const * const rowptr = dest->rowptr.data;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex i = 0; i < nrows; ++i) {
+        sptValue const * const row = src->values + (size_t) i * src->stride;
+        sptNnzIndex at = rowptr[i];
+        for(sptIndex c = 0; c < ncols; ++c) {
+            if(fabs(row[c]) > threshold) {
+                dest->colind.data[at] = c;
+                dest->values.data[at] = row[c];
+                ++at;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Expand a CSR sparse matrix into a dense row-major matrix, summing duplicates.
+ *
+ * @param dest a dense matrix with src->nrows rows and src->ncols columns, overwritten
+ * @param src  the CSR matrix
+ */
+int sptSparseMatrixCSRToMatrix(sptMatrix *dest, const sptSparseMatrixCSR *src) {
+    if(dest->nrows != src->nrows || dest->ncols != src->ncols) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpMtx CSR To Dense", "shape mismatch");
+    }
+    memset(dest->values, 0, (size_t) dest->nrows * dest->stride * sizeof *dest->values);
+    for(sptIndex i = 0; i < src->nrows; ++i) {
+        sptValue * const row = dest->values + (size_t) i * dest->stride;
+        for(sptNnzIndex j = src->rowptr.data[i]; j < src->rowptr.data[i+1]; ++j) {
+            row[src->colind.data[j]] += src->values.data[j];
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Gram matrix A^T A of a CSR sparse matrix, into the upper triangle of a
+ * dense row-major matrix like sptOmpMatrixGram. Each row adds the outer
+ * product of its non-zeros only, so the cost follows the squared row
+ * lengths instead of the squared column count. Threads accumulate private
+ * copies that are summed at the end.
+ *
+ * @param ata a dense A->ncols x A->ncols matrix, upper triangle overwritten
+ * @param A   the CSR matrix, columns sorted within rows
+ * @param tk  the number of threads
+ */
+int sptSparseMatrixCSRGram(sptMatrix *ata, const sptSparseMatrixCSR *A, int const tk) {
+    if(ata->nrows != A->ncols || ata->ncols != A->ncols) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpMtx CSR Gram", "ata does not match A");
+    }
+    sptIndex const stride = ata->stride;
+    size_t const len = (size_t) A->ncols * stride;
+    int const nparts = tk > 0 ? tk : 1;
+    sptValue * const parts = calloc((size_t) nparts * len, sizeof *parts);
+    spt_CheckOSError(!parts, "SpMtx CSR Gram");
+    sptNnzIndex const * const rowptr = A->rowptr.data;
+    sptIndex const * const colind = A->colind.data;
+    sptValue const * const vals = A->values.data;
+
+    #pragma omp parallel num_threads(nparts)
+    {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const g = parts + omp_get_thread_num() * len;
+#else
+        sptValue * const g = parts;
+#endif
+        #pragma omp for schedule(static)
+        for(sptIndex i = 0; i < A->nrows; ++i) {
+            for(sptNnzIndex j = rowptr[i]; j < rowptr[i+1]; ++j) {
+                sptValue * const grow = g + (size_t) colind[j] * stride;
+                sptValue const v = vals[j];
+                for(sptNnzIndex k = j; k < rowptr[i+1]; ++k) {
+                    grow[colind[k]] += v * vals[k];
+                }
+            }
+        }
+    }
+
+    for(int p = 1; p < nparts; ++p) {
+        sptValue const * const part = parts + (size_t) p * len;
+        for(size_t x = 0; x < len; ++x) {
+            parts[x] += part[x];
+        }
+    }
+    for(sptIndex r = 0; r < A->ncols; ++r) {
+        memcpy(ata->values + (size_t) r * stride + r, parts + (size_t) r * stride + r, (A->ncols - r) * sizeof *parts);
+    }
+    free(parts);
+    return 0;
+}
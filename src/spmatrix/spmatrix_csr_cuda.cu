@@ -0,0 +1,114 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <cusparse.h>
+#include "../cudawrap.h"
+
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define SPT_CUDA_R_VALUE CUDA_R_32F
+#else
+  #define SPT_CUDA_R_VALUE CUDA_R_64F
+#endif
+
+#define spt_CheckCusparseError(status, module) \
+    if((status) != CUSPARSE_STATUS_SUCCESS) { \
+        spt_CheckError(SPTERR_CUDA_ERROR, (module), cusparseGetErrorString(status)); \
+    }
+
+
+/**
+ * CSR sparse matrix times a dense matrix on the GPU through cuSPARSE SpMM,
+ * C = A B with both dense matrices row-major.
+ *
+ * @param C a dense matrix with at least A->nrows rows and B->ncols columns, overwritten
+ * @param A the CSR matrix
+ * @param B a dense matrix with A->ncols rows
+ */
+int sptCudaSparseMatrixCSRSpMM(sptMatrix *C, const sptSparseMatrixCSR *A, const sptMatrix *B) {
+    int result;
+    cusparseStatus_t status;
+    if(B->nrows != A->ncols || C->cap < A->nrows || C->ncols != B->ncols) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpMtx CSR SpMM", "shape mismatch");
+    }
+
+    /* cuSPARSE takes 64-bit row offsets only together with 64-bit column indices */
+    int64_t * colind = new int64_t[A->nnz > 0 ? A->nnz : 1];
+    for(sptNnzIndex i = 0; i < A->nnz; ++i) {
+        colind[i] = A->colind.data[i];
+    }
+    sptNnzIndex * dev_rowptr;
+    result = sptCudaDuplicateMemory(&dev_rowptr, A->rowptr.data, ((size_t) A->nrows + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+    int64_t * dev_colind;
+    result = sptCudaDuplicateMemory(&dev_colind, colind, (A->nnz > 0 ? A->nnz : 1) * sizeof (int64_t), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+    delete[] colind;
+    sptValue * dev_vals;
+    result = sptCudaDuplicateMemory(&dev_vals, A->values.data, (A->nnz > 0 ? A->nnz : 1) * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+    sptValue * dev_B;
+    result = sptCudaDuplicateMemory(&dev_B, B->values, (size_t) B->nrows * B->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+    sptValue * dev_C;
+    result = spt_CudaPoolAlloc((void **) &dev_C, (size_t) A->nrows * C->stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+
+    cusparseHandle_t handle;
+    result = spt_cusparseCreate(&handle);
+    spt_CheckCusparseError((cusparseStatus_t) result, "CUDA SpMtx CSR SpMM");
+    cusparseSpMatDescr_t matA;
+    cusparseDnMatDescr_t matB, matC;
+    status = cusparseCreateCsr(&matA, A->nrows, A->ncols, A->nnz, dev_rowptr, dev_colind, dev_vals,
+        CUSPARSE_INDEX_64I, CUSPARSE_INDEX_64I, CUSPARSE_INDEX_BASE_ZERO, SPT_CUDA_R_VALUE);
+    spt_CheckCusparseError(status, "CUDA SpMtx CSR SpMM");
+    status = cusparseCreateDnMat(&matB, B->nrows, B->ncols, B->stride, dev_B, SPT_CUDA_R_VALUE, CUSPARSE_ORDER_ROW);
+    spt_CheckCusparseError(status, "CUDA SpMtx CSR SpMM");
+    status = cusparseCreateDnMat(&matC, A->nrows, C->ncols, C->stride, dev_C, SPT_CUDA_R_VALUE, CUSPARSE_ORDER_ROW);
+    spt_CheckCusparseError(status, "CUDA SpMtx CSR SpMM");
+
+    sptValue const alpha = 1, beta = 0;
+    size_t buffer_size = 0;
+    status = cusparseSpMM_bufferSize(handle, CUSPARSE_OPERATION_NON_TRANSPOSE, CUSPARSE_OPERATION_NON_TRANSPOSE,
+        &alpha, matA, matB, &beta, matC, SPT_CUDA_R_VALUE, CUSPARSE_SPMM_ALG_DEFAULT, &buffer_size);
+    spt_CheckCusparseError(status, "CUDA SpMtx CSR SpMM");
+    void * dev_buffer = NULL;
+    if(buffer_size > 0) {
+        result = spt_CudaWorkspace(&dev_buffer, buffer_size);
+        spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+    }
+    status = cusparseSpMM(handle, CUSPARSE_OPERATION_NON_TRANSPOSE, CUSPARSE_OPERATION_NON_TRANSPOSE,
+        &alpha, matA, matB, &beta, matC, SPT_CUDA_R_VALUE, CUSPARSE_SPMM_ALG_DEFAULT, dev_buffer);
+    spt_CheckCusparseError(status, "CUDA SpMtx CSR SpMM");
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+
+    result = cudaMemcpy(C->values, dev_C, (size_t) A->nrows * C->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpMtx CSR SpMM");
+
+    cusparseDestroySpMat(matA);
+    cusparseDestroyDnMat(matB);
+    cusparseDestroyDnMat(matC);
+    spt_CudaPoolFree(dev_rowptr);
+    spt_CudaPoolFree(dev_colind);
+    spt_CudaPoolFree(dev_vals);
+    spt_CudaPoolFree(dev_B);
+    spt_CudaPoolFree(dev_C);
+    return 0;
+}
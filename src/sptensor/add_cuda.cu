@@ -0,0 +1,383 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thrust/device_ptr.h>
+#include <thrust/scan.h>
+#include "sptensor.h"
+#include "sort_cuda.h"
+#include "../cudawrap.h"
+
+/*
+ * Element-wise union and intersection of device sparse tensors sorted in the
+ * natural order. Both inputs get linearized keys, mode 0 the most
+ * significant, and the merge path cuts the merged sequence into equal
+ * pieces, PARTI_CUDA_MERGE_ITEMS per thread, that threads merge on their
+ * own. Runs of equal keys in the merge, a match between X and Y as well as
+ * duplicates within either, are then numbered by a prefix sum, reduced to
+ * one value each, and the nonzero results compacted into Z, which comes out
+ * sorted without duplicates.
+ */
+
+#define PARTI_CUDA_MERGE_ITEMS 8
+
+enum {
+    SPT_DEVICE_MERGE_ADD = 0,
+    SPT_DEVICE_MERGE_SUB = 1,
+    SPT_DEVICE_MERGE_MUL = 2,
+};
+
+/* Word w of the key of merged entry r: X's nonzero r below nx, else Y's r - nx */
+__device__ static inline uint64_t spt_MergeKeyWord(
+    uint64_t const *kx, sptNnzIndex const nx, uint64_t const *ky, sptNnzIndex const ny,
+    sptNnzIndex const r, sptIndex const w)
+{
+    return r < nx ? kx[(size_t) w * nx + r] : ky[(size_t) w * ny + (r - nx)];
+}
+
+__device__ static inline int spt_MergeCompare(
+    uint64_t const *kx, sptNnzIndex const nx, uint64_t const *ky, sptNnzIndex const ny,
+    sptIndex const nwords, sptNnzIndex const a, sptNnzIndex const b)
+{
+    for(sptIndex w = nwords; w-- > 0; ) {
+        uint64_t const ka = spt_MergeKeyWord(kx, nx, ky, ny, a, w);
+        uint64_t const kb = spt_MergeKeyWord(kx, nx, ky, ny, b, w);
+        if(ka != kb) {
+            return ka < kb ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* xbound[p]: the X nonzeros among the first p * PARTI_CUDA_MERGE_ITEMS merged, X first on ties */
+__global__ static void spt_MergePathSplitKernel(
+    uint64_t const *kx, sptNnzIndex const nx, uint64_t const *ky, sptNnzIndex const ny,
+    sptIndex const nwords, sptNnzIndex const nparts, sptNnzIndex *xbound)
+{
+    sptNnzIndex const p = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(p > nparts) {
+        return;
+    }
+    sptNnzIndex const total = nx + ny;
+    sptNnzIndex const diag = p * PARTI_CUDA_MERGE_ITEMS < total ? p * PARTI_CUDA_MERGE_ITEMS : total;
+    sptNnzIndex lo = diag > ny ? diag - ny : 0;
+    sptNnzIndex hi = diag < nx ? diag : nx;
+    while(lo < hi) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(spt_MergeCompare(kx, nx, ky, ny, nwords, mid, nx + (diag - mid - 1)) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    xbound[p] = lo;
+}
+
+/* Merge piece p into ref, each entry the X nonzero below nx or nx plus the Y nonzero */
+__global__ static void spt_MergePathKernel(
+    uint64_t const *kx, sptNnzIndex const nx, uint64_t const *ky, sptNnzIndex const ny,
+    sptIndex const nwords, sptNnzIndex const nparts, sptNnzIndex const *xbound, sptNnzIndex *ref)
+{
+    sptNnzIndex const p = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(p >= nparts) {
+        return;
+    }
+    sptNnzIndex const total = nx + ny;
+    sptNnzIndex const begin = p * PARTI_CUDA_MERGE_ITEMS;
+    sptNnzIndex const end = begin + PARTI_CUDA_MERGE_ITEMS < total ? begin + PARTI_CUDA_MERGE_ITEMS : total;
+    sptNnzIndex i = xbound[p], j = begin - xbound[p];
+    for(sptNnzIndex d = begin; d < end; ++d) {
+        if(i < nx && (j >= ny || spt_MergeCompare(kx, nx, ky, ny, nwords, i, nx + j) <= 0)) {
+            ref[d] = i++;
+        } else {
+            ref[d] = nx + j++;
+        }
+    }
+}
+
+/* head[d] = 1 where merged entry d starts a run of equal keys */
+__global__ static void spt_MergeHeadKernel(
+    uint64_t const *kx, sptNnzIndex const nx, uint64_t const *ky, sptNnzIndex const ny,
+    sptIndex const nwords, sptNnzIndex const *ref, sptNnzIndex *head)
+{
+    sptNnzIndex const d = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(d >= nx + ny) {
+        return;
+    }
+    head[d] = d == 0 || spt_MergeCompare(kx, nx, ky, ny, nwords, ref[d-1], ref[d]) != 0;
+}
+
+__global__ static void spt_MergeRunStartKernel(
+    sptNnzIndex const total, sptNnzIndex const *head, sptNnzIndex const *run, sptNnzIndex *start)
+{
+    sptNnzIndex const d = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(d < total && head[d]) {
+        start[run[d]] = d;
+    }
+}
+
+/* The value of run s, and keep[s] = 1 if it is nonzero and, for an intersection, in both inputs */
+__global__ static void spt_MergeRunValueKernel(
+    sptValue const *vx, sptNnzIndex const nx, sptValue const *vy,
+    sptNnzIndex const *ref, sptNnzIndex const *start, sptNnzIndex const nruns, int const op,
+    sptValue *runval, sptNnzIndex *keep)
+{
+    sptNnzIndex const s = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(s >= nruns) {
+        return;
+    }
+    sptValue sx = 0, sy = 0;
+    int inx = 0, iny = 0;
+    for(sptNnzIndex d = start[s]; d < start[s+1]; ++d) {
+        sptNnzIndex const r = ref[d];
+        if(r < nx) {
+            sx += vx[r];
+            inx = 1;
+        } else {
+            sy += vy[r - nx];
+            iny = 1;
+        }
+    }
+    sptValue const v = op == SPT_DEVICE_MERGE_ADD ? sx + sy : op == SPT_DEVICE_MERGE_SUB ? sx - sy : sx * sy;
+    runval[s] = v;
+    keep[s] = v != 0 && (op != SPT_DEVICE_MERGE_MUL || (inx && iny));
+}
+
+/* Write every kept run to its slot pos[s] of Z */
+__global__ static void spt_MergeScatterKernel(
+    sptIndex const *ix, sptNnzIndex const nx, sptIndex const *iy, sptNnzIndex const ny, sptIndex const nmodes,
+    sptNnzIndex const *ref, sptNnzIndex const *start, sptNnzIndex const nruns,
+    sptValue const *runval, sptNnzIndex const *keep, sptNnzIndex const *pos,
+    sptIndex *Z_inds, sptValue *Z_val, sptNnzIndex const Z_nnz)
+{
+    sptNnzIndex const s = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(s >= nruns || !keep[s]) {
+        return;
+    }
+    sptNnzIndex const r = ref[start[s]];
+    sptNnzIndex const out = pos[s];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        Z_inds[m * Z_nnz + out] = r < nx ? ix[m * nx + r] : iy[m * ny + (r - nx)];
+    }
+    Z_val[out] = runval[s];
+}
+
+/* The sum of n flags, scanned in place into their exclusive prefix sums */
+static sptNnzIndex spt_MergeScanCount(sptNnzIndex *flags, sptNnzIndex const n) {
+    if(n == 0) {
+        return 0;
+    }
+    sptNnzIndex last = 0, before = 0;
+    cudaMemcpy(&last, flags + n - 1, sizeof last, cudaMemcpyDeviceToHost);
+    thrust::device_ptr<sptNnzIndex> ptr(flags);
+    thrust::exclusive_scan(ptr, ptr + n, ptr);
+    cudaMemcpy(&before, flags + n - 1, sizeof before, cudaMemcpyDeviceToHost);
+    return before + last;
+}
+
+static int spt_DeviceSparseTensorMerge(
+    sptDeviceSparseTensor *dZ,
+    const sptDeviceSparseTensor *dX,
+    const sptDeviceSparseTensor *dY,
+    int const op,
+    const char *module)
+{
+    if(dY->nmodes != dX->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    for(sptIndex m = 0; m < dX->nmodes; ++m) {
+        if(dY->ndims[m] != dX->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+        }
+    }
+    sptIndex const nmodes = dX->nmodes;
+    sptNnzIndex const nx = dX->nnz, ny = dY->nnz, total = nx + ny;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* Linearized keys of both inputs, of the same width as they have the same shape */
+    sptIndex * order = new sptIndex[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        order[m] = m;
+    }
+    uint64_t *kx, *ky;
+    sptIndex nwords;
+    int result = spt_CudaLexKeys(&kx, &nwords, dX->inds, nx, nmodes, dX->ndims, order, 0, 0);
+    spt_CheckError(result, module, NULL);
+    result = spt_CudaLexKeys(&ky, &nwords, dY->inds, ny, nmodes, dY->ndims, order, 0, 0);
+    spt_CheckError(result, module, NULL);
+    delete[] order;
+
+    /* ref, head, run, start (one more), keep and pos; runs are at most total */
+    sptNnzIndex const nparts = (total + PARTI_CUDA_MERGE_ITEMS - 1) / PARTI_CUDA_MERGE_ITEMS;
+    sptNnzIndex *dev_work, *dev_xbound;
+    sptValue *dev_runval;
+    result = cudaMalloc((void **) &dev_work, (6 * total + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &dev_xbound, (nparts + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &dev_runval, (total + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    sptNnzIndex * const dev_ref = dev_work;
+    sptNnzIndex * const dev_head = dev_work + total;
+    sptNnzIndex * const dev_run = dev_work + 2 * total;
+    sptNnzIndex * const dev_start = dev_work + 3 * total;
+    sptNnzIndex * const dev_keep = dev_work + 4 * total + 1;
+    sptNnzIndex * const dev_pos = dev_work + 5 * total + 1;
+
+    sptNnzIndex nruns = 0, nnz = 0;
+    if(total > 0) {
+        spt_MergePathSplitKernel<<<spt_CudaLayoutBlocks(nparts + 1), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            kx, nx, ky, ny, nwords, nparts, dev_xbound);
+        spt_MergePathKernel<<<spt_CudaLayoutBlocks(nparts), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            kx, nx, ky, ny, nwords, nparts, dev_xbound, dev_ref);
+        spt_MergeHeadKernel<<<spt_CudaLayoutBlocks(total), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            kx, nx, ky, ny, nwords, dev_ref, dev_head);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+
+        /* Number the runs and find where each starts, the last ending at total */
+        result = cudaMemcpy(dev_run, dev_head, total * sizeof (sptNnzIndex), cudaMemcpyDeviceToDevice);
+        spt_CheckCudaError(result != 0, module);
+        nruns = spt_MergeScanCount(dev_run, total);
+        spt_MergeRunStartKernel<<<spt_CudaLayoutBlocks(total), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            total, dev_head, dev_run, dev_start);
+        result = cudaMemcpy(dev_start + nruns, &total, sizeof total, cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+
+        spt_MergeRunValueKernel<<<spt_CudaLayoutBlocks(nruns), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            dX->values, nx, dY->values, dev_ref, dev_start, nruns, op, dev_runval, dev_keep);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+        result = cudaMemcpy(dev_pos, dev_keep, nruns * sizeof (sptNnzIndex), cudaMemcpyDeviceToDevice);
+        spt_CheckCudaError(result != 0, module);
+        nnz = spt_MergeScanCount(dev_pos, nruns);
+    }
+
+    dZ->nmodes = nmodes;
+    dZ->nnz = nnz;
+    dZ->ndims = (sptIndex *) malloc(nmodes * sizeof *dZ->ndims);
+    spt_CheckOSError(!dZ->ndims, module);
+    memcpy(dZ->ndims, dX->ndims, nmodes * sizeof *dZ->ndims);
+    result = cudaMalloc((void **) &dZ->inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &dZ->values, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    if(nnz > 0) {
+        spt_MergeScatterKernel<<<spt_CudaLayoutBlocks(nruns), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            dX->inds, nx, dY->inds, ny, nmodes, dev_ref, dev_start, nruns,
+            dev_runval, dev_keep, dev_pos, dZ->inds, dZ->values, nnz);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, module);
+    sptFreeTimer(timer);
+
+    cudaFree(kx);
+    cudaFree(ky);
+    cudaFree(dev_work);
+    cudaFree(dev_xbound);
+    cudaFree(dev_runval);
+    return 0;
+}
+
+
+/**
+ * Element-wise add two device sparse tensors, Z = X + Y over the union of
+ * their nonzeros, without leaving the device. Both must be sorted in the
+ * natural order, see sptDeviceSparseTensorSortIndex. Duplicate coordinates
+ * are summed and results of zero dropped, so Z is sorted and duplicate free.
+ * @param[out] dZ an uninitialized device sparse tensor
+ * @param[in]  dX the first operand
+ * @param[in]  dY the second operand
+ */
+int sptDeviceSparseTensorAdd(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY) {
+    return spt_DeviceSparseTensorMerge(dZ, dX, dY, SPT_DEVICE_MERGE_ADD, "DevSpTns Add");
+}
+
+/**
+ * Element-wise subtract two device sparse tensors, Z = X - Y, see sptDeviceSparseTensorAdd.
+ * @param[out] dZ an uninitialized device sparse tensor
+ * @param[in]  dX the first operand
+ * @param[in]  dY the second operand
+ */
+int sptDeviceSparseTensorSub(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY) {
+    return spt_DeviceSparseTensorMerge(dZ, dX, dY, SPT_DEVICE_MERGE_SUB, "DevSpTns Sub");
+}
+
+/**
+ * Element-wise multiply two device sparse tensors of any nonzero patterns,
+ * Z = X .* Y over the intersection of their nonzeros, see sptDeviceSparseTensorAdd.
+ * @param[out] dZ an uninitialized device sparse tensor
+ * @param[in]  dX the first operand
+ * @param[in]  dY the second operand
+ */
+int sptDeviceSparseTensorDotMul(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY) {
+    return spt_DeviceSparseTensorMerge(dZ, dX, dY, SPT_DEVICE_MERGE_MUL, "DevSpTns DotMul");
+}
+
+
+/* Upload, sort on the device, merge, and download */
+static int spt_CudaSparseTensorMerge(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y,
+    int const op, const char *module)
+{
+    sptDeviceSparseTensor dX, dY, dZ;
+    int result = sptDeviceUploadSparseTensor(&dX, X);
+    spt_CheckError(result, module, NULL);
+    result = sptDeviceUploadSparseTensor(&dY, Y);
+    spt_CheckError(result, module, NULL);
+    result = sptDeviceSparseTensorSortIndex(&dX);
+    spt_CheckError(result, module, NULL);
+    result = sptDeviceSparseTensorSortIndex(&dY);
+    spt_CheckError(result, module, NULL);
+    result = spt_DeviceSparseTensorMerge(&dZ, &dX, &dY, op, module);
+    spt_CheckError(result, module, NULL);
+    sptFreeDeviceSparseTensor(&dX);
+    sptFreeDeviceSparseTensor(&dY);
+    result = sptDeviceDownloadSparseTensor(Z, &dZ);
+    spt_CheckError(result, module, NULL);
+    sptFreeDeviceSparseTensor(&dZ);
+    return 0;
+}
+
+/**
+ * CUDA element wise add two sparse tensors, by a device merge of their
+ * nonzeros sorted on the device, see sptDeviceSparseTensorAdd.
+ * @param[out] Z the result of X+Y, should be uninitialized; it comes out sorted
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptCudaSparseTensorAdd(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
+    return spt_CudaSparseTensorMerge(Z, X, Y, SPT_DEVICE_MERGE_ADD, "CUDA SpTns Add");
+}
+
+/**
+ * CUDA element wise subtract two sparse tensors, see sptCudaSparseTensorAdd.
+ * @param[out] Z the result of X-Y, should be uninitialized; it comes out sorted
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptCudaSparseTensorSub(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
+    return spt_CudaSparseTensorMerge(Z, X, Y, SPT_DEVICE_MERGE_SUB, "CUDA SpTns Sub");
+}
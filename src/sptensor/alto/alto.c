@@ -0,0 +1,212 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sptensor.h"
+#include "alto.h"
+
+/*
+ * Adaptive linearized tensor order (ALTO).
+ *
+ * Mode m needs b_m = ceil(log2(ndims[m])) bits. Key bits are handed out from
+ * the least significant one, level by level: at level j every mode with
+ * j < b_m takes the next bit, lower modes first. Short modes drop out early,
+ * so the key has sum(b_m) bits instead of nmodes * max(b_m) as in Morton
+ * order, while the interleaving keeps nearby keys close in every mode.
+ */
+
+typedef struct {
+    sptSparseTensor const * tsr;
+    sptSparseTensorALTO const * alto;
+    sptIndex nwords;
+} spt_ALTOKeyContext;
+
+
+/* Low (hi = 0) or high (hi = 1) key word of nonzero z of the COO tensor */
+static inline uint64_t spt_ALTOKeyWord(
+    sptSparseTensor const * const tsr,
+    sptSparseTensorALTO const * const alto,
+    sptNnzIndex const z,
+    int const hi)
+{
+    uint64_t word = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        uint64_t const i = tsr->inds[m].data[z];
+        if(hi) {
+            unsigned const nlo = (unsigned) __builtin_popcountll(alto->mask_lo[m]);
+            word |= nlo < 64 ? spt_ALTODeposit(i >> nlo, alto->mask_hi[m]) : 0;
+        } else {
+            word |= spt_ALTODeposit(i, alto->mask_lo[m]);
+        }
+    }
+    return word;
+}
+
+static void spt_ALTOKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * vctx)
+{
+    spt_ALTOKeyContext const * const ctx = vctx;
+    /* Word 0 is the most significant */
+    int const hi = ctx->nwords == 2 && word == 0;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = spt_ALTOKeyWord(ctx->tsr, ctx->alto, perm[i], hi);
+    }
+}
+
+
+/**
+ * Release the memory of an ALTO sparse tensor
+ * @param alto  an ALTO sparse tensor built by sptSparseTensorToALTO
+ */
+void sptFreeSparseTensorALTO(sptSparseTensorALTO *alto)
+{
+    free(alto->ndims);
+    free(alto->mask_lo);
+    free(alto->mask_hi);
+    free(alto->keys);
+    free(alto->keys_hi);
+    free(alto->part_ptr);
+    free(alto->part_lo);
+    free(alto->part_hi);
+    sptFreeValueVector(&alto->values);
+    alto->nmodes = 0;
+    alto->nnz = 0;
+}
+
+
+/**
+ * Convert a COO sparse tensor into ALTO format
+ * @param alto  an uninitialized ALTO sparse tensor
+ * @param tsr   the COO sparse tensor, left untouched
+ * @param tk    the number of threads used to sort, and the number of nonzero ranges
+ *
+ * Fails with SPTERR_VALUE_ERROR if the coordinates need more than 128 bits.
+ */
+int sptSparseTensorToALTO(
+    sptSparseTensorALTO *alto,
+    sptSparseTensor const * const tsr,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "ALTO Convert", "tk < 1");
+    }
+
+    unsigned nbits = 0, max_bits = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        unsigned const b = spt_RadixBitWidth(tsr->ndims[m]);
+        nbits += b;
+        if(b > max_bits) {
+            max_bits = b;
+        }
+    }
+    if(nbits > 128) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "ALTO Convert", "coordinates need more than 128 bits");
+    }
+
+    memset(alto, 0, sizeof *alto);
+    alto->nmodes = nmodes;
+    alto->nnz = nnz;
+    alto->nbits = nbits;
+    alto->ndims = malloc(nmodes * sizeof *alto->ndims);
+    alto->mask_lo = calloc(nmodes, sizeof *alto->mask_lo);
+    alto->mask_hi = calloc(nmodes, sizeof *alto->mask_hi);
+    spt_CheckOSError(!alto->ndims || !alto->mask_lo || !alto->mask_hi, "ALTO Convert");
+    memcpy(alto->ndims, tsr->ndims, nmodes * sizeof *alto->ndims);
+
+    unsigned pos = 0;
+    for(unsigned j = 0; j < max_bits; ++j) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(j < spt_RadixBitWidth(tsr->ndims[m])) {
+                if(pos < 64) {
+                    alto->mask_lo[m] |= (uint64_t) 1 << pos;
+                } else {
+                    alto->mask_hi[m] |= (uint64_t) 1 << (pos - 64);
+                }
+                ++pos;
+            }
+        }
+    }
+
+    /* Sort once by key, then store the keys and values in that order */
+    sptIndex const nwords = nbits > 64 ? 2 : 1;
+    unsigned word_bits[2];
+    if(nwords == 2) {
+        word_bits[0] = nbits - 64;
+        word_bits[1] = 64;
+    } else {
+        word_bits[0] = nbits;
+    }
+    sptNnzIndex * perm = malloc((nnz > 0 ? nnz : 1) * sizeof *perm);
+    spt_CheckOSError(!perm, "ALTO Convert");
+    spt_ALTOKeyContext ctx = { tsr, alto, nwords };
+    if(nnz > 0) {
+        result = spt_RadixSortPermutation(perm, nnz, nwords, word_bits, spt_ALTOKey, &ctx, tk);
+        spt_CheckError(result, "ALTO Convert", NULL);
+    }
+
+    alto->keys = malloc((nnz > 0 ? nnz : 1) * sizeof *alto->keys);
+    spt_CheckOSError(!alto->keys, "ALTO Convert");
+    if(nwords == 2) {
+        alto->keys_hi = malloc((nnz > 0 ? nnz : 1) * sizeof *alto->keys_hi);
+        spt_CheckOSError(!alto->keys_hi, "ALTO Convert");
+    }
+    result = sptNewValueVector(&alto->values, nnz, nnz);
+    spt_CheckError(result, "ALTO Convert", NULL);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptNnzIndex const from = perm[z];
+        alto->keys[z] = spt_ALTOKeyWord(tsr, alto, from, 0);
+        if(nwords == 2) {
+            alto->keys_hi[z] = spt_ALTOKeyWord(tsr, alto, from, 1);
+        }
+        alto->values.data[z] = tsr->values.data[from];
+    }
+    free(perm);
+
+    /* Equal nonzero ranges, and the index interval each one covers per mode */
+    alto->nparts = tk;
+    alto->part_ptr = malloc((tk + 1) * sizeof *alto->part_ptr);
+    alto->part_lo = malloc((size_t) tk * nmodes * sizeof *alto->part_lo);
+    alto->part_hi = malloc((size_t) tk * nmodes * sizeof *alto->part_hi);
+    spt_CheckOSError(!alto->part_ptr || !alto->part_lo || !alto->part_hi, "ALTO Convert");
+    for(int p = 0; p <= tk; ++p) {
+        alto->part_ptr[p] = nnz * p / tk;
+    }
+    #pragma omp parallel for schedule(static, 1) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptIndex * const lo = alto->part_lo + (size_t) p * nmodes;
+        sptIndex * const hi = alto->part_hi + (size_t) p * nmodes;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            lo[m] = (sptIndex) -1;
+            hi[m] = 0;
+        }
+        for(sptNnzIndex z = alto->part_ptr[p]; z < alto->part_ptr[p+1]; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptIndex const i = spt_ALTOIndex(alto, z, m);
+                if(i < lo[m]) lo[m] = i;
+                if(i > hi[m]) hi[m] = i;
+            }
+        }
+    }
+
+    return 0;
+}
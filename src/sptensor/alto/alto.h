@@ -0,0 +1,84 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_SPTENSORALTO_H
+#define PARTI_SPTENSORALTO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ParTI.h>
+#include "../../error/error.h"
+#if defined(__BMI2__)
+  #include <immintrin.h>
+#endif
+
+/* Scatter the low bits of src to the set bits of mask, lowest first */
+static inline uint64_t spt_ALTODeposit(uint64_t src, uint64_t mask)
+{
+#if defined(__BMI2__)
+    return _pdep_u64(src, mask);
+#else
+    uint64_t out = 0;
+    while(mask != 0) {
+        uint64_t const lowest = mask & (~mask + 1);
+        if(src & 1) {
+            out |= lowest;
+        }
+        src >>= 1;
+        mask ^= lowest;
+    }
+    return out;
+#endif
+}
+
+/* Gather the bits of src under mask into the low bits, lowest first */
+static inline uint64_t spt_ALTOExtract(uint64_t const src, uint64_t mask)
+{
+#if defined(__BMI2__)
+    return _pext_u64(src, mask);
+#else
+    uint64_t out = 0, bit = 1;
+    while(mask != 0) {
+        uint64_t const lowest = mask & (~mask + 1);
+        if(src & lowest) {
+            out |= bit;
+        }
+        bit <<= 1;
+        mask ^= lowest;
+    }
+    return out;
+#endif
+}
+
+/* Index of nonzero z of an ALTO tensor in mode m */
+static inline sptIndex spt_ALTOIndex(sptSparseTensorALTO const * const X, sptNnzIndex const z, sptIndex const m)
+{
+    uint64_t i = spt_ALTOExtract(X->keys[z], X->mask_lo[m]);
+    if(X->keys_hi != NULL && X->mask_hi[m] != 0) {
+        i |= spt_ALTOExtract(X->keys_hi[z], X->mask_hi[m]) << __builtin_popcountll(X->mask_lo[m]);
+    }
+    return (sptIndex) i;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sptensor.h"
+#include "alto.h"
+
+/*
+ * Mode-agnostic MTTKRP on ALTO keys.
+ *
+ * Every thread takes one contiguous range of nonzeros and decodes their
+ * coordinates on the fly. Key order keeps the output rows of a range within a
+ * narrow interval of every mode; a range whose interval meets no other range's
+ * interval owns its rows and updates them without atomics.
+ */
+
+/* Whether the mode-m index interval of range p overlaps that of another range */
+static int spt_ALTORangeShared(sptSparseTensorALTO const * const X, int const p, sptIndex const m)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(X->part_ptr[p] == X->part_ptr[p+1]) {
+        return 0;
+    }
+    sptIndex const lo = X->part_lo[(size_t) p * nmodes + m];
+    sptIndex const hi = X->part_hi[(size_t) p * nmodes + m];
+    for(int q = 0; q < X->nparts; ++q) {
+        if(q == p || X->part_ptr[q] == X->part_ptr[q+1]) {
+            continue;
+        }
+        if(X->part_lo[(size_t) q * nmodes + m] <= hi && lo <= X->part_hi[(size_t) q * nmodes + m]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * OpenMP MTTKRP on an ALTO sparse tensor, for any mode
+ * @param X     the ALTO sparse tensor
+ * @param mats  (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mode  the mode on which the MTTKRP is performed
+ * @param tk    the number of threads
+ */
+int sptOmpMTTKRPALTO(
+    sptSparseTensorALTO const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns ALTO MTTKRP", "mode >= nmodes");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns ALTO MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns ALTO MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[0]->stride;
+    sptValue const * const vals = X->values.data;
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * stride * sizeof *mvals);
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0, team = 1;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+        team = omp_get_num_threads();
+#endif
+        sptValue * const restrict acc = spt_ScratchAlloc(stride * sizeof *acc);
+        for(int p = tid; p < X->nparts; p += team) {
+            int const shared = spt_ALTORangeShared(X, p, mode);
+            for(sptNnzIndex z = X->part_ptr[p]; z < X->part_ptr[p+1]; ++z) {
+                sptValue const entry = vals[z];
+                for(sptIndex r=0; r<R; ++r) {
+                    acc[r] = entry;
+                }
+                for(sptIndex m=0; m<nmodes; ++m) {
+                    if(m == mode) {
+                        continue;
+                    }
+                    sptValue const * const restrict row = mats[m]->values + (sptNnzIndex)spt_ALTOIndex(X, z, m) * stride;
+                    #pragma omp simd
+                    for(sptIndex r=0; r<R; ++r) {
+                        acc[r] *= row[r];
+                    }
+                }
+
+                sptValue * const restrict out_row = mvals + (sptNnzIndex)spt_ALTOIndex(X, z, mode) * stride;
+                if(shared) {
+                    for(sptIndex r=0; r<R; ++r) {
+                        #pragma omp atomic update
+                        out_row[r] += acc[r];
+                    }
+                } else {
+                    #pragma omp simd
+                    for(sptIndex r=0; r<R; ++r) {
+                        out_row[r] += acc[r];
+                    }
+                }
+            }
+        }
+        spt_ScratchFree(acc);
+    }
+
+    return 0;
+}
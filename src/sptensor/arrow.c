@@ -0,0 +1,255 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Columnar ingest through the Arrow C Data Interface.
+ *
+ * A Parquet or Arrow IPC reader of any Arrow library exports a record batch
+ * as one struct array whose children are the columns: one per mode, then
+ * the values. Columns of the width and signedness of sptIndex and sptValue
+ * are used in place; others are converted in parallel into arrays of the
+ * tensor. One parallel pass per index column finds its range, which checks
+ * it and gives ndims when the caller does not.
+ */
+
+/* Byte width of an Arrow integer format, 0 if it is not one */
+static int spt_ArrowIntegerWidth(char const * format) {
+    if(format == NULL || format[0] == '\0' || format[1] != '\0') {
+        return 0;
+    }
+    switch(format[0]) {
+    case 'c': case 'C': return 1;
+    case 's': case 'S': return 2;
+    case 'i': case 'I': return 4;
+    case 'l': case 'L': return 8;
+    default: return 0;
+    }
+}
+
+/* Element z of an integer column, widened; unsigned 64-bit values above INT64_MAX come out negative */
+static inline int64_t spt_ArrowInteger(void const * data, char const type, int64_t const z) {
+    switch(type) {
+    case 'c': return ((int8_t const *) data)[z];
+    case 'C': return ((uint8_t const *) data)[z];
+    case 's': return ((int16_t const *) data)[z];
+    case 'S': return ((uint16_t const *) data)[z];
+    case 'i': return ((int32_t const *) data)[z];
+    case 'I': return ((uint32_t const *) data)[z];
+    case 'l': return ((int64_t const *) data)[z];
+    default:  return (int64_t) ((uint64_t const *) data)[z];
+    }
+}
+
+/* Check a column of a struct array: data, no nulls, and the length */
+static int spt_ArrowCheckColumn(struct ArrowArray const * column, int64_t const length) {
+    if(column->length < length || column->n_buffers < 2 || column->buffers[1] == NULL) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "column shorter than the batch or without data");
+    }
+    if(column->null_count != 0 && column->buffers[0] != NULL) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "columns with nulls are not supported");
+    }
+    return 0;
+}
+
+/* Give inds the indices of one column, in place when they are sptIndex and need no shift */
+static int spt_ArrowImportIndices(
+    sptIndexVector * inds,
+    sptIndex * dim,
+    struct ArrowSchema const * schema,
+    struct ArrowArray const * column,
+    int64_t const offset,
+    int64_t const nnz,
+    sptIndex const start_index,
+    int const tk)
+{
+    int const width = spt_ArrowIntegerWidth(schema->format);
+    if(width == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "index columns must be integers");
+    }
+    int result = spt_ArrowCheckColumn(column, offset + nnz);
+    spt_CheckError(result, "SpTns Arrow", NULL);
+    char const type = schema->format[0];
+    void const * const data = (char const *) column->buffers[1] + (column->offset + offset) * width;
+
+    /* Range of the column, to check it and infer its size */
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    #pragma omp parallel for schedule(static) reduction(min:lo) reduction(max:hi) num_threads(tk)
+    for(int64_t z = 0; z < nnz; ++z) {
+        int64_t const v = spt_ArrowInteger(data, type, z);
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+    }
+    if(nnz > 0 && (lo < (int64_t) start_index || (uint64_t) (hi - (int64_t) start_index) >= (uint64_t) PARTI_INDEX_MAX)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "index out of range");
+    }
+    sptIndex const extent = nnz > 0 ? (sptIndex) (hi - (int64_t) start_index + 1) : 0;
+    if(*dim == 0) {
+        *dim = extent;
+    } else if(extent > *dim) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "index out of range");
+    }
+
+    inds->len = nnz;
+    inds->cap = nnz;
+    if(width == sizeof (sptIndex) && start_index == 0 && ((uintptr_t) data % sizeof (sptIndex)) == 0) {
+        /* Signed columns qualify too, their range being checked nonnegative */
+        inds->data = (sptIndex *) data;
+        return 0;
+    }
+    inds->data = malloc((nnz > 0 ? nnz : 1) * sizeof *inds->data);
+    spt_CheckOSError(!inds->data, "SpTns Arrow");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int64_t z = 0; z < nnz; ++z) {
+        inds->data[z] = (sptIndex) (spt_ArrowInteger(data, type, z) - (int64_t) start_index);
+    }
+    return 0;
+}
+
+/* Give values the value column, in place when it is of type sptValue */
+static int spt_ArrowImportValues(
+    sptValueVector * values,
+    struct ArrowSchema const * schema,
+    struct ArrowArray const * column,
+    int64_t const offset,
+    int64_t const nnz,
+    int const tk)
+{
+    char const * const format = schema->format;
+    int const is_float = format != NULL && (strcmp(format, "f") == 0 || strcmp(format, "g") == 0);
+    int const width = is_float ? (format[0] == 'f' ? 4 : 8) : spt_ArrowIntegerWidth(format);
+    if(width == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "value columns must be floating point or integers");
+    }
+    int result = spt_ArrowCheckColumn(column, offset + nnz);
+    spt_CheckError(result, "SpTns Arrow", NULL);
+    void const * const data = (char const *) column->buffers[1] + (column->offset + offset) * width;
+
+    values->len = nnz;
+    values->cap = nnz;
+    if(is_float && width == sizeof (sptValue) && ((uintptr_t) data % sizeof (sptValue)) == 0) {
+        values->data = (sptValue *) data;
+        return 0;
+    }
+    values->data = malloc((nnz > 0 ? nnz : 1) * sizeof *values->data);
+    spt_CheckOSError(!values->data, "SpTns Arrow");
+    char const type = format[0];
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int64_t z = 0; z < nnz; ++z) {
+        values->data[z] = type == 'f' ? (sptValue) ((float const *) data)[z] :
+            type == 'g' ? (sptValue) ((double const *) data)[z] :
+            type == 'L' ? (sptValue) ((uint64_t const *) data)[z] :
+            (sptValue) spt_ArrowInteger(data, type, z);
+    }
+    return 0;
+}
+
+
+/**
+ * Make a sparse tensor over the columns of an Arrow record batch, exported
+ * through the Arrow C Data Interface, e.g. by pyarrow's
+ * RecordBatch._export_to_c after reading Parquet or Arrow IPC.
+ *
+ * The batch is a struct array with nmodes integer index columns, then an
+ * optional floating point or integer value column; without it the tensor is
+ * a pattern tensor. Columns must not hold nulls. Index columns of the width
+ * of sptIndex, when start_index is 0, and value columns of type sptValue
+ * are used without a copy, as sptWrapSparseTensor does; the others are
+ * converted in parallel. In-place kernels such as sorting reorder the
+ * columns used without a copy. The array must stay alive, and unreleased,
+ * until the tensor is released with sptUnwrapArrowSparseTensor.
+ *
+ * @param tsr         an uninitialized sparse tensor
+ * @param schema      the schema of the batch, a struct ("+s")
+ * @param array       the batch
+ * @param nmodes      number of modes, the first nmodes columns
+ * @param start_index the index of the first element of a mode, 0 or 1 as in the file
+ * @param ndims       the size of each mode, or NULL for one past the largest index of each column
+ * @param tk          the number of threads
+ */
+int sptImportArrowSparseTensor(
+    sptSparseTensor *tsr,
+    struct ArrowSchema const * schema,
+    struct ArrowArray const * array,
+    sptIndex const nmodes,
+    sptIndex const start_index,
+    const sptIndex ndims[],
+    int const tk)
+{
+    if(schema->format == NULL || strcmp(schema->format, "+s") != 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "expected a struct array, one column per mode then the values");
+    }
+    if(nmodes == 0 || (schema->n_children != (int64_t) nmodes && schema->n_children != (int64_t) nmodes + 1) ||
+        array->n_children != schema->n_children) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Arrow", "expected nmodes or nmodes + 1 columns");
+    }
+    if(array->null_count > 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Arrow", "null rows are not supported");
+    }
+    sptNnzIndex const nnz = (sptNnzIndex) array->length;
+    tsr->nmodes = nmodes;
+    tsr->nnz = nnz;
+    tsr->sortorder = malloc(nmodes * sizeof *tsr->sortorder);
+    spt_CheckOSError(!tsr->sortorder, "SpTns Arrow");
+    tsr->ndims = malloc(nmodes * sizeof *tsr->ndims);
+    spt_CheckOSError(!tsr->ndims, "SpTns Arrow");
+    tsr->inds = malloc(nmodes * sizeof *tsr->inds);
+    spt_CheckOSError(!tsr->inds, "SpTns Arrow");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->sortorder[m] = m;
+        tsr->ndims[m] = ndims != NULL ? ndims[m] : 0;
+        int result = spt_ArrowImportIndices(&tsr->inds[m], &tsr->ndims[m], schema->children[m],
+            array->children[m], array->offset, array->length, start_index, tk);
+        spt_CheckError(result, "SpTns Arrow", NULL);
+    }
+    if(schema->n_children > (int64_t) nmodes) {
+        int result = spt_ArrowImportValues(&tsr->values, schema->children[nmodes], array->children[nmodes],
+            array->offset, array->length, tk);
+        spt_CheckError(result, "SpTns Arrow", NULL);
+    } else {
+        tsr->values.len = 0;
+        tsr->values.cap = 0;
+        tsr->values.data = NULL;
+    }
+    tsr->cache = NULL;
+    return 0;
+}
+
+/**
+ * Release a sparse tensor made by sptImportArrowSparseTensor: the columns
+ * it converted are freed, those it used in place are left to the array,
+ * which the caller may release after this.
+ * @param tsr   the imported tensor
+ * @param array the batch it was imported from
+ */
+void sptUnwrapArrowSparseTensor(sptSparseTensor *tsr, struct ArrowArray const * array) {
+    for(sptIndex m = 0; m <= tsr->nmodes && (int64_t) m < array->n_children; ++m) {
+        struct ArrowArray const * const column = array->children[m];
+        size_t const width = m < tsr->nmodes ? sizeof (sptIndex) : sizeof (sptValue);
+        void * const data = m < tsr->nmodes ? (void *) tsr->inds[m].data : (void *) tsr->values.data;
+        /* In place exactly when it points at the first row of the column's buffer */
+        if(data != (char const *) column->buffers[1] + (column->offset + array->offset) * width) {
+            free(data);
+        }
+    }
+    sptUnwrapSparseTensor(tsr);
+}
@@ -0,0 +1,570 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sptensor.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SPT_HAVE_IO_URING 1
+#endif
+#endif
+
+/*
+ * Asynchronous file reader of the streaming kernels.
+ *
+ * Reads are cut into chunks of SPT_ASYNC_CHUNK bytes and queued; a group
+ * collects the reads of one buffer, so that a caller waits for exactly the
+ * buffer it is about to use. Where io_uring is available, one service thread
+ * keeps up to `depth` chunks in flight through the file opened with
+ * O_DIRECT: each chunk is read, block aligned, into a registered staging
+ * slot and copied to its destination, bypassing the page cache that a
+ * single pass over the file would only pollute. Elsewhere, or when the
+ * kernel refuses io_uring, a pool of `depth` threads serves the chunks with
+ * pread.
+ */
+
+#define SPT_ASYNC_CHUNK (1u << 20)
+#define SPT_ASYNC_ALIGN 4096u
+#define SPT_ASYNC_MAX_THREADS 64
+#define SPT_STREAM_QUEUE_DEPTH_DEFAULT 32
+#define SPT_STREAM_PREFETCH_DEFAULT 1
+
+static int spt_stream_queue_depth = -1;
+static int spt_stream_prefetch = -1;
+static int spt_stream_uring = -1;
+
+/* Reads in flight, from PARTI_STREAM_QUEUE_DEPTH until sptSetStreamQueueDepth is called */
+int spt_StreamQueueDepth(void) {
+    if(spt_stream_queue_depth < 0) {
+        char const * env = getenv("PARTI_STREAM_QUEUE_DEPTH");
+        spt_stream_queue_depth = env != NULL ? atoi(env) : SPT_STREAM_QUEUE_DEPTH_DEFAULT;
+        if(spt_stream_queue_depth < 1) {
+            spt_stream_queue_depth = 1;
+        }
+    }
+    return spt_stream_queue_depth;
+}
+
+/* Shards read ahead, from PARTI_STREAM_PREFETCH until sptSetStreamPrefetchDistance is called */
+sptIndex spt_StreamPrefetchDistance(void) {
+    if(spt_stream_prefetch < 0) {
+        char const * env = getenv("PARTI_STREAM_PREFETCH");
+        spt_stream_prefetch = env != NULL ? atoi(env) : SPT_STREAM_PREFETCH_DEFAULT;
+        if(spt_stream_prefetch < 0) {
+            spt_stream_prefetch = 0;
+        }
+    }
+    return (sptIndex) spt_stream_prefetch;
+}
+
+/* Whether io_uring is tried, from PARTI_STREAM_URING until sptSetStreamIoUring is called */
+static int spt_StreamIoUringEnabled(void) {
+    if(spt_stream_uring < 0) {
+        char const * env = getenv("PARTI_STREAM_URING");
+        spt_stream_uring = env == NULL || atoi(env) != 0;
+    }
+    return spt_stream_uring;
+}
+
+/**
+ * Set how many reads the streaming kernels keep in flight, each of up to
+ * 1 MB: the io_uring queue depth, or the number of reader threads of the
+ * pread fallback, which is capped at 64.
+ * Defaults to the PARTI_STREAM_QUEUE_DEPTH environment variable, else 32.
+ * @param depth  the number of concurrent reads, at least 1
+ */
+int sptSetStreamQueueDepth(int const depth) {
+    if(depth < 1 || depth > 1024) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Stream", "queue depth out of range");
+    }
+    spt_stream_queue_depth = depth;
+    return 0;
+}
+
+/**
+ * Set how many shards the streaming kernels read ahead of the one being
+ * computed. Each costs one more shard buffer; 0 reads every shard when it
+ * is needed, without overlap.
+ * Defaults to the PARTI_STREAM_PREFETCH environment variable, else 1.
+ * @param distance  the number of shards read ahead
+ */
+int sptSetStreamPrefetchDistance(sptIndex const distance) {
+    if(distance > 1024) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Stream", "prefetch distance too large");
+    }
+    spt_stream_prefetch = (int) distance;
+    return 0;
+}
+
+/**
+ * Choose between io_uring and the pread thread pool for the streaming
+ * kernels. io_uring is still only used where the kernel allows it.
+ * Defaults to the PARTI_STREAM_URING environment variable, else on.
+ * @param enable  1 to try io_uring, 0 to always use pread
+ */
+int sptSetStreamIoUring(int const enable) {
+    spt_stream_uring = enable != 0;
+    return 0;
+}
+
+
+int spt_PreadAll(int fd, void * dst, size_t bytes, uint64_t offset)
+{
+    char * p = dst;
+    while(bytes != 0) {
+        ssize_t got = pread(fd, p, bytes, (off_t) offset);
+        if(got < 0 && errno == EINTR) {
+            continue;
+        }
+        if(got == 0) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Stream Read", "file is truncated");
+        }
+        spt_CheckOSError(got < 0, "SpTns Stream Read");
+        p += got;
+        bytes -= (size_t) got;
+        offset += (uint64_t) got;
+    }
+    return 0;
+}
+
+
+typedef struct {
+    int group;
+    char * dst;
+    size_t bytes;
+    uint64_t offset;
+} spt_AsyncChunk;
+
+#ifdef SPT_HAVE_IO_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned * sq_head, * sq_tail, * sq_mask, * sq_array;
+    unsigned * cq_head, * cq_tail, * cq_mask;
+    struct io_uring_sqe * sqes;
+    struct io_uring_cqe * cqes;
+    void * sq_map, * cq_map;
+    size_t sq_map_bytes, cq_map_bytes;
+    size_t sqes_bytes;
+    int fixed;                  /// staging slots are registered buffers
+    int direct_fd;              /// the O_DIRECT descriptor, -1 if the file system refuses it
+    char * staging;             /// entries slots of spt_UringSlotBytes, page aligned
+    spt_AsyncChunk * slot_chunks;
+    unsigned * free_slots;
+    unsigned nfree;
+} spt_Uring;
+#endif
+
+struct spt_AsyncReader {
+    int fd;
+    int ngroups;
+    int depth;
+    int uring;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /// chunks queued or stop requested
+    pthread_cond_t done;        /// a group finished
+    spt_AsyncChunk * queue;
+    size_t queue_head, queue_len, queue_cap;
+    size_t * pending;           /// chunks not yet finished, per group
+    int * errors;               /// first error, per group
+    int stop;
+    int nthreads;
+    pthread_t * threads;
+#ifdef SPT_HAVE_IO_URING
+    spt_Uring ring;
+#endif
+};
+
+/* Take the oldest queued chunk; the lock is held */
+static spt_AsyncChunk spt_AsyncPop(spt_AsyncReader * r) {
+    spt_AsyncChunk const c = r->queue[r->queue_head];
+    r->queue_head = (r->queue_head + 1) % r->queue_cap;
+    --r->queue_len;
+    return c;
+}
+
+/* Account for a finished chunk; the lock is held */
+static void spt_AsyncFinish(spt_AsyncReader * r, int const group, int const result) {
+    if(result != 0 && r->errors[group] == 0) {
+        r->errors[group] = result;
+    }
+    if(--r->pending[group] == 0) {
+        pthread_cond_broadcast(&r->done);
+    }
+}
+
+static void * spt_AsyncPreadThread(void * arg) {
+    spt_AsyncReader * r = arg;
+    pthread_mutex_lock(&r->lock);
+    for(;;) {
+        while(r->queue_len == 0 && !r->stop) {
+            pthread_cond_wait(&r->work, &r->lock);
+        }
+        if(r->queue_len == 0) {
+            break;
+        }
+        spt_AsyncChunk const c = spt_AsyncPop(r);
+        pthread_mutex_unlock(&r->lock);
+        int const result = spt_PreadAll(r->fd, c.dst, c.bytes, c.offset);
+        pthread_mutex_lock(&r->lock);
+        spt_AsyncFinish(r, c.group, result);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+
+#ifdef SPT_HAVE_IO_URING
+/* A chunk plus the block alignment of its start and end */
+static size_t spt_UringSlotBytes(void) {
+    return SPT_ASYNC_CHUNK + 2 * SPT_ASYNC_ALIGN;
+}
+
+static void spt_UringClose(spt_Uring * u) {
+    if(u->sq_map != NULL && u->sq_map != MAP_FAILED) {
+        munmap(u->sq_map, u->sq_map_bytes);
+    }
+    if(u->cq_map != NULL && u->cq_map != MAP_FAILED && u->cq_map != u->sq_map) {
+        munmap(u->cq_map, u->cq_map_bytes);
+    }
+    if(u->sqes != NULL && (void *) u->sqes != MAP_FAILED) {
+        munmap(u->sqes, u->sqes_bytes);
+    }
+    if(u->fd >= 0) {
+        close(u->fd);
+    }
+    if(u->direct_fd >= 0) {
+        close(u->direct_fd);
+    }
+    free(u->staging);
+    free(u->slot_chunks);
+    free(u->free_slots);
+}
+
+/* Set up a ring of `entries` reads on filename; nonzero if the kernel refuses it */
+static int spt_UringOpen(spt_Uring * u, const char * filename, unsigned const entries) {
+    memset(u, 0, sizeof *u);
+    u->fd = -1;
+    u->direct_fd = open(filename, O_RDONLY | O_DIRECT);
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    u->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if(u->fd < 0) {
+        spt_UringClose(u);
+        return -1;
+    }
+    u->entries = p.sq_entries;
+    u->sq_map_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_map_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(u->cq_map_bytes > u->sq_map_bytes) {
+            u->sq_map_bytes = u->cq_map_bytes;
+        }
+        u->cq_map_bytes = u->sq_map_bytes;
+    }
+    u->sq_map = mmap(NULL, u->sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    u->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? u->sq_map :
+        mmap(NULL, u->cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    u->sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sq_map == MAP_FAILED || u->cq_map == MAP_FAILED || (void *) u->sqes == MAP_FAILED) {
+        spt_UringClose(u);
+        return -1;
+    }
+    char * const sq = u->sq_map, * const cq = u->cq_map;
+    u->sq_head = (unsigned *) (sq + p.sq_off.head);
+    u->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *) (sq + p.sq_off.array);
+    u->cq_head = (unsigned *) (cq + p.cq_off.head);
+    u->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    size_t const slot_bytes = spt_UringSlotBytes();
+    void * staging = NULL;
+    u->slot_chunks = malloc(u->entries * sizeof *u->slot_chunks);
+    u->free_slots = malloc(u->entries * sizeof *u->free_slots);
+    if(posix_memalign(&staging, SPT_ASYNC_ALIGN, u->entries * slot_bytes) != 0 ||
+        u->slot_chunks == NULL || u->free_slots == NULL) {
+        u->staging = staging;
+        spt_UringClose(u);
+        return -1;
+    }
+    u->staging = staging;
+    for(unsigned s = 0; s < u->entries; ++s) {
+        u->free_slots[s] = u->entries - 1 - s;
+    }
+    u->nfree = u->entries;
+
+    /* Registered slots spare the kernel pinning them on every read; without them plain reads do */
+    struct iovec * iov = malloc(u->entries * sizeof *iov);
+    if(iov != NULL) {
+        for(unsigned s = 0; s < u->entries; ++s) {
+            iov[s].iov_base = u->staging + s * slot_bytes;
+            iov[s].iov_len = slot_bytes;
+        }
+        u->fixed = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, u->entries) == 0;
+        free(iov);
+    }
+    return 0;
+}
+
+/* Queue the read of chunk c into a free slot; the caller submits */
+static void spt_UringPrepare(spt_Uring * u, int const buffered_fd, spt_AsyncChunk const * c) {
+    unsigned const slot = u->free_slots[--u->nfree];
+    uint64_t const start = c->offset / SPT_ASYNC_ALIGN * SPT_ASYNC_ALIGN;
+    uint64_t const end = (c->offset + c->bytes + SPT_ASYNC_ALIGN - 1) / SPT_ASYNC_ALIGN * SPT_ASYNC_ALIGN;
+    u->slot_chunks[slot] = *c;
+
+    unsigned const tail = *u->sq_tail;
+    unsigned const index = tail & *u->sq_mask;
+    struct io_uring_sqe * const sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = u->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = u->direct_fd >= 0 ? u->direct_fd : buffered_fd;
+    sqe->off = start;
+    sqe->addr = (uintptr_t) (u->staging + slot * spt_UringSlotBytes());
+    sqe->len = (unsigned) (end - start);
+    sqe->buf_index = (uint16_t) slot;
+    sqe->user_data = slot;
+    u->sq_array[index] = index;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Copy a completed read to its destination, finishing it with pread if it came up short */
+static int spt_UringComplete(spt_AsyncReader * r, unsigned const slot, int const res) {
+    spt_Uring * const u = &r->ring;
+    spt_AsyncChunk const * const c = &u->slot_chunks[slot];
+    size_t const head = (size_t) (c->offset % SPT_ASYNC_ALIGN);
+    if(res == -EINVAL && u->direct_fd >= 0) {
+        /* The file system takes O_DIRECT opens but not the reads: go buffered from now on */
+        close(u->direct_fd);
+        u->direct_fd = -1;
+    }
+    if(res < 0 && res != -EINVAL && res != -EAGAIN && res != -EINTR) {
+        spt_CheckError(SPTERR_OS_ERROR - res, "SpTns Stream Read", strerror(-res));
+    }
+    size_t const got = res > (int) head ? (size_t) res - head : 0;
+    size_t const used = got < c->bytes ? got : c->bytes;
+    memcpy(c->dst, u->staging + slot * spt_UringSlotBytes() + head, used);
+    if(used < c->bytes) {
+        int const result = spt_PreadAll(r->fd, c->dst + used, c->bytes - used, c->offset + used);
+        spt_CheckError(result, "SpTns Stream Read", NULL);
+    }
+    return 0;
+}
+
+static void * spt_AsyncUringThread(void * arg) {
+    spt_AsyncReader * r = arg;
+    spt_Uring * const u = &r->ring;
+    unsigned inflight = 0;
+    pthread_mutex_lock(&r->lock);
+    for(;;) {
+        unsigned nsubmit = 0;
+        while(r->queue_len != 0 && u->nfree != 0) {
+            spt_AsyncChunk const c = spt_AsyncPop(r);
+            spt_UringPrepare(u, r->fd, &c);
+            ++nsubmit;
+        }
+        if(nsubmit == 0 && inflight == 0) {
+            if(r->stop) {
+                break;
+            }
+            pthread_cond_wait(&r->work, &r->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&r->lock);
+
+        inflight += nsubmit;
+        while(nsubmit != 0) {
+            long const ret = syscall(__NR_io_uring_enter, u->fd, nsubmit, 0, 0, NULL, 0);
+            if(ret < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            sptAssert(ret > 0);
+            nsubmit -= (unsigned) ret;
+        }
+        /* Wait for at least one read, then reap all that are done */
+        unsigned head = *u->cq_head;
+        while(head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+            long const ret = syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            sptAssert(ret >= 0 || errno == EINTR);
+        }
+        unsigned const tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        unsigned const ndone = tail - head;
+        unsigned done_slots[ndone];
+        int results[ndone];
+        for(unsigned i = 0; head != tail; ++head, ++i) {
+            struct io_uring_cqe const * const cqe = &u->cqes[head & *u->cq_mask];
+            done_slots[i] = (unsigned) cqe->user_data;
+            results[i] = spt_UringComplete(r, done_slots[i], cqe->res);
+        }
+        __atomic_store_n(u->cq_head, tail, __ATOMIC_RELEASE);
+        inflight -= ndone;
+
+        pthread_mutex_lock(&r->lock);
+        for(unsigned i = 0; i < ndone; ++i) {
+            spt_AsyncFinish(r, u->slot_chunks[done_slots[i]].group, results[i]);
+            u->free_slots[u->nfree++] = done_slots[i];
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+#endif
+
+
+/**
+ * Open filename for asynchronous reads gathered in ngroups groups, served by
+ * io_uring when possible, else by a pread thread pool.
+ */
+int spt_AsyncReaderOpen(spt_AsyncReader ** reader, const char * filename, int const ngroups)
+{
+    spt_AsyncReader * r = calloc(1, sizeof *r);
+    spt_CheckOSError(r == NULL, "SpTns Stream Open");
+    r->fd = open(filename, O_RDONLY);
+    spt_CheckOSError(r->fd < 0, "SpTns Stream Open");
+    r->ngroups = ngroups;
+    r->depth = spt_StreamQueueDepth();
+    r->queue_cap = 64;
+    r->queue = malloc(r->queue_cap * sizeof *r->queue);
+    r->pending = calloc(ngroups, sizeof *r->pending);
+    r->errors = calloc(ngroups, sizeof *r->errors);
+    spt_CheckOSError(!r->queue || !r->pending || !r->errors, "SpTns Stream Open");
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->work, NULL);
+    pthread_cond_init(&r->done, NULL);
+
+#ifdef SPT_HAVE_IO_URING
+    r->uring = spt_StreamIoUringEnabled() && spt_UringOpen(&r->ring, filename, (unsigned) r->depth) == 0;
+#else
+    (void) spt_StreamIoUringEnabled;
+#endif
+    r->nthreads = r->uring ? 1 : (r->depth < SPT_ASYNC_MAX_THREADS ? r->depth : SPT_ASYNC_MAX_THREADS);
+    r->threads = malloc(r->nthreads * sizeof *r->threads);
+    spt_CheckOSError(!r->threads, "SpTns Stream Open");
+    for(int t = 0; t < r->nthreads; ++t) {
+#ifdef SPT_HAVE_IO_URING
+        void * (* const body)(void *) = r->uring ? spt_AsyncUringThread : spt_AsyncPreadThread;
+#else
+        void * (* const body)(void *) = spt_AsyncPreadThread;
+#endif
+        int const result = pthread_create(&r->threads[t], NULL, body, r);
+        if(result != 0) {
+            r->nthreads = t;
+            spt_AsyncReaderClose(r);
+            spt_CheckError(SPTERR_OS_ERROR + result, "SpTns Stream Open", "cannot start reader thread");
+        }
+    }
+    *reader = r;
+    return 0;
+}
+
+/* Whether reads go through io_uring */
+int spt_AsyncReaderUsesUring(spt_AsyncReader const * r) {
+    return r->uring;
+}
+
+/* Queue the read of bytes at offset into dst, as part of group */
+int spt_AsyncReaderSubmit(spt_AsyncReader * r, int const group, void * dst, size_t const bytes, uint64_t const offset)
+{
+    pthread_mutex_lock(&r->lock);
+    size_t const nchunks = (bytes + SPT_ASYNC_CHUNK - 1) / SPT_ASYNC_CHUNK;
+    if(r->queue_len + nchunks > r->queue_cap) {
+        size_t cap = r->queue_cap;
+        while(r->queue_len + nchunks > cap) {
+            cap *= 2;
+        }
+        spt_AsyncChunk * const queue = malloc(cap * sizeof *queue);
+        if(queue == NULL) {
+            pthread_mutex_unlock(&r->lock);
+            spt_CheckOSError(1, "SpTns Stream Read");
+        }
+        for(size_t i = 0; i < r->queue_len; ++i) {
+            queue[i] = r->queue[(r->queue_head + i) % r->queue_cap];
+        }
+        free(r->queue);
+        r->queue = queue;
+        r->queue_head = 0;
+        r->queue_cap = cap;
+    }
+    for(size_t k = 0; k < nchunks; ++k) {
+        size_t const pos = k * SPT_ASYNC_CHUNK;
+        spt_AsyncChunk * const c = &r->queue[(r->queue_head + r->queue_len++) % r->queue_cap];
+        c->group = group;
+        c->dst = (char *) dst + pos;
+        c->bytes = bytes - pos < SPT_ASYNC_CHUNK ? bytes - pos : SPT_ASYNC_CHUNK;
+        c->offset = offset + pos;
+    }
+    r->pending[group] += nchunks;
+    pthread_cond_broadcast(&r->work);
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+/* Wait for all reads of group; returns the first error among them */
+int spt_AsyncReaderWait(spt_AsyncReader * r, int const group)
+{
+    pthread_mutex_lock(&r->lock);
+    while(r->pending[group] != 0) {
+        pthread_cond_wait(&r->done, &r->lock);
+    }
+    int const result = r->errors[group];
+    r->errors[group] = 0;
+    pthread_mutex_unlock(&r->lock);
+    spt_CheckError(result, "SpTns Stream Read", NULL);
+    return 0;
+}
+
+/* Finish the queued reads and release the reader */
+void spt_AsyncReaderClose(spt_AsyncReader * r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->work);
+    pthread_mutex_unlock(&r->lock);
+    for(int t = 0; t < r->nthreads; ++t) {
+        pthread_join(r->threads[t], NULL);
+    }
+#ifdef SPT_HAVE_IO_URING
+    if(r->uring) {
+        spt_UringClose(&r->ring);
+    }
+#endif
+    pthread_cond_destroy(&r->done);
+    pthread_cond_destroy(&r->work);
+    pthread_mutex_destroy(&r->lock);
+    close(r->fd);
+    free(r->threads);
+    free(r->queue);
+    free(r->pending);
+    free(r->errors);
+    free(r);
+}
@@ -0,0 +1,492 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*************************************************
+ * PRIVATE FUNCTIONS
+ *************************************************/
+/**
+ * Byte offset of the first index array, right after the header, ndims, sortorder and fingerprint.
+ */
+uint64_t spt_SparseTensorBinaryDataOffset(sptIndex const nmodes)
+{
+    return spt_BinaryAlignUp(spt_SparseTensorBinaryHeadBytes(nmodes, PARTI_BINARY_VERSION));
+}
+
+/**
+ * Total file size of a binary sparse tensor with the given shape and widths.
+ */
+uint64_t spt_SparseTensorBinaryFileSize(spt_SparseTensorBinaryHeader const * const header)
+{
+    uint64_t const ind_bytes = spt_BinaryAlignUp(header->nnz * header->index_width);
+    uint64_t const val_bytes = spt_BinaryAlignUp(header->nnz * header->value_width);
+    return header->data_offset + header->nmodes * ind_bytes + val_bytes;
+}
+
+/**
+ * Validate a binary header, used by every binary reader.
+ */
+int spt_SparseTensorBinaryCheckHeader(spt_SparseTensorBinaryHeader const * const header)
+{
+    if(memcmp(header->magic, PARTI_BINARY_MAGIC, sizeof header->magic) != 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "not a ParTI binary tensor");
+    }
+    if(header->endian != PARTI_BINARY_ENDIAN) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "byte order mismatch");
+    }
+    if(header->version > PARTI_BINARY_VERSION) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "unsupported format version");
+    }
+    if(header->index_width != 2 && header->index_width != 4 && header->index_width != 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "unsupported index width");
+    }
+    if(header->value_width != 4 && header->value_width != 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "unsupported value width");
+    }
+    if(header->data_offset < spt_BinaryAlignUp(spt_SparseTensorBinaryHeadBytes(header->nmodes, header->version))) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin", "corrupted header");
+    }
+    return 0;
+}
+
+static int spt_BinaryWritePadding(uint64_t const bytes, FILE *fp)
+{
+    static const char zeros[PARTI_BINARY_ALIGN] = { 0 };
+    uint64_t const pad = spt_BinaryAlignUp(bytes) - bytes;
+    if(pad != 0) {
+        size_t iores = fwrite(zeros, 1, pad, fp);
+        spt_CheckOSError(iores != pad, "SpTns Bin Dump");
+    }
+    return 0;
+}
+
+/**
+ * Read past `bytes` bytes of fp, which need not be seekable.
+ */
+int spt_BinarySkip(uint64_t bytes, FILE *fp)
+{
+    char buf[PARTI_BINARY_ALIGN];
+    while(bytes != 0) {
+        size_t chunk = bytes < sizeof buf ? bytes : sizeof buf;
+        size_t iores = fread(buf, 1, chunk, fp);
+        spt_CheckOSError(iores != chunk, "SpTns Bin Load");
+        bytes -= chunk;
+    }
+    return 0;
+}
+
+
+/* Write n indices narrowed to `width` bytes, the caller checked they fit */
+static int spt_BinaryWriteIndices(sptIndex const * const inds, sptNnzIndex const n, uint32_t const width, FILE *fp)
+{
+    size_t iores;
+    if(width == sizeof(sptIndex)) {
+        iores = fwrite(inds, sizeof(sptIndex), n, fp);
+        spt_CheckOSError(iores != n, "SpTns Bin Dump");
+        return 0;
+    }
+    enum { CHUNK = 4096 };
+    uint64_t buf[CHUNK];
+    for(sptNnzIndex z = 0; z < n; z += CHUNK) {
+        size_t const len = n - z < CHUNK ? n - z : CHUNK;
+        for(size_t i = 0; i < len; ++i) {
+            if(width == 2) {
+                ((uint16_t *) buf)[i] = (uint16_t) inds[z + i];
+            } else if(width == 4) {
+                ((uint32_t *) buf)[i] = (uint32_t) inds[z + i];
+            } else {
+                buf[i] = inds[z + i];
+            }
+        }
+        iores = fwrite(buf, width, len, fp);
+        spt_CheckOSError(iores != len, "SpTns Bin Dump");
+    }
+    return 0;
+}
+
+/* Write n values converted to `width` bytes */
+static int spt_BinaryWriteValues(sptValue const * const vals, sptNnzIndex const n, uint32_t const width, FILE *fp)
+{
+    size_t iores;
+    if(width == sizeof(sptValue)) {
+        iores = fwrite(vals, sizeof(sptValue), n, fp);
+        spt_CheckOSError(iores != n, "SpTns Bin Dump");
+        return 0;
+    }
+    enum { CHUNK = 4096 };
+    double buf[CHUNK];
+    for(sptNnzIndex z = 0; z < n; z += CHUNK) {
+        size_t const len = n - z < CHUNK ? n - z : CHUNK;
+        for(size_t i = 0; i < len; ++i) {
+            if(width == 4) {
+                ((float *) buf)[i] = (float) vals[z + i];
+            } else {
+                buf[i] = (double) vals[z + i];
+            }
+        }
+        iores = fwrite(buf, width, len, fp);
+        spt_CheckOSError(iores != len, "SpTns Bin Dump");
+    }
+    return 0;
+}
+
+
+/*************************************************
+ * PUBLIC FUNCTIONS
+ *************************************************/
+/**
+ * Save a sparse tensor into the binary container.
+ *
+ * The file starts with a versioned header (nmodes, nnz, index and value
+ * widths), followed by ndims, sortorder and the tensor's
+ * sptSparseTensorFingerprint, then the nmodes index arrays and the value array, each aligned to PARTI_BINARY_ALIGN bytes so that the
+ * file can be mapped directly by sptMmapSparseTensor.
+ *
+ * @param tsr the sparse tensor to write
+ * @param fp  the file to write into, opened in binary mode
+ */
+int sptDumpSparseTensorBinary(const sptSparseTensor *tsr, FILE *fp)
+{
+    return sptDumpSparseTensorBinaryWidths(tsr, fp, sizeof(sptIndex), sizeof(sptValue));
+}
+
+
+/**
+ * Save a sparse tensor into the binary container with chosen storage widths,
+ * e.g. 16-bit indices for small modes or float values from a double build.
+ * sptLoadSparseTensorBinary converts them back to sptIndex and sptValue;
+ * sptMmapSparseTensor only accepts files with this build's widths.
+ *
+ * @param tsr         the sparse tensor to write
+ * @param fp          the file to write into, opened in binary mode
+ * @param index_width bytes per index, 2, 4 or 8; 0 picks the smallest one all ndims fit in
+ * @param value_width bytes per value, 4 or 8
+ */
+int sptDumpSparseTensorBinaryWidths(const sptSparseTensor *tsr, FILE *fp, uint32_t index_width, uint32_t const value_width)
+{
+    size_t iores;
+    uint64_t const max_dim = tsr->nmodes > 0 ? sptMaxIndexArray(tsr->ndims, tsr->nmodes) : 0;
+    if(index_width == 0) {
+        index_width = max_dim <= UINT16_MAX + 1ULL ? 2 : (max_dim <= UINT32_MAX + 1ULL ? 4 : 8);
+    }
+    if(index_width != 2 && index_width != 4 && index_width != 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin Dump", "unsupported index width");
+    }
+    if(index_width < 8 && max_dim > (1ULL << (8 * index_width))) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin Dump", "a dimension does not fit the index width");
+    }
+    if(value_width != 4 && value_width != 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin Dump", "unsupported value width");
+    }
+
+    spt_SparseTensorBinaryHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_BINARY_MAGIC, sizeof header.magic);
+    header.version = PARTI_BINARY_VERSION;
+    header.endian = PARTI_BINARY_ENDIAN;
+    header.nmodes = tsr->nmodes;
+    header.index_width = index_width;
+    header.value_width = value_width;
+    header.nnz = tsr->nnz;
+    header.data_offset = spt_SparseTensorBinaryDataOffset(tsr->nmodes);
+
+    iores = fwrite(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Bin Dump");
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        uint64_t dim = tsr->ndims[m];
+        iores = fwrite(&dim, sizeof dim, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Bin Dump");
+    }
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        uint32_t order = tsr->sortorder[m];
+        iores = fwrite(&order, sizeof order, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Bin Dump");
+    }
+    uint64_t const fingerprint = sptSparseTensorFingerprint(tsr);
+    iores = fwrite(&fingerprint, sizeof fingerprint, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Bin Dump");
+    int result = spt_BinaryWritePadding(spt_SparseTensorBinaryHeadBytes(tsr->nmodes, PARTI_BINARY_VERSION), fp);
+    spt_CheckError(result, "SpTns Bin Dump", NULL);
+
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        result = spt_BinaryWriteIndices(tsr->inds[m].data, tsr->nnz, index_width, fp);
+        spt_CheckError(result, "SpTns Bin Dump", NULL);
+        result = spt_BinaryWritePadding(tsr->nnz * index_width, fp);
+        spt_CheckError(result, "SpTns Bin Dump", NULL);
+    }
+    result = spt_BinaryWriteValues(tsr->values.data, tsr->nnz, value_width, fp);
+    spt_CheckError(result, "SpTns Bin Dump", NULL);
+    result = spt_BinaryWritePadding(tsr->nnz * value_width, fp);
+    spt_CheckError(result, "SpTns Bin Dump", NULL);
+
+    return 0;
+}
+
+
+/**
+ * Load a sparse tensor from the binary container into newly allocated memory.
+ *
+ * Index and value widths stored in the file are converted to sptIndex and
+ * sptValue when they differ from this build. The stored fingerprint, if the
+ * file has one, becomes the tensor's sptSparseTensorFingerprint.
+ *
+ * @param tsr an uninitialized sparse tensor
+ * @param fp  the file to read from, opened in binary mode
+ */
+int sptLoadSparseTensorBinary(sptSparseTensor *tsr, FILE *fp)
+{
+    size_t iores;
+    int result;
+    spt_SparseTensorBinaryHeader header;
+    iores = fread(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Bin Load");
+    result = spt_SparseTensorBinaryCheckHeader(&header);
+    spt_CheckError(result, "SpTns Bin Load", NULL);
+
+    sptIndex const nmodes = header.nmodes;
+    sptNnzIndex const nnz = header.nnz;
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "SpTns Bin Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        uint64_t dim;
+        iores = fread(&dim, sizeof dim, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Bin Load");
+        if(dim > PARTI_INDEX_MAX) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin Load", "dimension exceeds sptIndex");
+        }
+        ndims[m] = (sptIndex) dim;
+    }
+    result = sptNewSparseTensor(tsr, nmodes, ndims);
+    spt_CheckError(result, "SpTns Bin Load", NULL);
+    free(ndims);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        uint32_t order;
+        iores = fread(&order, sizeof order, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Bin Load");
+        tsr->sortorder[m] = order;
+    }
+    uint64_t fingerprint = 0;
+    if(header.version >= 2) {
+        iores = fread(&fingerprint, sizeof fingerprint, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Bin Load");
+    }
+    result = spt_BinarySkip(header.data_offset - spt_SparseTensorBinaryHeadBytes(nmodes, header.version), fp);
+    spt_CheckError(result, "SpTns Bin Load", NULL);
+
+    tsr->nnz = nnz;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&tsr->inds[m], nnz);
+        spt_CheckError(result, "SpTns Bin Load", NULL);
+        sptIndex * const inds = tsr->inds[m].data;
+        if(header.index_width == sizeof(sptIndex)) {
+            iores = fread(inds, sizeof(sptIndex), nnz, fp);
+            spt_CheckOSError(iores != nnz, "SpTns Bin Load");
+        } else if(header.index_width == 2) {
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                uint16_t idx;
+                iores = fread(&idx, sizeof idx, 1, fp);
+                spt_CheckOSError(iores != 1, "SpTns Bin Load");
+                inds[z] = (sptIndex) idx;
+            }
+        } else if(header.index_width == 4) {
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                uint32_t idx;
+                iores = fread(&idx, sizeof idx, 1, fp);
+                spt_CheckOSError(iores != 1, "SpTns Bin Load");
+                inds[z] = (sptIndex) idx;
+            }
+        } else {
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                uint64_t idx;
+                iores = fread(&idx, sizeof idx, 1, fp);
+                spt_CheckOSError(iores != 1, "SpTns Bin Load");
+                if(idx > PARTI_INDEX_MAX) {
+                    spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Bin Load", "index exceeds sptIndex");
+                }
+                inds[z] = (sptIndex) idx;
+            }
+        }
+        result = spt_BinarySkip(spt_BinaryAlignUp(nnz * header.index_width) - nnz * header.index_width, fp);
+        spt_CheckError(result, "SpTns Bin Load", NULL);
+    }
+
+    result = sptResizeValueVector(&tsr->values, nnz);
+    spt_CheckError(result, "SpTns Bin Load", NULL);
+    sptValue * const vals = tsr->values.data;
+    if(header.value_width == sizeof(sptValue)) {
+        iores = fread(vals, sizeof(sptValue), nnz, fp);
+        spt_CheckOSError(iores != nnz, "SpTns Bin Load");
+    } else if(header.value_width == 4) {
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            float val;
+            iores = fread(&val, sizeof val, 1, fp);
+            spt_CheckOSError(iores != 1, "SpTns Bin Load");
+            vals[z] = (sptValue) val;
+        }
+    } else {
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            double val;
+            iores = fread(&val, sizeof val, 1, fp);
+            spt_CheckOSError(iores != 1, "SpTns Bin Load");
+            vals[z] = (sptValue) val;
+        }
+    }
+    if(header.version >= 2) {
+        spt_SparseTensorSetFingerprint(tsr, fingerprint);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Map a binary sparse tensor file into memory without copying.
+ *
+ * `inds[m].data` and `values.data` point straight into the mapped pages, so
+ * loading costs O(nmodes) regardless of nnz. The mapping is private
+ * (copy-on-write): in-place kernels such as sorting work, but the file is
+ * never modified. The index and value arrays must not be grown or freed;
+ * release the tensor with sptUnmapSparseTensor instead of sptFreeSparseTensor.
+ * The file must have been written with the index and value widths of this build.
+ *
+ * @param tsr      an uninitialized sparse tensor
+ * @param filename the binary file to map
+ */
+int sptMmapSparseTensor(sptSparseTensor *tsr, const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    spt_CheckOSError(fd < 0, "SpTns Mmap");
+    return spt_MmapSparseTensorFd(tsr, fd);
+}
+
+
+/**
+ * Map the binary sparse tensor behind fd as sptMmapSparseTensor does; fd is
+ * closed in any case. Shared-memory segments come through here too.
+ */
+int spt_MmapSparseTensorFd(sptSparseTensor *tsr, int fd)
+{
+    struct stat st;
+    int result = fstat(fd, &st);
+    if(result != 0) {
+        close(fd);
+        spt_CheckOSError(1, "SpTns Mmap");
+    }
+    if((uint64_t) st.st_size < sizeof(spt_SparseTensorBinaryHeader)) {
+        close(fd);
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Mmap", "file too small");
+    }
+    char * base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    spt_CheckOSError(base == MAP_FAILED, "SpTns Mmap");
+
+    spt_SparseTensorBinaryHeader const * const header = (spt_SparseTensorBinaryHeader const *) base;
+    result = spt_SparseTensorBinaryCheckHeader(header);
+    if(result == 0 && (header->index_width != sizeof(sptIndex) || header->value_width != sizeof(sptValue))) {
+        result = SPTERR_VALUE_ERROR;
+        spt_ComplainError("SpTns Mmap", result, __FILE__, __LINE__, "index or value width differs from this build, use sptLoadSparseTensorBinary");
+    }
+    /* The header check bounds the offset for the file's version; the arrays are used in place, so it must be aligned */
+    if(result == 0 && spt_BinaryAlignUp(header->data_offset) != header->data_offset) {
+        result = SPTERR_VALUE_ERROR;
+        spt_ComplainError("SpTns Mmap", result, __FILE__, __LINE__, "unaligned data offset");
+    }
+    if(result == 0 && spt_SparseTensorBinaryFileSize(header) > (uint64_t) st.st_size) {
+        result = SPTERR_VALUE_ERROR;
+        spt_ComplainError("SpTns Mmap", result, __FILE__, __LINE__, "file truncated");
+    }
+    if(result != 0) {
+        munmap(base, st.st_size);
+        return result;
+    }
+
+    sptIndex const nmodes = header->nmodes;
+    sptNnzIndex const nnz = header->nnz;
+    uint64_t const * const file_ndims = (uint64_t const *) (base + sizeof *header);
+    uint32_t const * const file_sortorder = (uint32_t const *) (file_ndims + nmodes);
+
+    tsr->nmodes = nmodes;
+    tsr->nnz = nnz;
+    tsr->ndims = malloc(nmodes * sizeof *tsr->ndims);
+    spt_CheckOSError(!tsr->ndims, "SpTns Mmap");
+    tsr->sortorder = malloc(nmodes * sizeof *tsr->sortorder);
+    spt_CheckOSError(!tsr->sortorder, "SpTns Mmap");
+    tsr->inds = malloc(nmodes * sizeof *tsr->inds);
+    spt_CheckOSError(!tsr->inds, "SpTns Mmap");
+
+    char * data = base + header->data_offset;
+    uint64_t const ind_bytes = spt_BinaryAlignUp(nnz * sizeof(sptIndex));
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->ndims[m] = (sptIndex) file_ndims[m];
+        tsr->sortorder[m] = file_sortorder[m];
+        tsr->inds[m].len = nnz;
+        tsr->inds[m].cap = nnz;
+        tsr->inds[m].data = (sptIndex *) data;
+        data += ind_bytes;
+    }
+    tsr->values.len = nnz;
+    tsr->values.cap = nnz;
+    tsr->values.data = (sptValue *) data;
+    tsr->cache = NULL;
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(tsr);
+    if(cache == NULL) {
+        munmap(base, st.st_size);
+        spt_CheckOSError(1, "SpTns Mmap");
+    }
+    cache->mapped_offset = header->data_offset;
+    if(header->version >= 2) {
+        /* Stored by the writer, so keying a cache on the mapped tensor reads none of its nonzeros */
+        uint64_t fingerprint;
+        memcpy(&fingerprint, file_sortorder + nmodes, sizeof fingerprint);
+        spt_SparseTensorSetFingerprint(tsr, fingerprint);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Release a sparse tensor mapped by sptMmapSparseTensor
+ * @param tsr the mapped tensor
+ */
+void sptUnmapSparseTensor(sptSparseTensor *tsr)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    if(nmodes == 0) {
+        return;
+    }
+    char * base = (char *) tsr->inds[0].data - tsr->cache->mapped_offset;
+    spt_SparseTensorBinaryHeader const * const header = (spt_SparseTensorBinaryHeader const *) base;
+    munmap(base, spt_SparseTensorBinaryFileSize(header));
+    spt_SparseTensorFreeCache(tsr);
+    free(tsr->sortorder);
+    free(tsr->ndims);
+    free(tsr->inds);
+    tsr->nmodes = 0;
+    tsr->nnz = 0;
+}
@@ -0,0 +1,330 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/*
+ * Coupled matrix-tensor factorization: X ~ [[lambda; A_1 .. A_N]] and
+ * Y ~ A_c V^T share the factor of the coupled mode c, fitted by ALS on
+ *
+ *   ||X - [[lambda; A_1 .. A_N]]||^2 + ||Y - A_c V^T||^2.
+ *
+ * A_c solves against both: its right-hand side is the tensor MTTKRP plus Y V
+ * and its normal equations the Hadamard product of the other Gram matrices
+ * plus V^T V. V solves against Y^T A_c. Both products with Y run on CSR
+ * copies, so Y never leaves this driver between the two halves.
+ */
+
+/* Solve X G = B in place for the rows of X, G the full symmetric rank x rank neqs; Cholesky, else LU */
+static int spt_CmtfSolve(sptMatrix * const X, sptValue * const neqs, sptValue * const backup, sptIndex const rank, sptIndex const stride)
+{
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+  int nrhs = (int) X->nrows;
+  int info;
+  memcpy(backup, neqs, (size_t) rank * stride * sizeof *backup);
+  spt_potrf_(&uplo, &blas_rank, neqs, &blas_stride, &info);
+  if(info == 0) {
+    spt_potrs_(&uplo, &blas_rank, &nrhs, neqs, &blas_stride, X->values, &blas_stride, &info);
+  } else {
+    int * ipiv = malloc(rank * sizeof *ipiv);
+    spt_CheckOSError(!ipiv, "CPU  SpTns CMTF-ALS");
+    spt_gesv_(&blas_rank, &nrhs, backup, &blas_stride, ipiv, X->values, &blas_stride, &info);
+    free(ipiv);
+  }
+  if(info != 0) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns CMTF-ALS", "singular normal equations");
+  }
+  return 0;
+}
+
+/* ata = A^T A, upper triangle row-major */
+static void spt_CmtfGram(sptMatrix const * const A, sptMatrix * const ata, sptIndex const rank)
+{
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) A->stride;
+  int blas_nrows = (int) A->nrows;
+  spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+    A->values, &blas_stride, &beta, ata->values, &blas_stride);
+}
+
+/* sum_rs G_rs H_rs of two symmetric matrices given by their upper triangles */
+static double spt_CmtfGramDot(sptValue const * const G, sptValue const * const H, sptIndex const rank, sptIndex const stride)
+{
+  double dot = 0;
+  for(sptIndex r=0; r < rank; ++r) {
+    dot += G[r * stride + r] * H[r * stride + r];
+    for(sptIndex s=r+1; s < rank; ++s) {
+      dot += 2 * G[r * stride + s] * H[r * stride + s];
+    }
+  }
+  return dot;
+}
+
+
+static double OmpCmtfAlsStep(
+  sptSparseTensor const * const spten,
+  sptSparseMatrixCSR const * const Y,
+  sptSparseMatrixCSR const * const Yt,
+  sptIndex const coupled,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptMatrix * V,
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+  }
+  sptMatrix vtv, backup, rhs, yta;
+  sptAssert(sptNewMatrix(&vtv, rank, rank) == 0);
+  sptAssert(sptNewMatrix(&backup, rank, rank) == 0);
+  sptAssert(sptNewMatrix(&rhs, Y->nrows, rank) == 0);   /// MTTKRP + Y V of the coupled mode
+  sptAssert(sptNewMatrix(&yta, Yt->nrows, rank) == 0);  /// Y^T A_c
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    spt_CmtfGram(mats[m], ata[m], rank);
+  }
+  spt_CmtfGram(V, &vtv, rank);
+
+  /* The data are fixed during the decomposition, so their norms are computed only once. */
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double spmat_normsq = 0;
+  for(sptNnzIndex j=0; j < Y->nnz; ++j) {
+    spmat_normsq += Y->values.data[j] * Y->values.data[j];
+  }
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      // mats[nmodes]: row-major
+      sptAssert (sptOmpMTTKRP(spten, mats, mats_order, m, tk) == 0);
+
+      if(m != coupled) {
+        sptAssert ( sptOmpMatrixSolveNormalsGram(m, nmodes, ata, tmp_mat, mats[m], lambda, it != 0, tk) == 0 );
+        continue;
+      }
+
+      /* The coupled mode: rhs = MTTKRP + Y V against the other Gram matrices + V^T V */
+      sptAssert (sptSparseMatrixCSRSpMM(&rhs, Y, V, tk) == 0);
+#ifdef PARTI_USE_OPENMP
+      #pragma omp parallel for num_threads(tk)
+#endif
+      for(sptIndex i=0; i < rhs.nrows; ++i) {
+        for(sptIndex r=0; r < rank; ++r) {
+          rhs.values[i * stride + r] += tmp_mat->values[i * stride + r];
+        }
+      }
+      sptAssert (sptMatrixDotMulSeqTriangle(m, nmodes, ata) == 0);
+      sptValue * const neqs = ata[nmodes]->values;
+      for(sptIndex r=0; r < rank; ++r) {
+        for(sptIndex s=r; s < rank; ++s) {
+          neqs[r * stride + s] += vtv.values[r * stride + s];
+          if(s != r) {
+            neqs[s * stride + r] += vtv.values[r * stride + s];
+          }
+        }
+      }
+      sptAssert (spt_CmtfSolve(&rhs, neqs, backup.values, rank, stride) == 0);
+      memcpy(mats[m]->values, rhs.values, (size_t) rhs.nrows * stride * sizeof(sptValue));
+
+      /* Normalize A_c into lambda and move the same scale onto V, so Y's model A_c V^T is unchanged */
+      if(it != 0) {
+        sptMatrixMaxNorm(mats[m], lambda);
+      } else {
+        sptMatrix2Norm(mats[m], lambda);
+      }
+      for(sptIndex j=0; j < V->nrows; ++j) {
+        for(sptIndex r=0; r < rank; ++r) {
+          V->values[j * stride + r] *= lambda[r];
+        }
+      }
+      spt_CmtfGram(mats[m], ata[m], rank);
+    } // Loop nmodes
+
+    /* ||X - model||^2, with mats[nmodes] still holding the MTTKRP of the last mode */
+    double const tensor_resid = spten_normsq + sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata)
+      - 2 * sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats);
+
+    /* V solves V (A_c^T A_c) = Y^T A_c */
+    sptAssert (sptSparseMatrixCSRSpMM(&yta, Yt, mats[coupled], tk) == 0);
+    memcpy(V->values, yta.values, (size_t) V->nrows * stride * sizeof(sptValue));
+    sptValue * const neqs = ata[nmodes]->values;
+    for(sptIndex r=0; r < rank; ++r) {
+      for(sptIndex s=r; s < rank; ++s) {
+        neqs[r * stride + s] = neqs[s * stride + r] = ata[coupled]->values[r * stride + s];
+      }
+    }
+    sptAssert (spt_CmtfSolve(V, neqs, backup.values, rank, stride) == 0);
+    spt_CmtfGram(V, &vtv, rank);
+
+    /* ||Y - A_c V^T||^2 = ||Y||^2 - 2 <Y^T A_c, V> + <A_c^T A_c, V^T V> */
+    double inner = 0;
+    for(sptIndex j=0; j < V->nrows; ++j) {
+      for(sptIndex r=0; r < rank; ++r) {
+        inner += yta.values[j * stride + r] * V->values[j * stride + r];
+      }
+    }
+    double const matrix_resid = spmat_normsq - 2 * inner + spt_CmtfGramDot(ata[coupled]->values, vtv.values, rank, stride);
+    double const resid = tensor_resid + matrix_resid;
+    fit = 1 - sqrt(resid > 0 ? resid : 0) / sqrt(spten_normsq + spmat_normsq);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  /* Unit columns for the tensor factors; the norms of A_c go to V as well as lambda */
+  for(sptIndex r=0; r < rank; ++r) {
+    sptValue const n = (sptValue) sqrt(ata[coupled]->values[r * stride + r]);
+    for(sptIndex j=0; j < V->nrows; ++j) {
+      V->values[j * stride + r] *= n;
+    }
+  }
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  sptFreeMatrix(&vtv);
+  sptFreeMatrix(&backup);
+  sptFreeMatrix(&rhs);
+  sptFreeMatrix(&yta);
+  free(mats_order);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel coupled matrix-tensor factorization (CMTF) using alternating least squares.
+ * The sparse tensor X and the sparse matrix Y share the factor of one mode:
+ * X ~ [[lambda; A_1 .. A_N]] and Y ~ A_c V^T. The fit reported is that of X and Y together.
+ * @param[in,out] ktensor the Kruskal tensor of X; factors it already holds are the initial guess
+ * @param[out] side   the factor V of Y's columns, an uninitialized matrix of spmat->ncols x rank
+ * @param[in]  spten  the COO representation of a sparse tensor
+ * @param[in]  spmat  the COO sparse matrix, with ndims[coupled] rows
+ * @param[in]  coupled the mode of spten whose factor Y's rows share
+ * @param[in]  rank   the rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol    the tolerance value for convergence
+ * @param[in]  tk     the number of threads
+ */
+int sptOmpCmtfAls(
+  sptSparseTensor const * const spten,
+  sptSparseMatrix const * const spmat,
+  sptIndex const coupled,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor,
+  sptMatrix * side)
+{
+  sptIndex const nmodes = spten->nmodes;
+  if(coupled >= nmodes || spmat->nrows != spten->ndims[coupled]) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CMTF-ALS", "the matrix rows do not match the coupled mode");
+  }
+  if(sptSparseTensorIsPattern(spten)) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns CMTF-ALS", "pattern tensors are not supported");
+  }
+
+  sptSparseMatrixCSR Y, Yt;
+  int result = sptSparseMatrixToCSR(&Y, spmat, 0);
+  spt_CheckError(result, "CPU  SpTns CMTF-ALS", NULL);
+  result = sptSparseMatrixToCSR(&Yt, spmat, 1);
+  spt_CheckError(result, "CPU  SpTns CMTF-ALS", NULL);
+
+  /* Initialize factor matrices, mats[nmodes] holds the MTTKRP output. A cold
+     start is seeded, so a run is reproducible */
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CMTF-ALS");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+      spt_CpdSeededFactor(mats[m], 4, m);
+    }
+  }
+  sptIndex const max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptNewMatrix(side, spmat->ncols, rank) == 0);
+  spt_CpdSeededFactor(side, 4, nmodes);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCmtfAlsStep(spten, &Y, &Yt, coupled, rank, niters, tol, tk, mats, side, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CMTF-ALS");
+  sptFreeTimer(timer);
+
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+  mats[nmodes] = NULL;
+  ktensor->factors = mats;
+  sptFreeSparseMatrixCSR(&Y);
+  sptFreeSparseMatrixCSR(&Yt);
+  return 0;
+}
@@ -0,0 +1,234 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Duplicate coalescing.
+ *
+ * A stable radix permutation orders the nonzeros by coordinate, keeping the
+ * file order of duplicates. Each thread then takes an even share of the
+ * sorted positions, and reduces every run of equal coordinates that starts
+ * in its share. A counting pass sizes the output once, and a second pass
+ * writes each surviving coordinate straight to its final slot, so the result
+ * is compact and sorted with no appends.
+ */
+
+static int spt_LoadCoalesceOp = -1;
+
+/* Whether sorted nonzeros a and b of tsr, given by position, share a coordinate */
+static inline int spt_SameCoordinate(sptSparseTensor const *tsr, sptNnzIndex const a, sptNnzIndex const b) {
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(tsr->inds[m].data[a] != tsr->inds[m].data[b]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Reduce the run of duplicates starting at sorted position k, setting *next past it */
+static inline sptValue spt_CoalesceRun(
+    sptSparseTensor const *tsr,
+    sptNnzIndex const *perm,
+    sptNnzIndex const k,
+    sptCoalesceOp const op,
+    sptNnzIndex *next)
+{
+    sptValue value = tsr->values.data[perm[k]];
+    sptNnzIndex j = k + 1;
+    for(; j < tsr->nnz && spt_SameCoordinate(tsr, perm[j], perm[k]); ++j) {
+        sptValue const v = tsr->values.data[perm[j]];
+        switch(op) {
+        case SPT_COALESCE_SUM:
+            value += v;
+            break;
+        case SPT_COALESCE_MAX:
+            value = v > value ? v : value;
+            break;
+        default:
+            value = v;
+            break;
+        }
+    }
+    *next = j;
+    return value;
+}
+
+/**
+ * Merge the nonzeros of a sparse tensor that share a coordinate, and drop
+ * those that are or become zero. The result is sorted.
+ * @param tsr the sparse tensor to operate on
+ * @param op  SPT_COALESCE_SUM to add duplicates, SPT_COALESCE_MAX to keep the
+ *            largest, or SPT_COALESCE_LAST to keep the one stored last
+ * @param tk  the number of threads, 0 for the default
+ */
+int sptSparseTensorCoalesce(sptSparseTensor *tsr, sptCoalesceOp const op, int tk) {
+    if(op != SPT_COALESCE_SUM && op != SPT_COALESCE_MAX && op != SPT_COALESCE_LAST) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Coalesce", "unknown coalescing operation");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    sptNnzIndex * perm = malloc((nnz > 0 ? nnz : 1) * sizeof *perm);
+    spt_CheckOSError(!perm, "SpTns Coalesce");
+    sptIndex * modes = malloc(nmodes * sizeof *modes);
+    spt_CheckOSError(!modes, "SpTns Coalesce");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        modes[m] = m;
+    }
+    int result = spt_SparseTensorRadixPermutation(tsr, 0, nnz, nmodes, modes, 0, perm, tk);
+    free(modes);
+    if(result != 0) {
+        free(perm);
+        spt_CheckError(result, "SpTns Coalesce", NULL);
+    }
+
+    /* Count the surviving runs that start in each thread's share */
+    sptNnzIndex * offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SpTns Coalesce");
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const lo = nnz * tid / tk;
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex k = lo;
+        sptNnzIndex count = 0;
+        while(k > 0 && k < hi && spt_SameCoordinate(tsr, perm[k], perm[k - 1])) {
+            ++ k;
+        }
+        while(k < hi) {
+            count += spt_CoalesceRun(tsr, perm, k, op, &k) != 0;
+        }
+        offsets[tid + 1] = count;
+    }
+    for(int t = 0; t < tk; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    sptNnzIndex const nnz_out = offsets[tk];
+
+    sptIndexVector * inds = malloc(nmodes * sizeof *inds);
+    spt_CheckOSError(!inds, "SpTns Coalesce");
+    sptValueVector values;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptNewIndexVector(&inds[m], nnz_out, nnz_out);
+        spt_CheckError(result, "SpTns Coalesce", NULL);
+    }
+    result = sptNewValueVector(&values, nnz_out, nnz_out);
+    spt_CheckError(result, "SpTns Coalesce", NULL);
+
+    /* Write each surviving run at its final slot */
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const lo = nnz * tid / tk;
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex k = lo;
+        sptNnzIndex out = offsets[tid];
+        while(k > 0 && k < hi && spt_SameCoordinate(tsr, perm[k], perm[k - 1])) {
+            ++ k;
+        }
+        while(k < hi) {
+            sptNnzIndex const head = perm[k];
+            sptValue const value = spt_CoalesceRun(tsr, perm, k, op, &k);
+            if(value != 0) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    inds[m].data[out] = tsr->inds[m].data[head];
+                }
+                values.data[out] = value;
+                ++ out;
+            }
+        }
+    }
+    free(offsets);
+    free(perm);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeIndexVector(&tsr->inds[m]);
+        tsr->inds[m] = inds[m];
+        tsr->sortorder[m] = m;
+    }
+    free(inds);
+    sptFreeValueVector(&tsr->values);
+    tsr->values = values;
+    tsr->nnz = nnz_out;
+    spt_SparseTensorDropOrderCache(tsr);
+    return 0;
+}
+
+
+/* The coalescing of the text loaders, from PARTI_LOAD_COALESCE until sptSetLoadCoalesce is called */
+static sptCoalesceOp spt_LoadCoalesce(void) {
+    if(spt_LoadCoalesceOp < 0) {
+        char const * env = getenv("PARTI_LOAD_COALESCE");
+        sptCoalesceOp op = SPT_COALESCE_NONE;
+        if(env != NULL && strcmp(env, "sum") == 0) {
+            op = SPT_COALESCE_SUM;
+        } else if(env != NULL && strcmp(env, "max") == 0) {
+            op = SPT_COALESCE_MAX;
+        } else if(env != NULL && strcmp(env, "last") == 0) {
+            op = SPT_COALESCE_LAST;
+        }
+        spt_LoadCoalesceOp = (int) op;
+    }
+    return (sptCoalesceOp) spt_LoadCoalesceOp;
+}
+
+/**
+ * Coalesce the duplicates of the tensors sptLoadSparseTensor and
+ * sptOmpLoadSparseTensor read, as sptSparseTensorCoalesce does with the
+ * default thread count, so they come back sorted and duplicate free.
+ * Zeros are dropped only after coalescing, so with SPT_COALESCE_LAST a zero
+ * on a later line deletes the coordinate.
+ * Defaults to the PARTI_LOAD_COALESCE environment variable, "sum", "max" or
+ * "last", else SPT_COALESCE_NONE, which keeps duplicates as they are.
+ * @param op  the coalescing operation, or SPT_COALESCE_NONE
+ */
+int sptSetLoadCoalesce(sptCoalesceOp const op) {
+    if(op < SPT_COALESCE_NONE || op > SPT_COALESCE_LAST) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Coalesce", "unknown coalescing operation");
+    }
+    spt_LoadCoalesceOp = (int) op;
+    return 0;
+}
+
+/* The last step of the text loaders: drop zeros, coalescing duplicates first if asked to */
+int spt_SparseTensorFinishLoad(sptSparseTensor *tsr) {
+    sptCoalesceOp const op = spt_LoadCoalesce();
+    if(op == SPT_COALESCE_NONE) {
+        spt_SparseTensorCollectZeros(tsr);
+        return 0;
+    }
+    return sptSparseTensorCoalesce(tsr, op, 0);
+}
@@ -0,0 +1,121 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/*
+ * Index compaction.
+ *
+ * A mode's used indices keep their relative order and are numbered densely
+ * from 0, and the unused ones follow in order, so the map is a permutation of
+ * the whole mode. Each thread marks the indices of an even share of the
+ * nonzeros, then counts the used ones in an even share of the mode, and after
+ * a prefix sum numbers its share in one pass.
+ */
+
+/**
+ * Relabel every mode of a sparse tensor to the dense range of its used
+ * indices, shrinking ndims to the number used, for tensors keyed by sparse
+ * or hashed IDs. The relabeling is monotone, so the order of the nonzeros
+ * and any sortedness are kept. map_inds[m][i] receives the new label of
+ * old index i, as sptSparseTensorShuffleIndices takes it; to map factors of
+ * the compacted tensor back, grow them to the old ndims with
+ * sptKruskalTensorExpandRows and undo the map with
+ * sptKruskalTensorInverseShuffleIndices. A mode with no used index keeps its
+ * size and an identity map.
+ * @param[in,out] tsr       the tensor to compact
+ * @param[out]    map_inds  nmodes arrays of the old ndims[m] entries each
+ * @param[in]     tk        the number of threads, 0 for the default
+ */
+int sptSparseTensorCompactIndices(sptSparseTensor *tsr, sptIndex ** map_inds, int tk)
+{
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    sptIndex const max_dim = sptMaxIndexArray(tsr->ndims, nmodes);
+    unsigned char * used = malloc((max_dim > 0 ? max_dim : 1) * sizeof *used);
+    sptIndex * counts = malloc((tk + 1) * sizeof *counts);
+    spt_CheckOSError(!used || !counts, "SpTns Compact");
+    sptSparseTensorDropCache(tsr);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const dim = tsr->ndims[m];
+        sptIndex * const inds = tsr->inds[m].data;
+        sptIndex * const map = map_inds[m];
+
+        #pragma omp parallel num_threads(tk)
+        {
+#ifdef PARTI_USE_OPENMP
+            int const tid = omp_get_thread_num();
+#else
+            int const tid = 0;
+#endif
+            #pragma omp for schedule(static)
+            for(sptIndex i = 0; i < dim; ++i) {
+                used[i] = 0;
+            }
+            /* Every writer stores the same 1, so a plain store is enough */
+            #pragma omp for schedule(static)
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                used[inds[z]] = 1;
+            }
+            sptIndex const lo = (sptIndex) ((sptNnzIndex) dim * tid / tk);
+            sptIndex const hi = (sptIndex) ((sptNnzIndex) dim * (tid + 1) / tk);
+            sptIndex nused = 0;
+            for(sptIndex i = lo; i < hi; ++i) {
+                nused += used[i];
+            }
+            counts[tid + 1] = nused;
+            #pragma omp barrier
+            #pragma omp single
+            {
+                counts[0] = 0;
+                for(int t = 0; t < tk; ++t) {
+                    counts[t + 1] += counts[t];
+                }
+            }
+            /* Used indices before i are numbered below it, unused ones after all used */
+            sptIndex const total = counts[tk];
+            sptIndex before = counts[tid];
+            for(sptIndex i = lo; i < hi; ++i) {
+                map[i] = used[i] ? before : total + (i - before);
+                before += used[i];
+            }
+            #pragma omp barrier
+            #pragma omp for schedule(static)
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                inds[z] = map[inds[z]];
+            }
+        }
+        if(counts[tk] > 0) {
+            tsr->ndims[m] = counts[tk];
+        }
+    }
+
+    free(counts);
+    free(used);
+    return 0;
+}
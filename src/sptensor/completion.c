@@ -0,0 +1,397 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * CP tensor completion: fit [[A_1 .. A_N]] to the observed entries only,
+ *
+ *   sum_{x observed} (x - <a_1(i_1), .., a_N(i_N)>)^2 + reg sum_m ||A_m||^2,
+ *
+ * by stochastic gradient descent, where CP-ALS would take every entry not
+ * stored as a zero. Updates are scheduled by stratum as in DSGD: each mode is
+ * cut into P row blocks, and the nonzeros of the block tuple (b_1 .. b_N) go
+ * to bucket b_1 + b_2 P + .. . Stratum (s_2 .. s_N) holds the P buckets
+ * (b, b + s_2, .., b + s_N) mod P, which share no row in any mode, so its P
+ * buckets run on P threads without locks or atomics; the P^(N-1) strata of
+ * an epoch cover every bucket once. Every epoch visits the strata in a new
+ * order and every bucket shuffles its own nonzeros, so the shuffle runs in
+ * parallel as well.
+ */
+
+/* Fisher-Yates over perm[0, n) from the stream state */
+static void spt_CompletionShuffle(sptNnzIndex * const perm, sptNnzIndex const n, uint64_t state)
+{
+  for(sptNnzIndex i = n; i > 1; --i) {
+    sptNnzIndex const j = (sptNnzIndex) (spt_GenNext(&state) % i);
+    sptNnzIndex const t = perm[i-1];
+    perm[i-1] = perm[j];
+    perm[j] = t;
+  }
+}
+
+/* sum of (x - model)^2 over the entries of X */
+static double spt_CompletionSse(sptSparseTensor const * const X, sptMatrix ** mats, sptIndex const rank, int const tk)
+{
+  sptIndex const nmodes = X->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double sse = 0;
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for num_threads(tk) reduction(+:sse)
+#endif
+  for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+    double model = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+      double v = 1;
+      for(sptIndex m = 0; m < nmodes; ++m) {
+        v *= mats[m]->values[(size_t) X->inds[m].data[x] * stride + r];
+      }
+      model += v;
+    }
+    double const d = X->values.data[x] - model;
+    sse += d * d;
+  }
+  return sse;
+}
+
+
+static double OmpCompletionSgdStep(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  sptIndex const nepochs,
+  sptValue step,
+  sptValue const reg,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptMatrix ** mats)  // Row-major
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const * const ndims = spten->ndims;
+  sptNnzIndex const nnz = spten->nnz;
+  sptIndex const stride = mats[0]->stride;
+  char const * const module = "CPU  SpTns Completion-SGD";
+
+  /* P blocks per mode: one per thread, fewer for high orders or short modes */
+  sptIndex P = tk > 0 ? (sptIndex) tk : 1;
+  for(;; --P) {
+    size_t nstrata = 1;
+    for(sptIndex m = 1; m < nmodes && nstrata <= PARTI_COMPLETION_MAX_STRATA; ++m) {
+      nstrata *= P;
+    }
+    int fits = nstrata <= PARTI_COMPLETION_MAX_STRATA;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      fits = fits && ndims[m] >= P;
+    }
+    if(fits || P == 1) {
+      break;
+    }
+  }
+  size_t nstrata = 1;
+  for(sptIndex m = 1; m < nmodes; ++m) {
+    nstrata *= P;
+  }
+  size_t const nbuckets = nstrata * P;
+
+  /* Bucket the nonzeros: perm lists them bucket by bucket, bptr[b] .. bptr[b+1] */
+  sptNnzIndex * const perm = malloc(nnz * sizeof *perm);
+  sptNnzIndex * const bptr = calloc(nbuckets + 1, sizeof *bptr);
+  size_t * const bucket_of = malloc(nnz * sizeof *bucket_of);
+  size_t * const order = malloc(nstrata * sizeof *order);
+  spt_CheckOSError(!perm || !bptr || !bucket_of || !order, module);
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for num_threads(tk)
+#endif
+  for(sptNnzIndex x = 0; x < nnz; ++x) {
+    size_t b = 0;
+    for(sptIndex m = nmodes; m-- > 0; ) {
+      b = b * P + (size_t) ((uint64_t) spten->inds[m].data[x] * P / ndims[m]);
+    }
+    bucket_of[x] = b;
+  }
+  for(sptNnzIndex x = 0; x < nnz; ++x) {
+    ++bptr[bucket_of[x] + 1];
+  }
+  for(size_t b = 0; b < nbuckets; ++b) {
+    bptr[b+1] += bptr[b];
+  }
+  for(sptNnzIndex x = 0; x < nnz; ++x) {
+    perm[bptr[bucket_of[x]]++] = x;
+  }
+  for(size_t b = nbuckets; b > 0; --b) {
+    bptr[b] = bptr[b-1];
+  }
+  bptr[0] = 0;
+  free(bucket_of);
+  for(size_t s = 0; s < nstrata; ++s) {
+    order[s] = s;
+  }
+
+  double const train_denom = (double) nnz;
+  double const heldout_denom = heldout != NULL && heldout->nnz > 0 ? (double) heldout->nnz : 0;
+  double sse = spt_CompletionSse(spten, mats, rank, tk);
+  double rmse = sqrt(sse / train_denom);
+
+  for(sptIndex epoch = 0; epoch < nepochs; ++epoch) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* The stratum order of this epoch */
+    uint64_t state = spt_GenMix(seed ^ spt_GenMix((uint64_t) epoch + 1));
+    for(size_t s = nstrata; s > 1; --s) {
+      size_t const j = (size_t) (spt_GenNext(&state) % s);
+      size_t const t = order[s-1];
+      order[s-1] = order[j];
+      order[j] = t;
+    }
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel num_threads(tk)
+#endif
+    {
+      /* suffix[m * rank + r]: the product of rows m .. N-1 of the current nonzero */
+      sptValue * const suffix = malloc(((size_t) nmodes + 1) * rank * sizeof *suffix);
+      sptValue * const prefix = malloc(rank * sizeof *prefix);
+      sptAssert(suffix != NULL && prefix != NULL);
+      for(size_t s = 0; s < nstrata; ++s) {
+        size_t const shift = order[s];
+#ifdef PARTI_USE_OPENMP
+        #pragma omp for schedule(dynamic, 1)
+#endif
+        for(sptIndex b = 0; b < P; ++b) {
+          /* Bucket (b, b + s_2, .., b + s_N), its digits read off the stratum number */
+          size_t bucket = b, radix = P, rest = shift;
+          for(sptIndex m = 1; m < nmodes; ++m) {
+            bucket += (size_t) ((b + rest % P) % P) * radix;
+            rest /= P;
+            radix *= P;
+          }
+          sptNnzIndex * const mine = perm + bptr[bucket];
+          sptNnzIndex const count = bptr[bucket+1] - bptr[bucket];
+          spt_CompletionShuffle(mine, count, spt_GenMix(state ^ spt_GenMix((uint64_t) bucket + 1)));
+
+          for(sptNnzIndex k = 0; k < count; ++k) {
+            sptNnzIndex const x = mine[k];
+            for(sptIndex r = 0; r < rank; ++r) {
+              suffix[(size_t) nmodes * rank + r] = 1;
+            }
+            for(sptIndex m = nmodes; m-- > 0; ) {
+              sptValue const * const row = mats[m]->values + (size_t) spten->inds[m].data[x] * stride;
+              for(sptIndex r = 0; r < rank; ++r) {
+                suffix[(size_t) m * rank + r] = suffix[((size_t) m + 1) * rank + r] * row[r];
+              }
+            }
+            sptValue model = 0;
+            for(sptIndex r = 0; r < rank; ++r) {
+              model += suffix[r];
+              prefix[r] = 1;
+            }
+            sptValue const e = spten->values.data[x] - model;
+            /* Each gradient takes the rows before their update */
+            for(sptIndex m = 0; m < nmodes; ++m) {
+              sptValue * const row = mats[m]->values + (size_t) spten->inds[m].data[x] * stride;
+              sptValue const * const after = suffix + ((size_t) m + 1) * rank;
+              for(sptIndex r = 0; r < rank; ++r) {
+                sptValue const old = row[r];
+                row[r] += step * (e * prefix[r] * after[r] - reg * old);
+                prefix[r] *= old;
+              }
+            }
+          }
+        }
+      }
+      free(suffix);
+      free(prefix);
+    }
+
+    /* Bold driver: halve the step after a worse epoch, grow it slowly after a better one */
+    double const new_sse = spt_CompletionSse(spten, mats, rank, tk);
+    double const old_rmse = rmse;
+    rmse = sqrt(new_sse / train_denom);
+    step = new_sse > sse ? step * 0.5f : step * 1.05f;
+    sse = new_sse;
+
+    sptStopTimer(timer);
+    double epoch_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    if(heldout_denom > 0) {
+      double const heldout_rmse = sqrt(spt_CompletionSse(heldout, mats, rank, tk) / heldout_denom);
+      printf("  epoch = %3"PARTI_PRI_INDEX " ( %.3lf s ) rmse = %0.5f  held-out = %0.5f  step = %.3e\n",
+          epoch+1, epoch_time, rmse, heldout_rmse, (double) step);
+    } else {
+      printf("  epoch = %3"PARTI_PRI_INDEX " ( %.3lf s ) rmse = %0.5f  step = %.3e\n",
+          epoch+1, epoch_time, rmse, (double) step);
+    }
+    if(fabs(old_rmse - rmse) <= tol * old_rmse) {
+      break;
+    }
+  }
+
+  free(perm);
+  free(bptr);
+  free(order);
+
+  /* fit = 1 - ||x - model|| / ||x|| over the held-out entries, else the observed ones */
+  sptSparseTensor const * const scored = heldout_denom > 0 ? heldout : spten;
+  double normsq = 0;
+  for(sptNnzIndex x = 0; x < scored->nnz; ++x) {
+    normsq += (double) scored->values.data[x] * scored->values.data[x];
+  }
+  double const scored_sse = scored == spten ? sse : spt_CompletionSse(scored, mats, rank, tk);
+  return normsq > 0 ? 1 - sqrt(scored_sse) / sqrt(normsq) : 0;
+}
+
+
+/*
+ * Check the arguments of a completion driver and set up mats[0 .. nmodes-1]:
+ * the factors ktensor holds with its lambda folded into the first, else
+ * seeded ones; mats[nmodes] is NULL.
+ */
+int spt_CompletionPrepare(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  uint64_t const seed,
+  sptKruskalTensor * ktensor,
+  sptMatrix ** mats,
+  char const * const module)
+{
+  (void) module;
+  sptIndex const nmodes = spten->nmodes;
+  if(nmodes < 2 || spten->nnz == 0 || rank == 0) {
+    spt_CheckError(SPTERR_VALUE_ERROR, module, "need observed entries of a tensor of two modes or more");
+  }
+  if(sptSparseTensorIsPattern(spten) || (heldout != NULL && sptSparseTensorIsPattern(heldout))) {
+    spt_CheckError(SPTERR_VALUE_ERROR, module, "pattern tensors are not supported");
+  }
+  if(heldout != NULL) {
+    if(heldout->nmodes != nmodes) {
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "the held-out entries do not match the tensor");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      if(heldout->ndims[m] != spten->ndims[m]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "the held-out entries do not match the tensor");
+      }
+    }
+  }
+
+  int warm;
+  int result = spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm);
+  spt_CheckError(result, module, NULL);
+  mats[nmodes] = NULL;
+  if(warm) {
+    /* The model carries no lambda while it trains */
+    for(sptIndex i=0; i < mats[0]->nrows; ++i) {
+      for(sptIndex r=0; r < rank; ++r) {
+        mats[0]->values[(size_t) i * mats[0]->stride + r] *= ktensor->lambda[r];
+      }
+    }
+  } else {
+    /*
+     * Seeded factors of one sign, that of the data mean, scaled so the mean
+     * square of the model matches that of the data. Mixed signs leave SGD in
+     * a swamp far more often.
+     */
+    double mean = 0, meansq = 0;
+    for(sptNnzIndex x = 0; x < spten->nnz; ++x) {
+      mean += spten->values.data[x];
+      meansq += (double) spten->values.data[x] * spten->values.data[x];
+    }
+    meansq /= (double) spten->nnz;
+    /* The entries of spt_CpdSeededFactor have mean square 3 */
+    sptValue const scale = (sptValue) sqrt(pow((meansq > 0 ? meansq : 1) / rank, 1.0 / nmodes) / 3);
+    for(sptIndex m=0; m < nmodes; ++m) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      spt_CheckOSError(!mats[m], module);
+      result = sptNewMatrix(mats[m], spten->ndims[m], rank);
+      spt_CheckError(result, module, NULL);
+      spt_CpdSeededFactor(mats[m], seed, m);
+      for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+        for(sptIndex r=0; r < rank; ++r) {
+          sptValue * const v = mats[m]->values + (size_t) i * mats[m]->stride + r;
+          *v = (m == 0 && mean < 0 ? -scale : scale) * (sptValue) fabs(*v);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+
+/**
+ * OpenMP parallel CP tensor completion by stratified stochastic gradient
+ * descent. Only the nonzeros of spten are observations; every other entry is
+ * missing rather than zero. The factors come out with unit columns and their
+ * norms in lambda. The P blocks each mode is cut into follow tk, so the
+ * result depends on the seed and the thread count.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds, scaled by its lambda, are the initial guess
+ * @param[in]  spten   the observed entries
+ * @param[in]  heldout entries withheld from training to score the model on, or NULL
+ * @param[in]  rank    the rank
+ * @param[in]  nepochs the maximum number of passes over the observed entries
+ * @param[in]  step    the initial learning rate, adapted after every epoch
+ * @param[in]  reg     the L2 regularization weight
+ * @param[in]  tol     stop when an epoch changes the training RMSE by less than this relative amount
+ * @param[in]  seed    the seed of the initial factors and of every shuffle
+ * @param[in]  tk      the number of threads
+ */
+int sptOmpCompletionSgd(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  sptIndex const nepochs,
+  sptValue const step,
+  sptValue const reg,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  char const * const module = "CPU  SpTns Completion-SGD";
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, module);
+  int result = spt_CompletionPrepare(spten, heldout, rank, seed, ktensor, mats, module);
+  if(result != 0) {
+    free(mats);
+    return result;
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCompletionSgdStep(spten, heldout, rank, nepochs, step, reg, tol, seed, tk, mats);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, module);
+  sptFreeTimer(timer);
+
+  for(sptIndex r=0; r < rank; ++r) {
+    ktensor->lambda[r] = 1;
+  }
+  GetFinalLambda(rank, nmodes, mats, ktensor->lambda);
+  ktensor->factors = mats;
+  return 0;
+}
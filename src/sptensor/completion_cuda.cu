@@ -0,0 +1,286 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <thrust/device_ptr.h>
+#include <thrust/reduce.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+
+#define PARTI_CUDA_COMPLETION_NTHREADS 256
+/* The kernel keeps one factor entry per mode in registers */
+#define PARTI_CUDA_COMPLETION_MAX_MODES 8
+
+/*
+ * The GPU counterpart of sptOmpCompletionSgd. A GPU runs far more nonzeros
+ * at once than there are strata to keep them apart, so its updates are
+ * Hogwild: one thread per nonzero, no locks, and the rare collisions on a
+ * factor row are let through. Each epoch walks the nonzeros in the order
+ * z -> (a z + b) mod nnz, a permutation for a coprime to nnz, which costs
+ * no memory and no shuffle pass.
+ */
+
+/* One SGD update per nonzero; the factors of all modes are stacked, mode m from row rowoff[m] */
+__global__ static void spt_CompletionSgdKernel(
+    sptIndex const *inds, sptValue const *vals, sptNnzIndex const nnz,
+    sptIndex const nmodes, sptIndex const rank, sptIndex const stride,
+    sptIndex const *rowoff, sptValue *A,
+    sptValue const step, sptValue const reg,
+    sptNnzIndex const perm_a, sptNnzIndex const perm_b)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptNnzIndex const x = (perm_a * z + perm_b) % nnz;
+    sptValue *rows[PARTI_CUDA_COMPLETION_MAX_MODES];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        rows[m] = A + (size_t) (rowoff[m] + inds[m * nnz + x]) * stride;
+    }
+    sptValue model = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+        sptValue p = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            p *= rows[m][r];
+        }
+        model += p;
+    }
+    sptValue const e = vals[x] - model;
+    for(sptIndex r = 0; r < rank; ++r) {
+        sptValue old[PARTI_CUDA_COMPLETION_MAX_MODES];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            old[m] = rows[m][r];
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptValue g = e;
+            for(sptIndex k = 0; k < nmodes; ++k) {
+                g = k != m ? g * old[k] : g;
+            }
+            rows[m][r] = old[m] + step * (g - reg * old[m]);
+        }
+    }
+}
+
+/* sq[x] = (x - model)^2 */
+__global__ static void spt_CompletionErrorKernel(
+    sptIndex const *inds, sptValue const *vals, sptNnzIndex const nnz,
+    sptIndex const nmodes, sptIndex const rank, sptIndex const stride,
+    sptIndex const *rowoff, sptValue const *A, double *sq)
+{
+    sptNnzIndex const x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(x >= nnz) {
+        return;
+    }
+    double model = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+        double p = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            p *= A[(size_t) (rowoff[m] + inds[m * nnz + x]) * stride + r];
+        }
+        model += p;
+    }
+    double const d = vals[x] - model;
+    sq[x] = d * d;
+}
+
+static int spt_CompletionUpload(sptSparseTensor const *X, sptIndex **inds, sptValue **vals, char const *module)
+{
+    sptNnzIndex const nnz = X->nnz;
+    int result = cudaMalloc((void **) inds, (X->nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        result = cudaMemcpy(*inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+    }
+    result = cudaMalloc((void **) vals, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMemcpy(*vals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    return 0;
+}
+
+/* sum of (x - model)^2 over the nnz entries on the device, sq their scratch */
+static double spt_CompletionSse(
+    sptIndex const *inds, sptValue const *vals, sptNnzIndex const nnz,
+    sptIndex const nmodes, sptIndex const rank, sptIndex const stride,
+    sptIndex const *rowoff, sptValue const *A, double *sq)
+{
+    sptNnzIndex const nblocks = (nnz + PARTI_CUDA_COMPLETION_NTHREADS - 1) / PARTI_CUDA_COMPLETION_NTHREADS;
+    spt_CompletionErrorKernel<<<nblocks, PARTI_CUDA_COMPLETION_NTHREADS>>>(inds, vals, nnz, nmodes, rank, stride, rowoff, A, sq);
+    thrust::device_ptr<double> sq_ptr(sq);
+    return thrust::reduce(sq_ptr, sq_ptr + nnz, 0.0);
+}
+
+static sptNnzIndex spt_Gcd(sptNnzIndex a, sptNnzIndex b)
+{
+    while(b != 0) {
+        sptNnzIndex const t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+/**
+ * CUDA CP tensor completion by Hogwild stochastic gradient descent, see
+ * sptOmpCompletionSgd for the model, the step size rule and the fit. The
+ * order of the updates within an epoch is up to the device, so two runs
+ * agree only up to rounding.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds, scaled by its lambda, are the initial guess
+ * @param[in]  spten   the observed entries, of at most PARTI_CUDA_COMPLETION_MAX_MODES modes
+ * @param[in]  heldout entries withheld from training to score the model on, or NULL
+ * @param[in]  rank    the rank
+ * @param[in]  nepochs the maximum number of passes over the observed entries
+ * @param[in]  step    the initial learning rate, adapted after every epoch
+ * @param[in]  reg     the L2 regularization weight
+ * @param[in]  tol     stop when an epoch changes the training RMSE by less than this relative amount
+ * @param[in]  seed    the seed of the initial factors and of every epoch's order
+ */
+int sptCudaCompletionSgd(
+  sptSparseTensor const * const spten,
+  sptSparseTensor const * const heldout,
+  sptIndex const rank,
+  sptIndex const nepochs,
+  sptValue const step,
+  sptValue const reg,
+  double const tol,
+  uint64_t const seed,
+  sptKruskalTensor * ktensor)
+{
+  char const * const module = "CUDA SpTns Completion-SGD";
+  sptIndex const nmodes = spten->nmodes;
+  if(nmodes > PARTI_CUDA_COMPLETION_MAX_MODES) {
+    spt_CheckError(SPTERR_VALUE_ERROR, module, "too many modes");
+  }
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, module);
+  int result = spt_CompletionPrepare(spten, heldout, rank, seed, ktensor, mats, module);
+  if(result != 0) {
+    free(mats);
+    return result;
+  }
+  sptIndex const stride = mats[0]->stride;
+  sptNnzIndex const nnz = spten->nnz;
+  sptNnzIndex const heldout_nnz = heldout != NULL ? heldout->nnz : 0;
+
+  sptIndex rowoff[PARTI_CUDA_COMPLETION_MAX_MODES + 1];
+  rowoff[0] = 0;
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    rowoff[m+1] = rowoff[m] + spten->ndims[m];
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  sptIndex *dev_inds, *dev_hinds = NULL, *dev_rowoff;
+  sptValue *dev_vals, *dev_hvals = NULL, *dev_A;
+  double *dev_sq;
+  result = spt_CompletionUpload(spten, &dev_inds, &dev_vals, module);
+  spt_CheckError(result, module, NULL);
+  if(heldout_nnz > 0) {
+    result = spt_CompletionUpload(heldout, &dev_hinds, &dev_hvals, module);
+    spt_CheckError(result, module, NULL);
+  }
+  result = sptCudaDuplicateMemory(&dev_rowoff, rowoff, (nmodes + 1) * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, module);
+  result = cudaMalloc((void **) &dev_A, (size_t) rowoff[nmodes] * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, module);
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpy(dev_A + (size_t) rowoff[m] * stride, mats[m]->values,
+        (size_t) spten->ndims[m] * stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+  }
+  result = cudaMalloc((void **) &dev_sq, (nnz > heldout_nnz ? nnz : heldout_nnz) * sizeof (double));
+  spt_CheckCudaError(result != 0, module);
+
+  sptNnzIndex const nblocks = (nnz + PARTI_CUDA_COMPLETION_NTHREADS - 1) / PARTI_CUDA_COMPLETION_NTHREADS;
+  sptValue rate = step;
+  double sse = spt_CompletionSse(dev_inds, dev_vals, nnz, nmodes, rank, stride, dev_rowoff, dev_A, dev_sq);
+  double rmse = sqrt(sse / nnz);
+  for(sptIndex epoch = 0; epoch < nepochs; ++epoch) {
+    sptTimer epoch_timer;
+    sptNewTimer(&epoch_timer, 0);
+    sptStartTimer(epoch_timer);
+
+    /* The order of this epoch: a below 2^20 keeps a z within 64 bits */
+    uint64_t state = spt_GenMix(seed ^ spt_GenMix((uint64_t) epoch + 1));
+    sptNnzIndex perm_a;
+    do {
+      perm_a = 1 + (sptNnzIndex) (spt_GenNext(&state) % ((1u << 20) - 1));
+    } while(spt_Gcd(perm_a, nnz) != 1);
+    sptNnzIndex const perm_b = (sptNnzIndex) (spt_GenNext(&state) % nnz);
+
+    spt_CompletionSgdKernel<<<nblocks, PARTI_CUDA_COMPLETION_NTHREADS>>>(dev_inds, dev_vals, nnz,
+        nmodes, rank, stride, dev_rowoff, dev_A, rate, reg, perm_a, perm_b);
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, module);
+
+    /* Bold driver, as on the CPU */
+    double const new_sse = spt_CompletionSse(dev_inds, dev_vals, nnz, nmodes, rank, stride, dev_rowoff, dev_A, dev_sq);
+    double const old_rmse = rmse;
+    rmse = sqrt(new_sse / nnz);
+    rate = new_sse > sse ? rate * 0.5f : rate * 1.05f;
+    sse = new_sse;
+
+    sptStopTimer(epoch_timer);
+    double epoch_time = sptElapsedTime(epoch_timer);
+    sptFreeTimer(epoch_timer);
+    printf("  epoch = %3"PARTI_PRI_INDEX " ( %.3lf s ) rmse = %0.5f  step = %.3e\n",
+        epoch+1, epoch_time, rmse, (double) rate);
+    if(fabs(old_rmse - rmse) <= tol * old_rmse) {
+      break;
+    }
+  }
+
+  /* fit = 1 - ||x - model|| / ||x|| over the held-out entries, else the observed ones */
+  sptSparseTensor const * const scored = heldout_nnz > 0 ? heldout : spten;
+  double const scored_sse = heldout_nnz > 0 ?
+      spt_CompletionSse(dev_hinds, dev_hvals, heldout_nnz, nmodes, rank, stride, dev_rowoff, dev_A, dev_sq) : sse;
+  double normsq = 0;
+  for(sptNnzIndex x = 0; x < scored->nnz; ++x) {
+    normsq += (double) scored->values.data[x] * scored->values.data[x];
+  }
+  ktensor->fit = normsq > 0 ? 1 - sqrt(scored_sse) / sqrt(normsq) : 0;
+
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpy(mats[m]->values, dev_A + (size_t) rowoff[m] * stride,
+        (size_t) spten->ndims[m] * stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, module);
+  }
+  cudaFree(dev_inds);
+  cudaFree(dev_vals);
+  cudaFree(dev_hinds);
+  cudaFree(dev_hvals);
+  cudaFree(dev_rowoff);
+  cudaFree(dev_A);
+  cudaFree(dev_sq);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, module);
+  sptFreeTimer(timer);
+
+  for(sptIndex r = 0; r < rank; ++r) {
+    ktensor->lambda[r] = 1;
+  }
+  GetFinalLambda(rank, nmodes, mats, ktensor->lambda);
+  ktensor->factors = mats;
+  return 0;
+}
@@ -0,0 +1,96 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+
+/**
+ * Append a sparse tensor to another along one mode, as the next slices of
+ * dest: the nonzero (i_0, ..., i_mode, ...) of src lands at i_mode +
+ * dest->ndims[mode], and ndims[mode] grows by src->ndims[mode]. The other
+ * modes grow to the larger of the two sizes. dest's arrays are grown once
+ * and src's copied in parallel, so appending costs O(src->nnz) besides the
+ * reallocation.
+ *
+ * Every appended nonzero comes after all of dest's in mode, so if both are
+ * sorted in the same order led by mode, so is the result, and sortorder is
+ * kept; otherwise sort before kernels that need an order. The cache of dest
+ * is dropped.
+ * @param[in,out] dest the tensor to append to
+ * @param[in]     src  the tensor appended, with as many modes and the same kind of values
+ * @param[in]     mode the mode to concatenate along
+ * @param[in]     tk   the number of threads, 0 for the default
+ */
+int sptSparseTensorConcat(sptSparseTensor *dest, const sptSparseTensor *src, sptIndex const mode, int tk)
+{
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = dest->nmodes;
+    if(src->nmodes != nmodes || mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Concat", "nmodes mismatch or mode out of range");
+    }
+    if(sptSparseTensorIsPattern(dest) != sptSparseTensorIsPattern(src) && src->nnz > 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Concat", "one tensor is a pattern tensor and the other is not");
+    }
+    sptIndex const offset = dest->ndims[mode];
+    if(offset + src->ndims[mode] < offset) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Concat", "mode size overflows sptIndex");
+    }
+    sptNnzIndex const old_nnz = dest->nnz;
+    sptNnzIndex const nnz = src->nnz;
+    int result = spt_SparseTensorReserve(dest, old_nnz + nnz);
+    spt_CheckError(result, "SpTns Concat", NULL);
+    sptSparseTensorDropCache(dest);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex * const restrict to = dest->inds[m].data + old_nnz;
+        sptIndex const * const restrict from = src->inds[m].data;
+        if(m == mode) {
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                to[z] = from[z] + offset;
+            }
+        } else {
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptNnzIndex z = 0; z < nnz; ++z) {
+                to[z] = from[z];
+            }
+            if(src->ndims[m] > dest->ndims[m]) {
+                dest->ndims[m] = src->ndims[m];
+            }
+        }
+        dest->inds[m].len = old_nnz + nnz;
+    }
+    if(!sptSparseTensorIsPattern(dest)) {
+        sptValue * const restrict to = dest->values.data + old_nnz;
+        sptValue const * const restrict from = src->values.data;
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            to[z] = from[z];
+        }
+        dest->values.len = old_nnz + nnz;
+    }
+    dest->ndims[mode] = offset + src->ndims[mode];
+    dest->nnz = old_nnz + nnz;
+    return 0;
+}
@@ -0,0 +1,354 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+#define SPT_CONTRACT_NONE ((sptNnzIndex) -1)
+
+typedef struct {
+    uint64_t key;
+    sptValue val;
+} spt_ContractEntry;
+
+static inline int spt_ThreadId(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static int spt_CompareContractEntry(const void *a, const void *b) {
+    uint64_t const ka = ((const spt_ContractEntry *) a)->key;
+    uint64_t const kb = ((const spt_ContractEntry *) b)->key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+static inline uint64_t spt_ContractHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Key of nonzero z over the given modes, row-major in their order */
+static inline uint64_t spt_ContractKey(const sptSparseTensor *tsr, sptNnzIndex const z, sptIndex const *modes, sptIndex const n) {
+    uint64_t key = 0;
+    for(sptIndex k = 0; k < n; ++k) {
+        key = key * tsr->ndims[modes[k]] + tsr->inds[modes[k]].data[z];
+    }
+    return key;
+}
+
+/* Product of the mode sizes, or 0 if it does not fit a 64-bit key */
+static uint64_t spt_ContractSpace(const sptSparseTensor *tsr, sptIndex const *modes, sptIndex const n) {
+    uint64_t space = 1;
+    for(sptIndex k = 0; k < n; ++k) {
+        if(tsr->ndims[modes[k]] != 0 && space > UINT64_MAX / tsr->ndims[modes[k]]) {
+            return 0;
+        }
+        space *= tsr->ndims[modes[k]];
+    }
+    return space;
+}
+
+/* Split modes of tsr into the free ones, ascending, then the contracted ones */
+static int spt_ContractOrder(const sptSparseTensor *tsr, sptIndex const *cmodes, sptIndex const ncmodes, int const free_first, sptIndex *order) {
+    sptIndex const nmodes = tsr->nmodes;
+    char * contracted = calloc(nmodes, 1);
+    spt_CheckOSError(!contracted, "SpTns Contract");
+    for(sptIndex k = 0; k < ncmodes; ++k) {
+        if(cmodes[k] >= nmodes || contracted[cmodes[k]]) {
+            free(contracted);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Contract", "invalid contracted modes");
+        }
+        contracted[cmodes[k]] = 1;
+    }
+    sptIndex const nfree = nmodes - ncmodes;
+    sptIndex f = free_first ? 0 : ncmodes;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(!contracted[m]) {
+            order[f++] = m;
+        }
+    }
+    memcpy(order + (free_first ? nfree : 0), cmodes, ncmodes * sizeof *order);
+    free(contracted);
+    return 0;
+}
+
+/**
+ * Contract two sparse tensors over pairs of modes,
+ * Z(fx, fy) = sum_c X(fx, c) * Y(c, fy), where c runs over modes
+ * cmodes_x[k] of X paired with cmodes_y[k] of Y, and Z has the free modes of
+ * X followed by the free modes of Y, each in ascending order.
+ *
+ * X is sorted free modes first and Y contracted modes first (skipped if their
+ * nonzeros already are), so each output slice Z(fx, :) gathers the runs of Y
+ * matching the nonzeros of X(fx, :). Slices are processed in parallel with a
+ * thread-private hash accumulator over fy: a symbolic pass counts every
+ * slice, a prefix sum sizes Z once, and a numeric pass fills it in sorted
+ * order. Both the contracted and the free-Y index spaces must fit 64-bit keys.
+ * @param[out] Z        the result, should be uninitialized
+ * @param[in]  X        the first operand, reordered in place
+ * @param[in]  Y        the second operand, reordered in place
+ * @param[in]  cmodes_x the contracted modes of X
+ * @param[in]  cmodes_y the matching contracted modes of Y
+ * @param[in]  ncmodes  the number of contracted mode pairs
+ * @param[in]  tk       the number of threads
+ */
+int sptSparseTensorContract(
+    sptSparseTensor *Z,
+    sptSparseTensor *X,
+    sptSparseTensor *Y,
+    sptIndex const cmodes_x[],
+    sptIndex const cmodes_y[],
+    sptIndex const ncmodes,
+    int const tk)
+{
+    int result;
+    if(ncmodes == 0 || ncmodes > X->nmodes || ncmodes > Y->nmodes ||
+        (ncmodes == X->nmodes && ncmodes == Y->nmodes)) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Contract", "need 1 to nmodes contracted pairs and a free mode");
+    }
+    for(sptIndex k = 0; k < ncmodes; ++k) {
+        if(cmodes_x[k] >= X->nmodes || cmodes_y[k] >= Y->nmodes || X->ndims[cmodes_x[k]] != Y->ndims[cmodes_y[k]]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Contract", "shape mismatch");
+        }
+    }
+    sptIndex const nfx = X->nmodes - ncmodes;
+    sptIndex const nfy = Y->nmodes - ncmodes;
+    sptIndex * xorder = malloc(X->nmodes * sizeof *xorder);
+    sptIndex * yorder = malloc(Y->nmodes * sizeof *yorder);
+    spt_CheckOSError(!xorder || !yorder, "SpTns Contract");
+    result = spt_ContractOrder(X, cmodes_x, ncmodes, 1, xorder);
+    spt_CheckError(result, "SpTns Contract", NULL);
+    result = spt_ContractOrder(Y, cmodes_y, ncmodes, 0, yorder);
+    spt_CheckError(result, "SpTns Contract", NULL);
+    sptIndex const * const xfree = xorder;
+    sptIndex const * const yfree = yorder + ncmodes;
+    uint64_t const fy_space = spt_ContractSpace(Y, yfree, nfy);
+    if(spt_ContractSpace(Y, cmodes_y, ncmodes) == 0 || fy_space == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Contract", "index space exceeds a 64-bit key");
+    }
+
+    if(!spt_SparseTensorIsSortedInOrder(X, xorder)) {
+        sptSparseTensorSortIndexCustomOrder(X, xorder, 1);
+    }
+    if(!spt_SparseTensorIsSortedInOrder(Y, yorder)) {
+        sptSparseTensorSortIndexCustomOrder(Y, yorder, 1);
+    }
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* Runs of Y sharing a contracted key, ascending in the key */
+    sptNnzIndex nruns = 0;
+    uint64_t * run_key = malloc((Y->nnz + 1) * sizeof *run_key);
+    sptNnzIndex * run_start = malloc((Y->nnz + 1) * sizeof *run_start);
+    uint64_t * yfkey = malloc((Y->nnz + 1) * sizeof *yfkey);
+    spt_CheckOSError(!run_key || !run_start || !yfkey, "SpTns Contract");
+    for(sptNnzIndex y = 0; y < Y->nnz; ++y) {
+        uint64_t const key = spt_ContractKey(Y, y, cmodes_y, ncmodes);
+        if(nruns == 0 || run_key[nruns - 1] != key) {
+            run_key[nruns] = key;
+            run_start[nruns++] = y;
+        }
+    }
+    run_start[nruns] = Y->nnz;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex y = 0; y < Y->nnz; ++y) {
+        yfkey[y] = spt_ContractKey(Y, y, yfree, nfy);
+    }
+
+    /* Slices of X sharing the free indices */
+    sptNnzIndex nslices = 0;
+    sptNnzIndex * slice_start = malloc((X->nnz + 1) * sizeof *slice_start);
+    sptNnzIndex * xrun = malloc((X->nnz + 1) * sizeof *xrun);
+    spt_CheckOSError(!slice_start || !xrun, "SpTns Contract");
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        int head = x == 0;
+        for(sptIndex k = 0; k < nfx && !head; ++k) {
+            head = X->inds[xfree[k]].data[x] != X->inds[xfree[k]].data[x-1];
+        }
+        if(head) {
+            slice_start[nslices++] = x;
+        }
+    }
+    slice_start[nslices] = X->nnz;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        uint64_t const key = spt_ContractKey(X, x, cmodes_x, ncmodes);
+        sptNnzIndex lo = 0, hi = nruns;
+        while(lo < hi) {
+            sptNnzIndex const mid = lo + (hi - lo) / 2;
+            if(run_key[mid] < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        xrun[x] = lo < nruns && run_key[lo] == key ? lo : SPT_CONTRACT_NONE;
+    }
+    free(run_key);
+
+    /* Upper bound on each slice's length for the accumulator size */
+    sptNnzIndex * slice_nnz = malloc((nslices + 1) * sizeof *slice_nnz);
+    spt_CheckOSError(!slice_nnz, "SpTns Contract");
+    sptNnzIndex max_bound = 0;
+    #pragma omp parallel for schedule(static) num_threads(tk) reduction(max:max_bound)
+    for(sptNnzIndex s = 0; s < nslices; ++s) {
+        sptNnzIndex bound = 0;
+        for(sptNnzIndex x = slice_start[s]; x < slice_start[s+1]; ++x) {
+            if(xrun[x] != SPT_CONTRACT_NONE) {
+                bound += run_start[xrun[x] + 1] - run_start[xrun[x]];
+            }
+        }
+        if(bound > fy_space) {
+            bound = fy_space;
+        }
+        if(bound > max_bound) {
+            max_bound = bound;
+        }
+    }
+    sptNnzIndex cap = 16;
+    while(cap < 2 * max_bound) {
+        cap <<= 1;
+    }
+
+    int const nt = tk > 0 ? tk : 1;
+    uint64_t * tab_key = malloc((size_t) nt * cap * sizeof *tab_key);
+    sptNnzIndex * tab_stamp = malloc((size_t) nt * cap * sizeof *tab_stamp);
+    sptValue * tab_val = malloc((size_t) nt * cap * sizeof *tab_val);
+    spt_ContractEntry * entries = malloc((size_t) nt * (max_bound + 1) * sizeof *entries);
+    spt_CheckOSError(!tab_key || !tab_stamp || !tab_val || !entries, "SpTns Contract");
+    for(size_t i = 0; i < (size_t) nt * cap; ++i) {
+        tab_stamp[i] = SPT_CONTRACT_NONE;
+    }
+
+    sptNnzIndex * offsets = malloc((nslices + 1) * sizeof *offsets);
+    spt_CheckOSError(!offsets, "SpTns Contract");
+
+    for(int numeric = 0; numeric < 2; ++numeric) {
+        if(numeric) {
+            /* Size Z from the symbolic counts */
+            offsets[0] = 0;
+            for(sptNnzIndex s = 0; s < nslices; ++s) {
+                offsets[s+1] = offsets[s] + slice_nnz[s];
+            }
+            sptIndex * zdims = malloc((nfx + nfy + 1) * sizeof *zdims);
+            spt_CheckOSError(!zdims, "SpTns Contract");
+            for(sptIndex k = 0; k < nfx; ++k) {
+                zdims[k] = X->ndims[xfree[k]];
+            }
+            for(sptIndex k = 0; k < nfy; ++k) {
+                zdims[nfx + k] = Y->ndims[yfree[k]];
+            }
+            result = sptNewSparseTensor(Z, nfx + nfy, zdims);
+            free(zdims);
+            spt_CheckError(result, "SpTns Contract", NULL);
+            for(sptIndex m = 0; m < Z->nmodes; ++m) {
+                result = sptResizeIndexVector(&Z->inds[m], offsets[nslices]);
+                spt_CheckError(result, "SpTns Contract", NULL);
+            }
+            result = sptResizeValueVector(&Z->values, offsets[nslices]);
+            spt_CheckError(result, "SpTns Contract", NULL);
+            Z->nnz = offsets[nslices];
+        }
+
+        #pragma omp parallel for schedule(dynamic, 16) num_threads(nt)
+        for(sptNnzIndex s = 0; s < nslices; ++s) {
+            size_t const tid = (size_t) spt_ThreadId();
+            uint64_t * const keys = tab_key + tid * cap;
+            sptNnzIndex * const stamp = tab_stamp + tid * cap;
+            sptValue * const vals = tab_val + tid * cap;
+            spt_ContractEntry * const ents = entries + tid * (max_bound + 1);
+            sptNnzIndex count = 0;
+            for(sptNnzIndex x = slice_start[s]; x < slice_start[s+1]; ++x) {
+                if(xrun[x] == SPT_CONTRACT_NONE) {
+                    continue;
+                }
+                sptValue const xv = X->values.data[x];
+                for(sptNnzIndex y = run_start[xrun[x]]; y < run_start[xrun[x] + 1]; ++y) {
+                    uint64_t const key = yfkey[y];
+                    sptNnzIndex slot = spt_ContractHash(key) & (cap - 1);
+                    while(stamp[slot] == s && keys[slot] != key) {
+                        slot = (slot + 1) & (cap - 1);
+                    }
+                    if(stamp[slot] != s) {
+                        stamp[slot] = s;
+                        keys[slot] = key;
+                        vals[slot] = 0;
+                        ents[count++].key = slot;
+                    }
+                    vals[slot] += xv * Y->values.data[y];
+                }
+            }
+            if(!numeric) {
+                slice_nnz[s] = count;
+                /* Stamps are slice numbers, so a later pass must not see this one's */
+                for(sptNnzIndex e = 0; e < count; ++e) {
+                    stamp[ents[e].key] = SPT_CONTRACT_NONE;
+                }
+                continue;
+            }
+
+            for(sptNnzIndex e = 0; e < count; ++e) {
+                sptNnzIndex const slot = ents[e].key;
+                ents[e].key = keys[slot];
+                ents[e].val = vals[slot];
+            }
+            qsort(ents, count, sizeof *ents, spt_CompareContractEntry);
+            sptNnzIndex const x0 = slice_start[s];
+            for(sptNnzIndex e = 0; e < count; ++e) {
+                sptNnzIndex const out = offsets[s] + e;
+                for(sptIndex k = 0; k < nfx; ++k) {
+                    Z->inds[k].data[out] = X->inds[xfree[k]].data[x0];
+                }
+                uint64_t key = ents[e].key;
+                for(sptIndex k = nfy; k-- > 0; ) {
+                    sptIndex const dim = Y->ndims[yfree[k]];
+                    Z->inds[nfx + k].data[out] = (sptIndex) (key % dim);
+                    key /= dim;
+                }
+                Z->values.data[out] = ents[e].val;
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SpTns Contract");
+    sptFreeTimer(timer);
+
+    free(offsets);
+    free(entries);
+    free(tab_val);
+    free(tab_stamp);
+    free(tab_key);
+    free(slice_nnz);
+    free(xrun);
+    free(slice_start);
+    free(yfkey);
+    free(run_start);
+    free(xorder);
+    free(yorder);
+    return 0;
+}
@@ -20,12 +20,6 @@
 #include <ParTI.h>
 #include <assert.h>
 #include <math.h>
-#ifdef PARTI_USE_MAGMA
-  #include "magma_v2.h"
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
 #include "sptensor.h"
 
 
@@ -46,13 +40,6 @@ double CpdAlsStep(
     sptAssert(mats[m]->ncols == rank);
   }
 
-  sptValue alpha = 1.0, beta = 0.0;
-  char notrans = 'N';
-  char trans = 'T';
-  char uplo = 'L';
-  int blas_rank = (int) rank;
-  int blas_stride = (int) stride;
-
   sptMatrix * tmp_mat = mats[nmodes];
   sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
   for(sptIndex m=0; m < nmodes+1; ++m) {
@@ -61,23 +48,45 @@ double CpdAlsStep(
     sptAssert(mats[m]->stride == ata[m]->stride);
   }
 
-  /* Compute all "ata"s */
+  /* Resume from the configured checkpoint when it holds this decomposition */
+  sptValue ** ckpt_vals = (sptValue **)malloc(nmodes * sizeof(*ckpt_vals));
   for(sptIndex m=0; m < nmodes; ++m) {
-    /* ata[m] = mats[m]^T * mats[m]), actually do A * A' due to row-major mats, and output an upper triangular matrix. */
-    int blas_nrows = (int)(mats[m]->nrows);
-    ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
-      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    ckpt_vals[m] = mats[m]->values;
   }
-
+  spt_CpdFactors const ckpt = { nmodes, rank, stride, spten->ndims, ckpt_vals, lambda };
+  spt_CpdCheckpointKey const ckpt_key = { spt_CpdCheckpointEnabled() ? sptSparseTensorFingerprint(spten) : 0, tol, niters };
+  sptIndex start_it = 0;
+  int converged = 0;
   double oldfit = 0;
+  sptAssert(spt_CpdCheckpointRestore(&ckpt, &ckpt_key, &start_it, &oldfit, &converged) == 0);
+  fit = oldfit;
+
+  /* Extrapolated steps, when enabled, are tried on the factors ckpt points at */
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  spt_CpdLineSearch ls;
+  sptAssert(spt_NewCpdLineSearch(&ls, &ckpt) == 0);
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, stride) == 0);
+
+  /* Compute all "ata"s as upper triangular matrices, independent of the threading of BLAS */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], 1) == 0);
+  }
+
+  /* The tensor values are fixed during CPD, so its norm is computed only once. */
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
   sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
 
 
-  for(sptIndex it=0; it < niters; ++it) {
+  for(sptIndex it=start_it; it < niters && !converged; ++it) {
     sptTimer timer;
     sptNewTimer(&timer, 0);
     sptStartTimer(timer);
 
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
     for(sptIndex m=0; m < nmodes; ++m) {
       tmp_mat->nrows = mats[m]->nrows;
 
@@ -93,7 +102,8 @@ double CpdAlsStep(
       memcpy(mats[m]->values, tmp_mat->values, mats[m]->nrows * stride * sizeof(sptValue));
 
       /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
-      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptMatrixSolveFormedNormals(nmodes, ata, mats[m]) == 0 );
 
       /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
       if (it == 0 ) {
@@ -103,13 +113,25 @@ double CpdAlsStep(
       }
 
       /* ata[m] = mats[m]^T * mats[m]) */
-      int blas_nrows = (int)(mats[m]->nrows);
-      ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
-        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      sptAssert(sptOmpMatrixGram(mats[m], ata[m], 1) == 0);
+      sptAssert(sptGramHadamardAdvance(&gh, m, ata_vals) == 0);
 
     } // Loop nmodes
 
-    fit = sptKruskalTensorFit(spten, lambda, mats, ata);
+    fit = sptKruskalTensorFitFromNorms(spten_normsq, sptGramHadamardKruskalNorm(&gh, lambda, ata_vals),
+        sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats));
+
+    /* Try an extrapolated step; its fit costs one MTTKRP of the last mode */
+    if(spt_CpdLineSearchPropose(&ls, &ckpt, ata_vals, it)) {
+      sptIndex const last = nmodes - 1;
+      tmp_mat->nrows = mats[last]->nrows;
+      mats_order[0] = last;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (last+i) % nmodes;
+      sptAssert (sptMTTKRP(spten, mats, mats_order, last) == 0);
+      double const trial_fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+      fit = spt_CpdLineSearchResolve(&ls, &ckpt, ata_vals, fit, trial_fit);
+    }
 
     sptStopTimer(timer);
     double its_time = sptElapsedTime(timer);
@@ -118,12 +140,18 @@ double CpdAlsStep(
     printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
         it+1, its_time, fit, fit - oldfit);
     if(it > 0 && fabs(fit - oldfit) < tol) {
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 1) == 0);
       break;
     }
     oldfit = fit;
+    sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, it+1 == niters, 0) == 0);
 
   } // Loop niters
 
+  free(ckpt_vals);
+  free(ata_vals);
+  sptFreeGramHadamard(&gh);
+  spt_FreeCpdLineSearch(&ls);
   GetFinalLambda(rank, nmodes, mats, lambda);
 
   for(sptIndex m=0; m < nmodes+1; ++m) {
@@ -139,7 +167,7 @@ double CpdAlsStep(
 
 /**
  * Sequential CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for COO formatted sparse tensors.
- * @param[out] ktensor the Kruskal tensor
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
  * @param[in]  spten the COO representation of a sparse tensor
  * @param[in]  rank the CPD rank
  * @param[in]  niters the maximum number of iterations
@@ -160,13 +188,12 @@ int sptCpdAls(
   /* Initialize factor matrices */
   sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
   sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
-  }
-  for(sptIndex m=0; m < nmodes; ++m) {
-    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
-    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, 1) == 0);
   }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
   sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
   sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
 
@@ -187,9 +214,7 @@ int sptCpdAls(
   magma_finalize();
 #endif
   sptFreeMatrix(mats[nmodes]);
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    free(mats[m]);
-  }
+  free(mats[nmodes]);
 
   return 0;
 }
@@ -0,0 +1,259 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "sptensor.h"
+
+
+void spt_CpdSeededFactor(sptMatrix * A, uint64_t const seed, sptIndex const mode) {
+    uint64_t state = spt_GenMix(seed ^ spt_GenMix((uint64_t) mode + 1));
+    for(sptIndex i=0; i < A->nrows; ++i) {
+        for(sptIndex r=0; r < A->ncols; ++r) {
+            sptValue const v = 3.0 * (sptValue) spt_GenUniform(&state);
+            A->values[(size_t) i * A->stride + r] = (spt_GenNext(&state) & 1) ? -v : v;
+        }
+    }
+}
+
+/* The columns [off, off+rank) of a wide matrix, as a matrix of its own */
+static inline sptMatrix spt_BatchView(sptMatrix const * W, sptIndex const off, sptIndex const rank) {
+    sptMatrix view = { W->nrows, rank, W->cap, W->stride, W->values + off };
+    return view;
+}
+
+
+static int OmpCpdAlsBatchedStep(
+  sptSparseTensor const * const spten,
+  sptIndex const nmodels,
+  sptIndex const ranks[],
+  sptIndex const offs[],
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** W,   // Row-major, all models side by side
+  sptKruskalTensor ktensors[])
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptMatrix * tmp_mat = W[nmodes];
+
+  /* Per model: views of its column block in every W[m], and its own "ata"s with the stride of W */
+  sptMatrix * views = (sptMatrix *)malloc((size_t) nmodels * (nmodes+1) * sizeof(*views));
+  sptMatrix ** view_ptrs = (sptMatrix **)malloc((size_t) nmodels * (nmodes+1) * sizeof(*view_ptrs));
+  sptMatrix ** ata = (sptMatrix **)malloc((size_t) nmodels * (nmodes+1) * sizeof(*ata));
+  double * oldfit = (double *)malloc(nmodels * sizeof(*oldfit));
+  char * done = (char *)malloc(nmodels);
+  spt_CheckOSError(!views || !view_ptrs || !ata || !oldfit || !done, "CPU  SpTns CPD-ALS Batched");
+
+  for(sptIndex k=0; k < nmodels; ++k) {
+    for(sptIndex m=0; m < nmodes+1; ++m) {
+      sptIndex const x = k * (nmodes+1) + m;
+      views[x] = spt_BatchView(W[m], offs[k], ranks[k]);
+      view_ptrs[x] = &views[x];
+      ata[x] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(ata[x], ranks[k], W[0]->stride) == 0);
+      sptAssert(ata[x]->stride == W[0]->stride);
+      ata[x]->ncols = ranks[k];
+    }
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptAssert(sptOmpMatrixGram(&views[k * (nmodes+1) + m], ata[k * (nmodes+1) + m], tk) == 0);
+    }
+    oldfit[k] = 0;
+    done[k] = 0;
+  }
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  sptIndex ndone = 0;
+
+  for(sptIndex it=0; it < niters && ndone < nmodels; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = W[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      /* One pass over the nonzeros serves every model */
+      sptAssert (sptOmpMTTKRP(spten, W, mats_order, m, tk) == 0);
+
+      for(sptIndex k=0; k < nmodels; ++k) {
+        if(done[k]) continue;
+        sptMatrix * rhs = &views[k * (nmodes+1) + nmodes];
+        rhs->nrows = tmp_mat->nrows;
+        sptAssert ( sptOmpMatrixSolveNormalsGram(m, nmodes, ata + k * (nmodes+1), rhs,
+          &views[k * (nmodes+1) + m], ktensors[k].lambda, it != 0, tk) == 0 );
+      }
+    } // Loop nmodes
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    for(sptIndex k=0; k < nmodels; ++k) {
+      if(done[k]) continue;
+      /* The last MTTKRP, still in the model's block of W[nmodes], gives <X, model> */
+      double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, ktensors[k].lambda, ata + k * (nmodes+1));
+      double const inner = sptSparseKruskalTensorInnerProduct(nmodes, ktensors[k].lambda, view_ptrs + k * (nmodes+1));
+      double const fit = sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner);
+      printf("  its = %3"PARTI_PRI_INDEX " model = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, k, its_time, fit, fit - oldfit[k]);
+      ktensors[k].fit = fit;
+      /* A converged model keeps its columns in W but is no longer solved */
+      if(it > 0 && fabs(fit - oldfit[k]) < tol) {
+        done[k] = 1;
+        ++ndone;
+      }
+      oldfit[k] = fit;
+    }
+  } // Loop niters
+
+  for(sptIndex k=0; k < nmodels; ++k) {
+    GetFinalLambda(ranks[k], nmodes, view_ptrs + k * (nmodes+1), ktensors[k].lambda);
+  }
+
+  for(sptIndex x=0; x < nmodels * (nmodes+1); ++x) {
+    sptFreeMatrix(ata[x]);
+    free(ata[x]);
+  }
+  free(ata);
+  free(views);
+  free(view_ptrs);
+  free(oldfit);
+  free(done);
+  free(mats_order);
+
+  return 0;
+}
+
+
+/**
+ * OpenMP Parallel CPD-ALS of several independent models of one COO sparse tensor, e.g. for choosing a rank or a seed.
+ * The factor columns of all models are laid side by side in one wide matrix per mode,
+ * so each MTTKRP streams the nonzeros once for all of them; the normal equations,
+ * normalization and fit are then computed per model on its own column block.
+ * Each model stops being updated once its fit changes by less than tol.
+ * @param[in,out] ktensors  nmodels Kruskal tensors made by sptNewKruskalTensor with ranks[k]; factors one already holds are its initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  nmodels the number of models
+ * @param[in]  ranks the CPD rank of each model
+ * @param[in]  seeds the seed of each model's random initial guess, or NULL to use k+1
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdAlsBatched(
+  sptSparseTensor const * const spten,
+  sptIndex const nmodels,
+  sptIndex const ranks[],
+  uint64_t const seeds[],
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor ktensors[])
+{
+  sptIndex const nmodes = spten->nmodes;
+
+  sptIndex * offs = (sptIndex *)malloc(nmodels * sizeof(*offs));
+  spt_CheckOSError(!offs, "CPU  SpTns CPD-ALS Batched");
+  sptIndex total_rank = 0;
+  for(sptIndex k=0; k < nmodels; ++k) {
+    offs[k] = total_rank;
+    total_rank += ranks[k];
+  }
+  if(nmodels == 0 || total_rank == 0) {
+    free(offs);
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CPD-ALS Batched", "no model to fit");
+  }
+
+  /* Initialize the wide factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** W = (sptMatrix **)malloc((nmodes+1) * sizeof(*W));
+  sptMatrix ** init = (sptMatrix **)malloc(nmodes * sizeof(*init));
+  spt_CheckOSError(!W || !init, "CPU  SpTns CPD-ALS Batched");
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    W[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(W[m], m < nmodes ? spten->ndims[m] : max_dim, total_rank) == 0);
+    sptAssert(sptConstantMatrix(W[m], 0) == 0);
+  }
+  for(sptIndex k=0; k < nmodels; ++k) {
+    int warm;
+    sptAssert(spt_CpdTakeFactors(&ktensors[k], nmodes, spten->ndims, ranks[k], init, &warm) == 0);
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptMatrix block = spt_BatchView(W[m], offs[k], ranks[k]);
+      if(warm) {
+        for(sptIndex i=0; i < block.nrows; ++i) {
+          memcpy(block.values + (size_t) i * block.stride, init[m]->values + (size_t) i * init[m]->stride,
+            ranks[k] * sizeof(sptValue));
+        }
+        sptFreeMatrix(init[m]);
+        free(init[m]);
+      } else {
+        spt_CpdSeededFactor(&block, seeds != NULL ? seeds[k] : (uint64_t) k + 1, m);
+      }
+    }
+  }
+  free(init);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  sptAssert(OmpCpdAlsBatchedStep(spten, nmodels, ranks, offs, niters, tol, tk, W, ktensors) == 0);
+  sptSetExecContext(caller_exec);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-ALS Batched");
+  sptFreeTimer(timer);
+
+  /* Hand each model its own columns */
+  for(sptIndex k=0; k < nmodels; ++k) {
+    sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+    spt_CheckOSError(!mats, "CPU  SpTns CPD-ALS Batched");
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptMatrix const block = spt_BatchView(W[m], offs[k], ranks[k]);
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], spten->ndims[m], ranks[k]) == 0);
+      sptAssert(sptConstantMatrix(mats[m], 0) == 0);
+      for(sptIndex i=0; i < block.nrows; ++i) {
+        memcpy(mats[m]->values + (size_t) i * mats[m]->stride, block.values + (size_t) i * block.stride,
+          ranks[k] * sizeof(sptValue));
+      }
+    }
+    mats[nmodes] = NULL;
+    ktensors[k].factors = mats;
+  }
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(W[m]);
+    free(W[m]);
+  }
+  free(W);
+  free(offs);
+
+  return 0;
+}
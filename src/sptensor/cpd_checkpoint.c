@@ -0,0 +1,447 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sptensor.h"
+
+#if defined(__GNUC__)
+    #define SPT_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define SPT_THREAD_LOCAL _Thread_local
+#else
+    #define SPT_THREAD_LOCAL
+#endif
+
+/*
+ * CP-ALS checkpoints: the factors, lambda and iteration state of a running
+ * decomposition, so a preempted run can pick up where it stopped. Values
+ * are stored as doubles and factors without their row padding. A checkpoint
+ * records the fingerprint of the tensor and the stopping criteria of its
+ * run, and only a run with the same ones resumes from it.
+ */
+
+#define PARTI_CPD_CHECKPOINT_MAGIC "PTICPDCK"
+#define PARTI_CPD_CHECKPOINT_VERSION 2
+
+typedef struct {
+    char magic[8];          /// PARTI_CPD_CHECKPOINT_MAGIC, not NUL-terminated
+    uint32_t version;
+    uint32_t endian;        /// PARTI_BINARY_ENDIAN as written by the producer
+    uint32_t nmodes;
+    uint32_t rank;
+    uint32_t converged;     /// 1 if the run met its tolerance
+    uint32_t reserved;
+    uint64_t iteration;     /// completed iterations
+    double fit;             /// fit after the last completed iteration
+    /* from version 2 */
+    uint64_t fingerprint;   /// sptSparseTensorFingerprint of the input, 0 if not from a run
+    double tol;             /// tolerance of the run
+    uint64_t niters;        /// maximum number of iterations of the run
+} spt_CpdCheckpointHeader;
+/* then ndims as uint64[nmodes], lambda as double[rank], and each factor as double[ndims[m]][rank] */
+
+/* Version 1 headers end before fingerprint */
+#define PARTI_CPD_CHECKPOINT_HEADER_V1 offsetof(spt_CpdCheckpointHeader, fingerprint)
+
+/* sptSetCpdCheckpoint's setting, for the calling thread */
+static SPT_THREAD_LOCAL char * spt_cpd_checkpoint_path = NULL;
+static SPT_THREAD_LOCAL sptIndex spt_cpd_checkpoint_every = 0;
+static SPT_THREAD_LOCAL int spt_cpd_checkpoint_init = 0;
+
+/*
+ * The checkpoint path of runs on the calling thread and its interval: the
+ * execution context's, else sptSetCpdCheckpoint's, else PARTI_CPD_CHECKPOINT's
+ */
+static char const * spt_CpdCheckpointPath(sptIndex * every) {
+    sptExecContext const * const ctx = sptGetExecContext();
+    if(ctx != NULL && ctx->cpd_checkpoint != NULL) {
+        *every = ctx->cpd_checkpoint_every;
+        return ctx->cpd_checkpoint;
+    }
+    if(!spt_cpd_checkpoint_init) {
+        spt_cpd_checkpoint_init = 1;
+        char const * env = getenv("PARTI_CPD_CHECKPOINT");
+        if(env != NULL && *env != '\0') {
+            spt_cpd_checkpoint_path = strdup(env);
+            char const * every = getenv("PARTI_CPD_CHECKPOINT_EVERY");
+            spt_cpd_checkpoint_every = every != NULL ? (sptIndex) strtoul(every, NULL, 10) : 1;
+        }
+    }
+    *every = spt_cpd_checkpoint_every;
+    return spt_cpd_checkpoint_path;
+}
+
+/* Whether the CP-ALS drivers checkpoint at all */
+int spt_CpdCheckpointEnabled(void) {
+    sptIndex every;
+    return spt_CpdCheckpointPath(&every) != NULL;
+}
+
+/**
+ * Make the CP-ALS drivers the calling thread runs checkpoint to `path` every
+ * `every` iterations and when they finish, and resume from it when it exists
+ * at start and was written for the same tensor, rank, tolerance and at most
+ * as many iterations. The file is replaced atomically, so a run killed while
+ * writing leaves the previous checkpoint. Decompositions running side by
+ * side need a path each, e.g. from their sptExecContext's cpd_checkpoint,
+ * which takes precedence.
+ * Defaults to the PARTI_CPD_CHECKPOINT and PARTI_CPD_CHECKPOINT_EVERY
+ * environment variables.
+ * @param path  the checkpoint file, NULL to disable
+ * @param every the interval in iterations, 0 to only write when done
+ */
+int sptSetCpdCheckpoint(char const * path, sptIndex const every) {
+    char * copy = NULL;
+    if(path != NULL) {
+        copy = strdup(path);
+        spt_CheckOSError(!copy, "CPD Checkpoint");
+    }
+    free(spt_cpd_checkpoint_path);
+    spt_cpd_checkpoint_path = copy;
+    spt_cpd_checkpoint_every = every;
+    spt_cpd_checkpoint_init = 1;
+    return 0;
+}
+
+/* Write the container to fp; returns nonzero on success */
+static int spt_WriteKruskalStream(FILE * fp, spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex const it, double const fit, int const converged) {
+    spt_CpdCheckpointHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_CPD_CHECKPOINT_MAGIC, sizeof header.magic);
+    header.version = PARTI_CPD_CHECKPOINT_VERSION;
+    header.endian = PARTI_BINARY_ENDIAN;
+    header.nmodes = f->nmodes;
+    header.rank = f->rank;
+    header.converged = converged != 0;
+    header.iteration = it;
+    header.fit = fit;
+    if(key != NULL) {
+        header.fingerprint = key->fingerprint;
+        header.tol = key->tol;
+        header.niters = key->niters;
+    }
+
+    int ok = fwrite(&header, sizeof header, 1, fp) == 1;
+    for(sptIndex m = 0; ok && m < f->nmodes; ++m) {
+        uint64_t const n = f->ndims[m];
+        ok = fwrite(&n, sizeof n, 1, fp) == 1;
+    }
+    double * row = malloc(f->rank * sizeof *row);
+    ok = ok && row != NULL;
+    for(sptIndex r = 0; ok && r < f->rank; ++r) {
+        row[r] = f->lambda[r];
+    }
+    ok = ok && fwrite(row, sizeof *row, f->rank, fp) == f->rank;
+    for(sptIndex m = 0; ok && m < f->nmodes; ++m) {
+        if(sizeof (sptValue) == sizeof (double) && f->stride == f->rank) {
+            /* Unpadded rows are stored as they are */
+            size_t const n = (size_t) f->ndims[m] * f->rank;
+            ok = fwrite(f->values[m], sizeof (double), n, fp) == n;
+            continue;
+        }
+        for(sptIndex i = 0; ok && i < f->ndims[m]; ++i) {
+            sptValue const * const vals = f->values[m] + (size_t) i * f->stride;
+            for(sptIndex r = 0; r < f->rank; ++r) {
+                row[r] = vals[r];
+            }
+            ok = fwrite(row, sizeof *row, f->rank, fp) == f->rank;
+        }
+    }
+    free(row);
+    return ok;
+}
+
+static int spt_WriteCheckpoint(char const * path, spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex const it, double const fit, int const converged) {
+    size_t const len = strlen(path);
+    char * tmp = malloc(len + 5);
+    spt_CheckOSError(!tmp, "CPD Checkpoint");
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE * fp = fopen(tmp, "wb");
+    if(fp == NULL) {
+        free(tmp);
+        spt_CheckOSError(1, "CPD Checkpoint");
+    }
+    int ok = spt_WriteKruskalStream(fp, f, key, it, fit, converged);
+    ok = fflush(fp) == 0 && ok;
+    ok = fsync(fileno(fp)) == 0 && ok;
+    ok = fclose(fp) == 0 && ok;
+    ok = ok && rename(tmp, path) == 0;
+    if(!ok) {
+        unlink(tmp);
+    }
+    free(tmp);
+    spt_CheckOSError(!ok, "CPD Checkpoint");
+    return 0;
+}
+
+/* Read a checkpoint header, of version 1 or 2, and ndims; ndims is malloc'ed */
+static int spt_ReadCheckpointHeader(FILE * fp, spt_CpdCheckpointHeader * header, sptIndex ** ndims) {
+    memset(header, 0, sizeof *header);
+    if(fread(header, PARTI_CPD_CHECKPOINT_HEADER_V1, 1, fp) != 1 ||
+        memcmp(header->magic, PARTI_CPD_CHECKPOINT_MAGIC, sizeof header->magic) != 0 ||
+        header->version < 1 || header->version > PARTI_CPD_CHECKPOINT_VERSION ||
+        header->endian != PARTI_BINARY_ENDIAN ||
+        header->nmodes == 0 || header->rank == 0 ||
+        (header->version >= 2 && fread((char *) header + PARTI_CPD_CHECKPOINT_HEADER_V1, sizeof *header - PARTI_CPD_CHECKPOINT_HEADER_V1, 1, fp) != 1)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Checkpoint", "not a CP-ALS checkpoint of this build");
+    }
+    *ndims = malloc(header->nmodes * sizeof **ndims);
+    spt_CheckOSError(!*ndims, "CPD Checkpoint");
+    for(sptIndex m = 0; m < header->nmodes; ++m) {
+        uint64_t n;
+        if(fread(&n, sizeof n, 1, fp) != 1 || n == 0 || n > (sptIndex) -1) {
+            free(*ndims);
+            spt_CheckError(SPTERR_VALUE_ERROR, "CPD Checkpoint", "bad mode size");
+        }
+        (*ndims)[m] = (sptIndex) n;
+    }
+    return 0;
+}
+
+/* Read lambda and the factors into f, whose shape matches the header */
+static int spt_ReadCheckpointFactors(FILE * fp, spt_CpdFactors const * f) {
+    double * row = malloc(f->rank * sizeof *row);
+    spt_CheckOSError(!row, "CPD Checkpoint");
+    int ok = fread(row, sizeof *row, f->rank, fp) == f->rank;
+    for(sptIndex r = 0; ok && r < f->rank; ++r) {
+        f->lambda[r] = (sptValue) row[r];
+    }
+    for(sptIndex m = 0; ok && m < f->nmodes; ++m) {
+        for(sptIndex i = 0; ok && i < f->ndims[m]; ++i) {
+            ok = fread(row, sizeof *row, f->rank, fp) == f->rank;
+            sptValue * const vals = f->values[m] + (size_t) i * f->stride;
+            for(sptIndex r = 0; ok && r < f->rank; ++r) {
+                vals[r] = (sptValue) row[r];
+            }
+        }
+    }
+    free(row);
+    if(!ok) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Checkpoint", "truncated checkpoint");
+    }
+    return 0;
+}
+
+int spt_CpdCheckpointRestore(spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex * it, double * fit, int * converged) {
+    *it = 0;
+    *converged = 0;
+    sptIndex every;
+    char const * const path = spt_CpdCheckpointPath(&every);
+    if(path == NULL) {
+        return 0;
+    }
+    FILE * fp = fopen(path, "rb");
+    if(fp == NULL) {
+        return 0;
+    }
+    spt_CpdCheckpointHeader header;
+    sptIndex * ndims;
+    int result = spt_ReadCheckpointHeader(fp, &header, &ndims);
+    if(result != 0) {
+        fclose(fp);
+        return result;
+    }
+    /* A run asking for more iterations continues one that asked for fewer */
+    int matches = header.nmodes == f->nmodes && header.rank == f->rank &&
+        header.fingerprint == key->fingerprint && header.tol == key->tol &&
+        header.niters <= key->niters && header.iteration <= key->niters;
+    for(sptIndex m = 0; matches && m < f->nmodes; ++m) {
+        matches = ndims[m] == f->ndims[m];
+    }
+    free(ndims);
+    if(!matches) {
+        /* A checkpoint of another decomposition or tensor: start afresh and overwrite it */
+        fclose(fp);
+        return 0;
+    }
+    result = spt_ReadCheckpointFactors(fp, f);
+    fclose(fp);
+    spt_CheckError(result, "CPD Checkpoint", NULL);
+    *it = (sptIndex) header.iteration;
+    *fit = header.fit;
+    *converged = header.converged != 0;
+    printf("  resumed from %s after %"PARTI_PRI_INDEX" iterations, fit = %0.5f\n", path, *it, *fit);
+    return 0;
+}
+
+int spt_CpdCheckpointSave(spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex const it, double const fit, int const done, int const converged) {
+    sptIndex every;
+    char const * const path = spt_CpdCheckpointPath(&every);
+    if(path == NULL) {
+        return 0;
+    }
+    if(!done && (every == 0 || it % every != 0)) {
+        return 0;
+    }
+    return spt_WriteCheckpoint(path, f, key, it, fit, converged);
+}
+
+/**
+ * Write a Kruskal tensor as a checkpoint, e.g. to warm-start tomorrow's run.
+ * sptLoadCpdCheckpoint reads it back.
+ */
+int sptSaveCpdCheckpoint(char const * path, sptKruskalTensor const * ktensor) {
+    sptValue ** values = malloc(ktensor->nmodes * sizeof *values);
+    spt_CheckOSError(!values, "CPD Checkpoint");
+    for(sptIndex m = 0; m < ktensor->nmodes; ++m) {
+        values[m] = ktensor->factors[m]->values;
+    }
+    spt_CpdFactors const f = { ktensor->nmodes, ktensor->rank, ktensor->factors[0]->stride, ktensor->ndims, values, ktensor->lambda };
+    int result = spt_WriteCheckpoint(path, &f, NULL, 0, ktensor->fit, 0);
+    free(values);
+    return result;
+}
+
+/**
+ * Write a Kruskal tensor in the checkpoint container, for consumers that map
+ * the factors instead of parsing sptDumpKruskalTensor's text: a 72-byte
+ * header of magic "PTICPDCK", uint32 version, endian, nmodes, rank,
+ * converged and reserved, uint64 iteration, double fit, uint64 fingerprint,
+ * double tol and uint64 niters, the last three 0 outside a run; then ndims as
+ * uint64[nmodes], lambda as double[rank], and each factor as a row-major
+ * double[ndims[m]][rank]. Every array starts 8-byte aligned.
+ * sptLoadKruskalTensorBinary reads it back.
+ */
+int sptDumpKruskalTensorBinary(sptKruskalTensor const * ktsr, FILE * fp) {
+    sptValue ** values = malloc(ktsr->nmodes * sizeof *values);
+    spt_CheckOSError(!values, "KruskalTns Bin Dump");
+    for(sptIndex m = 0; m < ktsr->nmodes; ++m) {
+        values[m] = ktsr->factors[m]->values;
+    }
+    spt_CpdFactors const f = { ktsr->nmodes, ktsr->rank, ktsr->factors[0]->stride, ktsr->ndims, values, ktsr->lambda };
+    int const ok = spt_WriteKruskalStream(fp, &f, NULL, 0, ktsr->fit, 0);
+    free(values);
+    spt_CheckOSError(!ok, "KruskalTns Bin Dump");
+    return 0;
+}
+
+/**
+ * Write a rank Kruskal tensor in the container of sptDumpKruskalTensorBinary.
+ */
+int sptDumpRankKruskalTensorBinary(sptRankKruskalTensor const * ktsr, FILE * fp) {
+    sptValue ** values = malloc(ktsr->nmodes * sizeof *values);
+    spt_CheckOSError(!values, "RankKruskalTns Bin Dump");
+    for(sptIndex m = 0; m < ktsr->nmodes; ++m) {
+        values[m] = ktsr->factors[m]->values;
+    }
+    spt_CpdFactors const f = { ktsr->nmodes, ktsr->rank, ktsr->factors[0]->stride, ktsr->ndims, values, ktsr->lambda };
+    int const ok = spt_WriteKruskalStream(fp, &f, NULL, 0, ktsr->fit, 0);
+    free(values);
+    spt_CheckOSError(!ok, "RankKruskalTns Bin Dump");
+    return 0;
+}
+
+/**
+ * Read a Kruskal tensor written by sptDumpKruskalTensorBinary or a CP-ALS
+ * checkpoint into a new Kruskal tensor, with its factors allocated.
+ */
+int sptLoadKruskalTensorBinary(sptKruskalTensor * ktensor, FILE * fp) {
+    spt_CpdCheckpointHeader header;
+    sptIndex * ndims;
+    int result = spt_ReadCheckpointHeader(fp, &header, &ndims);
+    spt_CheckError(result, "KruskalTns Bin Load", NULL);
+    sptIndex const nmodes = header.nmodes;
+    sptIndex const rank = header.rank;
+    result = sptNewKruskalTensor(ktensor, nmodes, ndims, rank);
+    free(ndims);
+    spt_CheckError(result, "KruskalTns Bin Load", NULL);
+    ktensor->factors = malloc(nmodes * sizeof *ktensor->factors);
+    sptValue ** values = malloc(nmodes * sizeof *values);
+    spt_CheckOSError(!ktensor->factors || !values, "KruskalTns Bin Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ktensor->factors[m] = malloc(sizeof *ktensor->factors[m]);
+        spt_CheckOSError(!ktensor->factors[m], "KruskalTns Bin Load");
+        result = sptNewMatrix(ktensor->factors[m], ktensor->ndims[m], rank);
+        spt_CheckError(result, "KruskalTns Bin Load", NULL);
+        values[m] = ktensor->factors[m]->values;
+    }
+    spt_CpdFactors const f = { nmodes, rank, ktensor->factors[0]->stride, ktensor->ndims, values, ktensor->lambda };
+    result = spt_ReadCheckpointFactors(fp, &f);
+    free(values);
+    if(result != 0) {
+        sptFreeKruskalTensor(ktensor);
+        return result;
+    }
+    ktensor->fit = header.fit;
+    return 0;
+}
+
+/**
+ * Read a checkpoint into a new Kruskal tensor, with its factors allocated.
+ * Passed to a CP-ALS driver, the factors are its initial guess instead of
+ * random ones.
+ */
+int sptLoadCpdCheckpoint(char const * path, sptKruskalTensor * ktensor) {
+    FILE * fp = fopen(path, "rb");
+    spt_CheckOSError(fp == NULL, "CPD Checkpoint");
+    int const result = sptLoadKruskalTensorBinary(ktensor, fp);
+    fclose(fp);
+    spt_CheckError(result, "CPD Checkpoint", NULL);
+    return 0;
+}
+
+int spt_CpdTakeFactors(sptKruskalTensor * ktensor, sptIndex const nmodes, sptIndex const ndims[], sptIndex const rank, sptMatrix ** mats, int * taken) {
+    *taken = 0;
+    if(ktensor->factors == NULL) {
+        return 0;
+    }
+    if(ktensor->nmodes != nmodes || ktensor->rank != rank) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Warm Start", "initial factors do not match the rank");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(ktensor->factors[m]->nrows != ndims[m] || ktensor->factors[m]->ncols != rank) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Warm Start", "initial factors do not match the tensor");
+        }
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = ktensor->factors[m];
+    }
+    free(ktensor->factors);
+    ktensor->factors = NULL;
+    *taken = 1;
+    return 0;
+}
+
+int spt_CpdTakeRankFactors(sptRankKruskalTensor * ktensor, sptIndex const nmodes, sptIndex const ndims[], sptIndex const rank, sptRankMatrix ** mats, int * taken) {
+    *taken = 0;
+    if(ktensor->factors == NULL) {
+        return 0;
+    }
+    if(ktensor->nmodes != nmodes || ktensor->rank != rank) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Warm Start", "initial factors do not match the rank");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(ktensor->factors[m]->nrows != ndims[m] || ktensor->factors[m]->ncols != rank) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Warm Start", "initial factors do not match the tensor");
+        }
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = ktensor->factors[m];
+    }
+    free(ktensor->factors);
+    ktensor->factors = NULL;
+    *taken = 1;
+    return 0;
+}
@@ -0,0 +1,578 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+#include <cublas_v2.h>
+#include <cusolverDn.h>
+
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_cublasSyrk cublasSsyrk
+  #define spt_cusolverDnPotrf_bufferSize cusolverDnSpotrf_bufferSize
+  #define spt_cusolverDnPotrf cusolverDnSpotrf
+  #define spt_cusolverDnPotrs cusolverDnSpotrs
+#else
+  #define spt_cublasSyrk cublasDsyrk
+  #define spt_cusolverDnPotrf_bufferSize cusolverDnDpotrf_bufferSize
+  #define spt_cusolverDnPotrf cusolverDnDpotrf
+  #define spt_cusolverDnPotrs cusolverDnDpotrs
+#endif
+
+#define PARTI_CUDA_CPD_NBLOCKS 256
+#define PARTI_CUDA_CPD_NTHREADS 256
+
+
+/* neqs = Hadamard product of all Gram matrices but ata[mode] (column-major, lower part used) */
+__global__ static void spt_CpdGramHadamardKernel(
+    sptIndex const mode,
+    sptIndex const nmodes,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue ** dev_ata,
+    sptValue * neqs)
+{
+    sptIndex const x = blockIdx.x * blockDim.x + threadIdx.x;
+    if(x < rank * rank) {
+        sptIndex const i = x % rank, j = x / rank;
+        sptValue v = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                v *= dev_ata[m][j * stride + i];
+            }
+        }
+        neqs[j * stride + i] = v;
+    }
+}
+
+
+/* One block per column: lambda[j] = 2-norm, or max clamped below at 1, then scale column j. */
+__global__ static void spt_CpdNormalizeKernel(
+    sptIndex const nrows,
+    sptIndex const stride,
+    sptValue * const vals,
+    sptValue * const lambda,
+    int const max_norm)
+{
+    __shared__ double shr[PARTI_CUDA_CPD_NTHREADS];
+    sptIndex const j = blockIdx.x;
+    double acc = 0;
+    for(sptIndex i = threadIdx.x; i < nrows; i += blockDim.x) {
+        double const v = vals[(sptNnzIndex) i * stride + j];
+        if(max_norm) {
+            if(v > acc) acc = v;
+        } else {
+            acc += v * v;
+        }
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            if(max_norm) {
+                if(shr[threadIdx.x + s] > shr[threadIdx.x]) shr[threadIdx.x] = shr[threadIdx.x + s];
+            } else {
+                shr[threadIdx.x] += shr[threadIdx.x + s];
+            }
+        }
+        __syncthreads();
+    }
+    double norm = shr[0];
+    if(max_norm) {
+        if(norm < 1) norm = 1;
+    } else {
+        norm = sqrt(norm);
+    }
+    if(threadIdx.x == 0) {
+        lambda[j] = (sptValue) norm;
+    }
+    for(sptIndex i = threadIdx.x; i < nrows; i += blockDim.x) {
+        vals[(sptNnzIndex) i * stride + j] /= (sptValue) norm;
+    }
+}
+
+
+/* Per-block partial sums of sum_i sum_r lambda[r] * A[i][r] * M[i][r] */
+__global__ static void spt_CpdInnerKernel(
+    sptIndex const nrows,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue const * const A,
+    sptValue const * const M,
+    sptValue const * const lambda,
+    double * const partial)
+{
+    __shared__ double shr[PARTI_CUDA_CPD_NTHREADS];
+    sptNnzIndex const total = (sptNnzIndex) nrows * rank;
+    double acc = 0;
+    for(sptNnzIndex x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x; x < total; x += (sptNnzIndex) gridDim.x * blockDim.x) {
+        sptIndex const i = (sptIndex) (x / rank), r = (sptIndex) (x % rank);
+        acc += (double) lambda[r] * A[(sptNnzIndex) i * stride + r] * M[(sptNnzIndex) i * stride + r];
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            shr[threadIdx.x] += shr[threadIdx.x + s];
+        }
+        __syncthreads();
+    }
+    if(threadIdx.x == 0) {
+        partial[blockIdx.x] = shr[0];
+    }
+}
+
+
+/* Single thread: combine the inner product, the Kruskal norm and the last potrf status into scalars[0..1]. */
+__global__ static void spt_CpdFitKernel(
+    sptIndex const nmodes,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue ** dev_ata,
+    sptValue const * const lambda,
+    double const * const partial,
+    int const npartial,
+    double const spten_normsq,
+    int const * const info,
+    double * const scalars)
+{
+    double inner = 0;
+    for(int b = 0; b < npartial; ++b) {
+        inner += partial[b];
+    }
+    double norm_mats = 0;
+    for(sptIndex i = 0; i < rank; ++i) {
+        for(sptIndex j = i; j < rank; ++j) {
+            double v = (double) lambda[i] * lambda[j];
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                v *= dev_ata[m][i * stride + j];
+            }
+            norm_mats += i == j ? v : 2 * v;
+        }
+    }
+    double residual = spten_normsq + fabs(norm_mats) - 2 * inner;
+    if(residual > 0.0) {
+        residual = sqrt(residual);
+    }
+    scalars[0] = 1 - residual / sqrt(spten_normsq);
+    scalars[1] = (double) *info;
+}
+
+
+/* Device operands of one CP-ALS run, as enqueued by spt_CudaCpdSweep */
+typedef struct {
+  sptIndex nmodes;
+  sptIndex rank;
+  sptIndex stride;
+  sptNnzIndex nnz;
+  sptIndex const * nrows;       /// host copy of the factor heights
+  sptIndex * dev_Xndims;
+  sptIndex ** dev_Xinds;
+  sptValue * dev_Xvals;
+  sptValue * dev_scratch;
+  sptIndex * dev_mats_order;    /// nmodes orders, that of mode m at m * nmodes
+  sptValue ** dev_mats;
+  sptValue ** mats_header;      /// device pointers of the factors, mats_header[nmodes] is the MTTKRP output
+  sptValue ** dev_ata;
+  sptValue ** ata_header;
+  sptValue * dev_lambda;
+  double * dev_partial;
+  double * dev_scalars;
+  sptValue * dev_work;
+  int lwork;
+  int * dev_info;
+  double spten_normsq;
+  cudaEvent_t * marks;          /// 2*nmodes+2 events for the trace, see spt_CudaCpdTraceSweep; NULL unless tracing
+  cublasHandle_t blas;
+  cusolverDnHandle_t solver;
+} spt_CudaCpdSweepArgs;
+
+/*
+ * Enqueue one ALS sweep and its fit on `stream`, with no host synchronization,
+ * so that the sweep can be captured into a CUDA graph; the fit and the Cholesky
+ * status land in dev_scalars.
+ */
+static int spt_CudaCpdSweep(spt_CudaCpdSweepArgs const * a, int const max_norm, cudaStream_t stream)
+{
+  sptIndex const nmodes = a->nmodes;
+  sptIndex const stride = a->stride;
+  sptValue const alpha = 1.0, beta = 0.0;
+  int const blas_rank = (int) a->rank;
+  int const blas_stride = (int) stride;
+  sptNnzIndex const nthreads = PARTI_CUDA_CPD_NTHREADS;
+  int result;
+
+  if(a->marks != NULL) {
+    cudaEventRecord(a->marks[0], stream);
+  }
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    sptIndex const nrows = a->nrows[m];
+    sptNnzIndex const len = (sptNnzIndex) nrows * stride;
+
+    result = cudaMemsetAsync(a->mats_header[nmodes], 0, len * sizeof (sptValue), stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    sptAssert(sptCudaMTTKRPDeviceAsync(m, nmodes, a->nnz, a->rank, stride, a->dev_Xndims, a->dev_Xinds, a->dev_Xvals,
+      a->dev_mats_order + m * nmodes, a->dev_mats, a->dev_scratch, stream) == 0);
+    if(a->marks != NULL) {
+      cudaEventRecord(a->marks[2*m+1], stream);
+    }
+
+    /* mats[m] = MTTKRP * inv(Hadamard of the other Gram matrices); mats[nmodes] is kept for the fit */
+    result = cudaMemcpyAsync(a->mats_header[m], a->mats_header[nmodes], len * sizeof (sptValue), cudaMemcpyDeviceToDevice, stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    spt_CpdGramHadamardKernel<<<(a->rank * a->rank + nthreads - 1) / nthreads, nthreads, 0, stream>>>(
+      m, nmodes, a->rank, stride, a->dev_ata, a->ata_header[nmodes]);
+    spt_cusolverDnPotrf(a->solver, CUBLAS_FILL_MODE_LOWER, blas_rank, a->ata_header[nmodes], blas_stride,
+      a->dev_work, a->lwork, a->dev_info);
+    spt_cusolverDnPotrs(a->solver, CUBLAS_FILL_MODE_LOWER, blas_rank, (int) nrows, a->ata_header[nmodes], blas_stride,
+      a->mats_header[m], blas_stride, a->dev_info + 1);
+
+    /* Normalize, using different norms to avoid precision explosion */
+    spt_CpdNormalizeKernel<<<a->rank, nthreads, 0, stream>>>(nrows, stride, a->mats_header[m], a->dev_lambda, max_norm);
+
+    spt_cublasSyrk(a->blas, CUBLAS_FILL_MODE_LOWER, CUBLAS_OP_N, blas_rank, (int) nrows,
+      &alpha, a->mats_header[m], blas_stride, &beta, a->ata_header[m], blas_stride);
+    if(a->marks != NULL) {
+      cudaEventRecord(a->marks[2*m+2], stream);
+    }
+  } // Loop nmodes
+
+  spt_CpdInnerKernel<<<PARTI_CUDA_CPD_NBLOCKS, nthreads, 0, stream>>>(
+    a->nrows[nmodes-1], a->rank, stride, a->mats_header[nmodes-1], a->mats_header[nmodes], a->dev_lambda, a->dev_partial);
+  spt_CpdFitKernel<<<1, 1, 0, stream>>>(nmodes, a->rank, stride, a->dev_ata, a->dev_lambda, a->dev_partial, PARTI_CUDA_CPD_NBLOCKS,
+    a->spten_normsq, a->dev_info, a->dev_scalars);
+  if(a->marks != NULL) {
+    cudaEventRecord(a->marks[2*nmodes+1], stream);
+  }
+  result = cudaGetLastError();
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  return 0;
+}
+
+/*
+ * Put the device intervals of a finished sweep on the "CUDA stream" row of
+ * the trace. Device times are relative to marks[0], which is taken to be
+ * host_begin, when the sweep was enqueued.
+ */
+static void spt_CudaCpdTraceSweep(cudaEvent_t const * marks, sptIndex const nmodes, double const host_begin)
+{
+  float ms[2];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    cudaEventElapsedTime(&ms[0], marks[0], marks[2*m]);
+    cudaEventElapsedTime(&ms[1], marks[0], marks[2*m+1]);
+    spt_TraceSpan("CUDA stream", "CUDA MTTKRP", m, host_begin + ms[0] * 1e3, (ms[1] - ms[0]) * 1e3);
+    cudaEventElapsedTime(&ms[0], marks[0], marks[2*m+2]);
+    spt_TraceSpan("CUDA stream", "CUDA solve, normalize and Gram", m, host_begin + ms[1] * 1e3, (ms[0] - ms[1]) * 1e3);
+  }
+  cudaEventElapsedTime(&ms[0], marks[0], marks[2*nmodes]);
+  cudaEventElapsedTime(&ms[1], marks[0], marks[2*nmodes+1]);
+  spt_TraceSpan("CUDA stream", "CUDA fit", -1, host_begin + ms[0] * 1e3, (ms[1] - ms[0]) * 1e3);
+}
+
+/* CUDA graphs (CUDA 10 and later) are used unless PARTI_CUDA_GRAPHS is set to 0 */
+static int spt_CudaGraphsEnabled(void)
+{
+  char const * env = getenv("PARTI_CUDA_GRAPHS");
+  return CUDART_VERSION >= 10000 && (env == NULL || atoi(env) != 0);
+}
+
+
+/**
+ * CUDA CP-ALS with every operand resident on the device chosen by sptCudaSetDevice.
+ *
+ * The tensor, the factor matrices, the Gram matrices and lambda stay on the
+ * device for the whole run. MTTKRP uses the CUDA scratch kernel. The normal
+ * equations are formed with cuBLAS SYRK and solved with cuSOLVER potrf/potrs,
+ * and the column norms and the fit are reduced on the device. Per iteration
+ * only the fit (and the Cholesky status) is copied back; the factors return to
+ * the host once at the end.
+ *
+ * Every sweep is enqueued on one stream with no host synchronization inside it.
+ * The sweeps after the first (which uses the 2-norm) are identical, so the
+ * second one is captured into a CUDA graph and the graph is replayed for the
+ * rest; set PARTI_CUDA_GRAPHS=0 to enqueue every sweep instead.
+ *
+ * @param[out] ktensor the Kruskal tensor
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ */
+int sptCudaCpdAls(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptNnzIndex const nnz = spten->nnz;
+  int result;
+
+  /* Initialize factor matrices on the host */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+  }
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptIndex const stride = mats[0]->stride;
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+  double const trace_upload = sptTraceBegin();
+
+  /* Tensor */
+  sptIndex * dev_Xndims;
+  result = sptCudaDuplicateMemory(&dev_Xndims, spten->ndims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptValue * dev_Xvals;
+  result = sptCudaDuplicateMemory(&dev_Xvals, spten->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptIndex ** Xinds_header = new sptIndex *[nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    Xinds_header[m] = spten->inds[m].data;
+  }
+  sptIndex ** dev_Xinds;
+  result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, Xinds_header, nmodes, nnz, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  delete[] Xinds_header;
+  sptValue * dev_scratch;
+  result = spt_CudaPoolAlloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+
+  /* Factors (mats[nmodes] is the MTTKRP output) and Gram matrices (ata[nmodes] is the normal equations) */
+  sptValue ** mats_header = new sptValue *[nmodes+1];
+  sptNnzIndex * lengths = new sptNnzIndex[nmodes+1];
+  sptValue ** ata_header = new sptValue *[nmodes+1];
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    mats_header[m] = mats[m]->values;
+    lengths[m] = (sptNnzIndex) mats[m]->nrows * stride;
+  }
+  sptValue ** dev_mats;
+  result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  result = cudaMemcpy(mats_header, dev_mats, (nmodes+1) * sizeof (sptValue *), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptValue * dev_ata_body;
+  result = spt_CudaPoolAlloc((void **) &dev_ata_body, (nmodes+1) * (sptNnzIndex) rank * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  result = cudaMemset(dev_ata_body, 0, (nmodes+1) * (sptNnzIndex) rank * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    ata_header[m] = dev_ata_body + (sptNnzIndex) m * rank * stride;
+  }
+  sptValue ** dev_ata;
+  result = sptCudaDuplicateMemory(&dev_ata, ata_header, (nmodes+1) * sizeof (sptValue *), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+
+  sptValue * dev_lambda;
+  result = spt_CudaPoolAlloc((void **) &dev_lambda, rank * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptIndex * mats_order = new sptIndex[nmodes * nmodes];
+  sptIndex * dev_mats_order;
+  result = spt_CudaPoolAlloc((void **) &dev_mats_order, nmodes * nmodes * sizeof (sptIndex));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  double * dev_partial;
+  result = spt_CudaPoolAlloc((void **) &dev_partial, (PARTI_CUDA_CPD_NBLOCKS + 2) * sizeof (double));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  double * dev_scalars = dev_partial + PARTI_CUDA_CPD_NBLOCKS;
+
+  /* cuBLAS and cuSOLVER */
+  cublasHandle_t blas;
+  result = cublasCreate(&blas);
+  spt_CheckError(result != CUBLAS_STATUS_SUCCESS ? SPTERR_CUDA_ERROR : 0, "CUDA SpTns CPD-ALS", "cublasCreate failed");
+  cusolverDnHandle_t solver;
+  result = cusolverDnCreate(&solver);
+  spt_CheckError(result != CUSOLVER_STATUS_SUCCESS ? SPTERR_CUDA_ERROR : 0, "CUDA SpTns CPD-ALS", "cusolverDnCreate failed");
+  int lwork = 0;
+  spt_cusolverDnPotrf_bufferSize(solver, CUBLAS_FILL_MODE_LOWER, (int) rank, ata_header[nmodes], (int) stride, &lwork);
+  sptValue * dev_work;
+  result = spt_CudaPoolAlloc((void **) &dev_work, (lwork > 0 ? lwork : 1) * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  int * dev_info;
+  result = spt_CudaPoolAlloc((void **) &dev_info, 2 * sizeof (int));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+
+  cudaStream_t stream;
+  result = cudaStreamCreate(&stream);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  cublasSetStream(blas, stream);
+  cusolverDnSetStream(solver, stream);
+
+  /* The Khatri-Rao orders of all modes, uploaded once */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    for(sptIndex i = 0; i < nmodes; ++i) {
+      mats_order[m * nmodes + i] = (m+i) % nmodes;
+    }
+  }
+  result = cudaMemcpy(dev_mats_order, mats_order, nmodes * nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptTraceEnd("CUDA upload", -1, trace_upload);
+
+  sptValue const alpha = 1.0, beta = 0.0;
+  int const blas_rank = (int) rank;
+  int const blas_stride = (int) stride;
+
+  /* ata[m] = mats[m]^T * mats[m], column-major lower part */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    spt_cublasSyrk(blas, CUBLAS_FILL_MODE_LOWER, CUBLAS_OP_N, blas_rank, (int) mats[m]->nrows,
+      &alpha, mats_header[m], blas_stride, &beta, ata_header[m], blas_stride);
+  }
+
+  sptIndex * nrows = new sptIndex[nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    nrows[m] = mats[m]->nrows;
+  }
+  spt_CudaCpdSweepArgs sweep = {
+    nmodes, rank, stride, nnz, nrows, dev_Xndims, dev_Xinds, dev_Xvals, dev_scratch,
+    dev_mats_order, dev_mats, mats_header, dev_ata, ata_header, dev_lambda,
+    dev_partial, dev_scalars, dev_work, lwork, dev_info,
+    SparseTensorFrobeniusNormSquared(spten), NULL, blas, solver
+  };
+  /* Tracing records events inside the sweep, so it runs without graphs */
+  cudaEvent_t * marks = NULL;
+  if(sptTracingEnabled()) {
+    marks = new cudaEvent_t[2*nmodes+2];
+    for(sptIndex i = 0; i < 2*nmodes+2; ++i) {
+      result = cudaEventCreate(&marks[i]);
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    }
+    sweep.marks = marks;
+  }
+  int const use_graph = spt_CudaGraphsEnabled() && marks == NULL;
+#if CUDART_VERSION >= 10000
+  cudaGraph_t graph = NULL;
+  cudaGraphExec_t graph_exec = NULL;
+#endif
+  double fit = 0, oldfit = 0;
+
+  for(sptIndex it = 0; it < niters; ++it) {
+    sptTimer its_timer;
+    sptNewTimer(&its_timer, 0);
+    sptStartTimer(its_timer);
+    double const trace_it = sptTraceBegin();
+
+#if CUDART_VERSION >= 10000
+    if(use_graph && it != 0) {
+      if(graph_exec == NULL) {
+        result = cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal);
+        spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+        sptAssert(spt_CudaCpdSweep(&sweep, 1, stream) == 0);
+        result = cudaStreamEndCapture(stream, &graph);
+        spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+        result = cudaGraphInstantiate(&graph_exec, graph, NULL, NULL, 0);
+        spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+      }
+      result = cudaGraphLaunch(graph_exec, stream);
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    } else
+#endif
+    {
+      sptAssert(spt_CudaCpdSweep(&sweep, it != 0, stream) == 0);
+    }
+
+    /* The only host wait of the iteration */
+    double scalars[2];
+    result = cudaMemcpyAsync(scalars, dev_scalars, sizeof scalars, cudaMemcpyDeviceToHost, stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    result = cudaStreamSynchronize(stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+    fit = scalars[0];
+    if(scalars[1] != 0) {
+      printf("Gram matrix is not SPD (potrf info %d).\n", (int) scalars[1]);
+    }
+    if(marks != NULL) {
+      spt_CudaCpdTraceSweep(marks, nmodes, trace_it);
+    }
+    sptTraceEnd("CUDA CPD iteration", it, trace_it);
+
+    sptStopTimer(its_timer);
+    double its_time = sptElapsedTime(its_timer);
+    sptFreeTimer(its_timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+#if CUDART_VERSION >= 10000
+  if(graph_exec != NULL) {
+    cudaGraphExecDestroy(graph_exec);
+    cudaGraphDestroy(graph);
+  }
+#endif
+  cudaStreamDestroy(stream);
+  delete[] nrows;
+  if(marks != NULL) {
+    for(sptIndex i = 0; i < 2*nmodes+2; ++i) {
+      cudaEventDestroy(marks[i]);
+    }
+    delete[] marks;
+  }
+
+  /* Bring the factors and lambda back once */
+  double const trace_download = sptTraceBegin();
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpy(mats[m]->values, mats_header[m], lengths[m] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  }
+  result = cudaMemcpy(ktensor->lambda, dev_lambda, rank * sizeof (sptValue), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS");
+  sptTraceEnd("CUDA download", -1, trace_download);
+  GetFinalLambda(rank, nmodes, mats, ktensor->lambda);
+  ktensor->fit = fit;
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CUDA SpTns CPD-ALS");
+  sptFreeTimer(timer);
+
+  cusolverDnDestroy(solver);
+  cublasDestroy(blas);
+  spt_CudaPoolFree(dev_info);
+  spt_CudaPoolFree(dev_work);
+  spt_CudaPoolFree(dev_partial);
+  spt_CudaPoolFree(dev_mats_order);
+  spt_CudaPoolFree(dev_lambda);
+  spt_CudaPoolFree(dev_ata);
+  spt_CudaPoolFree(dev_ata_body);
+  spt_CudaPoolFree(dev_mats);
+  spt_CudaPoolFree(dev_scratch);
+  spt_CudaPoolFree(dev_Xinds);
+  spt_CudaPoolFree(dev_Xvals);
+  spt_CudaPoolFree(dev_Xndims);
+  delete[] mats_order;
+  delete[] ata_header;
+  delete[] lengths;
+  delete[] mats_header;
+
+  ktensor->factors = mats;
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
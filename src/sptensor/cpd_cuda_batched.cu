@@ -0,0 +1,538 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+#include <cusolverDn.h>
+
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_cusolverDnPotrfBatched cusolverDnSpotrfBatched
+#else
+  #define spt_cusolverDnPotrfBatched cusolverDnDpotrfBatched
+#endif
+
+#define PARTI_CUDA_BATCH_NTHREADS 256
+
+
+/*
+ * The batch is packed as one block-diagonal tensor: the factor rows of tensor b
+ * in mode m are rows rowoff[m][b] .. rowoff[m][b+1]-1 of one factor buffer per
+ * mode, and its nonzeros carry those global row numbers. One MTTKRP over the
+ * packed tensor is then the MTTKRP of every tensor of the batch.
+ */
+
+/* The tensor of the batch that owns global row i, given the ntensors+1 row offsets of its mode */
+__device__ static sptIndex spt_BatchOwner(sptIndex const * rowoff, sptIndex const ntensors, sptIndex const i)
+{
+    sptIndex lo = 0, hi = ntensors - 1;
+    while(lo < hi) {
+        sptIndex const mid = (lo + hi + 1) / 2;
+        if(rowoff[mid] <= i) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+
+/* One block per tensor: its Gram matrix of rows rowoff[b] .. rowoff[b+1]-1 of A, both triangles */
+__global__ static void spt_CpdBatchGramKernel(
+    sptIndex const rank,
+    sptIndex const stride,
+    sptIndex const * const rowoff,
+    sptValue const * const A,
+    sptValue * const ata)   // ntensors Gram matrices of rank * stride
+{
+    sptIndex const b = blockIdx.x;
+    sptValue * const g = ata + (sptNnzIndex) b * rank * stride;
+    for(sptIndex x = threadIdx.x; x < rank * rank; x += blockDim.x) {
+        sptIndex const i = x % rank, j = x / rank;
+        double acc = 0;
+        for(sptIndex row = rowoff[b]; row < rowoff[b+1]; ++row) {
+            acc += (double) A[(sptNnzIndex) row * stride + i] * A[(sptNnzIndex) row * stride + j];
+        }
+        g[j * stride + i] = (sptValue) acc;
+    }
+}
+
+
+/* neqs[b] = Hadamard product of all Gram matrices of tensor b but that of mode */
+__global__ static void spt_CpdBatchHadamardKernel(
+    sptIndex const mode,
+    sptIndex const nmodes,
+    sptIndex const ntensors,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue * const ata)   // (nmodes+1) * ntensors Gram matrices, the last ntensors are neqs
+{
+    sptNnzIndex const x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    sptNnzIndex const len = (sptNnzIndex) rank * stride;
+    if(x >= (sptNnzIndex) ntensors * rank * rank) {
+        return;
+    }
+    sptIndex const b = (sptIndex) (x / ((sptNnzIndex) rank * rank));
+    sptIndex const ij = (sptIndex) (x % ((sptNnzIndex) rank * rank));
+    sptIndex const i = ij % rank, j = ij / rank;
+    sptValue v = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            v *= ata[((sptNnzIndex) m * ntensors + b) * len + j * stride + i];
+        }
+    }
+    ata[((sptNnzIndex) nmodes * ntensors + b) * len + j * stride + i] = v;
+}
+
+
+/* One thread per row: solve L L^T x = row in place with the Cholesky factor of the row's tensor */
+__global__ static void spt_CpdBatchSolveKernel(
+    sptIndex const nrows,
+    sptIndex const ntensors,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptIndex const * const rowoff,
+    sptValue const * const neqs,    // ntensors lower Cholesky factors, column-major
+    int const * const info,
+    sptValue * const A)
+{
+    sptIndex const row = blockIdx.x * blockDim.x + threadIdx.x;
+    if(row >= nrows) {
+        return;
+    }
+    sptIndex const b = spt_BatchOwner(rowoff, ntensors, row);
+    if(info[b] != 0) {
+        return;
+    }
+    sptValue const * const L = neqs + (sptNnzIndex) b * rank * stride;
+    sptValue * const x = A + (sptNnzIndex) row * stride;
+    for(sptIndex i = 0; i < rank; ++i) {
+        sptValue v = x[i];
+        for(sptIndex j = 0; j < i; ++j) {
+            v -= L[j * stride + i] * x[j];
+        }
+        x[i] = v / L[i * stride + i];
+    }
+    for(sptIndex i = rank; i-- > 0; ) {
+        sptValue v = x[i];
+        for(sptIndex j = i + 1; j < rank; ++j) {
+            v -= L[i * stride + j] * x[j];
+        }
+        x[i] = v / L[i * stride + i];
+    }
+}
+
+
+/* One block per (tensor, column): lambda = 2-norm, or max clamped below at 1, then scale the column. */
+__global__ static void spt_CpdBatchNormalizeKernel(
+    sptIndex const rank,
+    sptIndex const stride,
+    sptIndex const * const rowoff,
+    sptValue * const vals,
+    sptValue * const lambda,    // ntensors * rank
+    int const max_norm)
+{
+    __shared__ double shr[PARTI_CUDA_BATCH_NTHREADS];
+    sptIndex const b = blockIdx.x / rank, j = blockIdx.x % rank;
+    double acc = 0;
+    for(sptIndex i = rowoff[b] + threadIdx.x; i < rowoff[b+1]; i += blockDim.x) {
+        double const v = vals[(sptNnzIndex) i * stride + j];
+        if(max_norm) {
+            if(v > acc) acc = v;
+        } else {
+            acc += v * v;
+        }
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            if(max_norm) {
+                if(shr[threadIdx.x + s] > shr[threadIdx.x]) shr[threadIdx.x] = shr[threadIdx.x + s];
+            } else {
+                shr[threadIdx.x] += shr[threadIdx.x + s];
+            }
+        }
+        __syncthreads();
+    }
+    double norm = shr[0];
+    if(max_norm) {
+        if(norm < 1) norm = 1;
+    } else {
+        norm = sqrt(norm);
+    }
+    if(threadIdx.x == 0) {
+        lambda[(sptNnzIndex) b * rank + j] = (sptValue) norm;
+    }
+    for(sptIndex i = rowoff[b] + threadIdx.x; i < rowoff[b+1]; i += blockDim.x) {
+        vals[(sptNnzIndex) i * stride + j] /= (sptValue) norm;
+    }
+}
+
+
+/* One block per tensor: its fit, from the last factor, the MTTKRP of the last mode, lambda and the Gram matrices */
+__global__ static void spt_CpdBatchFitKernel(
+    sptIndex const nmodes,
+    sptIndex const ntensors,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptIndex const * const rowoff,  // of the last mode
+    sptValue const * const A,
+    sptValue const * const M,
+    sptValue const * const lambda,
+    sptValue const * const ata,
+    double const * const normsq,
+    double * const fits)
+{
+    __shared__ double shr[PARTI_CUDA_BATCH_NTHREADS];
+    sptIndex const b = blockIdx.x;
+    sptValue const * const lam = lambda + (sptNnzIndex) b * rank;
+    sptNnzIndex const first = (sptNnzIndex) rowoff[b] * rank;
+    sptNnzIndex const last = (sptNnzIndex) rowoff[b+1] * rank;
+    double acc = 0;
+    for(sptNnzIndex x = first + threadIdx.x; x < last; x += blockDim.x) {
+        sptIndex const i = (sptIndex) (x / rank), r = (sptIndex) (x % rank);
+        acc += (double) lam[r] * A[(sptNnzIndex) i * stride + r] * M[(sptNnzIndex) i * stride + r];
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            shr[threadIdx.x] += shr[threadIdx.x + s];
+        }
+        __syncthreads();
+    }
+    if(threadIdx.x == 0) {
+        sptNnzIndex const len = (sptNnzIndex) rank * stride;
+        double norm_mats = 0;
+        for(sptIndex i = 0; i < rank; ++i) {
+            for(sptIndex j = i; j < rank; ++j) {
+                double v = (double) lam[i] * lam[j];
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    v *= ata[((sptNnzIndex) m * ntensors + b) * len + i * stride + j];
+                }
+                norm_mats += i == j ? v : 2 * v;
+            }
+        }
+        double residual = normsq[b] + fabs(norm_mats) - 2 * shr[0];
+        if(residual > 0.0) {
+            residual = sqrt(residual);
+        }
+        fits[b] = 1 - residual / sqrt(normsq[b]);
+    }
+}
+
+
+/**
+ * CUDA CP-ALS of a batch of small tensors, all of the same order and decomposed with the same rank.
+ *
+ * The batch is uploaded once, packed as one block-diagonal tensor with the
+ * factors of all tensors stacked in one buffer per mode, so that a single
+ * MTTKRP launch serves the whole batch. The normal equations of all tensors are
+ * factorized by one cuSOLVER potrfBatched call and solved, normalized and
+ * reduced to a fit by one kernel launch each. Per iteration only the fits are
+ * copied back; the factors return once at the end. Iterations stop once no fit
+ * changes by more than tol.
+ *
+ * @param[out] ktensors ntensors Kruskal tensors made by sptNewKruskalTensor with rank
+ * @param[in]  tensors the COO sparse tensors
+ * @param[in]  ntensors the number of tensors
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ */
+int sptCudaCpdAlsBatched(
+  sptSparseTensor const * const tensors[],
+  sptIndex const ntensors,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor ktensors[])
+{
+  if(ntensors == 0) {
+    return 0;
+  }
+  sptIndex const nmodes = tensors[0]->nmodes;
+  int result;
+
+  /* Row offsets of every tensor in every mode, and nonzero offsets */
+  sptIndex * rowoff = new sptIndex[nmodes * (ntensors+1)];
+  sptNnzIndex nnz = 0;
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    rowoff[m * (ntensors+1)] = 0;
+  }
+  for(sptIndex b = 0; b < ntensors; ++b) {
+    if(tensors[b]->nmodes != nmodes) {
+      delete[] rowoff;
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns CPD-ALS Batched", "tensors of different orders");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      rowoff[m * (ntensors+1) + b + 1] = rowoff[m * (ntensors+1) + b] + tensors[b]->ndims[m];
+    }
+    nnz += tensors[b]->nnz;
+  }
+  sptIndex * total_rows = new sptIndex[nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    total_rows[m] = rowoff[m * (ntensors+1) + ntensors];
+  }
+
+  /* The packed tensor on the host, with global row numbers */
+  sptIndex ** pinds = new sptIndex *[nmodes];
+  sptValue * pvals = new sptValue[nnz];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    pinds[m] = new sptIndex[nnz];
+  }
+  double * normsq = new double[ntensors];
+  sptNnzIndex z = 0;
+  for(sptIndex b = 0; b < ntensors; ++b) {
+    sptSparseTensor const * X = tensors[b];
+    for(sptNnzIndex x = 0; x < X->nnz; ++x, ++z) {
+      for(sptIndex m = 0; m < nmodes; ++m) {
+        pinds[m][z] = rowoff[m * (ntensors+1) + b] + X->inds[m].data[x];
+      }
+      pvals[z] = X->values.data[x];
+    }
+    normsq[b] = SparseTensorFrobeniusNormSquared(X);
+  }
+
+  /* Stacked factors on the host, mats[nmodes] is the MTTKRP output */
+  sptIndex max_rows = sptMaxIndexArray(total_rows, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(mats[m], m < nmodes ? total_rows[m] : max_rows, rank) == 0);
+  }
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    sptAssert(sptRandomizeMatrix(mats[m], total_rows[m], rank) == 0);
+  }
+  sptIndex const stride = mats[0]->stride;
+  sptNnzIndex const len = (sptNnzIndex) rank * stride;
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  /* Upload the batch once */
+  sptIndex * dev_Xndims;
+  result = sptCudaDuplicateMemory(&dev_Xndims, total_rows, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptValue * dev_Xvals;
+  result = sptCudaDuplicateMemory(&dev_Xvals, pvals, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptIndex ** dev_Xinds;
+  result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, pinds, nmodes, nnz, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptIndex * dev_rowoff;
+  result = sptCudaDuplicateMemory(&dev_rowoff, rowoff, nmodes * (ntensors+1) * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  double * dev_normsq;
+  result = sptCudaDuplicateMemory(&dev_normsq, normsq, ntensors * sizeof (double), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptValue * dev_scratch;
+  result = spt_CudaPoolAlloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+
+  sptValue ** mats_header = new sptValue *[nmodes+1];
+  sptNnzIndex * lengths = new sptNnzIndex[nmodes+1];
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    mats_header[m] = mats[m]->values;
+    lengths[m] = (sptNnzIndex) mats[m]->nrows * stride;
+  }
+  sptValue ** dev_mats;
+  result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  result = cudaMemcpy(mats_header, dev_mats, (nmodes+1) * sizeof (sptValue *), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+
+  /* Gram matrices: ata[m][b] at (m * ntensors + b) * len, with m = nmodes for the normal equations */
+  sptValue * dev_ata;
+  result = spt_CudaPoolAlloc((void **) &dev_ata, (nmodes+1) * ntensors * len * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  result = cudaMemset(dev_ata, 0, (nmodes+1) * ntensors * len * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptValue * const dev_neqs = dev_ata + (sptNnzIndex) nmodes * ntensors * len;
+  sptValue ** neqs_header = new sptValue *[ntensors];
+  for(sptIndex b = 0; b < ntensors; ++b) {
+    neqs_header[b] = dev_neqs + (sptNnzIndex) b * len;
+  }
+  sptValue ** dev_neqs_array;
+  result = sptCudaDuplicateMemory(&dev_neqs_array, neqs_header, ntensors * sizeof (sptValue *), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+
+  sptValue * dev_lambda;
+  result = spt_CudaPoolAlloc((void **) &dev_lambda, (sptNnzIndex) ntensors * rank * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  sptIndex * mats_order = new sptIndex[nmodes];
+  sptIndex * dev_mats_order;
+  result = spt_CudaPoolAlloc((void **) &dev_mats_order, nmodes * sizeof (sptIndex));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  double * dev_fits;
+  result = spt_CudaPoolAlloc((void **) &dev_fits, ntensors * sizeof (double));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  int * dev_info;
+  result = spt_CudaPoolAlloc((void **) &dev_info, ntensors * sizeof (int));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+
+  cusolverDnHandle_t solver;
+  result = cusolverDnCreate(&solver);
+  spt_CheckError(result != CUSOLVER_STATUS_SUCCESS ? SPTERR_CUDA_ERROR : 0, "CUDA SpTns CPD-ALS Batched", "cusolverDnCreate failed");
+
+  sptIndex const nthreads = PARTI_CUDA_BATCH_NTHREADS;
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    spt_CpdBatchGramKernel<<<ntensors, nthreads>>>(rank, stride, dev_rowoff + m * (ntensors+1),
+      mats_header[m], dev_ata + (sptNnzIndex) m * ntensors * len);
+  }
+
+  double * fits = new double[ntensors];
+  double * oldfits = new double[ntensors];
+  for(sptIndex b = 0; b < ntensors; ++b) {
+    fits[b] = oldfits[b] = 0;
+  }
+
+  for(sptIndex it = 0; it < niters; ++it) {
+    sptTimer its_timer;
+    sptNewTimer(&its_timer, 0);
+    sptStartTimer(its_timer);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      sptIndex const nrows = total_rows[m];
+      sptIndex const * const dev_mode_rowoff = dev_rowoff + m * (ntensors+1);
+
+      mats_order[0] = m;
+      for(sptIndex i = 1; i < nmodes; ++i) {
+        mats_order[i] = (m+i) % nmodes;
+      }
+      result = cudaMemcpy(dev_mats_order, mats_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+      result = cudaMemset(mats_header[nmodes], 0, (sptNnzIndex) nrows * stride * sizeof (sptValue));
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+      sptAssert(sptCudaMTTKRPDevice(m, nmodes, nnz, rank, stride, dev_Xndims, dev_Xinds, dev_Xvals,
+        dev_mats_order, dev_mats, dev_scratch) == 0);
+
+      /* mats[m] = MTTKRP * inv(Hadamard of the other Gram matrices), per tensor; mats[nmodes] is kept for the fit */
+      result = cudaMemcpy(mats_header[m], mats_header[nmodes], (sptNnzIndex) nrows * stride * sizeof (sptValue), cudaMemcpyDeviceToDevice);
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+      sptNnzIndex const nentries = (sptNnzIndex) ntensors * rank * rank;
+      spt_CpdBatchHadamardKernel<<<(nentries + nthreads - 1) / nthreads, nthreads>>>(
+        m, nmodes, ntensors, rank, stride, dev_ata);
+      spt_cusolverDnPotrfBatched(solver, CUBLAS_FILL_MODE_LOWER, (int) rank, dev_neqs_array, (int) stride,
+        dev_info, (int) ntensors);
+      spt_CpdBatchSolveKernel<<<(nrows + nthreads - 1) / nthreads, nthreads>>>(
+        nrows, ntensors, rank, stride, dev_mode_rowoff, dev_neqs, dev_info, mats_header[m]);
+
+      /* Normalize, using different norms to avoid precision explosion */
+      spt_CpdBatchNormalizeKernel<<<ntensors * rank, nthreads>>>(rank, stride, dev_mode_rowoff,
+        mats_header[m], dev_lambda, it != 0);
+
+      spt_CpdBatchGramKernel<<<ntensors, nthreads>>>(rank, stride, dev_mode_rowoff,
+        mats_header[m], dev_ata + (sptNnzIndex) m * ntensors * len);
+      result = cudaGetLastError();
+      spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+    } // Loop nmodes
+
+    spt_CpdBatchFitKernel<<<ntensors, nthreads>>>(nmodes, ntensors, rank, stride,
+      dev_rowoff + (nmodes-1) * (ntensors+1), mats_header[nmodes-1], mats_header[nmodes],
+      dev_lambda, dev_ata, dev_normsq, dev_fits);
+    result = cudaMemcpy(fits, dev_fits, ntensors * sizeof (double), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+
+    double min_fit = fits[0], max_delta = 0;
+    for(sptIndex b = 0; b < ntensors; ++b) {
+      if(fits[b] < min_fit) min_fit = fits[b];
+      if(fabs(fits[b] - oldfits[b]) > max_delta) max_delta = fabs(fits[b] - oldfits[b]);
+      oldfits[b] = fits[b];
+    }
+
+    sptStopTimer(its_timer);
+    double its_time = sptElapsedTime(its_timer);
+    sptFreeTimer(its_timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) min fit = %0.5f  max delta = %+0.4e\n",
+        it+1, its_time, min_fit, max_delta);
+    if(it > 0 && max_delta < tol) {
+      break;
+    }
+  } // Loop niters
+
+  /* Bring the factors and lambda back once, and hand each tensor its rows */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpy(mats[m]->values, mats_header[m], lengths[m] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  }
+  sptValue * lambda = new sptValue[(sptNnzIndex) ntensors * rank];
+  result = cudaMemcpy(lambda, dev_lambda, (sptNnzIndex) ntensors * rank * sizeof (sptValue), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-ALS Batched");
+  for(sptIndex b = 0; b < ntensors; ++b) {
+    sptMatrix ** kmats = (sptMatrix **)malloc((nmodes+1) * sizeof(*kmats));
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      sptIndex const first = rowoff[m * (ntensors+1) + b];
+      kmats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(kmats[m], tensors[b]->ndims[m], rank) == 0);
+      memcpy(kmats[m]->values, mats[m]->values + (sptNnzIndex) first * stride,
+        (sptNnzIndex) tensors[b]->ndims[m] * stride * sizeof (sptValue));
+    }
+    kmats[nmodes] = NULL;
+    memcpy(ktensors[b].lambda, lambda + (sptNnzIndex) b * rank, rank * sizeof (sptValue));
+    GetFinalLambda(rank, nmodes, kmats, ktensors[b].lambda);
+    ktensors[b].factors = kmats;
+    ktensors[b].fit = fits[b];
+  }
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CUDA SpTns CPD-ALS Batched");
+  sptFreeTimer(timer);
+
+  cusolverDnDestroy(solver);
+  spt_CudaPoolFree(dev_info);
+  spt_CudaPoolFree(dev_fits);
+  spt_CudaPoolFree(dev_mats_order);
+  spt_CudaPoolFree(dev_lambda);
+  spt_CudaPoolFree(dev_neqs_array);
+  spt_CudaPoolFree(dev_ata);
+  spt_CudaPoolFree(dev_mats);
+  spt_CudaPoolFree(dev_scratch);
+  spt_CudaPoolFree(dev_normsq);
+  spt_CudaPoolFree(dev_rowoff);
+  spt_CudaPoolFree(dev_Xinds);
+  spt_CudaPoolFree(dev_Xvals);
+  spt_CudaPoolFree(dev_Xndims);
+  delete[] lambda;
+  delete[] fits;
+  delete[] oldfits;
+  delete[] neqs_header;
+  delete[] mats_order;
+  delete[] lengths;
+  delete[] mats_header;
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    sptFreeMatrix(mats[m]);
+    free(mats[m]);
+  }
+  free(mats);
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    delete[] pinds[m];
+  }
+  delete[] pinds;
+  delete[] pvals;
+  delete[] normsq;
+  delete[] total_rows;
+  delete[] rowoff;
+
+  return 0;
+}
@@ -0,0 +1,533 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+
+#ifdef PARTI_USE_MPI
+
+#include <math.h>
+#include <stdlib.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+#include <cublas_v2.h>
+#include <cusolverDn.h>
+#if defined(OPEN_MPI) && OPEN_MPI
+#include <mpi-ext.h>
+#endif
+
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_cublasSyrk cublasSsyrk
+  #define spt_cublasDot cublasSdot
+  #define spt_cusolverDnPotrf_bufferSize cusolverDnSpotrf_bufferSize
+  #define spt_cusolverDnPotrf cusolverDnSpotrf
+  #define spt_cusolverDnPotrs cusolverDnSpotrs
+#else
+  #define spt_cublasSyrk cublasDsyrk
+  #define spt_cublasDot cublasDdot
+  #define spt_cusolverDnPotrf_bufferSize cusolverDnDpotrf_bufferSize
+  #define spt_cusolverDnPotrf cusolverDnDpotrf
+  #define spt_cusolverDnPotrs cusolverDnDpotrs
+#endif
+
+#define PARTI_CUDA_CPD_NBLOCKS 256
+#define PARTI_CUDA_CPD_NTHREADS 256
+
+
+/* Rank p owns rows [spt_MpiRowBegin(n, p, P), spt_MpiRowBegin(n, p+1, P)) of an n-row factor, as in cpd_mpi.c. */
+static inline sptIndex spt_MpiRowBegin(sptIndex const nrows, int const p, int const nprocs)
+{
+    return (sptIndex) ((uint64_t) nrows * (uint64_t) p / (uint64_t) nprocs);
+}
+
+/*
+ * Whether MPI takes device pointers. Open MPI answers MPIX_Query_cuda_support;
+ * for other implementations (MVAPICH2-GDR, Cray MPICH, ...) set
+ * PARTI_MPI_CUDA_AWARE=1, which also overrides the query.
+ */
+static int spt_MpiCudaAware(void)
+{
+    char const * env = getenv("PARTI_MPI_CUDA_AWARE");
+    if(env != NULL) {
+        return atoi(env) != 0;
+    }
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+    return MPIX_Query_cuda_support();
+#else
+    return 0;
+#endif
+}
+
+
+/* neqs = Hadamard product of all Gram matrices but ata[mode] (column-major, lower part used) */
+__global__ static void spt_MpiCpdGramHadamardKernel(
+    sptIndex const mode,
+    sptIndex const nmodes,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue ** dev_ata,
+    sptValue * neqs)
+{
+    sptIndex const x = blockIdx.x * blockDim.x + threadIdx.x;
+    if(x < rank * rank) {
+        sptIndex const i = x % rank, j = x / rank;
+        sptValue v = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                v *= dev_ata[m][j * stride + i];
+            }
+        }
+        neqs[j * stride + i] = v;
+    }
+}
+
+
+/* One block per column: this rank's share of the column norm, the sum of squares or the max */
+__global__ static void spt_MpiCpdColumnNormKernel(
+    sptIndex const nrows,
+    sptIndex const stride,
+    sptValue const * const vals,
+    sptValue * const lambda,
+    int const max_norm)
+{
+    __shared__ double shr[PARTI_CUDA_CPD_NTHREADS];
+    sptIndex const j = blockIdx.x;
+    double acc = 0;
+    for(sptIndex i = threadIdx.x; i < nrows; i += blockDim.x) {
+        double const v = vals[(sptNnzIndex) i * stride + j];
+        if(max_norm) {
+            if(v > acc) acc = v;
+        } else {
+            acc += v * v;
+        }
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            if(max_norm) {
+                if(shr[threadIdx.x + s] > shr[threadIdx.x]) shr[threadIdx.x] = shr[threadIdx.x + s];
+            } else {
+                shr[threadIdx.x] += shr[threadIdx.x + s];
+            }
+        }
+        __syncthreads();
+    }
+    if(threadIdx.x == 0) {
+        lambda[j] = (sptValue) shr[0];
+    }
+}
+
+
+/* One block per column: finish the all-reduced norm into lambda[j] (2-norm, or max clamped below at 1) and scale column j */
+__global__ static void spt_MpiCpdScaleKernel(
+    sptIndex const nrows,
+    sptIndex const stride,
+    sptValue * const vals,
+    sptValue * const lambda,
+    int const max_norm)
+{
+    sptIndex const j = blockIdx.x;
+    double norm = lambda[j];
+    if(max_norm) {
+        if(norm < 1) norm = 1;
+    } else {
+        norm = sqrt(norm);
+    }
+    __syncthreads();
+    if(threadIdx.x == 0) {
+        lambda[j] = (sptValue) norm;
+    }
+    for(sptIndex i = threadIdx.x; i < nrows; i += blockDim.x) {
+        vals[(sptNnzIndex) i * stride + j] /= (sptValue) norm;
+    }
+}
+
+
+/* Per-block partial sums of sum_i sum_r lambda[r] * A[i][r] * M[i][r] */
+__global__ static void spt_MpiCpdInnerKernel(
+    sptIndex const nrows,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue const * const A,
+    sptValue const * const M,
+    sptValue const * const lambda,
+    double * const partial)
+{
+    __shared__ double shr[PARTI_CUDA_CPD_NTHREADS];
+    sptNnzIndex const total = (sptNnzIndex) nrows * rank;
+    double acc = 0;
+    for(sptNnzIndex x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x; x < total; x += (sptNnzIndex) gridDim.x * blockDim.x) {
+        sptIndex const i = (sptIndex) (x / rank), r = (sptIndex) (x % rank);
+        acc += (double) lambda[r] * A[(sptNnzIndex) i * stride + r] * M[(sptNnzIndex) i * stride + r];
+    }
+    shr[threadIdx.x] = acc;
+    __syncthreads();
+    for(unsigned s = blockDim.x / 2; s > 0; s >>= 1) {
+        if(threadIdx.x < s) {
+            shr[threadIdx.x] += shr[threadIdx.x + s];
+        }
+        __syncthreads();
+    }
+    if(threadIdx.x == 0) {
+        partial[blockIdx.x] = shr[0];
+    }
+}
+
+
+/* Single thread: combine the all-reduced inner product, the Kruskal norm and the potrf status into scalars[0..1]. */
+__global__ static void spt_MpiCpdFitKernel(
+    sptIndex const nmodes,
+    sptIndex const rank,
+    sptIndex const stride,
+    sptValue ** dev_ata,
+    sptValue const * const lambda,
+    double const * const partial,
+    int const npartial,
+    double const spten_normsq,
+    int const * const info,
+    double * const scalars)
+{
+    double inner = 0;
+    for(int b = 0; b < npartial; ++b) {
+        inner += partial[b];
+    }
+    double norm_mats = 0;
+    for(sptIndex i = 0; i < rank; ++i) {
+        for(sptIndex j = i; j < rank; ++j) {
+            double v = (double) lambda[i] * lambda[j];
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                v *= dev_ata[m][i * stride + j];
+            }
+            norm_mats += i == j ? v : 2 * v;
+        }
+    }
+    double residual = spten_normsq + fabs(norm_mats) - 2 * inner;
+    if(residual > 0.0) {
+        residual = sqrt(residual);
+    }
+    scalars[0] = 1 - residual / sqrt(spten_normsq);
+    scalars[1] = (double) *info;
+}
+
+
+/**
+ * Multi-node GPU CP-ALS: sptMpiCpdAls with every rank's nonzeros and factors
+ * resident on its GPU, as in sptCudaCpdAls. Each rank runs the CUDA MTTKRP
+ * over its own nonzeros; the partial results are reduce-scattered into row
+ * blocks, each rank solves its block with cuSOLVER and adds its SYRK to the
+ * all-reduced Gram matrix, and the blocks are all-gathered. The column norms
+ * and the fit are reduced the same way.
+ *
+ * Every exchange hands device buffers straight to MPI, so MPI must be
+ * CUDA-aware (GPUDirect RDMA between nodes, CUDA IPC within one); nothing is
+ * staged through host memory, and the run fails with SPTERR_CUDA_ERROR rather
+ * than fall back to it. The awareness is queried from Open MPI, or set with
+ * PARTI_MPI_CUDA_AWARE=1. Per iteration only the fit returns to the host.
+ *
+ * Each rank selects its GPU (e.g. sptCudaSetDevice by node-local rank) before
+ * uploading its nonzeros with sptDeviceUploadSparseTensor. All ranks end up
+ * with the same Kruskal tensor.
+ *
+ * @param[out] ktensor the Kruskal tensor, allocated with the global shape
+ * @param[in]  dX      this rank's nonzeros on its device, with the global ndims
+ * @param[in]  rank    the CPD rank
+ * @param[in]  niters  the maximum number of iterations
+ * @param[in]  tol     the tolerance value for convergence
+ * @param[in]  comm    the communicator sharing the tensor
+ */
+int sptMpiCudaCpdAls(
+  sptDeviceSparseTensor const * const dX,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = dX->nmodes;
+  sptNnzIndex const nnz = dX->nnz;
+  int myrank, nprocs;
+  MPI_Comm_rank(comm, &myrank);
+  MPI_Comm_size(comm, &nprocs);
+  int result;
+
+  if(!spt_MpiCudaAware()) {
+    spt_CheckError(SPTERR_CUDA_ERROR, "MPI CUDA SpTns CPD-ALS", "MPI is not CUDA-aware; set PARTI_MPI_CUDA_AWARE=1 if it is");
+  }
+
+  /* Factors on the host only to be allocated; rank 0's random ones are broadcast on the device */
+  sptIndex const max_dim = sptMaxIndexArray(dX->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "MPI CUDA SpTns CPD-ALS");
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptNewMatrix(mats[m], dX->ndims[m], rank) == 0);
+    if(myrank == 0) {
+      sptAssert(sptRandomizeMatrix(mats[m], dX->ndims[m], rank) == 0);
+    }
+  }
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptIndex const stride = mats[0]->stride;
+
+  double start = MPI_Wtime();
+
+  /* Tensor: the device handle already holds the nonzeros */
+  sptIndex * dev_Xndims;
+  result = sptCudaDuplicateMemory(&dev_Xndims, dX->ndims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  sptIndex ** Xinds_header = new sptIndex *[nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    Xinds_header[m] = dX->inds + m * nnz;
+  }
+  sptIndex ** dev_Xinds;
+  result = sptCudaDuplicateMemory(&dev_Xinds, Xinds_header, nmodes * sizeof (sptIndex *), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  delete[] Xinds_header;
+  sptValue * dev_scratch;
+  result = spt_CudaPoolAlloc((void **) &dev_scratch, (nnz > 0 ? nnz : 1) * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+
+  /* Factors (mats[nmodes] is the MTTKRP output) and Gram matrices (ata[nmodes] is the normal equations) */
+  sptValue ** mats_header = new sptValue *[nmodes+1];
+  sptNnzIndex * lengths = new sptNnzIndex[nmodes+1];
+  sptValue ** ata_header = new sptValue *[nmodes+1];
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    mats_header[m] = mats[m]->values;
+    lengths[m] = (sptNnzIndex) mats[m]->nrows * stride;
+  }
+  sptValue ** dev_mats;
+  result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  result = cudaMemcpy(mats_header, dev_mats, (nmodes+1) * sizeof (sptValue *), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    MPI_Bcast(mats_header[m], (int) lengths[m], PARTI_MPI_VALUE, 0, comm);
+  }
+  sptValue * dev_ata_body;
+  result = spt_CudaPoolAlloc((void **) &dev_ata_body, (nmodes+1) * (sptNnzIndex) rank * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  result = cudaMemset(dev_ata_body, 0, (nmodes+1) * (sptNnzIndex) rank * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    ata_header[m] = dev_ata_body + (sptNnzIndex) m * rank * stride;
+  }
+  sptValue ** dev_ata;
+  result = sptCudaDuplicateMemory(&dev_ata, ata_header, (nmodes+1) * sizeof (sptValue *), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+
+  /* The reduce-scattered MTTKRP block, kept for the fit */
+  sptValue * dev_owned;
+  result = spt_CudaPoolAlloc((void **) &dev_owned, (sptNnzIndex) (max_dim / nprocs + 1) * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  sptValue * dev_lambda;
+  result = spt_CudaPoolAlloc((void **) &dev_lambda, rank * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  sptIndex * mats_order = new sptIndex[nmodes * nmodes];
+  sptIndex * dev_mats_order;
+  result = spt_CudaPoolAlloc((void **) &dev_mats_order, nmodes * nmodes * sizeof (sptIndex));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  double * dev_partial;
+  result = spt_CudaPoolAlloc((void **) &dev_partial, (PARTI_CUDA_CPD_NBLOCKS + 2) * sizeof (double));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  double * dev_scalars = dev_partial + PARTI_CUDA_CPD_NBLOCKS;
+
+  /* cuBLAS and cuSOLVER */
+  cublasHandle_t blas;
+  result = cublasCreate(&blas);
+  spt_CheckError(result != CUBLAS_STATUS_SUCCESS ? SPTERR_CUDA_ERROR : 0, "MPI CUDA SpTns CPD-ALS", "cublasCreate failed");
+  cusolverDnHandle_t solver;
+  result = cusolverDnCreate(&solver);
+  spt_CheckError(result != CUSOLVER_STATUS_SUCCESS ? SPTERR_CUDA_ERROR : 0, "MPI CUDA SpTns CPD-ALS", "cusolverDnCreate failed");
+  int lwork = 0;
+  spt_cusolverDnPotrf_bufferSize(solver, CUBLAS_FILL_MODE_LOWER, (int) rank, ata_header[nmodes], (int) stride, &lwork);
+  sptValue * dev_work;
+  result = spt_CudaPoolAlloc((void **) &dev_work, (lwork > 0 ? lwork : 1) * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  int * dev_info;
+  result = spt_CudaPoolAlloc((void **) &dev_info, 2 * sizeof (int));
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+
+  cudaStream_t stream;
+  result = cudaStreamCreate(&stream);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  cublasSetStream(blas, stream);
+  cusolverDnSetStream(solver, stream);
+
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    for(sptIndex i = 0; i < nmodes; ++i) {
+      mats_order[m * nmodes + i] = (m+i) % nmodes;
+    }
+  }
+  result = cudaMemcpy(dev_mats_order, mats_order, nmodes * nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+
+  sptValue const alpha = 1.0, beta = 0.0;
+  int const blas_rank = (int) rank;
+  int const blas_stride = (int) stride;
+  sptNnzIndex const nthreads = PARTI_CUDA_CPD_NTHREADS;
+
+  /* Gram matrices of the replicated initial factors need no communication. */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    spt_cublasSyrk(blas, CUBLAS_FILL_MODE_LOWER, CUBLAS_OP_N, blas_rank, (int) mats[m]->nrows,
+      &alpha, mats_header[m], blas_stride, &beta, ata_header[m], blas_stride);
+  }
+
+  sptValue local_normsq = 0;
+  if(nnz > 0) {
+    spt_cublasDot(blas, (int) nnz, dX->values, 1, dX->values, 1, &local_normsq);
+  }
+  double spten_normsq = (double) local_normsq;
+  MPI_Allreduce(MPI_IN_PLACE, &spten_normsq, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+  /* Row blocks of every mode, element counts for reduce-scatter and allgather */
+  int * counts = new int[nprocs];
+  int * displs = new int[nprocs];
+  double fit = 0, oldfit = 0;
+
+  for(sptIndex it = 0; it < niters; ++it) {
+    double its_time = MPI_Wtime();
+    int const max_norm = it != 0;
+    sptIndex row_begin = 0, owned_rows = 0;
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+      sptIndex const nrows = mats[m]->nrows;
+      for(int p = 0; p < nprocs; ++p) {
+        sptIndex const b = spt_MpiRowBegin(nrows, p, nprocs);
+        counts[p] = (int) ((spt_MpiRowBegin(nrows, p+1, nprocs) - b) * stride);
+        displs[p] = (int) (b * stride);
+      }
+      row_begin = spt_MpiRowBegin(nrows, myrank, nprocs);
+      owned_rows = spt_MpiRowBegin(nrows, myrank+1, nprocs) - row_begin;
+      sptValue * const owned = mats_header[m] + (sptNnzIndex) row_begin * stride;
+
+      /* Local MTTKRP over this rank's nonzeros, summed into the owners' rows */
+      result = cudaMemsetAsync(mats_header[nmodes], 0, (sptNnzIndex) nrows * stride * sizeof (sptValue), stream);
+      spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+      if(nnz > 0) {
+        sptAssert(sptCudaMTTKRPDeviceAsync(m, nmodes, nnz, rank, stride, dev_Xndims, dev_Xinds, dX->values,
+          dev_mats_order + m * nmodes, dev_mats, dev_scratch, stream) == 0);
+      }
+      result = cudaStreamSynchronize(stream);
+      spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+      MPI_Reduce_scatter(mats_header[nmodes], dev_owned, counts, PARTI_MPI_VALUE, MPI_SUM, comm);
+
+      /* Each rank solves its own rows (ata[nmodes] is rebuilt identically everywhere). */
+      result = cudaMemcpyAsync(owned, dev_owned, (sptNnzIndex) owned_rows * stride * sizeof (sptValue), cudaMemcpyDeviceToDevice, stream);
+      spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+      spt_MpiCpdGramHadamardKernel<<<(rank * rank + nthreads - 1) / nthreads, nthreads, 0, stream>>>(
+        m, nmodes, rank, stride, dev_ata, ata_header[nmodes]);
+      spt_cusolverDnPotrf(solver, CUBLAS_FILL_MODE_LOWER, blas_rank, ata_header[nmodes], blas_stride,
+        dev_work, lwork, dev_info);
+      spt_cusolverDnPotrs(solver, CUBLAS_FILL_MODE_LOWER, blas_rank, (int) owned_rows, ata_header[nmodes], blas_stride,
+        owned, blas_stride, dev_info + 1);
+
+      /* Global column norms, using different norms to avoid precision explosion */
+      spt_MpiCpdColumnNormKernel<<<rank, nthreads, 0, stream>>>(owned_rows, stride, owned, dev_lambda, max_norm);
+      result = cudaStreamSynchronize(stream);
+      spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+      MPI_Allreduce(MPI_IN_PLACE, dev_lambda, (int) rank, PARTI_MPI_VALUE, max_norm ? MPI_MAX : MPI_SUM, comm);
+      spt_MpiCpdScaleKernel<<<rank, nthreads, 0, stream>>>(owned_rows, stride, owned, dev_lambda, max_norm);
+
+      /* ata[m] = sum over ranks of owned^T * owned */
+      spt_cublasSyrk(blas, CUBLAS_FILL_MODE_LOWER, CUBLAS_OP_N, blas_rank, (int) owned_rows,
+        &alpha, owned, blas_stride, &beta, ata_header[m], blas_stride);
+      result = cudaStreamSynchronize(stream);
+      spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+      MPI_Allreduce(MPI_IN_PLACE, ata_header[m], (int) (rank * stride), PARTI_MPI_VALUE, MPI_SUM, comm);
+
+      /* Replicate the updated rows for the next modes' MTTKRP. */
+      MPI_Allgatherv(MPI_IN_PLACE, 0, PARTI_MPI_VALUE, mats_header[m], counts, displs, PARTI_MPI_VALUE, comm);
+    } // Loop nmodes
+
+    /* The inner product only needs the owned rows of the last mode. */
+    spt_MpiCpdInnerKernel<<<PARTI_CUDA_CPD_NBLOCKS, nthreads, 0, stream>>>(
+      owned_rows, rank, stride, mats_header[nmodes-1] + (sptNnzIndex) row_begin * stride, dev_owned, dev_lambda, dev_partial);
+    result = cudaStreamSynchronize(stream);
+    spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+    MPI_Allreduce(MPI_IN_PLACE, dev_partial, PARTI_CUDA_CPD_NBLOCKS, MPI_DOUBLE, MPI_SUM, comm);
+    spt_MpiCpdFitKernel<<<1, 1, 0, stream>>>(nmodes, rank, stride, dev_ata, dev_lambda, dev_partial, PARTI_CUDA_CPD_NBLOCKS,
+      spten_normsq, dev_info, dev_scalars);
+    result = cudaGetLastError();
+    spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+
+    /* The only host copy of the iteration */
+    double scalars[2];
+    result = cudaMemcpyAsync(scalars, dev_scalars, sizeof scalars, cudaMemcpyDeviceToHost, stream);
+    spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+    result = cudaStreamSynchronize(stream);
+    spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+    fit = scalars[0];
+    if(scalars[1] != 0 && myrank == 0) {
+      printf("Gram matrix is not SPD (potrf info %d).\n", (int) scalars[1]);
+    }
+
+    its_time = MPI_Wtime() - its_time;
+    if(myrank == 0) {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, its_time, fit, fit - oldfit);
+    }
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  cudaStreamDestroy(stream);
+  delete[] displs;
+  delete[] counts;
+
+  /* Bring the replicated factors and lambda back once */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpy(mats[m]->values, mats_header[m], lengths[m] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  }
+  result = cudaMemcpy(ktensor->lambda, dev_lambda, rank * sizeof (sptValue), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "MPI CUDA SpTns CPD-ALS");
+  GetFinalLambda(rank, nmodes, mats, ktensor->lambda);
+  ktensor->fit = fit;
+  if(myrank == 0) {
+    printf("[MPI CUDA SpTns CPD-ALS]: %.9lf s\n", MPI_Wtime() - start);
+  }
+
+  cusolverDnDestroy(solver);
+  cublasDestroy(blas);
+  spt_CudaPoolFree(dev_info);
+  spt_CudaPoolFree(dev_work);
+  spt_CudaPoolFree(dev_partial);
+  spt_CudaPoolFree(dev_mats_order);
+  spt_CudaPoolFree(dev_lambda);
+  spt_CudaPoolFree(dev_owned);
+  spt_CudaPoolFree(dev_ata);
+  spt_CudaPoolFree(dev_ata_body);
+  spt_CudaPoolFree(dev_mats);
+  spt_CudaPoolFree(dev_scratch);
+  spt_CudaPoolFree(dev_Xinds);
+  spt_CudaPoolFree(dev_Xndims);
+  delete[] mats_order;
+  delete[] ata_header;
+  delete[] lengths;
+  delete[] mats_header;
+
+  ktensor->factors = mats;
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,177 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_CUDA
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+
+static double CudaCpdAlsStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCudaMttkrpMultiGpu * ctx,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+  }
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    sptAssert(sptCudaMttkrpMultiGpuSetFactor(ctx, mats[m], m) == 0);
+  }
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      /* MTTKRP on the devices, against their resident factors */
+      sptAssert (sptCudaMTTKRPMultiGpu(ctx, mats, m) == 0);
+
+      memcpy(mats[m]->values, tmp_mat->values, mats[m]->nrows * stride * sizeof(sptValue));
+      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
+
+      if (it == 0 ) {
+        sptMatrix2Norm(mats[m], lambda);
+      } else {
+        sptMatrixMaxNorm(mats[m], lambda);
+      }
+
+      int blas_nrows = (int)(mats[m]->nrows);
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+
+      /* Only the updated factor goes back to the devices. */
+      sptAssert(sptCudaMttkrpMultiGpuSetFactor(ctx, mats[m], m) == 0);
+    } // Loop nmodes
+
+    fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+
+  return fit;
+}
+
+
+/**
+ * CP-ALS with the MTTKRP spread over several GPUs, see sptCudaNewMttkrpMultiGpu.
+ * The tensor is partitioned on its longest mode, whose MTTKRP then needs no
+ * reduction; the dense solves run on the host.
+ * @param[out] ktensor the Kruskal tensor
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  ndevices the number of GPUs, devices 0..ndevices-1 are used
+ *                      (only the current device when ndevices is 1)
+ */
+int sptCudaCpdAlsMultiGpu(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  int const ndevices,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+  sptIndex part_mode = 0;
+  for(sptIndex m=1; m < nmodes; ++m) {
+    if(spten->ndims[m] > spten->ndims[part_mode]) {
+      part_mode = m;
+    }
+  }
+
+  sptCudaMttkrpMultiGpu ctx;
+  sptAssert(sptCudaNewMttkrpMultiGpu(&ctx, spten, part_mode, rank, ndevices, NULL) == 0);
+
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+  }
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = CudaCpdAlsStep(spten, rank, niters, tol, &ctx, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CUDA SpTns CPD-ALS");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+  sptCudaFreeMttkrpMultiGpu(&ctx);
+
+  return 0;
+}
+
+
+#endif
@@ -0,0 +1,188 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+#if defined(__GNUC__)
+    #define SPT_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define SPT_THREAD_LOCAL _Thread_local
+#else
+    #define SPT_THREAD_LOCAL
+#endif
+
+/*
+ * Deadline-aware stopping for CP-ALS. The cost of the next iteration is
+ * predicted from the ones before, the larger of the last and a running
+ * mean, so a run stops with a whole iteration of slack rather than being
+ * killed in the middle of one. The factors of the best evaluated fit are
+ * kept aside, and are what a stopped run returns. Budgets and callbacks are
+ * set per thread or per execution context, so decompositions running side
+ * by side do not share them.
+ */
+
+static SPT_THREAD_LOCAL double spt_cpd_deadline = -1;
+static SPT_THREAD_LOCAL sptCpdProgress spt_cpd_progress = NULL;
+static SPT_THREAD_LOCAL void * spt_cpd_progress_arg = NULL;
+
+/*
+ * The budget in seconds of runs on the calling thread: the execution
+ * context's, else sptSetCpdDeadline's, else PARTI_CPD_DEADLINE's
+ */
+static double spt_CpdDeadline(void) {
+    sptExecContext const * const ctx = sptGetExecContext();
+    if(ctx != NULL && ctx->cpd_deadline > 0) {
+        return ctx->cpd_deadline;
+    }
+    if(spt_cpd_deadline < 0) {
+        char const * env = getenv("PARTI_CPD_DEADLINE");
+        spt_cpd_deadline = env != NULL ? atof(env) : 0;
+        if(spt_cpd_deadline < 0) {
+            spt_cpd_deadline = 0;
+        }
+    }
+    return spt_cpd_deadline;
+}
+
+/* The progress callback of runs on the calling thread, the execution context's first */
+static sptCpdProgress spt_CpdProgress(void ** arg) {
+    sptExecContext const * const ctx = sptGetExecContext();
+    if(ctx != NULL && ctx->cpd_progress != NULL) {
+        *arg = ctx->cpd_progress_arg;
+        return ctx->cpd_progress;
+    }
+    *arg = spt_cpd_progress_arg;
+    return spt_cpd_progress;
+}
+
+/**
+ * Give every CP-ALS run the calling thread starts, COO and HiCOO, a
+ * wall-clock budget; sptExecContext's cpd_deadline takes precedence. A run stops
+ * before an iteration that is predicted to overrun it, evaluates the fit of
+ * where it got, and returns the best factors seen, so a job with a hard
+ * time limit still ends with a usable, checkpointed model.
+ * Defaults to the PARTI_CPD_DEADLINE environment variable.
+ * @param seconds the budget from the start of each decomposition, 0 for none
+ */
+int sptSetCpdDeadline(double const seconds) {
+    if(!(seconds >= 0)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Deadline", "seconds < 0");
+    }
+    spt_cpd_deadline = seconds;
+    return 0;
+}
+
+/**
+ * Call `progress` after every iteration of the CP-ALS runs the calling thread
+ * starts, COO and HiCOO; sptExecContext's cpd_progress takes precedence. When it
+ * returns nonzero the run stops as at a deadline, with the best factors seen.
+ * @param progress the callback, NULL for none
+ * @param arg      passed through to the callback
+ */
+int sptSetCpdProgress(sptCpdProgress const progress, void * arg) {
+    spt_cpd_progress = progress;
+    spt_cpd_progress_arg = arg;
+    return 0;
+}
+
+int spt_CpdGuardEnabled(void) {
+    void * arg;
+    return spt_CpdDeadline() > 0 || spt_CpdProgress(&arg) != NULL;
+}
+
+int spt_NewCpdGuard(spt_CpdGuard * g, spt_CpdFactors const * f) {
+    memset(g, 0, sizeof *g);
+    g->budget = spt_CpdDeadline();
+    g->progress = spt_CpdProgress(&g->progress_arg);
+    if(g->budget == 0 && g->progress == NULL) {
+        return 0;
+    }
+    g->best = calloc(f->nmodes, sizeof *g->best);
+    g->best_lambda = malloc(f->rank * sizeof *g->best_lambda);
+    spt_CheckOSError(!g->best || !g->best_lambda, "CPD Deadline");
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        g->best[m] = malloc((size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+        spt_CheckOSError(!g->best[m], "CPD Deadline");
+    }
+    g->nmodes = f->nmodes;
+    g->start = spt_TraceNow();
+    g->active = 1;
+    return 0;
+}
+
+void spt_FreeCpdGuard(spt_CpdGuard * g) {
+    for(sptIndex m = 0; m < g->nmodes; ++m) {
+        free(g->best[m]);
+    }
+    free(g->best);
+    free(g->best_lambda);
+    memset(g, 0, sizeof *g);
+}
+
+int spt_CpdGuardDue(spt_CpdGuard * g) {
+    if(!g->active || g->budget == 0) {
+        return 0;
+    }
+    double const elapsed = (spt_TraceNow() - g->start) * 1e-6;
+    return elapsed + g->predicted > g->budget;
+}
+
+int spt_CpdGuardRecord(spt_CpdGuard * g, spt_CpdFactors const * f, sptIndex const it, double const its_time, double const fit, int const evaluated) {
+    if(!g->active) {
+        return 0;
+    }
+    static double const decay = 0.5;
+    double const mean = g->predicted == 0 ? its_time : decay * g->predicted + (1 - decay) * its_time;
+    g->predicted = its_time > mean ? its_time : mean;
+
+    if(evaluated && (!g->have_best || fit > g->best_fit)) {
+        for(sptIndex m = 0; m < f->nmodes; ++m) {
+            memcpy(g->best[m], f->values[m], (size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+        }
+        memcpy(g->best_lambda, f->lambda, f->rank * sizeof *g->best_lambda);
+        g->best_fit = fit;
+        g->have_best = 1;
+    }
+
+    if(g->progress != NULL) {
+        double const elapsed = (spt_TraceNow() - g->start) * 1e-6;
+        if(g->progress(it + 1, fit, elapsed, g->progress_arg) != 0) {
+            g->stopped = 2;
+            return 1;
+        }
+    }
+    if(spt_CpdGuardDue(g)) {
+        g->stopped = 1;
+        return 1;
+    }
+    return 0;
+}
+
+double spt_CpdGuardRestore(spt_CpdGuard * g, spt_CpdFactors const * f, double const fit, int const evaluated) {
+    if(!g->have_best || (evaluated && fit >= g->best_fit)) {
+        return fit;
+    }
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        memcpy(f->values[m], g->best[m], (size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+    }
+    memcpy(f->lambda, g->best_lambda, f->rank * sizeof *f->lambda);
+    return g->best_fit;
+}
@@ -0,0 +1,520 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/lapack.h"
+
+
+/*
+ * Gauss-Newton CP with Levenberg-Marquardt damping. The scale of each
+ * component is kept in the factors, so the unknowns are the nmodes factors
+ * and f = 1/2 ||X - [[A_1, ..., A_N]]||^2. With W_l = A_l^T A_l and
+ * G_n (G_nk) the Hadamard product of all W_l but W_n (and W_k), the
+ * gradient is A_n G_n - MTTKRP_n(X), and J^T J applied to a direction V is
+ *
+ *   (J^T J V)_n = V_n G_n + A_n sum_{k != n} (G_nk .* A_k^T V_k)^T,
+ *
+ * rank x rank work per mode on top of one pass over the rows of the
+ * factors, so the tensor is read only by the MTTKRPs of the gradient, once
+ * per trial point. The damped system (J^T J + mu I) P = -grad is solved by
+ * conjugate gradients, preconditioned by the block diagonal G_n + mu I.
+ */
+
+#define SPT_GN_CG_ITERS 20      /// the most CG iterations per step
+#define SPT_GN_CG_TOL 1e-2      /// CG stops at this residual relative to the gradient
+
+/* out = the Hadamard product of W[l] for l other than skip1 and skip2, full rank x rank */
+static void spt_GnHadamard(sptValue * const out, sptMatrix ** W, sptIndex const nmodes,
+  sptIndex const skip1, sptIndex const skip2, sptIndex const rank, sptIndex const stride)
+{
+  for(sptIndex r=0; r < rank; ++r) {
+    for(sptIndex s=0; s < rank; ++s) {
+      sptValue v = 1;
+      for(sptIndex l=0; l < nmodes; ++l) {
+        if(l != skip1 && l != skip2) {
+          v *= W[l]->values[r * stride + s];
+        }
+      }
+      out[r * stride + s] = v;
+    }
+  }
+}
+
+/* Y = beta * Y + X * C for row-major nrows x rank X and Y and rank x rank C */
+static void spt_GnRowMul(sptMatrix * const Y, sptMatrix const * const X, sptValue const * const C,
+  sptValue const beta, int const tk)
+{
+  sptIndex const rank = X->ncols, stride = X->stride;
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptIndex i=0; i < X->nrows; ++i) {
+    sptValue const * const x = X->values + (size_t) i * stride;
+    sptValue * const y = Y->values + (size_t) i * stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      sptValue acc = beta * y[r];
+      for(sptIndex s=0; s < rank; ++s) {
+        acc += x[s] * C[s * stride + r];
+      }
+      y[r] = acc;
+    }
+  }
+}
+
+/* out[s][r] = sum_i X[i][s] * A[i][r] */
+static void spt_GnCross(sptValue * const out, sptMatrix const * const X, sptMatrix const * const A, int const tk)
+{
+  sptIndex const rank = X->ncols, stride = X->stride;
+  memset(out, 0, (size_t) rank * stride * sizeof *out);
+  #pragma omp parallel num_threads(tk)
+  {
+    sptValue * const part = calloc((size_t) rank * stride, sizeof *part);
+    #pragma omp for schedule(static)
+    for(sptIndex i=0; i < X->nrows; ++i) {
+      sptValue const * const x = X->values + (size_t) i * stride;
+      sptValue const * const a = A->values + (size_t) i * stride;
+      for(sptIndex s=0; s < rank; ++s) {
+        for(sptIndex r=0; r < rank; ++r) {
+          part[s * stride + r] += x[s] * a[r];
+        }
+      }
+    }
+    #pragma omp critical
+    for(sptIndex x=0; x < rank * stride; ++x) {
+      out[x] += part[x];
+    }
+    free(part);
+  }
+}
+
+/* The sum over all modes of the entrywise product of U and V */
+static double spt_GnDot(sptMatrix ** U, sptMatrix ** V, sptIndex const nmodes, int const tk)
+{
+  double dot = 0;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptIndex const rank = U[m]->ncols, stride = U[m]->stride;
+    #pragma omp parallel for schedule(static) num_threads(tk) reduction(+:dot)
+    for(sptIndex i=0; i < U[m]->nrows; ++i) {
+      for(sptIndex r=0; r < rank; ++r) {
+        dot += U[m]->values[(size_t) i * stride + r] * V[m]->values[(size_t) i * stride + r];
+      }
+    }
+  }
+  return dot;
+}
+
+/* Y = a * X + b * Y over all modes */
+static void spt_GnAxpby(sptMatrix ** Y, sptValue const a, sptMatrix ** X, sptValue const b, sptIndex const nmodes, int const tk)
+{
+  for(sptIndex m=0; m < nmodes; ++m) {
+    size_t const len = (size_t) Y[m]->nrows * Y[m]->stride;
+    sptValue * const y = Y[m]->values;
+    sptValue const * const x = X[m]->values;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(size_t k=0; k < len; ++k) {
+      y[k] = a * x[k] + b * y[k];
+    }
+  }
+}
+
+/* Full Gram matrices W[m] = A[m]^T A[m] */
+static void spt_GnGrams(sptMatrix ** W, sptMatrix ** A, sptIndex const nmodes, int const tk)
+{
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptOmpMatrixGram(A[m], W[m], tk) == 0);
+    sptIndex const rank = A[m]->ncols, stride = A[m]->stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      for(sptIndex s=0; s < r; ++s) {
+        W[m]->values[r * stride + s] = W[m]->values[s * stride + r];
+      }
+    }
+  }
+}
+
+/* f = 1/2 ||X - model||^2 from the Gram matrices and the MTTKRP U[0] of mode 0 */
+static double spt_GnObjective(double const spten_normsq, sptMatrix ** A, sptMatrix ** W, sptMatrix ** U,
+  sptIndex const nmodes, sptValue * const work, double * const model_normsq, int const tk)
+{
+  sptIndex const rank = A[0]->ncols, stride = A[0]->stride;
+  spt_GnHadamard(work, W, nmodes, nmodes, nmodes, rank, stride);
+  double norm = 0;
+  for(sptIndex r=0; r < rank; ++r) {
+    for(sptIndex s=0; s < rank; ++s) {
+      norm += work[r * stride + s];
+    }
+  }
+  double const inner = spt_GnDot(A, U, 1, tk);
+  *model_normsq = norm;
+  return 0.5 * (spten_normsq + norm - 2 * inner);
+}
+
+/* Y = (J^T J + mu I) V; gram[m] holds G_m and work is rank x stride scratch, cross nmodes of them */
+static void spt_GnApply(sptMatrix ** Y, sptMatrix ** V, sptMatrix ** A, sptMatrix ** W,
+  sptValue * const * const gram, sptValue * const * const cross, sptValue * const work,
+  sptValue const mu, sptIndex const nmodes, int const tk)
+{
+  sptIndex const rank = A[0]->ncols, stride = A[0]->stride;
+  for(sptIndex k=0; k < nmodes; ++k) {
+    spt_GnCross(cross[k], V[k], A[k], tk);
+  }
+  for(sptIndex n=0; n < nmodes; ++n) {
+    /* C[s][r] = sum_k G_nk[r][s] * cross_k[s][r] */
+    sptValue * const C = work;
+    memset(C, 0, (size_t) rank * stride * sizeof *C);
+    for(sptIndex k=0; k < nmodes; ++k) {
+      if(k == n) continue;
+      for(sptIndex s=0; s < rank; ++s) {
+        for(sptIndex r=0; r < rank; ++r) {
+          sptValue g = 1;
+          for(sptIndex l=0; l < nmodes; ++l) {
+            if(l != n && l != k) {
+              g *= W[l]->values[r * stride + s];
+            }
+          }
+          C[s * stride + r] += g * cross[k][s * stride + r];
+        }
+      }
+    }
+    spt_GnRowMul(Y[n], A[n], C, 0, tk);
+    spt_GnRowMul(Y[n], V[n], gram[n], 1, tk);
+  }
+  if(mu != 0) {
+    spt_GnAxpby(Y, mu, V, 1, nmodes, tk);
+  }
+}
+
+/* Z = (G_m + mu I)^{-1} R per mode, the block-diagonal preconditioner */
+static void spt_GnPrecondition(sptMatrix ** Z, sptMatrix ** R, sptValue * const * const gram,
+  sptValue * const work, sptValue const mu, sptIndex const nmodes, int const tk)
+{
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptIndex const rank = R[m]->ncols, stride = R[m]->stride;
+    memcpy(work, gram[m], (size_t) rank * stride * sizeof *work);
+    for(sptIndex r=0; r < rank; ++r) {
+      work[r * stride + r] += mu;
+    }
+    memcpy(Z[m]->values, R[m]->values, (size_t) R[m]->nrows * stride * sizeof(sptValue));
+    sptAssert(spt_OmpSolveFormedNormals(work, rank, stride, Z[m]->values, R[m]->nrows, tk) == 0);
+  }
+}
+
+static sptMatrix ** spt_GnNewSet(sptMatrix ** like, sptIndex const nmodes, sptIndex const nrows_of_rank)
+{
+  sptMatrix ** set = malloc(nmodes * sizeof *set);
+  sptAssert(set != NULL);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    set[m] = malloc(sizeof *set[m]);
+    sptAssert(set[m] != NULL);
+    sptAssert(sptNewMatrix(set[m], nrows_of_rank ? like[m]->ncols : like[m]->nrows, like[m]->ncols) == 0);
+    sptAssert(sptConstantMatrix(set[m], 0) == 0);
+  }
+  return set;
+}
+
+static void spt_GnFreeSet(sptMatrix ** set, sptIndex const nmodes)
+{
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptFreeMatrix(set[m]);
+    free(set[m]);
+  }
+  free(set);
+}
+
+
+/**
+ * The Gauss-Newton iterations of sptOmpCpdGaussNewton and
+ * sptCudaCpdGaussNewton. mats[0..nmodes-1] are the factors, lambda their
+ * weights, both updated; mttkrp(arg, A, U) writes the MTTKRP of every mode
+ * against factors A to U, which is the only access to the tensor. Returns
+ * the fit of the factors returned.
+ */
+double spt_CpdGaussNewtonStep(
+  double const spten_normsq,
+  sptIndex const nmodes,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int nt,
+  sptMatrix ** mats,
+  sptValue * const lambda,
+  spt_CpdMttkrpAll const mttkrp,
+  void * const arg)
+{
+  sptIndex const stride = mats[0]->stride;
+  int const tk = nt > 0 ? nt : 1;
+
+  /* Spread lambda over the factors, so all of the scale is in them */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptValue const * const scale = lambda;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+      for(sptIndex r=0; r < rank; ++r) {
+        sptValue const l = fabs(scale[r]);
+        mats[m]->values[(size_t) i * stride + r] *= (sptValue) pow(l, 1.0 / nmodes) * (m == 0 && scale[r] < 0 ? -1 : 1);
+      }
+    }
+  }
+
+  sptMatrix ** A = mats;
+  sptMatrix ** trial = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** U = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** trial_U = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** grad = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** P = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** R = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** Z = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** D = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** Q = spt_GnNewSet(mats, nmodes, 0);
+  sptMatrix ** W = spt_GnNewSet(mats, nmodes, 1);
+  sptMatrix ** trial_W = spt_GnNewSet(mats, nmodes, 1);
+  size_t const square = (size_t) rank * stride;
+  sptValue * const scratch = malloc((2 * nmodes + 1) * square * sizeof *scratch);
+  sptValue ** gram = malloc(nmodes * sizeof *gram);
+  sptValue ** cross = malloc(nmodes * sizeof *cross);
+  sptAssert(scratch != NULL && gram != NULL && cross != NULL);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    gram[m] = scratch + m * square;
+    cross[m] = scratch + (nmodes + m) * square;
+  }
+  sptValue * const work = scratch + 2 * nmodes * square;
+
+  spt_GnGrams(W, A, nmodes, tk);
+  sptAssert(mttkrp(arg, A, U) == 0);
+  double model_normsq;
+  double f = spt_GnObjective(spten_normsq, A, W, U, nmodes, work, &model_normsq, tk);
+  double fit = 1 - sqrt(2 * (f > 0 ? f : 0)) / sqrt(spten_normsq);
+  double oldfit = fit;
+
+  /* The damping starts small against the curvature, and follows the gain ratio after (Nielsen's rule) */
+  double mu_scale = 0;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    spt_GnHadamard(gram[m], W, nmodes, m, nmodes, rank, stride);
+    for(sptIndex r=0; r < rank; ++r) {
+      if(gram[m][r * stride + r] > mu_scale) mu_scale = gram[m][r * stride + r];
+    }
+  }
+  double mu = 1e-3 * (mu_scale > 0 ? mu_scale : 1);
+  double nu = 2;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* grad_n = A_n G_n - MTTKRP_n */
+    for(sptIndex m=0; m < nmodes; ++m) {
+      spt_GnHadamard(gram[m], W, nmodes, m, nmodes, rank, stride);
+      memcpy(grad[m]->values, U[m]->values, (size_t) U[m]->nrows * stride * sizeof(sptValue));
+      spt_GnRowMul(grad[m], A[m], gram[m], -1, tk);
+    }
+    double const gnorm = sqrt(spt_GnDot(grad, grad, nmodes, tk));
+
+    /* Preconditioned CG on (J^T J + mu I) P = -grad, from P = 0 */
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptAssert(sptConstantMatrix(P[m], 0) == 0);
+    }
+    spt_GnAxpby(R, -1, grad, 0, nmodes, tk);
+    spt_GnPrecondition(Z, R, gram, work, (sptValue) mu, nmodes, tk);
+    spt_GnAxpby(D, 1, Z, 0, nmodes, tk);
+    double rz = spt_GnDot(R, Z, nmodes, tk);
+    sptIndex cg_iters = 0;
+    while(cg_iters < SPT_GN_CG_ITERS && gnorm > 0) {
+      spt_GnApply(Q, D, A, W, gram, cross, work, (sptValue) mu, nmodes, tk);
+      double const dq = spt_GnDot(D, Q, nmodes, tk);
+      if(!(dq > 0)) break;
+      double const alpha = rz / dq;
+      spt_GnAxpby(P, (sptValue) alpha, D, 1, nmodes, tk);
+      spt_GnAxpby(R, (sptValue) -alpha, Q, 1, nmodes, tk);
+      ++cg_iters;
+      if(sqrt(spt_GnDot(R, R, nmodes, tk)) < SPT_GN_CG_TOL * gnorm) break;
+      spt_GnPrecondition(Z, R, gram, work, (sptValue) mu, nmodes, tk);
+      double const rz_next = spt_GnDot(R, Z, nmodes, tk);
+      spt_GnAxpby(D, 1, Z, (sptValue) (rz_next / rz), nmodes, tk);
+      rz = rz_next;
+    }
+
+    /* The decrease the undamped model predicts, and the actual one */
+    spt_GnApply(Q, P, A, W, gram, cross, work, 0, nmodes, tk);
+    double const predicted = -(spt_GnDot(grad, P, nmodes, tk) + 0.5 * spt_GnDot(P, Q, nmodes, tk));
+    for(sptIndex m=0; m < nmodes; ++m) {
+      memcpy(trial[m]->values, A[m]->values, (size_t) A[m]->nrows * stride * sizeof(sptValue));
+    }
+    spt_GnAxpby(trial, 1, P, 1, nmodes, tk);
+    spt_GnGrams(trial_W, trial, nmodes, tk);
+    sptAssert(mttkrp(arg, trial, trial_U) == 0);
+    double trial_model_normsq;
+    double const trial_f = spt_GnObjective(spten_normsq, trial, trial_W, trial_U, nmodes, work, &trial_model_normsq, tk);
+    double const rho = predicted > 0 ? (f - trial_f) / predicted : -1;
+
+    int const accepted = rho > 0;
+    if(accepted) {
+      sptMatrix ** swap;
+      swap = A; A = trial; trial = swap;
+      swap = W; W = trial_W; trial_W = swap;
+      swap = U; U = trial_U; trial_U = swap;
+      f = trial_f;
+      double const t = 2 * rho - 1;
+      double const shrink = 1 - t * t * t;
+      mu *= shrink > 1.0 / 3 ? shrink : 1.0 / 3;
+      nu = 2;
+    } else {
+      mu *= nu;
+      nu *= 2;
+    }
+    fit = 1 - sqrt(2 * (f > 0 ? f : 0)) / sqrt(spten_normsq);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e  cg = %"PARTI_PRI_INDEX "%s\n",
+        it+1, its_time, fit, fit - oldfit, cg_iters, accepted ? "" : "  rejected");
+    if(accepted && it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    /* Nothing left to gain above rounding */
+    if(gnorm == 0 || !(predicted > 1e-14 * spten_normsq) || !isfinite(mu)) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  /* The factors may have been swapped with the trial set */
+  if(A != mats) {
+    for(sptIndex m=0; m < nmodes; ++m) {
+      memcpy(mats[m]->values, A[m]->values, (size_t) A[m]->nrows * stride * sizeof(sptValue));
+    }
+    trial = A;
+  }
+
+  /* Normalize, with the scale of each component back in lambda */
+  sptValue * const norms = malloc(rank * sizeof *norms);
+  sptAssert(norms != NULL);
+  for(sptIndex r=0; r < rank; ++r) {
+    lambda[r] = 1;
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptMatrix2Norm(mats[m], norms);
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] *= norms[r];
+    }
+  }
+  free(norms);
+
+  spt_GnFreeSet(trial, nmodes);
+  spt_GnFreeSet(U, nmodes);
+  spt_GnFreeSet(trial_U, nmodes);
+  spt_GnFreeSet(grad, nmodes);
+  spt_GnFreeSet(P, nmodes);
+  spt_GnFreeSet(R, nmodes);
+  spt_GnFreeSet(Z, nmodes);
+  spt_GnFreeSet(D, nmodes);
+  spt_GnFreeSet(Q, nmodes);
+  spt_GnFreeSet(W, nmodes);
+  spt_GnFreeSet(trial_W, nmodes);
+  free(scratch);
+  free(gram);
+  free(cross);
+  return fit;
+}
+
+
+typedef struct {
+  sptSparseTensor const * spten;
+  sptIndex * modes;
+  int tk;
+} spt_GnOmpArgs;
+
+static int spt_GnOmpMttkrp(void * arg, sptMatrix ** A, sptMatrix ** U)
+{
+  spt_GnOmpArgs const * const a = arg;
+  return sptOmpMTTKRPMulti(a->spten, A, a->spten->nmodes, a->modes, U, a->tk);
+}
+
+
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) by Gauss-Newton with
+ * Levenberg-Marquardt damping for COO formatted sparse tensors, for
+ * ill-conditioned problems on which ALS swamps.
+ *
+ * Each iteration solves the damped normal equations of all factors together
+ * by conjugate gradients preconditioned with the per-mode Gram products, as
+ * ALS solves one mode; the Jacobian products inside CG need only the Gram
+ * matrices and rank x rank products with the factors. The tensor is read
+ * once per iteration, by one sptOmpMTTKRPMulti at the trial point, which
+ * gives both its fit and the next gradient. A step that does not decrease
+ * the residual is rejected and the damping raised.
+ * @param[in,out] ktensor the Kruskal tensor; factors and lambda it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdGaussNewton(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-GN");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, tk) == 0);
+    for(sptIndex r=0; r < rank; ++r) {
+      ktensor->lambda[r] = 1;
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], sptMaxIndexArray(spten->ndims, nmodes), rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  spt_GnOmpArgs args = { spten, (sptIndex *)malloc(nmodes * sizeof(sptIndex)), tk };
+  spt_CheckOSError(!args.modes, "CPU  SpTns CPD-GN");
+  for(sptIndex m=0; m < nmodes; ++m) {
+    args.modes[m] = m;
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = spt_CpdGaussNewtonStep(SparseTensorFrobeniusNormSquared(spten), nmodes, rank, niters, tol, tk,
+    mats, ktensor->lambda, spt_GnOmpMttkrp, &args);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-GN");
+  sptFreeTimer(timer);
+
+  free(args.modes);
+  sptSetExecContext(caller_exec);
+  ktensor->factors = mats;
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+
+
+/* The tensor and the factors on the device, for the MTTKRPs of the Gauss-Newton CPD */
+typedef struct {
+  sptIndex nmodes;
+  sptIndex rank;
+  sptIndex stride;
+  sptNnzIndex nnz;
+  sptIndex const * ndims;       /// host copy of the mode sizes
+  sptIndex * dev_Xndims;
+  sptIndex ** dev_Xinds;
+  sptValue * dev_Xvals;
+  sptValue * dev_scratch;
+  sptIndex * dev_mats_order;    /// nmodes orders, that of mode m at m * nmodes
+  sptValue ** dev_mats;
+  sptValue ** mats_header;      /// device pointers of the factors, mats_header[nmodes] is the MTTKRP output
+  cudaStream_t stream;
+} spt_CudaGnArgs;
+
+/* Upload the factors A, then the MTTKRP of every mode into U, one after the other on the stream */
+static int spt_CudaGnMttkrp(void * arg, sptMatrix ** A, sptMatrix ** U)
+{
+  spt_CudaGnArgs const * const a = (spt_CudaGnArgs const *) arg;
+  sptIndex const nmodes = a->nmodes;
+  int result;
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    result = cudaMemcpyAsync(a->mats_header[m], A[m]->values, (sptNnzIndex) a->ndims[m] * a->stride * sizeof (sptValue),
+      cudaMemcpyHostToDevice, a->stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  }
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    sptNnzIndex const len = (sptNnzIndex) a->ndims[m] * a->stride;
+    result = cudaMemsetAsync(a->mats_header[nmodes], 0, len * sizeof (sptValue), a->stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+    sptAssert(sptCudaMTTKRPDeviceAsync(m, nmodes, a->nnz, a->rank, a->stride, a->dev_Xndims, a->dev_Xinds, a->dev_Xvals,
+      a->dev_mats_order + m * nmodes, a->dev_mats, a->dev_scratch, a->stream) == 0);
+    result = cudaMemcpyAsync(U[m]->values, a->mats_header[nmodes], len * sizeof (sptValue), cudaMemcpyDeviceToHost, a->stream);
+    spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  }
+  result = cudaStreamSynchronize(a->stream);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  return 0;
+}
+
+
+/**
+ * CUDA CANDECOMP/PARAFAC decomposition (CPD) by Gauss-Newton with
+ * Levenberg-Marquardt damping, as sptOmpCpdGaussNewton.
+ *
+ * The tensor stays on the device chosen by sptCudaSetDevice, and the
+ * MTTKRPs of all modes at each trial point, the only work that grows with
+ * the nonzeros, run there with the CUDA scratch kernel. The conjugate
+ * gradient steps work on the factors and rank x rank matrices only and run
+ * on the host threads, so each iteration moves the factors to the device
+ * and the MTTKRP outputs back once.
+ *
+ * @param[out] ktensor the Kruskal tensor
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ */
+int sptCudaCpdGaussNewton(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptNnzIndex const nnz = spten->nnz;
+  int result;
+
+  /* Initialize factor matrices on the host */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CUDA SpTns CPD-GN");
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+  }
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptIndex const stride = mats[0]->stride;
+  for(sptIndex r=0; r < rank; ++r) {
+    ktensor->lambda[r] = 1;
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  /* Tensor */
+  sptIndex * dev_Xndims;
+  result = sptCudaDuplicateMemory(&dev_Xndims, spten->ndims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  sptValue * dev_Xvals;
+  result = sptCudaDuplicateMemory(&dev_Xvals, spten->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  sptIndex ** Xinds_header = new sptIndex *[nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    Xinds_header[m] = spten->inds[m].data;
+  }
+  sptIndex ** dev_Xinds;
+  result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, Xinds_header, nmodes, nnz, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  delete[] Xinds_header;
+  sptValue * dev_scratch;
+  result = spt_CudaPoolAlloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+
+  /* Factors, mats[nmodes] the MTTKRP output */
+  sptValue ** mats_header = new sptValue *[nmodes+1];
+  sptNnzIndex * lengths = new sptNnzIndex[nmodes+1];
+  for(sptIndex m = 0; m <= nmodes; ++m) {
+    mats_header[m] = mats[m]->values;
+    lengths[m] = (sptNnzIndex) mats[m]->nrows * stride;
+  }
+  sptValue ** dev_mats;
+  result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+  result = cudaMemcpy(mats_header, dev_mats, (nmodes+1) * sizeof (sptValue *), cudaMemcpyDeviceToHost);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+
+  /* The Khatri-Rao orders of all modes, uploaded once */
+  sptIndex * mats_order = new sptIndex[nmodes * nmodes];
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    for(sptIndex i = 0; i < nmodes; ++i) {
+      mats_order[m * nmodes + i] = (m+i) % nmodes;
+    }
+  }
+  sptIndex * dev_mats_order;
+  result = sptCudaDuplicateMemory(&dev_mats_order, mats_order, nmodes * nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+
+  cudaStream_t stream;
+  result = cudaStreamCreate(&stream);
+  spt_CheckCudaError(result != 0, "CUDA SpTns CPD-GN");
+
+  spt_CudaGnArgs args = {
+    nmodes, rank, stride, nnz, spten->ndims, dev_Xndims, dev_Xinds, dev_Xvals, dev_scratch,
+    dev_mats_order, dev_mats, mats_header, stream
+  };
+  ktensor->fit = spt_CpdGaussNewtonStep(SparseTensorFrobeniusNormSquared(spten), nmodes, rank, niters, tol,
+    sptExecThreads(0), mats, ktensor->lambda, spt_CudaGnMttkrp, &args);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CUDA SpTns CPD-GN");
+  sptFreeTimer(timer);
+
+  cudaStreamDestroy(stream);
+  spt_CudaPoolFree(dev_mats_order);
+  spt_CudaPoolFree(dev_mats);
+  spt_CudaPoolFree(dev_scratch);
+  spt_CudaPoolFree(dev_Xinds);
+  spt_CudaPoolFree(dev_Xvals);
+  spt_CudaPoolFree(dev_Xndims);
+  delete[] mats_order;
+  delete[] lengths;
+  delete[] mats_header;
+
+  ktensor->factors = mats;
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
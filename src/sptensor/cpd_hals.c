@@ -0,0 +1,239 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/* Floor of the HALS updates, so no column is locked at zero */
+#define SPT_HALS_EPS 1e-16
+
+
+/**
+ * One HALS sweep over the columns of a factor, with every row updated independently.
+ * Column r of row i becomes max(eps, a_ir + (m_ir - a_i . g_r) / g_rr),
+ * using the already updated a_i1 .. a_i(r-1).
+ * @param[in,out] A  the row-major factor, its weights folded in
+ * @param[in]  M  the row-major MTTKRP of this mode
+ * @param[in]  G  the full Hadamard product of the other Gram matrices
+ */
+void spt_CpdHalsUpdateRows(
+  sptValue * const A,
+  sptValue const * const M,
+  sptValue const * const G,
+  sptIndex const nrows,
+  sptIndex const rank,
+  sptIndex const stride,
+  int const tk)
+{
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for schedule(static) num_threads(tk)
+#endif
+  for(sptIndex i=0; i < nrows; ++i) {
+    sptValue * const a = A + (size_t) i * stride;
+    sptValue const * const m = M + (size_t) i * stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      sptValue const * const g = G + (size_t) r * stride;
+      if(g[r] <= 0) {
+        continue;
+      }
+      sptValue v = m[r];
+      for(sptIndex s=0; s < rank; ++s) {
+        v -= a[s] * g[s];
+      }
+      v = a[r] + v / g[r];
+      a[r] = v > SPT_HALS_EPS ? v : SPT_HALS_EPS;
+    }
+  }
+}
+
+
+static double OmpCpdNnHalsStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spten->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+
+  /* Keep every factor normalized, with the scale in lambda, and compute all "ata"s */
+  sptValue * norms = (sptValue *)malloc(rank * sizeof(*norms));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptMatrix2Norm(mats[m], norms);
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] *= norms[r];
+    }
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+  free(norms);
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      // mats[nmodes]: row-major
+      sptAssert (sptOmpMTTKRP(spten, mats, mats_order, m, tk) == 0);
+
+      /* ata[nmodes] = Hadamard product of the other "ata"s, in full */
+      sptAssert (sptMatrixDotMulSeqTriangle(m, nmodes, ata) == 0);
+
+      /* Fold lambda into mats[m], update it by HALS, and normalize it again */
+      sptValue * const vals = mats[m]->values;
+#ifdef PARTI_USE_OPENMP
+      #pragma omp parallel for num_threads(tk)
+#endif
+      for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+        for(sptIndex r=0; r < rank; ++r) {
+          vals[i * stride + r] *= lambda[r];
+        }
+      }
+      spt_CpdHalsUpdateRows(vals, tmp_mat->values, ata[nmodes]->values, mats[m]->nrows, rank, stride, tk);
+      sptMatrix2Norm(mats[m], lambda);
+
+      /* ata[m] = mats[m]^T * mats[m]) */
+      int blas_nrows = (int)(mats[m]->nrows);
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    } // Loop nmodes
+
+    /* mats[nmodes] still holds the MTTKRP of the last mode */
+    fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel non-negative CANDECOMP/PARAFAC decomposition (CPD) using hierarchical alternating least squares (HALS) for COO formatted sparse tensors.
+ * Every factor stays non-negative; the rows of a factor are updated in parallel.
+ * @param[in,out] ktensor the Kruskal tensor; factors and lambda it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdNnHals(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-HALS");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+    }
+  }
+  if(!warm) {
+    for(sptIndex r=0; r < rank; ++r) {
+      ktensor->lambda[r] = 1;
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCpdNnHalsStep(spten, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-HALS");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_CUDA
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include "sptensor.h"
+
+
+static double CudaCpdAlsHybridStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  double fit = 0;
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spten->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+  }
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, ata[0]->stride) == 0);
+
+  /* The split between the devices starts even and follows the measured rates */
+  sptCudaMttkrpHybrid hybrid;
+  sptAssert(sptCudaNewMttkrpHybrid(&hybrid, spten, rank, tk, 0) == 0);
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      sptAssert (sptCudaMTTKRPHybrid(&hybrid, spten, mats, mats_order, m) == 0);
+
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptOmpMatrixSolveFormedNormalsGram(m, nmodes, ata, tmp_mat, mats[m], lambda, it != 0, tk) == 0 );
+      sptAssert ( sptGramHadamardAdvance(&gh, m, ata_vals) == 0 );
+    } // Loop nmodes
+
+    double const norm_mats = sptGramHadamardKruskalNorm(&gh, lambda, ata_vals);
+    double const inner = sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats);
+    fit = sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e  gpu share = %.2f\n",
+        it+1, its_time, fit, fit - oldfit, hybrid.gpu_share);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  sptCudaFreeMttkrpHybrid(&hybrid);
+  sptFreeGramHadamard(&gh);
+  free(ata_vals);
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+
+  return fit;
+}
+
+
+/**
+ * CPD-ALS whose MTTKRPs run on the current CUDA device and the host cores at once,
+ * see sptCudaMTTKRPHybrid. The share of the nonzeros given to the GPU is set from
+ * the throughputs measured in each MTTKRP, so it settles within a few iterations.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of host threads, at least 2, one of which drives the GPU
+ */
+int sptCudaCpdAlsHybrid(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, tk) == 0);
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = CudaCpdAlsHybridStep(spten, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU+CUDA SpTns CPD-ALS Hybrid");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,285 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Initial factors for CP-ALS.
+ *
+ * Random starts make ALS spend its first sweeps finding the dominant
+ * subspaces. The range finder gets a basis of each of them for one MTTKRP:
+ * X_(n) times the Khatri-Rao product of Gaussian factors is a Gaussian sketch
+ * of the mode-n unfolding, whose column space is close to its leading one.
+ * The truncated HOSVD refines those bases with one sweep of leading left
+ * singular vectors of X times the other bases, through the semi-sparse
+ * unfoldings of sptSparseTensorMulMatricesExcept. The sampled start runs a few
+ * iterations of the randomized CP-ALS, each cheaper than one MTTKRP.
+ */
+
+/* The HOSVD unfoldings have at most this many columns */
+#define SPT_CPD_INIT_HOSVD_COLS 4096
+/* Iterations of sptOmpCpdAlsSampled behind the sampled start */
+#define SPT_CPD_INIT_SAMPLED_ITERS 5
+
+static int spt_cpd_init = -1;
+
+/* The initialization the drivers use, from PARTI_CPD_INIT until sptSetCpdInit is called */
+static sptCpdInit spt_CpdInitMethod(void) {
+    if(spt_cpd_init < 0) {
+        char const * env = getenv("PARTI_CPD_INIT");
+        spt_cpd_init = SPT_CPD_INIT_RANDOM;
+        if(env != NULL && strcmp(env, "range") == 0) {
+            spt_cpd_init = SPT_CPD_INIT_RANGE;
+        } else if(env != NULL && strcmp(env, "hosvd") == 0) {
+            spt_cpd_init = SPT_CPD_INIT_HOSVD;
+        } else if(env != NULL && strcmp(env, "sampled") == 0) {
+            spt_cpd_init = SPT_CPD_INIT_SAMPLED;
+        }
+    }
+    return (sptCpdInit) spt_cpd_init;
+}
+
+/**
+ * Choose how the COO CP-ALS drivers (sptCpdAls, sptOmpCpdAls and its
+ * workspace, Jacobi and hybrid variants) start when the Kruskal tensor holds
+ * no factors. Defaults to the PARTI_CPD_INIT environment variable, one of
+ * "random", "range", "hosvd" or "sampled".
+ * @param init  the initialization, SPT_CPD_INIT_RANDOM for sptRandomizeMatrix
+ */
+int sptSetCpdInit(sptCpdInit const init) {
+    if(init < SPT_CPD_INIT_RANDOM || init > SPT_CPD_INIT_SAMPLED) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Init", "unknown initialization");
+    }
+    spt_cpd_init = init;
+    return 0;
+}
+
+
+/* Fill A with standard normal entries by Box-Muller */
+static void spt_CpdGaussianMatrix(sptMatrix * A, uint64_t * state) {
+    sptIndex const ncols = A->ncols;
+    for(sptIndex i = 0; i < A->nrows; ++i) {
+        sptValue * row = A->values + (size_t) i * A->stride;
+        for(sptIndex r = 0; r < ncols; r += 2) {
+            double const u = 1.0 - spt_GenUniform(state);
+            double const t = 2 * M_PI * spt_GenUniform(state);
+            double const rad = sqrt(-2 * log(u));
+            row[r] = (sptValue) (rad * cos(t));
+            if(r + 1 < ncols) {
+                row[r+1] = (sptValue) (rad * sin(t));
+            }
+        }
+    }
+}
+
+/* Orthonormalize the columns of A, or only normalize them when there are more columns than rows */
+static void spt_CpdInitBasis(sptMatrix * A, double * col) {
+    if(A->nrows >= A->ncols) {
+        spt_TuckerOrthonormalize(A, col);
+        return;
+    }
+    for(sptIndex r = 0; r < A->ncols; ++r) {
+        double norm = 0;
+        for(sptIndex i = 0; i < A->nrows; ++i) {
+            double const v = A->values[(size_t) i * A->stride + r];
+            norm += v * v;
+        }
+        norm = norm > 0 ? sqrt(norm) : 1;
+        for(sptIndex i = 0; i < A->nrows; ++i) {
+            A->values[(size_t) i * A->stride + r] /= norm;
+        }
+    }
+}
+
+/* Range finder: mats[n] is a basis of X_(n) times the Khatri-Rao product of Gaussian factors */
+static int spt_CpdInitRange(sptSparseTensor const * X, sptIndex const rank, sptMatrix ** mats, uint64_t seed, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptMatrix ** omega = malloc((nmodes + 1) * sizeof *omega);
+    sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+    double * col = malloc(max_dim * sizeof *col);
+    spt_CheckOSError(!omega || !mats_order || !col, "CPD Init");
+    uint64_t state = spt_GenMix(seed);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        omega[m] = malloc(sizeof *omega[m]);
+        spt_CheckOSError(!omega[m], "CPD Init");
+        int result = sptNewMatrix(omega[m], m < nmodes ? X->ndims[m] : max_dim, rank);
+        spt_CheckError(result, "CPD Init", NULL);
+        if(m < nmodes) {
+            spt_CpdGaussianMatrix(omega[m], &state);
+        }
+    }
+
+    for(sptIndex n = 0; n < nmodes; ++n) {
+        for(sptIndex i = 0; i < nmodes; ++i) {
+            mats_order[i] = (n + i) % nmodes;
+        }
+        int result = sptOmpMTTKRP(X, omega, mats_order, n, tk);
+        spt_CheckError(result, "CPD Init", NULL);
+        memcpy(mats[n]->values, omega[nmodes]->values, (size_t) X->ndims[n] * mats[n]->stride * sizeof(sptValue));
+        spt_CpdInitBasis(mats[n], col);
+    }
+
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeMatrix(omega[m]);
+        free(omega[m]);
+    }
+    free(omega);
+    free(mats_order);
+    free(col);
+    return 0;
+}
+
+/*
+ * One truncated HOSVD sweep from the range bases: mats[n] takes the leading
+ * left singular vectors of X times the leading r columns of every other basis,
+ * r capped so an unfolding has at most SPT_CPD_INIT_HOSVD_COLS columns. Its
+ * columns past what the unfolding can give keep the range basis.
+ */
+static int spt_CpdInitHosvd(sptSparseTensor const * X, sptIndex const rank, sptMatrix ** mats, uint64_t seed, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    int result = spt_CpdInitRange(X, rank, mats, seed, tk);
+    spt_CheckError(result, "CPD Init", NULL);
+
+    sptIndex r = rank;
+    while(r > 1 && pow((double) r, (double) (nmodes - 1)) > SPT_CPD_INIT_HOSVD_COLS) {
+        --r;
+    }
+
+    /* X is sorted by every mode in turn, so the sweep runs on a copy */
+    sptSparseTensor Xc;
+    result = sptCopySparseTensor(&Xc, X, tk);
+    spt_CheckError(result, "CPD Init", NULL);
+    sptMatrix * views = malloc(nmodes * sizeof *views);
+    sptMatrix ** U = malloc(nmodes * sizeof *U);
+    double * col = malloc(sptMaxIndexArray(X->ndims, nmodes) * sizeof *col);
+    spt_CheckOSError(!views || !U || !col, "CPD Init");
+
+    for(sptIndex n = 0; n < nmodes; ++n) {
+        sptIndex cols = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const rm = r < X->ndims[m] ? r : X->ndims[m];
+            views[m] = (sptMatrix) { mats[m]->nrows, rm, mats[m]->cap, mats[m]->stride, mats[m]->values };
+            U[m] = &views[m];
+            cols *= m != n ? rm : 1;
+        }
+        sptIndex k = rank < cols ? rank : cols;
+        /* A full basis of the mode is any basis, nothing to refine */
+        if(k >= X->ndims[n]) {
+            continue;
+        }
+        sptMatrix Y;
+        result = sptSparseTensorMulMatricesExcept(&Y, &Xc, U, n, tk);
+        spt_CheckError(result, "CPD Init", NULL);
+        views[n].ncols = k;
+        double energy;
+        result = spt_MatrixLeadingLeftVectors(&Y, &views[n], &energy, -1);
+        spt_CheckError(result, "CPD Init", NULL);
+        sptFreeMatrix(&Y);
+        /* The columns past k are made orthogonal to the new leading ones */
+        spt_CpdInitBasis(mats[n], col);
+    }
+
+    sptFreeSparseTensor(&Xc);
+    free(views);
+    free(U);
+    free(col);
+    return 0;
+}
+
+/* A few iterations of the randomized CP-ALS; only the directions of the factors matter to ALS */
+static int spt_CpdInitSampled(sptSparseTensor const * X, sptIndex const rank, sptMatrix ** mats, uint64_t seed, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptKruskalTensor kt;
+    int result = sptNewKruskalTensor(&kt, nmodes, X->ndims, rank);
+    spt_CheckError(result, "CPD Init", NULL);
+    result = sptOmpCpdAlsSampled(X, rank, 0, SPT_CPD_INIT_SAMPLED_ITERS, 0, seed, tk, &kt);
+    spt_CheckError(result, "CPD Init", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+        mats[m] = kt.factors[m];
+    }
+    free(kt.factors);
+    kt.factors = NULL;
+    sptFreeKruskalTensor(&kt);
+    return 0;
+}
+
+static int spt_CpdInitWith(sptSparseTensor const * X, sptIndex const rank, sptCpdInit const init, sptMatrix ** mats, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        spt_CheckOSError(!mats[m], "CPD Init");
+        int result = sptNewMatrix(mats[m], X->ndims[m], rank);
+        spt_CheckError(result, "CPD Init", NULL);
+        result = sptRandomizeMatrix(mats[m], X->ndims[m], rank);
+        spt_CheckError(result, "CPD Init", NULL);
+    }
+    if(init == SPT_CPD_INIT_RANDOM || nmodes < 2 || X->nnz == 0) {
+        return 0;
+    }
+    /* Seeded from the library stream as the random start is, so sptSetRandomSeed decides the run */
+    uint64_t const seed = spt_RandomBits(spt_RandomReserve(1));
+    switch(init) {
+    case SPT_CPD_INIT_RANGE:
+        return spt_CpdInitRange(X, rank, mats, seed, tk);
+    case SPT_CPD_INIT_HOSVD:
+        return spt_CpdInitHosvd(X, rank, mats, seed, tk);
+    case SPT_CPD_INIT_SAMPLED:
+        return spt_CpdInitSampled(X, rank, mats, seed, tk);
+    default:
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Init", "unknown initialization");
+    }
+    return 0;
+}
+
+/* Allocate mats[0..nmodes-1] as the initial factors chosen by sptSetCpdInit */
+int spt_CpdInitMatrices(sptSparseTensor const * X, sptIndex const rank, sptMatrix ** mats, int const tk) {
+    return spt_CpdInitWith(X, rank, spt_CpdInitMethod(), mats, tk);
+}
+
+/**
+ * Compute initial factors for a CP decomposition of X into a Kruskal tensor
+ * that holds none, so that passing it to any CP-ALS driver, COO or HiCOO,
+ * starts from them.
+ * @param[in,out] ktensor a Kruskal tensor of X's shape and the rank, from sptNewKruskalTensor
+ * @param[in]  X     the COO tensor
+ * @param[in]  rank  the CPD rank
+ * @param[in]  init  the initialization
+ * @param[in]  tk    the number of threads
+ */
+int sptCpdInitFactors(sptKruskalTensor * ktensor, sptSparseTensor const * const X, sptIndex const rank, sptCpdInit const init, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    if(ktensor->nmodes != nmodes || ktensor->rank != rank) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Init", "the Kruskal tensor does not match the rank");
+    }
+    if(ktensor->factors != NULL) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Init", "the Kruskal tensor already holds factors");
+    }
+    sptMatrix ** mats = malloc(nmodes * sizeof *mats);
+    spt_CheckOSError(!mats, "CPD Init");
+    int result = spt_CpdInitWith(X, rank, init, mats, tk);
+    spt_CheckError(result, "CPD Init", NULL);
+    ktensor->factors = mats;
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "sptensor.h"
+
+
+/*
+ * Jacobi-style ALS: every factor is solved against the factors of the
+ * previous iteration, so all MTTKRPs of an iteration come from one pass of
+ * sptOmpMTTKRPMulti and the modes no longer wait on each other. Each update
+ * is the least-squares solution with the other factors held, as in ALS, but
+ * taken together they may improve the fit less per iteration.
+ */
+
+/* The fit of the model from the MTTKRP of mode 0 against its factors */
+static double spt_CpdJacobiFit(
+  double const spten_normsq,
+  sptIndex const nmodes,
+  sptIndex const rank,
+  sptMatrix ** mats,
+  sptMatrix const * const mttkrp,
+  sptValue const * const lambda,
+  sptMatrix ** ata)
+{
+  sptIndex const stride = mats[0]->stride;
+  double inner = 0;
+  for(sptIndex i=0; i < mats[0]->nrows; ++i) {
+    for(sptIndex r=0; r < rank; ++r) {
+      inner += lambda[r] * mttkrp->values[i * stride + r] * mats[0]->values[i * stride + r];
+    }
+  }
+  return sptKruskalTensorFitFromNorms(spten_normsq, sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata), inner);
+}
+
+
+static double OmpCpdAlsJacobiStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spten->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  /* One MTTKRP output per mode, all against the same factors */
+  sptMatrix ** outs = (sptMatrix **)malloc(nmodes * sizeof(*outs));
+  sptIndex * modes = (sptIndex *)malloc(nmodes * sizeof(*modes));
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    outs[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(outs[m], spten->ndims[m], rank) == 0);
+    modes[m] = m;
+  }
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[0]->stride == ata[m]->stride);
+  }
+
+  /* Keep every factor normalized, with the scale in lambda, and compute all "ata"s */
+  sptValue * norms = (sptValue *)malloc(rank * sizeof(*norms));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptMatrix2Norm(mats[m], norms);
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] *= norms[r];
+    }
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+  }
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double oldfit = 0;
+  int converged = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptAssert (sptOmpMTTKRPMulti(spten, mats, nmodes, modes, outs, tk) == 0);
+
+    fit = spt_CpdJacobiFit(spten_normsq, nmodes, rank, mats, outs[0], lambda, ata);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      converged = 1;
+      sptStopTimer(timer);
+      sptFreeTimer(timer);
+      break;
+    }
+
+    /* Every mode against the Gram matrices of the previous factors; the new ones are taken after */
+    for(sptIndex m=0; m < nmodes; ++m) {
+      memcpy(mats[m]->values, outs[m]->values, (size_t) mats[m]->nrows * stride * sizeof(sptValue));
+      sptAssert ( sptOmpMatrixSolveNormals(m, nmodes, ata, mats[m], tk) == 0 );
+      sptMatrix2Norm(mats[m], norms);
+    }
+    /* Each solution carries the full scale; the last one's is kept, as in ALS */
+    memcpy(lambda, norms, rank * sizeof(*lambda));
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+    }
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    oldfit = fit;
+  } // Loop niters
+
+  /* The last update has not been measured yet */
+  if(!converged && niters > 0) {
+    sptAssert (sptOmpMTTKRPMulti(spten, mats, 1, modes, outs, tk) == 0);
+    fit = spt_CpdJacobiFit(spten_normsq, nmodes, rank, mats, outs[0], lambda, ata);
+  }
+
+  free(norms);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptFreeMatrix(outs[m]);
+    free(outs[m]);
+  }
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(outs);
+  free(modes);
+  free(ata);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) using Jacobi-style alternating least squares for COO formatted sparse tensors.
+ * All factors are updated together from the previous iteration's factors, with the MTTKRPs of all modes in one pass over the tensor.
+ * The fit reported is that of the factors returned.
+ * @param[in,out] ktensor the Kruskal tensor; factors and lambda it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdAlsJacobi(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-Jacobi");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, tk) == 0);
+  }
+  if(!warm) {
+    for(sptIndex r=0; r < rank; ++r) {
+      ktensor->lambda[r] = 1;
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCpdAlsJacobiStep(spten, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-Jacobi");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  return 0;
+}
@@ -0,0 +1,310 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Mode-specific layouts for CP-ALS.
+ *
+ * A COO MTTKRP is fastest on nonzeros ordered by the output mode: each
+ * thread then owns whole output rows and accumulates them in a register-
+ * sized buffer. One order serves one mode, so a run either shares the input
+ * layout between all modes, keeps a sorted copy per mode, or, in between,
+ * keeps copies for the longest modes, whose scattered output rows gain the
+ * most. The copies are picked within a byte budget, longest mode first.
+ */
+
+static size_t spt_cpd_layout_budget = PARTI_CPD_LAYOUT_BYTES;
+
+/* The budget of sptNewCpdLayouts calls that pass 0 */
+size_t spt_CpdLayoutBudget(void) {
+    return spt_cpd_layout_budget;
+}
+
+/**
+ * Set the bytes of mode-specific copies sptOmpCpdAls and sptOmpCpdAlsHiCOO
+ * may keep, PARTI_CPD_LAYOUT_BYTES until called; 0 makes every mode read
+ * the input tensor.
+ */
+int sptSetCpdLayoutBudget(size_t const bytes) {
+    spt_cpd_layout_budget = bytes;
+    return 0;
+}
+
+
+/* Bytes of one mode's copy: its indices and values, slice pointers and thread boundaries */
+static size_t spt_CpdLayoutCopyBytes(sptIndex const nmodes, sptIndex const ndim, sptNnzIndex const nnz,
+    int const has_values, int const tk)
+{
+    return (size_t) nnz * (nmodes * sizeof(sptIndex) + (has_values ? sizeof(sptValue) : 0)) +
+        ((size_t) ndim + 1) * sizeof(sptNnzIndex) + ((size_t) tk + 1) * sizeof(sptNnzIndex);
+}
+
+/*
+ * Pick the modes that get copies within budget, longest first, and mark
+ * them in routed. Returns the bytes the copies and their row buffers take,
+ * 0 when no mode gets one.
+ */
+size_t spt_PlanCpdLayouts(
+    int * routed,
+    sptIndex const nmodes,
+    sptIndex const ndims[],
+    sptNnzIndex const nnz,
+    int const has_values,
+    sptIndex const rank,
+    int const tk,
+    size_t const budget)
+{
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        routed[m] = 0;
+    }
+    if(nmodes < 2 || nnz == 0) {
+        return 0;
+    }
+    size_t bytes = (size_t) tk * spt_MatrixBytes(1, rank);
+    size_t const base = bytes;
+    for(sptIndex k = 0; k < nmodes; ++k) {
+        /* The longest mode without a copy yet, the lowest on ties */
+        sptIndex longest = nmodes;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(!routed[m] && (longest == nmodes || ndims[m] > ndims[longest])) {
+                longest = m;
+            }
+        }
+        size_t const more = spt_CpdLayoutCopyBytes(nmodes, ndims[longest], nnz, has_values, tk);
+        if(bytes + more > budget) {
+            break;
+        }
+        routed[longest] = 1;
+        bytes += more;
+    }
+    return bytes != base ? bytes : 0;
+}
+
+
+/*
+ * Build the layouts of X with copies for the routed modes. With own_x, X is
+ * taken over as the last copy rather than copied, and released otherwise.
+ */
+int spt_NewCpdLayouts(
+    sptCpdLayouts * layouts,
+    sptSparseTensor * X,
+    int const own_x,
+    int const * routed,
+    sptIndex const rank,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    int result;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Layouts", "tk < 1");
+    }
+    layouts->nmodes = nmodes;
+    layouts->tk = tk;
+    layouts->rank = rank;
+    layouts->stride = ((rank-1)/8+1)*8;
+    layouts->bytes = 0;
+    layouts->copies = calloc(nmodes, sizeof *layouts->copies);
+    layouts->bounds = calloc(nmodes, sizeof *layouts->bounds);
+    layouts->factors = calloc(nmodes, sizeof *layouts->factors);
+    spt_CheckOSError(!layouts->copies || !layouts->bounds || !layouts->factors, "CPD Layouts");
+
+    sptIndex ncopies = 0, last = nmodes;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(routed[m]) {
+            ++ncopies;
+            last = m;
+        }
+    }
+    layouts->policy = ncopies == 0 ? SPT_CPD_LAYOUT_SHARED :
+        ncopies == nmodes ? SPT_CPD_LAYOUT_PER_MODE : SPT_CPD_LAYOUT_HYBRID;
+
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    spt_CheckOSError(!order, "CPD Layouts");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(!routed[m]) {
+            continue;
+        }
+        sptSparseTensor * copy = malloc(sizeof *copy);
+        spt_CheckOSError(!copy, "CPD Layouts");
+        if(own_x && m == last) {
+            *copy = *X;
+        } else {
+            result = sptCopySparseTensor(copy, X, tk);
+            spt_CheckError(result, "CPD Layouts", NULL);
+        }
+        /* The mode leading, then the others in the Khatri-Rao order of its MTTKRP */
+        for(sptIndex i = 0; i < nmodes; ++i) {
+            order[i] = (m + i) % nmodes;
+        }
+        sptSparseTensorSortIndexCustomOrder(copy, order, 1);
+        layouts->copies[m] = copy;
+
+        sptNnzIndex const * const slice_ptr = spt_SparseTensorSlicePtr(copy, m);
+        spt_CheckOSError(!slice_ptr, "CPD Layouts");
+        result = sptNewNnzIndexVector(&layouts->bounds[m], tk + 1, tk + 1);
+        spt_CheckError(result, "CPD Layouts", NULL);
+        result = spt_PartitionSegments(layouts->bounds[m].data, slice_ptr, copy->ndims[m], tk);
+        spt_CheckError(result, "CPD Layouts", NULL);
+        layouts->bytes += spt_CpdLayoutCopyBytes(nmodes, copy->ndims[m], copy->nnz, copy->values.data != NULL, tk);
+    }
+    free(order);
+    if(own_x && last == nmodes) {
+        sptFreeSparseTensor(X);
+    }
+
+    sptNnzIndex const nscratch = ncopies != 0 ? (sptNnzIndex) tk * layouts->stride : 0;
+    result = sptNewValueVector(&layouts->scratch, nscratch, nscratch);
+    spt_CheckError(result, "CPD Layouts", NULL);
+    layouts->bytes += nscratch * sizeof(sptValue);
+    return 0;
+}
+
+
+/**
+ * Pick how the modes of a CP-ALS run on X read the tensor, and build the
+ * copies that takes: one sorted copy per mode if they all fit the budget,
+ * none if not even one does, and otherwise copies for as many of the
+ * longest modes as fit. Modes without a copy read X.
+ * @param[out] layouts  the layouts to initialize
+ * @param[in]  X        the sparse tensor, left untouched
+ * @param[in]  rank     the number of columns of the factor matrices
+ * @param[in]  tk       the number of threads the MTTKRP will use
+ * @param[in]  budget   the bytes of all copies, 0 for the sptSetCpdLayoutBudget setting
+ */
+int sptNewCpdLayouts(
+    sptCpdLayouts * layouts,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    size_t const budget)
+{
+    int * routed = malloc(X->nmodes * sizeof *routed);
+    spt_CheckOSError(!routed, "CPD Layouts");
+    spt_PlanCpdLayouts(routed, X->nmodes, X->ndims, X->nnz, !sptSparseTensorIsPattern(X), rank, tk,
+        budget != 0 ? budget : spt_CpdLayoutBudget());
+    int const result = spt_NewCpdLayouts(layouts, (sptSparseTensor *) X, 0, routed, rank, tk);
+    free(routed);
+    return result;
+}
+
+
+/**
+ * Release layouts built by sptNewCpdLayouts or sptNewCpdLayoutsHiCOO
+ */
+void sptFreeCpdLayouts(sptCpdLayouts * layouts)
+{
+    for(sptIndex m = 0; m < layouts->nmodes; ++m) {
+        if(layouts->copies[m] != NULL) {
+            sptFreeSparseTensor(layouts->copies[m]);
+            free(layouts->copies[m]);
+            sptFreeNnzIndexVector(&layouts->bounds[m]);
+        }
+    }
+    free(layouts->copies);
+    free(layouts->bounds);
+    free(layouts->factors);
+    sptFreeValueVector(&layouts->scratch);
+    layouts->nmodes = 0;
+}
+
+
+static inline int spt_CpdLayoutThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline int spt_CpdLayoutNumThreads(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+/*
+ * MTTKRP of a mode with a copy, on factor values the caller puts in
+ * layouts->factors: each thread accumulates the rows of its slices one at a
+ * time and stores them, so every row of out is written exactly once.
+ * Matrices of either sptMatrix or sptRankMatrix rows fit, given their stride.
+ */
+int spt_OmpMTTKRPCpdLayout(
+    sptCpdLayouts * layouts,
+    sptIndex const mode,
+    sptIndex const mats_order[],
+    sptIndex const stride,
+    sptIndex const R,
+    sptValue * const out)
+{
+    sptSparseTensor const * const X = layouts->copies[mode];
+    if(X == NULL || R > layouts->rank) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "no copy of the mode at this rank");
+    }
+    sptIndex const nmodes = X->nmodes;
+    sptValue const * const vals = X->values.data;
+    sptNnzIndex const * const slice_ptr = spt_SparseTensorSlicePtr(X, mode);
+    spt_CheckOSError(!slice_ptr, "CPU  SpTns MTTKRP");
+    sptNnzIndex const * const bounds = layouts->bounds[mode].data;
+    sptValue * const * const factors = layouts->factors;
+    int const tk = layouts->tk;
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int const tid = spt_CpdLayoutThreadNum();
+        int const nthreads = spt_CpdLayoutNumThreads();
+        sptValue * const restrict acc = layouts->scratch.data + tid * layouts->stride;
+        /* A smaller team than tk still covers every range */
+        for(int t = tid; t < tk; t += nthreads) {
+            for(sptNnzIndex i = bounds[t]; i < bounds[t+1]; ++i) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    acc[r] = 0;
+                }
+                for(sptNnzIndex x = slice_ptr[i]; x < slice_ptr[i+1]; ++x) {
+                    sptValue const entry = vals != NULL ? vals[x] : 1;
+                    sptValue const * const restrict row1 = factors[mats_order[1]] + (sptNnzIndex) X->inds[mats_order[1]].data[x] * stride;
+                    if(nmodes == 2) {
+                        #pragma omp simd
+                        for(sptIndex r = 0; r < R; ++r) {
+                            acc[r] += entry * row1[r];
+                        }
+                        continue;
+                    }
+                    sptValue const * const restrict row2 = factors[mats_order[2]] + (sptNnzIndex) X->inds[mats_order[2]].data[x] * stride;
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue prod = entry * row1[r] * row2[r];
+                        for(sptIndex k = 3; k < nmodes; ++k) {
+                            prod *= factors[mats_order[k]][(sptNnzIndex) X->inds[mats_order[k]].data[x] * stride + r];
+                        }
+                        acc[r] += prod;
+                    }
+                }
+                sptValue * const restrict out_row = out + i * stride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    out_row[r] = acc[r];
+                }
+            }
+        }
+    }
+    return 0;
+}
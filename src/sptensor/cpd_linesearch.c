@@ -0,0 +1,203 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/*
+ * Line search for CP-ALS (Bro's extrapolation): after a sweep, step from the
+ * previous iterate through the current one by s = it^(1/3), and keep the
+ * step only when it improves the fit. Checking a step costs one MTTKRP,
+ * which the driver runs since it owns the kernel.
+ */
+
+static int spt_cpd_linesearch = -1;
+
+/* Whether the drivers extrapolate, from PARTI_CPD_LINESEARCH until sptSetCpdLineSearch is called */
+int spt_CpdLineSearchEnabled(void) {
+    if(spt_cpd_linesearch < 0) {
+        char const * env = getenv("PARTI_CPD_LINESEARCH");
+        spt_cpd_linesearch = env != NULL && atoi(env) != 0;
+    }
+    return spt_cpd_linesearch;
+}
+
+/**
+ * Make the CP-ALS drivers, COO and HiCOO, try an extrapolated step after
+ * every sweep where the fit is evaluated, and keep it when the fit improves.
+ * Each try costs one extra MTTKRP; in exchange the swamps of plain ALS are
+ * crossed in far fewer sweeps.
+ * Defaults to the PARTI_CPD_LINESEARCH environment variable.
+ * @param enable  1 to extrapolate, 0 for plain ALS
+ */
+int sptSetCpdLineSearch(int const enable) {
+    spt_cpd_linesearch = enable != 0;
+    return 0;
+}
+
+/* Recompute the Gram matrix of every factor, upper triangle as the drivers keep it */
+static void spt_CpdLineSearchGrams(spt_CpdFactors const * f, sptValue ** ata) {
+    sptValue alpha = 1.0, beta = 0.0;
+    char notrans = 'N';
+    char uplo = 'L';
+    int blas_rank = (int) f->rank;
+    int blas_stride = (int) f->stride;
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        int blas_nrows = (int) f->ndims[m];
+        spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+            f->values[m], &blas_stride, &beta, ata[m], &blas_stride);
+    }
+}
+
+/* Copy the model in f to dst with lambda folded into the last factor */
+static void spt_CpdLineSearchFold(spt_CpdFactors const * f, sptValue ** dst) {
+    sptIndex const last = f->nmodes - 1;
+    for(sptIndex m = 0; m < last; ++m) {
+        memcpy(dst[m], f->values[m], (size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+    }
+    for(sptIndex i = 0; i < f->ndims[last]; ++i) {
+        sptValue const * src = f->values[last] + (size_t) i * f->stride;
+        sptValue * row = dst[last] + (size_t) i * f->stride;
+        for(sptIndex r = 0; r < f->rank; ++r) {
+            row[r] = src[r] * f->lambda[r];
+        }
+    }
+}
+
+int spt_NewCpdLineSearch(spt_CpdLineSearch * ls, spt_CpdFactors const * f) {
+    memset(ls, 0, sizeof *ls);
+    if(!spt_CpdLineSearchEnabled() || f->nmodes < 2) {
+        return 0;
+    }
+    ls->prev = calloc(f->nmodes, sizeof *ls->prev);
+    ls->cur = calloc(f->nmodes, sizeof *ls->cur);
+    ls->cur_lambda = malloc(f->rank * sizeof *ls->cur_lambda);
+    spt_CheckOSError(!ls->prev || !ls->cur || !ls->cur_lambda, "CPD LineSearch");
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        size_t const n = (size_t) f->ndims[m] * f->stride;
+        ls->prev[m] = malloc(n * sizeof(sptValue));
+        ls->cur[m] = malloc(n * sizeof(sptValue));
+        spt_CheckOSError(!ls->prev[m] || !ls->cur[m], "CPD LineSearch");
+    }
+    ls->nmodes = f->nmodes;
+    ls->enabled = 1;
+    return 0;
+}
+
+void spt_FreeCpdLineSearch(spt_CpdLineSearch * ls) {
+    for(sptIndex m = 0; m < ls->nmodes; ++m) {
+        free(ls->prev[m]);
+        free(ls->cur[m]);
+    }
+    free(ls->prev);
+    free(ls->cur);
+    free(ls->cur_lambda);
+    memset(ls, 0, sizeof *ls);
+}
+
+int spt_CpdLineSearchPropose(spt_CpdLineSearch * ls, spt_CpdFactors const * f, sptValue ** ata, sptIndex const it) {
+    if(!ls->enabled) {
+        return 0;
+    }
+    sptIndex const last = f->nmodes - 1;
+    if(!ls->have_prev) {
+        spt_CpdLineSearchFold(f, ls->prev);
+        ls->have_prev = 1;
+        return 0;
+    }
+
+    /* Keep the ALS iterate, then overwrite f with prev + (1 + s) * (cur - prev) */
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        memcpy(ls->cur[m], f->values[m], (size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+    }
+    memcpy(ls->cur_lambda, f->lambda, f->rank * sizeof *ls->cur_lambda);
+    sptValue const s = (sptValue) cbrt((double) it + 1);
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        sptValue * const vals = f->values[m];
+        sptValue const * const prev = ls->prev[m];
+        for(sptIndex i = 0; i < f->ndims[m]; ++i) {
+            for(sptIndex r = 0; r < f->rank; ++r) {
+                size_t const at = (size_t) i * f->stride + r;
+                sptValue const cur = m == last ? vals[at] * f->lambda[r] : vals[at];
+                vals[at] = cur + s * (cur - prev[at]);
+            }
+        }
+    }
+    for(sptIndex r = 0; r < f->rank; ++r) {
+        f->lambda[r] = 1;
+    }
+    spt_CpdLineSearchGrams(f, ata);
+    return 1;
+}
+
+double spt_CpdLineSearchResolve(spt_CpdLineSearch * ls, spt_CpdFactors const * f, sptValue ** ata, double const fit, double const trial_fit) {
+    sptIndex const last = f->nmodes - 1;
+    /* The next step starts from this ALS iterate either way */
+    for(sptIndex m = 0; m < last; ++m) {
+        sptValue * const tmp = ls->prev[m];
+        ls->prev[m] = ls->cur[m];
+        ls->cur[m] = tmp;
+    }
+    for(sptIndex i = 0; i < f->ndims[last]; ++i) {
+        sptValue const * src = ls->cur[last] + (size_t) i * f->stride;
+        sptValue * row = ls->prev[last] + (size_t) i * f->stride;
+        for(sptIndex r = 0; r < f->rank; ++r) {
+            row[r] = src[r] * ls->cur_lambda[r];
+        }
+    }
+
+    if(trial_fit > fit) {
+        /* Move the scale of the last factor back into lambda */
+        sptValue * const vals = f->values[last];
+        for(sptIndex r = 0; r < f->rank; ++r) {
+            double norm = 0;
+            for(sptIndex i = 0; i < f->ndims[last]; ++i) {
+                norm += (double) vals[(size_t) i * f->stride + r] * vals[(size_t) i * f->stride + r];
+            }
+            f->lambda[r] = (sptValue) sqrt(norm);
+            if(f->lambda[r] > 0) {
+                for(sptIndex i = 0; i < f->ndims[last]; ++i) {
+                    vals[(size_t) i * f->stride + r] /= f->lambda[r];
+                }
+            }
+        }
+        ++ls->accepted;
+        sptValue alpha = 1.0, beta = 0.0;
+        char notrans = 'N';
+        char uplo = 'L';
+        int blas_rank = (int) f->rank;
+        int blas_stride = (int) f->stride;
+        int blas_nrows = (int) f->ndims[last];
+        spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+            vals, &blas_stride, &beta, ata[last], &blas_stride);
+        return trial_fit;
+    }
+
+    /* Rejected: put the ALS iterate back; prev now holds it, in folded form */
+    for(sptIndex m = 0; m < f->nmodes; ++m) {
+        memcpy(f->values[m], m == last ? ls->cur[m] : ls->prev[m], (size_t) f->ndims[m] * f->stride * sizeof(sptValue));
+    }
+    memcpy(f->lambda, ls->cur_lambda, f->rank * sizeof *ls->cur_lambda);
+    ++ls->rejected;
+    spt_CpdLineSearchGrams(f, ata);
+    return fit;
+}
@@ -0,0 +1,316 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/* Mixed-precision CP-ALS: the tensor and the factor matrices stay in sptValue,
+ * which is meant to be float (PARTI_VALUE_TYPEWIDTH=32) to halve the memory
+ * traffic of MTTKRP, while the MTTKRP rows, Gram matrices, normal-equation
+ * solves, column norms and the fit are all computed in double. */
+
+
+/* out[i * rank + r] = MTTKRP of mode mats_order[0], accumulated in double */
+static void spt_MixedMTTKRP(
+  sptSparseTensor const * const X,
+  sptMatrix ** mats,
+  sptIndex const mats_order[],
+  sptIndex const rank,
+  int const tk,
+  double * const scratch,   // tk rows of rank doubles
+  double * const out)
+{
+  sptIndex const nmodes = X->nmodes;
+  sptIndex const mode = mats_order[0];
+  sptIndex const stride = mats[0]->stride;
+  sptValue const * const vals = X->values.data;
+  sptIndex const * const mode_ind = X->inds[mode].data;
+  memset(out, 0, (size_t)X->ndims[mode] * rank * sizeof *out);
+
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex x=0; x<X->nnz; ++x) {
+#ifdef PARTI_USE_OPENMP
+    double * const row = scratch + (size_t)omp_get_thread_num() * rank;
+#else
+    double * const row = scratch;
+#endif
+    sptValue const * times_row = mats[mats_order[1]]->values + (size_t)X->inds[mats_order[1]].data[x] * stride;
+    double const entry = vals[x];
+    for(sptIndex r=0; r<rank; ++r) {
+      row[r] = entry * times_row[r];
+    }
+    for(sptIndex i=2; i<nmodes; ++i) {
+      times_row = mats[mats_order[i]]->values + (size_t)X->inds[mats_order[i]].data[x] * stride;
+      for(sptIndex r=0; r<rank; ++r) {
+        row[r] *= times_row[r];
+      }
+    }
+    double * const out_row = out + (size_t)mode_ind[x] * rank;
+    for(sptIndex r=0; r<rank; ++r) {
+      #pragma omp atomic update
+      out_row[r] += row[r];
+    }
+  }
+}
+
+
+/* ata = A^T * A in double, stored as a full symmetric rank x rank matrix */
+static void spt_MixedGram(sptMatrix const * const A, sptIndex const rank, double * const buf, double * const ata)
+{
+  sptIndex const nrows = A->nrows;
+  sptIndex const stride = A->stride;
+  #pragma omp parallel for schedule(static)
+  for(sptIndex i=0; i<nrows; ++i) {
+    for(sptIndex r=0; r<rank; ++r) {
+      buf[(size_t)i * rank + r] = A->values[(size_t)i * stride + r];
+    }
+  }
+  /* Row-major A is column-major A^T, so A^T * A is "A * A'" to BLAS */
+  char uplo = 'L', notrans = 'N';
+  int blas_rank = (int) rank, blas_nrows = (int) nrows;
+  double alpha = 1.0, beta = 0.0;
+  dsyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha, buf, &blas_rank, &beta, ata, &blas_rank);
+  for(sptIndex r=0; r<rank; ++r) {
+    for(sptIndex s=r+1; s<rank; ++s) {
+      ata[s * rank + r] = ata[r * rank + s];
+    }
+  }
+}
+
+
+/* v = Hadamard product of all Grams but mode's */
+static void spt_MixedHadamard(sptIndex const nmodes, sptIndex const mode, sptIndex const rank, double * const * const ata, double * const v)
+{
+  for(sptIndex x=0; x<rank*rank; ++x) {
+    v[x] = 1.0;
+  }
+  for(sptIndex m=0; m<nmodes; ++m) {
+    if(m != mode) {
+      for(sptIndex x=0; x<rank*rank; ++x) {
+        v[x] *= ata[m][x];
+      }
+    }
+  }
+}
+
+
+/* Solve X * v = rhs in double for the nrows x rank row-major rhs, with Cholesky or pivoted LU if v is not SPD */
+static int spt_MixedSolveNormals(sptIndex const nmodes, sptIndex const mode, sptIndex const rank, sptIndex const nrows,
+  double * const * const ata, double * const v, double * const rhs)
+{
+  char uplo = 'L';
+  int blas_rank = (int) rank, nrhs = (int) nrows, info = 0;
+  spt_MixedHadamard(nmodes, mode, rank, ata, v);
+  dpotrf_(&uplo, &blas_rank, v, &blas_rank, &info);
+  if(info == 0) {
+    dpotrs_(&uplo, &blas_rank, &nrhs, v, &blas_rank, rhs, &blas_rank, &info);
+    spt_CheckError(info ? SPTERR_VALUE_ERROR : 0, "CPU  SpTns Mixed CPD-ALS", "dpotrs failed");
+    return 0;
+  }
+  /* Not SPD even in double, restore v and pivot */
+  spt_MixedHadamard(nmodes, mode, rank, ata, v);
+  int * ipiv = malloc(rank * sizeof *ipiv);
+  spt_CheckOSError(ipiv == NULL, "CPU  SpTns Mixed CPD-ALS");
+  dgesv_(&blas_rank, &nrhs, v, &blas_rank, ipiv, rhs, &blas_rank, &info);
+  free(ipiv);
+  spt_CheckError(info ? SPTERR_VALUE_ERROR : 0, "CPU  SpTns Mixed CPD-ALS", "dgesv failed");
+  return 0;
+}
+
+
+/* Normalize the columns of sol in double, 2-norm or max-norm like sptMatrix2Norm and sptMatrixMaxNorm, and round into A */
+static void spt_MixedNormalize(double * const sol, sptIndex const rank, int const use_2norm, double * const dlambda, sptMatrix * const A)
+{
+  sptIndex const nrows = A->nrows;
+  sptIndex const stride = A->stride;
+  for(sptIndex r=0; r<rank; ++r) {
+    dlambda[r] = 0;
+  }
+  for(sptIndex i=0; i<nrows; ++i) {
+    double const * const row = sol + (size_t)i * rank;
+    for(sptIndex r=0; r<rank; ++r) {
+      if(use_2norm) {
+        dlambda[r] += row[r] * row[r];
+      } else if(row[r] > dlambda[r]) {
+        dlambda[r] = row[r];
+      }
+    }
+  }
+  for(sptIndex r=0; r<rank; ++r) {
+    if(use_2norm) {
+      dlambda[r] = sqrt(dlambda[r]);
+    } else if(dlambda[r] < 1) {
+      dlambda[r] = 1;
+    }
+  }
+  #pragma omp parallel for schedule(static)
+  for(sptIndex i=0; i<nrows; ++i) {
+    for(sptIndex r=0; r<rank; ++r) {
+      A->values[(size_t)i * stride + r] = (sptValue) (sol[(size_t)i * rank + r] / dlambda[r]);
+    }
+  }
+}
+
+
+/* The body of sptOmpCpdAlsMixed, run under its execution context */
+static int spt_OmpCpdAlsMixedSweeps(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+
+  sptMatrix ** mats = malloc(nmodes * sizeof *mats);
+  spt_CheckOSError(mats == NULL, "CPU  SpTns Mixed CPD-ALS");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, tk) == 0);
+  }
+
+  double * const mttkrp = malloc((size_t)max_dim * rank * sizeof *mttkrp);
+  double * const sol = malloc((size_t)max_dim * rank * sizeof *sol);
+  double * const scratch = malloc((size_t)tk * rank * sizeof *scratch);
+  double * const v = malloc((size_t)rank * rank * sizeof *v);
+  double * const dlambda = malloc(rank * sizeof *dlambda);
+  double ** const ata = malloc(nmodes * sizeof *ata);
+  sptIndex * const mats_order = malloc(nmodes * sizeof *mats_order);
+  spt_CheckOSError(!mttkrp || !sol || !scratch || !v || !dlambda || !ata || !mats_order, "CPU  SpTns Mixed CPD-ALS");
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata[m] = malloc((size_t)rank * rank * sizeof *ata[m]);
+    spt_CheckOSError(ata[m] == NULL, "CPU  SpTns Mixed CPD-ALS");
+    spt_MixedGram(mats[m], rank, sol, ata[m]);
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double fit = 0, oldfit = 0;
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer its_timer;
+    sptNewTimer(&its_timer, 0);
+    sptStartTimer(its_timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+        mats_order[i] = (m+i) % nmodes;
+
+      sptIndex const nrows = spten->ndims[m];
+      spt_MixedMTTKRP(spten, mats, mats_order, rank, tk, scratch, mttkrp);
+      memcpy(sol, mttkrp, (size_t)nrows * rank * sizeof *sol);
+      int result = spt_MixedSolveNormals(nmodes, m, rank, nrows, ata, v, sol);
+      spt_CheckError(result, "CPU  SpTns Mixed CPD-ALS", NULL);
+      spt_MixedNormalize(sol, rank, it == 0, dlambda, mats[m]);
+      spt_MixedGram(mats[m], rank, sol, ata[m]);
+    }
+
+    /* ||K||^2 = lambda^T (*_m ata[m]) lambda, <X, K> from the last MTTKRP */
+    spt_MixedHadamard(nmodes, nmodes, rank, ata, v);
+    double norm_mats = 0;
+    for(sptIndex r=0; r<rank; ++r) {
+      for(sptIndex s=0; s<rank; ++s) {
+        norm_mats += dlambda[r] * v[r * rank + s] * dlambda[s];
+      }
+    }
+    sptMatrix const * const last = mats[nmodes-1];
+    double inner = 0;
+    #pragma omp parallel for reduction(+:inner) schedule(static)
+    for(sptIndex i=0; i<last->nrows; ++i) {
+      for(sptIndex r=0; r<rank; ++r) {
+        inner += mttkrp[(size_t)i * rank + r] * last->values[(size_t)i * last->stride + r] * dlambda[r];
+      }
+    }
+    double residual = spten_normsq + fabs(norm_mats) - 2 * inner;
+    residual = residual > 0.0 ? sqrt(residual) : 0.0;
+    fit = 1 - residual / sqrt(spten_normsq);
+
+    sptStopTimer(its_timer);
+    double its_time = sptElapsedTime(its_timer);
+    sptFreeTimer(its_timer);
+
+    printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  }
+
+  for(sptIndex r=0; r<rank; ++r) {
+    ktensor->lambda[r] = (sptValue) dlambda[r];
+  }
+  GetFinalLambda(rank, nmodes, mats, ktensor->lambda);
+  ktensor->fit = fit;
+  ktensor->factors = mats;
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns Mixed CPD-ALS");
+  sptFreeTimer(timer);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    free(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+  free(dlambda);
+  free(v);
+  free(scratch);
+  free(sol);
+  free(mttkrp);
+
+  return 0;
+}
+
+
+/**
+ * OpenMP mixed-precision CANDECOMP/PARAFAC decomposition using alternating
+ * least squares for COO sparse tensors. Values and factors are stored as
+ * sptValue; MTTKRP accumulation, Gram matrices, solves and the fit use double,
+ * so a float build converges like a double one on ill-conditioned problems.
+ * @param[in]  spten  the COO representation of a sparse tensor
+ * @param[in]  rank   the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol    the tolerance value for convergence
+ * @param[in]  tk     the number of threads
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ */
+int sptOmpCpdAlsMixed(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  int const result = spt_OmpCpdAlsMixedSweeps(spten, rank, niters, tol, tk, ktensor);
+  sptSetExecContext(caller_exec);
+  return result;
+}
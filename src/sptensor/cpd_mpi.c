@@ -0,0 +1,629 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_MPI
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+
+/* Rank p owns rows [spt_MpiRowBegin(n, p, P), spt_MpiRowBegin(n, p+1, P)) of an n-row factor. */
+static inline sptIndex spt_MpiRowBegin(sptIndex const nrows, int const p, int const nprocs)
+{
+    return (sptIndex) ((uint64_t) nrows * (uint64_t) p / (uint64_t) nprocs);
+}
+
+/* A matrix header over rows [begin, begin+nrows) of A, sharing A's storage. */
+static inline sptMatrix spt_MpiRowView(sptMatrix const * const A, sptIndex const begin, sptIndex const nrows)
+{
+    sptMatrix view = *A;
+    view.nrows = nrows;
+    view.cap = nrows;
+    view.values = A->values + (size_t) begin * A->stride;
+    return view;
+}
+
+/**
+ * Normalize the columns of a row-distributed factor by their global 2-norm
+ * (max_norm == 0) or by their global maximum clamped below at 1 (max_norm != 0),
+ * matching sptMatrix2Norm and sptMatrixMaxNorm.
+ */
+static void spt_MpiMatrixNorm(sptMatrix * const local, sptValue * const lambda, int const max_norm, MPI_Comm comm)
+{
+    sptIndex const ncols = local->ncols;
+    sptIndex const stride = local->stride;
+    sptValue * const vals = local->values;
+
+    for(sptIndex j=0; j < ncols; ++j) {
+        lambda[j] = 0.0;
+    }
+    for(sptIndex i=0; i < local->nrows; ++i) {
+        for(sptIndex j=0; j < ncols; ++j) {
+            sptValue const v = vals[i*stride + j];
+            if(max_norm) {
+                if(v > lambda[j])
+                    lambda[j] = v;
+            } else {
+                lambda[j] += v * v;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, lambda, (int) ncols, PARTI_MPI_VALUE, max_norm ? MPI_MAX : MPI_SUM, comm);
+    for(sptIndex j=0; j < ncols; ++j) {
+        if(max_norm) {
+            if(lambda[j] < 1)
+                lambda[j] = 1;
+        } else {
+            lambda[j] = sqrt(lambda[j]);
+        }
+    }
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel for
+#endif
+    for(sptIndex i=0; i < local->nrows; ++i) {
+        for(sptIndex j=0; j < ncols; ++j) {
+            vals[i*stride + j] /= lambda[j];
+        }
+    }
+}
+
+
+/* Factor matrices initialized on rank 0 and shared, mats[nmodes] the workspace MTTKRP output */
+static sptMatrix ** spt_MpiNewFactors(sptSparseTensor const * const spten, sptIndex const rank, sptCpdWorkspace * ws, MPI_Comm comm)
+{
+  sptIndex const nmodes = spten->nmodes;
+  int myrank;
+  MPI_Comm_rank(comm, &myrank);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  sptAssert(mats != NULL);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+    if(myrank == 0) {
+      sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+    }
+    MPI_Bcast(mats[m]->values, (int) (mats[m]->nrows * mats[m]->stride), PARTI_MPI_VALUE, 0, comm);
+  }
+  mats[nmodes] = ws->mttkrp;
+  mats[nmodes]->nrows = mats[nmodes]->cap;
+  return mats;
+}
+
+
+static double MpiCpdAlsStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptMatrix ** mats,  // Row-major, replicated on every rank
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  int myrank, nprocs;
+  MPI_Comm_rank(comm, &myrank);
+  MPI_Comm_size(comm, &nprocs);
+  double fit = 0;
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = ws->ata;
+
+  /* Row blocks of every mode, element counts for reduce-scatter and allgather */
+  int * counts = malloc(nprocs * sizeof *counts);
+  int * displs = malloc(nprocs * sizeof *displs);
+  spt_CheckOSError(!counts || !displs, "MPI  SpTns CPD-ALS");
+  sptIndex const max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix owned_mttkrp;
+  sptAssert(sptNewMatrix(&owned_mttkrp, max_dim / nprocs + 1, rank) == 0);
+
+  /* Gram matrices of the replicated initial factors need no communication. */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+
+  double spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  MPI_Allreduce(MPI_IN_PLACE, &spten_normsq, 1, MPI_DOUBLE, MPI_SUM, comm);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    double its_time = MPI_Wtime();
+    sptIndex row_begin = 0, owned_rows = 0;
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptIndex const nrows = mats[m]->nrows;
+      for(int p=0; p < nprocs; ++p) {
+        sptIndex const b = spt_MpiRowBegin(nrows, p, nprocs);
+        counts[p] = (int) ((spt_MpiRowBegin(nrows, p+1, nprocs) - b) * stride);
+        displs[p] = (int) (b * stride);
+      }
+      row_begin = spt_MpiRowBegin(nrows, myrank, nprocs);
+      owned_rows = spt_MpiRowBegin(nrows, myrank+1, nprocs) - row_begin;
+
+      /* Local MTTKRP over this rank's nonzeros, summed into the owners' rows */
+      tmp_mat->nrows = nrows;
+      sptAssert (sptOmpMTTKRPWorkspace(spten, mats, m, ws) == 0);
+      owned_mttkrp.nrows = owned_rows;
+      MPI_Reduce_scatter(tmp_mat->values, owned_mttkrp.values, counts, PARTI_MPI_VALUE, MPI_SUM, comm);
+
+      /* Each rank solves its own rows (ata[nmodes] is rebuilt identically everywhere). */
+      sptMatrix local = spt_MpiRowView(mats[m], row_begin, owned_rows);
+      memcpy(local.values, owned_mttkrp.values, (size_t) owned_rows * stride * sizeof(sptValue));
+      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, &local) == 0 );
+      spt_MpiMatrixNorm(&local, lambda, it != 0, comm);
+
+      /* ata[m] = sum over ranks of local^T * local */
+      int blas_nrows = (int) owned_rows;
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        local.values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      MPI_Allreduce(MPI_IN_PLACE, ata[m]->values, (int) (rank * stride), PARTI_MPI_VALUE, MPI_SUM, comm);
+
+      /* Replicate the updated rows for the next modes' MTTKRP. */
+      MPI_Allgatherv(MPI_IN_PLACE, 0, PARTI_MPI_VALUE, mats[m]->values, counts, displs, PARTI_MPI_VALUE, comm);
+    } // Loop nmodes
+
+    /* The inner product only needs the owned rows of the last mode. */
+    sptMatrix ** views = malloc((nmodes+1) * sizeof *views);
+    spt_CheckOSError(!views, "MPI  SpTns CPD-ALS");
+    sptMatrix last_view = spt_MpiRowView(mats[nmodes-1], row_begin, owned_rows);
+    for(sptIndex m=0; m < nmodes-1; ++m) {
+      views[m] = mats[m];
+    }
+    views[nmodes-1] = &last_view;
+    views[nmodes] = &owned_mttkrp;
+    double inner = sptSparseKruskalTensorInnerProduct(nmodes, lambda, views);
+    free(views);
+    MPI_Allreduce(MPI_IN_PLACE, &inner, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+    double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata);
+    double residual = spten_normsq + norm_mats - 2 * inner;
+    if (residual > 0.0) {
+      residual = sqrt(residual);
+    }
+    fit = 1 - (residual / sqrt(spten_normsq));
+
+    its_time = MPI_Wtime() - its_time;
+    if(myrank == 0) {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, its_time, fit, fit - oldfit);
+    }
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  sptFreeMatrix(&owned_mttkrp);
+  free(displs);
+  free(counts);
+
+  return fit;
+}
+
+
+/**
+ * Distributed-memory CP-ALS for a COO tensor whose nonzeros are spread across
+ * the ranks of a communicator, e.g. by sptMpiLoadSparseTensorBinary.
+ *
+ * Any nonzero distribution works. Every rank computes the MTTKRP of its own
+ * nonzeros with the OpenMP kernels of the workspace; the partial results are
+ * reduce-scattered so that each rank owns a contiguous block of factor rows,
+ * solves them, and contributes to the all-reduced Gram matrix. The updated
+ * rows are then all-gathered, so each rank holds the full factors.
+ * All ranks end up with the same Kruskal tensor.
+ *
+ * @param[out] ktensor the Kruskal tensor, allocated with the global shape
+ * @param[in]  spten   this rank's nonzeros, with the global ndims
+ * @param[in]  rank    the CPD rank
+ * @param[in]  niters  the maximum number of iterations
+ * @param[in]  tol     the tolerance value for convergence
+ * @param[in]  ws      a workspace from sptNewCpdWorkspace for the global shape
+ * @param[in]  comm    the communicator sharing the tensor
+ */
+int sptMpiCpdAls(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+  if(ws->nmodes != nmodes || ws->rank != rank) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "workspace does not match the tensor or rank");
+  }
+  if(ws->mttkrp->cap < sptMaxIndexArray(spten->ndims, nmodes)) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "workspace is too small for the tensor");
+  }
+  int myrank;
+  MPI_Comm_rank(comm, &myrank);
+
+  sptMatrix ** mats = spt_MpiNewFactors(spten, rank, ws, comm);
+
+  double start = MPI_Wtime();
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, ws->tk);
+  ktensor->fit = MpiCpdAlsStep(spten, rank, niters, tol, mats, ws, comm, ktensor->lambda);
+  sptSetExecContext(caller_exec);
+  if(myrank == 0) {
+    printf("[MPI  SpTns CPD-ALS]: %.9lf s\n", MPI_Wtime() - start);
+  }
+
+  mats[nmodes] = NULL;
+  ktensor->factors = mats;
+
+  return 0;
+}
+
+
+/* The point-to-point row exchange of one mode under a row ownership: rows this
+   rank touches but does not own are folded to their owners, and the rows it
+   owns are expanded back to the ranks that touch them. */
+typedef struct {
+  sptIndex nsend;         /// rows touched here and owned elsewhere
+  sptIndex nrecv;         /// rows owned here and touched elsewhere, once per toucher
+  sptIndex nown;          /// rows owned here
+  sptIndex * send_rows;   /// grouped by owner, length nsend
+  sptIndex * recv_rows;   /// grouped by toucher, length nrecv
+  sptIndex * own_rows;    /// increasing, length nown
+  int * send_counts;      /// values folded to each rank, and expanded from it
+  int * send_displs;
+  int * recv_counts;      /// values folded from each rank, and expanded to it
+  int * recv_displs;
+  sptValue * send_buf;
+  sptValue * recv_buf;
+} spt_MpiRowPlan;
+
+static int spt_MpiNewRowPlan(
+  spt_MpiRowPlan * plan,
+  sptSparseTensor const * const spten,
+  sptRowOwnership const * own,
+  sptIndex const m,
+  sptIndex const stride,
+  MPI_Comm comm)
+{
+  int myrank, nprocs;
+  MPI_Comm_rank(comm, &myrank);
+  MPI_Comm_size(comm, &nprocs);
+  sptIndex const nrows = spten->ndims[m];
+  int const * const owner = own->owner[m];
+
+  char * touched = calloc(nrows, 1);
+  plan->send_counts = calloc(nprocs, sizeof *plan->send_counts);
+  plan->send_displs = malloc(nprocs * sizeof *plan->send_displs);
+  plan->recv_counts = malloc(nprocs * sizeof *plan->recv_counts);
+  plan->recv_displs = malloc(nprocs * sizeof *plan->recv_displs);
+  spt_CheckOSError(!touched || !plan->send_counts || !plan->send_displs || !plan->recv_counts || !plan->recv_displs, "MPI  SpTns CPD-ALS");
+  for(sptNnzIndex z = 0; z < spten->nnz; ++z) {
+    touched[spten->inds[m].data[z]] = 1;
+  }
+  plan->nsend = 0;
+  plan->nown = 0;
+  for(sptIndex i = 0; i < nrows; ++i) {
+    if(owner[i] == myrank) {
+      ++plan->nown;
+    } else if(touched[i]) {
+      ++plan->send_counts[owner[i]];
+      ++plan->nsend;
+    }
+  }
+
+  /* Rows first, turned into value counts once exchanged */
+  MPI_Alltoall(plan->send_counts, 1, MPI_INT, plan->recv_counts, 1, MPI_INT, comm);
+  plan->nrecv = 0;
+  for(int p = 0; p < nprocs; ++p) {
+    plan->send_displs[p] = p == 0 ? 0 : plan->send_displs[p-1] + plan->send_counts[p-1];
+    plan->recv_displs[p] = (int) plan->nrecv;
+    plan->nrecv += (sptIndex) plan->recv_counts[p];
+  }
+  plan->send_rows = malloc(((size_t) plan->nsend + 1) * sizeof *plan->send_rows);
+  plan->recv_rows = malloc(((size_t) plan->nrecv + 1) * sizeof *plan->recv_rows);
+  plan->own_rows = malloc(((size_t) plan->nown + 1) * sizeof *plan->own_rows);
+  int * fill = malloc(nprocs * sizeof *fill);
+  spt_CheckOSError(!plan->send_rows || !plan->recv_rows || !plan->own_rows || !fill, "MPI  SpTns CPD-ALS");
+  memcpy(fill, plan->send_displs, nprocs * sizeof *fill);
+  sptIndex k = 0;
+  for(sptIndex i = 0; i < nrows; ++i) {
+    if(owner[i] == myrank) {
+      plan->own_rows[k++] = i;
+    } else if(touched[i]) {
+      plan->send_rows[fill[owner[i]]++] = i;
+    }
+  }
+  free(fill);
+  free(touched);
+  MPI_Alltoallv(plan->send_rows, plan->send_counts, plan->send_displs, PARTI_MPI_INDEX,
+    plan->recv_rows, plan->recv_counts, plan->recv_displs, PARTI_MPI_INDEX, comm);
+
+  for(int p = 0; p < nprocs; ++p) {
+    plan->send_counts[p] *= (int) stride;
+    plan->send_displs[p] *= (int) stride;
+    plan->recv_counts[p] *= (int) stride;
+    plan->recv_displs[p] *= (int) stride;
+  }
+  plan->send_buf = malloc(((size_t) plan->nsend * stride + 1) * sizeof *plan->send_buf);
+  plan->recv_buf = malloc(((size_t) plan->nrecv * stride + 1) * sizeof *plan->recv_buf);
+  spt_CheckOSError(!plan->send_buf || !plan->recv_buf, "MPI  SpTns CPD-ALS");
+  return 0;
+}
+
+static void spt_MpiFreeRowPlan(spt_MpiRowPlan * plan)
+{
+  free(plan->send_rows);
+  free(plan->recv_rows);
+  free(plan->own_rows);
+  free(plan->send_counts);
+  free(plan->send_displs);
+  free(plan->recv_counts);
+  free(plan->recv_displs);
+  free(plan->send_buf);
+  free(plan->recv_buf);
+}
+
+/* Sum the partial MTTKRP rows of M touched elsewhere into their owners' M */
+static void spt_MpiFoldRows(spt_MpiRowPlan * plan, sptMatrix * M, MPI_Comm comm)
+{
+  sptIndex const stride = M->stride;
+  for(sptIndex k = 0; k < plan->nsend; ++k) {
+    memcpy(plan->send_buf + (size_t) k * stride, M->values + (size_t) plan->send_rows[k] * stride, stride * sizeof(sptValue));
+  }
+  MPI_Alltoallv(plan->send_buf, plan->send_counts, plan->send_displs, PARTI_MPI_VALUE,
+    plan->recv_buf, plan->recv_counts, plan->recv_displs, PARTI_MPI_VALUE, comm);
+  for(sptIndex k = 0; k < plan->nrecv; ++k) {
+    sptValue * const row = M->values + (size_t) plan->recv_rows[k] * stride;
+    sptValue const * const part = plan->recv_buf + (size_t) k * stride;
+    for(sptIndex r = 0; r < stride; ++r) {
+      row[r] += part[r];
+    }
+  }
+}
+
+/* Send the owned rows of A to the ranks that touch them */
+static void spt_MpiExpandRows(spt_MpiRowPlan * plan, sptMatrix * A, MPI_Comm comm)
+{
+  sptIndex const stride = A->stride;
+  for(sptIndex k = 0; k < plan->nrecv; ++k) {
+    memcpy(plan->recv_buf + (size_t) k * stride, A->values + (size_t) plan->recv_rows[k] * stride, stride * sizeof(sptValue));
+  }
+  MPI_Alltoallv(plan->recv_buf, plan->recv_counts, plan->recv_displs, PARTI_MPI_VALUE,
+    plan->send_buf, plan->send_counts, plan->send_displs, PARTI_MPI_VALUE, comm);
+  for(sptIndex k = 0; k < plan->nsend; ++k) {
+    memcpy(A->values + (size_t) plan->send_rows[k] * stride, plan->send_buf + (size_t) k * stride, stride * sizeof(sptValue));
+  }
+}
+
+
+static double MpiCpdAlsOwnedStep(
+  sptSparseTensor const * const spten,
+  sptRowOwnership const * own,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptMatrix ** mats,  // Row-major, only the rows touched or owned here are current
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  int myrank;
+  MPI_Comm_rank(comm, &myrank);
+  double fit = 0;
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = ws->ata;
+
+  spt_MpiRowPlan * plans = malloc(nmodes * sizeof *plans);
+  spt_CheckOSError(!plans, "MPI  SpTns CPD-ALS");
+  sptIndex max_own = 0;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spt_MpiNewRowPlan(&plans[m], spten, own, m, stride, comm) == 0);
+    if(plans[m].nown > max_own) {
+      max_own = plans[m].nown;
+    }
+  }
+  sptMatrix owned_mttkrp, local;
+  sptAssert(sptNewMatrix(&owned_mttkrp, max_own + 1, rank) == 0);
+  sptAssert(sptNewMatrix(&local, max_own + 1, rank) == 0);
+
+  /* Gram matrices of the replicated initial factors need no communication. */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+
+  double spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  MPI_Allreduce(MPI_IN_PLACE, &spten_normsq, 1, MPI_DOUBLE, MPI_SUM, comm);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    double its_time = MPI_Wtime();
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      spt_MpiRowPlan * const plan = &plans[m];
+
+      /* Local MTTKRP over this rank's nonzeros, the shared rows summed at their owners */
+      tmp_mat->nrows = mats[m]->nrows;
+      sptAssert (sptOmpMTTKRPWorkspace(spten, mats, m, ws) == 0);
+      spt_MpiFoldRows(plan, tmp_mat, comm);
+
+      /* Each rank solves its own rows (ata[nmodes] is rebuilt identically everywhere). */
+      owned_mttkrp.nrows = plan->nown;
+      local.nrows = plan->nown;
+      for(sptIndex k=0; k < plan->nown; ++k) {
+        memcpy(owned_mttkrp.values + (size_t) k * stride, tmp_mat->values + (size_t) plan->own_rows[k] * stride, stride * sizeof(sptValue));
+      }
+      memcpy(local.values, owned_mttkrp.values, (size_t) plan->nown * stride * sizeof(sptValue));
+      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, &local) == 0 );
+      spt_MpiMatrixNorm(&local, lambda, it != 0, comm);
+
+      /* ata[m] = sum over ranks of local^T * local */
+      int blas_nrows = (int) plan->nown;
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        local.values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      MPI_Allreduce(MPI_IN_PLACE, ata[m]->values, (int) (rank * stride), PARTI_MPI_VALUE, MPI_SUM, comm);
+
+      /* Only the ranks touching a row need it for the next modes' MTTKRP. */
+      for(sptIndex k=0; k < plan->nown; ++k) {
+        memcpy(mats[m]->values + (size_t) plan->own_rows[k] * stride, local.values + (size_t) k * stride, stride * sizeof(sptValue));
+      }
+      spt_MpiExpandRows(plan, mats[m], comm);
+    } // Loop nmodes
+
+    /* The inner product only needs the owned rows of the last mode. */
+    double inner = 0;
+    for(sptIndex k=0; k < local.nrows; ++k) {
+      sptValue const * const a = local.values + (size_t) k * stride;
+      sptValue const * const b = owned_mttkrp.values + (size_t) k * stride;
+      for(sptIndex r=0; r < rank; ++r) {
+        inner += lambda[r] * a[r] * b[r];
+      }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &inner, 1, MPI_DOUBLE, MPI_SUM, comm);
+
+    double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, lambda, ata);
+    double residual = spten_normsq + norm_mats - 2 * inner;
+    if (residual > 0.0) {
+      residual = sqrt(residual);
+    }
+    fit = 1 - (residual / sqrt(spten_normsq));
+
+    its_time = MPI_Wtime() - its_time;
+    if(myrank == 0) {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, its_time, fit, fit - oldfit);
+    }
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+
+  } // Loop niters
+
+  /* Replicate the factors: every row has one owner, so a sum of the owned rows restores them */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    int const * const owner = own->owner[m];
+    for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+      if(owner[i] != myrank) {
+        memset(mats[m]->values + (size_t) i * stride, 0, stride * sizeof(sptValue));
+      }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, mats[m]->values, (int) (mats[m]->nrows * stride), PARTI_MPI_VALUE, MPI_SUM, comm);
+  }
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  sptFreeMatrix(&local);
+  sptFreeMatrix(&owned_mttkrp);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    spt_MpiFreeRowPlan(&plans[m]);
+  }
+  free(plans);
+
+  return fit;
+}
+
+
+/**
+ * Distributed-memory CP-ALS with factor rows owned as `own` says, e.g. from
+ * sptHypergraphPartition and sptLoadRowOwnership, and communicated point to
+ * point. Every rank computes the MTTKRP of its own nonzeros; each row it
+ * touches but does not own is sent to the owner, which sums, solves and
+ * sends the updated row back to the ranks touching it. A sweep moves as many
+ * rows as the partition cuts, see sptRowOwnershipVolume, instead of every
+ * row of every factor as in sptMpiCpdAls.
+ * All ranks end up with the same Kruskal tensor.
+ *
+ * @param[out] ktensor the Kruskal tensor, allocated with the global shape
+ * @param[in]  spten   this rank's nonzeros, with the global ndims
+ * @param[in]  own     the row ownership, with one part per rank of comm
+ * @param[in]  rank    the CPD rank
+ * @param[in]  niters  the maximum number of iterations
+ * @param[in]  tol     the tolerance value for convergence
+ * @param[in]  ws      a workspace from sptNewCpdWorkspace for the global shape
+ * @param[in]  comm    the communicator sharing the tensor
+ */
+int sptMpiCpdAlsOwned(
+  sptSparseTensor const * const spten,
+  sptRowOwnership const * own,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  MPI_Comm comm,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+  if(ws->nmodes != nmodes || ws->rank != rank) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "workspace does not match the tensor or rank");
+  }
+  if(ws->mttkrp->cap < sptMaxIndexArray(spten->ndims, nmodes)) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "workspace is too small for the tensor");
+  }
+  int myrank, nprocs;
+  MPI_Comm_rank(comm, &myrank);
+  MPI_Comm_size(comm, &nprocs);
+  if(own->nparts != nprocs || own->nmodes != nmodes) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "ownership does not match the communicator or tensor");
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(own->ndims[m] != spten->ndims[m]) {
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns CPD-ALS", "ownership does not match the tensor");
+    }
+  }
+
+  sptMatrix ** mats = spt_MpiNewFactors(spten, rank, ws, comm);
+
+  double start = MPI_Wtime();
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, ws->tk);
+  ktensor->fit = MpiCpdAlsOwnedStep(spten, own, rank, niters, tol, mats, ws, comm, ktensor->lambda);
+  sptSetExecContext(caller_exec);
+  if(myrank == 0) {
+    printf("[MPI  SpTns CPD-ALS]: %.9lf s\n", MPI_Wtime() - start);
+  }
+
+  mats[nmodes] = NULL;
+  ktensor->factors = mats;
+
+  return 0;
+}
+
+#endif
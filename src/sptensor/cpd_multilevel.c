@@ -0,0 +1,227 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Multilevel CP-ALS.
+ *
+ * A coarser tensor merges index pairs 2i and 2i+1 of every mode long enough,
+ * adding up the nonzeros that meet, and compacts away the coarse indices no
+ * nonzero uses. Its CPD is cheap and close to the fine one wherever
+ * neighbouring indices behave alike, so the levels are solved coarsest first,
+ * each factor row of a finer level starting as the row of its coarse parent,
+ * and the full tensor only refines.
+ */
+
+/* Coarsening stops at this many nonzeros */
+#define SPT_MULTILEVEL_MIN_NNZ 4096
+/* A mode is halved only while it keeps this many indices, and at least the rank */
+#define SPT_MULTILEVEL_MIN_DIM 16
+
+typedef struct {
+    sptSparseTensor X;
+    sptIndex ** parent;   /// parent[m][i], the coarse index of index i of the finer level, ndims[m] if unused
+} spt_MultilevelLevel;
+
+
+/* Halve the long modes of X into lv, or return 1 when no mode is long enough */
+static int spt_MultilevelCoarsen(spt_MultilevelLevel * lv, sptSparseTensor const * X, sptIndex const rank, int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const min_dim = 2 * (rank > SPT_MULTILEVEL_MIN_DIM ? rank : SPT_MULTILEVEL_MIN_DIM);
+    int any = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        any |= X->ndims[m] >= min_dim;
+    }
+    if(!any) {
+        return 1;
+    }
+
+    int result = sptCopySparseTensor(&lv->X, X, tk);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+    sptSparseTensorDropCache(&lv->X);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(X->ndims[m] >= min_dim) {
+            sptIndex * const inds = lv->X.inds[m].data;
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptNnzIndex z = 0; z < lv->X.nnz; ++z) {
+                inds[z] >>= 1;
+            }
+            lv->X.ndims[m] = (X->ndims[m] + 1) / 2;
+        }
+    }
+    result = sptSparseTensorCoalesce(&lv->X, SPT_COALESCE_SUM, tk);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+
+    sptIndex ** map_inds = malloc(nmodes * sizeof *map_inds);
+    lv->parent = malloc(nmodes * sizeof *lv->parent);
+    spt_CheckOSError(!map_inds || !lv->parent, "CPU  SpTns CPD-ALS Multilevel");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        map_inds[m] = malloc(lv->X.ndims[m] * sizeof *map_inds[m]);
+        lv->parent[m] = malloc(X->ndims[m] * sizeof *lv->parent[m]);
+        spt_CheckOSError(!map_inds[m] || !lv->parent[m], "CPU  SpTns CPD-ALS Multilevel");
+    }
+    result = sptSparseTensorCompactIndices(&lv->X, map_inds, tk);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        int const halved = X->ndims[m] >= min_dim;
+        for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+            sptIndex const p = map_inds[m][halved ? i >> 1 : i];
+            lv->parent[m][i] = p < lv->X.ndims[m] ? p : lv->X.ndims[m];
+        }
+        free(map_inds[m]);
+    }
+    free(map_inds);
+    return 0;
+}
+
+static void spt_MultilevelFreeLevel(spt_MultilevelLevel * lv, sptIndex const nmodes)
+{
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        free(lv->parent[m]);
+    }
+    free(lv->parent);
+    sptFreeSparseTensor(&lv->X);
+}
+
+/* Release the factors of a Kruskal tensor left by a driver, and the tensor */
+static void spt_MultilevelFreeKruskal(sptKruskalTensor * kt)
+{
+    for(sptIndex m = 0; m < kt->nmodes; ++m) {
+        sptFreeMatrix(kt->factors[m]);
+        free(kt->factors[m]);
+    }
+    free(kt->factors);
+    kt->factors = NULL;
+    sptFreeKruskalTensor(kt);
+}
+
+/*
+ * The initial factors of the finer level, each row that of its parent in the
+ * coarse solution kt, with lambda folded into the first mode. Rows without a
+ * parent start at zero.
+ */
+static int spt_MultilevelProlong(sptMatrix ** fine, sptKruskalTensor const * kt, sptIndex ** parent, sptIndex const ndims[])
+{
+    sptIndex const rank = kt->rank;
+    for(sptIndex m = 0; m < kt->nmodes; ++m) {
+        sptMatrix const * C = kt->factors[m];
+        fine[m] = malloc(sizeof *fine[m]);
+        spt_CheckOSError(!fine[m], "CPU  SpTns CPD-ALS Multilevel");
+        int result = sptNewMatrix(fine[m], ndims[m], rank);
+        spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            sptValue * const row = fine[m]->values + (size_t) i * fine[m]->stride;
+            sptIndex const p = parent[m][i];
+            for(sptIndex r = 0; r < rank; ++r) {
+                row[r] = p < C->nrows ? C->values[(size_t) p * C->stride + r] * (m == 0 ? kt->lambda[r] : 1) : 0;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Multilevel OpenMP CP-ALS for COO sparse tensors. The tensor is coarsened
+ * by merging index pairs in each mode and compacting the indices left
+ * unused, until it is small or nlevels coarse levels are built. The
+ * coarsest is decomposed from the start chosen by sptSetCpdInit, and every
+ * finer level starts from the factors of the one below, each row from its
+ * merged parent, so the expensive iterations on the full tensor only refine.
+ * Given a Kruskal tensor that already holds factors, such as a loaded
+ * checkpoint, the coarse levels are skipped.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  nlevels the maximum number of coarse levels, 0 for no limit
+ * @param[in]  coarse_iters the maximum number of iterations on each coarse level
+ * @param[in]  niters the maximum number of iterations on the full tensor
+ * @param[in]  tol the tolerance value for convergence, on every level
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdAlsMultilevel(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const nlevels,
+  sptIndex const coarse_iters,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  if(ktensor->factors != NULL || nmodes < 2) {
+    return sptOmpCpdAls(spten, rank, niters, tol, tk, 0, ktensor);
+  }
+
+  /* Build the levels, finest first */
+  sptIndex nbuilt = 0, cap = 4;
+  spt_MultilevelLevel * levels = malloc(cap * sizeof *levels);
+  spt_CheckOSError(!levels, "CPU  SpTns CPD-ALS Multilevel");
+  sptSparseTensor const * X = spten;
+  while((nlevels == 0 || nbuilt < nlevels) && X->nnz >= SPT_MULTILEVEL_MIN_NNZ) {
+    if(nbuilt == cap) {
+      cap *= 2;
+      levels = realloc(levels, cap * sizeof *levels);
+      spt_CheckOSError(!levels, "CPU  SpTns CPD-ALS Multilevel");
+      X = &levels[nbuilt-1].X;
+    }
+    if(spt_MultilevelCoarsen(&levels[nbuilt], X, rank, tk) != 0) {
+      break;
+    }
+    X = &levels[nbuilt].X;
+    ++nbuilt;
+  }
+
+  /* Solve coarsest first; level l-1 starts from level l */
+  sptKruskalTensor kt;
+  int result;
+  for(sptIndex l = nbuilt; l > 0; --l) {
+    sptSparseTensor const * const Xl = &levels[l-1].X;
+    sptKruskalTensor next;
+    sptNewKruskalTensor(&next, nmodes, Xl->ndims, rank);
+    if(l < nbuilt) {
+      next.factors = malloc(nmodes * sizeof *next.factors);
+      spt_CheckOSError(!next.factors, "CPU  SpTns CPD-ALS Multilevel");
+      result = spt_MultilevelProlong(next.factors, &kt, levels[l].parent, Xl->ndims);
+      spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+      spt_MultilevelFreeKruskal(&kt);
+    }
+    result = sptOmpCpdAls(Xl, rank, coarse_iters, tol, tk, 0, &next);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+    kt = next;
+  }
+  if(nbuilt > 0) {
+    ktensor->factors = malloc(nmodes * sizeof *ktensor->factors);
+    spt_CheckOSError(!ktensor->factors, "CPU  SpTns CPD-ALS Multilevel");
+    result = spt_MultilevelProlong(ktensor->factors, &kt, levels[0].parent, spten->ndims);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Multilevel", NULL);
+    spt_MultilevelFreeKruskal(&kt);
+  }
+  for(sptIndex l = 0; l < nbuilt; ++l) {
+    spt_MultilevelFreeLevel(&levels[l], nmodes);
+  }
+  free(levels);
+
+  return sptOmpCpdAls(spten, rank, niters, tol, tk, 0, ktensor);
+}
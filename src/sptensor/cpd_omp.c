@@ -20,12 +20,6 @@
 #include <ParTI.h>
 #include <assert.h>
 #include <math.h>
-#ifdef PARTI_USE_MAGMA
-  #include "magma_v2.h"
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
 #include "sptensor.h"
 
 
@@ -34,18 +28,16 @@ double OmpCpdAlsStep(
   sptIndex const rank,
   sptIndex const niters,
   double const tol,
-  const int tk,
-  const int use_reduce,
   sptMatrix ** mats,  // Row-major
-  sptMatrix ** copy_mats, 
+  sptCpdWorkspace * ws,
   sptValue * const lambda)
 {
   sptIndex const nmodes = spten->nmodes;
   sptIndex const stride = mats[0]->stride;
+  int const tk = ws->tk;
   double fit = 0;
-#ifdef PARTI_USE_OPENMP  
-  omp_set_num_threads(tk);
-#endif
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
 
   for(sptIndex m=0; m < nmodes; ++m) {
     sptAssert(spten->ndims[m] == mats[m]->nrows);
@@ -53,115 +45,176 @@ double OmpCpdAlsStep(
     // assert(mats[m]->stride == rank);  // for correct column-major magma functions
   }
 
-  sptValue alpha = 1.0, beta = 0.0;
-  char notrans = 'N';
-  char trans = 'T';
-  char uplo = 'L';
-  int blas_rank = (int) rank;
-  int blas_stride = (int) stride;
-
   sptMatrix * tmp_mat = mats[nmodes];
-  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
+  sptMatrix ** ata = ws->ata; // symmetric matrices, but in column-major
   for(sptIndex m=0; m < nmodes+1; ++m) {
-    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
-    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
     sptAssert(mats[m]->stride == ata[m]->stride);
   }
 
-  /* Compute all "ata"s */
+  /* Resume from the configured checkpoint when it holds this decomposition */
+  sptValue ** ckpt_vals = (sptValue **)malloc(nmodes * sizeof(*ckpt_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ckpt_vals[m] = mats[m]->values;
+  }
+  spt_CpdFactors const ckpt = { nmodes, rank, stride, spten->ndims, ckpt_vals, lambda };
+  spt_CpdCheckpointKey const ckpt_key = { spt_CpdCheckpointEnabled() ? sptSparseTensorFingerprint(spten) : 0, tol, niters };
+  sptIndex start_it = 0;
+  int converged = 0;
+  double oldfit = 0;
+  sptAssert(spt_CpdCheckpointRestore(&ckpt, &ckpt_key, &start_it, &oldfit, &converged) == 0);
+  fit = oldfit;
+
+  /* Extrapolated steps, when enabled, are tried on the factors ckpt points at */
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  spt_CpdLineSearch ls;
+  sptAssert(spt_NewCpdLineSearch(&ls, &ckpt) == 0);
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, ata[0]->stride) == 0);
+  spt_CpdGuard guard;
+  sptAssert(spt_NewCpdGuard(&guard, &ckpt) == 0);
+
+  /* Compute all "ata"s, row-parallel, as upper triangular matrices */
   for(sptIndex m=0; m < nmodes; ++m) {
-    /* ata[m] = mats[m]^T * mats[m]), actually do A * A' due to row-major mats, and output an upper triangular matrix. */
-    int blas_nrows = (int)(mats[m]->nrows);
-    ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
-      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
   }
 
 
-  double oldfit = 0;
-  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  /* The tensor values are fixed during CPD, so its norm is computed only once. */
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  if(ws->dimtree != NULL) {
+    for(sptIndex m=0; m < nmodes; ++m) {
+      sptMttkrpDimTreeInvalidate(ws->dimtree, m);
+    }
+  }
 
 
-  for(sptIndex it=0; it < niters; ++it) {
+  for(sptIndex it=start_it; it < niters && !converged; ++it) {
     sptTimer timer;
     sptNewTimer(&timer, 0);
     sptStartTimer(timer);
+    double const trace_it = sptTraceBegin();
 
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
     for(sptIndex m=0; m < nmodes; ++m) {
       tmp_mat->nrows = mats[m]->nrows;
 
-      /* Factor Matrices order */
-      mats_order[0] = m;
-      for(sptIndex i=1; i<nmodes; ++i)
-          mats_order[i] = (m+i) % nmodes;
-
       // mats[nmodes]: row-major
-      if(use_reduce == 1) {
-        sptAssert (sptOmpMTTKRP_Reduce(spten, mats, copy_mats, mats_order, m, tk) == 0);
+      double trace_phase = sptTraceBegin();
+      if(ws->dimtree != NULL) {
+        sptAssert (sptOmpMTTKRPDimTree(ws->dimtree, spten, mats, m, tk) == 0);
       } else {
-        sptAssert (sptOmpMTTKRP(spten, mats, mats_order, m, tk) == 0);
+        sptAssert (sptOmpMTTKRPWorkspace(spten, mats, m, ws) == 0);
       }
-
-      // Row-major
-#ifdef PARTI_USE_OPENMP
-    #pragma omp parallel for num_threads(tk)
-#endif
-      for(sptIndex i=0; i<mats[m]->nrows * stride; ++i)
-        mats[m]->values[i] = tmp_mat->values[i];        
-
-      /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
-      sptAssert ( sptMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
-
-      /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
-      if (it == 0 ) {
-        sptMatrix2Norm(mats[m], lambda);
-      } else {
-        sptMatrixMaxNorm(mats[m], lambda);
+      sptTraceEnd("CPD MTTKRP", m, trace_phase);
+
+      /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) into mats[m], normalize it into lambda
+         and set ata[m] = mats[m]^T * mats[m], in one pass over the rows.
+         Use different norms to avoid precision explosion. */
+      trace_phase = sptTraceBegin();
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptOmpMatrixSolveFormedNormalsGram(m, nmodes, ata, tmp_mat, mats[m], lambda, it != 0, tk) == 0 );
+      sptAssert ( sptGramHadamardAdvance(&gh, m, ata_vals) == 0 );
+      sptTraceEnd("CPD solve, normalize and Gram", m, trace_phase);
+
+      if(ws->dimtree != NULL) {
+        sptMttkrpDimTreeInvalidate(ws->dimtree, m);
       }
-
-      /* ata[m] = mats[m]^T * mats[m]) */
-      int blas_nrows = (int)(mats[m]->nrows);
-      ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
-        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
-
     } // Loop nmodes
 
     // PrintDenseValueVector(lambda, rank, "lambda", "debug.txt");
-    fit = sptKruskalTensorFit(spten, lambda, mats, ata);
+    /* Evaluate the fit before stopping at the deadline, so it can be compared with the best */
+    int const eval_fit = (it + 1) % ws->fit_every == 0 || it + 1 == niters || spt_CpdGuardDue(&guard);
+    if(eval_fit) {
+      double const trace_fit = sptTraceBegin();
+      double const norm_mats = sptGramHadamardKruskalNorm(&gh, lambda, ata_vals);
+      double const inner = sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats);
+      fit = sptKruskalTensorFitFromNorms(spten_normsq, norm_mats, inner);
+
+      /* Try an extrapolated step; its fit costs one MTTKRP of the last mode */
+      if(spt_CpdLineSearchPropose(&ls, &ckpt, ata_vals, it)) {
+        sptIndex const last = nmodes - 1;
+        tmp_mat->nrows = mats[last]->nrows;
+        if(ws->dimtree != NULL) {
+          for(sptIndex m=0; m < nmodes; ++m) {
+            sptMttkrpDimTreeInvalidate(ws->dimtree, m);
+          }
+          sptAssert (sptOmpMTTKRPDimTree(ws->dimtree, spten, mats, last, tk) == 0);
+        } else {
+          sptAssert (sptOmpMTTKRPWorkspace(spten, mats, last, ws) == 0);
+        }
+        double const trial_fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+        fit = spt_CpdLineSearchResolve(&ls, &ckpt, ata_vals, fit, trial_fit);
+        if(ws->dimtree != NULL) {
+          for(sptIndex m=0; m < nmodes; ++m) {
+            sptMttkrpDimTreeInvalidate(ws->dimtree, m);
+          }
+        }
+      }
+      sptTraceEnd("CPD fit", -1, trace_fit);
+    }
+    sptTraceEnd("CPD iteration", it, trace_it);
 
     sptStopTimer(timer);
     double its_time = sptElapsedTime(timer);
     sptFreeTimer(timer);
 
-    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
-        it+1, its_time, fit, fit - oldfit);
-    if(it > 0 && fabs(fit - oldfit) < tol) {
+    int const stop = spt_CpdGuardRecord(&guard, &ckpt, it, its_time, fit, eval_fit);
+    if(!eval_fit) {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s )\n", it+1, its_time);
+    } else {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, its_time, fit, fit - oldfit);
+      if(it + 1 > ws->fit_every && fabs(fit - oldfit) < tol) {
+        sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 1) == 0);
+        break;
+      }
+      oldfit = fit;
+    }
+    if(stop) {
+      fit = spt_CpdGuardRestore(&guard, &ckpt, fit, eval_fit);
+      printf("  stopped %s, best fit = %0.5f\n", guard.stopped == 1 ? "ahead of the deadline" : "by the progress callback", fit);
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 0) == 0);
       break;
     }
-    oldfit = fit;
+    if(!eval_fit) {
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 0, 0) == 0);
+      continue;
+    }
+    sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, it+1 == niters, 0) == 0);
 
   } // Loop niters
 
+  free(ckpt_vals);
+  free(ata_vals);
+  sptFreeGramHadamard(&gh);
+  spt_FreeCpdLineSearch(&ls);
+  spt_FreeCpdGuard(&guard);
   GetFinalLambda(rank, nmodes, mats, lambda);
 
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    sptFreeMatrix(ata[m]);
-  }
-  free(ata);
-  free(mats_order);
-
+  sptSetExecContext(caller_exec);
   return fit;
 }
 
 
 /**
  * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for COO formatted sparse tensors.
- * @param[out] ktensor the Kruskal tensor
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
  * @param[in]  spten the COO representation of a sparse tensor
  * @param[in]  rank the CPD rank
  * @param[in]  niters the maximum number of iterations
  * @param[in]  tol the tolerance value for convergence
  * @param[in]  tk the number of threads
- * @param[in]  use_reduce =1: use privatization; =0: use OpenMP atomic.
+ * @param[in]  use_reduce =1: use privatization, per mode in full or of the rows with the most
+ *                        nonzeros within PARTI_MTTKRP_PRIVATE_BYTES; =0: use OpenMP atomic.
+ *
+ * Modes read copies of the tensor sorted for them as far as the
+ * sptSetCpdLayoutBudget setting allows, see sptNewCpdLayouts.
+ *
+ * Tensors of at most PARTI_CPD_SMALL_NNZ nonzeros at rank PARTI_CPD_SMALL_RANK
+ * or less run on the calling thread without timing output, see spt_CpdAlsSmall.
  */
 int sptOmpCpdAls(
   sptSparseTensor const * const spten,
@@ -171,58 +224,82 @@ int sptOmpCpdAls(
   const int tk,
   const int use_reduce,
   sptKruskalTensor * ktensor)
+{
+  if(spt_CpdIsSmall(spten, rank)) {
+    return spt_CpdAlsSmall(spten, rank, niters, tol, ktensor);
+  }
+  sptCpdWorkspace ws;
+  /* Full per-thread copies of every mode would cost tk * max_dim * rank, pick per mode instead */
+  sptAssert(sptNewCpdWorkspace(&ws, spten->nmodes, spten->ndims, rank, tk, use_reduce == 1 ? 0 : use_reduce) == 0);
+  if(use_reduce == 1) {
+    sptAssert(sptCpdWorkspaceUseHotRows(&ws, spten, 0) == 0);
+  }
+  if(spt_CpdLayoutBudget() != 0) {
+    sptAssert(sptCpdWorkspaceUseLayouts(&ws, spten, 0) == 0);
+  }
+  int result = sptOmpCpdAlsWorkspace(spten, rank, niters, tol, &ws, ktensor);
+  sptFreeCpdWorkspace(&ws);
+  return result;
+}
+
+
+/**
+ * OpenMP Parallel CP-ALS reusing the scratch of a workspace from sptNewCpdWorkspace.
+ * The workspace must match the tensor order and rank, and fit the largest mode;
+ * it can be reused across calls. Only the factor matrices are allocated per call.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  ws the workspace, which also fixes the thread count and update strategy
+ */
+int sptOmpCpdAlsWorkspace(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptCpdWorkspace * ws,
+  sptKruskalTensor * ktensor)
 {
   sptIndex nmodes = spten->nmodes;
+  if(ws->nmodes != nmodes || ws->rank != rank) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CPD-ALS", "workspace does not match the tensor or rank");
+  }
+  if(ws->mttkrp->cap < sptMaxIndexArray(spten->ndims, nmodes)) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CPD-ALS", "workspace is too small for the tensor");
+  }
 #ifdef PARTI_USE_MAGMA
   magma_init();
 #endif
 
-  /* Initialize factor matrices */
-  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  /* Initialize factor matrices, mats[nmodes] is the workspace MTTKRP output */
   sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
-  }
-  for(sptIndex m=0; m < nmodes; ++m) {
-    sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
-    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
-  }
-  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
-  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
-
-  sptMatrix ** copy_mats;
-  if(use_reduce == 1) {
-    copy_mats = (sptMatrix **)malloc(tk * sizeof(*copy_mats));
-    for(int t=0; t<tk; ++t) {
-      copy_mats[t] = (sptMatrix *)malloc(sizeof(sptMatrix));
-      sptAssert(sptNewMatrix(copy_mats[t], max_dim, rank) == 0);
-      sptAssert(sptConstantMatrix(copy_mats[t], 0) == 0);
-    }
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-ALS");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  if(!warm) {
+    sptAssert(spt_CpdInitMatrices(spten, rank, mats, ws->tk) == 0);
   }
+  mats[nmodes] = ws->mttkrp;
+  mats[nmodes]->nrows = mats[nmodes]->cap;
 
   sptTimer timer;
   sptNewTimer(&timer, 0);
   sptStartTimer(timer);
 
-  ktensor->fit = OmpCpdAlsStep(spten, rank, niters, tol, tk, use_reduce, mats, copy_mats, ktensor->lambda);
+  ktensor->fit = OmpCpdAlsStep(spten, rank, niters, tol, mats, ws, ktensor->lambda);
 
   sptStopTimer(timer);
   sptPrintElapsedTime(timer, "CPU  SpTns CPD-ALS");
   sptFreeTimer(timer);
 
+  mats[nmodes] = NULL;
   ktensor->factors = mats;
 
 #ifdef PARTI_USE_MAGMA
   magma_finalize();
 #endif
-  sptFreeMatrix(mats[nmodes]);
-  if(use_reduce == 1) {
-    for(int t=0; t<tk; ++t) {
-      sptFreeMatrix(copy_mats[t]);
-      free(copy_mats[t]);
-    }
-    free(copy_mats);
-  }
 
   return 0;
 }
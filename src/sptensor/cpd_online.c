@@ -0,0 +1,395 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/*
+ * Online CP-ALS in the style of OnlineCP (Zhou et al., KDD 2016). For every
+ * non-time mode n the normal equations A_n Q_n = P_n of the whole history are
+ * kept, with P_n the MTTKRP and Q_n the Hadamard product of the other Grams.
+ * A new slice only adds its own MTTKRP and Gram terms, so an update costs time
+ * proportional to the slice, never to the history.
+ */
+
+/* g = a^T a, in the triangle layout CP-ALS uses */
+static void spt_OnlineGram(sptMatrix const * a, sptMatrix * g)
+{
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) a->ncols;
+  int blas_stride = (int) a->stride;
+  int blas_nrows = (int) a->nrows;
+  spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+    a->values, &blas_stride, &beta, g->values, &blas_stride);
+}
+
+/* Solve x q = rhs in place for a full symmetric q, factorizing a copy in scratch */
+static int spt_OnlineSolve(sptMatrix const * q, sptMatrix * rhs, sptMatrix * scratch)
+{
+  int rank = (int) q->ncols;
+  int stride = (int) q->stride;
+  int nrhs = (int) rhs->nrows;
+  int info;
+  char uplo = 'L';
+
+  memcpy(scratch->values, q->values, q->nrows * q->stride * sizeof (sptValue));
+  spt_potrf_(&uplo, &rank, scratch->values, &stride, &info);
+  if(info == 0) {
+    spt_potrs_(&uplo, &rank, &nrhs, scratch->values, &stride, rhs->values, &stride, &info);
+  } else {
+    int * ipiv = malloc(rank * sizeof *ipiv);
+    spt_CheckOSError(!ipiv, "CPU  SpTns Online CPD");
+    memcpy(scratch->values, q->values, q->nrows * q->stride * sizeof (sptValue));
+    spt_gesv_(&rank, &nrhs, scratch->values, &stride, ipiv, rhs->values, &stride, &info);
+    free(ipiv);
+  }
+  if(info != 0) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns Online CPD", "singular normal equations");
+  }
+  return 0;
+}
+
+/* Hadamard product of the Grams of all modes but `mode` into ata[nmodes], the time Gram taken from `time_ata` */
+static void spt_OnlineHadamard(sptOnlineCpd * state, sptIndex const mode, sptMatrix * time_ata)
+{
+  sptMatrix * const saved = state->ata[state->time_mode];
+  state->ata[state->time_mode] = time_ata;
+  sptMatrixDotMulSeqTriangle(mode, state->nmodes, state->ata);
+  state->ata[state->time_mode] = saved;
+}
+
+static int spt_OnlineNewMatrix(sptMatrix ** mtx, sptIndex const nrows, sptIndex const ncols)
+{
+  *mtx = malloc(sizeof **mtx);
+  spt_CheckOSError(!*mtx, "CPU  SpTns Online CPD");
+  int result = sptNewMatrix(*mtx, nrows, ncols);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  return sptConstantMatrix(*mtx, 0);
+}
+
+static void spt_OnlineFreeMatrix(sptMatrix * mtx)
+{
+  if(mtx != NULL) {
+    sptFreeMatrix(mtx);
+    free(mtx);
+  }
+}
+
+/* <slice, [[mats]]> with unit weights, mats[time_mode] holding the slice rows */
+static double spt_OnlineInnerProduct(sptSparseTensor const * const slice, sptMatrix ** mats, int const tk)
+{
+  sptIndex const nmodes = slice->nmodes;
+  sptIndex const rank = mats[0]->ncols;
+  sptIndex const stride = mats[0]->stride;
+  double inner = 0;
+  (void) tk;
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for reduction(+:inner) num_threads(tk)
+#endif
+  for(sptNnzIndex x = 0; x < slice->nnz; ++x) {
+    double sum = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+      double prod = slice->values.data[x];
+      for(sptIndex m = 0; m < nmodes; ++m) {
+        prod *= mats[m]->values[slice->inds[m].data[x] * stride + r];
+      }
+      sum += prod;
+    }
+    inner += sum;
+  }
+  return inner;
+}
+
+
+/**
+ * Start online CP updates of a Kruskal tensor, e.g. one from sptOmpCpdAls on
+ * the history so far. lambda is folded into the time-mode factor and set to
+ * one, so the factors keep their scale across updates.
+ *
+ * The accumulated MTTKRP of each non-time mode is seeded with A_n Q_n, which
+ * is what an ALS fixed point on the history would have produced, so the
+ * history tensor itself is not needed.
+ *
+ * @param[out]    state     the online state
+ * @param[in,out] ktensor   the decomposition to keep updating
+ * @param[in]     time_mode the mode new slices extend
+ * @param[in]     forget    weight of the history at each update, 1 keeps all of it
+ */
+int sptNewOnlineCpd(
+  sptOnlineCpd * state,
+  sptKruskalTensor * ktensor,
+  sptIndex const time_mode,
+  double const forget)
+{
+  sptIndex const nmodes = ktensor->nmodes;
+  sptIndex const rank = ktensor->rank;
+  if(time_mode >= nmodes || nmodes < 2) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Online CPD", "time mode out of range");
+  }
+  if(!(forget > 0 && forget <= 1)) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns Online CPD", "forget must be in (0, 1]");
+  }
+  int result;
+
+  state->nmodes = nmodes;
+  state->rank = rank;
+  state->time_mode = time_mode;
+  state->forget = forget;
+
+  /* Fold lambda into the time factor */
+  sptMatrix * const time_mat = ktensor->factors[time_mode];
+  for(sptIndex i = 0; i < time_mat->nrows; ++i) {
+    for(sptIndex r = 0; r < rank; ++r) {
+      time_mat->values[i * time_mat->stride + r] *= ktensor->lambda[r];
+    }
+  }
+  for(sptIndex r = 0; r < rank; ++r) {
+    ktensor->lambda[r] = 1;
+  }
+
+  state->ata = malloc((nmodes+1) * sizeof *state->ata);
+  state->p = calloc(nmodes, sizeof *state->p);
+  state->q = calloc(nmodes, sizeof *state->q);
+  spt_CheckOSError(!state->ata || !state->p || !state->q, "CPU  SpTns Online CPD");
+  for(sptIndex m = 0; m < nmodes+1; ++m) {
+    result = spt_OnlineNewMatrix(&state->ata[m], rank, rank);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  }
+  result = spt_OnlineNewMatrix(&state->slice_ata, rank, rank);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    spt_OnlineGram(ktensor->factors[m], state->ata[m]);
+  }
+
+  sptIndex max_dim = 1;
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    if(m == time_mode) {
+      continue;
+    }
+    if(ktensor->ndims[m] > max_dim) {
+      max_dim = ktensor->ndims[m];
+    }
+    result = spt_OnlineNewMatrix(&state->q[m], rank, rank);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+    sptMatrixDotMulSeqTriangle(m, nmodes, state->ata);
+    memcpy(state->q[m]->values, state->ata[nmodes]->values, rank * state->ata[nmodes]->stride * sizeof (sptValue));
+
+    /* p = a q */
+    sptMatrix const * const a = ktensor->factors[m];
+    sptMatrix const * const q = state->q[m];
+    result = spt_OnlineNewMatrix(&state->p[m], a->nrows, rank);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+    sptValue * const pvals = state->p[m]->values;
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel for
+#endif
+    for(sptIndex i = 0; i < a->nrows; ++i) {
+      for(sptIndex k = 0; k < rank; ++k) {
+        sptValue const aik = a->values[i * a->stride + k];
+        for(sptIndex r = 0; r < rank; ++r) {
+          pvals[i * a->stride + r] += aik * q->values[k * q->stride + r];
+        }
+      }
+    }
+  }
+  result = spt_OnlineNewMatrix(&state->mttkrp, max_dim, rank);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  result = spt_OnlineNewMatrix(&state->rows, 1, rank);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+
+  return 0;
+}
+
+
+/**
+ * Append a slice to an online CP decomposition and update all factors.
+ * The slice has the shape of the decomposed tensor except along the time
+ * mode, where its indices count from 0 within the slice; its time rows are
+ * appended after the existing ones. ktensor->fit is set to the fit on the
+ * slice.
+ *
+ * @param[in,out] state   the state from sptNewOnlineCpd
+ * @param[in]     slice   the new time slice(s)
+ * @param[in]     tk      the number of threads
+ * @param[in,out] ktensor the decomposition given to sptNewOnlineCpd
+ */
+int sptOnlineCpdUpdate(
+  sptOnlineCpd * state,
+  sptSparseTensor const * const slice,
+  int const tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = state->nmodes;
+  sptIndex const rank = state->rank;
+  sptIndex const time_mode = state->time_mode;
+  int result;
+
+  if(slice->nmodes != nmodes || ktensor->nmodes != nmodes || ktensor->rank != rank) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Online CPD", "slice does not match the decomposition");
+  }
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    if(m != time_mode && slice->ndims[m] != ktensor->ndims[m]) {
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Online CPD", "slice does not match the decomposition");
+    }
+  }
+  sptIndex const nrows = slice->ndims[time_mode];
+  if(nrows == 0) {
+    return 0;
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  if(state->mttkrp->cap < nrows) {
+    result = sptResizeMatrix(state->mttkrp, nrows);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  }
+  if(state->rows->cap < nrows) {
+    result = sptResizeMatrix(state->rows, nrows);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  }
+  state->rows->nrows = nrows;
+
+  sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+  sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+  spt_CheckOSError(!mats || !mats_order, "CPU  SpTns Online CPD");
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    mats[m] = ktensor->factors[m];
+  }
+  mats[time_mode] = state->rows;
+  mats[nmodes] = state->mttkrp;
+  sptMatrix * const tmp_mat = state->mttkrp;
+  sptIndex const stride = tmp_mat->stride;
+
+  /* New time rows: least squares against the current non-time factors */
+  mats_order[0] = time_mode;
+  for(sptIndex i = 1; i < nmodes; ++i) {
+    mats_order[i] = (time_mode + i) % nmodes;
+  }
+  tmp_mat->nrows = nrows;
+  result = sptOmpMTTKRP(slice, mats, mats_order, time_mode, tk);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  memcpy(state->rows->values, tmp_mat->values, nrows * stride * sizeof (sptValue));
+  result = sptMatrixSolveNormals(time_mode, nmodes, state->ata, state->rows);
+  spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  spt_OnlineGram(state->rows, state->slice_ata);
+
+  /* Each non-time mode: add the slice's terms to its normal equations and solve */
+  for(sptIndex n = 0; n < nmodes; ++n) {
+    if(n == time_mode) {
+      continue;
+    }
+    mats_order[0] = n;
+    for(sptIndex i = 1; i < nmodes; ++i) {
+      mats_order[i] = (n + i) % nmodes;
+    }
+    tmp_mat->nrows = ktensor->ndims[n];
+    result = sptOmpMTTKRP(slice, mats, mats_order, n, tk);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+
+    sptMatrix * const p = state->p[n];
+    sptValue const forget = (sptValue) state->forget;
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel for num_threads(tk)
+#endif
+    for(sptIndex i = 0; i < p->nrows; ++i) {
+      for(sptIndex r = 0; r < rank; ++r) {
+        p->values[i * stride + r] = forget * p->values[i * stride + r] + tmp_mat->values[i * stride + r];
+      }
+    }
+
+    spt_OnlineHadamard(state, n, state->slice_ata);
+    sptMatrix * const q = state->q[n];
+    sptValue const * const hvals = state->ata[nmodes]->values;
+    for(sptIndex i = 0; i < rank; ++i) {
+      for(sptIndex r = 0; r < rank; ++r) {
+        q->values[i * stride + r] = forget * q->values[i * stride + r] + hvals[i * stride + r];
+      }
+    }
+
+    sptMatrix * const a = ktensor->factors[n];
+    memcpy(a->values, p->values, p->nrows * stride * sizeof (sptValue));
+    result = spt_OnlineSolve(q, a, state->ata[nmodes]);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+    spt_OnlineGram(a, state->ata[n]);
+  }
+
+  /* Fit on the slice, before its rows join the time factor */
+  double const slice_normsq = SparseTensorFrobeniusNormSquared(slice);
+  sptMatrix * const saved = state->ata[time_mode];
+  state->ata[time_mode] = state->slice_ata;
+  double const norm_mats = sptKruskalTensorFrobeniusNormSquared(nmodes, ktensor->lambda, state->ata);
+  state->ata[time_mode] = saved;
+  double const inner = spt_OnlineInnerProduct(slice, mats, tk);
+  double residual = slice_normsq + norm_mats - 2 * inner;
+  ktensor->fit = 1 - sqrt(residual > 0 ? residual : 0) / sqrt(slice_normsq);
+
+  /* Append the rows and their Gram */
+  sptMatrix * const time_mat = ktensor->factors[time_mode];
+  sptIndex const old_nrows = time_mat->nrows;
+  for(sptIndex i = 0; i < nrows; ++i) {
+    result = sptAppendMatrix(time_mat, NULL);
+    spt_CheckError(result, "CPU  SpTns Online CPD", NULL);
+  }
+  memcpy(time_mat->values + (size_t) old_nrows * stride, state->rows->values, nrows * stride * sizeof (sptValue));
+  ktensor->ndims[time_mode] += nrows;
+  for(sptIndex i = 0; i < rank; ++i) {
+    for(sptIndex r = 0; r < rank; ++r) {
+      saved->values[i * stride + r] += state->slice_ata->values[i * stride + r];
+    }
+  }
+
+  free(mats_order);
+  free(mats);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns Online CPD Update");
+  sptFreeTimer(timer);
+
+  return 0;
+}
+
+
+/**
+ * Release the state of sptNewOnlineCpd; the Kruskal tensor stays valid.
+ */
+void sptFreeOnlineCpd(sptOnlineCpd * state)
+{
+  for(sptIndex m = 0; m < state->nmodes; ++m) {
+    spt_OnlineFreeMatrix(state->p[m]);
+    spt_OnlineFreeMatrix(state->q[m]);
+  }
+  for(sptIndex m = 0; m < state->nmodes+1; ++m) {
+    spt_OnlineFreeMatrix(state->ata[m]);
+  }
+  spt_OnlineFreeMatrix(state->slice_ata);
+  spt_OnlineFreeMatrix(state->mttkrp);
+  spt_OnlineFreeMatrix(state->rows);
+  free(state->ata);
+  free(state->p);
+  free(state->q);
+  state->nmodes = 0;
+  state->rank = 0;
+}
@@ -0,0 +1,466 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+/* The exact fit needs a full MTTKRP, so it is only computed every few sampled iterations */
+#define SPT_SAMPLED_FIT_PERIOD 5
+
+
+/* The nonzeros sorted with one mode last, so that a fiber of that mode is a run sharing all other indices */
+typedef struct {
+  sptSparseTensor X;
+  sptIndex * order;
+  sptNnzIndex nfibers;
+  sptNnzIndex * fptr;   /// nfibers+1 offsets into X
+} spt_SampledFibers;
+
+static int spt_NewSampledFibers(spt_SampledFibers * f, sptSparseTensor const * spten, sptIndex const mode, int const tk)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptAssert(sptCopySparseTensor(&f->X, spten, tk) == 0);
+  f->order = (sptIndex *)malloc(nmodes * sizeof(*f->order));
+  spt_CheckOSError(!f->order, "CPU  SpTns CPD-ALS Sampled");
+  for(sptIndex i=0; i < nmodes; ++i) {
+    f->order[i] = (mode+1+i) % nmodes;
+  }
+  sptSparseTensorSortIndexCustomOrder(&f->X, f->order, 1);
+
+  sptNnzIndex const nnz = f->X.nnz;
+  f->fptr = (sptNnzIndex *)malloc((nnz+1) * sizeof(*f->fptr));
+  spt_CheckOSError(!f->fptr, "CPU  SpTns CPD-ALS Sampled");
+  f->nfibers = 0;
+  for(sptNnzIndex z=0; z < nnz; ++z) {
+    int start = z == 0;
+    for(sptIndex i=0; i+1 < nmodes && !start; ++i) {
+      sptIndex const * const inds = f->X.inds[f->order[i]].data;
+      start = inds[z] != inds[z-1];
+    }
+    if(start) {
+      f->fptr[f->nfibers++] = z;
+    }
+  }
+  f->fptr[f->nfibers] = nnz;
+  return 0;
+}
+
+static void spt_FreeSampledFibers(spt_SampledFibers * f)
+{
+  sptFreeSparseTensor(&f->X);
+  free(f->order);
+  free(f->fptr);
+}
+
+/* The fiber whose other indices are key[] (indexed by mode), or nfibers if it has no nonzero */
+static sptNnzIndex spt_FindFiber(spt_SampledFibers const * f, sptIndex const * key)
+{
+  sptIndex const nmodes = f->X.nmodes;
+  sptNnzIndex lo = 0, hi = f->nfibers;
+  while(lo < hi) {
+    sptNnzIndex const mid = lo + (hi - lo) / 2;
+    sptNnzIndex const z = f->fptr[mid];
+    int cmp = 0;
+    for(sptIndex i=0; i+1 < nmodes && cmp == 0; ++i) {
+      sptIndex const v = f->X.inds[f->order[i]].data[z];
+      cmp = (v > key[f->order[i]]) - (v < key[f->order[i]]);
+    }
+    if(cmp == 0) {
+      return mid;
+    } else if(cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return f->nfibers;
+}
+
+
+/*
+ * cdf[i] is the sum of the leverage scores of rows 0..i of A, where the score of
+ * row a is a (A^T A)^-1 a^T, computed with the Cholesky factor of the Gram matrix ata.
+ * Rows are weighted uniformly when ata is singular.
+ */
+static void spt_LeverageCdf(sptMatrix const * A, sptMatrix const * ata, sptValue * chol, double * cdf, int const tk)
+{
+  sptIndex const rank = A->ncols;
+  sptIndex const stride = A->stride;
+  memcpy(chol, ata->values, (size_t) rank * stride * sizeof(sptValue));
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+  int info;
+  spt_potrf_(&uplo, &blas_rank, chol, &blas_stride, &info);
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel num_threads(tk)
+#endif
+  {
+    sptValue * y = (sptValue *)malloc(rank * sizeof(*y));
+#ifdef PARTI_USE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for(sptIndex i=0; i < A->nrows; ++i) {
+      if(info) {
+        cdf[i] = 1;
+        continue;
+      }
+      sptValue const * const a = A->values + (size_t) i * stride;
+      double lev = 0;
+      /* y = L^-1 a, with L(r,s) = chol[s*stride + r] */
+      for(sptIndex r=0; r < rank; ++r) {
+        sptValue v = a[r];
+        for(sptIndex s=0; s < r; ++s) {
+          v -= chol[(size_t) s * stride + r] * y[s];
+        }
+        y[r] = v / chol[(size_t) r * stride + r];
+        lev += y[r] * y[r];
+      }
+      cdf[i] = lev;
+    }
+    free(y);
+  }
+
+  for(sptIndex i=1; i < A->nrows; ++i) {
+    cdf[i] += cdf[i-1];
+  }
+}
+
+/* The first row whose cdf exceeds u */
+static inline sptIndex spt_SampleRow(double const * cdf, sptIndex const nrows, double const u)
+{
+  sptIndex lo = 0, hi = nrows - 1;
+  while(lo < hi) {
+    sptIndex const mid = lo + (hi - lo) / 2;
+    if(cdf[mid] > u) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+
+/*
+ * Solve the least-squares problem of `mode` on nsamples rows of the Khatri-Rao
+ * product, each drawn with probability the product of the leverage scores of its
+ * factor rows. Writes the sketched MTTKRP into A and the sketched Gram into neqs,
+ * then solves; falls back to the exact Gram if the sketched one is singular.
+ */
+static int spt_SampledSolve(
+  spt_SampledFibers const * f,
+  sptIndex const mode,
+  sptMatrix ** mats,
+  sptMatrix ** ata,
+  double ** cdfs,
+  sptNnzIndex const nsamples,
+  uint64_t const stream,
+  int const tk)
+{
+  sptIndex const nmodes = f->X.nmodes;
+  sptMatrix * const A = mats[mode];
+  sptIndex const rank = A->ncols;
+  sptIndex const stride = A->stride;
+  size_t const len = (size_t) rank * stride;
+  sptValue * const neqs = ata[nmodes]->values;
+  sptIndex const * const rows = f->X.inds[mode].data;
+  sptValue const * const vals = f->X.values.data;
+  int const nparts = tk > 0 ? tk : 1;
+
+  sptValue * const parts = (sptValue *)calloc((size_t) nparts * len, sizeof(*parts));
+  spt_CheckOSError(!parts, "CPU  SpTns CPD-ALS Sampled");
+  memset(A->values, 0, (size_t) A->nrows * stride * sizeof(sptValue));
+
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel num_threads(nparts)
+#endif
+  {
+#ifdef PARTI_USE_OPENMP
+    sptValue * const g = parts + omp_get_thread_num() * len;
+#else
+    sptValue * const g = parts;
+#endif
+    sptValue * const krow = (sptValue *)malloc(rank * sizeof(*krow));
+    sptIndex * const key = (sptIndex *)malloc(nmodes * sizeof(*key));
+
+#ifdef PARTI_USE_OPENMP
+    #pragma omp for schedule(static)
+#endif
+    for(sptNnzIndex s=0; s < nsamples; ++s) {
+      uint64_t state = stream ^ spt_GenMix(s + 1);
+      double p = 1;
+      for(sptIndex r=0; r < rank; ++r) {
+        krow[r] = 1;
+      }
+      for(sptIndex m=0; m < nmodes; ++m) {
+        if(m == mode) continue;
+        sptIndex const I = mats[m]->nrows;
+        double const * const cdf = cdfs[m];
+        sptIndex const i = spt_SampleRow(cdf, I, spt_GenUniform(&state) * cdf[I-1]);
+        p *= (cdf[i] - (i > 0 ? cdf[i-1] : 0)) / cdf[I-1];
+        key[m] = i;
+        sptValue const * const a = mats[m]->values + (size_t) i * stride;
+        for(sptIndex r=0; r < rank; ++r) {
+          krow[r] *= a[r];
+        }
+      }
+      sptValue const w = (sptValue) (1.0 / ((double) nsamples * p));
+
+      for(sptIndex r=0; r < rank; ++r) {
+        sptValue const wr = w * krow[r];
+        for(sptIndex q=r; q < rank; ++q) {
+          g[(size_t) r * stride + q] += wr * krow[q];
+        }
+      }
+
+      sptNnzIndex const fid = spt_FindFiber(f, key);
+      if(fid == f->nfibers) continue;
+      for(sptNnzIndex z=f->fptr[fid]; z < f->fptr[fid+1]; ++z) {
+        sptValue * const out = A->values + (size_t) rows[z] * stride;
+        sptValue const wv = w * vals[z];
+        for(sptIndex r=0; r < rank; ++r) {
+#ifdef PARTI_USE_OPENMP
+          #pragma omp atomic update
+#endif
+          out[r] += wv * krow[r];
+        }
+      }
+    }
+    free(krow);
+    free(key);
+  }
+
+  memset(neqs, 0, len * sizeof(sptValue));
+  for(int t=0; t < nparts; ++t) {
+    for(size_t x=0; x < len; ++x) {
+      neqs[x] += parts[(size_t) t * len + x];
+    }
+  }
+  free(parts);
+
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+  int nrhs = (int) A->nrows;
+  int info;
+  spt_potrf_(&uplo, &blas_rank, neqs, &blas_stride, &info);
+  if(info == 0) {
+    spt_potrs_(&uplo, &blas_rank, &nrhs, neqs, &blas_stride, A->values, &blas_stride, &info);
+  }
+  if(info) {
+    return sptMatrixSolveNormals(mode, nmodes, ata, A);
+  }
+  return 0;
+}
+
+
+static double OmpCpdAlsSampledStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptNnzIndex const nsamples,
+  sptIndex const niters,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spten->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  spt_SampledFibers * fibers = (spt_SampledFibers *)malloc(nmodes * sizeof(*fibers));
+  double ** cdfs = (double **)malloc(nmodes * sizeof(*cdfs));
+  sptValue * chol = (sptValue *)malloc((size_t) rank * stride * sizeof(*chol));
+  spt_CheckOSError(!ata || !fibers || !cdfs || !chol, "CPU  SpTns CPD-ALS Sampled");
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spt_NewSampledFibers(&fibers[m], spten, m, tk) == 0);
+    cdfs[m] = (double *)malloc(mats[m]->nrows * sizeof(*cdfs[m]));
+    spt_CheckOSError(!cdfs[m], "CPU  SpTns CPD-ALS Sampled");
+    sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+    spt_LeverageCdf(mats[m], ata[m], chol, cdfs[m], tk);
+  }
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  double oldfit = 0;
+  int have_fit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      uint64_t const stream = spt_GenMix(seed ^ spt_GenMix((uint64_t) it * nmodes + m + 1));
+      sptAssert ( spt_SampledSolve(&fibers[m], m, mats, ata, cdfs, nsamples, stream, tk) == 0 );
+
+      /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
+      if (it == 0 ) {
+        sptMatrix2Norm(mats[m], lambda);
+      } else {
+        sptMatrixMaxNorm(mats[m], lambda);
+      }
+
+      /* ata[m] = mats[m]^T * mats[m]), then the scores the other modes sample mats[m] by */
+      sptAssert(sptOmpMatrixGram(mats[m], ata[m], tk) == 0);
+      spt_LeverageCdf(mats[m], ata[m], chol, cdfs[m], tk);
+    } // Loop nmodes
+
+    int const last_it = it+1 == niters;
+    if((it+1) % SPT_SAMPLED_FIT_PERIOD == 0 || last_it) {
+      /* The exact fit, from one exact MTTKRP of the last mode */
+      sptIndex const last = nmodes - 1;
+      tmp_mat->nrows = mats[last]->nrows;
+      mats_order[0] = last;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (last+i) % nmodes;
+      sptAssert (sptOmpMTTKRP(spten, mats, mats_order, last, tk) == 0);
+      fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+    }
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    if((it+1) % SPT_SAMPLED_FIT_PERIOD == 0 || last_it) {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+          it+1, its_time, fit, fit - oldfit);
+      if(have_fit && fabs(fit - oldfit) < tol) {
+        break;
+      }
+      oldfit = fit;
+      have_fit = 1;
+    } else {
+      printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s )\n", it+1, its_time);
+    }
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    spt_FreeSampledFibers(&fibers[m]);
+    free(cdfs[m]);
+  }
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  free(fibers);
+  free(cdfs);
+  free(chol);
+  free(mats_order);
+
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel randomized CPD-ALS for COO formatted sparse tensors.
+ * Each factor update solves the least-squares problem on nsamples rows of the
+ * Khatri-Rao product instead of all of them, drawn by the leverage scores of the
+ * other factors as computed from their cached Gram matrices; the nonzeros a sample
+ * needs are found in a copy of the tensor sorted with the updated mode last, so
+ * the memory is that of nmodes copies of the tensor.
+ * An iteration costs O(nsamples * rank * (nmodes + rank)) plus the nonzeros hit,
+ * instead of a full MTTKRP per mode. The exact fit, which needs one full MTTKRP,
+ * is computed every SPT_SAMPLED_FIT_PERIOD iterations and at the end, and only
+ * those fits are compared against tol.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  nsamples the number of sampled rows per least-squares problem, 0 for 64 * rank * log2(2 * rank)
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  seed the seed of the initial guess and of the samples
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdAlsSampled(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptNnzIndex const nsamples,
+  sptIndex const niters,
+  double const tol,
+  uint64_t const seed,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+
+  sptNnzIndex J = nsamples;
+  if(J == 0) {
+    J = (sptNnzIndex) ceil(64.0 * rank * log2(2.0 * rank));
+  }
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-ALS Sampled");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+      sptAssert(sptConstantMatrix(mats[m], 0) == 0);
+      spt_CpdSeededFactor(mats[m], seed, m);
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  ktensor->fit = OmpCpdAlsSampledStep(spten, rank, J, niters, tol, seed, tk, mats, ktensor->lambda);
+  sptSetExecContext(caller_exec);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-ALS Sampled");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
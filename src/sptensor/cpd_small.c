@@ -0,0 +1,292 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * CP-ALS for tensors of a few thousand nonzeros, where the setup of the
+ * parallel drivers costs more than the arithmetic: no parallel regions, one
+ * scratch allocation, no timing or output, and the rank x rank normal
+ * equations factored inline instead of through LAPACK. The iterates follow
+ * sptOmpCpdAls: the same solves and the same column normalization.
+ */
+
+/*
+ * Whether sptOmpCpdAls takes the small path: few nonzeros and a small rank,
+ * with no checkpoint, line search, deadline or progress callback configured,
+ * as those need the full driver.
+ */
+int spt_CpdIsSmall(sptSparseTensor const * const spten, sptIndex const rank) {
+    return spten->nnz <= PARTI_CPD_SMALL_NNZ && rank <= PARTI_CPD_SMALL_RANK && spten->nmodes >= 2 &&
+        !spt_CpdCheckpointEnabled() && !spt_CpdLineSearchEnabled() && !spt_CpdGuardEnabled();
+}
+
+/*
+ * Cholesky factorization of the symmetric positive definite rank x rank V in
+ * place, the lower triangle holding L. 0 if V is not positive definite.
+ */
+static int spt_SmallCholesky(sptValue * const V, sptIndex const rank) {
+    for(sptIndex j = 0; j < rank; ++j) {
+        sptValue * const vj = V + (size_t) j * rank;
+        sptValue d = vj[j];
+        for(sptIndex k = 0; k < j; ++k) {
+            d -= vj[k] * vj[k];
+        }
+        if(!(d > 0)) {
+            return 0;
+        }
+        vj[j] = (sptValue) sqrt(d);
+        for(sptIndex i = j + 1; i < rank; ++i) {
+            sptValue * const vi = V + (size_t) i * rank;
+            sptValue s = vi[j];
+            for(sptIndex k = 0; k < j; ++k) {
+                s -= vi[k] * vj[k];
+            }
+            vi[j] = s / vj[j];
+        }
+    }
+    return 1;
+}
+
+/*
+ * The Hadamard product of the Gram matrices of every mode but `mode`, into V
+ * and factored. A ridge grows on its diagonal until it factors, in place of
+ * the pseudo-inverse the full driver falls back to. 0 if it still does not
+ * factor after PARTI_CPD_SMALL_RIDGES tries, as for a Gram matrix of NaNs.
+ */
+#define PARTI_CPD_SMALL_RIDGES 16
+static int spt_SmallNormals(sptValue * const V, sptValue const * const grams, sptIndex const nmodes, sptIndex const mode, sptIndex const rank) {
+    size_t const rr = (size_t) rank * rank;
+    sptValue ridge = 0;
+    for(int tries = 0; tries < PARTI_CPD_SMALL_RIDGES; ++tries) {
+        for(size_t x = 0; x < rr; ++x) {
+            V[x] = 1;
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                for(size_t x = 0; x < rr; ++x) {
+                    V[x] *= grams[m * rr + x];
+                }
+            }
+        }
+        sptValue diag = 0;
+        for(sptIndex r = 0; r < rank; ++r) {
+            V[(size_t) r * rank + r] += ridge;
+            diag = V[(size_t) r * rank + r] > diag ? V[(size_t) r * rank + r] : diag;
+        }
+        if(spt_SmallCholesky(V, rank)) {
+            return 1;
+        }
+        ridge = ridge == 0 ? (diag > 0 ? diag : 1) * 1e-12 : ridge * 100;
+    }
+    return 0;
+}
+
+/**
+ * Single-threaded CP-ALS for small tensors, see spt_CpdIsSmall. Factors the
+ * Kruskal tensor already holds are the initial guess; the others are random.
+ * @param[in]  spten  the sparse tensor
+ * @param[in]  rank   the CPD rank, at most PARTI_CPD_SMALL_RANK
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol    the tolerance value for convergence
+ * @param[in,out] ktensor the Kruskal tensor
+ */
+int spt_CpdAlsSmall(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const * const ndims = spten->ndims;
+  sptValue const * const vals = spten->values.data;
+  sptNnzIndex const nnz = spten->nnz;
+  sptValue * const lambda = ktensor->lambda;
+  size_t const rr = (size_t) rank * rank;
+
+  sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-ALS Small");
+  int warm;
+  int result = spt_CpdTakeFactors(ktensor, nmodes, ndims, rank, mats, &warm);
+  spt_CheckError(result, "CPU  SpTns CPD-ALS Small", NULL);
+  if(!warm) {
+    result = spt_CpdInitMatrices(spten, rank, mats, 1);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS Small", NULL);
+  }
+  mats[nmodes] = NULL;
+  sptIndex const stride = mats[0]->stride;
+
+  /* All scratch in one block: nmodes Gram matrices, V, a product row, and the MTTKRP output */
+  sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+  sptValue * const arena = sptMalloc(((nmodes + 1) * rr + stride + (size_t) max_dim * stride) * sizeof *arena);
+  spt_CheckOSError(!arena, "CPU  SpTns CPD-ALS Small");
+  sptValue * const grams = arena;
+  sptValue * const V = grams + nmodes * rr;
+  sptValue * const prod = V + rr;
+  sptValue * const M = prod + stride;
+
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    sptValue const * const A = mats[m]->values;
+    sptValue * const G = grams + m * rr;
+    memset(G, 0, rr * sizeof *G);
+    for(sptIndex i = 0; i < ndims[m]; ++i) {
+      sptValue const * const a = A + (size_t) i * stride;
+      for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex s = 0; s < rank; ++s) {
+          G[(size_t) r * rank + s] += a[r] * a[s];
+        }
+      }
+    }
+  }
+  double normsq = 0;
+  for(sptNnzIndex x = 0; x < nnz; ++x) {
+    normsq += vals != NULL ? (double) vals[x] * vals[x] : 1;
+  }
+
+  double fit = 0, oldfit = 0;
+  for(sptIndex it = 0; it < niters; ++it) {
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+      sptIndex const nrows = ndims[mode];
+      sptValue * const A = mats[mode]->values;
+
+      /* MTTKRP */
+      memset(M, 0, (size_t) nrows * stride * sizeof *M);
+      for(sptNnzIndex x = 0; x < nnz; ++x) {
+        sptValue const v = vals != NULL ? vals[x] : 1;
+        for(sptIndex r = 0; r < rank; ++r) {
+          prod[r] = v;
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+          if(m != mode) {
+            sptValue const * const row = mats[m]->values + (size_t) spten->inds[m].data[x] * stride;
+            for(sptIndex r = 0; r < rank; ++r) {
+              prod[r] *= row[r];
+            }
+          }
+        }
+        sptValue * const out = M + (size_t) spten->inds[mode].data[x] * stride;
+        for(sptIndex r = 0; r < rank; ++r) {
+          out[r] += prod[r];
+        }
+      }
+
+      /* Solve A V = M row by row through L L^T = V, taking the column norms */
+      if(!spt_SmallNormals(V, grams, nmodes, mode, rank)) {
+        sptFree(arena);
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns CPD-ALS Small", "normal equations do not factor");
+      }
+      for(sptIndex r = 0; r < rank; ++r) {
+        lambda[r] = 0;
+      }
+      for(sptIndex i = 0; i < nrows; ++i) {
+        sptValue const * const b = M + (size_t) i * stride;
+        sptValue * const a = A + (size_t) i * stride;
+        for(sptIndex r = 0; r < rank; ++r) {
+          sptValue v = b[r];
+          for(sptIndex s = 0; s < r; ++s) {
+            v -= V[(size_t) r * rank + s] * a[s];
+          }
+          a[r] = v / V[(size_t) r * rank + r];
+        }
+        for(sptIndex r = rank; r-- > 0; ) {
+          sptValue v = a[r];
+          for(sptIndex s = r + 1; s < rank; ++s) {
+            v -= V[(size_t) s * rank + r] * a[s];
+          }
+          a[r] = v / V[(size_t) r * rank + r];
+          if(it != 0) {
+            lambda[r] = a[r] > lambda[r] ? a[r] : lambda[r];
+          } else {
+            lambda[r] += a[r] * a[r];
+          }
+        }
+      }
+      for(sptIndex r = 0; r < rank; ++r) {
+        lambda[r] = it != 0 ? (lambda[r] < 1 ? 1 : lambda[r]) : (sptValue) sqrt(lambda[r]);
+        /* A zero column, as from a tensor without nonzeros, stays zero */
+        if(lambda[r] == 0) {
+          lambda[r] = 1;
+        }
+      }
+
+      /* Normalize and refresh the Gram matrix of this mode */
+      sptValue * const G = grams + mode * rr;
+      memset(G, 0, rr * sizeof *G);
+      for(sptIndex i = 0; i < nrows; ++i) {
+        sptValue * const a = A + (size_t) i * stride;
+        for(sptIndex r = 0; r < rank; ++r) {
+          a[r] /= lambda[r];
+        }
+        for(sptIndex r = 0; r < rank; ++r) {
+          for(sptIndex s = 0; s < rank; ++s) {
+            G[(size_t) r * rank + s] += a[r] * a[s];
+          }
+        }
+      }
+    }
+
+    /* fit = 1 - ||X - model|| / ||X||, with ||model||^2 = lambda^T (*grams) lambda
+       and <X, model> from the MTTKRP of the last mode, still in M */
+    double model = 0;
+    for(sptIndex r = 0; r < rank; ++r) {
+      for(sptIndex s = 0; s < rank; ++s) {
+        double g = (double) lambda[r] * lambda[s];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+          g *= grams[m * rr + (size_t) r * rank + s];
+        }
+        model += g;
+      }
+    }
+    double inner = 0;
+    sptValue const * const last = mats[nmodes-1]->values;
+    for(sptIndex i = 0; i < ndims[nmodes-1]; ++i) {
+      for(sptIndex r = 0; r < rank; ++r) {
+        inner += (double) lambda[r] * M[(size_t) i * stride + r] * last[(size_t) i * stride + r];
+      }
+    }
+    fit = sptKruskalTensorFitFromNorms(normsq, model, inner);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  }
+
+  /* Fold the column 2-norms of every factor into lambda, as GetFinalLambda does */
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    sptValue * const A = mats[m]->values;
+    sptValue const * const G = grams + m * rr;
+    for(sptIndex r = 0; r < rank; ++r) {
+      sptValue const n = (sptValue) sqrt(G[(size_t) r * rank + r]);
+      if(n > 0) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+          A[(size_t) i * stride + r] /= n;
+        }
+      }
+      lambda[r] *= n;
+    }
+  }
+
+  sptFree(arena);
+  ktensor->fit = fit;
+  ktensor->factors = mats;
+  return 0;
+}
@@ -0,0 +1,289 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include "sptensor.h"
+
+/* Coordinate descent sweeps per factor update */
+#define SPT_SPARSE_SWEEPS 5
+
+
+/**
+ * One L1-penalized coordinate descent sweep over the columns of a factor,
+ * with every row updated independently. Column r of row i becomes
+ * soft(m_ir - sum_{s != r} a_is g_sr, l1) / g_rr, using the already updated
+ * a_i1 .. a_i(r-1), so entries whose least-squares value is within l1 of
+ * zero come out exactly zero.
+ * @param[in,out] A  the row-major factor, its weights folded in
+ * @param[in]  M  the row-major MTTKRP of this mode
+ * @param[in]  G  the full Hadamard product of the other Gram matrices
+ */
+static void spt_CpdSparseUpdateRows(
+  sptValue * const A,
+  sptValue const * const M,
+  sptValue const * const G,
+  sptIndex const nrows,
+  sptIndex const rank,
+  sptIndex const stride,
+  sptValue const l1,
+  int const tk)
+{
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for schedule(static) num_threads(tk)
+#endif
+  for(sptIndex i=0; i < nrows; ++i) {
+    sptValue * const a = A + (size_t) i * stride;
+    sptValue const * const m = M + (size_t) i * stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      sptValue const * const g = G + (size_t) r * stride;
+      if(g[r] <= 0) {
+        a[r] = 0;
+        continue;
+      }
+      sptValue v = m[r] + a[r] * g[r];
+      for(sptIndex s=0; s < rank; ++s) {
+        v -= a[s] * g[s];
+      }
+      if(v > l1) {
+        a[r] = (v - l1) / g[r];
+      } else if(v < -l1) {
+        a[r] = (v + l1) / g[r];
+      } else {
+        a[r] = 0;
+      }
+    }
+  }
+}
+
+
+/* Normalize the columns of A into lambda; a column of zeros keeps a zero weight */
+static void spt_CpdSparseNormalize(sptMatrix * const A, sptValue * const lambda, int const tk)
+{
+  sptIndex const rank = A->ncols;
+  sptIndex const stride = A->stride;
+  for(sptIndex r=0; r < rank; ++r) {
+    lambda[r] = 0;
+  }
+  for(sptIndex i=0; i < A->nrows; ++i) {
+    sptValue const * const a = A->values + (size_t) i * stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] += a[r] * a[r];
+    }
+  }
+  for(sptIndex r=0; r < rank; ++r) {
+    lambda[r] = sqrt(lambda[r]);
+  }
+#ifdef PARTI_USE_OPENMP
+  #pragma omp parallel for schedule(static) num_threads(tk)
+#endif
+  for(sptIndex i=0; i < A->nrows; ++i) {
+    sptValue * const a = A->values + (size_t) i * stride;
+    for(sptIndex r=0; r < rank; ++r) {
+      if(lambda[r] > 0) {
+        a[r] /= lambda[r];
+      }
+    }
+  }
+}
+
+
+static double OmpCpdAlsSparseFactorsStep(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptValue const l1,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(spten->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // upper triangles, row-major
+  sptSparseMatrixCSR ** csr = (sptSparseMatrixCSR **)malloc(nmodes * sizeof(*csr));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+
+  /* Keep every factor normalized, with the scale in lambda, and compress it to CSR */
+  sptValue * norms = (sptValue *)malloc(rank * sizeof(*norms));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    spt_CpdSparseNormalize(mats[m], norms, tk);
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] *= norms[r];
+    }
+    csr[m] = (sptSparseMatrixCSR *)malloc(sizeof(sptSparseMatrixCSR));
+    sptAssert(sptSparseMatrixCSRFromMatrix(csr[m], mats[m], 0, tk) == 0);
+    sptAssert(sptSparseMatrixCSRGram(ata[m], csr[m], tk) == 0);
+  }
+  free(norms);
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      // mats[nmodes]: row-major
+      sptAssert (sptOmpMTTKRPSparseFactors(spten, csr, m, tmp_mat, tk) == 0);
+
+      /* ata[nmodes] = Hadamard product of the other "ata"s, in full */
+      sptAssert (sptMatrixDotMulSeqTriangle(m, nmodes, ata) == 0);
+
+      /* Fold lambda into mats[m], update it with the L1 penalty, and normalize it again */
+      sptValue * const vals = mats[m]->values;
+#ifdef PARTI_USE_OPENMP
+      #pragma omp parallel for num_threads(tk)
+#endif
+      for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+        for(sptIndex r=0; r < rank; ++r) {
+          vals[i * stride + r] *= lambda[r];
+        }
+      }
+      for(sptIndex sweep=0; sweep < SPT_SPARSE_SWEEPS; ++sweep) {
+        spt_CpdSparseUpdateRows(vals, tmp_mat->values, ata[nmodes]->values, mats[m]->nrows, rank, stride, l1, tk);
+      }
+      spt_CpdSparseNormalize(mats[m], lambda, tk);
+
+      /* Only the entries the penalty left go on to the other modes */
+      sptFreeSparseMatrixCSR(csr[m]);
+      sptAssert(sptSparseMatrixCSRFromMatrix(csr[m], mats[m], 0, tk) == 0);
+      sptAssert(sptSparseMatrixCSRGram(ata[m], csr[m], tk) == 0);
+    } // Loop nmodes
+
+    /* mats[nmodes] still holds the MTTKRP of the last mode */
+    fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    sptNnzIndex factor_nnz = 0, factor_size = 0;
+    for(sptIndex m=0; m < nmodes; ++m) {
+      factor_nnz += csr[m]->nnz;
+      factor_size += (sptNnzIndex) mats[m]->nrows * rank;
+    }
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e  density = %0.4f\n",
+        it+1, its_time, fit, fit - oldfit, (double) factor_nnz / factor_size);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptFreeSparseMatrixCSR(csr[m]);
+    free(csr[m]);
+  }
+  free(csr);
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) with sparse factor matrices for COO formatted sparse tensors.
+ * Each factor update is an L1-penalized least squares solved by coordinate
+ * descent, which sets to zero the entries within l1 of zero, and the factors
+ * are kept in CSR between updates so that MTTKRP skips their zero rows and
+ * columns; with l1 = 0 it is an unconstrained HALS-style CP-ALS.
+ * The factors of ktensor are returned dense; sptSparseMatrixCSRFromMatrix with
+ * a zero threshold recovers their sparsity.
+ * @param[in,out] ktensor the Kruskal tensor; factors and lambda it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  l1 the weight of the L1 penalty on the factors, scaled with the tensor values
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdAlsSparseFactors(
+  sptSparseTensor const * const spten,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptValue const l1,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = spten->nmodes;
+  if(l1 < 0) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns CPD-SpFactors", "l1 must not be negative");
+  }
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(spten->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  SpTns CPD-SpFactors");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, spten->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], spten->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], rank) == 0);
+    }
+  }
+  if(!warm) {
+    for(sptIndex r=0; r < rank; ++r) {
+      ktensor->lambda[r] = 1;
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCpdAlsSparseFactorsStep(spten, rank, niters, tol, l1, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-SpFactors");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+  return 0;
+}
@@ -0,0 +1,537 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+
+/*
+ * Nonzero shards of a binary tensor file, read asynchronously through
+ * prefetch distance + 1 rotating buffers, one reader group per buffer.
+ * Packed files (see sptDumpPackedSparseTensor) keep their block metadata
+ * resident and stream whole blocks of packed words and values.
+ */
+typedef struct {
+  int fd;
+  spt_SparseTensorBinaryHeader header;
+  int packed;
+  sptPackedSparseTensor meta;   /// of a packed file: block metadata only, no words or values
+  uint64_t sections[6];         /// of a packed file, see spt_PackedBinarySections
+  sptIndex nmodes;
+  sptNnzIndex nnz;
+  sptNnzIndex shard_nnz;
+  sptNnzIndex nshards;
+  int nbufs;
+  sptSparseTensor * bufs;       /// shard indices and values; only values for packed files
+  uint64_t ** words;            /// shard words of a packed file
+  spt_AsyncReader * reader;
+} spt_ShardStream;
+
+/* Blocks [*b_begin, *b_end) of a shard of a packed file */
+static void spt_ShardBlocks(spt_ShardStream const * stream, sptNnzIndex const shard, sptNnzIndex * b_begin, sptNnzIndex * b_end)
+{
+  sptNnzIndex const shard_blocks = stream->shard_nnz / PARTI_PACKED_BLOCK;
+  *b_begin = shard * shard_blocks;
+  *b_end = *b_begin + shard_blocks < stream->meta.nblocks ? *b_begin + shard_blocks : stream->meta.nblocks;
+}
+
+/* Queue the reads of a shard into buffer slot; spt_AsyncReaderWait on the slot completes them */
+static int spt_SubmitShard(spt_ShardStream * stream, int const slot, sptNnzIndex const shard)
+{
+  sptSparseTensor * const buf = &stream->bufs[slot];
+  spt_SparseTensorBinaryHeader const * const header = &stream->header;
+  sptNnzIndex const begin = shard * stream->shard_nnz;
+  sptNnzIndex const nnz = stream->nnz - begin < stream->shard_nnz ? stream->nnz - begin : stream->shard_nnz;
+  int result;
+
+  if(stream->packed) {
+    sptNnzIndex b_begin, b_end;
+    spt_ShardBlocks(stream, shard, &b_begin, &b_end);
+    uint64_t const * const offsets = stream->meta.offsets;
+    result = spt_AsyncReaderSubmit(stream->reader, slot, stream->words[slot], (offsets[b_end] - offsets[b_begin]) * sizeof(uint64_t),
+      stream->sections[3] + offsets[b_begin] * sizeof(uint64_t));
+    spt_CheckError(result, "SpTns Stream Read", NULL);
+    result = spt_AsyncReaderSubmit(stream->reader, slot, buf->values.data, nnz * sizeof(sptValue), stream->sections[4] + begin * sizeof(sptValue));
+    spt_CheckError(result, "SpTns Stream Read", NULL);
+    buf->values.len = nnz;
+    buf->nnz = nnz;
+    return 0;
+  }
+
+  uint64_t const ind_bytes = spt_BinaryAlignUp(header->nnz * sizeof(sptIndex));
+
+  for(sptIndex m = 0; m < header->nmodes; ++m) {
+    uint64_t const offset = header->data_offset + m * ind_bytes + begin * sizeof(sptIndex);
+    result = spt_AsyncReaderSubmit(stream->reader, slot, buf->inds[m].data, nnz * sizeof(sptIndex), offset);
+    spt_CheckError(result, "SpTns Stream Read", NULL);
+    buf->inds[m].len = nnz;
+  }
+  uint64_t const offset = header->data_offset + header->nmodes * ind_bytes + begin * sizeof(sptValue);
+  result = spt_AsyncReaderSubmit(stream->reader, slot, buf->values.data, nnz * sizeof(sptValue), offset);
+  spt_CheckError(result, "SpTns Stream Read", NULL);
+  buf->values.len = nnz;
+  buf->nnz = nnz;
+
+  return 0;
+}
+
+/* Read the resident block metadata of a packed file */
+static int spt_OpenPackedMeta(spt_ShardStream * stream)
+{
+  spt_PackedBinaryHeader header;
+  int result = spt_PreadAll(stream->fd, &header, sizeof header, 0);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  result = spt_PackedBinaryCheckHeader(&header);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  spt_PackedBinarySections(&header, stream->sections);
+
+  sptPackedSparseTensor * const meta = &stream->meta;
+  sptIndex const nmodes = header.nmodes;
+  sptNnzIndex const nblocks = (header.nnz + PARTI_PACKED_BLOCK - 1) / PARTI_PACKED_BLOCK;
+  memset(meta, 0, sizeof *meta);
+  meta->nmodes = nmodes;
+  meta->nnz = header.nnz;
+  meta->nblocks = nblocks;
+  uint64_t * buf = malloc((nblocks * nmodes + nmodes + 1) * sizeof *buf);
+  spt_CheckOSError(!buf, "SpTns Stream Open");
+  result = spt_PreadAll(stream->fd, buf, nmodes * sizeof *buf, sizeof header);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  meta->ndims = malloc(nmodes * sizeof *meta->ndims);
+  spt_CheckOSError(!meta->ndims, "SpTns Stream Open");
+  for(sptIndex m = 0; m < nmodes; ++m) {
+    meta->ndims[m] = (sptIndex) buf[m];
+  }
+  result = spt_PreadAll(stream->fd, &meta->fingerprint, sizeof meta->fingerprint,
+    sizeof header + nmodes * (sizeof (uint64_t) + sizeof (uint32_t)));
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  result = spt_PreadAll(stream->fd, buf, nblocks * nmodes * sizeof *buf, stream->sections[0]);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  meta->firsts = malloc((nblocks * nmodes + 1) * sizeof *meta->firsts);
+  spt_CheckOSError(!meta->firsts, "SpTns Stream Open");
+  for(sptNnzIndex i = 0; i < nblocks * nmodes; ++i) {
+    meta->firsts[i] = (sptIndex) buf[i];
+  }
+  free(buf);
+  meta->widths = malloc(nblocks * nmodes + 1);
+  spt_CheckOSError(!meta->widths, "SpTns Stream Open");
+  result = spt_PreadAll(stream->fd, meta->widths, nblocks * nmodes, stream->sections[1]);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  meta->offsets = malloc((nblocks + 1) * sizeof *meta->offsets);
+  spt_CheckOSError(!meta->offsets, "SpTns Stream Open");
+  result = spt_PreadAll(stream->fd, meta->offsets, (nblocks + 1) * sizeof *meta->offsets, stream->sections[2]);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  if(meta->offsets[nblocks] != header.nwords) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Stream Open", "corrupt block offsets");
+  }
+  return 0;
+}
+
+static int spt_OpenShardStream(spt_ShardStream * stream, const char * filename, sptNnzIndex shard_nnz)
+{
+  int result;
+  char magic[8];
+  stream->fd = open(filename, O_RDONLY);
+  spt_CheckOSError(stream->fd < 0, "SpTns Stream Open");
+  result = spt_PreadAll(stream->fd, magic, sizeof magic, 0);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  stream->packed = memcmp(magic, PARTI_PACKED_MAGIC, sizeof magic) == 0;
+
+  sptIndex * ndims;
+  if(stream->packed) {
+    result = spt_OpenPackedMeta(stream);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    stream->nmodes = stream->meta.nmodes;
+    stream->nnz = stream->meta.nnz;
+    ndims = malloc(stream->nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "SpTns Stream Open");
+    memcpy(ndims, stream->meta.ndims, stream->nmodes * sizeof *ndims);
+  } else {
+    result = spt_PreadAll(stream->fd, &stream->header, sizeof stream->header, 0);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    result = spt_SparseTensorBinaryCheckHeader(&stream->header);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    if(stream->header.index_width != sizeof(sptIndex) || stream->header.value_width != sizeof(sptValue)) {
+      spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Stream Open", "index or value width differs from this build");
+    }
+    stream->nmodes = stream->header.nmodes;
+    stream->nnz = stream->header.nnz;
+    uint64_t * file_ndims = malloc(stream->nmodes * sizeof *file_ndims);
+    spt_CheckOSError(!file_ndims, "SpTns Stream Open");
+    result = spt_PreadAll(stream->fd, file_ndims, stream->nmodes * sizeof *file_ndims, sizeof stream->header);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    ndims = malloc(stream->nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "SpTns Stream Open");
+    for(sptIndex m = 0; m < stream->nmodes; ++m) {
+      ndims[m] = (sptIndex) file_ndims[m];
+    }
+    free(file_ndims);
+  }
+
+  sptIndex const nmodes = stream->nmodes;
+  sptNnzIndex const nnz = stream->nnz;
+  if(shard_nnz == 0 || shard_nnz > nnz) {
+    shard_nnz = nnz;
+  }
+  if(stream->packed) {
+    /* Whole blocks per shard */
+    shard_nnz = (shard_nnz + PARTI_PACKED_BLOCK - 1) / PARTI_PACKED_BLOCK * PARTI_PACKED_BLOCK;
+  }
+  stream->shard_nnz = shard_nnz;
+  stream->nshards = shard_nnz == 0 ? 0 : (nnz + shard_nnz - 1) / shard_nnz;
+
+  /* A single shard stays resident; otherwise one buffer per shard read ahead, plus the current one */
+  sptNnzIndex const ahead = spt_StreamPrefetchDistance();
+  int const nbufs = stream->nshards > 1 ? (int) (ahead + 1 < stream->nshards ? ahead + 1 : stream->nshards) : 1;
+  stream->nbufs = nbufs;
+  stream->bufs = malloc(nbufs * sizeof *stream->bufs);
+  stream->words = calloc(nbufs, sizeof *stream->words);
+  spt_CheckOSError(!stream->bufs || !stream->words, "SpTns Stream Open");
+  for(int b = 0; b < nbufs; ++b) {
+    result = sptNewSparseTensor(&stream->bufs[b], nmodes, ndims);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    for(sptIndex m = 0; m < nmodes && !stream->packed; ++m) {
+      result = sptResizeIndexVector(&stream->bufs[b].inds[m], shard_nnz);
+      spt_CheckError(result, "SpTns Stream Open", NULL);
+    }
+    result = sptResizeValueVector(&stream->bufs[b].values, shard_nnz);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+  }
+  free(ndims);
+
+  if(stream->packed) {
+    uint64_t max_words = 0;
+    for(sptNnzIndex s = 0; s < stream->nshards; ++s) {
+      sptNnzIndex b_begin, b_end;
+      spt_ShardBlocks(stream, s, &b_begin, &b_end);
+      uint64_t const words = stream->meta.offsets[b_end] - stream->meta.offsets[b_begin];
+      max_words = words > max_words ? words : max_words;
+    }
+    for(int b = 0; b < nbufs; ++b) {
+      stream->words[b] = malloc((max_words + 1) * sizeof(uint64_t));
+      spt_CheckOSError(!stream->words[b], "SpTns Stream Open");
+    }
+  }
+
+  result = spt_AsyncReaderOpen(&stream->reader, filename, nbufs);
+  spt_CheckError(result, "SpTns Stream Open", NULL);
+  if(stream->nshards == 1) {
+    result = spt_SubmitShard(stream, 0, 0);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+    result = spt_AsyncReaderWait(stream->reader, 0);
+    spt_CheckError(result, "SpTns Stream Open", NULL);
+  }
+
+  return 0;
+}
+
+static void spt_CloseShardStream(spt_ShardStream * stream)
+{
+  spt_AsyncReaderClose(stream->reader);
+  for(int b = 0; b < stream->nbufs; ++b) {
+    sptFreeSparseTensor(&stream->bufs[b]);
+    free(stream->words[b]);
+  }
+  free(stream->bufs);
+  free(stream->words);
+  if(stream->packed) {
+    sptFreePackedSparseTensor(&stream->meta);
+  }
+  close(stream->fd);
+}
+
+
+/* mats[nmodes] += MTTKRP of one shard, without clearing the output first. */
+static void spt_MTTKRPAccumulate(
+  sptSparseTensor const * const X,
+  sptMatrix * mats[],
+  sptIndex const mats_order[],
+  sptIndex const mode,
+  const int tk)
+{
+  sptIndex const nmodes = X->nmodes;
+  sptNnzIndex const nnz = X->nnz;
+  sptIndex const stride = mats[0]->stride;
+  sptIndex const R = mats[mode]->ncols;
+  sptValue const * const restrict vals = X->values.data;
+  sptIndex const * const restrict mode_ind = X->inds[mode].data;
+  sptValue * const restrict mvals = mats[nmodes]->values;
+
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex x=0; x<nnz; ++x) {
+    sptValue scratch[R];
+    sptIndex times_mat_index = mats_order[1];
+    sptValue const * times_vals = mats[times_mat_index]->values + (sptNnzIndex) X->inds[times_mat_index].data[x] * stride;
+    sptValue const entry = vals[x];
+    for(sptIndex r=0; r<R; ++r) {
+      scratch[r] = entry * times_vals[r];
+    }
+    for(sptIndex i=2; i<nmodes; ++i) {
+      times_mat_index = mats_order[i];
+      times_vals = mats[times_mat_index]->values + (sptNnzIndex) X->inds[times_mat_index].data[x] * stride;
+      for(sptIndex r=0; r<R; ++r) {
+        scratch[r] *= times_vals[r];
+      }
+    }
+    sptValue * const restrict out = mvals + (sptNnzIndex) mode_ind[x] * stride;
+    for(sptIndex r=0; r<R; ++r) {
+      #pragma omp atomic update
+      out[r] += scratch[r];
+    }
+  }
+}
+
+
+/*
+ * One MTTKRP over the whole file: the shards up to the prefetch distance
+ * ahead of shard s are being read while it is multiplied. If normsq is not NULL, the squared
+ * Frobenius norm of the tensor is accumulated on the way.
+ */
+static int spt_StreamMTTKRP(
+  spt_ShardStream * stream,
+  sptMatrix * mats[],
+  sptIndex const mats_order[],
+  sptIndex const mode,
+  const int tk,
+  double * normsq)
+{
+  sptIndex const nmodes = stream->nmodes;
+  sptMatrix * const M = mats[nmodes];
+  memset(M->values, 0, (size_t) mats[mode]->nrows * M->stride * sizeof(sptValue));
+
+  int result;
+  int const streamed = stream->nshards > 1;
+  sptNnzIndex const nbufs = (sptNnzIndex) stream->nbufs;
+  for(sptNnzIndex s = 0; streamed && s < nbufs; ++s) {
+    result = spt_SubmitShard(stream, (int) s, s);
+    spt_CheckError(result, "SpTns Stream MTTKRP", NULL);
+  }
+
+  for(sptNnzIndex s = 0; s < stream->nshards; ++s) {
+    int const slot = (int) (s % nbufs);
+    sptSparseTensor * const cur = &stream->bufs[slot];
+    if(streamed) {
+      result = spt_AsyncReaderWait(stream->reader, slot);
+      spt_CheckError(result, "SpTns Stream MTTKRP", NULL);
+    }
+
+    if(stream->packed) {
+      sptNnzIndex b_begin, b_end;
+      spt_ShardBlocks(stream, s, &b_begin, &b_end);
+      result = spt_PackedMTTKRPAccumulate(&stream->meta, b_begin, b_end, stream->words[slot],
+        stream->meta.offsets[b_begin], cur->values.data, mats, mats_order, mode, tk);
+      spt_CheckError(result, "SpTns Stream MTTKRP", NULL);
+    } else {
+      spt_MTTKRPAccumulate(cur, mats, mats_order, mode, tk);
+    }
+    if(normsq != NULL) {
+      double sum = 0;
+      sptValue const * const vals = cur->values.data;
+      #pragma omp parallel for reduction(+:sum) num_threads(tk)
+      for(sptNnzIndex x = 0; x < cur->nnz; ++x) {
+        sum += vals[x] * vals[x];
+      }
+      *normsq += sum;
+    }
+
+    if(streamed && s + nbufs < stream->nshards) {
+      result = spt_SubmitShard(stream, slot, s + nbufs);
+      spt_CheckError(result, "SpTns Stream MTTKRP", NULL);
+    }
+  }
+
+  return 0;
+}
+
+
+static double CpdAlsStreamStep(
+  spt_ShardStream * stream,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = stream->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  double normsq = 0;
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata)); // symmetric matrices, but in column-major
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+
+  /* Compute all "ata"s */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+
+  double oldfit = 0;
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      /* The tensor norm is collected during the very first sweep. */
+      sptAssert (spt_StreamMTTKRP(stream, mats, mats_order, m, tk, (it == 0 && m == 0) ? &normsq : NULL) == 0);
+
+      memcpy(mats[m]->values, tmp_mat->values, mats[m]->nrows * stride * sizeof(sptValue));
+
+      sptAssert ( sptOmpMatrixSolveNormals(m, nmodes, ata, mats[m], tk) == 0 );
+
+      if (it == 0 ) {
+        sptMatrix2Norm(mats[m], lambda);
+      } else {
+        sptMatrixMaxNorm(mats[m], lambda);
+      }
+
+      int blas_nrows = (int)(mats[m]->nrows);
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    } // Loop nmodes
+
+    /* The norm is gathered from the shards on the first sweep. */
+    fit = sptKruskalTensorFitNorm(nmodes, normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+
+  return fit;
+}
+
+
+/**
+ * Out-of-core CANDECOMP/PARAFAC decomposition using alternating least squares.
+ *
+ * The tensor is never fully resident: every MTTKRP streams the nonzeros
+ * from a binary tensor file (see sptDumpSparseTensorBinary) in shards of
+ * `shard_nnz` nonzeros, accumulating into mats[nmodes]. Packed files (see
+ * sptDumpPackedSparseTensor) are read in whole blocks and decoded on the fly. Shards are
+ * read ahead, sptSetStreamPrefetchDistance of them, while the current one is
+ * computed, through io_uring with O_DIRECT where the kernel allows it, else
+ * a pool of pread threads; sptSetStreamQueueDepth bounds the reads in flight.
+ * Text tensors can be converted once with the tns2bin example.
+ *
+ * @param[out] ktensor   an uninitialized Kruskal tensor
+ * @param[in]  filename  the binary or packed tensor file
+ * @param[in]  rank      the CPD rank
+ * @param[in]  niters    the maximum number of iterations
+ * @param[in]  tol       the tolerance value for convergence
+ * @param[in]  shard_nnz the number of nonzeros per shard, 0 to load the whole tensor
+ * @param[in]  tk        the number of threads
+ */
+int sptCpdAlsStream(
+  const char * filename,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptNnzIndex const shard_nnz,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  spt_ShardStream stream;
+  int result = spt_OpenShardStream(&stream, filename, shard_nnz);
+  spt_CheckError(result, "CPU  SpTns CPD-ALS Stream", NULL);
+  sptIndex const nmodes = stream.nmodes;
+  sptIndex const * const ndims = stream.bufs[0].ndims;
+#ifdef PARTI_USE_MAGMA
+  magma_init();
+#endif
+
+  result = sptNewKruskalTensor(ktensor, nmodes, ndims, rank);
+  spt_CheckError(result, "CPU  SpTns CPD-ALS Stream", NULL);
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptNewMatrix(mats[m], ndims[m], rank) == 0);
+    sptAssert(sptRandomizeMatrix(mats[m], ndims[m], rank) == 0);
+  }
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = CpdAlsStreamStep(&stream, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SpTns CPD-ALS Stream");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+#ifdef PARTI_USE_MAGMA
+  magma_finalize();
+#endif
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+  spt_CloseShardStream(&stream);
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "sptensor.h"
+
+
+/* neqs = G .^ power on the upper triangle, which is the lower triangle column-major */
+static void spt_SymmGramPower(sptValue * const neqs, sptValue const * const G, sptIndex const rank, sptIndex const stride, sptIndex const power) {
+  for(sptIndex r=0; r < rank; ++r) {
+    for(sptIndex c=r; c < rank; ++c) {
+      sptValue const g = G[(size_t) r * stride + c];
+      sptValue p = 1;
+      for(sptIndex k=0; k < power; ++k) {
+        p *= g;
+      }
+      neqs[(size_t) r * stride + c] = p;
+    }
+  }
+}
+
+
+/* Steps tried per iteration, each half the previous, before one that lowers the fit is taken */
+#define SPT_SYMM_MAX_HALVINGS 8
+
+/*
+ * Fit of the model with factor U and the least squares lambda for it, from
+ * the normal equations of the symmetric model (U^T U) .^ N lambda = b with
+ * b_r = <X, u_r^N>. Leaves the MTTKRP with U in M.
+ */
+static double spt_SymmEvaluate(
+  sptSymmSparseTensor const * const S,
+  sptMatrix const * const U,
+  sptMatrix * const M,
+  sptMatrix * const G,
+  sptMatrix * const neqs,
+  sptValue * const b,
+  sptValue * const lambda,
+  double const normsq,
+  const int tk)
+{
+  sptIndex const rank = U->ncols;
+  sptIndex const stride = U->stride;
+  sptAssert(sptOmpSymmMTTKRP(S, U, M, tk) == 0);
+  for(sptIndex r=0; r < rank; ++r) {
+    double dot = 0;
+    for(sptIndex i=0; i < S->ndim; ++i) {
+      dot += U->values[(size_t) i * stride + r] * M->values[(size_t) i * stride + r];
+    }
+    b[r] = (sptValue) dot;
+    lambda[r] = b[r];
+  }
+  sptAssert(sptOmpMatrixGram(U, G, tk) == 0);
+  spt_SymmGramPower(G->values, G->values, rank, stride, S->nmodes);
+  memcpy(neqs->values, G->values, (size_t) rank * stride * sizeof *neqs->values);
+  sptAssert(spt_OmpSolveFormedNormals(neqs->values, rank, stride, lambda, 1, tk) == 0);
+
+  /* ||X - Y||^2 = ||X||^2 - 2 lambda . b + lambda^T (U^T U) .^ N lambda */
+  double quad = 0, inner = 0;
+  for(sptIndex r=0; r < rank; ++r) {
+    inner += lambda[r] * b[r];
+    quad += lambda[r] * lambda[r] * G->values[(size_t) r * stride + r];
+    for(sptIndex c=r+1; c < rank; ++c) {
+      quad += 2 * lambda[r] * lambda[c] * G->values[(size_t) r * stride + c];
+    }
+  }
+  double const residual = normsq - 2 * inner + quad;
+  return 1 - sqrt(residual > 0 ? residual : 0) / sqrt(normsq);
+}
+
+
+static double OmpCpdAlsSymmetricStep(
+  sptSymmSparseTensor const * const S,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptMatrix * const U,  // Row-major, normalized
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = S->nmodes;
+  sptIndex const stride = U->stride;
+  size_t const ubytes = (size_t) S->ndim * stride * sizeof *U->values;
+
+  sptMatrix M, A, U0, G, neqs;
+  sptAssert(sptNewMatrix(&M, S->ndim, rank) == 0);
+  sptAssert(sptNewMatrix(&A, S->ndim, rank) == 0);
+  sptAssert(sptNewMatrix(&U0, S->ndim, rank) == 0);
+  sptAssert(sptNewMatrix(&G, rank, rank) == 0);
+  sptAssert(sptNewMatrix(&neqs, rank, rank) == 0);
+  sptAssert(M.stride == stride && G.stride == stride);
+  sptValue * const b = malloc(stride * sizeof *b);
+  sptValue * const norms = malloc(rank * sizeof *norms);
+  sptAssert(b != NULL && norms != NULL);
+
+  double const normsq = sptSymmSparseTensorNormSquared(S, tk);
+  double fit = spt_SymmEvaluate(S, U, &M, &G, &neqs, b, lambda, normsq, tk);
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* The N-1 other modes share U: solve M against (U^T U) .^ (N-1) for the new factor A */
+    sptAssert(sptOmpMatrixGram(U, &G, tk) == 0);
+    spt_SymmGramPower(neqs.values, G.values, rank, stride, nmodes - 1);
+    memcpy(A.values, M.values, ubytes);
+    sptAssert(spt_OmpSolveFormedNormals(neqs.values, rank, stride, A.values, S->ndim, tk) == 0);
+    sptMatrix2Norm(&A, norms);
+
+    /*
+     * Unlike with distinct factors, the full step U = A can cycle, so the
+     * step is halved, A's columns turned to agree in sign with U, while it
+     * lowers the fit; the fit never goes down.
+     */
+    memcpy(U0.values, U->values, ubytes);
+    double const prevfit = fit;
+    double step = 1;
+    for(sptIndex h=0; h <= SPT_SYMM_MAX_HALVINGS; ++h, step /= 2) {
+      for(sptIndex r=0; r < rank; ++r) {
+        double dot = 0;
+        for(sptIndex i=0; i < S->ndim; ++i) {
+          dot += U0.values[(size_t) i * stride + r] * A.values[(size_t) i * stride + r];
+        }
+        sptValue const sign = dot < 0 ? -1 : 1;
+        for(sptIndex i=0; i < S->ndim; ++i) {
+          size_t const x = (size_t) i * stride + r;
+          U->values[x] = (1 - step) * U0.values[x] + step * sign * A.values[x];
+        }
+      }
+      sptMatrix2Norm(U, norms);
+      fit = spt_SymmEvaluate(S, U, &M, &G, &neqs, b, lambda, normsq, tk);
+      if(fit >= prevfit) {
+        break;
+      }
+    }
+    if(fit < prevfit) {
+      /* No step helps: U stays, and the unchanged fit ends the iterations */
+      memcpy(U->values, U0.values, ubytes);
+      fit = spt_SymmEvaluate(S, U, &M, &G, &neqs, b, lambda, normsq, tk);
+    }
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  sptFreeMatrix(&M);
+  sptFreeMatrix(&A);
+  sptFreeMatrix(&U0);
+  sptFreeMatrix(&G);
+  sptFreeMatrix(&neqs);
+  free(b);
+  free(norms);
+  return fit;
+}
+
+
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) of a supersymmetric sparse tensor,
+ * X ~ sum_r lambda_r u_r o u_r o .. o u_r, with a single factor U shared by every mode.
+ * Each iteration solves the MTTKRP against the (N-1)-th Hadamard power of U^T U,
+ * normalizes the result into U, backtracking towards the old U while that lowers
+ * the fit, and fits lambda to U by least squares, so lambda carries the sign of
+ * components of odd order. On return the factors of ktensor
+ * are nmodes copies of U, so the Kruskal tensor routines take it as is.
+ * @param[in,out] ktensor the Kruskal tensor; the first factor it already holds is the initial guess
+ * @param[in]  S the supersymmetric sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptCpdAlsSymmetric(
+  sptSymmSparseTensor const * const S,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = S->nmodes;
+  sptIndex * ndims = (sptIndex *)malloc(nmodes * sizeof(*ndims));
+  sptMatrix ** mats = (sptMatrix **)malloc(nmodes * sizeof(*mats));
+  spt_CheckOSError(!ndims || !mats, "CPU  SymmSpTns CPD-ALS");
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ndims[m] = S->ndim;
+  }
+
+  /* Initialize the shared factor */
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, ndims, rank, mats, &warm) == 0);
+  if(warm) {
+    for(sptIndex m=1; m < nmodes; ++m) {
+      sptFreeMatrix(mats[m]);
+      free(mats[m]);
+    }
+  } else {
+    mats[0] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(mats[0], S->ndim, rank) == 0);
+    sptAssert(sptRandomizeMatrix(mats[0], S->ndim, rank) == 0);
+  }
+  sptAssert(sptMatrix2Norm(mats[0], ktensor->lambda) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = OmpCpdAlsSymmetricStep(S, rank, niters, tol, tk, mats[0], ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  SymmSpTns CPD-ALS");
+  sptFreeTimer(timer);
+
+  /* Distinct copies, as sptFreeKruskalTensor frees every factor */
+  for(sptIndex m=1; m < nmodes; ++m) {
+    mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptCopyMatrix(mats[m], mats[0]) == 0);
+  }
+  ktensor->factors = mats;
+  free(ndims);
+
+  return 0;
+}
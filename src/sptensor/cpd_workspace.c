@@ -0,0 +1,309 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/**
+ * Create a reusable workspace for CP-ALS and MTTKRP on tensors of a given shape.
+ * All scratch used inside the iteration loop is allocated here once, so
+ * back-to-back decompositions of same-shaped tensors do not touch the allocator.
+ *
+ * @param[out] ws         the workspace to initialize
+ * @param[in]  nmodes     the number of modes
+ * @param[in]  ndims      the size of each mode
+ * @param[in]  rank       the CPD rank
+ * @param[in]  tk         the number of threads
+ * @param[in]  use_reduce =1: per-thread privatized buffers; =2: row lock pool; =0: OpenMP atomic.
+ */
+int sptNewCpdWorkspace(
+    sptCpdWorkspace * ws,
+    sptIndex const nmodes,
+    sptIndex const ndims[],
+    sptIndex const rank,
+    int const tk,
+    int const use_reduce)
+{
+    int result;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Workspace", "tk < 1");
+    }
+    sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+
+    ws->nmodes = nmodes;
+    ws->rank = rank;
+    ws->tk = tk;
+    ws->fit_every = 1;
+    ws->copy_mats = NULL;
+    ws->dimtree = NULL;
+    ws->rowpart = NULL;
+    ws->hotrows = NULL;
+    ws->tiling = NULL;
+    ws->layouts = NULL;
+#ifdef PARTI_USE_OPENMP
+    ws->lock_pool = NULL;
+#endif
+
+    ws->mats_order = malloc(nmodes * sizeof *ws->mats_order);
+    spt_CheckOSError(!ws->mats_order, "CPD Workspace");
+
+    ws->mttkrp = malloc(sizeof *ws->mttkrp);
+    spt_CheckOSError(!ws->mttkrp, "CPD Workspace");
+    result = sptNewMatrix(ws->mttkrp, max_dim, rank);
+    spt_CheckError(result, "CPD Workspace", NULL);
+    ws->scratch_stride = ws->mttkrp->stride;
+
+    ws->ata = malloc((nmodes+1) * sizeof *ws->ata);
+    spt_CheckOSError(!ws->ata, "CPD Workspace");
+    for(sptIndex m = 0; m < nmodes+1; ++m) {
+        ws->ata[m] = malloc(sizeof *ws->ata[m]);
+        spt_CheckOSError(!ws->ata[m], "CPD Workspace");
+        result = sptNewMatrix(ws->ata[m], rank, rank);
+        spt_CheckError(result, "CPD Workspace", NULL);
+    }
+
+    result = sptNewValueVector(&ws->scratch, (sptNnzIndex)tk * ws->scratch_stride, (sptNnzIndex)tk * ws->scratch_stride);
+    spt_CheckError(result, "CPD Workspace", NULL);
+
+    if(use_reduce == 1) {
+        ws->copy_mats = malloc(tk * sizeof *ws->copy_mats);
+        spt_CheckOSError(!ws->copy_mats, "CPD Workspace");
+        for(int t = 0; t < tk; ++t) {
+            ws->copy_mats[t] = malloc(sizeof *ws->copy_mats[t]);
+            spt_CheckOSError(!ws->copy_mats[t], "CPD Workspace");
+            result = sptNewMatrix(ws->copy_mats[t], max_dim, rank);
+            spt_CheckError(result, "CPD Workspace", NULL);
+        }
+    } else if(use_reduce == 2) {
+#ifdef PARTI_USE_OPENMP
+        ws->lock_pool = sptMutexAlloc();
+#else
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Workspace", "lock pools need OpenMP");
+#endif
+    }
+
+    return 0;
+}
+
+
+/**
+ * Make CP-ALS on this workspace compute MTTKRP through a dimension tree built for X.
+ * Partial products are then shared between the modes of each half of the tree
+ * within a sweep. The workspace can afterwards only be used with X.
+ */
+int sptCpdWorkspaceUseDimTree(sptCpdWorkspace * ws, sptSparseTensor const * const X)
+{
+    if(X->nmodes != ws->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Workspace", "workspace does not match the tensor");
+    }
+    if(ws->dimtree != NULL) {
+        sptFreeMttkrpDimTree(ws->dimtree);
+    } else {
+        ws->dimtree = malloc(sizeof *ws->dimtree);
+        spt_CheckOSError(!ws->dimtree, "CPD Workspace");
+    }
+    int result = sptNewMttkrpDimTree(ws->dimtree, X, ws->rank, ws->tk);
+    if(result != 0) {
+        free(ws->dimtree);
+        ws->dimtree = NULL;
+    }
+    return result;
+}
+
+
+/**
+ * Make MTTKRP on this workspace accumulate into thread-owned rows of X,
+ * which takes precedence over the update strategy chosen at creation.
+ * The workspace can afterwards only be used with X.
+ */
+int sptCpdWorkspaceUseRowPartition(sptCpdWorkspace * ws, sptSparseTensor const * const X)
+{
+    if(X->nmodes != ws->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Workspace", "workspace does not match the tensor");
+    }
+    if(ws->rowpart != NULL) {
+        sptFreeMttkrpRowPartition(ws->rowpart);
+    } else {
+        ws->rowpart = malloc(sizeof *ws->rowpart);
+        spt_CheckOSError(!ws->rowpart, "CPD Workspace");
+    }
+    int result = sptNewMttkrpRowPartition(ws->rowpart, X, ws->rank, ws->tk);
+    if(result != 0) {
+        free(ws->rowpart);
+        ws->rowpart = NULL;
+    }
+    if(ws->hotrows != NULL) {
+        sptFreeMttkrpHotRows(ws->hotrows);
+        free(ws->hotrows);
+        ws->hotrows = NULL;
+    }
+    return result;
+}
+
+
+/**
+ * Make MTTKRP on this workspace privatize, per mode, the output rows of X with
+ * the most nonzeros within a byte budget and update the other rows atomically.
+ * A mode whose full output fits the budget is privatized entirely. This takes
+ * precedence over the update strategy chosen at creation, but not over a row
+ * partition. The workspace can afterwards only be used with X.
+ * @param budget  the bytes of all private rows, 0 for PARTI_MTTKRP_PRIVATE_BYTES
+ */
+int sptCpdWorkspaceUseHotRows(sptCpdWorkspace * ws, sptSparseTensor const * const X, size_t const budget)
+{
+    if(X->nmodes != ws->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Workspace", "workspace does not match the tensor");
+    }
+    if(ws->hotrows != NULL) {
+        sptFreeMttkrpHotRows(ws->hotrows);
+    } else {
+        ws->hotrows = malloc(sizeof *ws->hotrows);
+        spt_CheckOSError(!ws->hotrows, "CPD Workspace");
+    }
+    int result = sptNewMttkrpHotRows(ws->hotrows, X, ws->rank, ws->tk, budget);
+    if(result != 0) {
+        free(ws->hotrows);
+        ws->hotrows = NULL;
+    }
+    return result;
+}
+
+
+/**
+ * Make MTTKRP on this workspace run over coarse tiles of X, so the factor rows
+ * a tile touches stay in cache, see sptNewMttkrpTiling. X is sorted in place;
+ * the workspace can afterwards only be used with X, in that order. This takes
+ * precedence over the update strategy chosen at creation, but not over a row
+ * partition or hot rows.
+ * @param tile_bits  log2 of the tile edge, 0 to size tiles by PARTI_MTTKRP_TILE_BYTES
+ */
+int sptCpdWorkspaceUseTiling(sptCpdWorkspace * ws, sptSparseTensor * X, sptElementIndex const tile_bits)
+{
+    if(X->nmodes != ws->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Workspace", "workspace does not match the tensor");
+    }
+    if(ws->tiling != NULL) {
+        sptFreeMttkrpTiling(ws->tiling);
+    } else {
+        ws->tiling = malloc(sizeof *ws->tiling);
+        spt_CheckOSError(!ws->tiling, "CPD Workspace");
+    }
+    int result = sptNewMttkrpTiling(ws->tiling, X, ws->rank, tile_bits, ws->tk);
+    if(result != 0) {
+        free(ws->tiling);
+        ws->tiling = NULL;
+    }
+    return result;
+}
+
+
+/**
+ * Make MTTKRP on this workspace read, for the modes sptNewCpdLayouts gives
+ * copies within budget, a copy of X sorted with that mode leading, which
+ * takes precedence over every other update strategy for those modes.
+ * The workspace can afterwards only be used with X.
+ * @param budget  the bytes of all copies, 0 for the sptSetCpdLayoutBudget setting
+ */
+int sptCpdWorkspaceUseLayouts(sptCpdWorkspace * ws, sptSparseTensor const * const X, size_t const budget)
+{
+    if(X->nmodes != ws->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPD Workspace", "workspace does not match the tensor");
+    }
+    if(ws->layouts != NULL) {
+        sptFreeCpdLayouts(ws->layouts);
+    } else {
+        ws->layouts = malloc(sizeof *ws->layouts);
+        spt_CheckOSError(!ws->layouts, "CPD Workspace");
+    }
+    int result = sptNewCpdLayouts(ws->layouts, X, ws->rank, ws->tk, budget);
+    if(result != 0) {
+        free(ws->layouts);
+        ws->layouts = NULL;
+    }
+    return result;
+}
+
+
+/**
+ * Make CP-ALS on this workspace evaluate the fit, and so test for convergence,
+ * only every `every` iterations and after the last one. The tolerance then
+ * bounds the change over `every` iterations.
+ */
+int sptCpdWorkspaceSetFitEvery(sptCpdWorkspace * ws, sptIndex const every)
+{
+    if(every < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Workspace", "every < 1");
+    }
+    ws->fit_every = every;
+    return 0;
+}
+
+
+/**
+ * Release a workspace created by sptNewCpdWorkspace.
+ */
+void sptFreeCpdWorkspace(sptCpdWorkspace * ws)
+{
+    if(ws->copy_mats != NULL) {
+        for(int t = 0; t < ws->tk; ++t) {
+            sptFreeMatrix(ws->copy_mats[t]);
+            free(ws->copy_mats[t]);
+        }
+        free(ws->copy_mats);
+        ws->copy_mats = NULL;
+    }
+#ifdef PARTI_USE_OPENMP
+    if(ws->lock_pool != NULL) {
+        sptMutexFree(ws->lock_pool);
+        ws->lock_pool = NULL;
+    }
+#endif
+    if(ws->dimtree != NULL) {
+        sptFreeMttkrpDimTree(ws->dimtree);
+        free(ws->dimtree);
+        ws->dimtree = NULL;
+    }
+    if(ws->rowpart != NULL) {
+        sptFreeMttkrpRowPartition(ws->rowpart);
+        free(ws->rowpart);
+        ws->rowpart = NULL;
+    }
+    if(ws->tiling != NULL) {
+        sptFreeMttkrpTiling(ws->tiling);
+        free(ws->tiling);
+        ws->tiling = NULL;
+    }
+    if(ws->layouts != NULL) {
+        sptFreeCpdLayouts(ws->layouts);
+        free(ws->layouts);
+        ws->layouts = NULL;
+    }
+    sptFreeValueVector(&ws->scratch);
+    for(sptIndex m = 0; m < ws->nmodes+1; ++m) {
+        sptFreeMatrix(ws->ata[m]);
+        free(ws->ata[m]);
+    }
+    free(ws->ata);
+    sptFreeMatrix(ws->mttkrp);
+    free(ws->mttkrp);
+    free(ws->mats_order);
+    ws->nmodes = 0;
+    ws->rank = 0;
+    ws->tk = 0;
+}
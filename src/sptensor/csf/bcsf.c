@@ -0,0 +1,169 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sptensor.h"
+
+/**
+ * Release the memory of a B-CSF sparse tensor
+ * @param bcsf  a B-CSF sparse tensor built by sptSparseTensorToBCSF
+ */
+void sptFreeSparseTensorBCSF(sptSparseTensorBCSF *bcsf)
+{
+    for(sptIndex l = 0; l + 1 < bcsf->nmodes; ++l) {
+        sptFreeIndexVector(&bcsf->fids[l]);
+    }
+    free(bcsf->fids);
+    sptFreeNnzIndexVector(&bcsf->fptr);
+    sptFreeIndexVector(&bcsf->leaf_ids);
+    sptFreeValueVector(&bcsf->values);
+    sptFreeNnzIndexVector(&bcsf->unit_ptr);
+    free(bcsf->mode_order);
+    free(bcsf->ndims);
+    bcsf->nmodes = 0;
+    bcsf->nnz = 0;
+}
+
+
+/**
+ * Convert a COO sparse tensor into B-CSF format for MTTKRP on one mode
+ * @param bcsf          an uninitialized B-CSF sparse tensor
+ * @param tsr           the COO sparse tensor, left untouched
+ * @param mode          the MTTKRP output mode, which becomes the root level
+ * @param max_unit_nnz  the most leaves of a fiber and of a work unit, 0 for PARTI_BCSF_UNIT_NNZ
+ * @param tk            the number of threads used to sort a copy of tsr
+ *
+ * The other modes follow the root in increasing order of their sizes, as in
+ * sptSparseTensorToCSF. Duplicate coordinates are kept as separate leaves.
+ */
+int sptSparseTensorToBCSF(
+    sptSparseTensorBCSF *bcsf,
+    sptSparseTensor const * const tsr,
+    sptIndex const mode,
+    sptNnzIndex max_unit_nnz,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    if(nmodes < 2 || mode >= nmodes) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "B-CSF Convert", "nmodes < 2 or mode out of range");
+    }
+    if(max_unit_nnz == 0) {
+        max_unit_nnz = PARTI_BCSF_UNIT_NNZ;
+    }
+
+    bcsf->nmodes = nmodes;
+    bcsf->nnz = tsr->nnz;
+    bcsf->ndims = malloc(nmodes * sizeof *bcsf->ndims);
+    spt_CheckOSError(!bcsf->ndims, "B-CSF Convert");
+    memcpy(bcsf->ndims, tsr->ndims, nmodes * sizeof *bcsf->ndims);
+    bcsf->mode_order = malloc(nmodes * sizeof *bcsf->mode_order);
+    spt_CheckOSError(!bcsf->mode_order, "B-CSF Convert");
+    bcsf->mode_order[0] = mode;
+    sptIndex nlevels = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m == mode) {
+            continue;
+        }
+        sptIndex k = nlevels++;
+        while(k > 1 && tsr->ndims[bcsf->mode_order[k-1]] > tsr->ndims[m]) {
+            bcsf->mode_order[k] = bcsf->mode_order[k-1];
+            --k;
+        }
+        bcsf->mode_order[k] = m;
+    }
+
+    sptSparseTensorCSF csf;
+    result = sptSparseTensorToCSF(&csf, tsr, bcsf->mode_order, tk);
+    spt_CheckError(result, "B-CSF Convert", NULL);
+
+    /* Split the fibers, the nodes of the last internal level, into bounded pieces */
+    sptIndex const last = nmodes - 2;
+    sptNnzIndexVector fiber_of;
+    result = spt_SplitHeavySegments(&fiber_of, &bcsf->fptr, csf.fptr[last].data, csf.nfibs[last], max_unit_nnz);
+    spt_CheckError(result, "B-CSF Convert", NULL);
+    sptNnzIndex const nfibs = fiber_of.len;
+    bcsf->nfibs = nfibs;
+
+    /* Each piece keeps the whole path of its fiber, found by walking up the tree */
+    bcsf->fids = malloc((nmodes - 1) * sizeof *bcsf->fids);
+    spt_CheckOSError(!bcsf->fids, "B-CSF Convert");
+    sptNnzIndex * node = malloc((csf.nfibs[last] + 1) * sizeof *node);
+    sptNnzIndex * parent = malloc((sptMaxNnzIndexArray(csf.nfibs, nmodes) + 1) * sizeof *parent);
+    spt_CheckOSError(!node || !parent, "B-CSF Convert");
+    for(sptNnzIndex n = 0; n < csf.nfibs[last]; ++n) {
+        node[n] = n;
+    }
+    for(sptIndex l = last + 1; l-- > 0; ) {
+        if(l < last) {
+            for(sptNnzIndex n = 0; n < csf.nfibs[l]; ++n) {
+                for(sptNnzIndex c = csf.fptr[l].data[n]; c < csf.fptr[l].data[n+1]; ++c) {
+                    parent[c] = n;
+                }
+            }
+            for(sptNnzIndex n = 0; n < csf.nfibs[last]; ++n) {
+                node[n] = parent[node[n]];
+            }
+        }
+        result = sptNewIndexVector(&bcsf->fids[l], nfibs, nfibs);
+        spt_CheckError(result, "B-CSF Convert", NULL);
+        for(sptNnzIndex f = 0; f < nfibs; ++f) {
+            bcsf->fids[l].data[f] = csf.fids[l].data[node[fiber_of.data[f]]];
+        }
+    }
+    free(parent);
+    free(node);
+    sptFreeNnzIndexVector(&fiber_of);
+
+    /* Consecutive pieces of one slice share a unit while their leaves fit */
+    sptNnzIndex const * const fptr = bcsf->fptr.data;
+    sptIndex const * const roots = bcsf->fids[0].data;
+    for(int pass = 0; pass < 2; ++pass) {
+        sptNnzIndex u = 0;
+        for(sptNnzIndex f = 0; f < nfibs; ) {
+            sptNnzIndex g = f + 1;
+            while(g < nfibs && roots[g] == roots[f] && fptr[g+1] - fptr[f] <= max_unit_nnz) {
+                ++g;
+            }
+            if(pass == 1) {
+                bcsf->unit_ptr.data[u] = f;
+            }
+            ++u;
+            f = g;
+        }
+        if(pass == 0) {
+            bcsf->nunits = u;
+            result = sptNewNnzIndexVector(&bcsf->unit_ptr, u + 1, u + 1);
+            spt_CheckError(result, "B-CSF Convert", NULL);
+        }
+    }
+    bcsf->unit_ptr.data[bcsf->nunits] = nfibs;
+
+    /* The leaves and values move over as they are */
+    bcsf->leaf_ids = csf.fids[nmodes-1];
+    csf.fids[nmodes-1].data = NULL;
+    csf.fids[nmodes-1].len = csf.fids[nmodes-1].cap = 0;
+    bcsf->values = csf.values;
+    csf.values.data = NULL;
+    csf.values.len = csf.values.cap = 0;
+    sptFreeSparseTensorCSF(&csf);
+
+    return 0;
+}
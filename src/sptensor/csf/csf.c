@@ -0,0 +1,186 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sptensor.h"
+
+/* The shallowest level at which nonzero z starts a new node, given the tensor is sorted in mode_order */
+static sptIndex spt_CSFFirstNewLevel(
+    sptSparseTensor const * const sorted,
+    sptIndex const * const mode_order,
+    sptNnzIndex const z)
+{
+    sptIndex const nmodes = sorted->nmodes;
+    if(z == 0) {
+        return 0;
+    }
+    for(sptIndex l = 0; l + 1 < nmodes; ++l) {
+        sptIndex const * const inds = sorted->inds[mode_order[l]].data;
+        if(inds[z] != inds[z-1]) {
+            return l;
+        }
+    }
+    return nmodes - 1;
+}
+
+
+/**
+ * The mode stored at each CSF level: mode_order checked, or with NULL the
+ * modes in increasing order of their sizes.
+ */
+int spt_CSFModeOrder(
+    sptIndex * const out,
+    sptSparseTensor const * const tsr,
+    sptIndex const * const mode_order)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    if(mode_order != NULL) {
+        for(sptIndex l = 0; l < nmodes; ++l) {
+            if(mode_order[l] >= nmodes) {
+                spt_CheckError(SPTERR_VALUE_ERROR, "CSF Convert", "mode_order out of range");
+            }
+            out[l] = mode_order[l];
+        }
+    } else {
+        /* Short modes near the root give the fewest fibers at the top levels */
+        for(sptIndex l = 0; l < nmodes; ++l) {
+            out[l] = l;
+        }
+        for(sptIndex l = 1; l < nmodes; ++l) {
+            sptIndex const m = out[l];
+            sptIndex k = l;
+            while(k > 0 && tsr->ndims[out[k-1]] > tsr->ndims[m]) {
+                out[k] = out[k-1];
+                --k;
+            }
+            out[k] = m;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Release the memory of a CSF sparse tensor
+ * @param csf  a CSF sparse tensor built by sptSparseTensorToCSF
+ */
+void sptFreeSparseTensorCSF(sptSparseTensorCSF *csf)
+{
+    for(sptIndex l = 0; l < csf->nmodes; ++l) {
+        if(l + 1 < csf->nmodes) {
+            sptFreeNnzIndexVector(&csf->fptr[l]);
+        }
+        sptFreeIndexVector(&csf->fids[l]);
+    }
+    free(csf->fptr);
+    free(csf->fids);
+    free(csf->nfibs);
+    free(csf->ndims);
+    free(csf->mode_order);
+    sptFreeValueVector(&csf->values);
+    csf->nmodes = 0;
+    csf->nnz = 0;
+}
+
+
+/**
+ * Convert a COO sparse tensor into CSF format
+ * @param csf         an uninitialized CSF sparse tensor
+ * @param tsr         the COO sparse tensor, left untouched
+ * @param mode_order  the mode stored at each CSF level, from root to leaves; NULL
+ *                    puts the modes in increasing order of their sizes
+ * @param tk          the number of threads used to sort a copy of tsr
+ *
+ * Duplicate coordinates are kept as separate leaves.
+ */
+int sptSparseTensorToCSF(
+    sptSparseTensorCSF *csf,
+    sptSparseTensor const * const tsr,
+    sptIndex const * const mode_order,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+
+    csf->nmodes = nmodes;
+    csf->nnz = nnz;
+    csf->ndims = malloc(nmodes * sizeof *csf->ndims);
+    spt_CheckOSError(!csf->ndims, "CSF Convert");
+    memcpy(csf->ndims, tsr->ndims, nmodes * sizeof *csf->ndims);
+    csf->mode_order = malloc(nmodes * sizeof *csf->mode_order);
+    spt_CheckOSError(!csf->mode_order, "CSF Convert");
+    result = spt_CSFModeOrder(csf->mode_order, tsr, mode_order);
+    spt_CheckError(result, "CSF Convert", NULL);
+
+    sptSparseTensor sorted;
+    result = sptCopySparseTensor(&sorted, tsr, tk);
+    spt_CheckError(result, "CSF Convert", NULL);
+    sptSparseTensorSortIndexCustomOrder(&sorted, csf->mode_order, 1);
+
+    /* Count the nodes of each level: level l starts a node wherever any of levels 0..l changes */
+    csf->nfibs = calloc(nmodes, sizeof *csf->nfibs);
+    spt_CheckOSError(!csf->nfibs, "CSF Convert");
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptIndex const first = spt_CSFFirstNewLevel(&sorted, csf->mode_order, z);
+        for(sptIndex l = first; l < nmodes; ++l) {
+            ++csf->nfibs[l];
+        }
+    }
+
+    csf->fptr = malloc(nmodes * sizeof *csf->fptr);
+    spt_CheckOSError(!csf->fptr, "CSF Convert");
+    csf->fids = malloc(nmodes * sizeof *csf->fids);
+    spt_CheckOSError(!csf->fids, "CSF Convert");
+    for(sptIndex l = 0; l < nmodes; ++l) {
+        if(l + 1 < nmodes) {
+            result = sptNewNnzIndexVector(&csf->fptr[l], csf->nfibs[l] + 1, csf->nfibs[l] + 1);
+            spt_CheckError(result, "CSF Convert", NULL);
+        }
+        result = sptNewIndexVector(&csf->fids[l], csf->nfibs[l], csf->nfibs[l]);
+        spt_CheckError(result, "CSF Convert", NULL);
+    }
+
+    /* Fill: a new node at level l points at the next node to be created at level l+1 */
+    sptNnzIndex * cnt = calloc(nmodes, sizeof *cnt);
+    spt_CheckOSError(!cnt, "CSF Convert");
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptIndex const first = spt_CSFFirstNewLevel(&sorted, csf->mode_order, z);
+        for(sptIndex l = first; l < nmodes; ++l) {
+            if(l + 1 < nmodes) {
+                csf->fptr[l].data[cnt[l]] = cnt[l+1];
+            }
+            csf->fids[l].data[cnt[l]] = sorted.inds[csf->mode_order[l]].data[z];
+            ++cnt[l];
+        }
+    }
+    for(sptIndex l = 0; l + 1 < nmodes; ++l) {
+        csf->fptr[l].data[csf->nfibs[l]] = csf->nfibs[l+1];
+    }
+    free(cnt);
+
+    /* The leaves follow the sorted nonzeros, so the values move over as they are */
+    csf->values = sorted.values;
+    sorted.values.data = NULL;
+    sorted.values.len = sorted.values.cap = 0;
+    sptFreeSparseTensor(&sorted);
+
+    return 0;
+}
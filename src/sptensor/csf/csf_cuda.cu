@@ -0,0 +1,190 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thrust/device_ptr.h>
+#include <thrust/scan.h>
+#include "../sptensor.h"
+#include "../sort_cuda.h"
+#include "../../cudawrap.h"
+
+/* first[z]: the first level at which sorted nonzero z starts a node, as spt_CSFFirstNewLevel */
+__global__ static void spt_CSFFirstLevelKernel(
+    sptIndex *first, sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nmodes, sptIndex const *order)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptIndex l = 0;
+    if(z != 0) {
+        while(l + 1 < nmodes && inds[order[l] * nnz + z] == inds[order[l] * nnz + z - 1]) {
+            ++l;
+        }
+    }
+    first[z] = l;
+}
+
+/* flags[z]: whether nonzero z starts a node at level l */
+__global__ static void spt_CSFLevelFlagKernel(
+    sptNnzIndex *flags, sptIndex const *first, sptNnzIndex const nnz, sptIndex const l)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    flags[z] = first[z] <= l;
+}
+
+/* The nodes of level l: their indices, and as fptr the id of the level l+1 node each one opens with */
+__global__ static void spt_CSFLevelFillKernel(
+    sptIndex *fids, sptNnzIndex *fptr, sptIndex const *first, sptNnzIndex const *id, sptNnzIndex const *child_id,
+    sptIndex const *mode_inds, sptNnzIndex const nnz, sptIndex const l)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz || first[z] > l) {
+        return;
+    }
+    fids[id[z]] = mode_inds[z];
+    if(fptr != NULL) {
+        fptr[id[z]] = child_id != NULL ? child_id[z] : z;
+    }
+}
+
+
+/**
+ * Convert a COO sparse tensor into CSF format on the GPU, with the result of
+ * sptSparseTensorToCSF. The nonzeros are sorted on the device and every level
+ * is numbered by a prefix sum over its node starts, from the leaves upward;
+ * the finished levels are downloaded into host vectors.
+ * @param csf         an uninitialized CSF sparse tensor
+ * @param tsr         the COO sparse tensor, left untouched
+ * @param mode_order  the mode stored at each CSF level, from root to leaves; NULL
+ *                    puts the modes in increasing order of their sizes
+ */
+int sptCudaSparseTensorToCSF(
+    sptSparseTensorCSF *csf,
+    sptSparseTensor const * const tsr,
+    sptIndex const * const mode_order)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(nnz == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA CSF Convert", "no nonzeros");
+    }
+
+    csf->nmodes = nmodes;
+    csf->nnz = nnz;
+    csf->ndims = (sptIndex *) malloc(nmodes * sizeof *csf->ndims);
+    spt_CheckOSError(!csf->ndims, "CUDA CSF Convert");
+    memcpy(csf->ndims, tsr->ndims, nmodes * sizeof *csf->ndims);
+    csf->mode_order = (sptIndex *) malloc(nmodes * sizeof *csf->mode_order);
+    spt_CheckOSError(!csf->mode_order, "CUDA CSF Convert");
+    result = spt_CSFModeOrder(csf->mode_order, tsr, mode_order);
+    spt_CheckError(result, "CUDA CSF Convert", NULL);
+
+    sptIndex * dev_inds;
+    sptValue * dev_vals;
+    uint64_t * dev_keys;
+    sptIndex nwords;
+    result = spt_CudaUploadCoo(tsr, &dev_inds, &dev_vals);
+    spt_CheckError(result, "CUDA CSF Convert", NULL);
+    result = spt_CudaLexKeys(&dev_keys, &nwords, dev_inds, nnz, nmodes, tsr->ndims, csf->mode_order, 0, 0);
+    spt_CheckError(result, "CUDA CSF Convert", NULL);
+    result = spt_CudaSortCoo(dev_inds, dev_vals, nnz, nmodes, dev_keys, nwords);
+    spt_CheckError(result, "CUDA CSF Convert", NULL);
+    cudaFree(dev_keys);
+
+    sptIndex * dev_order;
+    sptIndex * dev_first;
+    result = sptCudaDuplicateMemory(&dev_order, csf->mode_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    result = cudaMalloc((void **) &dev_first, nnz * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    spt_CSFFirstLevelKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_first, dev_inds, nnz, nmodes, dev_order);
+    cudaFree(dev_order);
+
+    csf->nfibs = (sptNnzIndex *) calloc(nmodes, sizeof *csf->nfibs);
+    spt_CheckOSError(!csf->nfibs, "CUDA CSF Convert");
+    csf->fptr = (sptNnzIndexVector *) malloc(nmodes * sizeof *csf->fptr);
+    spt_CheckOSError(!csf->fptr, "CUDA CSF Convert");
+    csf->fids = (sptIndexVector *) malloc(nmodes * sizeof *csf->fids);
+    spt_CheckOSError(!csf->fids, "CUDA CSF Convert");
+
+    /* Node ids of the level below, NULL at the leaves where they are z itself */
+    sptNnzIndex * dev_flags, * dev_ids, * dev_child_ids = NULL, * dev_fptr;
+    sptIndex * dev_fids;
+    result = cudaMalloc((void **) &dev_flags, nnz * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    result = cudaMalloc((void **) &dev_fids, nnz * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    result = cudaMalloc((void **) &dev_fptr, (nnz + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    for(sptIndex l = nmodes; l-- > 0; ) {
+        result = cudaMalloc((void **) &dev_ids, nnz * sizeof (sptNnzIndex));
+        spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+        spt_CSFLevelFlagKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_flags, dev_first, nnz, l);
+        sptNnzIndex last_flag, last_id;
+        cudaMemcpy(&last_flag, dev_flags + nnz - 1, sizeof last_flag, cudaMemcpyDeviceToHost);
+        thrust::device_ptr<sptNnzIndex> flags_ptr(dev_flags);
+        thrust::device_ptr<sptNnzIndex> ids_ptr(dev_ids);
+        thrust::exclusive_scan(flags_ptr, flags_ptr + nnz, ids_ptr);
+        cudaMemcpy(&last_id, dev_ids + nnz - 1, sizeof last_id, cudaMemcpyDeviceToHost);
+        sptNnzIndex const nf = last_id + last_flag;
+        csf->nfibs[l] = nf;
+
+        spt_CSFLevelFillKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            dev_fids, l + 1 < nmodes ? dev_fptr : NULL, dev_first, dev_ids, dev_child_ids,
+            dev_inds + csf->mode_order[l] * nnz, nnz, l);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+
+        result = sptNewIndexVector(&csf->fids[l], nf, nf);
+        spt_CheckError(result, "CUDA CSF Convert", NULL);
+        result = cudaMemcpy(csf->fids[l].data, dev_fids, nf * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+        if(l + 1 < nmodes) {
+            result = sptNewNnzIndexVector(&csf->fptr[l], nf + 1, nf + 1);
+            spt_CheckError(result, "CUDA CSF Convert", NULL);
+            result = cudaMemcpy(csf->fptr[l].data, dev_fptr, nf * sizeof (sptNnzIndex), cudaMemcpyDeviceToHost);
+            spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+            csf->fptr[l].data[nf] = csf->nfibs[l+1];
+        }
+
+        cudaFree(dev_child_ids);
+        dev_child_ids = dev_ids;
+    }
+    cudaFree(dev_child_ids);
+    cudaFree(dev_flags);
+    cudaFree(dev_fids);
+    cudaFree(dev_fptr);
+    cudaFree(dev_first);
+
+    /* The leaves follow the sorted nonzeros */
+    result = sptNewValueVector(&csf->values, nnz, nnz);
+    spt_CheckError(result, "CUDA CSF Convert", NULL);
+    result = cudaMemcpy(csf->values.data, dev_vals, nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA CSF Convert");
+    cudaFree(dev_inds);
+    cudaFree(dev_vals);
+
+    return 0;
+}
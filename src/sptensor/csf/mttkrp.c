@@ -0,0 +1,230 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sptensor.h"
+
+typedef struct {
+    sptSparseTensorCSF const * X;
+    sptMatrix ** mats;
+    sptIndex target;            /// CSF level of the output mode
+    sptIndex R;
+    sptIndex stride;
+    sptValue * mvals;           /// output rows, mats[nmodes]
+    sptValue * below;           /// this thread's bottom-up rows, one per level
+    sptValue * prefix;          /// this thread's top-down rows, one per level
+    int use_atomic;
+} spt_CSFMttkrpContext;
+
+
+/* out = sum over the subtree of node n at level l of the value times the factor rows of levels l+1.. */
+static void spt_CSFBelow(
+    spt_CSFMttkrpContext const * const ctx,
+    sptIndex const l,
+    sptNnzIndex const n,
+    sptValue * const restrict out)
+{
+    sptSparseTensorCSF const * const X = ctx->X;
+    sptIndex const leaf = X->nmodes - 1;
+    sptIndex const R = ctx->R;
+    sptIndex const stride = ctx->stride;
+    sptNnzIndex const begin = X->fptr[l].data[n];
+    sptNnzIndex const end = X->fptr[l].data[n+1];
+    sptIndex const * const child_ids = X->fids[l+1].data;
+    sptValue const * const child_vals = ctx->mats[X->mode_order[l+1]]->values;
+
+    for(sptIndex r = 0; r < R; ++r) {
+        out[r] = 0;
+    }
+    if(l + 1 == leaf) {
+        sptValue const * const vals = X->values.data;
+        for(sptNnzIndex c = begin; c < end; ++c) {
+            sptValue const entry = vals[c];
+            sptValue const * const restrict row = child_vals + (sptNnzIndex)child_ids[c] * stride;
+            #pragma omp simd
+            for(sptIndex r = 0; r < R; ++r) {
+                out[r] += entry * row[r];
+            }
+        }
+    } else {
+        sptValue * const restrict sub = ctx->below + (l+1) * stride;
+        for(sptNnzIndex c = begin; c < end; ++c) {
+            spt_CSFBelow(ctx, l+1, c, sub);
+            sptValue const * const restrict row = child_vals + (sptNnzIndex)child_ids[c] * stride;
+            #pragma omp simd
+            for(sptIndex r = 0; r < R; ++r) {
+                out[r] += sub[r] * row[r];
+            }
+        }
+    }
+}
+
+
+/* Walk from node n at level l down to the target level, carrying the Hadamard product of the factor rows above l */
+static void spt_CSFDescend(
+    spt_CSFMttkrpContext const * const ctx,
+    sptIndex const l,
+    sptNnzIndex const n,
+    sptValue const * const restrict prefix)  // NULL at the root
+{
+    sptSparseTensorCSF const * const X = ctx->X;
+    sptIndex const leaf = X->nmodes - 1;
+    sptIndex const R = ctx->R;
+    sptIndex const stride = ctx->stride;
+
+    if(l == ctx->target) {
+        sptValue * const restrict out_row = ctx->mvals + (sptNnzIndex)X->fids[l].data[n] * stride;
+        sptValue * const restrict contrib = ctx->below + l * stride;
+        if(l == leaf) {
+            sptValue const entry = X->values.data[n];
+            for(sptIndex r = 0; r < R; ++r) {
+                contrib[r] = prefix != NULL ? entry * prefix[r] : entry;
+            }
+        } else {
+            spt_CSFBelow(ctx, l, n, contrib);
+            if(prefix != NULL) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    contrib[r] *= prefix[r];
+                }
+            }
+        }
+        if(ctx->use_atomic) {
+            for(sptIndex r = 0; r < R; ++r) {
+                #pragma omp atomic update
+                out_row[r] += contrib[r];
+            }
+        } else {
+            for(sptIndex r = 0; r < R; ++r) {
+                out_row[r] += contrib[r];
+            }
+        }
+        return;
+    }
+
+    sptValue * const restrict cur = ctx->prefix + l * stride;
+    sptValue const * const restrict row = ctx->mats[X->mode_order[l]]->values + (sptNnzIndex)X->fids[l].data[n] * stride;
+    if(prefix != NULL) {
+        #pragma omp simd
+        for(sptIndex r = 0; r < R; ++r) {
+            cur[r] = prefix[r] * row[r];
+        }
+    } else {
+        #pragma omp simd
+        for(sptIndex r = 0; r < R; ++r) {
+            cur[r] = row[r];
+        }
+    }
+    for(sptNnzIndex c = X->fptr[l].data[n]; c < X->fptr[l].data[n+1]; ++c) {
+        spt_CSFDescend(ctx, l+1, c, cur);
+    }
+}
+
+
+/**
+ * OpenMP parallelized MTTKRP on a CSF sparse tensor
+ * @param[in]  X     the CSF sparse tensor input
+ * @param[in]  mats  (N+1) dense matrices, with mats[nmodes] as the output, ndims[mode] * R
+ * @param[in]  mode  the mode on which the MTTKRP is performed
+ * @param[in]  tk    the number of threads
+ *
+ * Partial Khatri-Rao products are shared along fibers. Trees are processed in
+ * parallel; when mode is the root level each output row belongs to a single
+ * tree and is written without atomics, otherwise rows are updated atomically
+ * once per node of the mode's level instead of once per nonzero.
+ */
+int sptOmpMTTKRPCSF(
+    sptSparseTensorCSF const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CSF MTTKRP", "mode >= nmodes");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CSF MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns CSF MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const stride = mats[0]->stride;
+    sptIndex target = 0;
+    while(X->mode_order[target] != mode) {
+        ++target;
+    }
+
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * stride * sizeof *mvals);
+    if(X->nnz == 0) {
+        return 0;
+    }
+
+    sptNnzIndex const bufsize = (sptNnzIndex)2 * nmodes * stride;
+    sptValue * const bufs = malloc((size_t)tk * bufsize * sizeof *bufs);
+    spt_CheckOSError(!bufs, "CPU  SpTns CSF MTTKRP");
+
+    spt_CSFMttkrpContext shared;
+    shared.X = X;
+    shared.mats = mats;
+    shared.target = target;
+    shared.R = mats[mode]->ncols;
+    shared.stride = stride;
+    shared.mvals = mvals;
+    shared.use_atomic = target != 0 && tk > 1;
+
+    sptNnzIndex const nroots = X->nfibs[0];
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        spt_CSFMttkrpContext ctx = shared;
+        ctx.below = bufs + tid * bufsize;
+        ctx.prefix = ctx.below + nmodes * stride;
+
+        #pragma omp for schedule(dynamic, 1)
+        for(sptNnzIndex n = 0; n < nroots; ++n) {
+            spt_CSFDescend(&ctx, 0, n, NULL);
+        }
+    }
+
+    free(bufs);
+    return 0;
+}
+
+
+/**
+ * Sequential MTTKRP on a CSF sparse tensor, see sptOmpMTTKRPCSF
+ */
+int sptMTTKRPCSF(
+    sptSparseTensorCSF const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode)
+{
+    return sptOmpMTTKRPCSF(X, mats, mode, 1);
+}
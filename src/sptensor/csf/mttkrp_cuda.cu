@@ -0,0 +1,172 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "../sptensor.h"
+#include "../../cudawrap.h"
+
+
+/* One warp per B-CSF unit, lanes over rank columns. Each lane sums the leaves
+ * of a fiber times their factor rows in a register, scales the sum by the
+ * rows of the fiber's path and adds it to the slice's running sum, so a unit
+ * issues one atomic per column however many nonzeros it holds. Units hold at
+ * most max_unit_nnz leaves, so the warps of a launch are balanced. blockDim.x
+ * must be 32. */
+__global__ static void spt_MTTKRPKernelBCSF(
+    const sptIndex nmodes,
+    const sptNnzIndex nunits,
+    const sptIndex R,
+    const sptIndex stride,
+    const sptNnzIndex * unit_ptr,
+    const sptNnzIndex * fptr,
+    sptIndex ** const fids,
+    const sptIndex * leaf_ids,
+    const sptValue * vals,
+    const sptIndex * dev_mode_order,
+    sptValue ** dev_mats)
+{
+    const sptNnzIndex unit = (sptNnzIndex) blockIdx.x * blockDim.y + threadIdx.y;
+    const sptIndex lane = threadIdx.x;
+    if(unit >= nunits) {
+        return;
+    }
+    const sptNnzIndex fbegin = unit_ptr[unit];
+    const sptNnzIndex fend = unit_ptr[unit+1];
+    if(fbegin == fend) {
+        return;
+    }
+    const sptIndex last = nmodes - 2;
+    sptValue const * const leaf_mat = dev_mats[dev_mode_order[nmodes-1]];
+    sptValue * const out_row = dev_mats[nmodes] + (sptNnzIndex) fids[0][fbegin] * stride;
+
+    for(sptIndex r0 = 0; r0 < R; r0 += 32) {
+        const sptIndex r = r0 + lane;
+        if(r >= R) {
+            break;
+        }
+        sptValue acc = 0;
+        for(sptNnzIndex f = fbegin; f < fend; ++f) {
+            sptValue fiber = 0;
+            for(sptNnzIndex z = fptr[f]; z < fptr[f+1]; ++z) {
+                fiber += vals[z] * leaf_mat[(sptNnzIndex) leaf_ids[z] * stride + r];
+            }
+            for(sptIndex l = 1; l <= last; ++l) {
+                fiber *= dev_mats[dev_mode_order[l]][(sptNnzIndex) fids[l][f] * stride + r];
+            }
+            acc += fiber;
+        }
+        atomicAdd(&out_row[r], acc);
+    }
+}
+
+
+/**
+ * CUDA MTTKRP on a B-CSF sparse tensor
+ * @param[in]  X    the B-CSF sparse tensor, built for `mode`
+ * @param[out] mats (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ */
+int sptCudaMTTKRPBCSF(
+    sptSparseTensorBCSF const * const X,
+    sptMatrix ** const mats,
+    sptIndex const mode)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    int result;
+
+    if(X->mode_order[0] != mode) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns B-CSF MTTKRP", "tensor was built for another mode");
+    }
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns B-CSF MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns B-CSF MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex * dev_mode_order;
+    result = sptCudaDuplicateMemory(&dev_mode_order, X->mode_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptNnzIndex * dev_unit_ptr;
+    result = sptCudaDuplicateMemory(&dev_unit_ptr, X->unit_ptr.data, (X->nunits + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptNnzIndex * dev_fptr;
+    result = sptCudaDuplicateMemory(&dev_fptr, X->fptr.data, (X->nfibs + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptIndex * dev_leaf_ids;
+    result = sptCudaDuplicateMemory(&dev_leaf_ids, X->leaf_ids.data, X->nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptValue * dev_vals;
+    result = sptCudaDuplicateMemory(&dev_vals, X->values.data, X->nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptIndex ** fids_header = new sptIndex *[nmodes-1];
+    for(sptIndex l = 0; l + 1 < nmodes; ++l) {
+        fids_header[l] = X->fids[l].data;
+    }
+    sptIndex ** dev_fids;
+    result = sptCudaDuplicateMemoryIndirect(&dev_fids, fids_header, nmodes-1, X->nfibs, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+
+    sptValue ** mats_header = new sptValue *[nmodes+1];
+    sptNnzIndex * const lengths = new sptNnzIndex[nmodes+1];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats_header[m] = mats[m]->values;
+        lengths[m] = mats[m]->nrows * stride;
+    }
+    mats_header[nmodes] = mats[nmodes]->values;
+    lengths[nmodes] = mats[mode]->nrows * stride;
+    sptValue ** dev_mats;
+    result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    sptValue * dev_out;
+    result = cudaMemcpy(&dev_out, dev_mats + nmodes, sizeof dev_out, cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    result = cudaMemset(dev_out, 0, lengths[nmodes] * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+
+    dim3 dimBlock(32, 8);
+    sptNnzIndex const nblocks = (X->nunits + dimBlock.y - 1) / dimBlock.y;
+    if(nblocks > 0) {
+        spt_MTTKRPKernelBCSF<<<nblocks, dimBlock>>>(
+            nmodes, X->nunits, R, stride,
+            dev_unit_ptr, dev_fptr, dev_fids, dev_leaf_ids, dev_vals,
+            dev_mode_order, dev_mats);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+    }
+
+    result = cudaMemcpy(mats[nmodes]->values, dev_out, lengths[nmodes] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns B-CSF MTTKRP");
+
+    spt_CudaPoolFree(dev_mode_order);
+    spt_CudaPoolFree(dev_unit_ptr);
+    spt_CudaPoolFree(dev_fptr);
+    spt_CudaPoolFree(dev_leaf_ids);
+    spt_CudaPoolFree(dev_vals);
+    spt_CudaPoolFree(dev_fids);
+    spt_CudaPoolFree(dev_mats);
+    delete[] fids_header;
+    delete[] mats_header;
+    delete[] lengths;
+
+    return 0;
+}
@@ -0,0 +1,373 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sptensor.h"
+#include "../cudawrap.h"
+
+/*
+ * Kernel choice for the impl_num = PARTI_CUDA_IMPL_AUTO mode of sptCudaMTTKRP,
+ * sptCudaMTTKRPOneKernel and sptCudaSparseTensorMulMatrixOneKernel.
+ *
+ * By default a kernel is picked from the tensor, rank and device. With
+ * PARTI_CUDA_AUTOTUNE=1 the candidates are timed once per shape class instead,
+ * and with PARTI_CUDA_KERNEL_CACHE=<file>, or else in the "cuda-kernels" entry
+ * of the plan cache (sptPlanCachePath), the timed choices are kept across runs.
+ * A shape class is the operation, device, order, mode, rank and the magnitudes
+ * of nnz and nnz per slice.
+ */
+
+namespace {
+
+struct spt_CudaKernelChoice {
+    char op[16];
+    char device[64];
+    sptIndex nmodes;
+    sptIndex mode;
+    sptIndex rank;
+    int lg_nnz;
+    int lg_slice;
+    sptIndex impl;
+};
+
+struct spt_CudaKernelCache {
+    std::mutex lock;
+    std::vector<spt_CudaKernelChoice> choices;
+    bool loaded = false;
+};
+
+spt_CudaKernelCache & spt_GetCudaKernelCache() {
+    static spt_CudaKernelCache cache;
+    return cache;
+}
+
+int spt_Log2Floor(double x) {
+    int lg = 0;
+    while(x >= 2) {
+        x /= 2;
+        ++lg;
+    }
+    return lg;
+}
+
+/* The shape class of an operation on X, impl left 0 */
+spt_CudaKernelChoice spt_CudaShapeClass(char const * op, sptSparseTensor const * X, sptIndex mode, sptIndex rank, cudaDeviceProp const * prop) {
+    spt_CudaKernelChoice key;
+    memset(&key, 0, sizeof key);
+    strncpy(key.op, op, sizeof key.op - 1);
+    strncpy(key.device, prop->name, sizeof key.device - 1);
+    for(char * c = key.device; *c != '\0'; ++c) {
+        if(*c == ' ') {
+            *c = '_';
+        }
+    }
+    key.nmodes = X->nmodes;
+    key.mode = mode;
+    key.rank = rank;
+    key.lg_nnz = spt_Log2Floor((double) X->nnz);
+    key.lg_slice = spt_Log2Floor((double) X->nnz / (X->ndims[mode] > 0 ? X->ndims[mode] : 1));
+    return key;
+}
+
+bool spt_SameShapeClass(spt_CudaKernelChoice const & a, spt_CudaKernelChoice const & b) {
+    return strcmp(a.op, b.op) == 0 && strcmp(a.device, b.device) == 0 && a.nmodes == b.nmodes &&
+        a.mode == b.mode && a.rank == b.rank && a.lg_nnz == b.lg_nnz && a.lg_slice == b.lg_slice;
+}
+
+/* The file PARTI_CUDA_KERNEL_CACHE names, or the plan cache's entry; empty with neither */
+std::string spt_CudaKernelCachePath() {
+    char const * env = getenv("PARTI_CUDA_KERNEL_CACHE");
+    if(env != NULL) {
+        return env;
+    }
+    char * cached = sptPlanCachePath(NULL, NULL, "cuda-kernels");
+    std::string path = cached != NULL ? cached : "";
+    free(cached);
+    return path;
+}
+
+/* Read the choices kept in the kernel cache file once; the caller holds the lock */
+void spt_LoadCudaKernelCache(spt_CudaKernelCache & cache) {
+    if(cache.loaded) {
+        return;
+    }
+    cache.loaded = true;
+    std::string const path = spt_CudaKernelCachePath();
+    if(path.empty()) {
+        return;
+    }
+    FILE * fp = fopen(path.c_str(), "r");
+    if(fp == NULL) {
+        return;
+    }
+    spt_CudaKernelChoice c;
+    memset(&c, 0, sizeof c);
+    while(fscanf(fp, " %15s %63s %"PARTI_SCN_INDEX" %"PARTI_SCN_INDEX" %"PARTI_SCN_INDEX" %d %d %"PARTI_SCN_INDEX,
+        c.op, c.device, &c.nmodes, &c.mode, &c.rank, &c.lg_nnz, &c.lg_slice, &c.impl) == 8) {
+        cache.choices.push_back(c);
+    }
+    fclose(fp);
+}
+
+bool spt_LookupCudaKernel(spt_CudaKernelChoice * key) {
+    spt_CudaKernelCache & cache = spt_GetCudaKernelCache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    spt_LoadCudaKernelCache(cache);
+    for(auto const & c : cache.choices) {
+        if(spt_SameShapeClass(c, *key)) {
+            key->impl = c.impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+void spt_StoreCudaKernel(spt_CudaKernelChoice const & choice) {
+    spt_CudaKernelCache & cache = spt_GetCudaKernelCache();
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cache.choices.push_back(choice);
+    std::string const path = spt_CudaKernelCachePath();
+    if(path.empty()) {
+        return;
+    }
+    FILE * fp = fopen(path.c_str(), "a");
+    if(fp == NULL) {
+        return;     // The cache only saves time, a run does not depend on it
+    }
+    fprintf(fp, "%s %s %"PARTI_PRI_INDEX" %"PARTI_PRI_INDEX" %"PARTI_PRI_INDEX" %d %d %"PARTI_PRI_INDEX"\n",
+        choice.op, choice.device, choice.nmodes, choice.mode, choice.rank, choice.lg_nnz, choice.lg_slice, choice.impl);
+    fclose(fp);
+}
+
+bool spt_CudaAutotuneEnabled() {
+    char const * env = getenv("PARTI_CUDA_AUTOTUNE");
+    return env != NULL && env[0] == '1';
+}
+
+int spt_CurrentDeviceProp(cudaDeviceProp * prop) {
+    int device;
+    int result = cudaGetDevice(&device);
+    if(result == cudaSuccess) {
+        result = cudaGetDeviceProperties(prop, device);
+    }
+    return result;
+}
+
+/* The device L2 bytes of the machine profile, which a profile file may lower for shared devices */
+size_t spt_DeviceCacheBytes(cudaDeviceProp const * prop) {
+    sptMachineProfile const * const profile = sptGetMachineProfile();
+    return profile->has_device && profile->device_cache > 0 ? profile->device_cache : (size_t) prop->l2CacheSize;
+}
+
+/* Bytes of the factor rows the Khatri-Rao product of a mode reads */
+size_t spt_KhatriRaoBytes(sptSparseTensor const * X, sptIndex mode, sptIndex stride) {
+    size_t bytes = 0;
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(m != mode) {
+            bytes += (size_t) X->ndims[m] * stride * sizeof (sptValue);
+        }
+    }
+    return bytes;
+}
+
+/* Seconds of one call after a warm-up call */
+template <class Fn>
+double spt_TimeCudaKernel(Fn run) {
+    if(run() != 0) {
+        return DBL_MAX;
+    }
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+    int const result = run();
+    sptStopTimer(timer);
+    double const seconds = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+    return result == 0 ? seconds : DBL_MAX;
+}
+
+}
+
+
+/**
+ * The sptCudaMTTKRP (one_kernel = 0) or sptCudaMTTKRPOneKernel (one_kernel = 1)
+ * kernel for X, mats and mode, see PARTI_CUDA_IMPL_AUTO. Timing the candidates
+ * leaves mats[nmodes] as it was.
+ */
+sptIndex spt_CudaSelectMTTKRPImpl(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode,
+    int const one_kernel)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    sptIndex const max_nthreadsy = 16;
+
+    /* Only the third-order tensors have a choice of kernels */
+    if(nmodes != 3) {
+        return one_kernel ? 15 : 5;
+    }
+
+    cudaDeviceProp prop;
+    if(spt_CurrentDeviceProp(&prop) != cudaSuccess) {
+        cudaGetLastError();
+        return one_kernel ? 15 : 5;
+    }
+    spt_CudaKernelChoice key = spt_CudaShapeClass(one_kernel ? "mttkrp1" : "mttkrp", X, mode, R, &prop);
+    if(spt_LookupCudaKernel(&key)) {
+        return key.impl;
+    }
+
+    /*
+     * Threads along the rank with the nonzeros split over the rest of the block
+     * coalesce the factor rows (5 and 15). A rank one decomposition leaves no
+     * rank to split, so one thread per nonzero is better. Once the factor rows
+     * read by the Khatri-Rao product do not fit in the profiled L2, looping
+     * over rank blocks outside the nonzeros (16) keeps one column block of
+     * them resident.
+     */
+    sptIndex impl;
+    if(R == 1) {
+        impl = one_kernel ? 11 : 1;
+    } else if(one_kernel && R > max_nthreadsy && spt_KhatriRaoBytes(X, mode, stride) > spt_DeviceCacheBytes(&prop)) {
+        impl = 16;
+    } else {
+        impl = one_kernel ? 15 : 5;
+    }
+
+    if(!spt_CudaAutotuneEnabled()) {
+        return impl;
+    }
+
+    /* sptCudaMTTKRP accumulates into mats[nmodes], so every trial starts from a copy */
+    size_t const out_len = (size_t) mats[mode]->nrows * stride;
+    sptValue * const saved = (sptValue *) malloc(out_len * sizeof (sptValue));
+    if(saved == NULL) {
+        return impl;
+    }
+    memcpy(saved, mats[nmodes]->values, out_len * sizeof (sptValue));
+
+    /* The 2D kernels without rank split put the whole rank in one block dimension */
+    sptIndex const multi_candidates[] = { 1, 2, 3, 4, 5 };
+    sptIndex const one_candidates[] = { 11, 12, 15, 16 };
+    sptIndex const * const candidates = one_kernel ? one_candidates : multi_candidates;
+    int const ncandidates = one_kernel ? 4 : 5;
+    double best = DBL_MAX;
+    for(int c = 0; c < ncandidates; ++c) {
+        sptIndex const cand = candidates[c];
+        if((cand == 2 || cand == 4) && R > 64) {
+            continue;
+        }
+        double const seconds = spt_TimeCudaKernel([&]() {
+            memcpy(mats[nmodes]->values, saved, out_len * sizeof (sptValue));
+            return one_kernel ? sptCudaMTTKRPOneKernel(X, mats, mats_order, mode, cand)
+                              : sptCudaMTTKRP(X, mats, mats_order, mode, cand);
+        });
+        if(seconds < best) {
+            best = seconds;
+            impl = cand;
+        }
+    }
+    memcpy(mats[nmodes]->values, saved, out_len * sizeof (sptValue));
+    free(saved);
+
+    key.impl = impl;
+    spt_StoreCudaKernel(key);
+    return impl;
+}
+
+
+/**
+ * The sptCudaSparseTensorMulMatrixOneKernel kernel for X, U and mode, and the
+ * shared memory it needs in *smen_size, see PARTI_CUDA_IMPL_AUTO.
+ */
+sptIndex spt_CudaSelectTTMImpl(
+    sptSparseTensor * const X,
+    const sptMatrix * const U,
+    sptIndex const mode,
+    sptNnzIndex * const smen_size)
+{
+    sptIndex const R = U->ncols;
+    sptIndex const max_nthreadsy = 16;
+    sptNnzIndex const max_nthreads_per_block = 256;
+    *smen_size = max_nthreads_per_block * sizeof (sptValue);
+
+    cudaDeviceProp prop;
+    if(spt_CurrentDeviceProp(&prop) != cudaSuccess) {
+        cudaGetLastError();
+        return R < max_nthreadsy ? 13 : 14;
+    }
+    bool const smem_fits = *smen_size <= prop.sharedMemPerBlock;
+    spt_CudaKernelChoice key = spt_CudaShapeClass("ttm", X, mode, R, &prop);
+    if(spt_LookupCudaKernel(&key) && (key.impl != 15 || smem_fits)) {
+        return key.impl;
+    }
+
+    /*
+     * One thread per fiber for a single column; threads along the columns
+     * otherwise, looping over column blocks once the rank exceeds a block row,
+     * with the partial products staged in shared memory when a block's worth fits.
+     */
+    sptIndex impl;
+    if(R == 1) {
+        impl = 11;
+    } else if(R < max_nthreadsy) {
+        impl = 13;
+    } else {
+        impl = smem_fits ? 15 : 14;
+    }
+
+    if(!spt_CudaAutotuneEnabled()) {
+        return impl;
+    }
+
+    sptIndex const candidates[] = { 11, 12, 13, 14, 15, 16 };
+    double best = DBL_MAX;
+    for(int c = 0; c < 6; ++c) {
+        sptIndex const cand = candidates[c];
+        if(cand == 15 && !smem_fits) {
+            continue;
+        }
+        double const seconds = spt_TimeCudaKernel([&]() {
+            sptSemiSparseTensor Y;
+            int const result = sptCudaSparseTensorMulMatrixOneKernel(&Y, X, U, mode, cand, *smen_size);
+            if(result == 0) {
+                sptFreeSemiSparseTensor(&Y);
+            }
+            return result;
+        });
+        if(seconds < best) {
+            best = seconds;
+            impl = cand;
+        }
+    }
+
+    key.impl = impl;
+    spt_StoreCudaKernel(key);
+    return impl;
+}
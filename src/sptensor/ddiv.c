@@ -25,11 +25,15 @@
  * @param[in]  X the input X
  * @param[in]  Y the input Y
  *
- * The name "DotDiv" comes from the MATLAB operator "./".
+ * The name "DotDiv" comes from the MATLAB operator "./". Unsorted inputs are
+ * intersected with a hash join, and Z then follows the order of the larger one.
  */
 int sptSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
     sptNnzIndex i, j;
     int result;
+    if(!spt_SparseTensorIsSorted(X) || !spt_SparseTensorIsSorted(Y)) {
+        return spt_SparseTensorHashJoin(Z, X, Y, spt_DivValues, 0, 1, "SpTns DotDiv");
+    }
     /* Ensure X and Y are in same shape */
     if(Y->nmodes != X->nmodes) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns DotDiv", "shape mismatch");
@@ -40,7 +44,11 @@ int sptSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sp
         }
     }
 
-    sptNewSparseTensor(Z, X->nmodes, X->ndims);
+    result = sptNewSparseTensor(Z, X->nmodes, X->ndims);
+    spt_CheckError(result, "SpTns DotDiv", NULL);
+    /* At most the smaller nnz survives the intersection */
+    result = spt_SparseTensorReserve(Z, X->nnz < Y->nnz ? X->nnz : Y->nnz);
+    spt_CheckError(result, "SpTns DotDiv", NULL);
 
     /* Multiply elements one by one, assume indices are ordered */
     i = 0;
@@ -54,7 +62,7 @@ int sptSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sp
             ++i;
         } else {
             for(sptIndex mode = 0; mode < X->nmodes; ++mode) {
-                result = sptAppendIndexVector(&Z->inds[mode], X->inds[mode].data[i] * Y->inds[mode].data[j]);
+                result = sptAppendIndexVector(&Z->inds[mode], X->inds[mode].data[i]);
                 spt_CheckError(result, "SpTns DotDiv", NULL);
             }
             result = sptAppendValueVector(&Z->values, X->values.data[i] / Y->values.data[j]);
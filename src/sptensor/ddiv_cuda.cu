@@ -0,0 +1,30 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+
+/**
+ * CUDA parallelized element wise divide two sparse tensors
+ * @param[out] Z the result of X/Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptCudaSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
+    return spt_CudaSparseTensorIntersect(Z, X, Y, 1, "CUDA SpTns DotDiv");
+}
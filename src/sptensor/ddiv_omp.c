@@ -0,0 +1,51 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+
+/**
+ * OpenMP parallelized element wise divide two sparse tensors
+ * @param[out] Z the result of X/Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ *
+ * Sorted inputs are intersected along a merge path and Z comes out sorted;
+ * otherwise they are hash-joined and Z follows the order of the larger one.
+ */
+int sptOmpSparseTensorDotDiv(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
+    int const nt = sptExecThreads(0);
+    int result;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(spt_SparseTensorIsSorted(X) && spt_SparseTensorIsSorted(Y)) {
+        result = spt_SparseTensorMerge(Z, X, Y, spt_DivValues, 0, nt, "OMP SpTns DotDiv");
+    } else {
+        result = spt_SparseTensorHashJoin(Z, X, Y, spt_DivValues, 0, nt, "OMP SpTns DotDiv");
+    }
+    spt_CheckError(result, "OMP SpTns DotDiv", NULL);
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "OMP  SpTns DotDiv");
+    sptFreeTimer(timer);
+
+    return 0;
+}
@@ -0,0 +1,558 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thrust/device_ptr.h>
+#include <thrust/fill.h>
+#include <thrust/scan.h>
+#include "sptensor.h"
+#include "sort_cuda.h"
+#include "mmul_cuda_kernels.h"
+#include "../cudawrap.h"
+#ifdef PARTI_USE_CUFILE
+#include <cufile.h>
+#endif
+
+/*
+ * Device-resident sparse tensors. Upload and download are the only
+ * transfers; the operations below take and return device handles, so a
+ * pipeline of GPU steps keeps its intermediates on the device.
+ */
+
+/**
+ * Copy a sparse tensor to the current CUDA device. A pattern tensor gets
+ * explicit values of 1.
+ * @param[out] dX an uninitialized device sparse tensor
+ * @param[in]  X  the host sparse tensor
+ */
+int sptDeviceUploadSparseTensor(sptDeviceSparseTensor *dX, const sptSparseTensor *X) {
+    dX->nmodes = X->nmodes;
+    dX->nnz = X->nnz;
+    dX->ndims = (sptIndex *) malloc(X->nmodes * sizeof *dX->ndims);
+    spt_CheckOSError(!dX->ndims, "DevSpTns Upload");
+    memcpy(dX->ndims, X->ndims, X->nmodes * sizeof *dX->ndims);
+    int result = spt_CudaUploadCoo(X, &dX->inds, &dX->values);
+    spt_CheckError(result, "DevSpTns Upload", NULL);
+    if(sptSparseTensorIsPattern(X)) {
+        thrust::device_ptr<sptValue> vals(dX->values);
+        thrust::fill(vals, vals + X->nnz, (sptValue) 1);
+    }
+    return 0;
+}
+
+/**
+ * Copy a device sparse tensor back to the host
+ * @param[out] X  an uninitialized host sparse tensor
+ * @param[in]  dX the device sparse tensor
+ */
+int sptDeviceDownloadSparseTensor(sptSparseTensor *X, const sptDeviceSparseTensor *dX) {
+    sptNnzIndex const nnz = dX->nnz;
+    int result = spt_SparseTensorNewSized(X, dX->nmodes, dX->ndims, nnz);
+    spt_CheckError(result, "DevSpTns Download", NULL);
+    for(sptIndex m = 0; m < dX->nmodes; ++m) {
+        result = cudaMemcpy(X->inds[m].data, dX->inds + m * nnz, nnz * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "DevSpTns Download");
+    }
+    result = cudaMemcpy(X->values.data, dX->values, nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "DevSpTns Download");
+    return 0;
+}
+
+/**
+ * Release a device sparse tensor
+ * @param dX a valid device sparse tensor
+ */
+void sptFreeDeviceSparseTensor(sptDeviceSparseTensor *dX) {
+    cudaFree(dX->inds);
+    cudaFree(dX->values);
+    free(dX->ndims);
+    dX->inds = NULL;
+    dX->values = NULL;
+    dX->ndims = NULL;
+    dX->nmodes = 0;
+    dX->nnz = 0;
+}
+
+
+/* Bytes per read of the bounce path; two pinned buffers of this size are in flight */
+#define SPT_DEVICE_LOAD_CHUNK ((size_t) 8 << 20)
+
+/* Read bytes at offset of fd into device memory at dst, through two pinned buffers: one fills while the other copies */
+static int spt_DeviceReadBounce(char *dst, int fd, uint64_t const offset, uint64_t const bytes,
+    char * const pinned[2], cudaEvent_t const copied[2], cudaStream_t const stream)
+{
+    int k = 0;
+    for(uint64_t pos = 0; pos < bytes; pos += SPT_DEVICE_LOAD_CHUNK, k ^= 1) {
+        size_t const n = bytes - pos < SPT_DEVICE_LOAD_CHUNK ? (size_t) (bytes - pos) : SPT_DEVICE_LOAD_CHUNK;
+        /* Buffer k is free once its previous copy is done */
+        int result = cudaEventSynchronize(copied[k]);
+        spt_CheckCudaError(result != 0, "DevSpTns Load");
+        for(size_t got = 0; got < n; ) {
+            ssize_t const r = pread(fd, pinned[k] + got, n - got, (off_t) (offset + pos + got));
+            spt_CheckOSError(r <= 0, "DevSpTns Load");
+            got += (size_t) r;
+        }
+        result = cudaMemcpyAsync(dst + pos, pinned[k], n, cudaMemcpyHostToDevice, stream);
+        spt_CheckCudaError(result != 0, "DevSpTns Load");
+        result = cudaEventRecord(copied[k], stream);
+        spt_CheckCudaError(result != 0, "DevSpTns Load");
+    }
+    return 0;
+}
+
+#ifdef PARTI_USE_CUFILE
+/*
+ * Read the sections of the file straight into device memory with cuFile
+ * (GPUDirect Storage). Returns nonzero, having read nothing usable, when
+ * the driver, the file system or the device refuses, so the caller falls
+ * back to the bounce path.
+ */
+static int spt_DeviceReadDirect(char * const dsts[], uint64_t const offsets[], uint64_t const bytes[], int const nsections, const char *filename)
+{
+    if(cuFileDriverOpen().err != CU_FILE_SUCCESS) {
+        return 1;
+    }
+    int fd = open(filename, O_RDONLY | O_DIRECT);
+    if(fd < 0) {
+        cuFileDriverClose();
+        return 1;
+    }
+    CUfileDescr_t descr;
+    memset(&descr, 0, sizeof descr);
+    descr.handle.fd = fd;
+    descr.type = CU_FILE_HANDLE_TYPE_OPAQUE_FD;
+    CUfileHandle_t handle;
+    int const registered = cuFileHandleRegister(&handle, &descr).err == CU_FILE_SUCCESS;
+    int failed = !registered;
+    for(int i = 0; i < nsections && !failed; ++i) {
+        for(uint64_t pos = 0; pos < bytes[i] && !failed; ) {
+            ssize_t const r = cuFileRead(handle, dsts[i], bytes[i] - pos, (off_t) (offsets[i] + pos), (off_t) pos);
+            failed = r <= 0;
+            pos += failed ? 0 : (uint64_t) r;
+        }
+    }
+    if(registered) {
+        cuFileHandleDeregister(handle);
+    }
+    close(fd);
+    cuFileDriverClose();
+    return failed;
+}
+#endif
+
+/**
+ * Read a binary sparse tensor, as written by sptDumpSparseTensorBinary,
+ * straight onto the current CUDA device, without a host copy of the tensor.
+ * Built with USE_CUFILE, the sections are read by GPUDirect Storage from the
+ * file into device memory; when that is unavailable, or without it, they
+ * pass through two pinned bounce buffers, the disk read of one chunk
+ * overlapping the copy of the previous. The file must have been written with
+ * the index and value widths of this build.
+ * @param[out] dX       an uninitialized device sparse tensor
+ * @param[in]  filename the binary file to read
+ */
+int sptDeviceLoadSparseTensorBinary(sptDeviceSparseTensor *dX, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    spt_CheckOSError(fd < 0, "DevSpTns Load");
+    spt_SparseTensorBinaryHeader header;
+    ssize_t r = pread(fd, &header, sizeof header, 0);
+    spt_CheckOSError(r != (ssize_t) sizeof header, "DevSpTns Load");
+    int result = spt_SparseTensorBinaryCheckHeader(&header);
+    spt_CheckError(result, "DevSpTns Load", NULL);
+    if(header.index_width != sizeof (sptIndex) || header.value_width != sizeof (sptValue)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "DevSpTns Load", "index or value width differs from this build, use sptLoadSparseTensorBinary");
+    }
+
+    sptIndex const nmodes = header.nmodes;
+    sptNnzIndex const nnz = header.nnz;
+    uint64_t * dims = new uint64_t[nmodes];
+    r = pread(fd, dims, nmodes * sizeof *dims, sizeof header);
+    spt_CheckOSError(r != (ssize_t) (nmodes * sizeof *dims), "DevSpTns Load");
+    dX->nmodes = nmodes;
+    dX->nnz = nnz;
+    dX->ndims = (sptIndex *) malloc(nmodes * sizeof *dX->ndims);
+    spt_CheckOSError(!dX->ndims, "DevSpTns Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(dims[m] > PARTI_INDEX_MAX) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "DevSpTns Load", "dimension exceeds sptIndex");
+        }
+        dX->ndims[m] = (sptIndex) dims[m];
+    }
+    delete[] dims;
+    result = cudaMalloc((void **) &dX->inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "DevSpTns Load");
+    result = cudaMalloc((void **) &dX->values, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSpTns Load");
+
+    /* The index arrays, each padded in the file, then the values */
+    int const nsections = (int) nmodes + 1;
+    char ** dsts = new char *[nsections];
+    uint64_t * offsets = new uint64_t[2 * nsections];
+    uint64_t * bytes = offsets + nsections;
+    uint64_t const ind_stride = spt_BinaryAlignUp(nnz * sizeof (sptIndex));
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        dsts[m] = (char *) (dX->inds + m * nnz);
+        offsets[m] = header.data_offset + m * ind_stride;
+        bytes[m] = nnz * sizeof (sptIndex);
+    }
+    dsts[nmodes] = (char *) dX->values;
+    offsets[nmodes] = header.data_offset + nmodes * ind_stride;
+    bytes[nmodes] = nnz * sizeof (sptValue);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    int direct = 0;
+#ifdef PARTI_USE_CUFILE
+    direct = spt_DeviceReadDirect(dsts, offsets, bytes, nsections, filename) == 0;
+#endif
+    if(!direct) {
+        char * pinned[2];
+        cudaEvent_t copied[2];
+        cudaStream_t stream;
+        pinned[0] = (char *) spt_CudaHostAlloc(2 * SPT_DEVICE_LOAD_CHUNK);
+        spt_CheckCudaError(pinned[0] == NULL, "DevSpTns Load");
+        pinned[1] = pinned[0] + SPT_DEVICE_LOAD_CHUNK;
+        result = cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking);
+        spt_CheckCudaError(result != 0, "DevSpTns Load");
+        for(int k = 0; k < 2; ++k) {
+            result = cudaEventCreateWithFlags(&copied[k], cudaEventDisableTiming);
+            spt_CheckCudaError(result != 0, "DevSpTns Load");
+        }
+        for(int i = 0; i < nsections; ++i) {
+            result = spt_DeviceReadBounce(dsts[i], fd, offsets[i], bytes[i], pinned, copied, stream);
+            spt_CheckError(result, "DevSpTns Load", NULL);
+        }
+        result = cudaStreamSynchronize(stream);
+        spt_CheckCudaError(result != 0, "DevSpTns Load");
+        cudaEventDestroy(copied[0]);
+        cudaEventDestroy(copied[1]);
+        cudaStreamDestroy(stream);
+        spt_CudaHostFree(pinned[0]);
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, direct ? "DevSpTns Load (GDS)" : "DevSpTns Load (bounce)");
+    sptFreeTimer(timer);
+
+    delete[] offsets;
+    delete[] dsts;
+    close(fd);
+    return 0;
+}
+
+__global__ static void spt_DeviceDotMulKernel(sptNnzIndex const nnz, sptValue *Z_val, sptValue const *X_val, sptValue const *Y_val)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z < nnz) {
+        Z_val[z] = X_val[z] * Y_val[z];
+    }
+}
+
+/**
+ * Device version of sptCudaSparseTensorDotMulEq, for X and Y with exactly
+ * the same nonzero positions. The products that come out zero are kept as
+ * explicit zeros, since removing them would need a round trip or a
+ * compaction the next step may not want.
+ * @param[out] dZ an uninitialized device sparse tensor
+ * @param[in]  dX the first operand
+ * @param[in]  dY the second operand
+ */
+int sptDeviceSparseTensorDotMulEq(sptDeviceSparseTensor *dZ, const sptDeviceSparseTensor *dX, const sptDeviceSparseTensor *dY) {
+    if(dY->nmodes != dX->nmodes || dY->nnz != dX->nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSpTns DotMul", "shape or nonzero distribution mismatch");
+    }
+    for(sptIndex m = 0; m < dX->nmodes; ++m) {
+        if(dY->ndims[m] != dX->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSpTns DotMul", "shape mismatch");
+        }
+    }
+    sptNnzIndex const nnz = dX->nnz;
+    dZ->nmodes = dX->nmodes;
+    dZ->nnz = nnz;
+    dZ->ndims = (sptIndex *) malloc(dX->nmodes * sizeof *dZ->ndims);
+    spt_CheckOSError(!dZ->ndims, "DevSpTns DotMul");
+    memcpy(dZ->ndims, dX->ndims, dX->nmodes * sizeof *dZ->ndims);
+    int result = cudaMalloc((void **) &dZ->inds, (dX->nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "DevSpTns DotMul");
+    result = cudaMemcpy(dZ->inds, dX->inds, dX->nmodes * nnz * sizeof (sptIndex), cudaMemcpyDeviceToDevice);
+    spt_CheckCudaError(result != 0, "DevSpTns DotMul");
+    result = cudaMalloc((void **) &dZ->values, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSpTns DotMul");
+
+    if(nnz > 0) {
+        spt_DeviceDotMulKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(nnz, dZ->values, dX->values, dY->values);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "DevSpTns DotMul kernel");
+    }
+    return 0;
+}
+
+
+/**
+ * Sort a device sparse tensor in place in the natural order, mode 0 first,
+ * as sptSparseTensorSortIndex does on the host; the element-wise device
+ * operations take their operands in this order.
+ * @param[in,out] dX the device sparse tensor
+ */
+int sptDeviceSparseTensorSortIndex(sptDeviceSparseTensor *dX) {
+    sptIndex const nmodes = dX->nmodes;
+    if(dX->nnz < 2) {
+        return 0;
+    }
+    sptIndex * order = new sptIndex[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        order[m] = m;
+    }
+    uint64_t * dev_keys;
+    sptIndex nwords;
+    int result = spt_CudaLexKeys(&dev_keys, &nwords, dX->inds, dX->nnz, nmodes, dX->ndims, order, 0, 0);
+    delete[] order;
+    spt_CheckError(result, "DevSpTns Sort", NULL);
+    result = spt_CudaSortCoo(dX->inds, dX->values, dX->nnz, nmodes, dev_keys, nwords);
+    spt_CheckError(result, "DevSpTns Sort", NULL);
+    cudaFree(dev_keys);
+    return 0;
+}
+
+/* start[z]: whether sorted nonzero z starts a new fiber, differing from the previous one outside mode */
+__global__ static void spt_DeviceFiberStartKernel(
+    sptNnzIndex *start, sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nmodes, sptIndex const mode)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptNnzIndex s = z == 0;
+    for(sptIndex m = 0; m < nmodes && !s; ++m) {
+        s = m != mode && inds[m * nnz + z] != inds[m * nnz + z - 1];
+    }
+    start[z] = s;
+}
+
+/* fiberidx[run[z] - 1] = z at every fiber start, and the fiber's indices copied to Y */
+__global__ static void spt_DeviceFiberHeadKernel(
+    sptNnzIndex *fiberidx, sptIndex *Y_inds, sptNnzIndex const nfibs,
+    sptNnzIndex const *start, sptNnzIndex const *run,
+    sptIndex const *X_inds, sptNnzIndex const nnz, sptIndex const nmodes, sptIndex const mode)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz || !start[z]) {
+        return;
+    }
+    sptNnzIndex const f = run[z] - 1;
+    fiberidx[f] = z;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            Y_inds[m * nfibs + f] = X_inds[m * nnz + z];
+        }
+    }
+}
+
+/**
+ * Device version of sptCudaSparseTensorMulMatrix, Y = X x_mode U^T into a
+ * device semi-sparse tensor. X is sorted in place on the device so that its
+ * fibers along mode are runs, which a scan numbers; nothing is copied to the
+ * host but the fiber count.
+ * @param[out] dY   an uninitialized device semi-sparse tensor
+ * @param[in]  dX   the device sparse tensor, reordered in place
+ * @param[in]  dU   the device matrix, with ndims[mode] rows and at most 1024 columns
+ * @param[in]  mode the mode to multiply
+ */
+int sptDeviceSparseTensorMulMatrix(sptDeviceSemiSparseTensor *dY, sptDeviceSparseTensor *dX, const sptDeviceMatrix *dU, sptIndex const mode) {
+    sptIndex const nmodes = dX->nmodes;
+    sptNnzIndex const nnz = dX->nnz;
+    if(mode >= nmodes || dX->ndims[mode] != dU->nrows || dU->ncols > 1024) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSpTns * Mtx", "shape mismatch");
+    }
+    int result;
+
+    /* The other modes in order, then mode, as sptSparseTensorSortIndexAtMode */
+    sptIndex * order = new sptIndex[nmodes];
+    for(sptIndex m = 0, k = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            order[k++] = m;
+        }
+    }
+    order[nmodes - 1] = mode;
+    if(nnz > 1) {
+        uint64_t * dev_keys;
+        sptIndex nwords;
+        result = spt_CudaLexKeys(&dev_keys, &nwords, dX->inds, nnz, nmodes, dX->ndims, order, 0, 0);
+        spt_CheckError(result, "DevSpTns * Mtx", NULL);
+        result = spt_CudaSortCoo(dX->inds, dX->values, nnz, nmodes, dev_keys, nwords);
+        spt_CheckError(result, "DevSpTns * Mtx", NULL);
+        cudaFree(dev_keys);
+    }
+    delete[] order;
+
+    sptNnzIndex * dev_work;
+    result = cudaMalloc((void **) &dev_work, (2 * nnz + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    sptNnzIndex * const dev_start = dev_work;
+    sptNnzIndex * const dev_run = dev_work + nnz;
+    sptNnzIndex nfibs = 0;
+    if(nnz > 0) {
+        spt_DeviceFiberStartKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_start, dX->inds, nnz, nmodes, mode);
+        thrust::device_ptr<sptNnzIndex> start(dev_start), run(dev_run);
+        thrust::inclusive_scan(start, start + nnz, run);
+        result = cudaMemcpy(&nfibs, dev_run + nnz - 1, sizeof nfibs, cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    }
+
+    dY->nmodes = nmodes;
+    dY->mode = mode;
+    dY->nnz = nfibs;
+    dY->ndims = (sptIndex *) malloc(nmodes * sizeof *dY->ndims);
+    spt_CheckOSError(!dY->ndims, "DevSpTns * Mtx");
+    memcpy(dY->ndims, dX->ndims, nmodes * sizeof *dY->ndims);
+    dY->ndims[mode] = dU->ncols;
+    dY->stride = ((dU->ncols-1)/8+1)*8;
+    result = cudaMalloc((void **) &dY->inds, (nmodes * nfibs + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    result = cudaMalloc((void **) &dY->values, (nfibs * dY->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    result = cudaMemset(dY->values, 0, nfibs * dY->stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    sptNnzIndex * dev_fiberidx;
+    result = cudaMalloc((void **) &dev_fiberidx, (nfibs + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    result = cudaMemcpy(dev_fiberidx + nfibs, &nnz, sizeof nnz, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(nnz > 0) {
+        spt_DeviceFiberHeadKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            dev_fiberidx, dY->inds, nfibs, dev_start, dev_run, dX->inds, nnz, nmodes, mode);
+        sptNnzIndex const max_nblocks = 32768;
+        sptNnzIndex nthreadsX = 256 / dU->ncols;
+        if(nthreadsX == 0) {
+            nthreadsX = 1;
+        }
+        dim3 dimBlock(nthreadsX, dU->ncols);
+        sptNnzIndex const all_nblocks = (nfibs + nthreadsX - 1) / nthreadsX;
+        for(sptNnzIndex block_offset = 0; block_offset < all_nblocks; block_offset += max_nblocks) {
+            sptNnzIndex const nblocks = all_nblocks - block_offset < max_nblocks ? all_nblocks - block_offset : max_nblocks;
+            spt_TTMNaiveKernel<<<nblocks, dimBlock>>>(
+                dY->values, dY->stride, nfibs,
+                dX->values, nnz, dX->inds + mode * nnz,
+                dev_fiberidx, nfibs + 1,
+                dU->values, dU->nrows, dU->ncols, dU->stride,
+                block_offset);
+        }
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "DevSpTns * Mtx kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "DevSpTns * Mtx");
+    sptFreeTimer(timer);
+
+    result = cudaFree(dev_fiberidx);
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    result = cudaFree(dev_work);
+    spt_CheckCudaError(result != 0, "DevSpTns * Mtx");
+    return 0;
+}
+
+
+/* Threads (r, k) of a block take columns r, r + blockDim.x, ... of nonzero blockIdx.x * blockDim.y + k */
+__global__ static void spt_DeviceMTTKRPKernel(
+    sptValue *out, sptIndex const R, sptIndex const stride,
+    sptIndex const nmodes, sptIndex const mode, sptNnzIndex const nnz,
+    sptIndex const *inds, sptValue const *vals, sptValue * const *mats)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.y + threadIdx.y;
+    if(z >= nnz) {
+        return;
+    }
+    sptValue * const orow = out + (sptNnzIndex) inds[mode * nnz + z] * stride;
+    for(sptIndex r = threadIdx.x; r < R; r += blockDim.x) {
+        sptValue v = vals[z];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                v *= mats[m][(sptNnzIndex) inds[m * nnz + z] * stride + r];
+            }
+        }
+        /* The 64-bit floating-point version of atomicAdd() is only supported by devices of compute capability 6.x and higher. */
+        atomicAdd(&orow[r], v);
+    }
+}
+
+/**
+ * Device version of sptCudaMTTKRP: mats[mode] is overwritten by the MTTKRP
+ * of the other device factors, all of the same rank.
+ * @param[in]     dX   the device sparse tensor
+ * @param[in,out] mats nmodes device matrices, mats[mode] the output
+ * @param[in]     mode the mode of the MTTKRP
+ */
+int sptDeviceMTTKRP(sptDeviceSparseTensor const * const dX, sptDeviceMatrix * const mats[], sptIndex const mode) {
+    sptIndex const nmodes = dX->nmodes;
+    sptNnzIndex const nnz = dX->nnz;
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSpTns MTTKRP", "mode out of range");
+    }
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(mats[m]->ncols != R || mats[m]->nrows != dX->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSpTns MTTKRP", "mats[m] is not ndims[m] x R");
+        }
+    }
+    sptValue ** mats_header = new sptValue *[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats_header[m] = mats[m]->values;
+    }
+    sptValue ** dev_mats;
+    int result = sptCudaDuplicateMemory(&dev_mats, mats_header, nmodes * sizeof (sptValue *), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "DevSpTns MTTKRP");
+    delete[] mats_header;
+    result = cudaMemset(mats[mode]->values, 0, (size_t) mats[mode]->nrows * stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSpTns MTTKRP");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(nnz > 0) {
+        sptIndex const nthreadsx = R < 32 ? R : 32;
+        sptIndex const nthreadsy = 256 / nthreadsx;
+        dim3 dimBlock(nthreadsx, nthreadsy);
+        sptNnzIndex const nblocks = (nnz + nthreadsy - 1) / nthreadsy;
+        spt_DeviceMTTKRPKernel<<<nblocks, dimBlock>>>(
+            mats[mode]->values, R, stride, nmodes, mode, nnz, dX->inds, dX->values, dev_mats);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "DevSpTns MTTKRP kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "DevSpTns MTTKRP");
+    sptFreeTimer(timer);
+
+    result = cudaFree(dev_mats);
+    spt_CheckCudaError(result != 0, "DevSpTns MTTKRP");
+    return 0;
+}
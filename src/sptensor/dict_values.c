@@ -0,0 +1,357 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Dictionary-encoded value storage.
+ *
+ * Count tensors tend to hold a handful of distinct small integers, each in a
+ * full sptValue. A sptDictValueVector keeps a table of the distinct values
+ * and one 8-bit code per nonzero when there are at most 256 of them, 16-bit
+ * up to 65536. The table sits in L1, so sptOmpMTTKRPDict streams one or two
+ * bytes per nonzero for the value instead of eight, and the norm comes from
+ * the table and the number of times each code occurs without touching the
+ * codes at all.
+ */
+
+/* Slots of the hash set the distinct values are gathered in, a power of two above the largest table */
+#define SPT_DICT_SLOTS (1u << 17)
+#define SPT_DICT_MAX_TABLE (1u << 16)
+
+static inline uint64_t spt_DictBits(sptValue const v) {
+    double const d = (double) v;
+    uint64_t u;
+    memcpy(&u, &d, sizeof u);
+    return u;
+}
+
+static inline uint32_t spt_DictSlot(uint64_t const bits) {
+    return (uint32_t) ((bits * 0x9e3779b97f4a7c15ull) >> 47) & (SPT_DICT_SLOTS - 1);
+}
+
+static int spt_CompareValues(void const * a, void const * b) {
+    sptValue const x = *(sptValue const *) a;
+    sptValue const y = *(sptValue const *) b;
+    return x < y ? -1 : (x > y);
+}
+
+/* The code of value v, which must be in the set */
+static inline uint32_t spt_DictLookup(uint64_t const * const keys, uint32_t const * const slots, sptValue const v) {
+    uint64_t const bits = spt_DictBits(v);
+    uint32_t s = spt_DictSlot(bits);
+    while(keys[s] != bits) {
+        s = (s + 1) & (SPT_DICT_SLOTS - 1);
+    }
+    return slots[s];
+}
+
+/*
+ * Gather the distinct values of vals into a hash set, keys/used, and number
+ * them in ascending order into table/slots. Returns the table size, or 0 if
+ * there are more than SPT_DICT_MAX_TABLE distinct values.
+ */
+static uint32_t spt_DictGather(sptValue const * const vals, sptNnzIndex const len,
+    uint64_t * const keys, uint8_t * const used, uint32_t * const slots, sptValue * const table)
+{
+    uint32_t ntable = 0;
+    uint64_t last = 0;
+    int have_last = 0;
+    for(sptNnzIndex z = 0; z < len; ++z) {
+        uint64_t const bits = spt_DictBits(vals[z]);
+        /* Runs of one value are common after sorting */
+        if(have_last && bits == last) {
+            continue;
+        }
+        last = bits;
+        have_last = 1;
+        uint32_t s = spt_DictSlot(bits);
+        while(used[s] && keys[s] != bits) {
+            s = (s + 1) & (SPT_DICT_SLOTS - 1);
+        }
+        if(!used[s]) {
+            if(ntable == SPT_DICT_MAX_TABLE) {
+                return 0;
+            }
+            used[s] = 1;
+            keys[s] = bits;
+            table[ntable++] = vals[z];
+        }
+    }
+    qsort(table, ntable, sizeof *table, spt_CompareValues);
+    for(uint32_t c = 0; c < ntable; ++c) {
+        uint64_t const bits = spt_DictBits(table[c]);
+        uint32_t s = spt_DictSlot(bits);
+        while(keys[s] != bits) {
+            s = (s + 1) & (SPT_DICT_SLOTS - 1);
+        }
+        slots[s] = c;
+    }
+    return ntable;
+}
+
+
+/*
+ * Encode len values, all 1 if vals is NULL, into dv. Returns 1 and leaves dv
+ * empty if there are more than SPT_DICT_MAX_TABLE distinct values.
+ */
+static int spt_DictEncode(sptDictValueVector *dv, sptValue const * const vals, sptNnzIndex const len, int const tk) {
+    sptValue const one = 1;
+    memset(dv, 0, sizeof *dv);
+    uint64_t * keys = malloc(SPT_DICT_SLOTS * sizeof *keys);
+    uint8_t * used = calloc(SPT_DICT_SLOTS, sizeof *used);
+    uint32_t * slots = malloc(SPT_DICT_SLOTS * sizeof *slots);
+    sptValue * table = malloc(SPT_DICT_MAX_TABLE * sizeof *table);
+    spt_CheckOSError(!keys || !used || !slots || !table, "DictVec New");
+
+    uint32_t const ntable = vals != NULL ? spt_DictGather(vals, len, keys, used, slots, table)
+        : spt_DictGather(&one, 1, keys, used, slots, table);
+    free(used);
+    if(ntable == 0 && len > 0) {
+        free(keys);
+        free(slots);
+        free(table);
+        return 1;
+    }
+
+    dv->len = len;
+    dv->ntable = ntable;
+    dv->width = ntable <= 256 ? 8 : 16;
+    dv->table = realloc(table, (ntable > 0 ? ntable : 1) * sizeof *table);
+    dv->counts = calloc(ntable > 0 ? ntable : 1, sizeof *dv->counts);
+    dv->codes = malloc((len > 0 ? len : 1) * (dv->width / 8));
+    spt_CheckOSError(!dv->table || !dv->counts || !dv->codes, "DictVec New");
+
+    int const nparts = tk > 0 ? tk : 1;
+    sptNnzIndex * parts = calloc((size_t) nparts * (ntable > 0 ? ntable : 1), sizeof *parts);
+    spt_CheckOSError(!parts, "DictVec New");
+    uint8_t * const codes8 = dv->codes;
+    uint16_t * const codes16 = dv->codes;
+    #pragma omp parallel num_threads(nparts)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptNnzIndex * const counts = parts + (size_t) tid * ntable;
+        #pragma omp for schedule(static)
+        for(sptNnzIndex z = 0; z < len; ++z) {
+            uint32_t const c = spt_DictLookup(keys, slots, vals != NULL ? vals[z] : one);
+            if(dv->width == 8) {
+                codes8[z] = (uint8_t) c;
+            } else {
+                codes16[z] = (uint16_t) c;
+            }
+            ++counts[c];
+        }
+    }
+    for(int t = 0; t < nparts; ++t) {
+        for(uint32_t c = 0; c < ntable; ++c) {
+            dv->counts[c] += parts[(size_t) t * ntable + c];
+        }
+    }
+    free(parts);
+    free(keys);
+    free(slots);
+    return 0;
+}
+
+/**
+ * Encode the values of a sparse tensor as codes into a table of its
+ * distinct values, in its current nonzero order, with 8-bit codes for up to
+ * 256 distinct values and 16-bit codes for up to 65536. Like
+ * sptNewHalfValueVector, reordering the tensor afterwards leaves the codes
+ * stale. A pattern tensor gets the one-value table {1}.
+ * @param dv  an uninitialized dictionary value vector
+ * @param tsr the sparse tensor
+ * @param tk  the number of threads
+ * @return SPTERR_VALUE_ERROR if tsr has more than 65536 distinct values
+ */
+int sptNewDictValueVector(sptDictValueVector *dv, const sptSparseTensor *tsr, int const tk) {
+    if(spt_DictEncode(dv, tsr->values.data, tsr->nnz, tk) != 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "DictVec New", "more than 65536 distinct values");
+    }
+    return 0;
+}
+
+/**
+ * Release a dictionary value vector
+ */
+void sptFreeDictValueVector(sptDictValueVector *dv) {
+    free(dv->table);
+    free(dv->counts);
+    free(dv->codes);
+    dv->table = NULL;
+    dv->counts = NULL;
+    dv->codes = NULL;
+    dv->len = 0;
+    dv->ntable = 0;
+}
+
+/**
+ * Value z of a dictionary value vector
+ */
+sptValue sptDictValueAt(const sptDictValueVector *dv, sptNnzIndex const z) {
+    uint32_t const c = dv->width == 8 ? ((uint8_t const *) dv->codes)[z] : ((uint16_t const *) dv->codes)[z];
+    return dv->table[c];
+}
+
+/**
+ * Write the values a dictionary value vector encodes back into a sparse
+ * tensor, giving a pattern tensor its value array again.
+ * @param tsr the sparse tensor dv was made from or loaded with
+ * @param dv  its dictionary-encoded values
+ * @param tk  the number of threads
+ */
+int sptDictDecodeValues(sptSparseTensor *tsr, const sptDictValueVector *dv, int const tk) {
+    if(dv->len != tsr->nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DictVec Decode", "dv->len != tsr->nnz");
+    }
+    if(sptSparseTensorIsPattern(tsr)) {
+        int result = sptNewValueVector(&tsr->values, tsr->nnz, tsr->nnz);
+        spt_CheckError(result, "DictVec Decode", NULL);
+    }
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < dv->len; ++z) {
+        tsr->values.data[z] = sptDictValueAt(dv, z);
+    }
+    return 0;
+}
+
+/**
+ * The squared Frobenius norm of the encoded values, from the table and the
+ * occurrences of each code; it costs the size of the table, not of the tensor.
+ * With the output of sptOmpMTTKRPDict it gives the fit of a CP model through
+ * sptKruskalTensorFitNorm.
+ */
+double sptDictValueNormSquared(const sptDictValueVector *dv) {
+    double normsq = 0;
+    for(uint32_t c = 0; c < dv->ntable; ++c) {
+        normsq += (double) dv->counts[c] * dv->table[c] * dv->table[c];
+    }
+    return normsq;
+}
+
+
+/**
+ * Load a sparse tensor from a text file like sptOmpLoadSparseTensor, and
+ * dictionary-encode its values when there are at most 65536 distinct ones.
+ * An encoded tensor is returned without its value array, as a pattern
+ * tensor, so it must go to the kernels that take dv, or have its values
+ * back from sptDictDecodeValues; otherwise dv is left with width 0 and the
+ * tensor keeps its values.
+ * @param tsr         an uninitialized sparse tensor
+ * @param dv          an uninitialized dictionary value vector
+ * @param start_index the index base of the file, 0 or 1
+ * @param filename    the file to load
+ * @param tk          the number of threads
+ */
+int sptOmpLoadSparseTensorDict(sptSparseTensor *tsr, sptDictValueVector *dv, sptIndex start_index, const char *filename, int const tk) {
+    int result = sptOmpLoadSparseTensor(tsr, start_index, filename, tk);
+    spt_CheckError(result, "OMP SpTns Load Dict", NULL);
+    memset(dv, 0, sizeof *dv);
+    if(sptSparseTensorIsPattern(tsr)) {
+        return 0;
+    }
+    /* Too many distinct values is not an error here: the tensor stays as it is */
+    if(spt_DictEncode(dv, tsr->values.data, tsr->nnz, tk) != 0) {
+        return 0;
+    }
+    sptFreeValueVector(&tsr->values);
+    tsr->values.data = NULL;
+    return 0;
+}
+
+
+/**
+ * OpenMP MTTKRP over the dictionary-encoded values of X. Each nonzero
+ * reads its code and looks the value up in the table, which stays in cache.
+ * @param X           the sparse tensor, in the order dv was made in; its own values are not read
+ * @param dv          the values of X from sptNewDictValueVector
+ * @param mats        (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mats_order  the order of the Khatri-Rao products
+ * @param mode        the mode on which the MTTKRP is performed
+ * @param tk          the number of threads
+ */
+int sptOmpMTTKRPDict(sptSparseTensor const * const X,
+    sptDictValueVector const * const dv,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[0]->stride;
+
+    if(dv->len != nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "dv->len != X->nnz");
+    }
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const restrict mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, mats[mode]->nrows * stride * sizeof (sptValue));
+    sptValue const * const restrict table = dv->table;
+    uint8_t const * const restrict codes8 = dv->codes;
+    uint16_t const * const restrict codes16 = dv->codes;
+    int const wide = dv->width == 16;
+
+    sptValue * scratch = malloc((size_t) tk * stride * sizeof *scratch + 1);
+    spt_CheckOSError(!scratch, "CPU  SpTns MTTKRP");
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptValue * const restrict row = scratch + (size_t) tid * stride;
+        #pragma omp for schedule(static)
+        for(sptNnzIndex x=0; x<nnz; ++x) {
+            sptValue const entry = table[wide ? codes16[x] : codes8[x]];
+            for(sptIndex r=0; r<R; ++r) {
+                row[r] = entry;
+            }
+            for(sptIndex i=1; i<nmodes; ++i) {
+                sptIndex const mi = mats_order[i];
+                sptValue const * const restrict vrow = mats[mi]->values + (size_t) X->inds[mi].data[x] * stride;
+                for(sptIndex r=0; r<R; ++r) {
+                    row[r] *= vrow[r];
+                }
+            }
+            sptValue * const restrict mvals_row = mvals + (size_t) mode_ind[x] * stride;
+            for(sptIndex r=0; r<R; ++r) {
+                #pragma omp atomic update
+                mvals_row[r] += row[r];
+            }
+        }
+    }
+    free(scratch);
+    return 0;
+}
@@ -0,0 +1,417 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Backend dispatch for MTTKRP and CP-ALS.
+ *
+ * The cost model is a memory roofline: a backend's MTTKRP takes the bytes it
+ * moves over the bandwidth of the memory it runs from, times a contention
+ * factor for the output rows many workers hit at once, plus what it pays
+ * once (a HiCOO conversion, the tensor's trip over PCIe) spread over the
+ * calls that share it. The bytes come from nnz, the mode lengths and the
+ * rank; the contention from the largest slice of the mode; HiCOO's factor
+ * traffic from the nonzeros per block, since a block touches at most
+ * 2^SPT_DISPATCH_SB_BITS rows of each factor. Slice sizes and block density
+ * are estimated from an even sample of the nonzeros.
+ *
+ * The machine side comes from the machine profile, see sptGetMachineModel,
+ * and can be replaced with sptSetMachineModel.
+ */
+
+#define SPT_DISPATCH_SB_BITS 7
+#define SPT_DISPATCH_SK_BITS 10
+#define SPT_DISPATCH_SAMPLE ((sptNnzIndex) 1 << 16)
+
+static sptMachineModel spt_machine;
+static int spt_machine_ready = 0;
+
+static char const * const spt_backend_names[SPT_NUM_BACKENDS] = { "OpenMP COO", "OpenMP HiCOO", "CUDA", "CUDA+OpenMP" };
+
+/**
+ * The machine parameters the dispatcher's cost model uses, taken from the
+ * machine profile on first use, see sptGetMachineProfile: the calibration's
+ * threads, triad bandwidth and last-level cache (PARTI_DISPATCH_CACHE_BYTES
+ * if it found none) and, with a device, its copy bandwidth and size and the
+ * host to device bandwidth.
+ */
+sptMachineModel const * sptGetMachineModel(void) {
+    if(!spt_machine_ready) {
+        sptMachineProfile const * const profile = sptGetMachineProfile();
+        #pragma omp critical(spt_machine_model)
+        {
+            if(!spt_machine_ready) {
+                sptMachineModel model;
+                memset(&model, 0, sizeof model);
+                model.ncores = profile->nthreads > 0 ? profile->nthreads : sptExecThreads(0);
+                model.host_bandwidth = profile->stream_bandwidth > 0 ? profile->stream_bandwidth : 10e9;
+                model.host_cache = profile->llc_bytes > 0 ? profile->llc_bytes : PARTI_DISPATCH_CACHE_BYTES;
+                model.has_device = profile->has_device;
+                model.device_bandwidth = profile->device_bandwidth;
+                model.pcie_bandwidth = profile->h2d_bandwidth;
+                model.device_memory = profile->device_memory;
+                spt_machine = model;
+                spt_machine_ready = 1;
+            }
+        }
+    }
+    return &spt_machine;
+}
+
+/**
+ * Replace the profiled machine parameters, e.g. with ones fitted offline,
+ * or derive them from the profile again on next use with NULL. Not
+ * thread-safe; set them before work starts.
+ */
+void sptSetMachineModel(sptMachineModel const * model) {
+    if(model != NULL) {
+        spt_machine = *model;
+        spt_machine_ready = 1;
+    } else {
+        spt_machine_ready = 0;
+    }
+}
+
+
+static int spt_CompareKeys(void const * a, void const * b) {
+    uint64_t const x = *(uint64_t const *) a, y = *(uint64_t const *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Tensor features from an even sample of at most SPT_DISPATCH_SAMPLE nonzeros */
+static int spt_DispatchFeatures(sptSparseTensor const * X, sptIndex const mode, double * max_slice_frac, double * block_density) {
+    sptNnzIndex const nnz = X->nnz;
+    *max_slice_frac = 0;
+    *block_density = 1;
+    if(nnz == 0) {
+        return 0;
+    }
+    sptNnzIndex const step = nnz > SPT_DISPATCH_SAMPLE ? nnz / SPT_DISPATCH_SAMPLE : 1;
+    sptNnzIndex const s = (nnz + step - 1) / step;
+    uint64_t * keys = malloc(2 * s * sizeof *keys);
+    spt_CheckOSError(keys == NULL, "Dispatch");
+    uint64_t * const slices = keys + s;
+    for(sptNnzIndex k = 0; k < s; ++k) {
+        sptNnzIndex const z = k * step;
+        uint64_t h = UINT64_C(1469598103934665603);
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            h = (h ^ (X->inds[m].data[z] >> SPT_DISPATCH_SB_BITS)) * UINT64_C(1099511628211);
+        }
+        keys[k] = h;
+        slices[k] = X->inds[mode].data[z];
+    }
+
+    /* The largest slice's share of the sample */
+    qsort(slices, s, sizeof *slices, spt_CompareKeys);
+    sptNnzIndex run = 0, max_run = 0;
+    for(sptNnzIndex k = 0; k < s; ++k) {
+        run = k > 0 && slices[k] == slices[k-1] ? run + 1 : 1;
+        if(run > max_run) {
+            max_run = run;
+        }
+    }
+    *max_slice_frac = (double) max_run / s;
+
+    qsort(keys, s, sizeof *keys, spt_CompareKeys);
+    sptNnzIndex distinct = 0;
+    for(sptNnzIndex k = 0; k < s; ++k) {
+        distinct += k == 0 || keys[k] != keys[k-1];
+    }
+    free(keys);
+    *block_density = spt_EstimateGroupSize(distinct, s, nnz);
+    return 0;
+}
+
+/* Slowdown of many workers adding into the rows of the largest slice */
+static double spt_ContentionFactor(double const max_slice_frac, double const nworkers) {
+    double const hot = max_slice_frac * nworkers;
+    return hot > 1 ? 1 + log2(hot) / 4 : 1;
+}
+
+/*
+ * Seconds of one MTTKRP of each backend (per_call) and of what a run of them
+ * pays once (once), DBL_MAX where the backend cannot run.
+ */
+static void spt_DispatchCosts(
+    double per_call[], double once[],
+    sptSparseTensor const * X, sptIndex const rank,
+    double const max_slice_frac, double const block_density,
+    int const tk, sptMachineModel const * machine)
+{
+    sptIndex const nmodes = X->nmodes;
+    double const nnz = (double) X->nnz;
+    double const row = (double) rank * sizeof (sptValue);
+    double factor_bytes = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        factor_bytes += (double) X->ndims[m] * row;
+    }
+    double const coo_bytes = nnz * (nmodes * sizeof (sptIndex) + sizeof (sptValue));
+    /* Rows read for the other modes and the output row, a quarter missing when the factors fit in cache */
+    double const miss = factor_bytes <= (double) machine->host_cache ? 0.25 : 1;
+    double const coo_rows = nnz * nmodes * row * miss;
+    int const ncores = tk > 0 ? tk : machine->ncores;
+    double const host_bw = machine->host_bandwidth * (ncores < machine->ncores ? (double) ncores / machine->ncores : 1);
+
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        per_call[b] = DBL_MAX;
+        once[b] = 0;
+    }
+
+    double const contention = spt_ContentionFactor(max_slice_frac, ncores);
+    per_call[SPT_BACKEND_OMP_COO] = (coo_bytes + coo_rows) / host_bw * contention;
+
+    /* HiCOO: byte element indices, a block header, and at most 2^sb rows per mode and block */
+    double const d = block_density > 1 ? block_density : 1;
+    double const nblocks = nnz / d;
+    double const hicoo_bytes = nnz * (nmodes + sizeof (sptValue)) + nblocks * (nmodes * sizeof (sptIndex) + 2 * sizeof (sptNnzIndex));
+    double const block_rows = (double) ((sptIndex) 1 << SPT_DISPATCH_SB_BITS);
+    double hicoo_rows = nblocks * nmodes * (d < block_rows ? d : block_rows) * row;
+    if(hicoo_rows > coo_rows) {
+        hicoo_rows = coo_rows;
+    }
+    per_call[SPT_BACKEND_OMP_HICOO] = (hicoo_bytes + hicoo_rows) / host_bw * contention;
+    /* The conversion copies the tensor, radix sorts it about four passes deep and writes HiCOO */
+    once[SPT_BACKEND_OMP_HICOO] = (coo_bytes * 10 + hicoo_bytes) / host_bw;
+
+    if(machine->has_device && machine->device_bandwidth > 0 && machine->pcie_bandwidth > 0) {
+        double const device_bytes = coo_bytes + factor_bytes * 2 + nnz * row;
+        if(device_bytes < (double) machine->device_memory) {
+            /* Device caches hold little of the factors; contention is over the warps in flight */
+            per_call[SPT_BACKEND_CUDA] = (coo_bytes + nnz * nmodes * row) / machine->device_bandwidth *
+                spt_ContentionFactor(max_slice_frac, 1024) + 2e-5;
+            once[SPT_BACKEND_CUDA] = (coo_bytes + factor_bytes) / machine->pcie_bandwidth;
+            if(ncores >= 2) {
+                /* Both sides at their own rate, with one host thread driving the device */
+                double const cpu = per_call[SPT_BACKEND_OMP_COO] * ncores / (ncores - 1);
+                double const gpu = per_call[SPT_BACKEND_CUDA] + factor_bytes / machine->pcie_bandwidth;
+                per_call[SPT_BACKEND_HYBRID] = 1.1 / (1 / cpu + 1 / gpu);
+                once[SPT_BACKEND_HYBRID] = once[SPT_BACKEND_CUDA];
+            }
+        }
+    }
+}
+
+/* The backend of the smallest total, telemetry and a summary line for it */
+static sptBackend spt_DispatchChoose(char const * op, sptDispatchPlan * plan, sptNnzIndex const nnz) {
+    plan->backend = SPT_BACKEND_OMP_COO;
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        if(plan->seconds[b] < plan->seconds[plan->backend]) {
+            plan->backend = (sptBackend) b;
+        }
+    }
+    char name[96];
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        if(plan->seconds[b] < DBL_MAX) {
+            snprintf(name, sizeof name, "%s predicted %s", op, spt_backend_names[b]);
+            sptTelemetryRecordTime(name, plan->seconds[b]);
+        }
+    }
+    snprintf(name, sizeof name, "%s chose %s", op, spt_backend_names[plan->backend]);
+    sptTelemetryAddCounter(name, 1);
+    if(spt_TelemetryPrinting()) {
+        printf("[%s] nnz %"PARTI_PRI_NNZ_INDEX", slice skew %.1f, %.1f nnz per block; predicted",
+            op, nnz, plan->slice_skew, plan->block_density);
+        for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+            if(plan->seconds[b] < DBL_MAX) {
+                printf(" %s %.3g s,", spt_backend_names[b], plan->seconds[b]);
+            }
+        }
+        printf(" chose %s\n", spt_backend_names[plan->backend]);
+    }
+    return plan->backend;
+}
+
+
+/**
+ * Predict the time of ncalls MTTKRPs of X at mode on each backend and pick
+ * the fastest, see the cost model above. Telemetry gets each prediction and
+ * the choice.
+ * @param[out] plan   the backend chosen and the predictions behind it
+ * @param[in]  X      the COO tensor
+ * @param[in]  rank   the number of factor columns
+ * @param[in]  mode   the MTTKRP mode
+ * @param[in]  ncalls the MTTKRPs that share one conversion or upload
+ * @param[in]  tk     the number of host threads, 0 for the default
+ */
+int sptPlanMTTKRP(
+    sptDispatchPlan * plan,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    sptIndex const mode,
+    sptNnzIndex const ncalls,
+    int const tk)
+{
+    if(mode >= X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "Dispatch MTTKRP", "mode out of range");
+    }
+    sptMachineModel const * const machine = sptGetMachineModel();
+    double max_slice_frac, block_density;
+    int result = spt_DispatchFeatures(X, mode, &max_slice_frac, &block_density);
+    spt_CheckError(result, "Dispatch MTTKRP", NULL);
+    double per_call[SPT_NUM_BACKENDS], once[SPT_NUM_BACKENDS];
+    spt_DispatchCosts(per_call, once, X, rank, max_slice_frac, block_density, tk, machine);
+    sptNnzIndex const n = ncalls > 0 ? ncalls : 1;
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        plan->seconds[b] = per_call[b] < DBL_MAX ? once[b] + n * per_call[b] : DBL_MAX;
+    }
+    plan->slice_skew = max_slice_frac * X->ndims[mode];
+    plan->block_density = block_density;
+    spt_DispatchChoose("Dispatch MTTKRP", plan, X->nnz);
+    return 0;
+}
+
+/**
+ * MTTKRP on the backend sptPlanMTTKRP predicts fastest for one call, with
+ * the arguments of sptOmpMTTKRP. A HiCOO choice converts a copy of X; a
+ * CUDA choice uploads X and the factors.
+ */
+int sptMTTKRPAuto(
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    int tk)
+{
+    tk = sptExecThreads(tk);
+    sptDispatchPlan plan;
+    int result = sptPlanMTTKRP(&plan, X, mats[mode]->ncols, mode, 1, tk);
+    spt_CheckError(result, "Auto MTTKRP", NULL);
+    switch(plan.backend) {
+    case SPT_BACKEND_OMP_HICOO: {
+        sptSparseTensor copy;
+        sptSparseTensorHiCOO hitsr;
+        sptNnzIndex max_nnzb = 0;
+        result = sptCopySparseTensor(&copy, X, tk);
+        spt_CheckError(result, "Auto MTTKRP", NULL);
+        result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &copy, SPT_DISPATCH_SB_BITS, SPT_DISPATCH_SK_BITS, tk);
+        sptFreeSparseTensor(&copy);
+        spt_CheckError(result, "Auto MTTKRP", NULL);
+        result = sptOmpMTTKRPHiCOO_RankTiled(&hitsr, mats, mats_order, mode, 0, tk);
+        sptFreeSparseTensorHiCOO(&hitsr);
+        break;
+    }
+#ifdef PARTI_USE_CUDA
+    case SPT_BACKEND_CUDA:
+        result = sptCudaMTTKRP(X, mats, (sptIndex *) mats_order, mode, PARTI_CUDA_IMPL_AUTO);
+        break;
+    case SPT_BACKEND_HYBRID: {
+        sptCudaMttkrpHybrid hybrid;
+        double const share = plan.seconds[SPT_BACKEND_OMP_COO] /
+            (plan.seconds[SPT_BACKEND_OMP_COO] + plan.seconds[SPT_BACKEND_CUDA]);
+        result = sptCudaNewMttkrpHybrid(&hybrid, X, mats[mode]->ncols, tk, share);
+        spt_CheckError(result, "Auto MTTKRP", NULL);
+        result = sptCudaMTTKRPHybrid(&hybrid, X, mats, (sptIndex *) mats_order, mode);
+        sptCudaFreeMttkrpHybrid(&hybrid);
+        break;
+    }
+#endif
+    default:
+        result = sptOmpMTTKRP(X, mats, mats_order, mode, tk);
+    }
+    spt_CheckError(result, "Auto MTTKRP", NULL);
+    return 0;
+}
+
+/**
+ * CP-ALS on the backend predicted fastest for niters sweeps over every mode,
+ * with the arguments of sptOmpCpdAls; see sptPlanMTTKRP. A HiCOO choice
+ * converts a copy of spten once and runs sptOmpCpdAlsHiCOORankTiled.
+ * @param[out] plan the choice and its predictions, may be NULL
+ */
+int sptCpdAlsAuto(
+    sptSparseTensor const * const spten,
+    sptIndex const rank,
+    sptIndex const niters,
+    double const tol,
+    int tk,
+    sptDispatchPlan * plan,
+    sptKruskalTensor * ktensor)
+{
+    tk = sptExecThreads(tk);
+    sptMachineModel const * const machine = sptGetMachineModel();
+    sptDispatchPlan local;
+    if(plan == NULL) {
+        plan = &local;
+    }
+    double total[SPT_NUM_BACKENDS];
+    double skew = 0, density = 0;
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        total[b] = 0;
+    }
+    for(sptIndex m = 0; m < spten->nmodes; ++m) {
+        double max_slice_frac, block_density;
+        int result = spt_DispatchFeatures(spten, m, &max_slice_frac, &block_density);
+        spt_CheckError(result, "Auto CPD", NULL);
+        double per_call[SPT_NUM_BACKENDS], once[SPT_NUM_BACKENDS];
+        spt_DispatchCosts(per_call, once, spten, rank, max_slice_frac, block_density, tk, machine);
+        for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+            if(per_call[b] == DBL_MAX || total[b] == DBL_MAX) {
+                total[b] = DBL_MAX;
+            } else {
+                total[b] += (m == 0 ? once[b] : 0) + (double) niters * per_call[b];
+            }
+        }
+        double const m_skew = max_slice_frac * spten->ndims[m];
+        if(m_skew > skew) {
+            skew = m_skew;
+        }
+        density = block_density;
+    }
+    for(int b = 0; b < SPT_NUM_BACKENDS; ++b) {
+        plan->seconds[b] = total[b];
+    }
+    plan->slice_skew = skew;
+    plan->block_density = density;
+    spt_DispatchChoose("Dispatch CPD", plan, spten->nnz);
+
+    int result;
+    switch(plan->backend) {
+    case SPT_BACKEND_OMP_HICOO: {
+        sptSparseTensor copy;
+        sptSparseTensorHiCOO hitsr;
+        sptNnzIndex max_nnzb = 0;
+        result = sptCopySparseTensor(&copy, spten, tk);
+        spt_CheckError(result, "Auto CPD", NULL);
+        result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &copy, SPT_DISPATCH_SB_BITS, SPT_DISPATCH_SK_BITS, tk);
+        sptFreeSparseTensor(&copy);
+        spt_CheckError(result, "Auto CPD", NULL);
+        result = sptOmpCpdAlsHiCOORankTiled(&hitsr, rank, niters, tol, tk, 0, ktensor);
+        sptFreeSparseTensorHiCOO(&hitsr);
+        break;
+    }
+#ifdef PARTI_USE_CUDA
+    case SPT_BACKEND_CUDA:
+        result = sptCudaCpdAls(spten, rank, niters, tol, ktensor);
+        break;
+    case SPT_BACKEND_HYBRID:
+        result = sptCudaCpdAlsHybrid(spten, rank, niters, tol, tk, ktensor);
+        break;
+#endif
+    default:
+        result = sptOmpCpdAls(spten, rank, niters, tol, tk, 0, ktensor);
+    }
+    spt_CheckError(result, "Auto CPD", NULL);
+    return 0;
+}
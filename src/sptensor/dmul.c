@@ -26,11 +26,15 @@
  * @param[in]  Y the input Y
  *
  * The name "DotMul" comes from the MATLAB operator ".*". This function is not
- * for "inner product" or "outer product".
+ * for "inner product" or "outer product". Unsorted inputs are intersected
+ * with a hash join, and Z then follows the order of the larger one.
  */
 int sptSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
     sptNnzIndex i, j;
     int result;
+    if(!spt_SparseTensorIsSorted(X) || !spt_SparseTensorIsSorted(Y)) {
+        return spt_SparseTensorHashJoin(Z, X, Y, spt_MulValues, 0, 1, "SpTns DotMul");
+    }
     /* Ensure X and Y are in same shape */
     if(Y->nmodes != X->nmodes) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns DotMul", "shape mismatch");
@@ -41,7 +45,11 @@ int sptSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sp
         }
     }
 
-    sptNewSparseTensor(Z, X->nmodes, X->ndims);
+    result = sptNewSparseTensor(Z, X->nmodes, X->ndims);
+    spt_CheckError(result, "SpTns DotMul", NULL);
+    /* At most the smaller nnz survives the intersection */
+    result = spt_SparseTensorReserve(Z, X->nnz < Y->nnz ? X->nnz : Y->nnz);
+    spt_CheckError(result, "SpTns DotMul", NULL);
 
     sptTimer timer;
     sptNewTimer(&timer, 0);
@@ -0,0 +1,249 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <thrust/device_ptr.h>
+#include <thrust/scan.h>
+#include "sptensor.h"
+
+/* Indices live on the device mode after mode: inds[m * nnz + z] */
+__device__ static int spt_CompareDeviceIndices(
+    sptIndex const *X_inds, sptNnzIndex const X_nnz, sptNnzIndex const x,
+    sptIndex const *Y_inds, sptNnzIndex const Y_nnz, sptNnzIndex const y,
+    sptIndex const nmodes)
+{
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const a = X_inds[m * X_nnz + x];
+        sptIndex const b = Y_inds[m * Y_nnz + y];
+        if(a != b) {
+            return a < b ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+__device__ static sptValue spt_DeviceJoinValue(int const op, sptValue const x, sptValue const y)
+{
+    return op == 0 ? x * y : x / y;
+}
+
+/* match[x] is the Y nonzero with X nonzero x's coordinates, or Y_nnz; keep[x] = 1 if their result is nonzero */
+__global__ static void spt_IntersectMatchKernel(
+    sptIndex const *X_inds, sptValue const *X_val, sptNnzIndex const X_nnz,
+    sptIndex const *Y_inds, sptValue const *Y_val, sptNnzIndex const Y_nnz,
+    sptIndex const nmodes, int const op,
+    sptNnzIndex *match, sptNnzIndex *keep)
+{
+    sptNnzIndex const x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(x >= X_nnz) {
+        return;
+    }
+    sptNnzIndex lo = 0, hi = Y_nnz;
+    while(lo < hi) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(spt_CompareDeviceIndices(X_inds, X_nnz, x, Y_inds, Y_nnz, mid, nmodes) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    sptNnzIndex y = Y_nnz, k = 0;
+    if(lo < Y_nnz && spt_CompareDeviceIndices(X_inds, X_nnz, x, Y_inds, Y_nnz, lo, nmodes) == 0 &&
+        spt_DeviceJoinValue(op, X_val[x], Y_val[lo]) != 0) {
+        y = lo;
+        k = 1;
+    }
+    match[x] = y;
+    keep[x] = k;
+}
+
+/* Write every kept X nonzero to its slot offset[x] of Z */
+__global__ static void spt_IntersectScatterKernel(
+    sptIndex const *X_inds, sptValue const *X_val, sptNnzIndex const X_nnz,
+    sptValue const *Y_val, sptNnzIndex const Y_nnz,
+    sptIndex const nmodes, int const op,
+    sptNnzIndex const *match, sptNnzIndex const *offset,
+    sptIndex *Z_inds, sptValue *Z_val, sptNnzIndex const Z_nnz)
+{
+    sptNnzIndex const x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(x >= X_nnz || match[x] == Y_nnz) {
+        return;
+    }
+    sptNnzIndex const out = offset[x];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        Z_inds[m * Z_nnz + out] = X_inds[m * X_nnz + x];
+    }
+    Z_val[out] = spt_DeviceJoinValue(op, X_val[x], Y_val[match[x]]);
+}
+
+static int spt_UploadSparseTensor(const sptSparseTensor *tsr, sptIndex **inds, sptValue **val, const char *module)
+{
+    sptNnzIndex const nnz = tsr->nnz;
+    int result = cudaMalloc((void **) inds, (tsr->nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        result = cudaMemcpy(*inds + m * nnz, tsr->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+    }
+    result = cudaMalloc((void **) val, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMemcpy(*val, tsr->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    return 0;
+}
+
+/**
+ * CUDA element-wise intersection Z = op(X, Y) of two sparse tensors. Each
+ * X nonzero binary-searches Y on the device, a prefix sum over the kept
+ * matches places the results, and a second kernel scatters them. Unsorted
+ * inputs are sorted on the host first. Z comes out sorted.
+ * @param[out] Z      the result, should be uninitialized
+ * @param[in]  X      the input X
+ * @param[in]  Y      the input Y
+ * @param[in]  op     0 for X .* Y, 1 for X ./ Y
+ * @param[in]  module the module name errors are reported under
+ */
+int spt_CudaSparseTensorIntersect(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    int const op,
+    const char *module)
+{
+    int result;
+    /* Ensure X and Y are in same shape */
+    if(Y->nmodes != X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    for(sptIndex i = 0; i < X->nmodes; ++i) {
+        if(Y->ndims[i] != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+        }
+    }
+    sptIndex const nmodes = X->nmodes;
+
+    /* The device search needs both inputs in the natural order */
+    sptSparseTensor Xs, Ys;
+    int const sort_x = !spt_SparseTensorIsSorted(X);
+    int const sort_y = !spt_SparseTensorIsSorted(Y);
+    if(sort_x) {
+        sptCopySparseTensor(&Xs, X, 1);
+        sptSparseTensorSortIndex(&Xs, 1);
+        X = &Xs;
+    }
+    if(sort_y) {
+        sptCopySparseTensor(&Ys, Y, 1);
+        sptSparseTensorSortIndex(&Ys, 1);
+        Y = &Ys;
+    }
+
+    sptIndex *X_inds = NULL, *Y_inds = NULL;
+    sptValue *X_val = NULL, *Y_val = NULL;
+    result = spt_UploadSparseTensor(X, &X_inds, &X_val, module);
+    spt_CheckError(result, module, NULL);
+    result = spt_UploadSparseTensor(Y, &Y_inds, &Y_val, module);
+    spt_CheckError(result, module, NULL);
+
+    sptNnzIndex *match = NULL, *offset = NULL;
+    result = cudaMalloc((void **) &match, (X->nnz + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &offset, (X->nnz + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, module);
+
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks = (X->nnz + nthreads - 1) / nthreads;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptNnzIndex nnz = 0;
+    if(nblocks > 0) {
+        spt_IntersectMatchKernel<<<nblocks, nthreads>>>(X_inds, X_val, X->nnz, Y_inds, Y_val, Y->nnz, nmodes, op, match, offset);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+
+        /* offset[x] = kept matches before x, offset[X->nnz] = all of them */
+        sptNnzIndex last_keep = 0;
+        result = cudaMemcpy(&last_keep, offset + X->nnz - 1, sizeof last_keep, cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, module);
+        thrust::device_ptr<sptNnzIndex> keep_ptr(offset);
+        thrust::exclusive_scan(keep_ptr, keep_ptr + X->nnz, keep_ptr);
+        result = cudaMemcpy(&nnz, offset + X->nnz - 1, sizeof nnz, cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, module);
+        nnz += last_keep;
+    }
+
+    sptIndex *Z_inds = NULL;
+    sptValue *Z_val = NULL;
+    result = cudaMalloc((void **) &Z_inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &Z_val, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    if(nnz > 0) {
+        spt_IntersectScatterKernel<<<nblocks, nthreads>>>(X_inds, X_val, X->nnz, Y_val, Y->nnz, nmodes, op, match, offset, Z_inds, Z_val, nnz);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, module);
+    sptFreeTimer(timer);
+
+    result = sptNewSparseTensor(Z, nmodes, X->ndims);
+    spt_CheckError(result, module, NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&Z->inds[m], nnz);
+        spt_CheckError(result, module, NULL);
+        result = cudaMemcpy(Z->inds[m].data, Z_inds + m * nnz, nnz * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, module);
+    }
+    result = sptResizeValueVector(&Z->values, nnz);
+    spt_CheckError(result, module, NULL);
+    result = cudaMemcpy(Z->values.data, Z_val, nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, module);
+    Z->nnz = nnz;
+
+    cudaFree(X_inds);
+    cudaFree(X_val);
+    cudaFree(Y_inds);
+    cudaFree(Y_val);
+    cudaFree(match);
+    cudaFree(offset);
+    cudaFree(Z_inds);
+    cudaFree(Z_val);
+    if(sort_x) {
+        sptFreeSparseTensor(&Xs);
+    }
+    if(sort_y) {
+        sptFreeSparseTensor(&Ys);
+    }
+
+    return 0;
+}
+
+
+/**
+ * CUDA parallelized element wise multiply two sparse tensors
+ * @param[out] Z the result of X*Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptCudaSparseTensorDotMul(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
+    return spt_CudaSparseTensorIntersect(Z, X, Y, 0, "CUDA SpTns DotMul");
+}
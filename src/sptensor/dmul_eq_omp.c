@@ -17,11 +17,13 @@
 */
 
 #include <ParTI.h>
+#include <string.h>
 #include "sptensor.h"
 
 /**
  * Openmp parallelized Element wise multiply two sparse tensors, with exactly the same nonzero
- * distribution.
+ * distribution. If the nonzeros are in a different order, they are joined by
+ * coordinates instead.
  * @param[out] Z the result of X*Y, should be uninitialized
  * @param[in]  X the input X
  * @param[in]  Y the input Y
@@ -42,6 +44,12 @@ int sptOmpSparseTensorDotMulEq(sptSparseTensor *Z, const sptSparseTensor *X, con
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns DotMul", "nonzero distribution mismatch");
     }
     sptNnzIndex nnz = X->nnz;
+    /* Same count but another pattern or order, join by coordinates */
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(memcmp(X->inds[m].data, Y->inds[m].data, nnz * sizeof *X->inds[m].data) != 0) {
+            return spt_SparseTensorHashJoin(Z, X, Y, spt_MulValues, 0, sptExecThreads(0), "SpTns DotMul");
+        }
+    }
 
     sptCopySparseTensor(Z, X, 1);
 
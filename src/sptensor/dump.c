@@ -20,8 +20,25 @@
 #include <stdio.h>
 #include "sptensor.h"
 
+typedef struct {
+    const sptSparseTensor *tsr;
+    sptIndex start_index;
+} spt_SparseTensorDumpArgs;
+
+static void spt_FormatSparseTensorRow(spt_TextBuffer *buf, void const *ctx, sptNnzIndex const i) {
+    spt_SparseTensorDumpArgs const * const args = ctx;
+    const sptSparseTensor * const tsr = args->tsr;
+    for(sptIndex mode = 0; mode < tsr->nmodes; ++mode) {
+        spt_TextPrintf(buf, "%"PARTI_PRI_INDEX "\t", tsr->inds[mode].data[i]+args->start_index);
+    }
+    spt_TextPrintf(buf, "%"PARTI_PRI_VALUE "\n", tsr->values.data != NULL ? (double) tsr->values.data[i] : 1.0);
+}
+
 /**
  * Save the contents of a sparse tensor into a text file
+ *
+ * The nonzeros are formatted in parallel and written in order.
+ *
  * @param tsr         th sparse tensor used to write
  * @param start_index the index of the first element in array. Set to 1 for MATLAB compability, else set to 0
  * @param fp          the file to write into
@@ -29,7 +46,6 @@
 int sptDumpSparseTensor(const sptSparseTensor *tsr, sptIndex start_index, FILE *fp) {
     int iores;
     sptIndex mode;
-    sptNnzIndex i;
     iores = fprintf(fp, "%"PARTI_PRI_INDEX "\n", tsr->nmodes);
     spt_CheckOSError(iores < 0, "SpTns Dump");
     for(mode = 0; mode < tsr->nmodes; ++mode) {
@@ -41,13 +57,8 @@ int sptDumpSparseTensor(const sptSparseTensor *tsr, sptIndex start_index, FILE *
         spt_CheckOSError(iores < 0, "SpTns Dump");
     }
     fputs("\n", fp);
-    for(i = 0; i < tsr->nnz; ++i) {
-        for(mode = 0; mode < tsr->nmodes; ++mode) {
-            iores = fprintf(fp, "%"PARTI_PRI_INDEX "\t", tsr->inds[mode].data[i]+start_index);
-            spt_CheckOSError(iores < 0, "SpTns Dump");
-        }
-        iores = fprintf(fp, "%"PARTI_PRI_VALUE "\n", (double) tsr->values.data[i]);
-        spt_CheckOSError(iores < 0, "SpTns Dump");
-    }
+    spt_SparseTensorDumpArgs const args = { tsr, start_index };
+    iores = spt_DumpRows(fp, tsr->nnz, 8 * tsr->nmodes + 12, spt_FormatSparseTensorRow, &args, 0);
+    spt_CheckError(iores, "SpTns Dump", NULL);
     return 0;
 }
@@ -0,0 +1,268 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Pruning before decomposition.
+ *
+ * Both filters mark the nonzeros to keep in parallel, then compact the
+ * tensor in one stable pass: each thread counts the survivors of an even
+ * share of the positions, a prefix sum over the threads gives every share
+ * its output offset, and the shares are copied out in order. A tensor that
+ * was sorted stays sorted. Top-k per slice buckets the nonzeros by slice and
+ * selects in each bucket with quickselect, so no values are sorted.
+ */
+
+/* Whether nonzero a ranks above nonzero b: larger magnitude, then earlier position */
+static inline int spt_TopKBefore(sptValue const * const vals, sptNnzIndex const a, sptNnzIndex const b) {
+    sptValue const va = vals != NULL ? fabs(vals[a]) : 1;
+    sptValue const vb = vals != NULL ? fabs(vals[b]) : 1;
+    return va > vb || (va == vb && a < b);
+}
+
+/* Reorder ids so that its first k entries are the k that rank highest, in no particular order */
+static void spt_TopKSelect(sptNnzIndex * const ids, sptNnzIndex const n, sptNnzIndex const k, sptValue const * const vals) {
+    sptNnzIndex lo = 0, hi = n - 1;
+    sptNnzIndex const target = k - 1;
+    while(lo < hi) {
+        /* Median of three as the pivot, moved to hi */
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        sptNnzIndex t;
+        if(spt_TopKBefore(vals, ids[mid], ids[lo])) { t = ids[mid]; ids[mid] = ids[lo]; ids[lo] = t; }
+        if(spt_TopKBefore(vals, ids[hi], ids[lo])) { t = ids[hi]; ids[hi] = ids[lo]; ids[lo] = t; }
+        if(spt_TopKBefore(vals, ids[mid], ids[hi])) { t = ids[mid]; ids[mid] = ids[hi]; ids[hi] = t; }
+        sptNnzIndex const pivot = ids[hi];
+        sptNnzIndex store = lo;
+        for(sptNnzIndex i = lo; i < hi; ++i) {
+            if(spt_TopKBefore(vals, ids[i], pivot)) {
+                t = ids[i]; ids[i] = ids[store]; ids[store] = t;
+                ++store;
+            }
+        }
+        ids[hi] = ids[store];
+        ids[store] = pivot;
+        if(store == target) {
+            break;
+        } else if(store < target) {
+            lo = store + 1;
+        } else {
+            hi = store - 1;
+        }
+    }
+}
+
+/**
+ * Mark in keep the k nonzeros of largest magnitude in each slice, ties going
+ * to the earlier position, given the slice of every nonzero.
+ * @param keep    nnz flags, overwritten
+ * @param vals    the nnz values, NULL for a pattern tensor
+ * @param slices  the slice of each nonzero, below nslices
+ * @param k       the number of nonzeros kept per slice
+ */
+int spt_TopKFlags(uint8_t * const keep, sptValue const * const vals, sptIndex const * const slices,
+    sptNnzIndex const nnz, sptIndex const nslices, sptIndex const k, int const tk)
+{
+    sptNnzIndex * start = calloc((size_t) nslices + 1, sizeof *start);
+    sptNnzIndex * fill = malloc(((size_t) nslices + 1) * sizeof *fill);
+    sptNnzIndex * ids = malloc((nnz > 0 ? nnz : 1) * sizeof *ids);
+    spt_CheckOSError(!start || !fill || !ids, "SpTns TopK");
+
+    /* Bucket the nonzeros by slice */
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        #pragma omp atomic update
+        ++start[slices[z] + 1];
+    }
+    for(sptIndex s = 0; s < nslices; ++s) {
+        start[s + 1] += start[s];
+    }
+    memcpy(fill, start, ((size_t) nslices + 1) * sizeof *fill);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptNnzIndex at;
+        #pragma omp atomic capture
+        at = fill[slices[z]]++;
+        ids[at] = z;
+        keep[z] = 0;
+    }
+    free(fill);
+
+    /* The bucket order depends on the threads, the selection does not */
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+    for(sptIndex s = 0; s < nslices; ++s) {
+        sptNnzIndex * const bucket = ids + start[s];
+        sptNnzIndex const n = start[s + 1] - start[s];
+        sptNnzIndex const kept = n < k ? n : k;
+        if(kept > 0 && kept < n) {
+            spt_TopKSelect(bucket, n, kept, vals);
+        }
+        for(sptNnzIndex i = 0; i < kept; ++i) {
+            keep[bucket[i]] = 1;
+        }
+    }
+    free(start);
+    free(ids);
+    return 0;
+}
+
+
+/* Keep the flagged nonzeros of tsr, in order */
+static int spt_SparseTensorCompact(sptSparseTensor *tsr, uint8_t const * const keep, int const tk, char const * const module) {
+    (void) module;
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    int const pattern = sptSparseTensorIsPattern(tsr);
+    sptNnzIndex * offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, module);
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const lo = nnz * tid / tk;
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex count = 0;
+        for(sptNnzIndex z = lo; z < hi; ++z) {
+            count += keep[z];
+        }
+        offsets[tid + 1] = count;
+    }
+    for(int t = 0; t < tk; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    sptNnzIndex const nnz_out = offsets[tk];
+
+    int result;
+    sptIndexVector * inds = malloc(nmodes * sizeof *inds);
+    spt_CheckOSError(!inds, module);
+    sptValueVector values;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptNewIndexVector(&inds[m], nnz_out, nnz_out);
+        spt_CheckError(result, module, NULL);
+    }
+    if(!pattern) {
+        result = sptNewValueVector(&values, nnz_out, nnz_out);
+        spt_CheckError(result, module, NULL);
+    }
+
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const lo = nnz * tid / tk;
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex out = offsets[tid];
+        for(sptNnzIndex z = lo; z < hi; ++z) {
+            if(keep[z]) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    inds[m].data[out] = tsr->inds[m].data[z];
+                }
+                if(!pattern) {
+                    values.data[out] = tsr->values.data[z];
+                }
+                ++ out;
+            }
+        }
+    }
+    free(offsets);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeIndexVector(&tsr->inds[m]);
+        tsr->inds[m] = inds[m];
+    }
+    free(inds);
+    if(!pattern) {
+        sptFreeValueVector(&tsr->values);
+        tsr->values = values;
+    }
+    tsr->nnz = nnz_out;
+    spt_SparseTensorDropOrderCache(tsr);
+    return 0;
+}
+
+
+/**
+ * Drop the nonzeros of a sparse tensor whose magnitude is below a threshold,
+ * in parallel. The remaining nonzeros keep their order.
+ * @param tsr       the sparse tensor to operate on
+ * @param threshold nonzeros with |value| < threshold are dropped
+ * @param tk        the number of threads, 0 for the default
+ */
+int sptSparseTensorThreshold(sptSparseTensor *tsr, sptValue const threshold, int tk) {
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptNnzIndex const nnz = tsr->nnz;
+    sptValue const * const vals = tsr->values.data;
+    uint8_t * keep = malloc(nnz > 0 ? nnz : 1);
+    spt_CheckOSError(!keep, "SpTns Threshold");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        keep[z] = (vals != NULL ? fabs(vals[z]) : 1) >= threshold;
+    }
+    int const result = spt_SparseTensorCompact(tsr, keep, tk, "SpTns Threshold");
+    free(keep);
+    spt_CheckError(result, "SpTns Threshold", NULL);
+    return 0;
+}
+
+
+/**
+ * Keep the k nonzeros of largest magnitude in each slice of one mode, in
+ * parallel, ties going to the one stored first. The remaining nonzeros keep
+ * their order.
+ * @param tsr  the sparse tensor to operate on
+ * @param mode the mode whose slices are pruned
+ * @param k    the number of nonzeros kept per slice
+ * @param tk   the number of threads, 0 for the default
+ */
+int sptSparseTensorTopK(sptSparseTensor *tsr, sptIndex const mode, sptIndex const k, int tk) {
+    if(mode >= tsr->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns TopK", "mode out of range");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    uint8_t * keep = malloc(tsr->nnz > 0 ? tsr->nnz : 1);
+    spt_CheckOSError(!keep, "SpTns TopK");
+    int result = spt_TopKFlags(keep, tsr->values.data, tsr->inds[mode].data, tsr->nnz, tsr->ndims[mode], k, tk);
+    if(result == 0) {
+        result = spt_SparseTensorCompact(tsr, keep, tk, "SpTns TopK");
+    }
+    free(keep);
+    spt_CheckError(result, "SpTns TopK", NULL);
+    return 0;
+}
@@ -23,56 +23,73 @@
 #include <string.h>
 #include <math.h>
 
+/* Whether a dense value is kept as a nonzero: NaN, infinite, or normal and not within epsilon of zero */
+static inline int spt_IsKeptValue(sptValue const data, sptValue const epsilon) {
+    int const data_class = fpclassify(data);
+    return data_class == FP_NAN ||
+        data_class == FP_INFINITE ||
+        (data_class == FP_NORMAL && !(data < epsilon && data > -epsilon));
+}
+
 /**
  * Convert a semi sparse tensor into a sparse tensor
+ *
+ * Each thread counts the values kept in an even share of the fibers, and
+ * after a prefix sum over the shares writes them at their final slots, so the
+ * output is allocated once.
  * @param[out] dest    a pointer to an uninitialized sparse tensor
  * @param[in]  src     a pointer to a valid semi sparse tensor
  * @param      epsilon a small positive value, usually 1e-6, which is considered approximately equal to zero
  */
 int sptSemiSparseTensorToSparseTensor(sptSparseTensor *dest, const sptSemiSparseTensor *src, sptValue epsilon) {
-    sptNnzIndex i;
-    int result;
-    sptIndex nmodes = src->nmodes;
+    sptIndex const nmodes = src->nmodes;
+    sptIndex const mode = src->mode;
+    sptIndex const dim = src->ndims[mode];
+    sptIndex const stride = src->stride;
+    sptNnzIndex const nfibers = src->nnz;
     assert(epsilon > 0);
-    dest->nmodes = nmodes;
-    dest->sortorder = malloc(nmodes * sizeof dest->sortorder[0]);
-    dest->ndims = malloc(nmodes * sizeof *dest->ndims);
-    spt_CheckOSError(!dest->ndims, "SspTns -> SpTns");
-    memcpy(dest->ndims, src->ndims, nmodes * sizeof *dest->ndims);
-    dest->nnz = 0;
-    dest->inds = malloc(nmodes * sizeof *dest->inds);
-    spt_CheckOSError(!dest->inds, "SspTns -> SpTns");
-    for(i = 0; i < nmodes; ++i) {
-        result = sptNewIndexVector(&dest->inds[i], 0, src->nnz);
-        spt_CheckError(result, "SspTns -> SpTns", NULL);
+#ifdef PARTI_USE_OPENMP
+    int const tk = omp_in_parallel() ? 1 : sptExecThreads(0);
+#else
+    int const tk = 1;
+#endif
+
+    sptNnzIndex * offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SspTns -> SpTns");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex count = 0;
+        for(sptNnzIndex i = nfibers * p / tk; i < nfibers * (p + 1) / tk; ++i) {
+            sptValue const * const fiber = &src->values.values[i * stride];
+            for(sptIndex j = 0; j < dim; ++j) {
+                count += spt_IsKeptValue(fiber[j], epsilon);
+            }
+        }
+        offsets[p + 1] = count;
+    }
+    for(int p = 0; p < tk; ++p) {
+        offsets[p + 1] += offsets[p];
     }
-    result = sptNewValueVector(&dest->values, 0, src->nnz);
+
+    int result = spt_SparseTensorNewSized(dest, nmodes, src->ndims, offsets[tk]);
     spt_CheckError(result, "SspTns -> SpTns", NULL);
-    for(i = 0; i < src->nnz; ++i) {
-        sptIndex j;
-        for(j = 0; j < src->ndims[src->mode]; ++j) {
-            sptValue data = src->values.values[i*src->stride + j];
-            int data_class = fpclassify(data);
-            if(
-                data_class == FP_NAN ||
-                data_class == FP_INFINITE ||
-                (data_class == FP_NORMAL && !(data < epsilon && data > -epsilon))
-            ) {
-                sptIndex m;
-                for(m = 0; m < nmodes; ++m) {
-                    if(m != src->mode) {
-                        result = sptAppendIndexVector(&dest->inds[m], src->inds[m].data[i]);
-                    } else {
-                        result = sptAppendIndexVector(&dest->inds[src->mode], j);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex out = offsets[p];
+        for(sptNnzIndex i = nfibers * p / tk; i < nfibers * (p + 1) / tk; ++i) {
+            sptValue const * const fiber = &src->values.values[i * stride];
+            for(sptIndex j = 0; j < dim; ++j) {
+                if(spt_IsKeptValue(fiber[j], epsilon)) {
+                    for(sptIndex m = 0; m < nmodes; ++m) {
+                        dest->inds[m].data[out] = m != mode ? src->inds[m].data[i] : j;
                     }
-                    spt_CheckError(result, "SspTns -> SpTns", NULL);
+                    dest->values.data[out] = fiber[j];
+                    ++out;
                 }
-                result = sptAppendValueVector(&dest->values, data);
-                spt_CheckError(result, "SspTns -> SpTns", NULL);
-                ++dest->nnz;
             }
         }
     }
+    free(offsets);
     sptSparseTensorSortIndex(dest, 1);
     return 0;
 }
@@ -0,0 +1,195 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include "sptensor.h"
+
+/*
+ * Every nonzero draws from its own splitmix64 stream seeded by (seed, z), so
+ * the generated tensor depends on the seed only, not on the thread count.
+ */
+
+static inline sptIndex spt_GenScale(double u, sptIndex n) {
+    sptIndex i = (sptIndex) (u * n);
+    return i < n ? i : n - 1;
+}
+
+/* Inverse CDF of the continuous power law x^-alpha on [1, n+1), shifted to [0, n) */
+static inline sptIndex spt_GenPowerLaw(double u, sptIndex n, double alpha) {
+    double x;
+    if(fabs(alpha - 1.0) < 1e-12) {
+        x = pow((double) n + 1, u);
+    } else {
+        double const e = 1.0 - alpha;
+        x = pow(1.0 + u * (pow((double) n + 1, e) - 1.0), 1.0 / e);
+    }
+    if(x < 1) {
+        return 0;
+    }
+    sptIndex i = (sptIndex) (x - 1);
+    return i < n ? i : n - 1;
+}
+
+static inline sptIndex spt_GenLevels(sptIndex n) {
+    sptIndex l = 0;
+    while(l < 8 * sizeof(sptIndex) && ((uint64_t) 1 << l) < (uint64_t) n) {
+        ++l;
+    }
+    return l;
+}
+
+/*
+ * One R-MAT descent: at every level the all-low cell of the 2^k active modes
+ * is taken with probability p, any other cell uniformly. Modes with fewer
+ * levels join at the bottom. Out of range coordinates are drawn again.
+ */
+static void spt_GenKronecker(
+    sptIndex *coord,
+    uint64_t *state,
+    sptIndex const nmodes,
+    sptIndex const *ndims,
+    sptIndex const *levels,
+    sptIndex const maxlevel,
+    double const p)
+{
+    for(;;) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            coord[m] = 0;
+        }
+        for(sptIndex l = 0; l < maxlevel; ++l) {
+            sptIndex nactive = 0;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                nactive += levels[m] + l >= maxlevel;
+            }
+            uint64_t cell = 0;
+            if(nactive > 0 && spt_GenUniform(state) >= p) {
+                uint64_t const ncells = ((uint64_t) 1 << nactive) - 1;
+                cell = 1 + spt_GenNext(state) % ncells;
+            }
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                if(levels[m] + l >= maxlevel) {
+                    coord[m] = (coord[m] << 1) | (sptIndex) (cell & 1);
+                    cell >>= 1;
+                }
+            }
+        }
+        sptIndex m = 0;
+        while(m < nmodes && coord[m] < ndims[m]) {
+            ++m;
+        }
+        if(m == nmodes) {
+            return;
+        }
+    }
+}
+
+/**
+ * Generate a random sparse tensor in parallel, directly into memory.
+ *
+ * @param tsr    the tensor to create
+ * @param nmodes the number of modes, at most 63
+ * @param ndims  the size of each mode
+ * @param nnz    the number of nonzeros; duplicate coordinates are kept
+ * @param kind   the index distribution
+ * @param param  SPT_GEN_POWERLAW: the exponent, >= 0 (0 is uniform);
+ *               SPT_GEN_KRONECKER: the all-low quadrant weight in (0, 1), e.g. 0.57;
+ *               ignored for SPT_GEN_UNIFORM
+ * @param seed   the same seed gives the same tensor for any thread count
+ * @param nt     the number of threads
+ *
+ * Values are uniform in (0, 1]. Pages are first touched by the generating
+ * threads. Sort and merge the result if duplicates matter; write it with
+ * sptDumpSparseTensorBinary to skip text parsing in later runs.
+ */
+int sptGenerateSparseTensor(
+    sptSparseTensor *tsr,
+    sptIndex nmodes,
+    const sptIndex ndims[],
+    sptNnzIndex nnz,
+    sptGeneratorKind const kind,
+    double const param,
+    uint64_t const seed,
+    int const nt)
+{
+    if(nmodes == 0 || nmodes > 63) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Generate", "nmodes out of range");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(ndims[m] == 0) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Generate", "zero-sized mode");
+        }
+    }
+    if(kind == SPT_GEN_POWERLAW && !(param >= 0)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Generate", "power-law exponent must be >= 0");
+    } else if(kind == SPT_GEN_KRONECKER && !(param > 0 && param < 1)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Generate", "Kronecker weight must be in (0, 1)");
+    } else if(kind != SPT_GEN_UNIFORM && kind != SPT_GEN_POWERLAW && kind != SPT_GEN_KRONECKER) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Generate", "unknown generator");
+    }
+
+    int result = sptNewSparseTensor(tsr, nmodes, ndims);
+    spt_CheckError(result, "SpTns Generate", NULL);
+    result = spt_SparseTensorReserve(tsr, nnz);
+    if(result != 0) {
+        sptFreeSparseTensor(tsr);
+        spt_CheckError(result, "SpTns Generate", NULL);
+    }
+
+    sptIndex levels[63];
+    sptIndex maxlevel = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        levels[m] = spt_GenLevels(ndims[m]);
+        if(levels[m] > maxlevel) {
+            maxlevel = levels[m];
+        }
+    }
+    uint64_t const base = spt_GenMix(seed ^ 0x243f6a8885a308d3ULL);
+
+    #pragma omp parallel for schedule(static) num_threads(nt)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        uint64_t state = base ^ spt_GenMix(z + 1);
+        sptIndex coord[63];
+        switch(kind) {
+        case SPT_GEN_POWERLAW:
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                coord[m] = spt_GenPowerLaw(spt_GenUniform(&state), ndims[m], param);
+            }
+            break;
+        case SPT_GEN_KRONECKER:
+            spt_GenKronecker(coord, &state, nmodes, ndims, levels, maxlevel, param);
+            break;
+        default:
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                coord[m] = spt_GenScale(spt_GenUniform(&state), ndims[m]);
+            }
+            break;
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            tsr->inds[m].data[z] = coord[m];
+        }
+        tsr->values.data[z] = (sptValue) (1.0 - spt_GenUniform(&state));
+    }
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->inds[m].len = nnz;
+    }
+    tsr->values.len = nnz;
+    tsr->nnz = nnz;
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+#include "sptensor.h"
+
+/*
+ * Reduced-precision value storage.
+ *
+ * A sptHalfValueVector keeps the values of a sparse tensor in 16 bits, bf16 or
+ * IEEE fp16, next to its index arrays. sptOmpMTTKRPHalf streams those instead
+ * of sptValue, optionally gathers 16-bit copies of the factor rows too, and
+ * does its arithmetic in float; only the output rows are sptValue.
+ */
+
+static inline uint32_t spt_FloatBits(float const f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof u);
+    return u;
+}
+
+static inline float spt_BitsFloat(uint32_t const u) {
+    float f;
+    memcpy(&f, &u, sizeof f);
+    return f;
+}
+
+/* float to bf16, rounding to nearest even and keeping NaNs quiet */
+static inline uint16_t spt_FloatToBF16(float const f) {
+    uint32_t const u = spt_FloatBits(f);
+    if((u & 0x7fffffffu) > 0x7f800000u) {
+        return (uint16_t) ((u >> 16) | 0x40);
+    }
+    return (uint16_t) ((u + 0x7fffu + ((u >> 16) & 1)) >> 16);
+}
+
+static inline float spt_BF16ToFloat(uint16_t const h) {
+    return spt_BitsFloat((uint32_t) h << 16);
+}
+
+/* float to fp16, rounding to nearest even; out-of-range values become infinite */
+static inline uint16_t spt_FloatToFP16(float const f) {
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t const u = spt_FloatBits(f);
+    uint16_t const sign = (uint16_t) ((u >> 16) & 0x8000);
+    uint32_t const a = u & 0x7fffffffu;
+    if(a > 0x7f800000u) {
+        return sign | 0x7e00;
+    }
+    if(a >= 0x477ff000u) {
+        return sign | 0x7c00;   /* rounds past the largest fp16, 65504 */
+    }
+    if(a < 0x38800000u) {
+        /* Subnormal or zero: align to 2^-24 units and round */
+        float const scaled = spt_BitsFloat(a) * 16777216.0f;
+        uint32_t const q = (uint32_t) scaled;
+        float const rem = scaled - (float) q;
+        return sign | (uint16_t) (q + (rem > 0.5f || (rem == 0.5f && (q & 1))));
+    }
+    uint32_t const r = a - 0x38000000u;     /* rebias the exponent from 127 to 15 */
+    return sign | (uint16_t) ((r + 0xfffu + ((r >> 13) & 1)) >> 13);
+#endif
+}
+
+static inline float spt_FP16ToFloat(uint16_t const h) {
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    uint32_t const sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t const e = (h >> 10) & 0x1f;
+    uint32_t const m = h & 0x3ff;
+    if(e == 0) {
+        float const f = (float) m * (1.0f / 16777216.0f);
+        return spt_BitsFloat(spt_FloatBits(f) | sign);
+    }
+    if(e == 31) {
+        return spt_BitsFloat(sign | 0x7f800000u | (m << 13));
+    }
+    return spt_BitsFloat(sign | ((e + 112) << 23) | (m << 13));
+#endif
+}
+
+static inline uint16_t spt_EncodeHalf(sptHalfFormat const format, float const f) {
+    return format == SPT_HALF_FP16 ? spt_FloatToFP16(f) : spt_FloatToBF16(f);
+}
+
+static inline float spt_DecodeHalf(sptHalfFormat const format, uint16_t const h) {
+    return format == SPT_HALF_FP16 ? spt_FP16ToFloat(h) : spt_BF16ToFloat(h);
+}
+
+
+/**
+ * Store the values of a sparse tensor in 16 bits, in its current nonzero
+ * order. Sorting or otherwise reordering the tensor afterwards leaves the
+ * copy stale, so make it from the tensor in the order it will be used in.
+ * The tensor keeps its own values; drop them with sptSparseTensorDropValues
+ * if they are all 1, or free them if only the 16-bit copy is used.
+ * @param hv     an uninitialized 16-bit value vector
+ * @param tsr    the sparse tensor
+ * @param format SPT_HALF_BF16, with the range of float, or SPT_HALF_FP16,
+ *               with 3 more mantissa bits but a largest value of 65504
+ * @param tk     the number of threads
+ */
+int sptNewHalfValueVector(sptHalfValueVector *hv, const sptSparseTensor *tsr, sptHalfFormat const format, int const tk) {
+    if(format != SPT_HALF_BF16 && format != SPT_HALF_FP16) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HalfVec New", "unknown 16-bit format");
+    }
+    hv->format = format;
+    hv->len = tsr->nnz;
+    hv->data = malloc((hv->len > 0 ? hv->len : 1) * sizeof *hv->data);
+    spt_CheckOSError(!hv->data, "HalfVec New");
+    sptValue const * const vals = tsr->values.data;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < hv->len; ++z) {
+        hv->data[z] = spt_EncodeHalf(format, vals != NULL ? (float) vals[z] : 1.0f);
+    }
+    return 0;
+}
+
+/**
+ * Release a 16-bit value vector
+ */
+void sptFreeHalfValueVector(sptHalfValueVector *hv) {
+    free(hv->data);
+    hv->data = NULL;
+    hv->len = 0;
+}
+
+/**
+ * Value z of a 16-bit value vector, widened
+ */
+sptValue sptHalfValueAt(const sptHalfValueVector *hv, sptNnzIndex const z) {
+    return (sptValue) spt_DecodeHalf(hv->format, hv->data[z]);
+}
+
+
+/**
+ * OpenMP MTTKRP over the 16-bit values of X, computed in float.
+ * @param X           the sparse tensor, in the order hv was made in
+ * @param hv          the values of X from sptNewHalfValueVector
+ * @param mats        (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mats_order  the order of the Khatri-Rao products
+ * @param mode        the mode on which the MTTKRP is performed
+ * @param half_factors nonzero to also read the factor rows from 16-bit
+ *                    copies, in the format of hv, made once per call
+ * @param tk          the number of threads
+ */
+int sptOmpMTTKRPHalf(sptSparseTensor const * const X,
+    sptHalfValueVector const * const hv,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    int const half_factors,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[0]->stride;
+    sptHalfFormat const format = hv->format;
+
+    if(hv->len != nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "hv->len != X->nnz");
+    }
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const restrict mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, mats[mode]->nrows * stride * sizeof (sptValue));
+
+    /* 16-bit copies of the factors read, packed R to a row */
+    uint16_t ** hmats = NULL;
+    if(half_factors) {
+        hmats = calloc(nmodes, sizeof *hmats);
+        spt_CheckOSError(!hmats, "CPU  SpTns MTTKRP");
+        for(sptIndex i=1; i<nmodes; ++i) {
+            sptMatrix const * const A = mats[mats_order[i]];
+            uint16_t * const H = malloc(((size_t) A->nrows * R + 1) * sizeof *H);
+            spt_CheckOSError(!H, "CPU  SpTns MTTKRP");
+            #pragma omp parallel for schedule(static) num_threads(tk)
+            for(sptIndex row=0; row<A->nrows; ++row) {
+                for(sptIndex r=0; r<R; ++r) {
+                    H[(size_t) row * R + r] = spt_EncodeHalf(format, (float) A->values[(size_t) row * stride + r]);
+                }
+            }
+            hmats[mats_order[i]] = H;
+        }
+    }
+
+    float * scratch = malloc((size_t) tk * R * sizeof *scratch + 1);
+    spt_CheckOSError(!scratch, "CPU  SpTns MTTKRP");
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        float * const restrict row = scratch + (size_t) tid * R;
+        #pragma omp for schedule(static)
+        for(sptNnzIndex x=0; x<nnz; ++x) {
+            float const entry = spt_DecodeHalf(format, hv->data[x]);
+            for(sptIndex r=0; r<R; ++r) {
+                row[r] = entry;
+            }
+            for(sptIndex i=1; i<nmodes; ++i) {
+                sptIndex const mi = mats_order[i];
+                sptIndex const ti = X->inds[mi].data[x];
+                if(hmats != NULL) {
+                    uint16_t const * const restrict hrow = hmats[mi] + (size_t) ti * R;
+                    for(sptIndex r=0; r<R; ++r) {
+                        row[r] *= spt_DecodeHalf(format, hrow[r]);
+                    }
+                } else {
+                    sptValue const * const restrict vrow = mats[mi]->values + (size_t) ti * stride;
+                    for(sptIndex r=0; r<R; ++r) {
+                        row[r] *= (float) vrow[r];
+                    }
+                }
+            }
+            sptValue * const restrict mvals_row = mvals + (size_t) mode_ind[x] * stride;
+            for(sptIndex r=0; r<R; ++r) {
+                #pragma omp atomic update
+                mvals_row[r] += row[r];
+            }
+        }
+    }
+    free(scratch);
+
+    if(hmats != NULL) {
+        for(sptIndex i=0; i<nmodes; ++i) {
+            free(hmats[i]);
+        }
+        free(hmats);
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+#define SPT_HASH_EMPTY ((sptNnzIndex) -1)
+
+/* Open-addressing table over the linearized coordinates of one operand.
+ * Keys are 64-bit when the tensor's index space fits, otherwise 128-bit. */
+typedef struct {
+    int wide;
+    sptNnzIndex mask;
+    sptNnzIndex * pos;      // nonzero location, or SPT_HASH_EMPTY
+    uint64_t * key64;
+    sptMortonIndex * key128;
+} spt_HashTable;
+
+static uint64_t spt_HashMix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint64_t spt_LinearKey64(const sptSparseTensor *tsr, sptNnzIndex const z) {
+    uint64_t key = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        key = key * tsr->ndims[m] + tsr->inds[m].data[z];
+    }
+    return key;
+}
+
+static inline sptMortonIndex spt_LinearKey128(const sptSparseTensor *tsr, sptNnzIndex const z) {
+    sptMortonIndex key = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        key = key * tsr->ndims[m] + tsr->inds[m].data[z];
+    }
+    return key;
+}
+
+/* Location in table->pos of the tsr[z] key, either holding it or empty */
+static inline sptNnzIndex spt_HashFind(spt_HashTable const * table, const sptSparseTensor *tsr, sptNnzIndex const z) {
+    sptNnzIndex slot;
+    if(table->wide) {
+        sptMortonIndex const key = spt_LinearKey128(tsr, z);
+        slot = spt_HashMix((uint64_t) key ^ spt_HashMix((uint64_t) (key >> 64))) & table->mask;
+        while(table->pos[slot] != SPT_HASH_EMPTY && table->key128[slot] != key) {
+            slot = (slot + 1) & table->mask;
+        }
+    } else {
+        uint64_t const key = spt_LinearKey64(tsr, z);
+        slot = spt_HashMix(key) & table->mask;
+        while(table->pos[slot] != SPT_HASH_EMPTY && table->key64[slot] != key) {
+            slot = (slot + 1) & table->mask;
+        }
+    }
+    return slot;
+}
+
+static int spt_NewHashTable(spt_HashTable *table, const sptSparseTensor *tsr, int const wide, int const nt, const char *module) {
+    (void) module;
+    sptNnzIndex cap = 16;
+    while(cap < 2 * tsr->nnz) {
+        cap <<= 1;
+    }
+    table->wide = wide;
+    table->mask = cap - 1;
+    table->pos = malloc(cap * sizeof *table->pos);
+    table->key64 = wide ? NULL : malloc(cap * sizeof *table->key64);
+    table->key128 = wide ? malloc(cap * sizeof *table->key128) : NULL;
+    spt_CheckOSError(!table->pos || (!table->key64 && !table->key128), module);
+    #pragma omp parallel for schedule(static) num_threads(nt)
+    for(sptNnzIndex s = 0; s < cap; ++s) {
+        table->pos[s] = SPT_HASH_EMPTY;
+    }
+
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        sptNnzIndex const slot = spt_HashFind(table, tsr, z);
+        if(table->pos[slot] == SPT_HASH_EMPTY) {
+            table->pos[slot] = z;
+            if(wide) {
+                table->key128[slot] = spt_LinearKey128(tsr, z);
+            } else {
+                table->key64[slot] = spt_LinearKey64(tsr, z);
+            }
+        }
+    }
+    return 0;
+}
+
+static void spt_FreeHashTable(spt_HashTable *table) {
+    free(table->pos);
+    free(table->key64);
+    free(table->key128);
+}
+
+/* Value of probe nonzero p, joined with build nonzero b or with nothing */
+static inline sptValue spt_JoinValue(
+    spt_JoinOp const op,
+    int const swapped,
+    const sptSparseTensor *P,
+    sptNnzIndex const p,
+    const sptSparseTensor *B,
+    sptNnzIndex const b)
+{
+    sptValue const pv = P->values.data[p];
+    sptValue const bv = b == SPT_HASH_EMPTY ? 0 : B->values.data[b];
+    return swapped ? op(bv, pv) : op(pv, bv);
+}
+
+/**
+ * Element-wise Z = op(X, Y) of two sparse tensors in any nonzero order, via a
+ * hash join on linearized coordinates instead of sorting both operands.
+ * Intersections build the table on the smaller operand and keep the order of
+ * the other; unions build on Y, keep the order of X and append Y-only
+ * nonzeros in Y's order, with op(x, 0) and op(0, y) for the unmatched sides.
+ * Results that are exactly zero are dropped.
+ * @param[out] Z        the result, should be uninitialized
+ * @param[in]  X        the first input, with unique coordinates
+ * @param[in]  Y        the second input, with unique coordinates
+ * @param[in]  op       the element-wise operation
+ * @param[in]  is_union 1 to keep nonzeros of either input, 0 for both only
+ * @param[in]  nt       the number of threads
+ * @param[in]  module   the module name errors are reported under
+ */
+int spt_SparseTensorHashJoin(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    spt_JoinOp const op,
+    int const is_union,
+    int const nt,
+    const char *module)
+{
+    /* Ensure X and Y are in same shape */
+    if(Y->nmodes != X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    for(sptIndex i = 0; i < X->nmodes; ++i) {
+        if(Y->ndims[i] != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+        }
+    }
+    sptIndex const nmodes = X->nmodes;
+
+    /* Linearized keys need the product of all mode sizes */
+    sptMortonIndex space = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(X->ndims[m] != 0 && space > ~(sptMortonIndex) 0 / X->ndims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, module, "index space exceeds a 128-bit key");
+        }
+        space *= X->ndims[m];
+    }
+    int const wide = space > (sptMortonIndex) UINT64_MAX;
+
+    int const nparts = nt > 0 ? nt : 1;
+    int const swapped = !is_union && X->nnz < Y->nnz;
+    const sptSparseTensor *P = swapped ? Y : X;
+    const sptSparseTensor *B = swapped ? X : Y;
+
+    spt_HashTable table;
+    int result = spt_NewHashTable(&table, B, wide, nparts, module);
+    spt_CheckError(result, module, NULL);
+
+    sptNnzIndex * match = malloc((P->nnz + 1) * sizeof *match);
+    unsigned char * matched = is_union ? calloc(B->nnz + 1, 1) : NULL;
+    spt_CheckOSError(!match || (is_union && !matched), module);
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(sptNnzIndex p = 0; p < P->nnz; ++p) {
+        match[p] = table.pos[spt_HashFind(&table, P, p)];
+        if(is_union && match[p] != SPT_HASH_EMPTY) {
+            matched[match[p]] = 1;
+        }
+    }
+    spt_FreeHashTable(&table);
+
+    /* Count, prefix-sum and scatter over nparts static blocks of P and then of B */
+    sptNnzIndex * offsets = calloc(2 * nparts + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, module);
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int t = 0; t < 2 * nparts; ++t) {
+        int const from_b = t >= nparts;
+        const sptSparseTensor *S = from_b ? B : P;
+        sptNnzIndex const begin = S->nnz * (t % nparts) / nparts;
+        sptNnzIndex const end = S->nnz * (t % nparts + 1) / nparts;
+        sptNnzIndex count = 0;
+        for(sptNnzIndex z = begin; z < end && (!from_b || is_union); ++z) {
+            if(from_b) {
+                count += !matched[z] && op(0, B->values.data[z]) != 0;
+            } else if(is_union || match[z] != SPT_HASH_EMPTY) {
+                count += spt_JoinValue(op, swapped, P, z, B, match[z]) != 0;
+            }
+        }
+        offsets[t + 1] = count;
+    }
+    for(int t = 0; t < 2 * nparts; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    sptNnzIndex const nnz = offsets[2 * nparts];
+
+    result = sptNewSparseTensor(Z, nmodes, X->ndims);
+    spt_CheckError(result, module, NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&Z->inds[m], nnz);
+        spt_CheckError(result, module, NULL);
+    }
+    result = sptResizeValueVector(&Z->values, nnz);
+    spt_CheckError(result, module, NULL);
+    Z->nnz = nnz;
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int t = 0; t < 2 * nparts; ++t) {
+        int const from_b = t >= nparts;
+        const sptSparseTensor *S = from_b ? B : P;
+        sptNnzIndex const begin = S->nnz * (t % nparts) / nparts;
+        sptNnzIndex const end = S->nnz * (t % nparts + 1) / nparts;
+        sptNnzIndex out = offsets[t];
+        for(sptNnzIndex z = begin; z < end && (!from_b || is_union); ++z) {
+            sptValue value;
+            if(from_b) {
+                if(matched[z]) {
+                    continue;
+                }
+                value = op(0, B->values.data[z]);
+            } else if(is_union || match[z] != SPT_HASH_EMPTY) {
+                value = spt_JoinValue(op, swapped, P, z, B, match[z]);
+            } else {
+                continue;
+            }
+            if(value == 0) {
+                continue;
+            }
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                Z->inds[m].data[out] = S->inds[m].data[z];
+            }
+            Z->values.data[out] = value;
+            ++out;
+        }
+    }
+
+    free(offsets);
+    free(matched);
+    free(match);
+    return 0;
+}
@@ -0,0 +1,428 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "hicoo.h"
+#include <float.h>
+#include <stdlib.h>
+
+/* Range of block sizes (in bits) the tuner tries. */
+#define SPT_TUNE_MIN_SB_BITS 3
+#define SPT_TUNE_MAX_SB_BITS 7
+/* Kernel sizes tried below the largest one that still gives enough kernels. */
+#define SPT_TUNE_NUM_SK 3
+#define SPT_TUNE_SK_STEP 2
+/* Stop growing blocks once they merge fewer than 10% of the blocks. */
+#define SPT_TUNE_MERGE_RATIO 0.9
+
+
+/**
+ * Run one HiCOO MTTKRP with the given variant
+ */
+int spt_MTTKRPHiCOOVariant(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptHiCOOMttkrpVariant const variant,
+    sptRankMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptRankMatrix * copy_mats[],    // temporary matrices for reduction
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int nt)
+{
+    switch(variant) {
+    case SPT_HICOO_MTTKRP_TILING:
+        if(nt == 1) {
+            return sptMTTKRPHiCOO_MatrixTiling(hitsr, mats, mats_order, mode);
+        }
+        return sptOmpMTTKRPHiCOO_MatrixTiling(hitsr, mats, mats_order, mode, nt);
+    case SPT_HICOO_MTTKRP_SCHEDULED:
+        return sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(hitsr, mats, mats_order, mode, nt);
+    case SPT_HICOO_MTTKRP_SCHEDULED_REDUCE:
+        if(copy_mats == NULL) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO MTTKRP Plan", "copy_mats required for reduction");
+        }
+        return sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(hitsr, mats, copy_mats, mats_order, mode, nt);
+    default:
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO MTTKRP Plan", "unknown MTTKRP variant");
+    }
+    return 0;
+}
+
+
+/**
+ * The variant chosen without tuning: privatize and reduce when a mode has too
+ * few kernel rows to schedule but many kernel iterations per row.
+ */
+sptHiCOOMttkrpVariant spt_HiCOODefaultVariant(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const mode)
+{
+    sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
+    sptIndex num_kernel_dim = (hitsr->ndims[mode] + sk - 1) / sk;
+    if(num_kernel_dim <= PAR_MIN_DEGREE * NUM_CORES && hitsr->nkiters[mode] / num_kernel_dim >= PAR_DEGREE_REDUCE) {
+        return SPT_HICOO_MTTKRP_SCHEDULED_REDUCE;
+    }
+    return SPT_HICOO_MTTKRP_SCHEDULED;
+}
+
+
+/**
+ * Matriced sparse tensor in HiCOO format times a sequence of dense matrix Khatri-Rao products (MTTKRP), using the variant a tuning plan chose for the mode
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size * ndims[mode] * R
+ * @param[in]  hitsr    the HiCOO sparse tensor input, converted with plan->sb_bits and plan->sk_bits
+ * @param[in]  plan    a plan from sptTuneHiCOOMTTKRP or sptLoadHiCOOPlan
+ * @param[in]  mats    (nmodes+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  copy_mats    plan->nthreads temporary matrices of at least ndims[mode] rows, may be NULL unless the mode's variant is SPT_HICOO_MTTKRP_SCHEDULED_REDUCE
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ */
+int sptMTTKRPHiCOOPlan(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptHiCOOPlan const * const plan,
+    sptRankMatrix * mats[],
+    sptRankMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode)
+{
+    if(plan->nmodes != hitsr->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "HiCOO MTTKRP Plan", "plan->nmodes != hitsr->nmodes");
+    }
+    return spt_MTTKRPHiCOOVariant(hitsr, plan->variants[mode], mats, copy_mats, mats_order, mode, plan->nthreads);
+}
+
+
+/* Average seconds of one MTTKRP after a warm-up run. */
+static double spt_TimeHiCOOVariant(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptHiCOOMttkrpVariant const variant,
+    sptRankMatrix * mats[],
+    sptRankMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    int const niters,
+    int const nt)
+{
+    sptAssert(spt_MTTKRPHiCOOVariant(hitsr, variant, mats, copy_mats, mats_order, mode, nt) == 0);
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+    for(int it = 0; it < niters; ++it) {
+        sptAssert(spt_MTTKRPHiCOOVariant(hitsr, variant, mats, copy_mats, mats_order, mode, nt) == 0);
+    }
+    sptStopTimer(timer);
+    double const seconds = sptElapsedTime(timer) / niters;
+    sptFreeTimer(timer);
+    return seconds;
+}
+
+
+/**
+ * Choose HiCOO block and kernel sizes and a per-mode MTTKRP variant by trial runs
+ * @param[out] plan    an uninitialized plan, release it with sptFreeHiCOOPlan
+ * @param[in]  tsr    the COO tensor; it is re-sorted by every trial conversion
+ * @param[in]  rank    the number of factor matrix columns to tune for
+ * @param[in]  niters    the number of timed MTTKRPs per candidate and mode
+ * @param[in]  nt    the number of threads
+ *
+ * Block sizes grow from 2^SPT_TUNE_MIN_SB_BITS while the block-local factor
+ * rows of all modes still fit in the fastest cache of the machine profile
+ * (L1_SIZE without one) and each doubling still merges at least 10% of the
+ * blocks, i.e. the block density keeps increasing. For every block
+ * size, the largest kernel size leaving PAR_MIN_DEGREE * nt kernel rows in the
+ * longest mode and a few smaller ones are converted and timed with every
+ * variant. The plan keeps the (sb_bits, sk_bits) with the lowest total MTTKRP
+ * time over all modes.
+ */
+int sptTuneHiCOOMTTKRP(
+    sptHiCOOPlan *plan,
+    sptSparseTensor *tsr,
+    sptIndex const rank,
+    int const niters,
+    int const nt)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    if(rank == 0 || (sptElementIndex)rank != rank) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO Tune", "rank does not fit sptElementIndex");
+    }
+    if(niters <= 0 || nt <= 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO Tune", "niters and nt must be positive");
+    }
+
+    plan->fingerprint = sptSparseTensorFingerprint(tsr);
+    plan->nmodes = nmodes;
+    plan->rank = rank;
+    plan->nthreads = nt;
+    plan->sb_bits = 0;
+    plan->sk_bits = 0;
+    plan->variants = malloc(nmodes * sizeof *plan->variants);
+    spt_CheckOSError(!plan->variants, "HiCOO Tune");
+    plan->seconds = malloc(nmodes * sizeof *plan->seconds);
+    spt_CheckOSError(!plan->seconds, "HiCOO Tune");
+
+    sptIndex max_ndims = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(tsr->ndims[m] > max_ndims) {
+            max_ndims = tsr->ndims[m];
+        }
+    }
+
+    sptHiCOOMttkrpVariant const all_variants[] = {
+        SPT_HICOO_MTTKRP_TILING, SPT_HICOO_MTTKRP_SCHEDULED, SPT_HICOO_MTTKRP_SCHEDULED_REDUCE
+    };
+    int const nvariants = nt == 1 ? 1 : 3;
+
+    /* Factors and reduction buffers shared by all candidates */
+    sptRankMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+    spt_CheckOSError(!mats, "HiCOO Tune");
+    for(sptIndex m = 0; m < nmodes+1; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        spt_CheckOSError(!mats[m], "HiCOO Tune");
+        sptAssert(sptNewRankMatrix(mats[m], m < nmodes ? tsr->ndims[m] : max_ndims, rank) == 0);
+        sptAssert(sptConstantRankMatrix(mats[m], m < nmodes ? 1 : 0) == 0);
+    }
+    sptRankMatrix ** copy_mats = NULL;
+    if(nvariants > 2) {
+        copy_mats = malloc(nt * sizeof *copy_mats);
+        spt_CheckOSError(!copy_mats, "HiCOO Tune");
+        for(int t = 0; t < nt; ++t) {
+            copy_mats[t] = malloc(sizeof *copy_mats[t]);
+            spt_CheckOSError(!copy_mats[t], "HiCOO Tune");
+            sptAssert(sptNewRankMatrix(copy_mats[t], max_ndims, rank) == 0);
+        }
+    }
+    sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+    spt_CheckOSError(!mats_order, "HiCOO Tune");
+    sptHiCOOMttkrpVariant * variants = malloc(nmodes * sizeof *variants);
+    spt_CheckOSError(!variants, "HiCOO Tune");
+    double * seconds = malloc(nmodes * sizeof *seconds);
+    spt_CheckOSError(!seconds, "HiCOO Tune");
+
+    /* Largest kernel size that leaves PAR_MIN_DEGREE * nt kernel rows. */
+    sptElementIndex sk_top = 0;
+    while(sk_top < 31 && (((sptNnzIndex)max_ndims + ((sptNnzIndex)2 << sk_top) - 1) >> (sk_top + 1)) >= (sptNnzIndex)PAR_MIN_DEGREE * nt) {
+        ++ sk_top;
+    }
+
+    sptMachineProfile const * const profile = sptGetMachineProfile();
+    size_t const l1_bytes = profile->l1_bytes > 0 ? profile->l1_bytes : L1_SIZE;
+
+    double best_cost = DBL_MAX;
+    sptNnzIndex prev_nb = 0;
+    for(sptElementIndex sb_bits = SPT_TUNE_MIN_SB_BITS; sb_bits <= SPT_TUNE_MAX_SB_BITS; ++sb_bits) {
+        if(sb_bits > SPT_TUNE_MIN_SB_BITS && ((sptNnzIndex)1 << sb_bits) * rank * nmodes * sizeof(sptValue) > l1_bytes) {
+            break;
+        }
+        int merged = 1;
+        int prev_sk = -1;
+        for(int s = 0; s < SPT_TUNE_NUM_SK; ++s) {
+            int const sk_signed = (int)sk_top - s * SPT_TUNE_SK_STEP;
+            sptElementIndex const sk_bits = sk_signed > (int)sb_bits ? (sptElementIndex)sk_signed : sb_bits;
+            if((int)sk_bits == prev_sk) {
+                break;  // Kernels cannot be smaller than blocks.
+            }
+            prev_sk = sk_bits;
+
+            sptSparseTensorHiCOO hitsr;
+            sptNnzIndex max_nnzb = 0;
+            sptAssert(sptSparseTensorToHiCOO(&hitsr, &max_nnzb, tsr, sb_bits, sk_bits, nt) == 0);
+            sptNnzIndex const nb = hitsr.bptr.len - 1;
+            if(s == 0) {
+                if(prev_nb > 0 && nb > SPT_TUNE_MERGE_RATIO * prev_nb) {
+                    merged = 0;
+                }
+                prev_nb = nb;
+            }
+
+            double cost = 0;
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                mats[nmodes]->nrows = tsr->ndims[mode];
+                seconds[mode] = DBL_MAX;
+                for(int v = 0; v < nvariants; ++v) {
+                    double const t = spt_TimeHiCOOVariant(&hitsr, all_variants[v], mats, copy_mats, mats_order, mode, niters, nt);
+                    if(t < seconds[mode]) {
+                        seconds[mode] = t;
+                        variants[mode] = all_variants[v];
+                    }
+                }
+                cost += seconds[mode];
+            }
+            sptFreeSparseTensorHiCOO(&hitsr);
+
+            if(cost < best_cost) {
+                best_cost = cost;
+                plan->sb_bits = sb_bits;
+                plan->sk_bits = sk_bits;
+                memcpy(plan->variants, variants, nmodes * sizeof *variants);
+                memcpy(plan->seconds, seconds, nmodes * sizeof *seconds);
+            }
+            if(!merged) {
+                break;
+            }
+        }
+        if(!merged) {
+            break;  // Larger blocks no longer gather nonzeros.
+        }
+    }
+
+    free(seconds);
+    free(variants);
+    free(mats_order);
+    if(copy_mats != NULL) {
+        for(int t = 0; t < nt; ++t) {
+            sptFreeRankMatrix(copy_mats[t]);
+            free(copy_mats[t]);
+        }
+        free(copy_mats);
+    }
+    for(sptIndex m = 0; m < nmodes+1; ++m) {
+        sptFreeRankMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+
+    return 0;
+}
+
+
+/**
+ * Release the memory of a HiCOO tuning plan
+ */
+void sptFreeHiCOOPlan(sptHiCOOPlan *plan) {
+    free(plan->variants);
+    free(plan->seconds);
+    plan->nmodes = 0;
+}
+
+
+/**
+ * Write a HiCOO tuning plan as text
+ * @param[in] plan the plan to write
+ * @param[in] fp   the file to write into
+ */
+int sptDumpHiCOOPlan(sptHiCOOPlan const * const plan, FILE *fp) {
+    int iores;
+    iores = fprintf(fp, "fingerprint %016"PRIx64"\n", plan->fingerprint);
+    spt_CheckOSError(iores < 0, "HiCOO Plan Dump");
+    iores = fprintf(fp, "nmodes %"PARTI_PRI_INDEX" rank %"PARTI_PRI_INDEX" nthreads %d\n", plan->nmodes, plan->rank, plan->nthreads);
+    spt_CheckOSError(iores < 0, "HiCOO Plan Dump");
+    iores = fprintf(fp, "sb_bits %u sk_bits %u\n", (unsigned) plan->sb_bits, (unsigned) plan->sk_bits);
+    spt_CheckOSError(iores < 0, "HiCOO Plan Dump");
+    for(sptIndex m = 0; m < plan->nmodes; ++m) {
+        iores = fprintf(fp, "mode %"PARTI_PRI_INDEX" variant %d seconds %.9g\n", m, (int) plan->variants[m], plan->seconds[m]);
+        spt_CheckOSError(iores < 0, "HiCOO Plan Dump");
+    }
+    return 0;
+}
+
+
+/**
+ * Read a HiCOO tuning plan written by sptDumpHiCOOPlan. The caller compares
+ * plan->fingerprint with sptSparseTensorFingerprint of its tensor to decide
+ * whether the plan applies.
+ * @param[out] plan an uninitialized plan, release it with sptFreeHiCOOPlan
+ * @param[in]  fp   the file to read from
+ */
+int sptLoadHiCOOPlan(sptHiCOOPlan *plan, FILE *fp) {
+    unsigned sb_bits, sk_bits;
+    if(fscanf(fp, " fingerprint %"SCNx64, &plan->fingerprint) != 1 ||
+        fscanf(fp, " nmodes %"PARTI_SCN_INDEX" rank %"PARTI_SCN_INDEX" nthreads %d", &plan->nmodes, &plan->rank, &plan->nthreads) != 3 ||
+        fscanf(fp, " sb_bits %u sk_bits %u", &sb_bits, &sk_bits) != 2) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO Plan Load", "malformed plan header");
+    }
+    plan->sb_bits = (sptElementIndex) sb_bits;
+    plan->sk_bits = (sptElementIndex) sk_bits;
+    plan->variants = malloc(plan->nmodes * sizeof *plan->variants);
+    spt_CheckOSError(!plan->variants, "HiCOO Plan Load");
+    plan->seconds = malloc(plan->nmodes * sizeof *plan->seconds);
+    spt_CheckOSError(!plan->seconds, "HiCOO Plan Load");
+    for(sptIndex m = 0; m < plan->nmodes; ++m) {
+        sptIndex mode;
+        int variant;
+        if(fscanf(fp, " mode %"PARTI_SCN_INDEX" variant %d seconds %lg", &mode, &variant, &plan->seconds[m]) != 3 || mode != m ||
+            variant < SPT_HICOO_MTTKRP_TILING || variant > SPT_HICOO_MTTKRP_SCHEDULED_REDUCE) {
+            sptFreeHiCOOPlan(plan);
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiCOO Plan Load", "malformed plan mode line");
+        }
+        plan->variants[m] = (sptHiCOOMttkrpVariant) variant;
+    }
+    return 0;
+}
+
+
+/**
+ * Load the HiCOO tuning plan stored at plan_path if it was made for this
+ * tensor, rank and thread count, otherwise tune one and store it there.
+ * With plan_path NULL the plan is kept in the plan cache (sptPlanCachePath)
+ * under this machine's profile, or only tuned if PARTI_PLAN_CACHE is not set.
+ * @param[out] plan    an uninitialized plan, release it with sptFreeHiCOOPlan
+ * @param[in]  plan_path    the plan file, or NULL
+ * @param[in]  tsr    the COO tensor
+ * @param[in]  rank    the number of factor matrix columns
+ * @param[in]  niters    the number of timed MTTKRPs per candidate and mode
+ * @param[in]  nt    the number of threads
+ */
+int sptTuneHiCOOMTTKRPCached(
+    sptHiCOOPlan *plan,
+    char const * const plan_path,
+    sptSparseTensor *tsr,
+    sptIndex const rank,
+    int const niters,
+    int const nt)
+{
+    char const * path = plan_path;
+    char * cache_path = NULL;
+    if(path == NULL) {
+        char kind[48];
+        snprintf(kind, sizeof kind, "hicoo-plan-r%"PARTI_PRI_INDEX"-t%d", rank, nt);
+        cache_path = sptPlanCachePath(tsr, sptGetMachineProfile(), kind);
+        if(cache_path == NULL) {
+            return sptTuneHiCOOMTTKRP(plan, tsr, rank, niters, nt);
+        }
+        path = cache_path;
+    }
+    FILE *fp = fopen(path, "r");
+    if(fp != NULL) {
+        int const loaded = sptLoadHiCOOPlan(plan, fp);
+        fclose(fp);
+        if(loaded == 0) {
+            if(plan->fingerprint == sptSparseTensorFingerprint(tsr) && plan->nmodes == tsr->nmodes &&
+                plan->rank == rank && plan->nthreads == nt) {
+                free(cache_path);
+                return 0;
+            }
+            sptFreeHiCOOPlan(plan);
+        }
+    }
+
+    int result = sptTuneHiCOOMTTKRP(plan, tsr, rank, niters, nt);
+    spt_CheckError(result, "HiCOO Tune", NULL);
+    fp = fopen(path, "w");
+    if(fp == NULL && cache_path != NULL) {
+        free(cache_path);
+        return 0;   // The cache only saves time, a run does not depend on it
+    }
+    free(cache_path);
+    spt_CheckOSError(fp == NULL, "HiCOO Tune");
+    result = sptDumpHiCOOPlan(plan, fp);
+    fclose(fp);
+    spt_CheckError(result, "HiCOO Tune", NULL);
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <string.h>
+#include "hicoo.h"
+
+#define PARTI_HICOO_BINARY_MAGIC "PTIHICOO"
+#define PARTI_HICOO_BINARY_VERSION 1
+#define PARTI_HICOO_BINARY_ENDIAN 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t nmodes;
+    uint8_t index_width;
+    uint8_t nnz_index_width;
+    uint8_t block_index_width;
+    uint8_t element_index_width;
+    uint8_t value_width;
+    uint8_t sb_bits;
+    uint8_t sk_bits;
+    uint8_t sc_bits;
+    uint32_t reserved;
+    uint64_t nnz;
+} spt_HiCOOBinaryHeader;
+
+
+/* Each array is stored as a uint64 length followed by its elements. */
+static int spt_WriteBinaryArray(void const * data, size_t elem_size, uint64_t len, FILE *fp)
+{
+    size_t iores = fwrite(&len, sizeof len, 1, fp);
+    spt_CheckOSError(iores != 1, "HiSpTns Bin Dump");
+    if(len != 0) {
+        iores = fwrite(data, elem_size, len, fp);
+        spt_CheckOSError(iores != len, "HiSpTns Bin Dump");
+    }
+    return 0;
+}
+
+static int spt_ReadBinaryLength(uint64_t *len, FILE *fp)
+{
+    size_t iores = fread(len, sizeof *len, 1, fp);
+    spt_CheckOSError(iores != 1, "HiSpTns Bin Load");
+    return 0;
+}
+
+static int spt_ReadBinaryData(void * data, size_t elem_size, uint64_t len, FILE *fp)
+{
+    if(len != 0) {
+        size_t iores = fread(data, elem_size, len, fp);
+        spt_CheckOSError(iores != len, "HiSpTns Bin Load");
+    }
+    return 0;
+}
+
+static int spt_ReadBinaryFixedArray(void * data, size_t elem_size, uint64_t expected, FILE *fp)
+{
+    uint64_t len;
+    int result = spt_ReadBinaryLength(&len, fp);
+    spt_CheckError(result, "HiSpTns Bin Load", NULL);
+    if(len != expected) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "HiSpTns Bin Load", "unexpected array length");
+    }
+    return spt_ReadBinaryData(data, elem_size, len, fp);
+}
+
+#define SPT_READ_BINARY_VECTOR(vec, resize, fp) do { \
+        uint64_t len_; \
+        result = spt_ReadBinaryLength(&len_, (fp)); \
+        spt_CheckError(result, "HiSpTns Bin Load", NULL); \
+        result = resize((vec), len_); \
+        spt_CheckError(result, "HiSpTns Bin Load", NULL); \
+        result = spt_ReadBinaryData((vec)->data, sizeof *(vec)->data, len_, (fp)); \
+        spt_CheckError(result, "HiSpTns Bin Load", NULL); \
+    } while(0)
+
+
+/**
+ * Save a HiCOO sparse tensor, including its scheduler, into a binary file
+ * so the conversion from COO can be done once and reused.
+ * @param hitsr the HiCOO tensor to write
+ * @param fp    the file to write into, opened in binary mode
+ */
+int sptDumpSparseTensorHiCOOBinary(sptSparseTensorHiCOO const * const hitsr, FILE *fp)
+{
+    spt_CheckUniformBlocks(hitsr, "HiSpTns Dump");
+    int result;
+    sptIndex const nmodes = hitsr->nmodes;
+    sptIndex const sk = (sptIndex)pow(2, hitsr->sk_bits);
+    spt_HiCOOBinaryHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_HICOO_BINARY_MAGIC, sizeof header.magic);
+    header.version = PARTI_HICOO_BINARY_VERSION;
+    header.endian = PARTI_HICOO_BINARY_ENDIAN;
+    header.nmodes = nmodes;
+    header.index_width = sizeof(sptIndex);
+    header.nnz_index_width = sizeof(sptNnzIndex);
+    header.block_index_width = sizeof(sptBlockIndex);
+    header.element_index_width = sizeof(sptElementIndex);
+    header.value_width = sizeof(sptValue);
+    header.sb_bits = hitsr->sb_bits;
+    header.sk_bits = hitsr->sk_bits;
+    header.sc_bits = hitsr->sc_bits;
+    header.nnz = hitsr->nnz;
+
+    size_t iores = fwrite(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "HiSpTns Bin Dump");
+
+    result = spt_WriteBinaryArray(hitsr->ndims, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    result = spt_WriteBinaryArray(hitsr->sortorder, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    result = spt_WriteBinaryArray(hitsr->nkiters, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const kernel_ndim = (hitsr->ndims[m] + sk - 1)/sk;
+        for(sptIndex i = 0; i < kernel_ndim; ++i) {
+            result = spt_WriteBinaryArray(hitsr->kschr[m][i].data, sizeof(sptIndex), hitsr->kschr[m][i].len, fp);
+            spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+        }
+    }
+
+    result = spt_WriteBinaryArray(hitsr->kptr.data, sizeof(sptNnzIndex), hitsr->kptr.len, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    result = spt_WriteBinaryArray(hitsr->cptr.data, sizeof(sptNnzIndex), hitsr->cptr.len, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    result = spt_WriteBinaryArray(hitsr->bptr.data, sizeof(sptNnzIndex), hitsr->bptr.len, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = spt_WriteBinaryArray(hitsr->binds[m].data, sizeof(sptBlockIndex), hitsr->binds[m].len, fp);
+        spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = spt_WriteBinaryArray(hitsr->einds[m].data, sizeof(sptElementIndex), hitsr->einds[m].len, fp);
+        spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+    }
+    result = spt_WriteBinaryArray(hitsr->values.data, sizeof(sptValue), hitsr->values.len, fp);
+    spt_CheckError(result, "HiSpTns Bin Dump", NULL);
+
+    return 0;
+}
+
+
+/**
+ * Load a HiCOO sparse tensor written by sptDumpSparseTensorHiCOOBinary.
+ * The file must have been written by a build with the same type widths.
+ * @param hitsr an uninitialized HiCOO tensor
+ * @param fp    the file to read from, opened in binary mode
+ */
+int sptLoadSparseTensorHiCOOBinary(sptSparseTensorHiCOO *hitsr, FILE *fp)
+{
+    int result;
+    spt_HiCOOBinaryHeader header;
+    size_t iores = fread(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "HiSpTns Bin Load");
+    if(memcmp(header.magic, PARTI_HICOO_BINARY_MAGIC, sizeof header.magic) != 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Bin Load", "not a ParTI binary HiCOO tensor");
+    }
+    if(header.endian != PARTI_HICOO_BINARY_ENDIAN) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Bin Load", "byte order mismatch");
+    }
+    if(header.version > PARTI_HICOO_BINARY_VERSION) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Bin Load", "unsupported format version");
+    }
+    if(header.index_width != sizeof(sptIndex) || header.nnz_index_width != sizeof(sptNnzIndex) ||
+        header.block_index_width != sizeof(sptBlockIndex) || header.element_index_width != sizeof(sptElementIndex) ||
+        header.value_width != sizeof(sptValue)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Bin Load", "type widths differ from this build");
+    }
+
+    sptIndex const nmodes = header.nmodes;
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "HiSpTns Bin Load");
+    result = spt_ReadBinaryFixedArray(ndims, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Load", NULL);
+    result = sptNewSparseTensorHiCOO(hitsr, nmodes, ndims, header.nnz, header.sb_bits, header.sk_bits, header.sc_bits);
+    spt_CheckError(result, "HiSpTns Bin Load", NULL);
+    free(ndims);
+
+    result = spt_ReadBinaryFixedArray(hitsr->sortorder, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Load", NULL);
+    result = spt_ReadBinaryFixedArray(hitsr->nkiters, sizeof(sptIndex), nmodes, fp);
+    spt_CheckError(result, "HiSpTns Bin Load", NULL);
+    sptIndex const sk = (sptIndex)pow(2, hitsr->sk_bits);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const kernel_ndim = (hitsr->ndims[m] + sk - 1)/sk;
+        for(sptIndex i = 0; i < kernel_ndim; ++i) {
+            SPT_READ_BINARY_VECTOR(&hitsr->kschr[m][i], sptResizeIndexVector, fp);
+        }
+    }
+
+    SPT_READ_BINARY_VECTOR(&hitsr->kptr, sptResizeNnzIndexVector, fp);
+    SPT_READ_BINARY_VECTOR(&hitsr->cptr, sptResizeNnzIndexVector, fp);
+    SPT_READ_BINARY_VECTOR(&hitsr->bptr, sptResizeNnzIndexVector, fp);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        SPT_READ_BINARY_VECTOR(&hitsr->binds[m], sptResizeBlockIndexVector, fp);
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        SPT_READ_BINARY_VECTOR(&hitsr->einds[m], sptResizeElementIndexVector, fp);
+    }
+    SPT_READ_BINARY_VECTOR(&hitsr->values, sptResizeValueVector, fp);
+    if(hitsr->values.len != hitsr->nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "HiSpTns Bin Load", "values.len != nnz");
+    }
+
+    return 0;
+}
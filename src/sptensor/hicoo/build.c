@@ -0,0 +1,563 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * Streaming HiCOO construction.
+ *
+ * sptSparseTensorToHiCOO sorts a complete COO tensor in place, so the COO and
+ * the HiCOO images live side by side. The builder instead bucket-sorts the
+ * nonzeros by kernel as they arrive. A kernel only needs the low sk_bits of
+ * each coordinate, stored in 1, 2 or 4 bytes, in fixed-size buffers chained
+ * per kernel. Finishing sorts and converts every kernel on its own, holding
+ * one kernel in COO per thread, and frees each kernel's buffers once its
+ * blocks are written. The result is the one sptSparseTensorToHiCOO gives.
+ */
+
+#define SPT_HICOO_BUILDER_CHUNK 4096
+
+
+static inline sptNnzIndex spt_HiCOOHashSlot(uint64_t const kernel, sptNnzIndex const nslots) {
+    return (sptNnzIndex) ((kernel * 0x9E3779B97F4A7C15ULL) >> 17) & (nslots - 1);
+}
+
+
+static inline void spt_HiCOOPutCoord(unsigned char * p, unsigned const bytes, sptIndex const v) {
+    switch(bytes) {
+    case 1: *p = (uint8_t) v; break;
+    case 2: memcpy(p, &(uint16_t) { (uint16_t) v }, 2); break;
+    default: memcpy(p, &(uint32_t) { (uint32_t) v }, 4); break;
+    }
+}
+
+
+static inline sptIndex spt_HiCOOGetCoord(unsigned char const * p, unsigned const bytes) {
+    uint16_t v16;
+    uint32_t v32;
+    switch(bytes) {
+    case 1: return *p;
+    case 2: memcpy(&v16, p, 2); return v16;
+    default: memcpy(&v32, p, 4); return v32;
+    }
+}
+
+
+/* Grow the kernel table to twice its size and rehash every bin */
+static int spt_HiCOOGrowSlots(sptHiCOOBuilder *bld) {
+    sptNnzIndex const nslots = bld->nslots * 2;
+    sptNnzIndex * slots = calloc(nslots, sizeof *slots);
+    spt_CheckOSError(!slots, "HiSpTns Builder");
+    for(sptNnzIndex i = 0; i < bld->nbins; ++i) {
+        sptNnzIndex s = spt_HiCOOHashSlot(bld->bins[i].kernel, nslots);
+        while(slots[s] != 0) {
+            s = (s + 1) & (nslots - 1);
+        }
+        slots[s] = i + 1;
+    }
+    free(bld->slots);
+    bld->slots = slots;
+    bld->nslots = nslots;
+    return 0;
+}
+
+
+/**
+ * Start building a HiCOO tensor from nonzeros given one at a time, in any order
+ * @param bld       an uninitialized builder
+ * @param nmodes    number of modes of the tensor
+ * @param ndims     the dimension of each mode
+ * @param sb_bits   the bits of block size (sb)
+ * @param sk_bits   the bits of superblock size (sk), at least sb_bits
+ * @param chunk_nnz the number of nonzeros per buffer, 0 for a default
+ */
+int sptNewHiCOOBuilder(
+    sptHiCOOBuilder *bld,
+    const sptIndex nmodes,
+    const sptIndex ndims[],
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    sptNnzIndex const chunk_nnz)
+{
+    if(sk_bits < sb_bits || sk_bits > 32) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Builder", "sk_bits < sb_bits or sk_bits > 32");
+    }
+    bld->nmodes = nmodes;
+    bld->ndims = malloc(nmodes * sizeof *bld->ndims);
+    bld->kdims = malloc(nmodes * sizeof *bld->kdims);
+    spt_CheckOSError(!bld->ndims || !bld->kdims, "HiSpTns Builder");
+    memcpy(bld->ndims, ndims, nmodes * sizeof *bld->ndims);
+    /* Kernels are numbered in row-major order, which must fit in 64 bits */
+    uint64_t nkernels = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        bld->kdims[m] = ndims[m] > 0 ? ((ndims[m] - 1) >> sk_bits) + 1 : 1;
+        if(nkernels > UINT64_MAX / bld->kdims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Builder", "too many kernels, raise sk_bits");
+        }
+        nkernels *= bld->kdims[m];
+    }
+    bld->sb_bits = sb_bits;
+    bld->sk_bits = sk_bits;
+    bld->nnz = 0;
+    bld->chunk_nnz = chunk_nnz > 0 ? chunk_nnz : SPT_HICOO_BUILDER_CHUNK;
+    bld->coord_bytes = sk_bits <= 8 ? 1 : sk_bits <= 16 ? 2 : 4;
+    bld->nbins = 0;
+    bld->bins_cap = 16;
+    bld->bins = malloc(bld->bins_cap * sizeof *bld->bins);
+    bld->nslots = 64;
+    bld->slots = calloc(bld->nslots, sizeof *bld->slots);
+    spt_CheckOSError(!bld->bins || !bld->slots, "HiSpTns Builder");
+    return 0;
+}
+
+
+/**
+ * Add one nonzero to a HiCOO builder
+ * @param bld    the builder
+ * @param coords the nmodes coordinates of the nonzero, from 0
+ * @param value  its value; duplicates are kept as separate nonzeros
+ */
+int sptHiCOOBuilderAppend(sptHiCOOBuilder *bld, const sptIndex coords[], sptValue const value) {
+    sptIndex const nmodes = bld->nmodes;
+    uint64_t kernel = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(coords[m] >= bld->ndims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Builder", "index out of range");
+        }
+        kernel = kernel * bld->kdims[m] + (coords[m] >> bld->sk_bits);
+    }
+
+    sptNnzIndex s = spt_HiCOOHashSlot(kernel, bld->nslots);
+    while(bld->slots[s] != 0 && bld->bins[bld->slots[s] - 1].kernel != kernel) {
+        s = (s + 1) & (bld->nslots - 1);
+    }
+    sptNnzIndex bi = bld->slots[s];
+    if(bi == 0) {
+        if(bld->nbins == bld->bins_cap) {
+            struct spt_HiCOOBin * bins = realloc(bld->bins, 2 * bld->bins_cap * sizeof *bins);
+            spt_CheckOSError(!bins, "HiSpTns Builder");
+            bld->bins = bins;
+            bld->bins_cap *= 2;
+        }
+        struct spt_HiCOOBin * const bin = &bld->bins[bld->nbins];
+        bin->kernel = kernel;
+        bin->nnz = 0;
+        bin->head = NULL;
+        bin->tail = NULL;
+        bi = bld->slots[s] = ++bld->nbins;
+        if(2 * bld->nbins > bld->nslots) {
+            int result = spt_HiCOOGrowSlots(bld);
+            spt_CheckError(result, "HiSpTns Builder", NULL);
+        }
+    }
+
+    struct spt_HiCOOBin * const bin = &bld->bins[bi - 1];
+    spt_HiCOOChunk * chunk = bin->tail;
+    if(chunk == NULL || chunk->len == bld->chunk_nnz) {
+        size_t const vbytes = bld->chunk_nnz * sizeof (sptValue);
+        chunk = malloc(sizeof *chunk + vbytes + bld->chunk_nnz * nmodes * bld->coord_bytes);
+        spt_CheckOSError(!chunk, "HiSpTns Builder");
+        chunk->next = NULL;
+        chunk->len = 0;
+        chunk->values = (sptValue *) (chunk + 1);
+        chunk->coords = (unsigned char *) chunk->values + vbytes;
+        if(bin->tail != NULL) {
+            bin->tail->next = chunk;
+        } else {
+            bin->head = chunk;
+        }
+        bin->tail = chunk;
+    }
+    sptIndex const kmask = (sptIndex) (((uint64_t) 1 << bld->sk_bits) - 1);
+    unsigned char * p = chunk->coords + chunk->len * nmodes * bld->coord_bytes;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        spt_HiCOOPutCoord(p, bld->coord_bytes, coords[m] & kmask);
+        p += bld->coord_bytes;
+    }
+    chunk->values[chunk->len++] = value;
+    ++bin->nnz;
+    ++bld->nnz;
+    return 0;
+}
+
+
+static void spt_HiCOOKernelKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    struct spt_HiCOOBin const * const bins = ctx;
+    (void) word;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = bins[perm[i]].kernel;
+    }
+}
+
+
+/* The first coordinate of a kernel in each mode */
+static void spt_HiCOOKernelOrigin(sptIndex * origin, sptHiCOOBuilder const * bld, uint64_t kernel) {
+    for(sptIndex m = bld->nmodes; m-- > 0; ) {
+        origin[m] = (sptIndex) (kernel % bld->kdims[m]) << bld->sk_bits;
+        kernel /= bld->kdims[m];
+    }
+}
+
+
+static void spt_HiCOOFreeChunks(struct spt_HiCOOBin * bin) {
+    spt_HiCOOChunk * chunk = bin->head;
+    while(chunk != NULL) {
+        spt_HiCOOChunk * const next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    bin->head = NULL;
+    bin->tail = NULL;
+}
+
+
+/*
+ * Sort the nonzeros of one bin as sptSparseTensorToHiCOO orders a kernel,
+ * writing them back into the bin's buffers, and count its blocks and chunks.
+ */
+static int spt_HiCOOSortKernel(
+    sptNnzIndex * nb_k,
+    sptNnzIndex * nc_k,
+    sptHiCOOBuilder const * bld,
+    struct spt_HiCOOBin * bin)
+{
+    sptIndex const nmodes = bld->nmodes;
+    unsigned const bytes = bld->coord_bytes;
+    sptElementIndex const sb_bits = bld->sb_bits;
+    sptIndex const sc = (sptIndex) 1 << 14;
+    sptIndex origin[nmodes];
+    spt_HiCOOKernelOrigin(origin, bld, bin->kernel);
+
+    sptSparseTensor tmp;
+    int result = spt_SparseTensorNewSized(&tmp, nmodes, bld->ndims, bin->nnz);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    sptNnzIndex z = 0;
+    for(spt_HiCOOChunk * chunk = bin->head; chunk != NULL; chunk = chunk->next) {
+        unsigned char const * p = chunk->coords;
+        for(sptNnzIndex i = 0; i < chunk->len; ++i, ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m, p += bytes) {
+                tmp.inds[m].data[z] = origin[m] + spt_HiCOOGetCoord(p, bytes);
+            }
+            tmp.values.data[z] = chunk->values[i];
+        }
+    }
+    sptSparseTensorSortIndexMorton(&tmp, 1, 0, tmp.nnz, sb_bits);
+
+    /* Same block and chunk boundaries as sptSparseTensorToHiCOO */
+    sptNnzIndex nb = 1, nc = 1, chunk_size = 0, ne = 1;
+    for(z = 1; z < tmp.nnz; ++z) {
+        int same = 1;
+        for(sptIndex m = 0; m < nmodes && same; ++m) {
+            same = (tmp.inds[m].data[z-1] >> sb_bits) == (tmp.inds[m].data[z] >> sb_bits);
+        }
+        if(same) {
+            ++ ne;
+        } else {
+            if(chunk_size + ne >= sc) {
+                ++ nc;
+                chunk_size = 0;
+            } else {
+                chunk_size += ne;
+            }
+            ++ nb;
+            ne = 1;
+        }
+    }
+    *nb_k = nb;
+    *nc_k = nc;
+
+    z = 0;
+    for(spt_HiCOOChunk * chunk = bin->head; chunk != NULL; chunk = chunk->next) {
+        unsigned char * p = chunk->coords;
+        for(sptNnzIndex i = 0; i < chunk->len; ++i, ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m, p += bytes) {
+                spt_HiCOOPutCoord(p, bytes, tmp.inds[m].data[z] - origin[m]);
+            }
+            chunk->values[i] = tmp.values.data[z];
+        }
+    }
+    sptFreeSparseTensor(&tmp);
+    return 0;
+}
+
+
+/**
+ * Finish a HiCOO builder into a HiCOO tensor, kernels in row-major order and
+ * blocks and elements in Morton order. The builder is left empty, still to
+ * be released by sptFreeHiCOOBuilder.
+ * @param[out] hitsr     an uninitialized HiCOO tensor
+ * @param[out] max_nnzb  the maximum number of nonzeros per tensor block
+ * @param[in]  bld       the builder
+ * @param[in]  tk        the number of threads
+ */
+int sptHiCOOBuilderFinish(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptHiCOOBuilder *bld,
+    int const tk)
+{
+    const sptElementIndex sc_bits = 14;
+    sptIndex const nmodes = bld->nmodes;
+    sptElementIndex const sb_bits = bld->sb_bits;
+    sptElementIndex const sk_bits = bld->sk_bits;
+    sptNnzIndex const nnz = bld->nnz;
+    sptNnzIndex const nk = bld->nbins;
+    sptIndex const sc = (sptIndex) 1 << sc_bits;
+    int result;
+
+    if(nnz == 0) {
+        *max_nnzb = 0;
+        return spt_NewEmptyHiCOO(hitsr, nmodes, bld->ndims, sb_bits, sk_bits);
+    }
+
+    sptTimer gen_timer;
+    sptNewTimer(&gen_timer, 0);
+    sptStartTimer(gen_timer);
+
+    /* Kernels in row-major order */
+    sptNnzIndex * order = malloc(nk * sizeof *order);
+    spt_CheckOSError(!order, "HiSpTns Builder");
+    uint64_t nkernels = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        nkernels *= bld->kdims[m];
+    }
+    unsigned kbits = 0;
+    while(kbits < 64 && (nkernels - 1) >> kbits != 0) {
+        ++kbits;
+    }
+    result = spt_RadixSortPermutation(order, nk, 1, &kbits, spt_HiCOOKernelKey, bld->bins, tk);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+
+    /* Sort every kernel and count its blocks and chunks */
+    sptNnzIndex * kernel_nb = malloc((nk + 1) * sizeof *kernel_nb);
+    sptNnzIndex * kernel_nc = malloc((nk + 1) * sizeof *kernel_nc);
+    sptNnzIndex * kernel_nz = malloc((nk + 1) * sizeof *kernel_nz);
+    spt_CheckOSError(!kernel_nb || !kernel_nc || !kernel_nz, "HiSpTns Builder");
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        if(spt_HiCOOSortKernel(&kernel_nb[k], &kernel_nc[k], bld, &bld->bins[order[k]]) != 0) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+    }
+    if(failed) {
+        spt_CheckError(SPTERR_UNKNOWN, "HiSpTns Builder", "kernel sort failed");
+    }
+
+    /* Exclusive prefix sums give the first nonzero, block and chunk of every kernel */
+    sptNnzIndex nb = 0, nc = 0, nz = 0;
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        sptNnzIndex const tmp_nb = kernel_nb[k], tmp_nc = kernel_nc[k];
+        kernel_nb[k] = nb;
+        kernel_nc[k] = nc;
+        kernel_nz[k] = nz;
+        nb += tmp_nb;
+        nc += tmp_nc;
+        nz += bld->bins[order[k]].nnz;
+    }
+    kernel_nb[nk] = nb;
+    kernel_nc[nk] = nc;
+    kernel_nz[nk] = nz;
+
+    result = sptNewSparseTensorHiCOO(hitsr, nmodes, bld->ndims, nnz, sb_bits, sk_bits, sc_bits);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->kptr, nk + 1);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->bptr, nb + 1);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->cptr, nc + 1);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeBlockIndexVector(&hitsr->binds[m], nb);
+        spt_CheckError(result, "HiSpTns Builder", NULL);
+        result = sptResizeElementIndexVector(&hitsr->einds[m], nnz);
+        spt_CheckError(result, "HiSpTns Builder", NULL);
+    }
+    result = sptResizeValueVector(&hitsr->values, nnz);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+
+    /* Write every kernel's blocks, then drop its buffers */
+    sptNnzIndex * const bptr = hitsr->bptr.data;
+    sptNnzIndex * const cptr = hitsr->cptr.data;
+    sptIndex const emask = ((sptIndex)1 << sb_bits) - 1;
+    unsigned const bytes = bld->coord_bytes;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        struct spt_HiCOOBin * const bin = &bld->bins[order[k]];
+        sptIndex origin[nmodes], coord[nmodes], prior[nmodes];
+        spt_HiCOOKernelOrigin(origin, bld, bin->kernel);
+        sptNnzIndex b = kernel_nb[k], c = kernel_nc[k], z = kernel_nz[k];
+        sptNnzIndex chunk_size = 0, ne = 0;
+        cptr[c] = b;
+        for(spt_HiCOOChunk * chunk = bin->head; chunk != NULL; chunk = chunk->next) {
+            unsigned char const * p = chunk->coords;
+            for(sptNnzIndex i = 0; i < chunk->len; ++i, ++z) {
+                int same = z != kernel_nz[k];
+                for(sptIndex m = 0; m < nmodes; ++m, p += bytes) {
+                    coord[m] = origin[m] + spt_HiCOOGetCoord(p, bytes);
+                    same = same && (coord[m] >> sb_bits) == (prior[m] >> sb_bits);
+                }
+                if(!same) {
+                    if(z != kernel_nz[k]) {
+                        ++ b;
+                        if(chunk_size + ne >= sc) {
+                            cptr[++ c] = b;
+                            chunk_size = 0;
+                        } else {
+                            chunk_size += ne;
+                        }
+                    }
+                    bptr[b] = z;
+                    for(sptIndex m = 0; m < nmodes; ++m)
+                        hitsr->binds[m].data[b] = (sptBlockIndex)(coord[m] >> sb_bits);
+                    ne = 0;
+                }
+                ++ ne;
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    hitsr->einds[m].data[z] = (sptElementIndex)(coord[m] & emask);
+                    prior[m] = coord[m];
+                }
+                hitsr->values.data[z] = chunk->values[i];
+            }
+        }
+        sptAssert(b + 1 == kernel_nb[k+1]);
+        sptAssert(c + 1 == kernel_nc[k+1]);
+        spt_HiCOOFreeChunks(bin);
+    }
+
+    /* Kernel pointers and the kernel scheduler */
+    for(sptNnzIndex k = 0; k <= nk; ++k)
+        hitsr->kptr.data[k] = kernel_nb[k];
+    cptr[nc] = nb;
+    bptr[nb] = nnz;
+    result = spt_HiCOOSetKernelScheduler(hitsr, tk);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+    result = spt_HiCOOPlaceHbm(hitsr);
+    spt_CheckError(result, "HiSpTns Builder", NULL);
+
+    sptNnzIndex max_nnzb_local = 0;
+    #pragma omp parallel for reduction(max:max_nnzb_local) num_threads(tk)
+    for(sptNnzIndex i = 0; i < nb; ++i) {
+        sptNnzIndex nnzb = bptr[i+1] - bptr[i];
+        if(max_nnzb_local < nnzb) {
+            max_nnzb_local = nnzb;
+        }
+    }
+    *max_nnzb = max_nnzb_local;
+
+    sptStopTimer(gen_timer);
+    sptPrintElapsedTime(gen_timer, "Build HiCOO");
+    sptFreeTimer(gen_timer);
+
+    /* The builder starts over empty */
+    bld->nbins = 0;
+    bld->nnz = 0;
+    memset(bld->slots, 0, bld->nslots * sizeof *bld->slots);
+    free(order);
+    free(kernel_nb);
+    free(kernel_nc);
+    free(kernel_nz);
+    return 0;
+}
+
+
+/**
+ * Release the memory of a HiCOO builder
+ */
+void sptFreeHiCOOBuilder(sptHiCOOBuilder *bld) {
+    for(sptNnzIndex i = 0; i < bld->nbins; ++i) {
+        spt_HiCOOFreeChunks(&bld->bins[i]);
+    }
+    free(bld->bins);
+    free(bld->slots);
+    free(bld->ndims);
+    free(bld->kdims);
+    bld->nmodes = 0;
+    bld->nbins = 0;
+    bld->nnz = 0;
+}
+
+
+/**
+ * Load a sparse tensor in the text format of sptLoadSparseTensor straight
+ * into HiCOO, through a builder, without a COO copy. Zeros are skipped.
+ * @param[out] hitsr       an uninitialized HiCOO tensor
+ * @param[out] max_nnzb    the maximum number of nonzeros per tensor block
+ * @param[in]  start_index the index of the first element of each mode, 0 or 1
+ * @param[in]  fp          the file to read from
+ * @param[in]  sb_bits     the bits of block size (sb)
+ * @param[in]  sk_bits     the bits of superblock size (sk)
+ * @param[in]  tk          the number of threads
+ */
+int sptLoadSparseTensorHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptIndex start_index,
+    FILE *fp,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk)
+{
+    int iores, result;
+    sptIndex nmodes;
+    iores = fscanf(fp, "%"PARTI_SCN_INDEX, &nmodes);
+    spt_CheckOSError(iores != 1, "HiSpTns Load");
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    sptIndex * coords = malloc(nmodes * sizeof *coords);
+    spt_CheckOSError(!ndims || !coords, "HiSpTns Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        iores = fscanf(fp, "%"PARTI_SCN_INDEX, &ndims[m]);
+        spt_CheckOSError(iores != 1, "HiSpTns Load");
+    }
+
+    sptHiCOOBuilder bld;
+    result = sptNewHiCOOBuilder(&bld, nmodes, ndims, sb_bits, sk_bits, 0);
+    spt_CheckError(result, "HiSpTns Load", NULL);
+    for(;;) {
+        sptIndex m;
+        for(m = 0; m < nmodes; ++m) {
+            if(fscanf(fp, "%"PARTI_SCN_INDEX, &coords[m]) != 1) {
+                break;
+            }
+            if(coords[m] < start_index) {
+                spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Load", "index < start_index");
+            }
+            coords[m] -= start_index;
+        }
+        double value;
+        if(m < nmodes || fscanf(fp, "%lf", &value) != 1) {
+            break;
+        }
+        if(value != 0) {
+            result = sptHiCOOBuilderAppend(&bld, coords, (sptValue) value);
+            spt_CheckError(result, "HiSpTns Load", NULL);
+        }
+    }
+
+    result = sptHiCOOBuilderFinish(hitsr, max_nnzb, &bld, tk);
+    sptFreeHiCOOBuilder(&bld);
+    free(ndims);
+    free(coords);
+    spt_CheckError(result, "HiSpTns Load", NULL);
+    return 0;
+}
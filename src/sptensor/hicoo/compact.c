@@ -0,0 +1,356 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * HiCOO with runtime-width element offsets and delta-encoded block indices.
+ *
+ * sptSparseTensorHiCOO stores element offsets as sptElementIndex, fixed at
+ * build time, which caps sb_bits at its width, and a full sptBlockIndex per
+ * block and mode. Here the offsets take one byte up to sb_bits 8 and two up
+ * to 16, picked at conversion, so hypersparse tensors can use larger blocks.
+ * Blocks of a kernel are in Morton order and so close to one another: each
+ * block stores, per mode, the zigzag varint of the step from the previous
+ * block of its kernel, which mostly fits one byte. A kernel decodes its block
+ * indices front to back while it runs.
+ */
+
+/* Zigzag encoding of cur - prev */
+static inline uint64_t spt_CompactZigZag(sptIndex const cur, sptIndex const prev) {
+    int64_t const d = (int64_t) cur - (int64_t) prev;
+    return ((uint64_t) d << 1) ^ (uint64_t) (d >> 63);
+}
+
+static inline sptIndex spt_CompactUnZigZag(sptIndex const prev, uint64_t const z) {
+    int64_t const d = (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+    return (sptIndex) ((int64_t) prev + d);
+}
+
+static inline sptNnzIndex spt_VarintBytes(uint64_t v) {
+    sptNnzIndex n = 1;
+    while(v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+static inline uint8_t * spt_PutVarint(uint8_t * p, uint64_t v) {
+    while(v >= 0x80) {
+        *p++ = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+static inline uint8_t const * spt_GetVarint(uint8_t const * p, uint64_t * v) {
+    uint64_t r = 0;
+    unsigned shift = 0;
+    while(*p & 0x80) {
+        r |= (uint64_t) (*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = r | (uint64_t) *p++ << shift;
+    return p;
+}
+
+/* Element offset z of one mode */
+static inline sptIndex spt_CompactOffset(void const * const einds, uint8_t const ewidth, sptNnzIndex const z) {
+    return ewidth == 1 ? ((uint8_t const *) einds)[z] : ((uint16_t const *) einds)[z];
+}
+
+static inline int spt_CompactSameBlock(
+    sptIndex * const * const inds,
+    sptIndex const nmodes,
+    sptNnzIndex const z1,
+    sptNnzIndex const z2,
+    sptElementIndex const sb_bits)
+{
+    for(sptIndex m=0; m<nmodes; ++m) {
+        if((inds[m][z1] >> sb_bits) != (inds[m][z2] >> sb_bits)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Convert a COO tensor to compact HiCOO, see sptCompactHiCOO.
+ * @param[out] ch        an uninitialized compact HiCOO tensor
+ * @param[out] max_nnzb  the maximum number of nonzeros per block
+ * @param[in]  tsr       the COO tensor, sorted in place into HiCOO order
+ * @param[in]  sb_bits   the bits of block size, at most 16
+ * @param[in]  sk_bits   the bits of kernel size, at least sb_bits
+ * @param[in]  tk        the number of threads
+ */
+int sptSparseTensorToCompactHiCOO(
+    sptCompactHiCOO *ch,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    int result;
+    if(sb_bits < 1 || sb_bits > 16) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Compact", "sb_bits out of [1, 16]");
+    }
+    if(sk_bits < sb_bits || sk_bits > 31) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Compact", "sk_bits out of [sb_bits, 31]");
+    }
+
+    ch->nmodes = nmodes;
+    ch->nnz = nnz;
+    ch->sb_bits = sb_bits;
+    ch->sk_bits = sk_bits;
+    ch->ewidth = sb_bits <= 8 ? 1 : 2;
+    ch->ndims = malloc(nmodes * sizeof *ch->ndims);
+    spt_CheckOSError(!ch->ndims, "HiSpTns Compact");
+    memcpy(ch->ndims, tsr->ndims, nmodes * sizeof *ch->ndims);
+
+    /* Kernels in row-major order, blocks in Morton order; kptr first points to nonzeros */
+    result = sptNewNnzIndexVector(&ch->kptr, 0, 0);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    if(nnz > 0) {
+        spt_PreprocessSparseTensor(&ch->kptr, tsr, sb_bits, sk_bits, tk);
+    } else {
+        result = sptAppendNnzIndexVector(&ch->kptr, 0);
+        spt_CheckError(result, "HiSpTns Compact", NULL);
+    }
+    sptNnzIndex const nk = ch->kptr.len - 1;
+    sptIndex ** inds = spt_ScratchAlloc(nmodes * sizeof *inds);
+    spt_CheckOSError(!inds, "HiSpTns Compact");
+    for(sptIndex m=0; m<nmodes; ++m) {
+        inds[m] = tsr->inds[m].data;
+    }
+
+    /* Count the blocks and delta bytes of every kernel */
+    sptNnzIndex * const kernel_nb = spt_ScratchAlloc((nk + 1) * sizeof *kernel_nb);
+    spt_CheckOSError(!kernel_nb, "HiSpTns Compact");
+    result = sptNewNnzIndexVector(&ch->kbytes, nk + 1, nk + 1);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex nb_k = 0, bytes_k = 0;
+        for(sptNnzIndex z = ch->kptr.data[k]; z < ch->kptr.data[k+1]; ++z) {
+            if(z == ch->kptr.data[k] || !spt_CompactSameBlock(inds, nmodes, z - 1, z, sb_bits)) {
+                for(sptIndex m=0; m<nmodes; ++m) {
+                    sptIndex const prev = z == ch->kptr.data[k] ? 0 : inds[m][z-1] >> sb_bits;
+                    bytes_k += spt_VarintBytes(spt_CompactZigZag(inds[m][z] >> sb_bits, prev));
+                }
+                ++nb_k;
+            }
+        }
+        kernel_nb[k] = nb_k;
+        ch->kbytes.data[k] = bytes_k;
+    }
+    sptNnzIndex nb = 0, nbytes = 0;
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex const tmp_nb = kernel_nb[k], tmp_bytes = ch->kbytes.data[k];
+        kernel_nb[k] = nb;
+        ch->kbytes.data[k] = nbytes;
+        nb += tmp_nb;
+        nbytes += tmp_bytes;
+    }
+    kernel_nb[nk] = nb;
+    ch->kbytes.data[nk] = nbytes;
+
+    result = sptNewNnzIndexVector(&ch->bptr, nb + 1, nb + 1);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    ch->bdeltas = malloc(nbytes + 1);
+    spt_CheckOSError(!ch->bdeltas, "HiSpTns Compact");
+    ch->einds = malloc(nmodes * sizeof *ch->einds);
+    spt_CheckOSError(!ch->einds, "HiSpTns Compact");
+    for(sptIndex m=0; m<nmodes; ++m) {
+        ch->einds[m] = malloc(nnz * ch->ewidth + 1);
+        spt_CheckOSError(!ch->einds[m], "HiSpTns Compact");
+    }
+    result = sptNewValueVector(&ch->values, nnz, nnz);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    if(nnz > 0) {
+        memcpy(ch->values.data, tsr->values.data, nnz * sizeof *ch->values.data);
+    }
+
+    /* Fill the blocks of every kernel */
+    sptIndex const emask = ((sptIndex) 1 << sb_bits) - 1;
+    sptNnzIndex max_nnzb_all = 0;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk) reduction(max: max_nnzb_all)
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex b = kernel_nb[k];
+        uint8_t * p = ch->bdeltas + ch->kbytes.data[k];
+        for(sptNnzIndex z = ch->kptr.data[k]; z < ch->kptr.data[k+1]; ++z) {
+            if(z == ch->kptr.data[k] || !spt_CompactSameBlock(inds, nmodes, z - 1, z, sb_bits)) {
+                for(sptIndex m=0; m<nmodes; ++m) {
+                    sptIndex const prev = z == ch->kptr.data[k] ? 0 : inds[m][z-1] >> sb_bits;
+                    p = spt_PutVarint(p, spt_CompactZigZag(inds[m][z] >> sb_bits, prev));
+                }
+                if(b > kernel_nb[k] && z - ch->bptr.data[b-1] > max_nnzb_all) {
+                    max_nnzb_all = z - ch->bptr.data[b-1];
+                }
+                ch->bptr.data[b++] = z;
+            }
+            for(sptIndex m=0; m<nmodes; ++m) {
+                if(ch->ewidth == 1) {
+                    ch->einds[m][z] = (uint8_t) (inds[m][z] & emask);
+                } else {
+                    ((uint16_t *) ch->einds[m])[z] = (uint16_t) (inds[m][z] & emask);
+                }
+            }
+        }
+        if(b > kernel_nb[k] && ch->kptr.data[k+1] - ch->bptr.data[b-1] > max_nnzb_all) {
+            max_nnzb_all = ch->kptr.data[k+1] - ch->bptr.data[b-1];
+        }
+        sptAssert(b == kernel_nb[k+1]);
+    }
+    ch->bptr.data[nb] = nnz;
+
+    /* kptr now indexes blocks */
+    memcpy(ch->kptr.data, kernel_nb, (nk + 1) * sizeof *kernel_nb);
+    if(max_nnzb != NULL) {
+        *max_nnzb = max_nnzb_all;
+    }
+
+    spt_ScratchFree(kernel_nb);
+    spt_ScratchFree(inds);
+    return 0;
+}
+
+
+/**
+ * Release a compact HiCOO tensor
+ */
+void sptFreeCompactHiCOO(sptCompactHiCOO *ch)
+{
+    for(sptIndex m=0; m<ch->nmodes; ++m) {
+        free(ch->einds[m]);
+    }
+    free(ch->einds);
+    free(ch->bdeltas);
+    free(ch->ndims);
+    sptFreeNnzIndexVector(&ch->kptr);
+    sptFreeNnzIndexVector(&ch->kbytes);
+    sptFreeNnzIndexVector(&ch->bptr);
+    sptFreeValueVector(&ch->values);
+    ch->nmodes = 0;
+    ch->nnz = 0;
+}
+
+
+/**
+ * Bytes of the index arrays of a compact HiCOO tensor: kernel, block and
+ * delta pointers, block deltas and element offsets.
+ */
+size_t sptCompactHiCOOIndexBytes(sptCompactHiCOO const * const ch)
+{
+    return (ch->kptr.len + ch->kbytes.len + ch->bptr.len) * sizeof (sptNnzIndex)
+        + ch->kbytes.data[ch->kbytes.len - 1]
+        + (size_t) ch->nmodes * ch->nnz * ch->ewidth;
+}
+
+
+/**
+ * OpenMP MTTKRP on a compact HiCOO tensor, a kernel per task, decoding block
+ * indices as it goes. The arguments are those of sptOmpMTTKRP.
+ */
+int sptOmpMTTKRPCompactHiCOO(sptCompactHiCOO const * const ch,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = ch->nmodes;
+    sptIndex const stride = mats[0]->stride;
+    sptIndex const R = mats[mode]->ncols;
+    sptElementIndex const sb_bits = ch->sb_bits;
+    uint8_t const ewidth = ch->ewidth;
+    sptValue const * const vals = ch->values.data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  HiSpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ch->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  HiSpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    memset(mvals, 0, (size_t) ch->ndims[mode] * stride * sizeof *mvals);
+
+    size_t const per_thread = (size_t) stride * sizeof (sptValue) + (size_t) nmodes * sizeof (sptIndex);
+    char * buf = malloc((size_t) tk * per_thread + 1);
+    spt_CheckOSError(!buf, "CPU  HiSpTns MTTKRP");
+
+    sptNnzIndex const nk = ch->kptr.len - 1;
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptValue * const restrict row = (sptValue *) (buf + (size_t) tid * per_thread);
+        sptIndex * const bidx = (sptIndex *) (row + stride);
+        #pragma omp for schedule(dynamic, 1)
+        for(sptNnzIndex k=0; k<nk; ++k) {
+            uint8_t const * p = ch->bdeltas + ch->kbytes.data[k];
+            for(sptIndex m=0; m<nmodes; ++m) {
+                bidx[m] = 0;
+            }
+            for(sptNnzIndex b=ch->kptr.data[k]; b<ch->kptr.data[k+1]; ++b) {
+                for(sptIndex m=0; m<nmodes; ++m) {
+                    uint64_t z;
+                    p = spt_GetVarint(p, &z);
+                    bidx[m] = spt_CompactUnZigZag(bidx[m], z);
+                }
+                for(sptNnzIndex x=ch->bptr.data[b]; x<ch->bptr.data[b+1]; ++x) {
+                    sptIndex mi = mats_order[1];
+                    sptValue const * times_row = mats[mi]->values +
+                        (size_t) ((bidx[mi] << sb_bits) + spt_CompactOffset(ch->einds[mi], ewidth, x)) * stride;
+                    for(sptIndex r=0; r<R; ++r) {
+                        row[r] = vals[x] * times_row[r];
+                    }
+                    for(sptIndex i=2; i<nmodes; ++i) {
+                        mi = mats_order[i];
+                        times_row = mats[mi]->values +
+                            (size_t) ((bidx[mi] << sb_bits) + spt_CompactOffset(ch->einds[mi], ewidth, x)) * stride;
+                        for(sptIndex r=0; r<R; ++r) {
+                            row[r] *= times_row[r];
+                        }
+                    }
+                    sptValue * const restrict out = mvals +
+                        (size_t) ((bidx[mode] << sb_bits) + spt_CompactOffset(ch->einds[mode], ewidth, x)) * stride;
+                    for(sptIndex r=0; r<R; ++r) {
+                        #pragma omp atomic update
+                        out[r] += row[r];
+                    }
+                }
+            }
+        }
+    }
+
+    free(buf);
+    return 0;
+}
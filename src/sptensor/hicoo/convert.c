@@ -49,24 +49,22 @@ static int spt_EqualWithTwoCoordinates(
 
 
 /**
- * Compute the end of this block
- * @param tsr    a pointer to a sparse tensor
- * @return out_item     the end indices of this block
+ * Check whether two nonzeros of a tensor fall into the same block.
+ * @return      1, same block; otherwise, 0.
  */
-static int spt_BlockEnd(
-    sptIndex * out_item,
-    sptSparseTensor *tsr,
-    const sptIndex * in_item,
-    const sptElementIndex sb)
+static inline int spt_InSameBlock(
+    sptIndex * const * const inds,
+    const sptIndex nmodes,
+    const sptNnzIndex z1,
+    const sptNnzIndex z2,
+    const sptElementIndex sb_bits)
 {
-    sptIndex nmodes = tsr->nmodes;
-
     for(sptIndex m=0; m<nmodes; ++m) {
-        sptAssert(in_item[m] < tsr->ndims[m]);
-        out_item[m] = in_item[m]+sb < tsr->ndims[m] ? in_item[m]+sb : tsr->ndims[m];    // exclusive
+        if((inds[m][z1] >> sb_bits) != (inds[m][z2] >> sb_bits)) {
+            return 0;
+        }
     }
-
-    return 0;
+    return 1;
 }
 
 
@@ -91,67 +89,9 @@ static int spt_LocateBeginCoord(
 }
 
 
-/**
- * Set scheduler for kernels.
- * @param[out] kschr  nmodes kernel schedulers
- * @param[out] nkiters  the number of columns for nmodes schedulers
- * @param[in] kptr  a vector of kernel pointers
- * @param[in] tsr    a pointer to a sparse tensor
- * @param[in] sk_bits    the bits of superblock size (sk)
- * @return      mode pointers
- */
-int spt_SetKernelScheduler(
-    sptIndexVector **kschr,
-    sptIndex *nkiters,
-    sptNnzIndexVector * const kptr,
-    sptSparseTensor *tsr, 
-    const sptElementIndex sk_bits)
-{
-    sptIndex nmodes = tsr->nmodes;
-    sptIndex * ndims = tsr->ndims;
-    int result = 0;
-
-    sptIndex * coord = (sptIndex *)malloc(nmodes * sizeof(*coord));
-    sptIndex * kernel_coord = (sptIndex *)malloc(nmodes * sizeof(*kernel_coord));
-
-    for(sptNnzIndex k=0; k<kptr->len - 1; ++k) {
-        sptNnzIndex z = kptr->data[k];
-        for(sptIndex m=0; m<nmodes; ++m) 
-            coord[m] = tsr->inds[m].data[z];
-        result = spt_LocateBeginCoord(kernel_coord, tsr, coord, sk_bits);
-        spt_CheckError(result, "HiSpTns Convert", NULL);
-
-        for(sptIndex m=0; m<nmodes; ++m) {
-            result = sptAppendIndexVector(&(kschr[m][kernel_coord[m]]), k);
-            spt_CheckError(result, "HiSpTns Convert", NULL);
-        }
-    }
-
-    free(coord);
-    free(kernel_coord);
-
-    sptIndex sk = (sptIndex)pow(2, sk_bits);
-    sptIndex tmp;
-    for(sptIndex m=0; m<nmodes; ++m) {
-        tmp = 0;
-        sptIndex kernel_ndim = (ndims[m] + sk - 1) / sk;
-        for(sptIndex i=0; i<kernel_ndim; ++i) {
-            if(tmp < kschr[m][i].len)
-                tmp = kschr[m][i].len;
-        }
-        nkiters[m] = tmp;
-    }
-
-    return 0;
-}
-
-
-
 /**
  * Pre-process COO sparse tensor by permuting, sorting, and record pointers to blocked rows. Kernels in Row-major order, blocks and elements are in Z-Morton order.
  * @param[out] kptr  a vector of kernel pointers
- * @param[out] kschr  nmodes kernel schedulers
- * @param[out] nkiters  the number of columns for nmodes schedulers
  * @param[in] tsr    a pointer to a sparse tensor
  * @param[in] sk_bits    the bits of superblock size (sk)
  * @param[in] sb_bits    the bits of block size (sb)
@@ -159,8 +99,6 @@ int spt_SetKernelScheduler(
  */
 int spt_PreprocessSparseTensor(
     sptNnzIndexVector * kptr,
-    sptIndexVector **kschr,
-    sptIndex *nkiters,
     sptSparseTensor *tsr, 
     const sptElementIndex sb_bits,
     const sptElementIndex sk_bits,
@@ -192,8 +130,6 @@ int spt_PreprocessSparseTensor(
 
     result = sptSetKernelPointers(kptr, tsr, sk_bits);
     spt_CheckError(result, "HiSpTns Preprocess", NULL);
-    result = spt_SetKernelScheduler(kschr, nkiters, kptr, tsr, sk_bits);
-    spt_CheckError(result, "HiSpTns Preprocess", NULL);
 
     sptStopTimer(set_kernel_timer);
     sptPrintElapsedTime(set_kernel_timer, "Set Kernel Ptrs");
@@ -204,12 +140,11 @@ int spt_PreprocessSparseTensor(
     sptStartTimer(morton_sort_timer);
 
     /* Sort blocks in each kernel in Morton-order */
-    sptNnzIndex k_begin, k_end;
     /* Loop for all kernels, 0-kptr.len for OMP code */
-    #pragma omp parallel for num_threads(tk) 
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
     for(sptNnzIndex k=0; k<kptr->len - 1; ++k) {
-        k_begin = kptr->data[k];
-        k_end = kptr->data[k+1];   // exclusive
+        sptNnzIndex const k_begin = kptr->data[k];
+        sptNnzIndex const k_end = kptr->data[k+1];   // exclusive
         /* Sort blocks in each kernel in Morton-order */
         sptSparseTensorSortIndexMorton(tsr, 1, k_begin, k_end, sb_bits);
 #if PARTI_DEBUG == 3
@@ -225,6 +160,169 @@ int spt_PreprocessSparseTensor(
     return 0;
 }
 
+/**
+ * Fill the blocks, chunks and nonzeros of a HiCOO tensor from a preprocessed
+ * COO tensor, hitsr->kptr still pointing to the nonzeros of each kernel.
+ * Kernel k is blocked by spt_HiCOOKernelBits(hitsr, k).
+ * @param[out] hitsr  the sparse tensor in HiCOO format
+ * @param[out] max_nnzb  the maximum number of nonzeros per tensor block
+ * @param[in] tsr    a pointer to a sorted sparse tensor
+ * @param[in] tk    the number of threads
+ */
+static int spt_FillHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    sptIndex const sc = (sptIndex)1 << hitsr->sc_bits;
+
+    sptTimer gen_timer;
+    sptNewTimer(&gen_timer, 0);
+    sptStartTimer(gen_timer);
+
+    /* Kernels are independent: count blocks and chunks per kernel, prefix-sum
+     * them into offsets, size every output array once, then fill in parallel.
+     * A block starts wherever the block coordinate changes, a kernel always
+     * starts a new block and a new chunk. Inside a kernel a chunk is closed
+     * once it holds at least sc nonzeros. */
+    sptNnzIndex const nk = hitsr->kptr.len - 1; // #Kernels
+    sptNnzIndex * kernel_nb = spt_ScratchAlloc((nk + 1) * sizeof(*kernel_nb));
+    spt_CheckOSError(!kernel_nb, "HiSpTns Convert");
+    sptNnzIndex * kernel_nc = spt_ScratchAlloc((nk + 1) * sizeof(*kernel_nc));
+    spt_CheckOSError(!kernel_nc, "HiSpTns Convert");
+    sptIndex ** inds = spt_ScratchAlloc(nmodes * sizeof(*inds));
+    spt_CheckOSError(!inds, "HiSpTns Convert");
+    for(sptIndex m=0; m<nmodes; ++m)
+        inds[m] = tsr->inds[m].data;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex const k_begin = hitsr->kptr.data[k];
+        sptNnzIndex const k_end = hitsr->kptr.data[k+1]; // exclusive
+        sptElementIndex const kb = spt_HiCOOKernelBits(hitsr, k);
+        sptNnzIndex nb_k = 1, nc_k = 1;
+        sptNnzIndex chunk_size = 0, ne = 1;
+        for(sptNnzIndex z = k_begin + 1; z < k_end; ++z) {
+            if(spt_InSameBlock(inds, nmodes, z - 1, z, kb) == 1) {
+                ++ ne;
+            } else {
+                if(chunk_size + ne >= sc) {
+                    ++ nc_k;
+                    chunk_size = 0;
+                } else {
+                    chunk_size += ne;
+                }
+                ++ nb_k;
+                ne = 1;
+            }
+        }
+        kernel_nb[k] = nb_k;
+        kernel_nc[k] = nc_k;
+    }
+
+    /* Exclusive prefix sums give the first block and chunk of every kernel. */
+    sptNnzIndex nb = 0, nc = 0;
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex const tmp_nb = kernel_nb[k], tmp_nc = kernel_nc[k];
+        kernel_nb[k] = nb;
+        kernel_nc[k] = nc;
+        nb += tmp_nb;
+        nc += tmp_nc;
+    }
+    kernel_nb[nk] = nb;
+    kernel_nc[nk] = nc;
+    sptAssert(nb <= nnz);
+
+    result = sptResizeNnzIndexVector(&hitsr->bptr, nb + 1);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->cptr, nc + 1);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+    for(sptIndex m=0; m<nmodes; ++m) {
+        result = sptResizeBlockIndexVector(&hitsr->binds[m], nb);
+        spt_CheckError(result, "HiSpTns Convert", NULL);
+        result = sptResizeElementIndexVector(&hitsr->einds[m], nnz);
+        spt_CheckError(result, "HiSpTns Convert", NULL);
+    }
+    result = sptResizeValueVector(&hitsr->values, nnz);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+
+    sptNnzIndex * const bptr = hitsr->bptr.data;
+    sptNnzIndex * const cptr = hitsr->cptr.data;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k=0; k<nk; ++k) {
+        sptNnzIndex const k_begin = hitsr->kptr.data[k];
+        sptNnzIndex const k_end = hitsr->kptr.data[k+1]; // exclusive
+        sptElementIndex const kb = spt_HiCOOKernelBits(hitsr, k);
+        sptIndex const emask = ((sptIndex)1 << kb) - 1;
+        sptNnzIndex b = kernel_nb[k], c = kernel_nc[k];
+        sptNnzIndex chunk_size = 0, ne = 0;
+        cptr[c] = b;
+
+        for(sptNnzIndex z = k_begin; z < k_end; ++z) {
+            if(z == k_begin || spt_InSameBlock(inds, nmodes, z - 1, z, kb) == 0) {
+                if(z != k_begin) {
+                    ++ b;
+                    if(chunk_size + ne >= sc) {
+                        cptr[++ c] = b;
+                        chunk_size = 0;
+                    } else {
+                        chunk_size += ne;
+                    }
+                }
+                bptr[b] = z;
+                for(sptIndex m=0; m<nmodes; ++m)
+                    hitsr->binds[m].data[b] = (sptBlockIndex)(inds[m][z] >> kb);
+                ne = 0;
+            }
+            ++ ne;
+            for(sptIndex m=0; m<nmodes; ++m)
+                hitsr->einds[m].data[z] = (sptElementIndex)(inds[m][z] & emask);
+            hitsr->values.data[z] = tsr->values.data[z];
+        }
+        sptAssert(b + 1 == kernel_nb[k+1]);
+        sptAssert(c + 1 == kernel_nc[k+1]);
+    }
+
+    /* Modify kptr pointing to block locations, and set the last elements */
+    for(sptNnzIndex k=0; k<=nk; ++k)
+        hitsr->kptr.data[k] = kernel_nb[k];
+    cptr[nc] = nb;
+    bptr[nb] = nnz;
+    result = spt_HiCOOSetKernelScheduler(hitsr, tk);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+    result = spt_HiCOOPlaceHbm(hitsr);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+
+    sptNnzIndex max_nnzb_local = 0;
+    #pragma omp parallel for reduction(max:max_nnzb_local) num_threads(tk)
+    for(sptNnzIndex i=0; i < nb; ++i) {
+        sptNnzIndex nnzb = bptr[i+1] - bptr[i];
+        if(max_nnzb_local < nnzb) {
+          max_nnzb_local = nnzb;
+        }
+    }
+    *max_nnzb = max_nnzb_local;
+
+    sptStopTimer(gen_timer);
+    sptPrintElapsedTime(gen_timer, "Generate HiCOO");
+    sptTelemetryAddCounter("HiCOO bytes written",
+        (double) nnz * (sizeof (sptValue) + nmodes * sizeof (sptElementIndex))
+        + (double) nb * (nmodes * sizeof (sptBlockIndex) + sizeof (sptNnzIndex)));
+    sptFreeTimer(gen_timer);
+
+    spt_ScratchFree(inds);
+    spt_ScratchFree(kernel_nb);
+    spt_ScratchFree(kernel_nc);
+
+    return 0;
+}
+
+
 /*************************************************
  * PUBLIC FUNCTIONS
  *************************************************/
@@ -247,9 +345,9 @@ int sptSetKernelPointers(
     result = sptAppendNnzIndexVector(kptr, 0);
     spt_CheckError(result, "HiSpTns Convert", NULL);
 
-    sptIndex * coord = (sptIndex *)malloc(nmodes * sizeof(*coord));
-    sptIndex * kernel_coord = (sptIndex *)malloc(nmodes * sizeof(*kernel_coord));
-    sptIndex * kernel_coord_prior = (sptIndex *)malloc(nmodes * sizeof(*kernel_coord_prior));
+    sptIndex * coord = spt_ScratchAlloc(nmodes * sizeof(*coord));
+    sptIndex * kernel_coord = spt_ScratchAlloc(nmodes * sizeof(*kernel_coord));
+    sptIndex * kernel_coord_prior = spt_ScratchAlloc(nmodes * sizeof(*kernel_coord_prior));
 
     /* Process first nnz to get the first kernel_coord_prior */
     for(sptIndex m=0; m<nmodes; ++m) 
@@ -280,9 +378,9 @@ int sptSetKernelPointers(
     /* Set the last element for kptr */
     sptAppendNnzIndexVector(kptr, nnz); 
 
-    free(coord);
-    free(kernel_coord);
-    free(kernel_coord_prior);
+    spt_ScratchFree(coord);
+    spt_ScratchFree(kernel_coord);
+    spt_ScratchFree(kernel_coord_prior);
 
     return 0;
 }
@@ -312,19 +410,16 @@ int sptSparseTensorToHiCOO(
     sptIndex i;
     int result;
     sptIndex nmodes = tsr->nmodes;
-    sptNnzIndex nnz = tsr->nnz;
-
-    sptElementIndex sb = pow(2, sb_bits);
-    sptIndex sc = pow(2, sc_bits);
 
     /* Set HiCOO parameters. ndims for type conversion, size_t -> sptIndex */
-    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    sptIndex * ndims = spt_ScratchAlloc(nmodes * sizeof *ndims);
     spt_CheckOSError(!ndims, "HiSpTns Convert");
     for(i = 0; i < nmodes; ++i) {
         ndims[i] = (sptIndex)tsr->ndims[i];
     }
 
-    result = sptNewSparseTensorHiCOO(hitsr, (sptIndex)tsr->nmodes, ndims, (sptNnzIndex)tsr->nnz, sb_bits, sk_bits, sc_bits);
+    /* The HiCOO arrays are backed like the COO ones */
+    result = sptNewSparseTensorHiCOOWithBacking(hitsr, (sptIndex)tsr->nmodes, ndims, (sptNnzIndex)tsr->nnz, sb_bits, sk_bits, sc_bits, spt_MemRequestOf(tsr->values.data));
     spt_CheckError(result, "HiSpTns Convert", NULL);
 
     /* Pre-process tensor to get hitsr->kptr, values are nonzero locations. */
@@ -332,7 +427,7 @@ int sptSparseTensorToHiCOO(
     sptNewTimer(&sort_timer, 0);
     sptStartTimer(sort_timer);
 
-    spt_PreprocessSparseTensor(&hitsr->kptr, hitsr->kschr, hitsr->nkiters, tsr, sb_bits, sk_bits, tk);
+    spt_PreprocessSparseTensor(&hitsr->kptr, tsr, sb_bits, sk_bits, tk);
 
     sptStopTimer(sort_timer);
     sptPrintElapsedTime(sort_timer, "HiCOO sorting (rowblock + morton)");
@@ -344,154 +439,100 @@ int sptSparseTensorToHiCOO(
     sptDumpNnzIndexVector(&hitsr->kptr, stdout);
 #endif
 
-    sptTimer gen_timer;
-    sptNewTimer(&gen_timer, 0);
-    sptStartTimer(gen_timer);
-
-    /* Temporary storage */
-    sptIndex * block_begin = (sptIndex *)malloc(nmodes * sizeof(*block_begin));
-    sptIndex * block_end = (sptIndex *)malloc(nmodes * sizeof(*block_end));
-    sptIndex * block_begin_prior = (sptIndex *)malloc(nmodes * sizeof(*block_begin_prior));
-    sptIndex * block_coord = (sptIndex *)malloc(nmodes * sizeof(*block_coord));
-
-    sptNnzIndex k_begin, k_end; // #Nonzeros locations
-    sptNnzIndex nk = 0; // #Kernels  
-    sptNnzIndex nc = 0; // #Chunks  
-    sptNnzIndex nb = 1; // #Blocks  // counting from the first nnz
-    sptNnzIndex nb_tmp = 0;
-    sptNnzIndex ne = 0; // #Nonzeros per block
-    sptIndex eindex = 0;
-    sptBlockIndex chunk_size = 0;
-
-    /* different appending methods:
-     * elements: append every nonzero entry
-     * blocks: append when seeing a new block.
-     * chunks: appending when seeting a new chunk. Notice the boundary of kernels and the last chunk of the whole tensor may be larger than the sc.
-     * kernels: append when seeing a new kernel. Not appending a vector, just write data into an allocated array.
-     */
-    /* Process first nnz */
-    for(sptIndex m=0; m<nmodes; ++m) 
-        block_coord[m] = tsr->inds[m].data[0];    // first nonzero indices
-    result = spt_LocateBeginCoord(block_begin_prior, tsr, block_coord, sb_bits);
+    double const trace = sptTraceBegin();
+    result = spt_FillHiCOO(hitsr, max_nnzb, tsr, tk);
     spt_CheckError(result, "HiSpTns Convert", NULL);
-    for(sptIndex m=0; m<nmodes; ++m)
-        sptAppendBlockIndexVector(&hitsr->binds[m], (sptBlockIndex)block_begin_prior[m]);
-    sptAppendNnzIndexVector(&hitsr->bptr, 0);
-
-
-    /* Loop for all kernels, 0 - hitsr->kptr.len - 1 for OMP code */
-    for(sptNnzIndex k=0; k<hitsr->kptr.len - 1; ++k) {
-        k_begin = hitsr->kptr.data[k];
-        k_end = hitsr->kptr.data[k+1]; // exclusive
-        nb_tmp = k == 0 ? 0: nb;
-        /* Modify kptr pointing to block locations */
-        hitsr->kptr.data[k] = nb_tmp;
-        ++ nk;
+    sptTraceEnd("HiCOO fill", -1, trace);
 
-        /* Only append a chunk for the new kernel, the last chunk in the old kernel may be larger than sc */
-        sptAppendNnzIndexVector(&hitsr->cptr, nb_tmp);
-        ++ nc;
-        chunk_size = 0;
+    spt_ScratchFree(ndims);
 
-        /* Loop nonzeros in each kernel */
-        for(sptNnzIndex z = k_begin; z < k_end; ++z) {
-            #if PARTI_DEBUG == 5
-                printf("z: %"PARTI_PRI_NNZ_INDEX "\n", z);
-            #endif
-
-            for(sptIndex m=0; m<nmodes; ++m) 
-                block_coord[m] = tsr->inds[m].data[z];    // first nonzero indices
-            #if PARTI_DEBUG == 5
-                printf("block_coord:\n");
-                sptAssert(sptDumpIndexArray(block_coord, nmodes, stdout) == 0);
-            #endif
-
-            result = spt_LocateBeginCoord(block_begin, tsr, block_coord, sb_bits);
-            spt_CheckError(result, "HiSpTns Convert", NULL);
-            #if PARTI_DEBUG == 5
-                printf("block_begin_prior:\n");
-                sptAssert(sptDumpIndexArray(block_begin_prior, nmodes, stdout) == 0);
-                printf("block_begin:\n");
-                sptAssert(sptDumpIndexArray(block_begin, nmodes, stdout) == 0);
-            #endif
-
-            result = spt_BlockEnd(block_end, tsr, block_begin, sb);  // exclusive
-            spt_CheckError(result, "HiSpTns Convert", NULL);
+	return 0;
+}
 
-            /* Append einds and values */
-            for(sptIndex m=0; m<nmodes; ++m) {
-                eindex = tsr->inds[m].data[z] < (block_begin[m] << sb_bits) ? tsr->inds[m].data[z] : tsr->inds[m].data[z] - (block_begin[m] << sb_bits);
-                sptAssert(eindex < sb);
-                sptAppendElementIndexVector(&hitsr->einds[m], (sptElementIndex)eindex);
-            }
-            sptAppendValueVector(&hitsr->values, tsr->values.data[z]);
 
+/**
+ * Convert a COO tensor to a HiCOO tensor whose block size is chosen per
+ * kernel from its local density. Each kernel takes the smallest block size
+ * in [sb_min, sb_max] whose blocks hold nnzb_target nonzeros on average, and
+ * sb_max when none does: dense kernels keep small, cache-sized blocks and
+ * sparse ones spend fewer block indices on blocks of one or two nonzeros.
+ * The bits of kernel k are hitsr->kbits.data[k], hitsr->sb_bits is sb_max.
+ * @param[out] hitsr  the sparse tensor in HiCOO format
+ * @param[out] max_nnzb  the maximum number of nonzeros per tensor block
+ * @param[in] tsr    a pointer to a sparse tensor
+ * @param[in] sb_min    the smallest bits of block size
+ * @param[in] sb_max    the largest bits of block size, at most 8 and sk_bits
+ * @param[in] sk_bits    the bits of superblock size (sk)
+ * @param[in] nnzb_target    the wanted average number of nonzeros per block
+ * @param[in] tk    the number of threads
+ */
+int sptSparseTensorToHiCOOAdaptive(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_min,
+    const sptElementIndex sb_max,
+    const sptElementIndex sk_bits,
+    sptNnzIndex const nnzb_target,
+    int const tk)
+{
+    const sptElementIndex sc_bits = 14;
+    if(sb_min > sb_max || sb_max > sk_bits || sb_max > 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Convert", "need sb_min <= sb_max <= min(sk_bits, 8)");
+    }
+    if(tsr->nnz == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Convert", "no nonzeros");
+    }
 
-            /* z in the same block with last z */
-            if (spt_EqualWithTwoCoordinates(block_begin, block_begin_prior, nmodes) == 1)
-            {
-                /* ne: #Elements in current block */
-                ++ ne;
-            } else { /* New block */
-                /* ne: #Elements in the last block */
-                /* Append block bptr and bidx */
-                sptAppendNnzIndexVector(&hitsr->bptr, (sptBlockIndex)z);
-                for(sptIndex m=0; m<nmodes; ++m)
-                    sptAppendBlockIndexVector(&hitsr->binds[m], (sptBlockIndex)block_begin[m]);
-                for(sptIndex m=0; m<nmodes; ++m)
-                    block_begin_prior[m] = block_begin[m];
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptIndex * ndims = spt_ScratchAlloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "HiSpTns Convert");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ndims[m] = (sptIndex)tsr->ndims[m];
+    }
+    result = sptNewSparseTensorHiCOOWithBacking(hitsr, nmodes, ndims, tsr->nnz, sb_max, sk_bits, sc_bits, spt_MemRequestOf(tsr->values.data));
+    spt_CheckError(result, "HiSpTns Convert", NULL);
+    spt_ScratchFree(ndims);
 
-                /* ne: old block's number of nonzeros */
-                if(chunk_size + ne >= sc) {    // calculate the prior block
-                    /* Append a chunk ending by the old block */
-                    sptAppendNnzIndexVector(&hitsr->cptr, nb);
-                    ++ nc;
-                    chunk_size = 0;
-                } else {
-                    chunk_size += ne;
-                }
+    /* The Morton order keeps every aligned block of every size contiguous, so one sort serves all the candidates */
+    result = spt_PreprocessSparseTensor(&hitsr->kptr, tsr, sb_max, sk_bits, tk);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
 
-                ++ nb;
-                ne = 1;              
-            } // End new block
-            #if PARTI_DEBUG == 5
-                printf("nk: %u, nc: %u, nb: %u, ne: %u, chunk_size: %lu\n\n", nk, nc, nb, ne, chunk_size);
-            #endif
+    sptNnzIndex const nk = hitsr->kptr.len - 1;
+    result = sptResizeElementIndexVector(&hitsr->kbits, nk);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
 
-        }   // End z loop
-        
-    }   // End k loop
-    sptAssert(nb <= nnz);
-    sptAssert(nb == hitsr->binds[0].len); 
-    // sptAssert(nc <= nb);
-    sptAssert(nk == hitsr->kptr.len - 1);
-
-    /* Last element for kptr, cptr, bptr */
-    hitsr->kptr.data[hitsr->kptr.len - 1] = hitsr->bptr.len;
-    sptAppendNnzIndexVector(&hitsr->cptr, hitsr->bptr.len);
-    sptAppendNnzIndexVector(&hitsr->bptr, nnz);
-
-
-    *max_nnzb = hitsr->bptr.data[1] - hitsr->bptr.data[0];
-    sptNnzIndex sum_nnzb = 0;
-    for(sptIndex i=0; i < hitsr->bptr.len - 1; ++i) {
-        sptNnzIndex nnzb = hitsr->bptr.data[i+1] - hitsr->bptr.data[i];
-        sum_nnzb += nnzb;
-        if(*max_nnzb < nnzb) {
-          *max_nnzb = nnzb;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        sptNnzIndex const k_begin = hitsr->kptr.data[k];
+        sptNnzIndex const k_end = hitsr->kptr.data[k+1];
+        /* nb[s] blocks at s bits: a new one starts where a coordinate changes above bit s */
+        sptNnzIndex nb[9];
+        for(sptElementIndex s = sb_min; s <= sb_max; ++s) {
+            nb[s] = 1;
+        }
+        for(sptNnzIndex z = k_begin + 1; z < k_end; ++z) {
+            sptIndex diff = 0;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                diff |= tsr->inds[m].data[z-1] ^ tsr->inds[m].data[z];
+            }
+            for(sptElementIndex s = sb_min; s <= sb_max && (diff >> s) != 0; ++s) {
+                ++ nb[s];
+            }
         }
+        sptElementIndex bits = sb_max;
+        for(sptElementIndex s = sb_min; s < sb_max; ++s) {
+            if(k_end - k_begin >= nnzb_target * nb[s]) {
+                bits = s;
+                break;
+            }
+        }
+        hitsr->kbits.data[k] = bits;
     }
-    sptAssert(sum_nnzb == hitsr->nnz);
-
-    sptStopTimer(gen_timer);
-    sptPrintElapsedTime(gen_timer, "Generate HiCOO");
-    sptFreeTimer(gen_timer);
-
 
-    free(block_begin);
-    free(block_end);
-    free(block_begin_prior);
-    free(block_coord);
+    result = spt_FillHiCOO(hitsr, max_nnzb, tsr, tk);
+    spt_CheckError(result, "HiSpTns Convert", NULL);
 
-	return 0;
+    return 0;
 }
@@ -0,0 +1,304 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <thrust/adjacent_difference.h>
+#include <thrust/device_ptr.h>
+#include <thrust/extrema.h>
+#include <thrust/scan.h>
+#include "../sptensor.h"
+#include "../sort_cuda.h"
+#include "hicoo.h"
+
+/*
+ * HiCOO built on the device in the order spt_PreprocessSparseTensor gives on
+ * the host: kernels row-major by their coordinates, nonzeros within a kernel
+ * in Morton order. One key per nonzero holds both, the kernel coordinates
+ * above the Morton interleaving of the low sk_bits of every index, so a
+ * single device sort replaces the row-block sort and the per-kernel Morton
+ * sorts. Block and kernel starts are flags, their prefix sums number the
+ * blocks and kernels, and chunks are cut one thread per kernel.
+ */
+
+/* Bit j < sk_bits of mode m to bit j * nmodes + m, as spt_SparseTensorCurveSort interleaves */
+__global__ static void spt_HiCOOMortonKeyKernel(
+    uint64_t *keys, sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nmodes, unsigned const sk_bits)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const i = inds[m * nnz + z];
+        for(unsigned j = 0; j < sk_bits; ++j) {
+            spt_CudaPutKeyBits(keys, nnz, z, j * nmodes + m, (i >> j) & 1, 1);
+        }
+    }
+}
+
+/* kstart[z], bstart[z]: whether sorted nonzero z opens a kernel, a block */
+__global__ static void spt_HiCOOStartKernel(
+    sptNnzIndex *kstart, sptNnzIndex *bstart, sptIndex const *inds, sptNnzIndex const nnz,
+    sptIndex const nmodes, unsigned const sb_bits, unsigned const sk_bits)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptIndex kdiff = z == 0, bdiff = z == 0;
+    for(sptIndex m = 0; m < nmodes && z != 0; ++m) {
+        sptIndex const d = inds[m * nnz + z] ^ inds[m * nnz + z - 1];
+        kdiff |= (d >> sk_bits) != 0;
+        bdiff |= (d >> sb_bits) != 0;
+    }
+    kstart[z] = kdiff;
+    bstart[z] = bdiff;
+}
+
+/* Scatter the block pointers and indices, the kernel pointers and the element indices */
+__global__ static void spt_HiCOOFillKernel(
+    sptNnzIndex *kptr, sptNnzIndex *bptr, sptBlockIndex *binds, sptElementIndex *einds,
+    sptNnzIndex const *kstart, sptNnzIndex const *kid, sptNnzIndex const *bstart, sptNnzIndex const *bid,
+    sptIndex const *inds, sptNnzIndex const nnz, sptNnzIndex const nb, sptIndex const nmodes, unsigned const sb_bits)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptIndex const emask = ((sptIndex) 1 << sb_bits) - 1;
+    sptNnzIndex const b = bid[z];
+    if(bstart[z]) {
+        bptr[b] = z;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            binds[m * nb + b] = (sptBlockIndex) (inds[m * nnz + z] >> sb_bits);
+        }
+    }
+    if(kstart[z]) {
+        kptr[kid[z]] = b;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        einds[m * nnz + z] = (sptElementIndex) (inds[m * nnz + z] & emask);
+    }
+}
+
+/*
+ * Chunks of kernel k as spt_FillHiCOO cuts them: a chunk closes once it holds
+ * at least sc nonzeros. With cptr NULL, count them into nc[k]; otherwise
+ * write the first block of each from cptr[nc[k]] on.
+ */
+__global__ static void spt_HiCOOChunkKernel(
+    sptNnzIndex *nc, sptNnzIndex *cptr, sptNnzIndex const *kptr, sptNnzIndex const *bptr,
+    sptNnzIndex const nk, sptNnzIndex const sc)
+{
+    sptNnzIndex const k = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(k >= nk) {
+        return;
+    }
+    sptNnzIndex c = cptr != NULL ? nc[k] : 0;
+    sptNnzIndex chunk_size = 0;
+    if(cptr != NULL) {
+        cptr[c] = kptr[k];
+    }
+    for(sptNnzIndex b = kptr[k] + 1; b < kptr[k+1]; ++b) {
+        sptNnzIndex const ne = bptr[b] - bptr[b-1];
+        if(chunk_size + ne >= sc) {
+            ++c;
+            if(cptr != NULL) {
+                cptr[c] = b;
+            }
+            chunk_size = 0;
+        } else {
+            chunk_size += ne;
+        }
+    }
+    if(cptr == NULL) {
+        nc[k] = c + 1;
+    }
+}
+
+/* Exclusive prefix sum of flags[0, n) into ids, returning the total */
+static sptNnzIndex spt_HiCOONumber(sptNnzIndex *ids, sptNnzIndex const *flags, sptNnzIndex const n)
+{
+    /* The last flag is read first, ids may be flags */
+    sptNnzIndex last_id, last_flag;
+    cudaMemcpy(&last_flag, flags + n - 1, sizeof last_flag, cudaMemcpyDeviceToHost);
+    thrust::device_ptr<sptNnzIndex const> f(flags);
+    thrust::device_ptr<sptNnzIndex> i(ids);
+    thrust::exclusive_scan(f, f + n, i);
+    cudaMemcpy(&last_id, ids + n - 1, sizeof last_id, cudaMemcpyDeviceToHost);
+    return last_id + last_flag;
+}
+
+template <class T>
+static int spt_HiCOODownload(T *host, T const *dev, sptNnzIndex const n)
+{
+    int result = cudaMemcpy(host, dev, n * sizeof (T), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    return 0;
+}
+
+
+/**
+ * Convert a COO tensor to a HiCOO tensor on the GPU. The result matches
+ * sptSparseTensorToHiCOO up to the order of duplicate coordinates; unlike it,
+ * tsr is left as it is, as the tensor is sorted on the device only.
+ * @param[out] hitsr  the sparse tensor in HiCOO format
+ * @param[out] max_nnzb  the maximum number of nonzeros per tensor block
+ * @param[in] tsr    a pointer to a sparse tensor
+ * @param[in] sb_bits    the bits of block size (sb)
+ * @param[in] sk_bits    the bits of superblock size (sk)
+ * @param[in] tk    the number of threads the kernel scheduler plans for
+ */
+int sptCudaSparseTensorToHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor const *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk)
+{
+    const sptElementIndex sc_bits = 14;
+    if(sk_bits < sb_bits) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA HiSpTns Convert", "need sb_bits <= sk_bits");
+    }
+    if(tsr->nnz == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA HiSpTns Convert", "no nonzeros");
+    }
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    int result;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* Sort: the kernel coordinates row-major above the Morton bits of the kernel offsets */
+    sptIndex * dev_inds;
+    sptValue * dev_vals;
+    uint64_t * dev_keys;
+    sptIndex nwords;
+    result = spt_CudaUploadCoo(tsr, &dev_inds, &dev_vals);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    sptIndex * order = new sptIndex[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        order[m] = m;
+    }
+    result = spt_CudaLexKeys(&dev_keys, &nwords, dev_inds, nnz, nmodes, tsr->ndims, order, sk_bits, nmodes * sk_bits);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    delete[] order;
+    spt_HiCOOMortonKeyKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_keys, dev_inds, nnz, nmodes, sk_bits);
+    result = spt_CudaSortCoo(dev_inds, dev_vals, nnz, nmodes, dev_keys, nwords);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    cudaFree(dev_keys);
+
+    /* Number the kernels and blocks */
+    sptNnzIndex * dev_flags;
+    result = cudaMalloc((void **) &dev_flags, 4 * nnz * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    sptNnzIndex * const dev_kstart = dev_flags;
+    sptNnzIndex * const dev_kid = dev_flags + nnz;
+    sptNnzIndex * const dev_bstart = dev_flags + 2 * nnz;
+    sptNnzIndex * const dev_bid = dev_flags + 3 * nnz;
+    spt_HiCOOStartKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+        dev_kstart, dev_bstart, dev_inds, nnz, nmodes, sb_bits, sk_bits);
+    sptNnzIndex const nk = spt_HiCOONumber(dev_kid, dev_kstart, nnz);
+    sptNnzIndex const nb = spt_HiCOONumber(dev_bid, dev_bstart, nnz);
+
+    sptNnzIndex * dev_kptr, * dev_bptr, * dev_nc, * dev_cptr;
+    sptBlockIndex * dev_binds;
+    sptElementIndex * dev_einds;
+    result = cudaMalloc((void **) &dev_kptr, (nk + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    result = cudaMalloc((void **) &dev_bptr, (nb + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    result = cudaMalloc((void **) &dev_nc, (nk + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    result = cudaMalloc((void **) &dev_binds, nmodes * nb * sizeof (sptBlockIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    result = cudaMalloc((void **) &dev_einds, nmodes * nnz * sizeof (sptElementIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    spt_HiCOOFillKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+        dev_kptr, dev_bptr, dev_binds, dev_einds, dev_kstart, dev_kid, dev_bstart, dev_bid,
+        dev_inds, nnz, nb, nmodes, sb_bits);
+    cudaMemcpy(dev_kptr + nk, &nb, sizeof nb, cudaMemcpyHostToDevice);
+    cudaMemcpy(dev_bptr + nb, &nnz, sizeof nnz, cudaMemcpyHostToDevice);
+    cudaFree(dev_flags);
+
+    /* Chunks: count per kernel, number, then fill */
+    sptNnzIndex const sc = (sptNnzIndex) 1 << sc_bits;
+    spt_HiCOOChunkKernel<<<spt_CudaLayoutBlocks(nk), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_nc, NULL, dev_kptr, dev_bptr, nk, sc);
+    sptNnzIndex const nc = spt_HiCOONumber(dev_nc, dev_nc, nk);
+    result = cudaMalloc((void **) &dev_cptr, (nc + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    spt_HiCOOChunkKernel<<<spt_CudaLayoutBlocks(nk), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_nc, dev_cptr, dev_kptr, dev_bptr, nk, sc);
+    cudaMemcpy(dev_cptr + nc, &nb, sizeof nb, cudaMemcpyHostToDevice);
+
+    /* The largest block, from the differences of bptr */
+    thrust::device_ptr<sptNnzIndex> bptr_ptr(dev_bptr);
+    sptNnzIndex * dev_diff;
+    result = cudaMalloc((void **) &dev_diff, (nb + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+    thrust::device_ptr<sptNnzIndex> nnzb_ptr(dev_diff);
+    thrust::adjacent_difference(bptr_ptr, bptr_ptr + nb + 1, nnzb_ptr);
+    *max_nnzb = *thrust::max_element(nnzb_ptr + 1, nnzb_ptr + nb + 1);
+    cudaFree(dev_diff);
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA HiSpTns Convert");
+
+    /* Download into a host HiCOO tensor */
+    result = sptNewSparseTensorHiCOO(hitsr, nmodes, tsr->ndims, nnz, sb_bits, sk_bits, sc_bits);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->kptr, nk + 1);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->bptr, nb + 1);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    result = sptResizeNnzIndexVector(&hitsr->cptr, nc + 1);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    result = sptResizeValueVector(&hitsr->values, nnz);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    spt_HiCOODownload(hitsr->kptr.data, dev_kptr, nk + 1);
+    spt_HiCOODownload(hitsr->bptr.data, dev_bptr, nb + 1);
+    spt_HiCOODownload(hitsr->cptr.data, dev_cptr, nc + 1);
+    spt_HiCOODownload(hitsr->values.data, dev_vals, nnz);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeBlockIndexVector(&hitsr->binds[m], nb);
+        spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+        result = sptResizeElementIndexVector(&hitsr->einds[m], nnz);
+        spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+        spt_HiCOODownload(hitsr->binds[m].data, dev_binds + m * nb, nb);
+        spt_HiCOODownload(hitsr->einds[m].data, dev_einds + m * nnz, nnz);
+    }
+    cudaFree(dev_inds);
+    cudaFree(dev_vals);
+    cudaFree(dev_kptr);
+    cudaFree(dev_bptr);
+    cudaFree(dev_nc);
+    cudaFree(dev_cptr);
+    cudaFree(dev_binds);
+    cudaFree(dev_einds);
+
+    result = spt_HiCOOSetKernelScheduler(hitsr, tk);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+    result = spt_HiCOOPlaceHbm(hitsr);
+    spt_CheckError(result, "CUDA HiSpTns Convert", NULL);
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA Generate HiCOO");
+    sptFreeTimer(timer);
+    return 0;
+}
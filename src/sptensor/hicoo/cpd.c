@@ -19,13 +19,9 @@
 #include <ParTI.h>
 #include <assert.h>
 #include <math.h>
-#ifdef PARTI_USE_MAGMA
-  #include "magma_v2.h"
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
+#include "../../matrix/lapack.h"
 #include "hicoo.h"
+#include "../sptensor.h"
 
 
 /*************************************************
@@ -63,22 +59,47 @@ double spt_CpdAlsStepHiCOO(
     sptAssert(mats[m]->stride == ata[m]->stride);
   }
 
+  /* Resume from the configured checkpoint when it holds this decomposition */
+  sptValue ** ckpt_vals = (sptValue **)malloc(nmodes * sizeof(*ckpt_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ckpt_vals[m] = mats[m]->values;
+  }
+  spt_CpdFactors const ckpt = { nmodes, rank, stride, hitsr->ndims, ckpt_vals, lambda };
+  spt_CpdCheckpointKey const ckpt_key = { spt_CpdCheckpointEnabled() ? sptSparseTensorHiCOOFingerprint(hitsr) : 0, tol, niters };
+  sptIndex start_it = 0;
+  int converged = 0;
+  double oldfit = 0;
+  sptAssert(spt_CpdCheckpointRestore(&ckpt, &ckpt_key, &start_it, &oldfit, &converged) == 0);
+  fit = oldfit;
+
+  /* Extrapolated steps, when enabled, are tried on the factors ckpt points at */
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  spt_CpdLineSearch ls;
+  sptAssert(spt_NewCpdLineSearch(&ls, &ckpt) == 0);
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, stride) == 0);
+
   /* Compute all "ata"s */
   for(sptIndex m=0; m < nmodes; ++m) {
     /* ata[m] = mats[m]^T * mats[m]), actually do A * A' due to row-major mats, and output an upper triangular matrix. */
     int blas_nrows = (int)(mats[m]->nrows);
-    ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
       mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
   }
 
-  double oldfit = 0;
+  /* The tensor values are fixed during CPD, so its norm is computed only once. */
+  double const spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
   sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
 
-  for(sptIndex it=0; it < niters; ++it) {
+  for(sptIndex it=start_it; it < niters && !converged; ++it) {
     sptTimer timer;
     sptNewTimer(&timer, 0);
     sptStartTimer(timer);
 
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
     for(sptIndex m=0; m < nmodes; ++m) {
       tmp_mat->nrows = mats[m]->nrows;
 
@@ -91,7 +112,8 @@ double spt_CpdAlsStepHiCOO(
 
       memcpy(mats[m]->values, tmp_mat->values, mats[m]->nrows * stride * sizeof(sptValue));
       /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
-      sptAssert ( sptRankMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptRankMatrixSolveFormedNormals(nmodes, ata, mats[m]) == 0 );
 
       /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
       if (it == 0 ) {
@@ -102,26 +124,46 @@ double spt_CpdAlsStepHiCOO(
 
       /* ata[m] = mats[m]^T * mats[m]) */
       int blas_nrows = (int)(mats[m]->nrows);
-      ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
         mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      sptAssert(sptGramHadamardAdvance(&gh, m, ata_vals) == 0);
 
     } // Loop nmodes
 
-    fit = sptKruskalTensorFitHiCOO(hitsr, lambda, mats, ata);
+    fit = sptKruskalTensorFitFromNorms(spten_normsq, sptGramHadamardKruskalNorm(&gh, lambda, ata_vals),
+        sptSparseKruskalTensorInnerProductRank(nmodes, lambda, mats));
+
+    /* Try an extrapolated step; its fit costs one MTTKRP of the last mode */
+    if(spt_CpdLineSearchPropose(&ls, &ckpt, ata_vals, it)) {
+      sptIndex const last = nmodes - 1;
+      tmp_mat->nrows = mats[last]->nrows;
+      mats_order[0] = last;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (last+i) % nmodes;
+      sptAssert (sptMTTKRPHiCOO_MatrixTiling(hitsr, mats, mats_order, last) == 0);
+      double const trial_fit = sptKruskalTensorFitNormRank(nmodes, spten_normsq, lambda, mats, ata);
+      fit = spt_CpdLineSearchResolve(&ls, &ckpt, ata_vals, fit, trial_fit);
+    }
 
     sptStopTimer(timer);
     double its_time = sptElapsedTime(timer);
     sptFreeTimer(timer);
 
-    printf("  its = %3u ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+    printf("  its = %3"PARTI_PRI_INDEX" ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
         it+1, its_time, fit, fit - oldfit);
     if(it > 0 && fabs(fit - oldfit) < tol) {
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 1) == 0);
       break;
     }
     oldfit = fit;
+    sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, it+1 == niters, 0) == 0);
     
   } // Loop niters
 
+  free(ckpt_vals);
+  free(ata_vals);
+  sptFreeGramHadamard(&gh);
+  spt_FreeCpdLineSearch(&ls);
   GetRankFinalLambda(rank, nmodes, mats, lambda);
 
   for(sptIndex m=0; m < nmodes+1; ++m) {
@@ -140,7 +182,7 @@ double spt_CpdAlsStepHiCOO(
  *************************************************/
 /**
  * Sequential CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for HiCOO formatted sparse tensors.
- * @param[out] ktensor the Kruskal tensor
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
  * @param[in]  hitsr the HiCOO representation of a sparse tensor
  * @param[in]  rank the CPD rank
  * @param[in]  niters the maximum number of iterations
@@ -164,13 +206,16 @@ int sptCpdAlsHiCOO(
     max_dim = (hitsr->ndims[m] > max_dim) ? hitsr->ndims[m] : max_dim;
   }
   sptRankMatrix ** mats = (sptRankMatrix **)malloc((nmodes+1) * sizeof(*mats));
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    mats[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
-  }
+  int warm;
+  sptAssert(spt_CpdTakeRankFactors(ktensor, nmodes, hitsr->ndims, rank, mats, &warm) == 0);
   for(sptIndex m=0; m < nmodes; ++m) {
-    sptAssert(sptNewRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
-    sptAssert(sptRandomizeRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    if(!warm) {
+      mats[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
+      sptAssert(sptNewRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    }
   }
+  mats[nmodes] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
   sptAssert(sptNewRankMatrix(mats[nmodes], max_dim, rank) == 0);
   sptAssert(sptConstantRankMatrix(mats[nmodes], 0) == 0);
 
@@ -0,0 +1,206 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ParTI.h>
+#include <math.h>
+#include "../../matrix/lapack.h"
+#include "hicoo.h"
+#include "../sptensor.h"
+
+#ifdef PARTI_USE_OPENMP
+
+
+/*************************************************
+ * PRIVATE FUNCTIONS
+ *************************************************/
+static double spt_OmpCpdNnHalsStepHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptRankMatrix ** mats,
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(hitsr->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptRankMatrix * tmp_mat = mats[nmodes];
+  sptRankMatrix ** ata = (sptRankMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
+    sptAssert(sptNewRankMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+
+  /* Keep every factor normalized, with the scale in lambda, and compute all "ata"s */
+  sptValue * norms = (sptValue *)malloc(rank * sizeof(*norms));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptRankMatrix2Norm(mats[m], norms);
+    for(sptIndex r=0; r < rank; ++r) {
+      lambda[r] *= norms[r];
+    }
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+  free(norms);
+
+  double const spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+  double oldfit = 0;
+
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      sptAssert (sptOmpMTTKRPHiCOO_MatrixTiling(hitsr, mats, mats_order, m, tk) == 0);
+
+      /* ata[nmodes] = Hadamard product of the other "ata"s, in full */
+      sptAssert (sptRankMatrixDotMulSeqTriangle(m, nmodes, ata) == 0);
+
+      /* Fold lambda into mats[m], update it by HALS, and normalize it again */
+      sptValue * const vals = mats[m]->values;
+      #pragma omp parallel for num_threads(tk)
+      for(sptIndex i=0; i < mats[m]->nrows; ++i) {
+        for(sptIndex r=0; r < rank; ++r) {
+          vals[i * stride + r] *= lambda[r];
+        }
+      }
+      spt_CpdHalsUpdateRows(vals, tmp_mat->values, ata[nmodes]->values, mats[m]->nrows, rank, stride, tk);
+      sptRankMatrix2Norm(mats[m], lambda);
+
+      /* ata[m] = mats[m]^T * mats[m]) */
+      int blas_nrows = (int)(mats[m]->nrows);
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+    } // Loop nmodes
+
+    /* mats[nmodes] still holds the MTTKRP of the last mode */
+    fit = sptKruskalTensorFitNormRank(nmodes, spten_normsq, lambda, mats, ata);
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX" ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  } // Loop niters
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeRankMatrix(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/*************************************************
+ * PUBLIC FUNCTIONS
+ *************************************************/
+/**
+ * OpenMP Parallel non-negative CANDECOMP/PARAFAC decomposition (CPD) using hierarchical alternating least squares (HALS) for HiCOO formatted sparse tensors.
+ * Every factor stays non-negative; the rows of a factor are updated in parallel.
+ * @param[in,out] ktensor the Kruskal tensor; factors and lambda it already holds are the initial guess
+ * @param[in]  hitsr the HiCOO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ */
+int sptOmpCpdNnHalsHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptRankKruskalTensor * ktensor)
+{
+  sptIndex nmodes = hitsr->nmodes;
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(hitsr->ndims, nmodes);
+  sptRankMatrix ** mats = (sptRankMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  HiCOO SpTns CPD-HALS");
+  int warm;
+  sptAssert(spt_CpdTakeRankFactors(ktensor, nmodes, hitsr->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
+      sptAssert(sptNewRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    }
+  }
+  if(!warm) {
+    for(sptIndex r=0; r < rank; ++r) {
+      ktensor->lambda[r] = 1;
+    }
+  }
+  mats[nmodes] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
+  sptAssert(sptNewRankMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantRankMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = spt_OmpCpdNnHalsStepHiCOO(hitsr, rank, niters, tol, tk, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  HiCOO SpTns CPD-HALS");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+  sptFreeRankMatrix(mats[nmodes]);
+
+  return 0;
+}
+
+#endif
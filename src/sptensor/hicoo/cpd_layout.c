@@ -0,0 +1,87 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/* Decode the nonzeros of a HiCOO tensor into a COO tensor, in block order */
+static int spt_HiCOOToCOO(sptSparseTensor * X, sptSparseTensorHiCOO const * const hitsr, int const tk)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  int result = spt_SparseTensorNewSized(X, nmodes, hitsr->ndims, hitsr->nnz);
+  spt_CheckError(result, "HiSpTns Layouts", NULL);
+  sptNnzIndex const nk = hitsr->kptr.len > 0 ? hitsr->kptr.len - 1 : 0;
+  #pragma omp parallel for schedule(dynamic, 1) num_threads(tk)
+  for(sptNnzIndex kn = 0; kn < nk; ++kn) {
+    sptElementIndex const kb = spt_HiCOOKernelBits(hitsr, kn);
+    for(sptNnzIndex b = hitsr->kptr.data[kn]; b < hitsr->kptr.data[kn+1]; ++b) {
+      for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const base = (sptIndex) hitsr->binds[m].data[b] << kb;
+        for(sptNnzIndex z = hitsr->bptr.data[b]; z < hitsr->bptr.data[b+1]; ++z) {
+          X->inds[m].data[z] = base + hitsr->einds[m].data[z];
+        }
+      }
+    }
+  }
+  memcpy(X->values.data, hitsr->values.data, hitsr->nnz * sizeof *X->values.data);
+  return 0;
+}
+
+
+/**
+ * Pick how the modes of a CP-ALS run on a HiCOO tensor read it, as
+ * sptNewCpdLayouts does for COO: HiCOO serves every mode alike, so the
+ * longest modes that fit the budget get COO copies sorted for them, and the
+ * others keep the HiCOO kernels. The copies are decoded from hitsr.
+ * @param[out] layouts  the layouts to initialize
+ * @param[in]  hitsr    the HiCOO tensor, left untouched
+ * @param[in]  rank     the number of columns of the factor matrices
+ * @param[in]  tk       the number of threads the MTTKRP will use
+ * @param[in]  budget   the bytes of all copies, 0 for the sptSetCpdLayoutBudget setting
+ */
+int sptNewCpdLayoutsHiCOO(
+  sptCpdLayouts * layouts,
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  int const tk,
+  size_t const budget)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  int * routed = malloc(nmodes * sizeof *routed);
+  spt_CheckOSError(!routed, "HiSpTns Layouts");
+  size_t const bytes = spt_PlanCpdLayouts(routed, nmodes, hitsr->ndims, hitsr->nnz, 1, rank, tk,
+    budget != 0 ? budget : spt_CpdLayoutBudget());
+
+  /* The decoded tensor becomes one of the copies; with none planned it is an empty stand-in */
+  sptSparseTensor X;
+  int result;
+  if(bytes != 0) {
+    result = spt_HiCOOToCOO(&X, hitsr, tk);
+  } else {
+    result = sptNewSparseTensor(&X, nmodes, hitsr->ndims);
+  }
+  if(result == 0) {
+    result = spt_NewCpdLayouts(layouts, &X, 1, routed, rank, tk);
+  }
+  free(routed);
+  spt_CheckError(result, "HiSpTns Layouts", NULL);
+  return 0;
+}
@@ -19,13 +19,9 @@
 #include <ParTI.h>
 #include <assert.h>
 #include <math.h>
-#ifdef PARTI_USE_MAGMA
-  #include "magma_v2.h"
-  #include "magma_lapack.h"
-#else
-  #include "clapack.h"
-#endif
+#include "../../matrix/lapack.h"
 #include "hicoo.h"
+#include "../sptensor.h"
 
 #ifdef PARTI_USE_OPENMP
 
@@ -33,6 +29,27 @@
 /*************************************************
  * PRIVATE FUNCTIONS
  *************************************************/
+/* MTTKRP of a mode on its sorted copy when the layouts have one, on hitsr otherwise */
+static int spt_MTTKRPHiCOOOrLayout(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptHiCOOMttkrpVariant const variant,
+  sptCpdLayouts * layouts,
+  sptRankMatrix * mats[],
+  sptRankMatrix * copy_mats[],
+  sptIndex const mats_order[],
+  sptIndex const mode,
+  const int tk)
+{
+  if(layouts == NULL || layouts->copies[mode] == NULL) {
+    return spt_MTTKRPHiCOOVariant(hitsr, variant, mats, copy_mats, mats_order, mode, tk);
+  }
+  sptIndex const nmodes = hitsr->nmodes;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    layouts->factors[m] = mats[m]->values;
+  }
+  return spt_OmpMTTKRPCpdLayout(layouts, mode, mats_order, mats[0]->stride, mats[mode]->ncols, mats[nmodes]->values);
+}
+
 double spt_OmpCpdAlsStepHiCOO(
   sptSparseTensorHiCOO const * const hitsr,
   sptIndex const rank,
@@ -40,7 +57,8 @@ double spt_OmpCpdAlsStepHiCOO(
   double const tol,
   const int tk,
   const int tb,
-  const int * par_iters,
+  const sptHiCOOMttkrpVariant * variants,
+  sptCpdLayouts * layouts,
   sptRankMatrix ** mats,
   sptRankMatrix *** copy_mats,
   sptValue * const lambda)
@@ -49,7 +67,8 @@ double spt_OmpCpdAlsStepHiCOO(
   sptIndex const stride = mats[0]->stride;
   double fit = 0;
 
-  omp_set_num_threads(tk);
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
 #ifdef PARTI_USE_MAGMA
   magma_set_omp_numthreads(tk);
   magma_set_lapack_numthreads(tk);
@@ -75,26 +94,54 @@ double spt_OmpCpdAlsStepHiCOO(
     sptAssert(mats[m]->stride == ata[m]->stride);
   }
 
+  /* Resume from the configured checkpoint when it holds this decomposition */
+  sptValue ** ckpt_vals = (sptValue **)malloc(nmodes * sizeof(*ckpt_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ckpt_vals[m] = mats[m]->values;
+  }
+  spt_CpdFactors const ckpt = { nmodes, rank, stride, hitsr->ndims, ckpt_vals, lambda };
+  spt_CpdCheckpointKey const ckpt_key = { spt_CpdCheckpointEnabled() ? sptSparseTensorHiCOOFingerprint(hitsr) : 0, tol, niters };
+  sptIndex start_it = 0;
+  int converged = 0;
+  double oldfit = 0;
+  sptAssert(spt_CpdCheckpointRestore(&ckpt, &ckpt_key, &start_it, &oldfit, &converged) == 0);
+  fit = oldfit;
+
+  /* Extrapolated steps, when enabled, are tried on the factors ckpt points at */
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  spt_CpdLineSearch ls;
+  sptAssert(spt_NewCpdLineSearch(&ls, &ckpt) == 0);
+  spt_CpdGuard guard;
+  sptAssert(spt_NewCpdGuard(&guard, &ckpt) == 0);
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, stride) == 0);
+
   /* Compute all "ata"s */
   for(sptIndex m=0; m < nmodes; ++m) {
     /* ata[m] = mats[m]^T * mats[m]), actually do A * A' due to row-major mats, and output an upper triangular matrix. */
     int blas_nrows = (int)(mats[m]->nrows);
-    ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
       mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
   }
 
-  double oldfit = 0;
+  /* The tensor values are fixed during CPD, so its norm is computed only once. */
+  double const spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
   sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
 
   sptTimer tmp_timer;
   sptNewTimer(&tmp_timer, 0);
   double mttkrp_time, solver_time, norm_time, ata_time, fit_time;
 
-  for(sptIndex it=0; it < niters; ++it) {
+  for(sptIndex it=start_it; it < niters && !converged; ++it) {
     sptTimer timer;
     sptNewTimer(&timer, 0);
     sptStartTimer(timer);
+    double const trace_it = sptTraceBegin();
 
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
     for(sptIndex m=0; m < nmodes; ++m) {
       tmp_mat->nrows = mats[m]->nrows;
 
@@ -104,61 +151,98 @@ double spt_OmpCpdAlsStepHiCOO(
           mats_order[i] = (m+i) % nmodes;     
 
       sptStartTimer(tmp_timer);
-      if(par_iters[m] == 1) {
-        sptAssert (sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(hitsr, mats, copy_mats[m], mats_order, m, tk) == 0);
-      } else {
-        sptAssert (sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(hitsr, mats, mats_order, m, tk) == 0);
-      }
+      double trace_phase = sptTraceBegin();
+      sptAssert (spt_MTTKRPHiCOOOrLayout(hitsr, variants[m], layouts, mats, copy_mats[m], mats_order, m, tk) == 0);
+      sptTraceEnd("CPD MTTKRP", m, trace_phase);
       sptStopTimer(tmp_timer);
       // mttkrp_time = sptPrintElapsedTime(tmp_timer, "MTTKRP");
 
       sptStartTimer(tmp_timer);
+      trace_phase = sptTraceBegin();
 #ifdef PARTI_USE_OPENMP
       #pragma omp parallel for num_threads(tk)
 #endif
       for(sptIndex i=0; i<mats[m]->nrows * stride; ++i)
         mats[m]->values[i] = tmp_mat->values[i];
+      sptTraceEnd("CPD copy", m, trace_phase);
 
       /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
       /* result is row-major, solve AT XT = BT */
-      sptAssert ( sptRankMatrixSolveNormals(m, nmodes, ata, mats[m]) == 0 );
+      trace_phase = sptTraceBegin();
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptOmpRankMatrixSolveFormedNormals(nmodes, ata, mats[m], tk) == 0 );
+      sptTraceEnd("CPD solve", m, trace_phase);
       sptStopTimer(tmp_timer);
 
       /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
       sptStartTimer(tmp_timer);
+      trace_phase = sptTraceBegin();
       if (it == 0 ) {
         sptRankMatrix2Norm(mats[m], lambda);
       } else {
         sptRankMatrixMaxNorm(mats[m], lambda);
       }
+      sptTraceEnd("CPD normalize", m, trace_phase);
       sptStopTimer(tmp_timer);
 
       /* ata[m] = mats[m]^T * mats[m]) */
       sptStartTimer(tmp_timer);
+      trace_phase = sptTraceBegin();
       int blas_nrows = (int)(mats[m]->nrows);
-      ssyrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
         mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      sptAssert(sptGramHadamardAdvance(&gh, m, ata_vals) == 0);
+      sptTraceEnd("CPD Gram", m, trace_phase);
       sptStopTimer(tmp_timer);
 
     } // Loop nmodes
 
     sptStartTimer(tmp_timer);
-    fit = sptKruskalTensorFitHiCOO(hitsr, lambda, mats, ata);
+    double const trace_fit = sptTraceBegin();
+    fit = sptKruskalTensorFitFromNorms(spten_normsq, sptGramHadamardKruskalNorm(&gh, lambda, ata_vals),
+        sptSparseKruskalTensorInnerProductRank(nmodes, lambda, mats));
+    sptTraceEnd("CPD fit", -1, trace_fit);
     sptStopTimer(tmp_timer);
 
+    /* Try an extrapolated step; its fit costs one MTTKRP of the last mode */
+    if(spt_CpdLineSearchPropose(&ls, &ckpt, ata_vals, it)) {
+      sptIndex const last = nmodes - 1;
+      tmp_mat->nrows = mats[last]->nrows;
+      mats_order[0] = last;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (last+i) % nmodes;
+      sptAssert (spt_MTTKRPHiCOOOrLayout(hitsr, variants[last], layouts, mats, copy_mats[last], mats_order, last, tk) == 0);
+      double const trial_fit = sptKruskalTensorFitNormRank(nmodes, spten_normsq, lambda, mats, ata);
+      fit = spt_CpdLineSearchResolve(&ls, &ckpt, ata_vals, fit, trial_fit);
+    }
+    sptTraceEnd("CPD iteration", it, trace_it);
+
     sptStopTimer(timer);
     double its_time = sptElapsedTime(timer);
     sptFreeTimer(timer);
 
-    printf("  its = %3u ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+    printf("  its = %3"PARTI_PRI_INDEX" ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
         it+1, its_time, fit, fit - oldfit);
     if(it > 0 && fabs(fit - oldfit) < tol) {
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 1) == 0);
       break;
     }
     oldfit = fit;
+    if(spt_CpdGuardRecord(&guard, &ckpt, it, its_time, fit, 1)) {
+      fit = spt_CpdGuardRestore(&guard, &ckpt, fit, 1);
+      printf("  stopped %s, best fit = %0.5f\n", guard.stopped == 1 ? "ahead of the deadline" : "by the progress callback", fit);
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 0) == 0);
+      break;
+    }
+    sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, it+1 == niters, 0) == 0);
     
   } // Loop niters
 
+  free(ckpt_vals);
+  free(ata_vals);
+  sptFreeGramHadamard(&gh);
+  spt_FreeCpdLineSearch(&ls);
+  spt_FreeCpdGuard(&guard);
   GetRankFinalLambda(rank, nmodes, mats, lambda);
 
   for(sptIndex m=0; m < nmodes+1; ++m) {
@@ -167,29 +251,20 @@ double spt_OmpCpdAlsStepHiCOO(
   free(ata);
   free(mats_order);
 
+  sptSetExecContext(caller_exec);
   return fit;
 }
 
 
-/*************************************************
- * PUBLIC FUNCTIONS
- *************************************************/
-/**
- * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for HiCOO formatted sparse tensors.
- * @param[out] ktensor the Kruskal tensor
- * @param[in]  hitsr the HiCOO representation of a sparse tensor
- * @param[in]  rank the CPD rank
- * @param[in]  niters the maximum number of iterations
- * @param[in]  tol the tolerance value for convergence
- * @param[in]  tk the number of threads for superblock parallelism
- * @param[in]  tb the number of threads for block parallelism
- */
-int sptOmpCpdAlsHiCOO(
+/* CPD-ALS driver running the given MTTKRP variant for each mode without a copy in layouts, which may be NULL. */
+static int spt_OmpCpdAlsHiCOOVariants(
   sptSparseTensorHiCOO const * const hitsr,
   sptIndex const rank,
   sptIndex const niters,
   double const tol,
   const int tk,
+  const sptHiCOOMttkrpVariant * variants,
+  sptCpdLayouts * layouts,
   sptRankKruskalTensor * ktensor)
 {
   sptIndex nmodes = hitsr->nmodes;
@@ -204,35 +279,23 @@ int sptOmpCpdAlsHiCOO(
     max_dim = (hitsr->ndims[m] > max_dim) ? hitsr->ndims[m] : max_dim;
   }
   sptRankMatrix ** mats = (sptRankMatrix **)malloc((nmodes+1) * sizeof(*mats));
-  for(sptIndex m=0; m < nmodes+1; ++m) {
-    mats[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
-  }
+  int warm;
+  sptAssert(spt_CpdTakeRankFactors(ktensor, nmodes, hitsr->ndims, rank, mats, &warm) == 0);
   for(sptIndex m=0; m < nmodes; ++m) {
-    sptAssert(sptNewRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
-    sptAssert(sptRandomizeRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    if(!warm) {
+      mats[m] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
+      sptAssert(sptNewRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeRankMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    }
   }
+  mats[nmodes] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
   sptAssert(sptNewRankMatrix(mats[nmodes], max_dim, rank) == 0);
   sptAssert(sptConstantRankMatrix(mats[nmodes], 0) == 0);
 
-  /* determine niters or num_kernel_dim to be parallelized */
-  int * par_iters = (int *)malloc(nmodes * sizeof(*par_iters));
-  sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
-  for(sptIndex m=0; m < nmodes; ++m) {
-    par_iters[m] = 0;
-    sptIndex num_kernel_dim = (hitsr->ndims[m] + sk - 1) / sk;
-    if(num_kernel_dim <= PAR_MIN_DEGREE * NUM_CORES && hitsr->nkiters[m] / num_kernel_dim >= PAR_DEGREE_REDUCE) {
-        par_iters[m] = 1;
-    }
-  }
-  // printf("par_iters:\n");
-  // for(sptIndex m=0; m < nmodes; ++m) {
-  //   printf("%d, ", par_iters[m]);
-  // }
-  // printf("\n");
-
   sptRankMatrix *** copy_mats = (sptRankMatrix ***)malloc(nmodes * sizeof(*copy_mats));
   for(sptIndex m=0; m < nmodes; ++m) {
-    if (par_iters[m] == 1) {
+    copy_mats[m] = NULL;
+    if (variants[m] == SPT_HICOO_MTTKRP_SCHEDULED_REDUCE && (layouts == NULL || layouts->copies[m] == NULL)) {
       copy_mats[m] = (sptRankMatrix **)malloc(tk * sizeof(sptRankMatrix*));
       for(int t=0; t<tk; ++t) {
         copy_mats[m][t] = (sptRankMatrix *)malloc(sizeof(sptRankMatrix));
@@ -246,7 +309,7 @@ int sptOmpCpdAlsHiCOO(
   sptNewTimer(&timer, 0);
   sptStartTimer(timer);
 
-  ktensor->fit = spt_OmpCpdAlsStepHiCOO(hitsr, rank, niters, tol, tk, tb, par_iters,  mats, copy_mats, ktensor->lambda);
+  ktensor->fit = spt_OmpCpdAlsStepHiCOO(hitsr, rank, niters, tol, tk, tb, variants, layouts, mats, copy_mats, ktensor->lambda);
 
   sptStopTimer(timer);
   sptPrintElapsedTime(timer, "CPU  HiCOO SpTns CPD-ALS");
@@ -259,7 +322,7 @@ int sptOmpCpdAlsHiCOO(
 #endif
   sptFreeRankMatrix(mats[nmodes]);
   for(sptIndex m=0; m < nmodes; ++m) {
-    if(par_iters[m] == 1) {
+    if(copy_mats[m] != NULL) {
       for(int t=0; t<tk; ++t) {
         sptFreeRankMatrix(copy_mats[m][t]);
         free(copy_mats[m][t]);
@@ -272,4 +335,147 @@ int sptOmpCpdAlsHiCOO(
   return 0;
 }
 
+
+/*************************************************
+ * PUBLIC FUNCTIONS
+ *************************************************/
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for HiCOO formatted sparse tensors.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  hitsr the HiCOO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads for superblock parallelism
+ *
+ * The longest modes read COO copies sorted for them as far as the
+ * sptSetCpdLayoutBudget setting allows, see sptNewCpdLayoutsHiCOO.
+ */
+int sptOmpCpdAlsHiCOO(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptRankKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+
+  /* determine niters or num_kernel_dim to be parallelized */
+  sptHiCOOMttkrpVariant * variants = (sptHiCOOMttkrpVariant *)malloc(nmodes * sizeof(*variants));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    variants[m] = spt_HiCOODefaultVariant(hitsr, m);
+  }
+  sptCpdLayouts layouts;
+  int const use_layouts = spt_CpdLayoutBudget() != 0;
+  if(use_layouts) {
+    sptAssert(sptNewCpdLayoutsHiCOO(&layouts, hitsr, rank, tk, 0) == 0);
+  }
+  int result = spt_OmpCpdAlsHiCOOVariants(hitsr, rank, niters, tol, tk, variants, use_layouts ? &layouts : NULL, ktensor);
+  if(use_layouts) {
+    sptFreeCpdLayouts(&layouts);
+  }
+  free(variants);
+  return result;
+}
+
+
+/**
+ * OpenMP Parallel CPD-ALS for HiCOO formatted sparse tensors, running the MTTKRP variants and thread count of a tuning plan.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  hitsr the HiCOO representation of a sparse tensor, converted with plan->sb_bits and plan->sk_bits
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  plan a plan from sptTuneHiCOOMTTKRP or sptLoadHiCOOPlan
+ */
+int sptOmpCpdAlsHiCOOPlan(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptHiCOOPlan const * const plan,
+  sptRankKruskalTensor * ktensor)
+{
+  if(plan->nmodes != hitsr->nmodes) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  HiCOO SpTns CPD-ALS", "plan->nmodes != hitsr->nmodes");
+  }
+  return spt_OmpCpdAlsHiCOOVariants(hitsr, rank, niters, tol, plan->nthreads, plan->variants, NULL, ktensor);
+}
+
+
+/**
+ * OpenMP Parallel CPD-ALS for HiCOO formatted sparse tensors as sptOmpCpdAlsHiCOO,
+ * within a memory budget: modes that would privatize and reduce fall back to
+ * the scheduled variant, largest copies first, until the estimated peak fits,
+ * and what the budget leaves goes to COO copies of the longest modes, up to
+ * the sptSetCpdLayoutBudget setting.
+ * Fails with SPTERR_VALUE_ERROR, before allocating, when nothing fits.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  hitsr the HiCOO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads for superblock parallelism
+ * @param[in]  budget the bytes the run may take at its peak, the tensor included
+ */
+int sptOmpCpdAlsHiCOOBudget(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  size_t const budget,
+  sptRankKruskalTensor * ktensor)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptHiCOOMttkrpVariant * variants = (sptHiCOOMttkrpVariant *)malloc(nmodes * sizeof(*variants));
+  spt_CheckOSError(!variants, "CPU  HiCOO SpTns CPD-ALS");
+  for(sptIndex m=0; m < nmodes; ++m) {
+    variants[m] = spt_HiCOODefaultVariant(hitsr, m);
+  }
+
+  sptMemoryEstimate est;
+  for(;;) {
+    int result = spt_EstimateCpdMemoryHiCOOVariants(&est, hitsr, rank, tk, variants);
+    if(result != 0) {
+      free(variants);
+      spt_CheckError(result, "CPU  HiCOO SpTns CPD-ALS", NULL);
+    }
+    if(est.peak <= budget) {
+      break;
+    }
+    sptIndex longest = nmodes;
+    for(sptIndex m=0; m < nmodes; ++m) {
+      if(variants[m] == SPT_HICOO_MTTKRP_SCHEDULED_REDUCE && (longest == nmodes || hitsr->ndims[m] > hitsr->ndims[longest])) {
+        longest = m;
+      }
+    }
+    if(longest == nmodes) {
+      free(variants);
+      spt_CheckError(SPTERR_VALUE_ERROR, "CPU  HiCOO SpTns CPD-ALS", "no configuration fits the memory budget");
+    }
+    variants[longest] = SPT_HICOO_MTTKRP_SCHEDULED;
+  }
+
+  size_t layout_bytes = budget - est.peak;
+  if(layout_bytes > spt_CpdLayoutBudget()) {
+    layout_bytes = spt_CpdLayoutBudget();
+  }
+  sptCpdLayouts layouts;
+  if(layout_bytes != 0) {
+    int result = sptNewCpdLayoutsHiCOO(&layouts, hitsr, rank, tk, layout_bytes);
+    if(result != 0) {
+      free(variants);
+      spt_CheckError(result, "CPU  HiCOO SpTns CPD-ALS", NULL);
+    }
+  }
+  int result = spt_OmpCpdAlsHiCOOVariants(hitsr, rank, niters, tol, tk, variants, layout_bytes != 0 ? &layouts : NULL, ktensor);
+  if(layout_bytes != 0) {
+    sptFreeCpdLayouts(&layouts);
+  }
+  free(variants);
+  return result;
+}
+
 #endif
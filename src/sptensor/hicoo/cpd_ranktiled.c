@@ -0,0 +1,267 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <assert.h>
+#include <math.h>
+#include "../../matrix/lapack.h"
+#include "hicoo.h"
+#include "../sptensor.h"
+
+
+/*************************************************
+ * PRIVATE FUNCTIONS
+ *************************************************/
+static double spt_CpdAlsStepHiCOORankTiled(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptIndex const R_tile,
+  sptMatrix ** mats,  // Row-major
+  sptValue * const lambda)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptIndex const stride = mats[0]->stride;
+  double fit = 0;
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(hitsr->ndims[m] == mats[m]->nrows);
+    sptAssert(mats[m]->ncols == rank);
+  }
+
+  sptValue alpha = 1.0, beta = 0.0;
+  char notrans = 'N';
+  char uplo = 'L';
+  int blas_rank = (int) rank;
+  int blas_stride = (int) stride;
+
+  sptMatrix * tmp_mat = mats[nmodes];
+  sptMatrix ** ata = (sptMatrix **)malloc((nmodes+1) * sizeof(*ata));
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    ata[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+    sptAssert(sptNewMatrix(ata[m], rank, rank) == 0);
+    sptAssert(mats[m]->stride == ata[m]->stride);
+  }
+
+  /* Resume from the configured checkpoint when it holds this decomposition */
+  sptValue ** ckpt_vals = (sptValue **)malloc(nmodes * sizeof(*ckpt_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ckpt_vals[m] = mats[m]->values;
+  }
+  spt_CpdFactors const ckpt = { nmodes, rank, stride, hitsr->ndims, ckpt_vals, lambda };
+  spt_CpdCheckpointKey const ckpt_key = { spt_CpdCheckpointEnabled() ? sptSparseTensorHiCOOFingerprint(hitsr) : 0, tol, niters };
+  sptIndex start_it = 0;
+  int converged = 0;
+  double oldfit = 0;
+  sptAssert(spt_CpdCheckpointRestore(&ckpt, &ckpt_key, &start_it, &oldfit, &converged) == 0);
+  fit = oldfit;
+
+  /* Extrapolated steps, when enabled, are tried on the factors ckpt points at */
+  sptValue ** ata_vals = (sptValue **)malloc(nmodes * sizeof(*ata_vals));
+  for(sptIndex m=0; m < nmodes; ++m) {
+    ata_vals[m] = ata[m]->values;
+  }
+  spt_CpdLineSearch ls;
+  sptAssert(spt_NewCpdLineSearch(&ls, &ckpt) == 0);
+  sptGramHadamard gh;
+  sptAssert(sptNewGramHadamard(&gh, nmodes, rank, stride) == 0);
+
+  /* Compute all "ata"s */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    /* ata[m] = mats[m]^T * mats[m]), actually do A * A' due to row-major mats, and output an upper triangular matrix. */
+    int blas_nrows = (int)(mats[m]->nrows);
+    spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+      mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+  }
+
+  double const spten_normsq = sptSparseTensorFrobeniusNormSquaredHiCOO(hitsr);
+  sptIndex * mats_order = (sptIndex*)malloc(nmodes * sizeof(*mats_order));
+
+  for(sptIndex it=start_it; it < niters && !converged; ++it) {
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptAssert(sptGramHadamardBeginSweep(&gh, ata_vals) == 0);
+    for(sptIndex m=0; m < nmodes; ++m) {
+      tmp_mat->nrows = mats[m]->nrows;
+
+      /* Factor Matrices order */
+      mats_order[0] = m;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (m+i) % nmodes;
+
+      sptAssert (sptOmpMTTKRPHiCOO_RankTiled(hitsr, mats, mats_order, m, R_tile, tk) == 0);
+
+#ifdef PARTI_USE_OPENMP
+      #pragma omp parallel for num_threads(tk)
+#endif
+      for(sptNnzIndex i=0; i<(sptNnzIndex)mats[m]->nrows * stride; ++i)
+        mats[m]->values[i] = tmp_mat->values[i];
+
+      /* Solve ? * ata[nmodes] = mats[nmodes] (tmp_mat) */
+      sptAssert ( sptGramHadamardForm(&gh, m, ata_vals, ata[nmodes]->values) == 0 );
+      sptAssert ( sptOmpMatrixSolveFormedNormals(nmodes, ata, mats[m], tk) == 0 );
+
+      /* Normalized mats[m], store the norms in lambda. Use different norms to avoid precision explosion. */
+      if (it == 0 ) {
+        sptMatrix2Norm(mats[m], lambda);
+      } else {
+        sptMatrixMaxNorm(mats[m], lambda);
+      }
+
+      /* ata[m] = mats[m]^T * mats[m]) */
+      int blas_nrows = (int)(mats[m]->nrows);
+      spt_syrk_(&uplo, &notrans, &blas_rank, &blas_nrows, &alpha,
+        mats[m]->values, &blas_stride, &beta, ata[m]->values, &blas_stride);
+      sptAssert(sptGramHadamardAdvance(&gh, m, ata_vals) == 0);
+    } // Loop nmodes
+
+    fit = sptKruskalTensorFitFromNorms(spten_normsq, sptGramHadamardKruskalNorm(&gh, lambda, ata_vals),
+        sptSparseKruskalTensorInnerProduct(nmodes, lambda, mats));
+
+    /* Try an extrapolated step; its fit costs one MTTKRP of the last mode */
+    if(spt_CpdLineSearchPropose(&ls, &ckpt, ata_vals, it)) {
+      sptIndex const last = nmodes - 1;
+      tmp_mat->nrows = mats[last]->nrows;
+      mats_order[0] = last;
+      for(sptIndex i=1; i<nmodes; ++i)
+          mats_order[i] = (last+i) % nmodes;
+      sptAssert (sptOmpMTTKRPHiCOO_RankTiled(hitsr, mats, mats_order, last, R_tile, tk) == 0);
+      double const trial_fit = sptKruskalTensorFitNorm(nmodes, spten_normsq, lambda, mats, ata);
+      fit = spt_CpdLineSearchResolve(&ls, &ckpt, ata_vals, fit, trial_fit);
+    }
+
+    sptStopTimer(timer);
+    double its_time = sptElapsedTime(timer);
+    sptFreeTimer(timer);
+
+    printf("  its = %3"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, 1, 1) == 0);
+      break;
+    }
+    oldfit = fit;
+    sptAssert(spt_CpdCheckpointSave(&ckpt, &ckpt_key, it+1, fit, it+1 == niters, 0) == 0);
+  } // Loop niters
+
+  free(ckpt_vals);
+  free(ata_vals);
+  sptFreeGramHadamard(&gh);
+  spt_FreeCpdLineSearch(&ls);
+  GetFinalLambda(rank, nmodes, mats, lambda);
+
+  for(sptIndex m=0; m < nmodes+1; ++m) {
+    sptFreeMatrix(ata[m]);
+    free(ata[m]);
+  }
+  free(ata);
+  free(mats_order);
+
+  sptSetExecContext(caller_exec);
+  return fit;
+}
+
+
+/*************************************************
+ * PUBLIC FUNCTIONS
+ *************************************************/
+/**
+ * OpenMP Parallel CANDECOMP/PARAFAC decomposition (CPD) using alternating least squares for HiCOO formatted sparse tensors, for any rank.
+ * Factors are sptMatrix and MTTKRP runs sptOmpMTTKRPHiCOO_RankTiled, so
+ * unlike sptOmpCpdAlsHiCOO the rank is not limited by sptElementIndex.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  hitsr the HiCOO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ * @param[in]  R_tile the number of factor columns per MTTKRP panel, 0 for the default
+ */
+int sptOmpCpdAlsHiCOORankTiled(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptIndex const R_tile,
+  sptKruskalTensor * ktensor)
+{
+  sptIndex nmodes = hitsr->nmodes;
+#ifdef PARTI_USE_MAGMA
+  magma_init();
+#endif
+
+  /* Initialize factor matrices */
+  sptIndex max_dim = sptMaxIndexArray(hitsr->ndims, nmodes);
+  sptMatrix ** mats = (sptMatrix **)malloc((nmodes+1) * sizeof(*mats));
+  spt_CheckOSError(!mats, "CPU  HiCOO SpTns CPD-ALS");
+  int warm;
+  sptAssert(spt_CpdTakeFactors(ktensor, nmodes, hitsr->ndims, rank, mats, &warm) == 0);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(!warm) {
+      mats[m] = (sptMatrix *)malloc(sizeof(sptMatrix));
+      sptAssert(sptNewMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+      sptAssert(sptRandomizeMatrix(mats[m], hitsr->ndims[m], rank) == 0);
+    }
+  }
+  mats[nmodes] = (sptMatrix *)malloc(sizeof(sptMatrix));
+  sptAssert(sptNewMatrix(mats[nmodes], max_dim, rank) == 0);
+  sptAssert(sptConstantMatrix(mats[nmodes], 0) == 0);
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  ktensor->fit = spt_CpdAlsStepHiCOORankTiled(hitsr, rank, niters, tol, tk, R_tile, mats, ktensor->lambda);
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, "CPU  HiCOO SpTns CPD-ALS");
+  sptFreeTimer(timer);
+
+  ktensor->factors = mats;
+
+#ifdef PARTI_USE_MAGMA
+  magma_finalize();
+#endif
+  sptFreeMatrix(mats[nmodes]);
+  free(mats[nmodes]);
+
+  return 0;
+}
+
+
+/**
+ * Sequential CPD-ALS for HiCOO formatted sparse tensors, for any rank.
+ * See sptOmpCpdAlsHiCOORankTiled.
+ */
+int sptCpdAlsHiCOORankTiled(
+  sptSparseTensorHiCOO const * const hitsr,
+  sptIndex const rank,
+  sptIndex const niters,
+  double const tol,
+  sptIndex const R_tile,
+  sptKruskalTensor * ktensor)
+{
+  return sptOmpCpdAlsHiCOORankTiled(hitsr, rank, niters, tol, 1, R_tile, ktensor);
+}
@@ -0,0 +1,396 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+#include "../../matrix/lapack.h"
+
+/*
+ * Dense HiCOO blocks.
+ *
+ * A block whose fill reaches a threshold costs less stored in full than as
+ * per-element offsets, and its MTTKRP contribution is a few small GEMMs
+ * instead of one decode and one row update per nonzero. Such blocks are cut
+ * out at conversion; the rest of the tensor stays HiCOO.
+ */
+
+/* C (n x R) = op(X) K with K (k x R), all row-major with rows of R values; op(X) is X (n x k) or X^T for X (k x n) */
+static void spt_DenseBlockGemm(
+    int const trans,
+    sptIndex const n,
+    sptIndex const k,
+    sptIndex const R,
+    sptValue const * const X,
+    sptValue const * const K,
+    sptValue * const C)
+{
+#ifdef PARTI_USE_BLAS
+    /* Row-major operands are column-major transposes: C^T = K^T op(X)^T */
+    char notrans = 'N', transx = trans ? 'T' : 'N';
+    integer m_ = (integer) R, n_ = (integer) n, k_ = (integer) k;
+    integer ldk = (integer) R, ldx = (integer) (trans ? n : k), ldc = (integer) R;
+    sptValue alpha = 1, beta = 0;
+    spt_gemm_(&notrans, &transx, &m_, &n_, &k_, &alpha, (sptValue *) K, &ldk,
+        (sptValue *) X, &ldx, &beta, C, &ldc);
+#else
+    memset(C, 0, (size_t) n * R * sizeof *C);
+    for(sptIndex i = 0; i < n; ++i) {
+        for(sptIndex j = 0; j < k; ++j) {
+            sptValue const x = trans ? X[(size_t) j * n + i] : X[(size_t) i * k + j];
+            sptValue const * const restrict krow = K + (size_t) j * R;
+            sptValue * const restrict crow = C + (size_t) i * R;
+            for(sptIndex r = 0; r < R; ++r) {
+                crow[r] += x * krow[r];
+            }
+        }
+    }
+#endif
+}
+
+
+/* Khatri-Rao product of the block's factor rows of modes [mbegin, mend), last mode fastest; returns its row count */
+static sptNnzIndex spt_DenseBlockKhatriRao(
+    sptValue * const kr,
+    sptRankMatrix * mats[],
+    sptIndex const * const corner,
+    sptIndex const * const ext,
+    sptIndex const mbegin,
+    sptIndex const mend,
+    sptIndex const R)
+{
+    sptNnzIndex len = 1;
+    for(sptIndex r = 0; r < R; ++r) {
+        kr[r] = 1;
+    }
+    for(sptIndex m = mbegin; m < mend; ++m) {
+        sptIndex const e = ext[m];
+        sptIndex const stride = mats[m]->stride;
+        sptValue const * const rows = mats[m]->values + (size_t) corner[m] * stride;
+        /* Expand in place from the back, so no row is overwritten before it is read */
+        for(sptNnzIndex i = len; i-- > 0; ) {
+            for(sptIndex j = e; j-- > 0; ) {
+                sptValue const * const src = kr + i * R;
+                sptValue * const dst = kr + (i * e + j) * R;
+                for(sptIndex r = 0; r < R; ++r) {
+                    dst[r] = src[r] * rows[(size_t) j * stride + r];
+                }
+            }
+        }
+        len *= e;
+    }
+    return len;
+}
+
+
+/**
+ * Convert a COO sparse tensor into HiCOO, with its dense blocks stored apart
+ * @param hitsr     an uninitialized HiCOO tensor, receives the sparse blocks
+ * @param dense     an uninitialized set of dense blocks
+ * @param max_nnzb  receives the most nonzeros of a sparse block
+ * @param tsr       the COO sparse tensor, sorted in place as by sptSparseTensorToHiCOO
+ * @param sb_bits   the block size in bits
+ * @param sk_bits   the kernel size in bits
+ * @param fill      the fraction of nonzeros from which a block is dense, 0 for PARTI_HICOO_DENSE_FILL
+ * @param tk        the number of threads
+ *
+ * The MTTKRP of the tensor is sptOmpMTTKRPHiCOO_MatrixTiling or another HiCOO
+ * MTTKRP of hitsr followed by sptOmpMTTKRPHiCOODense on the same output.
+ */
+int sptSparseTensorToHiCOODense(
+    sptSparseTensorHiCOO *hitsr,
+    sptHiCOODenseBlocks *dense,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    double fill,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+    sptIndex const * const ndims = tsr->ndims;
+    sptIndex const B = (sptIndex) 1 << sb_bits;
+    if(fill <= 0) {
+        fill = PARTI_HICOO_DENSE_FILL;
+    }
+
+    sptSparseTensorHiCOO full;
+    result = sptSparseTensorToHiCOO(&full, max_nnzb, tsr, sb_bits, sk_bits, tk);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+
+    /* Pick the blocks filled at least `fill` within the tensor */
+    sptNnzIndex const nb = full.bptr.len - 1;
+    char * is_dense = calloc(nb > 0 ? nb : 1, 1);
+    spt_CheckOSError(!is_dense, "HiSpTns Dense Convert");
+    sptNnzIndex ndense = 0, nvals = 0, dense_nnz = 0;
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        double volume = 1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const corner = (sptIndex) full.binds[m].data[b] << sb_bits;
+            volume *= ndims[m] - corner < B ? ndims[m] - corner : B;
+        }
+        sptNnzIndex const nnzb = full.bptr.data[b+1] - full.bptr.data[b];
+        if((double) nnzb >= fill * volume) {
+            is_dense[b] = 1;
+            ++ndense;
+            nvals += (sptNnzIndex) volume;
+            dense_nnz += nnzb;
+        }
+    }
+
+    dense->nmodes = nmodes;
+    dense->sb_bits = sb_bits;
+    dense->nblocks = ndense;
+    dense->nnz = dense_nnz;
+    dense->ndims = malloc(nmodes * sizeof *dense->ndims);
+    dense->corners = malloc(nmodes * sizeof *dense->corners);
+    dense->extents = malloc((ndense > 0 ? ndense : 1) * nmodes * sizeof *dense->extents);
+    spt_CheckOSError(!dense->ndims || !dense->corners || !dense->extents, "HiSpTns Dense Convert");
+    memcpy(dense->ndims, ndims, nmodes * sizeof *dense->ndims);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptNewIndexVector(&dense->corners[m], ndense, ndense);
+        spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    }
+    result = sptNewNnzIndexVector(&dense->vptr, ndense + 1, ndense + 1);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    result = sptNewValueVector(&dense->values, nvals, nvals);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    memset(dense->values.data, 0, nvals * sizeof *dense->values.data);
+
+    if(ndense == 0) {
+        dense->vptr.data[0] = 0;
+        free(is_dense);
+        *hitsr = full;
+        return 0;
+    }
+
+    /* Scatter the dense blocks, gather the rest back into COO */
+    sptSparseTensor rest;
+    sptNnzIndex const nrest = tsr->nnz - dense_nnz;
+    result = sptNewSparseTensor(&rest, nmodes, ndims);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&rest.inds[m], nrest);
+        spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    }
+    result = sptResizeValueVector(&rest.values, nrest);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+    rest.nnz = nrest;
+
+    sptNnzIndex d = 0, zr = 0;
+    dense->vptr.data[0] = 0;
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        if(is_dense[b]) {
+            sptIndex * const ext = dense->extents + d * nmodes;
+            sptNnzIndex volume = 1;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptIndex const corner = (sptIndex) full.binds[m].data[b] << sb_bits;
+                dense->corners[m].data[d] = corner;
+                ext[m] = ndims[m] - corner < B ? ndims[m] - corner : B;
+                volume *= ext[m];
+            }
+            sptValue * const block = dense->values.data + dense->vptr.data[d];
+            for(sptNnzIndex z = full.bptr.data[b]; z < full.bptr.data[b+1]; ++z) {
+                sptNnzIndex offset = 0;
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    offset = offset * ext[m] + full.einds[m].data[z];
+                }
+                block[offset] += full.values.data[z];
+            }
+            dense->vptr.data[d+1] = dense->vptr.data[d] + volume;
+            ++d;
+        } else {
+            for(sptNnzIndex z = full.bptr.data[b]; z < full.bptr.data[b+1]; ++z) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    rest.inds[m].data[zr] = ((sptIndex) full.binds[m].data[b] << sb_bits) + full.einds[m].data[z];
+                }
+                rest.values.data[zr] = full.values.data[z];
+                ++zr;
+            }
+        }
+    }
+    free(is_dense);
+    sptFreeSparseTensorHiCOO(&full);
+
+    if(nrest > 0) {
+        result = sptSparseTensorToHiCOO(hitsr, max_nnzb, &rest, sb_bits, sk_bits, tk);
+    } else {
+        result = spt_NewEmptyHiCOO(hitsr, nmodes, ndims, sb_bits, sk_bits);
+        *max_nnzb = 0;
+    }
+    sptFreeSparseTensor(&rest);
+    spt_CheckError(result, "HiSpTns Dense Convert", NULL);
+
+    return 0;
+}
+
+
+/**
+ * Release the dense blocks made by sptSparseTensorToHiCOODense
+ */
+void sptFreeHiCOODenseBlocks(sptHiCOODenseBlocks *dense)
+{
+    for(sptIndex m = 0; m < dense->nmodes; ++m) {
+        sptFreeIndexVector(&dense->corners[m]);
+    }
+    free(dense->corners);
+    free(dense->extents);
+    free(dense->ndims);
+    sptFreeNnzIndexVector(&dense->vptr);
+    sptFreeValueVector(&dense->values);
+    dense->nmodes = 0;
+    dense->nblocks = 0;
+}
+
+
+/**
+ * Add the MTTKRP of dense HiCOO blocks to mats[nmodes]
+ * @param dense  the dense blocks
+ * @param mats   (N+1) dense matrices, mats[nmodes] is added to, not cleared
+ * @param mode   the mode on which the MTTKRP is performed
+ * @param tk     the number of threads, which share the blocks
+ *
+ * With the block unfolded as P x I_mode x Q, where P and Q span the modes
+ * before and after `mode`, each block takes P GEMMs of I_mode x Q times the
+ * Q x R Khatri-Rao product of the later modes, each scaled by a row of the
+ * earlier modes' product; for the last mode it is one GEMM with the P x R product.
+ */
+int sptOmpMTTKRPHiCOODense(
+    sptHiCOODenseBlocks const * const dense,
+    sptRankMatrix * mats[],     // mats[nmodes] receives the sum.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = dense->nmodes;
+    sptIndex const * const ndims = dense->ndims;
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  HiCOO SpTns Dense MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  HiCOO SpTns Dense MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    if(dense->nblocks == 0) {
+        return 0;
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[nmodes]->stride;
+    sptValue * const mvals = mats[nmodes]->values;
+
+    /* Scratch for the largest block */
+    sptNnzIndex max_kr = 1, max_rows = 1;
+    for(sptNnzIndex d = 0; d < dense->nblocks; ++d) {
+        sptIndex const * const ext = dense->extents + d * nmodes;
+        sptNnzIndex P = 1, Q = 1;
+        for(sptIndex m = 0; m < mode; ++m) P *= ext[m];
+        for(sptIndex m = mode + 1; m < nmodes; ++m) Q *= ext[m];
+        sptNnzIndex const kr = Q > 1 ? Q : P;
+        if(kr > max_kr) max_kr = kr;
+        if(ext[mode] > max_rows) max_rows = ext[mode];
+    }
+
+    int failed = 0;
+    #pragma omp parallel num_threads(tk)
+    {
+        sptValue * const kr = malloc(max_kr * R * sizeof *kr);
+        sptValue * const kp = malloc(R * sizeof *kp);
+        sptValue * const tmp = malloc(max_rows * R * sizeof *tmp);
+        sptValue * const acc = malloc(max_rows * R * sizeof *acc);
+        sptIndex * const corner = malloc(nmodes * sizeof *corner);
+        sptIndex * const idx = malloc(nmodes * sizeof *idx);
+        int const ok = kr && kp && tmp && acc && corner && idx;
+        /* Every thread reaches the loop, so a failed one does not stall the others */
+        #pragma omp for schedule(dynamic)
+        for(sptNnzIndex d = 0; d < dense->nblocks; ++d) {
+            if(!ok) {
+                #pragma omp atomic write
+                failed = 1;
+                continue;
+            }
+            sptIndex const * const ext = dense->extents + d * nmodes;
+            sptValue const * const block = dense->values.data + dense->vptr.data[d];
+            sptIndex const rows = ext[mode];
+            sptNnzIndex P = 1, Q = 1;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                corner[m] = dense->corners[m].data[d];
+                if(m < mode) P *= ext[m];
+                if(m > mode) Q *= ext[m];
+            }
+
+            if(Q == 1) {
+                /* acc = X^T Kp for X unfolded as P x rows */
+                spt_DenseBlockKhatriRao(kr, mats, corner, ext, 0, mode, R);
+                spt_DenseBlockGemm(1, rows, (sptIndex) P, R, block, kr, acc);
+            } else {
+                spt_DenseBlockKhatriRao(kr, mats, corner, ext, mode + 1, nmodes, R);
+                memset(acc, 0, (size_t) rows * R * sizeof *acc);
+                for(sptIndex m = 0; m < mode; ++m) {
+                    idx[m] = 0;
+                }
+                for(sptNnzIndex p = 0; p < P; ++p) {
+                    /* kp = Hadamard product of the earlier modes' rows at p */
+                    for(sptIndex r = 0; r < R; ++r) {
+                        kp[r] = 1;
+                    }
+                    for(sptIndex m = 0; m < mode; ++m) {
+                        sptValue const * const row = mats[m]->values + (size_t) (corner[m] + idx[m]) * mats[m]->stride;
+                        for(sptIndex r = 0; r < R; ++r) {
+                            kp[r] *= row[r];
+                        }
+                    }
+                    spt_DenseBlockGemm(0, rows, (sptIndex) Q, R, block + p * rows * Q, kr, tmp);
+                    for(sptIndex i = 0; i < rows; ++i) {
+                        for(sptIndex r = 0; r < R; ++r) {
+                            acc[(size_t) i * R + r] += tmp[(size_t) i * R + r] * kp[r];
+                        }
+                    }
+                    /* Next p, last of the earlier modes fastest */
+                    for(sptIndex m = mode; m-- > 0; ) {
+                        if(++idx[m] < ext[m]) break;
+                        idx[m] = 0;
+                    }
+                }
+            }
+
+            /* Blocks that share rows of this mode run at the same time */
+            for(sptIndex i = 0; i < rows; ++i) {
+                sptValue * const out_row = mvals + (size_t) (corner[mode] + i) * stride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    #pragma omp atomic update
+                    out_row[r] += acc[(size_t) i * R + r];
+                }
+            }
+        }
+        free(kr);
+        free(kp);
+        free(tmp);
+        free(acc);
+        free(corner);
+        free(idx);
+    }
+    spt_CheckOSError(failed, "CPU  HiCOO SpTns Dense MTTKRP");
+
+    return 0;
+}
@@ -31,14 +31,14 @@ int sptDumpSparseTensorHiCOO(sptSparseTensorHiCOO * const hitsr, FILE *fp)
     sptIndex mode;
     sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
 
-    iores = fprintf(fp, "%u\n", hitsr->nmodes);
+    iores = fprintf(fp, "%"PARTI_PRI_INDEX"\n", hitsr->nmodes);
     spt_CheckOSError(iores < 0, "SpTns Dump");
     for(mode = 0; mode < hitsr->nmodes; ++mode) {
         if(mode != 0) {
             iores = fputs(" ", fp);
             spt_CheckOSError(iores < 0, "SpTns Dump");
         }
-        iores = fprintf(fp, "%u", hitsr->ndims[mode]);
+        iores = fprintf(fp, "%"PARTI_PRI_INDEX, hitsr->ndims[mode]);
         spt_CheckOSError(iores < 0, "SpTns Dump");
     }
     fputs("\n", fp);
@@ -46,7 +46,7 @@ int sptDumpSparseTensorHiCOO(sptSparseTensorHiCOO * const hitsr, FILE *fp)
     sptDumpIndexArray(hitsr->nkiters, hitsr->nmodes, fp);
     fprintf(fp, "kschr:\n");
     for(mode = 0; mode < hitsr->nmodes; ++mode) {
-        fprintf(fp, "mode %u\n", mode);
+        fprintf(fp, "mode %"PARTI_PRI_INDEX"\n", mode);
         for(sptIndex i=0; i<(hitsr->ndims[mode] + sk - 1)/sk; ++i) {
             sptDumpIndexVector(&hitsr->kschr[mode][i], fp);
         }
@@ -0,0 +1,207 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * Pruning of HiCOO tensors, see filter.c for COO. The surviving nonzeros
+ * keep their blocks and their order within them; blocks left empty are
+ * dropped, and the kernel and chunk pointers, which index blocks, are moved
+ * to the renumbered blocks. Kernels, their block sizes and the kernel
+ * scheduler are unchanged, so the result is a valid HiCOO tensor.
+ */
+
+/* Keep the flagged nonzeros of hitsr */
+static int spt_HiCOOCompact(sptSparseTensorHiCOO *hitsr, uint8_t const * const keep, int const tk, char const * const module) {
+    (void) module;
+    sptIndex const nmodes = hitsr->nmodes;
+    sptNnzIndex const nb = hitsr->bptr.len - 1;
+    sptNnzIndex const * const bptr = hitsr->bptr.data;
+
+    /* Survivors of each block, then the new number of each block and where its nonzeros go */
+    sptNnzIndex * block_nnz = malloc((nb + 1) * sizeof *block_nnz);
+    sptNnzIndex * block_id = malloc((nb + 1) * sizeof *block_id);
+    spt_CheckOSError(!block_nnz || !block_id, module);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        sptNnzIndex count = 0;
+        for(sptNnzIndex z = bptr[b]; z < bptr[b+1]; ++z) {
+            count += keep[z];
+        }
+        block_nnz[b] = count;
+    }
+    sptNnzIndex nb_out = 0, nnz_out = 0;
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        block_id[b] = nb_out;
+        sptNnzIndex const count = block_nnz[b];
+        block_nnz[b] = nnz_out;
+        nb_out += count > 0;
+        nnz_out += count;
+    }
+    block_id[nb] = nb_out;
+    block_nnz[nb] = nnz_out;
+
+    int result;
+    sptNnzIndexVector new_bptr;
+    sptBlockIndexVector * binds = malloc(nmodes * sizeof *binds);
+    sptElementIndexVector * einds = malloc(nmodes * sizeof *einds);
+    spt_CheckOSError(!binds || !einds, module);
+    sptValueVector values;
+    result = sptNewNnzIndexVector(&new_bptr, nb_out + 1, nb_out + 1);
+    spt_CheckError(result, module, NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptNewBlockIndexVector(&binds[m], nb_out, nb_out);
+        spt_CheckError(result, module, NULL);
+        result = sptNewElementIndexVector(&einds[m], nnz_out, nnz_out);
+        spt_CheckError(result, module, NULL);
+    }
+    result = sptNewValueVector(&values, nnz_out, nnz_out);
+    spt_CheckError(result, module, NULL);
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        if(block_id[b + 1] == block_id[b]) {
+            continue;
+        }
+        sptNnzIndex const nbid = block_id[b];
+        sptNnzIndex out = block_nnz[b];
+        new_bptr.data[nbid] = out;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            binds[m].data[nbid] = hitsr->binds[m].data[b];
+        }
+        for(sptNnzIndex z = bptr[b]; z < bptr[b+1]; ++z) {
+            if(keep[z]) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    einds[m].data[out] = hitsr->einds[m].data[z];
+                }
+                values.data[out] = hitsr->values.data[z];
+                ++ out;
+            }
+        }
+    }
+    new_bptr.data[nb_out] = nnz_out;
+
+    /* Kernels and chunks start at the first surviving block at or after their old start */
+    for(sptNnzIndex k = 0; k < hitsr->kptr.len; ++k) {
+        hitsr->kptr.data[k] = block_id[hitsr->kptr.data[k]];
+    }
+    for(sptNnzIndex c = 0; c < hitsr->cptr.len; ++c) {
+        hitsr->cptr.data[c] = block_id[hitsr->cptr.data[c]];
+    }
+    free(block_nnz);
+    free(block_id);
+
+    sptFreeNnzIndexVector(&hitsr->bptr);
+    hitsr->bptr = new_bptr;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeBlockIndexVector(&hitsr->binds[m]);
+        hitsr->binds[m] = binds[m];
+        sptFreeElementIndexVector(&hitsr->einds[m]);
+        hitsr->einds[m] = einds[m];
+    }
+    free(binds);
+    free(einds);
+    sptFreeValueVector(&hitsr->values);
+    hitsr->values = values;
+    hitsr->nnz = nnz_out;
+    return spt_HiCOOPlaceHbm(hitsr);
+}
+
+
+/**
+ * Drop the nonzeros of a HiCOO sparse tensor whose magnitude is below a
+ * threshold, in parallel, see sptSparseTensorThreshold. Plans and schedules
+ * made for the tensor beforehand, which refer to its blocks, must be made again.
+ * @param hitsr     the HiCOO sparse tensor to operate on
+ * @param threshold nonzeros with |value| < threshold are dropped
+ * @param tk        the number of threads, 0 for the default
+ */
+int sptSparseTensorThresholdHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const threshold, int tk) {
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptNnzIndex const nnz = hitsr->nnz;
+    sptValue const * const vals = hitsr->values.data;
+    uint8_t * keep = malloc(nnz > 0 ? nnz : 1);
+    spt_CheckOSError(!keep, "HiSpTns Threshold");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        keep[z] = fabs(vals[z]) >= threshold;
+    }
+    int const result = spt_HiCOOCompact(hitsr, keep, tk, "HiSpTns Threshold");
+    free(keep);
+    spt_CheckError(result, "HiSpTns Threshold", NULL);
+    return 0;
+}
+
+
+/**
+ * Keep the k nonzeros of largest magnitude in each slice of one mode of a
+ * HiCOO sparse tensor, in parallel, ties going to the one stored first,
+ * see sptSparseTensorTopK and sptSparseTensorThresholdHiCOO.
+ * @param hitsr the HiCOO sparse tensor to operate on
+ * @param mode  the mode whose slices are pruned
+ * @param k     the number of nonzeros kept per slice
+ * @param tk    the number of threads, 0 for the default
+ */
+int sptSparseTensorTopKHiCOO(sptSparseTensorHiCOO *hitsr, sptIndex const mode, sptIndex const k, int tk) {
+    if(mode >= hitsr->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "HiSpTns TopK", "mode out of range");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptNnzIndex const nnz = hitsr->nnz;
+    sptNnzIndex const nk = hitsr->kptr.len > 0 ? hitsr->kptr.len - 1 : 0;
+    uint8_t * keep = malloc(nnz > 0 ? nnz : 1);
+    sptIndex * slices = malloc((nnz > 0 ? nnz : 1) * sizeof *slices);
+    spt_CheckOSError(!keep || !slices, "HiSpTns TopK");
+
+    /* The full mode index of every nonzero, from its block and the block size of its kernel */
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex kn = 0; kn < nk; ++kn) {
+        sptElementIndex const kb = spt_HiCOOKernelBits(hitsr, kn);
+        for(sptNnzIndex b = hitsr->kptr.data[kn]; b < hitsr->kptr.data[kn+1]; ++b) {
+            sptIndex const base = (sptIndex) hitsr->binds[mode].data[b] << kb;
+            for(sptNnzIndex z = hitsr->bptr.data[b]; z < hitsr->bptr.data[b+1]; ++z) {
+                slices[z] = base + hitsr->einds[mode].data[z];
+            }
+        }
+    }
+    int result = spt_TopKFlags(keep, hitsr->values.data, slices, nnz, hitsr->ndims[mode], k, tk);
+    free(slices);
+    if(result == 0) {
+        result = spt_HiCOOCompact(hitsr, keep, tk, "HiSpTns TopK");
+    }
+    free(keep);
+    spt_CheckError(result, "HiSpTns TopK", NULL);
+    return 0;
+}
@@ -18,6 +18,7 @@
 
 #include <ParTI.h>
 #include "hicoo.h"
+#include "../sptensor.h"
 
 /**
  * Create a new sparse tensor in HiCOO format
@@ -34,6 +35,30 @@ int sptNewSparseTensorHiCOO(
     const sptElementIndex sb_bits,
     const sptElementIndex sk_bits,
     const sptElementIndex sc_bits)
+{
+    return sptNewSparseTensorHiCOOWithBacking(hitsr, nmodes, ndims, nnz, sb_bits, sk_bits, sc_bits, SPT_MEM_DEFAULT);
+}
+
+/**
+ * Create a new sparse tensor in HiCOO format whose block, element index and
+ * value arrays get the requested backing, e.g. SPT_MEM_HUGE_2MB, as they
+ * grow; see sptMallocBacked. SPT_MEM_DEFAULT takes those of
+ * sptSetDataPlacement for the indices and values.
+ * @param hitsr   a pointer to an uninitialized sparse tensor
+ * @param nmodes  number of modes the tensor will have
+ * @param ndims   the dimension of each mode the tensor will have
+ * @param nnz     number of nonzeros the tensor will have
+ * @param backing the backing to request
+ */
+int sptNewSparseTensorHiCOOWithBacking(
+    sptSparseTensorHiCOO *hitsr, 
+    const sptIndex nmodes, 
+    const sptIndex ndims[],
+    const sptNnzIndex nnz,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    const sptElementIndex sc_bits,
+    sptMemBacking const backing)
 {
     sptIndex i;
     int result;
@@ -69,6 +94,8 @@ int sptNewSparseTensorHiCOO(
 
     result = sptNewNnzIndexVector(&hitsr->kptr, 0, 0);
     spt_CheckError(result, "HiSpTns New", NULL);
+    result = sptNewElementIndexVector(&hitsr->kbits, 0, 0);
+    spt_CheckError(result, "HiSpTns New", NULL);
     result = sptNewNnzIndexVector(&hitsr->cptr, 0, 0);
     spt_CheckError(result, "HiSpTns New", NULL);
 
@@ -89,8 +116,74 @@ int sptNewSparseTensorHiCOO(
     }
     result = sptNewValueVector(&hitsr->values, 0, 0);
     spt_CheckError(result, "HiSpTns New", NULL);
+    if(backing != SPT_MEM_DEFAULT) {
+        spt_RequestVectorBacking(&hitsr->bptr, backing, "HiSpTns New");
+    }
+    result = sptPlaceSparseTensorHiCOO(hitsr, backing);
+    spt_CheckError(result, "HiSpTns New", NULL);
+
+    return 0;
+}
+
+/**
+ * Move the block indices, element indices and values of a HiCOO tensor to
+ * the requested backing, which they keep as they grow, e.g. SPT_MEM_CAPACITY
+ * for tensors streamed once per MTTKRP. SPT_MEM_DEFAULT moves each to the
+ * backing sptSetDataPlacement sets for its class. Arrays already there are
+ * left alone.
+ * @param hitsr   the tensor to move
+ * @param backing the backing to request
+ */
+int sptPlaceSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr, sptMemBacking const backing)
+{
+    sptMemBacking const ind_backing = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_HICOO_INDICES);
+    sptMemBacking const val_backing = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_HICOO_VALUES);
+    for(sptIndex m = 0; m < hitsr->nmodes; ++m) {
+        spt_PlaceVector(&hitsr->binds[m], ind_backing, "HiSpTns Place");
+        spt_PlaceVector(&hitsr->einds[m], ind_backing, "HiSpTns Place");
+    }
+    spt_PlaceVector(&hitsr->values, val_backing, "HiSpTns Place");
+    return 0;
+}
 
 
+/*
+ * Move the element indices of a built HiCOO tensor to high-bandwidth memory,
+ * mode by mode while sptSetHbmPlacement leaves room for streamed data. Those
+ * asked for with another backing stay where they are.
+ */
+int spt_HiCOOPlaceHbm(sptSparseTensorHiCOO *hitsr)
+{
+    for(sptIndex m = 0; m < hitsr->nmodes; ++m) {
+        sptElementIndexVector * einds = &hitsr->einds[m];
+        if(spt_MemRequestOf(einds->data) == SPT_MEM_DEFAULT &&
+            spt_HbmBacking(einds->cap * sizeof *einds->data, 1) == SPT_MEM_HBM) {
+            spt_RequestVectorBacking(einds, SPT_MEM_HBM, "HiSpTns HBM");
+        }
+    }
+    return 0;
+}
+
+
+/* A HiCOO tensor without nonzeros, kernels or blocks, which sptSparseTensorToHiCOO cannot make */
+int spt_NewEmptyHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptIndex const nmodes,
+    sptIndex const ndims[],
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits)
+{
+    int result = sptNewSparseTensorHiCOO(hitsr, nmodes, ndims, 0, sb_bits, sk_bits, 14);
+    spt_CheckError(result, "HiSpTns New", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        hitsr->nkiters[m] = 0;
+    }
+    result = sptAppendNnzIndexVector(&hitsr->kptr, 0);
+    spt_CheckError(result, "HiSpTns New", NULL);
+    result = sptAppendNnzIndexVector(&hitsr->bptr, 0);
+    spt_CheckError(result, "HiSpTns New", NULL);
+    result = sptAppendNnzIndexVector(&hitsr->cptr, 0);
+    spt_CheckError(result, "HiSpTns New", NULL);
     return 0;
 }
 
@@ -116,6 +209,7 @@ void sptFreeSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr)
     free(hitsr->nkiters);
 
     sptFreeNnzIndexVector(&hitsr->kptr);
+    sptFreeElementIndexVector(&hitsr->kbits);
     sptFreeNnzIndexVector(&hitsr->cptr);
 
     sptFreeNnzIndexVector(&hitsr->bptr);
@@ -138,6 +232,54 @@ void sptFreeSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr)
 }
 
 
+/**
+ * Copy a HiCOO sparse tensor
+ * @param[out] dest a pointer to an uninitialized HiCOO sparse tensor
+ * @param[in]  src  a pointer to a valid HiCOO sparse tensor
+ */
+int sptCopySparseTensorHiCOO(sptSparseTensorHiCOO *dest, sptSparseTensorHiCOO const * const src)
+{
+    sptIndex const nmodes = src->nmodes;
+    sptIndex const sk = (sptIndex)pow(2, src->sk_bits);
+    int result = sptNewSparseTensorHiCOO(dest, nmodes, src->ndims, src->nnz, src->sb_bits, src->sk_bits, src->sc_bits);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    memcpy(dest->sortorder, src->sortorder, nmodes * sizeof *dest->sortorder);
+    memcpy(dest->nkiters, src->nkiters, nmodes * sizeof *dest->nkiters);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex kernel_ndim = (src->ndims[m] + sk - 1)/sk;
+        for(sptIndex i = 0; i < kernel_ndim; ++i) {
+            sptFreeIndexVector(&dest->kschr[m][i]);
+            result = sptCopyIndexVector(&dest->kschr[m][i], &src->kschr[m][i], 1);
+            spt_CheckError(result, "HiSpTns Copy", NULL);
+        }
+    }
+    sptFreeNnzIndexVector(&dest->kptr);
+    sptFreeNnzIndexVector(&dest->cptr);
+    sptFreeNnzIndexVector(&dest->bptr);
+    result = sptCopyNnzIndexVector(&dest->kptr, &src->kptr);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    sptFreeElementIndexVector(&dest->kbits);
+    result = sptCopyElementIndexVector(&dest->kbits, &src->kbits);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    result = sptCopyNnzIndexVector(&dest->cptr, &src->cptr);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    result = sptCopyNnzIndexVector(&dest->bptr, &src->bptr);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeBlockIndexVector(&dest->binds[m]);
+        sptFreeElementIndexVector(&dest->einds[m]);
+        result = sptCopyBlockIndexVector(&dest->binds[m], &src->binds[m]);
+        spt_CheckError(result, "HiSpTns Copy", NULL);
+        result = sptCopyElementIndexVector(&dest->einds[m], &src->einds[m]);
+        spt_CheckError(result, "HiSpTns Copy", NULL);
+    }
+    sptFreeValueVector(&dest->values);
+    result = sptCopyValueVector(&dest->values, &src->values, 1);
+    spt_CheckError(result, "HiSpTns Copy", NULL);
+    return 0;
+}
+
+
 /**
  * Compute the Frobenius squared norm of a HiCOO sparse tensor.
  * @param hitsr the HiCOO tensor 
@@ -156,3 +298,31 @@ double sptSparseTensorFrobeniusNormSquaredHiCOO(sptSparseTensorHiCOO const * con
   return norm;
 }
 
+
+
+/**
+ * The sptSparseTensorFingerprint of a HiCOO tensor's nonzeros, the same as
+ * that of the COO tensor it was built from, e.g. to tie a CP-ALS checkpoint
+ * to its input whichever format the run used.
+ * @param hitsr the HiCOO tensor
+ */
+uint64_t sptSparseTensorHiCOOFingerprint(sptSparseTensorHiCOO const * const hitsr)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptNnzIndex const nk = hitsr->kptr.len > 0 ? hitsr->kptr.len - 1 : 0;
+  uint64_t sum = 0;
+  #pragma omp parallel for schedule(dynamic, 1) reduction(+:sum)
+  for(sptNnzIndex kn = 0; kn < nk; ++kn) {
+    sptElementIndex const kb = spt_HiCOOKernelBits(hitsr, kn);
+    sptIndex inds[nmodes];
+    for(sptNnzIndex b = hitsr->kptr.data[kn]; b < hitsr->kptr.data[kn+1]; ++b) {
+      for(sptNnzIndex z = hitsr->bptr.data[b]; z < hitsr->bptr.data[b+1]; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+          inds[m] = ((sptIndex) hitsr->binds[m].data[b] << kb) + hitsr->einds[m].data[z];
+        }
+        sum += spt_FingerprintNonzero(nmodes, inds, &hitsr->values.data[z]);
+      }
+    }
+  }
+  return spt_FingerprintCombine(spt_FingerprintShape(nmodes, hitsr->ndims, hitsr->nnz), sum);
+}
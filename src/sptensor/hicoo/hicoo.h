@@ -26,6 +26,102 @@ extern "C" {
 #include <ParTI.h>
 #include "../../error/error.h"
 
+/* Row-major kernels of Morton-ordered blocks, kptr to nonzeros, see convert.c */
+int spt_PreprocessSparseTensor(
+    sptNnzIndexVector * kptr,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk);
+
+int spt_NewEmptyHiCOO(
+    sptSparseTensorHiCOO *hitsr,
+    sptIndex const nmodes,
+    sptIndex const ndims[],
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits);
+
+/* Block size in bits of kernel k, see sptSparseTensorToHiCOOAdaptive */
+static inline sptElementIndex spt_HiCOOKernelBits(sptSparseTensorHiCOO const * const hitsr, sptNnzIndex const k)
+{
+    return hitsr->kbits.len != 0 ? hitsr->kbits.data[k] : hitsr->sb_bits;
+}
+/* For the kernels that assume one block size throughout */
+#define spt_CheckUniformBlocks(hitsr, module) \
+    if((hitsr)->kbits.len != 0) { \
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "per-kernel block sizes need a MatrixTiling MTTKRP"); \
+    }
+
+/* Streaming builder bins, see build.c */
+typedef struct spt_HiCOOChunk {
+    struct spt_HiCOOChunk * next;
+    sptNnzIndex len;            /// # non-zeros held
+    sptValue * values;          /// chunk_nnz values
+    unsigned char * coords;     /// chunk_nnz * nmodes local coordinates of coord_bytes each
+} spt_HiCOOChunk;
+struct spt_HiCOOBin {
+    uint64_t kernel;            /// row-major kernel number
+    sptNnzIndex nnz;
+    spt_HiCOOChunk * head;
+    spt_HiCOOChunk * tail;
+};
+
+int spt_MTTKRPHiCOOVariant(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptHiCOOMttkrpVariant const variant,
+    sptRankMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptRankMatrix * copy_mats[],    // temporary matrices for reduction
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int nt);
+sptHiCOOMttkrpVariant spt_HiCOODefaultVariant(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const mode);
+
+/* Bytes of a HiCOO tensor, and the peak of sptOmpCpdAlsHiCOO on it with the given variants, see memplan.c */
+size_t spt_SparseTensorHiCOOBytes(sptSparseTensorHiCOO const * const hitsr);
+int spt_EstimateCpdMemoryHiCOOVariants(
+    sptMemoryEstimate * est,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const rank,
+    int const tk,
+    sptHiCOOMttkrpVariant const * variants);
+
+/* Element indices to high-bandwidth memory, see hicoo.c */
+int spt_HiCOOPlaceHbm(sptSparseTensorHiCOO *hitsr);
+
+/* Round-balanced kernel scheduler, see schedule.c */
+int spt_HiCOOSetKernelScheduler(sptSparseTensorHiCOO *hitsr, int const tk);
+
+/* Rank-specialized MatrixTiling MTTKRP, see mttkrp_specialized.c */
+typedef int (*spt_OmpMTTKRPHiCOOKernel)(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptRankMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk);
+spt_OmpMTTKRPHiCOOKernel spt_LookupOmpMTTKRPHiCOOKernel(sptIndex const nmodes, sptIndex const R);
+
+/* Work-stealing queues of weighted tasks, see steal.c */
+typedef struct {
+    sptIndex * tasks;   /// task ids, queue by queue, heaviest first in each
+    sptIndex * begin;   /// nqueues+1 offsets of the queues in tasks
+    sptIndex * next;    /// each queue's next unclaimed position, a cache line apart
+    int nqueues;
+} spt_StealQueues;
+int spt_NewStealQueues(
+    spt_StealQueues * queues,
+    sptNnzIndex const * weights,
+    sptIndex const ntasks,
+    int const nqueues);
+int spt_StealNext(spt_StealQueues * queues, int const self, sptIndex * task);
+void spt_FreeStealQueues(spt_StealQueues * queues);
+int spt_NewHiCOOKernelRowQueues(
+    spt_StealQueues * queues,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const mode,
+    int const nqueues);
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,124 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/**
+ * Bytes held by a HiCOO tensor, its kernel scheduler included
+ */
+size_t spt_SparseTensorHiCOOBytes(sptSparseTensorHiCOO const * const hitsr)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  size_t bytes = hitsr->nnz * ( sizeof(sptValue) + nmodes * sizeof(sptElementIndex) );
+  bytes += hitsr->binds[0].len * nmodes * sizeof(sptBlockIndex);
+  bytes += hitsr->bptr.len * sizeof(sptNnzIndex);
+  bytes += hitsr->kptr.len * sizeof(sptNnzIndex);
+  bytes += hitsr->kbits.len * sizeof(sptElementIndex);
+  bytes += hitsr->cptr.len * sizeof(sptNnzIndex);
+  /* add kschr */
+  sptIndex const sk = (sptIndex)1 << hitsr->sk_bits;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptIndex kernel_ndim = (hitsr->ndims[m] + sk - 1)/sk;
+    for(sptIndex i=0; i < kernel_ndim; ++i) {
+      bytes += hitsr->kschr[m][i].len * sizeof(sptIndex);
+    }
+    bytes += kernel_ndim * sizeof(sptIndexVector *);
+  }
+  bytes += nmodes * sizeof(sptIndexVector **);
+  /* add nkiters  */
+  bytes += nmodes * sizeof(sptIndex);
+  return bytes;
+}
+
+
+/**
+ * Predict the peak bytes of OpenMP HiCOO CP-ALS running the given MTTKRP
+ * variants: every mode run with SPT_HICOO_MTTKRP_SCHEDULED_REDUCE holds tk
+ * copies of its output for the whole run.
+ */
+int spt_EstimateCpdMemoryHiCOOVariants(
+    sptMemoryEstimate * est,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const rank,
+    int const tk,
+    sptHiCOOMttkrpVariant const * variants)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  if(tk < 1) {
+    spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns MemPlan", "tk < 1");
+  }
+  sptIndex const max_dim = sptMaxIndexArray(hitsr->ndims, nmodes);
+  size_t factor_bytes = 0;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    factor_bytes += spt_MatrixBytes(hitsr->ndims[m], rank);
+  }
+
+  est->tensor = spt_SparseTensorHiCOOBytes(hitsr);
+  est->factors = factor_bytes + rank * sizeof(sptValue) + spt_MatrixBytes(max_dim, rank) +
+    (nmodes + 1) * spt_MatrixBytes(rank, rank);
+  /* A scratch row per thread in the MatrixTiling kernels */
+  est->scratch = (size_t)tk * spt_MatrixBytes(1, rank);
+  if(spt_CpdLineSearchEnabled()) {
+    est->scratch += 2 * factor_bytes + rank * sizeof(sptValue);
+  }
+  est->privatized = 0;
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(variants[m] == SPT_HICOO_MTTKRP_SCHEDULED_REDUCE) {
+      est->privatized += (size_t)tk * spt_MatrixBytes(hitsr->ndims[m], rank);
+    }
+  }
+  est->peak = est->tensor + est->factors + est->scratch + est->privatized;
+  return 0;
+}
+
+
+/**
+ * Predict the peak bytes of sptOmpCpdAlsHiCOO, including the tensor itself
+ * and the mode-specific copies the sptSetCpdLayoutBudget setting allows
+ * @param[out] est    the estimate, by component and in total
+ * @param[in]  hitsr  the HiCOO tensor to decompose
+ * @param[in]  rank   the CPD rank
+ * @param[in]  tk     the number of threads
+ */
+int sptEstimateCpdMemoryHiCOO(
+    sptMemoryEstimate * est,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const rank,
+    int const tk)
+{
+  sptIndex const nmodes = hitsr->nmodes;
+  sptHiCOOMttkrpVariant * variants = malloc(nmodes * sizeof *variants);
+  spt_CheckOSError(!variants, "HiSpTns MemPlan");
+  int * routed = malloc(nmodes * sizeof *routed);
+  spt_CheckOSError(!routed, "HiSpTns MemPlan");
+  size_t const layout_bytes = spt_PlanCpdLayouts(routed, nmodes, hitsr->ndims, hitsr->nnz, 1, rank, tk, spt_CpdLayoutBudget());
+  /* A mode reading its copy privatizes nothing */
+  for(sptIndex m=0; m < nmodes; ++m) {
+    variants[m] = routed[m] ? SPT_HICOO_MTTKRP_SCHEDULED : spt_HiCOODefaultVariant(hitsr, m);
+  }
+  free(routed);
+  int result = spt_EstimateCpdMemoryHiCOOVariants(est, hitsr, rank, tk, variants);
+  free(variants);
+  spt_CheckError(result, "HiSpTns MemPlan", NULL);
+  est->tensor += layout_bytes;
+  est->peak += layout_bytes;
+  return 0;
+}
@@ -18,6 +18,7 @@
 
 #include <ParTI.h>
 #include "hicoo.h"
+#include "../../matrix/simd.h"
 
 /*************************************************
  * PRIVATE FUNCTIONS
@@ -56,8 +57,10 @@ int sptMTTKRPHiCOO(
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
+    spt_CheckUniformBlocks(hitsr, "CPU  HiCOO SpTns MTTKRP");
     if(nmodes == 3) {
         sptAssert(spt_MTTKRPHiCOO_3D(hitsr, mats, mats_order, mode) == 0);
         return 0;
@@ -113,17 +116,13 @@ int sptMTTKRPHiCOO(
                 sptMatrix * times_mat = mats[times_mat_index];
                 sptIndex tmp_i = ele_coord[times_mat_index];
                 sptValue const entry = vals[z];
-                for(sptIndex r=0; r<R; ++r) {
-                    scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-                }
+                simd->scale(scratch.data, entry, times_mat->values + tmp_i * stride, R);
                 /* Multiply the rest matrices */
                 for(sptIndex m=2; m<nmodes; ++m) {
                     times_mat_index = mats_order[m];
                     times_mat = mats[times_mat_index];
                     tmp_i = ele_coord[times_mat_index];
-                    for(sptIndex r=0; r<R; ++r) {
-                        scratch.data[r] *= times_mat->values[tmp_i * stride + r];
-                    }
+                    simd->mul(scratch.data, times_mat->values + tmp_i * stride, R);
                 }
 
                 sptIndex const mode_i = ele_coord[mode];
@@ -161,9 +160,10 @@ int sptMTTKRPHiCOO_MatrixTiling(
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
-    if(nmodes == 3) {
+    if(nmodes == 3 && hitsr->kbits.len == 0) {
         sptAssert(spt_MTTKRPHiCOO_3D_MatrixTiling(hitsr, mats, mats_order, mode) == 0);
         return 0;
     } 
@@ -196,13 +196,14 @@ int sptMTTKRPHiCOO_MatrixTiling(
     for(sptIndex k=0; k<hitsr->kptr.len - 1; ++k) {
         sptNnzIndex kptr_begin = hitsr->kptr.data[k];
         sptNnzIndex kptr_end = hitsr->kptr.data[k+1];
+        sptElementIndex const sb = spt_HiCOOKernelBits(hitsr, k);
 
         /* Loop blocks in a kernel */
         for(sptIndex b=kptr_begin; b<kptr_end; ++b) {
             /* Block indices */
             for(sptIndex m=0; m<nmodes; ++m)
-                blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << hitsr->sb_bits) * stride;
-            sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+                blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << sb) * stride;
+            sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << sb) * stride;
 
             sptNnzIndex bptr_begin = hitsr->bptr.data[b];
             sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
@@ -213,18 +214,12 @@ int sptMTTKRPHiCOO_MatrixTiling(
                 sptIndex times_mat_index = mats_order[1];
                 sptElementIndex tmp_i = hitsr->einds[times_mat_index].data[z];
                 sptValue const entry = vals[z];
-                #pragma omp simd
-                for(sptElementIndex r=0; r<R; ++r) {
-                    scratch.data[r] = entry * blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                }
+                simd->scale(scratch.data, entry, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                 /* Multiply the rest matrices */
                 for(sptIndex m=2; m<nmodes; ++m) {
                     times_mat_index = mats_order[m];
                     tmp_i = hitsr->einds[times_mat_index].data[z];
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        scratch.data[r] *= blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                    }
+                    simd->mul(scratch.data, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                 }
 
                 sptElementIndex const mode_i = hitsr->einds[mode].data[z];
@@ -0,0 +1,256 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "hicoo.h"
+#include "../../cudawrap.h"
+
+/* Static shared memory budget of one thread block, in bytes. */
+#define SPT_HICOO_CUDA_SMEM_BYTES (48 * 1024)
+/* Nonzeros staged in shared memory per round. */
+#define SPT_HICOO_CUDA_CHUNK 256
+
+
+/* One thread block per HiCOO block, lanes (threadIdx.x) over a panel of pw
+ * rank columns, threadIdx.y over nonzeros. For every mode the block spans
+ * only 2^sb_bits rows, so the block-local factor rows and the output rows
+ * of a panel fit in shared memory as tiles addressed directly by the 8-bit
+ * element indices; the output tile is flushed with one global atomic per
+ * touched entry. Blocks with fewer nonzeros than 2^sb_bits skip the tiles,
+ * since staging them costs more than the loads they save.
+ * Shared layout: tiles[nmodes][2^sb_bits][pw], vals[chunk], einds[nmodes][chunk]. */
+__global__ static void spt_MTTKRPHiCOOKernelBlockTiled(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nblocks,
+    const sptIndex R,
+    const sptIndex stride,
+    const sptElementIndex sb_bits,
+    const sptIndex pw,
+    const sptIndex chunk,
+    const sptIndex * dev_ndims,
+    const sptNnzIndex * bptr,
+    sptBlockIndex ** const binds,
+    sptElementIndex ** const einds,
+    const sptValue * vals,
+    sptValue ** dev_mats)
+{
+    extern __shared__ sptValue smem[];
+    const sptIndex tile_rows = (sptIndex)1 << sb_bits;
+    const sptIndex tile_size = tile_rows * pw;
+    sptValue * const tiles = smem;
+    sptValue * const chunk_vals = tiles + nmodes * tile_size;
+    sptElementIndex * const chunk_einds = (sptElementIndex *)(chunk_vals + chunk);
+    const sptIndex nthreads = blockDim.x * blockDim.y;
+    const sptIndex tid = threadIdx.y * blockDim.x + threadIdx.x;
+    const sptIndex c = threadIdx.x;
+    sptValue * const mvals = dev_mats[nmodes];
+
+    for(sptNnzIndex b = blockIdx.x; b < nblocks; b += gridDim.x) {
+        const sptNnzIndex bptr_begin = bptr[b];
+        const sptNnzIndex bptr_end = bptr[b+1];
+        const bool staged = bptr_end - bptr_begin >= tile_rows;
+
+        for(sptIndex r0 = 0; r0 < R; r0 += pw) {
+            const sptIndex ncols = R - r0 < pw ? R - r0 : pw;
+
+            if(staged) {
+                /* Stage the block-local factor rows, zero the output tile. */
+                for(sptIndex t = tid; t < nmodes * tile_size; t += nthreads) {
+                    const sptIndex m = t / tile_size;
+                    const sptIndex row = (t / pw) % tile_rows;
+                    const sptIndex col = t % pw;
+                    const sptIndex i = ((sptIndex)binds[m][b] << sb_bits) + row;
+                    sptValue v = 0;
+                    if(m != mode && col < ncols && i < dev_ndims[m]) {
+                        v = dev_mats[m][i * stride + r0 + col];
+                    }
+                    tiles[t] = v;
+                }
+            }
+            __syncthreads();
+
+            for(sptNnzIndex z0 = bptr_begin; z0 < bptr_end; z0 += chunk) {
+                const sptIndex len = bptr_end - z0 < chunk ? (sptIndex)(bptr_end - z0) : chunk;
+                for(sptIndex t = tid; t < len; t += nthreads) {
+                    chunk_vals[t] = vals[z0 + t];
+                    for(sptIndex m = 0; m < nmodes; ++m) {
+                        chunk_einds[m * chunk + t] = einds[m][z0 + t];
+                    }
+                }
+                __syncthreads();
+
+                if(c < ncols) {
+                    for(sptIndex t = threadIdx.y; t < len; t += blockDim.y) {
+                        sptValue v = chunk_vals[t];
+                        if(staged) {
+                            for(sptIndex m = 0; m < nmodes; ++m) {
+                                if(m != mode) {
+                                    v *= tiles[(m * tile_rows + chunk_einds[m * chunk + t]) * pw + c];
+                                }
+                            }
+                            atomicAdd(&(tiles[(mode * tile_rows + chunk_einds[mode * chunk + t]) * pw + c]), v);
+                        } else {
+                            for(sptIndex m = 0; m < nmodes; ++m) {
+                                if(m != mode) {
+                                    const sptIndex i = ((sptIndex)binds[m][b] << sb_bits) + chunk_einds[m * chunk + t];
+                                    v *= dev_mats[m][i * stride + r0 + c];
+                                }
+                            }
+                            const sptIndex i = ((sptIndex)binds[mode][b] << sb_bits) + chunk_einds[mode * chunk + t];
+                            atomicAdd(&(mvals[i * stride + r0 + c]), v);
+                        }
+                    }
+                }
+                __syncthreads();
+            }
+
+            if(staged) {
+                /* Flush the output tile; untouched rows stay zero and are skipped. */
+                const sptIndex base = (sptIndex)binds[mode][b] << sb_bits;
+                for(sptIndex t = tid; t < tile_size; t += nthreads) {
+                    const sptValue v = tiles[mode * tile_size + t];
+                    if(v != 0) {
+                        atomicAdd(&(mvals[(base + t / pw) * stride + r0 + t % pw]), v);
+                    }
+                }
+                __syncthreads();
+            }
+        }
+    }
+}
+
+
+/**
+ * CUDA Matriced sparse tensor in HiCOO format times a sequence of dense matrix Khatri-Rao products (MTTKRP) on a specified mode
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size * ndims[mode] * R
+ * @param[in]  hitsr    the HiCOO sparse tensor input
+ * @param[in]  mats    (nmodes+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ *
+ * Each HiCOO block is mapped to a thread block which keeps the block's
+ * element indices and its factor and output row tiles in shared memory.
+ * The rank is processed in panels narrow enough for nmodes tiles of
+ * 2^sb_bits rows to fit in SPT_HICOO_CUDA_SMEM_BYTES.
+ */
+int sptCudaMTTKRPHiCOO(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode)
+{
+    sptIndex const nmodes = hitsr->nmodes;
+    sptNnzIndex const nnz = hitsr->nnz;
+    sptIndex const * const ndims = hitsr->ndims;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    sptNnzIndex const nblocks = hitsr->bptr.len - 1;
+    sptIndex const tile_rows = (sptIndex)1 << hitsr->sb_bits;
+    int result;
+    (void) mats_order;  // The product over the other modes does not depend on their order.
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA HiCOO SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA HiCOO SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    /* Widest rank panel (at most a warp) whose tiles fit in shared memory. */
+    sptIndex const chunk = SPT_HICOO_CUDA_CHUNK;
+    size_t const chunk_bytes = chunk * (sizeof (sptValue) + nmodes * sizeof (sptElementIndex));
+    sptIndex pw = R < 32 ? R : 32;
+    while(pw > 1 && nmodes * tile_rows * pw * sizeof (sptValue) + chunk_bytes > SPT_HICOO_CUDA_SMEM_BYTES) {
+        pw /= 2;
+    }
+    size_t const smem_bytes = nmodes * tile_rows * pw * sizeof (sptValue) + chunk_bytes;
+    if(smem_bytes > SPT_HICOO_CUDA_SMEM_BYTES) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA HiCOO SpTns MTTKRP", "HiCOO blocks too large for shared memory, reduce sb_bits");
+    }
+
+    /* Transfer tensor and matrices */
+    sptIndex * dev_ndims;
+    result = sptCudaDuplicateMemory(&dev_ndims, ndims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    sptNnzIndex * dev_bptr;
+    result = sptCudaDuplicateMemory(&dev_bptr, hitsr->bptr.data, (nblocks + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    sptValue * dev_vals;
+    result = sptCudaDuplicateMemory(&dev_vals, hitsr->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+
+    sptBlockIndex ** binds_header = new sptBlockIndex *[nmodes];
+    sptElementIndex ** einds_header = new sptElementIndex *[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        binds_header[m] = hitsr->binds[m].data;
+        einds_header[m] = hitsr->einds[m].data;
+    }
+    sptBlockIndex ** dev_binds;
+    result = sptCudaDuplicateMemoryIndirect(&dev_binds, binds_header, nmodes, nblocks, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    sptElementIndex ** dev_einds;
+    result = sptCudaDuplicateMemoryIndirect(&dev_einds, einds_header, nmodes, nnz, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+
+    sptValue ** mats_header = new sptValue *[nmodes+1];
+    sptNnzIndex * const lengths = new sptNnzIndex[nmodes+1];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats_header[m] = mats[m]->values;
+        lengths[m] = mats[m]->nrows * stride;
+    }
+    mats_header[nmodes] = mats[nmodes]->values;
+    lengths[nmodes] = mats[mode]->nrows * stride;
+    sptValue ** dev_mats;
+    result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    sptValue * dev_part_prod;
+    result = cudaMemcpy(&dev_part_prod, dev_mats + nmodes, sizeof dev_part_prod, cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    result = cudaMemset(dev_part_prod, 0, lengths[nmodes] * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+
+    dim3 const nthreads(pw, 256 / pw);
+    sptNnzIndex const nthread_blocks = nblocks < 32768 ? nblocks : 32768;
+    if(nthread_blocks > 0) {
+        spt_MTTKRPHiCOOKernelBlockTiled<<<nthread_blocks, nthreads, smem_bytes>>>(
+            mode, nmodes, nblocks, R, stride, hitsr->sb_bits, pw, chunk,
+            dev_ndims, dev_bptr, dev_binds, dev_einds, dev_vals, dev_mats);
+        result = cudaThreadSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+    }
+
+    result = cudaMemcpy(mats[nmodes]->values, dev_part_prod, lengths[nmodes] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA HiCOO SpTns MTTKRP");
+
+    spt_CudaPoolFree(dev_ndims);
+    spt_CudaPoolFree(dev_bptr);
+    spt_CudaPoolFree(dev_vals);
+    spt_CudaPoolFree(dev_binds);
+    spt_CudaPoolFree(dev_einds);
+    spt_CudaPoolFree(dev_mats);
+    delete[] binds_header;
+    delete[] einds_header;
+    delete[] mats_header;
+    delete[] lengths;
+
+    return 0;
+}
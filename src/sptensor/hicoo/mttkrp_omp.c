@@ -18,6 +18,8 @@
 
 #include <ParTI.h>
 #include "hicoo.h"
+#include "../sptensor.h"
+#include "../../matrix/simd.h"
 
 #define CHUNKSIZE 1
 
@@ -78,6 +80,7 @@ int sptOmpMTTKRPHiCOO(
     sptIndex const mode,
     const int nt)
 {
+    spt_CheckUniformBlocks(hitsr, "OMP  HiCOO SpTns MTTKRP");
     sptAssert(spt_OmpMTTKRPHiCOOKernels(hitsr, mats, mats_order, mode, nt) == 0);
     return 0;
 }
@@ -108,7 +111,7 @@ int sptOmpMTTKRPHiCOO_MatrixTiling(
 
 
 /**
- * OpenMP parallel Matriced sparse tensor in HiCOO format times a sequence of dense matrix Khatri-Rao products (MTTKRP) on a specified mode. The tensor rank and columns of dense matrices are stored in less bits, in sptElementIndex type. We independently parallelize it by rows of the superblock scheduler.
+ * OpenMP parallel Matriced sparse tensor in HiCOO format times a sequence of dense matrix Khatri-Rao products (MTTKRP) on a specified mode. The tensor rank and columns of dense matrices are stored in less bits, in sptElementIndex type. We independently parallelize it by rows of the superblock scheduler, each row a task weighted by its nonzeros on work-stealing queues, so no barrier separates its kernels.
  * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size * ndims[mode] * R
  * @param[in]  hitsr    the HiCOO sparse tensor input
  * @param[in]  mats    (N+1) dense matrices, with mats[nmodes] as temporary
@@ -238,6 +241,7 @@ int spt_OmpMTTKRPHiCOOKernels(
     sptIndex const mode,
     const int tk) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
     if(nmodes == 3) {
@@ -299,17 +303,13 @@ int spt_OmpMTTKRPHiCOOKernels(
                 sptMatrix * times_mat = mats[times_mat_index];
                 sptIndex tmp_i = ele_coord[times_mat_index];
                 sptValue const entry = vals[z];
-                for(sptIndex r=0; r<R; ++r) {
-                    scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-                }
+                simd->scale(scratch.data, entry, times_mat->values + tmp_i * stride, R);
                 /* Multiply the rest matrices */
                 for(sptIndex m=2; m<nmodes; ++m) {
                     times_mat_index = mats_order[m];
                     times_mat = mats[times_mat_index];
                     tmp_i = ele_coord[times_mat_index];
-                    for(sptIndex r=0; r<R; ++r) {
-                        scratch.data[r] *= times_mat->values[tmp_i * stride + r];
-                    }
+                    simd->mul(scratch.data, times_mat->values + tmp_i * stride, R);
                 }
 
                 sptIndex const mode_i = ele_coord[mode];
@@ -416,9 +416,16 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling(
     sptIndex const mode,
     const int tk) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
-    if(nmodes == 3) {
+    /* The specialized and 3-D kernels assume one block size */
+    int const uniform = hitsr->kbits.len == 0;
+    spt_OmpMTTKRPHiCOOKernel const kernel = spt_LookupOmpMTTKRPHiCOOKernel(nmodes, mats[mode]->ncols);
+    if(kernel != NULL && uniform) {
+        return kernel(hitsr, mats, mats_order, mode, tk);
+    }
+    if(nmodes == 3 && uniform) {
         sptAssert(spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling(hitsr, mats, mats_order, mode, tk) == 0);
         return 0;
     }
@@ -442,6 +449,7 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling(
     sptRankMatrix * const restrict M = mats[nmodes];
     sptValue * const restrict mvals = M->values;
     memset(mvals, 0, tmpI*stride*sizeof(*mvals));
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
 
     /* Loop kernels */
     #pragma omp parallel for schedule(dynamic, CHUNKSIZE) num_threads(tk)
@@ -453,35 +461,35 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling(
 
         sptNnzIndex kptr_begin = hitsr->kptr.data[k];
         sptNnzIndex kptr_end = hitsr->kptr.data[k+1];        
+        sptElementIndex const sb = spt_HiCOOKernelBits(hitsr, k);
 
         /* Loop blocks in a kernel */
         for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
             /* Blocked matrices */
             for(sptIndex m=0; m<nmodes; ++m)
-                blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << hitsr->sb_bits) * stride;
-            sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+                blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << sb) * stride;
+            sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << sb) * stride;
 
             sptNnzIndex bptr_begin = hitsr->bptr.data[b];
             sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
             /* Loop entries in a block */
             for(sptIndex z=bptr_begin; z<bptr_end; ++z) {
+                if(pd != 0 && z + pd < bptr_end) {
+                    for(sptIndex m=1; m<nmodes; ++m) {
+                        spt_PrefetchRow(blocked_times_mat[mats_order[m]] + (sptBlockMatrixIndex)hitsr->einds[mats_order[m]].data[z + pd] * stride, R);
+                    }
+                }
 
                 /* Multiply the 1st matrix */
                 sptIndex times_mat_index = mats_order[1];
                 sptElementIndex tmp_i = hitsr->einds[times_mat_index].data[z];
                 sptValue const entry = vals[z];
-                #pragma omp simd
-                for(sptElementIndex r=0; r<R; ++r) {
-                    scratch.data[r] = entry * blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                }
+                simd->scale(scratch.data, entry, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                 /* Multiply the rest matrices */
                 for(sptIndex m=2; m<nmodes; ++m) {
                     times_mat_index = mats_order[m];
                     tmp_i = hitsr->einds[times_mat_index].data[z];
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        scratch.data[r] *= blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                    }
+                    simd->mul(scratch.data, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                 }
 
                 sptElementIndex const mode_i = hitsr->einds[mode].data[z];
@@ -537,53 +545,59 @@ int spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling_Scheduled(
     sptIndex times_mat_index_2 = mats_order[2];
     sptRankMatrix * restrict times_mat_2 = mats[times_mat_index_2];
 
-    sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
-    sptIndex num_kernel_dim = (ndims[mode] + sk - 1) / sk;
     sptIndexVector * restrict kschr_mode = hitsr->kschr[mode];
+    spt_StealQueues queues;
+    sptAssert(spt_NewHiCOOKernelRowQueues(&queues, hitsr, mode, tk) == 0);
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int self = 0;
+#ifdef PARTI_USE_OPENMP
+        self = omp_get_thread_num();
+#endif
+        /* Each thread's share of the rows, to show the balance the stealing reached */
+        double const trace = sptTraceBegin();
+        sptIndex k;
+        /* Loop kernel rows: a row owns its output rows, so its kernels need no barrier in between */
+        while(spt_StealNext(&queues, self, &k)) {
+            /* Loop kernels of the row */
+            for(sptIndex i=0; i<kschr_mode[k].len; ++i) {
+                sptIndex kptr_loc = kschr_mode[k].data[i];
+                sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
+                sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
+
+                /* Loop blocks in a kernel */
+                for(sptIndex b=kptr_begin; b<kptr_end; ++b) {
+
+                    sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+                    sptValue * blocked_times_mat_1 = times_mat_1->values + (hitsr->binds[times_mat_index_1].data[b] << hitsr->sb_bits) * stride;
+                    sptValue * blocked_times_mat_2 = times_mat_2->values + (hitsr->binds[times_mat_index_2].data[b] << hitsr->sb_bits) * stride;
+
+                    sptNnzIndex bptr_begin = hitsr->bptr.data[b];
+                    sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
+                    /* Loop entries in a block */
+                    for(sptIndex z=bptr_begin; z<bptr_end; ++z) {
+                        
+                        sptElementIndex mode_i = hitsr->einds[mode].data[z];
+                        sptElementIndex tmp_i_1 = hitsr->einds[times_mat_index_1].data[z];
+                        sptElementIndex tmp_i_2 = hitsr->einds[times_mat_index_2].data[z];
+                        sptValue entry = vals[z];
 
+                        #pragma omp simd
+                        for(sptElementIndex r=0; r<R; ++r) {
+                            blocked_mvals[(sptBlockMatrixIndex)mode_i * stride + r] += entry * 
+                                blocked_times_mat_1[(sptBlockMatrixIndex)tmp_i_1 * stride + r] * 
+                                blocked_times_mat_2[(sptBlockMatrixIndex)tmp_i_2 * stride + r];
+                        }
+                        
+                    }   // End loop entries
+                }   // End loop blocks
 
-    /* Loop parallel iterations */
-    for(sptIndex i=0; i<hitsr->nkiters[mode]; ++i) {
-        /* Loop kernels */
-        #pragma omp parallel for schedule(dynamic, CHUNKSIZE) num_threads(tk)
-        for(sptIndex k=0; k<num_kernel_dim; ++k) {
-            if(i >= kschr_mode[k].len) {
-                // printf("i: %u, k: %u\n", i, k);
-                continue;
-            }
-            sptIndex kptr_loc = kschr_mode[k].data[i];
-            sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
-            sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
-
-            /* Loop blocks in a kernel */
-            for(sptIndex b=kptr_begin; b<kptr_end; ++b) {
-
-                sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
-                sptValue * blocked_times_mat_1 = times_mat_1->values + (hitsr->binds[times_mat_index_1].data[b] << hitsr->sb_bits) * stride;
-                sptValue * blocked_times_mat_2 = times_mat_2->values + (hitsr->binds[times_mat_index_2].data[b] << hitsr->sb_bits) * stride;
-
-                sptNnzIndex bptr_begin = hitsr->bptr.data[b];
-                sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
-                /* Loop entries in a block */
-                for(sptIndex z=bptr_begin; z<bptr_end; ++z) {
-                    
-                    sptElementIndex mode_i = hitsr->einds[mode].data[z];
-                    sptElementIndex tmp_i_1 = hitsr->einds[times_mat_index_1].data[z];
-                    sptElementIndex tmp_i_2 = hitsr->einds[times_mat_index_2].data[z];
-                    sptValue entry = vals[z];
-
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        blocked_mvals[(sptBlockMatrixIndex)mode_i * stride + r] += entry * 
-                            blocked_times_mat_1[(sptBlockMatrixIndex)tmp_i_1 * stride + r] * 
-                            blocked_times_mat_2[(sptBlockMatrixIndex)tmp_i_2 * stride + r];
-                    }
-                    
-                }   // End loop entries
-            }   // End loop blocks
-
-        }   // End loop kernels
-    }   // End loop iterations
+            }   // End loop kernels
+        }   // End loop kernel rows
+        sptTraceEnd("HiCOO MTTKRP worker", mode, trace);
+    }
+    spt_FreeStealQueues(&queues);
 
     return 0;
 }
@@ -596,9 +610,10 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled(
     sptIndex const mode,
     const int tk) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
-    if(nmodes == 3) {
+    if(nmodes == 3 && hitsr->kbits.len == 0) {
         sptAssert(spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling_Scheduled(hitsr, mats, mats_order, mode, tk) == 0);
         return 0;
     }
@@ -622,70 +637,79 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled(
     sptRankMatrix * const restrict M = mats[nmodes];
     sptValue * const restrict mvals = M->values;
     memset(mvals, 0, tmpI*stride*sizeof(*mvals));
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
 
-    sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
-    sptIndex num_kernel_dim = (ndims[mode] + sk - 1) / sk;
     sptIndexVector * restrict kschr_mode = hitsr->kschr[mode];
+    spt_StealQueues queues;
+    sptAssert(spt_NewHiCOOKernelRowQueues(&queues, hitsr, mode, tk) == 0);
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int self = 0;
+#ifdef PARTI_USE_OPENMP
+        self = omp_get_thread_num();
+#endif
+        double const trace = sptTraceBegin();
+        /* Allocate thread-private data */
+        sptValue ** blocked_times_mat = (sptValue**)malloc(nmodes * sizeof(*blocked_times_mat));
+        sptValueVector scratch; // Temporary array
+        sptNewValueVector(&scratch, R, R);
 
-    /* Loop parallel iterations */
-    for(sptIndex i=0; i<hitsr->nkiters[mode]; ++i) {
-        /* Loop kernels */
-        #pragma omp parallel for schedule(dynamic, CHUNKSIZE) num_threads(tk)
-        for(sptIndex k=0; k<num_kernel_dim; ++k) {
-
-            if(i >= kschr_mode[k].len) continue;
-            sptIndex kptr_loc = kschr_mode[k].data[i];
-            sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
-            sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
-
-            /* Allocate thread-private data */
-            sptValue ** blocked_times_mat = (sptValue**)malloc(nmodes * sizeof(*blocked_times_mat));
-            sptValueVector scratch; // Temporary array
-            sptNewValueVector(&scratch, R, R);       
-
-            /* Loop blocks in a kernel */
-            for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
-                /* Blocked matrices */
-                for(sptIndex m=0; m<nmodes; ++m)
-                    blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << hitsr->sb_bits) * stride;
-                sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+        sptIndex k;
+        /* Loop kernel rows: a row owns its output rows, so its kernels need no barrier in between */
+        while(spt_StealNext(&queues, self, &k)) {
+            /* Loop kernels of the row */
+            for(sptIndex i=0; i<kschr_mode[k].len; ++i) {
+                sptIndex kptr_loc = kschr_mode[k].data[i];
+                sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
+                sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
+                sptElementIndex const sb = spt_HiCOOKernelBits(hitsr, kptr_loc);
+
+                /* Loop blocks in a kernel */
+                for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
+                    /* Blocked matrices */
+                    for(sptIndex m=0; m<nmodes; ++m)
+                        blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << sb) * stride;
+                    sptValue * blocked_mvals = mvals + (hitsr->binds[mode].data[b] << sb) * stride;
+
+                    sptNnzIndex bptr_begin = hitsr->bptr.data[b];
+                    sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
+                    /* Loop entries in a block */
+                    for(sptIndex z=bptr_begin; z<bptr_end; ++z) {
+                        if(pd != 0 && z + pd < bptr_end) {
+                            for(sptIndex m=1; m<nmodes; ++m) {
+                                spt_PrefetchRow(blocked_times_mat[mats_order[m]] + (sptBlockMatrixIndex)hitsr->einds[mats_order[m]].data[z + pd] * stride, R);
+                            }
+                        }
 
-                sptNnzIndex bptr_begin = hitsr->bptr.data[b];
-                sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
-                /* Loop entries in a block */
-                for(sptIndex z=bptr_begin; z<bptr_end; ++z) {
+                        /* Multiply the 1st matrix */
+                        sptIndex times_mat_index = mats_order[1];
+                        sptElementIndex tmp_i = hitsr->einds[times_mat_index].data[z];
+                        sptValue const entry = vals[z];
+                        simd->scale(scratch.data, entry, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
+                        /* Multiply the rest matrices */
+                        for(sptIndex m=2; m<nmodes; ++m) {
+                            times_mat_index = mats_order[m];
+                            tmp_i = hitsr->einds[times_mat_index].data[z];
+                            simd->mul(scratch.data, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
+                        }
 
-                    /* Multiply the 1st matrix */
-                    sptIndex times_mat_index = mats_order[1];
-                    sptElementIndex tmp_i = hitsr->einds[times_mat_index].data[z];
-                    sptValue const entry = vals[z];
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        scratch.data[r] = entry * blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                    }
-                    /* Multiply the rest matrices */
-                    for(sptIndex m=2; m<nmodes; ++m) {
-                        times_mat_index = mats_order[m];
-                        tmp_i = hitsr->einds[times_mat_index].data[z];
+                        sptElementIndex const mode_i = hitsr->einds[mode].data[z];
                         #pragma omp simd
                         for(sptElementIndex r=0; r<R; ++r) {
-                            scratch.data[r] *= blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
+                            blocked_mvals[(sptBlockMatrixIndex)mode_i * stride + r] += scratch.data[r];
                         }
-                    }
-
-                    sptElementIndex const mode_i = hitsr->einds[mode].data[z];
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        blocked_mvals[(sptBlockMatrixIndex)mode_i * stride + r] += scratch.data[r];
-                    }
-                }   // End loop entries
-            }   // End loop blocks
+                    }   // End loop entries
+                }   // End loop blocks
+            }   // End loop kernels
+        }   // End loop kernel rows
 
-            /* Free thread-private space */
-            free(blocked_times_mat);
-            sptFreeValueVector(&scratch);
-        }   // End loop kernels
-    }   // End loop iterations
+        /* Free thread-private space */
+        free(blocked_times_mat);
+        sptFreeValueVector(&scratch);
+        sptTraceEnd("HiCOO MTTKRP worker", mode, trace);
+    }
+    spt_FreeStealQueues(&queues);
 
     return 0;
 }
@@ -805,9 +829,10 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled_Reduce(
     sptIndex const mode,
     const int tk) 
 {
+    spt_SimdKernels const * const simd = spt_Simd();
     sptIndex const nmodes = hitsr->nmodes;
 
-    if(nmodes == 3) {
+    if(nmodes == 3 && hitsr->kbits.len == 0) {
         sptAssert(spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling_Scheduled_Reduce(hitsr, mats, copy_mats, mats_order, mode, tk) == 0);
         return 0;
     }
@@ -851,6 +876,7 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled_Reduce(
             sptIndex kptr_loc = kschr_mode[k].data[i];
             sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
             sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
+            sptElementIndex const sb = spt_HiCOOKernelBits(hitsr, kptr_loc);
 
             /* Allocate thread-private data */
             sptValue ** blocked_times_mat = (sptValue**)malloc(nmodes * sizeof(*blocked_times_mat));
@@ -861,8 +887,8 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled_Reduce(
             for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
                 /* Blocked matrices */
                 for(sptIndex m=0; m<nmodes; ++m)
-                    blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << hitsr->sb_bits) * stride;
-                sptValue * blocked_mvals = copy_mats[tid]->values + (hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+                    blocked_times_mat[m] = mats[m]->values + (hitsr->binds[m].data[b] << sb) * stride;
+                sptValue * blocked_mvals = copy_mats[tid]->values + (hitsr->binds[mode].data[b] << sb) * stride;
 
                 sptNnzIndex bptr_begin = hitsr->bptr.data[b];
                 sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
@@ -873,18 +899,12 @@ int spt_OmpMTTKRPHiCOOKernels_MatrixTiling_Scheduled_Reduce(
                     sptIndex times_mat_index = mats_order[1];
                     sptElementIndex tmp_i = hitsr->einds[times_mat_index].data[z];
                     sptValue const entry = vals[z];
-                    #pragma omp simd
-                    for(sptElementIndex r=0; r<R; ++r) {
-                        scratch.data[r] = entry * blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                    }
+                    simd->scale(scratch.data, entry, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                     /* Multiply the rest matrices */
                     for(sptIndex m=2; m<nmodes; ++m) {
                         times_mat_index = mats_order[m];
                         tmp_i = hitsr->einds[times_mat_index].data[z];
-                        #pragma omp simd
-                        for(sptElementIndex r=0; r<R; ++r) {
-                            scratch.data[r] *= blocked_times_mat[times_mat_index][(sptBlockMatrixIndex)tmp_i * stride + r];
-                        }
+                        simd->mul(scratch.data, blocked_times_mat[times_mat_index] + (sptBlockMatrixIndex)tmp_i * stride, R);
                     }
 
                     sptElementIndex const mode_i = hitsr->einds[mode].data[z];
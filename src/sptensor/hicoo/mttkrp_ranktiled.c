@@ -0,0 +1,178 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "hicoo.h"
+
+/* Default number of factor columns per panel. */
+#define SPT_HICOO_RANK_TILE 64
+
+
+static int spt_MTTKRPHiCOOKernels_RankTiled(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex R_tile,
+    const int tk)
+{
+    spt_CheckUniformBlocks(hitsr, "HiCOO SpTns MTTKRP RankTiled");
+    sptIndex const nmodes = hitsr->nmodes;
+    sptIndex const * const ndims = hitsr->ndims;
+    sptValue const * const restrict vals = hitsr->values.data;
+    sptIndex const stride = mats[0]->stride;
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiCOO SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiCOO SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const tmpI = mats[mode]->nrows;
+    sptIndex const R = mats[mode]->ncols;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, (sptNnzIndex)tmpI*stride*sizeof(*mvals));
+    if(R == 0) {
+        return 0;
+    }
+    if(R_tile == 0) {
+        R_tile = SPT_HICOO_RANK_TILE;
+    }
+    if(R_tile > R) {
+        R_tile = R;
+    }
+    sptIndex const npanels = (R + R_tile - 1) / R_tile;
+
+    sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
+    sptIndex num_kernel_dim = (ndims[mode] + sk - 1) / sk;
+    sptIndexVector * restrict kschr_mode = hitsr->kschr[mode];
+
+    #pragma omp parallel num_threads(tk)
+    {
+        /* Thread-private data */
+        sptValue ** blocked_times_mat = (sptValue**)malloc(nmodes * sizeof(*blocked_times_mat));
+        sptValue * scratch = (sptValue*)malloc(R_tile * sizeof(*scratch));
+
+        /* Loop parallel iterations */
+        for(sptIndex i=0; i<hitsr->nkiters[mode]; ++i) {
+            /* Kernels of one iteration write disjoint output rows and panels
+             * disjoint columns, so all (kernel, panel) pairs run in parallel. */
+            #pragma omp for schedule(dynamic) collapse(2)
+            for(sptIndex k=0; k<num_kernel_dim; ++k) {
+                for(sptIndex p=0; p<npanels; ++p) {
+                    if(i >= kschr_mode[k].len) continue;
+                    sptIndex const r0 = p * R_tile;
+                    sptIndex const RT = (R - r0 < R_tile) ? R - r0 : R_tile;
+                    sptIndex kptr_loc = kschr_mode[k].data[i];
+                    sptNnzIndex kptr_begin = hitsr->kptr.data[kptr_loc];
+                    sptNnzIndex kptr_end = hitsr->kptr.data[kptr_loc+1];
+
+                    /* Loop blocks in a kernel */
+                    for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
+                        /* Blocked matrices, shifted to the panel */
+                        for(sptIndex m=0; m<nmodes; ++m)
+                            blocked_times_mat[m] = mats[m]->values + ((sptNnzIndex)hitsr->binds[m].data[b] << hitsr->sb_bits) * stride + r0;
+                        sptValue * blocked_mvals = mvals + ((sptNnzIndex)hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride + r0;
+
+                        sptNnzIndex bptr_begin = hitsr->bptr.data[b];
+                        sptNnzIndex bptr_end = hitsr->bptr.data[b+1];
+                        /* Loop entries in a block */
+                        for(sptNnzIndex z=bptr_begin; z<bptr_end; ++z) {
+
+                            /* Multiply the 1st matrix */
+                            sptIndex times_mat_index = mats_order[1];
+                            sptIndex tmp_i = hitsr->einds[times_mat_index].data[z];
+                            sptValue const entry = vals[z];
+                            #pragma omp simd
+                            for(sptIndex r=0; r<RT; ++r) {
+                                scratch[r] = entry * blocked_times_mat[times_mat_index][tmp_i * stride + r];
+                            }
+                            /* Multiply the rest matrices */
+                            for(sptIndex m=2; m<nmodes; ++m) {
+                                times_mat_index = mats_order[m];
+                                tmp_i = hitsr->einds[times_mat_index].data[z];
+                                #pragma omp simd
+                                for(sptIndex r=0; r<RT; ++r) {
+                                    scratch[r] *= blocked_times_mat[times_mat_index][tmp_i * stride + r];
+                                }
+                            }
+
+                            sptIndex const mode_i = hitsr->einds[mode].data[z];
+                            #pragma omp simd
+                            for(sptIndex r=0; r<RT; ++r) {
+                                blocked_mvals[mode_i * stride + r] += scratch[r];
+                            }
+                        }   // End loop entries
+                    }   // End loop blocks
+                }   // End loop panels
+            }   // End loop kernels
+        }   // End loop iterations
+
+        /* Free thread-private space */
+        free(blocked_times_mat);
+        free(scratch);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Matriced sparse tensor in HiCOO format times a sequence of dense matrix Khatri-Rao products (MTTKRP) on a specified mode, for any rank. The factor columns are processed in panels of R_tile, so the scratch and the block-local factor rows touched per panel stay in cache as with sptMTTKRPHiCOO_MatrixTiling, without its sptElementIndex rank limit.
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size * ndims[mode] * R
+ * @param[in]  hitsr    the HiCOO sparse tensor input
+ * @param[in]  mats    (nmodes+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ * @param[in]  R_tile   the number of columns per panel, 0 for SPT_HICOO_RANK_TILE
+ */
+int sptMTTKRPHiCOO_RankTiled(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex const R_tile)
+{
+    return spt_MTTKRPHiCOOKernels_RankTiled(hitsr, mats, mats_order, mode, R_tile, 1);
+}
+
+
+/**
+ * OpenMP parallel HiCOO MTTKRP for any rank, processing factor columns in panels of R_tile. Kernels are scheduled as in sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled, and each (kernel, panel) pair is an independent task, so modes with few kernel rows still expose parallelism without a reduction.
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size * ndims[mode] * R
+ * @param[in]  hitsr    the HiCOO sparse tensor input
+ * @param[in]  mats    (nmodes+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ * @param[in]  R_tile   the number of columns per panel, 0 for SPT_HICOO_RANK_TILE
+ * @param[in]  nt   the number of threads
+ */
+int sptOmpMTTKRPHiCOO_RankTiled(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex const R_tile,
+    const int nt)
+{
+    return spt_MTTKRPHiCOOKernels_RankTiled(hitsr, mats, mats_order, mode, R_tile, nt);
+}
@@ -0,0 +1,87 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "hicoo.h"
+#include <string.h>
+
+#ifdef PARTI_USE_SPECIALIZED_MTTKRP
+
+#define SPT_PASTE_(a, b) a##b
+#define SPT_PASTE(a, b) SPT_PASTE_(a, b)
+#define SPT_RANKED(name) SPT_PASTE(name, SPT_RANK)
+
+static int spt_CheckSpecializedHiCOOMats(sptSparseTensorHiCOO const * const hitsr, sptRankMatrix * mats[], sptIndex const nmodes)
+{
+    sptAssert(hitsr->nmodes == nmodes);
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiCOO SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != hitsr->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiCOO SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    return 0;
+}
+
+#define SPT_RANK 8
+#include "mttkrp_specialized_impl.h"
+#undef SPT_RANK
+#define SPT_RANK 16
+#include "mttkrp_specialized_impl.h"
+#undef SPT_RANK
+#define SPT_RANK 32
+#include "mttkrp_specialized_impl.h"
+#undef SPT_RANK
+#define SPT_RANK 64
+#include "mttkrp_specialized_impl.h"
+#undef SPT_RANK
+#define SPT_RANK 128
+#include "mttkrp_specialized_impl.h"
+#undef SPT_RANK
+
+#define SPT_RANK_CASE(R) \
+    case R: return nmodes == 3 ? spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling_R##R : \
+        (nmodes == 4 ? spt_OmpMTTKRPHiCOOKernels_4D_MatrixTiling_R##R : NULL);
+
+#endif
+
+
+/**
+ * Find the HiCOO MatrixTiling MTTKRP kernel specialized for a tensor order
+ * and rank, see spt_LookupOmpMTTKRPKernel for the COO counterpart.
+ * @return the kernel, or NULL if the generic code has to run
+ */
+spt_OmpMTTKRPHiCOOKernel spt_LookupOmpMTTKRPHiCOOKernel(sptIndex const nmodes, sptIndex const R)
+{
+#ifdef PARTI_USE_SPECIALIZED_MTTKRP
+    switch(R) {
+    SPT_RANK_CASE(8)
+    SPT_RANK_CASE(16)
+    SPT_RANK_CASE(32)
+    SPT_RANK_CASE(64)
+    SPT_RANK_CASE(128)
+    default: break;
+    }
+#else
+    (void) nmodes;
+    (void) R;
+#endif
+    return NULL;
+}
@@ -0,0 +1,140 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Rank-specialized HiCOO OpenMP MTTKRP kernels in the MatrixTiling layout.
+ * Included once per rank by mttkrp_specialized.c with SPT_RANK defined. */
+
+static int SPT_RANKED(spt_OmpMTTKRPHiCOOKernels_3D_MatrixTiling_R)(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptRankMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    int result = spt_CheckSpecializedHiCOOMats(hitsr, mats, 3);
+    spt_CheckError(result, "OMP  HiCOO SpTns MTTKRP", NULL);
+
+    sptValue const * const restrict vals = hitsr->values.data;
+    sptElementIndex const stride = mats[0]->stride;
+    sptIndex const times_mat_index_1 = mats_order[1];
+    sptIndex const times_mat_index_2 = mats_order[2];
+    sptElementIndex const * const restrict einds_0 = hitsr->einds[mode].data;
+    sptElementIndex const * const restrict einds_1 = hitsr->einds[times_mat_index_1].data;
+    sptElementIndex const * const restrict einds_2 = hitsr->einds[times_mat_index_2].data;
+    sptValue * const restrict mvals = mats[3]->values;
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(*mvals));
+
+    /* Loop kernels */
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(tk)
+    for(sptIndex k=0; k<hitsr->kptr.len - 1; ++k) {
+        sptNnzIndex kptr_begin = hitsr->kptr.data[k];
+        sptNnzIndex kptr_end = hitsr->kptr.data[k+1];
+
+        /* Loop blocks in a kernel */
+        for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
+            sptValue const * const restrict blocked_times_mat_1 = mats[times_mat_index_1]->values
+                + ((sptNnzIndex)hitsr->binds[times_mat_index_1].data[b] << hitsr->sb_bits) * stride;
+            sptValue const * const restrict blocked_times_mat_2 = mats[times_mat_index_2]->values
+                + ((sptNnzIndex)hitsr->binds[times_mat_index_2].data[b] << hitsr->sb_bits) * stride;
+            sptValue * const restrict blocked_mvals = mvals
+                + ((sptNnzIndex)hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+
+            /* Loop entries in a block */
+            for(sptNnzIndex z=hitsr->bptr.data[b]; z<hitsr->bptr.data[b+1]; ++z) {
+                sptValue const * const restrict row_1 = blocked_times_mat_1 + (sptBlockMatrixIndex)einds_1[z] * stride;
+                sptValue const * const restrict row_2 = blocked_times_mat_2 + (sptBlockMatrixIndex)einds_2[z] * stride;
+                sptValue * const restrict bmvals_row = blocked_mvals + (sptBlockMatrixIndex)einds_0[z] * stride;
+                sptValue const entry = vals[z];
+                sptValue acc[SPT_RANK];
+                #pragma omp simd
+                for(sptElementIndex r=0; r<SPT_RANK; ++r) {
+                    acc[r] = entry * row_1[r] * row_2[r];
+                }
+                for(sptElementIndex r=0; r<SPT_RANK; ++r) {
+                    #pragma omp atomic update
+                    bmvals_row[r] += acc[r];
+                }
+            }   // End loop entries
+        }   // End loop blocks
+    }   // End loop kernels
+
+    return 0;
+}
+
+
+static int SPT_RANKED(spt_OmpMTTKRPHiCOOKernels_4D_MatrixTiling_R)(
+    sptSparseTensorHiCOO const * const hitsr,
+    sptRankMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    int result = spt_CheckSpecializedHiCOOMats(hitsr, mats, 4);
+    spt_CheckError(result, "OMP  HiCOO SpTns MTTKRP", NULL);
+
+    sptValue const * const restrict vals = hitsr->values.data;
+    sptElementIndex const stride = mats[0]->stride;
+    sptIndex const times_mat_index_1 = mats_order[1];
+    sptIndex const times_mat_index_2 = mats_order[2];
+    sptIndex const times_mat_index_3 = mats_order[3];
+    sptElementIndex const * const restrict einds_0 = hitsr->einds[mode].data;
+    sptElementIndex const * const restrict einds_1 = hitsr->einds[times_mat_index_1].data;
+    sptElementIndex const * const restrict einds_2 = hitsr->einds[times_mat_index_2].data;
+    sptElementIndex const * const restrict einds_3 = hitsr->einds[times_mat_index_3].data;
+    sptValue * const restrict mvals = mats[4]->values;
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(*mvals));
+
+    /* Loop kernels */
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(tk)
+    for(sptIndex k=0; k<hitsr->kptr.len - 1; ++k) {
+        sptNnzIndex kptr_begin = hitsr->kptr.data[k];
+        sptNnzIndex kptr_end = hitsr->kptr.data[k+1];
+
+        /* Loop blocks in a kernel */
+        for(sptNnzIndex b=kptr_begin; b<kptr_end; ++b) {
+            sptValue const * const restrict blocked_times_mat_1 = mats[times_mat_index_1]->values
+                + ((sptNnzIndex)hitsr->binds[times_mat_index_1].data[b] << hitsr->sb_bits) * stride;
+            sptValue const * const restrict blocked_times_mat_2 = mats[times_mat_index_2]->values
+                + ((sptNnzIndex)hitsr->binds[times_mat_index_2].data[b] << hitsr->sb_bits) * stride;
+            sptValue const * const restrict blocked_times_mat_3 = mats[times_mat_index_3]->values
+                + ((sptNnzIndex)hitsr->binds[times_mat_index_3].data[b] << hitsr->sb_bits) * stride;
+            sptValue * const restrict blocked_mvals = mvals
+                + ((sptNnzIndex)hitsr->binds[mode].data[b] << hitsr->sb_bits) * stride;
+
+            /* Loop entries in a block */
+            for(sptNnzIndex z=hitsr->bptr.data[b]; z<hitsr->bptr.data[b+1]; ++z) {
+                sptValue const * const restrict row_1 = blocked_times_mat_1 + (sptBlockMatrixIndex)einds_1[z] * stride;
+                sptValue const * const restrict row_2 = blocked_times_mat_2 + (sptBlockMatrixIndex)einds_2[z] * stride;
+                sptValue const * const restrict row_3 = blocked_times_mat_3 + (sptBlockMatrixIndex)einds_3[z] * stride;
+                sptValue * const restrict bmvals_row = blocked_mvals + (sptBlockMatrixIndex)einds_0[z] * stride;
+                sptValue const entry = vals[z];
+                sptValue acc[SPT_RANK];
+                #pragma omp simd
+                for(sptElementIndex r=0; r<SPT_RANK; ++r) {
+                    acc[r] = entry * row_1[r] * row_2[r] * row_3[r];
+                }
+                for(sptElementIndex r=0; r<SPT_RANK; ++r) {
+                    #pragma omp atomic update
+                    bmvals_row[r] += acc[r];
+                }
+            }   // End loop entries
+        }   // End loop blocks
+    }   // End loop kernels
+
+    return 0;
+}
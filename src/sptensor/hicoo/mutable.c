@@ -0,0 +1,488 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * HiCOO with incremental updates.
+ *
+ * Updates are additive: a nonzero added at an existing coordinate adds to
+ * its value. They are appended to a COO delta, which MTTKRP processes after
+ * the HiCOO base. Compaction sorts the delta by kernel and rebuilds only the
+ * kernels it hits, sorting their old and new nonzeros together in Morton
+ * order and summing duplicates. Every other kernel keeps its blocks, which
+ * are only moved to their new offsets.
+ */
+
+#define SPT_NO_KERNEL ((sptNnzIndex) -1)
+
+typedef struct {
+    sptSparseTensor const * delta;
+    sptIndex const * kdims;
+    sptElementIndex sk_bits;
+} spt_DeltaKernelCtx;
+
+
+static uint64_t spt_DeltaKernel(spt_DeltaKernelCtx const * c, sptNnzIndex const z) {
+    uint64_t kernel = 0;
+    for(sptIndex m = 0; m < c->delta->nmodes; ++m) {
+        kernel = kernel * c->kdims[m] + (c->delta->inds[m].data[z] >> c->sk_bits);
+    }
+    return kernel;
+}
+
+
+static void spt_DeltaKernelKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    (void) word;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = spt_DeltaKernel(ctx, perm[i]);
+    }
+}
+
+
+/* Chunk pointers of a HiCOO tensor from its kernel and block pointers, as sptSparseTensorToHiCOO sets them */
+static int spt_HiCOOSetChunks(sptSparseTensorHiCOO *hitsr) {
+    sptNnzIndex const sc = (sptNnzIndex) 1 << hitsr->sc_bits;
+    sptNnzIndex const * const kptr = hitsr->kptr.data;
+    sptNnzIndex const * const bptr = hitsr->bptr.data;
+    int result;
+    hitsr->cptr.len = 0;
+    for(sptNnzIndex k = 0; k + 1 < hitsr->kptr.len; ++k) {
+        result = sptAppendNnzIndexVector(&hitsr->cptr, kptr[k]);
+        spt_CheckError(result, "HiSpTns Compact", NULL);
+        sptNnzIndex chunk_size = 0;
+        for(sptNnzIndex b = kptr[k] + 1; b < kptr[k+1]; ++b) {
+            sptNnzIndex const ne = bptr[b] - bptr[b-1];
+            if(chunk_size + ne >= sc) {
+                result = sptAppendNnzIndexVector(&hitsr->cptr, b);
+                spt_CheckError(result, "HiSpTns Compact", NULL);
+                chunk_size = 0;
+            } else {
+                chunk_size += ne;
+            }
+        }
+    }
+    result = sptAppendNnzIndexVector(&hitsr->cptr, hitsr->bptr.len - 1);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    return 0;
+}
+
+
+/**
+ * Make a HiCOO tensor take updates
+ * @param mh          an uninitialized mutable HiCOO tensor
+ * @param hitsr       a HiCOO tensor, which mh takes over and releases
+ * @param max_nnzb    the maximum number of nonzeros per block of hitsr
+ * @param compact_nnz the delta size at which sptMutableHiCOOAdd compacts, 0 for never
+ * @param tk          the number of threads of those compactions
+ */
+int sptNewMutableHiCOO(
+    sptMutableHiCOO *mh,
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex const max_nnzb,
+    sptNnzIndex const compact_nnz,
+    int const tk)
+{
+    if(hitsr->sk_bits < hitsr->sb_bits || hitsr->sk_bits >= 32) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Mutable", "sk_bits < sb_bits or sk_bits >= 32");
+    }
+    spt_CheckUniformBlocks(hitsr, "HiSpTns Mutable");
+    int result = sptNewSparseTensor(&mh->delta, hitsr->nmodes, hitsr->ndims);
+    spt_CheckError(result, "HiSpTns Mutable", NULL);
+    mh->base = *hitsr;
+    mh->max_nnzb = max_nnzb;
+    mh->compact_nnz = compact_nnz;
+    mh->tk = tk;
+    return 0;
+}
+
+
+/**
+ * Release a mutable HiCOO tensor, its base included
+ */
+void sptFreeMutableHiCOO(sptMutableHiCOO *mh) {
+    sptFreeSparseTensorHiCOO(&mh->base);
+    sptFreeSparseTensor(&mh->delta);
+}
+
+
+/**
+ * Add a value at a coordinate of a mutable HiCOO tensor, compacting once the
+ * delta reaches compact_nnz nonzeros
+ * @param mh     the mutable HiCOO tensor
+ * @param coords the nmodes coordinates, from 0
+ * @param value  added to the value at coords, which may be a new nonzero
+ */
+int sptMutableHiCOOAdd(sptMutableHiCOO *mh, const sptIndex coords[], sptValue const value) {
+    sptSparseTensor * const delta = &mh->delta;
+    int result;
+    for(sptIndex m = 0; m < delta->nmodes; ++m) {
+        if(coords[m] >= delta->ndims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Mutable", "index out of range");
+        }
+    }
+    for(sptIndex m = 0; m < delta->nmodes; ++m) {
+        result = sptAppendIndexVector(&delta->inds[m], coords[m]);
+        spt_CheckError(result, "HiSpTns Mutable", NULL);
+    }
+    result = sptAppendValueVector(&delta->values, value);
+    spt_CheckError(result, "HiSpTns Mutable", NULL);
+    ++delta->nnz;
+    sptSparseTensorDropCache(delta);
+    if(mh->compact_nnz > 0 && delta->nnz >= mh->compact_nnz) {
+        result = sptMutableHiCOOCompact(mh, mh->tk);
+        spt_CheckError(result, "HiSpTns Mutable", NULL);
+    }
+    return 0;
+}
+
+
+/*
+ * The old and new nonzeros of one kernel, in Morton order with duplicates
+ * summed, in tmp. base_k is the kernel of the base or SPT_NO_KERNEL.
+ */
+static int spt_MergeKernel(
+    sptSparseTensor * tmp,
+    sptSparseTensorHiCOO const * const base,
+    sptNnzIndex const base_k,
+    sptSparseTensor const * const delta,
+    sptNnzIndex const * const dperm,
+    sptNnzIndex const dbegin,
+    sptNnzIndex const dend)
+{
+    sptIndex const nmodes = base->nmodes;
+    sptElementIndex const sb_bits = base->sb_bits;
+    sptNnzIndex bbegin = 0, bend = 0;
+    if(base_k != SPT_NO_KERNEL) {
+        bbegin = base->kptr.data[base_k];
+        bend = base->kptr.data[base_k + 1];
+    }
+    sptNnzIndex const nold = base->bptr.data[bend] - base->bptr.data[bbegin];
+    int result = spt_SparseTensorNewSized(tmp, nmodes, base->ndims, nold + dend - dbegin);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+
+    sptNnzIndex w = 0;
+    for(sptNnzIndex b = bbegin; b < bend; ++b) {
+        for(sptNnzIndex z = base->bptr.data[b]; z < base->bptr.data[b+1]; ++z, ++w) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                tmp->inds[m].data[w] = ((sptIndex) base->binds[m].data[b] << sb_bits) + base->einds[m].data[z];
+            }
+            tmp->values.data[w] = base->values.data[z];
+        }
+    }
+    for(sptNnzIndex i = dbegin; i < dend; ++i, ++w) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            tmp->inds[m].data[w] = delta->inds[m].data[dperm[i]];
+        }
+        tmp->values.data[w] = delta->values.data[dperm[i]];
+    }
+    sptSparseTensorSortIndexMorton(tmp, 1, 0, tmp->nnz, sb_bits);
+
+    /* Equal coordinates are adjacent in Morton order */
+    w = 0;
+    for(sptNnzIndex z = 0; z < tmp->nnz; ++z) {
+        int same = w > 0;
+        for(sptIndex m = 0; m < nmodes && same; ++m) {
+            same = tmp->inds[m].data[z] == tmp->inds[m].data[w-1];
+        }
+        if(same) {
+            tmp->values.data[w-1] += tmp->values.data[z];
+        } else {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                tmp->inds[m].data[w] = tmp->inds[m].data[z];
+            }
+            tmp->values.data[w] = tmp->values.data[z];
+            ++w;
+        }
+    }
+    tmp->nnz = w;
+    return 0;
+}
+
+
+/**
+ * Merge the delta of a mutable HiCOO tensor into its base. Only the kernels
+ * holding delta nonzeros are sorted again; the others are copied block by block.
+ * @param mh the mutable HiCOO tensor
+ * @param tk the number of threads
+ */
+int sptMutableHiCOOCompact(sptMutableHiCOO *mh, int const tk) {
+    sptSparseTensorHiCOO * const base = &mh->base;
+    sptSparseTensor * const delta = &mh->delta;
+    sptIndex const nmodes = base->nmodes;
+    sptElementIndex const sb_bits = base->sb_bits;
+    sptElementIndex const sk_bits = base->sk_bits;
+    sptNnzIndex const dnnz = delta->nnz;
+    int result;
+    if(dnnz == 0) {
+        return 0;
+    }
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptIndex * kdims = malloc(nmodes * sizeof *kdims);
+    spt_CheckOSError(!kdims, "HiSpTns Compact");
+    uint64_t nkernels = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        kdims[m] = ((base->ndims[m] - 1) >> sk_bits) + 1;
+        if(nkernels > UINT64_MAX / kdims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Compact", "too many kernels, raise sk_bits");
+        }
+        nkernels *= kdims[m];
+    }
+    unsigned kbits = 0;
+    while(kbits < 64 && (nkernels - 1) >> kbits != 0) {
+        ++kbits;
+    }
+
+    /* Delta nonzeros in kernel order */
+    spt_DeltaKernelCtx const ctx = { delta, kdims, sk_bits };
+    sptNnzIndex * dperm = malloc(dnnz * sizeof *dperm);
+    spt_CheckOSError(!dperm, "HiSpTns Compact");
+    result = spt_RadixSortPermutation(dperm, dnnz, 1, &kbits, spt_DeltaKernelKey, &ctx, tk);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+
+    /* Merge the base kernels, already in row-major order, with the delta's */
+    sptNnzIndex const nk_old = base->kptr.len - 1;
+    sptNnzIndex const cap = nk_old + dnnz;
+    sptNnzIndex * out_base = malloc(cap * sizeof *out_base);
+    sptNnzIndex * out_dbegin = malloc((cap + 1) * sizeof *out_dbegin);
+    sptNnzIndex * out_dend = malloc(cap * sizeof *out_dend);
+    spt_CheckOSError(!out_base || !out_dbegin || !out_dend, "HiSpTns Compact");
+    sptNnzIndex nk = 0, k = 0, d = 0;
+    while(k < nk_old || d < dnnz) {
+        uint64_t kb = UINT64_MAX, kd = UINT64_MAX;
+        if(k < nk_old) {
+            sptNnzIndex const b = base->kptr.data[k];
+            kb = 0;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                kb = kb * kdims[m] + (base->binds[m].data[b] >> (sk_bits - sb_bits));
+            }
+        }
+        if(d < dnnz) {
+            kd = spt_DeltaKernel(&ctx, dperm[d]);
+        }
+        out_base[nk] = kb <= kd ? k++ : SPT_NO_KERNEL;
+        out_dbegin[nk] = d;
+        if(kd <= kb) {
+            while(d < dnnz && spt_DeltaKernel(&ctx, dperm[d]) == kd) {
+                ++d;
+            }
+        }
+        out_dend[nk] = d;
+        ++nk;
+    }
+
+    /* Rebuild the kernels with delta nonzeros, count blocks and nonzeros of all */
+    sptSparseTensor * tmps = calloc(nk, sizeof *tmps);
+    sptNnzIndex * kernel_nb = malloc((nk + 1) * sizeof *kernel_nb);
+    sptNnzIndex * kernel_nz = malloc((nk + 1) * sizeof *kernel_nz);
+    spt_CheckOSError(!tmps || !kernel_nb || !kernel_nz, "HiSpTns Compact");
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex j = 0; j < nk; ++j) {
+        if(out_dbegin[j] == out_dend[j]) {
+            sptNnzIndex const kb = out_base[j];
+            kernel_nb[j] = base->kptr.data[kb+1] - base->kptr.data[kb];
+            kernel_nz[j] = base->bptr.data[base->kptr.data[kb+1]] - base->bptr.data[base->kptr.data[kb]];
+            continue;
+        }
+        sptSparseTensor * const tmp = &tmps[j];
+        if(spt_MergeKernel(tmp, base, out_base[j], delta, dperm, out_dbegin[j], out_dend[j]) != 0) {
+            #pragma omp atomic write
+            failed = 1;
+            continue;
+        }
+        sptNnzIndex nb = 1;
+        for(sptNnzIndex z = 1; z < tmp->nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                if((tmp->inds[m].data[z] >> sb_bits) != (tmp->inds[m].data[z-1] >> sb_bits)) {
+                    ++nb;
+                    break;
+                }
+            }
+        }
+        kernel_nb[j] = nb;
+        kernel_nz[j] = tmp->nnz;
+    }
+    if(failed) {
+        spt_CheckError(SPTERR_UNKNOWN, "HiSpTns Compact", "kernel merge failed");
+    }
+    sptNnzIndex nb = 0, nnz = 0;
+    for(sptNnzIndex j = 0; j < nk; ++j) {
+        sptNnzIndex const tmp_nb = kernel_nb[j], tmp_nz = kernel_nz[j];
+        kernel_nb[j] = nb;
+        kernel_nz[j] = nnz;
+        nb += tmp_nb;
+        nnz += tmp_nz;
+    }
+    kernel_nb[nk] = nb;
+    kernel_nz[nk] = nnz;
+
+    sptSparseTensorHiCOO next;
+    result = sptNewSparseTensorHiCOO(&next, nmodes, base->ndims, nnz, sb_bits, sk_bits, base->sc_bits);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    result = sptResizeNnzIndexVector(&next.kptr, nk + 1);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    result = sptResizeNnzIndexVector(&next.bptr, nb + 1);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeBlockIndexVector(&next.binds[m], nb);
+        spt_CheckError(result, "HiSpTns Compact", NULL);
+        result = sptResizeElementIndexVector(&next.einds[m], nnz);
+        spt_CheckError(result, "HiSpTns Compact", NULL);
+    }
+    result = sptResizeValueVector(&next.values, nnz);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+
+    /* Move the untouched kernels and write the rebuilt ones */
+    sptIndex const emask = ((sptIndex)1 << sb_bits) - 1;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptNnzIndex j = 0; j < nk; ++j) {
+        sptNnzIndex b = kernel_nb[j], z0 = kernel_nz[j];
+        if(out_dbegin[j] == out_dend[j]) {
+            sptNnzIndex const kb = out_base[j];
+            sptNnzIndex const ob = base->kptr.data[kb], oe = base->kptr.data[kb+1];
+            sptNnzIndex const oz = base->bptr.data[ob], n = base->bptr.data[oe] - oz;
+            for(sptNnzIndex i = ob; i < oe; ++i) {
+                next.bptr.data[b + i - ob] = base->bptr.data[i] - oz + z0;
+            }
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                memcpy(next.binds[m].data + b, base->binds[m].data + ob, (oe - ob) * sizeof *next.binds[m].data);
+                memcpy(next.einds[m].data + z0, base->einds[m].data + oz, n * sizeof *next.einds[m].data);
+            }
+            memcpy(next.values.data + z0, base->values.data + oz, n * sizeof *next.values.data);
+            continue;
+        }
+        sptSparseTensor * const tmp = &tmps[j];
+        for(sptNnzIndex z = 0; z < tmp->nnz; ++z) {
+            int is_new = z == 0;
+            for(sptIndex m = 0; m < nmodes && !is_new; ++m) {
+                is_new = (tmp->inds[m].data[z] >> sb_bits) != (tmp->inds[m].data[z-1] >> sb_bits);
+            }
+            if(is_new) {
+                if(z != 0) {
+                    ++ b;
+                }
+                next.bptr.data[b] = z0 + z;
+                for(sptIndex m = 0; m < nmodes; ++m)
+                    next.binds[m].data[b] = (sptBlockIndex)(tmp->inds[m].data[z] >> sb_bits);
+            }
+            for(sptIndex m = 0; m < nmodes; ++m)
+                next.einds[m].data[z0 + z] = (sptElementIndex)(tmp->inds[m].data[z] & emask);
+            next.values.data[z0 + z] = tmp->values.data[z];
+        }
+        sptFreeSparseTensor(tmp);
+    }
+    for(sptNnzIndex j = 0; j <= nk; ++j) {
+        next.kptr.data[j] = kernel_nb[j];
+    }
+    next.bptr.data[nb] = nnz;
+    result = spt_HiCOOSetChunks(&next);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+
+    result = spt_HiCOOSetKernelScheduler(&next, tk);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+    result = spt_HiCOOPlaceHbm(&next);
+    spt_CheckError(result, "HiSpTns Compact", NULL);
+
+    sptNnzIndex max_nnzb = 0;
+    for(sptNnzIndex i = 0; i < nb; ++i) {
+        if(max_nnzb < next.bptr.data[i+1] - next.bptr.data[i]) {
+            max_nnzb = next.bptr.data[i+1] - next.bptr.data[i];
+        }
+    }
+    mh->max_nnzb = max_nnzb;
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "HiSpTns Compact");
+    sptFreeTimer(timer);
+
+    sptFreeSparseTensorHiCOO(base);
+    *base = next;
+    delta->nnz = 0;
+    delta->values.len = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        delta->inds[m].len = 0;
+    }
+    sptSparseTensorDropCache(delta);
+
+    free(tmps);
+    free(kernel_nb);
+    free(kernel_nz);
+    free(out_base);
+    free(out_dbegin);
+    free(out_dend);
+    free(dperm);
+    free(kdims);
+    return 0;
+}
+
+
+/**
+ * OpenMP MTTKRP of a mutable HiCOO tensor: the base by
+ * sptOmpMTTKRPHiCOO_MatrixTiling, then the delta with atomic updates.
+ * @param[in]  mh         the mutable HiCOO tensor
+ * @param[out] mats       (N+1) dense matrices, with mats[nmodes] as the output
+ * @param[in]  mats_order the order of the Khatri-Rao products
+ * @param[in]  mode       the mode on which the MTTKRP is performed
+ * @param[in]  tk         the number of threads
+ */
+int sptOmpMTTKRPMutableHiCOO(
+    sptMutableHiCOO const * const mh,
+    sptRankMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    sptSparseTensor const * const delta = &mh->delta;
+    sptIndex const nmodes = delta->nmodes;
+    int result = sptOmpMTTKRPHiCOO_MatrixTiling(&mh->base, mats, mats_order, mode, tk);
+    spt_CheckError(result, "OMP  HiSpTns MTTKRP Mutable", NULL);
+
+    sptElementIndex const R = mats[mode]->ncols;
+    sptElementIndex const stride = mats[0]->stride;
+    sptValue * const mvals = mats[nmodes]->values;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < delta->nnz; ++z) {
+        sptValue row[256];
+        sptValue const v = delta->values.data[z];
+        for(sptElementIndex r = 0; r < R; ++r) {
+            row[r] = v;
+        }
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            sptIndex const m = mats_order[i];
+            sptValue const * const restrict urow = mats[m]->values + (sptNnzIndex) delta->inds[m].data[z] * stride;
+            for(sptElementIndex r = 0; r < R; ++r) {
+                row[r] *= urow[r];
+            }
+        }
+        sptValue * const out = mvals + (sptNnzIndex) delta->inds[mode].data[z] * stride;
+        for(sptElementIndex r = 0; r < R; ++r) {
+            #pragma omp atomic update
+            out[r] += row[r];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * Scalar and element-wise operations on HiCOO tensors. They only touch the
+ * values, so the block and element indices are kept or copied as they are.
+ */
+
+/**
+ * OpenMP parallelized multiply a HiCOO sparse tensor by a scalar, in place.
+ * Unlike the COO version, a zero scalar keeps the pattern with zero values.
+ * @param[in,out] hitsr the HiCOO sparse tensor
+ * @param[in]     a     the scalar
+ */
+int sptOmpSparseTensorMulScalarHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const a) {
+    sptValue * const restrict vals = hitsr->values.data;
+    #pragma omp parallel for schedule(static)
+    for(sptNnzIndex z = 0; z < hitsr->nnz; ++z) {
+        vals[z] *= a;
+    }
+    return 0;
+}
+
+
+/**
+ * OpenMP parallelized divide a HiCOO sparse tensor by a scalar, in place
+ * @param[in,out] hitsr the HiCOO sparse tensor
+ * @param[in]     a     the scalar, not zero
+ */
+int sptOmpSparseTensorDivScalarHiCOO(sptSparseTensorHiCOO *hitsr, sptValue const a) {
+    if(a == 0) {
+        spt_CheckError(SPTERR_ZERO_DIVISION, "OMP HiSpTns Div", "divide by zero");
+    }
+    sptValue * const restrict vals = hitsr->values.data;
+    #pragma omp parallel for schedule(static)
+    for(sptNnzIndex z = 0; z < hitsr->nnz; ++z) {
+        vals[z] /= a;
+    }
+    return 0;
+}
+
+
+/* Whether X and Y have the same blocks and the same nonzeros in the same order */
+static int spt_HiCOOSamePattern(sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y) {
+    if(X->nmodes != Y->nmodes || X->nnz != Y->nnz || X->sb_bits != Y->sb_bits ||
+        X->bptr.len != Y->bptr.len || X->kbits.len != Y->kbits.len) {
+        return 0;
+    }
+    if(memcmp(X->kbits.data, Y->kbits.data, X->kbits.len * sizeof *X->kbits.data) != 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(X->ndims[m] != Y->ndims[m]) {
+            return 0;
+        }
+    }
+    sptNnzIndex const nb = X->bptr.len;
+    if(memcmp(X->bptr.data, Y->bptr.data, nb * sizeof *X->bptr.data) != 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(memcmp(X->binds[m].data, Y->binds[m].data, (nb - 1) * sizeof *X->binds[m].data) != 0 ||
+            memcmp(X->einds[m].data, Y->einds[m].data, X->nnz * sizeof *X->einds[m].data) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* Z = op(X, Y) over the shared pattern of X and Y, Z is uninitialized */
+static int spt_HiCOOZipValues(
+    sptSparseTensorHiCOO *Z,
+    sptSparseTensorHiCOO const * const X,
+    sptSparseTensorHiCOO const * const Y,
+    spt_JoinOp const op,
+    const char *module)
+{
+    (void) module;
+    if(!spt_HiCOOSamePattern(X, Y)) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "nonzero distribution mismatch");
+    }
+    int result = sptCopySparseTensorHiCOO(Z, X);
+    spt_CheckError(result, module, NULL);
+
+    sptValue const * const restrict xv = X->values.data;
+    sptValue const * const restrict yv = Y->values.data;
+    sptValue * const restrict zv = Z->values.data;
+    #pragma omp parallel for schedule(static)
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        zv[z] = op(xv[z], yv[z]);
+    }
+    return 0;
+}
+
+
+/**
+ * OpenMP parallelized element-wise add two HiCOO sparse tensors with the same
+ * nonzero pattern, as built from the same coordinates with the same block
+ * and kernel sizes. Nonzeros that cancel are kept as zeros.
+ * @param[out] Z the result of X+Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptOmpSparseTensorAddEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y) {
+    return spt_HiCOOZipValues(Z, X, Y, spt_AddValues, "OMP HiSpTns Add");
+}
+
+
+/**
+ * OpenMP parallelized element-wise subtract two HiCOO sparse tensors with the
+ * same nonzero pattern, see sptOmpSparseTensorAddEqHiCOO
+ * @param[out] Z the result of X-Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptOmpSparseTensorSubEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y) {
+    return spt_HiCOOZipValues(Z, X, Y, spt_SubValues, "OMP HiSpTns Sub");
+}
+
+
+/**
+ * OpenMP parallelized element-wise multiply two HiCOO sparse tensors with the
+ * same nonzero pattern, see sptOmpSparseTensorAddEqHiCOO
+ * @param[out] Z the result of X.*Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptOmpSparseTensorDotMulEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y) {
+    return spt_HiCOOZipValues(Z, X, Y, spt_MulValues, "OMP HiSpTns DotMul");
+}
+
+
+/**
+ * OpenMP parallelized element-wise divide two HiCOO sparse tensors with the
+ * same nonzero pattern, see sptOmpSparseTensorAddEqHiCOO
+ * @param[out] Z the result of X./Y, should be uninitialized
+ * @param[in]  X the input X
+ * @param[in]  Y the input Y
+ */
+int sptOmpSparseTensorDotDivEqHiCOO(sptSparseTensorHiCOO *Z, sptSparseTensorHiCOO const * const X, sptSparseTensorHiCOO const * const Y) {
+    return spt_HiCOOZipValues(Z, X, Y, spt_DivValues, "OMP HiSpTns DotDiv");
+}
@@ -0,0 +1,401 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * CP-ALS of a text tensor file, in the background.
+ *
+ * Loading with sptLoadSparseTensor, converting with sptSparseTensorToHiCOO
+ * and decomposing with sptOmpCpdAlsHiCOO each wait for the whole of the step
+ * before. The pipeline overlaps them instead. A parser thread reads the
+ * file in batches of nonzeros while the driver thread bins the previous
+ * batch by kernel in a sptHiCOOBuilder, so kernels are bucket-sorted as the
+ * file arrives. A third thread draws the initial factors as soon as the
+ * header gives the dimensions. Once the file ends, the kernels are sorted
+ * and converted in parallel, and CP-ALS starts from the drawn factors.
+ */
+
+#define SPT_PIPELINE_BATCH (1 << 16)
+
+typedef struct {
+    sptIndex * coords;  /// SPT_PIPELINE_BATCH nonzeros of nmodes coordinates
+    sptValue * values;
+    sptNnzIndex nnz;
+    int full;           /// handed to the driver and not binned yet
+    int last;           /// the parser stops after this batch
+} spt_PipelineBatch;
+
+struct sptTagCpdPipeline {
+    char * filename;
+    sptIndex start_index;
+    sptElementIndex sb_bits;
+    sptElementIndex sk_bits;
+    sptIndex rank;
+    sptIndex niters;
+    double tol;
+    int tk;
+
+    FILE * fp;
+    sptIndex nmodes;
+    sptIndex * ndims;
+    spt_PipelineBatch batches[2];
+    int parse_result;
+    sptRankMatrix ** init_factors;
+    int init_result;
+
+    pthread_mutex_t lock;   /// guards the batches' full flags and stage
+    pthread_cond_t cond;
+    sptPipelineStage stage;
+    pthread_t driver;
+
+    int result;
+    int has_hitsr;
+    int has_ktensor;
+    sptSparseTensorHiCOO hitsr;
+    sptRankKruskalTensor ktensor;
+};
+
+
+static void spt_PipelineSetStage(sptCpdPipeline pipe, sptPipelineStage const stage) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->stage = stage;
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+/* Parse one line into coords and value: 1 for a nonzero, 0 for a blank line or a zero, -1 on error */
+static int spt_PipelineParseLine(char const * line, sptIndex const nmodes, sptIndex const start_index, sptIndex * coords, sptValue * value) {
+    char const * p = line;
+    char * q;
+    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        ++p;
+    }
+    if(*p == '\0') {
+        return 0;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        unsigned long long const index = strtoull(p, &q, 10);
+        if(q == p || index < start_index || index - start_index > PARTI_INDEX_MAX) {
+            return -1;
+        }
+        coords[m] = (sptIndex) (index - start_index);
+        p = q;
+    }
+    double const v = strtod(p, &q);
+    if(q == p) {
+        return -1;
+    }
+    *value = v;
+    return v != 0;
+}
+
+/* Read the body of the file into the two batches in turn, until it ends or a line is malformed */
+static void * spt_PipelineParse(void * arg) {
+    sptCpdPipeline const pipe = arg;
+    sptIndex const nmodes = pipe->nmodes;
+    char * line = NULL;
+    size_t line_cap = 0;
+    int last = 0;
+    for(int b = 0; !last; b ^= 1) {
+        spt_PipelineBatch * const batch = &pipe->batches[b];
+        pthread_mutex_lock(&pipe->lock);
+        while(batch->full) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        }
+        pthread_mutex_unlock(&pipe->lock);
+
+        batch->nnz = 0;
+        while(batch->nnz < SPT_PIPELINE_BATCH) {
+            if(getline(&line, &line_cap, pipe->fp) < 0) {
+                last = 1;
+                break;
+            }
+            int const parsed = spt_PipelineParseLine(line, nmodes, pipe->start_index,
+                batch->coords + batch->nnz * nmodes, &batch->values[batch->nnz]);
+            if(parsed < 0) {
+                pipe->parse_result = SPTERR_VALUE_ERROR;
+                last = 1;
+                break;
+            }
+            batch->nnz += parsed;
+        }
+
+        pthread_mutex_lock(&pipe->lock);
+        batch->last = last;
+        batch->full = 1;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    free(line);
+    return NULL;
+}
+
+/* Draw the initial factors, for CP-ALS to start from */
+static void * spt_PipelineInit(void * arg) {
+    sptCpdPipeline const pipe = arg;
+    sptRankMatrix ** factors = calloc(pipe->nmodes, sizeof *factors);
+    pipe->init_result = SPTERR_OS_ERROR;
+    if(factors == NULL) {
+        return NULL;
+    }
+    for(sptIndex m = 0; m < pipe->nmodes; ++m) {
+        factors[m] = malloc(sizeof *factors[m]);
+        if(factors[m] == NULL || sptNewRankMatrix(factors[m], pipe->ndims[m], (sptElementIndex) pipe->rank) != 0) {
+            free(factors[m]);
+            for(sptIndex n = 0; n < m; ++n) {
+                sptFreeRankMatrix(factors[n]);
+                free(factors[n]);
+            }
+            free(factors);
+            return NULL;
+        }
+        sptRandomizeRankMatrix(factors[m], pipe->ndims[m], (sptElementIndex) pipe->rank);
+    }
+    pipe->init_factors = factors;
+    pipe->init_result = 0;
+    return NULL;
+}
+
+/* Bin the parsed batches, until the parser's last one, into bld; errors are kept but the batches drained */
+static int spt_PipelineBin(sptCpdPipeline pipe, sptHiCOOBuilder * bld) {
+    sptIndex const nmodes = pipe->nmodes;
+    int result = 0;
+    int last = 0;
+    for(int b = 0; !last; b ^= 1) {
+        spt_PipelineBatch * const batch = &pipe->batches[b];
+        pthread_mutex_lock(&pipe->lock);
+        while(!batch->full) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+        }
+        last = batch->last;
+        pthread_mutex_unlock(&pipe->lock);
+
+        for(sptNnzIndex z = 0; result == 0 && z < batch->nnz; ++z) {
+            result = sptHiCOOBuilderAppend(bld, batch->coords + z * nmodes, batch->values[z]);
+        }
+
+        pthread_mutex_lock(&pipe->lock);
+        batch->full = 0;
+        pthread_cond_broadcast(&pipe->cond);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    return result;
+}
+
+static int spt_PipelineDrive(sptCpdPipeline pipe) {
+    int result;
+    int iores = fscanf(pipe->fp, "%"PARTI_SCN_INDEX, &pipe->nmodes);
+    if(iores != 1 || pipe->nmodes == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Pipeline", "bad nmodes");
+    }
+    pipe->ndims = malloc(pipe->nmodes * sizeof *pipe->ndims);
+    spt_CheckOSError(!pipe->ndims, "CPD Pipeline");
+    for(sptIndex m = 0; m < pipe->nmodes; ++m) {
+        iores = fscanf(pipe->fp, "%"PARTI_SCN_INDEX, &pipe->ndims[m]);
+        if(iores != 1) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "CPD Pipeline", "bad ndims");
+        }
+    }
+    for(int b = 0; b < 2; ++b) {
+        pipe->batches[b].coords = malloc((size_t) SPT_PIPELINE_BATCH * pipe->nmodes * sizeof (sptIndex));
+        pipe->batches[b].values = malloc((size_t) SPT_PIPELINE_BATCH * sizeof (sptValue));
+        spt_CheckOSError(!pipe->batches[b].coords || !pipe->batches[b].values, "CPD Pipeline");
+    }
+    sptHiCOOBuilder bld;
+    result = sptNewHiCOOBuilder(&bld, pipe->nmodes, pipe->ndims, pipe->sb_bits, pipe->sk_bits, 0);
+    spt_CheckError(result, "CPD Pipeline", NULL);
+
+    /* Draw the factors and parse the file while the driver bins nonzeros */
+    pthread_t init, parser;
+    result = pthread_create(&init, NULL, spt_PipelineInit, pipe);
+    if(result != 0) {
+        sptFreeHiCOOBuilder(&bld);
+        spt_CheckOSError(1, "CPD Pipeline");
+    }
+    result = pthread_create(&parser, NULL, spt_PipelineParse, pipe);
+    if(result != 0) {
+        pthread_join(init, NULL);
+        sptFreeHiCOOBuilder(&bld);
+        spt_CheckOSError(1, "CPD Pipeline");
+    }
+    result = spt_PipelineBin(pipe, &bld);
+    pthread_join(parser, NULL);
+    if(result == 0) {
+        result = pipe->parse_result;
+    }
+
+    if(result == 0) {
+        spt_PipelineSetStage(pipe, SPT_PIPELINE_CONVERTING);
+        sptNnzIndex max_nnzb = 0;
+        result = sptHiCOOBuilderFinish(&pipe->hitsr, &max_nnzb, &bld, pipe->tk);
+        pipe->has_hitsr = result == 0;
+    }
+    sptFreeHiCOOBuilder(&bld);
+    pthread_join(init, NULL);
+    if(result == 0) {
+        result = pipe->init_result;
+    }
+    spt_CheckError(result, "CPD Pipeline", NULL);
+
+    result = sptNewRankKruskalTensor(&pipe->ktensor, pipe->nmodes, pipe->ndims, (sptElementIndex) pipe->rank);
+    spt_CheckError(result, "CPD Pipeline", NULL);
+    pipe->has_ktensor = 1;
+    pipe->ktensor.factors = pipe->init_factors;
+    pipe->init_factors = NULL;
+
+    spt_PipelineSetStage(pipe, SPT_PIPELINE_DECOMPOSING);
+    result = sptOmpCpdAlsHiCOO(&pipe->hitsr, pipe->rank, pipe->niters, pipe->tol, pipe->tk, &pipe->ktensor);
+    spt_CheckError(result, "CPD Pipeline", NULL);
+    return 0;
+}
+
+static void * spt_PipelineRun(void * arg) {
+    sptCpdPipeline const pipe = arg;
+    pipe->result = spt_PipelineDrive(pipe);
+    fclose(pipe->fp);
+    pipe->fp = NULL;
+    spt_PipelineSetStage(pipe, SPT_PIPELINE_DONE);
+    return NULL;
+}
+
+static void spt_FreePipeline(sptCpdPipeline pipe) {
+    if(pipe->fp != NULL) {
+        fclose(pipe->fp);
+    }
+    if(pipe->init_factors != NULL) {
+        for(sptIndex m = 0; m < pipe->nmodes; ++m) {
+            sptFreeRankMatrix(pipe->init_factors[m]);
+            free(pipe->init_factors[m]);
+        }
+        free(pipe->init_factors);
+    }
+    if(pipe->has_hitsr) {
+        sptFreeSparseTensorHiCOO(&pipe->hitsr);
+    }
+    if(pipe->has_ktensor) {
+        sptFreeRankKruskalTensor(&pipe->ktensor);
+    }
+    for(int b = 0; b < 2; ++b) {
+        free(pipe->batches[b].coords);
+        free(pipe->batches[b].values);
+    }
+    pthread_cond_destroy(&pipe->cond);
+    pthread_mutex_destroy(&pipe->lock);
+    free(pipe->ndims);
+    free(pipe->filename);
+    free(pipe);
+}
+
+
+/**
+ * Start loading a text tensor file, converting it to HiCOO and running
+ * CP-ALS on it as sptOmpCpdAlsHiCOO does, in the background. Parsing,
+ * binning nonzeros by kernel and drawing the initial factors overlap; see
+ * sptCpdPipelineStage for progress and sptWaitCpdPipeline for the result.
+ * @param[out] pipe        the handle of the running pipeline
+ * @param[in]  filename    a file in the format of sptLoadSparseTensor
+ * @param[in]  start_index the index of the first element, 1 for MATLAB files
+ * @param[in]  sb_bits     the bits of the HiCOO block size
+ * @param[in]  sk_bits     the bits of the HiCOO kernel size, at least sb_bits
+ * @param[in]  rank        the rank of the decomposition, below 256
+ * @param[in]  niters      the maximum number of iterations
+ * @param[in]  tol         the tolerance of the fit change
+ * @param[in]  tk          the number of threads of conversion and CP-ALS, 0 for the default
+ */
+int sptStartCpdAlsHiCOOPipeline(
+    sptCpdPipeline * pipe,
+    const char * filename,
+    sptIndex const start_index,
+    sptElementIndex const sb_bits,
+    sptElementIndex const sk_bits,
+    sptIndex const rank,
+    sptIndex const niters,
+    double const tol,
+    const int tk)
+{
+    if(rank == 0 || rank > 255 || sk_bits < sb_bits) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPD Pipeline", "rank not in 1..255 or sk_bits < sb_bits");
+    }
+    sptCpdPipeline p = calloc(1, sizeof *p);
+    spt_CheckOSError(!p, "CPD Pipeline");
+    p->fp = fopen(filename, "r");
+    if(p->fp == NULL) {
+        free(p);
+        spt_CheckOSError(1, "CPD Pipeline");
+    }
+    p->filename = strdup(filename);
+    p->start_index = start_index;
+    p->sb_bits = sb_bits;
+    p->sk_bits = sk_bits;
+    p->rank = rank;
+    p->niters = niters;
+    p->tol = tol;
+    p->tk = tk > 0 ? tk : sptExecThreads(0);
+    p->stage = SPT_PIPELINE_LOADING;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    if(pthread_create(&p->driver, NULL, spt_PipelineRun, p) != 0) {
+        spt_FreePipeline(p);
+        spt_CheckOSError(1, "CPD Pipeline");
+    }
+    *pipe = p;
+    return 0;
+}
+
+/**
+ * The stage a pipeline started by sptStartCpdAlsHiCOOPipeline has reached
+ */
+sptPipelineStage sptCpdPipelineStage(sptCpdPipeline pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    sptPipelineStage const stage = pipe->stage;
+    pthread_mutex_unlock(&pipe->lock);
+    return stage;
+}
+
+/**
+ * Wait for a pipeline started by sptStartCpdAlsHiCOOPipeline to finish and
+ * release it, handing over its results when it succeeded
+ * @param[in]  pipe    the pipeline, invalid afterwards
+ * @param[out] hitsr   the HiCOO tensor loaded, or NULL to release it
+ * @param[out] ktensor the decomposition
+ * @return the error of the first step that failed, or 0
+ */
+int sptWaitCpdPipeline(
+    sptCpdPipeline pipe,
+    sptSparseTensorHiCOO * hitsr,
+    sptRankKruskalTensor * ktensor)
+{
+    pthread_join(pipe->driver, NULL);
+    int const result = pipe->result;
+    if(result == 0) {
+        if(hitsr != NULL) {
+            *hitsr = pipe->hitsr;
+            pipe->has_hitsr = 0;
+        }
+        *ktensor = pipe->ktensor;
+        pipe->has_ktensor = 0;
+    }
+    spt_FreePipeline(pipe);
+    return result;
+}
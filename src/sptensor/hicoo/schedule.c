@@ -0,0 +1,176 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "hicoo.h"
+
+/*
+ * Kernel scheduler.
+ *
+ * kschr[m][r] lists the kernels of kernel row r in mode m, and the scheduled
+ * MTTKRPs run round i over the i-th kernel of every row. Two kernels conflict
+ * when they share a row, so the conflict graph is one clique per row and a
+ * coloring needs as many rounds as the longest row, nkiters[m], which any
+ * order within the rows reaches. What the order decides is the work in each
+ * round: rows are placed heaviest first, each putting its heaviest kernels
+ * into its least loaded rounds. A row of L kernels owns rounds 0..L-1, as the
+ * MTTKRPs take a row shorter than round i to be done with it.
+ */
+
+typedef struct {
+    sptNnzIndex weight;
+    sptIndex id;
+} spt_ScheduleItem;
+
+static int spt_ScheduleHeavier(void const * a, void const * b) {
+    spt_ScheduleItem const * const x = a;
+    spt_ScheduleItem const * const y = b;
+    if(x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : (x->id > y->id);
+}
+
+static int spt_ScheduleLighter(void const * a, void const * b) {
+    spt_ScheduleItem const * const x = a;
+    spt_ScheduleItem const * const y = b;
+    if(x->weight != y->weight) {
+        return x->weight < y->weight ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : (x->id > y->id);
+}
+
+
+/* Schedule mode m from the row of every kernel in that mode and its nonzeros */
+static int spt_ScheduleMode(
+    sptSparseTensorHiCOO *hitsr,
+    sptIndex const m,
+    sptIndex const * rows,
+    sptNnzIndex const * weights)
+{
+    sptIndex const nmodes = hitsr->nmodes;
+    sptNnzIndex const nk = hitsr->kptr.len - 1;
+    sptIndex const sk = (sptIndex)1 << hitsr->sk_bits;
+    sptIndex const kernel_ndim = (hitsr->ndims[m] + sk - 1) / sk;
+
+    /* Bucket the kernels by row, keeping their order */
+    sptNnzIndex * row_begin = calloc(kernel_ndim + 1, sizeof *row_begin);
+    spt_ScheduleItem * row_order = malloc((kernel_ndim > 0 ? kernel_ndim : 1) * sizeof *row_order);
+    sptIndex * by_row = malloc((nk > 0 ? nk : 1) * sizeof *by_row);
+    spt_CheckOSError(!row_begin || !row_order || !by_row, "HiSpTns Schedule");
+    for(sptIndex r = 0; r < kernel_ndim; ++r) {
+        row_order[r].weight = 0;
+        row_order[r].id = r;
+    }
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        sptIndex const r = rows[k * nmodes + m];
+        ++ row_begin[r + 1];
+        row_order[r].weight += weights[k];
+    }
+    sptIndex nkiters = 0;
+    for(sptIndex r = 0; r < kernel_ndim; ++r) {
+        if(nkiters < row_begin[r + 1]) {
+            nkiters = (sptIndex) row_begin[r + 1];
+        }
+        row_begin[r + 1] += row_begin[r];
+    }
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        by_row[row_begin[rows[k * nmodes + m]]++] = (sptIndex) k;
+    }
+    for(sptIndex r = kernel_ndim; r > 0; --r) {
+        row_begin[r] = row_begin[r - 1];
+    }
+    row_begin[0] = 0;
+    qsort(row_order, kernel_ndim, sizeof *row_order, spt_ScheduleHeavier);
+
+    sptNnzIndex * load = calloc(nkiters > 0 ? nkiters : 1, sizeof *load);
+    spt_ScheduleItem * kernels = malloc((nkiters > 0 ? nkiters : 1) * sizeof *kernels);
+    spt_ScheduleItem * rounds = malloc((nkiters > 0 ? nkiters : 1) * sizeof *rounds);
+    spt_CheckOSError(!load || !kernels || !rounds, "HiSpTns Schedule");
+    for(sptIndex i = 0; i < kernel_ndim; ++i) {
+        sptIndex const r = row_order[i].id;
+        sptIndex const len = (sptIndex) (row_begin[r + 1] - row_begin[r]);
+        for(sptIndex j = 0; j < len; ++j) {
+            sptIndex const k = by_row[row_begin[r] + j];
+            kernels[j].weight = weights[k];
+            kernels[j].id = k;
+            rounds[j].weight = load[j];
+            rounds[j].id = j;
+        }
+        qsort(kernels, len, sizeof *kernels, spt_ScheduleHeavier);
+        qsort(rounds, len, sizeof *rounds, spt_ScheduleLighter);
+        int result = sptResizeIndexVector(&hitsr->kschr[m][r], len);
+        spt_CheckError(result, "HiSpTns Schedule", NULL);
+        for(sptIndex j = 0; j < len; ++j) {
+            hitsr->kschr[m][r].data[rounds[j].id] = kernels[j].id;
+            load[rounds[j].id] += kernels[j].weight;
+        }
+    }
+    hitsr->nkiters[m] = nkiters;
+
+    free(row_begin);
+    free(row_order);
+    free(by_row);
+    free(load);
+    free(kernels);
+    free(rounds);
+    return 0;
+}
+
+
+/**
+ * Build the kernel scheduler kschr and nkiters of a HiCOO tensor from its
+ * kernel and block pointers and block indices, balancing the nonzeros of the
+ * rounds, see above. Modes are scheduled in parallel.
+ * @param[in,out] hitsr  a HiCOO tensor with empty kernel scheduler rows
+ * @param[in] tk    the number of threads
+ */
+int spt_HiCOOSetKernelScheduler(sptSparseTensorHiCOO *hitsr, int const tk)
+{
+    sptIndex const nmodes = hitsr->nmodes;
+    sptNnzIndex const nk = hitsr->kptr.len - 1;
+    sptIndex * rows = malloc((nk > 0 ? nk : 1) * nmodes * sizeof *rows);
+    sptNnzIndex * weights = malloc((nk > 0 ? nk : 1) * sizeof *weights);
+    spt_CheckOSError(!rows || !weights, "HiSpTns Schedule");
+
+    #pragma omp parallel for num_threads(tk)
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        sptNnzIndex const b = hitsr->kptr.data[k];
+        sptElementIndex const shift = hitsr->sk_bits - spt_HiCOOKernelBits(hitsr, k);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            rows[k * nmodes + m] = hitsr->binds[m].data[b] >> shift;
+        }
+        weights[k] = hitsr->bptr.data[hitsr->kptr.data[k+1]] - hitsr->bptr.data[b];
+    }
+
+    int failed = 0;
+    #pragma omp parallel for schedule(dynamic) num_threads(tk)
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(spt_ScheduleMode(hitsr, m, rows, weights) != 0) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+    }
+    free(rows);
+    free(weights);
+    if(failed) {
+        spt_CheckError(SPTERR_UNKNOWN, "HiSpTns Schedule", "scheduling a mode failed");
+    }
+    return 0;
+}
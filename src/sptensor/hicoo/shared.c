@@ -0,0 +1,313 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/* Mappable HiCOO container of sptPublishSparseTensorHiCOO */
+#define PARTI_HICOO_SHARED_MAGIC "PTIHISHM"
+
+typedef struct {
+    char magic[8];          /// PARTI_HICOO_SHARED_MAGIC, not NUL-terminated
+    uint32_t version;       /// PARTI_BINARY_VERSION
+    uint32_t endian;        /// PARTI_BINARY_ENDIAN as written by the producer
+    uint32_t nmodes;
+    uint8_t index_width;
+    uint8_t nnz_index_width;
+    uint8_t block_index_width;
+    uint8_t element_index_width;
+    uint8_t value_width;
+    uint8_t sb_bits;
+    uint8_t sk_bits;
+    uint8_t sc_bits;
+    uint64_t nnz;
+    uint64_t nblocks;
+    uint64_t nkptr;         /// length of kptr
+    uint64_t ncptr;         /// length of cptr
+    uint64_t meta_offset;   /// byte offset of ndims, sortorder, nkiters and the kernel schedule
+    uint64_t size;          /// bytes of the whole segment
+} spt_HiCOOSharedHeader;
+/* Followed, each padded to PARTI_BINARY_ALIGN, by bptr, binds[nmodes],
+   einds[nmodes], values, kptr and cptr; then sptIndex ndims, sortorder and
+   nkiters[nmodes], and each kschr[m][i] as a uint64 length and its indices.
+   bptr sits at a fixed offset, which is how a detach finds the mapping. */
+
+static uint64_t spt_HiCOOSharedDataOffset(void) {
+    return spt_BinaryAlignUp(sizeof(spt_HiCOOSharedHeader));
+}
+
+static sptIndex spt_HiCOOKernelDim(sptSparseTensorHiCOO const * const hitsr, sptIndex const m) {
+    sptIndex const sk = (sptIndex) 1 << hitsr->sk_bits;
+    return (hitsr->ndims[m] + sk - 1) / sk;
+}
+
+static int spt_SharedWrite(void const * data, uint64_t const bytes, int const pad, FILE *fp) {
+    static const char zeros[PARTI_BINARY_ALIGN] = { 0 };
+    if(bytes != 0 && fwrite(data, 1, bytes, fp) != bytes) {
+        return -1;
+    }
+    uint64_t const npad = pad ? spt_BinaryAlignUp(bytes) - bytes : 0;
+    if(npad != 0 && fwrite(zeros, 1, npad, fp) != npad) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Publish a HiCOO tensor under a name for other processes to attach, the
+ * HiCOO counterpart of sptPublishSparseTensor.
+ *
+ * @param hitsr the HiCOO tensor to publish, with uniform block sizes
+ * @param name  the segment name, "/name" for POSIX shared memory or a file path
+ */
+int sptPublishSparseTensorHiCOO(sptSparseTensorHiCOO const * const hitsr, const char *name) {
+    spt_CheckUniformBlocks(hitsr, "HiSpTns Publish");
+    sptIndex const nmodes = hitsr->nmodes;
+    sptNnzIndex const nblocks = hitsr->bptr.len != 0 ? hitsr->bptr.len - 1 : 0;
+
+    spt_HiCOOSharedHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_HICOO_SHARED_MAGIC, sizeof header.magic);
+    header.version = PARTI_BINARY_VERSION;
+    header.endian = PARTI_BINARY_ENDIAN;
+    header.nmodes = nmodes;
+    header.index_width = sizeof(sptIndex);
+    header.nnz_index_width = sizeof(sptNnzIndex);
+    header.block_index_width = sizeof(sptBlockIndex);
+    header.element_index_width = sizeof(sptElementIndex);
+    header.value_width = sizeof(sptValue);
+    header.sb_bits = hitsr->sb_bits;
+    header.sk_bits = hitsr->sk_bits;
+    header.sc_bits = hitsr->sc_bits;
+    header.nnz = hitsr->nnz;
+    header.nblocks = nblocks;
+    header.nkptr = hitsr->kptr.len;
+    header.ncptr = hitsr->cptr.len;
+    header.meta_offset = spt_HiCOOSharedDataOffset() +
+        spt_BinaryAlignUp(hitsr->bptr.len * sizeof(sptNnzIndex)) +
+        nmodes * spt_BinaryAlignUp(nblocks * sizeof(sptBlockIndex)) +
+        nmodes * spt_BinaryAlignUp(hitsr->nnz * sizeof(sptElementIndex)) +
+        spt_BinaryAlignUp(hitsr->nnz * sizeof(sptValue)) +
+        spt_BinaryAlignUp(hitsr->kptr.len * sizeof(sptNnzIndex)) +
+        spt_BinaryAlignUp(hitsr->cptr.len * sizeof(sptNnzIndex));
+    header.size = header.meta_offset + 3 * nmodes * sizeof(sptIndex);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        for(sptIndex i = 0; i < spt_HiCOOKernelDim(hitsr, m); ++i) {
+            header.size += sizeof(uint64_t) + hitsr->kschr[m][i].len * sizeof(sptIndex);
+        }
+    }
+
+    int fd = spt_OpenTensorSegment(name, O_CREAT | O_EXCL | O_WRONLY);
+    spt_CheckOSError(fd < 0, "HiSpTns Publish");
+    FILE * fp = fdopen(fd, "wb");
+    if(fp == NULL) {
+        close(fd);
+        sptUnpublishTensor(name);
+        spt_CheckOSError(1, "HiSpTns Publish");
+    }
+    /* Sequential writes: an early attacher sees fewer than header.size bytes */
+    int ok = spt_SharedWrite(&header, sizeof header, 1, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->bptr.data, hitsr->bptr.len * sizeof(sptNnzIndex), 1, fp) == 0;
+    for(sptIndex m = 0; ok && m < nmodes; ++m) {
+        ok = spt_SharedWrite(hitsr->binds[m].data, nblocks * sizeof(sptBlockIndex), 1, fp) == 0;
+    }
+    for(sptIndex m = 0; ok && m < nmodes; ++m) {
+        ok = spt_SharedWrite(hitsr->einds[m].data, hitsr->nnz * sizeof(sptElementIndex), 1, fp) == 0;
+    }
+    ok = ok && spt_SharedWrite(hitsr->values.data, hitsr->nnz * sizeof(sptValue), 1, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->kptr.data, hitsr->kptr.len * sizeof(sptNnzIndex), 1, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->cptr.data, hitsr->cptr.len * sizeof(sptNnzIndex), 1, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->ndims, nmodes * sizeof(sptIndex), 0, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->sortorder, nmodes * sizeof(sptIndex), 0, fp) == 0;
+    ok = ok && spt_SharedWrite(hitsr->nkiters, nmodes * sizeof(sptIndex), 0, fp) == 0;
+    for(sptIndex m = 0; ok && m < nmodes; ++m) {
+        for(sptIndex i = 0; ok && i < spt_HiCOOKernelDim(hitsr, m); ++i) {
+            uint64_t const len = hitsr->kschr[m][i].len;
+            ok = spt_SharedWrite(&len, sizeof len, 0, fp) == 0 &&
+                spt_SharedWrite(hitsr->kschr[m][i].data, len * sizeof(sptIndex), 0, fp) == 0;
+        }
+    }
+    int const saved = errno;
+    ok = fclose(fp) == 0 && ok;
+    if(!ok) {
+        errno = saved;
+        sptUnpublishTensor(name);
+        spt_CheckOSError(1, "HiSpTns Publish");
+    }
+    return 0;
+}
+
+/* Copy n bytes of segment metadata, failing past the end */
+static int spt_SharedRead(void * dst, size_t const n, char const ** p, char const * end) {
+    if((size_t) (end - *p) < n) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Attach", "segment truncated");
+    }
+    memcpy(dst, *p, n);
+    *p += n;
+    return 0;
+}
+
+/**
+ * Attach a HiCOO tensor published by sptPublishSparseTensorHiCOO without
+ * copying its blocks, elements or values.
+ *
+ * The mapping is copy-on-write, as for sptAttachSparseTensor; read-only
+ * kernels such as the HiCOO MTTKRP work on it directly. The kernel schedule
+ * and small per-mode arrays are private copies. Release it with
+ * sptDetachSparseTensorHiCOO, not sptFreeSparseTensorHiCOO.
+ *
+ * @param hitsr an uninitialized HiCOO tensor
+ * @param name  the segment name
+ */
+int sptAttachSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr, const char *name) {
+    int result;
+    int fd = spt_OpenTensorSegment(name, O_RDONLY);
+    spt_CheckOSError(fd < 0, "HiSpTns Attach");
+    struct stat st;
+    result = fstat(fd, &st);
+    if(result != 0 || (uint64_t) st.st_size < spt_HiCOOSharedDataOffset()) {
+        close(fd);
+        spt_CheckOSError(result != 0, "HiSpTns Attach");
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Attach", "segment too small");
+    }
+    char * base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    spt_CheckOSError(base == MAP_FAILED, "HiSpTns Attach");
+
+    spt_HiCOOSharedHeader const * const header = (spt_HiCOOSharedHeader const *) base;
+    char const * reason = NULL;
+    if(memcmp(header->magic, PARTI_HICOO_SHARED_MAGIC, sizeof header->magic) != 0) {
+        reason = "not a published HiCOO tensor";
+    } else if(header->endian != PARTI_BINARY_ENDIAN || header->version > PARTI_BINARY_VERSION) {
+        reason = "byte order or format version mismatch";
+    } else if(header->index_width != sizeof(sptIndex) || header->nnz_index_width != sizeof(sptNnzIndex) ||
+        header->block_index_width != sizeof(sptBlockIndex) || header->element_index_width != sizeof(sptElementIndex) ||
+        header->value_width != sizeof(sptValue)) {
+        reason = "type widths differ from this build";
+    } else if(header->size > (uint64_t) st.st_size || header->meta_offset > header->size) {
+        reason = "segment truncated";
+    }
+    if(reason != NULL) {
+        munmap(base, st.st_size);
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns Attach", reason);
+    }
+
+    sptIndex const nmodes = header->nmodes;
+    sptNnzIndex const nnz = header->nnz;
+    sptNnzIndex const nblocks = header->nblocks;
+    memset(hitsr, 0, sizeof *hitsr);
+    hitsr->nmodes = nmodes;
+    hitsr->nnz = nnz;
+    hitsr->sb_bits = header->sb_bits;
+    hitsr->sk_bits = header->sk_bits;
+    hitsr->sc_bits = header->sc_bits;
+    hitsr->ndims = malloc(nmodes * sizeof *hitsr->ndims);
+    hitsr->sortorder = malloc(nmodes * sizeof *hitsr->sortorder);
+    hitsr->nkiters = malloc(nmodes * sizeof *hitsr->nkiters);
+    hitsr->kschr = calloc(nmodes, sizeof *hitsr->kschr);
+    hitsr->binds = malloc(nmodes * sizeof *hitsr->binds);
+    hitsr->einds = malloc(nmodes * sizeof *hitsr->einds);
+    spt_CheckOSError(!hitsr->ndims || !hitsr->sortorder || !hitsr->nkiters || !hitsr->kschr ||
+        !hitsr->binds || !hitsr->einds, "HiSpTns Attach");
+    result = sptNewElementIndexVector(&hitsr->kbits, 0, 0);
+    spt_CheckError(result, "HiSpTns Attach", NULL);
+
+    /* The large arrays stay in the mapping */
+    char * data = base + spt_HiCOOSharedDataOffset();
+#define SPT_SHARED_VECTOR(vec, n) do { \
+        (vec).len = (vec).cap = (n); \
+        (vec).data = (void *) data; \
+        data += spt_BinaryAlignUp((n) * sizeof *(vec).data); \
+    } while(0)
+    SPT_SHARED_VECTOR(hitsr->bptr, nblocks + 1);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        SPT_SHARED_VECTOR(hitsr->binds[m], nblocks);
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        SPT_SHARED_VECTOR(hitsr->einds[m], nnz);
+    }
+    SPT_SHARED_VECTOR(hitsr->values, nnz);
+    SPT_SHARED_VECTOR(hitsr->kptr, header->nkptr);
+    SPT_SHARED_VECTOR(hitsr->cptr, header->ncptr);
+#undef SPT_SHARED_VECTOR
+
+    /* The metadata is copied */
+    char const * p = base + header->meta_offset;
+    char const * const end = base + header->size;
+    result = spt_SharedRead(hitsr->ndims, nmodes * sizeof(sptIndex), &p, end);
+    result = result != 0 ? result : spt_SharedRead(hitsr->sortorder, nmodes * sizeof(sptIndex), &p, end);
+    result = result != 0 ? result : spt_SharedRead(hitsr->nkiters, nmodes * sizeof(sptIndex), &p, end);
+    for(sptIndex m = 0; result == 0 && m < nmodes; ++m) {
+        sptIndex const kernel_ndim = spt_HiCOOKernelDim(hitsr, m);
+        hitsr->kschr[m] = calloc(kernel_ndim, sizeof *hitsr->kschr[m]);
+        spt_CheckOSError(kernel_ndim != 0 && !hitsr->kschr[m], "HiSpTns Attach");
+        for(sptIndex i = 0; result == 0 && i < kernel_ndim; ++i) {
+            uint64_t len;
+            result = spt_SharedRead(&len, sizeof len, &p, end);
+            result = result != 0 ? result : sptNewIndexVector(&hitsr->kschr[m][i], len, len);
+            result = result != 0 ? result : spt_SharedRead(hitsr->kschr[m][i].data, len * sizeof(sptIndex), &p, end);
+        }
+    }
+    if(result != 0) {
+        sptDetachSparseTensorHiCOO(hitsr);
+        spt_CheckError(result, "HiSpTns Attach", NULL);
+    }
+    return 0;
+}
+
+/**
+ * Release a HiCOO tensor from sptAttachSparseTensorHiCOO. The segment itself
+ * stays published.
+ * @param hitsr the attached tensor
+ */
+void sptDetachSparseTensorHiCOO(sptSparseTensorHiCOO *hitsr) {
+    sptIndex const nmodes = hitsr->nmodes;
+    if(nmodes == 0) {
+        return;
+    }
+    char * base = (char *) hitsr->bptr.data - spt_HiCOOSharedDataOffset();
+    spt_HiCOOSharedHeader const * const header = (spt_HiCOOSharedHeader const *) base;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(hitsr->kschr[m] == NULL) {
+            continue;
+        }
+        for(sptIndex i = 0; i < spt_HiCOOKernelDim(hitsr, m); ++i) {
+            sptFreeIndexVector(&hitsr->kschr[m][i]);
+        }
+        free(hitsr->kschr[m]);
+    }
+    free(hitsr->kschr);
+    sptFreeElementIndexVector(&hitsr->kbits);
+    munmap(base, header->size);
+    free(hitsr->nkiters);
+    free(hitsr->binds);
+    free(hitsr->einds);
+    free(hitsr->sortorder);
+    free(hitsr->ndims);
+    hitsr->nmodes = 0;
+    hitsr->nnz = 0;
+}
@@ -39,32 +39,35 @@ void sptSparseTensorStatusHiCOO(sptSparseTensorHiCOO *hitsr, FILE *fp)
   fprintf(fp, " sk=%"PARTI_PRI_INDEX, (sptIndex)pow(2, hitsr->sk_bits));
   fprintf(fp, " sc=%"PARTI_PRI_INDEX, (sptIndex)pow(2, hitsr->sc_bits));
   fprintf(fp, "\n");
+  if(hitsr->kbits.len != 0) {
+    /* Adaptive block sizes: sb above is the largest, count the kernels of each */
+    sptNnzIndex nk_bits[9] = { 0 };
+    for(sptNnzIndex k=0; k < hitsr->kbits.len; ++k) {
+      ++ nk_bits[hitsr->kbits.data[k]];
+    }
+    fprintf(fp, "kernels by sb:");
+    for(sptElementIndex b=0; b <= 8; ++b) {
+      if(nk_bits[b] != 0) {
+        fprintf(fp, " %"PARTI_PRI_INDEX"=%"PARTI_PRI_NNZ_INDEX, (sptIndex)1 << b, nk_bits[b]);
+      }
+    }
+    fprintf(fp, "\n");
+  }
   fprintf(fp, "nb=%"PARTI_PRI_NNZ_INDEX, hitsr->bptr.len - 1);
   fprintf(fp, " nk=%"PARTI_PRI_NNZ_INDEX, hitsr->kptr.len - 1);
   fprintf(fp, " nc=%"PARTI_PRI_NNZ_INDEX, hitsr->cptr.len - 1);
   fprintf(fp, "\n");
 
-  sptNnzIndex bytes = hitsr->nnz * ( sizeof(sptValue) + nmodes * sizeof(sptElementIndex) );
-  bytes += hitsr->binds[0].len * nmodes * sizeof(sptBlockIndex);
-  bytes += hitsr->bptr.len * sizeof(sptNnzIndex);
-  bytes += hitsr->kptr.len * sizeof(sptNnzIndex);
-  bytes += hitsr->cptr.len * sizeof(sptNnzIndex);
-  /* add kschr */
   sptIndex sk = (sptIndex)pow(2, hitsr->sk_bits);
-  for(sptIndex m=0; m < nmodes; ++m) {
-    sptIndex kernel_ndim = (hitsr->ndims[m] + sk - 1)/sk;
-    for(sptIndex i=0; i < kernel_ndim; ++i) {
-      bytes += hitsr->kschr[m][i].len * sizeof(sptIndex);
-    }
-    bytes += kernel_ndim * sizeof(sptIndexVector *);
-  }
-  bytes += nmodes * sizeof(sptIndexVector **);
-  /* add nkiters  */
-  bytes += nmodes * sizeof(sptIndex);
+  sptNnzIndex bytes = spt_SparseTensorHiCOOBytes(hitsr);
 
   char * bytestr = sptBytesString(bytes);
   fprintf(fp, "HiCOO-STORAGE=%s\n", bytestr);
   free(bytestr);
+  fprintf(fp, "BACKING: binds=%s einds=%s values=%s\n",
+    sptMemBackingString(sptMemBackingOf(hitsr->binds[0].data)),
+    sptMemBackingString(sptMemBackingOf(hitsr->einds[0].data)),
+    sptMemBackingString(sptMemBackingOf(hitsr->values.data)));
 
   fprintf(fp, "SCHEDULE INFO [KERNEL]: \n");
   for(sptIndex m=0; m < nmodes; ++m) {
@@ -0,0 +1,177 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "hicoo.h"
+
+/*
+ * Work-stealing over weighted tasks.
+ *
+ * The tasks are dealt heaviest first to the least loaded queue, so each
+ * thread starts with about the same amount of work and its heaviest tasks
+ * first. A thread claims its own tasks in that order, and once its queue is
+ * empty claims the next task of the other queues in turn. A claim is one
+ * atomic increment of the queue's cursor, so threads only wait on each other
+ * at the end of the parallel region, not between rounds.
+ */
+
+/* Queue cursors a cache line apart */
+#define SPT_STEAL_PAD (64 / sizeof (sptIndex))
+
+typedef struct {
+    sptNnzIndex weight;
+    sptIndex task;
+} spt_StealTask;
+
+static int spt_StealHeavier(void const * a, void const * b) {
+    spt_StealTask const * const x = a;
+    spt_StealTask const * const y = b;
+    if(x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->task < y->task ? -1 : 1;
+}
+
+
+/**
+ * Deal ntasks tasks of the given weights to nqueues work-stealing queues.
+ * Tasks of weight 0 are left out.
+ */
+int spt_NewStealQueues(
+    spt_StealQueues * queues,
+    sptNnzIndex const * weights,
+    sptIndex const ntasks,
+    int const nqueues)
+{
+    if(nqueues < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Steal Queues", "nqueues < 1");
+    }
+    spt_StealTask * order = malloc((ntasks > 0 ? ntasks : 1) * sizeof *order);
+    sptIndex * owner = malloc((ntasks > 0 ? ntasks : 1) * sizeof *owner);
+    sptNnzIndex * load = calloc(nqueues, sizeof *load);
+    queues->tasks = malloc((ntasks > 0 ? ntasks : 1) * sizeof *queues->tasks);
+    queues->begin = calloc(nqueues + 1, sizeof *queues->begin);
+    queues->next = calloc((size_t) nqueues * SPT_STEAL_PAD, sizeof *queues->next);
+    spt_CheckOSError(!order || !owner || !load || !queues->tasks || !queues->begin || !queues->next, "Steal Queues");
+    queues->nqueues = nqueues;
+
+    sptIndex nwork = 0;
+    for(sptIndex t = 0; t < ntasks; ++t) {
+        if(weights[t] != 0) {
+            order[nwork].weight = weights[t];
+            order[nwork].task = t;
+            ++nwork;
+        }
+    }
+    qsort(order, nwork, sizeof *order, spt_StealHeavier);
+
+    /* Heaviest first to the least loaded queue */
+    for(sptIndex x = 0; x < nwork; ++x) {
+        int lightest = 0;
+        for(int q = 1; q < nqueues; ++q) {
+            if(load[q] < load[lightest]) {
+                lightest = q;
+            }
+        }
+        owner[x] = (sptIndex) lightest;
+        load[lightest] += order[x].weight;
+        ++queues->begin[lightest + 1];
+    }
+    for(int q = 0; q < nqueues; ++q) {
+        queues->begin[q + 1] += queues->begin[q];
+        queues->next[(size_t) q * SPT_STEAL_PAD] = queues->begin[q];
+    }
+    /* Keep each queue heaviest first */
+    for(sptIndex x = 0; x < nwork; ++x) {
+        sptIndex const q = owner[x];
+        queues->tasks[queues->next[(size_t) q * SPT_STEAL_PAD]++] = order[x].task;
+    }
+    for(int q = 0; q < nqueues; ++q) {
+        queues->next[(size_t) q * SPT_STEAL_PAD] = queues->begin[q];
+    }
+
+    free(order);
+    free(owner);
+    free(load);
+    return 0;
+}
+
+
+/**
+ * Claim the next task for thread self: its own queue first, then the others.
+ * Returns 0 once every task has been claimed.
+ */
+int spt_StealNext(spt_StealQueues * queues, int const self, sptIndex * task) {
+    int const nqueues = queues->nqueues;
+    for(int v = 0; v < nqueues; ++v) {
+        int const q = (self + v) % nqueues;
+        sptIndex * const cursor = &queues->next[(size_t) q * SPT_STEAL_PAD];
+        sptIndex const end = queues->begin[q + 1];
+        sptIndex pos;
+        #pragma omp atomic read
+        pos = *cursor;
+        if(pos >= end) {
+            continue;
+        }
+        #pragma omp atomic capture
+        pos = (*cursor)++;
+        if(pos < end) {
+            *task = queues->tasks[pos];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+void spt_FreeStealQueues(spt_StealQueues * queues) {
+    free(queues->tasks);
+    free(queues->begin);
+    free(queues->next);
+}
+
+
+/**
+ * Queues of the kernel rows of a mode, one task per row weighted by its
+ * nonzeros. The kernels of a row write only that row's output rows, so
+ * taking a row whole keeps every output row with a single owner.
+ */
+int spt_NewHiCOOKernelRowQueues(
+    spt_StealQueues * queues,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptIndex const mode,
+    int const nqueues)
+{
+    sptIndex const sk = (sptIndex)pow(2, hitsr->sk_bits);
+    sptIndex const num_kernel_dim = (hitsr->ndims[mode] + sk - 1) / sk;
+    sptIndexVector const * const kschr_mode = hitsr->kschr[mode];
+    sptNnzIndex * weights = malloc((num_kernel_dim > 0 ? num_kernel_dim : 1) * sizeof *weights);
+    spt_CheckOSError(!weights, "Steal Queues");
+    for(sptIndex k = 0; k < num_kernel_dim; ++k) {
+        weights[k] = 0;
+        for(sptIndex i = 0; i < kschr_mode[k].len; ++i) {
+            sptIndex const kptr_loc = kschr_mode[k].data[i];
+            weights[k] += hitsr->bptr.data[hitsr->kptr.data[kptr_loc+1]] - hitsr->bptr.data[hitsr->kptr.data[kptr_loc]];
+        }
+    }
+    int const result = spt_NewStealQueues(queues, weights, num_kernel_dim, nqueues);
+    free(weights);
+    spt_CheckError(result, "Steal Queues", NULL);
+    return 0;
+}
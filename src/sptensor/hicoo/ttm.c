@@ -0,0 +1,272 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hicoo.h"
+#include "../sptensor.h"
+
+/*
+ * TTM and TTV straight on HiCOO, without a COO copy of the tensor.
+ *
+ * A mode-n fiber of X lies in the blocks that share their block indices in
+ * every mode but n. Such blocks form a group, found by sorting the blocks on
+ * those indices. Within a group, a fiber is named by the element indices of
+ * the other modes, packed into one word, so sorting the group's nonzeros on
+ * that word lines up the fibers. Each group then owns a dense tile of the
+ * output, its fibers times the columns of U, which one thread fills without
+ * atomics. Fibers come out in block order, not in the order of the COO TTM.
+ */
+
+typedef struct {
+    uint64_t key;       /// packed element indices of the other modes
+    sptNnzIndex z;      /// the nonzero
+    sptNnzIndex b;      /// its block
+} spt_HiCOOFiberEntry;
+
+typedef struct {
+    sptSparseTensorHiCOO const * hitsr;
+    sptIndex const * modes;     /// the modes other than the product mode
+} spt_HiCOOBlockKeyCtx;
+
+
+static void spt_HiCOOBlockKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    spt_HiCOOBlockKeyCtx const * const c = ctx;
+    sptBlockIndex const * const binds = c->hitsr->binds[c->modes[word]].data;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = binds[perm[i]];
+    }
+}
+
+
+static int spt_HiCOOFiberEntryCompare(void const * a, void const * b) {
+    spt_HiCOOFiberEntry const * const x = a;
+    spt_HiCOOFiberEntry const * const y = b;
+    if(x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->z < y->z ? -1 : x->z > y->z;
+}
+
+
+static int spt_HiCOOMulMatrix(
+    sptSemiSparseTensor *Y,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptValue const * const U,
+    sptIndex const ustride,
+    sptIndex const ncols,
+    sptIndex const mode,
+    int const tk,
+    const char *module)
+{
+    spt_CheckUniformBlocks(hitsr, module);
+    int result;
+    sptIndex const nmodes = hitsr->nmodes;
+    sptElementIndex const sb_bits = hitsr->sb_bits;
+    sptNnzIndex const nblocks = hitsr->bptr.len - 1;
+    sptNnzIndex const * const bptr = hitsr->bptr.data;
+    if((nmodes - 1) * sb_bits > 64) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "block too large to name its fibers");
+    }
+
+    sptIndex * const modes = malloc(nmodes * sizeof *modes);
+    unsigned * const word_bits = malloc(nmodes * sizeof *word_bits);
+    sptIndex * const ind_buf = malloc(nmodes * sizeof *ind_buf);
+    sptNnzIndex * const order = malloc((nblocks + 1) * sizeof *order);
+    spt_CheckOSError(!modes || !word_bits || !ind_buf || !order, module);
+    sptIndex nother = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ind_buf[m] = hitsr->ndims[m];
+        if(m != mode) {
+            modes[nother] = m;
+            word_bits[nother] = spt_RadixBitWidth(((hitsr->ndims[m] - 1) >> sb_bits) + 1);
+            ++nother;
+        }
+    }
+    ind_buf[mode] = ncols;
+    result = sptNewSemiSparseTensor(Y, nmodes, mode, ind_buf);
+    free(ind_buf);
+    spt_CheckError(result, module, NULL);
+
+    /* Blocks in group order */
+    spt_HiCOOBlockKeyCtx const ctx = { hitsr, modes };
+    result = spt_RadixSortPermutation(order, nblocks, nother, word_bits, spt_HiCOOBlockKey, &ctx, tk);
+    spt_CheckError(result, module, NULL);
+
+    /* Group starts in order, and the first entry of each group */
+    sptNnzIndex ngroups = 0;
+    sptNnzIndex * const gptr = malloc((nblocks + 1) * sizeof *gptr);
+    sptNnzIndex * const eptr = malloc((nblocks + 1) * sizeof *eptr);
+    spt_CheckOSError(!gptr || !eptr, module);
+    eptr[0] = 0;
+    for(sptNnzIndex i = 0; i < nblocks; ++i) {
+        sptNnzIndex const b = order[i];
+        int is_new = i == 0;
+        for(sptIndex k = 0; k < nother && !is_new; ++k) {
+            is_new = hitsr->binds[modes[k]].data[b] != hitsr->binds[modes[k]].data[order[i-1]];
+        }
+        if(is_new) {
+            gptr[ngroups] = i;
+            eptr[ngroups+1] = eptr[ngroups];
+            ++ngroups;
+        }
+        eptr[ngroups] += bptr[b+1] - bptr[b];
+    }
+    gptr[ngroups] = nblocks;
+
+    /* Sort each group's nonzeros by fiber and count its fibers */
+    spt_HiCOOFiberEntry * const entries = malloc((hitsr->nnz > 0 ? hitsr->nnz : 1) * sizeof *entries);
+    sptNnzIndex * const fptr = malloc((ngroups + 1) * sizeof *fptr);
+    spt_CheckOSError(!entries || !fptr, module);
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(tk)
+    for(sptNnzIndex g = 0; g < ngroups; ++g) {
+        spt_HiCOOFiberEntry * const ge = entries + eptr[g];
+        sptNnzIndex n = 0;
+        for(sptNnzIndex i = gptr[g]; i < gptr[g+1]; ++i) {
+            sptNnzIndex const b = order[i];
+            for(sptNnzIndex z = bptr[b]; z < bptr[b+1]; ++z) {
+                uint64_t key = 0;
+                for(sptIndex k = 0; k < nother; ++k) {
+                    key = (key << sb_bits) | hitsr->einds[modes[k]].data[z];
+                }
+                ge[n].key = key;
+                ge[n].z = z;
+                ge[n].b = b;
+                ++n;
+            }
+        }
+        qsort(ge, n, sizeof *ge, spt_HiCOOFiberEntryCompare);
+        sptNnzIndex nfibers = n > 0;
+        for(sptNnzIndex i = 1; i < n; ++i) {
+            nfibers += ge[i].key != ge[i-1].key;
+        }
+        fptr[g+1] = nfibers;
+    }
+    fptr[0] = 0;
+    for(sptNnzIndex g = 0; g < ngroups; ++g) {
+        fptr[g+1] += fptr[g];
+    }
+
+    sptNnzIndex const nfibers = fptr[ngroups];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            result = sptResizeIndexVector(&Y->inds[m], nfibers);
+            spt_CheckError(result, module, NULL);
+        }
+    }
+    result = sptResizeMatrix(&Y->values, nfibers);
+    spt_CheckError(result, module, NULL);
+    Y->nnz = nfibers;
+    memset(Y->values.values, 0, nfibers * Y->stride * sizeof (sptValue));
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    /* Fill each group's output tile */
+    sptIndex const ystride = Y->stride;
+    sptBlockIndex const * const mode_binds = hitsr->binds[mode].data;
+    sptElementIndex const * const mode_einds = hitsr->einds[mode].data;
+    sptValue const * const vals = hitsr->values.data;
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(tk)
+    for(sptNnzIndex g = 0; g < ngroups; ++g) {
+        spt_HiCOOFiberEntry const * const ge = entries + eptr[g];
+        sptNnzIndex const n = eptr[g+1] - eptr[g];
+        sptNnzIndex f = fptr[g];
+        sptValue * restrict tile = Y->values.values + f * ystride;
+        for(sptNnzIndex i = 0; i < n; ++i) {
+            sptNnzIndex const z = ge[i].z;
+            sptNnzIndex const b = ge[i].b;
+            if(i == 0 || ge[i].key != ge[i-1].key) {
+                if(i > 0) {
+                    ++f;
+                    tile += ystride;
+                }
+                for(sptIndex k = 0; k < nother; ++k) {
+                    sptIndex const m = modes[k];
+                    Y->inds[m].data[f] = ((sptIndex) hitsr->binds[m].data[b] << sb_bits) + hitsr->einds[m].data[z];
+                }
+            }
+            sptIndex const r = ((sptIndex) mode_binds[b] << sb_bits) + mode_einds[z];
+            sptValue const v = vals[z];
+            sptValue const * const restrict urow = U + (sptNnzIndex) r * ustride;
+            #pragma omp simd
+            for(sptIndex c = 0; c < ncols; ++c) {
+                tile[c] += v * urow[c];
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, module);
+    sptFreeTimer(timer);
+
+    free(entries);
+    free(fptr);
+    free(gptr);
+    free(eptr);
+    free(order);
+    free(word_bits);
+    free(modes);
+    return 0;
+}
+
+
+/**
+ * OpenMP parallelized HiCOO sparse tensor times a dense matrix (TTM)
+ * @param[out] Y    an uninitialized semi-sparse tensor, dense in mode, with its fibers in block order
+ * @param[in]  hitsr the HiCOO sparse tensor X
+ * @param[in]  U    the dense matrix, ndims[mode] rows
+ * @param[in]  mode the mode on which the multiplication is done
+ * @param[in]  tk   the number of threads
+ */
+int sptOmpSparseTensorMulMatrixHiCOO(
+    sptSemiSparseTensor *Y,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix const * const U,
+    sptIndex const mode,
+    int const tk)
+{
+    if(mode >= hitsr->nmodes || hitsr->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiSpTns * Mtx", "shape mismatch");
+    }
+    return spt_HiCOOMulMatrix(Y, hitsr, U->values, U->stride, U->ncols, mode, tk, "OMP  HiSpTns * Mtx");
+}
+
+
+/**
+ * OpenMP parallelized HiCOO sparse tensor times a vector (TTV)
+ * @param[out] Y    an uninitialized semi-sparse tensor of size 1 in mode, with its fibers in block order
+ * @param[in]  hitsr the HiCOO sparse tensor X
+ * @param[in]  V    the vector, ndims[mode] long
+ * @param[in]  mode the mode on which the multiplication is done
+ * @param[in]  tk   the number of threads
+ */
+int sptOmpSparseTensorMulVectorHiCOO(
+    sptSemiSparseTensor *Y,
+    sptSparseTensorHiCOO const * const hitsr,
+    sptValueVector const * const V,
+    sptIndex const mode,
+    int const tk)
+{
+    if(mode >= hitsr->nmodes || hitsr->ndims[mode] != V->len) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  HiSpTns * Vec", "shape mismatch");
+    }
+    return spt_HiCOOMulMatrix(Y, hitsr, V->data, 1, 1, mode, tk, "OMP  HiSpTns * Vec");
+}
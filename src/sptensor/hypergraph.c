@@ -0,0 +1,490 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Fine-grained partitioning for distributed CP-ALS. Nonzeros are the vertices
+ * of a hypergraph with one net per factor row, connecting the nonzeros of that
+ * slice. A row whose net spans lambda parts is folded from and expanded to
+ * lambda - 1 of them every sweep, so the communication volume is the
+ * connectivity-1 cut, which is what the partitioner minimizes.
+ *
+ * It starts from the best of the per-mode slice partitions, which cut no net
+ * of their own mode, and refines by moving single nonzeros to the part that
+ * lowers the cut most while the parts stay within the imbalance bound. Pin
+ * counts are kept dense, sum(ndims) x nparts, which suits the rank counts of
+ * an MPI job; an external partitioner can be used instead by writing its
+ * parts with sptDumpPartitionedSparseTensor.
+ */
+
+/* Refinement passes over the nonzeros at most */
+#define PARTI_HYPERGRAPH_PASSES 8
+
+#define PARTI_OWNER_MAGIC "PTIOWNER"
+
+typedef struct {
+    char magic[8];          /// PARTI_OWNER_MAGIC, not NUL-terminated
+    uint32_t version;       /// PARTI_BINARY_VERSION
+    uint32_t endian;        /// PARTI_BINARY_ENDIAN as written by the producer
+    uint32_t nmodes;
+    uint32_t nparts;
+} spt_RowOwnershipHeader;
+/* Followed by uint64 ndims[nmodes], then int32 owner[ndims[m]] of each mode */
+
+
+/* Pins of every net in every part, row i of mode m at pins[m][i * nparts + p] */
+static uint32_t ** spt_NewPins(sptSparseTensor const * tsr, int const * part, int const nparts)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    uint32_t ** pins = calloc(nmodes, sizeof *pins);
+    if(pins == NULL) {
+        return NULL;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        pins[m] = calloc((size_t) tsr->ndims[m] * nparts, sizeof *pins[m]);
+        if(pins[m] == NULL) {
+            return NULL;
+        }
+        sptIndex const * inds = tsr->inds[m].data;
+        for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+            ++pins[m][(size_t) inds[z] * nparts + part[z]];
+        }
+    }
+    return pins;
+}
+
+static void spt_FreePins(uint32_t ** pins, sptIndex const nmodes)
+{
+    if(pins != NULL) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            free(pins[m]);
+        }
+        free(pins);
+    }
+}
+
+/* Rows folded from other parts each sweep: per row, the parts it spans other
+   than its owner, or than one of them when there are no owners yet */
+static sptNnzIndex spt_PinsVolume(uint32_t * const * pins, sptSparseTensor const * tsr, int const nparts, int * const * owner)
+{
+    sptNnzIndex volume = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        for(sptIndex i = 0; i < tsr->ndims[m]; ++i) {
+            uint32_t const * row = pins[m] + (size_t) i * nparts;
+            sptNnzIndex spans = 0;
+            for(int p = 0; p < nparts; ++p) {
+                spans += row[p] != 0 && (owner == NULL || owner[m][i] != p);
+            }
+            volume += owner == NULL && spans > 0 ? spans - 1 : spans;
+        }
+    }
+    return volume;
+}
+
+/* Each nonzero to the part of its slice in the slice partition of mode */
+static int spt_SlicePartition(int * part, sptSparseTensor const * tsr, sptIndex const mode, int const nparts)
+{
+    sptNnzIndex const * ptr = spt_SparseTensorSlicePtr(tsr, mode);
+    sptNnzIndex * bounds = malloc((nparts + 1) * sizeof *bounds);
+    int * slice_part = malloc(((size_t) tsr->ndims[mode] + 1) * sizeof *slice_part);
+    spt_CheckOSError(!ptr || !bounds || !slice_part, "SpTns Hypergraph");
+    int result = spt_PartitionSegments(bounds, ptr, tsr->ndims[mode], nparts);
+    spt_CheckError(result, "SpTns Hypergraph", NULL);
+    for(int p = 0; p < nparts; ++p) {
+        for(sptNnzIndex i = bounds[p]; i < bounds[p+1]; ++i) {
+            slice_part[i] = p;
+        }
+    }
+    sptIndex const * inds = tsr->inds[mode].data;
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        part[z] = slice_part[inds[z]];
+    }
+    free(slice_part);
+    free(bounds);
+    return 0;
+}
+
+
+/**
+ * Partition the nonzeros of a tensor among nparts ranks so that the factor
+ * rows they share are few, and give every row an owner among the ranks that
+ * touch it, balancing the owned rows between equals. See the notes at the top
+ * of hypergraph.c for the model and the heuristic.
+ *
+ * @param[out] part      the rank of each nonzero, length nnz
+ * @param[out] own       the row ownership, uninitialized
+ * @param[in]  tsr       the tensor
+ * @param[in]  nparts    the number of ranks
+ * @param[in]  imbalance the allowed excess of a rank's nonzeros over the mean, e.g. 0.03
+ */
+int sptHypergraphPartition(
+    int * part,
+    sptRowOwnership * own,
+    sptSparseTensor const * tsr,
+    int const nparts,
+    double const imbalance)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(nparts < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Hypergraph", "nparts < 1");
+    }
+    if(!(imbalance >= 0)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Hypergraph", "imbalance < 0");
+    }
+
+    /* The slice partition of the mode that cuts the fewest rows of the others */
+    int * trial = malloc(nnz * sizeof *trial);
+    spt_CheckOSError(!trial && nnz != 0, "SpTns Hypergraph");
+    uint32_t ** pins = NULL;
+    sptNnzIndex best_volume = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        int result = spt_SlicePartition(trial, tsr, m, nparts);
+        spt_CheckError(result, "SpTns Hypergraph", NULL);
+        uint32_t ** trial_pins = spt_NewPins(tsr, trial, nparts);
+        spt_CheckOSError(!trial_pins, "SpTns Hypergraph");
+        sptNnzIndex const volume = spt_PinsVolume(trial_pins, tsr, nparts, NULL);
+        if(pins == NULL || volume < best_volume) {
+            spt_FreePins(pins, nmodes);
+            pins = trial_pins;
+            best_volume = volume;
+            memcpy(part, trial, nnz * sizeof *part);
+        } else {
+            spt_FreePins(trial_pins, nmodes);
+        }
+    }
+    free(trial);
+
+    /* Move nonzeros to the part with the largest cut reduction, within the balance bound */
+    sptNnzIndex * load = calloc(nparts, sizeof *load);
+    int * penalty = malloc(nparts * sizeof *penalty);
+    spt_CheckOSError(!load || !penalty, "SpTns Hypergraph");
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        ++load[part[z]];
+    }
+    sptNnzIndex const max_load = (sptNnzIndex) ((double) nnz / nparts * (1 + imbalance)) + 1;
+    for(int pass = 0; pass < PARTI_HYPERGRAPH_PASSES && nparts > 1; ++pass) {
+        sptNnzIndex moved = 0;
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            int const a = part[z];
+            /* Moving z out of a frees each net where it is a's last pin, and
+               adds a part to each net with no pin in the target yet */
+            int freed = 0;
+            for(int p = 0; p < nparts; ++p) {
+                penalty[p] = 0;
+            }
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                uint32_t const * row = pins[m] + (size_t) tsr->inds[m].data[z] * nparts;
+                freed += row[a] == 1;
+                for(int p = 0; p < nparts; ++p) {
+                    penalty[p] += row[p] == 0;
+                }
+            }
+            if(freed == 0) {
+                continue;
+            }
+            int best = a, best_gain = 0;
+            for(int p = 0; p < nparts; ++p) {
+                int const gain = freed - penalty[p];
+                if(p != a && load[p] < max_load && (gain > best_gain || (gain == best_gain && best != a && load[p] < load[best]))) {
+                    best = p;
+                    best_gain = gain;
+                }
+            }
+            if(best == a) {
+                continue;
+            }
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                uint32_t * row = pins[m] + (size_t) tsr->inds[m].data[z] * nparts;
+                --row[a];
+                ++row[best];
+            }
+            --load[a];
+            ++load[best];
+            part[z] = best;
+            ++moved;
+        }
+        if(moved == 0) {
+            break;
+        }
+    }
+    free(penalty);
+
+    /* Each row to the part with most of its nonzeros, the one owning fewer rows among equals */
+    own->nmodes = nmodes;
+    own->nparts = nparts;
+    own->ndims = malloc(nmodes * sizeof *own->ndims);
+    own->owner = malloc(nmodes * sizeof *own->owner);
+    spt_CheckOSError(!own->ndims || !own->owner, "SpTns Hypergraph");
+    sptNnzIndex * owned = load;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const nrows = tsr->ndims[m];
+        own->ndims[m] = nrows;
+        own->owner[m] = malloc((size_t) nrows * sizeof *own->owner[m]);
+        spt_CheckOSError(!own->owner[m] && nrows != 0, "SpTns Hypergraph");
+        memset(owned, 0, nparts * sizeof *owned);
+        for(sptIndex i = 0; i < nrows; ++i) {
+            uint32_t const * row = pins[m] + (size_t) i * nparts;
+            int best = 0;
+            for(int p = 1; p < nparts; ++p) {
+                if(row[p] > row[best] || (row[p] == row[best] && owned[p] < owned[best])) {
+                    best = p;
+                }
+            }
+            own->owner[m][i] = best;
+            ++owned[best];
+        }
+    }
+    free(load);
+    spt_FreePins(pins, nmodes);
+
+    return 0;
+}
+
+
+/**
+ * The contiguous row blocks sptMpiCpdAls uses, rank p owning rows
+ * [p * n / nparts, (p+1) * n / nparts) of an n-row factor, as a row ownership
+ * @param[out] own    the row ownership, uninitialized
+ * @param[in]  nmodes the number of modes
+ * @param[in]  ndims  the size of each mode
+ * @param[in]  nparts the number of ranks
+ */
+int sptNewRowOwnershipBlock(sptRowOwnership * own, sptIndex const nmodes, sptIndex const ndims[], int const nparts)
+{
+    if(nparts < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership", "nparts < 1");
+    }
+    own->nmodes = nmodes;
+    own->nparts = nparts;
+    own->ndims = malloc(nmodes * sizeof *own->ndims);
+    own->owner = malloc(nmodes * sizeof *own->owner);
+    spt_CheckOSError(!own->ndims || !own->owner, "SpTns Ownership");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        own->ndims[m] = ndims[m];
+        own->owner[m] = malloc((size_t) ndims[m] * sizeof *own->owner[m]);
+        spt_CheckOSError(!own->owner[m] && ndims[m] != 0, "SpTns Ownership");
+        int p = 0;
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            while((uint64_t) ndims[m] * (p + 1) / nparts <= i) {
+                ++p;
+            }
+            own->owner[m][i] = p;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Release a row ownership
+ */
+void sptFreeRowOwnership(sptRowOwnership * own)
+{
+    for(sptIndex m = 0; m < own->nmodes; ++m) {
+        free(own->owner[m]);
+    }
+    free(own->owner);
+    free(own->ndims);
+    own->owner = NULL;
+    own->ndims = NULL;
+    own->nmodes = 0;
+}
+
+
+/**
+ * Factor rows a distributed CP-ALS sweep folds to their owners under a
+ * partition, the same number being expanded back: per row, the ranks whose
+ * nonzeros touch it other than its owner, summed over the modes.
+ * @param[in] own  the row ownership
+ * @param[in] tsr  the tensor
+ * @param[in] part the rank of each nonzero
+ */
+sptNnzIndex sptRowOwnershipVolume(sptRowOwnership const * own, sptSparseTensor const * tsr, int const * part)
+{
+    uint32_t ** pins = spt_NewPins(tsr, part, own->nparts);
+    if(pins == NULL) {
+        spt_CheckOSError(1, "SpTns Ownership");
+    }
+    sptNnzIndex const volume = spt_PinsVolume(pins, tsr, own->nparts, own->owner);
+    spt_FreePins(pins, tsr->nmodes);
+    return volume;
+}
+
+
+/**
+ * Write the per-rank parts of a partitioned tensor, `prefix`.<p>.bin for rank p
+ * in the binary container of sptDumpSparseTensorBinary with the global ndims,
+ * and the row ownership to `prefix`.owner.bin, see sptDumpRowOwnership. Rank p
+ * of sptMpiCpdAlsOwned then reads its part with sptLoadSparseTensorBinary and
+ * the ownership with sptLoadRowOwnership.
+ * @param[in] tsr    the tensor
+ * @param[in] part   the rank of each nonzero, e.g. from sptHypergraphPartition
+ * @param[in] own    the row ownership
+ * @param[in] prefix the path prefix of the files
+ */
+int sptDumpPartitionedSparseTensor(sptSparseTensor const * tsr, int const * part, sptRowOwnership const * own, char const * prefix)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    int const nparts = own->nparts;
+    size_t const len = strlen(prefix) + 32;
+    char * path = malloc(len);
+    sptNnzIndex * counts = calloc(nparts, sizeof *counts);
+    spt_CheckOSError(!path || !counts, "SpTns Partition Dump");
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        if(part[z] < 0 || part[z] >= nparts) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Partition Dump", "part out of range");
+        }
+        ++counts[part[z]];
+    }
+
+    for(int p = 0; p < nparts; ++p) {
+        sptSparseTensor local;
+        int result = spt_SparseTensorNewSized(&local, nmodes, tsr->ndims, counts[p]);
+        spt_CheckError(result, "SpTns Partition Dump", NULL);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            local.sortorder[m] = tsr->sortorder[m];
+        }
+        sptNnzIndex k = 0;
+        for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+            if(part[z] == p) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    local.inds[m].data[k] = tsr->inds[m].data[z];
+                }
+                local.values.data[k] = tsr->values.data != NULL ? tsr->values.data[z] : 1;
+                ++k;
+            }
+        }
+        snprintf(path, len, "%s.%d.bin", prefix, p);
+        FILE * fp = fopen(path, "wb");
+        spt_CheckOSError(!fp, "SpTns Partition Dump");
+        result = sptDumpSparseTensorBinary(&local, fp);
+        fclose(fp);
+        sptFreeSparseTensor(&local);
+        spt_CheckError(result, "SpTns Partition Dump", NULL);
+    }
+    free(counts);
+
+    snprintf(path, len, "%s.owner.bin", prefix);
+    FILE * fp = fopen(path, "wb");
+    spt_CheckOSError(!fp, "SpTns Partition Dump");
+    int result = sptDumpRowOwnership(own, fp);
+    fclose(fp);
+    free(path);
+    spt_CheckError(result, "SpTns Partition Dump", NULL);
+    return 0;
+}
+
+
+/**
+ * Save a row ownership: a versioned header, the uint64 ndims, then the owner
+ * of each row as int32, mode by mode.
+ * @param own the row ownership
+ * @param fp  the file to write into, opened in binary mode
+ */
+int sptDumpRowOwnership(sptRowOwnership const * own, FILE * fp)
+{
+    spt_RowOwnershipHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_OWNER_MAGIC, sizeof header.magic);
+    header.version = PARTI_BINARY_VERSION;
+    header.endian = PARTI_BINARY_ENDIAN;
+    header.nmodes = own->nmodes;
+    header.nparts = (uint32_t) own->nparts;
+    size_t iores = fwrite(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Ownership Dump");
+    for(sptIndex m = 0; m < own->nmodes; ++m) {
+        uint64_t const dim = own->ndims[m];
+        iores = fwrite(&dim, sizeof dim, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Ownership Dump");
+    }
+    enum { CHUNK = 4096 };
+    int32_t buf[CHUNK];
+    for(sptIndex m = 0; m < own->nmodes; ++m) {
+        for(sptIndex i = 0; i < own->ndims[m]; i += CHUNK) {
+            size_t const len = own->ndims[m] - i < CHUNK ? own->ndims[m] - i : CHUNK;
+            for(size_t k = 0; k < len; ++k) {
+                buf[k] = own->owner[m][i + k];
+            }
+            iores = fwrite(buf, sizeof *buf, len, fp);
+            spt_CheckOSError(iores != len, "SpTns Ownership Dump");
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Load a row ownership saved by sptDumpRowOwnership
+ * @param own an uninitialized row ownership
+ * @param fp  the file to read from, opened in binary mode
+ */
+int sptLoadRowOwnership(sptRowOwnership * own, FILE * fp)
+{
+    spt_RowOwnershipHeader header;
+    size_t iores = fread(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Ownership Load");
+    if(memcmp(header.magic, PARTI_OWNER_MAGIC, sizeof header.magic) != 0 || header.version > PARTI_BINARY_VERSION) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership Load", "not a row ownership file");
+    }
+    if(header.endian != PARTI_BINARY_ENDIAN) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership Load", "written with another byte order");
+    }
+    if(header.nparts < 1 || header.nparts > INT32_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership Load", "bad part count");
+    }
+    sptIndex const nmodes = header.nmodes;
+    enum { CHUNK = 4096 };
+    int32_t buf[CHUNK];
+    own->nmodes = nmodes;
+    own->nparts = (int) header.nparts;
+    own->ndims = malloc(nmodes * sizeof *own->ndims);
+    own->owner = calloc(nmodes, sizeof *own->owner);
+    spt_CheckOSError(!own->ndims || !own->owner, "SpTns Ownership Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        uint64_t dim;
+        iores = fread(&dim, sizeof dim, 1, fp);
+        spt_CheckOSError(iores != 1, "SpTns Ownership Load");
+        if(dim > PARTI_INDEX_MAX) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership Load", "dimension exceeds sptIndex");
+        }
+        own->ndims[m] = (sptIndex) dim;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const nrows = own->ndims[m];
+        own->owner[m] = malloc((size_t) nrows * sizeof *own->owner[m]);
+        spt_CheckOSError(!own->owner[m] && nrows != 0, "SpTns Ownership Load");
+        for(sptIndex i = 0; i < nrows; i += CHUNK) {
+            size_t const len = nrows - i < CHUNK ? nrows - i : CHUNK;
+            iores = fread(buf, sizeof *buf, len, fp);
+            spt_CheckOSError(iores != len, "SpTns Ownership Load");
+            for(size_t k = 0; k < len; ++k) {
+                if(buf[k] < 0 || buf[k] >= own->nparts) {
+                    spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Ownership Load", "owner out of range");
+                }
+                own->owner[m][i + k] = buf[k];
+            }
+        }
+    }
+    return 0;
+}
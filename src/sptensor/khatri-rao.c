@@ -18,10 +18,10 @@
 
 #include <ParTI.h>
 #include "sptensor.h"
+#include "../matrix/simd.h"
 #include <stdlib.h>
 #include <string.h>
 
-/* jli: (TODO) Keep this function, but add another Khatri-Rao product for two dense matrices. */
 /* jli: (Future TODO) Add Khatri-Rao product for two sparse matrices. */
 
 int sptSparseTensorKhatriRaoMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B) {
@@ -69,3 +69,34 @@ int sptSparseTensorKhatriRaoMul(sptSparseTensor *Y, const sptSparseTensor *A, co
     sptSparseTensorSortIndex(Y, 1);
     return 0;
 }
+
+
+/**
+ * Khatri-Rao product of two dense matrices, the column-wise Kronecker product:
+ * row i * B->nrows + j of C is row i of A times row j of B elementwise
+ * @param[out] C  an uninitialized matrix, (A->nrows * B->nrows) x R
+ * @param[in]  A  the input A, with R columns
+ * @param[in]  B  the input B, with R columns
+ * @param[in]  tk the number of threads
+ */
+int sptMatrixKhatriRaoMul(sptMatrix *C, const sptMatrix *A, const sptMatrix *B, int const tk) {
+    if(A->ncols != B->ncols) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "Mtx Khatri-Rao", "shape mismatch");
+    }
+    sptNnzIndex const nrows = (sptNnzIndex) A->nrows * B->nrows;
+    if(nrows > (sptIndex) -1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Mtx Khatri-Rao", "product rows overflow sptIndex");
+    }
+    int result = sptNewMatrix(C, (sptIndex) nrows, A->ncols);
+    spt_CheckError(result, "Mtx Khatri-Rao", NULL);
+
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const R = A->ncols;
+    sptIndex const J = B->nrows;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex row = 0; row < nrows; ++row) {
+        sptNnzIndex const i = row / J, j = row % J;
+        simd->hadamard(C->values + row * C->stride, A->values + i * A->stride, B->values + j * B->stride, R);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+
+/**
+ * Khatri-Rao product of two sparse tensors in parallel, matching on the last
+ * mode. B is bucketed by its last index, keeping its order within a bucket,
+ * so nonzero i of A pairs with exactly count[last index of i] nonzeros of B.
+ * A prefix sum of those counts sizes the product exactly and gives every
+ * nonzero of A a disjoint output range.
+ * @param[out] Y  the result, should be uninitialized
+ * @param[in]  A  the input A
+ * @param[in]  B  the input B
+ * @param[in]  tk the number of threads
+ */
+int sptOmpSparseTensorKhatriRaoMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B, int const tk) {
+    int result;
+    if(A->nmodes != B->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns Khatri-Rao", "shape mismatch");
+    }
+    sptIndex const nmodes = A->nmodes;
+    if(nmodes == 0) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns Khatri-Rao", "shape mismatch");
+    }
+    sptIndex const last = nmodes - 1;
+    if(A->ndims[last] != B->ndims[last]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns Khatri-Rao", "shape mismatch");
+    }
+    sptIndex const ncols = A->ndims[last];
+
+    /* B's nonzeros by last index: bucket c holds bperm[bptr[c]] to bperm[bptr[c+1]] */
+    sptNnzIndex * bptr = calloc((size_t) ncols + 1, sizeof *bptr);
+    sptNnzIndex * bperm = malloc((B->nnz > 0 ? B->nnz : 1) * sizeof *bperm);
+    sptNnzIndex * aptr = malloc((A->nnz + 1) * sizeof *aptr);
+    spt_CheckOSError(!bptr || !bperm || !aptr, "OMP  SpTns Khatri-Rao");
+    sptIndex const * const blast = B->inds[last].data;
+    for(sptNnzIndex j = 0; j < B->nnz; ++j) {
+        ++bptr[blast[j] + 1];
+    }
+    for(sptIndex c = 0; c < ncols; ++c) {
+        bptr[c+1] += bptr[c];
+    }
+    for(sptNnzIndex j = 0; j < B->nnz; ++j) {
+        bperm[bptr[blast[j]]++] = j;
+    }
+    for(sptIndex c = ncols; c > 0; --c) {
+        bptr[c] = bptr[c-1];
+    }
+    bptr[0] = 0;
+
+    sptIndex const * const alast = A->inds[last].data;
+    aptr[0] = 0;
+    for(sptNnzIndex i = 0; i < A->nnz; ++i) {
+        aptr[i+1] = aptr[i] + (bptr[alast[i] + 1] - bptr[alast[i]]);
+    }
+
+    sptIndex * inds = malloc(nmodes * sizeof *inds);
+    spt_CheckOSError(!inds, "OMP  SpTns Khatri-Rao");
+    for(sptIndex mode = 0; mode < last; ++mode) {
+        inds[mode] = A->ndims[mode] * B->ndims[mode];
+    }
+    inds[last] = ncols;
+    result = spt_SparseTensorNewSized(Y, nmodes, inds, aptr[A->nnz]);
+    free(inds);
+    spt_CheckError(result, "OMP  SpTns Khatri-Rao", NULL);
+
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+    for(sptNnzIndex i = 0; i < A->nnz; ++i) {
+        sptIndex const c = alast[i];
+        sptNnzIndex const jbegin = bptr[c];
+        sptNnzIndex const jend = bptr[c+1];
+        sptNnzIndex y = aptr[i];
+        sptValue const a = A->values.data[i];
+        for(sptNnzIndex p = jbegin; p < jend; ++p, ++y) {
+            sptNnzIndex const j = bperm[p];
+            for(sptIndex mode = 0; mode < last; ++mode) {
+                Y->inds[mode].data[y] = A->inds[mode].data[i] * B->ndims[mode] + B->inds[mode].data[j];
+            }
+            Y->inds[last].data[y] = c;
+            Y->values.data[y] = a * B->values.data[j];
+        }
+    }
+
+    free(bptr);
+    free(bperm);
+    free(aptr);
+    sptSparseTensorSortIndex(Y, 1);
+    return 0;
+}
@@ -45,7 +45,9 @@ int sptSparseTensorKroneckerMul(sptSparseTensor *Y, const sptSparseTensor *A, co
     result = sptNewSparseTensor(Y, nmodes, inds);
     spt_CheckError(result, "SpTns Kronecker", NULL);
     free(inds);
-    spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Kronecker", "shape mismatch");
+    /* The product has exactly nnzA * nnzB nonzeros */
+    result = spt_SparseTensorReserve(Y, A->nnz * B->nnz);
+    spt_CheckError(result, "SpTns Kronecker", NULL);
     /* For each element in A and B */
     for(i = 0; i < A->nnz; ++i) {
         for(j = 0; j < B->nnz; ++j) {
@@ -53,13 +55,6 @@ int sptSparseTensorKroneckerMul(sptSparseTensor *Y, const sptSparseTensor *A, co
                 Y[f(i1,j1), ..., f(i(N-1), j(N-1)] = a[i1, ..., i(N-1)] * b[j1, ..., j(N-1)]
                 where f(in, jn) = jn + in * Jn
             */
-            /* jli: (TODO). Append when acculumating a certain number (e.g. 10) of elements.
-                Don't do realloc only increasing length by one.
-                ! More important: The resulting Kronecker-product size is fixed, nnzA * nnzB.
-                Don't need realloc.
-
-               sb: sptAppendSizeVector already do acculumating
-            */
             for(mode = 0; mode < nmodes; ++mode) {
                 result = sptAppendIndexVector(&Y->inds[mode], A->inds[mode].data[i] * B->ndims[mode] + B->inds[mode].data[j]);
                 spt_CheckError(result, "SpTns Kronecker", NULL);
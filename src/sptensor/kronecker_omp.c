@@ -0,0 +1,68 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+
+/**
+ * Kronecker product of two sparse tensors in parallel. The product has
+ * exactly nnzA * nnzB nonzeros, so it is allocated once and nonzero i of A
+ * writes the disjoint range [i * nnzB, (i+1) * nnzB).
+ * @param[out] Y  the result of A(*)B, should be uninitialized
+ * @param[in]  A  the input A
+ * @param[in]  B  the input B
+ * @param[in]  tk the number of threads
+ */
+int sptOmpSparseTensorKroneckerMul(sptSparseTensor *Y, const sptSparseTensor *A, const sptSparseTensor *B, int const tk) {
+    int result;
+    if(A->nmodes != B->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns Kronecker", "shape mismatch");
+    }
+    sptIndex const nmodes = A->nmodes;
+    sptIndex * inds = malloc(nmodes * sizeof *inds);
+    spt_CheckOSError(!inds, "OMP  SpTns Kronecker");
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+        inds[mode] = A->ndims[mode] * B->ndims[mode];
+    }
+    sptNnzIndex const nnzB = B->nnz;
+    result = spt_SparseTensorNewSized(Y, nmodes, inds, A->nnz * nnzB);
+    free(inds);
+    spt_CheckError(result, "OMP  SpTns Kronecker", NULL);
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex i = 0; i < A->nnz; ++i) {
+        sptNnzIndex const base = i * nnzB;
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            sptIndex const a = A->inds[mode].data[i] * B->ndims[mode];
+            sptIndex const * const restrict bind = B->inds[mode].data;
+            sptIndex * const restrict yind = Y->inds[mode].data + base;
+            for(sptNnzIndex j = 0; j < nnzB; ++j) {
+                yind[j] = a + bind[j];
+            }
+        }
+        sptValue const a = A->values.data[i];
+        sptValue const * const restrict bval = B->values.data;
+        sptValue * const restrict yval = Y->values.data + base;
+        for(sptNnzIndex j = 0; j < nnzB; ++j) {
+            yval[j] = a * bval[j];
+        }
+    }
+    sptSparseTensorSortIndex(Y, 1);
+    return 0;
+}
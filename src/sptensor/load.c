@@ -31,7 +31,7 @@
 int sptLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, FILE *fp) {
     int iores, retval;
     sptIndex mode;
-    iores = fscanf(fp, "%u", &tsr->nmodes);
+    iores = fscanf(fp, "%"PARTI_SCN_INDEX, &tsr->nmodes);
     spt_CheckOSError(iores < 0, "SpTns Load");
     /* Only allocate space for sortorder, initialized to 0s. */
     tsr->sortorder = malloc(tsr->nmodes * sizeof tsr->sortorder[0]);
@@ -40,7 +40,7 @@ int sptLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, FILE *fp) {
     tsr->ndims = malloc(tsr->nmodes * sizeof *tsr->ndims);
     spt_CheckOSError(!tsr->ndims, "SpTns Load");
     for(mode = 0; mode < tsr->nmodes; ++mode) {
-        iores = fscanf(fp, "%u", &tsr->ndims[mode]);
+        iores = fscanf(fp, "%"PARTI_SCN_INDEX, &tsr->ndims[mode]);
         spt_CheckOSError(iores != 1, "SpTns Load");
     }
     tsr->nnz = 0;
@@ -52,11 +52,14 @@ int sptLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, FILE *fp) {
     }
     retval = sptNewValueVector(&tsr->values, 0, 0);
     spt_CheckError(retval, "SpTns Load", NULL);
+    tsr->cache = NULL;
+    retval = sptPlaceSparseTensor(tsr, SPT_MEM_DEFAULT);
+    spt_CheckError(retval, "SpTns Load", NULL);
     while(retval == 0) {
         double value;
         for(mode = 0; mode < tsr->nmodes; ++mode) {
             sptIndex index;
-            iores = fscanf(fp, "%u", &index);
+            iores = fscanf(fp, "%"PARTI_SCN_INDEX, &index);
             if(iores != 1) {
                 retval = -1;
                 break;
@@ -79,7 +82,5 @@ int sptLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, FILE *fp) {
     for(mode = 0; mode < tsr->nmodes; ++mode) {
         tsr->inds[mode].len = tsr->nnz;
     }
-    spt_SparseTensorCollectZeros(tsr);
-    
-    return 0;
+    return spt_SparseTensorFinishLoad(tsr);
 }
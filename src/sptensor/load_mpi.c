@@ -0,0 +1,435 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_MPI
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* Bytes moved by one MPI-IO call, inside the int count of the interface */
+#define SPT_MPI_IO_CHUNK ((uint64_t) 1 << 30)
+/* Bytes rank 0 reads to find the header of a text tensor */
+#define SPT_MPI_TEXT_HEAD ((MPI_Offset) 1 << 16)
+
+
+/* Collective read of `bytes` at `offset` on every rank of comm, each with its
+   own range, split into calls of at most SPT_MPI_IO_CHUNK bytes. */
+static int spt_MpiReadAtAll(MPI_File fh, MPI_Offset offset, void *buf, uint64_t bytes, MPI_Comm comm)
+{
+    uint64_t max_bytes = bytes;
+    MPI_Allreduce(MPI_IN_PLACE, &max_bytes, 1, MPI_UINT64_T, MPI_MAX, comm);
+    char * p = buf;
+    int failed = 0;
+    for(uint64_t done = 0; done < max_bytes; done += SPT_MPI_IO_CHUNK) {
+        uint64_t const left = done < bytes ? bytes - done : 0;
+        int const count = (int) (left < SPT_MPI_IO_CHUNK ? left : SPT_MPI_IO_CHUNK);
+        MPI_Status status;
+        failed |= MPI_File_read_at_all(fh, offset + (MPI_Offset) done, p + (done < bytes ? done : 0), count, MPI_BYTE, &status) != MPI_SUCCESS;
+        int got = 0;
+        MPI_Get_count(&status, MPI_BYTE, &got);
+        failed |= got != count;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, comm);
+    if(failed) {
+        spt_CheckError(SPTERR_OS_ERROR, "SpTns MPI Load", "MPI-IO read failed");
+    }
+    return 0;
+}
+
+
+/**
+ * Load this rank's share of a binary sparse tensor, every rank reading its
+ * part of the file concurrently with collective MPI-IO; only rank 0 reads the
+ * header, and broadcasts it.
+ *
+ * Rank p of P receives the nonzeros [p*nnz/P, (p+1)*nnz/P) of the file, which
+ * is a fine-grained partition; when the file is sorted it also keeps each
+ * rank's leading-mode indices contiguous. `ndims` is the global shape on every
+ * rank, so the parts can be fed to sptMpiCpdAls directly, or moved to the
+ * owners of their slices by sptMpiRedistributeSparseTensor.
+ * The file must have been written with the index and value widths of this build.
+ *
+ * @param tsr      an uninitialized sparse tensor, holding the local nonzeros on return
+ * @param filename the binary file written by sptDumpSparseTensorBinary
+ * @param comm     the communicator sharing the tensor
+ */
+int sptMpiLoadSparseTensorBinary(sptSparseTensor *tsr, const char *filename, MPI_Comm comm)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    MPI_File fh;
+    int result = MPI_File_open(comm, (char *) filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if(result != MPI_SUCCESS) {
+        spt_CheckError(SPTERR_OS_ERROR, "SpTns MPI Load", "cannot open the file");
+    }
+
+    /* The header, then uint64 ndims and uint32 sortorder, from rank 0 */
+    spt_SparseTensorBinaryHeader header;
+    result = 0;
+    if(rank == 0) {
+        MPI_Status status;
+        int got = 0;
+        MPI_File_read_at(fh, 0, &header, (int) sizeof header, MPI_BYTE, &status);
+        MPI_Get_count(&status, MPI_BYTE, &got);
+        result = got != (int) sizeof header ? SPTERR_VALUE_ERROR : spt_SparseTensorBinaryCheckHeader(&header);
+        if(result == 0 && (header.index_width != sizeof(sptIndex) || header.value_width != sizeof(sptValue))) {
+            result = SPTERR_VALUE_ERROR;
+            spt_ComplainError("SpTns MPI Load", result, __FILE__, __LINE__, "index or value width differs from this build, use sptLoadSparseTensorBinary");
+        }
+    }
+    MPI_Bcast(&result, 1, MPI_INT, 0, comm);
+    if(result != 0) {
+        MPI_File_close(&fh);
+        return result;
+    }
+    MPI_Bcast(&header, (int) sizeof header, MPI_BYTE, 0, comm);
+
+    sptIndex const nmodes = header.nmodes;
+    size_t const shape_bytes = nmodes * (sizeof(uint64_t) + sizeof(uint32_t));
+    char * shape = malloc(shape_bytes);
+    spt_CheckOSError(!shape, "SpTns MPI Load");
+    if(rank == 0) {
+        MPI_Status status;
+        MPI_File_read_at(fh, (MPI_Offset) sizeof header, shape, (int) shape_bytes, MPI_BYTE, &status);
+    }
+    MPI_Bcast(shape, (int) shape_bytes, MPI_BYTE, 0, comm);
+    uint64_t const * file_ndims = (uint64_t const *) shape;
+    uint32_t const * file_sortorder = (uint32_t const *) (shape + nmodes * sizeof(uint64_t));
+
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "SpTns MPI Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(file_ndims[m] > PARTI_INDEX_MAX) {
+            MPI_File_close(&fh);
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Load", "dimension exceeds sptIndex");
+        }
+        ndims[m] = (sptIndex) file_ndims[m];
+    }
+    result = sptNewSparseTensor(tsr, nmodes, ndims);
+    spt_CheckError(result, "SpTns MPI Load", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->sortorder[m] = file_sortorder[m];
+    }
+    free(ndims);
+    free(shape);
+
+    sptNnzIndex const begin = header.nnz * (sptNnzIndex) rank / (sptNnzIndex) nprocs;
+    sptNnzIndex const end = header.nnz * (sptNnzIndex) (rank + 1) / (sptNnzIndex) nprocs;
+    sptNnzIndex const local_nnz = end - begin;
+    uint64_t const ind_bytes = spt_BinaryAlignUp(header.nnz * sizeof(sptIndex));
+
+    tsr->nnz = local_nnz;
+    MPI_Offset offset = (MPI_Offset) header.data_offset;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&tsr->inds[m], local_nnz);
+        spt_CheckError(result, "SpTns MPI Load", NULL);
+        result = spt_MpiReadAtAll(fh, offset + (MPI_Offset) (begin * sizeof(sptIndex)), tsr->inds[m].data, local_nnz * sizeof(sptIndex), comm);
+        spt_CheckError(result, "SpTns MPI Load", NULL);
+        offset += (MPI_Offset) ind_bytes;
+    }
+    result = sptResizeValueVector(&tsr->values, local_nnz);
+    spt_CheckError(result, "SpTns MPI Load", NULL);
+    result = spt_MpiReadAtAll(fh, offset + (MPI_Offset) (begin * sizeof(sptValue)), tsr->values.data, local_nnz * sizeof(sptValue), comm);
+    spt_CheckError(result, "SpTns MPI Load", NULL);
+
+    MPI_File_close(&fh);
+    return 0;
+}
+
+
+/**
+ * Load this rank's share of a text sparse tensor, the format of
+ * sptLoadSparseTensor, every rank reading and parsing its part of the file
+ * concurrently.
+ *
+ * Rank 0 reads the header and broadcasts the shape. The body is then cut into
+ * P byte ranges of equal size; rank p parses the lines that start in range p,
+ * reading on past its end to finish its last line, with `tk` threads. The
+ * nonzeros of a rank are thus about an equal share of the file, in file
+ * order; move them to the owners of their slices with
+ * sptMpiRedistributeSparseTensor. Duplicates are coalesced as by
+ * sptLoadSparseTensor, but only within a rank.
+ *
+ * @param tsr         an uninitialized sparse tensor, holding the local nonzeros on return
+ * @param start_index the index of the first element in array. Set to 1 for MATLAB compability, else set to 0
+ * @param filename    the file to read from
+ * @param tk          the number of threads of each rank
+ * @param comm        the communicator sharing the tensor
+ */
+int sptMpiLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk, MPI_Comm comm)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    MPI_File fh;
+    int result = MPI_File_open(comm, (char *) filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if(result != MPI_SUCCESS) {
+        spt_CheckError(SPTERR_OS_ERROR, "SpTns MPI Load", "cannot open the file");
+    }
+    MPI_Offset file_size = 0;
+    MPI_File_get_size(fh, &file_size);
+
+    /* nmodes and the body offset, then ndims, from rank 0 */
+    unsigned long long head[3] = { 0, 0, 0 };
+    sptIndex * ndims = NULL;
+    if(rank == 0) {
+        MPI_Offset const len = file_size < SPT_MPI_TEXT_HEAD ? file_size : SPT_MPI_TEXT_HEAD;
+        char * buf = malloc((size_t) len + 1);
+        spt_CheckOSError(!buf, "SpTns MPI Load");
+        MPI_Status status;
+        MPI_File_read_at(fh, 0, buf, (int) len, MPI_BYTE, &status);
+        const char * p = buf;
+        sptSparseTensor shape;
+        result = len > 0 ? spt_ParseSparseTensorHeader(&shape, &p, buf + len) : SPTERR_VALUE_ERROR;
+        if(result == 0) {
+            /* A header running past the buffer has been cut */
+            if(p == buf + len && len < file_size) {
+                result = SPTERR_VALUE_ERROR;
+            } else {
+                head[0] = 1;
+                head[1] = shape.nmodes;
+                head[2] = (unsigned long long) (p - buf);
+                ndims = malloc(shape.nmodes * sizeof *ndims);
+                spt_CheckOSError(!ndims, "SpTns MPI Load");
+                memcpy(ndims, shape.ndims, shape.nmodes * sizeof *ndims);
+            }
+            sptFreeSparseTensor(&shape);
+        }
+        free(buf);
+    }
+    MPI_Bcast(head, 3, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    if(head[0] == 0) {
+        MPI_File_close(&fh);
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Load", "bad header");
+    }
+    sptIndex const nmodes = (sptIndex) head[1];
+    if(rank != 0) {
+        ndims = malloc(nmodes * sizeof *ndims);
+        spt_CheckOSError(!ndims, "SpTns MPI Load");
+    }
+    MPI_Bcast(ndims, (int) nmodes, PARTI_MPI_INDEX, 0, comm);
+    result = sptNewSparseTensor(tsr, nmodes, ndims);
+    free(ndims);
+    spt_CheckError(result, "SpTns MPI Load", NULL);
+
+    /* Byte range [begin, end) of the body, read from the byte before it to see where lines start */
+    MPI_Offset const body = (MPI_Offset) head[2];
+    MPI_Offset const body_size = file_size - body;
+    MPI_Offset const begin = body + body_size * rank / nprocs;
+    MPI_Offset const end = body + body_size * (rank + 1) / nprocs;
+    MPI_Offset const from = begin > body ? begin - 1 : begin;
+    size_t len = (size_t) (end - from);
+    size_t cap = len + 1;
+    char * buf = malloc(cap);
+    spt_CheckOSError(!buf, "SpTns MPI Load");
+    result = spt_MpiReadAtAll(fh, from, buf, len, comm);
+    spt_CheckError(result, "SpTns MPI Load", NULL);
+
+    /* The first line starting at or after begin */
+    size_t first = 0;
+    if(from < begin) {
+        char const * nl = memchr(buf, '\n', len);
+        first = nl != NULL ? (size_t) (nl - buf) + 1 : len;
+    }
+    /* Finish the last line, independently, as it ends wherever it ends */
+    if(first < len && buf[len-1] != '\n') {
+        MPI_Offset at = end;
+        while(at < file_size) {
+            size_t const step = (size_t) (file_size - at < SPT_MPI_TEXT_HEAD ? file_size - at : SPT_MPI_TEXT_HEAD);
+            if(len + step + 1 > cap) {
+                cap = (len + step + 1) * 2;
+                char * grown = realloc(buf, cap);
+                spt_CheckOSError(!grown, "SpTns MPI Load");
+                buf = grown;
+            }
+            MPI_Status status;
+            MPI_File_read_at(fh, at, buf + len, (int) step, MPI_BYTE, &status);
+            char const * nl = memchr(buf + len, '\n', step);
+            if(nl != NULL) {
+                len = (size_t) (nl - buf) + 1;
+                break;
+            }
+            len += step;
+            at += (MPI_Offset) step;
+        }
+    }
+    MPI_File_close(&fh);
+
+    result = spt_ParseSparseTensorLines(tsr, start_index, buf + first, buf + (first < len ? len : first), tk);
+    free(buf);
+    if(result != 0) {
+        sptFreeSparseTensor(tsr);
+        spt_CheckError(result, "SpTns MPI Load", NULL);
+    }
+    return spt_SparseTensorFinishLoad(tsr);
+}
+
+
+/**
+ * The owners of nslices slices when every rank of comm holds `n` items with
+ * slice indices `slice`: consecutive ranges of whole slices with about equal
+ * items over all ranks, the same on every rank.
+ */
+int spt_MpiBalancedOwners(int *owner, sptIndex const *slice, sptNnzIndex const n, sptIndex const nslices, MPI_Comm comm)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    sptNnzIndex * ptr = calloc((size_t) nslices + 1, sizeof *ptr);
+    sptNnzIndex * bounds = malloc((nprocs + 1) * sizeof *bounds);
+    spt_CheckOSError(!ptr || !bounds, "SpTns MPI Owners");
+    for(sptNnzIndex z = 0; z < n; ++z) {
+        ++ptr[slice[z] + 1];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, ptr + 1, (int) nslices, MPI_UINT64_T, MPI_SUM, comm);
+    for(sptIndex i = 0; i < nslices; ++i) {
+        ptr[i+1] += ptr[i];
+    }
+    int result = spt_PartitionSegments(bounds, ptr, nslices, nprocs);
+    spt_CheckError(result, "SpTns MPI Owners", NULL);
+    for(int p = 0; p < nprocs; ++p) {
+        for(sptNnzIndex i = bounds[p]; i < bounds[p+1]; ++i) {
+            owner[i] = p;
+        }
+    }
+    free(bounds);
+    free(ptr);
+    return 0;
+}
+
+
+/**
+ * Move every nonzero to the rank owning its slice of `mode`, with one
+ * all-to-all exchange per array. The owners are `own->owner[mode]`, e.g. from
+ * sptLoadRowOwnership, or without `own` consecutive ranges of whole slices
+ * with about equal nonzeros, the distribution of sptMpiScatterSparseTensor.
+ * The received nonzeros are grouped by the rank that sent them.
+ *
+ * @param tsr  this rank's nonzeros, with the global ndims, replaced by the ones it owns
+ * @param mode the mode whose slices are owned
+ * @param own  the row ownership with one part per rank of comm, or NULL
+ * @param comm the communicator sharing the tensor
+ */
+int sptMpiRedistributeSparseTensor(sptSparseTensor *tsr, sptIndex const mode, sptRowOwnership const *own, MPI_Comm comm)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+    sptIndex const nmodes = tsr->nmodes;
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Redistribute", "mode >= nmodes");
+    }
+    sptIndex const nslices = tsr->ndims[mode];
+    sptIndex const * const slice = tsr->inds[mode].data;
+
+    /* The owner of every slice */
+    int * owner = NULL;
+    if(own != NULL) {
+        if(own->nparts != nprocs || own->nmodes != nmodes || own->ndims[mode] != nslices) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns MPI Redistribute", "ownership does not match the communicator or tensor");
+        }
+    } else {
+        owner = malloc(((size_t) nslices + 1) * sizeof *owner);
+        spt_CheckOSError(!owner, "SpTns MPI Redistribute");
+        int result = spt_MpiBalancedOwners(owner, slice, tsr->nnz, nslices, comm);
+        spt_CheckError(result, "SpTns MPI Redistribute", NULL);
+    }
+    int const * const slice_owner = own != NULL ? own->owner[mode] : owner;
+
+    /* Group the nonzeros by owner */
+    int * send_counts = calloc(nprocs, sizeof *send_counts);
+    int * send_displs = malloc(nprocs * sizeof *send_displs);
+    int * recv_counts = malloc(nprocs * sizeof *recv_counts);
+    int * recv_displs = malloc(nprocs * sizeof *recv_displs);
+    sptNnzIndex * order = malloc((tsr->nnz + 1) * sizeof *order);
+    spt_CheckOSError(!send_counts || !send_displs || !recv_counts || !recv_displs || !order, "SpTns MPI Redistribute");
+    if(tsr->nnz > INT_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Redistribute", "nonzeros exceed the MPI count range");
+    }
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        ++send_counts[slice_owner[slice[z]]];
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    sptNnzIndex recv_nnz = 0;
+    for(int p = 0; p < nprocs; ++p) {
+        send_displs[p] = p == 0 ? 0 : send_displs[p-1] + send_counts[p-1];
+        recv_displs[p] = (int) recv_nnz;
+        recv_nnz += (sptNnzIndex) recv_counts[p];
+        if(recv_nnz > INT_MAX) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Redistribute", "nonzeros exceed the MPI count range");
+        }
+    }
+    int * fill = malloc(nprocs * sizeof *fill);
+    spt_CheckOSError(!fill, "SpTns MPI Redistribute");
+    memcpy(fill, send_displs, nprocs * sizeof *fill);
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        order[fill[slice_owner[slice[z]]]++] = z;
+    }
+    free(fill);
+    free(owner);
+
+    /* One exchange per index array and for the values, through one staging buffer */
+    size_t const width = sizeof(sptIndex) > sizeof(sptValue) ? sizeof(sptIndex) : sizeof(sptValue);
+    void * stage = malloc((tsr->nnz + 1) * width);
+    spt_CheckOSError(!stage, "SpTns MPI Redistribute");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex * const packed = stage;
+        for(sptNnzIndex k = 0; k < tsr->nnz; ++k) {
+            packed[k] = tsr->inds[m].data[order[k]];
+        }
+        sptIndexVector received;
+        int result = sptNewIndexVector(&received, recv_nnz, recv_nnz);
+        spt_CheckError(result, "SpTns MPI Redistribute", NULL);
+        MPI_Alltoallv(packed, send_counts, send_displs, PARTI_MPI_INDEX,
+            received.data, recv_counts, recv_displs, PARTI_MPI_INDEX, comm);
+        sptFreeIndexVector(&tsr->inds[m]);
+        tsr->inds[m] = received;
+    }
+    /* A pattern tensor stays one, on every rank alike */
+    int has_values = tsr->values.data != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &has_values, 1, MPI_INT, MPI_LOR, comm);
+    if(has_values) {
+        sptValue * const packed = stage;
+        for(sptNnzIndex k = 0; k < tsr->nnz; ++k) {
+            packed[k] = tsr->values.data != NULL ? tsr->values.data[order[k]] : 1;
+        }
+        sptValueVector received;
+        int result = sptNewValueVector(&received, recv_nnz, recv_nnz);
+        spt_CheckError(result, "SpTns MPI Redistribute", NULL);
+        MPI_Alltoallv(packed, send_counts, send_displs, PARTI_MPI_VALUE,
+            received.data, recv_counts, recv_displs, PARTI_MPI_VALUE, comm);
+        sptFreeValueVector(&tsr->values);
+        tsr->values = received;
+    }
+    tsr->nnz = recv_nnz;
+    spt_SparseTensorFreeCache(tsr);
+
+    free(stage);
+    free(order);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    return 0;
+}
+
+#endif
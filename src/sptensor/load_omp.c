@@ -0,0 +1,337 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* Exact powers of ten representable in a double, for the fast float path. */
+static const double spt_ExactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline int spt_IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline int spt_IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Skip blanks (not newlines) and parse an unsigned integer.
+ * Returns the position after the number, or NULL if there is none.
+ */
+static const char * spt_ScanIndex(const char *p, const char *end, uint64_t *out) {
+    while(p < end && spt_IsSpace(*p)) {
+        ++p;
+    }
+    if(p == end || !spt_IsDigit(*p)) {
+        return NULL;
+    }
+    uint64_t v = 0;
+    while(p < end && spt_IsDigit(*p)) {
+        v = v * 10 + (uint64_t) (*p - '0');
+        ++p;
+    }
+    *out = v;
+    return p;
+}
+
+/**
+ * Skip blanks and parse a floating point number.
+ * Decimal numbers with at most 19 significant digits and a small exponent are
+ * converted exactly in-line; anything else falls back to strtod.
+ */
+static const char * spt_ScanValue(const char *p, const char *end, double *out) {
+    while(p < end && spt_IsSpace(*p)) {
+        ++p;
+    }
+    const char * const start = p;
+    int negative = 0;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int ndigits = 0, exp10 = 0, seen_digit = 0;
+    while(p < end && spt_IsDigit(*p)) {
+        if(ndigits < 19) {
+            mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+            if(mantissa != 0) ++ndigits;
+        } else {
+            ++exp10;
+            ++ndigits;
+        }
+        seen_digit = 1;
+        ++p;
+    }
+    if(p < end && *p == '.') {
+        ++p;
+        while(p < end && spt_IsDigit(*p)) {
+            if(ndigits < 19) {
+                mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+                if(mantissa != 0) ++ndigits;
+                --exp10;
+            } else {
+                ++ndigits;
+            }
+            seen_digit = 1;
+            ++p;
+        }
+    }
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int exp_negative = 0, e = 0, seen_exp = 0;
+        if(q < end && (*q == '-' || *q == '+')) {
+            exp_negative = *q == '-';
+            ++q;
+        }
+        while(q < end && spt_IsDigit(*q)) {
+            if(e < 100000) e = e * 10 + (*q - '0');
+            seen_exp = 1;
+            ++q;
+        }
+        if(seen_exp) {
+            exp10 += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+    if(seen_digit && ndigits <= 19 && mantissa < ((uint64_t) 1 << 53) && exp10 >= -22 && exp10 <= 22) {
+        double v = (double) mantissa;
+        v = exp10 < 0 ? v / spt_ExactPow10[-exp10] : v * spt_ExactPow10[exp10];
+        *out = negative ? -v : v;
+        return p;
+    }
+
+    /* Slow path: copy the token so strtod never reads past the mapping. */
+    char buf[128];
+    size_t len = 0;
+    p = start;
+    while(p < end && !spt_IsSpace(*p) && *p != '\n' && len < sizeof buf - 1) {
+        buf[len++] = *p++;
+    }
+    buf[len] = '\0';
+    char *endptr;
+    *out = strtod(buf, &endptr);
+    if(endptr == buf) {
+        return NULL;
+    }
+    return start + (endptr - buf);
+}
+
+/* Move to the first character of the next line. */
+static inline const char * spt_NextLine(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+/* A line holds a nonzero if it has any non-blank character. */
+static inline int spt_LineHasData(const char *p, const char *end) {
+    while(p < end && *p != '\n') {
+        if(!spt_IsSpace(*p)) return 1;
+        ++p;
+    }
+    return 0;
+}
+
+
+/**
+ * Parse the header of a text tensor, nmodes and ndims separated by any
+ * whitespace, and create an empty tensor of that shape.
+ * On success *pp is moved to the first line of the body.
+ */
+int spt_ParseSparseTensorHeader(sptSparseTensor *tsr, const char **pp, const char *end) {
+    int result;
+    const char *p = *pp;
+    uint64_t parsed;
+    while(p < end && (spt_IsSpace(*p) || *p == '\n')) ++p;
+    p = spt_ScanIndex(p, end, &parsed);
+    if(p == NULL || parsed == 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Parse", "bad nmodes");
+    }
+    sptIndex const nmodes = (sptIndex) parsed;
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, "SpTns Parse");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        while(p < end && (spt_IsSpace(*p) || *p == '\n')) ++p;
+        p = spt_ScanIndex(p, end, &parsed);
+        if(p == NULL || parsed > PARTI_INDEX_MAX) {
+            free(ndims);
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Parse", "bad ndims");
+        }
+        ndims[m] = (sptIndex) parsed;
+    }
+    result = sptNewSparseTensor(tsr, nmodes, ndims);
+    free(ndims);
+    spt_CheckError(result, "SpTns Parse", NULL);
+    *pp = spt_NextLine(p, end);
+    return 0;
+}
+
+/**
+ * Parse whole nonzero lines in [p, end) and append them to tsr, in parallel.
+ *
+ * The text is cut into one chunk per thread on newline boundaries, counted in
+ * a first pass to grow the index and value arrays once, and parsed in a
+ * second pass with a hand-written scanner. Zeros and duplicates are kept;
+ * the caller finishes the load.
+ */
+int spt_ParseSparseTensorLines(sptSparseTensor *tsr, sptIndex start_index, const char *p, const char *end, int const tk) {
+    int result;
+    sptIndex const nmodes = tsr->nmodes;
+
+    /* Split the body into per-thread chunks on newline boundaries */
+    int const nchunks = tk > 0 ? tk : 1;
+    const char ** chunk_begin = malloc((nchunks + 1) * sizeof *chunk_begin);
+    spt_CheckOSError(!chunk_begin, "SpTns Parse");
+    sptNnzIndex * chunk_nnz = calloc(nchunks + 1, sizeof *chunk_nnz);
+    spt_CheckOSError(!chunk_nnz, "SpTns Parse");
+    size_t const body_size = (size_t) (end - p);
+    chunk_begin[0] = p;
+    for(int c = 1; c < nchunks; ++c) {
+        const char *q = p + body_size / nchunks * c;
+        if(q < chunk_begin[c-1]) q = chunk_begin[c-1];
+        chunk_begin[c] = (q == p || q[-1] == '\n') ? q : spt_NextLine(q, end);
+    }
+    chunk_begin[nchunks] = end;
+
+    /* Pass 1: count nonzero lines per chunk */
+    #pragma omp parallel for schedule(static, 1) num_threads(nchunks)
+    for(int c = 0; c < nchunks; ++c) {
+        sptNnzIndex count = 0;
+        const char *q = chunk_begin[c];
+        const char * const qend = chunk_begin[c+1];
+        while(q < qend) {
+            if(spt_LineHasData(q, qend)) ++count;
+            q = spt_NextLine(q, qend);
+        }
+        chunk_nnz[c+1] = count;
+    }
+    chunk_nnz[0] = tsr->nnz;
+    for(int c = 0; c < nchunks; ++c) {
+        chunk_nnz[c+1] += chunk_nnz[c];
+    }
+    sptNnzIndex const nnz = chunk_nnz[nchunks];
+
+    /* Appending callers come back once per chunk of text, so grow geometrically */
+    if(nnz > tsr->values.cap) {
+        sptNnzIndex cap = nnz;
+        if(tsr->nnz != 0 && tsr->values.cap * 2 > cap) {
+            cap = tsr->values.cap * 2;
+        }
+        result = spt_SparseTensorReserve(tsr, cap);
+        spt_CheckError(result, "SpTns Parse", NULL);
+    }
+    tsr->nnz = nnz;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->inds[m].len = nnz;
+    }
+    tsr->values.len = nnz;
+
+    /* Pass 2: parse into the preallocated arrays */
+    int parse_error = 0;
+    #pragma omp parallel for schedule(static, 1) num_threads(nchunks) reduction(|:parse_error)
+    for(int c = 0; c < nchunks; ++c) {
+        sptNnzIndex z = chunk_nnz[c];
+        const char *q = chunk_begin[c];
+        const char * const qend = chunk_begin[c+1];
+        while(q < qend && !parse_error) {
+            if(spt_LineHasData(q, qend)) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    uint64_t index;
+                    q = spt_ScanIndex(q, qend, &index);
+                    if(q == NULL || index < start_index || index - start_index > PARTI_INDEX_MAX) {
+                        parse_error = 1;
+                        break;
+                    }
+                    tsr->inds[m].data[z] = (sptIndex) (index - start_index);
+                }
+                if(parse_error) break;
+                double value;
+                q = spt_ScanValue(q, qend, &value);
+                if(q == NULL) {
+                    parse_error = 1;
+                    break;
+                }
+                tsr->values.data[z] = value;
+                ++z;
+            }
+            q = spt_NextLine(q, qend);
+        }
+    }
+
+    free(chunk_nnz);
+    free(chunk_begin);
+    if(parse_error) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Parse", "malformed nonzero line");
+    }
+    return 0;
+}
+
+/**
+ * Load a sparse tensor from a text file in parallel.
+ *
+ * Reads the same format as sptLoadSparseTensor, with one nonzero per line.
+ * The file is mapped and its body handed to spt_ParseSparseTensorLines.
+ *
+ * @param tsr         the sparse tensor to store into
+ * @param start_index the index of the first element in array. Set to 1 for MATLAB compability, else set to 0
+ * @param filename    the file to read from
+ * @param tk          the number of threads
+ */
+int sptOmpLoadSparseTensor(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk) {
+    int result;
+    int fd = open(filename, O_RDONLY);
+    spt_CheckOSError(fd < 0, "OMP SpTns Load");
+    struct stat st;
+    result = fstat(fd, &st);
+    spt_CheckOSError(result != 0, "OMP SpTns Load");
+    size_t const file_size = (size_t) st.st_size;
+    if(file_size == 0) {
+        close(fd);
+        spt_CheckError(SPTERR_VALUE_ERROR, "OMP SpTns Load", "empty file");
+    }
+    const char * const base = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    spt_CheckOSError(base == MAP_FAILED, "OMP SpTns Load");
+    madvise((void *) base, file_size, MADV_SEQUENTIAL);
+    const char * const end = base + file_size;
+
+    const char *p = base;
+    result = spt_ParseSparseTensorHeader(tsr, &p, end);
+    if(result != 0) {
+        munmap((void *) base, file_size);
+        spt_CheckError(result, "OMP SpTns Load", NULL);
+    }
+    result = spt_ParseSparseTensorLines(tsr, start_index, p, end, tk);
+    munmap((void *) base, file_size);
+    if(result != 0) {
+        sptFreeSparseTensor(tsr);
+        spt_CheckError(result, "OMP SpTns Load", NULL);
+    }
+    return spt_SparseTensorFinishLoad(tsr);
+}
@@ -0,0 +1,243 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/*
+ * Coordinate lookup.
+ *
+ * Point queries hash the coordinates themselves rather than a linearized key,
+ * so any index space works, and a probe confirms a slot by comparing against
+ * the tensor's own indices. Only the first nonzero of each run of equal
+ * coordinates in sorted order is inserted, so every key is claimed by exactly
+ * one thread, with a compare-and-swap, and duplicates resolve to the one
+ * stored first. Range queries walk the sorted permutation by binary search.
+ */
+
+/* Hash of the coordinates coords[m] of all modes */
+static inline uint64_t spt_LookupHash(sptIndex const nmodes, sptIndex const * coords) {
+    uint64_t h = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        h = spt_GenMix(h ^ coords[m]);
+    }
+    return h;
+}
+
+static inline uint64_t spt_LookupHashAt(sptSparseTensor const * tsr, sptNnzIndex const z) {
+    uint64_t h = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        h = spt_GenMix(h ^ tsr->inds[m].data[z]);
+    }
+    return h;
+}
+
+static inline int spt_LookupMatches(sptSparseTensor const * tsr, sptNnzIndex const z, sptIndex const * coords) {
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(tsr->inds[m].data[z] != coords[m]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline int spt_LookupSameAt(sptSparseTensor const * tsr, sptNnzIndex const a, sptNnzIndex const b) {
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(tsr->inds[m].data[a] != tsr->inds[m].data[b]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Build a coordinate lookup index over a sparse tensor, for point queries in
+ * O(1) expected time and box queries in O(log nnz) per visited prefix plus
+ * the output. Neither the tensor nor its order is changed; the index holds
+ * a pointer to it and must be rebuilt after the tensor changes.
+ * @param[out] lk   an uninitialized lookup index
+ * @param[in]  tsr  the tensor to index, with at least one mode
+ * @param[in]  tk   the number of threads, 0 for the default
+ */
+int sptNewSparseTensorLookup(sptSparseTensorLookup *lk, sptSparseTensor const *tsr, int tk) {
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(nmodes == 0) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Lookup", "no modes to index");
+    }
+    lk->tsr = tsr;
+    lk->nnz = nnz;
+
+    /* Lexicographic order, mode 0 first, and the mode-0 slice starts in it */
+    lk->perm = malloc((nnz > 0 ? nnz : 1) * sizeof *lk->perm);
+    spt_CheckOSError(!lk->perm, "SpTns Lookup");
+    sptIndex * modes = malloc(nmodes * sizeof *modes);
+    spt_CheckOSError(!modes, "SpTns Lookup");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        modes[m] = m;
+    }
+    int result = spt_SparseTensorRadixPermutation(tsr, 0, nnz, nmodes, modes, 0, lk->perm, tk);
+    free(modes);
+    spt_CheckError(result, "SpTns Lookup", NULL);
+
+    sptIndex const * const inds0 = tsr->inds[0].data;
+    sptNnzIndex const * const perm = lk->perm;
+    lk->slices = malloc(((sptNnzIndex) tsr->ndims[0] + 1) * sizeof *lk->slices);
+    spt_CheckOSError(!lk->slices, "SpTns Lookup");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex k = 0; k < nnz; ++k) {
+        sptNnzIndex const lo = k == 0 ? 0 : (sptNnzIndex) inds0[perm[k-1]] + 1;
+        for(sptNnzIndex i = lo; i <= inds0[perm[k]]; ++i) {
+            lk->slices[i] = k;
+        }
+    }
+    for(sptNnzIndex i = nnz == 0 ? 0 : (sptNnzIndex) inds0[perm[nnz-1]] + 1; i <= tsr->ndims[0]; ++i) {
+        lk->slices[i] = nnz;
+    }
+
+    /* Hash the first nonzero of every coordinate, at most half the slots full */
+    sptNnzIndex cap = 16;
+    while(cap < 2 * nnz) {
+        cap <<= 1;
+    }
+    lk->mask = cap - 1;
+    lk->slots = malloc(cap * sizeof *lk->slots);
+    spt_CheckOSError(!lk->slots, "SpTns Lookup");
+    #pragma omp parallel num_threads(tk)
+    {
+        #pragma omp for schedule(static)
+        for(sptNnzIndex s = 0; s < cap; ++s) {
+            lk->slots[s] = PARTI_NOT_FOUND;
+        }
+        #pragma omp for schedule(static)
+        for(sptNnzIndex k = 0; k < nnz; ++k) {
+            sptNnzIndex const z = perm[k];
+            if(k > 0 && spt_LookupSameAt(tsr, z, perm[k-1])) {
+                continue;
+            }
+            sptNnzIndex slot = spt_LookupHashAt(tsr, z) & lk->mask;
+            for(;;) {
+                sptNnzIndex expected = PARTI_NOT_FOUND;
+                if(__atomic_compare_exchange_n(&lk->slots[slot], &expected, z, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+                slot = (slot + 1) & lk->mask;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Release a coordinate lookup index; the tensor is not touched
+ * @param lk  a lookup index built by sptNewSparseTensorLookup
+ */
+void sptFreeSparseTensorLookup(sptSparseTensorLookup *lk) {
+    free(lk->perm);
+    free(lk->slices);
+    free(lk->slots);
+    lk->perm = lk->slices = lk->slots = NULL;
+    lk->nnz = 0;
+}
+
+/**
+ * Find the nonzero at a coordinate
+ * @param lk      a lookup index
+ * @param coords  the index of each mode
+ * @return the position of the nonzero in the tensor, the first stored one if
+ *         the coordinate is duplicated, or PARTI_NOT_FOUND
+ */
+sptNnzIndex sptSparseTensorLookupFind(sptSparseTensorLookup const *lk, sptIndex const coords[]) {
+    sptSparseTensor const * const tsr = lk->tsr;
+    sptNnzIndex slot = spt_LookupHash(tsr->nmodes, coords) & lk->mask;
+    while(lk->slots[slot] != PARTI_NOT_FOUND) {
+        if(spt_LookupMatches(tsr, lk->slots[slot], coords)) {
+            return lk->slots[slot];
+        }
+        slot = (slot + 1) & lk->mask;
+    }
+    return PARTI_NOT_FOUND;
+}
+
+/* First k in [b, e) of the sorted nonzeros whose mode-m index is at least v, all modes before m being equal over [b, e) */
+static sptNnzIndex spt_LookupLowerBound(sptSparseTensorLookup const *lk, sptIndex const m, sptNnzIndex b, sptNnzIndex e, sptIndex const v) {
+    sptIndex const * const inds = lk->tsr->inds[m].data;
+    while(b < e) {
+        sptNnzIndex const mid = b + (e - b) / 2;
+        if(inds[lk->perm[mid]] < v) {
+            b = mid + 1;
+        } else {
+            e = mid;
+        }
+    }
+    return b;
+}
+
+/* Append the nonzeros of sorted range [b, e), equal on the modes before m, that fall in the box from mode m on */
+static int spt_LookupRangeFrom(sptNnzIndexVector *out, sptSparseTensorLookup const *lk, sptIndex const m,
+    sptNnzIndex b, sptNnzIndex e, sptIndex const lo[], sptIndex const hi[])
+{
+    sptIndex const * const inds = lk->tsr->inds[m].data;
+    b = spt_LookupLowerBound(lk, m, b, e, lo[m]);
+    e = spt_LookupLowerBound(lk, m, b, e, hi[m]);
+    if(m + 1 == lk->tsr->nmodes) {
+        return sptAppendNnzIndexVectorN(out, lk->perm + b, e - b);
+    }
+    while(b < e) {
+        sptIndex const v = inds[lk->perm[b]];
+        sptNnzIndex const run_end = v + 1 < hi[m] ? spt_LookupLowerBound(lk, m, b, e, v + 1) : e;
+        int result = spt_LookupRangeFrom(out, lk, m + 1, b, run_end, lo, hi);
+        spt_CheckError(result, "SpTns Lookup", NULL);
+        b = run_end;
+    }
+    return 0;
+}
+
+/**
+ * Collect the nonzeros inside a box of coordinates, lo[m] <= index < hi[m]
+ * in every mode m, in lexicographic coordinate order. A box that spans whole
+ * trailing modes costs one binary search per distinct leading prefix.
+ * @param[out] out  the positions of the nonzeros in the tensor are appended here
+ * @param[in]  lk   a lookup index
+ * @param[in]  lo   the first index of the box in each mode
+ * @param[in]  hi   one past the last index of the box in each mode
+ */
+int sptSparseTensorLookupRange(
+    sptNnzIndexVector *out,
+    sptSparseTensorLookup const *lk,
+    sptIndex const lo[],
+    sptIndex const hi[])
+{
+    sptSparseTensor const * const tsr = lk->tsr;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(lo[m] >= hi[m]) {
+            return 0;
+        }
+    }
+    sptIndex const first = lo[0] < tsr->ndims[0] ? lo[0] : tsr->ndims[0];
+    sptIndex const last = hi[0] < tsr->ndims[0] ? hi[0] : tsr->ndims[0];
+    return spt_LookupRangeFrom(out, lk, 0, lk->slices[first], lk->slices[last], lo, hi);
+}
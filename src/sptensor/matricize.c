@@ -17,8 +17,45 @@
 */
 
 #include <ParTI.h>
+#include <stdlib.h>
 #include "sptensor.h"
 
+/*
+ * The modes other than m, in the order (m+1, ..., N-1, 0, ..., m-1) with the
+ * first one slowest, are linearized into one index; strides[i] is the stride
+ * of new_order[i]. Returns the product of their sizes.
+ */
+static sptNnzIndex spt_MatricizeLayout(
+    sptSparseTensor const * const X,
+    sptIndex const m,
+    sptIndex * const new_order,
+    sptNnzIndex * const strides)
+{
+    sptIndex const nmodes = X->nmodes;
+    for(sptIndex i=1; i<nmodes; ++i) {
+        new_order[i-1] = (m+i) % nmodes;
+    }
+    sptNnzIndex span = 1;
+    for(sptIndex i=nmodes-1; i-- > 0; ) {
+        strides[i] = span;
+        span *= X->ndims[new_order[i]];
+    }
+    return span;
+}
+
+static inline sptNnzIndex spt_MatricizeLinear(
+    sptSparseTensor const * const X,
+    sptNnzIndex const x,
+    sptIndex const * const new_order,
+    sptNnzIndex const * const strides)
+{
+    sptNnzIndex lin = 0;
+    for(sptIndex i=0; i<X->nmodes-1; ++i) {
+        lin += X->inds[new_order[i]].data[x] * strides[i];
+    }
+    return lin;
+}
+
 int sptMatricize(sptSparseTensor const * const X,
     sptIndex const m,
     sptSparseMatrix * const A,
@@ -35,57 +72,31 @@ int sptMatricize(sptSparseTensor const * const X,
     sptNewIndexVector(&(A->colind), 0, nnz);
     sptNewValueVector(&(A->values), 0, nnz);
 
-    /* Calculate the new_order of the rest modes except mode-m. */
+    /* Calculate the new_order of the rest modes except mode-m, and their strides. */
     sptIndex * new_order = (sptIndex *)malloc((nmodes-1) * sizeof * new_order);
-    for(sptIndex i=1; i<nmodes; ++i) {
-        new_order[i-1] = (m+i) % nmodes;
-    }
-    /* Calculate strides for tensor X, from mode-(N-1) to mode-0. */
     sptNnzIndex * strides = (sptNnzIndex *)malloc((nmodes-1) * sizeof *strides);
-    strides[nmodes-2] = 1;
-    for(int i=nmodes-3; i>=0; --i) {
-        sptIndex new_i = new_order[i];
-        strides[i] = strides[i+1] * ndims[new_i+1];
-    }
+    sptNnzIndex const span = spt_MatricizeLayout(X, m, new_order, strides);
 
 
     if(transpose == 1) {    // mode-m as row
         A->nrows = ndims[m];
-        A->ncols = 1;
-        for(sptIndex i=0; i<nmodes-1; ++i) {
-            sptIndex new_i = new_order[i];
-            A->ncols *= ndims[new_i];
-        }
+        A->ncols = (sptIndex)span;
 
         sptCopyIndexVector(&(A->rowind), &(X->inds[m]), 1);
         for(sptNnzIndex x=0; x<nnz; ++x) {
-            sptNnzIndex col = 0;
-            for(sptIndex i=0; i<nmodes-1; ++i) {
-                sptIndex new_i = new_order[i];
-                sptIndex index = X->inds[new_i].data[x];
-                col += index * strides[i];
-            }
+            sptNnzIndex col = spt_MatricizeLinear(X, x, new_order, strides);
             sptAppendIndexVector(&(A->colind), (sptIndex)col);  // maybe overflow
             sptAppendValueVector(&(A->values), vals[x]);
         }
 
     } else if(transpose == 0) {    // mode-m as column
         A->ncols = ndims[m];
-        A->nrows = 1;
-        for(sptIndex i=0; i<nmodes-1; ++i) {
-            sptIndex new_i = new_order[i];
-            A->nrows *= ndims[new_i];
-        }
+        A->nrows = (sptIndex)span;
 
         sptCopyIndexVector(&(A->colind), &(X->inds[m]), 1);
         for(sptNnzIndex x=0; x<nnz; ++x) {
-            sptNnzIndex row = 0;
-            for(sptIndex i=0; i<nmodes-1; ++i) {
-                sptIndex new_i = new_order[i];
-                sptIndex index = X->inds[new_i].data[x];
-                row += index * strides[i];
-            }
-            sptAppendIndexVector(&(A->colind), (sptIndex)row);
+            sptNnzIndex row = spt_MatricizeLinear(X, x, new_order, strides);
+            sptAppendIndexVector(&(A->rowind), (sptIndex)row);
             sptAppendValueVector(&(A->values), vals[x]);
         }
 
@@ -97,3 +108,112 @@ int sptMatricize(sptSparseTensor const * const X,
     free(new_order);
     return 0;
 }
+
+
+typedef struct {
+    sptNnzIndex const * rows;
+    sptNnzIndex const * cols;
+} spt_MatricizeKeyContext;
+
+static void spt_MatricizeKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    spt_MatricizeKeyContext const * const c = ctx;
+    sptNnzIndex const * const src = word == 0 ? c->rows : c->cols;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = src[perm[i]];
+    }
+}
+
+
+/**
+ * Matricize a sparse tensor into a CSR matrix in parallel, with the columns of
+ * every row in increasing order. The nonzeros are ordered by a stable radix
+ * sort on (row, column) and the row pointers are found from the row changes,
+ * so no step is serial in the number of nonzeros.
+ * @param[in]  X         the sparse tensor
+ * @param[in]  m         the mode to matricize on
+ * @param[out] A         an uninitialized CSR matrix
+ * @param[in]  transpose 1 for mode m as the rows, 0 for mode m as the columns
+ * @param[in]  tk        the number of threads
+ */
+int sptMatricizeCSR(sptSparseTensor const * const X,
+    sptIndex const m,
+    sptSparseMatrixCSR * const A,
+    int const transpose,
+    int const tk) {
+
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(m >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Matricize CSR", "m >= nmodes");
+    }
+    if(transpose != 0 && transpose != 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Matricize CSR", "incorrect transpose value");
+    }
+
+    sptIndex * new_order = malloc((nmodes > 1 ? nmodes-1 : 1) * sizeof *new_order);
+    sptNnzIndex * strides = malloc((nmodes > 1 ? nmodes-1 : 1) * sizeof *strides);
+    spt_CheckOSError(!new_order || !strides, "SpTns Matricize CSR");
+    sptNnzIndex const span = spt_MatricizeLayout(X, m, new_order, strides);
+    sptNnzIndex const nrows = transpose ? X->ndims[m] : span;
+    sptNnzIndex const ncols = transpose ? span : X->ndims[m];
+    if(nrows > (sptIndex) -1 || ncols > (sptIndex) -1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Matricize CSR", "matricized dimension overflows sptIndex");
+    }
+
+    sptNnzIndex * rows = malloc((nnz > 0 ? nnz : 1) * sizeof *rows);
+    sptNnzIndex * cols = malloc((nnz > 0 ? nnz : 1) * sizeof *cols);
+    sptNnzIndex * perm = malloc((nnz > 0 ? nnz : 1) * sizeof *perm);
+    spt_CheckOSError(!rows || !cols || !perm, "SpTns Matricize CSR");
+    sptIndex const * const mode_ind = X->inds[m].data;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex x = 0; x < nnz; ++x) {
+        sptNnzIndex const lin = spt_MatricizeLinear(X, x, new_order, strides);
+        rows[x] = transpose ? mode_ind[x] : lin;
+        cols[x] = transpose ? lin : mode_ind[x];
+    }
+
+    unsigned const word_bits[2] = { spt_RadixBitWidth((sptIndex) nrows), spt_RadixBitWidth((sptIndex) ncols) };
+    spt_MatricizeKeyContext const ctx = { rows, cols };
+    if(nnz > 0) {
+        result = spt_RadixSortPermutation(perm, nnz, 2, word_bits, spt_MatricizeKey, &ctx, tk);
+        spt_CheckError(result, "SpTns Matricize CSR", NULL);
+    }
+
+    A->nrows = (sptIndex) nrows;
+    A->ncols = (sptIndex) ncols;
+    A->nnz = nnz;
+    result = sptNewNnzIndexVector(&A->rowptr, nrows + 1, nrows + 1);
+    spt_CheckError(result, "SpTns Matricize CSR", NULL);
+    result = sptNewIndexVector(&A->colind, nnz, nnz);
+    spt_CheckError(result, "SpTns Matricize CSR", NULL);
+    result = sptNewValueVector(&A->values, nnz, nnz);
+    spt_CheckError(result, "SpTns Matricize CSR", NULL);
+
+    sptNnzIndex * const rowptr = A->rowptr.data;
+    sptValue const * const vals = X->values.data;
+    #pragma omp parallel num_threads(tk)
+    {
+        #pragma omp for schedule(static)
+        for(sptNnzIndex i = 0; i < nnz; ++i) {
+            A->colind.data[i] = (sptIndex) cols[perm[i]];
+            A->values.data[i] = vals[perm[i]];
+        }
+        /* Position i starts rows (row of i-1, row of i]; every pointer has exactly one writer */
+        #pragma omp for schedule(static)
+        for(sptNnzIndex i = 0; i <= nnz; ++i) {
+            sptNnzIndex const first = i == 0 ? 0 : rows[perm[i-1]] + 1;
+            sptNnzIndex const last = i == nnz ? nrows : rows[perm[i]];
+            for(sptNnzIndex r = first; r <= last; ++r) {
+                rowptr[r] = i;
+            }
+        }
+    }
+
+    free(rows);
+    free(cols);
+    free(perm);
+    free(strides);
+    free(new_order);
+    return 0;
+}
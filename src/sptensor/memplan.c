@@ -0,0 +1,258 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/*
+ * Memory footprint planning.
+ *
+ * The estimates add up what a run allocates, with the sizes the allocating
+ * code uses: rows padded to a multiple of 8 values, a matrix of zero rows
+ * taking one. Where the size depends on the data, such as the hot rows of a
+ * mode or the blocks of a HiCOO tensor, they take the largest it can be, so
+ * a run that fits its estimate fits its memory.
+ */
+
+/* Bytes of a dense matrix as sptNewMatrix and sptNewRankMatrix allocate it */
+size_t spt_MatrixBytes(sptIndex const nrows, sptIndex const ncols)
+{
+    size_t const stride = ncols != 0 ? ((size_t)(ncols - 1) / 8 + 1) * 8 : 8;
+    return (size_t)(nrows != 0 ? nrows : 1) * stride * sizeof(sptValue);
+}
+
+static void spt_SumMemoryEstimate(sptMemoryEstimate * est)
+{
+    est->peak = est->tensor + est->factors + est->scratch + est->privatized;
+}
+
+
+/*
+ * sptOmpCpdAls on X, with at most private_bytes of hot rows when use_reduce
+ * is 1 and at most layout_bytes of mode-specific copies
+ */
+static int spt_EstimateCpdMemory(
+    sptMemoryEstimate * est,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    int const use_reduce,
+    size_t const private_bytes,
+    size_t const layout_bytes)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MemPlan", "tk < 1");
+    }
+    if(use_reduce < 0 || use_reduce > 2) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MemPlan", "use_reduce is neither 0, 1 nor 2");
+    }
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    size_t const row_bytes = spt_MatrixBytes(1, rank);
+    size_t factor_bytes = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        factor_bytes += spt_MatrixBytes(X->ndims[m], rank);
+    }
+
+    est->tensor = (size_t) spt_SparseTensorBytes(X);
+    if(layout_bytes != 0) {
+        int * routed = malloc(nmodes * sizeof *routed);
+        spt_CheckOSError(!routed, "SpTns MemPlan");
+        est->tensor += spt_PlanCpdLayouts(routed, nmodes, X->ndims, X->nnz, !sptSparseTensorIsPattern(X), rank, tk, layout_bytes);
+        free(routed);
+    }
+    /* Factors, lambda, the MTTKRP output and nmodes+1 Gram matrices of the workspace */
+    est->factors = factor_bytes + rank * sizeof(sptValue) + spt_MatrixBytes(max_dim, rank) +
+        (nmodes + 1) * spt_MatrixBytes(rank, rank);
+    est->scratch = (size_t)tk * row_bytes;
+    if(spt_CpdLineSearchEnabled()) {
+        est->scratch += 2 * factor_bytes + rank * sizeof(sptValue);
+    }
+
+    est->privatized = 0;
+    if(use_reduce == 1) {
+        /* sptNewMttkrpHotRows: the slots of every row, and up to cap private rows per thread */
+        size_t const cap = private_bytes / ((size_t)tk * row_bytes);
+        size_t const max_hot = cap < max_dim ? cap : max_dim;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            size_t const nhot = cap < X->ndims[m] ? cap : X->ndims[m];
+            est->privatized += ((size_t)X->ndims[m] + nhot) * sizeof(sptIndex);
+        }
+        est->privatized += (size_t)tk * max_hot * row_bytes + (size_t)tk * row_bytes;
+    } else if(use_reduce == 2) {
+#ifdef PARTI_USE_OPENMP
+        est->privatized = sizeof(sptMutexPool) + (size_t)PARTI_DEFAULT_NLOCKS * PARTI_DEFAULT_LOCK_PAD_SIZE * sizeof(omp_lock_t);
+#else
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MemPlan", "lock pools need OpenMP");
+#endif
+    }
+    spt_SumMemoryEstimate(est);
+    return 0;
+}
+
+
+/**
+ * Predict the peak bytes of sptOmpCpdAls, including the tensor itself
+ * @param[out] est         the estimate, by component and in total
+ * @param[in]  X           the COO tensor to decompose
+ * @param[in]  rank        the CPD rank
+ * @param[in]  tk          the number of threads
+ * @param[in]  use_reduce  as for sptOmpCpdAls
+ */
+int sptEstimateCpdMemory(
+    sptMemoryEstimate * est,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    int const use_reduce)
+{
+    return spt_EstimateCpdMemory(est, X, rank, tk, use_reduce, PARTI_MTTKRP_PRIVATE_BYTES, spt_CpdLayoutBudget());
+}
+
+
+/**
+ * Predict the peak bytes of sptSparseTensorToHiCOO, the COO tensor and the
+ * HiCOO tensor both held, while the COO tensor is being sorted. Every block
+ * and kernel is taken to hold a single nonzero, unless the tensor is too
+ * small to have that many.
+ * @param[out] est      the estimate, by component and in total
+ * @param[in]  tsr      the COO tensor to convert
+ * @param[in]  sb_bits  the block size bits
+ * @param[in]  sk_bits  the kernel size bits
+ * @param[in]  tk       the number of threads
+ */
+int sptEstimateHiCOOMemory(
+    sptMemoryEstimate * est,
+    sptSparseTensor const * const tsr,
+    sptElementIndex const sb_bits,
+    sptElementIndex const sk_bits,
+    int const tk)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(sk_bits < sb_bits) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MemPlan", "sk_bits < sb_bits");
+    }
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MemPlan", "tk < 1");
+    }
+
+    /* At most one block or kernel per nonzero, and no more than the tensor has */
+    double nblocks = 1, nkernels = 1;
+    size_t kernel_rows = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const kernel_ndim = (tsr->ndims[m] + ((sptIndex)1 << sk_bits) - 1) >> sk_bits;
+        nblocks *= (double)((tsr->ndims[m] + ((sptIndex)1 << sb_bits) - 1) >> sb_bits);
+        nkernels *= (double)kernel_ndim;
+        kernel_rows += kernel_ndim;
+    }
+    size_t const nb = nblocks < (double)nnz ? (size_t)nblocks : (size_t)nnz;
+    size_t const nk = nkernels < (double)nnz ? (size_t)nkernels : (size_t)nnz;
+
+    est->tensor = (size_t) spt_SparseTensorBytes(tsr);
+    est->tensor += (size_t)nnz * (sizeof(sptValue) + nmodes * sizeof(sptElementIndex));
+    est->tensor += nb * nmodes * sizeof(sptBlockIndex) + (nb + 1) * sizeof(sptNnzIndex);
+    est->tensor += (nk + 1) * sizeof(sptNnzIndex);
+    /* The kernel scheduler lists every kernel once per mode */
+    est->tensor += nk * nmodes * sizeof(sptIndex) + kernel_rows * sizeof(sptIndexVector) + nmodes * sizeof(sptIndex);
+    est->factors = 0;
+    /* The radix sort: a permutation, its keys and their double buffers, and the per-thread histograms */
+    est->scratch = 2 * (size_t)nnz * (sizeof(sptNnzIndex) + sizeof(uint64_t)) + (size_t)tk * 256 * sizeof(sptNnzIndex);
+    est->privatized = 0;
+    spt_SumMemoryEstimate(est);
+    return 0;
+}
+
+
+/**
+ * OpenMP CP-ALS as sptOmpCpdAls, choosing the fastest update strategy whose
+ * estimated peak fits a memory budget: mode-specific tensor copies take what
+ * the budget leaves after the rest of the run, up to the sptSetCpdLayoutBudget
+ * setting, privatized hot rows what remains, up to PARTI_MTTKRP_PRIVATE_BYTES,
+ * and MTTKRP falls back to atomics when not a single row fits.
+ * Fails with SPTERR_VALUE_ERROR, before allocating, when nothing fits.
+ * @param[in,out] ktensor the Kruskal tensor; factors it already holds are the initial guess
+ * @param[in]  spten the COO representation of a sparse tensor
+ * @param[in]  rank the CPD rank
+ * @param[in]  niters the maximum number of iterations
+ * @param[in]  tol the tolerance value for convergence
+ * @param[in]  tk the number of threads
+ * @param[in]  budget the bytes the run may take at its peak, the tensor included
+ */
+int sptOmpCpdAlsBudget(
+    sptSparseTensor const * const spten,
+    sptIndex const rank,
+    sptIndex const niters,
+    double const tol,
+    const int tk,
+    size_t const budget,
+    sptKruskalTensor * ktensor)
+{
+    sptMemoryEstimate est;
+    int result = spt_EstimateCpdMemory(&est, spten, rank, tk, 0, 0, 0);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+    if(est.peak > budget) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns CPD-ALS", "no configuration fits the memory budget");
+    }
+
+    /* Copies for the longest modes first, then the run with them is the base for hot rows */
+    size_t layout_bytes = budget - est.peak;
+    if(layout_bytes > spt_CpdLayoutBudget()) {
+        layout_bytes = spt_CpdLayoutBudget();
+    }
+    result = spt_EstimateCpdMemory(&est, spten, rank, tk, 0, 0, layout_bytes);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+
+    /* Hot rows privatized in the bytes left over, once their bookkeeping is paid for */
+    size_t private_bytes = budget - est.peak;
+    if(private_bytes > PARTI_MTTKRP_PRIVATE_BYTES) {
+        private_bytes = PARTI_MTTKRP_PRIVATE_BYTES;
+    }
+    sptMemoryEstimate hot;
+    while(private_bytes > 0) {
+        result = spt_EstimateCpdMemory(&hot, spten, rank, tk, 1, private_bytes, layout_bytes);
+        spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+        if(hot.peak <= budget) {
+            break;
+        }
+        private_bytes -= hot.peak - budget < private_bytes ? hot.peak - budget : private_bytes;
+    }
+    int const use_hot = private_bytes >= (size_t)tk * spt_MatrixBytes(1, rank);
+
+    sptCpdWorkspace ws;
+    result = sptNewCpdWorkspace(&ws, spten->nmodes, spten->ndims, rank, tk, 0);
+    spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+    if(use_hot) {
+        result = sptCpdWorkspaceUseHotRows(&ws, spten, private_bytes);
+        if(result != 0) {
+            sptFreeCpdWorkspace(&ws);
+            spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+        }
+    }
+    if(layout_bytes != 0) {
+        result = sptCpdWorkspaceUseLayouts(&ws, spten, layout_bytes);
+        if(result != 0) {
+            sptFreeCpdWorkspace(&ws);
+            spt_CheckError(result, "CPU  SpTns CPD-ALS", NULL);
+        }
+    }
+    result = sptOmpCpdAlsWorkspace(spten, rank, niters, tol, &ws, ktensor);
+    sptFreeCpdWorkspace(&ws);
+    return result;
+}
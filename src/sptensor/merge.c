@@ -0,0 +1,178 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/* Merge-path split of diagonal diag: the first xi nonzeros of X and yj of Y,
+ * xi + yj = diag (or diag + 1), merge before the rest. Equal indices go to
+ * the same side, so every partition can add its matches on its own. */
+static void spt_MergePathSplit(
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    sptNnzIndex const diag,
+    sptNnzIndex *xi,
+    sptNnzIndex *yj)
+{
+    sptNnzIndex lo = diag > Y->nnz ? diag - Y->nnz : 0;
+    sptNnzIndex hi = diag < X->nnz ? diag : X->nnz;
+    while(lo < hi) {
+        sptNnzIndex mid = lo + (hi - lo) / 2;
+        if(spt_SparseTensorCompareIndices(X, mid, Y, diag - mid - 1) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *xi = lo;
+    *yj = diag - lo;
+    if(*xi > 0 && *yj < Y->nnz && spt_SparseTensorCompareIndices(X, *xi - 1, Y, *yj) == 0) {
+        ++*yj;
+    }
+}
+
+/* Merge X[xb, xe) with Y[yb, ye) into Z from offset out, or only count if Z is NULL */
+static sptNnzIndex spt_MergeRange(
+    sptSparseTensor *Z,
+    sptNnzIndex out,
+    const sptSparseTensor *X,
+    sptNnzIndex i,
+    sptNnzIndex const xe,
+    const sptSparseTensor *Y,
+    sptNnzIndex j,
+    sptNnzIndex const ye,
+    spt_JoinOp const op,
+    int const is_union)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex count = 0;
+    while(is_union ? i < xe || j < ye : i < xe && j < ye) {
+        int compare;
+        if(i == xe) {
+            compare = 1;
+        } else if(j == ye) {
+            compare = -1;
+        } else {
+            compare = spt_SparseTensorCompareIndices(X, i, Y, j);
+        }
+        const sptSparseTensor *src = compare > 0 ? Y : X;
+        sptNnzIndex const loc = compare > 0 ? j : i;
+        sptValue value;
+        if(compare != 0 && !is_union) {
+            i += compare < 0;
+            j += compare > 0;
+            continue;
+        } else if(compare < 0) {
+            value = op(X->values.data[i++], 0);
+        } else if(compare > 0) {
+            value = op(0, Y->values.data[j++]);
+        } else {
+            value = op(X->values.data[i++], Y->values.data[j++]);
+        }
+        /* Drop entries that cancel out, like spt_SparseTensorCollectZeros */
+        if(value == 0) {
+            continue;
+        }
+        if(Z != NULL) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                Z->inds[m].data[out + count] = src->inds[m].data[loc];
+            }
+            Z->values.data[out + count] = value;
+        }
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * Element-wise Z = op(X, Y) of two sparse tensors sorted in the natural
+ * (mode 0 first) order, over the union or the intersection of their nonzeros. Both inputs are split into nt partitions at
+ * co-ranked index boundaries (merge path), each partition counts its output
+ * nonzeros, and after a prefix sum every partition scatters into one
+ * preallocated Z, which comes out in the same order.
+ * @param[out] Z        the result, should be uninitialized
+ * @param[in]  X        the first input
+ * @param[in]  Y        the second input
+ * @param[in]  op       the element-wise operation
+ * @param[in]  is_union 1 to keep nonzeros of either input, 0 for both only
+ * @param[in]  nt       the number of threads
+ * @param[in]  module   the module name errors are reported under
+ */
+int spt_SparseTensorMerge(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    spt_JoinOp const op,
+    int const is_union,
+    int const nt,
+    const char *module)
+{
+    (void) module;
+    /* Ensure X and Y are in same shape */
+    if(Y->nmodes != X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    for(sptIndex i = 0; i < X->nmodes; ++i) {
+        if(Y->ndims[i] != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+        }
+    }
+    int const nparts = nt > 0 ? nt : 1;
+
+    sptNnzIndex * xbound = malloc((nparts + 1) * sizeof *xbound);
+    sptNnzIndex * ybound = malloc((nparts + 1) * sizeof *ybound);
+    sptNnzIndex * offsets = malloc((nparts + 1) * sizeof *offsets);
+    spt_CheckOSError(!xbound || !ybound || !offsets, module);
+
+    sptNnzIndex const total = X->nnz + Y->nnz;
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p <= nparts; ++p) {
+        sptNnzIndex const diag = total / nparts * p + (total % nparts) * p / nparts;
+        spt_MergePathSplit(X, Y, diag, &xbound[p], &ybound[p]);
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        offsets[p + 1] = spt_MergeRange(NULL, 0, X, xbound[p], xbound[p + 1], Y, ybound[p], ybound[p + 1], op, is_union);
+    }
+    offsets[0] = 0;
+    for(int p = 0; p < nparts; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+
+    int result = sptNewSparseTensor(Z, X->nmodes, X->ndims);
+    spt_CheckError(result, module, NULL);
+    for(sptIndex m = 0; m < Z->nmodes; ++m) {
+        result = sptResizeIndexVector(&Z->inds[m], offsets[nparts]);
+        spt_CheckError(result, module, NULL);
+    }
+    result = sptResizeValueVector(&Z->values, offsets[nparts]);
+    spt_CheckError(result, module, NULL);
+    Z->nnz = offsets[nparts];
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        spt_MergeRange(Z, offsets[p], X, xbound[p], xbound[p + 1], Y, ybound[p], ybound[p + 1], op, is_union);
+    }
+
+    free(xbound);
+    free(ybound);
+    free(offsets);
+    return 0;
+}
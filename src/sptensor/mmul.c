@@ -32,6 +32,8 @@
  * if you need to access raw data.
  * Anyway, you do not have to take this side-effect into consideration if you
  * do not need to access raw data.
+ * With `sptSparseTensorKeepSortedCopies` enabled on X, X is left in its order
+ * and a copy sorted at mode is kept on it instead.
  */
 int sptSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode) {
     int result;
@@ -45,9 +47,10 @@ int sptSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const s
     if(X->ndims[mode] != U->nrows) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Mtx", "shape mismatch");
     }
-    sptSparseTensorSortIndexAtMode(X, mode, 0);
-    // jli: try to avoid malloc in all operation functions.
-    ind_buf = malloc(X->nmodes * sizeof *ind_buf);
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "CPU  SpTns * Mtx");
+    ind_buf = spt_ScratchAlloc(X->nmodes * sizeof *ind_buf);
     spt_CheckOSError(!ind_buf, "CPU  SpTns * Mtx");
     for(m = 0; m < X->nmodes; ++m) {
         ind_buf[m] = X->ndims[m];
@@ -55,28 +58,40 @@ int sptSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const s
     ind_buf[mode] = U->ncols;
     // jli: use pre-processing to allocate Y size outside this function.
     result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
-    free(ind_buf);
+    spt_ScratchFree(ind_buf);
     spt_CheckError(result, "CPU  SpTns * Mtx", NULL);
     sptSemiSparseTensorSetIndices(Y, &fiberidx, X);
 
     sptTimer timer;
     sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(1);
     sptStartTimer(timer);
 
     for(i = 0; i < Y->nnz; ++i) {
         sptNnzIndex inz_begin = fiberidx.data[i];
         sptNnzIndex inz_end = fiberidx.data[i+1];
         // jli: exchange the two loops
-        for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
-            sptIndex r = X->inds[mode].data[j];
-            for(sptIndex k = 0; k < U->ncols; ++k) {
-                Y->values.values[i*Y->stride + k] += X->values.data[j] * U->values[r*U->stride + k];
+        if(X->values.data == NULL) {
+            for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
+                sptIndex r = X->inds[mode].data[j];
+                for(sptIndex k = 0; k < U->ncols; ++k) {
+                    Y->values.values[i*Y->stride + k] += U->values[r*U->stride + k];
+                }
+            }
+        } else {
+            for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
+                sptIndex r = X->inds[mode].data[j];
+                for(sptIndex k = 0; k < U->ncols; ++k) {
+                    Y->values.values[i*Y->stride + k] += X->values.data[j] * U->values[r*U->stride + k];
+                }
             }
         }
     }
 
     sptStopTimer(timer);
-    sptPrintElapsedTime(timer, "CPU  SpTns * Mtx");
+    /* Two flops per nonzero and column; reads X and its rows of U, writes Y */
+    spt_KernelProbeStop(probe, timer, "CPU  SpTns * Mtx", 2.0 * X->nnz * U->ncols,
+        spt_SparseTensorBytes(X) + ((double) X->nnz + Y->nnz) * U->ncols * sizeof (sptValue));
     sptFreeTimer(timer);
 
     sptFreeNnzIndexVector(&fiberidx);
@@ -40,7 +40,9 @@ int sptCudaSparseTensorMulMatrix(
     if(X->ndims[mode] != U->nrows) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Mtx", "shape mismatch");
     }
-    sptSparseTensorSortIndexAtMode(X, mode, 0);
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "CUDA SpTns * Mtx");
     ind_buf = new sptIndex[X->nmodes * sizeof *ind_buf];
     for(m = 0; m < X->nmodes; ++m) {
         ind_buf[m] = X->ndims[m];
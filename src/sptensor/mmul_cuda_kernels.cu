@@ -389,4 +389,43 @@ __global__ void spt_TTMRankRBNnzKernelSM(
         }
     }
 
-}
\ No newline at end of file
+}
+
+
+
+/* impl_num = 16 */
+__global__ void spt_TTMRankUnitKernel(
+    sptValue *Y_val, 
+    sptIndex Y_stride,
+    const sptValue * __restrict__ X_val, 
+    const sptIndex * __restrict__ X_inds_m,
+    const sptNnzIndex * __restrict__ unit_seg, 
+    const sptNnzIndex * __restrict__ unit_ptr, 
+    sptNnzIndex nunits,
+    const sptValue * __restrict__ U_val, 
+    sptIndex U_ncols, 
+    sptIndex U_stride)
+{
+    const sptNnzIndex units_per_loop = gridDim.x * blockDim.y;
+
+    for(sptNnzIndex u = blockIdx.x * blockDim.y + threadIdx.y; u < nunits; u += units_per_loop) {
+        const sptNnzIndex x = unit_seg[u];
+        /* The units of a heavy fiber are neighbours and add up their partial sums */
+        const bool split = (u > 0 && unit_seg[u-1] == x) || (u + 1 < nunits && unit_seg[u+1] == x);
+        const sptNnzIndex inz_begin = unit_ptr[u];
+        const sptNnzIndex inz_end = unit_ptr[u+1];
+
+        for(sptIndex r = threadIdx.x; r < U_ncols; r += blockDim.x) {
+            sptValue sum = 0;
+            for(sptNnzIndex i = inz_begin; i < inz_end; ++i) {
+                const sptIndex row = X_inds_m[i];
+                sum += X_val[i] * U_val[row*U_stride + r];
+            }
+            if(split) {
+                atomicAdd(&(Y_val[x*Y_stride + r]), sum);
+            } else {
+                Y_val[x*Y_stride + r] = sum;
+            }
+        }
+    }
+}
@@ -112,4 +112,17 @@ __global__ void spt_TTMRankRBNnzKernelSM(
     sptIndex U_ncols, 
     sptIndex U_stride);
 
+/* impl_num = 16, fibers cut into work units by spt_SplitHeavySegments */
+__global__ void spt_TTMRankUnitKernel(
+    sptValue *Y_val, 
+    sptIndex Y_stride,
+    const sptValue * __restrict__ X_val, 
+    const sptIndex * __restrict__ X_inds_m,
+    const sptNnzIndex * __restrict__ unit_seg, 
+    const sptNnzIndex * __restrict__ unit_ptr, 
+    sptNnzIndex nunits,
+    const sptValue * __restrict__ U_val, 
+    sptIndex U_ncols, 
+    sptIndex U_stride);
+
 #endif
\ No newline at end of file
@@ -21,9 +21,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "sptensor.h"
+#include "../cudawrap.h"
 #include "mmul_cuda_kernels.h"
 
 
+/**
+ * CUDA sparse tensor times a dense matrix on a mode, in one kernel
+ * @param[out] Y    the semi-sparse result
+ * @param[in]  X    the sparse tensor, sorted at mode if it is not yet
+ * @param[in]  U    the dense matrix
+ * @param[in]  mode   the mode to multiply
+ * @param[in]  impl_num   the kernel, 11 to 16, or PARTI_CUDA_IMPL_AUTO; 16 cuts heavy fibers into bounded work units
+ * @param[in]  smen_size   the shared memory bytes per block of kernel 15; ignored with PARTI_CUDA_IMPL_AUTO
+ */
 int sptCudaSparseTensorMulMatrixOneKernel(
     sptSemiSparseTensor *Y,
     sptSparseTensor *X,
@@ -32,6 +42,11 @@ int sptCudaSparseTensorMulMatrixOneKernel(
     sptIndex const impl_num,
     sptNnzIndex const smen_size) 
 {
+    if(impl_num == PARTI_CUDA_IMPL_AUTO) {
+        sptNnzIndex auto_smen_size;
+        sptIndex const auto_impl = spt_CudaSelectTTMImpl(X, U, mode, &auto_smen_size);
+        return sptCudaSparseTensorMulMatrixOneKernel(Y, X, U, mode, auto_impl, auto_smen_size);
+    }
     int result;
     sptIndex *ind_buf;
     sptIndex m;
@@ -42,7 +57,9 @@ int sptCudaSparseTensorMulMatrixOneKernel(
     if(X->ndims[mode] != U->nrows) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Mtx", "shape mismatch");
     }
-    sptSparseTensorSortIndexAtMode(X, mode, 0);
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "CUDA SpTns * Mtx");
     ind_buf = new sptIndex[X->nmodes * sizeof *ind_buf];
     for(m = 0; m < X->nmodes; ++m) {
         ind_buf[m] = X->ndims[m];
@@ -87,6 +104,24 @@ int sptCudaSparseTensorMulMatrixOneKernel(
     spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
     cudaMemcpy(fiberidx_val, fiberidx.data, fiberidx.len * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
 
+    /* Kernel 16 spreads the nonzeros of long fibers over several thread rows */
+    sptNnzIndexVector unit_seg, unit_ptr;
+    sptNnzIndex *unit_seg_val = NULL;
+    sptNnzIndex *unit_ptr_val = NULL;
+    sptNnzIndex nunits = 0;
+    if(impl_num == 16) {
+        result = spt_SplitHeavySegments(&unit_seg, &unit_ptr, fiberidx.data, fiberidx.len - 1, 0);
+        spt_CheckError(result, "CUDA SpTns * Mtx", NULL);
+        nunits = unit_seg.len;
+        result = sptCudaDuplicateMemory(&unit_seg_val, unit_seg.data, nunits * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
+        result = sptCudaDuplicateMemory(&unit_ptr_val, unit_ptr.data, (nunits + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
+        printf("nunits: %lu\n", nunits);
+        sptFreeNnzIndexVector(&unit_seg);
+        sptFreeNnzIndexVector(&unit_ptr);
+    }
+
     const sptNnzIndex max_nblocks = 32768;
     const sptNnzIndex max_nthreads_per_block = 256;
     sptNnzIndex max_nthreadsy = 16;
@@ -173,6 +208,19 @@ int sptCudaSparseTensorMulMatrixOneKernel(
         }
         sptAssert(smen_size >= nthreadsx * nthreadsy * sizeof (sptValue));
         break;
+    case 16:
+        if(U->ncols <= max_nthreadsy)
+            nthreadsx = U->ncols;
+        else
+            nthreadsx = max_nthreadsy;
+        nthreadsy = max_nthreads_per_block / nthreadsx;
+
+        all_nblocks = (nunits + nthreadsy -1) / nthreadsy;
+        nblocks = all_nblocks < max_nblocks ? all_nblocks : max_nblocks;
+        if(nblocks == 0) {
+            nblocks = 1;
+        }
+        break;
     }
     dim3 dimBlock(nthreadsx, nthreadsy);
     printf("all_nblocks: %lu, nthreadsx: %lu, nthreadsy: %lu\n", all_nblocks, nthreadsx, nthreadsy);
@@ -224,6 +272,14 @@ int sptCudaSparseTensorMulMatrixOneKernel(
             fiberidx_val, fiberidx.len,
             U_val, U->nrows, U->ncols, U->stride);
         break; 
+    case 16:
+        printf("[CUDA SpTns * Mtx] spt_TTMRankUnitKernel<<<%lu, (%lu, %lu)>>>\n", nblocks, nthreadsx, nthreadsy);
+        spt_TTMRankUnitKernel<<<nblocks, dimBlock>>>(
+            Y_val, Y->stride,
+            X_val, X_inds_m,
+            unit_seg_val, unit_ptr_val, nunits,
+            U_val, U->ncols, U->stride);
+        break;
     }
     result = cudaThreadSynchronize();
     spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx kernel");
@@ -243,6 +299,12 @@ int sptCudaSparseTensorMulMatrixOneKernel(
     spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
     result = cudaFree(Y_val);
     spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
+    if(impl_num == 16) {
+        result = spt_CudaPoolFree(unit_seg_val);
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
+        result = spt_CudaPoolFree(unit_ptr_val);
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtx");
+    }
     sptFreeNnzIndexVector(&fiberidx);
 
     return 0;
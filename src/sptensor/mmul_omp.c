@@ -31,9 +31,10 @@ int sptOmpSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, cons
     if(X->ndims[mode] != U->nrows) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Mtx", "shape mismatch");
     }
-    sptSparseTensorSortIndexAtMode(X, mode, 0);
-    // jli: try to avoid malloc in all operation functions.
-    ind_buf = malloc(X->nmodes * sizeof *ind_buf);
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "OMP  SpTns * Mtx");
+    ind_buf = spt_ScratchAlloc(X->nmodes * sizeof *ind_buf);
     spt_CheckOSError(!ind_buf, "OMP  SpTns * Mtx");
     for(m = 0; m < X->nmodes; ++m) {
         ind_buf[m] = X->ndims[m];
@@ -41,31 +42,61 @@ int sptOmpSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, cons
     ind_buf[mode] = U->ncols;
     // jli: use pre-processing to allocate Y size outside this function.
     result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
-    free(ind_buf);
+    spt_ScratchFree(ind_buf);
     spt_CheckError(result, "OMP  SpTns * Mtx", NULL);
     sptSemiSparseTensorSetIndices(Y, &fiberidx, X);
 
+    /* Equal nonzeros per thread, so a few long fibers do not hold up the rest */
+    int const nt = sptExecThreads(0);
+    sptNnzIndex * bounds = spt_ScratchAlloc((nt + 1) * sizeof *bounds);
+    spt_CheckOSError(!bounds, "OMP  SpTns * Mtx");
+    result = spt_PartitionSegments(bounds, fiberidx.data, Y->nnz, nt);
+    spt_CheckError(result, "OMP  SpTns * Mtx", NULL);
+
     sptTimer timer;
     sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(nt);
     sptStartTimer(timer);
 
-    #pragma omp parallel for
-    for(sptNnzIndex i = 0; i < Y->nnz; ++i) {
-        sptNnzIndex inz_begin = fiberidx.data[i];
-        sptNnzIndex inz_end = fiberidx.data[i+1];
-        // jli: exchange two loops
-        for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
-            sptIndex r = X->inds[mode].data[j];
-            for(sptIndex k = 0; k < U->ncols; ++k) {
-                Y->values.values[i*Y->stride + k] += X->values.data[j] * U->values[r*U->stride + k];
+    #pragma omp parallel num_threads(nt)
+    {
+        int tid = 0, team = 1;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+        team = omp_get_num_threads();
+#endif
+        /* One part per thread, unless the team came out smaller */
+        for(int t = tid; t < nt; t += team) {
+            for(sptNnzIndex i = bounds[t]; i < bounds[t+1]; ++i) {
+                sptNnzIndex inz_begin = fiberidx.data[i];
+                sptNnzIndex inz_end = fiberidx.data[i+1];
+                // jli: exchange two loops
+                if(X->values.data == NULL) {
+                    for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
+                        sptIndex r = X->inds[mode].data[j];
+                        for(sptIndex k = 0; k < U->ncols; ++k) {
+                            Y->values.values[i*Y->stride + k] += U->values[r*U->stride + k];
+                        }
+                    }
+                } else {
+                    for(sptNnzIndex j = inz_begin; j < inz_end; ++j) {
+                        sptIndex r = X->inds[mode].data[j];
+                        for(sptIndex k = 0; k < U->ncols; ++k) {
+                            Y->values.values[i*Y->stride + k] += X->values.data[j] * U->values[r*U->stride + k];
+                        }
+                    }
+                }
             }
         }
     }
 
     sptStopTimer(timer);
-    sptPrintElapsedTime(timer, "OMP  SpTns * Mtx");
+    /* Two flops per nonzero and column; reads X and its rows of U, writes Y */
+    spt_KernelProbeStop(probe, timer, "OMP  SpTns * Mtx", 2.0 * X->nnz * U->ncols,
+        spt_SparseTensorBytes(X) + ((double) X->nnz + Y->nnz) * U->ncols * sizeof (sptValue));
     sptFreeTimer(timer);
 
+    spt_ScratchFree(bounds);
     sptFreeNnzIndexVector(&fiberidx);
     return 0;
 }
@@ -0,0 +1,236 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/* Whether entry a of acc ranks below entry b: smaller magnitude, or the same at a later column */
+static inline int spt_PrunedBelow(sptValue const * acc, sptIndex const a, sptIndex const b) {
+    sptValue const x = fabs(acc[a]), y = fabs(acc[b]);
+    return x < y || (x == y && a > b);
+}
+
+/* Restore the heap of the first n columns below position i, the lowest ranked at the root */
+static void spt_PrunedSiftDown(sptValue const * acc, sptIndex * heap, sptIndex i, sptIndex const n) {
+    for(;;) {
+        sptIndex c = 2 * i + 1;
+        if(c >= n) {
+            return;
+        }
+        if(c + 1 < n && spt_PrunedBelow(acc, heap[c + 1], heap[c])) {
+            ++c;
+        }
+        if(!spt_PrunedBelow(acc, heap[c], heap[i])) {
+            return;
+        }
+        sptIndex const t = heap[i]; heap[i] = heap[c]; heap[c] = t;
+        i = c;
+    }
+}
+
+static int spt_CompareColumns(const void *a, const void *b) {
+    sptIndex const x = *(const sptIndex *) a, y = *(const sptIndex *) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * The columns of one accumulated fiber that pass epsilon, at most topk of
+ * them by magnitude when topk is not 0, in increasing order. Returns their
+ * number; heap is scratch of ncols entries and receives the columns.
+ */
+static sptIndex spt_PrunedSelect(sptValue const * acc, sptIndex const ncols, sptValue const epsilon,
+    sptIndex const topk, sptIndex * heap)
+{
+    sptIndex filled = 0;
+    for(sptIndex j = 0; j < ncols; ++j) {
+        if(acc[j] == 0 || fabs(acc[j]) < epsilon) {
+            continue;
+        }
+        if(topk == 0) {
+            heap[filled++] = j;
+        } else if(filled < topk) {
+            /* Sift the new column up */
+            sptIndex i = filled++;
+            while(i > 0 && spt_PrunedBelow(acc, j, heap[(i - 1) / 2])) {
+                heap[i] = heap[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            heap[i] = j;
+        } else if(spt_PrunedBelow(acc, heap[0], j)) {
+            heap[0] = j;
+            spt_PrunedSiftDown(acc, heap, 0, topk);
+        }
+    }
+    if(topk != 0) {
+        qsort(heap, filled, sizeof *heap, spt_CompareColumns);
+    }
+    return filled;
+}
+
+
+/**
+ * OpenMP parallel sparse tensor times a dense matrix (SpTTM) with a sparse,
+ * pruned result: sptOmpSparseTensorMulMatrix followed by
+ * sptSemiSparseTensorToSparseTensor in one pass. Each thread accumulates one
+ * fiber of U->ncols values at a time and keeps only the entries of magnitude
+ * at least epsilon, and of those the topk largest when topk is not 0, so the
+ * dense fibers of the semi-sparse result are never stored; the kept entries
+ * go to per-thread buffers and are then copied into Y at their offsets.
+ * Magnitude ties at the top-k cut go to the lower column.
+ *
+ * @param[out] Y       the result, sorted like X at mode, should be uninitialized
+ * @param[in]  X       the sparse tensor, sorted at mode like sptSparseTensorMulMatrix does
+ * @param[in]  U       the dense matrix of X->ndims[mode] rows
+ * @param      mode    the mode on which the multiplication is done on
+ * @param      epsilon entries of smaller magnitude are dropped, zeros always are
+ * @param      topk    the most entries kept per fiber, 0 for no limit
+ * @param      tk      the number of threads, or 0 for the default
+ */
+int sptOmpSparseTensorMulMatrixPruned(
+    sptSparseTensor *Y,
+    sptSparseTensor *X,
+    const sptMatrix *U,
+    sptIndex const mode,
+    sptValue const epsilon,
+    sptIndex const topk,
+    int tk)
+{
+    char const * const module = "OMP  SpTns * Mtx Pruned";
+    if(mode >= X->nmodes || X->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    if(!(epsilon >= 0)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, module, "epsilon must not be negative");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const ncols = U->ncols;
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, module);
+    sptNnzIndexVector const * fibers;
+    int result = spt_SparseTensorFiberIndex(&fibers, X, mode);
+    spt_CheckError(result, module, NULL);
+    sptNnzIndex const * const fiberidx = fibers->data;
+    sptNnzIndex const nfibers = fibers->len - 1;
+
+    /* Equal nonzeros per thread, each with the kept entries of its fibers in order */
+    sptNnzIndex * bounds = malloc((tk + 1) * sizeof *bounds);
+    sptNnzIndex * yptr = malloc((nfibers + 1) * sizeof *yptr);
+    sptIndexVector * kept_cols = calloc(tk, sizeof *kept_cols);
+    sptValueVector * kept_vals = calloc(tk, sizeof *kept_vals);
+    spt_CheckOSError(!bounds || !yptr || !kept_cols || !kept_vals, module);
+    result = spt_PartitionSegments(bounds, fiberidx, nfibers, tk);
+    spt_CheckError(result, module, NULL);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    sptStartTimer(timer);
+
+    int failed = 0;
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0, team = 1;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+        team = omp_get_num_threads();
+#endif
+        sptValue * const acc = malloc(((size_t) ncols + 1) * sizeof *acc);
+        sptIndex * const heap = malloc(((size_t) ncols + 1) * sizeof *heap);
+        int ok = acc != NULL && heap != NULL;
+        /* One part per thread, unless the team came out smaller */
+        for(int t = tid; t < tk && ok; t += team) {
+            ok = sptNewIndexVector(&kept_cols[t], 0, 0) == 0 && sptNewValueVector(&kept_vals[t], 0, 0) == 0;
+            for(sptNnzIndex f = bounds[t]; f < bounds[t+1] && ok; ++f) {
+                memset(acc, 0, (size_t) ncols * sizeof *acc);
+                for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+                    sptValue const x = X->values.data != NULL ? X->values.data[z] : 1;
+                    sptValue const * const row = U->values + (size_t) X->inds[mode].data[z] * U->stride;
+                    for(sptIndex k = 0; k < ncols; ++k) {
+                        acc[k] += x * row[k];
+                    }
+                }
+                sptIndex const n = spt_PrunedSelect(acc, ncols, epsilon, topk, heap);
+                for(sptIndex c = 0; c < n && ok; ++c) {
+                    ok = sptAppendIndexVector(&kept_cols[t], heap[c]) == 0 &&
+                        sptAppendValueVector(&kept_vals[t], acc[heap[c]]) == 0;
+                }
+                yptr[f + 1] = n;
+            }
+        }
+        if(!ok) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+        free(acc);
+        free(heap);
+    }
+    spt_CheckOSError(failed, module);
+    yptr[0] = 0;
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        yptr[f + 1] += yptr[f];
+    }
+
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, module);
+    memcpy(ndims, X->ndims, nmodes * sizeof *ndims);
+    ndims[mode] = ncols;
+    result = spt_SparseTensorNewSized(Y, nmodes, ndims, yptr[nfibers]);
+    free(ndims);
+    spt_CheckError(result, module, NULL);
+    memcpy(Y->sortorder, X->sortorder, nmodes * sizeof *Y->sortorder);
+
+    #pragma omp parallel for schedule(static, 1) num_threads(tk)
+    for(int t = 0; t < tk; ++t) {
+        sptNnzIndex const base = yptr[bounds[t]];
+        memcpy(Y->inds[mode].data + base, kept_cols[t].data, kept_cols[t].len * sizeof (sptIndex));
+        memcpy(Y->values.data + base, kept_vals[t].data, kept_vals[t].len * sizeof (sptValue));
+        for(sptNnzIndex f = bounds[t]; f < bounds[t+1]; ++f) {
+            for(sptNnzIndex y = yptr[f]; y < yptr[f+1]; ++y) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    if(m != mode) {
+                        Y->inds[m].data[y] = X->inds[m].data[fiberidx[f]];
+                    }
+                }
+            }
+        }
+        sptFreeIndexVector(&kept_cols[t]);
+        sptFreeValueVector(&kept_vals[t]);
+    }
+
+    sptStopTimer(timer);
+    /* Two flops per nonzero and column; reads X and its rows of U, writes the kept entries */
+    spt_KernelProbeStop(probe, timer, module, 2.0 * X->nnz * ncols,
+        spt_SparseTensorBytes(X) + (double) X->nnz * ncols * sizeof (sptValue) + spt_SparseTensorBytes(Y));
+    sptFreeTimer(timer);
+
+    free(kept_cols);
+    free(kept_vals);
+    free(yptr);
+    free(bounds);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Open-addressing table of the output columns of one fiber. A slot is in
+ * use while its stamp is the current fiber's, so moving to the next fiber
+ * clears the table without touching it.
+ */
+typedef struct {
+    unsigned logcap;      /// the table holds 2^logcap slots
+    sptIndex * keys;
+    sptNnzIndex * stamps;
+    sptValue * vals;
+} spt_ColumnHash;
+
+/* Make room for n distinct columns at a load of at most one half */
+static int spt_ColumnHashReserve(spt_ColumnHash *h, sptNnzIndex const n) {
+    unsigned logcap = 4;
+    while(((sptNnzIndex) 1 << logcap) < 2 * n) {
+        ++logcap;
+    }
+    if(h->keys != NULL && logcap <= h->logcap) {
+        return 0;
+    }
+    size_t const cap = (size_t) 1 << logcap;
+    free(h->keys);
+    free(h->stamps);
+    free(h->vals);
+    h->logcap = logcap;
+    h->keys = malloc(cap * sizeof *h->keys);
+    h->stamps = calloc(cap, sizeof *h->stamps);
+    h->vals = malloc(cap * sizeof *h->vals);
+    return h->keys == NULL || h->stamps == NULL || h->vals == NULL ? -1 : 0;
+}
+
+static void spt_ColumnHashFree(spt_ColumnHash *h) {
+    free(h->keys);
+    free(h->stamps);
+    free(h->vals);
+}
+
+/* The slot of column key under stamp, taken and zeroed if new, which *fresh reports */
+static inline size_t spt_ColumnHashSlot(spt_ColumnHash *h, sptIndex const key, sptNnzIndex const stamp, int *fresh) {
+    size_t const mask = ((size_t) 1 << h->logcap) - 1;
+    size_t s = (size_t) (((uint64_t) key * 0x9E3779B97F4A7C15ULL) >> (64 - h->logcap));
+    while(h->stamps[s] == stamp) {
+        if(h->keys[s] == key) {
+            *fresh = 0;
+            return s;
+        }
+        s = (s + 1) & mask;
+    }
+    h->stamps[s] = stamp;
+    h->keys[s] = key;
+    h->vals[s] = 0;
+    *fresh = 1;
+    return s;
+}
+
+static int spt_CompareIndices(const void *a, const void *b) {
+    sptIndex const x = *(const sptIndex *) a, y = *(const sptIndex *) b;
+    return x < y ? -1 : x > y;
+}
+
+
+/**
+ * OpenMP parallel sparse tensor times a sparse matrix (SpTTM with a sparse
+ * operand), Y = X x_mode U^T as in sptSparseTensorMulMatrix, for projection
+ * and aggregation maps too sparse to store dense. The result is sparse: each
+ * fiber of X at mode gives the columns of U reached by its nonzeros' rows.
+ *
+ * A symbolic phase counts the distinct columns of every fiber in a hash
+ * table, so that Y is allocated once at its exact size, and a numeric phase
+ * accumulates the products in the same table and writes the fiber's columns
+ * in increasing order. Fibers are shared among the threads dynamically, each
+ * thread with its own table. Columns whose products cancel stay as explicit
+ * zeros. A COO matrix is turned into U with sptSparseMatrixToCSR, with
+ * transpose = 1 if it is stored as ncols x ndims[mode].
+ *
+ * @param[out] Y    the result, sorted like X at mode, should be uninitialized
+ * @param[in]  X    the sparse tensor, sorted at mode like sptSparseTensorMulMatrix does
+ * @param[in]  U    the CSR matrix of X->ndims[mode] rows; Y's mode has U->ncols indices
+ * @param      mode the mode on which the multiplication is done on
+ * @param      tk   the number of threads, or 0 for the default
+ */
+int sptOmpSparseTensorMulSparseMatrix(sptSparseTensor *Y, sptSparseTensor *X, const sptSparseMatrixCSR *U, sptIndex const mode, int tk) {
+    char const * const module = "CPU  SpTns * SpMtx";
+    if(mode >= X->nmodes || X->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = X->nmodes;
+
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, module);
+    sptNnzIndexVector const * fibers;
+    int result = spt_SparseTensorFiberIndex(&fibers, X, mode);
+    spt_CheckError(result, module, NULL);
+    sptNnzIndex const * const fiberidx = fibers->data;
+    sptNnzIndex const nfibers = fibers->len - 1;
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, module);
+    memcpy(ndims, X->ndims, nmodes * sizeof *ndims);
+
+    sptIndex const * const xinds = X->inds[mode].data;
+    sptValue const * const xvals = X->values.data;
+    sptNnzIndex const * const rowptr = U->rowptr.data;
+    sptIndex const * const colind = U->colind.data;
+    sptValue const * const uvals = U->values.data;
+
+    sptNnzIndex * yptr = malloc((nfibers + 1) * sizeof *yptr);
+    spt_CheckOSError(!yptr, module);
+    spt_ColumnHash * hashes = calloc(tk, sizeof *hashes);
+    spt_CheckOSError(!hashes, module);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    sptStartTimer(timer);
+
+    /* Symbolic phase: the number of distinct columns of each fiber */
+    int failed = 0;
+    double nproducts = 0;
+    #pragma omp parallel num_threads(tk) reduction(+:nproducts)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        spt_ColumnHash * const h = &hashes[tid];
+        #pragma omp for schedule(dynamic, 64)
+        for(sptNnzIndex f = 0; f < nfibers; ++f) {
+            sptNnzIndex bound = 0;
+            for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+                bound += rowptr[xinds[z] + 1] - rowptr[xinds[z]];
+            }
+            nproducts += (double) bound;
+            if(spt_ColumnHashReserve(h, bound) != 0) {
+                #pragma omp atomic write
+                failed = 1;
+                yptr[f + 1] = 0;
+                continue;
+            }
+            sptNnzIndex count = 0;
+            for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+                for(sptNnzIndex k = rowptr[xinds[z]]; k < rowptr[xinds[z] + 1]; ++k) {
+                    int fresh;
+                    spt_ColumnHashSlot(h, colind[k], f + 1, &fresh);
+                    count += fresh;
+                }
+            }
+            yptr[f + 1] = count;
+        }
+    }
+    spt_CheckOSError(failed, module);
+    yptr[0] = 0;
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        yptr[f + 1] += yptr[f];
+    }
+
+    ndims[mode] = U->ncols;
+    result = spt_SparseTensorNewSized(Y, nmodes, ndims, yptr[nfibers]);
+    spt_CheckError(result, module, NULL);
+    memcpy(Y->sortorder, X->sortorder, nmodes * sizeof *Y->sortorder);
+
+    /* Numeric phase: accumulate each fiber afresh, its stamps now offset past the symbolic ones */
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        spt_ColumnHash * const h = &hashes[tid];
+        #pragma omp for schedule(dynamic, 64)
+        for(sptNnzIndex f = 0; f < nfibers; ++f) {
+            sptNnzIndex const stamp = nfibers + f + 1;
+            if(spt_ColumnHashReserve(h, yptr[f+1] - yptr[f]) != 0) {
+                #pragma omp atomic write
+                failed = 1;
+                continue;
+            }
+            sptIndex * const cols = Y->inds[mode].data + yptr[f];
+            sptNnzIndex count = 0;
+            for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+                sptValue const x = xvals != NULL ? xvals[z] : 1;
+                for(sptNnzIndex k = rowptr[xinds[z]]; k < rowptr[xinds[z] + 1]; ++k) {
+                    int fresh;
+                    size_t const s = spt_ColumnHashSlot(h, colind[k], stamp, &fresh);
+                    h->vals[s] += x * uvals[k];
+                    if(fresh) {
+                        cols[count++] = colind[k];
+                    }
+                }
+            }
+            qsort(cols, count, sizeof *cols, spt_CompareIndices);
+            for(sptNnzIndex c = 0; c < count; ++c) {
+                int fresh;
+                Y->values.data[yptr[f] + c] = h->vals[spt_ColumnHashSlot(h, cols[c], stamp, &fresh)];
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    if(m != mode) {
+                        Y->inds[m].data[yptr[f] + c] = X->inds[m].data[fiberidx[f]];
+                    }
+                }
+            }
+        }
+    }
+    spt_CheckOSError(failed, module);
+
+    sptStopTimer(timer);
+    /* Two flops per product; reads X and its rows of U, writes Y */
+    spt_KernelProbeStop(probe, timer, module, 2.0 * nproducts,
+        spt_SparseTensorBytes(X) + 2 * nproducts * (sizeof (sptIndex) + sizeof (sptValue)) + spt_SparseTensorBytes(Y));
+    sptFreeTimer(timer);
+
+    for(int t = 0; t < tk; ++t) {
+        spt_ColumnHashFree(&hashes[t]);
+    }
+    free(hashes);
+    free(yptr);
+    free(ndims);
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+
+#define PARTI_CUDA_SPTTM_NTHREADS 128
+#define PARTI_CUDA_SPTTM_EMPTY ((sptIndex) -1)
+
+/*
+ * The GPU counterpart of sptOmpSparseTensorMulSparseMatrix. One thread
+ * takes one fiber, with a hash table of its own in global memory: as many
+ * slots as the next power of two above twice the fiber's products, so the
+ * table never fills. The symbolic kernel inserts the columns and counts
+ * them, and the numeric kernel sums the products into the same slots and
+ * writes the fiber's columns out in increasing order.
+ */
+
+__device__ static inline sptNnzIndex spt_SpTTMHashStart(sptIndex const key, sptNnzIndex const cap) {
+    return (sptNnzIndex) (((unsigned long long) key * 0x9E3779B97F4A7C15ULL) >> 32) & (cap - 1);
+}
+
+/* Insert the columns of fiber f into its table and count the distinct ones */
+__global__ static void spt_SpTTMSymbolicKernel(
+    sptIndex const *xinds, sptNnzIndex const *fiberidx, sptNnzIndex const nfibers,
+    sptNnzIndex const *rowptr, sptIndex const *colind,
+    sptNnzIndex const *hashptr, sptIndex *keys, sptNnzIndex *counts)
+{
+    sptNnzIndex const f = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(f >= nfibers) {
+        return;
+    }
+    sptIndex * const table = keys + hashptr[f];
+    sptNnzIndex const cap = hashptr[f+1] - hashptr[f];
+    sptNnzIndex count = 0;
+    for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+        for(sptNnzIndex k = rowptr[xinds[z]]; k < rowptr[xinds[z] + 1]; ++k) {
+            sptIndex const key = colind[k];
+            sptNnzIndex s = spt_SpTTMHashStart(key, cap);
+            while(table[s] != PARTI_CUDA_SPTTM_EMPTY && table[s] != key) {
+                s = (s + 1) & (cap - 1);
+            }
+            if(table[s] == PARTI_CUDA_SPTTM_EMPTY) {
+                table[s] = key;
+                ++count;
+            }
+        }
+    }
+    counts[f] = count;
+}
+
+/* Sum the products of fiber f into its table, then write its columns sorted at yptr[f] */
+__global__ static void spt_SpTTMNumericKernel(
+    sptIndex const *xinds, sptValue const *xvals, sptNnzIndex const *fiberidx, sptNnzIndex const nfibers,
+    sptNnzIndex const *rowptr, sptIndex const *colind, sptValue const *uvals,
+    sptNnzIndex const *hashptr, sptIndex const *keys, sptValue *hvals,
+    sptNnzIndex const *yptr, sptIndex *ycols, sptValue *yvals)
+{
+    sptNnzIndex const f = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(f >= nfibers) {
+        return;
+    }
+    sptIndex const * const table = keys + hashptr[f];
+    sptValue * const sums = hvals + hashptr[f];
+    sptNnzIndex const cap = hashptr[f+1] - hashptr[f];
+    for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+        sptValue const x = xvals != NULL ? xvals[z] : 1;
+        for(sptNnzIndex k = rowptr[xinds[z]]; k < rowptr[xinds[z] + 1]; ++k) {
+            sptNnzIndex s = spt_SpTTMHashStart(colind[k], cap);
+            while(table[s] != colind[k]) {
+                s = (s + 1) & (cap - 1);
+            }
+            sums[s] += x * uvals[k];
+        }
+    }
+    /* Insertion sort into place, fibers of an aggregation map being short */
+    sptIndex * const cols = ycols + yptr[f];
+    sptValue * const vals = yvals + yptr[f];
+    sptNnzIndex n = 0;
+    for(sptNnzIndex s = 0; s < cap; ++s) {
+        if(table[s] == PARTI_CUDA_SPTTM_EMPTY) {
+            continue;
+        }
+        sptNnzIndex j = n++;
+        while(j > 0 && cols[j-1] > table[s]) {
+            cols[j] = cols[j-1];
+            vals[j] = vals[j-1];
+            --j;
+        }
+        cols[j] = table[s];
+        vals[j] = sums[s];
+    }
+}
+
+
+/**
+ * CUDA sparse tensor times a sparse matrix, see sptOmpSparseTensorMulSparseMatrix.
+ * The fibers of X are found and Y's other indices filled on the host; the
+ * symbolic and numeric phases run on the device, one thread per fiber.
+ * @param[out] Y    the result, sorted like X at mode, should be uninitialized
+ * @param[in]  X    the sparse tensor, sorted at mode like sptSparseTensorMulMatrix does
+ * @param[in]  U    the CSR matrix of X->ndims[mode] rows; Y's mode has U->ncols indices
+ * @param      mode the mode on which the multiplication is done on
+ */
+int sptCudaSparseTensorMulSparseMatrix(sptSparseTensor *Y, sptSparseTensor *X, const sptSparseMatrixCSR *U, sptIndex const mode) {
+    char const * const module = "CUDA SpTns * SpMtx";
+    if(mode >= X->nmodes || X->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+    sptIndex const nmodes = X->nmodes;
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, module);
+    sptNnzIndexVector const * fibers;
+    int result = spt_SparseTensorFiberIndex(&fibers, X, mode);
+    spt_CheckError(result, module, NULL);
+    sptNnzIndex const * const fiberidx = fibers->data;
+    sptNnzIndex const nfibers = fibers->len - 1;
+    sptIndex *ndims = new sptIndex[nmodes];
+    memcpy(ndims, X->ndims, nmodes * sizeof *ndims);
+
+    /* Each fiber's table, sized on the host from its number of products */
+    sptNnzIndex *hashptr = new sptNnzIndex[nfibers + 1];
+    hashptr[0] = 0;
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        sptNnzIndex bound = 0;
+        for(sptNnzIndex z = fiberidx[f]; z < fiberidx[f+1]; ++z) {
+            bound += U->rowptr.data[X->inds[mode].data[z] + 1] - U->rowptr.data[X->inds[mode].data[z]];
+        }
+        sptNnzIndex cap = bound > 0 ? 2 : 0;
+        while(cap < 2 * bound) {
+            cap *= 2;
+        }
+        hashptr[f+1] = hashptr[f] + cap;
+    }
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptIndex *dev_xinds, *dev_colind, *dev_keys, *dev_ycols = NULL;
+    sptValue *dev_xvals = NULL, *dev_uvals, *dev_hvals, *dev_yvals = NULL;
+    sptNnzIndex *dev_fiberidx, *dev_rowptr, *dev_hashptr, *dev_counts;
+    result = sptCudaDuplicateMemory(&dev_xinds, X->inds[mode].data, X->nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    if(X->values.data != NULL) {
+        result = sptCudaDuplicateMemory(&dev_xvals, X->values.data, X->nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, module);
+    }
+    result = sptCudaDuplicateMemory(&dev_fiberidx, fiberidx, (nfibers + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = sptCudaDuplicateMemory(&dev_rowptr, U->rowptr.data, (U->nrows + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = sptCudaDuplicateMemory(&dev_colind, U->colind.data, U->nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = sptCudaDuplicateMemory(&dev_uvals, U->values.data, U->nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    result = sptCudaDuplicateMemory(&dev_hashptr, hashptr, (nfibers + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, module);
+    sptNnzIndex const nslots = hashptr[nfibers];
+    result = cudaMalloc((void **) &dev_keys, (nslots + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    cudaMemset(dev_keys, 0xff, (nslots + 1) * sizeof (sptIndex));
+    result = cudaMalloc((void **) &dev_hvals, (nslots + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+    cudaMemset(dev_hvals, 0, (nslots + 1) * sizeof (sptValue));
+    result = cudaMalloc((void **) &dev_counts, (nfibers + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, module);
+
+    sptNnzIndex const nblocks = (nfibers + PARTI_CUDA_SPTTM_NTHREADS - 1) / PARTI_CUDA_SPTTM_NTHREADS;
+    if(nblocks > 0) {
+        spt_SpTTMSymbolicKernel<<<nblocks, PARTI_CUDA_SPTTM_NTHREADS>>>(dev_xinds, dev_fiberidx, nfibers,
+            dev_rowptr, dev_colind, dev_hashptr, dev_keys, dev_counts);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+    }
+
+    /* The offsets of the fibers in Y, then Y at its exact size */
+    sptNnzIndex *yptr = new sptNnzIndex[nfibers + 1];
+    yptr[0] = 0;
+    cudaMemcpy(yptr + 1, dev_counts, nfibers * sizeof (sptNnzIndex), cudaMemcpyDeviceToHost);
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        yptr[f+1] += yptr[f];
+    }
+    ndims[mode] = U->ncols;
+    result = spt_SparseTensorNewSized(Y, nmodes, ndims, yptr[nfibers]);
+    spt_CheckError(result, module, NULL);
+    memcpy(Y->sortorder, X->sortorder, nmodes * sizeof *Y->sortorder);
+    cudaMemcpy(dev_counts, yptr, (nfibers + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    result = cudaMalloc((void **) &dev_ycols, (Y->nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, module);
+    result = cudaMalloc((void **) &dev_yvals, (Y->nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, module);
+
+    if(nblocks > 0) {
+        spt_SpTTMNumericKernel<<<nblocks, PARTI_CUDA_SPTTM_NTHREADS>>>(dev_xinds, dev_xvals, dev_fiberidx, nfibers,
+            dev_rowptr, dev_colind, dev_uvals, dev_hashptr, dev_keys, dev_hvals,
+            dev_counts, dev_ycols, dev_yvals);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, module);
+    }
+    cudaMemcpy(Y->inds[mode].data, dev_ycols, Y->nnz * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+    cudaMemcpy(Y->values.data, dev_yvals, Y->nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, module);
+    sptFreeTimer(timer);
+
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        for(sptNnzIndex y = yptr[f]; y < yptr[f+1]; ++y) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                if(m != mode) {
+                    Y->inds[m].data[y] = X->inds[m].data[fiberidx[f]];
+                }
+            }
+        }
+    }
+
+    cudaFree(dev_xinds);
+    cudaFree(dev_xvals);
+    cudaFree(dev_fiberidx);
+    cudaFree(dev_rowptr);
+    cudaFree(dev_colind);
+    cudaFree(dev_uvals);
+    cudaFree(dev_hashptr);
+    cudaFree(dev_keys);
+    cudaFree(dev_hvals);
+    cudaFree(dev_counts);
+    cudaFree(dev_ycols);
+    cudaFree(dev_yvals);
+    delete[] yptr;
+    delete[] hashptr;
+    delete[] ndims;
+    return 0;
+}
@@ -18,6 +18,7 @@
 
 #include <ParTI.h>
 #include "sptensor.h"
+#include "../matrix/simd.h"
 
 int sptMTTKRP_3D(sptSparseTensor const * const X,
     sptMatrix * mats[],     // mats[nmodes] as temporary space.
@@ -43,11 +44,15 @@ int sptMTTKRP(sptSparseTensor const * const X,
 
     sptIndex const nmodes = X->nmodes;
 
+    if(sptSparseTensorIsPattern(X)) {
+        return spt_OmpMTTKRP_Pattern(X, mats, mats_order, mode, 1);
+    }
     if(nmodes == 3) {
         sptAssert(sptMTTKRP_3D(X, mats, mats_order, mode) == 0);
         return 0;
     }
 
+    spt_SimdKernels const * const simd = spt_Simd();
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
     sptValue const * const restrict vals = X->values.data;
@@ -70,12 +75,17 @@ int sptMTTKRP(sptSparseTensor const * const X,
     sptMatrix * const restrict M = mats[nmodes];
     sptValue * const restrict mvals = M->values;
     memset(mvals, 0, tmpI*stride*sizeof(sptValue));
+    if(spt_MTTKRPLanesEnabled(R)) {
+        spt_MTTKRPLanes(X, mats, mats_order, mode, mvals, 0, nnz);
+        return 0;
+    }
     sptNewValueVector(&scratch, R, R);
     sptConstantValueVector(&scratch, 0);
 
 
     sptTimer timer;
     sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(1);
     sptStartTimer(timer);
 
     for(sptNnzIndex x=0; x<nnz; ++x) {
@@ -85,9 +95,7 @@ int sptMTTKRP(sptSparseTensor const * const X,
         sptIndex * times_inds = X->inds[times_mat_index].data;
         sptIndex tmp_i = times_inds[x];
         sptValue const entry = vals[x];
-        for(sptIndex r=0; r<R; ++r) {
-            scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-        }
+        simd->scale(scratch.data, entry, times_mat->values + tmp_i * stride, R);
 
         for(sptIndex i=2; i<nmodes; ++i) {
             times_mat_index = mats_order[i];
@@ -95,9 +103,7 @@ int sptMTTKRP(sptSparseTensor const * const X,
             times_inds = X->inds[times_mat_index].data;
             tmp_i = times_inds[x];
 
-            for(sptIndex r=0; r<R; ++r) {
-                scratch.data[r] *= times_mat->values[tmp_i * stride + r];
-            }
+            simd->mul(scratch.data, times_mat->values + tmp_i * stride, R);
         }
 
         sptIndex const mode_i = mode_ind[x];
@@ -106,7 +112,7 @@ int sptMTTKRP(sptSparseTensor const * const X,
         }
     }
     sptStopTimer(timer);
-    sptPrintElapsedTime(timer, "Cpu SpTns MTTKRP");
+    spt_KernelProbeStop(probe, timer, "Cpu SpTns MTTKRP", spt_MTTKRPFlops(X, R), spt_MTTKRPBytes(X, R));
     
     sptFreeTimer(timer);
     sptFreeValueVector(&scratch);
@@ -144,6 +150,10 @@ int sptMTTKRP_3D(sptSparseTensor const * const X,
     sptMatrix * const restrict M = mats[nmodes];
     sptValue * const restrict mvals = M->values;
     memset(mvals, 0, tmpI*stride*sizeof(sptValue));
+    if(spt_MTTKRPLanesEnabled(R)) {
+        spt_MTTKRPLanes(X, mats, mats_order, mode, mvals, 0, nnz);
+        return 0;
+    }
 
     sptIndex times_mat_index_1 = mats_order[1];
     sptMatrix * restrict times_mat_1 = mats[times_mat_index_1];
@@ -158,6 +168,7 @@ int sptMTTKRP_3D(sptSparseTensor const * const X,
 
     sptTimer timer;
     sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(1);
     sptStartTimer(timer);
     for(sptNnzIndex x=0; x<nnz; ++x) {
         mode_i = mode_ind[x];
@@ -170,7 +181,7 @@ int sptMTTKRP_3D(sptSparseTensor const * const X,
         }
     }
     sptStopTimer(timer);
-    sptPrintElapsedTime(timer, "Cpu SpTns MTTKRP");
+    spt_KernelProbeStop(probe, timer, "Cpu SpTns MTTKRP", spt_MTTKRPFlops(X, R), spt_MTTKRPBytes(X, R));
     sptFreeTimer(timer);
 
     return 0;
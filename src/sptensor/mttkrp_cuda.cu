@@ -31,7 +31,7 @@
  * @param[in]  mats    (N+1) dense matrices, with mats[nmodes] as temporary
  * @param[in]  mats_order    the order of the Khatri-Rao products
  * @param[in]  mode   the mode on which the MTTKRP is performed
- * @param[in]  scratch an temporary array to store intermediate results, space assigned before this function
+ * @param[in]  impl_num   the kernel, 1 to 5, or PARTI_CUDA_IMPL_AUTO
  *
  * This function uses support arbitrary-order sparse tensors with Khatri-Rao
  * products of dense factor matrices, the output is the updated dense matrix for the "mode".
@@ -45,6 +45,9 @@ int sptCudaMTTKRP(
     sptIndex const mode,
     sptIndex const impl_num) 
 {
+    if(impl_num == PARTI_CUDA_IMPL_AUTO) {
+        return sptCudaMTTKRP(X, mats, mats_order, mode, spt_CudaSelectMTTKRPImpl(X, mats, mats_order, mode, 0));
+    }
     sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
@@ -67,6 +70,14 @@ int sptCudaMTTKRP(
         }
     }
 
+    /* With everything in managed memory the kernel works in place, see SPT_MEM_MANAGED */
+    bool managed = sptMemBackingOf(X->values.data) == SPT_MEM_MANAGED &&
+        sptMemBackingOf(mats[nmodes]->values) == SPT_MEM_MANAGED;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        managed = managed && sptMemBackingOf(X->inds[m].data) == SPT_MEM_MANAGED &&
+            sptMemBackingOf(mats[m]->values) == SPT_MEM_MANAGED;
+    }
+
 
     /* Transfer tensor and matrices */
     /* dev_mats_order: 1st gpu. */
@@ -105,20 +116,10 @@ int sptCudaMTTKRP(
     spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
     dev_mem_size += nmodes * sizeof (sptIndex);
 
-    /* dev_Xvals */
-    result = sptCudaDuplicateMemory(&dev_Xvals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
-    spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
-    dev_mem_size += nnz * sizeof (sptValue);
-
     /* Xinds_header */
     for(sptIndex m = 0; m < nmodes; ++m) {
         Xinds_header[m] = X->inds[m].data;
     }
-    /* dev_Xinds */
-    result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, Xinds_header, nmodes, nnz, cudaMemcpyHostToDevice);
-    spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
-    dev_mem_size += nmodes * nnz * sizeof(sptIndex);
-
     /* mats_header and lengths */
     sptNnzIndex sum_mat_length = 0;
     for(sptIndex m = 0; m < nmodes; ++m) {
@@ -129,14 +130,36 @@ int sptCudaMTTKRP(
     mats_header[nmodes] = mats[nmodes]->values;
     lengths[nmodes] = mats[mode]->nrows * stride;
     sum_mat_length += mats[mode]->nrows * stride;
-    /* dev_mats */
-    result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
-    spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
-    dev_mem_size += sum_mat_length * sizeof(sptValue);
+
+    if(managed) {
+        /* The kernel reads and writes the managed buffers in place; only their addresses go up */
+        result = sptCudaPrefetchMTTKRP(X, mats, mode, mats[nmodes]);
+        spt_CheckError(result, "CUDA SpTns MTTKRP", NULL);
+        dev_Xvals = X->values.data;
+        result = sptCudaDuplicateMemory(&dev_Xinds, Xinds_header, nmodes * sizeof (sptIndex *), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        result = sptCudaDuplicateMemory(&dev_mats, mats_header, (nmodes+1) * sizeof (sptValue *), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+    } else {
+        /* dev_Xvals */
+        result = sptCudaDuplicateMemory(&dev_Xvals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        dev_mem_size += nnz * sizeof (sptValue);
+
+        /* dev_Xinds */
+        result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, Xinds_header, nmodes, nnz, cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        dev_mem_size += nmodes * nnz * sizeof(sptIndex);
+
+        /* dev_mats */
+        result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        dev_mem_size += sum_mat_length * sizeof(sptValue);
+    }
 
     if(nmodes > 4) {
         /* dev_scratch */
-        result = cudaMalloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
+        result = spt_CudaPoolAlloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
         result = cudaMemset(dev_scratch, 0, nnz * stride * sizeof (sptValue));
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
@@ -331,39 +354,49 @@ int sptCudaMTTKRP(
     time_exe = sptElapsedTime(timer);
     gflops_exe = dev_flops / time_exe / 1e9;
     sptPrintElapsedTime(timer, "CUDA SpTns MTTKRP");
-    printf("[GFLOPS]: %lf GFlops \n", gflops_exe);
+    sptTelemetryAddCounter("CUDA SpTns MTTKRP flops", (double) dev_flops);
+    if(spt_TelemetryPrinting()) {
+        printf("[GFLOPS]: %lf GFlops \n", gflops_exe);
+    }
 
     sptStartTimer(timer);
 
     dev_mem_size = 0;
-    /* Copy back the pointer to dev_mats[nmodes] to the result */
-    result = cudaMemcpy(&dev_part_prod, dev_mats + nmodes, sizeof dev_part_prod, cudaMemcpyDeviceToHost);
-    spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
-    dev_mem_size += sizeof dev_part_prod;
-
-    result = cudaMemcpy(mats[nmodes]->values, dev_part_prod, mats[mode]->nrows * stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
-    spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
-    dev_mem_size += mats[mode]->nrows * stride * sizeof (sptValue);
+    if(!managed) {
+        /* Copy back the pointer to dev_mats[nmodes] to the result */
+        result = cudaMemcpy(&dev_part_prod, dev_mats + nmodes, sizeof dev_part_prod, cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        dev_mem_size += sizeof dev_part_prod;
+
+        result = cudaMemcpy(mats[nmodes]->values, dev_part_prod, mats[mode]->nrows * stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA SpTns SpltMTTKRP");
+        dev_mem_size += mats[mode]->nrows * stride * sizeof (sptValue);
+    }
 
     sptStopTimer(timer);
     time_d2h = sptElapsedTime(timer);
     gbw_d2h = dev_mem_size / time_d2h /1e9;
     sptPrintElapsedTime(timer, "CUDA SpTns MTTKRP D2H");
-    printf("[Bandwidth D2H]: %lf GBytes/sec\n", gbw_d2h);
+    sptTelemetryAddCounter("CUDA SpTns MTTKRP D2H bytes", (double) dev_mem_size);
+    if(spt_TelemetryPrinting()) {
+        printf("[Bandwidth D2H]: %lf GBytes/sec\n", gbw_d2h);
+    }
     sptFreeTimer(timer);
 
-    result = cudaFree(dev_mats_order);
+    result = spt_CudaPoolFree(dev_mats_order);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xndims);
+    result = spt_CudaPoolFree(dev_Xndims);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xvals);
-    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xinds);
+    if(!managed) {
+        result = spt_CudaPoolFree(dev_Xvals);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+    }
+    result = spt_CudaPoolFree(dev_Xinds);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_mats);
+    result = spt_CudaPoolFree(dev_mats);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
     if(nmodes > 4) {
-        result = cudaFree(dev_scratch);
+        result = spt_CudaPoolFree(dev_scratch);
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
     }
     delete[] Xinds_header;
@@ -375,7 +408,11 @@ int sptCudaMTTKRP(
 
 
 
-int sptCudaMTTKRPDevice(
+/**
+ * Enqueue the scratch MTTKRP on `stream` without waiting for it, so that it can be
+ * ordered after and before other device work or captured into a CUDA graph.
+ */
+int sptCudaMTTKRPDeviceAsync(
     const sptIndex mode,
     const sptIndex nmodes,
     const sptNnzIndex nnz,
@@ -386,28 +423,24 @@ int sptCudaMTTKRPDevice(
     const sptValue * Xvals,
     const sptIndex * dev_mats_order,
     sptValue ** dev_mats,
-    sptValue * dev_scratch)
+    sptValue * dev_scratch,
+    cudaStream_t stream)
 {
   int result;
 
-  result = cudaMemset(dev_scratch, 0, nnz * rank * sizeof (sptValue));
+  result = cudaMemsetAsync(dev_scratch, 0, nnz * rank * sizeof (sptValue), stream);
   spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
 
   sptNnzIndex nthreads = 128;
   const sptNnzIndex max_nblocks = 32768;
   sptNnzIndex all_nblocks = (nnz + nthreads -1) / nthreads;
 
-  // sptTimer timer;
-  // sptNewTimer(&timer, 0);
-  // sptStartTimer(timer);
-
-
   for(sptNnzIndex block_offset = 0; block_offset < all_nblocks; block_offset += max_nblocks) {
     sptNnzIndex nblocks = all_nblocks - block_offset;
     if(nblocks > max_nblocks) {
         nblocks = max_nblocks;
     }
-    spt_MTTKRPKernelScratch<<<nblocks, nthreads>>>(
+    spt_MTTKRPKernelScratch<<<nblocks, nthreads, 0, stream>>>(
         mode,
         nmodes,
         nnz,
@@ -421,15 +454,164 @@ int sptCudaMTTKRPDevice(
         dev_scratch,
         block_offset
         );
-    result = cudaThreadSynchronize();
-    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
   }
+  result = cudaGetLastError();
+  spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
 
-  // sptStopTimer(timer);
-  // sptPrintElapsedTime(timer, "CUDA SpTns MTTKRP");
-  // sptFreeTimer(timer);
+  return 0;
+}
 
 
+int sptCudaMTTKRPDevice(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex rank,
+    const sptIndex stride,
+    const sptIndex * Xndims,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    sptValue * dev_scratch)
+{
+  int result = sptCudaMTTKRPDeviceAsync(mode, nmodes, nnz, rank, stride, Xndims, Xinds, Xvals,
+    dev_mats_order, dev_mats, dev_scratch, 0);
+  if(result != 0) {
+    return result;
+  }
+  /* Launches on the legacy default stream are ordered, so one wait covers every chunk */
+  result = cudaStreamSynchronize(0);
+  spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+
   return 0;
 }
 
+
+
+/* Nonzeros walked by one warp of spt_MTTKRPKernelSegmented */
+#define PARTI_CUDA_SEGMENT_NNZ 32
+
+/**
+ * Device-side segmented MTTKRP on nonzeros sorted by the mode index,
+ * accumulating into dev_mats[nmodes], which must be zeroed by the caller.
+ * Unlike sptCudaMTTKRPDevice it needs no nnz * rank scratch.
+ */
+int sptCudaMTTKRPSegmentedDevice(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex rank,
+    const sptIndex stride,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats)
+{
+  int result;
+  dim3 dimBlock(32, 8);
+  sptNnzIndex const nwarps = (nnz + PARTI_CUDA_SEGMENT_NNZ - 1) / PARTI_CUDA_SEGMENT_NNZ;
+  sptNnzIndex const nblocks = (nwarps + dimBlock.y - 1) / dimBlock.y;
+
+  spt_MTTKRPKernelSegmented<<<nblocks, dimBlock>>>(
+      mode,
+      nmodes,
+      nnz,
+      rank,
+      stride,
+      Xinds,
+      Xvals,
+      dev_mats_order,
+      dev_mats,
+      PARTI_CUDA_SEGMENT_NNZ);
+  result = cudaDeviceSynchronize();
+  spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+
+  return 0;
+}
+
+
+/**
+ * CUDA MTTKRP without the nnz * rank scratch of sptCudaMTTKRP.
+ * X must be sorted by its index on `mode` (e.g. by
+ * sptSparseTensorSortIndexSingleMode), so that equal output rows form runs;
+ * each run is reduced in registers before a single atomic per column.
+ * @param[in]  X    the sparse tensor input X, sorted by mode
+ * @param[out] mats (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mats_order the order of the Khatri-Rao products
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ */
+int sptCudaMTTKRPSegmented(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    int result;
+
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    for(sptNnzIndex x = 1; x < nnz; ++x) {
+        if(mode_ind[x] < mode_ind[x-1]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns MTTKRP", "tensor is not sorted by the MTTKRP mode");
+        }
+    }
+
+    sptIndex * dev_mats_order;
+    result = sptCudaDuplicateMemory(&dev_mats_order, mats_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+    sptValue * dev_Xvals;
+    result = sptCudaDuplicateMemory(&dev_Xvals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+    sptIndex ** Xinds_header = new sptIndex *[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        Xinds_header[m] = X->inds[m].data;
+    }
+    sptIndex ** dev_Xinds;
+    result = sptCudaDuplicateMemoryIndirect(&dev_Xinds, Xinds_header, nmodes, nnz, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+
+    sptValue ** mats_header = new sptValue *[nmodes+1];
+    sptNnzIndex * const lengths = new sptNnzIndex[nmodes+1];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats_header[m] = mats[m]->values;
+        lengths[m] = mats[m]->nrows * stride;
+    }
+    mats_header[nmodes] = mats[nmodes]->values;
+    lengths[nmodes] = mats[mode]->nrows * stride;
+    sptValue ** dev_mats;
+    result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+    sptValue * dev_part_prod;
+    result = cudaMemcpy(&dev_part_prod, dev_mats + nmodes, sizeof dev_part_prod, cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+    result = cudaMemset(dev_part_prod, 0, lengths[nmodes] * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+
+    result = sptCudaMTTKRPSegmentedDevice(mode, nmodes, nnz, R, stride, dev_Xinds, dev_Xvals, dev_mats_order, dev_mats);
+    spt_CheckError(result, "CUDA SpTns MTTKRP", NULL);
+
+    result = cudaMemcpy(mats[nmodes]->values, dev_part_prod, lengths[nmodes] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
+
+    spt_CudaPoolFree(dev_mats_order);
+    spt_CudaPoolFree(dev_Xvals);
+    spt_CudaPoolFree(dev_Xinds);
+    spt_CudaPoolFree(dev_mats);
+    delete[] Xinds_header;
+    delete[] mats_header;
+    delete[] lengths;
+
+    return 0;
+}
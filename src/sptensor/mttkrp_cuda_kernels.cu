@@ -1715,4 +1715,62 @@ __global__ void spt_MTTKRPKernelScratchDist(
     //     printf("mvals end\n");
     // }
     
-}
\ No newline at end of file
+}
+
+
+/* impl_num = 19, nonzeros sorted by the mode index, no scratch.
+ * Each warp walks nnz_per_warp consecutive nonzeros with one lane per rank
+ * column, keeps the running sum of a run of equal output indices in a
+ * register, and issues one atomic per run and column. The run test is
+ * warp-uniform, so the warp never diverges on it. blockDim.x must be 32. */
+__global__ void spt_MTTKRPKernelSegmented(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex R,
+    const sptIndex stride,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    const sptNnzIndex nnz_per_warp)
+{
+    const sptNnzIndex warp = (sptNnzIndex) blockIdx.x * blockDim.y + threadIdx.y;
+    const sptIndex lane = threadIdx.x;
+    const sptNnzIndex begin = warp * nnz_per_warp;
+    if(begin >= nnz) {
+        return;
+    }
+    const sptNnzIndex end = begin + nnz_per_warp < nnz ? begin + nnz_per_warp : nnz;
+
+    sptIndex const * const mode_ind = Xinds[mode];
+    sptValue * const mvals = dev_mats[nmodes];
+
+    for(sptIndex r0 = 0; r0 < R; r0 += 32) {
+        const sptIndex r = r0 + lane;
+        const bool active = r < R;
+        sptIndex cur = mode_ind[begin];
+        sptValue acc = 0;
+        for(sptNnzIndex x = begin; x < end; ++x) {
+            const sptIndex i = mode_ind[x];
+            if(i != cur) {
+                if(active) {
+                    atomicAdd(&(mvals[cur * stride + r]), acc);
+                }
+                acc = 0;
+                cur = i;
+            }
+            if(active) {
+                sptValue v = Xvals[x];
+                for(sptIndex k = 1; k < nmodes; ++k) {
+                    const sptIndex times_mat_index = dev_mats_order[k];
+                    v *= dev_mats[times_mat_index][Xinds[times_mat_index][x] * stride + r];
+                }
+                acc += v;
+            }
+        }
+        if(active) {
+            atomicAdd(&(mvals[cur * stride + r]), acc);
+        }
+    }
+}
@@ -129,6 +129,21 @@ __global__ void spt_MTTKRPKernelScratch(
     sptNnzIndex block_offset);
 
 
+/* impl_num = 59, a partition whose indices of each mode start at inds_low */
+__global__ void spt_MTTKRPKernelScratchDist(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex R,
+    const sptIndex stride,
+    const sptIndex * Xndims,
+    const sptIndex * inds_low,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    sptValue * dev_scratch);
+
 
 /**** impl_num = 1x: One GPU using one kernel ****/
 /* impl_num = 11 */
@@ -197,5 +212,19 @@ __global__ void spt_MTTKRPKernelRankSplitNnzRB3DOneKernel(
     sptValue ** dev_mats);
 
 
+/* impl_num = 19, nonzeros sorted by the mode index, no scratch */
+__global__ void spt_MTTKRPKernelSegmented(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex R,
+    const sptIndex stride,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    const sptNnzIndex nnz_per_warp);
+
+
 
-#endif
\ No newline at end of file
+#endif
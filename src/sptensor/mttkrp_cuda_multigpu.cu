@@ -0,0 +1,408 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+#include "mttkrp_cuda_kernels.h"
+#include <string.h>
+
+
+__global__ static void spt_MTTKRPAddRowsKernel(
+    sptValue * const out,
+    sptValue const * const in,
+    sptNnzIndex const len)
+{
+    sptNnzIndex const x = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(x < len) {
+        out[x] += in[x];
+    }
+}
+
+
+/**
+ * Distribute a sparse tensor across several GPUs for sptCudaMTTKRPMultiGpu.
+ *
+ * The slices of part_mode are cut into ndevices contiguous ranges holding about
+ * nnz/ndevices nonzeros each, and every device receives the nonzeros of its
+ * range. MTTKRP on part_mode then needs no reduction. For the other modes the
+ * devices' partial rows are summed on devices[0] through peer copies.
+ * Factor matrices are uploaded with sptCudaMttkrpMultiGpuSetFactor.
+ *
+ * @param[out] ctx       an uninitialized multi-GPU tensor
+ * @param[in]  X         the sparse tensor
+ * @param[in]  part_mode the mode to partition on
+ * @param[in]  rank      the number of columns of the factor matrices
+ * @param[in]  ndevices  the number of GPUs
+ * @param[in]  devices   the CUDA device ids, or NULL for 0..ndevices-1
+ *                       (for the current device when ndevices is 1)
+ */
+int sptCudaNewMttkrpMultiGpu(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptSparseTensor const * const X,
+    sptIndex const part_mode,
+    sptIndex const rank,
+    int const ndevices,
+    int const * const devices)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    int result;
+
+    if(ndevices < 1 || part_mode >= nmodes) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns MultiGPU", "invalid device count or mode");
+    }
+
+    ctx->ndevices = ndevices;
+    ctx->devices = new int[ndevices];
+    for(int d = 0; d < ndevices; ++d) {
+        ctx->devices[d] = devices != NULL ? devices[d] : d;
+    }
+    if(devices == NULL && ndevices == 1) {
+        result = cudaGetDevice(&ctx->devices[0]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+    }
+    ctx->nmodes = nmodes;
+    ctx->ndims = new sptIndex[nmodes];
+    memcpy(ctx->ndims, X->ndims, nmodes * sizeof (sptIndex));
+    ctx->rank = rank;
+    ctx->stride = ((rank - 1) / 8 + 1) * 8;
+    ctx->part_mode = part_mode;
+    sptIndex const stride = ctx->stride;
+
+    /* Cut the slices of part_mode into ndevices ranges of balanced nnz */
+    sptIndex const pdim = X->ndims[part_mode];
+    sptNnzIndex const * slice_ptr = spt_SparseTensorSlicePtr(X, part_mode);
+    spt_CheckOSError(!slice_ptr, "CUDA SpTns MultiGPU");
+    int * owner = new int[pdim];
+    sptIndex s = 0;
+    for(int d = 0; d < ndevices; ++d) {
+        sptNnzIndex const target = nnz * (d + 1) / ndevices;
+        while(s < pdim && (d == ndevices - 1 || slice_ptr[s] < target)) {
+            owner[s++] = d;
+        }
+    }
+
+    /* Count and scatter the nonzeros of each device, in their original order */
+    ctx->nnz = new sptNnzIndex[ndevices];
+    ctx->inds_low = new sptIndex[ndevices * nmodes];
+    ctx->inds_high = new sptIndex[ndevices * nmodes];
+    for(int d = 0; d < ndevices; ++d) {
+        ctx->nnz[d] = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            ctx->inds_low[d * nmodes + m] = PARTI_INDEX_MAX;
+            ctx->inds_high[d * nmodes + m] = 0;
+        }
+    }
+    sptIndex const * const pinds = X->inds[part_mode].data;
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        int const d = owner[pinds[z]];
+        ++ctx->nnz[d];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const i = X->inds[m].data[z];
+            if(i < ctx->inds_low[d * nmodes + m]) ctx->inds_low[d * nmodes + m] = i;
+            if(i >= ctx->inds_high[d * nmodes + m]) ctx->inds_high[d * nmodes + m] = i + 1;
+        }
+    }
+    for(int d = 0; d < ndevices; ++d) {
+        if(ctx->nnz[d] == 0) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                ctx->inds_low[d * nmodes + m] = 0;
+            }
+        }
+    }
+
+    sptIndex *** h_inds = new sptIndex **[ndevices];
+    sptValue ** h_vals = new sptValue *[ndevices];
+    sptNnzIndex * pos = new sptNnzIndex[ndevices];
+    for(int d = 0; d < ndevices; ++d) {
+        h_inds[d] = new sptIndex *[nmodes];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            h_inds[d][m] = new sptIndex[ctx->nnz[d]];
+        }
+        h_vals[d] = new sptValue[ctx->nnz[d]];
+        pos[d] = 0;
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        int const d = owner[pinds[z]];
+        sptNnzIndex const p = pos[d]++;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            h_inds[d][m][p] = X->inds[m].data[z];
+        }
+        h_vals[d][p] = X->values.data[z];
+    }
+    delete[] pos;
+    delete[] owner;
+
+    /* Upload the partitions and allocate the resident factor row blocks */
+    ctx->dev_ndims = new sptIndex *[ndevices];
+    ctx->dev_inds_low = new sptIndex *[ndevices];
+    ctx->dev_inds = new sptIndex **[ndevices];
+    ctx->dev_vals = new sptValue *[ndevices];
+    ctx->dev_mats_order = new sptIndex *[ndevices];
+    ctx->mats_header = new sptValue **[ndevices];
+    ctx->dev_mats = new sptValue **[ndevices];
+    ctx->dev_scratch = new sptValue *[ndevices];
+    sptIndex * local_dims = new sptIndex[nmodes];
+    sptIndex max_local = 0;
+    for(int d = 0; d < ndevices; ++d) {
+        sptNnzIndex const dnnz = ctx->nnz[d];
+        sptIndex const * const low = ctx->inds_low + d * nmodes;
+        sptIndex const * const high = ctx->inds_high + d * nmodes;
+        result = cudaSetDevice(ctx->devices[d]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+
+        sptIndex max_rows = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            local_dims[m] = high[m] - low[m];
+            if(local_dims[m] > max_rows) max_rows = local_dims[m];
+        }
+        if(max_rows > max_local) max_local = max_rows;
+
+        result = sptCudaDuplicateMemory(&ctx->dev_ndims[d], local_dims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = sptCudaDuplicateMemory(&ctx->dev_inds_low[d], low, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = sptCudaDuplicateMemoryIndirect(&ctx->dev_inds[d], h_inds[d], nmodes, dnnz, cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = sptCudaDuplicateMemory(&ctx->dev_vals[d], h_vals[d], dnnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = spt_CudaPoolAlloc((void **) &ctx->dev_mats_order[d], nmodes * sizeof (sptIndex));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = spt_CudaPoolAlloc((void **) &ctx->dev_scratch[d], (dnnz > 0 ? dnnz : 1) * stride * sizeof (sptValue));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+
+        ctx->mats_header[d] = new sptValue *[nmodes + 1];
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptIndex const rows = m < nmodes ? local_dims[m] : max_rows;
+            result = spt_CudaPoolAlloc((void **) &ctx->mats_header[d][m], ((sptNnzIndex) rows + 1) * stride * sizeof (sptValue));
+            spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        }
+        result = sptCudaDuplicateMemory(&ctx->dev_mats[d], ctx->mats_header[d], (nmodes + 1) * sizeof (sptValue *), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            delete[] h_inds[d][m];
+        }
+        delete[] h_inds[d];
+        delete[] h_vals[d];
+    }
+    delete[] h_inds;
+    delete[] h_vals;
+    delete[] local_dims;
+
+    /* Reduction buffers on the first device, with peer access where the topology allows it */
+    result = cudaSetDevice(ctx->devices[0]);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+    result = spt_CudaPoolAlloc((void **) &ctx->dev_full, (sptNnzIndex) sptMaxIndexArray(ctx->ndims, nmodes) * stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+    result = spt_CudaPoolAlloc((void **) &ctx->dev_stage, ((sptNnzIndex) max_local + 1) * stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+    for(int d = 1; d < ndevices; ++d) {
+        int can_access = 0;
+        cudaDeviceCanAccessPeer(&can_access, ctx->devices[0], ctx->devices[d]);
+        if(can_access && ctx->devices[d] != ctx->devices[0]) {
+            if(cudaDeviceEnablePeerAccess(ctx->devices[d], 0) != cudaSuccess) {
+                cudaGetLastError();  /* already enabled */
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Upload the rows of factor matrix `mode` that each device's nonzeros touch.
+ * Call it for every mode before the first MTTKRP and whenever a factor changes.
+ * @param ctx  the multi-GPU tensor
+ * @param A    the factor matrix, ndims[mode] * rank with the context's stride
+ * @param mode the mode of the factor
+ */
+int sptCudaMttkrpMultiGpuSetFactor(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptMatrix const * const A,
+    sptIndex const mode)
+{
+    sptIndex const nmodes = ctx->nmodes;
+    if(A->nrows != ctx->ndims[mode] || A->ncols != ctx->rank || A->stride != ctx->stride) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MultiGPU", "factor does not match the tensor");
+    }
+    for(int d = 0; d < ctx->ndevices; ++d) {
+        sptIndex const low = ctx->inds_low[d * nmodes + mode];
+        sptIndex const rows = ctx->inds_high[d * nmodes + mode] - low;
+        if(rows == 0) {
+            continue;
+        }
+        int result = cudaSetDevice(ctx->devices[d]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+        result = cudaMemcpy(ctx->mats_header[d][mode], A->values + (sptNnzIndex) low * ctx->stride,
+            (sptNnzIndex) rows * ctx->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU");
+    }
+    return 0;
+}
+
+
+/**
+ * Multi-GPU MTTKRP on a tensor distributed by sptCudaNewMttkrpMultiGpu.
+ * The factors resident on the devices are used; only the result is moved.
+ * @param[in]  ctx  the multi-GPU tensor, with every factor uploaded
+ * @param[out] mats mats[nmodes] receives the ndims[mode] * rank result
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ */
+int sptCudaMTTKRPMultiGpu(
+    sptCudaMttkrpMultiGpu * ctx,
+    sptMatrix ** const mats,
+    sptIndex const mode)
+{
+    sptIndex const nmodes = ctx->nmodes;
+    sptIndex const stride = ctx->stride;
+    sptIndex const nrows = ctx->ndims[mode];
+    sptValue * const out = mats[nmodes]->values;
+    int result;
+
+    if(mats[nmodes]->cap < nrows || mats[nmodes]->stride != stride) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MultiGPU MTTKRP", "mats[nmodes] is too small");
+    }
+    mats[nmodes]->nrows = nrows;
+
+    sptIndex * mats_order = new sptIndex[nmodes];
+    mats_order[0] = mode;
+    for(sptIndex i = 1; i < nmodes; ++i) {
+        mats_order[i] = (mode + i) % nmodes;
+    }
+
+    /* Launch on every device; kernels of different devices overlap. */
+    sptNnzIndex const nthreads = 256;
+    for(int d = 0; d < ctx->ndevices; ++d) {
+        sptNnzIndex const dnnz = ctx->nnz[d];
+        if(dnnz == 0) {
+            continue;
+        }
+        sptIndex const rows = ctx->inds_high[d * nmodes + mode] - ctx->inds_low[d * nmodes + mode];
+        result = cudaSetDevice(ctx->devices[d]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+        result = cudaMemcpy(ctx->dev_mats_order[d], mats_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+        result = cudaMemset(ctx->mats_header[d][nmodes], 0, (sptNnzIndex) rows * stride * sizeof (sptValue));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+        spt_MTTKRPKernelScratchDist<<<(dnnz + nthreads - 1) / nthreads, nthreads>>>(
+            mode,
+            nmodes,
+            dnnz,
+            ctx->rank,
+            stride,
+            ctx->dev_ndims[d],
+            ctx->dev_inds_low[d],
+            ctx->dev_inds[d],
+            ctx->dev_vals[d],
+            ctx->dev_mats_order[d],
+            ctx->dev_mats[d],
+            ctx->dev_scratch[d]);
+        result = cudaGetLastError();
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+    }
+    delete[] mats_order;
+
+    if(mode == ctx->part_mode) {
+        /* Devices own disjoint rows: copy each block back. */
+        memset(out, 0, (sptNnzIndex) nrows * stride * sizeof (sptValue));
+        for(int d = 0; d < ctx->ndevices; ++d) {
+            sptIndex const low = ctx->inds_low[d * nmodes + mode];
+            sptIndex const rows = ctx->inds_high[d * nmodes + mode] - low;
+            if(rows == 0) {
+                continue;
+            }
+            result = cudaSetDevice(ctx->devices[d]);
+            spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+            result = cudaMemcpy(out + (sptNnzIndex) low * stride, ctx->mats_header[d][nmodes],
+                (sptNnzIndex) rows * stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+            spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+        }
+        return 0;
+    }
+
+    /* Rows are shared: sum the partial blocks on the first device. */
+    int const dev0 = ctx->devices[0];
+    result = cudaSetDevice(dev0);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+    result = cudaMemset(ctx->dev_full, 0, (sptNnzIndex) nrows * stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+    for(int d = 0; d < ctx->ndevices; ++d) {
+        sptIndex const low = ctx->inds_low[d * nmodes + mode];
+        sptIndex const rows = ctx->inds_high[d * nmodes + mode] - low;
+        if(rows == 0) {
+            continue;
+        }
+        sptNnzIndex const len = (sptNnzIndex) rows * stride;
+        sptValue const * partial = ctx->mats_header[d][nmodes];
+        if(d != 0) {
+            result = cudaMemcpyPeer(ctx->dev_stage, dev0, partial, ctx->devices[d], len * sizeof (sptValue));
+            spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+            partial = ctx->dev_stage;
+        }
+        spt_MTTKRPAddRowsKernel<<<(len + nthreads - 1) / nthreads, nthreads>>>(
+            ctx->dev_full + (sptNnzIndex) low * stride, partial, len);
+        result = cudaGetLastError();
+        spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+    }
+    result = cudaMemcpy(out, ctx->dev_full, (sptNnzIndex) nrows * stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MultiGPU MTTKRP");
+
+    return 0;
+}
+
+
+/**
+ * Release the device memory of a multi-GPU tensor
+ */
+void sptCudaFreeMttkrpMultiGpu(sptCudaMttkrpMultiGpu * ctx)
+{
+    for(int d = 0; d < ctx->ndevices; ++d) {
+        cudaSetDevice(ctx->devices[d]);
+        spt_CudaPoolFree(ctx->dev_ndims[d]);
+        spt_CudaPoolFree(ctx->dev_inds_low[d]);
+        spt_CudaPoolFree(ctx->dev_inds[d]);
+        spt_CudaPoolFree(ctx->dev_vals[d]);
+        spt_CudaPoolFree(ctx->dev_mats_order[d]);
+        spt_CudaPoolFree(ctx->dev_scratch[d]);
+        for(sptIndex m = 0; m <= ctx->nmodes; ++m) {
+            spt_CudaPoolFree(ctx->mats_header[d][m]);
+        }
+        spt_CudaPoolFree(ctx->dev_mats[d]);
+        delete[] ctx->mats_header[d];
+    }
+    cudaSetDevice(ctx->devices[0]);
+    spt_CudaPoolFree(ctx->dev_full);
+    spt_CudaPoolFree(ctx->dev_stage);
+
+    delete[] ctx->dev_ndims;
+    delete[] ctx->dev_inds_low;
+    delete[] ctx->dev_inds;
+    delete[] ctx->dev_vals;
+    delete[] ctx->dev_mats_order;
+    delete[] ctx->dev_scratch;
+    delete[] ctx->mats_header;
+    delete[] ctx->dev_mats;
+    delete[] ctx->nnz;
+    delete[] ctx->inds_low;
+    delete[] ctx->inds_high;
+    delete[] ctx->ndims;
+    delete[] ctx->devices;
+    ctx->ndevices = 0;
+}
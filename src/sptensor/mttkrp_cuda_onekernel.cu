@@ -31,7 +31,7 @@
  * @param[in]  mats    (N+1) dense matrices, with mats[nmodes] as temporary
  * @param[in]  mats_order    the order of the Khatri-Rao products
  * @param[in]  mode   the mode on which the MTTKRP is performed
- * @param[in]  scratch an temporary array to store intermediate results, space assigned before this function
+ * @param[in]  impl_num   the kernel, 11, 12, 15 or 16, or PARTI_CUDA_IMPL_AUTO
  *
  * This function uses support arbitrary-order sparse tensors with Khatri-Rao
  * products of dense factor matrices, the output is the updated dense matrix for the "mode".
@@ -45,6 +45,9 @@ int sptCudaMTTKRPOneKernel(
     sptIndex const mode,
     sptIndex const impl_num) 
 {
+    if(impl_num == PARTI_CUDA_IMPL_AUTO) {
+        return sptCudaMTTKRPOneKernel(X, mats, mats_order, mode, spt_CudaSelectMTTKRPImpl(X, mats, mats_order, mode, 1));
+    }
     sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
@@ -141,7 +144,7 @@ int sptCudaMTTKRPOneKernel(
 
     if(nmodes > 4) {
         /* dev_scratch */
-        result = cudaMalloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
+        result = spt_CudaPoolAlloc((void **) &dev_scratch, nnz * stride * sizeof (sptValue));
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
         result = cudaMemset(dev_scratch, 0, nnz * stride * sizeof (sptValue));
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
@@ -405,18 +408,18 @@ int sptCudaMTTKRPOneKernel(
     printf("\n");
     sptFreeTimer(timer);
 
-    result = cudaFree(dev_mats_order);
+    result = spt_CudaPoolFree(dev_mats_order);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xndims);
+    result = spt_CudaPoolFree(dev_Xndims);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xvals);
+    result = spt_CudaPoolFree(dev_Xvals);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_Xinds);
+    result = spt_CudaPoolFree(dev_Xinds);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
-    result = cudaFree(dev_mats);
+    result = spt_CudaPoolFree(dev_mats);
     spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
     if(nmodes > 4) {
-        result = cudaFree(dev_scratch);
+        result = spt_CudaPoolFree(dev_scratch);
         spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP");
     }
     delete[] Xinds_header;
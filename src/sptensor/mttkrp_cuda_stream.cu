@@ -0,0 +1,209 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+#include "mttkrp_cuda_kernels.h"
+
+
+/**
+ * CUDA MTTKRP for tensors that do not fit in device memory.
+ *
+ * Only the factor matrices and the output stay resident. The nonzeros are cut
+ * into batches of batch_nnz, and each batch is copied with cudaMemcpyAsync into
+ * one of nstreams device slots. The copy of a batch overlaps with the kernels
+ * of the batches in the other streams, and every kernel accumulates atomically
+ * into the resident output. The tensor's host arrays are page-locked with
+ * cudaHostRegister for the duration of the call, so the copies are truly
+ * asynchronous.
+ *
+ * @param[in]  X          the sparse tensor input X
+ * @param[out] mats       (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mats_order the order of the Khatri-Rao products
+ * @param[in]  mode       the mode on which the MTTKRP is performed
+ * @param[in]  batch_nnz  nonzeros per batch, 0 to size batches from the free device memory
+ * @param[in]  nstreams   the number of CUDA streams (and device batch slots)
+ */
+int sptCudaMTTKRPStream(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode,
+    sptNnzIndex batch_nnz,
+    int const nstreams)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[mode]->stride;
+    int result;
+
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MTTKRP Stream", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns MTTKRP Stream", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    if(nstreams < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns MTTKRP Stream", "nstreams < 1");
+    }
+
+    /* Resident: factor matrices and the output */
+    sptValue ** mats_header = new sptValue *[nmodes+1];
+    sptNnzIndex * const lengths = new sptNnzIndex[nmodes+1];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats_header[m] = mats[m]->values;
+        lengths[m] = mats[m]->nrows * stride;
+    }
+    mats_header[nmodes] = mats[nmodes]->values;
+    lengths[nmodes] = mats[mode]->nrows * stride;
+    sptValue ** dev_mats;
+    result = sptCudaDuplicateMemoryIndirect(&dev_mats, mats_header, nmodes+1, lengths, cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    sptValue * dev_out;
+    result = cudaMemcpy(&dev_out, dev_mats + nmodes, sizeof dev_out, cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    result = cudaMemset(dev_out, 0, lengths[nmodes] * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    sptIndex * dev_mats_order;
+    result = sptCudaDuplicateMemory(&dev_mats_order, mats_order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    sptIndex * dev_Xndims;
+    result = sptCudaDuplicateMemory(&dev_Xndims, X->ndims, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+
+    /* Size the batches from what is left on the device, keeping 10% in reserve */
+    sptNnzIndex const bytes_per_nnz = nmodes * sizeof (sptIndex) + sizeof (sptValue) + stride * sizeof (sptValue);
+    if(batch_nnz == 0) {
+        size_t free_bytes = 0, total_bytes = 0;
+        result = cudaMemGetInfo(&free_bytes, &total_bytes);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        batch_nnz = (sptNnzIndex) (free_bytes / 10 * 9) / (bytes_per_nnz * nstreams);
+        if(batch_nnz == 0) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns MTTKRP Stream", "factor matrices leave no room for nonzeros");
+        }
+    }
+    if(batch_nnz > nnz) {
+        batch_nnz = nnz > 0 ? nnz : 1;
+    }
+
+    /* Per-stream slots: index arrays, values and scratch for one batch */
+    cudaStream_t * streams = new cudaStream_t[nstreams];
+    sptIndex ** slot_inds = new sptIndex *[nstreams];
+    sptIndex *** dev_slot_inds = new sptIndex **[nstreams];
+    sptValue ** slot_vals = new sptValue *[nstreams];
+    sptValue ** slot_scratch = new sptValue *[nstreams];
+    sptIndex ** inds_header = new sptIndex *[nmodes];
+    for(int s = 0; s < nstreams; ++s) {
+        result = cudaStreamCreate(&streams[s]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        result = spt_CudaPoolAlloc((void **) &slot_inds[s], nmodes * batch_nnz * sizeof (sptIndex));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            inds_header[m] = slot_inds[s] + m * batch_nnz;
+        }
+        result = sptCudaDuplicateMemory(&dev_slot_inds[s], inds_header, nmodes * sizeof (sptIndex *), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        result = spt_CudaPoolAlloc((void **) &slot_vals[s], batch_nnz * sizeof (sptValue));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        result = spt_CudaPoolAlloc((void **) &slot_scratch[s], batch_nnz * stride * sizeof (sptValue));
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    }
+
+    /* Page-lock the tensor so the copies can overlap with the kernels */
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        cudaHostRegister(X->inds[m].data, nnz * sizeof (sptIndex), cudaHostRegisterDefault);
+    }
+    cudaHostRegister(X->values.data, nnz * sizeof (sptValue), cudaHostRegisterDefault);
+    cudaGetLastError();  /* registration is only an optimization */
+
+    sptNnzIndex const nthreads = 128;
+    sptNnzIndex const max_nblocks = 32768;
+    sptNnzIndex b = 0;
+    for(sptNnzIndex begin = 0; begin < nnz; begin += batch_nnz, ++b) {
+        int const s = (int) (b % nstreams);
+        sptNnzIndex const len = nnz - begin < batch_nnz ? nnz - begin : batch_nnz;
+
+        /* Stream order keeps this copy behind the previous kernel using the slot. */
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            result = cudaMemcpyAsync(slot_inds[s] + m * batch_nnz, X->inds[m].data + begin,
+                len * sizeof (sptIndex), cudaMemcpyHostToDevice, streams[s]);
+            spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+        }
+        result = cudaMemcpyAsync(slot_vals[s], X->values.data + begin,
+            len * sizeof (sptValue), cudaMemcpyHostToDevice, streams[s]);
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+
+        sptNnzIndex const all_nblocks = (len + nthreads - 1) / nthreads;
+        for(sptNnzIndex block_offset = 0; block_offset < all_nblocks; block_offset += max_nblocks) {
+            sptNnzIndex nblocks = all_nblocks - block_offset;
+            if(nblocks > max_nblocks) {
+                nblocks = max_nblocks;
+            }
+            spt_MTTKRPKernelScratch<<<nblocks, nthreads, 0, streams[s]>>>(
+                mode,
+                nmodes,
+                len,
+                R,
+                stride,
+                dev_Xndims,
+                dev_slot_inds[s],
+                slot_vals[s],
+                dev_mats_order,
+                dev_mats,
+                slot_scratch[s],
+                block_offset);
+        }
+        result = cudaGetLastError();
+        spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+    }
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+
+    result = cudaMemcpy(mats[nmodes]->values, dev_out, lengths[nmodes] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns MTTKRP Stream");
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        cudaHostUnregister(X->inds[m].data);
+    }
+    cudaHostUnregister(X->values.data);
+    cudaGetLastError();
+
+    for(int s = 0; s < nstreams; ++s) {
+        cudaStreamDestroy(streams[s]);
+        spt_CudaPoolFree(slot_inds[s]);
+        spt_CudaPoolFree(dev_slot_inds[s]);
+        spt_CudaPoolFree(slot_vals[s]);
+        spt_CudaPoolFree(slot_scratch[s]);
+    }
+    spt_CudaPoolFree(dev_mats);
+    spt_CudaPoolFree(dev_mats_order);
+    spt_CudaPoolFree(dev_Xndims);
+    delete[] streams;
+    delete[] slot_inds;
+    delete[] dev_slot_inds;
+    delete[] slot_vals;
+    delete[] slot_scratch;
+    delete[] inds_header;
+    delete[] mats_header;
+    delete[] lengths;
+
+    return 0;
+}
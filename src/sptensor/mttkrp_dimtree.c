@@ -0,0 +1,278 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * All-modes MTTKRP memoized by a two-way dimension tree.
+ *
+ * The modes are split into two halves. For each half s, partial[s] holds
+ * the tensor contracted with the factors of the other half, one row per
+ * distinct index tuple of s. MTTKRP on a mode of s then only multiplies that
+ * row by the factors of the remaining modes of s. A CP-ALS sweep updates the
+ * modes in order, so partial[0] is built once for modes [0, nsplit) and
+ * partial[1] once for the rest: two passes over the nonzeros per sweep
+ * instead of nmodes.
+ */
+
+static inline sptIndex spt_DimTreeHalf(sptMttkrpDimTree const * const tree, sptIndex const mode) {
+    return mode < tree->nsplit ? 0 : 1;
+}
+
+static inline sptIndex spt_DimTreeFirst(sptMttkrpDimTree const * const tree, sptIndex const half) {
+    return half == 0 ? 0 : tree->nsplit;
+}
+
+static inline sptIndex spt_DimTreeLast(sptMttkrpDimTree const * const tree, sptIndex const half) {
+    return half == 0 ? tree->nsplit : tree->nmodes;
+}
+
+
+/**
+ * Build a dimension tree for MTTKRP on a COO sparse tensor
+ * @param tree  an uninitialized dimension tree
+ * @param X     the sparse tensor with at least two modes, left untouched
+ * @param rank  the number of columns of the factor matrices
+ * @param tk    the number of threads
+ *
+ * The tree keeps no pointer to X; the same tensor must be passed to sptOmpMTTKRPDimTree.
+ */
+int sptNewMttkrpDimTree(
+    sptMttkrpDimTree * tree,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(nmodes < 2) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns DimTree", "nmodes < 2");
+    }
+
+    tree->nmodes = nmodes;
+    tree->nsplit = nmodes / 2;
+    tree->rank = rank;
+    tree->stride = ((rank-1)/8+1)*8;
+    tree->nnz = nnz;
+
+    sptIndex * key_modes = malloc(nmodes * sizeof *key_modes);
+    spt_CheckOSError(!key_modes, "SpTns DimTree");
+
+    for(sptIndex s = 0; s < 2; ++s) {
+        sptIndex const first = spt_DimTreeFirst(tree, s);
+        sptIndex const nkeys = spt_DimTreeLast(tree, s) - first;
+        for(sptIndex k = 0; k < nkeys; ++k) {
+            key_modes[k] = first + k;
+        }
+
+        result = sptNewNnzIndexVector(&tree->perm[s], nnz, nnz);
+        spt_CheckError(result, "SpTns DimTree", NULL);
+        sptNnzIndex * const perm = tree->perm[s].data;
+        result = spt_SparseTensorRadixPermutation(X, 0, nnz, nkeys, key_modes, 0, perm, tk);
+        spt_CheckError(result, "SpTns DimTree", NULL);
+
+        /* Groups are the runs of equal index tuples along perm */
+        result = sptNewNnzIndexVector(&tree->gptr[s], 0, 0);
+        spt_CheckError(result, "SpTns DimTree", NULL);
+        tree->ginds[s] = malloc(nkeys * sizeof *tree->ginds[s]);
+        spt_CheckOSError(!tree->ginds[s], "SpTns DimTree");
+        for(sptIndex k = 0; k < nkeys; ++k) {
+            result = sptNewIndexVector(&tree->ginds[s][k], 0, 0);
+            spt_CheckError(result, "SpTns DimTree", NULL);
+        }
+        for(sptNnzIndex i = 0; i < nnz; ++i) {
+            int new_group = (i == 0);
+            for(sptIndex k = 0; k < nkeys && !new_group; ++k) {
+                sptIndex const * const inds = X->inds[first + k].data;
+                new_group = inds[perm[i]] != inds[perm[i-1]];
+            }
+            if(new_group) {
+                sptAppendNnzIndexVector(&tree->gptr[s], i);
+                for(sptIndex k = 0; k < nkeys; ++k) {
+                    sptAppendIndexVector(&tree->ginds[s][k], X->inds[first + k].data[perm[i]]);
+                }
+            }
+        }
+        tree->ngroups[s] = tree->gptr[s].len;
+        sptAppendNnzIndexVector(&tree->gptr[s], nnz);
+
+        result = sptNewValueVector(&tree->partial[s], tree->ngroups[s] * tree->stride, tree->ngroups[s] * tree->stride);
+        spt_CheckError(result, "SpTns DimTree", NULL);
+        tree->valid[s] = 0;
+    }
+
+    free(key_modes);
+    return 0;
+}
+
+
+/**
+ * Release a dimension tree built by sptNewMttkrpDimTree
+ */
+void sptFreeMttkrpDimTree(sptMttkrpDimTree * tree)
+{
+    for(sptIndex s = 0; s < 2; ++s) {
+        sptIndex const nkeys = spt_DimTreeLast(tree, s) - spt_DimTreeFirst(tree, s);
+        for(sptIndex k = 0; k < nkeys; ++k) {
+            sptFreeIndexVector(&tree->ginds[s][k]);
+        }
+        free(tree->ginds[s]);
+        sptFreeNnzIndexVector(&tree->gptr[s]);
+        sptFreeNnzIndexVector(&tree->perm[s]);
+        sptFreeValueVector(&tree->partial[s]);
+    }
+    tree->nmodes = 0;
+}
+
+
+/**
+ * Tell a dimension tree that the factor matrix of `mode` has changed,
+ * which makes the partial product contracted with it stale.
+ */
+void sptMttkrpDimTreeInvalidate(sptMttkrpDimTree * tree, sptIndex const mode)
+{
+    tree->valid[1 - spt_DimTreeHalf(tree, mode)] = 0;
+}
+
+
+/* partial[s][g] = sum over the nonzeros of group g of the value times the other half's factor rows */
+static void spt_DimTreeContract(
+    sptMttkrpDimTree * tree,
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const s,
+    int const tk)
+{
+    sptIndex const R = tree->rank;
+    sptIndex const stride = tree->stride;
+    sptIndex const mstride = mats[0]->stride;
+    sptIndex const ofirst = spt_DimTreeFirst(tree, 1 - s);
+    sptIndex const olast = spt_DimTreeLast(tree, 1 - s);
+    sptNnzIndex const * const gptr = tree->gptr[s].data;
+    sptNnzIndex const * const perm = tree->perm[s].data;
+    sptValue const * const vals = X->values.data;
+    sptValue * const partial = tree->partial[s].data;
+
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+    for(sptNnzIndex g = 0; g < tree->ngroups[s]; ++g) {
+        sptValue * const restrict row = partial + g * stride;
+        for(sptIndex r = 0; r < R; ++r) {
+            row[r] = 0;
+        }
+        for(sptNnzIndex i = gptr[g]; i < gptr[g+1]; ++i) {
+            sptNnzIndex const z = perm[i];
+            sptValue const entry = vals[z];
+            sptValue const * const restrict first_row = mats[ofirst]->values + (sptNnzIndex)X->inds[ofirst].data[z] * mstride;
+            if(olast - ofirst == 1) {
+                #pragma omp simd
+                for(sptIndex r = 0; r < R; ++r) {
+                    row[r] += entry * first_row[r];
+                }
+            } else {
+                sptValue const * const restrict second_row = mats[ofirst+1]->values + (sptNnzIndex)X->inds[ofirst+1].data[z] * mstride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    sptValue prod = entry * first_row[r] * second_row[r];
+                    for(sptIndex n = ofirst + 2; n < olast; ++n) {
+                        prod *= mats[n]->values[(sptNnzIndex)X->inds[n].data[z] * mstride + r];
+                    }
+                    row[r] += prod;
+                }
+            }
+        }
+    }
+    tree->valid[s] = 1;
+}
+
+
+/**
+ * OpenMP MTTKRP through a dimension tree
+ * @param tree  the dimension tree built for X
+ * @param X     the sparse tensor
+ * @param mats  (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mode  the mode on which the MTTKRP is performed
+ * @param tk    the number of threads
+ *
+ * The partial product of mode's half is rebuilt only if a factor of the other
+ * half was invalidated since it was last computed.
+ */
+int sptOmpMTTKRPDimTree(
+    sptMttkrpDimTree * tree,
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mode,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+
+    if(tree->nmodes != nmodes || tree->nnz != X->nnz || mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns DimTree MTTKRP", "tree does not match the tensor");
+    }
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != tree->rank) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns DimTree MTTKRP", "mats[i]->cols != rank");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns DimTree MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const s = spt_DimTreeHalf(tree, mode);
+    if(!tree->valid[s]) {
+        spt_DimTreeContract(tree, X, mats, s, tk);
+    }
+
+    sptIndex const R = tree->rank;
+    sptIndex const stride = tree->stride;
+    sptIndex const mstride = mats[0]->stride;
+    sptIndex const first = spt_DimTreeFirst(tree, s);
+    sptIndex const last = spt_DimTreeLast(tree, s);
+    sptIndex const * const mode_ginds = tree->ginds[s][mode - first].data;
+    sptValue const * const partial = tree->partial[s].data;
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * mstride * sizeof *mvals);
+
+    /* A single-mode half has one group per output row */
+    int const use_atomic = (last - first > 1) && tk > 1;
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex g = 0; g < tree->ngroups[s]; ++g) {
+        sptValue const * const restrict prow = partial + g * stride;
+        sptValue * const restrict out_row = mvals + (sptNnzIndex)mode_ginds[g] * mstride;
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue prod = prow[r];
+            for(sptIndex n = first; n < last; ++n) {
+                if(n != mode) {
+                    prod *= mats[n]->values[(sptNnzIndex)tree->ginds[s][n - first].data[g] * mstride + r];
+                }
+            }
+            if(use_atomic) {
+                #pragma omp atomic update
+                out_row[r] += prod;
+            } else {
+                out_row[r] += prod;
+            }
+        }
+    }
+
+    return 0;
+}
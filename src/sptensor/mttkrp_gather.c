@@ -0,0 +1,190 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * Hiding the latency of the factor-row gathers of MTTKRP.
+ *
+ * Every nonzero reads one random row of each factor, so the loops stall on
+ * cache misses rather than on arithmetic. The loops prefetch the rows of the
+ * nonzero a few iterations ahead, and sptOmpMTTKRP_Gather splits the work
+ * into a gather stage, which copies the distinct rows of a batch of nonzeros
+ * in address order, and a compute stage over the copies.
+ */
+
+/* Nonzeros ahead the rows are prefetched for, unless PARTI_MTTKRP_PREFETCH says otherwise */
+#define SPT_MTTKRP_PREFETCH_DEFAULT 16
+/* Nonzeros gathered at once by sptOmpMTTKRP_Gather */
+#define SPT_GATHER_BATCH 256
+
+static int spt_mttkrp_prefetch = -1;
+
+/**
+ * The prefetch distance of the MTTKRP loops in nonzeros, 0 for none, from
+ * PARTI_MTTKRP_PREFETCH until sptSetMTTKRPPrefetchDistance is called
+ */
+sptIndex spt_MTTKRPPrefetchDistance(void) {
+    if(spt_mttkrp_prefetch < 0) {
+        char const * env = getenv("PARTI_MTTKRP_PREFETCH");
+        spt_mttkrp_prefetch = env != NULL ? atoi(env) : SPT_MTTKRP_PREFETCH_DEFAULT;
+        if(spt_mttkrp_prefetch < 0) {
+            spt_mttkrp_prefetch = 0;
+        }
+    }
+    return (sptIndex) spt_mttkrp_prefetch;
+}
+
+/**
+ * Make the COO and HiCOO OpenMP MTTKRP loops prefetch the factor rows of the
+ * nonzero `distance` iterations ahead. The best distance covers the memory
+ * latency with the work of that many nonzeros, so it shrinks as the rank
+ * grows; 0 turns prefetching off.
+ * Defaults to the PARTI_MTTKRP_PREFETCH environment variable, else 16.
+ * @param distance  the prefetch distance in nonzeros
+ */
+int sptSetMTTKRPPrefetchDistance(sptIndex const distance) {
+    if(distance > (1u << 20)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP", "prefetch distance too large");
+    }
+    spt_mttkrp_prefetch = (int) distance;
+    return 0;
+}
+
+
+static int spt_CompareKeys(void const * a, void const * b) {
+    uint64_t const x = *(uint64_t const *) a;
+    uint64_t const y = *(uint64_t const *) b;
+    return x < y ? -1 : (x > y);
+}
+
+/**
+ * OpenMP MTTKRP in two stages per batch of nonzeros. The gather stage sorts
+ * the row indices of each factor in the batch, and copies each distinct row
+ * once and in address order into a thread-private buffer, so the loads are
+ * independent of each other and rows shared in the batch are fetched once.
+ * The compute stage then multiplies rows of the buffers only, and adds into
+ * the output with atomics like sptOmpMTTKRP.
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size ndims[mode] * R
+ * @param[in]  X    the sparse tensor input X
+ * @param[in]  mats    (N+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ * @param[in]  tk    the number of threads
+ */
+int sptOmpMTTKRP_Gather(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(sptValue));
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
+
+    int failed = 0;
+    #pragma omp parallel num_threads(tk)
+    {
+        uint64_t * keys = malloc(SPT_GATHER_BATCH * sizeof *keys);
+        sptIndex * slots = malloc((size_t) nmodes * SPT_GATHER_BATCH * sizeof *slots);
+        sptValue * stage = malloc((size_t) nmodes * SPT_GATHER_BATCH * stride * sizeof *stage);
+        sptValue * acc = malloc(stride * sizeof *acc);
+        if(!keys || !slots || !stage || !acc) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+
+        #pragma omp for schedule(static)
+        for(sptNnzIndex begin = 0; begin < nnz; begin += SPT_GATHER_BATCH) {
+            if(failed) {
+                continue;
+            }
+            sptIndex const n = (sptIndex) (nnz - begin < SPT_GATHER_BATCH ? nnz - begin : SPT_GATHER_BATCH);
+
+            /* Gather: the distinct rows of each factor, in address order */
+            for(sptIndex i=1; i<nmodes; ++i) {
+                sptIndex const * const inds = X->inds[mats_order[i]].data + begin;
+                sptValue const * const mat = mats[mats_order[i]]->values;
+                sptValue * const staged = stage + (size_t) i * SPT_GATHER_BATCH * stride;
+                sptIndex * const slot = slots + (size_t) i * SPT_GATHER_BATCH;
+                for(sptIndex j=0; j<n; ++j) {
+                    keys[j] = (uint64_t) inds[j] << 32 | j;
+                }
+                qsort(keys, n, sizeof *keys, spt_CompareKeys);
+                sptIndex nrows = 0;
+                for(sptIndex j=0; j<n; ++j) {
+                    sptIndex const row = (sptIndex) (keys[j] >> 32);
+                    if(j == 0 || row != (sptIndex) (keys[j-1] >> 32)) {
+                        if(pd != 0 && j + pd < n) {
+                            spt_PrefetchRow(mat + (keys[j + pd] >> 32) * stride, R);
+                        }
+                        memcpy(staged + (size_t) nrows * stride, mat + (sptNnzIndex) row * stride, R * sizeof *staged);
+                        ++ nrows;
+                    }
+                    slot[keys[j] & 0xFFFFFFFFu] = nrows - 1;
+                }
+            }
+
+            /* Compute over the staged rows */
+            for(sptIndex j=0; j<n; ++j) {
+                simd->scale(acc, vals[begin + j], stage + ((size_t) SPT_GATHER_BATCH + slots[SPT_GATHER_BATCH + j]) * stride, R);
+                for(sptIndex i=2; i<nmodes; ++i) {
+                    simd->mul(acc, stage + ((size_t) i * SPT_GATHER_BATCH + slots[(size_t) i * SPT_GATHER_BATCH + j]) * stride, R);
+                }
+                sptValue * const restrict mvals_row = mvals + (sptNnzIndex) mode_ind[begin + j] * stride;
+                for(sptIndex r=0; r<R; ++r) {
+                    #pragma omp atomic update
+                    mvals_row[r] += acc[r];
+                }
+            }
+        }
+
+        free(keys);
+        free(slots);
+        free(stage);
+        free(acc);
+    }
+    if(failed) {
+        spt_CheckError(SPTERR_UNKNOWN, "CPU  SpTns MTTKRP", "out of memory for the gather buffers");
+    }
+
+    return 0;
+}
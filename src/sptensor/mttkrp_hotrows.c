@@ -0,0 +1,319 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * MTTKRP with privatization limited to the hottest output rows.
+ *
+ * A full private copy of the output per thread costs tk * I * R values, which
+ * does not fit for long modes. Skewed tensors put most nonzeros, and so most
+ * of the contention, into few rows, so only the rows with the most nonzeros
+ * get per-thread accumulators, as many as a byte budget allows. The long tail
+ * of light rows is rarely hit by two threads at once and is updated with
+ * atomics.
+ */
+
+static inline int spt_HotRowsThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+
+/* floor(log2(count)) */
+static inline int spt_HotRowsBucket(sptNnzIndex count) {
+    int b = 0;
+    while(count >>= 1) {
+        ++b;
+    }
+    return b;
+}
+
+
+/*
+ * Give the at most cap rows with the most nonzeros a private slot, in row order.
+ * Rows are ranked by the power of two of their count; the last bucket that
+ * does not fit in full is filled in row order. Rows with fewer than min_count
+ * nonzeros (at least two, one nonzero is never contended) get no slot unless
+ * the whole mode fits.
+ */
+static sptIndex spt_PickHotRows(
+    sptIndex * slot,
+    sptIndex * rows,
+    sptNnzIndex const * const counts,
+    sptIndex const nrows,
+    sptIndex const cap,
+    sptNnzIndex const min_count)
+{
+    if(nrows <= cap) {
+        for(sptIndex i = 0; i < nrows; ++i) {
+            slot[i] = i;
+            rows[i] = i;
+        }
+        return nrows;
+    }
+
+    sptIndex hist[8 * sizeof (sptNnzIndex)] = { 0 };
+    for(sptIndex i = 0; i < nrows; ++i) {
+        if(counts[i] >= min_count) {
+            ++hist[spt_HotRowsBucket(counts[i])];
+        }
+    }
+    /* Buckets above `last` are taken in full, `partial` rows of bucket `last` */
+    int last = 0;
+    sptIndex taken = 0, partial = 0;
+    for(int b = 8 * sizeof (sptNnzIndex) - 1; b > 0; --b) {
+        if(taken + hist[b] > cap) {
+            last = b;
+            partial = cap - taken;
+            break;
+        }
+        taken += hist[b];
+    }
+
+    sptIndex nhot = 0;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        slot[i] = PARTI_HOT_ROW_NONE;
+        if(counts[i] < min_count) {
+            continue;
+        }
+        int const b = spt_HotRowsBucket(counts[i]);
+        if(b > last || (b == last && partial > 0)) {
+            if(b == last) {
+                --partial;
+            }
+            slot[i] = nhot;
+            rows[nhot++] = i;
+        }
+    }
+    return nhot;
+}
+
+
+/*
+ * The fewest nonzeros for which a row's private copies pay off, from the
+ * machine profile: zeroing and reducing tk copies of the row moves
+ * 2 tk stride values at triad bandwidth, while each of its nonzeros adds rank
+ * values at the contended rather than the uncontended atomic rate. Machines
+ * whose atomics do not slow down under contention get no partial
+ * privatization.
+ */
+static sptNnzIndex spt_HotRowsMinCount(sptIndex const rank, sptIndex const stride, int const tk) {
+    sptMachineProfile const * const profile = sptGetMachineProfile();
+    if(profile->stream_bandwidth <= 0 || profile->atomic_shared <= 0 || profile->atomic_private <= 0) {
+        return 2;
+    }
+    double const extra = 1 / profile->atomic_shared - 1 / profile->atomic_private;
+    if(extra <= 0) {
+        return (sptNnzIndex) -1;
+    }
+    double const reduce = 2.0 * tk * stride * sizeof (sptValue) / profile->stream_bandwidth;
+    double const count = ceil(reduce / (rank * extra));
+    return count < 2 ? 2 : count < 1e18 ? (sptNnzIndex) count : (sptNnzIndex) -1;
+}
+
+
+/**
+ * Pick the privatized output rows of every mode of a sparse tensor
+ * @param hot     an uninitialized hot row set
+ * @param X       the sparse tensor, left untouched
+ * @param rank    the number of columns of the factor matrices
+ * @param tk      the number of threads the MTTKRP will use
+ * @param budget  the bytes all private accumulators may take, 0 for PARTI_MTTKRP_PRIVATE_BYTES
+ *                and only the rows the machine profile finds worth a private copy
+ */
+int sptNewMttkrpHotRows(
+    sptMttkrpHotRows * hot,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    size_t const budget)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns HotRows", "tk < 1");
+    }
+
+    hot->nmodes = nmodes;
+    hot->nnz = X->nnz;
+    hot->tk = tk;
+    hot->rank = rank;
+    hot->stride = ((rank-1)/8+1)*8;
+    hot->nhot = malloc(nmodes * sizeof *hot->nhot);
+    hot->slot = malloc(nmodes * sizeof *hot->slot);
+    hot->rows = malloc(nmodes * sizeof *hot->rows);
+    spt_CheckOSError(!hot->nhot || !hot->slot || !hot->rows, "SpTns HotRows");
+
+    size_t const row_bytes = (size_t)tk * hot->stride * sizeof (sptValue);
+    size_t const max_rows = (budget > 0 ? budget : (size_t) PARTI_MTTKRP_PRIVATE_BYTES) / row_bytes;
+    sptIndex const cap = max_rows < (sptIndex) -1 ? (sptIndex) max_rows : (sptIndex) -1 - 1;
+    sptNnzIndex const min_count = budget > 0 ? 2 : spt_HotRowsMinCount(rank, hot->stride, tk);
+
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptNnzIndex * counts = malloc((size_t)max_dim * sizeof *counts);
+    spt_CheckOSError(!counts, "SpTns HotRows");
+
+    sptIndex max_hot = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const nrows = X->ndims[m];
+        sptNnzIndex const * const slice_ptr = spt_SparseTensorSlicePtr(X, m);
+        spt_CheckOSError(!slice_ptr, "SpTns HotRows");
+        for(sptIndex i = 0; i < nrows; ++i) {
+            counts[i] = slice_ptr[i+1] - slice_ptr[i];
+        }
+        result = sptNewIndexVector(&hot->slot[m], nrows, nrows);
+        spt_CheckError(result, "SpTns HotRows", NULL);
+        result = sptNewIndexVector(&hot->rows[m], nrows < cap ? nrows : cap, nrows < cap ? nrows : cap);
+        spt_CheckError(result, "SpTns HotRows", NULL);
+        hot->nhot[m] = spt_PickHotRows(hot->slot[m].data, hot->rows[m].data, counts, nrows, cap, min_count);
+        hot->rows[m].len = hot->nhot[m];
+        if(hot->nhot[m] > max_hot) {
+            max_hot = hot->nhot[m];
+        }
+    }
+    free(counts);
+
+    sptNnzIndex const priv_len = (sptNnzIndex)tk * max_hot * hot->stride;
+    result = sptNewValueVector(&hot->priv, priv_len, priv_len);
+    spt_CheckError(result, "SpTns HotRows", NULL);
+    result = sptNewValueVector(&hot->scratch, (sptNnzIndex)tk * hot->stride, (sptNnzIndex)tk * hot->stride);
+    spt_CheckError(result, "SpTns HotRows", NULL);
+
+    return 0;
+}
+
+
+/**
+ * Release a hot row set built by sptNewMttkrpHotRows
+ */
+void sptFreeMttkrpHotRows(sptMttkrpHotRows * hot)
+{
+    for(sptIndex m = 0; m < hot->nmodes; ++m) {
+        sptFreeIndexVector(&hot->slot[m]);
+        sptFreeIndexVector(&hot->rows[m]);
+    }
+    free(hot->nhot);
+    free(hot->slot);
+    free(hot->rows);
+    sptFreeValueVector(&hot->priv);
+    sptFreeValueVector(&hot->scratch);
+    hot->nmodes = 0;
+}
+
+
+/**
+ * OpenMP MTTKRP privatizing the hot rows of the mode and updating the others atomically
+ * @param X           the sparse tensor input X
+ * @param mats        (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mats_order  the order of the Khatri-Rao products
+ * @param mode        the mode on which the MTTKRP is performed
+ * @param hot         the hot rows picked for X, which also fix the thread count
+ */
+int sptOmpMTTKRP_HotRows(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpHotRows * hot)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+    int const tk = hot->tk;
+
+    if(nmodes < 2 || hot->nmodes != nmodes || hot->nnz != nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "hot rows do not match the tensor");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols || mats[i]->ncols > hot->rank) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptIndex const * const slot = hot->slot[mode].data;
+    sptIndex const * const rows = hot->rows[mode].data;
+    sptIndex const nhot = hot->nhot[mode];
+    sptIndex const pstride = hot->stride;
+    sptNnzIndex const plen = (sptNnzIndex)nhot * pstride;
+    sptValue * const priv = hot->priv.data;
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * stride * sizeof *mvals);
+    memset(priv, 0, (size_t)tk * plen * sizeof *priv);
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex x=0; x<nnz; ++x) {
+        int const tid = spt_HotRowsThreadNum();
+        sptValue * const restrict scratch_row = hot->scratch.data + tid * pstride;
+
+        sptIndex times_mat_index = mats_order[1];
+        sptValue const entry = vals[x];
+        simd->scale(scratch_row, entry, mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride, R);
+        for(sptIndex i=2; i<nmodes; ++i) {
+            times_mat_index = mats_order[i];
+            simd->mul(scratch_row, mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride, R);
+        }
+
+        sptIndex const mode_i = mode_ind[x];
+        sptIndex const s = slot[mode_i];
+        if(s != PARTI_HOT_ROW_NONE) {
+            sptValue * const restrict acc = priv + tid * plen + (sptNnzIndex)s * pstride;
+            #pragma omp simd
+            for(sptIndex r=0; r<R; ++r) {
+                acc[r] += scratch_row[r];
+            }
+        } else {
+            sptValue * const out_row = mvals + (sptNnzIndex)mode_i * stride;
+            for(sptIndex r=0; r<R; ++r) {
+                #pragma omp atomic update
+                out_row[r] += scratch_row[r];
+            }
+        }
+    }   // End loop nnzs
+
+    /* Reduction of the private rows, which no atomic has touched */
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex s=0; s<nhot; ++s) {
+        sptValue * const restrict out_row = mvals + (sptNnzIndex)rows[s] * stride;
+        for(int t=0; t<tk; ++t) {
+            sptValue const * const restrict acc = priv + t * plen + (sptNnzIndex)s * pstride;
+            #pragma omp simd
+            for(sptIndex r=0; r<R; ++r) {
+                out_row[r] += acc[r];
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_CUDA
+
+#include <ParTI.h>
+#include <string.h>
+#include "sptensor.h"
+
+/* Each side keeps at least this share, so that both throughputs stay measured */
+#define SPT_HYBRID_MIN_SHARE 0.02
+
+
+/* Nonzeros [begin, begin+count) of X, sharing its arrays; inds holds nmodes vectors */
+static sptSparseTensor spt_NnzRangeView(
+    sptSparseTensor const * const X,
+    sptNnzIndex const begin,
+    sptNnzIndex const count,
+    sptIndexVector * const inds)
+{
+    sptSparseTensor view = *X;
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        inds[m].len = count;
+        inds[m].cap = count;
+        inds[m].data = X->inds[m].data + begin;
+    }
+    view.nnz = count;
+    view.inds = inds;
+    view.values.len = count;
+    view.values.cap = count;
+    view.values.data = X->values.data + begin;
+    view.cache = NULL;
+    return view;
+}
+
+
+/**
+ * Prepare a CPU+GPU MTTKRP of X on the current CUDA device.
+ * @param[out] hybrid    an uninitialized hybrid state, release it with sptCudaFreeMttkrpHybrid
+ * @param[in]  X         the sparse tensor
+ * @param[in]  rank      the number of columns of the factor matrices
+ * @param[in]  tk        the number of host threads, at least 2, one of which drives the GPU
+ * @param[in]  gpu_share the initial fraction of the nonzeros for the GPU, 0 for one half
+ */
+int sptCudaNewMttkrpHybrid(
+    sptCudaMttkrpHybrid * hybrid,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk,
+    double const gpu_share)
+{
+    if(tk < 2 || gpu_share < 0 || gpu_share > 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Hybrid SpTns MTTKRP", "tk < 2 or gpu_share outside [0, 1]");
+    }
+    hybrid->gpu_share = gpu_share > 0 ? gpu_share : 0.5;
+    hybrid->gpu_rate = 0;
+    hybrid->cpu_rate = 0;
+    hybrid->tk = tk;
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, X->nmodes);
+    int result = sptNewMatrix(&hybrid->gpu_out, max_dim, rank);
+    spt_CheckError(result, "Hybrid SpTns MTTKRP", NULL);
+    return 0;
+}
+
+
+/**
+ * Release the memory of a hybrid MTTKRP state
+ */
+void sptCudaFreeMttkrpHybrid(sptCudaMttkrpHybrid * hybrid) {
+    sptFreeMatrix(&hybrid->gpu_out);
+}
+
+
+/**
+ * MTTKRP with the nonzeros split between the GPU (sptCudaMTTKRP) and the host
+ * cores (sptOmpMTTKRP), which run at the same time. The GPU part writes its own
+ * output, which is then added row by row into mats[nmodes]. Afterwards both
+ * throughputs are measured and the split is moved to where the two parts would
+ * have finished together, so it adapts from one call to the next.
+ * @param[in,out] hybrid    the state made by sptCudaNewMttkrpHybrid
+ * @param[in]  X    the sparse tensor input X
+ * @param[out] mats (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mats_order the order of the Khatri-Rao products
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ */
+int sptCudaMTTKRPHybrid(
+    sptCudaMttkrpHybrid * hybrid,
+    sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex * const mats_order,
+    sptIndex const mode)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[mode]->stride;
+    sptIndex const nrows = mats[mode]->nrows;
+
+    if(hybrid->gpu_out.ncols != mats[mode]->ncols || hybrid->gpu_out.stride != stride ||
+        hybrid->gpu_out.cap < nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "Hybrid SpTns MTTKRP", "hybrid state does not match the factors");
+    }
+
+    sptNnzIndex const gpu_nnz = (sptNnzIndex) (hybrid->gpu_share * (double) nnz);
+    sptNnzIndex const cpu_nnz = nnz - gpu_nnz;
+    sptIndexVector * inds = (sptIndexVector *) malloc(2 * nmodes * sizeof *inds);
+    sptMatrix ** gpu_mats = (sptMatrix **) malloc((nmodes+1) * sizeof *gpu_mats);
+    spt_CheckOSError(!inds || !gpu_mats, "Hybrid SpTns MTTKRP");
+    sptSparseTensor gpu_part = spt_NnzRangeView(X, 0, gpu_nnz, inds);
+    sptSparseTensor cpu_part = spt_NnzRangeView(X, gpu_nnz, cpu_nnz, inds + nmodes);
+
+    /* The GPU output starts from zero, sptCudaMTTKRP adds to what it uploads */
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        gpu_mats[m] = mats[m];
+    }
+    gpu_mats[nmodes] = &hybrid->gpu_out;
+    hybrid->gpu_out.nrows = nrows;
+    memset(hybrid->gpu_out.values, 0, (size_t) nrows * stride * sizeof (sptValue));
+    if(cpu_nnz == 0) {
+        memset(mats[nmodes]->values, 0, (size_t) nrows * stride * sizeof (sptValue));
+    }
+
+    int gpu_result = 0, cpu_result = 0;
+    double gpu_time = 0, cpu_time = 0;
+#ifdef PARTI_USE_OPENMP
+    int const levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+    #pragma omp parallel num_threads(2)
+#endif
+    {
+        int side = 0;
+#ifdef PARTI_USE_OPENMP
+        side = omp_get_thread_num();
+        if(omp_get_num_threads() == 1) {
+            side = -1;  // No second thread, run both parts in turn
+        }
+#endif
+        sptTimer timer;
+        sptNewTimer(&timer, 0);
+        if(side <= 0 && gpu_nnz > 0) {
+            sptStartTimer(timer);
+            /* The one-kernel path is the one with a fourth-order kernel */
+            gpu_result = nmodes == 4 ?
+                sptCudaMTTKRPOneKernel(&gpu_part, gpu_mats, mats_order, mode, PARTI_CUDA_IMPL_AUTO) :
+                sptCudaMTTKRP(&gpu_part, gpu_mats, mats_order, mode, PARTI_CUDA_IMPL_AUTO);
+            sptStopTimer(timer);
+            gpu_time = sptElapsedTime(timer);
+        }
+        if(side != 0 && cpu_nnz > 0) {
+            sptStartTimer(timer);
+            cpu_result = sptOmpMTTKRP(&cpu_part, mats, mats_order, mode, hybrid->tk - 1);
+            sptStopTimer(timer);
+            cpu_time = sptElapsedTime(timer);
+        }
+        sptFreeTimer(timer);
+    }
+#ifdef PARTI_USE_OPENMP
+    omp_set_max_active_levels(levels);
+#endif
+    free(inds);
+    free(gpu_mats);
+    spt_CheckError(gpu_result, "Hybrid SpTns MTTKRP", "GPU part failed");
+    spt_CheckError(cpu_result, "Hybrid SpTns MTTKRP", "CPU part failed");
+
+    /* Row-wise merge of the two partial outputs */
+    if(gpu_nnz > 0) {
+        sptValue * const restrict out = mats[nmodes]->values;
+        sptValue const * const restrict part = hybrid->gpu_out.values;
+#ifdef PARTI_USE_OPENMP
+        #pragma omp parallel for schedule(static) num_threads(hybrid->tk)
+#endif
+        for(sptIndex i = 0; i < nrows; ++i) {
+            for(sptIndex r = 0; r < stride; ++r) {
+                out[(size_t) i * stride + r] += part[(size_t) i * stride + r];
+            }
+        }
+    }
+
+    /* Give each side nonzeros in proportion to its throughput */
+    if(gpu_nnz > 0 && gpu_time > 0) {
+        hybrid->gpu_rate = gpu_nnz / gpu_time;
+    }
+    if(cpu_nnz > 0 && cpu_time > 0) {
+        hybrid->cpu_rate = cpu_nnz / cpu_time;
+    }
+    if(hybrid->gpu_rate > 0 && hybrid->cpu_rate > 0) {
+        double share = hybrid->gpu_rate / (hybrid->gpu_rate + hybrid->cpu_rate);
+        if(share < SPT_HYBRID_MIN_SHARE) share = SPT_HYBRID_MIN_SHARE;
+        if(share > 1 - SPT_HYBRID_MIN_SHARE) share = 1 - SPT_HYBRID_MIN_SHARE;
+        hybrid->gpu_share = share;
+    }
+    sptTelemetryAddCounter("Hybrid SpTns MTTKRP GPU share", hybrid->gpu_share);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * MTTKRP vectorized across nonzeros, for ranks narrower than a vector.
+ *
+ * The row-wise loops put one factor row in a vector, so a rank of 4 leaves
+ * most lanes idle. Here a batch of nonzeros is taken one column at a time:
+ * the Khatri-Rao entries are gathered into a vector of nonzeros and the
+ * products are scattered into the output column with the indexed kernels of
+ * spt_Simd, which resolve repeated output rows within a vector.
+ */
+
+/* Nonzeros per batch, kept in a stack buffer */
+#define SPT_LANES_BATCH 256
+
+/**
+ * Whether the indexed kernels are vectorized and a rank-R row fills less than one vector
+ */
+int spt_MTTKRPLanesEnabled(sptIndex const R) {
+    sptIndex const lanes = spt_Simd()->indexed_lanes;
+    return lanes != 0 && R < lanes;
+}
+
+/**
+ * Add the MTTKRP of nonzeros [begin, end) of X into out, ndims[mode] rows of
+ * the factors' stride; mats_order[0] is mode.
+ */
+void spt_MTTKRPLanes(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    sptValue * const out,
+    sptNnzIndex const begin,
+    sptNnzIndex const end)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const stride = mats[0]->stride;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue batch[SPT_LANES_BATCH];
+
+    for(sptNnzIndex b = begin; b < end; b += SPT_LANES_BATCH) {
+        sptIndex const n = (sptIndex) (end - b < SPT_LANES_BATCH ? end - b : SPT_LANES_BATCH);
+        for(sptIndex r = 0; r < R; ++r) {
+            memcpy(batch, X->values.data + b, n * sizeof *batch);
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                sptIndex const m = mats_order[i];
+                simd->gather_mul(batch, mats[m]->values + r, stride, X->inds[m].data + b, n);
+            }
+            simd->scatter_add(out + r, stride, mode_ind + b, batch, n);
+        }
+    }
+}
+
+/**
+ * OpenMP MTTKRP across nonzeros, see spt_MTTKRPLanes. Each thread adds its
+ * batches into its own copy_mats, which are then reduced, so the scatters
+ * need no atomics.
+ */
+int spt_OmpMTTKRP_Lanes(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const * const ndims = X->ndims;
+    sptIndex const stride = mats[0]->stride;
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t) ndims[mode] * stride * sizeof(sptValue));
+    for(int t=0; t<tk; ++t) {
+        memset(copy_mats[t]->values, 0, (size_t) ndims[mode] * stride * sizeof(sptValue));
+    }
+
+    sptNnzIndex const nbatches = (nnz + SPT_LANES_BATCH - 1) / SPT_LANES_BATCH;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex b=0; b<nbatches; ++b) {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const end = (b + 1) * SPT_LANES_BATCH < nnz ? (b + 1) * SPT_LANES_BATCH : nnz;
+        spt_MTTKRPLanes(X, mats, mats_order, mode, copy_mats[tid]->values, b * SPT_LANES_BATCH, end);
+    }
+
+    /* Reduction */
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptIndex i=0; i<ndims[mode]; ++i) {
+        for(int t=0; t<tk; ++t) {
+            #pragma omp simd
+            for(sptIndex r=0; r<R; ++r) {
+                mvals[i * stride + r] += copy_mats[t]->values[i * stride + r];
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/**
+ * MTTKRP as one SpMM, M = X_(mode) KR, for tensors whose modes other than
+ * `mode` are short enough for their Khatri-Rao product KR to be formed: a
+ * matrix-like tensor, or one mode against a few small ones. KR has one row per
+ * column of A, in the order of sptMatricizeCSR, and the product goes through
+ * sptSparseMatrixCSRSpMM and so through the vendor sparse BLAS when enabled.
+ * @param[in]  X    the sparse tensor, for its shape
+ * @param[in]  A    the CSR matricization of X at mode, from sptMatricizeCSR with transpose 1
+ * @param[out] mats (N+1) dense matrices, mats[nmodes] receives the result
+ * @param[in]  mode the mode on which the MTTKRP is performed
+ * @param[in]  tk   the number of threads
+ */
+int sptMTTKRPMatricized(sptSparseTensor const * const X,
+    sptSparseMatrixCSR const * const A,
+    sptMatrix * mats[],
+    sptIndex const mode,
+    const int tk)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = mats[mode]->ncols;
+    if(A->nrows != X->ndims[mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP Matricized", "A is not the matricization at mode");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(mats[m]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP Matricized", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[m]->nrows != X->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP Matricized", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptMatrix kr;
+    result = sptNewMatrix(&kr, A->ncols, R);
+    spt_CheckError(result, "CPU  SpTns MTTKRP Matricized", NULL);
+    sptIndex const stride = kr.stride;
+    for(sptIndex r = 0; r < R; ++r) {
+        kr.values[r] = 1;
+    }
+    /* Modes mode+1, ..., mode-1 with the first slowest; expand in place from the back */
+    sptNnzIndex len = 1;
+    for(sptIndex i = 1; i < nmodes; ++i) {
+        sptMatrix const * const U = mats[(mode+i) % nmodes];
+        sptIndex const e = U->nrows;
+        for(sptNnzIndex p = len; p-- > 0; ) {
+            for(sptIndex j = e; j-- > 0; ) {
+                sptValue const * const src = kr.values + p * stride;
+                sptValue * const dst = kr.values + (p * e + j) * stride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    dst[r] = src[r] * U->values[(size_t) j * U->stride + r];
+                }
+            }
+        }
+        len *= e;
+    }
+    if(len != A->ncols) {
+        sptFreeMatrix(&kr);
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP Matricized", "A is not the matricization at mode");
+    }
+
+    result = sptSparseMatrixCSRSpMM(mats[nmodes], A, &kr, tk);
+    sptFreeMatrix(&kr);
+    spt_CheckError(result, "CPU  SpTns MTTKRP Matricized", NULL);
+    return 0;
+}
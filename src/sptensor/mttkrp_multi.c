@@ -0,0 +1,301 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "hicoo/hicoo.h"
+#include "../matrix/simd.h"
+
+/*
+ * MTTKRP of several modes in one pass over the nonzeros.
+ *
+ * For a nonzero with value v and factor rows a_0 .. a_{N-1}, the output of
+ * mode m gets v * (a_0 .* .. a_{m-1}) .* (a_{m+1} .* .. a_{N-1}). The prefix
+ * and suffix products are shared between the outputs, so all N outputs cost
+ * about 3N row products per nonzero rather than N (N - 1), and the indices,
+ * value and factor rows of a nonzero are loaded once for all of them.
+ */
+
+/* Per-nonzero state: which modes are wanted, and the prefix and suffix product rows */
+typedef struct {
+    sptIndex nmodes;
+    sptIndex R;
+    sptIndex lo;                /// the first mode with an output
+    sptIndex hi;                /// the last mode with an output
+    sptValue * const * outs;    /// output matrix values of each mode, NULL for none
+} spt_MultiMTTKRP;
+
+/* out[r] += x[r], atomically when other threads may share the row */
+static inline void spt_MultiAccum(spt_SimdKernels const * simd, sptValue * const out, sptValue const * const x, sptIndex const R, int const atomic)
+{
+    if(!atomic) {
+        simd->axpy(out, 1, x, R);
+        return;
+    }
+    for(sptIndex r=0; r < R; ++r) {
+#ifdef PARTI_USE_OPENMP
+        #pragma omp atomic update
+#endif
+        out[r] += x[r];
+    }
+}
+
+/*
+ * Add the contributions of one nonzero: rows[m] its factor rows, orows[m]
+ * its output rows, pre and suf nmodes scratch rows of stride each, tmp one.
+ */
+static inline void spt_MultiMTTKRPEntry(
+    spt_SimdKernels const * simd,
+    spt_MultiMTTKRP const * const mm,
+    sptValue const * const * rows,
+    sptValue * const * orows,
+    sptValue const v,
+    sptValue * const pre,
+    sptValue * const suf,
+    sptValue * const tmp,
+    sptIndex const stride,
+    int const atomic)
+{
+    sptIndex const N = mm->nmodes;
+    sptIndex const R = mm->R;
+    /* pre_m = v * a_0 .* .. a_{m-1} for 0 < m <= hi */
+    if(mm->hi > 0) {
+        simd->scale(pre + stride, v, rows[0], R);
+        for(sptIndex m=2; m <= mm->hi; ++m) {
+            simd->hadamard(pre + (size_t) m * stride, pre + (size_t) (m-1) * stride, rows[m-1], R);
+        }
+    }
+    /* suf_m = a_{m+1} .* .. a_{N-1} for lo <= m < N - 1, suf_{N-2} being a_{N-1} itself */
+    sptValue const * sufm = rows[N-1];
+    for(sptIndex m=N-1; m-- > mm->lo; ) {
+        if(m < N - 2) {
+            simd->hadamard(suf + (size_t) m * stride, sufm, rows[m+1], R);
+            sufm = suf + (size_t) m * stride;
+        }
+        if(mm->outs[m] == NULL) {
+            continue;
+        }
+        if(m == 0) {
+            simd->scale(tmp, v, sufm, R);
+        } else {
+            simd->hadamard(tmp, pre + (size_t) m * stride, sufm, R);
+        }
+        spt_MultiAccum(simd, orows[m], tmp, R, atomic);
+    }
+    if(mm->outs[N-1] != NULL) {
+        spt_MultiAccum(simd, orows[N-1], pre + (size_t) (N-1) * stride, R, atomic);
+    }
+}
+
+/* Check the modes and outputs, clear the outputs, and index them by mode */
+static int spt_MultiMTTKRPSetup(
+    spt_MultiMTTKRP * const mm,
+    sptValue ** const by_mode,
+    sptIndex const nmodes,
+    sptIndex const * const ndims,
+    sptMatrix * mats[],
+    sptIndex const nout,
+    sptIndex const modes[],
+    sptMatrix * outs[],
+    char const * const module)
+{
+    (void) module;
+    if(nmodes < 2 || nout == 0) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "need two modes and one output");
+    }
+    sptIndex const R = mats[0]->ncols;
+    sptIndex const stride = mats[0]->stride;
+    for(sptIndex m=0; m < nmodes; ++m) {
+        if(mats[m]->ncols != R || mats[m]->stride != stride || mats[m]->nrows != ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "mats[m] is not ndims[m] x R");
+        }
+        by_mode[m] = NULL;
+    }
+    mm->nmodes = nmodes;
+    mm->R = R;
+    mm->lo = nmodes;
+    mm->hi = 0;
+    for(sptIndex k=0; k < nout; ++k) {
+        sptIndex const m = modes[k];
+        if(m >= nmodes || by_mode[m] != NULL) {
+            spt_CheckError(SPTERR_VALUE_ERROR, module, "modes must be distinct modes of X");
+        }
+        if(outs[k]->ncols != R || outs[k]->stride != stride || outs[k]->nrows < ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "outs[k] is not ndims[modes[k]] x R");
+        }
+        memset(outs[k]->values, 0, (size_t) ndims[m] * stride * sizeof(sptValue));
+        by_mode[m] = outs[k]->values;
+        mm->lo = m < mm->lo ? m : mm->lo;
+        mm->hi = m > mm->hi ? m : mm->hi;
+    }
+    mm->outs = by_mode;
+    return 0;
+}
+
+
+/**
+ * OpenMP parallel MTTKRP of several modes of a COO tensor in one pass over its nonzeros.
+ * @param[in]  X      the sparse tensor
+ * @param[in]  mats   the nmodes factor matrices, all ndims[m] x R
+ * @param[in]  nout   the number of modes to compute
+ * @param[in]  modes  the nout distinct modes
+ * @param[out] outs   outs[k] receives the MTTKRP of modes[k], at least ndims[modes[k]] x R
+ * @param[in]  tk     the number of threads; outputs are updated atomically when tk > 1
+ *
+ * Gradient-based CP, CMTF and Jacobi-style ALS take all MTTKRPs against the
+ * same factors; this reads the tensor once for them, see sptOmpCpdAlsJacobi.
+ */
+int sptOmpMTTKRPMulti(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const nout,
+    sptIndex const modes[],
+    sptMatrix * outs[],
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptValue ** by_mode = malloc(nmodes * sizeof *by_mode);
+    spt_CheckOSError(!by_mode, "OMP  SpTns MTTKRP Multi");
+    spt_MultiMTTKRP mm;
+    int const result = spt_MultiMTTKRPSetup(&mm, by_mode, nmodes, X->ndims, mats, nout, modes, outs, "OMP  SpTns MTTKRP Multi");
+    if(result != 0) {
+        free(by_mode);
+        return result;
+    }
+
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const stride = mats[0]->stride;
+    int const nthreads = tk > 0 ? tk : 1;
+    size_t const per_thread = (size_t) (2 * nmodes + 1) * stride;
+    sptValue * const scratch = malloc(nthreads * per_thread * sizeof *scratch);
+    spt_CheckOSError(!scratch, "OMP  SpTns MTTKRP Multi");
+    sptValue const * const vals = X->values.data;
+    sptNnzIndex const nnz = X->nnz;
+
+    spt_KernelProbe * probe = spt_KernelProbeStart(nthreads);
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel num_threads(nthreads)
+#endif
+    {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const pre = scratch + omp_get_thread_num() * per_thread;
+#else
+        sptValue * const pre = scratch;
+#endif
+        sptValue * const suf = pre + (size_t) nmodes * stride;
+        sptValue * const tmp = suf + (size_t) nmodes * stride;
+        sptValue const * rows[nmodes];
+        sptValue * orows[nmodes];
+#ifdef PARTI_USE_OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(sptNnzIndex x=0; x < nnz; ++x) {
+            for(sptIndex m=0; m < nmodes; ++m) {
+                size_t const off = (size_t) X->inds[m].data[x] * stride;
+                rows[m] = mats[m]->values + off;
+                orows[m] = by_mode[m] != NULL ? by_mode[m] + off : NULL;
+            }
+            spt_MultiMTTKRPEntry(simd, &mm, rows, orows, vals[x], pre, suf, tmp, stride, nthreads > 1);
+        }
+    }
+    spt_KernelProbeStop(probe, NULL, "OMP  SpTns MTTKRP Multi",
+        (double) nnz * mm.R * (2 * nmodes + nout), spt_SparseTensorBytes(X) + (double) nnz * mm.R * (nmodes + nout) * sizeof(sptValue));
+
+    free(scratch);
+    free(by_mode);
+    return 0;
+}
+
+
+/**
+ * OpenMP parallel MTTKRP of several modes of a HiCOO tensor in one pass over its nonzeros,
+ * see sptOmpMTTKRPMulti. The factor and output rows of a block are located once per block.
+ * Kernels run in parallel; outputs are updated atomically when tk > 1.
+ */
+int sptOmpMTTKRPHiCOOMulti(sptSparseTensorHiCOO const * const hitsr,
+    sptMatrix * mats[],
+    sptIndex const nout,
+    sptIndex const modes[],
+    sptMatrix * outs[],
+    const int tk)
+{
+    spt_CheckUniformBlocks(hitsr, "OMP  HiCOO SpTns MTTKRP Multi");
+    sptIndex const nmodes = hitsr->nmodes;
+    sptValue ** by_mode = malloc(nmodes * sizeof *by_mode);
+    spt_CheckOSError(!by_mode, "OMP  HiCOO SpTns MTTKRP Multi");
+    spt_MultiMTTKRP mm;
+    int const result = spt_MultiMTTKRPSetup(&mm, by_mode, nmodes, hitsr->ndims, mats, nout, modes, outs, "OMP  HiCOO SpTns MTTKRP Multi");
+    if(result != 0) {
+        free(by_mode);
+        return result;
+    }
+
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const stride = mats[0]->stride;
+    int const nthreads = tk > 0 ? tk : 1;
+    size_t const per_thread = (size_t) (2 * nmodes + 1) * stride;
+    sptValue * const scratch = malloc(nthreads * per_thread * sizeof *scratch);
+    spt_CheckOSError(!scratch, "OMP  HiCOO SpTns MTTKRP Multi");
+    sptValue const * const vals = hitsr->values.data;
+    sptNnzIndex const nkernels = hitsr->kptr.len - 1;
+
+    spt_KernelProbe * probe = spt_KernelProbeStart(nthreads);
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel num_threads(nthreads)
+#endif
+    {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const pre = scratch + omp_get_thread_num() * per_thread;
+#else
+        sptValue * const pre = scratch;
+#endif
+        sptValue * const suf = pre + (size_t) nmodes * stride;
+        sptValue * const tmp = suf + (size_t) nmodes * stride;
+        sptValue const * block_rows[nmodes];
+        sptValue * block_orows[nmodes];
+        sptValue const * rows[nmodes];
+        sptValue * orows[nmodes];
+#ifdef PARTI_USE_OPENMP
+        #pragma omp for schedule(dynamic, 1)
+#endif
+        for(sptNnzIndex k=0; k < nkernels; ++k) {
+            for(sptNnzIndex b=hitsr->kptr.data[k]; b < hitsr->kptr.data[k+1]; ++b) {
+                for(sptIndex m=0; m < nmodes; ++m) {
+                    size_t const off = ((size_t) hitsr->binds[m].data[b] << hitsr->sb_bits) * stride;
+                    block_rows[m] = mats[m]->values + off;
+                    block_orows[m] = by_mode[m] != NULL ? by_mode[m] + off : NULL;
+                }
+                for(sptNnzIndex z=hitsr->bptr.data[b]; z < hitsr->bptr.data[b+1]; ++z) {
+                    for(sptIndex m=0; m < nmodes; ++m) {
+                        size_t const off = (size_t) hitsr->einds[m].data[z] * stride;
+                        rows[m] = block_rows[m] + off;
+                        orows[m] = block_orows[m] != NULL ? block_orows[m] + off : NULL;
+                    }
+                    spt_MultiMTTKRPEntry(simd, &mm, rows, orows, vals[z], pre, suf, tmp, stride, nthreads > 1);
+                }
+            }
+        }
+    }
+    spt_KernelProbeStop(probe, NULL, "OMP  HiCOO SpTns MTTKRP Multi",
+        (double) hitsr->nnz * mm.R * (2 * nmodes + nout), 0);
+
+    free(scratch);
+    free(by_mode);
+    return 0;
+}
@@ -18,6 +18,7 @@
 
 #include <ParTI.h>
 #include "sptensor.h"
+#include "../matrix/simd.h"
 
 int sptOmpMTTKRP_3D(sptSparseTensor const * const X,
     sptMatrix * mats[],     // mats[nmodes] as temporary space.
@@ -35,7 +36,40 @@ int sptOmpMTTKRP_3D_Lock(sptSparseTensor const * const X,
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int tk,
-    sptMutexPool * lock_pool);
+    sptMutexPool * lock_pool,
+    sptValue * const scratch,   // tk rows of length mats[0]->stride
+    sptIndex const scratch_stride);
+static int spt_OmpMTTKRP_Atomic(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptValue * const scratch,
+    sptIndex const scratch_stride);
+static int spt_OmpMTTKRP_Reduce(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptValue * const scratch,
+    sptIndex const scratch_stride);
+static int spt_OmpMTTKRP_Lock(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptMutexPool * lock_pool,
+    sptValue * const scratch,
+    sptIndex const scratch_stride);
+
+static inline int spt_ThreadId(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
 
 /**
  * OpenMP parallelized Matriced sparse tensor times a sequence of dense matrix Khatri-Rao products (MTTKRP) on a specified mode
@@ -122,19 +156,143 @@ int sptOmpMTTKRP_Init(sptSparseTensor const * const X,
 }
 
 
+static int spt_OmpMTTKRPDispatch(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    if(sptSparseTensorIsPattern(X)) {
+        return spt_OmpMTTKRP_Pattern(X, mats, mats_order, mode, tk);
+    }
+    spt_OmpMTTKRPKernel const kernel = spt_LookupOmpMTTKRPKernel(X->nmodes, mats[mode]->ncols);
+    if(kernel != NULL) {
+        return kernel(X, mats, mats_order, mode, tk);
+    }
+    if(X->nmodes == 3) {
+        sptAssert(sptOmpMTTKRP_3D(X, mats, mats_order, mode, tk) == 0);
+        return 0;
+    }
+
+    sptIndex const stride = mats[0]->stride;
+    sptValueVector scratch;
+    int result = sptNewValueVector(&scratch, (sptNnzIndex)tk * stride, (sptNnzIndex)tk * stride);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+    result = spt_OmpMTTKRP_Atomic(X, mats, mats_order, mode, tk, scratch.data, stride);
+    sptFreeValueVector(&scratch);
+    return result;
+}
+
 int sptOmpMTTKRP(sptSparseTensor const * const X,
     sptMatrix * mats[],     // mats[nmodes] as temporary space.
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int tk)
+{
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    int const result = spt_OmpMTTKRPDispatch(X, mats, mats_order, mode, tk);
+    spt_KernelProbeStop(probe, NULL, "OMP  SpTns MTTKRP", spt_MTTKRPFlops(X, mats[mode]->ncols), spt_MTTKRPBytes(X, mats[mode]->ncols));
+    return result;
+}
+
+
+/**
+ * OpenMP MTTKRP with all scratch taken from a workspace made by sptNewCpdWorkspace.
+ * The workspace decides the update strategy: whole rows of a sorted copy if it
+ * has one for the mode, thread-owned rows if it has a row partition, privatized hot rows if it has picked them, privatized reduction if
+ * it owns copy_mats, row locks if it owns a lock pool, and atomics otherwise.
+ * The Khatri-Rao order is written to ws->mats_order.
+ */
+static int spt_OmpMTTKRPWorkspaceDispatch(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mode,
+    sptCpdWorkspace * ws)
 {
     sptIndex const nmodes = X->nmodes;
+    int const tk = ws->tk;
 
+    if(ws->nmodes != nmodes || ws->rank != mats[mode]->ncols || ws->scratch_stride < mats[0]->stride) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "workspace does not match the tensor or rank");
+    }
+    ws->mats_order[0] = mode;
+    for(sptIndex i=1; i<nmodes; ++i) {
+        ws->mats_order[i] = (mode+i) % nmodes;
+    }
+    sptIndex const * const mats_order = ws->mats_order;
+
+    if(ws->layouts != NULL && ws->layouts->copies[mode] != NULL) {
+        if(ws->layouts->copies[mode]->nnz != X->nnz) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "layouts do not match the tensor");
+        }
+        for(sptIndex i=0; i<nmodes; ++i) {
+            if(mats[i]->nrows != X->ndims[i] || mats[i]->ncols != mats[nmodes]->ncols) {
+                spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats do not match the tensor");
+            }
+            ws->layouts->factors[i] = mats[i]->values;
+        }
+        return spt_OmpMTTKRPCpdLayout(ws->layouts, mode, mats_order, mats[0]->stride, mats[mode]->ncols, mats[nmodes]->values);
+    }
+    if(sptSparseTensorIsPattern(X)) {
+        return spt_OmpMTTKRP_Pattern(X, mats, mats_order, mode, tk);
+    }
+    if(ws->rowpart != NULL) {
+        return sptOmpMTTKRP_Owner(X, mats, mats_order, mode, ws->rowpart);
+    }
+    if(ws->hotrows != NULL) {
+        return sptOmpMTTKRP_HotRows(X, mats, mats_order, mode, ws->hotrows);
+    }
+    if(ws->tiling != NULL) {
+        return sptOmpMTTKRP_Tiled(X, mats, mats_order, mode, ws->tiling, tk);
+    }
+    if(ws->copy_mats != NULL) {
+        if(spt_MTTKRPLanesEnabled(mats[mode]->ncols)) {
+            return spt_OmpMTTKRP_Lanes(X, mats, ws->copy_mats, mats_order, mode, tk);
+        }
+        if(nmodes == 3) {
+            return sptOmpMTTKRP_3D_Reduce(X, mats, ws->copy_mats, mats_order, mode, tk);
+        }
+        return spt_OmpMTTKRP_Reduce(X, mats, ws->copy_mats, mats_order, mode, tk, ws->scratch.data, ws->scratch_stride);
+    }
+#ifdef PARTI_USE_OPENMP
+    if(ws->lock_pool != NULL) {
+        if(nmodes == 3) {
+            return sptOmpMTTKRP_3D_Lock(X, mats, mats_order, mode, tk, ws->lock_pool, ws->scratch.data, ws->scratch_stride);
+        }
+        return spt_OmpMTTKRP_Lock(X, mats, mats_order, mode, tk, ws->lock_pool, ws->scratch.data, ws->scratch_stride);
+    }
+#endif
+    spt_OmpMTTKRPKernel const kernel = spt_LookupOmpMTTKRPKernel(nmodes, mats[mode]->ncols);
+    if(kernel != NULL) {
+        return kernel(X, mats, mats_order, mode, tk);
+    }
     if(nmodes == 3) {
-        sptAssert(sptOmpMTTKRP_3D(X, mats, mats_order, mode, tk) == 0);
-        return 0;
+        return sptOmpMTTKRP_3D(X, mats, mats_order, mode, tk);
     }
+    return spt_OmpMTTKRP_Atomic(X, mats, mats_order, mode, tk, ws->scratch.data, ws->scratch_stride);
+}
 
+int sptOmpMTTKRPWorkspace(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mode,
+    sptCpdWorkspace * ws)
+{
+    spt_KernelProbe * probe = spt_KernelProbeStart(ws->tk);
+    int const result = spt_OmpMTTKRPWorkspaceDispatch(X, mats, mode, ws);
+    spt_KernelProbeStop(probe, NULL, "OMP  SpTns MTTKRP", spt_MTTKRPFlops(X, mats[mode]->ncols), spt_MTTKRPBytes(X, mats[mode]->ncols));
+    return result;
+}
+
+
+static int spt_OmpMTTKRP_Atomic(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptValue * const scratch,
+    sptIndex const scratch_stride)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
     sptValue const * const vals = X->values.data;
@@ -155,44 +313,46 @@ int sptOmpMTTKRP(sptSparseTensor const * const X,
     sptIndex const * const mode_ind = X->inds[mode].data;
     sptValue * const restrict mvals = mats[nmodes]->values;
     memset(mvals, 0, tmpI*stride*sizeof(sptValue));
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
+
+    /* Each thread's share ends without a barrier, so the trace shows the imbalance */
+    #pragma omp parallel num_threads(tk)
+    {
+        double const trace = sptTraceBegin();
+        #pragma omp for schedule(static) nowait
+        for(sptNnzIndex x=0; x<nnz; ++x) {
+            sptValue * const restrict scratch_row = scratch + spt_ThreadId() * scratch_stride;
+            if(pd != 0 && x + pd < nnz) {
+                for(sptIndex i=1; i<nmodes; ++i) {
+                    spt_PrefetchRow(mats[mats_order[i]]->values + X->inds[mats_order[i]].data[x + pd] * stride, R);
+                }
+            }
 
-    #pragma omp parallel for schedule(static) num_threads(tk)
-    for(sptNnzIndex x=0; x<nnz; ++x) {
-        sptValueVector scratch;  // Temporary array
-        sptNewValueVector(&scratch, R, R);
-        sptConstantValueVector(&scratch, 0);
+            sptIndex times_mat_index = mats_order[1];
+            sptMatrix * times_mat = mats[times_mat_index];
+            sptIndex * times_inds = X->inds[times_mat_index].data;
+            sptIndex tmp_i = times_inds[x];
+            sptValue const entry = vals[x];
+            simd->scale(scratch_row, entry, times_mat->values + tmp_i * stride, R);
 
-        sptIndex times_mat_index = mats_order[1];
-        sptMatrix * times_mat = mats[times_mat_index];
-        sptIndex * times_inds = X->inds[times_mat_index].data;
-        sptIndex tmp_i = times_inds[x];
-        sptValue const entry = vals[x];
-        #pragma omp simd
-        for(sptIndex r=0; r<R; ++r) {
-            scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-        }
+            for(sptIndex i=2; i<nmodes; ++i) {
+                times_mat_index = mats_order[i];
+                times_mat = mats[times_mat_index];
+                times_inds = X->inds[times_mat_index].data;
+                tmp_i = times_inds[x];
 
-        for(sptIndex i=2; i<nmodes; ++i) {
-            times_mat_index = mats_order[i];
-            times_mat = mats[times_mat_index];
-            times_inds = X->inds[times_mat_index].data;
-            tmp_i = times_inds[x];
+                simd->mul(scratch_row, times_mat->values + tmp_i * stride, R);
+            }
 
-            #pragma omp simd
+            sptIndex const mode_i = mode_ind[x];
+            sptValue * const restrict mvals_row = mvals + mode_i * stride;
             for(sptIndex r=0; r<R; ++r) {
-                scratch.data[r] *= times_mat->values[tmp_i * stride + r];
+                #pragma omp atomic update
+                mvals_row[r] += scratch_row[r];
             }
-        }
-
-        sptIndex const mode_i = mode_ind[x];
-        sptValue * const restrict mvals_row = mvals + mode_i * stride;
-        for(sptIndex r=0; r<R; ++r) {
-            #pragma omp atomic update
-            mvals_row[r] += scratch.data[r];
-        }
-
-        sptFreeValueVector(&scratch);
-    }   // End loop nnzs
+        }   // End loop nnzs
+        sptTraceEnd("COO MTTKRP worker", mode, trace);
+    }
 
     return 0;
 }
@@ -233,9 +393,14 @@ int sptOmpMTTKRP_3D(sptSparseTensor const * const X,
     sptIndex times_mat_index_2 = mats_order[2];
     sptMatrix * restrict times_mat_2 = mats[times_mat_index_2];
     sptIndex * restrict times_inds_2 = X->inds[times_mat_index_2].data;
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
 
     #pragma omp parallel for schedule(static) num_threads(tk)
     for(sptNnzIndex x=0; x<nnz; ++x) {
+        if(pd != 0 && x + pd < nnz) {
+            spt_PrefetchRow(times_mat_1->values + times_inds_1[x + pd] * stride, R);
+            spt_PrefetchRow(times_mat_2->values + times_inds_2[x + pd] * stride, R);
+        }
         sptIndex mode_i = mode_ind[x];
         sptValue * const restrict mvals_row = mvals + mode_i * stride;
         sptIndex tmp_i_1 = times_inds_1[x];
@@ -259,13 +424,31 @@ int sptOmpMTTKRP_Lock(sptSparseTensor const * const X,
     const int tk,
     sptMutexPool * lock_pool)
 {
-    sptIndex const nmodes = X->nmodes;
-
-    if(nmodes == 3) {
-        sptAssert(sptOmpMTTKRP_3D_Lock(X, mats, mats_order, mode, tk, lock_pool) == 0);
-        return 0;
+    sptIndex const stride = mats[0]->stride;
+    sptValueVector scratch;
+    int result = sptNewValueVector(&scratch, (sptNnzIndex)tk * stride, (sptNnzIndex)tk * stride);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+    if(X->nmodes == 3) {
+        result = sptOmpMTTKRP_3D_Lock(X, mats, mats_order, mode, tk, lock_pool, scratch.data, stride);
+    } else {
+        result = spt_OmpMTTKRP_Lock(X, mats, mats_order, mode, tk, lock_pool, scratch.data, stride);
     }
+    sptFreeValueVector(&scratch);
+    return result;
+}
 
+
+static int spt_OmpMTTKRP_Lock(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptMutexPool * lock_pool,
+    sptValue * const scratch,
+    sptIndex const scratch_stride)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
     sptValue const * const vals = X->values.data;
@@ -286,21 +469,23 @@ int sptOmpMTTKRP_Lock(sptSparseTensor const * const X,
     sptIndex const * const mode_ind = X->inds[mode].data;
     sptValue * const mvals = mats[nmodes]->values;
     memset(mvals, 0, tmpI*stride*sizeof(sptValue));
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
 
     #pragma omp parallel for schedule(static) num_threads(tk)
     for(sptNnzIndex x=0; x<nnz; ++x) {
-        sptValueVector scratch;  // Temporary array
-        sptNewValueVector(&scratch, R, R);
-        sptConstantValueVector(&scratch, 0);
+        sptValue * const restrict scratch_row = scratch + spt_ThreadId() * scratch_stride;
+        if(pd != 0 && x + pd < nnz) {
+            for(sptIndex i=1; i<nmodes; ++i) {
+                spt_PrefetchRow(mats[mats_order[i]]->values + X->inds[mats_order[i]].data[x + pd] * stride, R);
+            }
+        }
 
         sptIndex times_mat_index = mats_order[1];
         sptMatrix * times_mat = mats[times_mat_index];
         sptIndex * times_inds = X->inds[times_mat_index].data;
         sptIndex tmp_i = times_inds[x];
         sptValue const entry = vals[x];
-        for(sptIndex r=0; r<R; ++r) {
-            scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-        }
+        simd->scale(scratch_row, entry, times_mat->values + tmp_i * stride, R);
 
         for(sptIndex i=2; i<nmodes; ++i) {
             times_mat_index = mats_order[i];
@@ -308,9 +493,7 @@ int sptOmpMTTKRP_Lock(sptSparseTensor const * const X,
             times_inds = X->inds[times_mat_index].data;
             tmp_i = times_inds[x];
 
-            for(sptIndex r=0; r<R; ++r) {
-                scratch.data[r] *= times_mat->values[tmp_i * stride + r];
-            }
+            simd->mul(scratch_row, times_mat->values + tmp_i * stride, R);
         }
 
         sptIndex const mode_i = mode_ind[x];
@@ -318,11 +501,9 @@ int sptOmpMTTKRP_Lock(sptSparseTensor const * const X,
 
         sptMutexSetLock(lock_pool, mode_i);
         for(sptIndex r=0; r<R; ++r) {
-            mvals_row[r] += scratch.data[r];
+            mvals_row[r] += scratch_row[r];
         }
         sptMutexUnsetLock(lock_pool, mode_i);
-
-        sptFreeValueVector(&scratch);
     }   // End loop nnzs
 
     return 0;
@@ -335,7 +516,9 @@ int sptOmpMTTKRP_3D_Lock(sptSparseTensor const * const X,
     sptIndex const mats_order[],    // Correspond to the mode order of X.
     sptIndex const mode,
     const int tk,
-    sptMutexPool * lock_pool) 
+    sptMutexPool * lock_pool,
+    sptValue * const scratch,
+    sptIndex const scratch_stride)
 {
     sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
@@ -369,9 +552,7 @@ int sptOmpMTTKRP_3D_Lock(sptSparseTensor const * const X,
 
     #pragma omp parallel for schedule(static) num_threads(tk)
     for(sptNnzIndex x=0; x<nnz; ++x) {
-        sptValueVector scratch;  // Temporary array
-        sptNewValueVector(&scratch, R, R);
-        sptConstantValueVector(&scratch, 0);
+        sptValue * const restrict scratch_row = scratch + spt_ThreadId() * scratch_stride;
 
         sptIndex mode_i = mode_ind[x];
         sptValue * const restrict mvals_row = mvals + mode_i * stride;
@@ -380,16 +561,14 @@ int sptOmpMTTKRP_3D_Lock(sptSparseTensor const * const X,
         sptValue entry = vals[x];
 
         for(sptIndex r=0; r<R; ++r) {
-            scratch.data[r] = entry * times_mat_1->values[tmp_i_1 * stride + r] * times_mat_2->values[tmp_i_2 * stride + r];
+            scratch_row[r] = entry * times_mat_1->values[tmp_i_1 * stride + r] * times_mat_2->values[tmp_i_2 * stride + r];
         }
 
         sptMutexSetLock(lock_pool, mode_i);
         for(sptIndex r=0; r<R; ++r) {
-            mvals_row[r] += scratch.data[r];
+            mvals_row[r] += scratch_row[r];
         }
         sptMutexUnsetLock(lock_pool, mode_i);
-
-        sptFreeValueVector(&scratch);
     }
 
     return 0;
@@ -405,13 +584,35 @@ int sptOmpMTTKRP_Reduce(sptSparseTensor const * const X,
     sptIndex const mode,
     const int tk) 
 {
-    sptIndex const nmodes = X->nmodes;
-
-    if(nmodes == 3) {
+    if(spt_MTTKRPLanesEnabled(mats[mode]->ncols)) {
+        return spt_OmpMTTKRP_Lanes(X, mats, copy_mats, mats_order, mode, tk);
+    }
+    if(X->nmodes == 3) {
         sptAssert(sptOmpMTTKRP_3D_Reduce(X, mats, copy_mats, mats_order, mode, tk) == 0);
         return 0;
     }
 
+    sptIndex const stride = mats[0]->stride;
+    sptValueVector scratch;
+    int result = sptNewValueVector(&scratch, (sptNnzIndex)tk * stride, (sptNnzIndex)tk * stride);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+    result = spt_OmpMTTKRP_Reduce(X, mats, copy_mats, mats_order, mode, tk, scratch.data, stride);
+    sptFreeValueVector(&scratch);
+    return result;
+}
+
+
+static int spt_OmpMTTKRP_Reduce(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk,
+    sptValue * const scratch,
+    sptIndex const scratch_stride)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
     sptNnzIndex const nnz = X->nnz;
     sptIndex const * const ndims = X->ndims;
     sptValue const * const vals = X->values.data;
@@ -439,21 +640,15 @@ int sptOmpMTTKRP_Reduce(sptSparseTensor const * const X,
 
     #pragma omp parallel for schedule(static) num_threads(tk)
     for(sptNnzIndex x=0; x<nnz; ++x) {
-        int tid = omp_get_thread_num();
-
-        sptValueVector scratch;  // Temporary array
-        sptNewValueVector(&scratch, R, R);
-        sptConstantValueVector(&scratch, 0);
+        int tid = spt_ThreadId();
+        sptValue * const restrict scratch_row = scratch + tid * scratch_stride;
 
         sptIndex times_mat_index = mats_order[1];
         sptMatrix * times_mat = mats[times_mat_index];
         sptIndex * times_inds = X->inds[times_mat_index].data;
         sptIndex tmp_i = times_inds[x];
         sptValue const entry = vals[x];
-        #pragma omp simd
-        for(sptIndex r=0; r<R; ++r) {
-            scratch.data[r] = entry * times_mat->values[tmp_i * stride + r];
-        }
+        simd->scale(scratch_row, entry, times_mat->values + tmp_i * stride, R);
 
         for(sptIndex i=2; i<nmodes; ++i) {
             times_mat_index = mats_order[i];
@@ -461,19 +656,14 @@ int sptOmpMTTKRP_Reduce(sptSparseTensor const * const X,
             times_inds = X->inds[times_mat_index].data;
             tmp_i = times_inds[x];
 
-            #pragma omp simd
-            for(sptIndex r=0; r<R; ++r) {
-                scratch.data[r] *= times_mat->values[tmp_i * stride + r];
-            }
+            simd->mul(scratch_row, times_mat->values + tmp_i * stride, R);
         }
 
         sptIndex const mode_i = mode_ind[x];
         #pragma omp simd
         for(sptIndex r=0; r<R; ++r) {
-            copy_mats[tid]->values[mode_i * stride + r] += scratch.data[r];
+            copy_mats[tid]->values[mode_i * stride + r] += scratch_row[r];
         }
-
-        sptFreeValueVector(&scratch);
     }   // End loop nnzs
 
     /* Reduction */
@@ -535,7 +725,7 @@ int sptOmpMTTKRP_3D_Reduce(sptSparseTensor const * const X,
 
     #pragma omp parallel for schedule(static) num_threads(tk)
     for(sptNnzIndex x=0; x<nnz; ++x) {
-        int tid = omp_get_thread_num();
+        int tid = spt_ThreadId();
 
         sptIndex mode_i = mode_ind[x];
         sptIndex tmp_i_1 = times_inds_1[x];
@@ -0,0 +1,182 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * MTTKRP swept by blocks of output rows, for factor matrices that do not fit
+ * in memory (see sptNewMatrixOutOfCore).
+ *
+ * With the nonzeros sorted by the output mode, each block of output rows is
+ * produced by one contiguous run of nonzeros. The block is finished before
+ * the next one starts: it is written back and evicted while the next block
+ * is prefetched, so the output keeps about two blocks resident, and the
+ * tensor, if mapped, is streamed once in order.
+ */
+
+/* Output block size when none is given */
+#define SPT_OOC_BLOCK_BYTES ((size_t) 64 << 20)
+
+static inline int spt_OocThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline int spt_OocNumThreads(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+/* First nonzero in [lo, hi) whose index is row or more */
+static sptNnzIndex spt_OocLowerBound(sptIndex const * const inds, sptNnzIndex lo, sptNnzIndex hi, sptIndex const row) {
+    while(lo < hi) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(inds[mid] < row) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Cut t of nt over [begin, end), moved forward to the first nonzero of a row */
+static sptNnzIndex spt_OocCut(sptIndex const * const inds, sptNnzIndex const begin, sptNnzIndex const end, int const t, int const nt) {
+    sptNnzIndex cut = begin + (end - begin) * (sptNnzIndex) t / (sptNnzIndex) nt;
+    while(cut > begin && cut < end && inds[cut] == inds[cut-1]) {
+        ++cut;
+    }
+    return cut;
+}
+
+/**
+ * OpenMP MTTKRP over blocks of output rows with bounded output residency
+ * @param X           the sparse tensor input X, sorted with `mode` first, e.g. by sptSparseTensorSortIndexCustomOrder with mats_order
+ * @param mats        (N+1) dense matrices, with mats[nmodes] as the output; any may be out-of-core
+ * @param mats_order  the order of the Khatri-Rao products
+ * @param mode        the mode on which the MTTKRP is performed
+ * @param block_rows  the output rows per block, 0 for about 64MB worth
+ * @param tk          the number of threads, 0 for the default
+ */
+int sptOmpMTTKRPOutOfCore(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptIndex block_rows,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+    sptNnzIndex const nnz = X->nnz;
+
+    if(nmodes < 2) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP OOC", "nmodes < 2");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP OOC", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP OOC", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    if(vals == NULL) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP OOC", "pattern tensors are not supported");
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const nrows = ndims[mode];
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    int const nt = sptExecThreads(tk);
+    if(block_rows == 0) {
+        size_t const rows = SPT_OOC_BLOCK_BYTES / (stride * sizeof (sptValue));
+        block_rows = rows > 0 && rows < nrows ? (sptIndex) rows : nrows;
+    }
+
+    int unsorted = 0;
+    #pragma omp parallel for num_threads(nt) reduction(|:unsorted)
+    for(sptNnzIndex x = 1; x < nnz; ++x) {
+        unsorted |= mode_ind[x] < mode_ind[x-1];
+    }
+    if(unsorted) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP OOC", "X is not sorted at the mode");
+    }
+
+    int result = sptMatrixPrefetchRows(mats[nmodes], 0, block_rows);
+    spt_CheckError(result, "CPU  SpTns MTTKRP OOC", NULL);
+    sptNnzIndex begin = 0;
+    sptIndex b0 = 0;
+    while(b0 < nrows) {
+        sptIndex const b1 = nrows - b0 > block_rows ? b0 + block_rows : nrows;
+        sptNnzIndex const end = spt_OocLowerBound(mode_ind, begin, nnz, b1);
+        result = sptMatrixPrefetchRows(mats[nmodes], b1, nrows - b1 > block_rows ? b1 + block_rows : nrows);
+        spt_CheckError(result, "CPU  SpTns MTTKRP OOC", NULL);
+
+        #pragma omp parallel num_threads(nt)
+        {
+            #pragma omp for schedule(static)
+            for(sptIndex i = b0; i < b1; ++i) {
+                memset(mvals + (sptNnzIndex) i * stride, 0, R * sizeof *mvals);
+            }
+            /* Each thread owns whole rows of the block, so it writes them without synchronization */
+            int const tid = spt_OocThreadNum();
+            int const nthreads = spt_OocNumThreads();
+            sptNnzIndex const lo = spt_OocCut(mode_ind, begin, end, tid, nthreads);
+            sptNnzIndex const hi = spt_OocCut(mode_ind, begin, end, tid + 1, nthreads);
+            for(sptNnzIndex x = lo; x < hi; ++x) {
+                sptValue * const restrict out_row = mvals + (sptNnzIndex) mode_ind[x] * stride;
+                sptValue const entry = vals[x];
+                sptValue const * const restrict row1 = mats[mats_order[1]]->values + (sptNnzIndex)X->inds[mats_order[1]].data[x] * stride;
+                if(nmodes == 2) {
+                    #pragma omp simd
+                    for(sptIndex r=0; r<R; ++r) {
+                        out_row[r] += entry * row1[r];
+                    }
+                    continue;
+                }
+                sptValue const * const restrict row2 = mats[mats_order[2]]->values + (sptNnzIndex)X->inds[mats_order[2]].data[x] * stride;
+                for(sptIndex r=0; r<R; ++r) {
+                    sptValue prod = entry * row1[r] * row2[r];
+                    for(sptIndex k=3; k<nmodes; ++k) {
+                        prod *= mats[mats_order[k]]->values[(sptNnzIndex)X->inds[mats_order[k]].data[x] * stride + r];
+                    }
+                    out_row[r] += prod;
+                }
+            }
+        }
+
+        result = sptMatrixEvictRows(mats[nmodes], b0, b1);
+        spt_CheckError(result, "CPU  SpTns MTTKRP OOC", NULL);
+        begin = end;
+        b0 = b1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,261 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * MTTKRP with ownership-based output accumulation.
+ *
+ * Nonzeros are visited in order of their output row and cut into one
+ * contiguous range per thread, so a thread owns every row that lies strictly
+ * inside its range and writes it without synchronization. Only a row that a
+ * cut goes through is shared; it is summed privately and published with one
+ * compare-and-swap based atomic update per column.
+ */
+
+static inline int spt_RowPartThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline int spt_RowPartNumThreads(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+
+/* Cut [0, nnz) into tk ranges of about nnz/tk nonzeros, moving each cut to a row boundary if one is close. */
+static void spt_RowPartCuts(
+    sptNnzIndex * bounds,
+    sptNnzIndex const * const row_ptr,     // length nrows+1
+    sptIndex const nrows,
+    sptNnzIndex const nnz,
+    int const tk)
+{
+    sptNnzIndex const slack = nnz / (16 * (sptNnzIndex)tk);
+    sptIndex row = 0;
+    bounds[0] = 0;
+    for(int t = 1; t < tk; ++t) {
+        sptNnzIndex const target = nnz * t / tk;
+        while(row < nrows && row_ptr[row+1] <= target) {
+            ++row;
+        }
+        sptNnzIndex cut = target;
+        if(row < nrows) {
+            sptNnzIndex const lo = row_ptr[row], hi = row_ptr[row+1];
+            if(target - lo <= slack) {
+                cut = lo;
+            } else if(hi - target <= slack) {
+                cut = hi;
+            }
+        }
+        bounds[t] = cut > bounds[t-1] ? cut : bounds[t-1];
+    }
+    bounds[tk] = nnz;
+}
+
+
+/**
+ * Build the row ownership partition of every mode of a sparse tensor
+ * @param part  an uninitialized partition
+ * @param X     the sparse tensor, left untouched
+ * @param rank  the number of columns of the factor matrices
+ * @param tk    the number of threads the MTTKRP will use
+ */
+int sptNewMttkrpRowPartition(
+    sptMttkrpRowPartition * part,
+    sptSparseTensor const * const X,
+    sptIndex const rank,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns RowPart", "tk < 1");
+    }
+
+    part->nmodes = nmodes;
+    part->nnz = nnz;
+    part->tk = tk;
+    part->rank = rank;
+    part->stride = ((rank-1)/8+1)*8;
+    part->perm = malloc(nmodes * sizeof *part->perm);
+    spt_CheckOSError(!part->perm, "SpTns RowPart");
+    part->bounds = malloc(nmodes * sizeof *part->bounds);
+    spt_CheckOSError(!part->bounds, "SpTns RowPart");
+
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptNnzIndex * row_ptr = malloc(((sptNnzIndex)max_dim + 1) * sizeof *row_ptr);
+    spt_CheckOSError(!row_ptr, "SpTns RowPart");
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const nrows = X->ndims[m];
+        sptIndex const * const inds = X->inds[m].data;
+
+        /* Counting sort of the nonzeros by their index in mode m */
+        sptNnzIndex const * const slice_ptr = spt_SparseTensorSlicePtr(X, m);
+        spt_CheckOSError(!slice_ptr, "SpTns RowPart");
+        memcpy(row_ptr, slice_ptr, ((sptNnzIndex)nrows + 1) * sizeof *row_ptr);
+        result = sptNewNnzIndexVector(&part->perm[m], nnz, nnz);
+        spt_CheckError(result, "SpTns RowPart", NULL);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            part->perm[m].data[row_ptr[inds[z]]++] = z;
+        }
+        for(sptIndex i = nrows; i > 0; --i) {
+            row_ptr[i] = row_ptr[i-1];
+        }
+        row_ptr[0] = 0;
+
+        result = sptNewNnzIndexVector(&part->bounds[m], tk + 1, tk + 1);
+        spt_CheckError(result, "SpTns RowPart", NULL);
+        spt_RowPartCuts(part->bounds[m].data, row_ptr, nrows, nnz, tk);
+    }
+    free(row_ptr);
+
+    result = sptNewValueVector(&part->scratch, (sptNnzIndex)tk * part->stride, (sptNnzIndex)tk * part->stride);
+    spt_CheckError(result, "SpTns RowPart", NULL);
+
+    return 0;
+}
+
+
+/**
+ * Release a partition built by sptNewMttkrpRowPartition
+ */
+void sptFreeMttkrpRowPartition(sptMttkrpRowPartition * part)
+{
+    for(sptIndex m = 0; m < part->nmodes; ++m) {
+        sptFreeNnzIndexVector(&part->perm[m]);
+        sptFreeNnzIndexVector(&part->bounds[m]);
+    }
+    free(part->perm);
+    free(part->bounds);
+    sptFreeValueVector(&part->scratch);
+    part->nmodes = 0;
+}
+
+
+/**
+ * OpenMP MTTKRP accumulating into rows owned by each thread
+ * @param X           the sparse tensor input X
+ * @param mats        (N+1) dense matrices, with mats[nmodes] as the output
+ * @param mats_order  the order of the Khatri-Rao products
+ * @param mode        the mode on which the MTTKRP is performed
+ * @param part        the row partition built for X, which also fixes the thread count
+ */
+int sptOmpMTTKRP_Owner(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpRowPartition * part)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+    int const tk = part->tk;
+
+    if(nmodes < 2 || part->nmodes != nmodes || part->nnz != X->nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "partition does not match the tensor");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols || mats[i]->ncols > part->rank) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptNnzIndex const * const perm = part->perm[mode].data;
+    sptNnzIndex const * const bounds = part->bounds[mode].data;
+    sptNnzIndex const nnz = X->nnz;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * stride * sizeof *mvals);
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int const tid = spt_RowPartThreadNum();
+        int const nthreads = spt_RowPartNumThreads();
+        sptValue * const restrict acc = part->scratch.data + tid * part->stride;
+        /* A smaller team than tk still covers every range */
+        for(int t = tid; t < tk; t += nthreads) {
+            sptNnzIndex const begin = bounds[t], end = bounds[t+1];
+            /* Rows cut by this range's boundaries are shared with the neighbours */
+            int const head_shared = begin > 0 && begin < end && mode_ind[perm[begin-1]] == mode_ind[perm[begin]];
+            int const tail_shared = end < nnz && begin < end && mode_ind[perm[end]] == mode_ind[perm[end-1]];
+
+            sptNnzIndex i = begin;
+            while(i < end) {
+                sptIndex const row = mode_ind[perm[i]];
+                for(sptIndex r=0; r<R; ++r) {
+                    acc[r] = 0;
+                }
+                for(; i < end && mode_ind[perm[i]] == row; ++i) {
+                    sptNnzIndex const x = perm[i];
+                    sptValue const entry = vals[x];
+                    sptValue const * const restrict row1 = mats[mats_order[1]]->values + (sptNnzIndex)X->inds[mats_order[1]].data[x] * stride;
+                    if(nmodes == 2) {
+                        #pragma omp simd
+                        for(sptIndex r=0; r<R; ++r) {
+                            acc[r] += entry * row1[r];
+                        }
+                        continue;
+                    }
+                    sptValue const * const restrict row2 = mats[mats_order[2]]->values + (sptNnzIndex)X->inds[mats_order[2]].data[x] * stride;
+                    for(sptIndex r=0; r<R; ++r) {
+                        sptValue prod = entry * row1[r] * row2[r];
+                        for(sptIndex k=3; k<nmodes; ++k) {
+                            prod *= mats[mats_order[k]]->values[(sptNnzIndex)X->inds[mats_order[k]].data[x] * stride + r];
+                        }
+                        acc[r] += prod;
+                    }
+                }
+
+                sptValue * const restrict out_row = mvals + (sptNnzIndex)row * stride;
+                int const shared = (head_shared && row == mode_ind[perm[begin]]) ||
+                    (tail_shared && row == mode_ind[perm[end-1]]);
+                if(shared) {
+                    for(sptIndex r=0; r<R; ++r) {
+                        #pragma omp atomic update
+                        out_row[r] += acc[r];
+                    }
+                } else {
+                    for(sptIndex r=0; r<R; ++r) {
+                        out_row[r] = acc[r];
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * MTTKRP of pattern tensors, whose nonzeros are all 1 and have no value
+ * array (see sptSparseTensorDropValues): each nonzero adds the Hadamard
+ * product of its factor rows to its output row, with no value load or scaling.
+ */
+
+/* Add the n values of x to y, atomically if other threads update y too */
+static inline void spt_PatternRowAdd(sptValue * restrict y, sptValue const * restrict x, sptIndex const n, int const shared) {
+    if(shared) {
+        for(sptIndex r = 0; r < n; ++r) {
+            #pragma omp atomic update
+            y[r] += x[r];
+        }
+    } else {
+        for(sptIndex r = 0; r < n; ++r) {
+            y[r] += x[r];
+        }
+    }
+}
+
+/**
+ * MTTKRP of a pattern tensor with tk threads, atomic output updates when
+ * tk > 1. The arguments are those of sptOmpMTTKRP.
+ */
+int spt_OmpMTTKRP_Pattern(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[0]->stride;
+
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != X->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const restrict mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, mats[mode]->nrows * stride * sizeof (sptValue));
+    int const shared = tk > 1;
+
+    if(nmodes == 3) {
+        sptValue const * const restrict values_1 = mats[mats_order[1]]->values;
+        sptIndex const * const restrict times_inds_1 = X->inds[mats_order[1]].data;
+        sptValue const * const restrict values_2 = mats[mats_order[2]]->values;
+        sptIndex const * const restrict times_inds_2 = X->inds[mats_order[2]].data;
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex x=0; x<nnz; ++x) {
+            sptValue * const restrict mvals_row = mvals + mode_ind[x] * stride;
+            sptValue const * const restrict row_1 = values_1 + times_inds_1[x] * stride;
+            sptValue const * const restrict row_2 = values_2 + times_inds_2[x] * stride;
+            if(shared) {
+                for(sptIndex r=0; r<R; ++r) {
+                    #pragma omp atomic update
+                    mvals_row[r] += row_1[r] * row_2[r];
+                }
+            } else {
+                for(sptIndex r=0; r<R; ++r) {
+                    mvals_row[r] += row_1[r] * row_2[r];
+                }
+            }
+        }
+        return 0;
+    }
+
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptValue * scratch = malloc((size_t) tk * stride * sizeof *scratch);
+    spt_CheckOSError(!scratch, "CPU  SpTns MTTKRP");
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptValue * const restrict row = scratch + (size_t) tid * stride;
+        #pragma omp for schedule(static)
+        for(sptNnzIndex x=0; x<nnz; ++x) {
+            sptIndex const m1 = mats_order[1];
+            memcpy(row, mats[m1]->values + X->inds[m1].data[x] * stride, R * sizeof *row);
+            for(sptIndex i=2; i<nmodes; ++i) {
+                sptIndex const mi = mats_order[i];
+                simd->mul(row, mats[mi]->values + X->inds[mi].data[x] * stride, R);
+            }
+            spt_PatternRowAdd(mvals + mode_ind[x] * stride, row, R, shared);
+        }
+    }
+    free(scratch);
+    return 0;
+}
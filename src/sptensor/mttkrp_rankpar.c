@@ -0,0 +1,160 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * MTTKRP partitioned over the rank.
+ *
+ * With a short output mode every thread of sptOmpMTTKRP adds into the same
+ * few rows, and the atomics serialize. Splitting the columns instead gives
+ * each thread a slice of every output row that only it writes, at the cost
+ * of every thread reading all the nonzeros. Slices are whole cache lines, so
+ * there are at most R/8 of them; the threads left over split the nonzeros
+ * into groups, each adding into a private copy of the short output that is
+ * summed at the end.
+ */
+
+/* Columns of a rank slice are a multiple of this, one 64-byte line of values */
+#define SPT_RANK_SLICE 8
+
+/**
+ * OpenMP MTTKRP splitting the rank columns, then the nonzeros, between the
+ * threads, without atomics. Meant for output modes of a few thousand rows at
+ * most with a large rank, as every group of nonzeros keeps its own copy of
+ * the output.
+ * @param[out] mats[nmodes]    the result of MTTKRP, a dense matrix, with size ndims[mode] * R
+ * @param[in]  X    the sparse tensor input X
+ * @param[in]  mats    (N+1) dense matrices, with mats[nmodes] as temporary
+ * @param[in]  mats_order    the order of the Khatri-Rao products
+ * @param[in]  mode   the mode on which the MTTKRP is performed
+ * @param[in]  tk    the number of threads
+ */
+int sptOmpMTTKRP_RankParallel(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    if(tk < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP", "tk < 1");
+    }
+
+    sptIndex const nrows = ndims[mode];
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(sptValue));
+    if(R == 0) {
+        return 0;
+    }
+
+    /* ncols slices of width columns each, times ngroups groups of nonzeros */
+    sptIndex const max_slices = (R + SPT_RANK_SLICE - 1) / SPT_RANK_SLICE;
+    sptIndex ncols = (sptIndex) tk < max_slices ? (sptIndex) tk : max_slices;
+    sptIndex const width = ((R + ncols - 1) / ncols + SPT_RANK_SLICE - 1) / SPT_RANK_SLICE * SPT_RANK_SLICE;
+    ncols = (R + width - 1) / width;
+    sptIndex ngroups = (sptIndex) tk / ncols;
+    if(ngroups < 1) {
+        ngroups = 1;
+    }
+    if(ngroups > nnz) {
+        ngroups = nnz > 0 ? (sptIndex) nnz : 1;
+    }
+
+    /* Group 0 adds into the output itself */
+    sptNnzIndex const copy_len = (sptNnzIndex)nrows * stride;
+    sptValue * copies = NULL;
+    if(ngroups > 1) {
+        copies = calloc((size_t)(ngroups - 1) * copy_len, sizeof *copies);
+        spt_CheckOSError(copies == NULL, "CPU  SpTns MTTKRP");
+    }
+
+    int failed = 0;
+    #pragma omp parallel num_threads(tk)
+    {
+        sptValue * acc = malloc(width * sizeof *acc);
+        if(acc == NULL) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+
+        #pragma omp for schedule(static, 1)
+        for(sptIndex w = 0; w < ncols * ngroups; ++w) {
+            if(acc == NULL) {
+                continue;
+            }
+            sptIndex const c = w % ncols;
+            sptIndex const g = w / ncols;
+            sptIndex const c_begin = c * width;
+            sptIndex const c_len = c_begin + width < R ? width : R - c_begin;
+            sptNnzIndex const x_begin = nnz * g / ngroups;
+            sptNnzIndex const x_end = nnz * (g + 1) / ngroups;
+            sptValue * const restrict out = g == 0 ? mvals : copies + (g - 1) * copy_len;
+
+            for(sptNnzIndex x = x_begin; x < x_end; ++x) {
+                sptIndex times_mat_index = mats_order[1];
+                simd->scale(acc, vals[x], mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride + c_begin, c_len);
+                for(sptIndex i=2; i<nmodes; ++i) {
+                    times_mat_index = mats_order[i];
+                    simd->mul(acc, mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride + c_begin, c_len);
+                }
+                simd->axpy(out + (sptNnzIndex)mode_ind[x] * stride + c_begin, 1, acc, c_len);
+            }
+        }
+
+        /* Sum the copies of the other groups into the output */
+        if(ngroups > 1) {
+            #pragma omp for schedule(static)
+            for(sptIndex i = 0; i < nrows; ++i) {
+                sptValue * const restrict mvals_row = mvals + (sptNnzIndex)i * stride;
+                for(sptIndex g = 1; g < ngroups; ++g) {
+                    simd->axpy(mvals_row, 1, copies + (g - 1) * copy_len + (sptNnzIndex)i * stride, R);
+                }
+            }
+        }
+
+        free(acc);
+    }
+    free(copies);
+    if(failed) {
+        spt_CheckError(SPTERR_UNKNOWN, "CPU  SpTns MTTKRP", "out of memory for the rank slices");
+    }
+
+    return 0;
+}
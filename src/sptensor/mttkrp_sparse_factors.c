@@ -0,0 +1,164 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * MTTKRP with sparse factor matrices.
+ *
+ * When the factors of a CP model are mostly zeros, each row of the
+ * Khatri-Rao product has non-zeros only in the columns where every factor
+ * row does. The kernel takes the factors in CSR, starts from the shortest of
+ * the rows a nonzero reads, and intersects it with the others, so a nonzero
+ * costs the length of its sparse rows rather than the rank, and one that
+ * meets an empty row costs nothing more.
+ */
+
+/**
+ * OpenMP MTTKRP against CSR factor matrices, M = X_(mode) (KRP of the other factors).
+ * Nonzeros touching an all-zero row of any other factor are skipped, and only
+ * the columns non-zero in all of their rows are computed; results are added
+ * into M with atomics like sptOmpMTTKRP.
+ * @param[in]  X        the sparse tensor input X
+ * @param[in]  factors  nmodes CSR factor matrices with columns sorted within rows, as
+ *                      sptSparseMatrixCSRFromMatrix makes them; factors[mode] is not read
+ * @param[in]  mode     the mode on which the MTTKRP is performed
+ * @param[out] M        dense ndims[mode] x R result, overwritten
+ * @param[in]  tk       the number of threads
+ */
+int sptOmpMTTKRPSparseFactors(sptSparseTensor const * const X,
+    sptSparseMatrixCSR * const factors[],
+    sptIndex const mode,
+    sptMatrix * const M,
+    const int tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const R = M->ncols;
+    sptIndex const stride = M->stride;
+
+    /* Check the factors. */
+    if(M->nrows != X->ndims[mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP SpFactors", "M->nrows != ndims[mode]");
+    }
+    for(sptIndex m=0; m<nmodes; ++m) {
+        if(m == mode) {
+            continue;
+        }
+        if(factors[m]->ncols != R) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP SpFactors", "factors[m]->ncols != M->ncols");
+        }
+        if(factors[m]->nrows != X->ndims[m]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP SpFactors", "factors[m]->nrows != ndims[m]");
+        }
+    }
+
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue const * const vals = X->values.data;
+    sptValue * const restrict mvals = M->values;
+    memset(mvals, 0, (sptNnzIndex) M->nrows * stride * sizeof(sptValue));
+
+    int failed = 0;
+    #pragma omp parallel num_threads(tk)
+    {
+        /* The surviving columns of the product row and their values */
+        sptIndex * cols = malloc((R > 0 ? R : 1) * sizeof *cols);
+        sptValue * prod = malloc((R > 0 ? R : 1) * sizeof *prod);
+        if(!cols || !prod) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+
+        #pragma omp for schedule(static)
+        for(sptNnzIndex x = 0; x < nnz; ++x) {
+            if(failed) {
+                continue;
+            }
+            /* The shortest row, and none of the rows empty */
+            sptIndex pivot = nmodes;
+            sptNnzIndex shortest = (sptNnzIndex) R + 1;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                if(m == mode) {
+                    continue;
+                }
+                sptNnzIndex const * const rowptr = factors[m]->rowptr.data;
+                sptIndex const i = X->inds[m].data[x];
+                sptNnzIndex const len = rowptr[i+1] - rowptr[i];
+                if(len < shortest) {
+                    shortest = len;
+                    pivot = m;
+                }
+            }
+            if(shortest == 0) {
+                continue;
+            }
+
+            sptNnzIndex n = 0;
+            if(pivot < nmodes) {
+                sptSparseMatrixCSR const * const F = factors[pivot];
+                sptNnzIndex const begin = F->rowptr.data[X->inds[pivot].data[x]];
+                for(sptNnzIndex j = 0; j < shortest; ++j) {
+                    cols[j] = F->colind.data[begin + j];
+                    prod[j] = F->values.data[begin + j];
+                }
+                n = shortest;
+            }
+            /* Intersect with each other row in place, both lists sorted by column */
+            for(sptIndex m = 0; m < nmodes && n > 0; ++m) {
+                if(m == mode || m == pivot) {
+                    continue;
+                }
+                sptSparseMatrixCSR const * const F = factors[m];
+                sptIndex const i = X->inds[m].data[x];
+                sptNnzIndex j = F->rowptr.data[i];
+                sptNnzIndex const end = F->rowptr.data[i+1];
+                sptNnzIndex kept = 0;
+                for(sptNnzIndex k = 0; k < n && j < end; ) {
+                    sptIndex const c = F->colind.data[j];
+                    if(c < cols[k]) {
+                        ++j;
+                    } else if(cols[k] < c) {
+                        ++k;
+                    } else {
+                        cols[kept] = c;
+                        prod[kept] = prod[k] * F->values.data[j];
+                        ++kept;
+                        ++k;
+                        ++j;
+                    }
+                }
+                n = kept;
+            }
+
+            sptValue const v = vals[x];
+            sptValue * const restrict mrow = mvals + (sptNnzIndex) mode_ind[x] * stride;
+            for(sptNnzIndex k = 0; k < n; ++k) {
+                #pragma omp atomic update
+                mrow[cols[k]] += v * prod[k];
+            }
+        }
+        free(cols);
+        free(prod);
+    }
+    spt_CheckOSError(failed, "CPU  SpTns MTTKRP SpFactors");
+
+    return 0;
+}
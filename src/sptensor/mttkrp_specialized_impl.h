@@ -0,0 +1,119 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Rank-specialized COO OpenMP MTTKRP kernels. Included once per rank by
+ * mttkrp_specialized.c with SPT_RANK defined; every loop over the rank has a
+ * compile-time trip count, so the compiler fully unrolls it and keeps the
+ * products of a nonzero in vector registers of the target ISA. */
+
+static int SPT_RANKED(spt_OmpMTTKRP_3D_R)(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[0]->stride;
+    sptValue const * const restrict vals = X->values.data;
+    sptIndex const * const restrict mode_ind = X->inds[mode].data;
+    sptIndex const * const restrict inds_1 = X->inds[mats_order[1]].data;
+    sptIndex const * const restrict inds_2 = X->inds[mats_order[2]].data;
+    sptValue const * const restrict mat_1 = mats[mats_order[1]]->values;
+    sptValue const * const restrict mat_2 = mats[mats_order[2]]->values;
+    sptValue * const restrict mvals = mats[3]->values;
+
+    int result = spt_CheckSpecializedMats(X, mats, 3);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(sptValue));
+
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex x=0; x<nnz; ++x) {
+        if(pd != 0 && x + pd < nnz) {
+            spt_PrefetchRow(mat_1 + (sptNnzIndex)inds_1[x + pd] * stride, SPT_RANK);
+            spt_PrefetchRow(mat_2 + (sptNnzIndex)inds_2[x + pd] * stride, SPT_RANK);
+        }
+        sptValue const * const restrict row_1 = mat_1 + (sptNnzIndex)inds_1[x] * stride;
+        sptValue const * const restrict row_2 = mat_2 + (sptNnzIndex)inds_2[x] * stride;
+        sptValue * const restrict mvals_row = mvals + (sptNnzIndex)mode_ind[x] * stride;
+        sptValue const entry = vals[x];
+        sptValue acc[SPT_RANK];
+        #pragma omp simd
+        for(sptIndex r=0; r<SPT_RANK; ++r) {
+            acc[r] = entry * row_1[r] * row_2[r];
+        }
+        for(sptIndex r=0; r<SPT_RANK; ++r) {
+            #pragma omp atomic update
+            mvals_row[r] += acc[r];
+        }
+    }
+
+    return 0;
+}
+
+
+static int SPT_RANKED(spt_OmpMTTKRP_4D_R)(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk)
+{
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex const stride = mats[0]->stride;
+    sptValue const * const restrict vals = X->values.data;
+    sptIndex const * const restrict mode_ind = X->inds[mode].data;
+    sptIndex const * const restrict inds_1 = X->inds[mats_order[1]].data;
+    sptIndex const * const restrict inds_2 = X->inds[mats_order[2]].data;
+    sptIndex const * const restrict inds_3 = X->inds[mats_order[3]].data;
+    sptValue const * const restrict mat_1 = mats[mats_order[1]]->values;
+    sptValue const * const restrict mat_2 = mats[mats_order[2]]->values;
+    sptValue const * const restrict mat_3 = mats[mats_order[3]]->values;
+    sptValue * const restrict mvals = mats[4]->values;
+
+    int result = spt_CheckSpecializedMats(X, mats, 4);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+    memset(mvals, 0, (sptNnzIndex)mats[mode]->nrows * stride * sizeof(sptValue));
+
+    sptIndex const pd = spt_MTTKRPPrefetchDistance();
+
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex x=0; x<nnz; ++x) {
+        if(pd != 0 && x + pd < nnz) {
+            spt_PrefetchRow(mat_1 + (sptNnzIndex)inds_1[x + pd] * stride, SPT_RANK);
+            spt_PrefetchRow(mat_2 + (sptNnzIndex)inds_2[x + pd] * stride, SPT_RANK);
+            spt_PrefetchRow(mat_3 + (sptNnzIndex)inds_3[x + pd] * stride, SPT_RANK);
+        }
+        sptValue const * const restrict row_1 = mat_1 + (sptNnzIndex)inds_1[x] * stride;
+        sptValue const * const restrict row_2 = mat_2 + (sptNnzIndex)inds_2[x] * stride;
+        sptValue const * const restrict row_3 = mat_3 + (sptNnzIndex)inds_3[x] * stride;
+        sptValue * const restrict mvals_row = mvals + (sptNnzIndex)mode_ind[x] * stride;
+        sptValue const entry = vals[x];
+        sptValue acc[SPT_RANK];
+        #pragma omp simd
+        for(sptIndex r=0; r<SPT_RANK; ++r) {
+            acc[r] = entry * row_1[r] * row_2[r] * row_3[r];
+        }
+        for(sptIndex r=0; r<SPT_RANK; ++r) {
+            #pragma omp atomic update
+            mvals_row[r] += acc[r];
+        }
+    }
+
+    return 0;
+}
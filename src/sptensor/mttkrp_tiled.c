@@ -0,0 +1,233 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/*
+ * Cache-blocked COO MTTKRP.
+ *
+ * The COO loops gather rows from anywhere in the factors. Sorting the
+ * nonzeros into coarse tiles, 2^tile_bits indices on every mode, bounds the
+ * rows one tile touches to a window of each factor, which stays in L2 while
+ * the tile is processed. This is the locality of the HiCOO _MatrixTiling
+ * kernels without building a HiCOO tensor: the tensor stays COO, reordered
+ * by one row-block sort.
+ *
+ * Tiles are grouped by their tile of the output mode, and a group is run by
+ * one thread, so its output rows need no atomics or private copies.
+ */
+
+static inline int spt_TiledThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+
+/* The widest tiles whose factor windows, one per mode, fit PARTI_MTTKRP_TILE_BYTES */
+static sptElementIndex spt_PickTileBits(sptSparseTensor const * const X, sptIndex const rank)
+{
+    size_t const row_bytes = (size_t) X->nmodes * ((rank + 7) / 8 * 8) * sizeof (sptValue);
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, X->nmodes);
+    sptElementIndex bits = 1;
+    while(bits < 31 && ((size_t) 2 << bits) * row_bytes <= PARTI_MTTKRP_TILE_BYTES && ((sptIndex) 1 << bits) < max_dim) {
+        ++bits;
+    }
+    return bits;
+}
+
+
+/**
+ * Sort a COO tensor into coarse tiles for sptOmpMTTKRP_Tiled. The tiling
+ * stays valid while X is neither reordered nor modified.
+ *
+ * @param[out] tl        an uninitialized tiling
+ * @param[in]  X         the tensor, sorted in place into row-major tile order
+ * @param[in]  rank      the rank the MTTKRP will run with, to size the tiles
+ * @param[in]  tile_bits log2 of the tile edge, 0 to fit the rows a tile touches
+ *                       into PARTI_MTTKRP_TILE_BYTES
+ * @param[in]  tk        the threads of the sort
+ */
+int sptNewMttkrpTiling(
+    sptMttkrpTiling * tl,
+    sptSparseTensor * X,
+    sptIndex const rank,
+    sptElementIndex const tile_bits,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(rank < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP Tiling", "rank < 1");
+    }
+    if(tile_bits > 31) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns MTTKRP Tiling", "tile_bits > 31");
+    }
+    sptElementIndex const bits = tile_bits != 0 ? tile_bits : spt_PickTileBits(X, rank);
+
+    if(nnz > 0) {
+        sptSparseTensorSortIndexRowBlock(X, 1, 0, nnz, bits, tk);
+    }
+
+    tl->nmodes = nmodes;
+    tl->nnz = nnz;
+    tl->tile_bits = bits;
+    int result = sptNewNnzIndexVector(&tl->tptr, 0, 0);
+    spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+    tl->gptr = malloc(nmodes * sizeof *tl->gptr);
+    tl->gtiles = malloc(nmodes * sizeof *tl->gtiles);
+    spt_CheckOSError(!tl->gptr || !tl->gtiles, "CPU  SpTns MTTKRP Tiling");
+
+    /* A tile ends where any mode moves to another tile */
+    result = sptAppendNnzIndexVector(&tl->tptr, 0);
+    spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+    for(sptNnzIndex z = 1; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(X->inds[m].data[z] >> bits != X->inds[m].data[z-1] >> bits) {
+                result = sptAppendNnzIndexVector(&tl->tptr, z);
+                spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+                break;
+            }
+        }
+    }
+    if(nnz > 0) {
+        result = sptAppendNnzIndexVector(&tl->tptr, nnz);
+        spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+    }
+    sptNnzIndex const ntiles = tl->tptr.len - 1;
+
+    /* Counting sort of the tiles by their tile of each mode */
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptNnzIndex const ngroups = ((sptNnzIndex) X->ndims[m] + ((sptNnzIndex) 1 << bits) - 1) >> bits;
+        result = sptNewNnzIndexVector(&tl->gptr[m], ngroups + 1, ngroups + 1);
+        spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+        result = sptNewNnzIndexVector(&tl->gtiles[m], ntiles, ntiles);
+        spt_CheckError(result, "CPU  SpTns MTTKRP Tiling", NULL);
+        sptNnzIndex * const gptr = tl->gptr[m].data;
+        memset(gptr, 0, (ngroups + 1) * sizeof *gptr);
+        for(sptNnzIndex t = 0; t < ntiles; ++t) {
+            ++gptr[(X->inds[m].data[tl->tptr.data[t]] >> bits) + 1];
+        }
+        for(sptNnzIndex g = 0; g < ngroups; ++g) {
+            gptr[g+1] += gptr[g];
+        }
+        for(sptNnzIndex t = 0; t < ntiles; ++t) {
+            sptNnzIndex const g = X->inds[m].data[tl->tptr.data[t]] >> bits;
+            tl->gtiles[m].data[gptr[g]++] = t;
+        }
+        for(sptNnzIndex g = ngroups; g > 0; --g) {
+            gptr[g] = gptr[g-1];
+        }
+        gptr[0] = 0;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Release a tiling created by sptNewMttkrpTiling
+ */
+void sptFreeMttkrpTiling(sptMttkrpTiling * tl)
+{
+    for(sptIndex m = 0; m < tl->nmodes; ++m) {
+        sptFreeNnzIndexVector(&tl->gptr[m]);
+        sptFreeNnzIndexVector(&tl->gtiles[m]);
+    }
+    free(tl->gptr);
+    free(tl->gtiles);
+    sptFreeNnzIndexVector(&tl->tptr);
+    tl->gptr = NULL;
+    tl->gtiles = NULL;
+    tl->nmodes = 0;
+    tl->nnz = 0;
+}
+
+
+/**
+ * OpenMP MTTKRP over a tensor sorted by sptNewMttkrpTiling, a tile at a time
+ * so the factor rows it touches stay in cache. Each thread takes whole groups
+ * of tiles that share their tile of `mode`, so no two threads write the same
+ * output row.
+ */
+int sptOmpMTTKRP_Tiled(sptSparseTensor const * const X,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    sptMttkrpTiling const * tl,
+    const int tk)
+{
+    spt_SimdKernels const * const simd = spt_Simd();
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const ndims = X->ndims;
+    sptValue const * const vals = X->values.data;
+    sptIndex const stride = mats[0]->stride;
+
+    if(nmodes < 2 || tl->nmodes != nmodes || tl->nnz != X->nnz) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "tiling does not match the tensor");
+    }
+    /* Check the mats. */
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+
+    sptIndex const R = mats[mode]->ncols;
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue * const mvals = mats[nmodes]->values;
+    memset(mvals, 0, (size_t)ndims[mode] * stride * sizeof *mvals);
+    sptNnzIndex const ngroups = tl->gptr[mode].len - 1;
+    sptNnzIndex const * const gptr = tl->gptr[mode].data;
+    sptNnzIndex const * const gtiles = tl->gtiles[mode].data;
+    sptNnzIndex const * const tptr = tl->tptr.data;
+
+    sptValueVector scratch;
+    int result = sptNewValueVector(&scratch, (sptNnzIndex)tk * stride, (sptNnzIndex)tk * stride);
+    spt_CheckError(result, "CPU  SpTns MTTKRP", NULL);
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(tk)
+    for(sptNnzIndex g=0; g<ngroups; ++g) {
+        sptValue * const restrict scratch_row = scratch.data + spt_TiledThreadNum() * stride;
+        for(sptNnzIndex k=gptr[g]; k<gptr[g+1]; ++k) {
+            sptNnzIndex const t = gtiles[k];
+            for(sptNnzIndex x=tptr[t]; x<tptr[t+1]; ++x) {
+                sptIndex times_mat_index = mats_order[1];
+                sptValue const entry = vals != NULL ? vals[x] : 1;
+                simd->scale(scratch_row, entry, mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride, R);
+                for(sptIndex i=2; i<nmodes; ++i) {
+                    times_mat_index = mats_order[i];
+                    simd->mul(scratch_row, mats[times_mat_index]->values + (sptNnzIndex)X->inds[times_mat_index].data[x] * stride, R);
+                }
+                simd->axpy(mvals + (sptNnzIndex)mode_ind[x] * stride, 1, scratch_row, R);
+            }
+        }
+    }
+
+    sptFreeValueVector(&scratch);
+    return 0;
+}
@@ -23,6 +23,9 @@
 double spt_SparseTensorNorm(const sptSparseTensor *X) {
     double sqnorm = 0;
     sptNnzIndex i;
+    if(sptSparseTensorIsPattern(X)) {
+        return sqrt((double) X->nnz);
+    }
     for(i = 0; i < X->nnz; ++i) {
         double cell_value = X->values.data[i];
         sqnorm += cell_value * cell_value;
@@ -0,0 +1,504 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Block-compressed COO.
+ *
+ * Sorted COO indices barely change from one nonzero to the next: the leading
+ * mode repeats, and the others move by small steps. Each block of
+ * PARTI_PACKED_BLOCK nonzeros keeps its first index per mode and the
+ * zigzag-encoded deltas after it, bit-packed into 64-bit words at the width of
+ * the largest delta of the block and mode. Decoding a block extracts every
+ * delta independently, which vectorizes, and then takes one prefix sum.
+ */
+
+#define SPT_INDEX_BITS (8 * (int) sizeof (sptIndex))
+
+/* Zigzag encoding of cur - prev, modulo the index width */
+static inline uint64_t spt_ZigZag(sptIndex const cur, sptIndex const prev) {
+    uint64_t const mask = SPT_INDEX_BITS == 64 ? ~0ULL : (1ULL << SPT_INDEX_BITS) - 1;
+    uint64_t const d = (uint64_t) (sptIndex) (cur - prev);
+    uint64_t const negative = (d >> (SPT_INDEX_BITS - 1)) & 1;
+    return ((d << 1) & mask) ^ (negative ? mask : 0);
+}
+
+static inline sptIndex spt_UnZigZag(uint64_t const z) {
+    return (sptIndex) ((z >> 1) ^ (0 - (z & 1)));
+}
+
+static inline uint8_t spt_BitWidth(uint64_t const v) {
+    return v == 0 ? 0 : (uint8_t) (64 - __builtin_clzll(v));
+}
+
+/* 64-bit words holding n values of width bits */
+static inline uint64_t spt_PackedWords(sptNnzIndex const n, uint8_t const width) {
+    return (n * width + 63) / 64;
+}
+
+/* Nonzeros in block b of a tensor with nnz nonzeros */
+static inline sptNnzIndex spt_PackedBlockLength(sptNnzIndex const nnz, sptNnzIndex const b) {
+    sptNnzIndex const begin = b * PARTI_PACKED_BLOCK;
+    return nnz - begin < PARTI_PACKED_BLOCK ? nnz - begin : PARTI_PACKED_BLOCK;
+}
+
+/* Decode the n values of width bits at words into out, before the prefix sum */
+static inline void spt_UnpackBits(uint64_t * restrict out, uint64_t const * restrict words, sptNnzIndex const n, uint8_t const width) {
+    if(width == 0) {
+        memset(out, 0, n * sizeof *out);
+        return;
+    }
+    uint64_t const mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        uint64_t const bit = i * width;
+        uint64_t const lo = words[bit / 64] >> (bit % 64);
+        /* The high part, when the value crosses into the next word */
+        uint64_t const hi = bit % 64 + width > 64 ? words[bit / 64 + 1] << (64 - bit % 64) : 0;
+        out[i] = (lo | hi) & mask;
+    }
+}
+
+/**
+ * Decode the indices of block b into inds[m * PARTI_PACKED_BLOCK + i]
+ * @param words the words of block b, from offsets[b]
+ */
+void spt_UnpackBlock(
+    sptIndex * restrict inds,
+    sptPackedSparseTensor const * const P,
+    sptNnzIndex const b,
+    uint64_t const * words)
+{
+    sptIndex const nmodes = P->nmodes;
+    sptNnzIndex const n = spt_PackedBlockLength(P->nnz, b);
+    uint64_t deltas[PARTI_PACKED_BLOCK];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        uint8_t const width = P->widths[b * nmodes + m];
+        sptIndex * restrict out = inds + m * PARTI_PACKED_BLOCK;
+        spt_UnpackBits(deltas, words, n - 1, width);
+        sptIndex cur = P->firsts[b * nmodes + m];
+        out[0] = cur;
+        for(sptNnzIndex i = 1; i < n; ++i) {
+            cur += spt_UnZigZag(deltas[i - 1]);
+            out[i] = cur;
+        }
+        words += spt_PackedWords(n - 1, width);
+    }
+}
+
+
+/**
+ * Pack the indices of a sparse tensor into blocks, in its current order;
+ * sort it first, e.g. with sptSparseTensorSortIndex, for small deltas.
+ * @param P  an uninitialized packed tensor
+ * @param X  the sparse tensor, left untouched
+ * @param tk the number of threads
+ */
+int sptNewPackedSparseTensor(sptPackedSparseTensor *P, const sptSparseTensor *X, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptNnzIndex const nblocks = (nnz + PARTI_PACKED_BLOCK - 1) / PARTI_PACKED_BLOCK;
+    int result;
+
+    if(sptSparseTensorIsPattern(X)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Pack", "pattern tensors are not supported");
+    }
+    P->nmodes = nmodes;
+    P->nnz = nnz;
+    P->nblocks = nblocks;
+    P->sortorder = malloc(nmodes * sizeof *P->sortorder);
+    spt_CheckOSError(!P->sortorder, "SpTns Pack");
+    memcpy(P->sortorder, X->sortorder, nmodes * sizeof *P->sortorder);
+    P->ndims = malloc(nmodes * sizeof *P->ndims);
+    spt_CheckOSError(!P->ndims, "SpTns Pack");
+    memcpy(P->ndims, X->ndims, nmodes * sizeof *P->ndims);
+    P->fingerprint = sptSparseTensorFingerprint(X);
+    P->firsts = malloc((nblocks * nmodes + 1) * sizeof *P->firsts);
+    spt_CheckOSError(!P->firsts, "SpTns Pack");
+    P->widths = malloc(nblocks * nmodes + 1);
+    spt_CheckOSError(!P->widths, "SpTns Pack");
+    P->offsets = malloc((nblocks + 1) * sizeof *P->offsets);
+    spt_CheckOSError(!P->offsets, "SpTns Pack");
+
+    /* Widths first, then the word offsets as a prefix sum */
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex b = 0; b < nblocks; ++b) {
+        sptNnzIndex const begin = b * PARTI_PACKED_BLOCK;
+        sptNnzIndex const n = spt_PackedBlockLength(nnz, b);
+        uint64_t words = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const * const inds = X->inds[m].data + begin;
+            uint64_t maxz = 0;
+            for(sptNnzIndex i = 1; i < n; ++i) {
+                uint64_t const z = spt_ZigZag(inds[i], inds[i - 1]);
+                maxz = z > maxz ? z : maxz;
+            }
+            P->firsts[b * nmodes + m] = inds[0];
+            P->widths[b * nmodes + m] = spt_BitWidth(maxz);
+            words += spt_PackedWords(n - 1, P->widths[b * nmodes + m]);
+        }
+        P->offsets[b + 1] = words;
+    }
+    P->offsets[0] = 0;
+    for(sptNnzIndex b = 0; b < nblocks; ++b) {
+        P->offsets[b + 1] += P->offsets[b];
+    }
+
+    P->words = calloc(P->offsets[nblocks] + 1, sizeof *P->words);
+    spt_CheckOSError(!P->words, "SpTns Pack");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex b = 0; b < nblocks; ++b) {
+        sptNnzIndex const begin = b * PARTI_PACKED_BLOCK;
+        sptNnzIndex const n = spt_PackedBlockLength(nnz, b);
+        uint64_t * words = P->words + P->offsets[b];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const * const inds = X->inds[m].data + begin;
+            uint8_t const width = P->widths[b * nmodes + m];
+            for(sptNnzIndex i = 1; width != 0 && i < n; ++i) {
+                uint64_t const z = spt_ZigZag(inds[i], inds[i - 1]);
+                uint64_t const bit = (i - 1) * width;
+                words[bit / 64] |= z << (bit % 64);
+                if(bit % 64 + width > 64) {
+                    words[bit / 64 + 1] |= z >> (64 - bit % 64);
+                }
+            }
+            words += spt_PackedWords(n - 1, width);
+        }
+    }
+
+    result = sptCopyValueVector(&P->values, &X->values, tk);
+    spt_CheckError(result, "SpTns Pack", NULL);
+    return 0;
+}
+
+/**
+ * Release a packed sparse tensor
+ */
+void sptFreePackedSparseTensor(sptPackedSparseTensor *P) {
+    free(P->sortorder);
+    free(P->ndims);
+    free(P->firsts);
+    free(P->widths);
+    free(P->offsets);
+    free(P->words);
+    sptFreeValueVector(&P->values);
+    P->nmodes = 0;
+    P->nnz = 0;
+    P->nblocks = 0;
+}
+
+/**
+ * Decode a packed sparse tensor back into COO
+ * @param X  an uninitialized sparse tensor
+ * @param P  the packed sparse tensor
+ * @param tk the number of threads
+ */
+int sptUnpackSparseTensor(sptSparseTensor *X, const sptPackedSparseTensor *P, int const tk) {
+    sptIndex const nmodes = P->nmodes;
+    int result = spt_SparseTensorNewSized(X, nmodes, P->ndims, P->nnz);
+    spt_CheckError(result, "SpTns Unpack", NULL);
+    memcpy(X->sortorder, P->sortorder, nmodes * sizeof *X->sortorder);
+    sptIndex * buf = malloc((size_t) tk * nmodes * PARTI_PACKED_BLOCK * sizeof *buf + 1);
+    spt_CheckOSError(!buf, "SpTns Unpack");
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptIndex * const inds = buf + (size_t) tid * nmodes * PARTI_PACKED_BLOCK;
+        #pragma omp for schedule(static)
+        for(sptNnzIndex b = 0; b < P->nblocks; ++b) {
+            sptNnzIndex const n = spt_PackedBlockLength(P->nnz, b);
+            spt_UnpackBlock(inds, P, b, P->words + P->offsets[b]);
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                memcpy(X->inds[m].data + b * PARTI_PACKED_BLOCK, inds + m * PARTI_PACKED_BLOCK, n * sizeof *inds);
+            }
+        }
+    }
+    free(buf);
+    memcpy(X->values.data, P->values.data, P->nnz * sizeof *X->values.data);
+    spt_SparseTensorSetFingerprint(X, P->fingerprint);
+    return 0;
+}
+
+
+/**
+ * mats[nmodes] += MTTKRP of the blocks [b_begin, b_end) of P, whose words
+ * start at word word_base of P and values at value values[0], without
+ * clearing the output first.
+ */
+int spt_PackedMTTKRPAccumulate(
+    sptPackedSparseTensor const * const P,
+    sptNnzIndex const b_begin,
+    sptNnzIndex const b_end,
+    uint64_t const * const words,
+    uint64_t const word_base,
+    sptValue const * const values,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    int const tk)
+{
+    sptIndex const nmodes = P->nmodes;
+    sptIndex const stride = mats[0]->stride;
+    sptIndex const R = mats[mode]->ncols;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    size_t const per_thread = (size_t) nmodes * PARTI_PACKED_BLOCK * sizeof (sptIndex) + (size_t) stride * sizeof (sptValue);
+    char * buf = malloc((size_t) tk * per_thread + 1);
+    spt_CheckOSError(!buf, "CPU  SpTns MTTKRP");
+
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        sptValue * const restrict row = (sptValue *) (buf + (size_t) tid * per_thread);
+        sptIndex * const inds = (sptIndex *) (row + stride);
+        #pragma omp for schedule(static)
+        for(sptNnzIndex b = b_begin; b < b_end; ++b) {
+            sptNnzIndex const n = spt_PackedBlockLength(P->nnz, b);
+            spt_UnpackBlock(inds, P, b, words + (P->offsets[b] - word_base));
+            sptValue const * const vals = values + (b - b_begin) * PARTI_PACKED_BLOCK;
+            sptIndex const * const mode_ind = inds + mode * PARTI_PACKED_BLOCK;
+            for(sptNnzIndex i = 0; i < n; ++i) {
+                sptIndex mi = mats_order[1];
+                sptValue const * times_row = mats[mi]->values + (size_t) inds[mi * PARTI_PACKED_BLOCK + i] * stride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    row[r] = vals[i] * times_row[r];
+                }
+                for(sptIndex k = 2; k < nmodes; ++k) {
+                    mi = mats_order[k];
+                    times_row = mats[mi]->values + (size_t) inds[mi * PARTI_PACKED_BLOCK + i] * stride;
+                    for(sptIndex r = 0; r < R; ++r) {
+                        row[r] *= times_row[r];
+                    }
+                }
+                sptValue * const restrict out = mvals + (size_t) mode_ind[i] * stride;
+                for(sptIndex r = 0; r < R; ++r) {
+                    #pragma omp atomic update
+                    out[r] += row[r];
+                }
+            }
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/**
+ * OpenMP MTTKRP that decodes the blocks of a packed sparse tensor as it goes.
+ * The arguments are those of sptOmpMTTKRP.
+ */
+int sptOmpMTTKRPPacked(sptPackedSparseTensor const * const P,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = P->nmodes;
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != P->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    memset(mats[nmodes]->values, 0, (size_t) mats[mode]->nrows * mats[0]->stride * sizeof (sptValue));
+    return spt_PackedMTTKRPAccumulate(P, 0, P->nblocks, P->words, 0, P->values.data, mats, mats_order, mode, tk);
+}
+
+
+/* Byte offsets of the sections of a packed file: firsts, widths, offsets, words, values and the end */
+void spt_PackedBinarySections(spt_PackedBinaryHeader const * const header, uint64_t sections[6]) {
+    uint64_t const nblocks = (header->nnz + PARTI_PACKED_BLOCK - 1) / PARTI_PACKED_BLOCK;
+    sections[0] = spt_SparseTensorBinaryDataOffset(header->nmodes);
+    sections[1] = sections[0] + spt_BinaryAlignUp(nblocks * header->nmodes * sizeof (uint64_t));
+    sections[2] = sections[1] + spt_BinaryAlignUp(nblocks * header->nmodes);
+    sections[3] = sections[2] + spt_BinaryAlignUp((nblocks + 1) * sizeof (uint64_t));
+    sections[4] = sections[3] + spt_BinaryAlignUp(header->nwords * sizeof (uint64_t));
+    sections[5] = sections[4] + spt_BinaryAlignUp(header->nnz * header->value_width);
+}
+
+/* Validate a packed file header against this build */
+int spt_PackedBinaryCheckHeader(spt_PackedBinaryHeader const * const header) {
+    if(memcmp(header->magic, PARTI_PACKED_MAGIC, sizeof header->magic) != 0) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Packed Load", "not a packed tensor file");
+    }
+    if(header->endian != PARTI_BINARY_ENDIAN) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Packed Load", "file written on a machine of the other endianness");
+    }
+    if(header->version != PARTI_BINARY_VERSION || header->block != PARTI_PACKED_BLOCK ||
+        header->value_width != sizeof (sptValue) || header->index_width != sizeof (sptIndex)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Packed Load", "version, block size or widths differ from this build");
+    }
+    return 0;
+}
+
+static int spt_PackedWrite(void const * data, uint64_t const bytes, FILE *fp) {
+    static const char zeros[PARTI_BINARY_ALIGN] = { 0 };
+    if(bytes != 0) {
+        spt_CheckOSError(fwrite(data, 1, bytes, fp) != bytes, "SpTns Packed Dump");
+    }
+    uint64_t const pad = spt_BinaryAlignUp(bytes) - bytes;
+    if(pad != 0) {
+        spt_CheckOSError(fwrite(zeros, 1, pad, fp) != pad, "SpTns Packed Dump");
+    }
+    return 0;
+}
+
+static int spt_PackedRead(void * data, uint64_t const bytes, FILE *fp) {
+    char pad[PARTI_BINARY_ALIGN];
+    if(bytes != 0) {
+        spt_CheckOSError(fread(data, 1, bytes, fp) != bytes, "SpTns Packed Load");
+    }
+    uint64_t const skip = spt_BinaryAlignUp(bytes) - bytes;
+    if(skip != 0) {
+        spt_CheckOSError(fread(pad, 1, skip, fp) != skip, "SpTns Packed Load");
+    }
+    return 0;
+}
+
+/**
+ * Write a packed sparse tensor, in the layout of the binary container of
+ * sptDumpSparseTensorBinary with the packed arrays in place of the indices.
+ * sptCpdAlsStream reads these files as well.
+ * @param P  the packed sparse tensor
+ * @param fp the file to write to, opened in binary mode
+ */
+int sptDumpPackedSparseTensor(const sptPackedSparseTensor *P, FILE *fp) {
+    sptIndex const nmodes = P->nmodes;
+    spt_PackedBinaryHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, PARTI_PACKED_MAGIC, sizeof header.magic);
+    header.version = PARTI_BINARY_VERSION;
+    header.endian = PARTI_BINARY_ENDIAN;
+    header.nmodes = nmodes;
+    header.block = PARTI_PACKED_BLOCK;
+    header.index_width = sizeof (sptIndex);
+    header.value_width = sizeof (sptValue);
+    header.nnz = P->nnz;
+    header.nwords = P->offsets[P->nblocks];
+
+    uint64_t * buf = malloc((nmodes * P->nblocks + nmodes + 1) * sizeof *buf);
+    spt_CheckOSError(!buf, "SpTns Packed Dump");
+    spt_CheckOSError(fwrite(&header, sizeof header, 1, fp) != 1, "SpTns Packed Dump");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        buf[m] = P->ndims[m];
+    }
+    spt_CheckOSError(fwrite(buf, sizeof *buf, nmodes, fp) != nmodes, "SpTns Packed Dump");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        uint32_t const order = P->sortorder[m];
+        spt_CheckOSError(fwrite(&order, sizeof order, 1, fp) != 1, "SpTns Packed Dump");
+    }
+    spt_CheckOSError(fwrite(&P->fingerprint, sizeof P->fingerprint, 1, fp) != 1, "SpTns Packed Dump");
+    static const char zeros[PARTI_BINARY_ALIGN] = { 0 };
+    uint64_t const head = sizeof header + nmodes * (sizeof (uint64_t) + sizeof (uint32_t)) + sizeof P->fingerprint;
+    uint64_t const pad = spt_BinaryAlignUp(head) - head;
+    spt_CheckOSError(pad != 0 && fwrite(zeros, 1, pad, fp) != pad, "SpTns Packed Dump");
+
+    for(sptNnzIndex i = 0; i < nmodes * P->nblocks; ++i) {
+        buf[i] = P->firsts[i];
+    }
+    int result = spt_PackedWrite(buf, nmodes * P->nblocks * sizeof *buf, fp);
+    spt_CheckError(result, "SpTns Packed Dump", NULL);
+    free(buf);
+    result = spt_PackedWrite(P->widths, nmodes * P->nblocks, fp);
+    spt_CheckError(result, "SpTns Packed Dump", NULL);
+    result = spt_PackedWrite(P->offsets, (P->nblocks + 1) * sizeof *P->offsets, fp);
+    spt_CheckError(result, "SpTns Packed Dump", NULL);
+    result = spt_PackedWrite(P->words, header.nwords * sizeof *P->words, fp);
+    spt_CheckError(result, "SpTns Packed Dump", NULL);
+    result = spt_PackedWrite(P->values.data, P->nnz * sizeof *P->values.data, fp);
+    spt_CheckError(result, "SpTns Packed Dump", NULL);
+    return 0;
+}
+
+/**
+ * Read a packed sparse tensor written by sptDumpPackedSparseTensor
+ * @param P  an uninitialized packed sparse tensor
+ * @param fp the file to read from, opened in binary mode
+ */
+int sptLoadPackedSparseTensor(sptPackedSparseTensor *P, FILE *fp) {
+    spt_PackedBinaryHeader header;
+    spt_CheckOSError(fread(&header, sizeof header, 1, fp) != 1, "SpTns Packed Load");
+    int result = spt_PackedBinaryCheckHeader(&header);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+
+    sptIndex const nmodes = header.nmodes;
+    sptNnzIndex const nblocks = (header.nnz + PARTI_PACKED_BLOCK - 1) / PARTI_PACKED_BLOCK;
+    P->nmodes = nmodes;
+    P->nnz = header.nnz;
+    P->nblocks = nblocks;
+    uint64_t * buf = malloc((nmodes * nblocks + nmodes + 1) * sizeof *buf);
+    spt_CheckOSError(!buf, "SpTns Packed Load");
+    uint32_t * order = malloc((nmodes + 1) * sizeof *order);
+    spt_CheckOSError(!order, "SpTns Packed Load");
+    spt_CheckOSError(fread(buf, sizeof *buf, nmodes, fp) != nmodes, "SpTns Packed Load");
+    spt_CheckOSError(fread(order, sizeof *order, nmodes, fp) != nmodes, "SpTns Packed Load");
+    spt_CheckOSError(fread(&P->fingerprint, sizeof P->fingerprint, 1, fp) != 1, "SpTns Packed Load");
+    uint64_t const head = sizeof header + nmodes * (sizeof (uint64_t) + sizeof (uint32_t)) + sizeof P->fingerprint;
+    char pad[PARTI_BINARY_ALIGN];
+    uint64_t const skip = spt_BinaryAlignUp(head) - head;
+    spt_CheckOSError(skip != 0 && fread(pad, 1, skip, fp) != skip, "SpTns Packed Load");
+
+    P->ndims = malloc(nmodes * sizeof *P->ndims);
+    spt_CheckOSError(!P->ndims, "SpTns Packed Load");
+    P->sortorder = malloc(nmodes * sizeof *P->sortorder);
+    spt_CheckOSError(!P->sortorder, "SpTns Packed Load");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        P->ndims[m] = (sptIndex) buf[m];
+        P->sortorder[m] = order[m];
+    }
+    free(order);
+
+    result = spt_PackedRead(buf, nmodes * nblocks * sizeof *buf, fp);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    P->firsts = malloc((nblocks * nmodes + 1) * sizeof *P->firsts);
+    spt_CheckOSError(!P->firsts, "SpTns Packed Load");
+    for(sptNnzIndex i = 0; i < nmodes * nblocks; ++i) {
+        P->firsts[i] = (sptIndex) buf[i];
+    }
+    free(buf);
+    P->widths = malloc(nblocks * nmodes + 1);
+    spt_CheckOSError(!P->widths, "SpTns Packed Load");
+    result = spt_PackedRead(P->widths, nmodes * nblocks, fp);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    P->offsets = malloc((nblocks + 1) * sizeof *P->offsets);
+    spt_CheckOSError(!P->offsets, "SpTns Packed Load");
+    result = spt_PackedRead(P->offsets, (nblocks + 1) * sizeof *P->offsets, fp);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    if(P->offsets[nblocks] != header.nwords) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Packed Load", "corrupt block offsets");
+    }
+    P->words = malloc((header.nwords + 1) * sizeof *P->words);
+    spt_CheckOSError(!P->words, "SpTns Packed Load");
+    result = spt_PackedRead(P->words, header.nwords * sizeof *P->words, fp);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    result = sptNewValueVector(&P->values, P->nnz, P->nnz);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    result = spt_PackedRead(P->values.data, P->nnz * sizeof *P->values.data, fp);
+    spt_CheckError(result, "SpTns Packed Load", NULL);
+    return 0;
+}
@@ -0,0 +1,215 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Mode permutation. New mode m is old mode perm[m] in every format: the
+ * per-mode arrays only trade places, and the mode numbers stored as data
+ * (sort orders, CSF levels, cached modes) are renamed through the inverse
+ * permutation. A lexicographic order of the nonzeros in the old modes is the
+ * same order in the renamed ones, so nothing has to be re-sorted for the
+ * tensor to stay valid; sortorder keeps telling how the data is ordered.
+ */
+
+/* Fill inv with the inverse of perm, 0 if perm is not a permutation of nmodes modes */
+static int spt_InvertModePermutation(sptIndex * inv, sptIndex const perm[], sptIndex const nmodes)
+{
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        inv[m] = nmodes;
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(perm[m] >= nmodes || inv[perm[m]] != nmodes) {
+            return 0;
+        }
+        inv[perm[m]] = m;
+    }
+    return 1;
+}
+
+/* Move the per-mode entries of arr, each of the given size, so that new entry m is old entry perm[m] */
+static int spt_PermuteModeArray(void * arr, size_t const size, sptIndex const perm[], sptIndex const nmodes)
+{
+    char * old = malloc(nmodes * size + 1);
+    if(old == NULL) {
+        return -1;
+    }
+    memcpy(old, arr, nmodes * size);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        memcpy((char *) arr + m * size, old + perm[m] * size, size);
+    }
+    free(old);
+    return 0;
+}
+
+/* Rename the cached data of a sparse tensor; the sorted copies are permuted lazily, like the tensor */
+static int spt_SparseTensorPermuteCache(sptSparseTensor *tsr, sptIndex const perm[], sptIndex const inv[])
+{
+    struct spt_SparseTensorCache * const cache = tsr->cache;
+    sptIndex const nmodes = tsr->nmodes;
+    cache->has_fingerprint = 0;     /* The modes are hashed in order */
+    if(cache->fibermode != nmodes) {
+        cache->fibermode = inv[cache->fibermode];
+    }
+    if(cache->slicemode != nmodes) {
+        cache->slicemode = inv[cache->slicemode];
+    }
+    if(cache->sliceptr != NULL && spt_PermuteModeArray(cache->sliceptr, sizeof *cache->sliceptr, perm, nmodes) != 0) {
+        return -1;
+    }
+    if(cache->copies != NULL) {
+        for(sptIndex m = 0; m < 2 * nmodes; ++m) {
+            if(cache->copies[m] != NULL && sptSparseTensorPermuteModes(cache->copies[m], perm, 0, 1) != 0) {
+                return -1;
+            }
+        }
+        /* The copy sorted at, or led by, old mode perm[m] is the one for new mode m */
+        if(spt_PermuteModeArray(cache->copies, sizeof *cache->copies, perm, nmodes) != 0 ||
+            spt_PermuteModeArray(cache->copies + nmodes, sizeof *cache->copies, perm, nmodes) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Permute the modes of a sparse tensor, so that new mode m is old mode
+ * perm[m], e.g. to follow an order from sptGetBestModeOrder. The index
+ * arrays only trade places and the cached slice pointers and sorted copies
+ * follow them, so no nonzero is copied.
+ *
+ * Without resort the nonzeros keep their order, which sortorder records in
+ * the new mode numbers, and kernels that need another order sort on demand.
+ * With resort they are then sorted lexicographically in the new modes by the
+ * parallel radix engine, unless sortorder says they already are.
+ * @param[in,out] tsr    the tensor to permute
+ * @param[in]     perm   the old mode of each new mode, a permutation of nmodes
+ * @param[in]     resort 1 to sort the nonzeros in the new mode order
+ * @param[in]     tk     the number of threads of the sort, 0 for the default
+ */
+int sptSparseTensorPermuteModes(sptSparseTensor *tsr, sptIndex const perm[], int const resort, int tk)
+{
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = tsr->nmodes;
+    sptIndex * const inv = malloc(nmodes * sizeof *inv);
+    spt_CheckOSError(!inv, "SpTns PermuteModes");
+    if(!spt_InvertModePermutation(inv, perm, nmodes)) {
+        free(inv);
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns PermuteModes", "perm is not a permutation of the modes");
+    }
+
+    int result = spt_PermuteModeArray(tsr->ndims, sizeof *tsr->ndims, perm, nmodes);
+    if(result == 0) {
+        result = spt_PermuteModeArray(tsr->inds, sizeof *tsr->inds, perm, nmodes);
+    }
+    if(result == 0 && tsr->cache != NULL) {
+        result = spt_SparseTensorPermuteCache(tsr, perm, inv);
+    }
+    if(result != 0) {
+        free(inv);
+        spt_CheckOSError(1, "SpTns PermuteModes");
+    }
+    int sorted = 1;
+    for(sptIndex k = 0; k < nmodes; ++k) {
+        tsr->sortorder[k] = inv[tsr->sortorder[k]];
+        sorted = sorted && tsr->sortorder[k] == k;
+    }
+    free(inv);
+
+    if(resort && !sorted) {
+        for(sptIndex k = 0; k < nmodes; ++k) {
+            tsr->sortorder[k] = k;
+        }
+        spt_SparseTensorDropOrderCache(tsr);
+        result = spt_SparseTensorRadixSort(tsr, 0, tsr->nnz, nmodes, tsr->sortorder, 0, tk);
+        spt_CheckError(result, "SpTns PermuteModes", NULL);
+    }
+    return 0;
+}
+
+/**
+ * Permute the modes of a HiCOO tensor in place, so that new mode m is old
+ * mode perm[m]. Blocks and kernels are the same boxes with their sides
+ * renamed, so the block, kernel and chunk pointers are kept and the
+ * per-mode block and element indices and kernel schedules trade places;
+ * no rebuild is needed. The blocks keep their order, which is no longer a
+ * Morton order of the new modes, which no HiCOO kernel relies on.
+ * @param[in,out] hitsr the tensor to permute
+ * @param[in]     perm  the old mode of each new mode, a permutation of nmodes
+ */
+int sptSparseTensorHiCOOPermuteModes(sptSparseTensorHiCOO *hitsr, sptIndex const perm[])
+{
+    sptIndex const nmodes = hitsr->nmodes;
+    sptIndex * const inv = malloc(nmodes * sizeof *inv);
+    spt_CheckOSError(!inv, "HiSpTns PermuteModes");
+    if(!spt_InvertModePermutation(inv, perm, nmodes)) {
+        free(inv);
+        spt_CheckError(SPTERR_VALUE_ERROR, "HiSpTns PermuteModes", "perm is not a permutation of the modes");
+    }
+    int result = spt_PermuteModeArray(hitsr->ndims, sizeof *hitsr->ndims, perm, nmodes);
+    result = result != 0 ? result : spt_PermuteModeArray(hitsr->binds, sizeof *hitsr->binds, perm, nmodes);
+    result = result != 0 ? result : spt_PermuteModeArray(hitsr->einds, sizeof *hitsr->einds, perm, nmodes);
+    result = result != 0 ? result : spt_PermuteModeArray(hitsr->kschr, sizeof *hitsr->kschr, perm, nmodes);
+    result = result != 0 ? result : spt_PermuteModeArray(hitsr->nkiters, sizeof *hitsr->nkiters, perm, nmodes);
+    if(result != 0) {
+        free(inv);
+        spt_CheckOSError(1, "HiSpTns PermuteModes");
+    }
+    for(sptIndex k = 0; k < nmodes; ++k) {
+        hitsr->sortorder[k] = inv[hitsr->sortorder[k]];
+    }
+    free(inv);
+    return 0;
+}
+
+/**
+ * Permute the modes of a CSF tensor in place, so that new mode m is old mode
+ * perm[m]. The tree is unchanged; only the mode stored at each level and the
+ * sizes are renamed.
+ * @param[in,out] csf  the tensor to permute
+ * @param[in]     perm the old mode of each new mode, a permutation of nmodes
+ */
+int sptSparseTensorCSFPermuteModes(sptSparseTensorCSF *csf, sptIndex const perm[])
+{
+    sptIndex const nmodes = csf->nmodes;
+    sptIndex * const inv = malloc(nmodes * sizeof *inv);
+    spt_CheckOSError(!inv, "SpTns CSF PermuteModes");
+    if(!spt_InvertModePermutation(inv, perm, nmodes)) {
+        free(inv);
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns CSF PermuteModes", "perm is not a permutation of the modes");
+    }
+    int const result = spt_PermuteModeArray(csf->ndims, sizeof *csf->ndims, perm, nmodes);
+    if(result != 0) {
+        free(inv);
+        spt_CheckOSError(1, "SpTns CSF PermuteModes");
+    }
+    for(sptIndex l = 0; l < nmodes; ++l) {
+        csf->mode_order[l] = inv[csf->mode_order[l]];
+    }
+    free(inv);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "sptensor.h"
+
+/*
+ * Plan and layout cache.
+ *
+ * Tuning decisions and converted formats are kept as files in the directory
+ * PARTI_PLAN_CACHE names, one per tensor fingerprint, machine fingerprint
+ * and kind, so that later runs on the same data skip the preprocessing. A
+ * missing or unreadable entry only costs the work it would have saved.
+ */
+
+/**
+ * The file that keeps a persisted plan or layout in the plan cache:
+ * "<dir>/<tensor>-<machine>.<kind>", with the hexadecimal
+ * sptSparseTensorFingerprint of tsr and sptMachineProfileFingerprint of
+ * profile. Either may be NULL for entries that do not depend on it, e.g. a
+ * format conversion needs no profile, and is then left out of the name.
+ * @param tsr     the tensor, or NULL
+ * @param profile the machine profile, or NULL
+ * @param kind    what the entry holds, also its file extension
+ * @return the path, to be freed by the caller, or NULL if PARTI_PLAN_CACHE is not set
+ */
+char * sptPlanCachePath(sptSparseTensor const * const tsr, sptMachineProfile const * const profile, char const * const kind)
+{
+    char const * const dir = getenv("PARTI_PLAN_CACHE");
+    if(dir == NULL || dir[0] == '\0') {
+        return NULL;
+    }
+    char key[40] = "";
+    if(tsr != NULL && profile != NULL) {
+        snprintf(key, sizeof key, "%016" PRIx64 "-%016" PRIx64 ".", sptSparseTensorFingerprint(tsr), sptMachineProfileFingerprint(profile));
+    } else if(tsr != NULL) {
+        snprintf(key, sizeof key, "%016" PRIx64 ".", sptSparseTensorFingerprint(tsr));
+    } else if(profile != NULL) {
+        snprintf(key, sizeof key, "%016" PRIx64 ".", sptMachineProfileFingerprint(profile));
+    }
+    int const len = snprintf(NULL, 0, "%s/%s%s", dir, key, kind);
+    char * const path = malloc(len + 1);
+    if(path != NULL) {
+        snprintf(path, len + 1, "%s/%s%s", dir, key, kind);
+    }
+    return path;
+}
+
+
+/**
+ * sptSparseTensorToHiCOO through the plan cache: the HiCOO tensor built
+ * from tsr with the same block and kernel bits by an earlier run is read
+ * back with sptLoadSparseTensorHiCOOBinary, otherwise it is converted and
+ * stored for the next one. Without PARTI_PLAN_CACHE this is
+ * sptSparseTensorToHiCOO. A layout read from the cache leaves tsr in its
+ * order, where the conversion may sort it.
+ * @param[out] hitsr    an uninitialized HiCOO tensor
+ * @param[out] max_nnzb the most nonzeros of a block
+ * @param[in]  tsr      the COO tensor
+ * @param[in]  sb_bits  the block bits
+ * @param[in]  sk_bits  the superblock (kernel) bits
+ * @param[in]  tk       the number of threads of a conversion
+ */
+int sptSparseTensorToHiCOOCached(
+    sptSparseTensorHiCOO *hitsr,
+    sptNnzIndex *max_nnzb,
+    sptSparseTensor *tsr,
+    const sptElementIndex sb_bits,
+    const sptElementIndex sk_bits,
+    int const tk)
+{
+    char kind[32];
+    snprintf(kind, sizeof kind, "hicoo-b%u-k%u", (unsigned) sb_bits, (unsigned) sk_bits);
+    char * const path = sptPlanCachePath(tsr, NULL, kind);
+    if(path != NULL) {
+        FILE * fp = fopen(path, "rb");
+        if(fp != NULL) {
+            int const loaded = sptLoadSparseTensorHiCOOBinary(hitsr, fp) == 0;
+            fclose(fp);
+            if(loaded && hitsr->nnz == tsr->nnz && hitsr->sb_bits == sb_bits && hitsr->sk_bits == sk_bits) {
+                *max_nnzb = 0;
+                for(sptNnzIndex b = 0; b + 1 < hitsr->bptr.len; ++b) {
+                    sptNnzIndex const n = hitsr->bptr.data[b+1] - hitsr->bptr.data[b];
+                    *max_nnzb = n > *max_nnzb ? n : *max_nnzb;
+                }
+                free(path);
+                return 0;
+            }
+            if(loaded) {
+                sptFreeSparseTensorHiCOO(hitsr);
+            }
+        }
+    }
+
+    int result = sptSparseTensorToHiCOO(hitsr, max_nnzb, tsr, sb_bits, sk_bits, tk);
+    if(result != 0) {
+        free(path);
+        spt_CheckError(result, "HiSpTns Cached", NULL);
+    }
+    if(path != NULL) {
+        /* Written aside and renamed, so a concurrent run never reads a partial file */
+        int const len = snprintf(NULL, 0, "%s.%d", path, (int) getpid());
+        char * const tmp = malloc(len + 1);
+        FILE * fp = NULL;
+        if(tmp != NULL) {
+            snprintf(tmp, len + 1, "%s.%d", path, (int) getpid());
+            fp = fopen(tmp, "wb");
+        }
+        if(fp != NULL) {
+            int const written = sptDumpSparseTensorHiCOOBinary(hitsr, fp) == 0;
+            if(fclose(fp) != 0 || !written || rename(tmp, path) != 0) {
+                remove(tmp);
+            }
+        }
+        free(tmp);
+        free(path);
+    }
+    return 0;
+}
@@ -0,0 +1,377 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/**
+ * Sparse tensor times a vector in every mode but one,
+ * y = X x_0 V[0] ... x_{mode-1} V[mode-1] x_{mode+1} V[mode+1] ..., the
+ * step of the higher-order power method, in one pass over the nonzeros
+ * instead of a chain of sptSparseTensorMulVector calls with semi-sparse
+ * intermediates. X is not reordered, so the modes can be cycled without
+ * sorting; with more than one thread the entries of y are added atomically.
+ * @param[out] y    a vector of X->ndims[mode] entries, overwritten
+ * @param[in]  X    the sparse tensor
+ * @param[in]  V    nmodes vectors, V[m] of length X->ndims[m]; V[mode] is unused
+ * @param[in]  mode the mode left out
+ * @param[in]  tk   the number of threads
+ */
+int sptSparseTensorMulVectorsExcept(
+    sptValueVector *y,
+    sptSparseTensor const *X,
+    const sptValueVector * const V[],
+    sptIndex const mode,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(mode >= nmodes || y->len != X->ndims[mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Vecs Except", "shape mismatch");
+    }
+    sptValue const ** vecs = malloc(nmodes * sizeof *vecs);
+    spt_CheckOSError(!vecs, "CPU  SpTns * Vecs Except");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode && V[m]->len != X->ndims[m]) {
+            free(vecs);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Vecs Except", "shape mismatch");
+        }
+        vecs[m] = m != mode ? V[m]->data : NULL;
+    }
+    spt_SparseTensorMulVectorsExcept(y->data, X, vecs, mode, tk);
+    free(vecs);
+    return 0;
+}
+
+/* The kernel of sptSparseTensorMulVectorsExcept on raw vectors */
+void spt_SparseTensorMulVectorsExcept(
+    sptValue * const y,
+    sptSparseTensor const * const X,
+    sptValue const * const * const vecs,
+    sptIndex const mode,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const * const out = X->inds[mode].data;
+    sptValue const * const vals = X->values.data;
+    int const nthreads = tk > 0 ? tk : 1;
+    memset(y, 0, X->ndims[mode] * sizeof *y);
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads)
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        sptValue prod = vals[z];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                prod *= vecs[m][X->inds[m].data[z]];
+            }
+        }
+        if(nthreads > 1) {
+            #pragma omp atomic update
+            y[out[z]] += prod;
+        } else {
+            y[out[z]] += prod;
+        }
+    }
+}
+
+
+/*
+ * Higher-order power iterations on x[0..nmodes-1], each of unit norm on
+ * return. ttv(arg, y, x, mode) writes the product of the tensor with x in
+ * every mode but mode. In the general (HOPM) case the modes are updated in
+ * turn, x_m = normalize(y + shift * x_m), and lambda is the tensor times
+ * all the x's; with symmetric set, x[] all alias one vector that is updated
+ * from mode 0 only (S-HOPM, or SS-HOPM with a shift), and lambda is the
+ * tensor times the vector before the update. Stops once lambda changes by
+ * less than tol relative to its magnitude.
+ */
+int spt_SparseTensorPowerIterate(
+    sptIndex const nmodes,
+    sptIndex const ndims[],
+    sptValue * const x[],
+    sptValue * const lambda,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol,
+    spt_TtvExceptFn const ttv,
+    void * const arg,
+    char const * const module)
+{
+    (void) module;
+    sptIndex const nupdate = symmetric ? 1 : nmodes;
+    sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+    sptValue * const y = malloc(max_dim * sizeof *y);
+    spt_CheckOSError(!y, module);
+
+    for(sptIndex m = 0; m < nupdate; ++m) {
+        double norm = 0;
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            norm += x[m][i] * x[m][i];
+        }
+        if(!(norm > 0)) {
+            free(y);
+            spt_CheckError(SPTERR_VALUE_ERROR, module, "a starting vector is zero");
+        }
+        norm = sqrt(norm);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            x[m][i] /= norm;
+        }
+    }
+
+    double value = 0;
+    for(sptIndex it = 0; it < niters; ++it) {
+        double const old = value;
+        for(sptIndex m = 0; m < nupdate; ++m) {
+            int const result = ttv(arg, y, x, m);
+            if(result != 0) {
+                free(y);
+                spt_CheckError(result, module, NULL);
+            }
+            double yx = 0, yy = 0;
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                yx += y[i] * x[m][i];
+                yy += y[i] * y[i];
+            }
+            /* ||y + shift * x||^2, x of unit norm */
+            double const norm = sqrt(yy + 2 * shift * yx + (double) shift * shift);
+            if(!(norm > 0)) {
+                free(y);
+                spt_CheckError(SPTERR_VALUE_ERROR, module, "the iterate vanished");
+            }
+            /* <y, x_new> = (||y||^2 + shift <y, x>) / norm */
+            value = symmetric ? yx : (yy + shift * yx) / norm;
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                x[m][i] = (sptValue) ((y[i] + shift * x[m][i]) / norm);
+            }
+        }
+        if(it > 0 && fabs(value - old) <= tol * fabs(value)) {
+            break;
+        }
+    }
+
+    *lambda = (sptValue) value;
+    free(y);
+    return 0;
+}
+
+typedef struct {
+    sptSparseTensor const * X;
+    int tk;
+} spt_PowerOmpArgs;
+
+static int spt_PowerOmpTtv(void * arg, sptValue * y, sptValue * const x[], sptIndex const mode)
+{
+    spt_PowerOmpArgs const * const a = arg;
+    spt_SparseTensorMulVectorsExcept(y, a->X, (sptValue const * const *) x, mode, a->tk);
+    return 0;
+}
+
+/**
+ * Higher-order power method on a sparse tensor, each step one fused
+ * all-but-one-mode TTV (sptSparseTensorMulVectorsExcept).
+ *
+ * In the general case (HOPM) every mode has its vector, and the modes are
+ * updated in turn to the normalized product of X with the others, plus
+ * shift times the old vector; this is the best rank-1 approximation by
+ * alternating least squares. With symmetric set, X is taken as symmetric,
+ * only x[0] is used, and x = normalize(X x^{nmodes-1} + shift x) (S-HOPM,
+ * or the shifted SS-HOPM, which converges for a large enough shift).
+ *
+ * @param[out]    lambda   the tensor times the final vectors
+ * @param[in,out] x        the starting vectors, x[m] of length X->ndims[m]; normalized eigenvectors on return
+ * @param[in]     X        the sparse tensor
+ * @param[in]     shift    added times the old vector at each update, 0 for the plain method
+ * @param[in]     symmetric whether to iterate one vector, for X of equal mode sizes
+ * @param[in]     niters   the maximum number of iterations, each a pass over the updated modes
+ * @param[in]     tol      the relative change of lambda to stop at
+ * @param[in]     tk       the number of threads
+ */
+int sptSparseTensorPowerMethod(
+    sptValue *lambda,
+    sptValueVector * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptValue ** vecs = malloc(nmodes * sizeof *vecs);
+    spt_CheckOSError(!vecs, "CPU  SpTns Power Method");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptValueVector * const v = symmetric ? x[0] : x[m];
+        if(v->len != X->ndims[m]) {
+            free(vecs);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Power Method", "shape mismatch");
+        }
+        vecs[m] = v->data;
+    }
+    spt_PowerOmpArgs args = { X, tk };
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    int const result = spt_SparseTensorPowerIterate(nmodes, X->ndims, vecs, lambda, shift, symmetric, niters, tol,
+        spt_PowerOmpTtv, &args, "CPU  SpTns Power Method");
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SpTns Power Method");
+    sptFreeTimer(timer);
+
+    free(vecs);
+    return result;
+}
+
+
+/**
+ * Higher-order power method from many starting vectors at once, as
+ * sptSparseTensorPowerMethod on each column. The all-but-one-mode TTVs of
+ * all columns are one MTTKRP (sptOmpMTTKRP), with column j of the factors
+ * the j-th set of vectors, so the tensor is read once per mode update for
+ * all of them. Iterations stop when every lambda has converged.
+ *
+ * @param[out]    lambda   x[0]->ncols values, the tensor times each column's final vectors
+ * @param[in,out] x        the starting vectors as columns, x[m] of X->ndims[m] rows; only x[0] if symmetric
+ * @param[in]     X        the sparse tensor
+ * @param[in]     shift    added times the old vectors at each update, 0 for the plain method
+ * @param[in]     symmetric whether to iterate one vector per column, for X of equal mode sizes
+ * @param[in]     niters   the maximum number of iterations
+ * @param[in]     tol      the relative change of lambda to stop at
+ * @param[in]     tk       the number of threads
+ */
+int sptSparseTensorPowerMethodBatched(
+    sptValue *lambda,
+    sptMatrix * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol,
+    int const tk)
+{
+    char const * const module = "CPU  SpTns Power Method Batched";
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const nvecs = x[0]->ncols;
+    sptIndex const stride = x[0]->stride;
+    sptIndex const nupdate = symmetric ? 1 : nmodes;
+    sptMatrix ** mats = malloc((nmodes + 1) * sizeof *mats);
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    double * value = calloc(nvecs, sizeof *value);
+    double * old = malloc(nvecs * sizeof *old);
+    spt_CheckOSError(!mats || !order || !value || !old, module);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = symmetric ? x[0] : x[m];
+        if(mats[m]->nrows != X->ndims[m] || mats[m]->ncols != nvecs) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+        }
+    }
+    sptMatrix Y;
+    int result = sptNewMatrix(&Y, sptMaxIndexArray(X->ndims, nmodes), nvecs);
+    spt_CheckError(result, module, NULL);
+    mats[nmodes] = &Y;
+    double * const sums = malloc(3 * (size_t) nvecs * sizeof *sums);
+    spt_CheckOSError(!sums, module);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    for(sptIndex m = 0; m < nupdate; ++m) {
+        memset(sums, 0, nvecs * sizeof *sums);
+        for(sptIndex i = 0; i < mats[m]->nrows; ++i) {
+            for(sptIndex j = 0; j < nvecs; ++j) {
+                sums[j] += mats[m]->values[(size_t) i * stride + j] * mats[m]->values[(size_t) i * stride + j];
+            }
+        }
+        for(sptIndex j = 0; j < nvecs; ++j) {
+            if(!(sums[j] > 0)) {
+                spt_CheckError(SPTERR_VALUE_ERROR, module, "a starting vector is zero");
+            }
+            sums[j] = 1 / sqrt(sums[j]);
+        }
+        for(sptIndex i = 0; i < mats[m]->nrows; ++i) {
+            for(sptIndex j = 0; j < nvecs; ++j) {
+                mats[m]->values[(size_t) i * stride + j] *= (sptValue) sums[j];
+            }
+        }
+    }
+
+    for(sptIndex it = 0; it < niters; ++it) {
+        memcpy(old, value, nvecs * sizeof *old);
+        for(sptIndex m = 0; m < nupdate; ++m) {
+            order[0] = m;
+            for(sptIndex k = 1; k < nmodes; ++k) {
+                order[k] = (m + k) % nmodes;
+            }
+            result = sptOmpMTTKRP(X, mats, order, m, tk);
+            spt_CheckError(result, module, NULL);
+            sptValue * const xv = mats[m]->values;
+            double * const yx = sums, * const yy = sums + nvecs, * const scale = sums + 2 * nvecs;
+            memset(sums, 0, 2 * (size_t) nvecs * sizeof *sums);
+            for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+                for(sptIndex j = 0; j < nvecs; ++j) {
+                    sptValue const yv = Y.values[(size_t) i * Y.stride + j];
+                    yx[j] += yv * xv[(size_t) i * stride + j];
+                    yy[j] += yv * yv;
+                }
+            }
+            for(sptIndex j = 0; j < nvecs; ++j) {
+                double const norm = sqrt(yy[j] + 2 * shift * yx[j] + (double) shift * shift);
+                if(!(norm > 0)) {
+                    spt_CheckError(SPTERR_VALUE_ERROR, module, "an iterate vanished");
+                }
+                value[j] = symmetric ? yx[j] : (yy[j] + shift * yx[j]) / norm;
+                scale[j] = 1 / norm;
+            }
+            #pragma omp parallel for schedule(static) num_threads(tk > 0 ? tk : 1)
+            for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+                for(sptIndex j = 0; j < nvecs; ++j) {
+                    size_t const k = (size_t) i * stride + j;
+                    xv[k] = (sptValue) ((Y.values[(size_t) i * Y.stride + j] + shift * xv[k]) * scale[j]);
+                }
+            }
+        }
+        int converged = it > 0;
+        for(sptIndex j = 0; j < nvecs && converged; ++j) {
+            converged = fabs(value[j] - old[j]) <= tol * fabs(value[j]);
+        }
+        if(converged) {
+            break;
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, module);
+    sptFreeTimer(timer);
+
+    for(sptIndex j = 0; j < nvecs; ++j) {
+        lambda[j] = (sptValue) value[j];
+    }
+    sptFreeMatrix(&Y);
+    free(sums);
+    free(mats);
+    free(order);
+    free(value);
+    free(old);
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+#include "../cudawrap.h"
+
+/*
+ * One thread per nonzero: y[i_mode] += val * prod_{m != mode} vecs[m][i_m],
+ * the vectors packed back to back in vecs at offset[m].
+ */
+__global__ static void spt_TTVExceptKernel(
+    sptValue *y, sptNnzIndex const nnz, sptIndex const nmodes, sptIndex const mode,
+    sptValue const *X_val, sptIndex const *X_inds,
+    sptValue const *vecs, sptNnzIndex const *offset)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptValue prod = X_val[z];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            prod *= vecs[offset[m] + X_inds[(sptNnzIndex) m * nnz + z]];
+        }
+    }
+    /* The 64-bit floating-point version of atomicAdd() is only supported by devices of compute capability 6.x and higher. */
+    atomicAdd(&y[X_inds[(sptNnzIndex) mode * nnz + z]], prod);
+}
+
+
+/* The tensor and the packed vectors on the device, kept across the steps of a power method */
+typedef struct {
+    sptIndex nmodes;
+    sptNnzIndex nnz;
+    sptIndex const * ndims;     /// host copy of the mode sizes
+    sptNnzIndex const * offset; /// host copy of dev_offset, nmodes+1 entries
+    sptValue * dev_y;
+    sptValue * dev_vals;
+    sptIndex * dev_inds;
+    sptValue * dev_vecs;
+    sptNnzIndex * dev_offset;
+} spt_CudaTtvExcept;
+
+static int spt_NewCudaTtvExcept(spt_CudaTtvExcept * t, sptSparseTensor const * X, sptNnzIndex * offset)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    int result;
+    t->nmodes = nmodes;
+    t->nnz = nnz;
+    t->ndims = X->ndims;
+    offset[0] = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        offset[m+1] = offset[m] + X->ndims[m];
+    }
+    t->offset = offset;
+    result = spt_CudaPoolAlloc((void **) &t->dev_y, (sptMaxIndexArray(X->ndims, nmodes) + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    result = sptCudaDuplicateMemory(&t->dev_vals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    result = spt_CudaPoolAlloc((void **) &t->dev_inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = cudaMemcpy(t->dev_inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    }
+    result = spt_CudaPoolAlloc((void **) &t->dev_vecs, (offset[nmodes] + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    result = sptCudaDuplicateMemory(&t->dev_offset, offset, (nmodes + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    return 0;
+}
+
+static void spt_FreeCudaTtvExcept(spt_CudaTtvExcept * t)
+{
+    spt_CudaPoolFree(t->dev_offset);
+    spt_CudaPoolFree(t->dev_vecs);
+    spt_CudaPoolFree(t->dev_inds);
+    spt_CudaPoolFree(t->dev_vals);
+    spt_CudaPoolFree(t->dev_y);
+}
+
+/* Upload the vectors but x[mode], run the kernel and download y */
+static int spt_CudaTtvExceptRun(void * arg, sptValue * y, sptValue * const x[], sptIndex const mode)
+{
+    spt_CudaTtvExcept const * const t = (spt_CudaTtvExcept const *) arg;
+    int result;
+    for(sptIndex m = 0; m < t->nmodes; ++m) {
+        if(m != mode) {
+            result = cudaMemcpy(t->dev_vecs + t->offset[m], x[m], t->ndims[m] * sizeof (sptValue), cudaMemcpyHostToDevice);
+            spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+        }
+    }
+    result = cudaMemset(t->dev_y, 0, t->ndims[mode] * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks = (t->nnz + nthreads - 1) / nthreads;
+    if(nblocks > 0) {
+        spt_TTVExceptKernel<<<nblocks, nthreads>>>(t->dev_y, t->nnz, t->nmodes, mode,
+            t->dev_vals, t->dev_inds, t->dev_vecs, t->dev_offset);
+        result = cudaGetLastError();
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except kernel");
+    }
+    result = cudaMemcpy(y, t->dev_y, t->ndims[mode] * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vecs Except");
+    return 0;
+}
+
+
+/**
+ * CUDA version of sptSparseTensorMulVectorsExcept. X and the vectors are
+ * copied to the current device for the call, and y is copied back.
+ * @param[out] y    a vector of X->ndims[mode] entries, overwritten
+ * @param[in]  X    the sparse tensor
+ * @param[in]  V    nmodes vectors, V[m] of length X->ndims[m]; V[mode] is unused
+ * @param[in]  mode the mode left out
+ */
+int sptCudaSparseTensorMulVectorsExcept(
+    sptValueVector *y,
+    sptSparseTensor const *X,
+    const sptValueVector * const V[],
+    sptIndex const mode)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(mode >= nmodes || y->len != X->ndims[mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Vecs Except", "shape mismatch");
+    }
+    sptValue ** vecs = new sptValue *[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode && V[m]->len != X->ndims[m]) {
+            delete[] vecs;
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Vecs Except", "shape mismatch");
+        }
+        vecs[m] = m != mode ? V[m]->data : NULL;
+    }
+    sptNnzIndex * offset = new sptNnzIndex[nmodes + 1];
+    spt_CudaTtvExcept t;
+    int result = spt_NewCudaTtvExcept(&t, X, offset);
+    spt_CheckError(result, "CUDA SpTns * Vecs Except", NULL);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    result = spt_CudaTtvExceptRun(&t, y->data, vecs, mode);
+    spt_CheckError(result, "CUDA SpTns * Vecs Except", NULL);
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SpTns * Vecs Except");
+    sptFreeTimer(timer);
+
+    spt_FreeCudaTtvExcept(&t);
+    delete[] offset;
+    delete[] vecs;
+    return 0;
+}
+
+
+/**
+ * CUDA version of sptSparseTensorPowerMethod. The tensor stays on the
+ * current device for all the iterations and every all-but-one-mode TTV runs
+ * there; only the vectors, of the mode sizes, cross the bus per step.
+ *
+ * @param[out]    lambda   the tensor times the final vectors
+ * @param[in,out] x        the starting vectors, x[m] of length X->ndims[m]; normalized eigenvectors on return
+ * @param[in]     X        the sparse tensor
+ * @param[in]     shift    added times the old vector at each update, 0 for the plain method
+ * @param[in]     symmetric whether to iterate one vector, for X of equal mode sizes
+ * @param[in]     niters   the maximum number of iterations, each a pass over the updated modes
+ * @param[in]     tol      the relative change of lambda to stop at
+ */
+int sptCudaSparseTensorPowerMethod(
+    sptValue *lambda,
+    sptValueVector * const x[],
+    sptSparseTensor const *X,
+    sptValue const shift,
+    int const symmetric,
+    sptIndex const niters,
+    double const tol)
+{
+    sptIndex const nmodes = X->nmodes;
+    sptValue ** vecs = new sptValue *[nmodes];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptValueVector * const v = symmetric ? x[0] : x[m];
+        if(v->len != X->ndims[m]) {
+            delete[] vecs;
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns Power Method", "shape mismatch");
+        }
+        vecs[m] = v->data;
+    }
+    sptNnzIndex * offset = new sptNnzIndex[nmodes + 1];
+    spt_CudaTtvExcept t;
+    int result = spt_NewCudaTtvExcept(&t, X, offset);
+    spt_CheckError(result, "CUDA SpTns Power Method", NULL);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    result = spt_SparseTensorPowerIterate(nmodes, X->ndims, vecs, lambda, shift, symmetric, niters, tol,
+        spt_CudaTtvExceptRun, &t, "CUDA SpTns Power Method");
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SpTns Power Method");
+    sptFreeTimer(timer);
+
+    spt_FreeCudaTtvExcept(&t);
+    delete[] offset;
+    delete[] vecs;
+    return result;
+}
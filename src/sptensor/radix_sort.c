@@ -0,0 +1,352 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * LSD radix sort engine for COO sparse tensors.
+ *
+ * The sort key of a nonzero is a sequence of 64-bit words, most significant
+ * first, produced on demand by a spt_RadixKeyFunc. Words are processed from
+ * the least significant one, each with stable 8-bit digit passes over
+ * (key, permutation) pairs, so no nonzero is moved until the final
+ * permutation is known. It is then applied to every index array and to the
+ * values in a single gather pass each.
+ */
+
+#define SPT_RADIX_BITS 8
+#define SPT_RADIX_BUCKETS (1 << SPT_RADIX_BITS)
+
+static inline int spt_RadixThreadNum(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static inline int spt_RadixNumThreads(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Number of bits needed to store every value below `dim`
+ */
+unsigned spt_RadixBitWidth(sptIndex const dim) {
+    unsigned bits = 0;
+    sptIndex v = dim > 0 ? dim - 1 : 0;
+    while(v != 0) {
+        ++bits;
+        v >>= 1;
+    }
+    return bits;
+}
+
+
+/**
+ * Compute a stable sorting permutation of n items.
+ * @param[out] perm      the permutation, perm[i] is the original position of the i-th item in order
+ * @param[in]  n         the number of items
+ * @param[in]  nwords    the number of 64-bit key words, most significant first
+ * @param[in]  word_bits the number of significant (low) bits in each key word
+ * @param[in]  key       callback filling one key word for a chunk of items
+ * @param[in]  ctx       passed to key
+ * @param[in]  tk        the number of threads
+ */
+int spt_RadixSortPermutation(
+    sptNnzIndex * perm,
+    sptNnzIndex const n,
+    sptIndex const nwords,
+    unsigned const * word_bits,
+    spt_RadixKeyFunc key,
+    void const * ctx,
+    int const tk)
+{
+    int const nt = tk > 0 ? tk : 1;
+    uint64_t * keys = malloc(n * sizeof *keys);
+    uint64_t * keys_out = malloc(n * sizeof *keys_out);
+    sptNnzIndex * perm_out = malloc(n * sizeof *perm_out);
+    sptNnzIndex * hist = malloc((size_t) nt * SPT_RADIX_BUCKETS * sizeof *hist);
+    if(!keys || !keys_out || !perm_out || !hist) {
+        free(keys);
+        free(keys_out);
+        free(perm_out);
+        free(hist);
+        spt_CheckOSError(1, "SpTns Radix Sort");
+    }
+
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        perm[i] = i;
+    }
+
+    sptNnzIndex * perm_in = perm;
+    for(sptIndex w = nwords; w-- > 0; ) {
+        unsigned const npasses = (word_bits[w] + SPT_RADIX_BITS - 1) / SPT_RADIX_BITS;
+        if(npasses == 0) {
+            continue;
+        }
+        uint64_t * keys_in = keys;
+        uint64_t * kout = keys_out;
+
+        #pragma omp parallel num_threads(nt)
+        {
+            int const tid = spt_RadixThreadNum();
+            int const nthreads = spt_RadixNumThreads();
+            sptNnzIndex const lo = n * tid / nthreads;
+            sptNnzIndex const hi = n * (tid + 1) / nthreads;
+            sptNnzIndex * const my_hist = hist + (size_t) tid * SPT_RADIX_BUCKETS;
+            /* The key word is gathered through the current permutation. */
+            key(keys_in + lo, perm_in + lo, hi - lo, w, ctx);
+
+            for(unsigned pass = 0; pass < npasses; ++pass) {
+                unsigned const shift = pass * SPT_RADIX_BITS;
+                memset(my_hist, 0, SPT_RADIX_BUCKETS * sizeof *my_hist);
+                for(sptNnzIndex i = lo; i < hi; ++i) {
+                    ++ my_hist[(keys_in[i] >> shift) & (SPT_RADIX_BUCKETS - 1)];
+                }
+                #pragma omp barrier
+                /* Skip digits every item shares. */
+                int skip = 0;
+                for(unsigned d = 0; d < SPT_RADIX_BUCKETS && !skip; ++d) {
+                    sptNnzIndex count = 0;
+                    for(int t = 0; t < nthreads; ++t) {
+                        count += hist[(size_t) t * SPT_RADIX_BUCKETS + d];
+                    }
+                    if(count == n) {
+                        skip = 1;
+                    } else if(count != 0) {
+                        break;
+                    }
+                }
+                if(!skip) {
+                    #pragma omp barrier
+                    #pragma omp single
+                    {
+                        sptNnzIndex sum = 0;
+                        for(unsigned d = 0; d < SPT_RADIX_BUCKETS; ++d) {
+                            for(int t = 0; t < nthreads; ++t) {
+                                sptNnzIndex const c = hist[(size_t) t * SPT_RADIX_BUCKETS + d];
+                                hist[(size_t) t * SPT_RADIX_BUCKETS + d] = sum;
+                                sum += c;
+                            }
+                        }
+                    }
+                    for(sptNnzIndex i = lo; i < hi; ++i) {
+                        sptNnzIndex const pos = my_hist[(keys_in[i] >> shift) & (SPT_RADIX_BUCKETS - 1)] ++;
+                        kout[pos] = keys_in[i];
+                        perm_out[pos] = perm_in[i];
+                    }
+                    #pragma omp barrier
+                    #pragma omp single
+                    {
+                        uint64_t * tmp_keys = keys_in; keys_in = kout; kout = tmp_keys;
+                        sptNnzIndex * tmp_perm = perm_in; perm_in = perm_out; perm_out = tmp_perm;
+                    }
+                } else {
+                    #pragma omp barrier
+                }
+            }
+        }
+        keys = keys_in;
+        keys_out = kout;
+    }
+
+    if(perm_in != perm) {
+        memcpy(perm, perm_in, n * sizeof *perm);
+        perm_out = perm_in;
+    }
+    free(perm_out);
+    free(keys);
+    free(keys_out);
+    free(hist);
+
+    return 0;
+}
+
+
+/**
+ * Reorder the nonzeros [begin, begin+n) of a sparse tensor by a permutation
+ * relative to begin, one gather pass per index array and for the values.
+ */
+int spt_SparseTensorApplyPermutation(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const n,
+    sptNnzIndex const * perm,
+    int const tk)
+{
+    size_t const elem_size = sizeof(sptValue) > sizeof(sptIndex) ? sizeof(sptValue) : sizeof(sptIndex);
+    void * buf = malloc(n * elem_size);
+    spt_CheckOSError(!buf, "SpTns Permute");
+
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        sptIndex * const data = tsr->inds[m].data + begin;
+        sptIndex * const tmp = buf;
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex i = 0; i < n; ++i) {
+            tmp[i] = data[perm[i]];
+        }
+        memcpy(data, tmp, n * sizeof *data);
+    }
+    if(tsr->values.data != NULL) {
+        sptValue * const vals = tsr->values.data + begin;
+        sptValue * const tmp = buf;
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex i = 0; i < n; ++i) {
+            tmp[i] = vals[perm[i]];
+        }
+        memcpy(vals, tmp, n * sizeof *vals);
+    }
+
+    free(buf);
+    return 0;
+}
+
+
+/* Lexicographic keys: modes are packed, most significant first, into as few 64-bit words as possible. */
+typedef struct {
+    sptSparseTensor const * tsr;
+    sptNnzIndex begin;
+    sptElementIndex shift_bits;
+    sptIndex const * key_modes;
+    unsigned const * mode_bits;
+    sptIndex const * word_first;    /// word w packs key_modes[word_first[w] .. word_first[w+1])
+} spt_RadixLexContext;
+
+static void spt_RadixLexKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx)
+{
+    spt_RadixLexContext const * const lex = ctx;
+    sptIndex const first = lex->word_first[word], last = lex->word_first[word + 1];
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = 0;
+    }
+    for(sptIndex k = first; k < last; ++k) {
+        unsigned const bits = lex->mode_bits[k];
+        sptIndex const * const inds = lex->tsr->inds[lex->key_modes[k]].data + lex->begin;
+        for(sptNnzIndex i = 0; i < n; ++i) {
+            keys[i] = (keys[i] << bits) | (uint64_t) (inds[perm[i]] >> lex->shift_bits);
+        }
+    }
+}
+
+
+/**
+ * Stable lexicographic sorting permutation of the nonzeros [begin, end) of a sparse tensor,
+ * leaving the tensor untouched.
+ * @param tsr        the sparse tensor
+ * @param begin      first nonzero of the range
+ * @param end        end of the range, exclusive
+ * @param nkeys      the number of modes compared
+ * @param key_modes  the compared modes, most significant first
+ * @param shift_bits indices are compared after a right shift, e.g. to compare blocks
+ * @param perm       output, length end-begin, offsets relative to begin
+ * @param tk         the number of threads
+ */
+int spt_SparseTensorRadixPermutation(
+    sptSparseTensor const *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    sptNnzIndex * perm,
+    int const tk)
+{
+    sptNnzIndex const n = end - begin;
+    if(n < 2 || nkeys == 0) {
+        for(sptNnzIndex i = 0; i < n; ++i) {
+            perm[i] = i;
+        }
+        return 0;
+    }
+
+    unsigned * mode_bits = malloc(nkeys * sizeof *mode_bits);
+    spt_CheckOSError(!mode_bits, "SpTns Radix Sort");
+    sptIndex * word_first = malloc((nkeys + 1) * sizeof *word_first);
+    spt_CheckOSError(!word_first, "SpTns Radix Sort");
+    unsigned * word_bits = malloc(nkeys * sizeof *word_bits);
+    spt_CheckOSError(!word_bits, "SpTns Radix Sort");
+
+    /* Greedily pack modes into words from the most significant one. */
+    sptIndex nwords = 0;
+    unsigned used = 0;
+    for(sptIndex k = 0; k < nkeys; ++k) {
+        sptIndex const dim = tsr->ndims[key_modes[k]];
+        mode_bits[k] = spt_RadixBitWidth(dim > 0 ? ((dim - 1) >> shift_bits) + 1 : 0);
+        if(nwords == 0 || used + mode_bits[k] > 64) {
+            word_first[nwords] = k;
+            word_bits[nwords] = 0;
+            ++ nwords;
+            used = 0;
+        }
+        used += mode_bits[k];
+        word_bits[nwords - 1] += mode_bits[k];
+    }
+    word_first[nwords] = nkeys;
+
+    spt_RadixLexContext ctx = { tsr, begin, shift_bits, key_modes, mode_bits, word_first };
+    int result = spt_RadixSortPermutation(perm, n, nwords, word_bits, spt_RadixLexKey, &ctx, tk);
+
+    free(word_bits);
+    free(word_first);
+    free(mode_bits);
+    return result;
+}
+
+
+/**
+ * Stable lexicographic radix sort of the nonzeros [begin, end) of a sparse tensor.
+ * @param tsr        the sparse tensor to operate on
+ * @param begin      first nonzero of the range
+ * @param end        end of the range, exclusive
+ * @param nkeys      the number of modes compared
+ * @param key_modes  the compared modes, most significant first
+ * @param shift_bits indices are compared after a right shift, e.g. to compare blocks
+ * @param tk         the number of threads
+ */
+int spt_SparseTensorRadixSort(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    int const tk)
+{
+    sptNnzIndex const n = end - begin;
+    if(n < 2 || nkeys == 0) {
+        return 0;
+    }
+
+    sptNnzIndex * perm = malloc(n * sizeof *perm);
+    spt_CheckOSError(!perm, "SpTns Radix Sort");
+    int result = spt_SparseTensorRadixPermutation(tsr, begin, end, nkeys, key_modes, shift_bits, perm, tk);
+    if(result == 0) {
+        result = spt_SparseTensorApplyPermutation(tsr, begin, n, perm, tk);
+    }
+
+    free(perm);
+    return result;
+}
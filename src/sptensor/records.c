@@ -0,0 +1,550 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Array-of-structs COO.
+ *
+ * A COO kernel over an N-mode tensor streams N index arrays and the values,
+ * N+1 independent streams each holding a prefetcher slot and TLB entries.
+ * Here each nonzero is one record, its value then its indices, padded to a
+ * power of two of at least 16 bytes so that records never straddle a cache
+ * line: 16 bytes for two modes, 32 for up to six. The kernels read a single
+ * stream. The record size is a constant in the common cases, so the compiler
+ * specializes the inner loops for it.
+ */
+
+/* Bytes of a record of nmodes indices and a value */
+static size_t spt_RecordBytes(sptIndex const nmodes) {
+    size_t const need = sizeof (sptValue) + (size_t) nmodes * sizeof (sptIndex);
+    size_t bytes = 16;
+    while(bytes < need) {
+        bytes *= 2;
+    }
+    return bytes;
+}
+
+static inline sptValue spt_RecordValue(char const * rec) {
+    return *(sptValue const *) rec;
+}
+
+static inline sptIndex const * spt_RecordInds(char const * rec) {
+    return (sptIndex const *) (rec + sizeof (sptValue));
+}
+
+
+/**
+ * Copy a sparse tensor into records, in its current order. Sort it at a
+ * mode first, e.g. with sptSparseTensorSortIndexAtMode, for the TTM and TTV
+ * along that mode to stream the records in place.
+ * @param R  an uninitialized record tensor
+ * @param X  the sparse tensor, left untouched
+ * @param tk the number of threads
+ */
+int sptNewRecordSparseTensor(sptRecordSparseTensor *R, const sptSparseTensor *X, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(sptSparseTensorIsPattern(X)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Records", "pattern tensors are not supported");
+    }
+    R->nmodes = nmodes;
+    R->nnz = nnz;
+    R->record_bytes = spt_RecordBytes(nmodes);
+    R->sortorder = malloc(nmodes * sizeof *R->sortorder);
+    spt_CheckOSError(!R->sortorder, "SpTns Records");
+    memcpy(R->sortorder, X->sortorder, nmodes * sizeof *R->sortorder);
+    R->ndims = malloc(nmodes * sizeof *R->ndims);
+    spt_CheckOSError(!R->ndims, "SpTns Records");
+    memcpy(R->ndims, X->ndims, nmodes * sizeof *R->ndims);
+    R->records = sptMalloc(nnz * R->record_bytes + 1);
+    spt_CheckOSError(!R->records, "SpTns Records");
+
+    size_t const rb = R->record_bytes;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        char * const rec = R->records + z * rb;
+        memset(rec, 0, rb);
+        *(sptValue *) rec = X->values.data[z];
+        sptIndex * const inds = (sptIndex *) (rec + sizeof (sptValue));
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            inds[m] = X->inds[m].data[z];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Release a record tensor
+ */
+void sptFreeRecordSparseTensor(sptRecordSparseTensor *R) {
+    free(R->sortorder);
+    free(R->ndims);
+    sptFree(R->records);
+    R->records = NULL;
+    R->nmodes = 0;
+    R->nnz = 0;
+}
+
+/**
+ * Copy a record tensor back into COO
+ * @param X  an uninitialized sparse tensor
+ * @param R  the record tensor
+ * @param tk the number of threads
+ */
+int sptSparseTensorFromRecords(sptSparseTensor *X, const sptRecordSparseTensor *R, int const tk) {
+    sptIndex const nmodes = R->nmodes;
+    int result = spt_SparseTensorNewSized(X, nmodes, R->ndims, R->nnz);
+    spt_CheckError(result, "SpTns From Records", NULL);
+    memcpy(X->sortorder, R->sortorder, nmodes * sizeof *X->sortorder);
+    size_t const rb = R->record_bytes;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < R->nnz; ++z) {
+        char const * const rec = R->records + z * rb;
+        sptIndex const * const inds = spt_RecordInds(rec);
+        X->values.data[z] = spt_RecordValue(rec);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            X->inds[m].data[z] = inds[m];
+        }
+    }
+    return 0;
+}
+
+
+/* out += acc, atomically when other threads may write the same row */
+static inline void spt_RecordFlushRow(sptValue * const restrict out, sptValue const * const restrict acc, sptIndex const rank, int const shared) {
+    if(shared) {
+        for(sptIndex r = 0; r < rank; ++r) {
+            #pragma omp atomic update
+            out[r] += acc[r];
+        }
+    } else {
+        for(sptIndex r = 0; r < rank; ++r) {
+            out[r] += acc[r];
+        }
+    }
+}
+
+/*
+ * MTTKRP over the records [begin, end), of rb bytes each, on the calling
+ * thread. Consecutive records of the same output row, all of a slice when
+ * the records are sorted with mode first, add up in acc and reach the
+ * output in one flush.
+ */
+static inline void spt_RecordMTTKRPRange(
+    sptRecordSparseTensor const * const R,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    size_t const rb,
+    sptValue * const restrict row,
+    sptValue * const restrict acc,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    int const shared)
+{
+    sptIndex const nmodes = R->nmodes;
+    sptIndex const stride = mats[0]->stride;
+    sptIndex const rank = mats[mode]->ncols;
+    sptValue * const restrict mvals = mats[nmodes]->values;
+    if(begin >= end) {
+        return;
+    }
+    sptIndex cur = spt_RecordInds(R->records + begin * rb)[mode];
+    memset(acc, 0, rank * sizeof *acc);
+    for(sptNnzIndex z = begin; z < end; ++z) {
+        char const * const rec = R->records + z * rb;
+        sptIndex const * const inds = spt_RecordInds(rec);
+        sptValue const val = spt_RecordValue(rec);
+        if(inds[mode] != cur) {
+            spt_RecordFlushRow(mvals + (size_t) cur * stride, acc, rank, shared);
+            memset(acc, 0, rank * sizeof *acc);
+            cur = inds[mode];
+        }
+        sptIndex mi = mats_order[1];
+        sptValue const * times_row = mats[mi]->values + (size_t) inds[mi] * stride;
+        for(sptIndex r = 0; r < rank; ++r) {
+            row[r] = val * times_row[r];
+        }
+        for(sptIndex k = 2; k < nmodes; ++k) {
+            mi = mats_order[k];
+            times_row = mats[mi]->values + (size_t) inds[mi] * stride;
+            for(sptIndex r = 0; r < rank; ++r) {
+                row[r] *= times_row[r];
+            }
+        }
+        for(sptIndex r = 0; r < rank; ++r) {
+            acc[r] += row[r];
+        }
+    }
+    spt_RecordFlushRow(mvals + (size_t) cur * stride, acc, rank, shared);
+}
+
+/**
+ * OpenMP MTTKRP over a record tensor. The arguments are those of sptOmpMTTKRP.
+ */
+int sptOmpMTTKRPRecords(sptRecordSparseTensor const * const R,
+    sptMatrix * mats[],     // mats[nmodes] as temporary space.
+    sptIndex const mats_order[],    // Correspond to the mode order of X.
+    sptIndex const mode,
+    const int tk)
+{
+    sptIndex const nmodes = R->nmodes;
+    for(sptIndex i=0; i<nmodes; ++i) {
+        if(mats[i]->ncols != mats[nmodes]->ncols) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->cols != mats[nmodes]->ncols");
+        }
+        if(mats[i]->nrows != R->ndims[i]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns MTTKRP", "mats[i]->nrows != ndims[i]");
+        }
+    }
+    sptIndex const stride = mats[0]->stride;
+    memset(mats[nmodes]->values, 0, (size_t) mats[mode]->nrows * stride * sizeof (sptValue));
+    sptValue * buf = malloc((size_t) tk * 2 * stride * sizeof *buf + 1);
+    spt_CheckOSError(!buf, "CPU  SpTns MTTKRP");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    sptStartTimer(timer);
+
+    size_t const rb = R->record_bytes;
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0, team = 1;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+        team = omp_get_num_threads();
+#endif
+        sptNnzIndex const begin = R->nnz * tid / team;
+        sptNnzIndex const end = R->nnz * (tid + 1) / team;
+        sptValue * const row = buf + (size_t) tid * 2 * stride;
+        sptValue * const acc = row + stride;
+        int const shared = team > 1;
+        /* Constant record sizes let the compiler specialize the loop */
+        if(rb == 16) {
+            spt_RecordMTTKRPRange(R, begin, end, 16, row, acc, mats, mats_order, mode, shared);
+        } else if(rb == 32) {
+            spt_RecordMTTKRPRange(R, begin, end, 32, row, acc, mats, mats_order, mode, shared);
+        } else {
+            spt_RecordMTTKRPRange(R, begin, end, rb, row, acc, mats, mats_order, mode, shared);
+        }
+    }
+
+    sptStopTimer(timer);
+    /* One stream of records; every factor and output row access counted as a miss */
+    sptIndex const rank = mats[mode]->ncols;
+    spt_KernelProbeStop(probe, timer, "CPU  SpTns MTTKRP Records", (double) R->nnz * rank * nmodes,
+        (double) R->nnz * (rb + (double) rank * nmodes * sizeof (sptValue)));
+    sptFreeTimer(timer);
+    free(buf);
+    return 0;
+}
+
+
+typedef struct {
+    sptRecordSparseTensor const * R;
+    sptIndex const * modes;     /// the modes other than the product mode
+} spt_RecordKeyCtx;
+
+static void spt_RecordFiberKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    spt_RecordKeyCtx const * const c = ctx;
+    sptIndex const m = c->modes[word];
+    size_t const rb = c->R->record_bytes;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = spt_RecordInds(c->R->records + perm[i] * rb)[m];
+    }
+}
+
+/* Compare records a and b on every mode but mode, in mode order */
+static inline int spt_RecordCompareExceptMode(sptRecordSparseTensor const * const R, sptNnzIndex const a, sptNnzIndex const b, sptIndex const mode) {
+    sptIndex const * const x = spt_RecordInds(R->records + a * R->record_bytes);
+    sptIndex const * const y = spt_RecordInds(R->records + b * R->record_bytes);
+    for(sptIndex m = 0; m < R->nmodes; ++m) {
+        if(m != mode && x[m] != y[m]) {
+            return x[m] < y[m] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* Whether position i of the records in order perm, or in place, starts a new fiber */
+static inline int spt_RecordIsFiberHead(sptRecordSparseTensor const * const R, sptNnzIndex const * perm, sptNnzIndex const i, sptIndex const mode) {
+    return i == 0 || spt_RecordCompareExceptMode(R, perm ? perm[i-1] : i - 1, perm ? perm[i] : i, mode) != 0;
+}
+
+/*
+ * Set up the semi sparse result of a product along mode with ncols columns,
+ * one row per mode fiber of R, and the fibers: fiberidx[f] is where fiber f
+ * starts in the records in order *order, or in place when *order comes back
+ * NULL because R is already sorted at mode. Otherwise *order is a stable
+ * radix sort of the records by fiber, to free.
+ */
+static int spt_RecordFibers(
+    sptSemiSparseTensor *Y,
+    sptNnzIndexVector *fiberidx,
+    sptNnzIndex **order,
+    sptRecordSparseTensor const * const R,
+    sptIndex const mode,
+    sptIndex const ncols,
+    int const tk,
+    char const * module)
+{
+    (void) module;
+    sptIndex const nmodes = R->nmodes;
+    sptNnzIndex const nnz = R->nnz;
+    int result;
+    sptIndex * const ind_buf = malloc(nmodes * sizeof *ind_buf);
+    spt_CheckOSError(!ind_buf, module);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ind_buf[m] = R->ndims[m];
+    }
+    ind_buf[mode] = ncols;
+    result = sptNewSemiSparseTensor(Y, nmodes, mode, ind_buf);
+    free(ind_buf);
+    spt_CheckError(result, module, NULL);
+
+    /* In place if every record sorts after the one before it */
+    sptNnzIndex unsorted = 0;
+    #pragma omp parallel for schedule(static) reduction(+:unsorted) num_threads(tk)
+    for(sptNnzIndex z = 1; z < nnz; ++z) {
+        unsorted += spt_RecordCompareExceptMode(R, z - 1, z, mode) > 0;
+    }
+    *order = NULL;
+    if(unsorted != 0) {
+        sptIndex * const modes = malloc(nmodes * sizeof *modes);
+        unsigned * const word_bits = malloc(nmodes * sizeof *word_bits);
+        spt_CheckOSError(!modes || !word_bits, module);
+        sptIndex nother = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                modes[nother] = m;
+                word_bits[nother] = spt_RadixBitWidth(R->ndims[m]);
+                ++nother;
+            }
+        }
+        *order = malloc((nnz + 1) * sizeof **order);
+        spt_CheckOSError(!*order, module);
+        spt_RecordKeyCtx const ctx = { R, modes };
+        result = spt_RadixSortPermutation(*order, nnz, nother, word_bits, spt_RecordFiberKey, &ctx, tk);
+        free(modes);
+        free(word_bits);
+        spt_CheckError(result, module, NULL);
+    }
+    sptNnzIndex const * const perm = *order;
+
+    /* Fiber heads counted per static part, then compacted at the part offsets */
+    sptNnzIndex * const offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, module);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex count = 0;
+        for(sptNnzIndex i = nnz * p / tk; i < nnz * (p + 1) / tk; ++i) {
+            count += spt_RecordIsFiberHead(R, perm, i, mode);
+        }
+        offsets[p + 1] = count;
+    }
+    for(int p = 0; p < tk; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    sptNnzIndex const nfibers = offsets[tk];
+    result = sptNewNnzIndexVector(fiberidx, nfibers + 1, nfibers + 1);
+    spt_CheckError(result, module, NULL);
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex out = offsets[p];
+        for(sptNnzIndex i = nnz * p / tk; i < nnz * (p + 1) / tk; ++i) {
+            if(spt_RecordIsFiberHead(R, perm, i, mode)) {
+                fiberidx->data[out++] = i;
+            }
+        }
+    }
+    fiberidx->data[nfibers] = nnz;
+    free(offsets);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            result = sptResizeIndexVector(&Y->inds[m], nfibers);
+            spt_CheckError(result, module, NULL);
+        }
+    }
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        sptNnzIndex const z = perm ? perm[fiberidx->data[f]] : fiberidx->data[f];
+        sptIndex const * const inds = spt_RecordInds(R->records + z * R->record_bytes);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(m != mode) {
+                Y->inds[m].data[f] = inds[m];
+            }
+        }
+    }
+    Y->nnz = nfibers;
+    result = sptResizeMatrix(&Y->values, nfibers);
+    spt_CheckError(result, module, NULL);
+    memset(Y->values.values, 0, nfibers * Y->stride * sizeof (sptValue));
+    return 0;
+}
+
+/* Y row f += the records of fiber f times the rows of U they select, for fibers [fbegin, fend) */
+static inline void spt_RecordMulMatrixRange(
+    sptSemiSparseTensor *Y,
+    sptRecordSparseTensor const * const R,
+    sptNnzIndex const * fiberidx,
+    sptNnzIndex const * perm,
+    sptNnzIndex const fbegin,
+    sptNnzIndex const fend,
+    size_t const rb,
+    sptMatrix const * const U,
+    sptIndex const mode)
+{
+    sptIndex const ncols = U->ncols;
+    for(sptNnzIndex f = fbegin; f < fend; ++f) {
+        sptValue * const restrict out = Y->values.values + f * Y->stride;
+        for(sptNnzIndex j = fiberidx[f]; j < fiberidx[f+1]; ++j) {
+            char const * const rec = R->records + (perm ? perm[j] : j) * rb;
+            sptValue const val = spt_RecordValue(rec);
+            sptValue const * const urow = U->values + (size_t) spt_RecordInds(rec)[mode] * U->stride;
+            for(sptIndex k = 0; k < ncols; ++k) {
+                out[k] += val * urow[k];
+            }
+        }
+    }
+}
+
+/**
+ * OpenMP TTM over a record tensor, the counterpart of sptOmpSparseTensorMulMatrix.
+ * Records sorted at mode are read in place; others through a radix sort by fiber.
+ * @param[out] Y     an uninitialized semi sparse tensor
+ * @param[in]  R     the record tensor
+ * @param[in]  U     the matrix, with ndims[mode] rows
+ * @param[in]  mode  the mode to multiply along
+ * @param[in]  tk    the number of threads
+ */
+int sptOmpRecordSparseTensorMulMatrix(
+    sptSemiSparseTensor *Y,
+    sptRecordSparseTensor const * const R,
+    sptMatrix const * const U,
+    sptIndex const mode,
+    int const tk)
+{
+    if(mode >= R->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Mtx Records", "shape mismatch");
+    }
+    if(R->ndims[mode] != U->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Mtx Records", "shape mismatch");
+    }
+    sptNnzIndexVector fiberidx;
+    sptNnzIndex * perm;
+    int result = spt_RecordFibers(Y, &fiberidx, &perm, R, mode, U->ncols, tk, "OMP  SpTns * Mtx Records");
+    spt_CheckError(result, "OMP  SpTns * Mtx Records", NULL);
+
+    /* Equal nonzeros per thread, so a few long fibers do not hold up the rest */
+    sptNnzIndex * bounds = malloc((tk + 1) * sizeof *bounds);
+    spt_CheckOSError(!bounds, "OMP  SpTns * Mtx Records");
+    result = spt_PartitionSegments(bounds, fiberidx.data, Y->nnz, tk);
+    spt_CheckError(result, "OMP  SpTns * Mtx Records", NULL);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    sptStartTimer(timer);
+
+    size_t const rb = R->record_bytes;
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0, team = 1;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+        team = omp_get_num_threads();
+#endif
+        for(int t = tid; t < tk; t += team) {
+            if(rb == 16) {
+                spt_RecordMulMatrixRange(Y, R, fiberidx.data, perm, bounds[t], bounds[t+1], 16, U, mode);
+            } else if(rb == 32) {
+                spt_RecordMulMatrixRange(Y, R, fiberidx.data, perm, bounds[t], bounds[t+1], 32, U, mode);
+            } else {
+                spt_RecordMulMatrixRange(Y, R, fiberidx.data, perm, bounds[t], bounds[t+1], rb, U, mode);
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    /* Two flops per nonzero and column; reads the records and their rows of U, writes Y */
+    spt_KernelProbeStop(probe, timer, "OMP  SpTns * Mtx Records", 2.0 * R->nnz * U->ncols,
+        (double) R->nnz * rb + ((double) R->nnz + Y->nnz) * U->ncols * sizeof (sptValue));
+    sptFreeTimer(timer);
+
+    free(bounds);
+    free(perm);
+    sptFreeNnzIndexVector(&fiberidx);
+    return 0;
+}
+
+/**
+ * OpenMP TTV over a record tensor, the counterpart of sptOmpSparseTensorMulVector.
+ * Records sorted at mode are read in place; others through a radix sort by fiber.
+ * @param[out] Y     an uninitialized semi sparse tensor
+ * @param[in]  R     the record tensor
+ * @param[in]  V     the vector, of length ndims[mode]
+ * @param[in]  mode  the mode to multiply along
+ * @param[in]  tk    the number of threads
+ */
+int sptOmpRecordSparseTensorMulVector(
+    sptSemiSparseTensor *Y,
+    sptRecordSparseTensor const * const R,
+    sptValueVector const * const V,
+    sptIndex const mode,
+    int const tk)
+{
+    if(mode >= R->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Vec Records", "shape mismatch");
+    }
+    if(R->ndims[mode] != V->len) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Vec Records", "shape mismatch");
+    }
+    sptNnzIndexVector fiberidx;
+    sptNnzIndex * perm;
+    int result = spt_RecordFibers(Y, &fiberidx, &perm, R, mode, 1, tk, "OMP  SpTns * Vec Records");
+    spt_CheckError(result, "OMP  SpTns * Vec Records", NULL);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    size_t const rb = R->record_bytes;
+    #pragma omp parallel for schedule(dynamic, 256) num_threads(tk)
+    for(sptNnzIndex f = 0; f < Y->nnz; ++f) {
+        sptValue sum = 0;
+        for(sptNnzIndex j = fiberidx.data[f]; j < fiberidx.data[f+1]; ++j) {
+            char const * const rec = R->records + (perm ? perm[j] : j) * rb;
+            sum += spt_RecordValue(rec) * V->data[spt_RecordInds(rec)[mode]];
+        }
+        Y->values.values[f * Y->stride] = sum;
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "OMP  SpTns * Vec Records");
+    sptFreeTimer(timer);
+
+    free(perm);
+    sptFreeNnzIndexVector(&fiberidx);
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/*
+ * Mode reduction.
+ *
+ * The nonzeros are ordered by a stable radix permutation on the kept modes
+ * only, which puts everything collapsing onto one output coordinate in a run.
+ * The runs are then reduced as sptSparseTensorCoalesce reduces duplicates:
+ * each thread takes the runs starting in an even share of the sorted
+ * positions, a counting pass sizes the output and a second pass writes it.
+ */
+
+/**
+ * The modes of X that survive reducing rmodes, in increasing order, into
+ * kept, with their count in *nkept. Fails on an out-of-range or repeated
+ * mode, or if no mode would be left.
+ */
+int spt_ReduceModesKept(
+    sptIndex * kept,
+    sptIndex * nkept,
+    sptSparseTensor const * X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    char const * module)
+{
+    (void) module;
+    sptIndex const nmodes = X->nmodes;
+    if(nreduce >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "at least one mode must be kept");
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        kept[m] = 1;
+    }
+    for(sptIndex i = 0; i < nreduce; ++i) {
+        if(rmodes[i] >= nmodes || !kept[rmodes[i]]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, module, "reduced modes out of range or repeated");
+        }
+        kept[rmodes[i]] = 0;
+    }
+    *nkept = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(kept[m]) {
+            kept[(*nkept)++] = m;
+        }
+    }
+    return 0;
+}
+
+/* Whether sorted nonzeros a and b of X agree on the kept modes */
+static inline int spt_SameKept(sptSparseTensor const *X, sptIndex const nkept, sptIndex const *kept,
+    sptNnzIndex const a, sptNnzIndex const b)
+{
+    for(sptIndex i = 0; i < nkept; ++i) {
+        if(X->inds[kept[i]].data[a] != X->inds[kept[i]].data[b]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Reduce the run starting at sorted position k, setting *next past it; a pattern tensor's values are 1 */
+static inline sptValue spt_ReduceRun(
+    sptSparseTensor const *X,
+    sptIndex const nkept,
+    sptIndex const *kept,
+    sptNnzIndex const *perm,
+    sptNnzIndex const k,
+    sptReduceOp const op,
+    sptNnzIndex *next)
+{
+    sptValue const * const vals = X->values.data;
+    sptValue value = op == SPT_REDUCE_COUNT ? 1 : vals != NULL ? vals[perm[k]] : 1;
+    sptNnzIndex j = k + 1;
+    for(; j < X->nnz && spt_SameKept(X, nkept, kept, perm[j], perm[k]); ++j) {
+        sptValue const v = vals != NULL ? vals[perm[j]] : 1;
+        switch(op) {
+        case SPT_REDUCE_SUM:
+            value += v;
+            break;
+        case SPT_REDUCE_MAX:
+            value = v > value ? v : value;
+            break;
+        case SPT_REDUCE_MIN:
+            value = v < value ? v : value;
+            break;
+        default:
+            value += 1;
+            break;
+        }
+    }
+    *next = j;
+    return value;
+}
+
+/* The first run of a thread's share [lo, hi): a run entering it from the left belongs to the previous thread */
+static inline sptNnzIndex spt_ReduceShareStart(sptSparseTensor const *X, sptIndex const nkept, sptIndex const *kept,
+    sptNnzIndex const *perm, sptNnzIndex const lo, sptNnzIndex const hi)
+{
+    sptNnzIndex k = lo;
+    while(k > 0 && k < hi && spt_SameKept(X, nkept, kept, perm[k], perm[k - 1])) {
+        ++ k;
+    }
+    return k;
+}
+
+/**
+ * Collapse modes of a sparse tensor, such as a user x item x time tensor
+ * into user x item: the nonzeros of X sharing their coordinates on the kept
+ * modes are combined into one nonzero of Y. Y has the kept modes in their
+ * order in X and comes out sorted. Only the stored nonzeros take part, so
+ * SPT_REDUCE_MAX and SPT_REDUCE_MIN ignore the implicit zeros, and results
+ * that are zero are dropped. A pattern tensor counts as all ones.
+ * @param[out] Y        an uninitialized sparse tensor
+ * @param[in]  X        the sparse tensor to reduce
+ * @param[in]  nreduce  the number of modes to collapse, less than X->nmodes
+ * @param[in]  rmodes   the modes to collapse, nreduce distinct ones
+ * @param[in]  op       how the collapsed nonzeros combine
+ * @param[in]  tk       the number of threads, 0 for the default
+ */
+int sptSparseTensorReduceModes(
+    sptSparseTensor *Y,
+    const sptSparseTensor *X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    sptReduceOp const op,
+    int tk)
+{
+    if(op != SPT_REDUCE_SUM && op != SPT_REDUCE_MAX && op != SPT_REDUCE_MIN && op != SPT_REDUCE_COUNT) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns ReduceModes", "unknown reduction");
+    }
+#ifdef PARTI_USE_OPENMP
+    if(tk <= 0) {
+        tk = sptExecThreads(0);
+    }
+#else
+    tk = 1;
+#endif
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex * kept = malloc(2 * nmodes * sizeof *kept);
+    spt_CheckOSError(!kept, "SpTns ReduceModes");
+    sptIndex * const ndims = kept + nmodes;
+    sptIndex nkept;
+    int result = spt_ReduceModesKept(kept, &nkept, X, nreduce, rmodes, "SpTns ReduceModes");
+    if(result != 0) {
+        free(kept);
+        return result;
+    }
+    for(sptIndex i = 0; i < nkept; ++i) {
+        ndims[i] = X->ndims[kept[i]];
+    }
+
+    sptNnzIndex * perm = malloc((nnz > 0 ? nnz : 1) * sizeof *perm);
+    spt_CheckOSError(!perm, "SpTns ReduceModes");
+    result = spt_SparseTensorRadixPermutation(X, 0, nnz, nkept, kept, 0, perm, tk);
+    spt_CheckError(result, "SpTns ReduceModes", NULL);
+
+    /* Count the surviving runs that start in each thread's share */
+    sptNnzIndex * offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SpTns ReduceModes");
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex k = spt_ReduceShareStart(X, nkept, kept, perm, nnz * tid / tk, hi);
+        sptNnzIndex count = 0;
+        while(k < hi) {
+            count += spt_ReduceRun(X, nkept, kept, perm, k, op, &k) != 0;
+        }
+        offsets[tid + 1] = count;
+    }
+    for(int t = 0; t < tk; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    sptNnzIndex const nnz_out = offsets[tk];
+
+    result = sptNewSparseTensor(Y, nkept, ndims);
+    spt_CheckError(result, "SpTns ReduceModes", NULL);
+    for(sptIndex i = 0; i < nkept; ++i) {
+        result = sptResizeIndexVector(&Y->inds[i], nnz_out);
+        spt_CheckError(result, "SpTns ReduceModes", NULL);
+    }
+    result = sptResizeValueVector(&Y->values, nnz_out);
+    spt_CheckError(result, "SpTns ReduceModes", NULL);
+    Y->nnz = nnz_out;
+
+    /* Write each surviving run at its final slot */
+    #pragma omp parallel num_threads(tk)
+    {
+#ifdef PARTI_USE_OPENMP
+        int const tid = omp_get_thread_num();
+#else
+        int const tid = 0;
+#endif
+        sptNnzIndex const hi = nnz * (tid + 1) / tk;
+        sptNnzIndex k = spt_ReduceShareStart(X, nkept, kept, perm, nnz * tid / tk, hi);
+        sptNnzIndex out = offsets[tid];
+        while(k < hi) {
+            sptNnzIndex const head = perm[k];
+            sptValue const value = spt_ReduceRun(X, nkept, kept, perm, k, op, &k);
+            if(value != 0) {
+                for(sptIndex i = 0; i < nkept; ++i) {
+                    Y->inds[i].data[out] = X->inds[kept[i]].data[head];
+                }
+                Y->values.data[out] = value;
+                ++ out;
+            }
+        }
+    }
+    free(offsets);
+    free(perm);
+    free(kept);
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <thrust/device_ptr.h>
+#include <thrust/fill.h>
+#include <thrust/functional.h>
+#include <thrust/reduce.h>
+#include <thrust/scan.h>
+#include "sptensor.h"
+#include "sort_cuda.h"
+#include "../cudawrap.h"
+
+/* start[z]: whether sorted nonzero z differs from the previous one on the kept modes */
+__global__ static void spt_ReduceStartKernel(
+    sptNnzIndex *start, sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nkept, sptIndex const *kept)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptNnzIndex s = z == 0;
+    for(sptIndex i = 0; i < nkept && !s; ++i) {
+        s = inds[kept[i] * nnz + z] != inds[kept[i] * nnz + z - 1];
+    }
+    start[z] = s;
+}
+
+/* head[run[z] - 1] = z at every run start, run[] the inclusive scan of the starts */
+__global__ static void spt_ReduceHeadKernel(
+    sptNnzIndex *head, sptNnzIndex const *start, sptNnzIndex const *run, sptNnzIndex const nnz)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z < nnz && start[z]) {
+        head[run[z] - 1] = z;
+    }
+}
+
+__global__ static void spt_ReduceNonzeroKernel(sptNnzIndex *flags, sptValue const *vals, sptNnzIndex const n)
+{
+    sptNnzIndex const r = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(r < n) {
+        flags[r] = vals[r] != 0;
+    }
+}
+
+/* Write run r, if its value is nonzero, to output slot pos[r] */
+__global__ static void spt_ReduceWriteKernel(
+    sptIndex *out_inds, sptValue *out_vals, sptNnzIndex const nnz_out,
+    sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nkept, sptIndex const *kept,
+    sptNnzIndex const *head, sptValue const *run_vals, sptNnzIndex const *pos, sptNnzIndex const nruns)
+{
+    sptNnzIndex const r = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(r >= nruns || run_vals[r] == 0) {
+        return;
+    }
+    sptNnzIndex const p = pos[r];
+    for(sptIndex i = 0; i < nkept; ++i) {
+        out_inds[i * nnz_out + p] = inds[kept[i] * nnz + head[r]];
+    }
+    out_vals[p] = run_vals[r];
+}
+
+
+/**
+ * Collapse modes of a sparse tensor on the GPU, with the result of
+ * sptSparseTensorReduceModes. The nonzeros are sorted on the device by the
+ * kept modes, and the runs this leaves are combined by a segmented reduction.
+ * @param[out] Y        an uninitialized sparse tensor
+ * @param[in]  X        the sparse tensor to reduce
+ * @param[in]  nreduce  the number of modes to collapse, less than X->nmodes
+ * @param[in]  rmodes   the modes to collapse, nreduce distinct ones
+ * @param[in]  op       how the collapsed nonzeros combine
+ */
+int sptCudaSparseTensorReduceModes(
+    sptSparseTensor *Y,
+    const sptSparseTensor *X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    sptReduceOp const op)
+{
+    if(op != SPT_REDUCE_SUM && op != SPT_REDUCE_MAX && op != SPT_REDUCE_MIN && op != SPT_REDUCE_COUNT) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns ReduceModes", "unknown reduction");
+    }
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex * kept = new sptIndex[2 * nmodes];
+    sptIndex * const ndims = kept + nmodes;
+    sptIndex nkept;
+    int result = spt_ReduceModesKept(kept, &nkept, X, nreduce, rmodes, "CUDA SpTns ReduceModes");
+    if(result != 0) {
+        delete[] kept;
+        return result;
+    }
+    for(sptIndex i = 0; i < nkept; ++i) {
+        ndims[i] = X->ndims[kept[i]];
+    }
+    result = sptNewSparseTensor(Y, nkept, ndims);
+    spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+    if(nnz == 0) {
+        delete[] kept;
+        return 0;
+    }
+
+    /* Sort by the kept modes; a pattern tensor, and every tensor counted, has values 1 */
+    sptIndex * dev_inds;
+    sptValue * dev_vals;
+    uint64_t * dev_keys;
+    sptIndex nwords;
+    result = spt_CudaUploadCoo(X, &dev_inds, &dev_vals);
+    spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+    thrust::device_ptr<sptValue> vals(dev_vals);
+    if(X->values.data == NULL || op == SPT_REDUCE_COUNT) {
+        thrust::fill(vals, vals + nnz, (sptValue) 1);
+    }
+    result = spt_CudaLexKeys(&dev_keys, &nwords, dev_inds, nnz, nkept, X->ndims, kept, 0, 0);
+    spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+    result = spt_CudaSortCoo(dev_inds, dev_vals, nnz, nmodes, dev_keys, nwords);
+    spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+    cudaFree(dev_keys);
+
+    /* Number the runs, then reduce each one keyed by its number */
+    sptIndex * dev_kept;
+    sptNnzIndex * dev_work;
+    sptValue * dev_run_vals;
+    result = sptCudaDuplicateMemory(&dev_kept, kept, nkept * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    result = cudaMalloc((void **) &dev_work, 4 * nnz * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    result = cudaMalloc((void **) &dev_run_vals, nnz * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    sptNnzIndex * const dev_start = dev_work;
+    sptNnzIndex * const dev_run = dev_work + nnz;
+    sptNnzIndex * const dev_run_keys = dev_work + 2 * nnz;
+    sptNnzIndex * const dev_head = dev_work + 3 * nnz;
+    spt_ReduceStartKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_start, dev_inds, nnz, nkept, dev_kept);
+    thrust::device_ptr<sptNnzIndex> start(dev_start), run(dev_run), run_keys(dev_run_keys);
+    thrust::device_ptr<sptValue> run_vals(dev_run_vals);
+    thrust::inclusive_scan(start, start + nnz, run);
+    sptNnzIndex nruns;
+    cudaMemcpy(&nruns, dev_run + nnz - 1, sizeof nruns, cudaMemcpyDeviceToHost);
+    switch(op) {
+    case SPT_REDUCE_MAX:
+        thrust::reduce_by_key(run, run + nnz, vals, run_keys, run_vals,
+            thrust::equal_to<sptNnzIndex>(), thrust::maximum<sptValue>());
+        break;
+    case SPT_REDUCE_MIN:
+        thrust::reduce_by_key(run, run + nnz, vals, run_keys, run_vals,
+            thrust::equal_to<sptNnzIndex>(), thrust::minimum<sptValue>());
+        break;
+    default:
+        thrust::reduce_by_key(run, run + nnz, vals, run_keys, run_vals);
+        break;
+    }
+    spt_ReduceHeadKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_head, dev_start, dev_run, nnz);
+
+    /* Drop the runs that reduced to zero */
+    sptNnzIndex * const dev_keep = dev_start;
+    sptNnzIndex * const dev_pos = dev_run_keys;
+    spt_ReduceNonzeroKernel<<<spt_CudaLayoutBlocks(nruns), PARTI_CUDA_LAYOUT_NTHREADS>>>(dev_keep, dev_run_vals, nruns);
+    thrust::device_ptr<sptNnzIndex> keep(dev_keep), pos(dev_pos);
+    sptNnzIndex last_keep, last_pos;
+    cudaMemcpy(&last_keep, dev_keep + nruns - 1, sizeof last_keep, cudaMemcpyDeviceToHost);
+    thrust::exclusive_scan(keep, keep + nruns, pos);
+    cudaMemcpy(&last_pos, dev_pos + nruns - 1, sizeof last_pos, cudaMemcpyDeviceToHost);
+    sptNnzIndex const nnz_out = last_pos + last_keep;
+
+    sptIndex * dev_out_inds;
+    sptValue * dev_out_vals;
+    result = cudaMalloc((void **) &dev_out_inds, (nkept * nnz_out + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    result = cudaMalloc((void **) &dev_out_vals, (nnz_out + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    spt_ReduceWriteKernel<<<spt_CudaLayoutBlocks(nruns), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+        dev_out_inds, dev_out_vals, nnz_out, dev_inds, nnz, nkept, dev_kept, dev_head, dev_run_vals, dev_pos, nruns);
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+
+    for(sptIndex i = 0; i < nkept; ++i) {
+        result = sptResizeIndexVector(&Y->inds[i], nnz_out);
+        spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+        result = cudaMemcpy(Y->inds[i].data, dev_out_inds + i * nnz_out, nnz_out * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    }
+    result = sptResizeValueVector(&Y->values, nnz_out);
+    spt_CheckError(result, "CUDA SpTns ReduceModes", NULL);
+    result = cudaMemcpy(Y->values.data, dev_out_vals, nnz_out * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns ReduceModes");
+    Y->nnz = nnz_out;
+
+    cudaFree(dev_out_inds);
+    cudaFree(dev_out_vals);
+    cudaFree(dev_run_vals);
+    cudaFree(dev_work);
+    cudaFree(dev_kept);
+    cudaFree(dev_inds);
+    cudaFree(dev_vals);
+    delete[] kept;
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Locality-improving relabelings of the indices of a sparse tensor.
+ *
+ * Like sptGetRandomShuffledIndices, they fill map_inds[m][i] with the new
+ * label of index i of mode m, for sptSparseTensorShuffleIndices to apply and
+ * the *InverseShuffleIndices functions to undo on the factors.
+ */
+
+/* A row of the mode-m matricization: its index and sorted, distinct columns */
+typedef struct {
+    sptIndex row;
+    sptNnzIndex ncols;
+    sptNnzIndex const * cols;
+} spt_LexiRow;
+
+/*
+ * Decreasing lexicographic order of rows seen as 0/1 vectors: the row with
+ * a column the other lacks at the first difference comes first, so a row
+ * precedes its own prefixes and empty rows come last.
+ */
+static int spt_CompareLexiRow(const void *a, const void *b) {
+    spt_LexiRow const * ra = a;
+    spt_LexiRow const * rb = b;
+    sptNnzIndex const n = ra->ncols < rb->ncols ? ra->ncols : rb->ncols;
+    for(sptNnzIndex k = 0; k < n; ++k) {
+        if(ra->cols[k] != rb->cols[k]) {
+            return ra->cols[k] < rb->cols[k] ? -1 : 1;
+        }
+    }
+    if(ra->ncols != rb->ncols) {
+        return ra->ncols > rb->ncols ? -1 : 1;
+    }
+    return ra->row < rb->row ? -1 : ra->row > rb->row;
+}
+
+/* Whether nonzeros z-1 and z of tsr differ in a mode other than mode */
+static int spt_DiffersExceptMode(const sptSparseTensor *tsr, sptNnzIndex const z, sptIndex const mode) {
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(m != mode && tsr->inds[m].data[z - 1] != tsr->inds[m].data[z]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Relabel mode `mode` of W, in place, by Lexi-Order; perm receives old label -> new label */
+static int spt_LexiOrderMode(sptSparseTensor *W, sptIndex const mode, sptIndex * perm) {
+    sptIndex const nrows = W->ndims[mode];
+    sptNnzIndex const nnz = W->nnz;
+
+    /* Columns are the tuples of the other modes, in lexicographic order */
+    sptSparseTensorSortIndexAtMode(W, mode, 1);
+
+    sptNnzIndex * rowptr = calloc((size_t) nrows + 1, sizeof *rowptr);
+    sptNnzIndex * cols = malloc((nnz > 0 ? nnz : 1) * sizeof *cols);
+    spt_LexiRow * rows = malloc((nrows > 0 ? nrows : 1) * sizeof *rows);
+    spt_CheckOSError(!rowptr || !cols || !rows, "SpTns LexiOrder");
+
+    sptIndex const * rowind = W->inds[mode].data;
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        ++ rowptr[rowind[z] + 1];
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        rowptr[i + 1] += rowptr[i];
+        rows[i].row = i;
+        rows[i].ncols = 0;
+        rows[i].cols = cols + rowptr[i];
+    }
+    /* Scanning in column order leaves each row's columns sorted */
+    sptNnzIndex col = 0;
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        if(z > 0 && spt_DiffersExceptMode(W, z, mode)) {
+            ++ col;
+        }
+        spt_LexiRow * r = &rows[rowind[z]];
+        /* Repeated coordinates give a column twice */
+        if(r->ncols == 0 || r->cols[r->ncols - 1] != col) {
+            cols[rowptr[rowind[z]] + r->ncols] = col;
+            ++ r->ncols;
+        }
+    }
+
+    qsort(rows, nrows, sizeof *rows, spt_CompareLexiRow);
+    for(sptIndex i = 0; i < nrows; ++i) {
+        perm[rows[i].row] = i;
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        W->inds[mode].data[z] = perm[W->inds[mode].data[z]];
+    }
+    sptSparseTensorDropCache(W);
+
+    free(rows);
+    free(cols);
+    free(rowptr);
+    return 0;
+}
+
+/**
+ * Compute a Lexi-Order relabeling of all indices.
+ *
+ * Each iteration visits the modes in turn and reorders the rows of the
+ * mode's matricization, with columns ordered lexicographically by the current
+ * labels of the other modes, in decreasing lexicographic order of their
+ * nonzero patterns. Nonzeros that share row or column neighbours get close
+ * labels, which fills HiCOO blocks densely and lets kernels reuse factor rows.
+ * A few iterations are usually enough.
+ *
+ * @param[in]  tsr      the tensor to relabel, left unchanged
+ * @param[out] map_inds length `nmodes`, each of length `ndims[m]`, receives the new label of each index
+ * @param[in]  niters   the number of iterations over all modes
+ */
+int sptGetLexiOrderShuffledIndices(const sptSparseTensor *tsr, sptIndex ** map_inds, int const niters) {
+    int result;
+    sptSparseTensor W;
+    result = sptCopySparseTensor(&W, tsr, 1);
+    spt_CheckError(result, "SpTns LexiOrder", NULL);
+
+    sptIndex max_ndim = 1;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        for(sptIndex i = 0; i < tsr->ndims[m]; ++i) {
+            map_inds[m][i] = i;
+        }
+        if(tsr->ndims[m] > max_ndim) {
+            max_ndim = tsr->ndims[m];
+        }
+    }
+    sptIndex * perm = malloc(max_ndim * sizeof *perm);
+    spt_CheckOSError(!perm, "SpTns LexiOrder");
+
+    for(int it = 0; it < niters; ++it) {
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            result = spt_LexiOrderMode(&W, m, perm);
+            spt_CheckError(result, "SpTns LexiOrder", NULL);
+            for(sptIndex i = 0; i < tsr->ndims[m]; ++i) {
+                map_inds[m][i] = perm[map_inds[m][i]];
+            }
+        }
+    }
+
+    free(perm);
+    sptFreeSparseTensor(&W);
+    return 0;
+}
+
+
+/* A vertex of the mode hypergraph, index i of mode m at offset[m] + i */
+typedef struct {
+    sptNnzIndex degree;
+    sptNnzIndex vertex;
+} spt_BfsVertex;
+
+static int spt_CompareBfsVertex(const void *a, const void *b) {
+    spt_BfsVertex const * va = a;
+    spt_BfsVertex const * vb = b;
+    if(va->degree != vb->degree) {
+        return va->degree < vb->degree ? -1 : 1;
+    }
+    return va->vertex < vb->vertex ? -1 : va->vertex > vb->vertex;
+}
+
+/**
+ * Compute a breadth-first relabeling of all indices on the mode hypergraph.
+ *
+ * The indices of all modes are the vertices and every nonzero is a hyperedge
+ * joining its indices. Each connected component is searched from its vertex
+ * of lowest degree, visiting the neighbours of a vertex by increasing degree
+ * as in Cuthill-McKee, and each mode numbers its indices in the order they
+ * are reached. Indices without nonzeros are numbered last.
+ *
+ * @param[in]  tsr      the tensor to relabel, left unchanged
+ * @param[out] map_inds length `nmodes`, each of length `ndims[m]`, receives the new label of each index
+ * @param[in]  reverse  nonzero to reverse the numbering of each mode (RCM)
+ */
+int sptGetBfsShuffledIndices(const sptSparseTensor *tsr, sptIndex ** map_inds, int const reverse) {
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+
+    sptNnzIndex * offset = malloc((nmodes + 1) * sizeof *offset);
+    spt_CheckOSError(!offset, "SpTns BFS");
+    offset[0] = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        offset[m + 1] = offset[m] + tsr->ndims[m];
+    }
+    sptNnzIndex const nv = offset[nmodes];
+
+    /* Incident nonzeros of every vertex */
+    sptNnzIndex * ptr = calloc(nv + 1, sizeof *ptr);
+    sptNnzIndex * edges = malloc((nnz > 0 ? nnz * nmodes : 1) * sizeof *edges);
+    spt_BfsVertex * start = malloc((nv > 0 ? nv : 1) * sizeof *start);
+    spt_BfsVertex * queue = malloc((nv > 0 ? nv : 1) * sizeof *queue);
+    char * seen = calloc(nv > 0 ? nv : 1, 1);
+    char * done = calloc(nnz > 0 ? nnz : 1, 1);
+    sptIndex * next = calloc(nmodes, sizeof *next);
+    spt_CheckOSError(!ptr || !edges || !start || !queue || !seen || !done || !next, "SpTns BFS");
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            ++ ptr[offset[m] + tsr->inds[m].data[z] + 1];
+        }
+    }
+    for(sptNnzIndex v = 0; v < nv; ++v) {
+        start[v].degree = ptr[v + 1];
+        start[v].vertex = v;
+        ptr[v + 1] += ptr[v];
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptNnzIndex const v = offset[m] + tsr->inds[m].data[z];
+            edges[ptr[v]++] = z;
+        }
+    }
+    /* Filling advanced each ptr[v] to the start of v + 1 */
+    for(sptNnzIndex v = nv; v > 0; --v) {
+        ptr[v] = ptr[v - 1];
+    }
+    ptr[0] = 0;
+    qsort(start, nv, sizeof *start, spt_CompareBfsVertex);
+
+    sptNnzIndex head = 0, tail = 0;
+    for(sptNnzIndex s = 0; s < nv; ++s) {
+        if(seen[start[s].vertex]) {
+            continue;
+        }
+        if(start[s].degree == 0) {
+            /* Isolated indices, numbered once all components are done */
+            continue;
+        }
+        seen[start[s].vertex] = 1;
+        queue[tail++] = start[s];
+        while(head < tail) {
+            sptNnzIndex const v = queue[head++].vertex;
+            sptIndex m = 0;
+            while(offset[m + 1] <= v) {
+                ++ m;
+            }
+            map_inds[m][v - offset[m]] = next[m]++;
+
+            sptNnzIndex const first = tail;
+            for(sptNnzIndex e = ptr[v]; e < ptr[v + 1]; ++e) {
+                sptNnzIndex const z = edges[e];
+                if(done[z]) {
+                    continue;
+                }
+                done[z] = 1;
+                for(sptIndex mm = 0; mm < nmodes; ++mm) {
+                    sptNnzIndex const u = offset[mm] + tsr->inds[mm].data[z];
+                    if(!seen[u]) {
+                        seen[u] = 1;
+                        queue[tail].vertex = u;
+                        queue[tail].degree = ptr[u + 1] - ptr[u];
+                        ++ tail;
+                    }
+                }
+            }
+            qsort(queue + first, tail - first, sizeof *queue, spt_CompareBfsVertex);
+        }
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        for(sptIndex i = 0; i < tsr->ndims[m]; ++i) {
+            if(!seen[offset[m] + i]) {
+                map_inds[m][i] = next[m]++;
+            }
+        }
+        if(reverse) {
+            for(sptIndex i = 0; i < tsr->ndims[m]; ++i) {
+                map_inds[m][i] = tsr->ndims[m] - 1 - map_inds[m][i];
+            }
+        }
+    }
+
+    free(next);
+    free(done);
+    free(seen);
+    free(queue);
+    free(start);
+    free(edges);
+    free(ptr);
+    free(offset);
+    return 0;
+}
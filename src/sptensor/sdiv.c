@@ -20,9 +20,9 @@
 #include "sptensor.h"
 
 int sptSparseTensorDivScalar(sptSparseTensor *X, sptValue const a) {
+    sptSparseTensorDropCache(X);
     if(a != 0) {
         sptNnzIndex i;
-        #pragma omp parallel for schedule(static)
         for(i = 0; i < X->nnz; ++i) {
             X->values.data[i] /= a;
         }
@@ -0,0 +1,223 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <stdlib.h>
+#if defined(__BMI2__)
+  #include <immintrin.h>
+#endif
+
+/*
+ * Space-filling curve keys (Morton and Hilbert) for tensors of any order.
+ *
+ * With B bits per coordinate, bit j of mode m lands at bit j * nmodes + m
+ * of an (nmodes * B)-bit key, split into 64-bit words. Every aligned
+ * power-of-two block is therefore contiguous in key order, which is what
+ * HiCOO needs. The higher the mode, the more significant its bit at each level.
+ * Hilbert keys use the same interleaving after Skilling's transform.
+ */
+
+/* Bits of mode m that belong to key word q: b = j - jlo for j in [jlo, jlo + count). */
+typedef struct {
+    unsigned jlo;
+    unsigned count;
+    uint64_t mask;
+} spt_CurveSlice;
+
+typedef struct {
+    sptSparseTensor const * tsr;
+    sptNnzIndex begin;
+    sptIndex nmodes;
+    unsigned bits;
+    sptIndex nwords;
+    int hilbert;
+    spt_CurveSlice const * slices;  /// nwords * nmodes, word-major, least significant word first
+} spt_CurveContext;
+
+
+static void spt_InitCurveSlices(spt_CurveSlice * slices, sptIndex const nmodes, unsigned const bits, sptIndex const nwords)
+{
+    for(sptIndex q = 0; q < nwords; ++q) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            spt_CurveSlice * s = &slices[q * nmodes + m];
+            s->jlo = 0;
+            s->count = 0;
+            s->mask = 0;
+            for(unsigned j = 0; j < bits; ++j) {
+                uint64_t const pos = (uint64_t) j * nmodes + m;
+                if(pos / 64 == q) {
+                    if(s->count == 0) {
+                        s->jlo = j;
+                    }
+                    ++ s->count;
+                    s->mask |= (uint64_t) 1 << (pos % 64);
+                }
+            }
+        }
+    }
+}
+
+static inline uint64_t spt_DepositBits(uint64_t const src, spt_CurveSlice const * s)
+{
+#if defined(__BMI2__)
+    return _pdep_u64(src >> s->jlo, s->mask);
+#else
+    uint64_t out = 0, mask = s->mask;
+    uint64_t v = src >> s->jlo;
+    for(unsigned k = 0; k < s->count; ++k) {
+        uint64_t const lowest = mask & (~mask + 1);
+        if(v & 1) {
+            out |= lowest;
+        }
+        v >>= 1;
+        mask ^= lowest;
+    }
+    return out;
+#endif
+}
+
+/**
+ * Skilling's transform from axes to the transposed Hilbert index, in place.
+ * x[0] is the most significant axis.
+ */
+static void spt_HilbertAxesToTranspose(uint32_t * x, sptIndex const n, unsigned const bits)
+{
+    if(bits == 0) {
+        return;
+    }
+    uint32_t const top = (uint32_t) 1 << (bits - 1);
+    uint32_t t;
+    for(uint32_t q = top; q > 1; q >>= 1) {
+        uint32_t const p = q - 1;
+        for(sptIndex i = 0; i < n; ++i) {
+            if(x[i] & q) {
+                x[0] ^= p;
+            } else {
+                t = (x[0] ^ x[i]) & p;
+                x[0] ^= t;
+                x[i] ^= t;
+            }
+        }
+    }
+    for(sptIndex i = 1; i < n; ++i) {
+        x[i] ^= x[i-1];
+    }
+    t = 0;
+    for(uint32_t q = top; q > 1; q >>= 1) {
+        if(x[n-1] & q) {
+            t ^= q - 1;
+        }
+    }
+    for(sptIndex i = 0; i < n; ++i) {
+        x[i] ^= t;
+    }
+}
+
+static void spt_CurveKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * vctx)
+{
+    spt_CurveContext const * const ctx = vctx;
+    sptIndex const nmodes = ctx->nmodes;
+    sptIndex const q = ctx->nwords - 1 - word;
+    spt_CurveSlice const * const slices = ctx->slices + q * nmodes;
+    uint32_t coord[nmodes];
+
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        sptNnzIndex const z = ctx->begin + perm[i];
+        if(ctx->hilbert) {
+            /* The transform puts its first axis first, so feed the modes reversed. */
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                coord[nmodes - 1 - m] = ctx->tsr->inds[m].data[z];
+            }
+            spt_HilbertAxesToTranspose(coord, nmodes, ctx->bits);
+            for(sptIndex m = 0; m < nmodes / 2; ++m) {
+                uint32_t const tmp = coord[m];
+                coord[m] = coord[nmodes - 1 - m];
+                coord[nmodes - 1 - m] = tmp;
+            }
+        } else {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                coord[m] = ctx->tsr->inds[m].data[z];
+            }
+        }
+        uint64_t key = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            key |= spt_DepositBits(coord[m], &slices[m]);
+        }
+        keys[i] = key;
+    }
+}
+
+
+/**
+ * Sort the nonzeros [begin, end) of a sparse tensor along a space-filling curve.
+ * @param tsr     the sparse tensor to operate on
+ * @param begin   first nonzero of the range
+ * @param end     end of the range, exclusive
+ * @param hilbert 1 for Hilbert order, 0 for Morton (Z) order
+ * @param tk      the number of threads
+ */
+int spt_SparseTensorCurveSort(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    int const hilbert,
+    int const tk)
+{
+    sptNnzIndex const n = end - begin;
+    sptIndex const nmodes = tsr->nmodes;
+    if(n < 2) {
+        return 0;
+    }
+
+    unsigned bits = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        unsigned const b = spt_RadixBitWidth(tsr->ndims[m]);
+        if(b > bits) {
+            bits = b;
+        }
+    }
+    sptIndex const nwords = (sptIndex) (((uint64_t) nmodes * bits + 63) / 64);
+    if(nwords == 0) {
+        return 0;
+    }
+
+    spt_CurveSlice * slices = malloc((size_t) nwords * nmodes * sizeof *slices);
+    spt_CheckOSError(!slices, "SpTns Curve Sort");
+    unsigned * word_bits = malloc(nwords * sizeof *word_bits);
+    spt_CheckOSError(!word_bits, "SpTns Curve Sort");
+    spt_InitCurveSlices(slices, nmodes, bits, nwords);
+    for(sptIndex w = 0; w < nwords; ++w) {
+        sptIndex const q = nwords - 1 - w;
+        uint64_t const total = (uint64_t) nmodes * bits;
+        word_bits[w] = (unsigned) (total - q * 64 < 64 ? total - q * 64 : 64);
+    }
+
+    spt_CurveContext ctx = { tsr, begin, nmodes, bits, nwords, hilbert, slices };
+    sptNnzIndex * perm = malloc(n * sizeof *perm);
+    spt_CheckOSError(!perm, "SpTns Curve Sort");
+    int result = spt_RadixSortPermutation(perm, n, nwords, word_bits, spt_CurveKey, &ctx, tk);
+    if(result == 0) {
+        result = spt_SparseTensorApplyPermutation(tsr, begin, n, perm, tk);
+    }
+
+    free(perm);
+    free(word_bits);
+    free(slices);
+    return result;
+}
@@ -0,0 +1,249 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+
+/**
+ * Split a sparse tensor into nshards consecutive ranges of whole slices of
+ * `mode` with about equal nonzeros, see spt_PartitionSegments. Unless the
+ * indices of `mode` are already nondecreasing, the tensor is sorted here with
+ * `mode` leading, so every shard is one contiguous range of nonzeros and can be
+ * taken as a view by sptSparseTensorShardView. A shard is empty when one slice
+ * alone outweighs a share.
+ *
+ * @param[out] sh      the sharding, uninitialized
+ * @param[in]  tsr     the tensor to split, sorted in place if needed
+ * @param[in]  mode    the mode whose slices are kept whole
+ * @param[in]  nshards the number of shards
+ */
+int sptNewSparseTensorSharding(sptSparseTensorSharding *sh, sptSparseTensor *tsr, sptIndex const mode, sptIndex const nshards)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    if(mode >= nmodes) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Shard", "mode >= nmodes");
+    }
+    if(nshards < 1 || nshards > (sptIndex) INT32_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Shard", "nshards out of range");
+    }
+
+    if(!spt_SparseTensorIsSliceSorted(tsr, mode)) {
+        sptIndex * order = malloc(nmodes * sizeof *order);
+        spt_CheckOSError(!order, "SpTns Shard");
+        order[0] = mode;
+        for(sptIndex m = 0, i = 1; m < nmodes; ++m) {
+            if(m != mode) {
+                order[i++] = m;
+            }
+        }
+        sptSparseTensorSortIndexCustomOrder(tsr, order, 1);
+        free(order);
+    }
+
+    sptNnzIndex const * ptr = spt_SparseTensorSlicePtr(tsr, mode);
+    sptNnzIndex * bounds = malloc((nshards + 1) * sizeof *bounds);
+    sh->slice_ptr = malloc((nshards + 1) * sizeof *sh->slice_ptr);
+    sh->nnz_ptr = malloc((nshards + 1) * sizeof *sh->nnz_ptr);
+    spt_CheckOSError(!ptr || !bounds || !sh->slice_ptr || !sh->nnz_ptr, "SpTns Shard");
+    int result = spt_PartitionSegments(bounds, ptr, tsr->ndims[mode], (int) nshards);
+    spt_CheckError(result, "SpTns Shard", NULL);
+    for(sptIndex s = 0; s <= nshards; ++s) {
+        sh->slice_ptr[s] = (sptIndex) bounds[s];
+        sh->nnz_ptr[s] = ptr[bounds[s]];
+    }
+    free(bounds);
+    sh->mode = mode;
+    sh->nshards = nshards;
+
+    return 0;
+}
+
+
+/**
+ * Release a sharding created by sptNewSparseTensorSharding
+ */
+void sptFreeSparseTensorSharding(sptSparseTensorSharding *sh)
+{
+    free(sh->slice_ptr);
+    free(sh->nnz_ptr);
+    sh->slice_ptr = NULL;
+    sh->nnz_ptr = NULL;
+    sh->nshards = 0;
+}
+
+
+/**
+ * Take shard s of a sharded tensor as a tensor of its own without copying:
+ * `inds[m].data` and `values.data` point into the nonzeros of `tsr`, and the
+ * indices and `ndims` stay global. The view is valid while `tsr` is neither
+ * freed nor reordered. In-place kernels such as sorting work and only move the
+ * shard's own nonzeros; the arrays must not be grown or freed, so release the
+ * view with sptFreeSparseTensorShardView instead of sptFreeSparseTensor.
+ *
+ * @param[out] view an uninitialized sparse tensor
+ * @param[in]  tsr  the tensor the sharding was made for
+ * @param[in]  sh   the sharding
+ * @param[in]  s    the shard to take
+ */
+int sptSparseTensorShardView(sptSparseTensor *view, sptSparseTensor const *tsr, sptSparseTensorSharding const *sh, sptIndex const s)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    if(s >= sh->nshards) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Shard", "s >= nshards");
+    }
+    if(sh->nnz_ptr[sh->nshards] != tsr->nnz || sh->slice_ptr[sh->nshards] != tsr->ndims[sh->mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Shard", "sharding was made for another tensor");
+    }
+    sptNnzIndex const begin = sh->nnz_ptr[s];
+    sptNnzIndex const nnz = sh->nnz_ptr[s+1] - begin;
+
+    view->nmodes = nmodes;
+    view->nnz = nnz;
+    view->ndims = malloc(nmodes * sizeof *view->ndims);
+    view->sortorder = malloc(nmodes * sizeof *view->sortorder);
+    view->inds = malloc(nmodes * sizeof *view->inds);
+    spt_CheckOSError(!view->ndims || !view->sortorder || !view->inds, "SpTns Shard");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        view->ndims[m] = tsr->ndims[m];
+        view->sortorder[m] = tsr->sortorder[m];
+        view->inds[m].len = nnz;
+        view->inds[m].cap = nnz;
+        view->inds[m].data = tsr->inds[m].data + begin;
+    }
+    view->values.len = tsr->values.data != NULL ? nnz : 0;
+    view->values.cap = view->values.len;
+    view->values.data = tsr->values.data != NULL ? tsr->values.data + begin : NULL;
+    view->cache = NULL;
+
+    return 0;
+}
+
+
+/**
+ * Release a shard view taken by sptSparseTensorShardView; the nonzeros stay with their tensor
+ */
+void sptFreeSparseTensorShardView(sptSparseTensor *view)
+{
+    spt_SparseTensorFreeCache(view);
+    free(view->sortorder);
+    free(view->ndims);
+    free(view->inds);
+    view->nmodes = 0;
+    view->nnz = 0;
+}
+
+
+#ifdef PARTI_USE_MPI
+
+/**
+ * Distribute a sparse tensor held by `root` over the ranks of comm, rank p
+ * receiving shard p of the sharding of sptNewSparseTensorSharding along
+ * `mode`, so the ranks own disjoint ranges of whole slices with about equal
+ * nonzeros. `ndims` is the global shape on every rank, so the parts can be
+ * fed to sptMpiCpdAls directly.
+ *
+ * @param[out] local an uninitialized sparse tensor, holding the rank's shard on return
+ * @param[in]  tsr   the whole tensor on root, sorted in place there if needed; ignored elsewhere
+ * @param[in]  mode  the mode whose slices are kept whole
+ * @param[in]  root  the rank holding tsr
+ * @param[in]  comm  the communicator sharing the tensor
+ */
+int sptMpiScatterSparseTensor(sptSparseTensor *local, sptSparseTensor *tsr, sptIndex const mode, int const root, MPI_Comm comm)
+{
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    /* The shape, then the nonzero counts of the shards */
+    unsigned long long header[2] = { 0, 0 };
+    sptSparseTensorSharding sh;
+    int result = 0;
+    if(rank == root) {
+        result = sptNewSparseTensorSharding(&sh, tsr, mode, (sptIndex) nprocs);
+        header[0] = result == 0 ? tsr->nmodes : 0;
+        header[1] = tsr->values.data != NULL;
+    }
+    MPI_Bcast(header, 2, MPI_UNSIGNED_LONG_LONG, root, comm);
+    if(header[0] == 0) {
+        spt_CheckError(rank == root && result != 0 ? result : SPTERR_VALUE_ERROR, "SpTns MPI Scatter", "root could not shard the tensor");
+    }
+    sptIndex const nmodes = (sptIndex) header[0];
+    /* ndims, then sortorder */
+    sptIndex * shape = malloc(2 * nmodes * sizeof *shape);
+    spt_CheckOSError(!shape, "SpTns MPI Scatter");
+    if(rank == root) {
+        memcpy(shape, tsr->ndims, nmodes * sizeof *shape);
+        memcpy(shape + nmodes, tsr->sortorder, nmodes * sizeof *shape);
+    }
+    MPI_Bcast(shape, (int) (2 * nmodes), PARTI_MPI_INDEX, root, comm);
+
+    int * counts = NULL;
+    int * displs = NULL;
+    if(rank == root) {
+        counts = malloc(nprocs * sizeof *counts);
+        displs = malloc(nprocs * sizeof *displs);
+        spt_CheckOSError(!counts || !displs, "SpTns MPI Scatter");
+        for(int p = 0; p < nprocs; ++p) {
+            sptNnzIndex const n = sh.nnz_ptr[p+1] - sh.nnz_ptr[p];
+            if(n > INT32_MAX || sh.nnz_ptr[p] > INT32_MAX) {
+                spt_CheckError(SPTERR_VALUE_ERROR, "SpTns MPI Scatter", "shard exceeds the MPI count range");
+            }
+            counts[p] = (int) n;
+            displs[p] = (int) sh.nnz_ptr[p];
+        }
+    }
+    int local_nnz = 0;
+    MPI_Scatter(counts, 1, MPI_INT, &local_nnz, 1, MPI_INT, root, comm);
+
+    result = sptNewSparseTensor(local, nmodes, shape);
+    spt_CheckError(result, "SpTns MPI Scatter", NULL);
+    /* Each shard is a range of the tensor on root, and keeps its order */
+    memcpy(local->sortorder, shape + nmodes, nmodes * sizeof *shape);
+    free(shape);
+    local->nnz = (sptNnzIndex) local_nnz;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&local->inds[m], local->nnz);
+        spt_CheckError(result, "SpTns MPI Scatter", NULL);
+        MPI_Scatterv(rank == root ? tsr->inds[m].data : NULL, counts, displs, PARTI_MPI_INDEX,
+            local->inds[m].data, local_nnz, PARTI_MPI_INDEX, root, comm);
+    }
+    if(header[1]) {
+        result = sptResizeValueVector(&local->values, local->nnz);
+        spt_CheckError(result, "SpTns MPI Scatter", NULL);
+        MPI_Scatterv(rank == root ? tsr->values.data : NULL, counts, displs, PARTI_MPI_VALUE,
+            local->values.data, local_nnz, PARTI_MPI_VALUE, root, comm);
+    } else {
+        /* A pattern tensor stays one */
+        sptFreeValueVector(&local->values);
+        local->values.data = NULL;
+        local->values.len = 0;
+        local->values.cap = 0;
+    }
+
+    if(rank == root) {
+        free(counts);
+        free(displs);
+        sptFreeSparseTensorSharding(&sh);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Tensors published once and attached by many processes. A segment holds the
+ * tensor in a binary container written sequentially, so an attacher racing
+ * the publisher sees a short segment and fails instead of reading a partial
+ * tensor. Attached tensors map the segment copy-on-write: every process
+ * shares the same physical pages, and a kernel that reorders nonzeros only
+ * copies the pages it touches, never changing the segment.
+ */
+
+/* "/name" with no other slash names a POSIX shared-memory object */
+static int spt_IsShmName(const char *name) {
+    return name[0] == '/' && strchr(name + 1, '/') == NULL;
+}
+
+/*
+ * Open a named segment, shm_open for POSIX shared-memory names and open for
+ * file paths. Returns the descriptor, or -1 with errno set.
+ */
+int spt_OpenTensorSegment(const char *name, int const flags) {
+    mode_t const mode = 0644;
+    return spt_IsShmName(name) ? shm_open(name, flags, mode) : open(name, flags, mode);
+}
+
+/**
+ * Publish a sparse tensor under a name for other processes to attach.
+ *
+ * A name of the form "/name" creates a POSIX shared-memory object, which
+ * lives in memory until sptUnpublishTensor or a reboot; any other name is a
+ * file path, e.g. on a tmpfs or a fast local disk. The name must not exist.
+ *
+ * @param tsr  the sparse tensor to publish
+ * @param name the segment name
+ */
+int sptPublishSparseTensor(const sptSparseTensor *tsr, const char *name) {
+    if(sptSparseTensorIsPattern(tsr)) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Publish", "pattern tensors have no values to publish");
+    }
+    int fd = spt_OpenTensorSegment(name, O_CREAT | O_EXCL | O_WRONLY);
+    spt_CheckOSError(fd < 0, "SpTns Publish");
+    FILE * fp = fdopen(fd, "wb");
+    if(fp == NULL) {
+        close(fd);
+        sptUnpublishTensor(name);
+        spt_CheckOSError(1, "SpTns Publish");
+    }
+    int result = sptDumpSparseTensorBinary(tsr, fp);
+    if(fclose(fp) != 0 && result == 0) {
+        result = SPTERR_OS_ERROR + errno;
+    }
+    if(result != 0) {
+        sptUnpublishTensor(name);
+        spt_CheckError(result, "SpTns Publish", NULL);
+    }
+    return 0;
+}
+
+/**
+ * Attach a sparse tensor published by sptPublishSparseTensor, or any binary
+ * tensor file, without copying it.
+ *
+ * Read-only kernels such as MTTKRP and the fit work on it directly. Release
+ * it with sptUnmapSparseTensor.
+ *
+ * @param tsr  an uninitialized sparse tensor
+ * @param name the segment name
+ */
+int sptAttachSparseTensor(sptSparseTensor *tsr, const char *name) {
+    int fd = spt_OpenTensorSegment(name, O_RDONLY);
+    spt_CheckOSError(fd < 0, "SpTns Attach");
+    int result = spt_MmapSparseTensorFd(tsr, fd);
+    spt_CheckError(result, "SpTns Attach", NULL);
+    return 0;
+}
+
+/**
+ * Remove a name published by sptPublishSparseTensor or
+ * sptPublishSparseTensorHiCOO. Attached processes keep their mappings; the
+ * memory is released when the last one detaches.
+ *
+ * @param name the segment name
+ */
+int sptUnpublishTensor(const char *name) {
+    int result = spt_IsShmName(name) ? shm_unlink(name) : unlink(name);
+    spt_CheckOSError(result != 0, "SpTns Unpublish");
+    return 0;
+}
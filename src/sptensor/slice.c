@@ -19,6 +19,29 @@
 #include <ParTI.h>
 #include "sptensor.h"
 
+/* Whether nonzero i of tsr lies in limit_low <= index < limit_high */
+static int spt_IsInBox(const sptSparseTensor *tsr, sptNnzIndex const i, const sptIndex limit_low[], const sptIndex limit_high[]) {
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(tsr->inds[m].data[i] < limit_low[m] || tsr->inds[m].data[i] >= limit_high[m]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* First position in [begin, end) of the nondecreasing ind whose value is >= key */
+static sptNnzIndex spt_LowerBound(sptIndex const *ind, sptNnzIndex begin, sptNnzIndex end, sptIndex const key) {
+    while(begin < end) {
+        sptNnzIndex const mid = begin + (end - begin) / 2;
+        if(ind[mid] < key) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
 /**
  * Construct a sub-tensor from an existing tensor, using given constraints
  *
@@ -29,33 +52,107 @@
  *
  * Indices are compared using `limit_low <= index < limit_high`.
  * Free `out` after it is no longer needed.
+ *
+ * The nonzeros keep their relative order. If the indices of the leading mode
+ * of `tsr->sortorder` are nondecreasing, only the segment between the binary
+ * searched bounds of that mode is visited, and it is copied as a block when no
+ * other mode is restricted; the check that it is sorted is kept on the tensor. Otherwise each thread counts the matches of its
+ * chunk, and after a prefix sum fills its own part of the output.
  */
 int spt_GetSubSparseTensor(sptSparseTensor *dest, const sptSparseTensor *tsr, const sptIndex limit_low[], const sptIndex limit_high[]) 
 {
     int result;
-    sptNnzIndex i;
     sptIndex m;
     result = sptNewSparseTensor(dest, tsr->nmodes, tsr->ndims);
     spt_CheckError(result, "SpTns Split", NULL);
 
-    for(i = 0; i < tsr->nnz; ++i) {
-        int match = 1;
+    sptNnzIndex begin = 0, end = tsr->nnz;
+    sptIndex const lead = tsr->sortorder[0];
+    int whole = 0;
+    if(limit_low[lead] < limit_high[lead] && spt_SparseTensorIsSliceSorted(tsr, lead)) {
+        begin = spt_LowerBound(tsr->inds[lead].data, 0, tsr->nnz, limit_low[lead]);
+        end = spt_LowerBound(tsr->inds[lead].data, begin, tsr->nnz, limit_high[lead]);
+        whole = 1;
+        for(m = 0; m < tsr->nmodes; ++m) {
+            if(m != lead && (limit_low[m] > 0 || limit_high[m] < tsr->ndims[m])) {
+                whole = 0;
+            }
+        }
+    }
+    if(begin >= end) {
+        return 0;
+    }
+
+    if(whole) {
+        result = spt_SparseTensorReserve(dest, end - begin);
+        spt_CheckError(result, "SpTns Split", NULL);
         for(m = 0; m < tsr->nmodes; ++m) {
-            if(tsr->inds[m].data[i] < limit_low[m] || tsr->inds[m].data[i] >= limit_high[m]) {
-                match = 0;
-                break;
+            memcpy(dest->inds[m].data, tsr->inds[m].data + begin, (end - begin) * sizeof *dest->inds[m].data);
+        }
+        memcpy(dest->values.data, tsr->values.data + begin, (end - begin) * sizeof *dest->values.data);
+        dest->nnz = end - begin;
+    } else {
+#ifdef PARTI_USE_OPENMP
+        int const nt = sptExecThreads(0);
+#else
+        int const nt = 1;
+#endif
+        sptNnzIndex * offsets = spt_ScratchAlloc((nt + 1) * sizeof *offsets);
+        spt_CheckOSError(!offsets, "SpTns Split");
+
+        /* Count the matches of each chunk, so the output is allocated once */
+        #pragma omp parallel num_threads(nt)
+        {
+#ifdef PARTI_USE_OPENMP
+            int const tid = omp_get_thread_num();
+#else
+            int const tid = 0;
+#endif
+            sptNnzIndex const lo = begin + (end - begin) * tid / nt;
+            sptNnzIndex const hi = begin + (end - begin) * (tid + 1) / nt;
+            sptNnzIndex nmatch = 0;
+            for(sptNnzIndex i = lo; i < hi; ++i) {
+                nmatch += spt_IsInBox(tsr, i, limit_low, limit_high);
             }
+            offsets[tid + 1] = nmatch;
         }
-        if(match) {
-            for(m = 0; m < tsr->nmodes; ++m) {
-                result = sptAppendIndexVector(&dest->inds[m], tsr->inds[m].data[i]);
-                spt_CheckError(result, "SpTns Split", NULL);
+        offsets[0] = 0;
+        for(int t = 0; t < nt; ++t) {
+            offsets[t + 1] += offsets[t];
+        }
+        result = spt_SparseTensorReserve(dest, offsets[nt]);
+        if(result != 0) {
+            spt_ScratchFree(offsets);
+        }
+        spt_CheckError(result, "SpTns Split", NULL);
+
+        #pragma omp parallel num_threads(nt)
+        {
+#ifdef PARTI_USE_OPENMP
+            int const tid = omp_get_thread_num();
+#else
+            int const tid = 0;
+#endif
+            sptNnzIndex const lo = begin + (end - begin) * tid / nt;
+            sptNnzIndex const hi = begin + (end - begin) * (tid + 1) / nt;
+            sptNnzIndex k = offsets[tid];
+            for(sptNnzIndex i = lo; i < hi; ++i) {
+                if(spt_IsInBox(tsr, i, limit_low, limit_high)) {
+                    for(sptIndex mm = 0; mm < tsr->nmodes; ++mm) {
+                        dest->inds[mm].data[k] = tsr->inds[mm].data[i];
+                    }
+                    dest->values.data[k] = tsr->values.data[i];
+                    ++k;
+                }
             }
-            sptAppendValueVector(&dest->values, tsr->values.data[i]);
-            spt_CheckError(result, "SpTns Split", NULL);
-            ++dest->nnz;
         }
+        dest->nnz = offsets[nt];
+        spt_ScratchFree(offsets);
     }
+    for(m = 0; m < tsr->nmodes; ++m) {
+        dest->inds[m].len = dest->nnz;
+    }
+    dest->values.len = dest->nnz;
 
     return 0;
 }
@@ -63,11 +160,11 @@ int spt_GetSubSparseTensor(sptSparseTensor *dest, const sptSparseTensor *tsr, co
 
 int spt_ComputeSliceSizes(
     sptNnzIndex * slice_nnzs, 
-    sptSparseTensor * const tsr,
+    sptSparseTensor const * const tsr,
     sptIndex const mode)
 {
-    sptIndex * const ndims = tsr->ndims;
-    sptIndexVector * inds = tsr->inds;
+    sptIndex const * const ndims = tsr->ndims;
+    sptIndexVector const * inds = tsr->inds;
     
     memset(slice_nnzs, 0, ndims[mode] * sizeof(sptNnzIndex));
     for(sptNnzIndex x=0; x<tsr->nnz; ++x) {
@@ -76,3 +173,110 @@ int spt_ComputeSliceSizes(
 
     return 0;
 }
+
+
+/**
+ * Cut segments of nonzeros into work units of at most max_nnz nonzeros, so that
+ * a few heavy slices or fibers do not hold up a GPU launch. Segment s covers
+ * ptr[s] to ptr[s+1], e.g. the prefix sum of spt_ComputeSliceSizes or a fiber
+ * index; empty segments get no unit.
+ * @param[out] unit_seg   an uninitialized vector, the segment of every unit
+ * @param[out] unit_ptr   an uninitialized vector of nunits+1 nonzero offsets
+ * @param[in]  ptr   nsegs+1 nondecreasing offsets
+ * @param[in]  nsegs   the number of segments
+ * @param[in]  max_nnz   the most nonzeros of a unit, 0 for the larger of the mean segment length and PARTI_CUDA_UNIT_NNZ
+ *
+ * Units of one segment are consecutive, so a kernel can tell a split segment,
+ * whose units must combine their partial results with atomics, by its neighbours.
+ */
+int spt_SplitHeavySegments(
+    sptNnzIndexVector * unit_seg,
+    sptNnzIndexVector * unit_ptr,
+    sptNnzIndex const * ptr,
+    sptNnzIndex const nsegs,
+    sptNnzIndex max_nnz)
+{
+    sptNnzIndex const nnz = nsegs > 0 ? ptr[nsegs] - ptr[0] : 0;
+    if(max_nnz == 0) {
+        max_nnz = nsegs > 0 ? (nnz + nsegs - 1) / nsegs : 1;
+        if(max_nnz < PARTI_CUDA_UNIT_NNZ) {
+            max_nnz = PARTI_CUDA_UNIT_NNZ;
+        }
+    }
+
+    sptNnzIndex nunits = 0;
+    for(sptNnzIndex s = 0; s < nsegs; ++s) {
+        nunits += (ptr[s+1] - ptr[s] + max_nnz - 1) / max_nnz;
+    }
+    int result = sptNewNnzIndexVector(unit_seg, nunits, nunits);
+    spt_CheckError(result, "SpTns Split Segments", NULL);
+    result = sptNewNnzIndexVector(unit_ptr, nunits + 1, nunits + 1);
+    if(result != 0) {
+        sptFreeNnzIndexVector(unit_seg);
+        spt_CheckError(result, "SpTns Split Segments", NULL);
+    }
+
+    sptNnzIndex u = 0;
+    for(sptNnzIndex s = 0; s < nsegs; ++s) {
+        for(sptNnzIndex begin = ptr[s]; begin < ptr[s+1]; begin += max_nnz) {
+            unit_seg->data[u] = s;
+            unit_ptr->data[u] = begin;
+            ++u;
+        }
+    }
+    unit_ptr->data[nunits] = nsegs > 0 ? ptr[nsegs] : 0;
+
+    return 0;
+}
+
+
+/**
+ * Cut segments of nonzeros into nparts consecutive ranges of about equal
+ * nonzero counts, e.g. fibers for the threads of a TTM or slices for an
+ * MTTKRP. Part t gets segments bounds[t] to bounds[t+1]; a segment is never
+ * split, so every part writes its own output rows, and a part may be empty
+ * when one segment alone outweighs a share.
+ * @param[out] bounds  nparts+1 segment indices
+ * @param[in]  ptr   nsegs+1 nondecreasing offsets, segment s covers ptr[s] to ptr[s+1]
+ * @param[in]  nsegs   the number of segments
+ * @param[in]  nparts  the number of parts
+ */
+int spt_PartitionSegments(
+    sptNnzIndex * bounds,
+    sptNnzIndex const * ptr,
+    sptNnzIndex const nsegs,
+    int const nparts)
+{
+    if(nparts < 1) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Partition", "nparts < 1");
+    }
+    bounds[0] = 0;
+    bounds[nparts] = nsegs;
+    if(nsegs == 0) {
+        for(int t = 1; t < nparts; ++t) {
+            bounds[t] = 0;
+        }
+        return 0;
+    }
+    sptNnzIndex const first = ptr[0];
+    sptNnzIndex const nnz = ptr[nsegs] - first;
+    for(int t = 1; t < nparts; ++t) {
+        sptNnzIndex const target = first + (sptNnzIndex) ((double) nnz * t / nparts);
+        /* The first segment starting at or after the target */
+        sptNnzIndex lo = bounds[t-1], hi = nsegs;
+        while(lo < hi) {
+            sptNnzIndex const mid = lo + (hi - lo) / 2;
+            if(ptr[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        /* Or the segment before it, if its start is closer */
+        if(lo > bounds[t-1] && target - ptr[lo-1] < ptr[lo] - target) {
+            --lo;
+        }
+        bounds[t] = lo;
+    }
+    return 0;
+}
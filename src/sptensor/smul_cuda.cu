@@ -0,0 +1,64 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+
+__global__ static void spt_MulScalarKernel(sptNnzIndex const nnz, sptValue *X_val, sptValue const a)
+{
+    sptNnzIndex const i = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(i < nnz) {
+        X_val[i] *= a;
+    }
+}
+
+/**
+ * CUDA parallelized multiply a sparse tensor by a scalar, in place
+ * @param[in,out] X the sparse tensor
+ * @param[in]     a the scalar; 0 leaves X with no nonzeros
+ */
+int sptCudaSparseTensorMulScalar(sptSparseTensor *X, sptValue const a) {
+    sptSparseTensorDropCache(X);
+    int result;
+    if(a == 0) {
+        X->nnz = 0;
+        X->values.len = 0;
+        return 0;
+    }
+    if(X->nnz == 0) {
+        return 0;
+    }
+
+    sptValue *X_val = NULL;
+    result = cudaMalloc((void **) &X_val, X->nnz * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Mul");
+    result = cudaMemcpy(X_val, X->values.data, X->nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns Mul");
+
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks = (X->nnz + nthreads - 1) / nthreads;
+    spt_MulScalarKernel<<<nblocks, nthreads>>>(X->nnz, X_val, a);
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA SpTns Mul");
+
+    result = cudaMemcpy(X->values.data, X_val, X->nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "CUDA SpTns Mul");
+    result = cudaFree(X_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns Mul");
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+
+/**
+ * OpenMP parallelized multiply a sparse tensor by a scalar, in place
+ * @param[in,out] X the sparse tensor
+ * @param[in]     a the scalar; 0 leaves X with no nonzeros
+ */
+int sptOmpSparseTensorMulScalar(sptSparseTensor *X, sptValue const a) {
+    sptSparseTensorDropCache(X);
+    if(a != 0) {
+        sptNnzIndex i;
+        #pragma omp parallel for schedule(static)
+        for(i = 0; i < X->nnz; ++i) {
+            X->values.data[i] *= a;
+        }
+    } else {
+        X->nnz = 0;
+        X->values.len = 0;
+    }
+    return 0;
+}
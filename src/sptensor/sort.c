@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include <time.h>
 #include <ParTI.h>
 #include "sptensor.h"
@@ -175,9 +176,57 @@ static inline void spt_SwapValues(sptSparseTensor *tsr, sptNnzIndex ind1, sptNnz
         tsr->inds[i].data[ind1] = tsr->inds[i].data[ind2];
         tsr->inds[i].data[ind2] = eleind1;
     }
-    sptValue val1 = tsr->values.data[ind1];
-    tsr->values.data[ind1] = tsr->values.data[ind2];
-    tsr->values.data[ind2] = val1;
+    if(tsr->values.data != NULL) {
+        sptValue val1 = tsr->values.data[ind1];
+        tsr->values.data[ind1] = tsr->values.data[ind2];
+        tsr->values.data[ind2] = val1;
+    }
+}
+
+
+/* Threads for sorts without a thread count: one inside a parallel region, all otherwise. */
+static int spt_DefaultSortThreads(void)
+{
+#ifdef PARTI_USE_OPENMP
+    return omp_in_parallel() ? 1 : sptExecThreads(0);
+#else
+    return 1;
+#endif
+}
+
+/* Ranges shorter than this are left to the quicksorts. */
+#define PARTI_RADIX_SORT_MIN_NNZ 4096
+
+/**
+ * Sort [begin, end) by merging its presorted runs when there are few, or
+ * with the radix engine when the range is large enough.
+ * @return 1 if sorted; 0 if the caller should fall back to a quicksort.
+ */
+static int spt_TryRadixSort(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    int tk)
+{
+    if(tk <= 0) {
+        tk = spt_DefaultSortThreads();
+    }
+    if(spt_SortAdaptiveEnabled() &&
+        spt_SparseTensorMergeRuns(tsr, begin, end, nkeys, key_modes, shift_bits, end - begin < PARTI_RADIX_SORT_MIN_NNZ ? 1 : tk)) {
+        return 1;
+    }
+    if(end - begin < PARTI_RADIX_SORT_MIN_NNZ) {
+        return 0;
+    }
+    spt_KernelProbe * probe = spt_KernelProbeStart(tk);
+    int const result = spt_SparseTensorRadixSort(tsr, begin, end, nkeys, key_modes, shift_bits, tk);
+    /* No flops; the range read and written once, a lower bound on the passes' traffic */
+    spt_KernelProbeStop(probe, NULL, "CPU  SpTns Radix Sort", 0,
+        2.0 * (end - begin) * (tsr->nmodes * sizeof (sptIndex) + sizeof (sptValue)));
+    return result == 0;
 }
 
 
@@ -366,44 +415,72 @@ int sptSparseTensorSortPartialIndex(
 
 
 
+/* The key of item i of a shuffle is draw base + i of the library stream */
+static void spt_ShuffleKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx) {
+    uint64_t const base = *(uint64_t const *) ctx;
+    (void) word;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = spt_RandomBits(base + perm[i]);
+    }
+}
+
+/* A uniformly random permutation of n items, sorted by random keys in parallel */
+static int spt_RandomPermutation(sptNnzIndex * perm, sptNnzIndex const n, int const tk) {
+    uint64_t const base = spt_RandomReserve(n);
+    unsigned const word_bits = 64;
+    return spt_RadixSortPermutation(perm, n, 1, &word_bits, spt_ShuffleKey, &base, tk);
+}
+
 /**
- * Randomly shuffle all nonzeros.
+ * Randomly shuffle all nonzeros, in parallel, by sorting them on keys from
+ * the library random stream, so a seed given to sptSetRandomSeed fixes the order.
  *
  * @param[in] tsr tensor to be shuffled
  *
  */
 void sptGetRandomShuffleElements(sptSparseTensor *tsr) {
     sptNnzIndex const nnz = tsr->nnz;
-    for(sptNnzIndex z=0; z<nnz; ++z) {
-        srand(z+1);
-        sptValue rand_val = (sptValue) rand() / (sptValue) RAND_MAX;
-        sptNnzIndex new_loc = (sptNnzIndex) ( rand_val * nnz ) % nnz;
-        spt_SwapValues(tsr, z, new_loc);
+    if(nnz < 2) {
+        return;
     }
-    
+    int const tk = spt_DefaultSortThreads();
+    spt_SparseTensorDropOrderCache(tsr);
+    sptNnzIndex * perm = malloc(nnz * sizeof *perm);
+    sptAssert(perm != NULL);
+    sptAssert(spt_RandomPermutation(perm, nnz, tk) == 0);
+    sptAssert(spt_SparseTensorApplyPermutation(tsr, 0, nnz, perm, tk) == 0);
+    free(perm);
 }
 
 
 /**
- * Randomly shuffle all indices.
+ * Randomly shuffle all indices, each mode by a parallel sort on keys from
+ * the library random stream.
  *
  * @param[in] tsr tensor to be shuffled
  * @param[out] map_inds records the randomly generated mapping
  *
  */
 void sptGetRandomShuffledIndices(sptSparseTensor *tsr, sptIndex ** map_inds) {
-    /* Get randomly renumbering indices */
+    int const tk = spt_DefaultSortThreads();
+    sptIndex const max_dim = sptMaxIndexArray(tsr->ndims, tsr->nmodes);
+    sptNnzIndex * perm = malloc((max_dim > 0 ? max_dim : 1) * sizeof *perm);
+    sptIndex * shuffled = malloc((max_dim > 0 ? max_dim : 1) * sizeof *shuffled);
+    sptAssert(perm != NULL && shuffled != NULL);
     for(sptIndex m = 0; m < tsr->nmodes; ++m) {
-        sptIndex dim_len = tsr->ndims[m];
-        for(sptIndex i = dim_len - 1; i > 0; --i) {
-            srand(m+i+1+time(NULL));
-            sptIndex new_loc = (sptIndex) (rand() % (i+1));            
-            /* Swap i <-> new_loc */
-            sptIndex tmp = map_inds[m][i];
-            map_inds[m][i] = map_inds[m][new_loc];
-            map_inds[m][new_loc] = tmp;
+        sptIndex const dim_len = tsr->ndims[m];
+        if(dim_len < 2) {
+            continue;
+        }
+        sptAssert(spt_RandomPermutation(perm, dim_len, tk) == 0);
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptIndex i = 0; i < dim_len; ++i) {
+            shuffled[i] = map_inds[m][perm[i]];
         }
+        memcpy(map_inds[m], shuffled, dim_len * sizeof *shuffled);
     }
+    free(perm);
+    free(shuffled);
 }
 
 
@@ -434,13 +511,17 @@ void sptSparseTensorSortIndexAtMode(sptSparseTensor *tsr, sptIndex const mode, i
     }
 
     if(needsort || force) {
-        spt_QuickSortAtMode(tsr, 0, tsr->nnz, mode);
+        spt_SparseTensorDropOrderCache(tsr);
+        if(!spt_TryRadixSort(tsr, 0, tsr->nnz, tsr->nmodes, tsr->sortorder, 0, 0)) {
+            spt_QuickSortAtMode(tsr, 0, tsr->nnz, mode);
+        }
     }
 }
 
 
 /**
  * Reorder the elements in a COO sparse tensor lexicographically, sorting by Morton-order.
+ * Any tensor order is supported; each aligned block of 2^sb_bits is kept contiguous.
  * @param hitsr  the sparse tensor to operate on
  */
 void sptSparseTensorSortIndexMorton(
@@ -461,7 +542,11 @@ void sptSparseTensorSortIndexMorton(
     }
 
     if(needsort || force) {
-        /* TODO: add support for other order tensors */
+        spt_SparseTensorDropOrderCache(tsr);
+        if(spt_SparseTensorCurveSort(tsr, begin, end, 0, spt_DefaultSortThreads()) == 0) {
+            return;
+        }
+        /* Out of scratch memory, fall back to the in-place sorts */
         switch(tsr->nmodes) {
             case 3:
                 spt_QuickSortIndexMorton3D(tsr, begin, end, sb_bits);
@@ -477,6 +562,37 @@ void sptSparseTensorSortIndexMorton(
 }
 
 
+/**
+ * Reorder the elements in a COO sparse tensor along the Hilbert curve, for any tensor order.
+ * @param tsr  the sparse tensor to operate on
+ * @param tk   the number of threads
+ */
+int sptSparseTensorSortIndexHilbert(
+    sptSparseTensor *tsr,
+    int force,
+    const sptNnzIndex begin,
+    const sptNnzIndex end,
+    int const tk)
+{
+    size_t m;
+    int needsort = 0;
+
+    for(m = 0; m < tsr->nmodes; ++m) {
+        if(tsr->sortorder[m] != m) {
+            tsr->sortorder[m] = m;
+            needsort = 1;
+        }
+    }
+
+    if(needsort || force) {
+        spt_SparseTensorDropOrderCache(tsr);
+        int result = spt_SparseTensorCurveSort(tsr, begin, end, 1, tk);
+        spt_CheckError(result, "SpTns Sort Hilbert", NULL);
+    }
+    return 0;
+}
+
+
 
 /**
  * Reorder the elements in a COO sparse tensor lexicographically, sorting by row major order.
@@ -500,11 +616,14 @@ void sptSparseTensorSortIndexRowBlock(
         }
     }
     if(needsort || force) {
-        #pragma omp parallel num_threads(tk)
-        {
-            #pragma omp single nowait
+        spt_SparseTensorDropOrderCache(tsr);
+        if(!spt_TryRadixSort(tsr, begin, end, tsr->nmodes, tsr->sortorder, sk_bits, tk)) {
+            #pragma omp parallel num_threads(tk)
             {
-                spt_QuickSortIndexRowBlock(tsr, begin, end, sk_bits);
+                #pragma omp single nowait
+                {
+                    spt_QuickSortIndexRowBlock(tsr, begin, end, sk_bits);
+                }
             }
         }
     }
@@ -527,7 +646,10 @@ void sptSparseTensorSortIndexSingleMode(sptSparseTensor *tsr, int force, sptInde
     }
 
     if(needsort || force) {
-        spt_QuickSortIndexSingleMode(tsr, 0, tsr->nnz, mode);
+        spt_SparseTensorDropOrderCache(tsr);
+        if(!spt_TryRadixSort(tsr, 0, tsr->nnz, 1, &mode, 0, 0)) {
+            spt_QuickSortIndexSingleMode(tsr, 0, tsr->nnz, mode);
+        }
     }
 }
 
@@ -548,11 +670,14 @@ void sptSparseTensorSortIndexExceptSingleMode(sptSparseTensor *tsr, int force, s
     }
 
     if(needsort || force) {
-        #pragma omp parallel num_threads(tk) 
-        {
-            #pragma omp single nowait 
+        spt_SparseTensorDropOrderCache(tsr);
+        if(!spt_TryRadixSort(tsr, 0, tsr->nnz, tsr->nmodes - 1, mode_order, 0, tk)) {
+            #pragma omp parallel num_threads(tk) 
             {
-                spt_QuickSortIndexExceptSingleMode(tsr, 0, tsr->nnz, mode_order);
+                #pragma omp single nowait 
+                {
+                    spt_QuickSortIndexExceptSingleMode(tsr, 0, tsr->nnz, mode_order);
+                }
             }
         }
     }
@@ -579,6 +704,8 @@ void sptSparseTensorSortIndexCustomOrder(sptSparseTensor *tsr, sptIndex const *
     tsr_temp.nnz = tsr->nnz;
     tsr_temp.inds = malloc(nmodes * sizeof tsr_temp.inds[0]);
     tsr_temp.values = tsr->values;
+    tsr_temp.cache = NULL;
+    spt_SparseTensorDropOrderCache(tsr);
 
     for(m = 0; m < nmodes; ++m) {
         tsr_temp.ndims[m] = tsr->ndims[mode_order[m]];
@@ -612,7 +739,12 @@ void sptSparseTensorSortIndex(sptSparseTensor *tsr, int force) {
     }
 
     if(needsort || force) {
-        spt_QuickSortIndex(tsr, 0, tsr->nnz);
+        double const trace = sptTraceBegin();
+        spt_SparseTensorDropOrderCache(tsr);
+        if(!spt_TryRadixSort(tsr, 0, tsr->nnz, tsr->nmodes, tsr->sortorder, 0, 0)) {
+            spt_QuickSortIndex(tsr, 0, tsr->nnz);
+        }
+        sptTraceEnd("Sort", -1, trace);
     }
 }
 
@@ -642,6 +774,47 @@ int spt_SparseTensorCompareIndices(const sptSparseTensor *tsr1, sptNnzIndex loc1
 }
 
 
+/**
+ * Check whether the nonzeros of a sparse tensor are in the natural (mode 0
+ * first) order with no repeated coordinates, regardless of its sortorder
+ * @param tsr the sparse tensor to check
+ * @return 1 if strictly increasing, 0 otherwise
+ */
+int spt_SparseTensorIsSorted(const sptSparseTensor *tsr) {
+    int sorted = 1;
+    #pragma omp parallel for schedule(static) reduction(&&:sorted)
+    for(sptNnzIndex z = 1; z < tsr->nnz; ++z) {
+        sorted = sorted && spt_SparseTensorCompareIndices(tsr, z - 1, tsr, z) < 0;
+    }
+    return sorted;
+}
+
+
+/**
+ * Check whether the nonzeros of a sparse tensor are in lexicographic order
+ * over mode_order, repeated coordinates allowed, regardless of its sortorder.
+ * A freshly loaded tensor reports the natural sortorder without being sorted,
+ * so callers that need a given order check it here before skipping a sort.
+ * @param tsr        the sparse tensor to check
+ * @param mode_order the order of modes to compare in
+ * @return 1 if nondecreasing, 0 otherwise
+ */
+int spt_SparseTensorIsSortedInOrder(const sptSparseTensor *tsr, sptIndex const *mode_order) {
+    int sorted = 1;
+    #pragma omp parallel for schedule(static) reduction(&&:sorted)
+    for(sptNnzIndex z = 1; z < tsr->nnz; ++z) {
+        int cmp = 0;
+        for(sptIndex k = 0; k < tsr->nmodes && cmp == 0; ++k) {
+            sptIndex const a = tsr->inds[mode_order[k]].data[z - 1];
+            sptIndex const b = tsr->inds[mode_order[k]].data[z];
+            cmp = (a > b) - (a < b);
+        }
+        sorted = sorted && cmp <= 0;
+    }
+    return sorted;
+}
+
+
 /*************************************************
  * PRIVATE FUNCTIONS
  *************************************************/
@@ -0,0 +1,198 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <thrust/copy.h>
+#include <thrust/device_ptr.h>
+#include <thrust/gather.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+#include "sptensor.h"
+#include "sort_cuda.h"
+#include "../cudawrap.h"
+
+/*
+ * Sorting on the device: the nonzeros get packed keys, thrust's radix sort
+ * orders a permutation by them one 64-bit word at a time from the least
+ * significant, and the indices and values are gathered through it once.
+ */
+
+/* Field l of nonzero z is inds[order[l]] >> shift, of widths[l] bits at offsets[l] */
+__global__ static void spt_CudaLexKeyKernel(
+    uint64_t *keys, sptIndex const *inds, sptNnzIndex const nnz, sptIndex const nmodes,
+    sptIndex const *order, unsigned const *widths, unsigned const *offsets, unsigned const shift)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    for(sptIndex l = 0; l < nmodes; ++l) {
+        spt_CudaPutKeyBits(keys, nnz, z, offsets[l], inds[order[l] * nnz + z] >> shift, widths[l]);
+    }
+}
+
+int spt_CudaUploadCoo(sptSparseTensor const *X, sptIndex **dev_inds, sptValue **dev_vals)
+{
+    sptNnzIndex const nnz = X->nnz;
+    int result = cudaMalloc((void **) dev_inds, (X->nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        result = cudaMemcpy(*dev_inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    }
+    result = cudaMalloc((void **) dev_vals, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    if(X->values.data != NULL) {
+        result = cudaMemcpy(*dev_vals, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+        spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    }
+    return 0;
+}
+
+int spt_CudaLexKeys(uint64_t **dev_keys, sptIndex *nwords, sptIndex const *dev_inds, sptNnzIndex const nnz,
+    sptIndex const nmodes, sptIndex const ndims[], sptIndex const order[], unsigned const shift, unsigned const low_bits)
+{
+    /* Fields from the least significant, the last of order lowest, above the caller's low_bits */
+    unsigned * widths = new unsigned[2 * nmodes];
+    unsigned * offsets = widths + nmodes;
+    unsigned total = low_bits;
+    for(sptIndex l = nmodes; l-- > 0; ) {
+        unsigned const w = spt_RadixBitWidth(ndims[order[l]]);
+        widths[l] = w > shift ? w - shift : 0;
+        offsets[l] = total;
+        total += widths[l];
+    }
+    *nwords = total > 0 ? (total + 63) / 64 : 1;
+
+    int result = cudaMalloc((void **) dev_keys, (size_t) *nwords * nnz * sizeof (uint64_t));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    result = cudaMemset(*dev_keys, 0, (size_t) *nwords * nnz * sizeof (uint64_t));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    sptIndex * dev_order;
+    unsigned * dev_widths;
+    result = sptCudaDuplicateMemory(&dev_order, order, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    result = sptCudaDuplicateMemory(&dev_widths, widths, 2 * nmodes * sizeof (unsigned), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    delete[] widths;
+
+    if(nnz != 0) {
+        spt_CudaLexKeyKernel<<<spt_CudaLayoutBlocks(nnz), PARTI_CUDA_LAYOUT_NTHREADS>>>(
+            *dev_keys, dev_inds, nnz, nmodes, dev_order, dev_widths, dev_widths + nmodes, shift);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    }
+    cudaFree(dev_order);
+    cudaFree(dev_widths);
+    return 0;
+}
+
+int spt_CudaSortCoo(sptIndex *dev_inds, sptValue *dev_vals, sptNnzIndex const nnz, sptIndex const nmodes,
+    uint64_t const *dev_keys, sptIndex const nwords)
+{
+    if(nnz < 2) {
+        return 0;
+    }
+    sptNnzIndex * dev_perm;
+    uint64_t * dev_word;
+    int result = cudaMalloc((void **) &dev_perm, nnz * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    result = cudaMalloc((void **) &dev_word, nnz * sizeof (uint64_t));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+
+    thrust::device_ptr<sptNnzIndex> perm(dev_perm);
+    thrust::device_ptr<uint64_t> word(dev_word);
+    thrust::sequence(perm, perm + nnz);
+    for(sptIndex w = 0; w < nwords; ++w) {
+        thrust::device_ptr<uint64_t const> keys(dev_keys + (size_t) w * nnz);
+        thrust::gather(perm, perm + nnz, keys, word);
+        thrust::stable_sort_by_key(word, word + nnz, perm);
+    }
+    cudaFree(dev_word);
+
+    /* One gather per mode and one for the values, through a scratch the size of the largest */
+    void * dev_tmp;
+    result = cudaMalloc(&dev_tmp, nnz * (sizeof (sptIndex) > sizeof (sptValue) ? sizeof (sptIndex) : sizeof (sptValue)));
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    thrust::device_ptr<sptIndex> tmp_inds((sptIndex *) dev_tmp);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        thrust::device_ptr<sptIndex> inds(dev_inds + m * nnz);
+        thrust::gather(perm, perm + nnz, inds, tmp_inds);
+        thrust::copy(tmp_inds, tmp_inds + nnz, inds);
+    }
+    thrust::device_ptr<sptValue> tmp_vals((sptValue *) dev_tmp);
+    thrust::device_ptr<sptValue> vals(dev_vals);
+    thrust::gather(perm, perm + nnz, vals, tmp_vals);
+    thrust::copy(tmp_vals, tmp_vals + nnz, vals);
+    cudaFree(dev_tmp);
+    cudaFree(dev_perm);
+
+    result = cudaDeviceSynchronize();
+    spt_CheckCudaError(result != 0, "CUDA SpTns Layout");
+    return 0;
+}
+
+
+/**
+ * Sort a sparse tensor on the GPU lexicographically in the given mode order,
+ * order[0] the most significant, with the result of
+ * sptSparseTensorSortIndexCustomOrder. The tensor is uploaded once, its
+ * nonzeros are ordered by a device radix sort on packed keys, and they are
+ * downloaded in place.
+ * @param tsr   the sparse tensor to operate on
+ * @param order the sort order of the modes, nmodes long
+ */
+int sptCudaSparseTensorSortIndexCustomOrder(sptSparseTensor *tsr, sptIndex const order[])
+{
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    for(sptIndex l = 0; l < nmodes; ++l) {
+        if(order[l] >= nmodes) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "CUDA SpTns Sort", "order out of range");
+        }
+    }
+
+    sptIndex * dev_inds;
+    sptValue * dev_vals;
+    uint64_t * dev_keys;
+    sptIndex nwords;
+    int result = spt_CudaUploadCoo(tsr, &dev_inds, &dev_vals);
+    spt_CheckError(result, "CUDA SpTns Sort", NULL);
+    result = spt_CudaLexKeys(&dev_keys, &nwords, dev_inds, nnz, nmodes, tsr->ndims, order, 0, 0);
+    spt_CheckError(result, "CUDA SpTns Sort", NULL);
+    result = spt_CudaSortCoo(dev_inds, dev_vals, nnz, nmodes, dev_keys, nwords);
+    spt_CheckError(result, "CUDA SpTns Sort", NULL);
+    cudaFree(dev_keys);
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = cudaMemcpy(tsr->inds[m].data, dev_inds + m * nnz, nnz * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA SpTns Sort");
+    }
+    if(tsr->values.data != NULL) {
+        result = cudaMemcpy(tsr->values.data, dev_vals, nnz * sizeof (sptValue), cudaMemcpyDeviceToHost);
+        spt_CheckCudaError(result != 0, "CUDA SpTns Sort");
+    }
+    cudaFree(dev_inds);
+    cudaFree(dev_vals);
+
+    spt_SparseTensorDropOrderCache(tsr);
+    for(sptIndex l = 0; l < nmodes; ++l) {
+        tsr->sortorder[l] = order[l];
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_SORT_CUDA_H
+#define PARTI_SORT_CUDA_H
+
+/*
+ * Device-side layout work, see sort_cuda.cu. A COO tensor on the device keeps
+ * its indices mode after mode, inds[m * nnz + z]. Sort keys are nwords 64-bit
+ * words per nonzero, word after word, keys[w * nnz + z], word 0 the least
+ * significant.
+ */
+
+#define PARTI_CUDA_LAYOUT_NTHREADS 256
+
+static inline unsigned spt_CudaLayoutBlocks(sptNnzIndex const n) {
+    return (unsigned) ((n + PARTI_CUDA_LAYOUT_NTHREADS - 1) / PARTI_CUDA_LAYOUT_NTHREADS);
+}
+
+/* OR the low `width` bits of v into the key of nonzero z at bit `off` */
+__device__ static inline void spt_CudaPutKeyBits(uint64_t *keys, sptNnzIndex const nnz, sptNnzIndex const z,
+    unsigned const off, uint64_t const v, unsigned const width)
+{
+    if(width == 0) {
+        return;
+    }
+    uint64_t const field = width < 64 ? v & (((uint64_t) 1 << width) - 1) : v;
+    unsigned const q = off / 64, b = off % 64;
+    keys[q * nnz + z] |= field << b;
+    if(b + width > 64) {
+        keys[(q + 1) * nnz + z] |= field >> (64 - b);
+    }
+}
+
+/* Upload the indices and values of X, mode after mode */
+int spt_CudaUploadCoo(sptSparseTensor const *X, sptIndex **dev_inds, sptValue **dev_vals);
+
+/* Keys of nmodes lexicographic fields, mode order[0] the most significant, each index shifted right by shift */
+int spt_CudaLexKeys(uint64_t **dev_keys, sptIndex *nwords, sptIndex const *dev_inds, sptNnzIndex const nnz,
+    sptIndex const nmodes, sptIndex const ndims[], sptIndex const order[], unsigned const shift, unsigned const low_bits);
+
+/* Stably reorder the nonzeros by their keys, an LSD radix sort one word at a time */
+int spt_CudaSortCoo(sptIndex *dev_inds, sptValue *dev_vals, sptNnzIndex const nnz, sptIndex const nmodes,
+    uint64_t const *dev_keys, sptIndex const nwords);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Run-adaptive sorting for nearly sorted tensors.
+ *
+ * Tensors often arrive as concatenations of sorted chunks. One parallel pass
+ * finds where the order breaks: no break means the range is sorted and is
+ * left alone, a few breaks mean a few sorted runs, merged by a parallel
+ * multiway merge instead of sorted from scratch. The output is cut into one
+ * part per thread at splitter keys sampled from the range; every run is
+ * binary searched for each splitter, so a thread merges, through a heap, the
+ * pieces of all runs that fall between its two splitters. Ties go to the
+ * earlier run, so the merge is stable like the radix sort.
+ */
+
+/* More runs than this are left to the radix sort */
+#define SPT_SORT_MAX_RUNS 64
+/* Splitter samples per output part */
+#define SPT_SORT_SAMPLES_PER_PART 16
+
+static int spt_sort_adaptive = -1;
+
+/* Whether sorts look for runs first, from PARTI_SORT_ADAPTIVE until sptSetSortAdaptive is called */
+int spt_SortAdaptiveEnabled(void) {
+    if(spt_sort_adaptive < 0) {
+        char const * env = getenv("PARTI_SORT_ADAPTIVE");
+        spt_sort_adaptive = env == NULL || atoi(env) != 0;
+    }
+    return spt_sort_adaptive;
+}
+
+/**
+ * Make the COO sorts check for presorted runs before sorting: an already
+ * sorted range costs one parallel pass, and one of up to SPT_SORT_MAX_RUNS
+ * sorted runs a multiway merge. On by default, or as set by the
+ * PARTI_SORT_ADAPTIVE environment variable.
+ * @param enable  1 to detect runs, 0 to always sort from scratch
+ */
+int sptSetSortAdaptive(int const enable) {
+    spt_sort_adaptive = enable != 0;
+    return 0;
+}
+
+
+typedef struct {
+    sptSparseTensor const * tsr;
+    sptIndex nkeys;
+    sptIndex const * key_modes;
+    sptElementIndex shift_bits;
+} spt_RunKeys;
+
+/* Compare nonzeros a and b on the key modes */
+static inline int spt_RunCompare(spt_RunKeys const * k, sptNnzIndex const a, sptNnzIndex const b) {
+    for(sptIndex i = 0; i < k->nkeys; ++i) {
+        sptIndex const * const inds = k->tsr->inds[k->key_modes[i]].data;
+        sptIndex const x = inds[a] >> k->shift_bits, y = inds[b] >> k->shift_bits;
+        if(x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* The first position of [lo, hi) whose key is not below that of nonzero s */
+static sptNnzIndex spt_RunLowerBound(spt_RunKeys const * k, sptNnzIndex lo, sptNnzIndex hi, sptNnzIndex const s) {
+    while(lo < hi) {
+        sptNnzIndex const mid = lo + (hi - lo) / 2;
+        if(spt_RunCompare(k, mid, s) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Heap entries are runs ordered by their head nonzero, then by run for stability */
+static inline int spt_RunHeapLess(spt_RunKeys const * k, sptNnzIndex const * head, sptIndex const a, sptIndex const b) {
+    int const c = spt_RunCompare(k, head[a], head[b]);
+    return c < 0 || (c == 0 && a < b);
+}
+
+static void spt_RunHeapDown(spt_RunKeys const * k, sptNnzIndex const * head, sptIndex * heap, sptIndex const size, sptIndex i) {
+    for(;;) {
+        sptIndex const l = 2 * i + 1, r = l + 1;
+        sptIndex top = i;
+        if(l < size && spt_RunHeapLess(k, head, heap[l], heap[top])) {
+            top = l;
+        }
+        if(r < size && spt_RunHeapLess(k, head, heap[r], heap[top])) {
+            top = r;
+        }
+        if(top == i) {
+            return;
+        }
+        sptIndex const t = heap[i];
+        heap[i] = heap[top];
+        heap[top] = t;
+        i = top;
+    }
+}
+
+/* Merge the pieces [from[r], to[r]) of every run into out, positions relative to begin */
+static void spt_RunMergePart(spt_RunKeys const * k, sptIndex const nruns, sptNnzIndex const * from, sptNnzIndex const * to,
+    sptNnzIndex const begin, sptNnzIndex * out)
+{
+    sptNnzIndex head[SPT_SORT_MAX_RUNS];
+    sptIndex heap[SPT_SORT_MAX_RUNS];
+    sptIndex size = 0;
+    for(sptIndex r = 0; r < nruns; ++r) {
+        head[r] = from[r];
+        if(from[r] < to[r]) {
+            heap[size++] = r;
+        }
+    }
+    for(sptIndex i = size / 2; i-- > 0; ) {
+        spt_RunHeapDown(k, head, heap, size, i);
+    }
+    sptNnzIndex o = 0;
+    while(size > 0) {
+        sptIndex const r = heap[0];
+        out[o++] = head[r] - begin;
+        if(++head[r] == to[r]) {
+            heap[0] = heap[--size];
+        }
+        spt_RunHeapDown(k, head, heap, size, 0);
+    }
+}
+
+/**
+ * Sort the nonzeros [begin, end) on the key modes, compared after a right
+ * shift by shift_bits, when they are already sorted or form at most
+ * SPT_SORT_MAX_RUNS sorted runs.
+ * @return 1 if the range is now sorted, 0 if it has too many runs and is untouched
+ */
+int spt_SparseTensorMergeRuns(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    int const tk)
+{
+    spt_RunKeys const k = { tsr, nkeys, key_modes, shift_bits };
+    sptNnzIndex const n = end - begin;
+    if(n < 2) {
+        return 1;
+    }
+
+    /* Count the breaks; stop early once there are too many */
+    sptNnzIndex nbreaks = 0;
+    #pragma omp parallel for schedule(static) reduction(+:nbreaks) num_threads(tk)
+    for(sptNnzIndex z = begin + 1; z < end; ++z) {
+        nbreaks += nbreaks <= SPT_SORT_MAX_RUNS && spt_RunCompare(&k, z - 1, z) > 0;
+    }
+    if(nbreaks == 0) {
+        return 1;
+    }
+    if(nbreaks >= SPT_SORT_MAX_RUNS) {
+        return 0;
+    }
+    sptIndex const nruns = (sptIndex) nbreaks + 1;
+    sptNnzIndex starts[SPT_SORT_MAX_RUNS + 1];
+    sptIndex r = 0;
+    starts[r++] = begin;
+    for(sptNnzIndex z = begin + 1; z < end; ++z) {
+        if(spt_RunCompare(&k, z - 1, z) > 0) {
+            starts[r++] = z;
+        }
+    }
+    starts[nruns] = end;
+
+    /* One part per thread, cut at sampled splitters */
+    sptIndex nparts = (sptIndex) (tk > 1 ? tk : 1);
+    if(n < (sptNnzIndex) nparts * SPT_SORT_SAMPLES_PER_PART) {
+        nparts = 1;
+    }
+    sptIndex const nsamples = nparts * SPT_SORT_SAMPLES_PER_PART;
+    sptNnzIndex * samples = malloc(nsamples * sizeof *samples);
+    sptNnzIndex * cuts = malloc((size_t) (nparts + 1) * nruns * sizeof *cuts);
+    sptNnzIndex * offsets = malloc((nparts + 1) * sizeof *offsets);
+    sptNnzIndex * perm = malloc(n * sizeof *perm);
+    spt_CheckOSError(!samples || !cuts || !offsets || !perm, "SpTns Merge Runs");
+    for(sptIndex s = 0; s < nsamples; ++s) {
+        sptNnzIndex const pos = begin + (sptNnzIndex) ((2 * (double) s + 1) * n / (2 * nsamples));
+        sptIndex i = s;
+        for(; i > 0 && spt_RunCompare(&k, samples[i-1], pos) > 0; --i) {
+            samples[i] = samples[i-1];
+        }
+        samples[i] = pos;
+    }
+    offsets[0] = 0;
+    for(sptIndex p = 0; p <= nparts; ++p) {
+        sptNnzIndex * const cut = cuts + (size_t) p * nruns;
+        for(sptIndex q = 0; q < nruns; ++q) {
+            cut[q] = p == 0 ? starts[q] : p == nparts ? starts[q+1] :
+                spt_RunLowerBound(&k, starts[q], starts[q+1], samples[p * SPT_SORT_SAMPLES_PER_PART]);
+        }
+        if(p > 0) {
+            offsets[p] = offsets[p-1];
+            for(sptIndex q = 0; q < nruns; ++q) {
+                offsets[p] += cut[q] - cuts[(size_t) (p-1) * nruns + q];
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(tk)
+    for(sptIndex p = 0; p < nparts; ++p) {
+        spt_RunMergePart(&k, nruns, cuts + (size_t) p * nruns, cuts + (size_t) (p+1) * nruns, begin, perm + offsets[p]);
+    }
+    int const result = spt_SparseTensorApplyPermutation(tsr, begin, n, perm, tk);
+
+    free(samples);
+    free(cuts);
+    free(offsets);
+    free(perm);
+    spt_CheckError(result, "SpTns Merge Runs", NULL);
+    return 1;
+}
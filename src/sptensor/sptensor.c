@@ -28,6 +28,19 @@
  * @param ndims  the dimension of each mode the tensor will have
  */
 int sptNewSparseTensor(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndims[]) {
+    return sptNewSparseTensorWithBacking(tsr, nmodes, ndims, SPT_MEM_DEFAULT);
+}
+
+/**
+ * Create a new sparse tensor whose index and value arrays get the requested
+ * backing, e.g. SPT_MEM_HUGE_2MB, as they grow; see sptMallocBacked.
+ * SPT_MEM_DEFAULT takes those of sptSetDataPlacement.
+ * @param tsr     a pointer to an uninitialized sparse tensor
+ * @param nmodes  number of modes the tensor will have
+ * @param ndims   the dimension of each mode the tensor will have
+ * @param backing the backing to request
+ */
+int sptNewSparseTensorWithBacking(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndims[], sptMemBacking const backing) {
     sptIndex i;
     int result;
     tsr->nmodes = nmodes;
@@ -47,6 +60,28 @@ int sptNewSparseTensor(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex ndi
     }
     result = sptNewValueVector(&tsr->values, 0, 0);
     spt_CheckError(result, "SpTns New", NULL);
+    tsr->cache = NULL;
+    result = sptPlaceSparseTensor(tsr, backing);
+    spt_CheckError(result, "SpTns New", NULL);
+    return 0;
+}
+
+/**
+ * Move the index and value arrays of a sparse tensor to the requested
+ * backing, which they keep as they grow, e.g. SPT_MEM_CAPACITY to free DRAM
+ * for the factor matrices. SPT_MEM_DEFAULT moves each to the backing
+ * sptSetDataPlacement sets for its class. Arrays already there are left
+ * alone; those not from sptMalloc, of mapped or wrapped tensors, cannot move.
+ * @param tsr     the tensor to move
+ * @param backing the backing to request
+ */
+int sptPlaceSparseTensor(sptSparseTensor *tsr, sptMemBacking const backing) {
+    sptMemBacking const ind_backing = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_COO_INDICES);
+    sptMemBacking const val_backing = backing != SPT_MEM_DEFAULT ? backing : sptDataPlacement(SPT_DATA_COO_VALUES);
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        spt_PlaceVector(&tsr->inds[m], ind_backing, "SpTns Place");
+    }
+    spt_PlaceVector(&tsr->values, val_backing, "SpTns Place");
     return 0;
 }
 
@@ -71,8 +106,33 @@ int sptCopySparseTensor(sptSparseTensor *dest, const sptSparseTensor *src, int c
         result = sptCopyIndexVector(&dest->inds[i], &src->inds[i], nt);
         spt_CheckError(result, "SpTns Copy", NULL);
     }
-    result = sptCopyValueVector(&dest->values, &src->values, nt);
-    spt_CheckError(result, "SpTns Copy", NULL);
+    if(sptSparseTensorIsPattern(src)) {
+        dest->values.len = 0;
+        dest->values.cap = 0;
+        dest->values.data = NULL;
+    } else {
+        result = sptCopyValueVector(&dest->values, &src->values, nt);
+        spt_CheckError(result, "SpTns Copy", NULL);
+    }
+    dest->cache = NULL;
+    return 0;
+}
+
+/**
+ * Move the index and value arrays of a sparse tensor into freshly allocated
+ * memory that is first touched in parallel, e.g. after a serial load.
+ * Under a first-touch NUMA policy each thread's `schedule(static)` share of
+ * nonzeros then lives on its own node. Needs the tensor's size in extra memory
+ * while copying.
+ * @param tsr the tensor to move
+ * @param nt  the number of threads copying
+ */
+int sptSparseTensorFirstTouch(sptSparseTensor *tsr, int const nt) {
+    sptSparseTensor moved;
+    int result = sptCopySparseTensor(&moved, tsr, nt);
+    spt_CheckError(result, "SpTns FirstTouch", NULL);
+    sptFreeSparseTensor(tsr);
+    *tsr = moved;
     return 0;
 }
 
@@ -82,6 +142,7 @@ int sptCopySparseTensor(sptSparseTensor *dest, const sptSparseTensor *src, int c
  */
 void sptFreeSparseTensor(sptSparseTensor *tsr) {
     sptIndex i;
+    spt_SparseTensorFreeCache(tsr);
     for(i = 0; i < tsr->nmodes; ++i) {
         sptFreeIndexVector(&tsr->inds[i]);
     }
@@ -93,10 +154,386 @@ void sptFreeSparseTensor(sptSparseTensor *tsr) {
 }
 
 
+/**
+ * Make a sparse tensor over index and value arrays the caller owns, such as
+ * NumPy arrays, without copying them.
+ *
+ * `inds[m].data` and `values.data` point straight at the arrays. In-place
+ * kernels such as sorting reorder them, but they must not be grown or freed
+ * by the library; release the tensor with sptUnwrapSparseTensor instead of
+ * sptFreeSparseTensor, and the arrays only after that.
+ *
+ * @param tsr    an uninitialized sparse tensor
+ * @param nmodes number of modes
+ * @param ndims  the dimension of each mode
+ * @param nnz    number of nonzeros, the length of every array
+ * @param inds   the zero-based indices of each mode, nmodes arrays
+ * @param values the nonzero values, or NULL for a pattern tensor
+ */
+int sptWrapSparseTensor(
+    sptSparseTensor *tsr,
+    sptIndex const nmodes,
+    const sptIndex ndims[],
+    sptNnzIndex const nnz,
+    sptIndex * const inds[],
+    sptValue * const values)
+{
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            if(inds[m][z] >= ndims[m]) {
+                spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Wrap", "index out of range");
+            }
+        }
+    }
+    tsr->nmodes = nmodes;
+    tsr->nnz = nnz;
+    tsr->sortorder = malloc(nmodes * sizeof *tsr->sortorder);
+    spt_CheckOSError(!tsr->sortorder, "SpTns Wrap");
+    tsr->ndims = malloc(nmodes * sizeof *tsr->ndims);
+    spt_CheckOSError(!tsr->ndims, "SpTns Wrap");
+    tsr->inds = malloc(nmodes * sizeof *tsr->inds);
+    spt_CheckOSError(!tsr->inds, "SpTns Wrap");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        tsr->sortorder[m] = m;
+        tsr->ndims[m] = ndims[m];
+        tsr->inds[m].len = nnz;
+        tsr->inds[m].cap = nnz;
+        tsr->inds[m].data = inds[m];
+    }
+    tsr->values.len = values != NULL ? nnz : 0;
+    tsr->values.cap = tsr->values.len;
+    tsr->values.data = values;
+    tsr->cache = NULL;
+    return 0;
+}
+
+/**
+ * Release a sparse tensor made by sptWrapSparseTensor, leaving its arrays
+ * to their owner
+ * @param tsr the wrapping tensor
+ */
+void sptUnwrapSparseTensor(sptSparseTensor *tsr) {
+    spt_SparseTensorFreeCache(tsr);
+    free(tsr->sortorder);
+    free(tsr->ndims);
+    free(tsr->inds);
+    tsr->nmodes = 0;
+    tsr->nnz = 0;
+}
+
+
+/**
+ * Whether a sparse tensor is a pattern tensor, one without a value array
+ * whose nonzeros are all 1.
+ * @param tsr the sparse tensor
+ */
+int sptSparseTensorIsPattern(const sptSparseTensor *tsr) {
+    return tsr->values.data == NULL;
+}
+
+/**
+ * Turn a sparse tensor whose values are all 1, such as a binary tensor, into
+ * a pattern tensor by freeing its value array.
+ *
+ * MTTKRP (sptMTTKRP, sptOmpMTTKRP and sptOmpMTTKRPWorkspace), TTM
+ * (sptSparseTensorMulMatrix and sptOmpSparseTensorMulMatrix), the norms,
+ * sorting, copying and dumping skip the value loads and multiplications of
+ * pattern tensors. Other kernels need the values back from
+ * sptSparseTensorRestoreValues first.
+ * @param tsr the sparse tensor, unchanged if a value is not 1
+ */
+int sptSparseTensorDropValues(sptSparseTensor *tsr) {
+    if(sptSparseTensorIsPattern(tsr)) {
+        return 0;
+    }
+    int ones = 1;
+    #pragma omp parallel for reduction(&&:ones)
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        ones = ones && tsr->values.data[z] == 1;
+    }
+    if(!ones) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Pattern", "not every value is 1");
+    }
+    sptFreeValueVector(&tsr->values);
+    tsr->values.data = NULL;
+    return 0;
+}
+
+/**
+ * Give a pattern tensor back a value array of ones
+ * @param tsr the sparse tensor, unchanged unless a pattern tensor
+ */
+int sptSparseTensorRestoreValues(sptSparseTensor *tsr) {
+    if(!sptSparseTensorIsPattern(tsr)) {
+        return 0;
+    }
+    int result = sptNewValueVector(&tsr->values, tsr->nnz, tsr->nnz);
+    spt_CheckError(result, "SpTns Pattern", NULL);
+    #pragma omp parallel for
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        tsr->values.data[z] = 1;
+    }
+    return 0;
+}
+
+
+/* Reserve room for nnz nonzeros in all index and value vectors of tsr */
+int spt_SparseTensorReserve(sptSparseTensor *tsr, sptNnzIndex const nnz) {
+    int result;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        result = sptReserveIndexVector(&tsr->inds[m], nnz);
+        spt_CheckError(result, "SpTns Reserve", NULL);
+    }
+    if(!sptSparseTensorIsPattern(tsr)) {
+        result = sptReserveValueVector(&tsr->values, nnz);
+        spt_CheckError(result, "SpTns Reserve", NULL);
+    }
+    return 0;
+}
+
+/**
+ * Create a sparse tensor holding exactly nnz nonzeros, for kernels that know
+ * the size of their output and write every slot once, in parallel
+ */
+int spt_SparseTensorNewSized(sptSparseTensor *Y, sptIndex const nmodes, sptIndex const ndims[], sptNnzIndex const nnz) {
+    int result = sptNewSparseTensor(Y, nmodes, ndims);
+    spt_CheckError(result, "SpTns New Sized", NULL);
+    result = spt_SparseTensorReserve(Y, nnz);
+    spt_CheckError(result, "SpTns New Sized", NULL);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        Y->inds[m].len = nnz;
+    }
+    Y->values.len = nnz;
+    Y->nnz = nnz;
+    return 0;
+}
+
+
+/**
+ * Release the data cached on a sparse tensor, such as fiber indices, slice
+ * pointers and sorted copies; whether copies are kept stays as set. The sorts, shuffles and
+ * in-place scalar ops call this themselves; code that rewrites a tensor's
+ * indices or values directly must call it before the next kernel.
+ * @param tsr the tensor whose cache to release
+ */
+void sptSparseTensorDropCache(sptSparseTensor *tsr) {
+    if(tsr->cache == NULL) {
+        return;
+    }
+    spt_SparseTensorDropOrderCache(tsr);
+    if(tsr->cache->sliceptr != NULL) {
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            free(tsr->cache->sliceptr[m]);
+        }
+        free(tsr->cache->sliceptr);
+        tsr->cache->sliceptr = NULL;
+    }
+    tsr->cache->has_fingerprint = 0;
+    if(tsr->cache->copies != NULL) {
+        for(sptIndex m = 0; m < 2 * tsr->nmodes; ++m) {
+            if(tsr->cache->copies[m] != NULL) {
+                sptFreeSparseTensor(tsr->cache->copies[m]);
+                free(tsr->cache->copies[m]);
+                tsr->cache->copies[m] = NULL;
+            }
+        }
+    }
+}
+
+/**
+ * Keep a copy of a sparse tensor sorted at each mode that a TTM or TTV is run
+ * on, built on first use. Sweeps that alternate modes, such as HOOI or CPD,
+ * then stop re-sorting the tensor on every call, for up to nmodes times its
+ * memory. Disabling releases the copies.
+ * @param tsr    the tensor
+ * @param enable 1 to keep copies, 0 to release them
+ */
+int sptSparseTensorKeepSortedCopies(sptSparseTensor *tsr, int const enable) {
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(tsr);
+    spt_CheckOSError(!cache, "SpTns KeepCopies");
+    if(enable && cache->copies == NULL) {
+        cache->copies = calloc(2 * tsr->nmodes, sizeof *cache->copies);
+        spt_CheckOSError(!cache->copies, "SpTns KeepCopies");
+    } else if(!enable && cache->copies != NULL) {
+        sptSparseTensorDropCache(tsr);
+        free(cache->copies);
+        cache->copies = NULL;
+    }
+    return 0;
+}
+
+/* Release what depends on the order of the nonzeros, i.e. the fiber index and which mode's slices are contiguous */
+void spt_SparseTensorDropOrderCache(sptSparseTensor *tsr) {
+    if(tsr->cache == NULL) {
+        return;
+    }
+    if(tsr->cache->fibermode != tsr->nmodes) {
+        sptFreeNnzIndexVector(&tsr->cache->fiberidx);
+        tsr->cache->fibermode = tsr->nmodes;
+    }
+    tsr->cache->slicemode = tsr->nmodes;
+}
+
+/* Release the cache itself, on freeing the tensor */
+void spt_SparseTensorFreeCache(sptSparseTensor *tsr) {
+    if(tsr->cache == NULL) {
+        return;
+    }
+    sptSparseTensorDropCache(tsr);
+    free(tsr->cache->copies);
+    free(tsr->cache);
+    tsr->cache = NULL;
+}
+
+/* The tensor's cache, created empty or emptied if nnz changed since it was built, NULL on allocation failure */
+struct spt_SparseTensorCache * spt_SparseTensorGetCache(sptSparseTensor *tsr) {
+    if(tsr->cache != NULL && tsr->cache->nnz != tsr->nnz) {
+        sptSparseTensorDropCache(tsr);
+        tsr->cache->nnz = tsr->nnz;
+    }
+    if(tsr->cache == NULL) {
+        tsr->cache = malloc(sizeof *tsr->cache);
+        if(tsr->cache == NULL) {
+            return NULL;
+        }
+        tsr->cache->nnz = tsr->nnz;
+        tsr->cache->fibermode = tsr->nmodes;
+        tsr->cache->copies = NULL;
+        tsr->cache->sliceptr = NULL;
+        tsr->cache->slicemode = tsr->nmodes;
+        tsr->cache->has_fingerprint = 0;
+        tsr->cache->mapped_offset = 0;
+    }
+    return tsr->cache;
+}
+
+/* Record a known sptSparseTensorFingerprint of tsr, e.g. one read with it; nothing if the cache cannot be made */
+void spt_SparseTensorSetFingerprint(sptSparseTensor const *tsr, uint64_t const fingerprint) {
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache((sptSparseTensor *) tsr);
+    if(cache != NULL) {
+        cache->fingerprint = fingerprint;
+        cache->has_fingerprint = 1;
+    }
+}
+
+/*
+ * The nnz-weighted slice pointer of a mode, ndims[mode]+1 prefix sums of the
+ * slice sizes, counted on first use and kept until the indices change. Sizes
+ * do not depend on the order of the nonzeros, so sorts keep it; when
+ * spt_SparseTensorIsSliceSorted holds it gives each slice's position too.
+ * NULL on allocation failure. The cache is not part of the tensor's value, so
+ * a const tensor still fills it.
+ */
+sptNnzIndex const * spt_SparseTensorSlicePtr(sptSparseTensor const *tsr, sptIndex const mode) {
+    sptSparseTensor * const mtsr = (sptSparseTensor *) tsr;
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(mtsr);
+    if(cache == NULL) {
+        return NULL;
+    }
+    if(cache->sliceptr == NULL) {
+        cache->sliceptr = calloc(tsr->nmodes, sizeof *cache->sliceptr);
+        if(cache->sliceptr == NULL) {
+            return NULL;
+        }
+    }
+    if(cache->sliceptr[mode] == NULL) {
+        sptIndex const nslices = tsr->ndims[mode];
+        sptNnzIndex * ptr = malloc(((sptNnzIndex) nslices + 1) * sizeof *ptr);
+        if(ptr == NULL) {
+            return NULL;
+        }
+        spt_ComputeSliceSizes(ptr + 1, tsr, mode);
+        ptr[0] = 0;
+        for(sptIndex i = 0; i < nslices; ++i) {
+            ptr[i+1] += ptr[i];
+        }
+        cache->sliceptr[mode] = ptr;
+    }
+    return cache->sliceptr[mode];
+}
+
+/*
+ * Whether the indices of a mode are nondecreasing, so its slices are contiguous
+ * runs of nonzeros. The data is checked rather than sortorder, which a tensor
+ * built in place may not honour, and a positive answer is kept until the next
+ * sort or shuffle.
+ */
+int spt_SparseTensorIsSliceSorted(sptSparseTensor const *tsr, sptIndex const mode) {
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache((sptSparseTensor *) tsr);
+    if(cache != NULL && cache->slicemode == mode) {
+        return 1;
+    }
+    sptIndex const * const ind = tsr->inds[mode].data;
+    sptNnzIndex const nnz = tsr->nnz;
+    int sorted = 1;
+    #pragma omp parallel for schedule(static) reduction(&&:sorted)
+    for(sptNnzIndex z = 1; z < nnz; ++z) {
+        sorted = sorted && ind[z - 1] <= ind[z];
+    }
+    if(sorted && cache != NULL) {
+        cache->slicemode = mode;
+    }
+    return sorted;
+}
+
+/*
+ * The tensor sorted in mode_order, for the kernels to read. Without kept
+ * copies it is tsr sorted in place; with them it is tsr if already in that
+ * order, else the copy cached in slot. NULL on allocation failure.
+ */
+sptSparseTensor * spt_SparseTensorSortedInOrder(sptSparseTensor *tsr, sptIndex const *mode_order, sptIndex const slot) {
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(tsr);
+    if(cache == NULL || cache->copies == NULL) {
+        if(!spt_SparseTensorIsSortedInOrder(tsr, mode_order)) {
+            sptSparseTensorSortIndexCustomOrder(tsr, mode_order, 1);
+        }
+        return tsr;
+    }
+    if(spt_SparseTensorIsSortedInOrder(tsr, mode_order)) {
+        return tsr;
+    }
+    if(cache->copies[slot] == NULL) {
+        sptSparseTensor * copy = malloc(sizeof *copy);
+        if(copy == NULL || sptCopySparseTensor(copy, tsr, 1) != 0) {
+            free(copy);
+            return NULL;
+        }
+        sptSparseTensorSortIndexCustomOrder(copy, mode_order, 1);
+        cache->copies[slot] = copy;
+    }
+    return cache->copies[slot];
+}
+
+/* The tensor sorted at mode as sptSparseTensorSortIndexAtMode would, see spt_SparseTensorSortedInOrder */
+sptSparseTensor * spt_SparseTensorSortedAtMode(sptSparseTensor *tsr, sptIndex const mode) {
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(tsr);
+    if(cache == NULL || cache->copies == NULL) {
+        sptSparseTensorSortIndexAtMode(tsr, mode, 0);
+        return tsr;
+    }
+    sptIndex * order = malloc(tsr->nmodes * sizeof *order);
+    if(order == NULL) {
+        return NULL;
+    }
+    for(sptIndex m = 0, k = 0; m < tsr->nmodes; ++m) {
+        if(m != mode) {
+            order[k++] = m;
+        }
+    }
+    order[tsr->nmodes - 1] = mode;
+    sptSparseTensor * sorted = spt_SparseTensorSortedInOrder(tsr, order, mode);
+    free(order);
+    return sorted;
+}
+
+
 double SparseTensorFrobeniusNormSquared(sptSparseTensor const * const spten) 
 {
   double norm = 0;
   sptValue const * const restrict vals = spten->values.data;
+  if(vals == NULL) {
+    return (double) spten->nnz;
+  }
   
 #ifdef PARTI_USE_OPENMP
   #pragma omp parallel for reduction(+:norm)
@@ -108,72 +545,160 @@ double SparseTensorFrobeniusNormSquared(sptSparseTensor const * const spten)
 }
 
 
-int spt_DistSparseTensor(sptSparseTensor * tsr,
-    int const nthreads,
-    sptNnzIndex * const dist_nnzs,
-    sptIndex * dist_nrows) {
+/* splitmix64 finalizer */
+static uint64_t spt_Mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
 
-    sptNnzIndex global_nnz = tsr->nnz;
-    sptNnzIndex aver_nnz = global_nnz / nthreads;
-    memset(dist_nnzs, 0, nthreads*sizeof(sptNnzIndex));
-    memset(dist_nrows, 0, nthreads*sizeof(sptIndex));
-
-    sptSparseTensorSortIndex(tsr, 0);
-    sptIndex * ind0 = tsr->inds[0].data;
-
-    int ti = 0;
-    dist_nnzs[0] = 1;
-    dist_nrows[0] = 1;
-    for(sptNnzIndex x=1; x<global_nnz; ++x) {
-        if(ind0[x] == ind0[x-1]) {
-            ++ dist_nnzs[ti];
-        } else if (ind0[x] > ind0[x-1]) {
-            if(dist_nnzs[ti] < aver_nnz || ti == nthreads-1) {
-                ++ dist_nnzs[ti];
-                ++ dist_nrows[ti];
-            } else {
-                ++ ti;
-                ++ dist_nnzs[ti];
-                ++ dist_nrows[ti];
-            }
-        } else {
-            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Dist", "tensor unsorted on mode-0");
+uint64_t spt_FingerprintShape(sptIndex const nmodes, sptIndex const * const ndims, sptNnzIndex const nnz) {
+    uint64_t h = spt_Mix64(nmodes);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        h = spt_Mix64(h ^ ndims[m]);
+    }
+    return spt_Mix64(h ^ nnz);
+}
+
+uint64_t spt_FingerprintNonzero(sptIndex const nmodes, sptIndex const * const inds, sptValue const * const value) {
+    /* A pattern tensor hashes as its nonzeros of 1 */
+    sptValue const one = 1;
+    uint64_t e = 0x9e3779b97f4a7c15ULL;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        e = spt_Mix64(e ^ inds[m]);
+    }
+    uint64_t vbits = 0;
+    memcpy(&vbits, value != NULL ? value : &one, sizeof one);
+    return spt_Mix64(e ^ vbits);
+}
+
+uint64_t spt_FingerprintCombine(uint64_t const shape, uint64_t const sum) {
+    return spt_Mix64(shape ^ sum);
+}
+
+/**
+ * A 64-bit fingerprint of a sparse tensor's shape and nonzeros, e.g. to
+ * recognize the tensor a tuning plan was made for. Nonzeros are hashed
+ * independently and summed, so the fingerprint does not depend on their order.
+ * It is kept in the tensor's cache until the cache is dropped, and binary
+ * files store it, so after sptLoadSparseTensorBinary or sptMmapSparseTensor
+ * it costs nothing.
+ * @param tsr the tensor to fingerprint
+ */
+uint64_t sptSparseTensorFingerprint(sptSparseTensor const * const tsr) {
+    if(tsr->cache != NULL && tsr->cache->nnz == tsr->nnz && tsr->cache->has_fingerprint) {
+        return tsr->cache->fingerprint;
+    }
+    sptIndex const nmodes = tsr->nmodes;
+    uint64_t sum = 0;
+    #pragma omp parallel for reduction(+:sum)
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        sptIndex inds[nmodes];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            inds[m] = tsr->inds[m].data[z];
         }
+        sum += spt_FingerprintNonzero(nmodes, inds, tsr->values.data != NULL ? &tsr->values.data[z] : NULL);
     }
+    uint64_t const h = spt_FingerprintCombine(spt_FingerprintShape(nmodes, tsr->ndims, tsr->nnz), sum);
+    spt_SparseTensorSetFingerprint(tsr, h);
+    return h;
+}
 
-    return 0;
+/**
+ * A 64-bit fingerprint of a sparse tensor's shape, nnz, sort order and
+ * nsamples of its nonzeros, evenly strided, each hashed with its position.
+ * Unlike sptSparseTensorFingerprint it depends on the order of the
+ * nonzeros, and it reads O(nsamples) of them, so it suits keys for data
+ * laid out after the tensor's arrays when a full pass costs too much.
+ * Tensors that differ only between the samples collide; nsamples = 0 or
+ * at least nnz hashes every nonzero.
+ * @param tsr      the tensor to fingerprint
+ * @param nsamples the number of nonzeros hashed
+ */
+uint64_t sptSparseTensorFingerprintSampled(sptSparseTensor const * const tsr, sptNnzIndex nsamples) {
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    if(nsamples == 0 || nsamples > nnz) {
+        nsamples = nnz;
+    }
+    uint64_t h = spt_Mix64(nmodes);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        h = spt_Mix64(h ^ tsr->ndims[m]);
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        h = spt_Mix64(h ^ tsr->sortorder[m]);
+    }
+    h = spt_Mix64(h ^ nnz);
+    h = spt_Mix64(h ^ nsamples);
 
+    sptValue const one = 1;
+    sptNnzIndex const step = nsamples > 0 ? nnz / nsamples : 0;
+    sptNnzIndex const rest = nsamples > 0 ? nnz % nsamples : 0;
+    uint64_t sum = 0;
+    #pragma omp parallel for reduction(+:sum)
+    for(sptNnzIndex s = 0; s < nsamples; ++s) {
+        sptNnzIndex const z = s * step + s * rest / nsamples;
+        uint64_t e = spt_Mix64(0x9e3779b97f4a7c15ULL ^ z);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            e = spt_Mix64(e ^ tsr->inds[m].data[z]);
+        }
+        uint64_t vbits = 0;
+        memcpy(&vbits, tsr->values.data != NULL ? &tsr->values.data[z] : &one, sizeof one);
+        sum += spt_Mix64(e ^ vbits);
+    }
+    return spt_Mix64(h ^ sum);
 }
 
 
+/**
+ * Distribute the nonzeros of tsr among nthreads threads in consecutive ranges
+ * of whole mode-0 slices with about equal nonzeros: the mode-0 sharding of
+ * sptNewSparseTensorSharding, which sorts tsr by mode 0 if needed.
+ * @param[out] dist_nnzs  the nonzeros of each thread's range
+ * @param[out] dist_nrows  the nonempty mode-0 slices of each thread's range
+ */
 int spt_DistSparseTensorFixed(sptSparseTensor * tsr,
     int const nthreads,
     sptNnzIndex * const dist_nnzs,
     sptNnzIndex * dist_nrows) {
 
-    sptNnzIndex global_nnz = tsr->nnz;
-    sptNnzIndex aver_nnz = global_nnz / nthreads;
-    memset(dist_nnzs, 0, nthreads*sizeof(sptNnzIndex));
-
-    sptSparseTensorSortIndex(tsr, 0);
-    sptIndex * ind0 = tsr->inds[0].data;
-
-    int ti = 0;
-    dist_nnzs[0] = 1;
-    for(sptNnzIndex x=1; x<global_nnz; ++x) {
-        if(ind0[x] == ind0[x-1]) {
-            ++ dist_nnzs[ti];
-        } else if (ind0[x] > ind0[x-1]) {
-            if(dist_nnzs[ti] < aver_nnz || ti == nthreads-1) {
-                ++ dist_nnzs[ti];
-            } else {
-                ++ ti;
-                ++ dist_nnzs[ti];
-            }
-        } else {
-            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Dist", "tensor unsorted on mode-0");
+    sptSparseTensorSharding sh;
+    int result = sptNewSparseTensorSharding(&sh, tsr, 0, (sptIndex) nthreads);
+    spt_CheckError(result, "SpTns Dist", NULL);
+    sptNnzIndex const * ptr = spt_SparseTensorSlicePtr(tsr, 0);
+    spt_CheckOSError(!ptr, "SpTns Dist");
+    for(int t = 0; t < nthreads; ++t) {
+        dist_nnzs[t] = sh.nnz_ptr[t+1] - sh.nnz_ptr[t];
+        dist_nrows[t] = 0;
+        for(sptIndex i = sh.slice_ptr[t]; i < sh.slice_ptr[t+1]; ++i) {
+            dist_nrows[t] += ptr[i+1] > ptr[i];
         }
     }
+    sptFreeSparseTensorSharding(&sh);
+
+    return 0;
+}
+
+
+/**
+ * As spt_DistSparseTensorFixed, with slice counts in sptIndex
+ */
+int spt_DistSparseTensor(sptSparseTensor * tsr,
+    int const nthreads,
+    sptNnzIndex * const dist_nnzs,
+    sptIndex * dist_nrows) {
+
+    sptNnzIndex * nrows = malloc(nthreads * sizeof *nrows);
+    spt_CheckOSError(!nrows, "SpTns Dist");
+    int result = spt_DistSparseTensorFixed(tsr, nthreads, dist_nnzs, nrows);
+    for(int t = 0; result == 0 && t < nthreads; ++t) {
+        dist_nrows[t] = (sptIndex) nrows[t];
+    }
+    free(nrows);
+    spt_CheckError(result, "SpTns Dist", NULL);
 
     return 0;
 }
@@ -190,6 +715,7 @@ int spt_DistSparseTensorFixed(sptSparseTensor * tsr,
 void sptSparseTensorShuffleIndices(sptSparseTensor *tsr, sptIndex ** map_inds) {
     /* Renumber nonzero elements */
     sptIndex tmp_ind;
+    sptSparseTensorDropCache(tsr);
     for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
         for(sptIndex m = 0; m < tsr->nmodes; ++m) {
             tmp_ind = tsr->inds[m].data[z];
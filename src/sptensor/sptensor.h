@@ -26,9 +26,257 @@ extern "C" {
 #include <ParTI.h>
 #include "../error/error.h"
 
+/* Binary container shared by sptDumpSparseTensorBinary and sptMmapSparseTensor */
+#define PARTI_BINARY_MAGIC "PTISPTNS"
+#define PARTI_BINARY_VERSION 2
+#define PARTI_BINARY_ENDIAN 0x01020304u
+#define PARTI_BINARY_ALIGN 64
+
+typedef struct {
+    char magic[8];          /// PARTI_BINARY_MAGIC, not NUL-terminated
+    uint32_t version;
+    uint32_t endian;        /// PARTI_BINARY_ENDIAN as written by the producer
+    uint32_t nmodes;
+    uint32_t index_width;   /// bytes per stored index
+    uint32_t value_width;   /// bytes per stored value
+    uint32_t reserved;
+    uint64_t nnz;
+    uint64_t data_offset;   /// byte offset of inds[0], aligned to PARTI_BINARY_ALIGN
+} spt_SparseTensorBinaryHeader;
+/* Followed by uint64 ndims[nmodes], uint32 sortorder[nmodes], from version 2
+   the uint64 sptSparseTensorFingerprint of the tensor, padding, then nmodes
+   index arrays and the value array, each padded to PARTI_BINARY_ALIGN. */
+
+static inline uint64_t spt_BinaryAlignUp(uint64_t const bytes) {
+    return (bytes + PARTI_BINARY_ALIGN - 1) / PARTI_BINARY_ALIGN * PARTI_BINARY_ALIGN;
+}
+/* Bytes of the header, ndims, sortorder and, from version 2, the fingerprint, before the padding */
+static inline uint64_t spt_SparseTensorBinaryHeadBytes(sptIndex const nmodes, uint32_t const version) {
+    return sizeof(spt_SparseTensorBinaryHeader) + nmodes * (sizeof(uint64_t) + sizeof(uint32_t)) +
+        (version >= 2 ? sizeof(uint64_t) : 0);
+}
+uint64_t spt_SparseTensorBinaryDataOffset(sptIndex const nmodes);
+uint64_t spt_SparseTensorBinaryFileSize(spt_SparseTensorBinaryHeader const * const header);
+int spt_SparseTensorBinaryCheckHeader(spt_SparseTensorBinaryHeader const * const header);
+int spt_BinarySkip(uint64_t bytes, FILE *fp);
+int spt_MmapSparseTensorFd(sptSparseTensor *tsr, int fd);
+/* Named tensor segments: POSIX shared memory for "/name", otherwise a file path */
+int spt_OpenTensorSegment(const char *name, int const flags);
+
+/* Packed container of sptDumpPackedSparseTensor, see packed.c */
+#define PARTI_PACKED_MAGIC "PTIPACKD"
+
+typedef struct {
+    char magic[8];          /// PARTI_PACKED_MAGIC, not NUL-terminated
+    uint32_t version;       /// PARTI_BINARY_VERSION
+    uint32_t endian;        /// PARTI_BINARY_ENDIAN as written by the producer
+    uint32_t nmodes;
+    uint32_t block;         /// PARTI_PACKED_BLOCK of the producer
+    uint32_t index_width;   /// bytes of sptIndex of the producer
+    uint32_t value_width;   /// bytes per stored value
+    uint64_t nnz;
+    uint64_t nwords;        /// packed 64-bit words
+} spt_PackedBinaryHeader;
+/* Followed by uint64 ndims[nmodes], uint32 sortorder[nmodes], the uint64
+   fingerprint of the packed tensor, padding, then uint64 firsts, uint8 widths, uint64 offsets, the words and the values,
+   each padded to PARTI_BINARY_ALIGN. */
+
+void spt_PackedBinarySections(spt_PackedBinaryHeader const * const header, uint64_t sections[6]);
+int spt_PackedBinaryCheckHeader(spt_PackedBinaryHeader const * const header);
+void spt_UnpackBlock(
+    sptIndex * restrict inds,
+    sptPackedSparseTensor const * const P,
+    sptNnzIndex const b,
+    uint64_t const * words);
+int spt_PackedMTTKRPAccumulate(
+    sptPackedSparseTensor const * const P,
+    sptNnzIndex const b_begin,
+    sptNnzIndex const b_end,
+    uint64_t const * const words,
+    uint64_t const word_base,
+    sptValue const * const values,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    int const tk);
+
+/* Asynchronous reads of the streaming kernels, see async_read.c */
+typedef struct spt_AsyncReader spt_AsyncReader;
+int spt_StreamQueueDepth(void);
+sptIndex spt_StreamPrefetchDistance(void);
+int spt_PreadAll(int fd, void * dst, size_t bytes, uint64_t offset);
+int spt_AsyncReaderOpen(spt_AsyncReader ** reader, const char * filename, int const ngroups);
+int spt_AsyncReaderUsesUring(spt_AsyncReader const * r);
+int spt_AsyncReaderSubmit(spt_AsyncReader * r, int const group, void * dst, size_t const bytes, uint64_t const offset);
+int spt_AsyncReaderWait(spt_AsyncReader * r, int const group);
+void spt_AsyncReaderClose(spt_AsyncReader * r);
+
+/* Rank-specialized OpenMP MTTKRP, see mttkrp_specialized.c */
+typedef int (*spt_OmpMTTKRPKernel)(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk);
+spt_OmpMTTKRPKernel spt_LookupOmpMTTKRPKernel(sptIndex const nmodes, sptIndex const R);
+/* MTTKRP of pattern tensors, see mttkrp_pattern.c */
+int spt_OmpMTTKRP_Pattern(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk);
+/* MTTKRP vectorized across nonzeros for small ranks, see mttkrp_lanes.c */
+int spt_MTTKRPLanesEnabled(sptIndex const R);
+void spt_MTTKRPLanes(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    sptValue * const out,
+    sptNnzIndex const begin,
+    sptNnzIndex const end);
+int spt_OmpMTTKRP_Lanes(sptSparseTensor const * const X,
+    sptMatrix * mats[],
+    sptMatrix * copy_mats[],
+    sptIndex const mats_order[],
+    sptIndex const mode,
+    const int tk);
+
 double spt_SparseTensorNorm(const sptSparseTensor *X);
 int spt_SparseTensorCompareIndices(const sptSparseTensor *tsr1, sptNnzIndex ind1, const sptSparseTensor *tsr2, sptNnzIndex ind2);
 void spt_SparseTensorCollectZeros(sptSparseTensor *tsr);
+/* The k largest-magnitude nonzeros of each slice, see filter.c */
+int spt_TopKFlags(uint8_t * const keep, sptValue const * const vals, sptIndex const * const slices,
+    sptNnzIndex const nnz, sptIndex const nslices, sptIndex const k, int const tk);
+int spt_SparseTensorFinishLoad(sptSparseTensor *tsr);
+/* The parallel text scanner of load_omp.c, for loaders reading from memory */
+int spt_ParseSparseTensorHeader(sptSparseTensor *tsr, const char **pp, const char *end);
+int spt_ParseSparseTensorLines(sptSparseTensor *tsr, sptIndex start_index, const char *p, const char *end, int const tk);
+/* Element-wise engines: sorted merge path (merge.c) and hash join (hash_join.c).
+   Unions apply op(x, 0) and op(0, y) to the unmatched nonzeros. */
+typedef sptValue (*spt_JoinOp)(sptValue x, sptValue y);
+static inline sptValue spt_AddValues(sptValue x, sptValue y) { return x + y; }
+static inline sptValue spt_SubValues(sptValue x, sptValue y) { return x - y; }
+static inline sptValue spt_MulValues(sptValue x, sptValue y) { return x * y; }
+static inline sptValue spt_DivValues(sptValue x, sptValue y) { return x / y; }
+/* Derived data kept on a sparse tensor. The fiber index lasts until the
+   nonzeros are reordered, the sorted copies until they are changed. */
+struct spt_SparseTensorCache {
+    sptNnzIndex nnz;              /// nnz when the entries were built
+    sptIndex fibermode;           /// mode fiberidx was built for, nmodes if none
+    sptNnzIndexVector fiberidx;   /// fiber starts with the tensor sorted at fibermode
+    sptSparseTensor ** copies;    /// 2*nmodes copies, sorted at mode m in slot m and with m leading in slot nmodes+m, built on demand; NULL unless enabled
+    sptNnzIndex ** sliceptr;      /// nmodes arrays of ndims[m]+1 prefix sums of the slice sizes, built on demand; NULL until one is
+    sptIndex slicemode;           /// mode whose indices are known nondecreasing, so slice i lies at sliceptr[i] to sliceptr[i+1]; nmodes if none
+    int has_fingerprint;          /// whether fingerprint holds the tensor's sptSparseTensorFingerprint
+    uint64_t fingerprint;         /// computed on first use or read from a binary file; kept by sorts, which do not change it
+    uint64_t mapped_offset;       /// data offset of the file sptMmapSparseTensor mapped the arrays from, 0 if not mapped; never dropped
+};
+struct spt_SparseTensorCache * spt_SparseTensorGetCache(sptSparseTensor *tsr);
+void spt_SparseTensorDropOrderCache(sptSparseTensor *tsr);
+void spt_SparseTensorSetFingerprint(sptSparseTensor const *tsr, uint64_t const fingerprint);
+/* The parts of sptSparseTensorFingerprint, for other formats of the same nonzeros:
+   the hash of the shape, the hashes of the nonzeros summed, and the two combined.
+   value is NULL for a pattern nonzero. */
+uint64_t spt_FingerprintShape(sptIndex const nmodes, sptIndex const * const ndims, sptNnzIndex const nnz);
+uint64_t spt_FingerprintNonzero(sptIndex const nmodes, sptIndex const * const inds, sptValue const * const value);
+uint64_t spt_FingerprintCombine(uint64_t const shape, uint64_t const sum);
+sptNnzIndex const * spt_SparseTensorSlicePtr(sptSparseTensor const *tsr, sptIndex const mode);
+int spt_SparseTensorIsSliceSorted(sptSparseTensor const *tsr, sptIndex const mode);
+int spt_SparseTensorReserve(sptSparseTensor *tsr, sptNnzIndex const nnz);
+int spt_SparseTensorNewSized(sptSparseTensor *Y, sptIndex const nmodes, sptIndex const ndims[], sptNnzIndex const nnz);
+
+/* Bytes of the indices and values of tsr, for the traffic models of spt_KernelProbeStop */
+static inline double spt_SparseTensorBytes(const sptSparseTensor *tsr) {
+    return (double) tsr->nnz * (tsr->nmodes * sizeof (sptIndex) + (tsr->values.data != NULL ? sizeof (sptValue) : 0));
+}
+/* COO MTTKRP of rank R: per nonzero and column, nmodes - 1 products and one sum */
+static inline double spt_MTTKRPFlops(const sptSparseTensor *X, sptIndex const R) {
+    return (double) X->nnz * R * X->nmodes;
+}
+/* COO MTTKRP traffic, every factor and output row access counted as a miss */
+static inline double spt_MTTKRPBytes(const sptSparseTensor *X, sptIndex const R) {
+    return spt_SparseTensorBytes(X) + (double) X->nnz * R * X->nmodes * sizeof (sptValue);
+}
+
+/* Bytes of a matrix as sptNewMatrix allocates it, see memplan.c */
+size_t spt_MatrixBytes(sptIndex const nrows, sptIndex const ncols);
+
+/* Mode-specific tensor copies of CP-ALS, see cpd_layout.c */
+size_t spt_CpdLayoutBudget(void);
+size_t spt_PlanCpdLayouts(int * routed, sptIndex const nmodes, sptIndex const ndims[], sptNnzIndex const nnz,
+    int const has_values, sptIndex const rank, int const tk, size_t const budget);
+int spt_NewCpdLayouts(sptCpdLayouts * layouts, sptSparseTensor * X, int const own_x, int const * routed,
+    sptIndex const rank, int const tk);
+int spt_OmpMTTKRPCpdLayout(sptCpdLayouts * layouts, sptIndex const mode, sptIndex const mats_order[],
+    sptIndex const stride, sptIndex const R, sptValue * const out);
+
+/* Factor-row prefetching of the MTTKRP loops, see mttkrp_gather.c */
+sptIndex spt_MTTKRPPrefetchDistance(void);
+/* Ask for the n values of row in cache, a cache line at a time */
+static inline void spt_PrefetchRow(sptValue const * row, sptIndex const n) {
+#if defined(__GNUC__)
+    for(sptIndex r = 0; r < n; r += 64 / sizeof (sptValue)) {
+        __builtin_prefetch(row + r, 0, 3);
+    }
+#else
+    (void) row;
+    (void) n;
+#endif
+}
+
+/* Move a vector's buffer so that it, and the buffers it grows into, get the requested backing */
+#define spt_RequestVectorBacking(vec, backing, module) do { \
+        void * data_ = spt_Realloc((vec)->data, (vec)->len * sizeof *(vec)->data, (vec)->cap * sizeof *(vec)->data, (backing)); \
+        spt_CheckOSError(!data_, (module)); \
+        (vec)->data = data_; \
+    } while(0)
+/* Move a vector's buffer, unless it already asked for that backing; not for mapped or foreign buffers */
+#define spt_PlaceVector(vec, backing, module) do { \
+        if((vec)->data != NULL && spt_MemRequestOf((vec)->data) != (backing)) { \
+            if(sptMemBackingOf((vec)->data) == SPT_MEM_FILE) { \
+                spt_CheckError(SPTERR_VALUE_ERROR, (module), "array not from sptMalloc"); \
+            } \
+            void * data_ = sptMallocBacked((vec)->cap * sizeof *(vec)->data, (backing)); \
+            spt_CheckOSError(!data_, (module)); \
+            memcpy(data_, (vec)->data, (vec)->len * sizeof *(vec)->data); \
+            sptFree((vec)->data); \
+            (vec)->data = data_; \
+        } \
+    } while(0)
+void spt_SparseTensorFreeCache(sptSparseTensor *tsr);
+sptSparseTensor * spt_SparseTensorSortedInOrder(sptSparseTensor *tsr, sptIndex const *mode_order, sptIndex const slot);
+sptSparseTensor * spt_SparseTensorSortedAtMode(sptSparseTensor *tsr, sptIndex const mode);
+int spt_SparseTensorFiberIndex(sptNnzIndexVector const **fiberidx, sptSparseTensor *ref, sptIndex const mode);
+int spt_SparseTensorIsSorted(const sptSparseTensor *tsr);
+int spt_SparseTensorIsSortedInOrder(const sptSparseTensor *tsr, sptIndex const *mode_order);
+int spt_MatrixLeadingLeftVectors(sptMatrix const * const Y, sptMatrix * const U, double * const energy, int const randomized);
+void spt_TuckerOrthonormalize(sptMatrix * const A, double * const col);
+#ifdef PARTI_USE_MPI
+/* nnz-balanced ranges of whole slices over the ranks of comm, see load_mpi.c */
+int spt_MpiBalancedOwners(int *owner, sptIndex const *slice, sptNnzIndex const n, sptIndex const nslices, MPI_Comm comm);
+#endif
+int spt_SparseTensorMerge(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    spt_JoinOp const op,
+    int const is_union,
+    int const nt,
+    const char *module);
+int spt_SparseTensorHashJoin(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    spt_JoinOp const op,
+    int const is_union,
+    int const nt,
+    const char *module);
+/* CUDA intersection of sorted operands, op is 0 for X .* Y and 1 for X ./ Y */
+int spt_CudaSparseTensorIntersect(
+    sptSparseTensor *Z,
+    const sptSparseTensor *X,
+    const sptSparseTensor *Y,
+    int const op,
+    const char *module);
 int spt_DistSparseTensor(sptSparseTensor * tsr,
     int const nthreads,
     sptNnzIndex * const dist_nnzs,
@@ -37,8 +285,238 @@ int spt_DistSparseTensorFixed(sptSparseTensor * tsr,
     int const nthreads,
     sptNnzIndex * const dist_nnzs,
     sptNnzIndex * dist_nrows);
+/* Mode of each CSF level, mode_order or the modes by increasing size when NULL (csf.c) */
+int spt_CSFModeOrder(sptIndex * const out, sptSparseTensor const * const tsr, sptIndex const * const mode_order);
+/* The modes left after reducing rmodes, in increasing order (reduce_modes.c) */
+int spt_ReduceModesKept(
+    sptIndex * kept,
+    sptIndex * nkept,
+    sptSparseTensor const * X,
+    sptIndex const nreduce,
+    sptIndex const rmodes[],
+    char const * module);
+/* Kept modes then multiplied ones, and the empty result, of sptSparseTensorMulMatrices (ttm_general.c) */
+int spt_SparseTensorMulMatricesSetup(
+    sptSemiSparseTensorGeneral *Y,
+    sptIndex * order,
+    sptSparseTensor const *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[],
+    char const * module);
+/* Mean nonzeros per slice, fiber or block from the groups an even sample meets, see stats.c */
+double spt_EstimateGroupSize(sptNnzIndex const distinct, sptNnzIndex const nsampled, sptNnzIndex const nnz);
+/* Radix sort engine */
+typedef void (*spt_RadixKeyFunc)(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx);
+unsigned spt_RadixBitWidth(sptIndex const dim);
+int spt_RadixSortPermutation(
+    sptNnzIndex * perm,
+    sptNnzIndex const n,
+    sptIndex const nwords,
+    unsigned const * word_bits,
+    spt_RadixKeyFunc key,
+    void const * ctx,
+    int const tk);
+int spt_SparseTensorRadixPermutation(
+    sptSparseTensor const *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    sptNnzIndex * perm,
+    int const tk);
+int spt_SparseTensorApplyPermutation(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const n,
+    sptNnzIndex const * perm,
+    int const tk);
+/* Run-adaptive sorting (sort_runs.c) */
+int spt_SortAdaptiveEnabled(void);
+int spt_SparseTensorMergeRuns(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    int const tk);
+int spt_SparseTensorRadixSort(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    sptIndex const nkeys,
+    sptIndex const * key_modes,
+    sptElementIndex const shift_bits,
+    int const tk);
+int spt_SparseTensorCurveSort(
+    sptSparseTensor *tsr,
+    sptNnzIndex const begin,
+    sptNnzIndex const end,
+    int const hilbert,
+    int const tk);
 int spt_GetSubSparseTensor(sptSparseTensor *dest, const sptSparseTensor *tsr, const sptIndex limit_low[], const sptIndex limit_high[]);
+/* CP-ALS factors seen as plain arrays, shared by the sptMatrix and sptRankMatrix drivers */
+typedef struct {
+    sptIndex nmodes;
+    sptIndex rank;
+    sptIndex stride;        /// row stride of every factor
+    sptIndex const * ndims; /// rows of each factor
+    sptValue ** values;     /// row-major values of each factor
+    sptValue * lambda;
+} spt_CpdFactors;
+/* What a CP-ALS checkpoint was written for, besides the shape of its factors */
+typedef struct {
+    uint64_t fingerprint;   /// sptSparseTensorFingerprint of the input tensor
+    double tol;             /// tolerance of the run
+    sptIndex niters;        /// maximum number of iterations of the run
+} spt_CpdCheckpointKey;
+/* Load the configured checkpoint if it matches f and key; *it is 0 when there is none */
+int spt_CpdCheckpointRestore(spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex * it, double * fit, int * converged);
+int spt_CpdCheckpointEnabled(void);
+/* Write the configured checkpoint after `it` iterations when due, or always when done */
+int spt_CpdCheckpointSave(spt_CpdFactors const * f, spt_CpdCheckpointKey const * key, sptIndex const it, double const fit, int const done, int const converged);
+/* State of the CP-ALS line search (cpd_linesearch.c); disabled unless sptSetCpdLineSearch turned it on */
+typedef struct {
+    int enabled;
+    int have_prev;
+    sptIndex nmodes;
+    sptValue ** prev;       /// last ALS iterate, lambda folded into the last factor
+    sptValue ** cur;        /// current ALS iterate while a step is tried
+    sptValue * cur_lambda;
+    sptIndex accepted;
+    sptIndex rejected;
+} spt_CpdLineSearch;
+/* Whether the CP-ALS drivers extrapolate, from PARTI_CPD_LINESEARCH or sptSetCpdLineSearch */
+int spt_CpdLineSearchEnabled(void);
+int spt_NewCpdLineSearch(spt_CpdLineSearch * ls, spt_CpdFactors const * f);
+void spt_FreeCpdLineSearch(spt_CpdLineSearch * ls);
+/* Replace the factors by an extrapolated step and refresh ata; returns 1 when the caller must now compute its fit */
+int spt_CpdLineSearchPropose(spt_CpdLineSearch * ls, spt_CpdFactors const * f, sptValue ** ata, sptIndex const it);
+/* Keep the step if trial_fit beats fit, else restore the ALS iterate; returns the fit of the kept factors */
+double spt_CpdLineSearchResolve(spt_CpdLineSearch * ls, spt_CpdFactors const * f, sptValue ** ata, double const fit, double const trial_fit);
+/* Deadline and progress callback of a CP-ALS run (cpd_deadline.c); inactive unless either is set */
+typedef struct {
+    int active;
+    double start;           /// microseconds, spt_TraceNow clock
+    double budget;          /// seconds, 0 for none
+    sptCpdProgress progress; /// callback, NULL for none
+    void * progress_arg;
+    double predicted;       /// seconds the next iteration is expected to take
+    sptIndex nmodes;
+    sptValue ** best;       /// factors of the best evaluated fit
+    sptValue * best_lambda;
+    double best_fit;
+    int have_best;
+    int stopped;            /// 1 at the deadline, 2 on request of the callback
+} spt_CpdGuard;
+/* Whether the CP-ALS drivers watch a deadline or call a progress callback */
+int spt_CpdGuardEnabled(void);
+int spt_NewCpdGuard(spt_CpdGuard * g, spt_CpdFactors const * f);
+void spt_FreeCpdGuard(spt_CpdGuard * g);
+/* Whether another iteration would overrun the deadline; the driver then evaluates the fit and stops */
+int spt_CpdGuardDue(spt_CpdGuard * g);
+/* Account an iteration and keep its factors when its fit is the best; returns 1 when the run must stop */
+int spt_CpdGuardRecord(spt_CpdGuard * g, spt_CpdFactors const * f, sptIndex const it, double const its_time, double const fit, int const evaluated);
+/* Put the best factors back into f when the last ones are not; returns their fit */
+double spt_CpdGuardRestore(spt_CpdGuard * g, spt_CpdFactors const * f, double const fit, int const evaluated);
+/* Single-threaded CP-ALS for tiny tensors (cpd_small.c), taken by sptOmpCpdAls when spt_CpdIsSmall */
+int spt_CpdIsSmall(sptSparseTensor const * const spten, sptIndex const rank);
+int spt_CpdAlsSmall(sptSparseTensor const * const spten, sptIndex const rank, sptIndex const niters, double const tol, sptKruskalTensor * ktensor);
+/* Non-negative HALS update of every row of A against its MTTKRP M and full Gram product G */
+void spt_CpdHalsUpdateRows(sptValue * const A, sptValue const * const M, sptValue const * const G,
+    sptIndex const nrows, sptIndex const rank, sptIndex const stride, int const tk);
+/* Use the factors already in ktensor as mats[0..nmodes-1], taking them over; *taken is 0 when there are none */
+int spt_CpdTakeFactors(sptKruskalTensor * ktensor, sptIndex const nmodes, sptIndex const ndims[], sptIndex const rank, sptMatrix ** mats, int * taken);
+int spt_CpdTakeRankFactors(sptRankKruskalTensor * ktensor, sptIndex const nmodes, sptIndex const ndims[], sptIndex const rank, sptRankMatrix ** mats, int * taken);
+/* Allocate mats[0..nmodes-1] as the initial factors chosen by sptSetCpdInit (cpd_init.c) */
+int spt_CpdInitMatrices(sptSparseTensor const * X, sptIndex const rank, sptMatrix ** mats, int const tk);
+/* The MTTKRP of every mode against factors A into U, the tensor access of the Gauss-Newton CPD (cpd_gn.c) */
+typedef int (*spt_CpdMttkrpAll)(void * arg, sptMatrix ** A, sptMatrix ** U);
+double spt_CpdGaussNewtonStep(double const spten_normsq, sptIndex const nmodes, sptIndex const rank, sptIndex const niters,
+    double const tol, const int nt, sptMatrix ** mats, sptValue * const lambda, spt_CpdMttkrpAll const mttkrp, void * const arg);
+/* The product with x in every mode but one, the tensor access of the power methods (power_method.c) */
+typedef int (*spt_TtvExceptFn)(void * arg, sptValue * y, sptValue * const x[], sptIndex const mode);
+void spt_SparseTensorMulVectorsExcept(sptValue * const y, sptSparseTensor const * const X, sptValue const * const * const vecs,
+    sptIndex const mode, int const tk);
+int spt_SparseTensorPowerIterate(sptIndex const nmodes, sptIndex const ndims[], sptValue * const x[], sptValue * const lambda,
+    sptValue const shift, int const symmetric, sptIndex const niters, double const tol, spt_TtvExceptFn const ttv, void * const arg,
+    char const * const module);
+
+/* splitmix64 streams, for results that depend on a seed only and not on the thread count */
+static inline uint64_t spt_GenMix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
 
+static inline uint64_t spt_GenNext(uint64_t *state) {
+    *state += 0x9e3779b97f4a7c15ULL;
+    return spt_GenMix(*state);
+}
+
+/* A uniform double in [0, 1) */
+static inline double spt_GenUniform(uint64_t *state) {
+    return (double) (spt_GenNext(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+/* Fill the factor of `mode` with values drawn like sptRandomValue, from the stream of (seed, mode) */
+void spt_CpdSeededFactor(sptMatrix * A, uint64_t const seed, sptIndex const mode);
+/* Argument checks and initial factors shared by the completion drivers (completion.c) */
+int spt_CompletionPrepare(sptSparseTensor const * const spten, sptSparseTensor const * const heldout, sptIndex const rank,
+    uint64_t const seed, sptKruskalTensor * ktensor, sptMatrix ** mats, char const * const module);
+
+
+#ifdef PARTI_USE_CUDA
+int sptCudaMTTKRPDevice(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex rank,
+    const sptIndex stride,
+    const sptIndex * Xndims,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    sptValue * dev_scratch);
+#if defined(__CUDACC__) || defined(__HIPCC__)
+int sptCudaMTTKRPDeviceAsync(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex rank,
+    const sptIndex stride,
+    const sptIndex * Xndims,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats,
+    sptValue * dev_scratch,
+    cudaStream_t stream);
+#endif
+sptIndex spt_CudaSelectMTTKRPImpl(
+    sptSparseTensor const * const X,
+    sptMatrix ** const mats,
+    sptIndex * const mats_order,
+    sptIndex const mode,
+    int const one_kernel);
+sptIndex spt_CudaSelectTTMImpl(
+    sptSparseTensor * const X,
+    const sptMatrix * const U,
+    sptIndex const mode,
+    sptNnzIndex * const smen_size);
+int sptCudaMTTKRPSegmentedDevice(
+    const sptIndex mode,
+    const sptIndex nmodes,
+    const sptNnzIndex nnz,
+    const sptIndex rank,
+    const sptIndex stride,
+    sptIndex ** const Xinds,
+    const sptValue * Xvals,
+    const sptIndex * dev_mats_order,
+    sptValue ** dev_mats);
+#endif
 
 #ifdef __cplusplus
 }
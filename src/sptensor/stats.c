@@ -0,0 +1,381 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Tensor statistics and format recommendation.
+ *
+ * Slices, fibers and blocks are all groups of nonzeros agreeing on some
+ * modes, shifted right for blocks. Each is counted by one parallel radix
+ * sort of the sampled positions on those modes and a pass over the runs.
+ * From a sample of p of the nonzeros, the group counts are corrected with
+ * spt_EstimateGroupSize; the largest group is scaled by 1/p.
+ */
+
+static char const * const spt_format_names[SPT_NUM_FORMATS] = { "COO", "HiCOO", "CSF" };
+
+/**
+ * Mean nonzeros per group of a tensor of nnz nonzeros whose even sample of
+ * nsampled meets `distinct` groups. With groups of d nonzeros, a sample of p
+ * of them meets (nnz/d)(1 - (1-p)^d) groups, which falls with d; solve for d
+ * by bisection.
+ */
+double spt_EstimateGroupSize(sptNnzIndex const distinct, sptNnzIndex const nsampled, sptNnzIndex const nnz)
+{
+    if(distinct == 0) {
+        return 1;
+    }
+    double const p = (double) nsampled / nnz;
+    if(p >= 1) {
+        return (double) nnz / distinct;
+    }
+    double lo = 0, hi = log((double) nnz);
+    for(int it = 0; it < 60; ++it) {
+        double const mid = (lo + hi) / 2;
+        double const d = exp(mid);
+        double const met = nnz / d * (1 - pow(1 - p, d));
+        if(met > distinct) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return exp(lo);
+}
+
+
+typedef struct {
+    sptSparseTensor const * tsr;
+    sptNnzIndex step;            /// sample k is nonzero k * step
+    sptIndex const * key_modes;
+    sptElementIndex shift;
+} spt_StatsKeyCtx;
+
+static void spt_StatsKey(uint64_t * keys, sptNnzIndex const * perm, sptNnzIndex const n, sptIndex const word, void const * ctx)
+{
+    spt_StatsKeyCtx const * const c = ctx;
+    sptIndex const * const inds = c->tsr->inds[c->key_modes[word]].data;
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        keys[i] = inds[perm[i] * c->step] >> c->shift;
+    }
+}
+
+static inline int spt_StatsSameGroup(spt_StatsKeyCtx const * const c, sptIndex const nkeys, sptNnzIndex const a, sptNnzIndex const b)
+{
+    for(sptIndex w = 0; w < nkeys; ++w) {
+        sptIndex const * const inds = c->tsr->inds[c->key_modes[w]].data;
+        if(inds[a * c->step] >> c->shift != inds[b * c->step] >> c->shift) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The groups of the s sampled nonzeros agreeing on key_modes >> shift: their number, the largest and a log2 histogram */
+static int spt_StatsGroups(
+    sptNnzIndex * ngroups,
+    sptNnzIndex * max_group,
+    sptNnzIndex * hist,
+    spt_StatsKeyCtx const * const ctx,
+    sptIndex const nkeys,
+    sptNnzIndex const s,
+    sptNnzIndex * perm,
+    int const tk)
+{
+    unsigned * word_bits = malloc((nkeys + 1) * sizeof *word_bits);
+    spt_CheckOSError(!word_bits, "SpTns Stats");
+    for(sptIndex w = 0; w < nkeys; ++w) {
+        unsigned const bits = spt_RadixBitWidth(ctx->tsr->ndims[ctx->key_modes[w]]);
+        word_bits[w] = bits > ctx->shift ? bits - ctx->shift : 0;
+    }
+    int result = spt_RadixSortPermutation(perm, s, nkeys, word_bits, spt_StatsKey, ctx, tk);
+    free(word_bits);
+    spt_CheckError(result, "SpTns Stats", NULL);
+
+    if(hist != NULL) {
+        memset(hist, 0, SPT_STATS_BINS * sizeof *hist);
+    }
+    sptNnzIndex groups = 0, largest = 0;
+    #pragma omp parallel num_threads(tk) reduction(+: groups) reduction(max: largest)
+    {
+        sptNnzIndex local[SPT_STATS_BINS] = { 0 };
+        #pragma omp for schedule(static)
+        for(sptNnzIndex i = 0; i < s; ++i) {
+            if(i == 0 || !spt_StatsSameGroup(ctx, nkeys, perm[i-1], perm[i])) {
+                sptNnzIndex j = i + 1;
+                while(j < s && spt_StatsSameGroup(ctx, nkeys, perm[j-1], perm[j])) {
+                    ++j;
+                }
+                ++groups;
+                if(j - i > largest) {
+                    largest = j - i;
+                }
+                ++local[63 - __builtin_clzll((unsigned long long) (j - i))];
+            }
+        }
+        if(hist != NULL) {
+            #pragma omp critical(spt_stats_hist)
+            for(int b = 0; b < SPT_STATS_BINS; ++b) {
+                hist[b] += local[b];
+            }
+        }
+    }
+    *ngroups = groups;
+    *max_group = largest;
+    return 0;
+}
+
+
+/**
+ * Gather the statistics of a sparse tensor: per mode the nonempty slices,
+ * the largest one and their histogram, the nonempty fibers and theirs, and
+ * how often a nonzero shares or nearly shares the index of the one stored
+ * before it; for every block size up to 2^SPT_STATS_SB_BITS, the mean fill
+ * of the nonempty blocks.
+ * @param[out] st        uninitialized statistics
+ * @param[in]  tsr       the sparse tensor
+ * @param[in]  nsamples  take them from an even sample of at most this many nonzeros, 0 for all
+ * @param[in]  tk        the number of threads
+ */
+int sptSparseTensorStatistics(
+    sptSparseTensorStats *st,
+    sptSparseTensor const * const tsr,
+    sptNnzIndex const nsamples,
+    int const tk)
+{
+    sptIndex const nmodes = tsr->nmodes;
+    sptNnzIndex const nnz = tsr->nnz;
+    memset(st, 0, sizeof *st);
+    st->nmodes = nmodes;
+    st->nnz = nnz;
+    st->max_dim = sptMaxIndexArray(tsr->ndims, nmodes);
+    st->density = sptSparseTensorDensity(tsr);
+    /* An odd stride, so that layouts periodic in a power of two are not aliased */
+    sptNnzIndex const step = nsamples != 0 && nnz > nsamples ? ((nnz + nsamples - 1) / nsamples) | 1 : 1;
+    sptNnzIndex const s = (nnz + step - 1) / step;
+    st->nsampled = s;
+
+    double * dbuf = calloc((size_t) 6 * nmodes + 1, sizeof *dbuf);
+    sptNnzIndex * hbuf = calloc((size_t) 2 * nmodes * SPT_STATS_BINS + 1, sizeof *hbuf);
+    if(!dbuf || !hbuf) {
+        free(dbuf);
+        free(hbuf);
+        spt_CheckOSError(1, "SpTns Stats");
+    }
+    st->nslices = dbuf;
+    st->max_slice = dbuf + nmodes;
+    st->slice_skew = dbuf + 2 * nmodes;
+    st->nfibers = dbuf + 3 * nmodes;
+    st->reuse = dbuf + 4 * nmodes;
+    st->near = dbuf + 5 * nmodes;
+    st->slice_hist = hbuf;
+    st->fiber_hist = hbuf + (size_t) nmodes * SPT_STATS_BINS;
+    if(s == 0) {
+        return 0;
+    }
+
+    sptNnzIndex * perm = malloc(s * sizeof *perm);
+    sptIndex * key_modes = malloc((nmodes + 1) * sizeof *key_modes);
+    if(!perm || !key_modes) {
+        free(perm);
+        free(key_modes);
+        spt_CheckOSError(1, "SpTns Stats");
+    }
+    spt_StatsKeyCtx ctx = { tsr, step, key_modes, 0 };
+    sptNnzIndex groups, largest;
+    int result;
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        key_modes[0] = m;
+        result = spt_StatsGroups(&groups, &largest, st->slice_hist + (size_t) m * SPT_STATS_BINS, &ctx, 1, s, perm, tk);
+        spt_CheckError(result, "SpTns Stats", NULL);
+        st->nslices[m] = nnz / spt_EstimateGroupSize(groups, s, nnz);
+        st->max_slice[m] = (double) largest * nnz / s;
+        st->slice_skew[m] = st->max_slice[m] * st->nslices[m] / nnz;
+
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            key_modes[i - 1] = (m + i) % nmodes;
+        }
+        result = spt_StatsGroups(&groups, &largest, st->fiber_hist + (size_t) m * SPT_STATS_BINS, &ctx, nmodes - 1, s, perm, tk);
+        spt_CheckError(result, "SpTns Stats", NULL);
+        st->nfibers[m] = nnz / spt_EstimateGroupSize(groups, s, nnz);
+    }
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        key_modes[m] = m;
+    }
+    for(sptElementIndex b = 0; b <= SPT_STATS_SB_BITS; ++b) {
+        ctx.shift = b;
+        result = spt_StatsGroups(&groups, &largest, NULL, &ctx, nmodes, s, perm, tk);
+        spt_CheckError(result, "SpTns Stats", NULL);
+        st->block_fill[b] = spt_EstimateGroupSize(groups, s, nnz);
+    }
+
+    /* Locality in storage order, over the sampled nonzeros and the ones after them */
+    sptNnzIndex const npairs = (s - 1) * step + 1 < nnz ? s : s - 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const * const inds = tsr->inds[m].data;
+        sptNnzIndex same = 0, close = 0;
+        #pragma omp parallel for schedule(static) num_threads(tk) reduction(+: same, close)
+        for(sptNnzIndex k = 0; k < npairs; ++k) {
+            sptIndex const a = inds[k * step], b = inds[k * step + 1];
+            sptIndex const d = a > b ? a - b : b - a;
+            same += d == 0;
+            close += d < ((sptIndex) 1 << SPT_STATS_SB_BITS);
+        }
+        st->reuse[m] = npairs > 0 ? (double) same / npairs : 0;
+        st->near[m] = npairs > 0 ? (double) close / npairs : 0;
+    }
+
+    free(key_modes);
+    free(perm);
+    return 0;
+}
+
+
+/**
+ * Release the statistics of sptSparseTensorStatistics
+ */
+void sptFreeSparseTensorStats(sptSparseTensorStats *st)
+{
+    free(st->nslices);
+    free(st->slice_hist);
+    st->nslices = st->max_slice = st->slice_skew = st->nfibers = st->reuse = st->near = NULL;
+    st->slice_hist = st->fiber_hist = NULL;
+    st->nmodes = 0;
+}
+
+
+void sptSparseTensorStatsPrint(sptSparseTensorStats const * const st, FILE *fp)
+{
+    fprintf(fp, "Sparse Tensor statistics---------\n");
+    fprintf(fp, "NNZ=%"PARTI_PRI_NNZ_INDEX" SAMPLED=%"PARTI_PRI_NNZ_INDEX" DENSITY=%e\n", st->nnz, st->nsampled, st->density);
+    for(sptIndex m = 0; m < st->nmodes; ++m) {
+        fprintf(fp, "Mode %"PARTI_PRI_INDEX": slices %.0f, largest %.0f (skew %.2f), fibers %.0f (%.2f nnz each), reuse %.2f, near %.2f\n",
+            m, st->nslices[m], st->max_slice[m], st->slice_skew[m],
+            st->nfibers[m], st->nfibers[m] > 0 ? st->nnz / st->nfibers[m] : 0, st->reuse[m], st->near[m]);
+    }
+    fprintf(fp, "Block fill (sb_bits: nnz per block):");
+    for(sptElementIndex b = 1; b <= SPT_STATS_SB_BITS; ++b) {
+        fprintf(fp, " %d: %.2f", (int) b, st->block_fill[b]);
+    }
+    fprintf(fp, "\n\n");
+}
+
+
+/**
+ * Recommend a format and its parameters from the statistics of a tensor,
+ * by the index bytes per nonzero each would take:
+ * - COO, nmodes indices;
+ * - HiCOO at the block size of fewest bytes, an element index per mode and
+ *   a block header per block fill; kernel bits leave at least 4 kernels per
+ *   thread along the largest mode;
+ * - CSF with the modes of fewest nonempty slices on top, the top level from
+ *   the slices, the level above the leaves from the fibers of the last mode,
+ *   the levels between interpolated.
+ * CSF is passed over when its root's largest slice exceeds half a thread's
+ * share of the nonzeros, as its parallel loop runs over root slices.
+ * @param[out] advice  an uninitialized recommendation
+ * @param[in]  st      statistics of the tensor, see sptSparseTensorStatistics
+ * @param[in]  tk      the number of threads the tensor will be processed with
+ */
+int sptRecommendFormat(
+    sptFormatAdvice *advice,
+    sptSparseTensorStats const * const st,
+    int const tk)
+{
+    sptIndex const nmodes = st->nmodes;
+    double const nnz = (double) st->nnz;
+    int const nt = tk > 0 ? tk : 1;
+    advice->mode_order = malloc((nmodes + 1) * sizeof *advice->mode_order);
+    spt_CheckOSError(!advice->mode_order, "SpTns Recommend");
+
+    /* CSF levels: fewest nonempty slices first */
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex i = m;
+        while(i > 0 && st->nslices[advice->mode_order[i-1]] > st->nslices[m]) {
+            advice->mode_order[i] = advice->mode_order[i-1];
+            --i;
+        }
+        advice->mode_order[i] = m;
+    }
+
+    advice->index_bytes[SPT_FORMAT_COO] = nmodes * sizeof (sptIndex);
+
+    sptElementIndex const max_sb = 8 * sizeof (sptElementIndex) < SPT_STATS_SB_BITS ? 8 * sizeof (sptElementIndex) : SPT_STATS_SB_BITS;
+    advice->sb_bits = 1;
+    advice->index_bytes[SPT_FORMAT_HICOO] = DBL_MAX;
+    for(sptElementIndex b = 1; b <= max_sb; ++b) {
+        double const fill = st->block_fill[b] > 1 ? st->block_fill[b] : 1;
+        double const bytes = nmodes * sizeof (sptElementIndex) + (nmodes * sizeof (sptBlockIndex) + sizeof (sptNnzIndex)) / fill;
+        if(bytes < advice->index_bytes[SPT_FORMAT_HICOO]) {
+            advice->index_bytes[SPT_FORMAT_HICOO] = bytes;
+            advice->sb_bits = b;
+        }
+    }
+    advice->sk_bits = advice->sb_bits;
+    while(advice->sk_bits < 31 && (st->max_dim >> (advice->sk_bits + 1)) >= (sptIndex) (4 * nt)) {
+        ++advice->sk_bits;
+    }
+
+    double csf = nnz * sizeof (sptIndex);
+    if(nmodes >= 2 && nnz > 0) {
+        double const top = st->nslices[advice->mode_order[0]];
+        double const bottom = nmodes > 2 ? st->nfibers[advice->mode_order[nmodes-1]] : top;
+        for(sptIndex l = 0; l + 1 < nmodes; ++l) {
+            double const nodes = nmodes > 2 ? top * pow(bottom / top, (double) l / (nmodes - 2)) : top;
+            csf += nodes * (sizeof (sptIndex) + sizeof (sptNnzIndex));
+        }
+    }
+    advice->index_bytes[SPT_FORMAT_CSF] = nnz > 0 ? csf / nnz : DBL_MAX;
+
+    advice->format = SPT_FORMAT_COO;
+    for(int f = 0; f < SPT_NUM_FORMATS; ++f) {
+        if(f == SPT_FORMAT_CSF && nmodes > 0 && st->max_slice[advice->mode_order[0]] > nnz / (2 * nt)) {
+            continue;
+        }
+        if(advice->index_bytes[f] < advice->index_bytes[advice->format]) {
+            advice->format = (sptTensorFormat) f;
+        }
+    }
+
+    if(spt_TelemetryPrinting()) {
+        printf("[Recommend] %s: index bytes per nnz COO %.2f, HiCOO %.2f (sb %d, sk %d), CSF %.2f\n",
+            spt_format_names[advice->format], advice->index_bytes[SPT_FORMAT_COO],
+            advice->index_bytes[SPT_FORMAT_HICOO], (int) advice->sb_bits, (int) advice->sk_bits,
+            advice->index_bytes[SPT_FORMAT_CSF]);
+    }
+    return 0;
+}
+
+
+/**
+ * Release a recommendation of sptRecommendFormat
+ */
+void sptFreeFormatAdvice(sptFormatAdvice *advice)
+{
+    free(advice->mode_order);
+    advice->mode_order = NULL;
+}
@@ -52,6 +52,9 @@ void sptSparseTensorStatus(sptSparseTensor *tsr, FILE *fp)
 
   char * bytestr = sptBytesString(tsr->nnz * (sizeof(sptIndex) * tsr->nmodes + sizeof(sptValue)));
   fprintf(fp, "COO-STORAGE=%s\n", bytestr);
+  fprintf(fp, "BACKING: inds=%s values=%s\n",
+    sptMemBackingString(tsr->nmodes > 0 ? sptMemBackingOf(tsr->inds[0].data) : SPT_MEM_DEFAULT),
+    sptMemBackingString(sptMemBackingOf(tsr->values.data)));
   fprintf(fp, "\n");
   free(bytestr);
 }
@@ -24,89 +24,13 @@
  * @param[out] Z the result of X-Y, should be uninitialized
  * @param[in]  X the input X
  * @param[in]  Y the input Y
+ *
+ * Z is sorted if X and Y are; otherwise it follows X, then Y-only nonzeros.
  */
 int sptSparseTensorSub(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y) {
-
-    /* Ensure X and Y are in same shape */
-    if(Y->nmodes != X->nmodes) {
-        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Sub", "shape mismatch");
-    }
-    for(sptIndex i = 0; i < X->nmodes; ++i) {
-        if(Y->ndims[i] != X->ndims[i]) {
-            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SpTns Sub", "shape mismatch");
-        }
-    }
-
-    sptNewSparseTensor(Z, X->nmodes, X->ndims);
-
-    /* Add elements one by one, assume indices are ordered */
-    sptNnzIndex i, j;
-    int result;
-    i = 0;
-    j = 0;
-    while(i < X->nnz && j < Y->nnz) {
-        int compare = spt_SparseTensorCompareIndices(X, i, Y, j);
-        if(compare > 0) {
-            for(sptIndex mode = 0; mode < X->nmodes; ++mode) {
-                result = sptAppendIndexVector(&Z->inds[mode], Y->inds[mode].data[j]);
-                spt_CheckError(result, "SpTns Sub", NULL);
-            }
-            result = sptAppendValueVector(&Z->values, -Y->values.data[j]);
-            spt_CheckError(result, "SpTns Sub", NULL);
-
-            ++Z->nnz;
-            ++j;
-        } else if(compare < 0) {
-            for(sptIndex mode = 0; mode < X->nmodes; ++mode) {
-                result = sptAppendIndexVector(&Z->inds[mode], X->inds[mode].data[i]);
-                spt_CheckError(result, "SpTns Sub", NULL);
-            }
-            result = sptAppendValueVector(&Z->values, X->values.data[i]);
-            spt_CheckError(result, "SpTns Sub", NULL);
-
-            ++Z->nnz;
-            ++i;
-        } else {
-            for(sptIndex mode = 0; mode < X->nmodes; ++mode) {
-                result = sptAppendIndexVector(&Z->inds[mode], X->inds[mode].data[i]);
-                spt_CheckError(result, "SpTns Sub", NULL);
-            }
-            result = sptAppendValueVector(&Z->values, X->values.data[i] - Y->values.data[j]);
-            spt_CheckError(result, "SpTns Sub", NULL);
-
-            ++Z->nnz;
-            ++i;
-            ++j;
-        }
-    }
-    /* Append remaining elements of X to Z */
-    while(i < X->nnz) {
-        for(sptIndex mode = 0; mode < X->nmodes; ++mode) {
-            result = sptAppendIndexVector(&Z->inds[mode], X->inds[mode].data[i]);
-            spt_CheckError(result, "SpTns Sub", NULL);
-        }
-        result = sptAppendValueVector(&Z->values, X->values.data[i]);
-        spt_CheckError(result, "SpTns Sub", NULL);
-        ++Z->nnz;
-        ++i;
-    }
-    /* Append remaining elements of Y to Z */
-    while(i < X->nnz) {
-        for(sptIndex mode = 0; mode < Y->nmodes; ++mode) {
-            result = sptAppendIndexVector(&Z->inds[mode], Y->inds[mode].data[j]);
-            spt_CheckError(result, "SpTns Sub", NULL);
-        }
-        result = sptAppendValueVector(&Z->values, -Y->values.data[j]);
-        spt_CheckError(result, "SpTns Sub", NULL);
-        ++Z->nnz;
-        ++j;
+    /* Unsorted operands are joined by coordinates rather than sorted first */
+    if(!spt_SparseTensorIsSorted(X) || !spt_SparseTensorIsSorted(Y)) {
+        return spt_SparseTensorHashJoin(Z, X, Y, spt_SubValues, 1, 1, "SpTns Sub");
     }
-    /* Check whether elements become zero after adding.
-       If so, fill the gap with the [nnz-1]'th element.
-    */
-    spt_SparseTensorCollectZeros(Z);
-    /* Sort the indices */
-    sptSparseTensorSortIndex(Z, 1);
-    
-    return 0;
+    return spt_SparseTensorMerge(Z, X, Y, spt_SubValues, 1, 1, "SpTns Sub");
 }
@@ -0,0 +1,396 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Supersymmetric sparse tensors.
+ *
+ * A tensor whose value is the same under every permutation of its
+ * coordinates keeps one entry per multiset of coordinates, the one with
+ * sorted coordinates: up to N! times fewer than COO for N modes. An entry
+ * whose distinct coordinates occur m_1, .., m_k times stands for
+ * N! / (m_1! .. m_k!) entries of the full tensor, and for
+ * (N-1)! m_j / (m_1! .. m_k!) of them with its j-th distinct coordinate in
+ * the first mode. The kernels expand an entry into these counts on the fly
+ * instead of into its permutations; with a single factor U, every mode of
+ * the MTTKRP is the same, and an entry adds to row c of the output its value
+ * times the count of c times the Hadamard product of the rows of U at its
+ * other coordinates.
+ */
+
+/**
+ * Create an empty supersymmetric sparse tensor.
+ * @param S       an uninitialized tensor
+ * @param nmodes  the number of modes, at least 1
+ * @param ndim    the size of every mode
+ */
+int sptNewSymmSparseTensor(sptSymmSparseTensor *S, sptIndex const nmodes, sptIndex const ndim) {
+    if(nmodes == 0) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SymmSpTns New", "nmodes must be at least 1");
+    }
+    S->nmodes = nmodes;
+    S->ndim = ndim;
+    S->nnz = 0;
+    S->inds = malloc(nmodes * sizeof *S->inds);
+    spt_CheckOSError(!S->inds, "SymmSpTns New");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        int result = sptNewIndexVector(&S->inds[m], 0, 0);
+        spt_CheckError(result, "SymmSpTns New", NULL);
+    }
+    int result = sptNewValueVector(&S->values, 0, 0);
+    spt_CheckError(result, "SymmSpTns New", NULL);
+    return 0;
+}
+
+/**
+ * Release the contents of a supersymmetric sparse tensor.
+ * @param S  the tensor to release
+ */
+void sptFreeSymmSparseTensor(sptSymmSparseTensor *S) {
+    for(sptIndex m = 0; m < S->nmodes; ++m) {
+        sptFreeIndexVector(&S->inds[m]);
+    }
+    free(S->inds);
+    sptFreeValueVector(&S->values);
+    S->nmodes = 0;
+    S->nnz = 0;
+}
+
+/**
+ * Append an entry to a supersymmetric sparse tensor; its coordinates may be
+ * in any order and are stored sorted. Appending two permutations of the same
+ * coordinates stores two entries.
+ * @param S       the tensor
+ * @param coords  the nmodes coordinates of the entry
+ * @param value   its value
+ */
+int sptAppendSymmSparseTensor(sptSymmSparseTensor *S, const sptIndex coords[], sptValue const value) {
+    sptIndex const nmodes = S->nmodes;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(coords[m] >= S->ndim) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SymmSpTns Append", "index out of range");
+        }
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        int result = sptAppendIndexVector(&S->inds[m], coords[m]);
+        spt_CheckError(result, "SymmSpTns Append", NULL);
+    }
+    int result = sptAppendValueVector(&S->values, value);
+    spt_CheckError(result, "SymmSpTns Append", NULL);
+
+    /* Insertion sort of the new entry across the modes */
+    sptNnzIndex const z = S->nnz++;
+    for(sptIndex m = 1; m < nmodes; ++m) {
+        sptIndex const c = S->inds[m].data[z];
+        sptIndex k = m;
+        for(; k > 0 && S->inds[k-1].data[z] > c; --k) {
+            S->inds[k].data[z] = S->inds[k-1].data[z];
+        }
+        S->inds[k].data[z] = c;
+    }
+    return 0;
+}
+
+
+/* Whether entry z of X has non-decreasing coordinates */
+static inline int spt_SymmIsSorted(const sptSparseTensor *X, sptNnzIndex const z) {
+    for(sptIndex m = 1; m < X->nmodes; ++m) {
+        if(X->inds[m-1].data[z] > X->inds[m].data[z]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Make a supersymmetric sparse tensor from a COO tensor holding one, either
+ * in full or only its entries with sorted coordinates: the entries with
+ * non-decreasing coordinates are kept, in order, and the rest dropped.
+ * @param S   an uninitialized tensor
+ * @param X   a COO tensor whose modes all have the same size
+ * @param tk  the number of threads
+ */
+int sptSymmSparseTensorFromSparseTensor(sptSymmSparseTensor *S, const sptSparseTensor *X, int const tk) {
+    sptIndex const nmodes = X->nmodes;
+    for(sptIndex m = 1; m < nmodes; ++m) {
+        if(X->ndims[m] != X->ndims[0]) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "SymmSpTns From COO", "modes of different sizes");
+        }
+    }
+    int result = sptNewSymmSparseTensor(S, nmodes, X->ndims[0]);
+    spt_CheckError(result, "SymmSpTns From COO", NULL);
+
+    /* Count the kept entries of each part, then each part writes from its offset */
+    int const nparts = tk > 0 ? tk : 1;
+    sptNnzIndex const nnz = X->nnz;
+    sptNnzIndex * offsets = calloc(nparts + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SymmSpTns From COO");
+    #pragma omp parallel for schedule(static, 1) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = nnz * p / nparts, end = nnz * (p + 1) / nparts;
+        sptNnzIndex count = 0;
+        for(sptNnzIndex z = begin; z < end; ++z) {
+            count += spt_SymmIsSorted(X, z);
+        }
+        offsets[p+1] = count;
+    }
+    for(int p = 0; p < nparts; ++p) {
+        offsets[p+1] += offsets[p];
+    }
+    sptNnzIndex const kept = offsets[nparts];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        result = sptResizeIndexVector(&S->inds[m], kept);
+        spt_CheckError(result, "SymmSpTns From COO", NULL);
+    }
+    result = sptResizeValueVector(&S->values, kept);
+    spt_CheckError(result, "SymmSpTns From COO", NULL);
+    S->nnz = kept;
+
+    #pragma omp parallel for schedule(static, 1) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = nnz * p / nparts, end = nnz * (p + 1) / nparts;
+        sptNnzIndex o = offsets[p];
+        for(sptNnzIndex z = begin; z < end; ++z) {
+            if(spt_SymmIsSorted(X, z)) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    S->inds[m].data[o] = X->inds[m].data[z];
+                }
+                S->values.data[o] = X->values.data[z];
+                ++o;
+            }
+        }
+    }
+    free(offsets);
+    return 0;
+}
+
+
+/* N! / (m_1! .. m_k!), the number of distinct permutations of the sorted coordinates of entry z */
+static inline sptNnzIndex spt_SymmPermutations(const sptSymmSparseTensor *S, sptNnzIndex const z) {
+    sptNnzIndex count = 1, run = 1;
+    for(sptIndex m = 1; m < S->nmodes; ++m) {
+        run = S->inds[m].data[z] == S->inds[m-1].data[z] ? run + 1 : 1;
+        count = count * (m + 1) / run;
+    }
+    return count;
+}
+
+/* Rearrange c into the next permutation of its multiset in lexicographic order; 0 after the last one */
+static int spt_SymmNextPermutation(sptIndex * const c, sptIndex const n) {
+    sptIndex i = n - 1;
+    while(i > 0 && c[i-1] >= c[i]) {
+        --i;
+    }
+    if(i == 0) {
+        return 0;
+    }
+    sptIndex j = n - 1;
+    while(c[j] <= c[i-1]) {
+        --j;
+    }
+    sptIndex t = c[i-1];
+    c[i-1] = c[j];
+    c[j] = t;
+    for(sptIndex a = i, b = n - 1; a < b; ++a, --b) {
+        t = c[a];
+        c[a] = c[b];
+        c[b] = t;
+    }
+    return 1;
+}
+
+/**
+ * Expand a supersymmetric sparse tensor into a COO tensor holding every
+ * distinct permutation of each of its entries.
+ * @param X   an uninitialized COO tensor
+ * @param S   the supersymmetric tensor
+ * @param tk  the number of threads
+ */
+int sptSparseTensorFromSymmSparseTensor(sptSparseTensor *X, const sptSymmSparseTensor *S, int const tk) {
+    sptIndex const nmodes = S->nmodes;
+    sptNnzIndex * offsets = malloc((S->nnz + 1) * sizeof *offsets);
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!offsets || !ndims, "SymmSpTns To COO");
+    offsets[0] = 0;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+        offsets[z+1] = spt_SymmPermutations(S, z);
+    }
+    for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+        offsets[z+1] += offsets[z];
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        ndims[m] = S->ndim;
+    }
+    int result = spt_SparseTensorNewSized(X, nmodes, ndims, offsets[S->nnz]);
+    free(ndims);
+    spt_CheckError(result, "SymmSpTns To COO", NULL);
+
+    #pragma omp parallel num_threads(tk)
+    {
+        sptIndex * const c = malloc(nmodes * sizeof *c);
+        sptAssert(c != NULL);
+        #pragma omp for schedule(dynamic, 256)
+        for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                c[m] = S->inds[m].data[z];
+            }
+            sptNnzIndex o = offsets[z];
+            do {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    X->inds[m].data[o] = c[m];
+                }
+                X->values.data[o] = S->values.data[z];
+                ++o;
+            } while(spt_SymmNextPermutation(c, nmodes));
+        }
+        free(c);
+    }
+    free(offsets);
+    return 0;
+}
+
+/**
+ * Squared Frobenius norm of the full tensor a supersymmetric tensor stands
+ * for, each entry counted once per distinct permutation.
+ * @param S   the tensor
+ * @param tk  the number of threads
+ */
+double sptSymmSparseTensorNormSquared(const sptSymmSparseTensor *S, int const tk) {
+    double norm = 0;
+    #pragma omp parallel for schedule(static) reduction(+:norm) num_threads(tk)
+    for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+        double const v = S->values.data[z];
+        norm += v * v * (double) spt_SymmPermutations(S, z);
+    }
+    return norm;
+}
+
+
+/*
+ * out += X U^{(N-1)}, the MTTKRP shared by every mode: each entry adds, to
+ * the row of each of its distinct coordinates c_s, its value times the
+ * number of permutations with c_s first times the Hadamard product of the
+ * rows of U at the other coordinates, the prefix before s times the suffix
+ * after it. Rows of U and out are rank wide, stride apart.
+ */
+static void spt_OmpSymmMTTKRPKernel(
+    sptSymmSparseTensor const * const S,
+    sptValue const * const U,
+    sptValue * const out,
+    sptIndex const rank,
+    sptIndex const stride,
+    int const tk)
+{
+    sptIndex const nmodes = S->nmodes;
+    double const inv_nmodes = 1.0 / nmodes;
+    #pragma omp parallel num_threads(tk)
+    {
+        /* suffix[k] is the product of the rows at coordinates k .. N-1, suffix[N] = 1 */
+        sptValue * const suffix = malloc((size_t) (nmodes + 1) * rank * sizeof *suffix);
+        sptValue * const prefix = malloc(rank * sizeof *prefix);
+        sptAssert(suffix != NULL && prefix != NULL);
+        #pragma omp for schedule(dynamic, 256)
+        for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+            sptValue * last = suffix + (size_t) nmodes * rank;
+            for(sptIndex r = 0; r < rank; ++r) {
+                last[r] = 1;
+                prefix[r] = 1;
+            }
+            for(sptIndex k = nmodes; k-- > 0; ) {
+                sptValue const * const row = U + (size_t) S->inds[k].data[z] * stride;
+                sptValue * const cur = suffix + (size_t) k * rank;
+                for(sptIndex r = 0; r < rank; ++r) {
+                    cur[r] = last[r] * row[r];
+                }
+                last = cur;
+            }
+            double const scale = S->values.data[z] * (double) spt_SymmPermutations(S, z) * inv_nmodes;
+            for(sptIndex s = 0; s < nmodes; ) {
+                sptIndex const c = S->inds[s].data[z];
+                sptIndex e = s + 1;
+                while(e < nmodes && S->inds[e].data[z] == c) {
+                    ++e;
+                }
+                sptValue const weight = (sptValue) (scale * (e - s));
+                sptValue const * const after = suffix + (size_t) (s + 1) * rank;
+                sptValue * const dst = out + (size_t) c * stride;
+                for(sptIndex r = 0; r < rank; ++r) {
+                    #pragma omp atomic update
+                    dst[r] += weight * prefix[r] * after[r];
+                }
+                for(; s < e; ++s) {
+                    sptValue const * const row = U + (size_t) c * stride;
+                    for(sptIndex r = 0; r < rank; ++r) {
+                        prefix[r] *= row[r];
+                    }
+                }
+            }
+        }
+        free(suffix);
+        free(prefix);
+    }
+}
+
+/**
+ * MTTKRP of a supersymmetric tensor with one factor U for every mode,
+ * M = X_(1) (U ⊙ .. ⊙ U), the same in every mode. The permutations of an
+ * entry are expanded on the fly, so a stored entry costs O(N rank) however
+ * many permutations it stands for.
+ * @param S   the tensor
+ * @param U   the ndim x rank row-major factor
+ * @param M   the ndim x rank row-major output, with the stride of U, overwritten
+ * @param tk  the number of threads
+ */
+int sptOmpSymmMTTKRP(sptSymmSparseTensor const * const S,
+    sptMatrix const * const U,
+    sptMatrix * const M,
+    const int tk)
+{
+    if(U->nrows != S->ndim || M->nrows < S->ndim || M->ncols != U->ncols || M->stride != U->stride) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP SymmSpTns MTTKRP", "shape mismatch");
+    }
+    memset(M->values, 0, (size_t) S->ndim * M->stride * sizeof *M->values);
+    spt_OmpSymmMTTKRPKernel(S, U->values, M->values, U->ncols, U->stride, tk);
+    return 0;
+}
+
+/**
+ * Tensor-times-same-vector of a supersymmetric tensor in every mode but
+ * one, y = X v^(N-1), the same for every mode left out.
+ * @param S   the tensor
+ * @param v   the vector, of length ndim
+ * @param y   the output, of length ndim, overwritten
+ * @param tk  the number of threads
+ */
+int sptOmpSymmTTV(sptSymmSparseTensor const * const S,
+    sptValueVector const * const v,
+    sptValueVector * const y,
+    const int tk)
+{
+    if(v->len != S->ndim || y->len != S->ndim) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP SymmSpTns TTV", "shape mismatch");
+    }
+    memset(y->data, 0, S->ndim * sizeof *y->data);
+    spt_OmpSymmMTTKRPKernel(S, v->data, y->data, 1, 1, tk);
+    return 0;
+}
@@ -0,0 +1,445 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/lapack.h"
+
+/*
+ * TT-SVD of a sparse tensor without dense unfoldings.
+ *
+ * Core k is the leading left singular vectors of the remainder W_k, the
+ * tensor projected onto cores 0 .. k-1, unfolded with rows (a, i_k), a the
+ * rank index of the previous core, and one column per distinct tuple
+ * (i_{k+1}, .., i_{N-1}). W_k is semi-sparse: a dense vector over a for each
+ * distinct (i_k, .., i_{N-1}) of the nonzeros, its fibers. Sorted once with
+ * the last mode slowest, the fibers of one column are consecutive at every
+ * k, and the columns of W_k are the fibers of W_{k+1}, so nothing larger than
+ * the nonzeros times the rank is formed. The singular vectors come from a
+ * randomized range finder: W_k and its transpose are only applied, column by
+ * column in parallel, to rank + SPT_TT_RSVD_OVERSAMPLE vectors.
+ */
+
+#define SPT_TT_RSVD_OVERSAMPLE 10
+#define SPT_TT_RSVD_POWER 1
+/* Singular values, and columns left by Gram-Schmidt, below this fraction of the largest are dropped */
+#define SPT_TT_RELATIVE_FLOOR 1e-12
+
+/*
+ * Orthonormalize the columns of the row-major nrows x ncols a in place, by
+ * modified Gram-Schmidt applied twice. A column left with no more than
+ * rounding error is set to zero rather than normalized, so the range of a
+ * matrix of lower rank than ncols stays orthonormal.
+ */
+static void spt_TtOrthonormalize(double * const a, sptNnzIndex const nrows, sptIndex const ncols, int const tk)
+{
+  for(sptIndex r=0; r<ncols; ++r) {
+    double before = 0;
+    #pragma omp parallel for schedule(static) reduction(+:before) num_threads(tk)
+    for(sptNnzIndex i=0; i<nrows; ++i) {
+      before += a[i * ncols + r] * a[i * ncols + r];
+    }
+    for(int pass=0; pass<2; ++pass) {
+      for(sptIndex s=0; s<r; ++s) {
+        double dot = 0;
+        #pragma omp parallel for schedule(static) reduction(+:dot) num_threads(tk)
+        for(sptNnzIndex i=0; i<nrows; ++i) {
+          dot += a[i * ncols + r] * a[i * ncols + s];
+        }
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex i=0; i<nrows; ++i) {
+          a[i * ncols + r] -= dot * a[i * ncols + s];
+        }
+      }
+    }
+    double norm = 0;
+    #pragma omp parallel for schedule(static) reduction(+:norm) num_threads(tk)
+    for(sptNnzIndex i=0; i<nrows; ++i) {
+      norm += a[i * ncols + r] * a[i * ncols + r];
+    }
+    double const scale = norm > before * SPT_TT_RELATIVE_FLOOR * SPT_TT_RELATIVE_FLOOR ? 1 / sqrt(norm) : 0;
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex i=0; i<nrows; ++i) {
+      a[i * ncols + r] *= scale;
+    }
+  }
+}
+
+
+/* The remainder W_k: fibers grouped into columns, each fiber a dense vector over the previous rank */
+typedef struct {
+  sptSparseTensor const * X;
+  sptIndex mode;             /// k
+  sptIndex rin;              /// ranks[k]
+  sptNnzIndex const * first; /// a nonzero of each fiber, giving its indices
+  double const * w;          /// nfibers x rin, row-major
+  sptNnzIndex const * cptr;  /// fibers of column c are cptr[c] .. cptr[c+1]-1
+  sptNnzIndex ncols;
+} spt_TtRemainder;
+
+/* y = W b for the row-major ncols x l b and nrows x l y; rows of W are shared, so the sums are atomic */
+static void spt_TtApply(spt_TtRemainder const * R, double const * const b, double * const y, sptIndex const l, int const tk)
+{
+  sptIndex const n = R->X->ndims[R->mode];
+  sptIndex const * const ik = R->X->inds[R->mode].data;
+  memset(y, 0, (size_t) R->rin * n * l * sizeof *y);
+  #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+  for(sptNnzIndex c=0; c<R->ncols; ++c) {
+    double const * const bc = b + c * l;
+    for(sptNnzIndex f=R->cptr[c]; f<R->cptr[c+1]; ++f) {
+      sptIndex const i = ik[R->first[f]];
+      for(sptIndex a=0; a<R->rin; ++a) {
+        double const v = R->w[f * R->rin + a];
+        double * const yr = y + ((size_t) a * n + i) * l;
+        for(sptIndex j=0; j<l; ++j) {
+          #pragma omp atomic update
+          yr[j] += v * bc[j];
+        }
+      }
+    }
+  }
+}
+
+/* z = W^T q for the row-major nrows x l q and ncols x l z, one column of W per row of z */
+static void spt_TtApplyTransposed(spt_TtRemainder const * R, double const * const q, double * const z, sptIndex const l, int const tk)
+{
+  sptIndex const n = R->X->ndims[R->mode];
+  sptIndex const * const ik = R->X->inds[R->mode].data;
+  #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+  for(sptNnzIndex c=0; c<R->ncols; ++c) {
+    double * const zc = z + c * l;
+    for(sptIndex j=0; j<l; ++j) {
+      zc[j] = 0;
+    }
+    for(sptNnzIndex f=R->cptr[c]; f<R->cptr[c+1]; ++f) {
+      sptIndex const i = ik[R->first[f]];
+      for(sptIndex a=0; a<R->rin; ++a) {
+        double const v = R->w[f * R->rin + a];
+        double const * const qr = q + ((size_t) a * n + i) * l;
+        for(sptIndex j=0; j<l; ++j) {
+          zc[j] += v * qr[j];
+        }
+      }
+    }
+  }
+}
+
+/* Whether nonzeros x and y differ in a mode after mode */
+static inline int spt_TtTrailingDiffer(sptSparseTensor const * X, sptIndex const mode, sptNnzIndex const x, sptNnzIndex const y)
+{
+  for(sptIndex m=mode+1; m<X->nmodes; ++m) {
+    if(X->inds[m].data[x] != X->inds[m].data[y]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/*
+ * Core k from the remainder of nfibers fibers: its leading left singular
+ * vectors, at most max_rank and no more than eps2 of energy left out. The
+ * fibers and w are replaced by those of the next remainder.
+ */
+static int spt_TtSvdCore(
+  sptSparseTensor const * const X,
+  sptIndex const mode,
+  sptIndex const rin,
+  sptIndex const max_rank,
+  double const eps2,
+  sptNnzIndex ** first,
+  double ** w,
+  sptNnzIndex * nfibers,
+  sptValue ** core,
+  sptIndex * rout,
+  int const tk)
+{
+  char const * const module = "OMP  SpTns TT-SVD";
+  sptIndex const n = X->ndims[mode];
+  sptNnzIndex const nf = *nfibers;
+  sptNnzIndex const * const fst = *first;
+  double const * const wk = *w;
+
+  /* A new column wherever the trailing indices change */
+  unsigned char * const head = malloc(nf > 0 ? nf : 1);
+  spt_CheckOSError(!head, module);
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex f=0; f<nf; ++f) {
+    head[f] = f == 0 || spt_TtTrailingDiffer(X, mode, fst[f-1], fst[f]);
+  }
+  sptNnzIndex ncols = 0;
+  for(sptNnzIndex f=0; f<nf; ++f) {
+    ncols += head[f];
+  }
+  sptNnzIndex * const cptr = malloc((ncols + 1) * sizeof *cptr);
+  spt_CheckOSError(!cptr, module);
+  for(sptNnzIndex f=0, c=0; f<nf; ++f) {
+    if(head[f]) {
+      cptr[c++] = f;
+    }
+  }
+  cptr[ncols] = nf;
+  free(head);
+  spt_TtRemainder const R = { X, mode, rin, fst, wk, cptr, ncols };
+
+  sptNnzIndex const nrows = (sptNnzIndex) rin * n;
+  sptNnzIndex maxr = max_rank;
+  maxr = maxr < nrows ? maxr : nrows;
+  maxr = maxr < ncols ? maxr : ncols;
+  sptNnzIndex lsize = maxr + SPT_TT_RSVD_OVERSAMPLE;
+  lsize = lsize < nrows ? lsize : nrows;
+  lsize = lsize < ncols ? lsize : ncols;
+  sptIndex const l = (sptIndex) lsize;
+
+  double * const omega = malloc(ncols * l * sizeof *omega);
+  double * const q = malloc(nrows * l * sizeof *q);
+  double * const g = malloc((size_t) l * l * sizeof *g);
+  double * const ev = malloc((size_t) l * sizeof *ev);
+  spt_CheckOSError(!omega || !q || !g || !ev, module);
+
+  /* Range finder with power iterations, omega reused for W^T q */
+  uint64_t const base = spt_RandomReserve(ncols * l);
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex x=0; x<ncols * l; ++x) {
+    omega[x] = spt_RandomValueOf(spt_RandomBits(base + x));
+  }
+  spt_TtApply(&R, omega, q, l, tk);
+  spt_TtOrthonormalize(q, nrows, l, tk);
+  for(int it=0; it<SPT_TT_RSVD_POWER; ++it) {
+    spt_TtApplyTransposed(&R, q, omega, l, tk);
+    spt_TtOrthonormalize(omega, ncols, l, tk);
+    spt_TtApply(&R, omega, q, l, tk);
+    spt_TtOrthonormalize(q, nrows, l, tk);
+  }
+
+  /* b = q^T W is l x ncols; the eigenvectors of b b^T rotate q into the singular vectors */
+  spt_TtApplyTransposed(&R, q, omega, l, tk);
+  memset(g, 0, (size_t) l * l * sizeof *g);
+  #pragma omp parallel num_threads(tk)
+  {
+    double * const part = calloc((size_t) l * l, sizeof *part);
+    sptAssert(part != NULL);
+    #pragma omp for schedule(static)
+    for(sptNnzIndex c=0; c<ncols; ++c) {
+      double const * const bc = omega + c * l;
+      for(sptIndex s=0; s<l; ++s) {
+        for(sptIndex t=0; t<l; ++t) {
+          part[(size_t) s * l + t] += bc[s] * bc[t];
+        }
+      }
+    }
+    #pragma omp critical
+    for(size_t x=0; x<(size_t) l * l; ++x) {
+      g[x] += part[x];
+    }
+    free(part);
+  }
+  int result = spt_TuckerEigen((integer) l, g, ev);
+  spt_CheckError(result, module, NULL);
+
+  /* The smallest rank that leaves out at most eps2 of the energy of W */
+  double wnormsq = 0;
+  #pragma omp parallel for schedule(static) reduction(+:wnormsq) num_threads(tk)
+  for(sptNnzIndex x=0; x<nf * rin; ++x) {
+    wnormsq += wk[x] * wk[x];
+  }
+  double const top = ev[l-1] > 0 ? ev[l-1] : 0;
+  sptIndex r = 0;
+  double kept = 0;
+  while(r < maxr && ev[l-1-r] > top * SPT_TT_RELATIVE_FLOOR * SPT_TT_RELATIVE_FLOOR &&
+      (r == 0 || wnormsq - kept > eps2)) {
+    kept += ev[l-1-r];
+    ++r;
+  }
+  r = r > 0 ? r : 1;
+
+  /* Core k = q V_r, rin x n x r */
+  sptValue * const U = malloc(nrows * r * sizeof *U);
+  spt_CheckOSError(!U, module);
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex i=0; i<nrows; ++i) {
+    for(sptIndex b=0; b<r; ++b) {
+      double const * const v = g + (size_t) (l - 1 - b) * l;
+      double sum = 0;
+      for(sptIndex j=0; j<l; ++j) {
+        sum += q[i * l + j] * v[j];
+      }
+      U[i * r + b] = (sptValue) sum;
+    }
+  }
+
+  /* The next remainder: one fiber per column, w' = U^T W */
+  sptNnzIndex * const next_first = malloc((ncols > 0 ? ncols : 1) * sizeof *next_first);
+  double * const next_w = malloc((ncols > 0 ? ncols : 1) * r * sizeof *next_w);
+  spt_CheckOSError(!next_first || !next_w, module);
+  sptIndex const * const ik = X->inds[mode].data;
+  #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+  for(sptNnzIndex c=0; c<ncols; ++c) {
+    double * const wc = next_w + c * r;
+    for(sptIndex b=0; b<r; ++b) {
+      wc[b] = 0;
+    }
+    next_first[c] = fst[cptr[c]];
+    for(sptNnzIndex f=cptr[c]; f<cptr[c+1]; ++f) {
+      sptIndex const i = ik[fst[f]];
+      for(sptIndex a=0; a<rin; ++a) {
+        double const v = wk[f * rin + a];
+        sptValue const * const u = U + ((size_t) a * n + i) * r;
+        for(sptIndex b=0; b<r; ++b) {
+          wc[b] += v * u[b];
+        }
+      }
+    }
+  }
+
+  free(omega);
+  free(q);
+  free(g);
+  free(ev);
+  free(cptr);
+  free(*first);
+  free(*w);
+  *first = next_first;
+  *w = next_w;
+  *nfibers = ncols;
+  *core = U;
+  *rout = r;
+  return 0;
+}
+
+
+static int spt_TensorTrainSvd(
+  sptSparseTensor * const spten,
+  double const eps,
+  const int tk,
+  sptTensorTrain * tt)
+{
+  char const * const module = "OMP  SpTns TT-SVD";
+  sptIndex const nmodes = spten->nmodes;
+  if(nmodes < 2 || tt->nmodes != nmodes) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    if(tt->ndims[m] != spten->ndims[m]) {
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+    }
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  /* Last mode slowest, so the fibers of every remainder column are consecutive */
+  sptIndex * const order = malloc(nmodes * sizeof *order);
+  spt_CheckOSError(!order, module);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    order[m] = nmodes - 1 - m;
+  }
+  sptSparseTensorSortIndexCustomOrder(spten, order, 1);
+  free(order);
+
+  /* W_0 has a fiber per nonzero, of rank 1 */
+  sptNnzIndex const nnz = spten->nnz;
+  sptNnzIndex nfibers = nnz;
+  sptNnzIndex * first = malloc((nnz > 0 ? nnz : 1) * sizeof *first);
+  double * w = malloc((nnz > 0 ? nnz : 1) * sizeof *w);
+  spt_CheckOSError(!first || !w, module);
+  #pragma omp parallel for schedule(static) num_threads(tk)
+  for(sptNnzIndex x=0; x<nnz; ++x) {
+    first[x] = x;
+    w[x] = spten->values.data[x];
+  }
+
+  /* Each of the N-1 truncations may leave out its share of eps^2 ||X||^2 */
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double const eps2 = eps * eps * spten_normsq / (nmodes - 1);
+  for(sptIndex k=0; k+1 < nmodes; ++k) {
+    sptTimer core_timer;
+    sptNewTimer(&core_timer, 0);
+    sptStartTimer(core_timer);
+
+    free(tt->cores[k]);
+    tt->cores[k] = NULL;
+    int result = spt_TtSvdCore(spten, k, tt->ranks[k], tt->ranks[k+1], eps2,
+      &first, &w, &nfibers, &tt->cores[k], &tt->ranks[k+1], tk);
+    spt_CheckError(result, module, NULL);
+
+    sptStopTimer(core_timer);
+    printf("  core = %"PARTI_PRI_INDEX " rank = %"PARTI_PRI_INDEX " ( %.3lf s )\n",
+        k+1, tt->ranks[k+1], sptElapsedTime(core_timer));
+    sptFreeTimer(core_timer);
+  }
+
+  /* The last core is the last remainder, one fiber per index of the last mode */
+  sptIndex const last = nmodes - 1, rin = tt->ranks[last], n = spten->ndims[last];
+  free(tt->cores[last]);
+  tt->cores[last] = calloc((size_t) rin * n, sizeof *tt->cores[last]);
+  spt_CheckOSError(!tt->cores[last], module);
+  double core_normsq = 0;
+  for(sptNnzIndex f=0; f<nfibers; ++f) {
+    sptIndex const i = spten->inds[last].data[first[f]];
+    for(sptIndex a=0; a<rin; ++a) {
+      tt->cores[last][(size_t) a * n + i] = (sptValue) w[f * rin + a];
+      core_normsq += w[f * rin + a] * w[f * rin + a];
+    }
+  }
+  free(first);
+  free(w);
+
+  /* The cores but the last are orthonormal, so ||X - TT||^2 = ||X||^2 - ||G_{N-1}||^2 */
+  double const residual = spten_normsq > core_normsq ? sqrt(spten_normsq - core_normsq) : 0;
+  tt->fit = spten_normsq > 0 ? 1 - residual / sqrt(spten_normsq) : 1;
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, module);
+  sptFreeTimer(timer);
+  return 0;
+}
+
+
+/**
+ * Tensor-train decomposition (TT-SVD) of a COO sparse tensor, for tensors of
+ * high order where CP and Tucker break down. Core k takes the leading left
+ * singular vectors of the k-th unfolding of what the previous cores leave,
+ * found by a randomized range finder, so the unfoldings, of up to
+ * ndims[k+1] x .. x ndims[N-1] columns, are never formed: the work and
+ * memory stay linear in the nonzeros times the rank (see tt_svd.c). Each
+ * truncation keeps the smallest rank within the maximum that loses at most
+ * eps^2 ||X||^2 / (N-1), so ||X - TT|| <= eps ||X|| when no maximum binds.
+ * The fit comes from the norm of the last core, as the others are orthonormal,
+ * and the norm of X, so its coordinates must be distinct (see sptSparseTensorCoalesce).
+ * @param[in]  spten the COO representation of a sparse tensor, reordered in place
+ * @param[in]  eps   the relative accuracy, 0 for the maximum ranks
+ * @param[in]  tk    the number of threads
+ * @param[in,out] tt the tensor train from sptNewTensorTrain, its ranks the maximum ones on entry and those used on return
+ */
+int sptOmpTensorTrainSvd(
+  sptSparseTensor * const spten,
+  double const eps,
+  const int tk,
+  sptTensorTrain * tt)
+{
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  int const result = spt_TensorTrainSvd(spten, eps, tk, tt);
+  sptSetExecContext(caller_exec);
+  return result;
+}
@@ -0,0 +1,169 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/* Whether nonzeros z-1 and z differ in any of the first n modes of order */
+static inline int spt_IsNewPrefix(const sptSparseTensor *X, sptNnzIndex const z, sptIndex const *order, sptIndex const n) {
+    if(z == 0) {
+        return 1;
+    }
+    for(sptIndex k = 0; k < n; ++k) {
+        if(X->inds[order[k]].data[z] != X->inds[order[k]].data[z-1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Multiply a sparse tensor by the transposes of all factor matrices but one,
+ * Y = X x_0 U[0]^T ... x_{mode-1} U[mode-1]^T x_{mode+1} U[mode+1]^T ...,
+ * returned unfolded on mode as a dense ndims[mode] x prod_{m != mode} ncols(U[m])
+ * matrix, with the column index row-major over the other modes in ascending order.
+ *
+ * Unlike a chain of sptSparseTensorMulMatrix calls, no intermediate
+ * semi-sparse tensor is built. X is sorted with mode first and the other
+ * modes ascending (skipped if its nonzeros already are), so each fiber along
+ * the last other mode is reduced to one dense row of its factor, then expanded
+ * once through the Kronecker product of the remaining factor rows into its
+ * output row. Output rows are processed in parallel, so no atomics are needed.
+ * @param[out] Y    the result, should be uninitialized
+ * @param[in]  X    the sparse tensor, reordered in place
+ * @param[in]  U    the factor matrices, U[m] has ndims[m] rows; U[mode] is unused
+ * @param[in]  mode the mode left out
+ * @param[in]  tk   the number of threads
+ */
+int sptSparseTensorMulMatricesExcept(
+    sptMatrix *Y,
+    sptSparseTensor *X,
+    sptMatrix * const U[],
+    sptIndex const mode,
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    if(nmodes < 2 || mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Mtxs", "need a tensor of order 2 or more and a valid mode");
+    }
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    spt_CheckOSError(!order, "CPU  SpTns * Mtxs");
+    order[0] = mode;
+    sptIndex ncols = 1;
+    for(sptIndex m = 0, k = 1; m < nmodes; ++m) {
+        if(m == mode) {
+            continue;
+        }
+        if(U[m]->nrows != X->ndims[m]) {
+            free(order);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Mtxs", "shape mismatch");
+        }
+        order[k++] = m;
+        ncols *= U[m]->ncols;
+    }
+    sptIndex const inner = order[nmodes - 1];
+    sptIndex const rinner = U[inner]->ncols;
+    sptIndex const nprefix = ncols / rinner;
+
+    /* Sorted in place, or a kept copy with mode leading */
+    X = spt_SparseTensorSortedInOrder(X, order, nmodes + mode);
+    if(X == NULL) {
+        free(order);
+        spt_CheckOSError(1, "CPU  SpTns * Mtxs");
+    }
+    result = sptNewMatrix(Y, X->ndims[mode], ncols);
+    spt_CheckError(result, "CPU  SpTns * Mtxs", NULL);
+    memset(Y->values, 0, (size_t) Y->cap * Y->stride * sizeof *Y->values);
+
+    /* Runs of nonzeros sharing the output row */
+    sptNnzIndex nrows = 0;
+    sptNnzIndex * row_start = malloc((X->nnz + 1) * sizeof *row_start);
+    spt_CheckOSError(!row_start, "CPU  SpTns * Mtxs");
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        if(spt_IsNewPrefix(X, z, order, 1)) {
+            row_start[nrows++] = z;
+        }
+    }
+    row_start[nrows] = X->nnz;
+
+    int const nt = tk > 0 ? tk : 1;
+    sptValue * scratch = malloc((size_t) nt * (nprefix + rinner) * sizeof *scratch);
+    spt_CheckOSError(!scratch, "CPU  SpTns * Mtxs");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(nt)
+    for(sptNnzIndex r = 0; r < nrows; ++r) {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const kron = scratch + (size_t) omp_get_thread_num() * (nprefix + rinner);
+#else
+        sptValue * const kron = scratch;
+#endif
+        sptValue * const fiber = kron + nprefix;
+        sptValue * const yrow = Y->values + (size_t) X->inds[mode].data[row_start[r]] * Y->stride;
+        sptNnzIndex z = row_start[r];
+        while(z < row_start[r+1]) {
+            /* Kronecker product of the factor rows over the fiber's fixed modes */
+            sptIndex len = 1;
+            kron[0] = 1;
+            for(sptIndex k = 1; k + 1 < nmodes; ++k) {
+                sptMatrix const * const Uk = U[order[k]];
+                sptValue const * const urow = Uk->values + (size_t) X->inds[order[k]].data[z] * Uk->stride;
+                for(sptIndex a = len; a-- > 0; ) {
+                    sptValue const ka = kron[a];
+                    for(sptIndex c = Uk->ncols; c-- > 0; ) {
+                        kron[a * Uk->ncols + c] = ka * urow[c];
+                    }
+                }
+                len *= Uk->ncols;
+            }
+            for(sptIndex c = 0; c < rinner; ++c) {
+                fiber[c] = 0;
+            }
+            do {
+                sptValue const val = X->values.data[z];
+                sptValue const * const urow = U[inner]->values + (size_t) X->inds[inner].data[z] * U[inner]->stride;
+                for(sptIndex c = 0; c < rinner; ++c) {
+                    fiber[c] += val * urow[c];
+                }
+                ++z;
+            } while(z < row_start[r+1] && !spt_IsNewPrefix(X, z, order, nmodes - 1));
+            for(sptIndex a = 0; a < nprefix; ++a) {
+                sptValue const ka = kron[a];
+                sptValue * const yblock = yrow + (size_t) a * rinner;
+                for(sptIndex c = 0; c < rinner; ++c) {
+                    yblock[c] += ka * fiber[c];
+                }
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SpTns * Mtxs");
+    sptFreeTimer(timer);
+
+    free(scratch);
+    free(row_start);
+    free(order);
+    return 0;
+}
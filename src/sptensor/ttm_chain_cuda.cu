@@ -0,0 +1,180 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * One thread per nonzero, looping over the output columns: column c is
+ * decoded row-major over the other modes into one row entry per factor, so
+ * Y[i_mode][c] += val * prod_k U_k[i_k][c_k]. Factors are packed back to back
+ * in U_val at U_offset[m], with U_ncols[m] columns and U_stride[m] as stride.
+ */
+__global__ static void spt_TTMChainKernel(
+    sptValue *Y_val, sptIndex const Y_stride, sptIndex const Y_ncols,
+    sptNnzIndex const nnz, sptIndex const nmodes, sptIndex const mode,
+    sptValue const *X_val, sptIndex const *X_inds,
+    sptValue const *U_val, sptNnzIndex const *U_offset,
+    sptIndex const *U_ncols, sptIndex const *U_stride)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptValue const val = X_val[z];
+    sptValue * const yrow = Y_val + (sptNnzIndex) X_inds[(sptNnzIndex) mode * nnz + z] * Y_stride;
+    for(sptIndex c = 0; c < Y_ncols; ++c) {
+        sptIndex rem = c;
+        sptValue prod = val;
+        for(sptIndex m = nmodes; m-- > 0; ) {
+            if(m == mode) {
+                continue;
+            }
+            sptIndex const cm = rem % U_ncols[m];
+            rem /= U_ncols[m];
+            prod *= U_val[U_offset[m] + (sptNnzIndex) X_inds[(sptNnzIndex) m * nnz + z] * U_stride[m] + cm];
+        }
+        /* The 64-bit floating-point version of atomicAdd() is only supported by devices of compute capability 6.x and higher. */
+        atomicAdd(&yrow[c], prod);
+    }
+}
+
+
+/**
+ * CUDA version of sptSparseTensorMulMatricesExcept, with the same dense
+ * mode-unfolded output. X and the factors are copied to the current device
+ * for the call, and the result is copied back.
+ * @param[out] Y    the result, should be uninitialized
+ * @param[in]  X    the sparse tensor
+ * @param[in]  U    the factor matrices, U[m] has ndims[m] rows; U[mode] is unused
+ * @param[in]  mode the mode left out
+ */
+int sptCudaSparseTensorMulMatricesExcept(
+    sptMatrix *Y,
+    sptSparseTensor *X,
+    sptMatrix * const U[],
+    sptIndex const mode)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    if(nmodes < 2 || mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Mtxs", "need a tensor of order 2 or more and a valid mode");
+    }
+    sptNnzIndex * U_offset = new sptNnzIndex[nmodes + 1];
+    sptIndex * U_ncols = new sptIndex[nmodes];
+    sptIndex * U_stride = new sptIndex[nmodes];
+    sptIndex ncols = 1;
+    U_offset[0] = 0;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m == mode) {
+            U_ncols[m] = 1;
+            U_stride[m] = 0;
+            U_offset[m+1] = U_offset[m];
+            continue;
+        }
+        if(U[m]->nrows != X->ndims[m]) {
+            delete[] U_stride;
+            delete[] U_ncols;
+            delete[] U_offset;
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Mtxs", "shape mismatch");
+        }
+        U_ncols[m] = U[m]->ncols;
+        U_stride[m] = U[m]->stride;
+        U_offset[m+1] = U_offset[m] + (sptNnzIndex) U[m]->nrows * U[m]->stride;
+        ncols *= U[m]->ncols;
+    }
+    result = sptNewMatrix(Y, X->ndims[mode], ncols);
+    spt_CheckError(result, "CUDA SpTns * Mtxs", NULL);
+
+    sptValue *Y_val = NULL;
+    result = cudaMalloc((void **) &Y_val, ((sptNnzIndex) Y->nrows * Y->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    cudaMemset(Y_val, 0, (sptNnzIndex) Y->nrows * Y->stride * sizeof (sptValue));
+    sptValue *X_val = NULL;
+    result = cudaMalloc((void **) &X_val, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    cudaMemcpy(X_val, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    sptIndex *X_inds = NULL;
+    result = cudaMalloc((void **) &X_inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        cudaMemcpy(X_inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    }
+    sptValue *U_val = NULL;
+    result = cudaMalloc((void **) &U_val, (U_offset[nmodes] + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m != mode) {
+            cudaMemcpy(U_val + U_offset[m], U[m]->values, (U_offset[m+1] - U_offset[m]) * sizeof (sptValue), cudaMemcpyHostToDevice);
+        }
+    }
+    sptNnzIndex *U_offset_dev = NULL;
+    result = cudaMalloc((void **) &U_offset_dev, (nmodes + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    cudaMemcpy(U_offset_dev, U_offset, (nmodes + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    sptIndex *U_ncols_dev = NULL;
+    result = cudaMalloc((void **) &U_ncols_dev, nmodes * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    cudaMemcpy(U_ncols_dev, U_ncols, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    sptIndex *U_stride_dev = NULL;
+    result = cudaMalloc((void **) &U_stride_dev, nmodes * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    cudaMemcpy(U_stride_dev, U_stride, nmodes * sizeof (sptIndex), cudaMemcpyHostToDevice);
+
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks = (nnz + nthreads - 1) / nthreads;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(nblocks > 0) {
+        spt_TTMChainKernel<<<nblocks, nthreads>>>(Y_val, Y->stride, ncols, nnz, nmodes, mode,
+            X_val, X_inds, U_val, U_offset_dev, U_ncols_dev, U_stride_dev);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SpTns * Mtxs");
+    sptFreeTimer(timer);
+
+    cudaMemcpy(Y->values, Y_val, (sptNnzIndex) Y->nrows * Y->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    result = cudaFree(U_stride_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(U_ncols_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(U_offset_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(U_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(X_inds);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(X_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+    result = cudaFree(Y_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs");
+
+    delete[] U_stride;
+    delete[] U_ncols;
+    delete[] U_offset;
+    return 0;
+}
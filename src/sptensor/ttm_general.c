@@ -0,0 +1,211 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../ssptensor/ssptensor.h"
+
+/* Whether nonzeros z-1 and z differ in any of the first n modes of order */
+static inline int spt_IsNewPrefix(const sptSparseTensor *X, sptNnzIndex const z, sptIndex const *order, sptIndex const n) {
+    if(z == 0) {
+        return 1;
+    }
+    for(sptIndex k = 0; k < n; ++k) {
+        if(X->inds[order[k]].data[z] != X->inds[order[k]].data[z-1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Set up the result of multiplying modes of X by matrices: checks the
+ * shapes, fills order with the kept modes ascending then the multiplied ones,
+ * and creates Y, empty, with the multiplied modes dense in their given order.
+ * Shared with the CUDA version.
+ */
+int spt_SparseTensorMulMatricesSetup(
+    sptSemiSparseTensorGeneral *Y,
+    sptIndex * order,
+    sptSparseTensor const *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[],
+    char const * module)
+{
+    (void) module;
+    sptIndex const nmodes = X->nmodes;
+    if(nmodes < 2 || nmats == 0 || nmats > nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "need a tensor of order 2 or more and 1 to nmodes matrices");
+    }
+    sptIndex * ndims = malloc(nmodes * sizeof *ndims);
+    spt_CheckOSError(!ndims, module);
+    memcpy(ndims, X->ndims, nmodes * sizeof *ndims);
+    for(sptIndex k = 0; k < nmats; ++k) {
+        if(modes[k] >= nmodes || spt_SemiSparseTensorGeneralDenseSlot(modes, k, modes[k]) != k || U[k]->nrows != X->ndims[modes[k]]) {
+            free(ndims);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "modes out of range or repeated, or shape mismatch");
+        }
+        ndims[modes[k]] = U[k]->ncols;
+    }
+    int result = sptNewSemiSparseTensorGeneral(Y, nmodes, ndims, nmats, modes);
+    free(ndims);
+    spt_CheckError(result, module, NULL);
+    spt_SemiSparseTensorGeneralSparseModes(order, Y);
+    memcpy(order + nmodes - nmats, modes, nmats * sizeof *order);
+    return 0;
+}
+
+/**
+ * Multiply several modes of a sparse tensor by matrices at once,
+ * Y = X x_{modes[0]} U[0]^T ... x_{modes[nmats-1]} U[nmats-1]^T, into a
+ * general semi sparse tensor whose dense blocks span all the multiplied
+ * modes, so a chain of TTMs builds one list of the kept indices instead of
+ * expanding a semi sparse tensor per mode.
+ *
+ * X is sorted by the kept modes ascending, then the multiplied ones (skipped
+ * if it already is), so each run of equal kept indices makes one block. In a
+ * block, each fiber along the last multiplied mode is reduced to one dense
+ * row of its factor, then expanded through the Kronecker product of the other
+ * factor rows. Blocks are processed in parallel, so no atomics are needed.
+ * @param[out] Y     the result, should be uninitialized
+ * @param[in]  X     the sparse tensor, reordered in place
+ * @param[in]  nmats the number of multiplied modes, 1 to nmodes
+ * @param[in]  U     the matrices, U[k] has ndims[modes[k]] rows
+ * @param[in]  modes the multiplied modes, distinct, in the order of the blocks
+ * @param[in]  tk    the number of threads
+ */
+int sptSparseTensorMulMatrices(
+    sptSemiSparseTensorGeneral *Y,
+    sptSparseTensor *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[],
+    int const tk)
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    spt_CheckOSError(!order, "CPU  SpTns * Mtxs General");
+    result = spt_SparseTensorMulMatricesSetup(Y, order, X, nmats, U, modes, "CPU  SpTns * Mtxs General");
+    if(result != 0) {
+        free(order);
+        return result;
+    }
+    sptIndex const nsmodes = nmodes - nmats;
+    sptMatrix const * const Uinner = U[nmats - 1];
+    sptIndex const inner = modes[nmats - 1];
+    sptIndex const rinner = Uinner->ncols;
+    sptIndex const ld = Y->strides[nmats - 1];
+    sptIndex nprefix = 1;
+    for(sptIndex k = 0; k + 1 < nmats; ++k) {
+        nprefix *= U[k]->ncols;
+    }
+
+    if(!spt_SparseTensorIsSortedInOrder(X, order)) {
+        sptSparseTensorSortIndexCustomOrder(X, order, 1);
+    }
+
+    /* Runs of nonzeros sharing the kept indices */
+    sptNnzIndex nblocks = 0;
+    sptNnzIndex * block_start = malloc((X->nnz + 1) * sizeof *block_start);
+    spt_CheckOSError(!block_start, "CPU  SpTns * Mtxs General");
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        if(spt_IsNewPrefix(X, z, order, nsmodes)) {
+            block_start[nblocks++] = z;
+        }
+    }
+    block_start[nblocks] = X->nnz;
+
+    for(sptIndex s = 0; s < nsmodes; ++s) {
+        result = sptResizeIndexVector(&Y->inds[s], nblocks);
+        spt_CheckError(result, "CPU  SpTns * Mtxs General", NULL);
+        for(sptNnzIndex b = 0; b < nblocks; ++b) {
+            Y->inds[s].data[b] = X->inds[order[s]].data[block_start[b]];
+        }
+    }
+    result = sptResizeMatrix(&Y->values, nblocks);
+    spt_CheckError(result, "CPU  SpTns * Mtxs General", NULL);
+    memset(Y->values.values, 0, (size_t) nblocks * Y->values.stride * sizeof (sptValue));
+    Y->nnz = nblocks;
+
+    int const nt = tk > 0 ? tk : 1;
+    sptValue * scratch = malloc((size_t) nt * (nprefix + rinner) * sizeof *scratch);
+    spt_CheckOSError(!scratch, "CPU  SpTns * Mtxs General");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(nt)
+    for(sptNnzIndex b = 0; b < nblocks; ++b) {
+#ifdef PARTI_USE_OPENMP
+        sptValue * const kron = scratch + (size_t) omp_get_thread_num() * (nprefix + rinner);
+#else
+        sptValue * const kron = scratch;
+#endif
+        sptValue * const fiber = kron + nprefix;
+        sptValue * const yblock = Y->values.values + (size_t) b * Y->values.stride;
+        sptNnzIndex z = block_start[b];
+        while(z < block_start[b+1]) {
+            /* Kronecker product of the factor rows over the fiber's other multiplied modes */
+            sptIndex len = 1;
+            kron[0] = 1;
+            for(sptIndex k = 0; k + 1 < nmats; ++k) {
+                sptMatrix const * const Uk = U[k];
+                sptValue const * const urow = Uk->values + (size_t) X->inds[modes[k]].data[z] * Uk->stride;
+                for(sptIndex a = len; a-- > 0; ) {
+                    sptValue const ka = kron[a];
+                    for(sptIndex c = Uk->ncols; c-- > 0; ) {
+                        kron[a * Uk->ncols + c] = ka * urow[c];
+                    }
+                }
+                len *= Uk->ncols;
+            }
+            for(sptIndex c = 0; c < rinner; ++c) {
+                fiber[c] = 0;
+            }
+            do {
+                sptValue const val = X->values.data[z];
+                sptValue const * const urow = Uinner->values + (size_t) X->inds[inner].data[z] * Uinner->stride;
+                for(sptIndex c = 0; c < rinner; ++c) {
+                    fiber[c] += val * urow[c];
+                }
+                ++z;
+            } while(z < block_start[b+1] && !spt_IsNewPrefix(X, z, order, nmodes - 1));
+            for(sptIndex a = 0; a < nprefix; ++a) {
+                sptValue const ka = kron[a];
+                sptValue * const yrow = yblock + (size_t) a * ld;
+                for(sptIndex c = 0; c < rinner; ++c) {
+                    yrow[c] += ka * fiber[c];
+                }
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SpTns * Mtxs General");
+    sptFreeTimer(timer);
+
+    free(scratch);
+    free(block_start);
+    free(order);
+    return 0;
+}
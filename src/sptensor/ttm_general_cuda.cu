@@ -0,0 +1,208 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * One thread per nonzero, looping over the entries of its block: entry
+ * (a, c) of the block has a decoded row-major over the multiplied modes but
+ * the last and c over the last, so Y[block][a * ld + c] += val * prod_k
+ * U_k[i_k][a_k] * U_last[i_last][c]. Factors are packed back to back in U_val
+ * at U_offset[k], with U_ncols[k] columns and U_stride[k] as stride.
+ */
+__global__ static void spt_TTMGeneralKernel(
+    sptValue *Y_val, sptIndex const Y_stride, sptIndex const ld, sptIndex const nprefix,
+    sptNnzIndex const *block_of,
+    sptNnzIndex const nnz, sptIndex const nmats, sptIndex const *modes,
+    sptValue const *X_val, sptIndex const *X_inds,
+    sptValue const *U_val, sptNnzIndex const *U_offset,
+    sptIndex const *U_ncols, sptIndex const *U_stride)
+{
+    sptNnzIndex const z = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(z >= nnz) {
+        return;
+    }
+    sptValue const val = X_val[z];
+    sptValue * const yblock = Y_val + block_of[z] * Y_stride;
+    sptIndex const last = nmats - 1;
+    sptValue const * const urow_last = U_val + U_offset[last] + (sptNnzIndex) X_inds[(sptNnzIndex) modes[last] * nnz + z] * U_stride[last];
+    for(sptIndex a = 0; a < nprefix; ++a) {
+        sptIndex rem = a;
+        sptValue prod = val;
+        for(sptIndex k = last; k-- > 0; ) {
+            sptIndex const ak = rem % U_ncols[k];
+            rem /= U_ncols[k];
+            prod *= U_val[U_offset[k] + (sptNnzIndex) X_inds[(sptNnzIndex) modes[k] * nnz + z] * U_stride[k] + ak];
+        }
+        for(sptIndex c = 0; c < U_ncols[last]; ++c) {
+            /* The 64-bit floating-point version of atomicAdd() is only supported by devices of compute capability 6.x and higher. */
+            atomicAdd(&yblock[(sptNnzIndex) a * ld + c], prod * urow_last[c]);
+        }
+    }
+}
+
+
+/**
+ * CUDA version of sptSparseTensorMulMatrices, with the same general semi
+ * sparse output. The blocks are found on the host after sorting X; X, the
+ * block of each nonzero and the factors are copied to the current device for
+ * the call, and the blocks are copied back.
+ * @param[out] Y     the result, should be uninitialized
+ * @param[in]  X     the sparse tensor, reordered in place
+ * @param[in]  nmats the number of multiplied modes, 1 to nmodes
+ * @param[in]  U     the matrices, U[k] has ndims[modes[k]] rows
+ * @param[in]  modes the multiplied modes, distinct, in the order of the blocks
+ */
+int sptCudaSparseTensorMulMatrices(
+    sptSemiSparseTensorGeneral *Y,
+    sptSparseTensor *X,
+    sptIndex const nmats,
+    sptMatrix * const U[],
+    sptIndex const modes[])
+{
+    int result;
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex const nnz = X->nnz;
+    sptIndex * order = new sptIndex[nmodes];
+    result = spt_SparseTensorMulMatricesSetup(Y, order, X, nmats, U, modes, "CUDA SpTns * Mtxs General");
+    if(result != 0) {
+        delete[] order;
+        return result;
+    }
+    sptIndex const nsmodes = nmodes - nmats;
+    if(!spt_SparseTensorIsSortedInOrder(X, order)) {
+        sptSparseTensorSortIndexCustomOrder(X, order, 1);
+    }
+
+    /* The block of each nonzero, numbering the runs of equal kept indices */
+    sptNnzIndex * block_of = new sptNnzIndex[nnz + 1];
+    sptNnzIndex nblocks = 0;
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        int fresh = z == 0;
+        for(sptIndex s = 0; s < nsmodes && !fresh; ++s) {
+            fresh = X->inds[order[s]].data[z] != X->inds[order[s]].data[z-1];
+        }
+        nblocks += fresh;
+        block_of[z] = nblocks - 1;
+    }
+    for(sptIndex s = 0; s < nsmodes; ++s) {
+        result = sptResizeIndexVector(&Y->inds[s], nblocks);
+        spt_CheckError(result, "CUDA SpTns * Mtxs General", NULL);
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex s = 0; s < nsmodes; ++s) {
+            Y->inds[s].data[block_of[z]] = X->inds[order[s]].data[z];
+        }
+    }
+    result = sptResizeMatrix(&Y->values, nblocks);
+    spt_CheckError(result, "CUDA SpTns * Mtxs General", NULL);
+    Y->nnz = nblocks;
+
+    sptNnzIndex * U_offset = new sptNnzIndex[nmats + 1];
+    sptIndex * U_ncols = new sptIndex[nmats];
+    sptIndex * U_stride = new sptIndex[nmats];
+    sptIndex nprefix = 1;
+    U_offset[0] = 0;
+    for(sptIndex k = 0; k < nmats; ++k) {
+        U_ncols[k] = U[k]->ncols;
+        U_stride[k] = U[k]->stride;
+        U_offset[k+1] = U_offset[k] + (sptNnzIndex) U[k]->nrows * U[k]->stride;
+        nprefix *= k + 1 < nmats ? U[k]->ncols : 1;
+    }
+    sptNnzIndex const Y_len = nblocks * Y->values.stride;
+
+    sptValue *Y_val = NULL;
+    result = cudaMalloc((void **) &Y_val, (Y_len + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    cudaMemset(Y_val, 0, Y_len * sizeof (sptValue));
+    sptNnzIndex *block_of_dev = NULL;
+    result = cudaMalloc((void **) &block_of_dev, (nnz + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    cudaMemcpy(block_of_dev, block_of, nnz * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    sptValue *X_val = NULL;
+    result = cudaMalloc((void **) &X_val, (nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    cudaMemcpy(X_val, X->values.data, nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    sptIndex *X_inds = NULL;
+    result = cudaMalloc((void **) &X_inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        cudaMemcpy(X_inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    }
+    sptValue *U_val = NULL;
+    result = cudaMalloc((void **) &U_val, (U_offset[nmats] + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    for(sptIndex k = 0; k < nmats; ++k) {
+        cudaMemcpy(U_val + U_offset[k], U[k]->values, (U_offset[k+1] - U_offset[k]) * sizeof (sptValue), cudaMemcpyHostToDevice);
+    }
+    sptNnzIndex *U_offset_dev = NULL;
+    result = cudaMalloc((void **) &U_offset_dev, (nmats + 1) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    cudaMemcpy(U_offset_dev, U_offset, (nmats + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    sptIndex *meta_dev = NULL;
+    result = cudaMalloc((void **) &meta_dev, 3 * nmats * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    cudaMemcpy(meta_dev, U_ncols, nmats * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    cudaMemcpy(meta_dev + nmats, U_stride, nmats * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    cudaMemcpy(meta_dev + 2 * nmats, modes, nmats * sizeof (sptIndex), cudaMemcpyHostToDevice);
+
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks_grid = (nnz + nthreads - 1) / nthreads;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(nblocks_grid > 0) {
+        spt_TTMGeneralKernel<<<nblocks_grid, nthreads>>>(Y_val, Y->values.stride, Y->strides[nmats - 1], nprefix,
+            block_of_dev, nnz, nmats, meta_dev + 2 * nmats,
+            X_val, X_inds, U_val, U_offset_dev, meta_dev, meta_dev + nmats);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SpTns * Mtxs General");
+    sptFreeTimer(timer);
+
+    cudaMemcpy(Y->values.values, Y_val, Y_len * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    result = cudaFree(meta_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(U_offset_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(U_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(X_inds);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(X_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(block_of_dev);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+    result = cudaFree(Y_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Mtxs General");
+
+    delete[] U_stride;
+    delete[] U_ncols;
+    delete[] U_offset;
+    delete[] block_of;
+    delete[] order;
+    return 0;
+}
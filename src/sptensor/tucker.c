@@ -0,0 +1,437 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+#include "../matrix/lapack.h"
+
+/* Gram matrices up to this size on a side are eigensolved exactly */
+#define SPT_TUCKER_EXACT_MAX 1024
+#define SPT_TUCKER_RSVD_OVERSAMPLE 10
+#define SPT_TUCKER_RSVD_POWER 2
+
+/* Orthonormalize the columns of A in place with modified Gram-Schmidt in double */
+void spt_TuckerOrthonormalize(sptMatrix * const A, double * const col)
+{
+  sptIndex const nrows = A->nrows;
+  sptIndex const stride = A->stride;
+  for(sptIndex r=0; r<A->ncols; ++r) {
+    for(sptIndex i=0; i<nrows; ++i) {
+      col[i] = A->values[(size_t)i * stride + r];
+    }
+    for(sptIndex s=0; s<r; ++s) {
+      double dot = 0;
+      for(sptIndex i=0; i<nrows; ++i) {
+        dot += col[i] * A->values[(size_t)i * stride + s];
+      }
+      for(sptIndex i=0; i<nrows; ++i) {
+        col[i] -= dot * A->values[(size_t)i * stride + s];
+      }
+    }
+    double norm = 0;
+    for(sptIndex i=0; i<nrows; ++i) {
+      norm += col[i] * col[i];
+    }
+    norm = norm > 0 ? sqrt(norm) : 1;
+    for(sptIndex i=0; i<nrows; ++i) {
+      A->values[(size_t)i * stride + r] = (sptValue) (col[i] / norm);
+    }
+  }
+}
+
+
+/* Orthonormalize the columns of the row-major nrows x ncols a in place with modified Gram-Schmidt */
+static void spt_TuckerOrthonormalizeRows(double * const a, sptIndex const nrows, sptIndex const ncols)
+{
+  for(sptIndex r=0; r<ncols; ++r) {
+    for(sptIndex s=0; s<r; ++s) {
+      double dot = 0;
+      for(sptIndex i=0; i<nrows; ++i) {
+        dot += a[(size_t)i * ncols + r] * a[(size_t)i * ncols + s];
+      }
+      for(sptIndex i=0; i<nrows; ++i) {
+        a[(size_t)i * ncols + r] -= dot * a[(size_t)i * ncols + s];
+      }
+    }
+    double norm = 0;
+    for(sptIndex i=0; i<nrows; ++i) {
+      norm += a[(size_t)i * ncols + r] * a[(size_t)i * ncols + r];
+    }
+    norm = norm > 0 ? sqrt(norm) : 1;
+    for(sptIndex i=0; i<nrows; ++i) {
+      a[(size_t)i * ncols + r] /= norm;
+    }
+  }
+}
+
+
+/* c = op(a) * op(b) for row-major operands, c is m x n and k is the inner dimension */
+static void spt_TuckerGemm(char transa, char transb, integer m, integer n, integer k,
+  double * const a, double * const b, double * const c)
+{
+  /* A row-major matrix is its own transpose in column-major order */
+  integer lda = transa == 'N' ? k : m;
+  integer ldb = transb == 'N' ? n : k;
+  double one = 1, zero = 0;
+  dgemm_(&transb, &transa, &n, &m, &k, &one, b, &ldb, a, &lda, &zero, c, &n);
+}
+
+
+/* Eigenpairs of the symmetric n x n g in place, eigenvalues ascending in w */
+int spt_TuckerEigen(integer n, double * const g, double * const w)
+{
+  char uplo = 'L', jobz = 'V';
+  integer lwork = -1, info = 0;
+  double wsize = 0;
+  dsyev_(&jobz, &uplo, &n, g, &n, w, &wsize, &lwork, &info);
+  lwork = (integer) wsize;
+  double * const work = malloc((size_t)lwork * sizeof *work);
+  spt_CheckOSError(!work, "CPU  SpTns Tucker-HOOI");
+  dsyev_(&jobz, &uplo, &n, g, &n, w, work, &lwork, &info);
+  free(work);
+  spt_CheckError(info ? SPTERR_VALUE_ERROR : 0, "CPU  SpTns Tucker-HOOI", "dsyev failed");
+  return 0;
+}
+
+
+/* Exact path: eigensolve the smaller of the Gram matrices a a^T and a^T a */
+static int spt_TuckerExactVectors(double * const a, integer const nrows, integer const ncols,
+  sptMatrix * const U, double * const energy)
+{
+  sptIndex const rank = U->ncols;
+  integer n = nrows < ncols ? nrows : ncols;
+  double * const g = malloc((size_t)n * n * sizeof *g);
+  double * const w = malloc((size_t)n * sizeof *w);
+  double * const col = malloc((size_t)nrows * sizeof *col);
+  spt_CheckOSError(!g || !w || !col, "CPU  SpTns Tucker-HOOI");
+
+  /* a is a^T in column-major order */
+  char uplo = 'L';
+  char trans = nrows <= ncols ? 'T' : 'N';
+  integer k = nrows <= ncols ? ncols : nrows;
+  integer lda = ncols;
+  double one = 1, zero = 0;
+  dsyrk_(&uplo, &trans, &n, &k, &one, a, &lda, &zero, g, &n);
+  int result = spt_TuckerEigen(n, g, w);
+  spt_CheckError(result, "CPU  SpTns Tucker-HOOI", NULL);
+
+  *energy = 0;
+  for(sptIndex r=0; r<rank; ++r) {
+    double const * const v = g + (size_t)(n - 1 - r) * n;
+    *energy += w[n - 1 - r] > 0 ? w[n - 1 - r] : 0;
+    #pragma omp parallel for schedule(static)
+    for(integer i=0; i<nrows; ++i) {
+      if(nrows <= ncols) {
+        U->values[(size_t)i * U->stride + r] = (sptValue) v[i];
+      } else {
+        /* U = a V, normalized below */
+        double sum = 0;
+        for(integer j=0; j<ncols; ++j) {
+          sum += a[(size_t)i * ncols + j] * v[j];
+        }
+        U->values[(size_t)i * U->stride + r] = (sptValue) sum;
+      }
+    }
+  }
+  if(nrows > ncols) {
+    spt_TuckerOrthonormalize(U, col);
+  }
+
+  free(col);
+  free(w);
+  free(g);
+  return 0;
+}
+
+
+/*
+ * Randomized path: a range finder with SPT_TUCKER_RSVD_POWER power
+ * iterations on rank + SPT_TUCKER_RSVD_OVERSAMPLE random directions, then an
+ * eigensolve of the small projected Gram matrix. Nothing of size
+ * min(nrows, ncols)^2 is formed.
+ */
+static int spt_TuckerRandomizedVectors(double * const a, integer const nrows, integer const ncols,
+  sptMatrix * const U, double * const energy)
+{
+  sptIndex const rank = U->ncols;
+  integer const l = rank + SPT_TUCKER_RSVD_OVERSAMPLE;
+  double * const omega = malloc((size_t)ncols * l * sizeof *omega);
+  double * const q = malloc((size_t)nrows * l * sizeof *q);
+  double * const b = malloc((size_t)ncols * l * sizeof *b);
+  double * const g = malloc((size_t)l * l * sizeof *g);
+  double * const w = malloc((size_t)l * sizeof *w);
+  spt_CheckOSError(!omega || !q || !b || !g || !w, "CPU  SpTns Tucker-HOOI");
+
+  /* Fixed xorshift stream, so a run is reproducible and leaves rand() alone */
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  for(size_t x=0; x<(size_t)ncols * l; ++x) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    omega[x] = (double) (state >> 11) / 9007199254740992.0 - 0.5;
+  }
+  spt_TuckerGemm('N', 'N', nrows, l, ncols, a, omega, q);
+  spt_TuckerOrthonormalizeRows(q, nrows, l);
+  for(int it=0; it<SPT_TUCKER_RSVD_POWER; ++it) {
+    spt_TuckerGemm('T', 'N', ncols, l, nrows, a, q, b);
+    spt_TuckerOrthonormalizeRows(b, ncols, l);
+    spt_TuckerGemm('N', 'N', nrows, l, ncols, a, b, q);
+    spt_TuckerOrthonormalizeRows(q, nrows, l);
+  }
+
+  /* b = q^T a is l x ncols, its Gram b b^T carries the leading spectrum of a a^T */
+  spt_TuckerGemm('T', 'N', l, ncols, nrows, q, a, b);
+  spt_TuckerGemm('N', 'T', l, l, ncols, b, b, g);
+  int result = spt_TuckerEigen(l, g, w);
+  spt_CheckError(result, "CPU  SpTns Tucker-HOOI", NULL);
+
+  *energy = 0;
+  for(sptIndex r=0; r<rank; ++r) {
+    double const * const v = g + (size_t)(l - 1 - r) * l;
+    *energy += w[l - 1 - r] > 0 ? w[l - 1 - r] : 0;
+    #pragma omp parallel for schedule(static)
+    for(integer i=0; i<nrows; ++i) {
+      double sum = 0;
+      for(integer j=0; j<l; ++j) {
+        sum += q[(size_t)i * l + j] * v[j];
+      }
+      U->values[(size_t)i * U->stride + r] = (sptValue) sum;
+    }
+  }
+
+  free(w);
+  free(g);
+  free(b);
+  free(q);
+  free(omega);
+  return 0;
+}
+
+
+/**
+ * Leading ncols(U) left singular vectors of Y into U, in double. Returns the
+ * sum of the kept squared singular values in *energy. The exact path
+ * eigensolves the smaller Gram matrix of Y; the randomized one is used when
+ * asked, or when randomized < 0 and that Gram matrix is larger than
+ * SPT_TUCKER_EXACT_MAX on a side.
+ */
+int spt_MatrixLeadingLeftVectors(sptMatrix const * const Y, sptMatrix * const U, double * const energy, int const randomized)
+{
+  integer const nrows = (integer) Y->nrows, ncols = (integer) Y->ncols;
+  integer const n = nrows < ncols ? nrows : ncols;
+  if(U->nrows != Y->nrows || U->ncols == 0 || (integer) U->ncols > n) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Tucker-HOOI", "shape mismatch");
+  }
+  int const use_rsvd = (integer) U->ncols + SPT_TUCKER_RSVD_OVERSAMPLE < n &&
+    (randomized > 0 || (randomized < 0 && n > SPT_TUCKER_EXACT_MAX));
+  double * const a = malloc((size_t)nrows * ncols * sizeof *a);
+  spt_CheckOSError(!a, "CPU  SpTns Tucker-HOOI");
+  #pragma omp parallel for schedule(static)
+  for(integer i=0; i<nrows; ++i) {
+    for(integer j=0; j<ncols; ++j) {
+      a[(size_t)i * ncols + j] = Y->values[(size_t)i * Y->stride + j];
+    }
+  }
+  int result = use_rsvd ?
+    spt_TuckerRandomizedVectors(a, nrows, ncols, U, energy) :
+    spt_TuckerExactVectors(a, nrows, ncols, U, energy);
+  free(a);
+  spt_CheckError(result, "CPU  SpTns Tucker-HOOI", NULL);
+  return 0;
+}
+
+
+/* The sweeps of spt_TuckerHooi, run under its execution context */
+static int spt_TuckerHooiSweeps(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  int const use_cuda,
+  char const * const module,
+  sptTuckerTensor * ttensor)
+{
+  sptIndex const nmodes = spten->nmodes;
+  sptIndex const * const ranks = ttensor->ranks;
+  if(nmodes < 2 || ttensor->nmodes != nmodes) {
+    spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "shape mismatch");
+  }
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptIndex others = 1;
+    for(sptIndex k=0; k < nmodes; ++k) {
+      others *= k != m ? ranks[k] : 1;
+    }
+    if(ttensor->ndims[m] != spten->ndims[m] || ranks[m] == 0 || ranks[m] > spten->ndims[m] || ranks[m] > others) {
+      spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "invalid ranks");
+    }
+  }
+#ifndef PARTI_USE_CUDA
+  (void) use_cuda;
+#endif
+
+  sptMatrix ** mats = ttensor->factors;
+  double * const col = malloc(sptMaxIndexArray(spten->ndims, nmodes) * sizeof *col);
+  spt_CheckOSError(!col, module);
+  for(sptIndex m=0; m < nmodes; ++m) {
+    sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], ranks[m]) == 0);
+    spt_TuckerOrthonormalize(mats[m], col);
+  }
+
+  sptTimer timer;
+  sptNewTimer(&timer, 0);
+  sptStartTimer(timer);
+
+  double const spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+  double fit = 0, oldfit = 0;
+  sptMatrix Y;
+  for(sptIndex it=0; it < niters; ++it) {
+    sptTimer its_timer;
+    sptNewTimer(&its_timer, 0);
+    sptStartTimer(its_timer);
+
+    double core_normsq = 0;
+    for(sptIndex m=0; m < nmodes; ++m) {
+      int result;
+#ifdef PARTI_USE_CUDA
+      if(use_cuda) {
+        result = sptCudaSparseTensorMulMatricesExcept(&Y, spten, mats, m);
+      } else
+#endif
+      {
+        result = sptSparseTensorMulMatricesExcept(&Y, spten, mats, m, tk);
+      }
+      spt_CheckError(result, module, NULL);
+      result = spt_MatrixLeadingLeftVectors(&Y, mats[m], &core_normsq, -1);
+      spt_CheckError(result, module, NULL);
+      if(m + 1 < nmodes) {
+        sptFreeMatrix(&Y);
+      }
+    }
+
+    /* Core = U[last]^T Y, laid out row-major over ranks with the last mode fastest */
+    sptMatrix const * const last = mats[nmodes-1];
+    sptIndex const rlast = ranks[nmodes-1];
+    #pragma omp parallel for schedule(static)
+    for(sptIndex c=0; c < Y.ncols; ++c) {
+      for(sptIndex r=0; r < rlast; ++r) {
+        double sum = 0;
+        for(sptIndex i=0; i < Y.nrows; ++i) {
+          sum += (double) last->values[(size_t)i * last->stride + r] * Y.values[(size_t)i * Y.stride + c];
+        }
+        ttensor->core[(size_t)c * rlast + r] = (sptValue) sum;
+      }
+    }
+    sptFreeMatrix(&Y);
+
+    double const residual = spten_normsq > core_normsq ? sqrt(spten_normsq - core_normsq) : 0;
+    fit = 1 - residual / sqrt(spten_normsq);
+
+    sptStopTimer(its_timer);
+    double its_time = sptElapsedTime(its_timer);
+    sptFreeTimer(its_timer);
+    printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+        it+1, its_time, fit, fit - oldfit);
+    if(it > 0 && fabs(fit - oldfit) < tol) {
+      break;
+    }
+    oldfit = fit;
+  }
+
+  sptStopTimer(timer);
+  sptPrintElapsedTime(timer, module);
+  sptFreeTimer(timer);
+
+  ttensor->fit = fit;
+  free(col);
+  return 0;
+}
+
+
+/* HOOI shared by the drivers, with the TTM chain on the GPU if use_cuda */
+static int spt_TuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  int const use_cuda,
+  char const * const module,
+  sptTuckerTensor * ttensor)
+{
+  sptExecContext exec;
+  sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+  int const result = spt_TuckerHooiSweeps(spten, niters, tol, tk, use_cuda, module, ttensor);
+  sptSetExecContext(caller_exec);
+  return result;
+}
+
+
+/**
+ * Tucker decomposition by higher-order orthogonal iteration (HOOI) for COO
+ * sparse tensors. Each factor update takes the leading left singular vectors
+ * of X times all other factors, computed by sptSparseTensorMulMatricesExcept
+ * so no intermediate semi-sparse tensor is built, then by an exact or a
+ * randomized eigensolve (see spt_MatrixLeadingLeftVectors). The fit comes
+ * from the core norm, ||X - G x U||^2 = ||X||^2 - ||G||^2 for orthonormal
+ * factors; the core stays dense.
+ * @param[in]  spten   the COO representation of a sparse tensor, reordered in place
+ * @param[in]  niters  the maximum number of iterations
+ * @param[in]  tol     the tolerance value for convergence
+ * @param[out] ttensor the Tucker tensor from sptNewTuckerTensor, whose ranks are used
+ */
+int sptTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  sptTuckerTensor * ttensor)
+{
+  return spt_TuckerHooi(spten, niters, tol, 1, 0, "CPU  SpTns Tucker-HOOI", ttensor);
+}
+
+
+/**
+ * OpenMP Tucker-HOOI, see sptTuckerHooi
+ * @param[in]  tk      the number of threads
+ */
+int sptOmpTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  const int tk,
+  sptTuckerTensor * ttensor)
+{
+  return spt_TuckerHooi(spten, niters, tol, tk, 0, "OMP  SpTns Tucker-HOOI", ttensor);
+}
+
+
+#ifdef PARTI_USE_CUDA
+/**
+ * Tucker-HOOI with the TTM chain on the current CUDA device, see sptTuckerHooi.
+ * The eigensolves and the core stay on the host.
+ */
+int sptCudaTuckerHooi(
+  sptSparseTensor * const spten,
+  sptIndex const niters,
+  double const tol,
+  sptTuckerTensor * ttensor)
+{
+  return spt_TuckerHooi(spten, niters, tol, 1, 1, "CUDA SpTns Tucker-HOOI", ttensor);
+}
+#endif
@@ -0,0 +1,428 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef PARTI_USE_MPI
+
+#include <ParTI.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../matrix/lapack.h"
+#include "../ssptensor/ssptensor.h"
+#include "sptensor.h"
+
+/* Unfoldings with at most this many columns are solved through their distributed Gram matrix */
+#define SPT_MPI_TUCKER_GRAM_MAX 1024
+
+
+/* Rank p holds rows [spt_MpiTuckerRowBegin(n, p, P), spt_MpiTuckerRowBegin(n, p+1, P)) of an n-row unfolding. */
+static inline sptIndex spt_MpiTuckerRowBegin(sptIndex const nrows, int const p, int const nprocs)
+{
+    return (sptIndex) ((uint64_t) nrows * (uint64_t) p / (uint64_t) nprocs);
+}
+
+
+/**
+ * Distributed sparse tensor times matrix, Y = X x_mode U, for a tensor whose
+ * nonzeros are spread across the ranks of comm.
+ *
+ * Every rank multiplies its own nonzeros with sptOmpSparseTensorMulMatrix,
+ * then sends each dense fiber to the rank owning its index in the key mode,
+ * 0 or 1 when mode is 0, where fibers met from several ranks are summed. The
+ * owners are `own->owner[key]`, or without `own` nnz-balanced ranges of whole
+ * slices as in sptMpiRedistributeSparseTensor; a tensor redistributed along
+ * the key mode with the same ownership sends no fiber away.
+ * Together the ranks hold Y, each its fibers sorted and unique.
+ *
+ * @param[out] Y    an uninitialized semi sparse tensor, this rank's fibers of the product
+ * @param[in]  X    this rank's nonzeros, with the global ndims, reordered in place
+ * @param[in]  U    the dense matrix, replicated, with ndims[mode] rows
+ * @param[in]  mode the mode to multiply along
+ * @param[in]  own  the row ownership with one part per rank of comm, or NULL
+ * @param[in]  comm the communicator sharing the tensor
+ */
+int sptMpiSparseTensorMulMatrix(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptMatrix *U, sptIndex const mode, sptRowOwnership const *own, MPI_Comm comm)
+{
+    int nprocs;
+    MPI_Comm_size(comm, &nprocs);
+    sptIndex const nmodes = X->nmodes;
+    if(nmodes < 2 || mode >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns * Mtx", "shape mismatch");
+    }
+    sptIndex const key = mode == 0 ? 1 : 0;
+    if(own != NULL && (own->nparts != nprocs || own->nmodes != nmodes || own->ndims[key] != X->ndims[key])) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns * Mtx", "ownership does not match the communicator or tensor");
+    }
+
+    sptSemiSparseTensor local;
+    int result = sptOmpSparseTensorMulMatrix(&local, X, U, mode);
+    spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    sptIndex const stride = local.stride;
+    sptIndex const * const slice = local.inds[key].data;
+
+    int * owner = NULL;
+    if(own == NULL) {
+        owner = malloc(((size_t) local.ndims[key] + 1) * sizeof *owner);
+        spt_CheckOSError(!owner, "MPI  SpTns * Mtx");
+        result = spt_MpiBalancedOwners(owner, slice, local.nnz, local.ndims[key], comm);
+        spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    }
+    int const * const slice_owner = own != NULL ? own->owner[key] : owner;
+
+    /* Group the fibers by owner; counts are in fibers, and in values times stride */
+    int * send_counts = calloc(nprocs, sizeof *send_counts);
+    int * send_displs = malloc(nprocs * sizeof *send_displs);
+    int * recv_counts = malloc(nprocs * sizeof *recv_counts);
+    int * recv_displs = malloc(nprocs * sizeof *recv_displs);
+    int * fill = malloc(nprocs * sizeof *fill);
+    sptNnzIndex * order = malloc((local.nnz + 1) * sizeof *order);
+    spt_CheckOSError(!send_counts || !send_displs || !recv_counts || !recv_displs || !fill || !order, "MPI  SpTns * Mtx");
+    if(local.nnz * stride > INT_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "MPI  SpTns * Mtx", "fibers exceed the MPI count range");
+    }
+    for(sptNnzIndex i = 0; i < local.nnz; ++i) {
+        ++send_counts[slice_owner[slice[i]]];
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    sptNnzIndex recv_nnz = 0;
+    for(int p = 0; p < nprocs; ++p) {
+        send_displs[p] = p == 0 ? 0 : send_displs[p-1] + send_counts[p-1];
+        recv_displs[p] = (int) recv_nnz;
+        recv_nnz += (sptNnzIndex) recv_counts[p];
+    }
+    if(recv_nnz * stride > INT_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "MPI  SpTns * Mtx", "fibers exceed the MPI count range");
+    }
+    memcpy(fill, send_displs, nprocs * sizeof *fill);
+    for(sptNnzIndex i = 0; i < local.nnz; ++i) {
+        order[fill[slice_owner[slice[i]]]++] = i;
+    }
+    free(fill);
+    free(owner);
+
+    result = sptNewSemiSparseTensor(Y, nmodes, mode, local.ndims);
+    spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    sptIndex * packed = malloc((local.nnz + 1) * sizeof *packed);
+    spt_CheckOSError(!packed, "MPI  SpTns * Mtx");
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        if(m == mode) {
+            continue;
+        }
+        for(sptNnzIndex k = 0; k < local.nnz; ++k) {
+            packed[k] = local.inds[m].data[order[k]];
+        }
+        result = sptResizeIndexVector(&Y->inds[m], recv_nnz);
+        spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+        MPI_Alltoallv(packed, send_counts, send_displs, PARTI_MPI_INDEX,
+            Y->inds[m].data, recv_counts, recv_displs, PARTI_MPI_INDEX, comm);
+    }
+    free(packed);
+
+    sptValue * fibers = malloc(((size_t) local.nnz * stride + 1) * sizeof *fibers);
+    spt_CheckOSError(!fibers, "MPI  SpTns * Mtx");
+    for(sptNnzIndex k = 0; k < local.nnz; ++k) {
+        memcpy(fibers + k * stride, local.values.values + order[k] * stride, stride * sizeof *fibers);
+    }
+    for(int p = 0; p < nprocs; ++p) {
+        send_counts[p] *= (int) stride;
+        send_displs[p] *= (int) stride;
+        recv_counts[p] *= (int) stride;
+        recv_displs[p] *= (int) stride;
+    }
+    result = sptResizeMatrix(&Y->values, (sptIndex) recv_nnz);
+    spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    MPI_Alltoallv(fibers, send_counts, send_displs, PARTI_MPI_VALUE,
+        Y->values.values, recv_counts, recv_displs, PARTI_MPI_VALUE, comm);
+    Y->nnz = recv_nnz;
+    free(fibers);
+    free(order);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    sptFreeSemiSparseTensor(&local);
+
+    /* Fibers of one index met from several ranks become one */
+    result = sptSemiSparseTensorSortIndex(Y);
+    spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    result = spt_SemiSparseTensorMergeValues(Y);
+    spt_CheckError(result, "MPI  SpTns * Mtx", NULL);
+    return 0;
+}
+
+
+/*
+ * The factor update of one mode from this rank's partial unfolding Y: the sum
+ * over ranks is reduce-scattered into row blocks, returned in *block. With
+ * few columns the Gram matrix of the sum is all-reduced and eigensolved on
+ * rank 0, and each rank projects its rows onto the leading eigenvectors;
+ * otherwise rank 0 gathers the sum and solves it alone. U ends up the same
+ * everywhere.
+ */
+static int spt_MpiLeadingLeftVectors(sptMatrix const * const Y, sptMatrix * const U, double * const energy,
+    sptMatrix * const block, double * const col, MPI_Comm comm)
+{
+    int myrank, nprocs;
+    MPI_Comm_rank(comm, &myrank);
+    MPI_Comm_size(comm, &nprocs);
+    sptIndex const nrows = Y->nrows, ncols = Y->ncols, stride = Y->stride;
+    sptIndex const rank = U->ncols;
+    if((uint64_t) nrows * stride > INT_MAX) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "MPI  SpTns Tucker-HOOI", "unfolding exceeds the MPI count range");
+    }
+
+    int * counts = malloc(nprocs * sizeof *counts);
+    int * displs = malloc(nprocs * sizeof *displs);
+    spt_CheckOSError(!counts || !displs, "MPI  SpTns Tucker-HOOI");
+    for(int p = 0; p < nprocs; ++p) {
+        sptIndex const begin = spt_MpiTuckerRowBegin(nrows, p, nprocs);
+        counts[p] = (int) ((spt_MpiTuckerRowBegin(nrows, p + 1, nprocs) - begin) * stride);
+        displs[p] = (int) (begin * stride);
+    }
+    sptIndex const row_begin = spt_MpiTuckerRowBegin(nrows, myrank, nprocs);
+    sptIndex const nlocal = spt_MpiTuckerRowBegin(nrows, myrank + 1, nprocs) - row_begin;
+    int result = sptNewMatrix(block, nlocal, ncols);
+    spt_CheckError(result, "MPI  SpTns Tucker-HOOI", NULL);
+    sptAssert(block->stride == stride);
+    MPI_Reduce_scatter(Y->values, block->values, counts, PARTI_MPI_VALUE, MPI_SUM, comm);
+
+    if(ncols <= nrows && ncols <= SPT_MPI_TUCKER_GRAM_MAX && rank <= ncols) {
+        /* G = Y^T Y, the right singular vectors of Y as its eigenvectors */
+        integer n = (integer) ncols;
+        double * const g = calloc((size_t) n * n, sizeof *g);
+        double * const w = malloc((size_t) n * sizeof *w);
+        spt_CheckOSError(!g || !w, "MPI  SpTns Tucker-HOOI");
+        #pragma omp parallel for schedule(dynamic, 8)
+        for(integer a = 0; a < n; ++a) {
+            for(sptIndex i = 0; i < nlocal; ++i) {
+                sptValue const * const y = block->values + (size_t) i * stride;
+                double const ya = y[a];
+                for(integer b = 0; b <= a; ++b) {
+                    g[(size_t) a * n + b] += ya * y[b];
+                }
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, g, (int) (n * n), MPI_DOUBLE, MPI_SUM, comm);
+        if(myrank == 0) {
+            /* The lower triangle in row-major order is the upper one in column-major */
+            char uplo = 'U', jobz = 'V';
+            integer lwork = -1, info = 0;
+            double wsize = 0;
+            dsyev_(&jobz, &uplo, &n, g, &n, w, &wsize, &lwork, &info);
+            lwork = (integer) wsize;
+            double * const work = malloc((size_t) lwork * sizeof *work);
+            spt_CheckOSError(!work, "MPI  SpTns Tucker-HOOI");
+            dsyev_(&jobz, &uplo, &n, g, &n, w, work, &lwork, &info);
+            free(work);
+            result = info ? SPTERR_VALUE_ERROR : 0;
+        }
+        MPI_Bcast(&result, 1, MPI_INT, 0, comm);
+        spt_CheckError(result, "MPI  SpTns Tucker-HOOI", "dsyev failed");
+        MPI_Bcast(g, (int) (n * n), MPI_DOUBLE, 0, comm);
+        MPI_Bcast(w, (int) n, MPI_DOUBLE, 0, comm);
+
+        /* U = Y V for the leading eigenvectors, row block by row block, normalized below */
+        *energy = 0;
+        for(sptIndex r = 0; r < rank; ++r) {
+            double const * const v = g + (size_t) (n - 1 - r) * n;
+            *energy += w[n - 1 - r] > 0 ? w[n - 1 - r] : 0;
+            #pragma omp parallel for schedule(static)
+            for(sptIndex i = 0; i < nlocal; ++i) {
+                sptValue const * const y = block->values + (size_t) i * stride;
+                double sum = 0;
+                for(integer j = 0; j < n; ++j) {
+                    sum += y[j] * v[j];
+                }
+                U->values[(size_t) (row_begin + i) * U->stride + r] = (sptValue) sum;
+            }
+        }
+        for(int p = 0; p < nprocs; ++p) {
+            counts[p] = counts[p] / (int) stride * (int) U->stride;
+            displs[p] = displs[p] / (int) stride * (int) U->stride;
+        }
+        MPI_Allgatherv(MPI_IN_PLACE, 0, PARTI_MPI_VALUE, U->values, counts, displs, PARTI_MPI_VALUE, comm);
+        spt_TuckerOrthonormalize(U, col);
+        free(w);
+        free(g);
+    } else {
+        sptMatrix sum;
+        if(myrank == 0) {
+            result = sptNewMatrix(&sum, nrows, ncols);
+            spt_CheckError(result, "MPI  SpTns Tucker-HOOI", NULL);
+        }
+        MPI_Gatherv(block->values, (int) (nlocal * stride), PARTI_MPI_VALUE,
+            myrank == 0 ? sum.values : NULL, counts, displs, PARTI_MPI_VALUE, 0, comm);
+        if(myrank == 0) {
+            result = spt_MatrixLeadingLeftVectors(&sum, U, energy, -1);
+            sptFreeMatrix(&sum);
+        }
+        MPI_Bcast(&result, 1, MPI_INT, 0, comm);
+        spt_CheckError(result, "MPI  SpTns Tucker-HOOI", NULL);
+        MPI_Bcast(U->values, (int) (U->nrows * U->stride), PARTI_MPI_VALUE, 0, comm);
+        MPI_Bcast(energy, 1, MPI_DOUBLE, 0, comm);
+    }
+
+    free(displs);
+    free(counts);
+    return 0;
+}
+
+
+/* The sweeps of sptMpiTuckerHooi, run under its execution context */
+static int spt_MpiTuckerHooiSweeps(
+    sptSparseTensor * const spten,
+    sptIndex const niters,
+    double const tol,
+    const int tk,
+    MPI_Comm comm,
+    sptTuckerTensor * ttensor)
+{
+    int myrank;
+    MPI_Comm_rank(comm, &myrank);
+    sptIndex const nmodes = spten->nmodes;
+    sptIndex const * const ranks = ttensor->ranks;
+    if(nmodes < 2 || ttensor->nmodes != nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns Tucker-HOOI", "shape mismatch");
+    }
+    for(sptIndex m=0; m < nmodes; ++m) {
+        sptIndex others = 1;
+        for(sptIndex k=0; k < nmodes; ++k) {
+            others *= k != m ? ranks[k] : 1;
+        }
+        if(ttensor->ndims[m] != spten->ndims[m] || ranks[m] == 0 || ranks[m] > spten->ndims[m] || ranks[m] > others) {
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "MPI  SpTns Tucker-HOOI", "invalid ranks");
+        }
+    }
+
+    /* Factors initialized on rank 0 and shared */
+    sptMatrix ** mats = ttensor->factors;
+    double * const col = malloc(sptMaxIndexArray(spten->ndims, nmodes) * sizeof *col);
+    spt_CheckOSError(!col, "MPI  SpTns Tucker-HOOI");
+    for(sptIndex m=0; m < nmodes; ++m) {
+        if(myrank == 0) {
+            sptAssert(sptRandomizeMatrix(mats[m], spten->ndims[m], ranks[m]) == 0);
+            spt_TuckerOrthonormalize(mats[m], col);
+        }
+        MPI_Bcast(mats[m]->values, (int) (mats[m]->nrows * mats[m]->stride), PARTI_MPI_VALUE, 0, comm);
+    }
+
+    double const start = MPI_Wtime();
+    double spten_normsq = SparseTensorFrobeniusNormSquared(spten);
+    MPI_Allreduce(MPI_IN_PLACE, &spten_normsq, 1, MPI_DOUBLE, MPI_SUM, comm);
+    double fit = 0, oldfit = 0;
+    size_t core_size = 1;
+    for(sptIndex m=0; m < nmodes; ++m) {
+        core_size *= ranks[m];
+    }
+
+    for(sptIndex it=0; it < niters; ++it) {
+        double its_time = MPI_Wtime();
+
+        /* The TTM chain of the local nonzeros, summed across ranks in the factor update */
+        double core_normsq = 0;
+        sptMatrix block;
+        for(sptIndex m=0; m < nmodes; ++m) {
+            sptMatrix Y;
+            int result = sptSparseTensorMulMatricesExcept(&Y, spten, mats, m, tk);
+            spt_CheckError(result, "MPI  SpTns Tucker-HOOI", NULL);
+            result = spt_MpiLeadingLeftVectors(&Y, mats[m], &core_normsq, &block, col, comm);
+            spt_CheckError(result, "MPI  SpTns Tucker-HOOI", NULL);
+            sptFreeMatrix(&Y);
+            if(m + 1 < nmodes) {
+                sptFreeMatrix(&block);
+            }
+        }
+
+        /* Core = U[last]^T Y over this rank's rows of the last unfolding, then summed */
+        sptMatrix const * const last = mats[nmodes-1];
+        sptIndex const rlast = ranks[nmodes-1];
+        int nprocs;
+        MPI_Comm_size(comm, &nprocs);
+        sptIndex const row_begin = spt_MpiTuckerRowBegin(last->nrows, myrank, nprocs);
+        #pragma omp parallel for schedule(static)
+        for(sptIndex c=0; c < block.ncols; ++c) {
+            for(sptIndex r=0; r < rlast; ++r) {
+                double sum = 0;
+                for(sptIndex i=0; i < block.nrows; ++i) {
+                    sum += (double) last->values[(size_t)(row_begin + i) * last->stride + r] * block.values[(size_t)i * block.stride + c];
+                }
+                ttensor->core[(size_t)c * rlast + r] = (sptValue) sum;
+            }
+        }
+        sptFreeMatrix(&block);
+        MPI_Allreduce(MPI_IN_PLACE, ttensor->core, (int) core_size, PARTI_MPI_VALUE, MPI_SUM, comm);
+
+        double const residual = spten_normsq > core_normsq ? sqrt(spten_normsq - core_normsq) : 0;
+        fit = 1 - residual / sqrt(spten_normsq);
+
+        its_time = MPI_Wtime() - its_time;
+        if(myrank == 0) {
+            printf("  its = %"PARTI_PRI_INDEX " ( %.3lf s ) fit = %0.5f  delta = %+0.4e\n",
+                it+1, its_time, fit, fit - oldfit);
+        }
+        if(it > 0 && fabs(fit - oldfit) < tol) {
+            break;
+        }
+        oldfit = fit;
+    }
+    if(myrank == 0) {
+        printf("[MPI  SpTns Tucker-HOOI]: %.9lf s\n", MPI_Wtime() - start);
+    }
+
+    ttensor->fit = fit;
+    free(col);
+    return 0;
+}
+
+
+/**
+ * Distributed-memory Tucker-HOOI for a COO tensor whose nonzeros are spread
+ * across the ranks of a communicator, loaded and partitioned as for
+ * sptMpiCpdAls, e.g. by sptMpiLoadSparseTensor and
+ * sptMpiRedistributeSparseTensor.
+ *
+ * Every rank runs the TTM chain of sptSparseTensorMulMatricesExcept on its own
+ * nonzeros. The partial unfoldings are reduce-scattered into row blocks, and
+ * the factor comes from the all-reduced Gram matrix of the sum, eigensolved
+ * once; only an unfolding too wide for that is gathered on rank 0 and solved
+ * as in sptTuckerHooi. The core is summed from the row blocks of the last
+ * mode. All ranks end up with the same Tucker tensor.
+ *
+ * @param[in]  spten   this rank's nonzeros, with the global ndims, reordered in place
+ * @param[in]  niters  the maximum number of iterations
+ * @param[in]  tol     the tolerance value for convergence
+ * @param[in]  tk      the number of threads of each rank
+ * @param[in]  comm    the communicator sharing the tensor
+ * @param[out] ttensor the Tucker tensor from sptNewTuckerTensor with the global shape, whose ranks are used
+ */
+int sptMpiTuckerHooi(
+    sptSparseTensor * const spten,
+    sptIndex const niters,
+    double const tol,
+    const int tk,
+    MPI_Comm comm,
+    sptTuckerTensor * ttensor)
+{
+    sptExecContext exec;
+    sptExecContext const * const caller_exec = spt_ExecPushThreads(&exec, tk);
+    int const result = spt_MpiTuckerHooiSweeps(spten, niters, tol, tk, comm, ttensor);
+    sptSetExecContext(caller_exec);
+    return result;
+}
+
+#endif
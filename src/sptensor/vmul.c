@@ -19,6 +19,7 @@
 #include <ParTI.h>
 #include <stdlib.h>
 #include "sptensor.h"
+#include "../matrix/simd.h"
 
 /**
  * Sparse tensor times a vector (SpTTV)
@@ -33,9 +34,10 @@ int sptSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const s
     if(X->ndims[mode] != V->len) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Vec", "shape mismatch");
     }
-    sptSparseTensorSortIndexAtMode(X, mode, 0);
-    // jli: try to avoid malloc in all operation functions.
-    ind_buf = malloc(X->nmodes * sizeof *ind_buf);
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "CPU  SpTns * Vec");
+    ind_buf = spt_ScratchAlloc(X->nmodes * sizeof *ind_buf);
     spt_CheckOSError(!ind_buf, "CPU  SpTns * Vec");
     for(sptIndex m = 0; m < X->nmodes; ++m) {
         ind_buf[m] = X->ndims[m];
@@ -43,7 +45,7 @@ int sptSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const s
     ind_buf[mode] = 1;
     // jli: use pre-processing to allocate Y size outside this function.
     result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
-    free(ind_buf);
+    spt_ScratchFree(ind_buf);
     spt_CheckError(result, "CPU  SpTns * Vec", NULL);
     sptSemiSparseTensorSetIndices(Y, &fiberidx, X);
 
@@ -51,15 +53,13 @@ int sptSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const s
     sptNewTimer(&timer, 0);
     sptStartTimer(timer);
 
+    /* Each fiber is a gathered dot product, vectorized across its nonzeros */
+    spt_SimdKernels const * const simd = spt_Simd();
     for(sptNnzIndex i = 0; i < Y->nnz; ++i) {
         sptNnzIndex inz_begin = fiberidx.data[i];
         sptNnzIndex inz_end = fiberidx.data[i+1];
-        sptNnzIndex j;
-        // jli: exchange the two loops
-        for(j = inz_begin; j < inz_end; ++j) {
-            sptIndex r = X->inds[mode].data[j];
-            Y->values.values[i*Y->stride] += X->values.data[j] * V->data[r];
-        }
+        Y->values.values[i*Y->stride] += simd->gather_dot(X->values.data + inz_begin, V->data,
+            X->inds[mode].data + inz_begin, (sptIndex) (inz_end - inz_begin));
     }
 
     sptStopTimer(timer);
@@ -0,0 +1,159 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/* Whether nonzero z starts a new run of kept coordinates, with X sorted kept modes first */
+static inline int spt_IsRunHead(const sptSparseTensor *X, sptIndex const *kept, sptIndex const nkept, sptNnzIndex const z) {
+    if(z == 0) {
+        return 1;
+    }
+    for(sptIndex k = 0; k < nkept; ++k) {
+        if(X->inds[kept[k]].data[z] != X->inds[kept[k]].data[z-1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sparse tensor times several vectors at once (multi-TTV),
+ * Y = X x_{modes[0]} V[0] x_{modes[1]} V[1] ... , contracting nvecs modes
+ * straight into a sparse Y over the remaining modes, in their original
+ * order. X is sorted with the remaining modes first (skipped if it already
+ * is), so every nonzero of Y is one run of X's nonzeros; runs are found and
+ * summed in parallel without dense fibers or atomics.
+ * @param[out] Y     the result, should be uninitialized; sorted on output
+ * @param[in]  X     the sparse tensor, reordered in place
+ * @param[in]  V     nvecs vectors, V[k] of length X->ndims[modes[k]]
+ * @param[in]  modes the distinct modes to contract
+ * @param[in]  nvecs the number of vectors, less than X->nmodes
+ * @param[in]  tk    the number of threads
+ */
+int sptSparseTensorMulVectors(
+    sptSparseTensor *Y,
+    sptSparseTensor *X,
+    const sptValueVector * const V[],
+    sptIndex const modes[],
+    sptIndex const nvecs,
+    int const tk)
+{
+    sptIndex const nmodes = X->nmodes;
+    if(nvecs == 0 || nvecs >= nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Vecs", "need 1 to nmodes-1 vectors");
+    }
+    char * contracted = calloc(nmodes, 1);
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    sptIndex * ydims = malloc(nmodes * sizeof *ydims);
+    spt_CheckOSError(!contracted || !order || !ydims, "CPU  SpTns * Vecs");
+    for(sptIndex k = 0; k < nvecs; ++k) {
+        if(modes[k] >= nmodes || contracted[modes[k]] || V[k]->len != X->ndims[modes[k]]) {
+            free(contracted);
+            free(order);
+            free(ydims);
+            spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns * Vecs", "shape mismatch");
+        }
+        contracted[modes[k]] = 1;
+    }
+    sptIndex const nkept = nmodes - nvecs;
+    for(sptIndex m = 0, k = 0; m < nmodes; ++m) {
+        if(!contracted[m]) {
+            ydims[k] = X->ndims[m];
+            order[k++] = m;
+        }
+    }
+    for(sptIndex k = 0; k < nvecs; ++k) {
+        order[nkept + k] = modes[k];
+    }
+    free(contracted);
+
+    if(!spt_SparseTensorIsSortedInOrder(X, order)) {
+        sptSparseTensorSortIndexCustomOrder(X, order, 1);
+    }
+    sptIndex const * const kept = order;
+
+    int const nparts = tk > 0 ? tk : 1;
+    sptNnzIndex * offsets = calloc(nparts + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "CPU  SpTns * Vecs");
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = X->nnz * p / nparts;
+        sptNnzIndex const end = X->nnz * (p + 1) / nparts;
+        sptNnzIndex count = 0;
+        for(sptNnzIndex z = begin; z < end; ++z) {
+            count += spt_IsRunHead(X, kept, nkept, z);
+        }
+        offsets[p + 1] = count;
+    }
+    for(int p = 0; p < nparts; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+
+    int result = sptNewSparseTensor(Y, nkept, ydims);
+    free(ydims);
+    spt_CheckError(result, "CPU  SpTns * Vecs", NULL);
+    for(sptIndex k = 0; k < nkept; ++k) {
+        result = sptResizeIndexVector(&Y->inds[k], offsets[nparts]);
+        spt_CheckError(result, "CPU  SpTns * Vecs", NULL);
+    }
+    result = sptResizeValueVector(&Y->values, offsets[nparts]);
+    spt_CheckError(result, "CPU  SpTns * Vecs", NULL);
+    Y->nnz = offsets[nparts];
+
+    /* Each part sums the runs that start inside it, finishing the last one past its end */
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = X->nnz * p / nparts;
+        sptNnzIndex const end = X->nnz * (p + 1) / nparts;
+        sptNnzIndex out = offsets[p];
+        sptNnzIndex z = begin;
+        while(z < end && !spt_IsRunHead(X, kept, nkept, z)) {
+            ++z;
+        }
+        while(z < end) {
+            for(sptIndex k = 0; k < nkept; ++k) {
+                Y->inds[k].data[out] = X->inds[kept[k]].data[z];
+            }
+            sptValue sum = 0;
+            do {
+                sptValue prod = X->values.data[z];
+                for(sptIndex k = 0; k < nvecs; ++k) {
+                    prod *= V[k]->data[X->inds[modes[k]].data[z]];
+                }
+                sum += prod;
+                ++z;
+            } while(z < X->nnz && !spt_IsRunHead(X, kept, nkept, z));
+            Y->values.data[out++] = sum;
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SpTns * Vecs");
+    sptFreeTimer(timer);
+
+    free(offsets);
+    free(order);
+    return 0;
+}
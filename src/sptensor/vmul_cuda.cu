@@ -0,0 +1,122 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+
+/* One thread per fiber: Y_val[i * Y_stride] = sum of X_val[j] * V_val[X_inds_m[j]] over fiber i */
+__global__ static void spt_TTVKernel(
+    sptValue *Y_val, sptIndex const Y_stride, sptNnzIndex const Y_nnz,
+    sptValue const *X_val, sptIndex const *X_inds_m,
+    sptNnzIndex const *fiberidx_val,
+    sptValue const *V_val)
+{
+    sptNnzIndex const i = (sptNnzIndex) blockIdx.x * blockDim.x + threadIdx.x;
+    if(i < Y_nnz) {
+        sptValue sum = 0;
+        for(sptNnzIndex j = fiberidx_val[i]; j < fiberidx_val[i+1]; ++j) {
+            sum += X_val[j] * V_val[X_inds_m[j]];
+        }
+        Y_val[i * Y_stride] = sum;
+    }
+}
+
+
+int sptCudaSparseTensorMulVector(
+    sptSemiSparseTensor *Y,
+    sptSparseTensor *X,
+    const sptValueVector *V,
+    sptIndex const mode
+) {
+    int result;
+    sptIndex *ind_buf;
+    sptNnzIndexVector fiberidx;
+    if(mode >= X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Vec", "shape mismatch");
+    }
+    if(X->ndims[mode] != V->len) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CUDA SpTns * Vec", "shape mismatch");
+    }
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "CUDA SpTns * Vec");
+    ind_buf = new sptIndex[X->nmodes];
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        ind_buf[m] = X->ndims[m];
+    }
+    ind_buf[mode] = 1;
+    result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
+    delete[] ind_buf;
+    spt_CheckError(result, "CUDA SpTns * Vec", NULL);
+    sptSemiSparseTensorSetIndices(Y, &fiberidx, X);
+
+    sptValue *Y_val = NULL;
+    result = cudaMalloc((void **) &Y_val, (Y->nnz * Y->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    cudaMemset(Y_val, 0, Y->nnz * Y->stride * sizeof (sptValue));
+    sptValue *X_val = NULL;
+    result = cudaMalloc((void **) &X_val, (X->nnz + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    cudaMemcpy(X_val, X->values.data, X->nnz * sizeof (sptValue), cudaMemcpyHostToDevice);
+    sptIndex *X_inds_m = NULL;
+    result = cudaMalloc((void **) &X_inds_m, (X->nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    cudaMemcpy(X_inds_m, X->inds[mode].data, X->nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    sptValue *V_val = NULL;
+    result = cudaMalloc((void **) &V_val, (V->len + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    cudaMemcpy(V_val, V->data, V->len * sizeof (sptValue), cudaMemcpyHostToDevice);
+    sptNnzIndex *fiberidx_val = NULL;
+    result = cudaMalloc((void **) &fiberidx_val, fiberidx.len * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    cudaMemcpy(fiberidx_val, fiberidx.data, fiberidx.len * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+
+    sptNnzIndex const nthreads = 256;
+    sptNnzIndex const nblocks = (Y->nnz + nthreads - 1) / nthreads;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(nblocks > 0) {
+        spt_TTVKernel<<<nblocks, nthreads>>>(Y_val, Y->stride, Y->nnz, X_val, X_inds_m, fiberidx_val, V_val);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SpTns * Vec kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SpTns * Vec");
+    sptFreeTimer(timer);
+
+    cudaMemcpy(Y->values.values, Y_val, Y->nnz * Y->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    result = cudaFree(fiberidx_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    result = cudaFree(V_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    result = cudaFree(X_inds_m);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    result = cudaFree(X_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+    result = cudaFree(Y_val);
+    spt_CheckCudaError(result != 0, "CUDA SpTns * Vec");
+
+    sptFreeNnzIndexVector(&fiberidx);
+
+    return 0;
+}
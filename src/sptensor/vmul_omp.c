@@ -0,0 +1,71 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "sptensor.h"
+#include "../matrix/simd.h"
+
+/**
+ * OpenMP parallelized sparse tensor times a vector (SpTTV), one fiber per iteration
+ */
+int sptOmpSparseTensorMulVector(sptSemiSparseTensor *Y, sptSparseTensor *X, const sptValueVector *V, sptIndex const mode) {
+    int result;
+    sptIndex *ind_buf;
+    sptNnzIndexVector fiberidx;
+    if(mode >= X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Vec", "shape mismatch");
+    }
+    if(X->ndims[mode] != V->len) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "OMP  SpTns * Vec", "shape mismatch");
+    }
+    /* Sorted in place, or a kept copy sorted at mode */
+    X = spt_SparseTensorSortedAtMode(X, mode);
+    spt_CheckOSError(!X, "OMP  SpTns * Vec");
+    ind_buf = spt_ScratchAlloc(X->nmodes * sizeof *ind_buf);
+    spt_CheckOSError(!ind_buf, "OMP  SpTns * Vec");
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        ind_buf[m] = X->ndims[m];
+    }
+    ind_buf[mode] = 1;
+    result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
+    spt_ScratchFree(ind_buf);
+    spt_CheckError(result, "OMP  SpTns * Vec", NULL);
+    sptSemiSparseTensorSetIndices(Y, &fiberidx, X);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    sptIndex const * const mode_ind = X->inds[mode].data;
+    sptValue const * const vals = X->values.data;
+    spt_SimdKernels const * const simd = spt_Simd();
+    #pragma omp parallel for schedule(dynamic, 256)
+    for(sptNnzIndex i = 0; i < Y->nnz; ++i) {
+        sptNnzIndex const begin = fiberidx.data[i];
+        Y->values.values[i*Y->stride] = simd->gather_dot(vals + begin, V->data, mode_ind + begin,
+            (sptIndex) (fiberidx.data[i+1] - begin));
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "OMP  SpTns * Vec");
+    sptFreeTimer(timer);
+
+    sptFreeNnzIndexVector(&fiberidx);
+    return 0;
+}
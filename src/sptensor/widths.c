@@ -0,0 +1,252 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sptensor.h"
+
+/*
+ * Run-time index and value widths.
+ *
+ * sptSparseTensor is written against sptIndex and sptValue, so it holds one
+ * width combination per build. A sptWidthSparseTensor carries its widths in
+ * its metadata instead: 16-, 32- or 64-bit indices and float or double
+ * values. sptOmpWidthMTTKRP is generated for each of the six combinations by
+ * widths_impl.h and dispatches on the tensor, so one build handles both a
+ * tensor with a dimension beyond 2^32 and a float workload, and small modes
+ * can stream 16-bit indices.
+ */
+
+#define SPT_WIDTH(name) name##_i16_f32
+#define SPT_WIDTH_INDEX uint16_t
+#define SPT_WIDTH_VALUE float
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+#define SPT_WIDTH(name) name##_i32_f32
+#define SPT_WIDTH_INDEX uint32_t
+#define SPT_WIDTH_VALUE float
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+#define SPT_WIDTH(name) name##_i64_f32
+#define SPT_WIDTH_INDEX uint64_t
+#define SPT_WIDTH_VALUE float
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+#define SPT_WIDTH(name) name##_i16_f64
+#define SPT_WIDTH_INDEX uint16_t
+#define SPT_WIDTH_VALUE double
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+#define SPT_WIDTH(name) name##_i32_f64
+#define SPT_WIDTH_INDEX uint32_t
+#define SPT_WIDTH_VALUE double
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+#define SPT_WIDTH(name) name##_i64_f64
+#define SPT_WIDTH_INDEX uint64_t
+#define SPT_WIDTH_VALUE double
+#include "widths_impl.h"
+#undef SPT_WIDTH
+#undef SPT_WIDTH_INDEX
+#undef SPT_WIDTH_VALUE
+
+static inline uint64_t spt_WidthGetIndex(void const * const inds, uint32_t const width, uint64_t const z) {
+    if(width == 2) {
+        return ((uint16_t const *) inds)[z];
+    } else if(width == 4) {
+        return ((uint32_t const *) inds)[z];
+    }
+    return ((uint64_t const *) inds)[z];
+}
+
+static inline void spt_WidthSetIndex(void * const inds, uint32_t const width, uint64_t const z, uint64_t const idx) {
+    if(width == 2) {
+        ((uint16_t *) inds)[z] = (uint16_t) idx;
+    } else if(width == 4) {
+        ((uint32_t *) inds)[z] = (uint32_t) idx;
+    } else {
+        ((uint64_t *) inds)[z] = idx;
+    }
+}
+
+
+/**
+ * Load a sparse tensor from the binary container, keeping its values at the
+ * stored width and its indices at `index_width`, independent of this build's
+ * sptIndex and sptValue.
+ *
+ * @param tsr         an uninitialized width sparse tensor
+ * @param fp          the file to read from, opened in binary mode
+ * @param index_width bytes per index, 2, 4 or 8; 0 picks the smallest one all ndims fit in
+ */
+int sptLoadWidthSparseTensorBinary(sptWidthSparseTensor *tsr, FILE *fp, uint32_t index_width)
+{
+    size_t iores;
+    int result;
+    spt_SparseTensorBinaryHeader header;
+    iores = fread(&header, sizeof header, 1, fp);
+    spt_CheckOSError(iores != 1, "SpTns Width Load");
+    result = spt_SparseTensorBinaryCheckHeader(&header);
+    spt_CheckError(result, "SpTns Width Load", NULL);
+
+    uint32_t const nmodes = header.nmodes;
+    uint64_t const nnz = header.nnz;
+    uint64_t * ndims = malloc(nmodes * sizeof *ndims + 1);
+    spt_CheckOSError(!ndims, "SpTns Width Load");
+    iores = fread(ndims, sizeof *ndims, nmodes, fp);
+    spt_CheckOSError(iores != nmodes, "SpTns Width Load");
+    uint64_t max_dim = 0;
+    for(uint32_t m = 0; m < nmodes; ++m) {
+        max_dim = ndims[m] > max_dim ? ndims[m] : max_dim;
+    }
+    if(index_width == 0) {
+        index_width = max_dim <= UINT16_MAX + 1ULL ? 2 : (max_dim <= UINT32_MAX + 1ULL ? 4 : 8);
+    }
+    if(index_width != 2 && index_width != 4 && index_width != 8) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Width Load", "unsupported index width");
+    }
+    if(index_width < 8 && max_dim > (1ULL << (8 * index_width))) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Width Load", "a dimension does not fit the index width");
+    }
+    result = spt_BinarySkip(header.data_offset - sizeof header - nmodes * sizeof *ndims, fp);
+    spt_CheckError(result, "SpTns Width Load", NULL);
+
+    tsr->nmodes = nmodes;
+    tsr->index_width = index_width;
+    tsr->value_width = header.value_width;
+    tsr->ndims = ndims;
+    tsr->nnz = nnz;
+    tsr->inds = calloc(nmodes + 1, sizeof *tsr->inds);
+    spt_CheckOSError(!tsr->inds, "SpTns Width Load");
+
+    /* Stored indices are converted a chunk at a time when the widths differ */
+    enum { CHUNK = 4096 };
+    uint64_t buf[CHUNK];
+    for(uint32_t m = 0; m < nmodes; ++m) {
+        tsr->inds[m] = malloc(nnz * index_width + 1);
+        spt_CheckOSError(!tsr->inds[m], "SpTns Width Load");
+        if(header.index_width == index_width) {
+            iores = fread(tsr->inds[m], index_width, nnz, fp);
+            spt_CheckOSError(iores != nnz, "SpTns Width Load");
+        } else {
+            for(uint64_t z = 0; z < nnz; z += CHUNK) {
+                size_t const len = nnz - z < CHUNK ? nnz - z : CHUNK;
+                iores = fread(buf, header.index_width, len, fp);
+                spt_CheckOSError(iores != len, "SpTns Width Load");
+                for(size_t i = 0; i < len; ++i) {
+                    uint64_t const idx = spt_WidthGetIndex(buf, header.index_width, i);
+                    if(idx >= ndims[m]) {
+                        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Width Load", "index out of range");
+                    }
+                    spt_WidthSetIndex(tsr->inds[m], index_width, z + i, idx);
+                }
+            }
+        }
+        result = spt_BinarySkip(spt_BinaryAlignUp(nnz * header.index_width) - nnz * header.index_width, fp);
+        spt_CheckError(result, "SpTns Width Load", NULL);
+    }
+
+    tsr->values = malloc(nnz * header.value_width + 1);
+    spt_CheckOSError(!tsr->values, "SpTns Width Load");
+    iores = fread(tsr->values, header.value_width, nnz, fp);
+    spt_CheckOSError(iores != nnz, "SpTns Width Load");
+
+    return 0;
+}
+
+
+/**
+ * Release the memory of a width sparse tensor
+ * @param tsr the tensor to release
+ */
+void sptFreeWidthSparseTensor(sptWidthSparseTensor *tsr)
+{
+    for(uint32_t m = 0; m < tsr->nmodes; ++m) {
+        free(tsr->inds[m]);
+    }
+    free(tsr->inds);
+    free(tsr->ndims);
+    free(tsr->values);
+    tsr->nmodes = 0;
+    tsr->nnz = 0;
+}
+
+
+/**
+ * OpenMP MTTKRP of a width sparse tensor, dispatched on its index and value widths.
+ *
+ * The factors mats[m] are row-major ndims[m] x stride arrays of the tensor's
+ * value width, float or double; mats[nmodes] receives the ndims[mode] output
+ * rows. Only the first R columns are read and written.
+ *
+ * @param X     the width sparse tensor
+ * @param mats  nmodes factors followed by the output
+ * @param stride leading dimension of every matrix in mats
+ * @param R     the rank
+ * @param mode  the mode to compute
+ * @param tk    the number of threads
+ */
+int sptOmpWidthMTTKRP(sptWidthSparseTensor const * const X,
+    void * const mats[],
+    uint64_t const stride,
+    uint64_t const R,
+    uint32_t const mode,
+    const int tk)
+{
+    if(mode >= X->nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Width MTTKRP", "mode >= X->nmodes");
+    }
+    if(R > stride) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "CPU  SpTns Width MTTKRP", "R > stride");
+    }
+
+    switch(X->index_width * 16 + X->value_width) {
+    case 2 * 16 + 4:
+        return spt_OmpWidthMTTKRP_i16_f32(X, mats, stride, R, mode, tk);
+    case 4 * 16 + 4:
+        return spt_OmpWidthMTTKRP_i32_f32(X, mats, stride, R, mode, tk);
+    case 8 * 16 + 4:
+        return spt_OmpWidthMTTKRP_i64_f32(X, mats, stride, R, mode, tk);
+    case 2 * 16 + 8:
+        return spt_OmpWidthMTTKRP_i16_f64(X, mats, stride, R, mode, tk);
+    case 4 * 16 + 8:
+        return spt_OmpWidthMTTKRP_i32_f64(X, mats, stride, R, mode, tk);
+    case 8 * 16 + 8:
+        return spt_OmpWidthMTTKRP_i64_f64(X, mats, stride, R, mode, tk);
+    default:
+        spt_CheckError(SPTERR_VALUE_ERROR, "CPU  SpTns Width MTTKRP", "unsupported index or value width");
+    }
+    return 0;
+}
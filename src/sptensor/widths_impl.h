@@ -0,0 +1,72 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* One COO MTTKRP over a sptWidthSparseTensor, included by widths.c once per
+ * (index width, value width) with SPT_WIDTH(name), SPT_WIDTH_INDEX and
+ * SPT_WIDTH_VALUE defined. */
+
+static int SPT_WIDTH(spt_OmpWidthMTTKRP)(sptWidthSparseTensor const * const X,
+    void * const mats[],
+    uint64_t const stride,
+    uint64_t const R,
+    uint32_t const mode,
+    const int tk)
+{
+    uint32_t const nmodes = X->nmodes;
+    uint64_t const nnz = X->nnz;
+    SPT_WIDTH_INDEX const * const restrict mode_ind = X->inds[mode];
+    SPT_WIDTH_VALUE const * const restrict vals = X->values;
+    SPT_WIDTH_VALUE * const restrict mvals = mats[nmodes];
+    memset(mvals, 0, X->ndims[mode] * stride * sizeof *mvals);
+
+    SPT_WIDTH_VALUE * scratch = malloc((size_t) tk * R * sizeof *scratch + 1);
+    spt_CheckOSError(!scratch, "CPU  SpTns Width MTTKRP");
+    #pragma omp parallel num_threads(tk)
+    {
+        int tid = 0;
+#ifdef PARTI_USE_OPENMP
+        tid = omp_get_thread_num();
+#endif
+        SPT_WIDTH_VALUE * const restrict row = scratch + (size_t) tid * R;
+        #pragma omp for schedule(static)
+        for(uint64_t x=0; x<nnz; ++x) {
+            SPT_WIDTH_VALUE const entry = vals[x];
+            for(uint64_t r=0; r<R; ++r) {
+                row[r] = entry;
+            }
+            for(uint32_t m=0; m<nmodes; ++m) {
+                if(m == mode) {
+                    continue;
+                }
+                uint64_t const ti = ((SPT_WIDTH_INDEX const *) X->inds[m])[x];
+                SPT_WIDTH_VALUE const * const restrict vrow = (SPT_WIDTH_VALUE const *) mats[m] + ti * stride;
+                for(uint64_t r=0; r<R; ++r) {
+                    row[r] *= vrow[r];
+                }
+            }
+            SPT_WIDTH_VALUE * const restrict mvals_row = mvals + (uint64_t) mode_ind[x] * stride;
+            for(uint64_t r=0; r<R; ++r) {
+                #pragma omp atomic update
+                mvals_row[r] += row[r];
+            }
+        }
+    }
+    free(scratch);
+
+    return 0;
+}
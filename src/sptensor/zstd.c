@@ -0,0 +1,494 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "sptensor.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef PARTI_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef PARTI_USE_ZSTD
+
+/* Decompressed text parsed per step, and uncompressed bytes per written frame */
+#define SPT_ZSTD_CHUNK ((size_t) 16 << 20)
+#define SPT_ZSTD_FRAME ((size_t) 4 << 20)
+
+/*
+ * A zstd file behind a stdio stream. Writers cut their input into frames of
+ * SPT_ZSTD_FRAME bytes that record their content size, so that
+ * sptLoadSparseTensorZstd can decompress them in parallel; readers accept any
+ * zstd file.
+ */
+typedef struct {
+    FILE *fp;               /// the compressed file
+    int level;              /// compression level
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    char *buf;              /// pending input of the writer, compressed input of the reader
+    size_t len;             /// bytes pending in buf, writer only
+    char *out;              /// one compressed frame, writer only
+    size_t out_cap;
+    ZSTD_inBuffer in;       /// reader only
+    size_t pending;         /// nonzero while the reader is inside a frame
+} spt_ZstdCookie;
+
+static int spt_ZstdFlushFrame(spt_ZstdCookie *c) {
+    if(c->len == 0) {
+        return 0;
+    }
+    size_t const n = ZSTD_compressCCtx(c->cctx, c->out, c->out_cap, c->buf, c->len, c->level);
+    if(ZSTD_isError(n)) {
+        errno = EIO;
+        return -1;
+    }
+    if(fwrite(c->out, 1, n, c->fp) != n) {
+        return -1;
+    }
+    c->len = 0;
+    return 0;
+}
+
+static ssize_t spt_ZstdCookieWrite(void *cookie, const char *data, size_t size) {
+    spt_ZstdCookie * const c = cookie;
+    size_t done = 0;
+    while(done < size) {
+        size_t n = SPT_ZSTD_FRAME - c->len;
+        if(n > size - done) n = size - done;
+        memcpy(c->buf + c->len, data + done, n);
+        c->len += n;
+        done += n;
+        if(c->len == SPT_ZSTD_FRAME && spt_ZstdFlushFrame(c) != 0) {
+            return 0;
+        }
+    }
+    return (ssize_t) size;
+}
+
+static ssize_t spt_ZstdCookieRead(void *cookie, char *data, size_t size) {
+    spt_ZstdCookie * const c = cookie;
+    ZSTD_outBuffer out = { data, size, 0 };
+    while(out.pos == 0) {
+        if(c->in.pos == c->in.size) {
+            c->in.size = fread(c->buf, 1, ZSTD_DStreamInSize(), c->fp);
+            c->in.pos = 0;
+            if(c->in.size == 0) {
+                if(ferror(c->fp)) {
+                    return -1;
+                }
+                if(c->pending != 0) {
+                    errno = EIO;    /* truncated frame */
+                    return -1;
+                }
+                break;
+            }
+        }
+        size_t const ret = ZSTD_decompressStream(c->dctx, &out, &c->in);
+        if(ZSTD_isError(ret)) {
+            errno = EIO;
+            return -1;
+        }
+        c->pending = ret;
+    }
+    return (ssize_t) out.pos;
+}
+
+static int spt_ZstdCookieClose(void *cookie) {
+    spt_ZstdCookie * const c = cookie;
+    int result = 0;
+    if(c->cctx != NULL && spt_ZstdFlushFrame(c) != 0) {
+        result = EOF;
+    }
+    if(fclose(c->fp) != 0) {
+        result = EOF;
+    }
+    ZSTD_freeCCtx(c->cctx);
+    ZSTD_freeDCtx(c->dctx);
+    free(c->buf);
+    free(c->out);
+    free(c);
+    return result;
+}
+
+#endif
+
+/**
+ * Open a zstd-compressed file as a stdio stream.
+ *
+ * Everything written to the stream is compressed and everything read from it
+ * decompressed, so the text and binary loaders and dumpers work on `.zst`
+ * files unchanged, e.g. sptDumpSparseTensorBinary(X, sptOpenZstdStream(...)).
+ * Written files are made of independent frames and load in parallel with
+ * sptLoadSparseTensorZstd. Close the stream with fclose to flush the last
+ * frame. Without zstd support in the build, NULL is returned with errno set
+ * to ENOTSUP.
+ *
+ * @param filename the file to open
+ * @param mode     "r" or "w", a "b" is accepted and ignored
+ * @param level    the compression level when writing, 0 for the zstd default
+ * @return the stream, or NULL with errno set on failure
+ */
+FILE * sptOpenZstdStream(const char *filename, const char *mode, int level) {
+#ifdef PARTI_USE_ZSTD
+    int const writing = mode[0] == 'w';
+    if(!writing && mode[0] != 'r') {
+        errno = EINVAL;
+        return NULL;
+    }
+    spt_ZstdCookie * c = calloc(1, sizeof *c);
+    if(c == NULL) {
+        return NULL;
+    }
+    c->fp = fopen(filename, writing ? "wb" : "rb");
+    if(c->fp == NULL) {
+        free(c);
+        return NULL;
+    }
+    c->level = level;
+    if(writing) {
+        c->cctx = ZSTD_createCCtx();
+        c->buf = malloc(SPT_ZSTD_FRAME);
+        c->out_cap = ZSTD_compressBound(SPT_ZSTD_FRAME);
+        c->out = malloc(c->out_cap);
+    } else {
+        c->dctx = ZSTD_createDCtx();
+        c->buf = malloc(ZSTD_DStreamInSize());
+        c->in.src = c->buf;
+    }
+    cookie_io_functions_t const io = {
+        writing ? NULL : spt_ZstdCookieRead,
+        writing ? spt_ZstdCookieWrite : NULL,
+        NULL,
+        spt_ZstdCookieClose
+    };
+    FILE * fp = NULL;
+    if((writing ? c->cctx != NULL && c->out != NULL : c->dctx != NULL) && c->buf != NULL) {
+        fp = fopencookie(c, writing ? "w" : "r", io);
+    } else {
+        errno = ENOMEM;
+    }
+    if(fp == NULL) {
+        int const saved = errno;
+        c->cctx = NULL;     /* nothing to flush */
+        spt_ZstdCookieClose(c);
+        errno = saved;
+    }
+    return fp;
+#else
+    (void) filename;
+    (void) mode;
+    (void) level;
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
+#ifdef PARTI_USE_ZSTD
+
+/* The mapped compressed file, handing out decompressed text chunk by chunk */
+typedef struct {
+    const char *src;
+    size_t size;
+    size_t pos;             /// next compressed byte, streaming mode
+    ZSTD_DCtx *dctx;        /// streaming mode
+    size_t nframes;         /// nonzero if every frame records its size: frame mode
+    size_t *frame_begin;    /// nframes+1 compressed offsets
+    size_t *frame_bytes;    /// decompressed size of each frame
+    size_t next_frame;
+    int done;               /// all text has been handed out
+    int tk;
+} spt_ZstdSource;
+
+/* Decompressed text, starting with the tail line carried over from the last chunk */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} spt_ZstdText;
+
+typedef struct {
+    spt_ZstdSource *source;
+    spt_ZstdText *text;
+    int result;
+} spt_ZstdFillRequest;
+
+static int spt_ZstdTextReserve(spt_ZstdText *t, size_t const cap) {
+    if(cap > t->cap) {
+        char * data = realloc(t->data, cap);
+        spt_CheckOSError(data == NULL, "SpTns Load Zstd");
+        t->data = data;
+        t->cap = cap;
+    }
+    return 0;
+}
+
+/*
+ * Index the frames if all of them record their decompressed size; archives
+ * written by sptOpenZstdStream or `zstd -B`/pzstd do, a plain `zstd` stream
+ * from a pipe does not and is decompressed sequentially instead.
+ */
+static int spt_ZstdIndexFrames(spt_ZstdSource *s) {
+    size_t n = 0, cap = 16, pos = 0;
+    s->frame_begin = malloc((cap + 1) * sizeof *s->frame_begin);
+    s->frame_bytes = malloc(cap * sizeof *s->frame_bytes);
+    spt_CheckOSError(s->frame_begin == NULL || s->frame_bytes == NULL, "SpTns Load Zstd");
+    while(pos < s->size) {
+        size_t const csize = ZSTD_findFrameCompressedSize(s->src + pos, s->size - pos);
+        if(ZSTD_isError(csize)) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", ZSTD_getErrorName(csize));
+        }
+        unsigned long long const bytes = ZSTD_getFrameContentSize(s->src + pos, s->size - pos);
+        if(bytes == ZSTD_CONTENTSIZE_UNKNOWN || bytes == ZSTD_CONTENTSIZE_ERROR) {
+            return 0;
+        }
+        if(n == cap) {
+            cap *= 2;
+            size_t * begin = realloc(s->frame_begin, (cap + 1) * sizeof *begin);
+            spt_CheckOSError(begin == NULL, "SpTns Load Zstd");
+            s->frame_begin = begin;
+            size_t * fbytes = realloc(s->frame_bytes, cap * sizeof *fbytes);
+            spt_CheckOSError(fbytes == NULL, "SpTns Load Zstd");
+            s->frame_bytes = fbytes;
+        }
+        s->frame_begin[n] = pos;
+        s->frame_bytes[n] = (size_t) bytes;
+        ++n;
+        pos += csize;
+    }
+    s->frame_begin[n] = pos;
+    s->nframes = n;
+    return 0;
+}
+
+/*
+ * Append about SPT_ZSTD_CHUNK bytes of text. Frame mode decompresses whole
+ * frames, all of a chunk in parallel; streaming mode runs one decoder.
+ */
+static int spt_ZstdFill(spt_ZstdSource *s, spt_ZstdText *t) {
+    int result;
+    if(s->nframes != 0) {
+        size_t const first = s->next_frame;
+        size_t last = first, bytes = 0;
+        while(last < s->nframes && (last == first || bytes + s->frame_bytes[last] <= SPT_ZSTD_CHUNK)) {
+            bytes += s->frame_bytes[last];
+            ++last;
+        }
+        result = spt_ZstdTextReserve(t, t->len + bytes);
+        spt_CheckError(result, "SpTns Load Zstd", NULL);
+        size_t * out = malloc((last - first + 1) * sizeof *out);
+        spt_CheckOSError(out == NULL, "SpTns Load Zstd");
+        out[0] = t->len;
+        for(size_t f = first; f < last; ++f) {
+            out[f - first + 1] = out[f - first] + s->frame_bytes[f];
+        }
+        int failed = 0;
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(s->tk) reduction(|:failed)
+        for(size_t f = first; f < last; ++f) {
+            size_t const got = ZSTD_decompress(t->data + out[f - first], s->frame_bytes[f],
+                s->src + s->frame_begin[f], s->frame_begin[f + 1] - s->frame_begin[f]);
+            if(ZSTD_isError(got) || got != s->frame_bytes[f]) {
+                failed = 1;
+            }
+        }
+        free(out);
+        if(failed) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", "corrupt frame");
+        }
+        t->len += bytes;
+        s->next_frame = last;
+        s->done = last == s->nframes;
+        return 0;
+    }
+
+    result = spt_ZstdTextReserve(t, t->len + SPT_ZSTD_CHUNK);
+    spt_CheckError(result, "SpTns Load Zstd", NULL);
+    ZSTD_inBuffer in = { s->src, s->size, s->pos };
+    ZSTD_outBuffer out = { t->data, t->len + SPT_ZSTD_CHUNK, t->len };
+    for(;;) {
+        size_t const ret = ZSTD_decompressStream(s->dctx, &out, &in);
+        if(ZSTD_isError(ret)) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", ZSTD_getErrorName(ret));
+        }
+        if(out.pos == out.size) {
+            break;
+        }
+        /* Output to spare with the input used up: the decoder is drained */
+        if(in.pos == in.size) {
+            if(ret != 0) {
+                spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", "truncated frame");
+            }
+            s->done = 1;
+            break;
+        }
+    }
+    s->pos = in.pos;
+    t->len = out.pos;
+    return 0;
+}
+
+static void * spt_ZstdFillThread(void *arg) {
+    spt_ZstdFillRequest * const req = arg;
+    req->result = spt_ZstdFill(req->source, req->text);
+    return NULL;
+}
+
+/* Parse a chunk of whole lines, reading the header from the first one */
+static int spt_ZstdParse(sptSparseTensor *tsr, int *have_header, sptIndex start_index, const char *p, const char *end, int tk) {
+    int result;
+    if(!*have_header) {
+        if(p == end) {
+            return 0;
+        }
+        result = spt_ParseSparseTensorHeader(tsr, &p, end);
+        spt_CheckError(result, "SpTns Load Zstd", NULL);
+        *have_header = 1;
+    }
+    result = spt_ParseSparseTensorLines(tsr, start_index, p, end, tk);
+    spt_CheckError(result, "SpTns Load Zstd", NULL);
+    return 0;
+}
+
+static int spt_ZstdLoad(sptSparseTensor *tsr, int *have_header, sptIndex start_index, spt_ZstdSource *s, int const tk) {
+    int result;
+    spt_ZstdText text[2] = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+    spt_ZstdFillRequest req;
+    pthread_t filler;
+
+    if(s->nframes == 0) {
+        s->dctx = ZSTD_createDCtx();
+        spt_CheckOSError(s->dctx == NULL, "SpTns Load Zstd");
+    }
+    result = spt_ZstdFill(s, &text[0]);
+    for(int i = 0; result == 0; i ^= 1) {
+        spt_ZstdText * const cur = &text[i];
+        spt_ZstdText * const next = &text[i ^ 1];
+        int const last = s->done;
+        size_t cut = cur->len;
+        if(!last) {
+            while(cut > 0 && cur->data[cut - 1] != '\n') --cut;
+        }
+
+        /* The tail line opens the next chunk. A sequential decoder fills it
+           while this chunk is parsed; frame mode runs after the parse, as it
+           uses all the threads itself. */
+        int overlap = 0;
+        if(!last) {
+            next->len = 0;
+            result = spt_ZstdTextReserve(next, cur->len - cut);
+            if(result != 0) break;
+            memcpy(next->data, cur->data + cut, cur->len - cut);
+            next->len = cur->len - cut;
+            req.source = s;
+            req.text = next;
+            req.result = 0;
+            overlap = s->nframes == 0 && pthread_create(&filler, NULL, spt_ZstdFillThread, &req) == 0;
+        }
+        result = spt_ZstdParse(tsr, have_header, start_index, cur->data, cur->data + cut, tk);
+        if(overlap) {
+            pthread_join(filler, NULL);
+        } else if(!last && result == 0) {
+            req.result = spt_ZstdFill(s, next);
+        }
+        if(result == 0 && !last) {
+            result = req.result;
+        }
+        if(last) break;
+    }
+    free(text[0].data);
+    free(text[1].data);
+    spt_CheckError(result, "SpTns Load Zstd", NULL);
+    if(!*have_header) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", "empty tensor file");
+    }
+    return 0;
+}
+
+#endif
+
+/**
+ * Load a sparse tensor from a zstd-compressed text file in parallel.
+ *
+ * Reads the format of sptLoadSparseTensor compressed with zstd, such as a
+ * `.tns.zst` archive, without a decompressed copy on disk: the text is
+ * decompressed in chunks that go straight to the parallel parser of
+ * sptOmpLoadSparseTensor. When every frame of the file records its size, as
+ * in files written through sptOpenZstdStream or by `zstd -B` and pzstd, the
+ * frames of a chunk are decompressed in parallel; otherwise one decoder runs
+ * ahead of the parser on a helper thread. Fails with ENOTSUP without zstd
+ * support in the build.
+ *
+ * @param tsr         the sparse tensor to store into
+ * @param start_index the index of the first element in array. Set to 1 for MATLAB compability, else set to 0
+ * @param filename    the file to read from
+ * @param tk          the number of threads
+ */
+int sptLoadSparseTensorZstd(sptSparseTensor *tsr, sptIndex start_index, const char *filename, int const tk) {
+#ifdef PARTI_USE_ZSTD
+    int result;
+    int fd = open(filename, O_RDONLY);
+    spt_CheckOSError(fd < 0, "SpTns Load Zstd");
+    struct stat st;
+    result = fstat(fd, &st);
+    if(result != 0 || st.st_size == 0) {
+        close(fd);
+        spt_CheckOSError(result != 0, "SpTns Load Zstd");
+        spt_CheckError(SPTERR_VALUE_ERROR, "SpTns Load Zstd", "empty file");
+    }
+    spt_ZstdSource s;
+    memset(&s, 0, sizeof s);
+    s.size = (size_t) st.st_size;
+    s.src = mmap(NULL, s.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    spt_CheckOSError(s.src == MAP_FAILED, "SpTns Load Zstd");
+    madvise((void *) s.src, s.size, MADV_SEQUENTIAL);
+    s.tk = tk > 0 ? tk : 1;
+
+    int have_header = 0;
+    result = spt_ZstdIndexFrames(&s);
+    if(result == 0) {
+        result = spt_ZstdLoad(tsr, &have_header, start_index, &s, tk);
+    }
+    ZSTD_freeDCtx(s.dctx);
+    free(s.frame_begin);
+    free(s.frame_bytes);
+    munmap((void *) s.src, s.size);
+    if(result != 0) {
+        if(have_header) {
+            sptFreeSparseTensor(tsr);
+        }
+        spt_CheckError(result, "SpTns Load Zstd", NULL);
+    }
+    return spt_SparseTensorFinishLoad(tsr);
+#else
+    (void) tsr;
+    (void) start_index;
+    (void) filename;
+    (void) tk;
+    errno = ENOTSUP;
+    spt_CheckOSError(1, "SpTns Load Zstd");
+    return 0;
+#endif
+}
@@ -0,0 +1,150 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cublas_v2.h>
+#include "../cudawrap.h"
+
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_cublasGemm cublasSgemm
+#else
+  #define spt_cublasGemm cublasDgemm
+#endif
+
+/* Rows of X per GEMM call, so every dimension fits in an int */
+#define SPT_SSPTTM_GEMM_ROWS ((sptNnzIndex) 1 << 30)
+
+/**
+ * Copy a semi-sparse tensor to the current CUDA device
+ * @param[out] dX an uninitialized device semi-sparse tensor
+ * @param[in]  X  the host semi-sparse tensor
+ */
+int sptDeviceUploadSemiSparseTensor(sptDeviceSemiSparseTensor *dX, const sptSemiSparseTensor *X) {
+    sptNnzIndex const nnz = X->nnz;
+    dX->nmodes = X->nmodes;
+    dX->mode = X->mode;
+    dX->nnz = nnz;
+    dX->stride = X->stride;
+    dX->ndims = (sptIndex *) malloc(X->nmodes * sizeof *dX->ndims);
+    spt_CheckOSError(!dX->ndims, "DevSspTns Upload");
+    memcpy(dX->ndims, X->ndims, X->nmodes * sizeof *dX->ndims);
+    int result = cudaMalloc((void **) &dX->inds, (X->nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "DevSspTns Upload");
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(m != X->mode) {
+            result = cudaMemcpy(dX->inds + m * nnz, X->inds[m].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+            spt_CheckCudaError(result != 0, "DevSspTns Upload");
+        }
+    }
+    result = cudaMalloc((void **) &dX->values, (nnz * X->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSspTns Upload");
+    result = cudaMemcpy(dX->values, X->values.values, nnz * X->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+    spt_CheckCudaError(result != 0, "DevSspTns Upload");
+    return 0;
+}
+
+/**
+ * Copy a device semi-sparse tensor back to the host
+ * @param[out] X  an uninitialized host semi-sparse tensor
+ * @param[in]  dX the device semi-sparse tensor
+ */
+int sptDeviceDownloadSemiSparseTensor(sptSemiSparseTensor *X, const sptDeviceSemiSparseTensor *dX) {
+    sptNnzIndex const nnz = dX->nnz;
+    int result = sptNewSemiSparseTensor(X, dX->nmodes, dX->mode, dX->ndims);
+    spt_CheckError(result, "DevSspTns Download", NULL);
+    for(sptIndex m = 0; m < dX->nmodes; ++m) {
+        if(m != dX->mode) {
+            result = sptResizeIndexVector(&X->inds[m], nnz);
+            spt_CheckError(result, "DevSspTns Download", NULL);
+            result = cudaMemcpy(X->inds[m].data, dX->inds + m * nnz, nnz * sizeof (sptIndex), cudaMemcpyDeviceToHost);
+            spt_CheckCudaError(result != 0, "DevSspTns Download");
+        }
+    }
+    result = sptResizeMatrix(&X->values, nnz);
+    spt_CheckError(result, "DevSspTns Download", NULL);
+    result = cudaMemcpy(X->values.values, dX->values, nnz * dX->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    spt_CheckCudaError(result != 0, "DevSspTns Download");
+    X->nnz = nnz;
+    return 0;
+}
+
+/**
+ * Release a device semi-sparse tensor
+ * @param dX a valid device semi-sparse tensor
+ */
+void sptFreeDeviceSemiSparseTensor(sptDeviceSemiSparseTensor *dX) {
+    cudaFree(dX->inds);
+    cudaFree(dX->values);
+    free(dX->ndims);
+    dX->inds = NULL;
+    dX->values = NULL;
+    dX->ndims = NULL;
+    dX->nmodes = 0;
+    dX->nnz = 0;
+}
+
+/**
+ * Device version of sptCudaSemiSparseTensorMulMatrix, for the dense mode
+ * of X only: the fibers are one GEMM with the device matrix, and the
+ * sparse indices are copied on the device.
+ * @param[out] dY   an uninitialized device semi-sparse tensor
+ * @param[in]  dX   the device semi-sparse tensor
+ * @param[in]  dU   the device matrix, with ndims[mode] rows
+ * @param[in]  mode the dense mode of X
+ */
+int sptDeviceSemiSparseTensorMulMatrix(sptDeviceSemiSparseTensor *dY, const sptDeviceSemiSparseTensor *dX, const sptDeviceMatrix *dU, sptIndex const mode) {
+    if(mode != dX->mode || dX->ndims[mode] != dU->nrows) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "DevSspTns * Mtx", "shape mismatch or mode is not the dense mode");
+    }
+    sptIndex const nmodes = dX->nmodes;
+    sptNnzIndex const nnz = dX->nnz;
+    dY->nmodes = nmodes;
+    dY->mode = mode;
+    dY->nnz = nnz;
+    dY->stride = dU->stride;
+    dY->ndims = (sptIndex *) malloc(nmodes * sizeof *dY->ndims);
+    spt_CheckOSError(!dY->ndims, "DevSspTns * Mtx");
+    memcpy(dY->ndims, dX->ndims, nmodes * sizeof *dY->ndims);
+    dY->ndims[mode] = dU->ncols;
+    int result = cudaMalloc((void **) &dY->inds, (nmodes * nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "DevSspTns * Mtx");
+    result = cudaMemcpy(dY->inds, dX->inds, nmodes * nnz * sizeof (sptIndex), cudaMemcpyDeviceToDevice);
+    spt_CheckCudaError(result != 0, "DevSspTns * Mtx");
+    result = cudaMalloc((void **) &dY->values, (nnz * dY->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSspTns * Mtx");
+    result = cudaMemset(dY->values, 0, nnz * dY->stride * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "DevSspTns * Mtx");
+
+    /* Y^T = U^T * X^T in column-major terms, as in sptCudaSemiSparseTensorMulMatrix */
+    cublasHandle_t blas;
+    result = spt_cublasHandle(&blas);
+    spt_CheckCudaError(result != CUBLAS_STATUS_SUCCESS, "DevSspTns * Mtx");
+    sptValue const alpha = 1, beta = 0;
+    for(sptNnzIndex i = 0; i < nnz; i += SPT_SSPTTM_GEMM_ROWS) {
+        sptNnzIndex const rows = nnz - i < SPT_SSPTTM_GEMM_ROWS ? nnz - i : SPT_SSPTTM_GEMM_ROWS;
+        result = spt_cublasGemm(blas, CUBLAS_OP_N, CUBLAS_OP_N, (int) dU->ncols, (int) rows, (int) dU->nrows,
+            &alpha, dU->values, (int) dU->stride, dX->values + i * dX->stride, (int) dX->stride,
+            &beta, dY->values + i * dY->stride, (int) dY->stride);
+        spt_CheckCudaError(result != CUBLAS_STATUS_SUCCESS, "DevSspTns * Mtx GEMM");
+    }
+    result = cudaStreamSynchronize((cudaStream_t) spt_ExecCudaStream());
+    spt_CheckCudaError(result != 0, "DevSspTns * Mtx GEMM");
+    return 0;
+}
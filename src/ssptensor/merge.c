@@ -18,84 +18,94 @@
 
 #include <ParTI.h>
 #include "ssptensor.h"
-#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
-static void spt_SwapValues(sptSemiSparseTensor *tsr, sptNnzIndex ind1, sptNnzIndex ind2, sptValue buffer[]);
+/* Whether fiber i of a sorted semi sparse tensor starts a run of equal indices */
+static inline int spt_IsRunHead(const sptSemiSparseTensor *tsr, sptNnzIndex i) {
+    return i == 0 || spt_SemiSparseTensorCompareIndices(tsr, i - 1, tsr, i) != 0;
+}
 
 /**
  * Merge fibers with identical indices of an invalid semi sparse tensor, making it valid
+ *
+ * The fibers must be sorted, so duplicates form runs. The run heads are
+ * found by a parallel count and compaction, each run is then summed into its
+ * output fiber, and the indices are gathered from the heads; the result stays
+ * sorted.
  * @param tsr the semi sparse tensor to operate on
  */
 int spt_SemiSparseTensorMergeValues(sptSemiSparseTensor *tsr) {
-    int result;
-    sptNnzIndex i;
-    sptNnzIndexVector collided;
-    sptValue *buffer;
-
-    if(tsr->nnz == 0) {
+    int const tk = spt_SemiSparseTensorThreads();
+    sptNnzIndex const nnz = tsr->nnz;
+    sptIndex const stride = tsr->stride;
+    if(nnz == 0) {
         return 0;
     }
 
-    buffer = malloc(tsr->stride * sizeof (sptValue));
-    spt_CheckOSError(!buffer, "SspTns Merge");
-
-    result = sptNewNnzIndexVector(&collided, 0, 0);
-    if(result) {
-        free(buffer);
-        spt_CheckError(result, "SspTns Merge", NULL);
+    /* Run heads, plus a trailing nnz */
+    sptNnzIndex * offsets = calloc(tk + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SspTns Merge");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex count = 0;
+        for(sptNnzIndex i = nnz * p / tk; i < nnz * (p + 1) / tk; ++i) {
+            count += spt_IsRunHead(tsr, i);
+        }
+        offsets[p + 1] = count;
     }
-
-    for(i = 0; i < tsr->nnz-1; ++i) {
-        // If two nnz has the same indices
-        if(spt_SemiSparseTensorCompareIndices(tsr, i, tsr, i+1) == 0) {
-            sptIndex col;
-            for(col = 0; col < tsr->stride; ++col) {
-                // Add them together
-                tsr->values.values[(i+1)*tsr->stride + col] += tsr->values.values[i*tsr->stride + col];
+    for(int p = 0; p < tk; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    sptNnzIndex const nruns = offsets[tk];
+    if(nruns == nnz) {
+        free(offsets);
+        return 0;
+    }
+    sptNnzIndex * heads = malloc((nruns + 1) * sizeof *heads);
+    spt_CheckOSError(!heads, "SspTns Merge");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(int p = 0; p < tk; ++p) {
+        sptNnzIndex out = offsets[p];
+        for(sptNnzIndex i = nnz * p / tk; i < nnz * (p + 1) / tk; ++i) {
+            if(spt_IsRunHead(tsr, i)) {
+                heads[out++] = i;
             }
-            sptAppendNnzIndexVector(&collided, i);
         }
     }
+    heads[nruns] = nnz;
+    free(offsets);
 
-    // Swap the last invalidated item with the last item
-    i = collided.len;
-    while(i) {
-        --i;
-        assert(tsr->nnz != 0);
-        spt_SwapValues(tsr, collided.data[i], tsr->nnz-1, buffer);
-        --tsr->nnz;
+    /* Sum each run into its own fiber of a new buffer */
+    sptValue * values = sptMallocBacked(tsr->values.cap * stride * sizeof (sptValue), spt_MemRequestOf(tsr->values.values));
+    spt_CheckOSError(!values, "SspTns Merge");
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(tk)
+    for(sptNnzIndex r = 0; r < nruns; ++r) {
+        sptValue * const out = &values[r * stride];
+        memcpy(out, &tsr->values.values[heads[r] * stride], stride * sizeof (sptValue));
+        for(sptNnzIndex i = heads[r] + 1; i < heads[r + 1]; ++i) {
+            sptValue const * const in = &tsr->values.values[i * stride];
+            for(sptIndex col = 0; col < stride; ++col) {
+                out[col] += in[col];
+            }
+        }
     }
+    sptFree(tsr->values.values);
+    tsr->values.values = values;
 
-    // Make sure all Vectors and Matrices have correct sizes
-    for(i = 0; i < tsr->nmodes; ++i) {
-        if(i != tsr->mode) {
-            tsr->inds[i].len = tsr->nnz;
+    /* Gathering from the heads only reads positions at or after the one written */
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(m != tsr->mode) {
+            sptIndex * const inds = tsr->inds[m].data;
+            for(sptNnzIndex r = 0; r < nruns; ++r) {
+                inds[r] = inds[heads[r]];
+            }
+            tsr->inds[m].len = nruns;
         }
     }
-    tsr->values.nrows = tsr->nnz;
+    tsr->nnz = nruns;
+    tsr->values.nrows = nruns;
 
-    sptFreeNnzIndexVector(&collided);
-    free(buffer);
-
-    result = sptSemiSparseTensorSortIndex(tsr);
-    spt_CheckError(result, "SspTns Merge", NULL);
+    free(heads);
     return 0;
 }
-
-static void spt_SwapValues(sptSemiSparseTensor *tsr, sptNnzIndex ind1, sptNnzIndex ind2, sptValue buffer[]) {
-    sptIndex i;
-    for(i = 0; i < tsr->nmodes; ++i) {
-        if(i != tsr->mode) {
-            sptIndex eleind1 = tsr->inds[i].data[ind1];
-            sptIndex eleind2 = tsr->inds[i].data[ind2];
-            tsr->inds[i].data[ind1] = eleind2;
-            tsr->inds[i].data[ind2] = eleind1;
-        }
-    }
-    if(ind1 != ind2) {
-        memcpy(buffer, &tsr->values.values[ind1*tsr->stride], tsr->stride * sizeof (sptValue));
-        memmove(&tsr->values.values[ind1*tsr->stride], &tsr->values.values[ind2*tsr->stride], tsr->stride * sizeof (sptValue));
-        memcpy(&tsr->values.values[ind2*tsr->stride], buffer, tsr->stride * sizeof (sptValue));
-    }
-}
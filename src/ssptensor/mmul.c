@@ -19,6 +19,10 @@
 #include <ParTI.h>
 #include "ssptensor.h"
 #include <stdlib.h>
+#include "../matrix/lapack.h"
+
+/* Rows of X per GEMM call, so every dimension fits the BLAS integer */
+#define SPT_SSPTTM_GEMM_ROWS ((sptNnzIndex) 1 << 30)
 
 /**
  * Semi sparse tensor times a dense matrix (SspTTM)
@@ -43,8 +47,7 @@ int sptSemiSparseTensorMulMatrix(
     if(X->ndims[mode] != U->nrows) {
         return -1;
     }
-    // jli: try to avoid malloc in all operation functions.
-    ind_buf = malloc(X->nmodes * sizeof *ind_buf);
+    ind_buf = spt_ScratchAlloc(X->nmodes * sizeof *ind_buf);
     if(!ind_buf) {
         return -1;
     }
@@ -54,7 +57,7 @@ int sptSemiSparseTensorMulMatrix(
     ind_buf[mode] = U->ncols;
     // jli: use pre-processing to allocate Y size outside this function.
     result = sptNewSemiSparseTensor(Y, X->nmodes, mode, ind_buf);
-    free(ind_buf);
+    spt_ScratchFree(ind_buf);
     if(result) {
         return result;
     }
@@ -73,13 +76,35 @@ int sptSemiSparseTensorMulMatrix(
     }
     Y->nnz = X->nnz;
     memset(Y->values.values, 0, Y->nnz * Y->stride * sizeof (sptValue));
+
+    /* The fibers of X form a row-major nnz x U->nrows matrix, so Y = X * U is one GEMM */
+#ifdef PARTI_USE_BLAS
+    for(i = 0; i < X->nnz; i += SPT_SSPTTM_GEMM_ROWS) {
+        sptNnzIndex const rows = X->nnz - i < SPT_SSPTTM_GEMM_ROWS ? X->nnz - i : SPT_SSPTTM_GEMM_ROWS;
+        /* Row-major operands are column-major transposes: Y^T = U^T * X^T */
+        char notrans = 'N';
+        integer m_ = (integer) U->ncols, n_ = (integer) rows, k_ = (integer) U->nrows;
+        integer ldu = (integer) U->stride, ldx = (integer) X->stride, ldy = (integer) Y->stride;
+        sptValue alpha = 1, beta = 0;
+        spt_gemm_(&notrans, &notrans, &m_, &n_, &k_, &alpha, U->values, &ldu,
+            X->values.values + i * X->stride, &ldx, &beta, Y->values.values + i * Y->stride, &ldy);
+    }
+#else
+    /* Each fiber accumulates rows of U, which stay in cache across the fibers of a thread */
+#ifdef PARTI_USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
     for(i = 0; i < X->nnz; ++i) {
-        sptIndex r, k;
-        for(k = 0; k < U->ncols; ++k) {
-            for(r = 0; r < U->nrows; ++r) {
-                Y->values.values[i*Y->stride + k] += X->values.values[i*X->stride + r] * U->values[r*U->stride + k];
+        sptValue * const y = Y->values.values + i * Y->stride;
+        sptValue const * const x = X->values.values + i * X->stride;
+        for(sptIndex r = 0; r < U->nrows; ++r) {
+            sptValue const xr = x[r];
+            sptValue const * const u = U->values + r * U->stride;
+            for(sptIndex k = 0; k < U->ncols; ++k) {
+                y[k] += xr * u[k];
             }
         }
     }
+#endif
     return 0;
 }
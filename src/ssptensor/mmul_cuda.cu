@@ -17,31 +17,17 @@
 */
 
 #include <ParTI.h>
+#include <cublas_v2.h>
+#include "../cudawrap.h"
 
-__global__ static void spt_TTMKernel(
-    sptValue *Y_val,
-    const sptValue *X_val,
-    sptIndex XY_stride,
-    sptNnzIndex XY_nnz,
-    const sptValue *U_val,
-    sptIndex U_nrows, sptIndex U_ncols, sptIndex U_stride,
-    sptIndex mode
-) {
-    size_t tid = blockIdx.x * blockDim.x + threadIdx.x;
-    if(tid < XY_nnz) {
-        size_t r, k;
-        for(k = 0; k < U_ncols; ++k) {
-            Y_val[tid*XY_stride + k] = 0;
-            for(r = 0; r < U_nrows; ++r) {
-                Y_val[tid*XY_stride + k] += X_val[tid*XY_stride + r] * U_val[r*U_stride + k];
-            }
-        }
-    }
-}
+#if PARTI_VALUE_TYPEWIDTH == 32
+  #define spt_cublasGemm cublasSgemm
+#else
+  #define spt_cublasGemm cublasDgemm
+#endif
 
-static sptNnzIndex spt_GetBlockCount(sptNnzIndex threads) {
-    return (threads / 256) + ((threads & 255) != 0);
-}
+/* Rows of X per GEMM call, so every dimension fits in an int */
+#define SPT_SSPTTM_GEMM_ROWS ((sptNnzIndex) 1 << 30)
 
 int sptCudaSemiSparseTensorMulMatrix(
     sptSemiSparseTensor *Y,
@@ -86,15 +72,14 @@ int sptCudaSemiSparseTensorMulMatrix(
     }
     Y->nnz = X->nnz;
 
-    sptNnzIndex blocks_count = spt_GetBlockCount(Y->nnz);
-    sptNnzIndex threads_count = blocks_count * 256;
     sptValue *Y_val = NULL;
-    result = cudaMalloc((void **) &Y_val, threads_count * Y->stride * sizeof (sptValue));
+    result = cudaMalloc((void **) &Y_val, Y->nnz * Y->stride * sizeof (sptValue));
     if(result != 0) {
         return result; // TODO: map error code?
     }
+    cudaMemset(Y_val, 0, Y->nnz * Y->stride * sizeof (sptValue));
     sptValue *X_val = NULL;
-    result = cudaMalloc((void **) &X_val, threads_count * X->stride * sizeof (sptValue));
+    result = cudaMalloc((void **) &X_val, X->nnz * X->stride * sizeof (sptValue));
     if(result != 0) {
         return result; // TODO: map error code?
     }
@@ -106,11 +91,24 @@ int sptCudaSemiSparseTensorMulMatrix(
     }
     cudaMemcpy(U_val, U->values, U->nrows * U->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
 
-    spt_TTMKernel<<<blocks_count, 256>>>(Y_val, X_val, Y->stride, Y->nnz, U_val, U->nrows, U->ncols, U->stride, mode);
-    result = cudaGetLastError();
-    if(result != 0) {
+    /* The fibers of X form a row-major nnz x U->nrows matrix, so Y = X * U is one GEMM;
+       row-major operands are column-major transposes: Y^T = U^T * X^T */
+    cublasHandle_t blas;
+    result = spt_cublasHandle(&blas);
+    if(result != CUBLAS_STATUS_SUCCESS) {
         return result;
     }
+    sptValue const alpha = 1, beta = 0;
+    for(sptNnzIndex i = 0; i < Y->nnz; i += SPT_SSPTTM_GEMM_ROWS) {
+        sptNnzIndex const rows = Y->nnz - i < SPT_SSPTTM_GEMM_ROWS ? Y->nnz - i : SPT_SSPTTM_GEMM_ROWS;
+        result = spt_cublasGemm(blas, CUBLAS_OP_N, CUBLAS_OP_N, (int) U->ncols, (int) rows, (int) U->nrows,
+            &alpha, U_val, (int) U->stride, X_val + i * X->stride, (int) X->stride,
+            &beta, Y_val + i * Y->stride, (int) Y->stride);
+        if(result != CUBLAS_STATUS_SUCCESS) {
+            return result;
+        }
+    }
+    cudaStreamSynchronize((cudaStream_t) spt_ExecCudaStream());
 
     cudaMemcpy(Y->values.values, Y_val, Y->nnz * Y->stride * sizeof (sptValue), cudaMemcpyDeviceToHost);
     cudaFree(U_val); cudaFree(X_val); cudaFree(Y_val);
@@ -0,0 +1,202 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include "ssptensor.h"
+#include "../sptensor/sptensor.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Whether sorted blocks perm[k-1] and perm[k] of X differ in any kept sparse mode, the one at slot skip excluded */
+static inline int spt_IsNewGroup(const sptSemiSparseTensorGeneral *X, sptNnzIndex const * perm, sptNnzIndex const k,
+    sptIndex const nsmodes, sptIndex const skip)
+{
+    if(k == 0) {
+        return 1;
+    }
+    for(sptIndex s = 0; s < nsmodes; ++s) {
+        if(s != skip && X->inds[s].data[perm[k]] != X->inds[s].data[perm[k-1]]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Group the blocks of X by their sparse indices other than mode, and set up
+ * Y = X x_mode U^T with mode made the last dense one: perm orders the blocks
+ * of X so that each group is a run, group_start[g] is where group g starts in
+ * perm, with a trailing nnz, and Y gets one zero block per group. Shared with
+ * the CUDA version.
+ */
+int spt_SemiSparseTensorGeneralMulMatrixSetup(
+    sptSemiSparseTensorGeneral *Y,
+    sptNnzIndex ** perm,
+    sptNnzIndexVector * group_start,
+    sptIndex * slot,
+    const sptSemiSparseTensorGeneral *X,
+    const sptMatrix *U,
+    sptIndex const mode,
+    char const * module)
+{
+    (void) module;
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const nsmodes = nmodes - X->ndmodes;
+    sptNnzIndex const nnz = X->nnz;
+    int result;
+    if(mode >= nmodes || spt_SemiSparseTensorGeneralDenseSlot(X->dmodes, X->ndmodes, mode) != X->ndmodes || U->nrows != X->ndims[mode]) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, module, "mode is not sparse, or shape mismatch");
+    }
+    sptIndex * smodes = malloc((nsmodes + 2 * nmodes + 1) * sizeof *smodes);
+    spt_CheckOSError(!smodes, module);
+    sptIndex * const ndims = smodes + nsmodes;
+    sptIndex * const dmodes = ndims + nmodes;
+    spt_SemiSparseTensorGeneralSparseModes(smodes, X);
+    *slot = 0;
+    while(smodes[*slot] != mode) {
+        ++*slot;
+    }
+
+    /* The radix engine reads only the sizes and the index arrays, so the sparse indices pose as a sparse tensor */
+    sptIndexVector * inds = calloc(nmodes, sizeof *inds);
+    spt_CheckOSError(!inds, module);
+    sptIndex nkeys = 0;
+    for(sptIndex s = 0; s < nsmodes; ++s) {
+        inds[smodes[s]] = X->inds[s];
+        if(s != *slot) {
+            smodes[nkeys++] = smodes[s];
+        }
+    }
+    sptSparseTensor view;
+    memset(&view, 0, sizeof view);
+    view.nmodes = nmodes;
+    view.ndims = X->ndims;
+    view.nnz = nnz;
+    view.inds = inds;
+    *perm = malloc((nnz > 0 ? nnz : 1) * sizeof **perm);
+    spt_CheckOSError(!*perm, module);
+    result = spt_SparseTensorRadixPermutation(&view, 0, nnz, nkeys, smodes, 0, *perm, spt_SemiSparseTensorThreads());
+    spt_CheckError(result, module, NULL);
+    free(inds);
+
+    result = sptNewNnzIndexVector(group_start, 0, 0);
+    spt_CheckError(result, module, NULL);
+    for(sptNnzIndex k = 0; k < nnz; ++k) {
+        if(spt_IsNewGroup(X, *perm, k, nsmodes, *slot)) {
+            result = sptAppendNnzIndexVector(group_start, k);
+            spt_CheckError(result, module, NULL);
+        }
+    }
+    result = sptAppendNnzIndexVector(group_start, nnz);
+    spt_CheckError(result, module, NULL);
+    sptNnzIndex const ngroups = group_start->len - 1;
+
+    memcpy(ndims, X->ndims, nmodes * sizeof *ndims);
+    ndims[mode] = U->ncols;
+    memcpy(dmodes, X->dmodes, X->ndmodes * sizeof *dmodes);
+    dmodes[X->ndmodes] = mode;
+    result = sptNewSemiSparseTensorGeneral(Y, nmodes, ndims, X->ndmodes + 1, dmodes);
+    spt_CheckError(result, module, NULL);
+    for(sptIndex s = 0, t = 0; s < nsmodes; ++s) {
+        if(s == *slot) {
+            continue;
+        }
+        result = sptResizeIndexVector(&Y->inds[t], ngroups);
+        spt_CheckError(result, module, NULL);
+        for(sptNnzIndex g = 0; g < ngroups; ++g) {
+            Y->inds[t].data[g] = X->inds[s].data[(*perm)[group_start->data[g]]];
+        }
+        ++t;
+    }
+    result = sptResizeMatrix(&Y->values, ngroups);
+    spt_CheckError(result, module, NULL);
+    memset(Y->values.values, 0, (size_t) ngroups * Y->values.stride * sizeof (sptValue));
+    Y->nnz = ngroups;
+    free(smodes);
+    return 0;
+}
+
+/**
+ * General semi sparse tensor times a dense matrix on one of its sparse modes,
+ * Y = X x_mode U^T, which makes mode the last dense mode of Y, so TTMs can be
+ * chained without going back to a sparse tensor. The blocks of X that agree
+ * on the other sparse modes, grouped by a stable radix sort, sum into one
+ * block of Y: each entry of a block of X scales the row of U at the block's
+ * index in mode. Groups are processed in parallel, so no atomics are needed.
+ * @param[out] Y    the result, should be uninitialized
+ * @param[in]  X    the general semi sparse tensor
+ * @param[in]  U    the matrix, with ndims[mode] rows
+ * @param[in]  mode a sparse mode of X
+ * @param[in]  tk   the number of threads
+ */
+int sptSemiSparseTensorGeneralMulMatrix(
+    sptSemiSparseTensorGeneral *Y,
+    const sptSemiSparseTensorGeneral *X,
+    const sptMatrix *U,
+    sptIndex const mode,
+    int const tk)
+{
+    sptNnzIndex * perm;
+    sptNnzIndexVector group_start;
+    sptIndex slot;
+    int result = spt_SemiSparseTensorGeneralMulMatrixSetup(Y, &perm, &group_start, &slot, X, U, mode, "CPU  SspTns * Mtx General");
+    spt_CheckError(result, "CPU  SspTns * Mtx General", NULL);
+
+    /* Entry (a, c) of a block of X, a over the dense modes but the last and c over the last, is entry a * dlast + c unpadded */
+    sptIndex const xlast = X->ndmodes - 1;
+    sptIndex const dlast = X->ndims[X->dmodes[xlast]];
+    sptIndex const xld = X->strides[xlast];
+    sptIndex const nprefix = spt_SemiSparseTensorGeneralBlockSize(X) / xld;
+    sptIndex const yld = Y->strides[Y->ndmodes - 1];
+    sptIndex const rank = U->ncols;
+    sptNnzIndex const ngroups = Y->nnz;
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(tk > 0 ? tk : 1)
+    for(sptNnzIndex g = 0; g < ngroups; ++g) {
+        sptValue * const yblock = Y->values.values + (size_t) g * Y->values.stride;
+        for(sptNnzIndex k = group_start.data[g]; k < group_start.data[g+1]; ++k) {
+            sptNnzIndex const b = perm[k];
+            sptValue const * const xblock = X->values.values + (size_t) b * X->values.stride;
+            sptValue const * const urow = U->values + (size_t) X->inds[slot].data[b] * U->stride;
+            for(sptIndex a = 0; a < nprefix; ++a) {
+                for(sptIndex c = 0; c < dlast; ++c) {
+                    sptValue const x = xblock[(size_t) a * xld + c];
+                    if(x == 0) {
+                        continue;
+                    }
+                    sptValue * const yrow = yblock + ((size_t) a * dlast + c) * yld;
+                    for(sptIndex r = 0; r < rank; ++r) {
+                        yrow[r] += x * urow[r];
+                    }
+                }
+            }
+        }
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CPU  SspTns * Mtx General");
+    sptFreeTimer(timer);
+
+    sptFreeNnzIndexVector(&group_start);
+    free(perm);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdlib.h>
+#include "ssptensor.h"
+
+/*
+ * One CUDA block per group of X blocks, its threads striding over the
+ * entries of the output block: entry (p, r), p an unpadded position over the
+ * dense modes of X, sums X_block[p] * U[i][r] over the blocks of the group,
+ * each entry written by one thread, so no atomics are needed.
+ */
+__global__ static void spt_SspTTMGeneralKernel(
+    sptValue *Y_val, sptIndex const Y_stride, sptIndex const yld,
+    sptValue const *X_val, sptIndex const X_stride, sptIndex const xld, sptIndex const dlast, sptIndex const npos,
+    sptIndex const *X_ind, sptNnzIndex const *perm, sptNnzIndex const *group_start,
+    sptValue const *U_val, sptIndex const U_stride, sptIndex const rank)
+{
+    sptNnzIndex const g = blockIdx.x;
+    sptValue * const yblock = Y_val + g * Y_stride;
+    sptNnzIndex const nentries = (sptNnzIndex) npos * rank;
+    for(sptNnzIndex e = threadIdx.x; e < nentries; e += blockDim.x) {
+        sptIndex const p = (sptIndex) (e / rank);
+        sptIndex const r = (sptIndex) (e % rank);
+        sptNnzIndex const xoff = (sptNnzIndex) (p / dlast) * xld + p % dlast;
+        sptValue sum = 0;
+        for(sptNnzIndex k = group_start[g]; k < group_start[g+1]; ++k) {
+            sptNnzIndex const b = perm[k];
+            sum += X_val[b * X_stride + xoff] * U_val[(sptNnzIndex) X_ind[b] * U_stride + r];
+        }
+        yblock[(sptNnzIndex) p * yld + r] = sum;
+    }
+}
+
+
+/**
+ * CUDA version of sptSemiSparseTensorGeneralMulMatrix. The blocks of X are
+ * grouped on the host; X, the grouping and U are copied to the current device
+ * for the call, and the blocks of Y are copied back.
+ * @param[out] Y    the result, should be uninitialized
+ * @param[in]  X    the general semi sparse tensor
+ * @param[in]  U    the matrix, with ndims[mode] rows
+ * @param[in]  mode a sparse mode of X
+ */
+int sptCudaSemiSparseTensorGeneralMulMatrix(
+    sptSemiSparseTensorGeneral *Y,
+    const sptSemiSparseTensorGeneral *X,
+    const sptMatrix *U,
+    sptIndex const mode)
+{
+    sptNnzIndex * perm;
+    sptNnzIndexVector group_start;
+    sptIndex slot;
+    int result = spt_SemiSparseTensorGeneralMulMatrixSetup(Y, &perm, &group_start, &slot, X, U, mode, "CUDA SspTns * Mtx General");
+    spt_CheckError(result, "CUDA SspTns * Mtx General", NULL);
+
+    sptIndex const xlast = X->ndmodes - 1;
+    sptIndex const dlast = X->ndims[X->dmodes[xlast]];
+    sptIndex const xld = X->strides[xlast];
+    sptIndex const npos = spt_SemiSparseTensorGeneralBlockSize(X) / xld * dlast;
+    sptNnzIndex const nnz = X->nnz;
+    sptNnzIndex const ngroups = Y->nnz;
+    sptNnzIndex const X_len = nnz * X->values.stride;
+    sptNnzIndex const Y_len = ngroups * Y->values.stride;
+
+    sptValue *Y_val = NULL;
+    result = cudaMalloc((void **) &Y_val, (Y_len + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    cudaMemset(Y_val, 0, Y_len * sizeof (sptValue));
+    sptValue *X_val = NULL;
+    result = cudaMalloc((void **) &X_val, (X_len + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    cudaMemcpy(X_val, X->values.values, X_len * sizeof (sptValue), cudaMemcpyHostToDevice);
+    sptIndex *X_ind = NULL;
+    result = cudaMalloc((void **) &X_ind, (nnz + 1) * sizeof (sptIndex));
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    cudaMemcpy(X_ind, X->inds[slot].data, nnz * sizeof (sptIndex), cudaMemcpyHostToDevice);
+    sptNnzIndex *perm_dev = NULL;
+    result = cudaMalloc((void **) &perm_dev, (nnz + ngroups + 2) * sizeof (sptNnzIndex));
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    cudaMemcpy(perm_dev, perm, nnz * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    cudaMemcpy(perm_dev + nnz, group_start.data, (ngroups + 1) * sizeof (sptNnzIndex), cudaMemcpyHostToDevice);
+    sptValue *U_val = NULL;
+    result = cudaMalloc((void **) &U_val, ((sptNnzIndex) U->nrows * U->stride + 1) * sizeof (sptValue));
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    cudaMemcpy(U_val, U->values, (sptNnzIndex) U->nrows * U->stride * sizeof (sptValue), cudaMemcpyHostToDevice);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+
+    if(ngroups > 0) {
+        spt_SspTTMGeneralKernel<<<ngroups, 256>>>(Y_val, Y->values.stride, Y->strides[Y->ndmodes - 1],
+            X_val, X->values.stride, xld, dlast, npos,
+            X_ind, perm_dev, perm_dev + nnz, U_val, U->stride, U->ncols);
+        result = cudaDeviceSynchronize();
+        spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General kernel");
+    }
+
+    sptStopTimer(timer);
+    sptPrintElapsedTime(timer, "CUDA SspTns * Mtx General");
+    sptFreeTimer(timer);
+
+    cudaMemcpy(Y->values.values, Y_val, Y_len * sizeof (sptValue), cudaMemcpyDeviceToHost);
+    result = cudaFree(U_val);
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    result = cudaFree(perm_dev);
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    result = cudaFree(X_ind);
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    result = cudaFree(X_val);
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+    result = cudaFree(Y_val);
+    spt_CheckCudaError(result != 0, "CUDA SspTns * Mtx General");
+
+    sptFreeNnzIndexVector(&group_start);
+    free(perm);
+    return 0;
+}
@@ -17,17 +17,114 @@
 */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ParTI.h>
 #include "ssptensor.h"
 #include "../sptensor/sptensor.h"
 
 static int spt_SparseTensorCompareExceptMode(const sptSparseTensor *tsr1, sptNnzIndex ind1, const sptSparseTensor *tsr2, sptNnzIndex ind2, sptIndex mode);
 
+/* Whether nonzero i of a tensor sorted at mode starts a new fiber */
+static inline int spt_IsFiberHead(const sptSparseTensor *tsr, sptNnzIndex i, sptIndex mode) {
+    return i == 0 || spt_SparseTensorCompareExceptMode(tsr, i - 1, tsr, i, mode) != 0;
+}
+
+/*
+ * Fiber starts of a tensor sorted at mode, plus a trailing nnz, in parallel:
+ * each static part flags and counts the fiber heads in it, a prefix sum over
+ * the parts gives their output offsets, and each part compacts its heads.
+ */
+static int spt_BuildFiberIndex(sptNnzIndexVector *fiberidx, const sptSparseTensor *ref, sptIndex mode) {
+    int const nparts = spt_SemiSparseTensorThreads();
+    sptNnzIndex * offsets = calloc(nparts + 1, sizeof *offsets);
+    spt_CheckOSError(!offsets, "SspTns SetIndices");
+
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = ref->nnz * p / nparts;
+        sptNnzIndex const end = ref->nnz * (p + 1) / nparts;
+        sptNnzIndex count = 0;
+        for(sptNnzIndex i = begin; i < end; ++i) {
+            count += spt_IsFiberHead(ref, i, mode);
+        }
+        offsets[p + 1] = count;
+    }
+    for(int p = 0; p < nparts; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+
+    int result = sptNewNnzIndexVector(fiberidx, offsets[nparts] + 1, offsets[nparts] + 1);
+    spt_CheckError(result, "SspTns SetIndices", NULL);
+    #pragma omp parallel for schedule(static) num_threads(nparts)
+    for(int p = 0; p < nparts; ++p) {
+        sptNnzIndex const begin = ref->nnz * p / nparts;
+        sptNnzIndex const end = ref->nnz * (p + 1) / nparts;
+        sptNnzIndex out = offsets[p];
+        for(sptNnzIndex i = begin; i < end; ++i) {
+            if(spt_IsFiberHead(ref, i, mode)) {
+                fiberidx->data[out++] = i;
+            }
+        }
+    }
+    fiberidx->data[offsets[nparts]] = ref->nnz;
+    free(offsets);
+    return 0;
+}
+
+/**
+ * The fiber starts of ref at mode, plus a trailing nnz, for kernels that walk
+ * the fibers without a semi-sparse tensor. ref is sorted at mode if it is not
+ * already, and the index is built in parallel and cached on ref, so *fiberidx
+ * lasts until ref is reordered (see sptSparseTensorDropCache).
+ * @param[out] fiberidx set to the cached fiber starts
+ * @param[in]  ref      a pointer to a valid sparse tensor
+ * @param      mode     the mode the fibers run along
+ */
+int spt_SparseTensorFiberIndex(sptNnzIndexVector const **fiberidx, sptSparseTensor *ref, sptIndex const mode) {
+    sptIndex m;
+    int result;
+    struct spt_SparseTensorCache * cache = spt_SparseTensorGetCache(ref);
+    spt_CheckOSError(!cache, "SpTns FiberIndex");
+    if(cache->fibermode != mode) {
+        /* A tensor built in place may claim an order it is not in, so check the data */
+        sptIndex * order = malloc(ref->nmodes * sizeof *order);
+        spt_CheckOSError(!order, "SpTns FiberIndex");
+        for(m = 0; m < ref->nmodes - 1; ++m) {
+            order[m] = m < mode ? m : m + 1;
+        }
+        order[ref->nmodes - 1] = mode;
+        if(spt_SparseTensorIsSortedInOrder(ref, order)) {
+            memcpy(ref->sortorder, order, ref->nmodes * sizeof *order);
+        } else {
+            sptSparseTensorSortIndexAtMode(ref, mode, 1);
+        }
+        free(order);
+
+        sptNnzIndexVector built;
+        result = spt_BuildFiberIndex(&built, ref, mode);
+        spt_CheckError(result, "SpTns FiberIndex", NULL);
+        cache = spt_SparseTensorGetCache(ref);
+        spt_CheckOSError(!cache, "SpTns FiberIndex");
+        if(cache->fibermode != ref->nmodes) {
+            sptFreeNnzIndexVector(&cache->fiberidx);
+        }
+        cache->fiberidx = built;
+        cache->fibermode = mode;
+    }
+    *fiberidx = &cache->fiberidx;
+    return 0;
+}
+
 /**
  * Convert a sparse tensor into a semi sparse tensor, but only set the indices
  * without setting any actual data
+ *
+ * ref is sorted at dest->mode if it is not already. The fiber starts are found
+ * in parallel and cached on ref, so later calls on the same mode skip the scan
+ * until ref is reordered (see sptSparseTensorDropCache).
  * @param[out] dest     a pointer to an uninitialized semi sparse tensor
- * @param[out] fiberidx a vector to store the starting position of each fiber, should be uninitialized
+ * @param[out] fiberidx a vector to store the starting position of each fiber, should be uninitialized, or NULL
  * @param[in]  ref      a pointer to a valid sparse tensor
  */
 int sptSemiSparseTensorSetIndices(
@@ -35,33 +132,32 @@ int sptSemiSparseTensorSetIndices(
     sptNnzIndexVector *fiberidx,
     sptSparseTensor *ref
 ) {
-    sptNnzIndex lastidx = ref->nnz;
-    sptNnzIndex i;
+    sptIndex const mode = dest->mode;
     sptIndex m;
     int result;
     assert(dest->nmodes == ref->nmodes);
-    sptSparseTensorSortIndexAtMode(ref, dest->mode, 0);
-    result = sptNewNnzIndexVector(fiberidx, 0, 0);
+
+    sptNnzIndexVector const * cached;
+    result = spt_SparseTensorFiberIndex(&cached, ref, mode);
     spt_CheckError(result, "SspTns SetIndices", NULL);
-    dest->nnz = 0;
-    for(i = 0; i < ref->nnz; ++i) {
-        if(lastidx == ref->nnz || spt_SparseTensorCompareExceptMode(ref, lastidx, ref, i, dest->mode) != 0) {
-            for(m = 0; m < dest->nmodes; ++m) {
-                if(m != dest->mode) {
-                    result = sptAppendIndexVector(&dest->inds[m], ref->inds[m].data[i]);
-                    spt_CheckError(result, "SspTns SetIndices", NULL);
-                }
-            }
-            lastidx = i;
-            ++dest->nnz;
-            if(fiberidx != NULL) {
-                result = sptAppendNnzIndexVector(fiberidx, i);
-                spt_CheckError(result, "SspTns SetIndices", NULL);
+    sptNnzIndex const nfibers = cached->len - 1;
+    for(m = 0; m < dest->nmodes; ++m) {
+        if(m != mode) {
+            result = sptResizeIndexVector(&dest->inds[m], nfibers);
+            spt_CheckError(result, "SspTns SetIndices", NULL);
+        }
+    }
+    #pragma omp parallel for schedule(static) num_threads(spt_SemiSparseTensorThreads())
+    for(sptNnzIndex f = 0; f < nfibers; ++f) {
+        for(sptIndex k = 0; k < dest->nmodes; ++k) {
+            if(k != mode) {
+                dest->inds[k].data[f] = ref->inds[k].data[cached->data[f]];
             }
         }
     }
+    dest->nnz = nfibers;
     if(fiberidx != NULL) {
-        result = sptAppendNnzIndexVector(fiberidx, ref->nnz);
+        result = sptCopyNnzIndexVector(fiberidx, cached);
         spt_CheckError(result, "SspTns SetIndices", NULL);
     }
     result = sptResizeMatrix(&dest->values, dest->nnz);
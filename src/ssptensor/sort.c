@@ -18,64 +18,78 @@
 
 #include <ParTI.h>
 #include "ssptensor.h"
+#include "../sptensor/sptensor.h"
 #include <stdlib.h>
 #include <string.h>
 
-static void spt_QuickSortIndex(sptSemiSparseTensor *tsr, sptNnzIndex l, sptNnzIndex r, sptValue buffer[]);
-static void spt_SwapValues(sptSemiSparseTensor *tsr, sptNnzIndex ind1, sptNnzIndex ind2, sptValue buffer[]);
-
 /**
- * Reorder the elements in a semi sparse tensor lexicographically
- * @param tsr  the semi sparse tensor to operate on
+ * The nonzero fibers of a semi sparse tensor reordered by perm, fiber k
+ * taking the place of fiber perm[k], each index array and each dense fiber
+ * moved once by a parallel gather
  */
-int sptSemiSparseTensorSortIndex(sptSemiSparseTensor *tsr) {
-    sptValue *buffer = malloc(tsr->stride * sizeof (sptValue));
-    spt_CheckOSError(!buffer, "SspTns SortIndex");
-    spt_QuickSortIndex(tsr, 0, tsr->nnz, buffer);
-    free(buffer);
-    return 0;
-}
-
-static void spt_QuickSortIndex(sptSemiSparseTensor *tsr, sptNnzIndex l, sptNnzIndex r, sptValue buffer[]) {
-    sptNnzIndex i, j, p;
-    if(r-l < 2) {
-        return;
-    }
-    p = (l+r) / 2;
-    for(i = l, j = r-1; ; ++i, --j) {
-        while(spt_SemiSparseTensorCompareIndices(tsr, i, tsr, p) < 0) {
-            ++i;
-        }
-        while(spt_SemiSparseTensorCompareIndices(tsr, p, tsr, j) < 0) {
-            --j;
+int spt_SemiSparseTensorGather(sptSemiSparseTensor *tsr, sptNnzIndex const * perm, int const tk) {
+    sptNnzIndex const nnz = tsr->nnz;
+    sptIndex const stride = tsr->stride;
+    sptIndex * scratch = malloc((nnz > 0 ? nnz : 1) * sizeof *scratch);
+    spt_CheckOSError(!scratch, "SspTns Gather");
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(m == tsr->mode) {
+            continue;
         }
-        if(i >= j) {
-            break;
-        }
-        spt_SwapValues(tsr, i, j, buffer);
-        if(i == p) {
-            p = j;
-        } else if(j == p) {
-            p = i;
+        sptIndex * const inds = tsr->inds[m].data;
+        #pragma omp parallel for schedule(static) num_threads(tk)
+        for(sptNnzIndex k = 0; k < nnz; ++k) {
+            scratch[k] = inds[perm[k]];
         }
+        memcpy(inds, scratch, nnz * sizeof *inds);
     }
-    spt_QuickSortIndex(tsr, l, i, buffer);
-    spt_QuickSortIndex(tsr, i, r, buffer);
+    free(scratch);
+
+    sptValue * values = sptMallocBacked(tsr->values.cap * stride * sizeof (sptValue), spt_MemRequestOf(tsr->values.values));
+    spt_CheckOSError(!values, "SspTns Gather");
+    #pragma omp parallel for schedule(static) num_threads(tk)
+    for(sptNnzIndex k = 0; k < nnz; ++k) {
+        memcpy(&values[k * stride], &tsr->values.values[perm[k] * stride], stride * sizeof (sptValue));
+    }
+    sptFree(tsr->values.values);
+    tsr->values.values = values;
+    return 0;
 }
 
-static void spt_SwapValues(sptSemiSparseTensor *tsr, sptNnzIndex ind1, sptNnzIndex ind2, sptValue buffer[]) {
-    sptIndex i;
-    for(i = 0; i < tsr->nmodes; ++i) {
-        if(i != tsr->mode) {
-            sptIndex eleind1 = tsr->inds[i].data[ind1];
-            sptIndex eleind2 = tsr->inds[i].data[ind2];
-            tsr->inds[i].data[ind1] = eleind2;
-            tsr->inds[i].data[ind2] = eleind1;
-        }
+/**
+ * Reorder the elements in a semi sparse tensor lexicographically
+ *
+ * A stable radix sort computes the order of the fibers from their indices
+ * alone, and the fibers are then moved once, in parallel.
+ * @param tsr  the semi sparse tensor to operate on
+ */
+int sptSemiSparseTensorSortIndex(sptSemiSparseTensor *tsr) {
+    int const tk = spt_SemiSparseTensorThreads();
+    sptNnzIndex const nnz = tsr->nnz;
+    if(nnz < 2) {
+        return 0;
     }
-    if(ind1 != ind2) {
-        memcpy(buffer, &tsr->values.values[ind1*tsr->stride], tsr->stride * sizeof (sptNnzIndex));
-        memcpy(&tsr->values.values[ind1*tsr->stride], &tsr->values.values[ind2*tsr->stride], tsr->stride * sizeof (sptNnzIndex));
-        memcpy(&tsr->values.values[ind2*tsr->stride], buffer, tsr->stride * sizeof (sptNnzIndex));
+    sptIndex * key_modes = malloc(tsr->nmodes * sizeof *key_modes);
+    sptNnzIndex * perm = malloc(nnz * sizeof *perm);
+    spt_CheckOSError(!key_modes || !perm, "SspTns SortIndex");
+    sptIndex nkeys = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(m != tsr->mode) {
+            key_modes[nkeys++] = m;
+        }
     }
+    /* The radix engine reads only the sizes and the index arrays, which the fibers share with a sparse tensor */
+    sptSparseTensor view;
+    memset(&view, 0, sizeof view);
+    view.nmodes = tsr->nmodes;
+    view.ndims = tsr->ndims;
+    view.nnz = nnz;
+    view.inds = tsr->inds;
+    int result = spt_SparseTensorRadixPermutation(&view, 0, nnz, nkeys, key_modes, 0, perm, tk);
+    spt_CheckError(result, "SspTns SortIndex", NULL);
+    result = spt_SemiSparseTensorGather(tsr, perm, tk);
+    spt_CheckError(result, "SspTns SortIndex", NULL);
+    free(perm);
+    free(key_modes);
+    return 0;
 }
@@ -17,6 +17,7 @@
 */
 
 #include <ParTI.h>
+#include <stdlib.h>
 #include "ssptensor.h"
 
 
@@ -24,6 +25,8 @@
  * Create a sparse matrix representation of an semi-sparse tensor `tsr`.
  * The mode specified in `tsr->modemode` map to the column of the matrix,
  * and the remaining modes (in ascending order) map to the rows.
+ * Both csrVal and csrColInd are copies of nnz * ndims[mode] entries; use
+ * spt_SemiSparseTensorToBlockView to pass the fibers on without copying.
  *
  * @parameter[out] csrVal     preallocated length = tsr->nnz * tsr->ndims[tsr->mode]
  * @parameter[out] csrRowPtr  preallocated length = tsr->nnz+1
@@ -38,7 +41,7 @@ int spt_SemiSparseTensorToSparseMatrixCSR(
     /*
         For tensor size [X, Y, Z], col_dim = 1,
         this function will output a matrix [X * Z, Y],
-        where [a, b, c] will map to [a * X + c, b].
+        where [a, b, c] will map to [a * Z + c, b].
     */
 
     const sptIndex stride = tsr->stride;
@@ -61,3 +64,55 @@ int spt_SemiSparseTensorToSparseMatrixCSR(
 
     return 0;
 }
+
+
+/**
+ * Build a dense-block view of a semi-sparse tensor, see spt_SemiSparseBlockView.
+ * Only the row indices are allocated, nnz of them; the dense fibers are not
+ * copied. Rows are numbered like spt_SemiSparseTensorToSparseMatrixCSR, the
+ * remaining modes linearized in ascending order.
+ *
+ * @parameter[out] view  an uninitialized view
+ * @parameter[in]  tsr   the semi-sparse tensor to view, must outlive the view
+ */
+int spt_SemiSparseTensorToBlockView(spt_SemiSparseBlockView *view, sptSemiSparseTensor *tsr) {
+    sptNnzIndex nmatrows = 1;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(m == tsr->mode) {
+            continue;
+        }
+        if(tsr->ndims[m] != 0 && nmatrows > (sptNnzIndex) -1 / tsr->ndims[m]) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SspTns -> BlockView", "matricized rows overflow sptNnzIndex");
+        }
+        nmatrows *= tsr->ndims[m];
+    }
+    view->nrows = tsr->nnz;
+    view->ncols = tsr->ndims[tsr->mode];
+    view->ld = tsr->stride;
+    view->nmatrows = nmatrows;
+    view->values = tsr->values.values;
+    view->rowind = malloc((tsr->nnz + 1) * sizeof *view->rowind);
+    spt_CheckOSError(!view->rowind, "SspTns -> BlockView");
+
+    #pragma omp parallel for schedule(static)
+    for(sptNnzIndex row = 0; row < tsr->nnz; ++row) {
+        sptNnzIndex lin = 0;
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            if(m != tsr->mode) {
+                lin = lin * tsr->ndims[m] + tsr->inds[m].data[row];
+            }
+        }
+        view->rowind[row] = lin;
+    }
+    return 0;
+}
+
+/**
+ * Release the row indices of a dense-block view, the viewed tensor is untouched
+ */
+void spt_FreeSemiSparseBlockView(spt_SemiSparseBlockView *view) {
+    free(view->rowind);
+    view->rowind = NULL;
+    view->values = NULL;
+    view->nrows = 0;
+}
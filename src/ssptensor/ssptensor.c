@@ -97,11 +97,12 @@ void sptFreeSemiSparseTensor(sptSemiSparseTensor *tsr) {
 
 
 /**
- * Create a new semi sparse tensor
- * @param tsr    a pointer to an uninitialized semi sparse tensor
- * @param nmodes number of modes the tensor will have
- * @param mode   the mode which will be stored in dense format
- * @param ndims  the dimension of each mode the tensor will have
+ * Create a new general semi sparse tensor, with no blocks
+ * @param tsr     a pointer to an uninitialized general semi sparse tensor
+ * @param nmodes  number of modes the tensor will have
+ * @param ndims   the dimension of each mode the tensor will have
+ * @param ndmodes the number of dense modes, from 1 to nmodes
+ * @param dmodes  the dense modes, distinct, in the order a block is laid out
  */
 int sptNewSemiSparseTensorGeneral(sptSemiSparseTensorGeneral *tsr, sptIndex nmodes, const sptIndex ndims[], sptIndex ndmodes, const sptIndex dmodes[]) {
     sptIndex i;
@@ -109,33 +110,57 @@ int sptNewSemiSparseTensorGeneral(sptSemiSparseTensorGeneral *tsr, sptIndex nmod
     if(nmodes < 2) {
         spt_CheckError(SPTERR_SHAPE_MISMATCH, "SspTns New", "nmodes < 2");
     }
+    if(ndmodes == 0 || ndmodes > nmodes) {
+        spt_CheckError(SPTERR_SHAPE_MISMATCH, "SspTns New", "ndmodes out of range");
+    }
+    for(i = 0; i < ndmodes; ++i) {
+        if(dmodes[i] >= nmodes || spt_SemiSparseTensorGeneralDenseSlot(dmodes, i, dmodes[i]) != i) {
+            spt_CheckError(SPTERR_VALUE_ERROR, "SspTns New", "dense modes out of range or repeated");
+        }
+    }
     tsr->nmodes = nmodes;
     tsr->ndims = malloc(nmodes * sizeof *tsr->ndims);
     spt_CheckOSError(!tsr->ndims, "SspTns New");
     memcpy(tsr->ndims, ndims, nmodes * sizeof *tsr->ndims);
 
     tsr->ndmodes = ndmodes;
-    tsr->dmodes = malloc(nmodes * sizeof *tsr->dmodes);
+    tsr->dmodes = malloc(ndmodes * sizeof *tsr->dmodes);
     spt_CheckOSError(!tsr->dmodes, "SspTns New");
-    memcpy(tsr->dmodes, dmodes, nmodes * sizeof *tsr->dmodes);
+    memcpy(tsr->dmodes, dmodes, ndmodes * sizeof *tsr->dmodes);
 
     sptIndex nsmodes = nmodes - ndmodes;
     tsr->nnz = 0;
-    tsr->inds = malloc(nsmodes * sizeof *tsr->inds);
+    tsr->inds = malloc((nsmodes > 0 ? nsmodes : 1) * sizeof *tsr->inds);
     spt_CheckOSError(!tsr->inds, "SspTns New");
     for(i = 0; i < nsmodes; ++i) {
         result = sptNewIndexVector(&tsr->inds[i], 0, 0);
         spt_CheckError(result, "SspTns New", NULL);
     }
     tsr->strides = malloc(ndmodes * sizeof *tsr->strides);
+    spt_CheckOSError(!tsr->strides, "SspTns New");
     for(i = 0; i < ndmodes; ++i) {
         tsr->strides[i] = ((ndims[dmodes[i]]-1)/8+1)*8;
     }
-    result = sptNewMatrix(&tsr->values, 0, tsr->strides[0]);
+    result = sptNewMatrix(&tsr->values, 0, spt_SemiSparseTensorGeneralBlockSize(tsr));
     spt_CheckError(result, "SspTns New", NULL);
     return 0;
 }
 
+/**
+ * The modes of a general semi sparse tensor that are not dense, in
+ * increasing order, i.e. the modes of its inds
+ * @param[out] smodes length nmodes - ndmodes
+ * @param[in]  tsr    the tensor
+ */
+void spt_SemiSparseTensorGeneralSparseModes(sptIndex * smodes, const sptSemiSparseTensorGeneral *tsr) {
+    sptIndex s = 0;
+    for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+        if(spt_SemiSparseTensorGeneralDenseSlot(tsr->dmodes, tsr->ndmodes, m) == tsr->ndmodes) {
+            smodes[s++] = m;
+        }
+    }
+}
+
 /**
  * Release any memory the semi sparse tensor is holding
  * @param tsr the tensor to release
@@ -29,14 +29,69 @@ extern "C" {
 int spt_SemiSparseTensorAppend(sptSemiSparseTensor *tsr, const sptIndex indices[], sptValue value);
 int spt_SemiSparseTensorCompareIndices(const sptSemiSparseTensor *tsr1, sptNnzIndex ind1, const sptSemiSparseTensor *tsr2, sptNnzIndex ind2);
 int spt_SemiSparseTensorMergeValues(sptSemiSparseTensor *tsr);
+int spt_SemiSparseTensorGather(sptSemiSparseTensor *tsr, sptNnzIndex const * perm, int const tk);
+
+/* Threads for the semi sparse kernels, one when already inside a parallel region */
+static inline int spt_SemiSparseTensorThreads(void) {
+#ifdef PARTI_USE_OPENMP
+    return omp_in_parallel() ? 1 : sptExecThreads(0);
+#else
+    return 1;
+#endif
+}
 
 double spt_SemiSparseTensorNorm(const sptSemiSparseTensor *X);
 
+/* Position of mode m among the first n dense modes, n if it is not one of them */
+static inline sptIndex spt_SemiSparseTensorGeneralDenseSlot(const sptIndex dmodes[], sptIndex const n, sptIndex const m) {
+    sptIndex d = 0;
+    while(d < n && dmodes[d] != m) {
+        ++d;
+    }
+    return d;
+}
+/* Values in one block, the last dense mode padded to its stride */
+static inline sptIndex spt_SemiSparseTensorGeneralBlockSize(const sptSemiSparseTensorGeneral *tsr) {
+    sptIndex size = tsr->strides[tsr->ndmodes - 1];
+    for(sptIndex d = 0; d + 1 < tsr->ndmodes; ++d) {
+        size *= tsr->ndims[tsr->dmodes[d]];
+    }
+    return size;
+}
+void spt_SemiSparseTensorGeneralSparseModes(sptIndex * smodes, const sptSemiSparseTensorGeneral *tsr);
+int spt_SemiSparseTensorGeneralMulMatrixSetup(
+    sptSemiSparseTensorGeneral *Y,
+    sptNnzIndex ** perm,
+    sptNnzIndexVector * group_start,
+    sptIndex * slot,
+    const sptSemiSparseTensorGeneral *X,
+    const sptMatrix *U,
+    sptIndex const mode,
+    char const * module);
+
 int spt_SemiSparseTensorSetMode(
     sptSemiSparseTensor       *dest,
     const sptSemiSparseTensor *src,
     sptIndex                    newmode
 );
+/**
+ * Dense-block view of a semi-sparse tensor matricized on its dense mode:
+ * dense row r holds matrix row rowind[r], with ncols values at values + r * ld.
+ * The values are borrowed from the tensor, so the view is valid only while
+ * the tensor is unchanged. values/ld can be handed as a row-major dense matrix
+ * with that leading dimension to BLAS/LAPACK or to cusparseCreateDnMat.
+ */
+typedef struct {
+    sptNnzIndex nrows;      /// # dense rows, the tensor's nnz
+    sptIndex ncols;         /// ndims[mode]
+    sptIndex ld;            /// leading dimension, the tensor's stride
+    sptNnzIndex nmatrows;   /// # rows of the matricized tensor
+    sptValue *values;       /// borrowed from tsr->values.values
+    sptNnzIndex *rowind;    /// matricized row of each dense row, owned
+} spt_SemiSparseBlockView;
+
+int spt_SemiSparseTensorToBlockView(spt_SemiSparseBlockView *view, sptSemiSparseTensor *tsr);
+void spt_FreeSemiSparseBlockView(spt_SemiSparseBlockView *view);
 int spt_SemiSparseTensorToSparseMatrixCSR(
     sptValue                  *csrVal,
     sptNnzIndex                        *csrRowPtr,
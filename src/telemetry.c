@@ -0,0 +1,592 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "error/error.h"
+
+#if defined(__GNUC__)
+    #define SPT_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+    #define SPT_THREAD_LOCAL _Thread_local
+#endif
+
+/*
+ * Telemetry registry.
+ *
+ * Entry names are registered once, under a lock, and get a dense id. Every
+ * thread accumulates its samples in its own slot array indexed by that id,
+ * with a small name cache in front, so recording takes no lock once a thread
+ * has seen a name. Snapshots add the slots of all threads together; they
+ * read the slots without synchronizing with the recording threads, so take
+ * them between kernels.
+ */
+
+typedef struct {
+    uint64_t count;
+    double total;
+    double min;
+    double max;
+} spt_TelemetrySlot;
+
+#define SPT_TELEMETRY_CACHE 64
+
+typedef struct spt_TelemetryLocal {
+    struct spt_TelemetryLocal * next;  /// all threads' tables, never freed
+    size_t nslots;
+    spt_TelemetrySlot * slots;
+    struct {
+        char const * name;    /// the pointer last looked up
+        char const * stored;  /// the registry's copy of its name
+        size_t id;
+    } cache[SPT_TELEMETRY_CACHE];
+} spt_TelemetryLocal;
+
+static pthread_mutex_t spt_telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+static char ** spt_telemetry_names = NULL;
+static sptTelemetryKind * spt_telemetry_kinds = NULL;
+static size_t spt_telemetry_len = 0;
+static size_t spt_telemetry_cap = 0;
+static spt_TelemetryLocal * spt_telemetry_threads = NULL;
+static sptTelemetryHook spt_telemetry_hook = NULL;
+static void * spt_telemetry_hook_ctx = NULL;
+static int spt_telemetry_print = -1;
+
+#ifdef SPT_THREAD_LOCAL
+static SPT_THREAD_LOCAL spt_TelemetryLocal * spt_telemetry_local = NULL;
+#else
+/* Without thread-local storage all threads share one table, and samples recorded at the same time may be lost */
+static spt_TelemetryLocal * spt_telemetry_local = NULL;
+#endif
+
+static size_t spt_TelemetryHash(char const * name) {
+    return ((uintptr_t) name >> 3) % SPT_TELEMETRY_CACHE;
+}
+
+/* Id of name, registering it as kind; the lock must be held */
+static size_t spt_TelemetryRegister(char const * name, sptTelemetryKind const kind) {
+    for(size_t i = 0; i < spt_telemetry_len; ++i) {
+        if(strcmp(spt_telemetry_names[i], name) == 0) {
+            return i;
+        }
+    }
+    if(spt_telemetry_len == spt_telemetry_cap) {
+        size_t const cap = spt_telemetry_cap ? 2 * spt_telemetry_cap : 32;
+        char ** names = realloc(spt_telemetry_names, cap * sizeof *names);
+        if(names == NULL) {
+            return SIZE_MAX;
+        }
+        spt_telemetry_names = names;
+        sptTelemetryKind * kinds = realloc(spt_telemetry_kinds, cap * sizeof *kinds);
+        if(kinds == NULL) {
+            return SIZE_MAX;
+        }
+        spt_telemetry_kinds = kinds;
+        spt_telemetry_cap = cap;
+    }
+    char * copy = strdup(name);
+    if(copy == NULL) {
+        return SIZE_MAX;
+    }
+    spt_telemetry_names[spt_telemetry_len] = copy;
+    spt_telemetry_kinds[spt_telemetry_len] = kind;
+    return spt_telemetry_len++;
+}
+
+/* The calling thread's slot for name, NULL when out of memory */
+static spt_TelemetrySlot * spt_TelemetrySlotOf(char const * name, sptTelemetryKind const kind) {
+    spt_TelemetryLocal * local = spt_telemetry_local;
+    size_t const h = spt_TelemetryHash(name);
+    if(local != NULL && local->cache[h].name == name && strcmp(local->cache[h].stored, name) == 0) {
+        return &local->slots[local->cache[h].id];
+    }
+
+    spt_TelemetrySlot * slot = NULL;
+    pthread_mutex_lock(&spt_telemetry_lock);
+    local = spt_telemetry_local;
+    if(local == NULL) {
+        local = calloc(1, sizeof *local);
+        if(local == NULL) {
+            goto done;
+        }
+        local->next = spt_telemetry_threads;
+        spt_telemetry_threads = local;
+        spt_telemetry_local = local;
+    }
+    size_t const id = spt_TelemetryRegister(name, kind);
+    if(id == SIZE_MAX) {
+        goto done;
+    }
+    if(id >= local->nslots) {
+        size_t const nslots = spt_telemetry_cap;
+        spt_TelemetrySlot * slots = realloc(local->slots, nslots * sizeof *slots);
+        if(slots == NULL) {
+            goto done;
+        }
+        memset(slots + local->nslots, 0, (nslots - local->nslots) * sizeof *slots);
+        local->slots = slots;
+        local->nslots = nslots;
+    }
+    /* Names are usually literals, so the pointer finds them; the string check catches reused buffers */
+    local->cache[h].name = name;
+    local->cache[h].stored = spt_telemetry_names[id];
+    local->cache[h].id = id;
+    slot = &local->slots[id];
+done:
+    pthread_mutex_unlock(&spt_telemetry_lock);
+    return slot;
+}
+
+static void spt_TelemetryRecord(char const * name, sptTelemetryKind const kind, double const value) {
+    spt_TelemetrySlot * slot = spt_TelemetrySlotOf(name, kind);
+    if(slot != NULL) {
+        if(slot->count == 0 || value < slot->min) {
+            slot->min = value;
+        }
+        if(slot->count == 0 || value > slot->max) {
+            slot->max = value;
+        }
+        slot->total += value;
+        ++ slot->count;
+    }
+    sptTelemetryHook const hook = spt_telemetry_hook;
+    if(hook != NULL) {
+        hook(name, kind, value, spt_telemetry_hook_ctx);
+    }
+}
+
+/**
+ * Record one timing sample. sptPrintElapsedTime and
+ * sptPrintAverageElapsedTime call this for every library timer.
+ * @param name    the entry, created on first use
+ * @param seconds the elapsed time
+ */
+void sptTelemetryRecordTime(char const * name, double const seconds) {
+    spt_TelemetryRecord(name, SPT_TELEMETRY_TIMER, seconds);
+}
+
+/**
+ * Add an amount, such as bytes moved, to a counter.
+ * @param name   the entry, created on first use
+ * @param amount the amount to add, recorded as one sample
+ */
+void sptTelemetryAddCounter(char const * name, double const amount) {
+    spt_TelemetryRecord(name, SPT_TELEMETRY_COUNTER, amount);
+}
+
+/**
+ * Call hook with every sample from now on, or stop with NULL. The hook runs
+ * on the recording thread, possibly inside parallel regions, and must not
+ * record telemetry itself. Not thread-safe; set it before work starts.
+ */
+void sptSetTelemetryHook(sptTelemetryHook hook, void * ctx) {
+    spt_telemetry_hook_ctx = ctx;
+    spt_telemetry_hook = hook;
+}
+
+/**
+ * Turn the timing lines that library calls print to stdout on or off. They
+ * are on unless the environment sets PARTI_TELEMETRY_PRINT=0; samples are
+ * recorded either way.
+ */
+void sptSetTelemetryPrint(int const enable) {
+    spt_telemetry_print = enable != 0;
+}
+
+/* Whether sptPrintElapsedTime should print */
+int spt_TelemetryPrinting(void) {
+    if(spt_telemetry_print < 0) {
+        char const * env = getenv("PARTI_TELEMETRY_PRINT");
+        spt_telemetry_print = env == NULL || strcmp(env, "0") != 0;
+    }
+    return spt_telemetry_print;
+}
+
+/**
+ * Aggregate all entries over all threads, in order of registration.
+ * @param[out] records receives up to `max` entries, may be NULL when max is 0
+ * @param[in]  max     the capacity of records
+ * @return the number of entries, which may exceed max
+ */
+size_t sptTelemetrySnapshot(sptTelemetryRecord * records, size_t const max) {
+    pthread_mutex_lock(&spt_telemetry_lock);
+    size_t const len = spt_telemetry_len;
+    for(size_t i = 0; i < len && i < max; ++i) {
+        sptTelemetryRecord * r = &records[i];
+        r->name = spt_telemetry_names[i];
+        r->kind = spt_telemetry_kinds[i];
+        r->count = 0;
+        r->total = 0;
+        r->min = 0;
+        r->max = 0;
+        for(spt_TelemetryLocal * local = spt_telemetry_threads; local != NULL; local = local->next) {
+            if(i >= local->nslots || local->slots[i].count == 0) {
+                continue;
+            }
+            spt_TelemetrySlot const * slot = &local->slots[i];
+            if(r->count == 0 || slot->min < r->min) {
+                r->min = slot->min;
+            }
+            if(r->count == 0 || slot->max > r->max) {
+                r->max = slot->max;
+            }
+            r->total += slot->total;
+            r->count += slot->count;
+        }
+    }
+    pthread_mutex_unlock(&spt_telemetry_lock);
+    return len;
+}
+
+static void spt_TelemetryWriteString(FILE * fp, char const * s, int const json) {
+    fputc('"', fp);
+    for(; *s != '\0'; ++s) {
+        unsigned char const c = (unsigned char) *s;
+        if(json && (c == '"' || c == '\\')) {
+            fprintf(fp, "\\%c", c);
+        } else if(json && c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else if(!json && c == '"') {
+            fputs("\"\"", fp);
+        } else {
+            fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+ * Write a snapshot of all entries as a JSON array of objects, or as CSV
+ * with a header line. Both carry name, kind, count, total, min and max.
+ * @param fp     the stream to write to
+ * @param format SPT_TELEMETRY_JSON or SPT_TELEMETRY_CSV
+ */
+int sptTelemetryExport(FILE * fp, sptTelemetryFormat const format) {
+    size_t const len = sptTelemetrySnapshot(NULL, 0);
+    sptTelemetryRecord * records = malloc((len > 0 ? len : 1) * sizeof *records);
+    spt_CheckOSError(!records, "Telemetry Export");
+    size_t n = sptTelemetrySnapshot(records, len);
+    if(n > len) {
+        n = len;
+    }
+    int const json = format == SPT_TELEMETRY_JSON;
+
+    if(json) {
+        fputs("[", fp);
+    } else {
+        fputs("name,kind,count,total,min,max\n", fp);
+    }
+    for(size_t i = 0; i < n; ++i) {
+        sptTelemetryRecord const * r = &records[i];
+        char const * kind = r->kind == SPT_TELEMETRY_TIMER ? "timer" : "counter";
+        if(json) {
+            fputs(i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ", fp);
+            spt_TelemetryWriteString(fp, r->name, 1);
+            fprintf(fp, ", \"kind\": \"%s\", \"count\": %llu, \"total\": %.9g, \"min\": %.9g, \"max\": %.9g}",
+                kind, (unsigned long long) r->count, r->total, r->min, r->max);
+        } else {
+            spt_TelemetryWriteString(fp, r->name, 0);
+            fprintf(fp, ",%s,%llu,%.9g,%.9g,%.9g\n", kind, (unsigned long long) r->count, r->total, r->min, r->max);
+        }
+    }
+    if(json) {
+        fputs(n > 0 ? "\n]\n" : "]\n", fp);
+    }
+    free(records);
+    spt_CheckOSError(ferror(fp), "Telemetry Export");
+    return 0;
+}
+
+/**
+ * Clear the samples of all entries. The entries stay registered, so names
+ * returned by earlier snapshots remain valid.
+ */
+void sptTelemetryReset(void) {
+    pthread_mutex_lock(&spt_telemetry_lock);
+    for(spt_TelemetryLocal * local = spt_telemetry_threads; local != NULL; local = local->next) {
+        memset(local->slots, 0, local->nslots * sizeof *local->slots);
+    }
+    pthread_mutex_unlock(&spt_telemetry_lock);
+}
+
+
+/*
+ * Timeline tracing.
+ *
+ * When on, every thread appends complete events (a name, a start and a
+ * duration) to its own buffer, so recording takes no lock once a thread
+ * holds a buffer and has seen a name. Device timelines are extra buffers
+ * named after their track. sptTraceExport writes all buffers as Chrome trace
+ * JSON, which chrome://tracing and Perfetto open; each thread is one row, so
+ * idle time and stragglers show as gaps.
+ */
+
+typedef struct {
+    char const * name;  /// interned, lives as long as the process
+    double ts;          /// start, microseconds on CLOCK_MONOTONIC
+    double dur;         /// microseconds
+    int64_t arg;        /// shown as args.arg, unless negative
+} spt_TraceEvent;
+
+#define SPT_TRACE_CACHE 32
+
+typedef struct spt_TraceBuffer {
+    struct spt_TraceBuffer * next;  /// all buffers, never freed
+    unsigned tid;                   /// the row in the trace
+    char * track;                   /// device track name, NULL for a host thread
+    size_t len;
+    size_t cap;
+    spt_TraceEvent * events;
+    struct {
+        char const * name;    /// the pointer last looked up
+        char const * stored;  /// the interned copy
+    } cache[SPT_TRACE_CACHE];
+} spt_TraceBuffer;
+
+static int spt_trace_enabled = -1;
+static char * spt_trace_path = NULL;
+static spt_TraceBuffer * spt_trace_buffers = NULL;
+static unsigned spt_trace_ntids = 0;
+static char ** spt_trace_names = NULL;
+static size_t spt_trace_nnames = 0;
+static size_t spt_trace_capnames = 0;
+
+#ifdef SPT_THREAD_LOCAL
+static SPT_THREAD_LOCAL spt_TraceBuffer * spt_trace_local = NULL;
+#else
+static spt_TraceBuffer * spt_trace_local = NULL;
+#endif
+
+static void spt_TraceExportAtExit(void) {
+    FILE * fp = fopen(spt_trace_path, "w");
+    if(fp != NULL) {
+        sptTraceExport(fp);
+        fclose(fp);
+    }
+}
+
+/**
+ * Turn timeline tracing on or off. It is off unless the environment sets
+ * PARTI_TRACE to a file name, in which case the trace is also written there
+ * at exit. Not thread-safe; switch it between library calls.
+ */
+void sptSetTracing(int const enable) {
+    spt_trace_enabled = enable != 0;
+}
+
+/* Whether events are being recorded */
+int sptTracingEnabled(void) {
+    if(spt_trace_enabled < 0) {
+        char const * env = getenv("PARTI_TRACE");
+        spt_trace_enabled = env != NULL && env[0] != '\0' && strcmp(env, "0") != 0;
+        if(spt_trace_enabled) {
+            spt_trace_path = strdup(env);
+            if(spt_trace_path != NULL) {
+                atexit(spt_TraceExportAtExit);
+            }
+        }
+    }
+    return spt_trace_enabled;
+}
+
+/* CLOCK_MONOTONIC in microseconds, the time base of all events */
+double spt_TraceNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec * 1e-3;
+}
+
+/* A new buffer for the calling thread or a track; the lock must be held */
+static spt_TraceBuffer * spt_TraceNewBuffer(char const * track) {
+    spt_TraceBuffer * buf = calloc(1, sizeof *buf);
+    if(buf == NULL) {
+        return NULL;
+    }
+    if(track != NULL) {
+        buf->track = strdup(track);
+        if(buf->track == NULL) {
+            free(buf);
+            return NULL;
+        }
+    }
+    buf->tid = ++spt_trace_ntids;
+    buf->next = spt_trace_buffers;
+    spt_trace_buffers = buf;
+    return buf;
+}
+
+/* The interned copy of name; the lock must be held */
+static char const * spt_TraceIntern(char const * name) {
+    for(size_t i = 0; i < spt_trace_nnames; ++i) {
+        if(strcmp(spt_trace_names[i], name) == 0) {
+            return spt_trace_names[i];
+        }
+    }
+    if(spt_trace_nnames == spt_trace_capnames) {
+        size_t const cap = spt_trace_capnames ? 2 * spt_trace_capnames : 32;
+        char ** names = realloc(spt_trace_names, cap * sizeof *names);
+        if(names == NULL) {
+            return NULL;
+        }
+        spt_trace_names = names;
+        spt_trace_capnames = cap;
+    }
+    char * copy = strdup(name);
+    if(copy == NULL) {
+        return NULL;
+    }
+    spt_trace_names[spt_trace_nnames++] = copy;
+    return copy;
+}
+
+static void spt_TraceAppend(spt_TraceBuffer * buf, char const * name, int64_t const arg, double const ts, double const dur, int const locked) {
+    size_t const h = ((uintptr_t) name >> 3) % SPT_TRACE_CACHE;
+    char const * stored = buf->cache[h].stored;
+    if(buf->cache[h].name != name || strcmp(stored, name) != 0) {
+        if(!locked) {
+            pthread_mutex_lock(&spt_telemetry_lock);
+        }
+        stored = spt_TraceIntern(name);
+        if(!locked) {
+            pthread_mutex_unlock(&spt_telemetry_lock);
+        }
+        if(stored == NULL) {
+            return;
+        }
+        buf->cache[h].name = name;
+        buf->cache[h].stored = stored;
+    }
+    if(buf->len == buf->cap) {
+        size_t const cap = buf->cap ? 2 * buf->cap : 1024;
+        spt_TraceEvent * events = realloc(buf->events, cap * sizeof *events);
+        if(events == NULL) {
+            return;
+        }
+        buf->events = events;
+        buf->cap = cap;
+    }
+    spt_TraceEvent * e = &buf->events[buf->len++];
+    e->name = stored;
+    e->ts = ts;
+    e->dur = dur;
+    e->arg = arg;
+}
+
+/**
+ * Record an event of the given start and duration, in microseconds on the
+ * clock of spt_TraceNow. A NULL track records on the calling thread's row;
+ * otherwise on the row of that name, such as a device timeline.
+ */
+void spt_TraceSpan(char const * track, char const * name, int64_t const arg, double const ts, double const dur) {
+    if(!sptTracingEnabled()) {
+        return;
+    }
+    if(track == NULL) {
+        spt_TraceBuffer * buf = spt_trace_local;
+        if(buf == NULL) {
+            pthread_mutex_lock(&spt_telemetry_lock);
+            buf = spt_TraceNewBuffer(NULL);
+            pthread_mutex_unlock(&spt_telemetry_lock);
+            if(buf == NULL) {
+                return;
+            }
+            spt_trace_local = buf;
+        }
+        spt_TraceAppend(buf, name, arg, ts, dur, 0);
+        return;
+    }
+    pthread_mutex_lock(&spt_telemetry_lock);
+    spt_TraceBuffer * buf = spt_trace_buffers;
+    while(buf != NULL && (buf->track == NULL || strcmp(buf->track, track) != 0)) {
+        buf = buf->next;
+    }
+    if(buf == NULL) {
+        buf = spt_TraceNewBuffer(track);
+    }
+    if(buf != NULL) {
+        spt_TraceAppend(buf, name, arg, ts, dur, 1);
+    }
+    pthread_mutex_unlock(&spt_telemetry_lock);
+}
+
+/**
+ * Start an event on the calling thread.
+ * @return the start to pass to sptTraceEnd, negative when tracing is off
+ */
+double sptTraceBegin(void) {
+    return sptTracingEnabled() ? spt_TraceNow() : -1;
+}
+
+/**
+ * End an event started by sptTraceBegin; nothing happens when it was started with tracing off.
+ * @param name  the event name
+ * @param arg   a number shown with the event, such as the mode, or -1 for none
+ * @param begin the value sptTraceBegin returned
+ */
+void sptTraceEnd(char const * name, int64_t const arg, double const begin) {
+    if(begin >= 0) {
+        spt_TraceSpan(NULL, name, arg, begin, spt_TraceNow() - begin);
+    }
+}
+
+/**
+ * Write all recorded events as Chrome trace JSON. Like snapshots, it reads
+ * the buffers without synchronizing with recording threads; call it between kernels.
+ * @param fp the stream to write to
+ */
+int sptTraceExport(FILE * fp) {
+    pthread_mutex_lock(&spt_telemetry_lock);
+    fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", fp);
+    int first = 1;
+    for(spt_TraceBuffer const * buf = spt_trace_buffers; buf != NULL; buf = buf->next) {
+        fprintf(fp, "%s\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", first ? "" : ",", buf->tid);
+        first = 0;
+        if(buf->track != NULL) {
+            spt_TelemetryWriteString(fp, buf->track, 1);
+        } else {
+            fprintf(fp, "\"host thread %u\"", buf->tid);
+        }
+        fprintf(fp, "}},\n  {\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"sort_index\": %u}}", buf->tid, buf->tid);
+        for(size_t i = 0; i < buf->len; ++i) {
+            spt_TraceEvent const * e = &buf->events[i];
+            fputs(",\n  {\"name\": ", fp);
+            spt_TelemetryWriteString(fp, e->name, 1);
+            fprintf(fp, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f", buf->tid, e->ts, e->dur);
+            if(e->arg >= 0) {
+                fprintf(fp, ", \"args\": {\"arg\": %lld}", (long long) e->arg);
+            }
+            fputc('}', fp);
+        }
+    }
+    fputs("\n]}\n", fp);
+    pthread_mutex_unlock(&spt_telemetry_lock);
+    spt_CheckOSError(ferror(fp), "Trace Export");
+    return 0;
+}
+
+/* Drop all recorded events; threads and tracks keep their rows */
+void sptTraceReset(void) {
+    pthread_mutex_lock(&spt_telemetry_lock);
+    for(spt_TraceBuffer * buf = spt_trace_buffers; buf != NULL; buf = buf->next) {
+        buf->len = 0;
+    }
+    pthread_mutex_unlock(&spt_telemetry_lock);
+}
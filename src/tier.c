@@ -0,0 +1,245 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error/error.h"
+#ifdef PARTI_USE_MEMKIND
+    #include <memkind.h>
+#endif
+#ifdef PARTI_USE_NUMA
+    #include <numa.h>
+    #include <dirent.h>
+#endif
+
+/*
+ * Capacity-tier memory, CXL-attached or Optane PMEM in memory mode, which
+ * the kernel shows as NUMA nodes slower than DRAM.
+ *
+ * It holds far more than DRAM at a fraction of its bandwidth and a multiple
+ * of its latency, which suits data read in order once per kernel: the
+ * indices and values of sparse tensors. Factor matrices and MTTKRP outputs,
+ * gathered at random, stay in DRAM, so MTTKRP keeps its speed on a tensor
+ * several times larger than DRAM alone would take. Where each class of data
+ * goes is set with sptSetDataPlacement. Buffers come from the nodes
+ * PARTI_CAPACITY_NODES lists, else from memkind's MEMKIND_DAX_KMEM when
+ * built with it, else from the slowest of the kernel's memory tiers through
+ * libnuma.
+ */
+
+enum {
+    SPT_TIER_UNKNOWN = -1,
+    SPT_TIER_NONE = 0,
+    SPT_TIER_MEMKIND = 1,
+    SPT_TIER_NUMA = 2,
+};
+
+static int spt_tier_source = SPT_TIER_UNKNOWN;
+static size_t spt_tier_used = 0;
+static int spt_placement[SPT_NDATA_CLASSES] = { -1, -1, -1, -1, -1 };
+#ifdef PARTI_USE_NUMA
+static struct bitmask * spt_tier_nodes = NULL;
+#endif
+
+#ifdef PARTI_USE_NUMA
+/* The nodes of the slowest memory tier, when the kernel reports more than one; NULL if not */
+static struct bitmask * spt_TierSlowestNodes(void) {
+    char const * const root = "/sys/devices/virtual/memory_tiering";
+    DIR * dir = opendir(root);
+    if(dir == NULL) {
+        return NULL;
+    }
+    int ntiers = 0, slowest = -1;
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL) {
+        int tier;
+        if(sscanf(entry->d_name, "memory_tier%d", &tier) == 1) {
+            ++ntiers;
+            slowest = tier > slowest ? tier : slowest;
+        }
+    }
+    closedir(dir);
+    if(ntiers < 2) {
+        return NULL;
+    }
+    char path[256], nodelist[256];
+    snprintf(path, sizeof path, "%s/memory_tier%d/nodelist", root, slowest);
+    FILE * fp = fopen(path, "r");
+    if(fp == NULL) {
+        return NULL;
+    }
+    char * const line = fgets(nodelist, sizeof nodelist, fp);
+    fclose(fp);
+    if(line == NULL) {
+        return NULL;
+    }
+    nodelist[strcspn(nodelist, "\n")] = '\0';
+    return numa_parse_nodestring(nodelist);
+}
+#endif
+
+/* Where capacity-tier memory comes from, found on first use */
+static int spt_TierSource(void) {
+    if(spt_tier_source != SPT_TIER_UNKNOWN) {
+        return spt_tier_source;
+    }
+    #pragma omp critical(spt_tier)
+    {
+        if(spt_tier_source == SPT_TIER_UNKNOWN) {
+            int source = SPT_TIER_NONE;
+#ifdef PARTI_USE_NUMA
+            char const * env = getenv("PARTI_CAPACITY_NODES");
+            if(env != NULL && numa_available() >= 0) {
+                spt_tier_nodes = numa_parse_nodestring(env);
+                source = spt_tier_nodes != NULL ? SPT_TIER_NUMA : SPT_TIER_NONE;
+            }
+#endif
+#ifdef PARTI_USE_MEMKIND
+            if(source == SPT_TIER_NONE && memkind_check_available(MEMKIND_DAX_KMEM) == 0) {
+                source = SPT_TIER_MEMKIND;
+            }
+#endif
+#ifdef PARTI_USE_NUMA
+            if(source == SPT_TIER_NONE && env == NULL && numa_available() >= 0) {
+                spt_tier_nodes = spt_TierSlowestNodes();
+                source = spt_tier_nodes != NULL ? SPT_TIER_NUMA : SPT_TIER_NONE;
+            }
+#endif
+            spt_tier_source = source;
+        }
+    }
+    return spt_tier_source;
+}
+
+/* Whether buffers asked for with SPT_MEM_CAPACITY can get capacity-tier memory */
+int sptCapacityTierAvailable(void) {
+    return spt_TierSource() != SPT_TIER_NONE;
+}
+
+/* Bytes of capacity-tier memory the library holds */
+size_t sptCapacityBytesInUse(void) {
+    size_t used;
+    #pragma omp atomic read
+    used = spt_tier_used;
+    return used;
+}
+
+/* Whether a NUMA node belongs to the capacity tier, so that it is not taken for high-bandwidth memory */
+int spt_CapacityTierHasNode(int const node) {
+#ifdef PARTI_USE_NUMA
+    return spt_TierSource() == SPT_TIER_NUMA && numa_bitmask_isbitset(spt_tier_nodes, (unsigned) node);
+#else
+    (void) node;
+    return 0;
+#endif
+}
+
+
+/*
+ * The placement of a class until sptSetDataPlacement: tensor data goes to
+ * the capacity tier when there is one, unless PARTI_CAPACITY_TIER is 0, and
+ * matrices stay in DRAM.
+ */
+static int spt_DefaultPlacement(sptDataClass const cls) {
+    char const * env = getenv("PARTI_CAPACITY_TIER");
+    int const enabled = env == NULL || atoi(env) != 0;
+    if(cls == SPT_DATA_MATRICES || !enabled || !sptCapacityTierAvailable()) {
+        return SPT_MEM_DEFAULT;
+    }
+    return SPT_MEM_CAPACITY;
+}
+
+/**
+ * Set the backing requested for one class of data: the arrays of sparse
+ * tensors and dense matrices created from now on, without a backing of
+ * their own, and those moved with sptPlaceSparseTensor,
+ * sptPlaceSparseTensorHiCOO or sptPlaceMatrix. SPT_MEM_CAPACITY puts them
+ * in the capacity tier, and in the heap where there is none; SPT_MEM_DEFAULT
+ * in DRAM, with sptSetHbmPlacement still choosing among matrices.
+ * By default tensor indices and values go to the capacity tier when there is
+ * one and the PARTI_CAPACITY_TIER environment variable is not 0, and
+ * matrices stay in DRAM.
+ * @param cls      the class of data
+ * @param backing  the backing to request for it
+ */
+int sptSetDataPlacement(sptDataClass const cls, sptMemBacking const backing) {
+    if((int) cls < 0 || cls >= SPT_NDATA_CLASSES) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Data Placement", "unknown data class");
+    }
+    spt_placement[cls] = (int) backing;
+    return 0;
+}
+
+/* The backing requested for a class of data, see sptSetDataPlacement */
+sptMemBacking sptDataPlacement(sptDataClass const cls) {
+    if(spt_placement[cls] < 0) {
+        spt_placement[cls] = spt_DefaultPlacement(cls);
+    }
+    return (sptMemBacking) spt_placement[cls];
+}
+
+
+/* bytes of capacity-tier memory aligned to PARTI_VECTOR_ALIGN, NULL if there is none */
+void * spt_CapacityAlloc(size_t const bytes) {
+    void * ptr = NULL;
+    switch(spt_TierSource()) {
+#ifdef PARTI_USE_MEMKIND
+    case SPT_TIER_MEMKIND:
+        if(memkind_posix_memalign(MEMKIND_DAX_KMEM, &ptr, PARTI_VECTOR_ALIGN, bytes) != 0) {
+            ptr = NULL;
+        }
+        break;
+#endif
+#ifdef PARTI_USE_NUMA
+    case SPT_TIER_NUMA:
+        /* Page-aligned, and spread over the devices when there are several */
+        ptr = numa_alloc_interleaved_subset(bytes, spt_tier_nodes);
+        break;
+#endif
+    default:
+        break;
+    }
+    if(ptr != NULL) {
+        #pragma omp atomic update
+        spt_tier_used += bytes;
+    }
+    return ptr;
+}
+
+/* Release bytes from spt_CapacityAlloc */
+void spt_CapacityFree(void * ptr, size_t const bytes) {
+    switch(spt_tier_source) {
+#ifdef PARTI_USE_MEMKIND
+    case SPT_TIER_MEMKIND:
+        memkind_free(MEMKIND_DAX_KMEM, ptr);
+        break;
+#endif
+#ifdef PARTI_USE_NUMA
+    case SPT_TIER_NUMA:
+        numa_free(ptr, bytes);
+        break;
+#endif
+    default:
+        (void) ptr;
+        break;
+    }
+    #pragma omp atomic update
+    spt_tier_used -= bytes;
+}
@@ -89,14 +89,24 @@ double sptElapsedTime(const sptTimer timer) {
 
 double sptPrintElapsedTime(const sptTimer timer, const char *name) {
     double elapsed_time = sptElapsedTime(timer);
-    fprintf(stdout, "[%s]: %.9lf s\n", name, elapsed_time);
+    sptTelemetryRecordTime(name, elapsed_time);
+    /* The timer has just been stopped, so its interval ends about now */
+    if(sptTracingEnabled() && elapsed_time >= 0) {
+        spt_TraceSpan(NULL, name, -1, spt_TraceNow() - elapsed_time * 1e6, elapsed_time * 1e6);
+    }
+    if(spt_TelemetryPrinting()) {
+        fprintf(stdout, "[%s]: %.9lf s\n", name, elapsed_time);
+    }
     return elapsed_time;
 }
 
 
 double sptPrintAverageElapsedTime(const sptTimer timer, const int niters, const char *name) {
     double elapsed_time = sptElapsedTime(timer) / niters;
-    fprintf(stdout, "[%s]: %.9lf s\n", name, elapsed_time);
+    sptTelemetryRecordTime(name, elapsed_time);
+    if(spt_TelemetryPrinting()) {
+        fprintf(stdout, "[%s]: %.9lf s\n", name, elapsed_time);
+    }
     return elapsed_time;
 }
 
@@ -0,0 +1,261 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error/error.h"
+#ifdef __linux__
+    #include <sched.h>
+#endif
+
+/*
+ * Machine topology and thread pinning orders.
+ *
+ * The logical CPUs the process may run on are read once, with their
+ * physical core and socket from sysfs, and sorted socket by socket and core
+ * by core. A pinning order lists CPUs for threads 0, 1, ... of a team, which
+ * an execution context pins round-robin, see sptSetExecContext:
+ * SPT_PIN_COMPACT follows the sorted list, SPT_PIN_SCATTER takes one
+ * hardware thread of each core, alternating sockets, before any second
+ * one, and SPT_PIN_SOCKET is the compact list of one socket.
+ */
+
+typedef struct {
+    int cpu;
+    int socket;
+    int core;       /// core id within the socket, as the kernel numbers it
+    int smt;        /// rank of the CPU among its core's hardware threads
+    int core_rank;  /// rank of the core within its socket
+} spt_CpuInfo;
+
+static sptTopology spt_topology;
+static int spt_topology_ready = 0;
+static int * spt_pin_scatter = NULL;
+static int spt_pin_policy = -1;
+
+#ifdef __linux__
+/* An integer from a sysfs file, or fallback */
+static int spt_ReadSysInt(int const cpu, char const * name, int const fallback) {
+    char path[128];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE * file = fopen(path, "r");
+    int value;
+    if(file == NULL) {
+        return fallback;
+    }
+    if(fscanf(file, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+#endif
+
+static int spt_CompareCompact(void const * a, void const * b) {
+    spt_CpuInfo const * const x = a;
+    spt_CpuInfo const * const y = b;
+    if(x->socket != y->socket) {
+        return x->socket < y->socket ? -1 : 1;
+    }
+    if(x->core != y->core) {
+        return x->core < y->core ? -1 : 1;
+    }
+    return x->cpu < y->cpu ? -1 : (x->cpu > y->cpu);
+}
+
+static int spt_CompareScatter(void const * a, void const * b) {
+    spt_CpuInfo const * const x = a;
+    spt_CpuInfo const * const y = b;
+    if(x->smt != y->smt) {
+        return x->smt < y->smt ? -1 : 1;
+    }
+    if(x->core_rank != y->core_rank) {
+        return x->core_rank < y->core_rank ? -1 : 1;
+    }
+    return x->socket < y->socket ? -1 : (x->socket > y->socket);
+}
+
+/* Discover the CPUs the process may use and build the pinning orders */
+static int spt_BuildTopology(sptTopology * topo) {
+    int ncpus = 0;
+    int max_cpus = 1;
+#ifdef __linux__
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof allowed, &allowed) == 0) {
+        max_cpus = CPU_SETSIZE;
+    } else {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+#endif
+    spt_CpuInfo * info = malloc(max_cpus * sizeof *info);
+    spt_CheckOSError(!info, "Topology");
+    for(int cpu = 0; cpu < max_cpus; ++cpu) {
+#ifdef __linux__
+        if(!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        info[ncpus].socket = spt_ReadSysInt(cpu, "physical_package_id", 0);
+        info[ncpus].core = spt_ReadSysInt(cpu, "core_id", cpu);
+#else
+        info[ncpus].socket = 0;
+        info[ncpus].core = cpu;
+#endif
+        info[ncpus].cpu = cpu;
+        ++ ncpus;
+    }
+    qsort(info, ncpus, sizeof *info, spt_CompareCompact);
+
+    /* Dense socket numbers, and the ranks scatter sorts by */
+    int nsockets = 0, ncores = 0, core_rank = 0, smt = 0;
+    for(int i = 0; i < ncpus; ++i) {
+        int const new_socket = i == 0 || info[i].socket != info[i-1].socket;
+        int const new_core = new_socket || info[i].core != info[i-1].core;
+        if(new_socket) {
+            ++ nsockets;
+            core_rank = 0;
+        } else if(new_core) {
+            ++ core_rank;
+        }
+        if(new_core) {
+            ++ ncores;
+            smt = 0;
+        } else {
+            ++ smt;
+        }
+        info[i].socket = nsockets - 1;
+        info[i].core_rank = core_rank;
+        info[i].smt = smt;
+    }
+
+    int * cpus = malloc((ncpus + 1) * sizeof *cpus);
+    int * socket_of = malloc((ncpus + 1) * sizeof *socket_of);
+    int * socket_begin = malloc((nsockets + 1) * sizeof *socket_begin);
+    int * scatter = malloc((ncpus + 1) * sizeof *scatter);
+    spt_CheckOSError(!cpus || !socket_of || !socket_begin || !scatter, "Topology");
+    for(int i = 0; i < ncpus; ++i) {
+        cpus[i] = info[i].cpu;
+        socket_of[i] = info[i].socket;
+        if(i == 0 || info[i].socket != info[i-1].socket) {
+            socket_begin[info[i].socket] = i;
+        }
+    }
+    socket_begin[nsockets] = ncpus;
+    qsort(info, ncpus, sizeof *info, spt_CompareScatter);
+    for(int i = 0; i < ncpus; ++i) {
+        scatter[i] = info[i].cpu;
+    }
+    free(info);
+
+    topo->ncpus = ncpus;
+    topo->ncores = ncores;
+    topo->nsockets = nsockets;
+    topo->cpus = cpus;
+    topo->socket_of = socket_of;
+    topo->socket_begin = socket_begin;
+    spt_pin_scatter = scatter;
+    return 0;
+}
+
+
+/**
+ * The logical CPUs the process may run on, grouped by socket and core, as
+ * found on first use; NULL if they cannot be read. Affinity set later, such
+ * as by a pinned context, does not change it.
+ */
+sptTopology const * sptGetTopology(void) {
+    if(!spt_topology_ready) {
+        #pragma omp critical(spt_topology)
+        {
+            if(!spt_topology_ready && spt_BuildTopology(&spt_topology) == 0) {
+                spt_topology_ready = 1;
+            }
+        }
+    }
+    return spt_topology_ready ? &spt_topology : NULL;
+}
+
+
+/**
+ * The CPUs to pin threads 0, 1, ... of a team to under policy, to go into an
+ * execution context's cores with *ncores; see sptSetExecContext. The list
+ * belongs to the library. NULL for SPT_PIN_NONE.
+ * @param[in]  policy  SPT_PIN_COMPACT, SPT_PIN_SCATTER or SPT_PIN_SOCKET
+ * @param[in]  socket  the socket of SPT_PIN_SOCKET, modulo the sockets found
+ * @param[out] ncores  the length of the list
+ */
+int const * sptPinOrder(sptPinPolicy const policy, int const socket, int * ncores) {
+    sptTopology const * const topo = sptGetTopology();
+    *ncores = 0;
+    if(topo == NULL || topo->ncpus == 0) {
+        return NULL;
+    }
+    switch(policy) {
+    case SPT_PIN_COMPACT:
+        *ncores = topo->ncpus;
+        return topo->cpus;
+    case SPT_PIN_SCATTER:
+        *ncores = topo->ncpus;
+        return spt_pin_scatter;
+    case SPT_PIN_SOCKET:
+        {
+            int const s = (socket % topo->nsockets + topo->nsockets) % topo->nsockets;
+            *ncores = topo->socket_begin[s + 1] - topo->socket_begin[s];
+            return topo->cpus + topo->socket_begin[s];
+        }
+    default:
+        return NULL;
+    }
+}
+
+
+/* The pinning of drivers whose context has no cores, from PARTI_PIN until sptSetPinPolicy is called */
+sptPinPolicy spt_PinPolicy(void) {
+    if(spt_pin_policy < 0) {
+        char const * env = getenv("PARTI_PIN");
+        sptPinPolicy policy = SPT_PIN_NONE;
+        if(env != NULL && strcmp(env, "compact") == 0) {
+            policy = SPT_PIN_COMPACT;
+        } else if(env != NULL && strcmp(env, "scatter") == 0) {
+            policy = SPT_PIN_SCATTER;
+        } else if(env != NULL && strcmp(env, "socket") == 0) {
+            policy = SPT_PIN_SOCKET;
+        }
+        spt_pin_policy = (int) policy;
+    }
+    return (sptPinPolicy) spt_pin_policy;
+}
+
+/**
+ * Pin the threads of decomposition drivers, such as sptOmpCpdAls, for their
+ * duration when the caller's execution context chooses no cores: compactly,
+ * scattered over sockets, or on the first socket, see sptPinOrder. Pinned
+ * teams keep their threads, and the pages those first touch, on the same
+ * cores from one iteration to the next.
+ * Defaults to the PARTI_PIN environment variable, "compact", "scatter" or
+ * "socket", else SPT_PIN_NONE, which leaves placement to OMP_PROC_BIND.
+ * @param policy  the pinning policy
+ */
+int sptSetPinPolicy(sptPinPolicy const policy) {
+    if(policy < SPT_PIN_NONE || policy > SPT_PIN_SOCKET) {
+        spt_CheckError(SPTERR_VALUE_ERROR, "Topology", "unknown pinning policy");
+    }
+    spt_pin_policy = (int) policy;
+    return 0;
+}
@@ -22,6 +22,18 @@
 #include "../error/error.h"
 
 
+/* The capacity to grow cap to for holding need values, 1.5x at least to keep appends amortized O(1) */
+static sptNnzIndex spt_VectorGrowCap(sptNnzIndex const cap, sptNnzIndex const need) {
+#ifndef MEMCHECK_MODE
+    sptNnzIndex const grown = cap + cap/2;
+    return grown > need ? grown : need;
+#else
+    (void) cap;
+    return need;
+#endif
+}
+
+
 /**
  * Initialize a new value vector
  *
@@ -40,9 +52,9 @@ int sptNewValueVector(sptValueVector *vec, sptNnzIndex len, sptNnzIndex cap) {
     }
     vec->len = len;
     vec->cap = cap;
-    vec->data = malloc(cap * sizeof *vec->data);
+    vec->data = sptMalloc(cap * sizeof *vec->data);
     spt_CheckOSError(!vec->data, "ValVec New");
-    memset(vec->data, 0, cap * sizeof *vec->data);
+    sptFirstTouchZero(vec->data, cap * sizeof *vec->data);
     return 0;
 }
 
@@ -92,15 +104,8 @@ int sptCopyValueVector(sptValueVector *dest, const sptValueVector *src, int cons
  */
 int sptAppendValueVector(sptValueVector *vec, sptValue const value) {
     if(vec->cap <= vec->len) {
-#ifndef MEMCHECK_MODE
-        sptNnzIndex newcap = vec->cap + vec->cap/2;
-#else
-        sptNnzIndex newcap = vec->len+1;
-#endif
-        sptValue *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "ValVec Append");
-        vec->cap = newcap;
-        vec->data = newdata;
+        int result = sptReserveValueVector(vec, spt_VectorGrowCap(vec->cap, vec->len + 1));
+        spt_CheckError(result, "ValVec Append", NULL);
     }
     vec->data[vec->len] = value;
     ++vec->len;
@@ -116,19 +121,48 @@ int sptAppendValueVector(sptValueVector *vec, sptValue const value) {
  * The values from `append_vec` will be appended to `vec`.
  */
 int sptAppendValueVectorWithVector(sptValueVector *vec, const sptValueVector *append_vec) {
-    sptNnzIndex newlen = vec->len + append_vec->len;
-    if(vec->cap <= newlen) {
-        sptNnzIndex newcap = vec->cap + append_vec->cap;
-        sptValue *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "ValVec Append ValVec");
-        vec->cap = newcap;
+    int result = sptAppendValueVectorN(vec, append_vec->data, append_vec->len);
+    spt_CheckError(result, "ValVec Append ValVec", NULL);
+    return 0;
+}
+
+/**
+ * Reserve room in a value vector without changing its length
+ *
+ * @param vec a pointer to a valid value vector
+ * @param cap the number of values to make room for
+ *
+ * Appends up to `cap` values then need no reallocation. The capacity is never
+ * shrunk, use `sptResizeValueVector` for that.
+ */
+int sptReserveValueVector(sptValueVector *vec, sptNnzIndex const cap) {
+    if(cap > vec->cap) {
+        sptValue *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, cap * sizeof *vec->data, SPT_MEM_DEFAULT);
+        spt_CheckOSError(!newdata, "ValVec Reserve");
+        vec->cap = cap;
         vec->data = newdata;
     }
-    for(sptNnzIndex i=0; i<append_vec->len; ++i) {
-        vec->data[vec->len + i] = append_vec->data[i];
-    }
-    vec->len = newlen;
+    return 0;
+}
 
+/**
+ * Add n values to the end of a value vector at once
+ *
+ * @param vec    a pointer to a valid value vector
+ * @param values the values to be appended, not inside `vec`, or NULL to leave them undefined for the caller to fill
+ * @param n      the number of values
+ *
+ * The capacity grows by the same policy as a single append.
+ */
+int sptAppendValueVectorN(sptValueVector *vec, const sptValue *values, sptNnzIndex const n) {
+    if(vec->cap < vec->len + n) {
+        int result = sptReserveValueVector(vec, spt_VectorGrowCap(vec->cap, vec->len + n));
+        spt_CheckError(result, "ValVec AppendN", NULL);
+    }
+    if(values != NULL && n != 0) {
+        memcpy(vec->data + vec->len, values, n * sizeof *vec->data);
+    }
+    vec->len += n;
     return 0;
 }
 
@@ -145,7 +179,7 @@ int sptAppendValueVectorWithVector(sptValueVector *vec, const sptValueVector *ap
 int sptResizeValueVector(sptValueVector *vec, sptNnzIndex const size) {
     sptNnzIndex newcap = size < 2 ? 2 : size;
     if(newcap != vec->cap) {
-        sptValue *newdata = realloc(vec->data, newcap * sizeof *vec->data);
+        sptValue *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, newcap * sizeof *vec->data, SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "ValVec Resize");
         vec->len = size;
         vec->cap = newcap;
@@ -165,7 +199,7 @@ int sptResizeValueVector(sptValueVector *vec, sptNnzIndex const size) {
 void sptFreeValueVector(sptValueVector *vec) {
     vec->len = 0;
     vec->cap = 0;
-    free(vec->data);
+    sptFree(vec->data);
 }
 
 
@@ -188,9 +222,9 @@ int sptNewIndexVector(sptIndexVector *vec, sptNnzIndex len, sptNnzIndex cap) {
     }
     vec->len = len;
     vec->cap = cap;
-    vec->data = malloc(cap * sizeof *vec->data);
+    vec->data = sptMalloc(cap * sizeof *vec->data);
     spt_CheckOSError(!vec->data, "IdxVec New");
-    memset(vec->data, 0, cap * sizeof *vec->data);
+    sptFirstTouchZero(vec->data, cap * sizeof *vec->data);
     return 0;
 }
 
@@ -241,15 +275,8 @@ int sptCopyIndexVector(sptIndexVector *dest, const sptIndexVector *src, int cons
  */
 int sptAppendIndexVector(sptIndexVector *vec, sptIndex const value) {
     if(vec->cap <= vec->len) {
-#ifndef MEMCHECK_MODE
-        sptNnzIndex newcap = vec->cap + vec->cap/2;
-#else
-        sptNnzIndex newcap = vec->len+1;
-#endif
-        sptIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "IdxVec Append");
-        vec->cap = newcap;
-        vec->data = newdata;
+        int result = sptReserveIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + 1));
+        spt_CheckError(result, "IdxVec Append", NULL);
     }
     vec->data[vec->len] = value;
     ++vec->len;
@@ -265,19 +292,48 @@ int sptAppendIndexVector(sptIndexVector *vec, sptIndex const value) {
  * The values from `append_vec` will be appended to `vec`.
  */
 int sptAppendIndexVectorWithVector(sptIndexVector *vec, const sptIndexVector *append_vec) {
-    sptNnzIndex newlen = vec->len + append_vec->len;
-    if(vec->cap <= newlen) {
-        sptNnzIndex newcap = vec->cap + append_vec->cap;
-        sptIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "IdxVec Append IdxVec");
-        vec->cap = newcap;
+    int result = sptAppendIndexVectorN(vec, append_vec->data, append_vec->len);
+    spt_CheckError(result, "IdxVec Append IdxVec", NULL);
+    return 0;
+}
+
+/**
+ * Reserve room in an index vector without changing its length
+ *
+ * @param vec a pointer to a valid index vector
+ * @param cap the number of values to make room for
+ *
+ * Appends up to `cap` values then need no reallocation. The capacity is never
+ * shrunk, use `sptResizeIndexVector` for that.
+ */
+int sptReserveIndexVector(sptIndexVector *vec, sptNnzIndex const cap) {
+    if(cap > vec->cap) {
+        sptIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, cap * sizeof *vec->data, SPT_MEM_DEFAULT);
+        spt_CheckOSError(!newdata, "IdxVec Reserve");
+        vec->cap = cap;
         vec->data = newdata;
     }
-    for(sptNnzIndex i=0; i<append_vec->len; ++i) {
-        vec->data[vec->len + i] = append_vec->data[i];
-    }
-    vec->len = newlen;
+    return 0;
+}
 
+/**
+ * Add n values to the end of an index vector at once
+ *
+ * @param vec    a pointer to a valid index vector
+ * @param values the values to be appended, not inside `vec`, or NULL to leave them undefined for the caller to fill
+ * @param n      the number of values
+ *
+ * The capacity grows by the same policy as a single append.
+ */
+int sptAppendIndexVectorN(sptIndexVector *vec, const sptIndex *values, sptNnzIndex const n) {
+    if(vec->cap < vec->len + n) {
+        int result = sptReserveIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + n));
+        spt_CheckError(result, "IdxVec AppendN", NULL);
+    }
+    if(values != NULL && n != 0) {
+        memcpy(vec->data + vec->len, values, n * sizeof *vec->data);
+    }
+    vec->len += n;
     return 0;
 }
 
@@ -294,7 +350,7 @@ int sptAppendIndexVectorWithVector(sptIndexVector *vec, const sptIndexVector *ap
 int sptResizeIndexVector(sptIndexVector *vec, sptNnzIndex const size) {
     sptNnzIndex newcap = size < 2 ? 2 : size;
     if(newcap != vec->cap) {
-        sptIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
+        sptIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, newcap * sizeof *vec->data, SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "IdxVec Resize");
         vec->len = size;
         vec->cap = newcap;
@@ -312,7 +368,7 @@ int sptResizeIndexVector(sptIndexVector *vec, sptNnzIndex const size) {
  *
  */
 void sptFreeIndexVector(sptIndexVector *vec) {
-    free(vec->data);
+    sptFree(vec->data);
     vec->len = 0;
     vec->cap = 0;
 }
@@ -337,9 +393,9 @@ int sptNewElementIndexVector(sptElementIndexVector *vec, sptNnzIndex len, sptNnz
     }
     vec->len = len;
     vec->cap = cap;
-    vec->data = malloc(cap * sizeof *vec->data);
+    vec->data = sptMalloc(cap * sizeof *vec->data);
     spt_CheckOSError(!vec->data, "EleIdxVec New");
-    memset(vec->data, 0, cap * sizeof *vec->data);
+    sptFirstTouchZero(vec->data, cap * sizeof *vec->data);
     return 0;
 }
 
@@ -382,15 +438,8 @@ int sptCopyElementIndexVector(sptElementIndexVector *dest, const sptElementIndex
  */
 int sptAppendElementIndexVector(sptElementIndexVector *vec, sptElementIndex const value) {
     if(vec->cap <= vec->len) {
-#ifndef MEMCHECK_MODE
-        sptNnzIndex newcap = vec->cap + vec->cap/2;
-#else
-        sptNnzIndex newcap = vec->len+1;
-#endif
-        sptElementIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "EleIdxVec Append");
-        vec->cap = newcap;
-        vec->data = newdata;
+        int result = sptReserveElementIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + 1));
+        spt_CheckError(result, "EleIdxVec Append", NULL);
     }
     vec->data[vec->len] = value;
     ++vec->len;
@@ -406,19 +455,48 @@ int sptAppendElementIndexVector(sptElementIndexVector *vec, sptElementIndex cons
  * The values from `append_vec` will be appended to `vec`.
  */
 int sptAppendElementIndexVectorWithVector(sptElementIndexVector *vec, const sptElementIndexVector *append_vec) {
-    sptNnzIndex newlen = vec->len + append_vec->len;
-    if(vec->cap <= newlen) {
-        sptNnzIndex newcap = vec->cap + append_vec->cap;
-        sptElementIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "EleIdxVec Append EleIdxVec");
-        vec->cap = newcap;
+    int result = sptAppendElementIndexVectorN(vec, append_vec->data, append_vec->len);
+    spt_CheckError(result, "EleIdxVec Append EleIdxVec", NULL);
+    return 0;
+}
+
+/**
+ * Reserve room in an element index vector without changing its length
+ *
+ * @param vec a pointer to a valid element index vector
+ * @param cap the number of values to make room for
+ *
+ * Appends up to `cap` values then need no reallocation. The capacity is never
+ * shrunk, use `sptResizeElementIndexVector` for that.
+ */
+int sptReserveElementIndexVector(sptElementIndexVector *vec, sptNnzIndex const cap) {
+    if(cap > vec->cap) {
+        sptElementIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, cap * sizeof *vec->data, SPT_MEM_DEFAULT);
+        spt_CheckOSError(!newdata, "EleIdxVec Reserve");
+        vec->cap = cap;
         vec->data = newdata;
     }
-    for(sptNnzIndex i=0; i<append_vec->len; ++i) {
-        vec->data[vec->len + i] = append_vec->data[i];
-    }
-    vec->len = newlen;
+    return 0;
+}
 
+/**
+ * Add n values to the end of an element index vector at once
+ *
+ * @param vec    a pointer to a valid element index vector
+ * @param values the values to be appended, not inside `vec`, or NULL to leave them undefined for the caller to fill
+ * @param n      the number of values
+ *
+ * The capacity grows by the same policy as a single append.
+ */
+int sptAppendElementIndexVectorN(sptElementIndexVector *vec, const sptElementIndex *values, sptNnzIndex const n) {
+    if(vec->cap < vec->len + n) {
+        int result = sptReserveElementIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + n));
+        spt_CheckError(result, "EleIdxVec AppendN", NULL);
+    }
+    if(values != NULL && n != 0) {
+        memcpy(vec->data + vec->len, values, n * sizeof *vec->data);
+    }
+    vec->len += n;
     return 0;
 }
 
@@ -435,7 +513,7 @@ int sptAppendElementIndexVectorWithVector(sptElementIndexVector *vec, const sptE
 int sptResizeElementIndexVector(sptElementIndexVector *vec, sptNnzIndex const size) {
     sptNnzIndex newcap = size < 2 ? 2 : size;
     if(newcap != vec->cap) {
-        sptElementIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
+        sptElementIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, newcap * sizeof *vec->data, SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "EleIdxVec Resize");
         vec->len = size;
         vec->cap = newcap;
@@ -453,7 +531,7 @@ int sptResizeElementIndexVector(sptElementIndexVector *vec, sptNnzIndex const si
  *
  */
 void sptFreeElementIndexVector(sptElementIndexVector *vec) {
-    free(vec->data);
+    sptFree(vec->data);
     vec->len = 0;
     vec->cap = 0;
 }
@@ -478,9 +556,9 @@ int sptNewBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex len, sptNnzInde
     }
     vec->len = len;
     vec->cap = cap;
-    vec->data = malloc(cap * sizeof *vec->data);
+    vec->data = sptMalloc(cap * sizeof *vec->data);
     spt_CheckOSError(!vec->data, "BlkIdxVec New");
-    memset(vec->data, 0, cap * sizeof *vec->data);
+    sptFirstTouchZero(vec->data, cap * sizeof *vec->data);
     return 0;
 }
 
@@ -523,15 +601,8 @@ int sptCopyBlockIndexVector(sptBlockIndexVector *dest, const sptBlockIndexVector
  */
 int sptAppendBlockIndexVector(sptBlockIndexVector *vec, sptBlockIndex const value) {
     if(vec->cap <= vec->len) {
-#ifndef MEMCHECK_MODE
-        sptNnzIndex newcap = vec->cap + vec->cap/2;
-#else
-        sptNnzIndex newcap = vec->len+1;
-#endif
-        sptBlockIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "BlkIdxVec Append");
-        vec->cap = newcap;
-        vec->data = newdata;
+        int result = sptReserveBlockIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + 1));
+        spt_CheckError(result, "BlkIdxVec Append", NULL);
     }
     vec->data[vec->len] = value;
     ++vec->len;
@@ -547,19 +618,48 @@ int sptAppendBlockIndexVector(sptBlockIndexVector *vec, sptBlockIndex const valu
  * The values from `append_vec` will be appended to `vec`.
  */
 int sptAppendBlockIndexVectorWithVector(sptBlockIndexVector *vec, const sptBlockIndexVector *append_vec) {
-    sptNnzIndex newlen = vec->len + append_vec->len;
-    if(vec->cap <= newlen) {
-        sptNnzIndex newcap = vec->cap + append_vec->cap;
-        sptBlockIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "BlkIdxVec Append BlkIdxVec");
-        vec->cap = newcap;
+    int result = sptAppendBlockIndexVectorN(vec, append_vec->data, append_vec->len);
+    spt_CheckError(result, "BlkIdxVec Append BlkIdxVec", NULL);
+    return 0;
+}
+
+/**
+ * Reserve room in a block index vector without changing its length
+ *
+ * @param vec a pointer to a valid block index vector
+ * @param cap the number of values to make room for
+ *
+ * Appends up to `cap` values then need no reallocation. The capacity is never
+ * shrunk, use `sptResizeBlockIndexVector` for that.
+ */
+int sptReserveBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex const cap) {
+    if(cap > vec->cap) {
+        sptBlockIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, cap * sizeof *vec->data, SPT_MEM_DEFAULT);
+        spt_CheckOSError(!newdata, "BlkIdxVec Reserve");
+        vec->cap = cap;
         vec->data = newdata;
     }
-    for(sptNnzIndex i=0; i<append_vec->len; ++i) {
-        vec->data[vec->len + i] = append_vec->data[i];
-    }
-    vec->len = newlen;
+    return 0;
+}
 
+/**
+ * Add n values to the end of a block index vector at once
+ *
+ * @param vec    a pointer to a valid block index vector
+ * @param values the values to be appended, not inside `vec`, or NULL to leave them undefined for the caller to fill
+ * @param n      the number of values
+ *
+ * The capacity grows by the same policy as a single append.
+ */
+int sptAppendBlockIndexVectorN(sptBlockIndexVector *vec, const sptBlockIndex *values, sptNnzIndex const n) {
+    if(vec->cap < vec->len + n) {
+        int result = sptReserveBlockIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + n));
+        spt_CheckError(result, "BlkIdxVec AppendN", NULL);
+    }
+    if(values != NULL && n != 0) {
+        memcpy(vec->data + vec->len, values, n * sizeof *vec->data);
+    }
+    vec->len += n;
     return 0;
 }
 
@@ -576,7 +676,7 @@ int sptAppendBlockIndexVectorWithVector(sptBlockIndexVector *vec, const sptBlock
 int sptResizeBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex const size) {
     sptNnzIndex newcap = size < 2 ? 2 : size;
     if(newcap != vec->cap) {
-        sptBlockIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
+        sptBlockIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, newcap * sizeof *vec->data, SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "BlkIdxVec Resize");
         vec->len = size;
         vec->cap = newcap;
@@ -594,7 +694,7 @@ int sptResizeBlockIndexVector(sptBlockIndexVector *vec, sptNnzIndex const size)
  *
  */
 void sptFreeBlockIndexVector(sptBlockIndexVector *vec) {
-    free(vec->data);
+    sptFree(vec->data);
     vec->len = 0;
     vec->cap = 0;
 }
@@ -619,9 +719,9 @@ int sptNewNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex len, sptNnzIndex ca
     }
     vec->len = len;
     vec->cap = cap;
-    vec->data = malloc(cap * sizeof *vec->data);
+    vec->data = sptMalloc(cap * sizeof *vec->data);
     spt_CheckOSError(!vec->data, "NnzIdxVec New");
-    memset(vec->data, 0, cap * sizeof *vec->data);
+    sptFirstTouchZero(vec->data, cap * sizeof *vec->data);
     return 0;
 }
 
@@ -664,15 +764,8 @@ int sptCopyNnzIndexVector(sptNnzIndexVector *dest, const sptNnzIndexVector *src)
  */
 int sptAppendNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const value) {
     if(vec->cap <= vec->len) {
-#ifndef MEMCHECK_MODE
-        sptNnzIndex newcap = vec->cap + vec->cap/2;
-#else
-        sptNnzIndex newcap = vec->len+1;
-#endif
-        sptNnzIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "NnzIdxVec Append");
-        vec->cap = newcap;
-        vec->data = newdata;
+        int result = sptReserveNnzIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + 1));
+        spt_CheckError(result, "NnzIdxVec Append", NULL);
     }
     vec->data[vec->len] = value;
     ++vec->len;
@@ -688,19 +781,48 @@ int sptAppendNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const value) {
  * The values from `append_vec` will be appended to `vec`.
  */
 int sptAppendNnzIndexVectorWithVector(sptNnzIndexVector *vec, const sptNnzIndexVector *append_vec) {
-    sptNnzIndex newlen = vec->len + append_vec->len;
-    if(vec->cap <= newlen) {
-        sptNnzIndex newcap = vec->cap + append_vec->cap;
-        sptNnzIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
-        spt_CheckOSError(!newdata, "NnzIdxVec Append NnzIdxVec");
-        vec->cap = newcap;
+    int result = sptAppendNnzIndexVectorN(vec, append_vec->data, append_vec->len);
+    spt_CheckError(result, "NnzIdxVec Append NnzIdxVec", NULL);
+    return 0;
+}
+
+/**
+ * Reserve room in a long nnz index vector without changing its length
+ *
+ * @param vec a pointer to a valid long nnz index vector
+ * @param cap the number of values to make room for
+ *
+ * Appends up to `cap` values then need no reallocation. The capacity is never
+ * shrunk, use `sptResizeNnzIndexVector` for that.
+ */
+int sptReserveNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const cap) {
+    if(cap > vec->cap) {
+        sptNnzIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, cap * sizeof *vec->data, SPT_MEM_DEFAULT);
+        spt_CheckOSError(!newdata, "NnzIdxVec Reserve");
+        vec->cap = cap;
         vec->data = newdata;
     }
-    for(sptNnzIndex i=0; i<append_vec->len; ++i) {
-        vec->data[vec->len + i] = append_vec->data[i];
-    }
-    vec->len = newlen;
+    return 0;
+}
 
+/**
+ * Add n values to the end of a long nnz index vector at once
+ *
+ * @param vec    a pointer to a valid long nnz index vector
+ * @param values the values to be appended, not inside `vec`, or NULL to leave them undefined for the caller to fill
+ * @param n      the number of values
+ *
+ * The capacity grows by the same policy as a single append.
+ */
+int sptAppendNnzIndexVectorN(sptNnzIndexVector *vec, const sptNnzIndex *values, sptNnzIndex const n) {
+    if(vec->cap < vec->len + n) {
+        int result = sptReserveNnzIndexVector(vec, spt_VectorGrowCap(vec->cap, vec->len + n));
+        spt_CheckError(result, "NnzIdxVec AppendN", NULL);
+    }
+    if(values != NULL && n != 0) {
+        memcpy(vec->data + vec->len, values, n * sizeof *vec->data);
+    }
+    vec->len += n;
     return 0;
 }
 
@@ -717,7 +839,7 @@ int sptAppendNnzIndexVectorWithVector(sptNnzIndexVector *vec, const sptNnzIndexV
 int sptResizeNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const size) {
     sptNnzIndex newcap = size < 2 ? 2 : size;
     if(newcap != vec->cap) {
-        sptNnzIndex *newdata = realloc(vec->data, newcap * sizeof *vec->data);
+        sptNnzIndex *newdata = spt_Realloc(vec->data, vec->len * sizeof *vec->data, newcap * sizeof *vec->data, SPT_MEM_DEFAULT);
         spt_CheckOSError(!newdata, "NnzIdxVec Resize");
         vec->len = size;
         vec->cap = newcap;
@@ -735,7 +857,7 @@ int sptResizeNnzIndexVector(sptNnzIndexVector *vec, sptNnzIndex const size) {
  *
  */
 void sptFreeNnzIndexVector(sptNnzIndexVector *vec) {
-    free(vec->data);
+    sptFree(vec->data);
     vec->len = 0;
     vec->cap = 0;
 }
@@ -10,8 +10,8 @@ export CTEST_OUTPUT_ON_FAILURE=1
 
 if cd build
 then
-    ctest -M Experimental -T MemCheck "$@"
-    ctest -M Experimental -T Coverage "$@"
+    ctest -M Experimental -T MemCheck -LE perf "$@"
+    ctest -M Experimental -T Coverage -LE perf "$@"
 else
     echo "Please run './build.sh' first."
 fi
@@ -0,0 +1,66 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARTI_TESTS_CPD_FIT_H
+#define PARTI_TESTS_CPD_FIT_H
+
+#include <ParTI.h>
+#include <math.h>
+
+/* The fit of factors vals[m] (row stride `stride`) and lambda to X, from the model itself */
+static inline double model_fit_values(sptSparseTensor const * X, sptIndex const rank, sptIndex const stride, sptValue ** vals, sptValue const * lambda) {
+    double normsq = 0, inner = 0, model_normsq = 0;
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        double model = 0;
+        for(sptIndex r = 0; r < rank; ++r) {
+            double v = lambda[r];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                v *= vals[m][X->inds[m].data[x] * stride + r];
+            }
+            model += v;
+        }
+        normsq += X->values.data[x] * X->values.data[x];
+        inner += X->values.data[x] * model;
+    }
+    for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex s = 0; s < rank; ++s) {
+            double v = lambda[r] * lambda[s];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                double g = 0;
+                for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+                    g += vals[m][i * stride + r] * vals[m][i * stride + s];
+                }
+                v *= g;
+            }
+            model_normsq += v;
+        }
+    }
+    double const resid = normsq + model_normsq - 2 * inner;
+    return 1 - sqrt(resid > 0 ? resid : 0) / sqrt(normsq);
+}
+
+/* The fit of a Kruskal tensor to X, computed from scratch */
+static inline double model_fit(sptSparseTensor const * X, sptKruskalTensor const * kt) {
+    sptValue * vals[X->nmodes];
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        vals[m] = kt->factors[m]->values;
+    }
+    return model_fit_values(X, kt->rank, kt->factors[0]->stride, vals, kt->lambda);
+}
+
+#endif
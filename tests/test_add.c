@@ -0,0 +1,136 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 20
+#define J 15
+#define K 11
+
+/* Random tensor over the I x J x K grid, built in natural order; small integer values are exact in float */
+static int spt_RandomTensor(sptSparseTensor *tsr, double *dense, int percent, double const *same_as) {
+    sptIndex const ndims[] = { I, J, K };
+    int result = sptNewSparseTensor(tsr, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptIndex i = 0; i < I; ++i) {
+        for(sptIndex j = 0; j < J; ++j) {
+            for(sptIndex k = 0; k < K; ++k) {
+                double *cell = &dense[(i * J + j) * K + k];
+                *cell = 0;
+                if(rand() % 100 >= percent) {
+                    continue;
+                }
+                /* Reuse the other tensor's value now and then so X - Y cancels */
+                *cell = same_as != NULL && same_as[(i * J + j) * K + k] != 0 && rand() % 4 == 0 ?
+                    same_as[(i * J + j) * K + k] : (double) (rand() % 19 - 9);
+                if(*cell == 0) {
+                    *cell = 10;
+                }
+                sptAppendIndexVector(&tsr->inds[0], i);
+                sptAppendIndexVector(&tsr->inds[1], j);
+                sptAppendIndexVector(&tsr->inds[2], k);
+                sptAppendValueVector(&tsr->values, *cell);
+                ++tsr->nnz;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Z must hold exactly the nonzeros of x + sign * y, in natural order */
+static int spt_CheckMerge(const sptSparseTensor *Z, double const *x, double const *y, double sign) {
+    sptNnzIndex z = 0;
+    for(sptIndex i = 0; i < I; ++i) {
+        for(sptIndex j = 0; j < J; ++j) {
+            for(sptIndex k = 0; k < K; ++k) {
+                double const expect = x[(i * J + j) * K + k] + sign * y[(i * J + j) * K + k];
+                if(expect == 0) {
+                    continue;
+                }
+                if(z >= Z->nnz || Z->inds[0].data[z] != i || Z->inds[1].data[z] != j || Z->inds[2].data[z] != k ||
+                    Z->values.data[z] != expect) {
+                    return 1;
+                }
+                ++z;
+            }
+        }
+    }
+    return z != Z->nnz;
+}
+
+int main(void) {
+    static double x[I * J * K], y[I * J * K];
+    sptSparseTensor X, Y, Z;
+    int result;
+
+    srand(11);
+    spt_RandomTensor(&X, x, 30, NULL);
+    spt_RandomTensor(&Y, y, 40, x);
+
+    result = sptSparseTensorAdd(&Z, &X, &Y);
+    spt_CheckError(result, "add", NULL);
+    if(spt_CheckMerge(&Z, x, y, 1) != 0) {
+        printf("sptSparseTensorAdd failed\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+
+    result = sptSparseTensorSub(&Z, &X, &Y);
+    spt_CheckError(result, "sub", NULL);
+    if(spt_CheckMerge(&Z, x, y, -1) != 0) {
+        printf("sptSparseTensorSub failed\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+
+    /* More partitions than nonzeros in one input exercise empty and tied splits */
+    int const nts[] = { 1, 2, 3, 7, 64 };
+    for(size_t t = 0; t < sizeof nts / sizeof nts[0]; ++t) {
+        sptSparseTensor R;
+        sptCopySparseTensor(&R, &Y, 1);
+        result = sptSparseTensorAddOMP(&R, &X, nts[t]);
+        spt_CheckError(result, "add omp", NULL);
+        if(spt_CheckMerge(&R, y, x, 1) != 0) {
+            printf("sptSparseTensorAddOMP failed with %d threads\n", nts[t]);
+            return 1;
+        }
+        result = sptSparseTensorSubOMP(&R, &X, nts[t]);
+        spt_CheckError(result, "sub omp", NULL);
+        if(spt_CheckMerge(&R, y, x, 0) != 0) {
+            printf("sptSparseTensorSubOMP failed with %d threads\n", nts[t]);
+            return 1;
+        }
+        sptFreeSparseTensor(&R);
+    }
+
+    /* Subtracting a tensor from itself leaves nothing */
+    result = sptSparseTensorSub(&Z, &X, &X);
+    spt_CheckError(result, "sub self", NULL);
+    if(Z.nnz != 0) {
+        printf("X - X is not empty\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
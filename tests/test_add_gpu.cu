@@ -0,0 +1,153 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+static void random_tensor(sptSparseTensor *X, sptIndex const ndims[], sptNnzIndex nnz) {
+    sptNewSparseTensor(X, 3, ndims);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X->inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X->values, (sptValue) (rand() % 7 - 3));
+    }
+    X->nnz = nnz;
+}
+
+/* Sum duplicates and drop zeros, so that the host result compares with the device's */
+static void canonical(sptSparseTensor *X) {
+    sptSparseTensorSortIndex(X, 1);
+    sptNnzIndex out = 0;
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        int same = out > 0;
+        for(sptIndex m = 0; m < X->nmodes && same; ++m) {
+            same = X->inds[m].data[out - 1] == X->inds[m].data[z];
+        }
+        if(same) {
+            X->values.data[out - 1] += X->values.data[z];
+            continue;
+        }
+        if(out > 0 && X->values.data[out - 1] == 0) {
+            --out;
+        }
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            X->inds[m].data[out] = X->inds[m].data[z];
+        }
+        X->values.data[out++] = X->values.data[z];
+    }
+    if(out > 0 && X->values.data[out - 1] == 0) {
+        --out;
+    }
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        X->inds[m].len = out;
+    }
+    X->values.len = out;
+    X->nnz = out;
+}
+
+static int same_tensor(sptSparseTensor const *A, sptSparseTensor const *B, char const *name) {
+    if(A->nnz != B->nnz) {
+        printf("%s: %lu nonzeros, expected %lu\n", name, (unsigned long) A->nnz, (unsigned long) B->nnz);
+        return 0;
+    }
+    for(sptNnzIndex z = 0; z < A->nnz; ++z) {
+        for(sptIndex m = 0; m < A->nmodes; ++m) {
+            if(A->inds[m].data[z] != B->inds[m].data[z]) {
+                printf("%s: index mismatch at %lu\n", name, (unsigned long) z);
+                return 0;
+            }
+        }
+        if(A->values.data[z] != B->values.data[z]) {
+            printf("%s: value mismatch at %lu\n", name, (unsigned long) z);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main() {
+    sptIndex const ndims[] = { 40, 30, 20 };
+    srand(7);
+    sptSparseTensor X, Y;
+    random_tensor(&X, ndims, 3000);
+    random_tensor(&Y, ndims, 2000);
+    canonical(&X);
+    canonical(&Y);
+
+    sptSparseTensor ref, Z;
+    int result = sptSparseTensorAdd(&ref, &X, &Y);
+    spt_CheckError(result, "add", NULL);
+    canonical(&ref);
+    result = sptCudaSparseTensorAdd(&Z, &X, &Y);
+    spt_CheckError(result, "cuda add", NULL);
+    if(!same_tensor(&Z, &ref, "add")) {
+        return 1;
+    }
+    sptFreeSparseTensor(&ref);
+    sptFreeSparseTensor(&Z);
+
+    result = sptSparseTensorSub(&ref, &X, &Y);
+    spt_CheckError(result, "sub", NULL);
+    canonical(&ref);
+    result = sptCudaSparseTensorSub(&Z, &X, &Y);
+    spt_CheckError(result, "cuda sub", NULL);
+    if(!same_tensor(&Z, &ref, "sub")) {
+        return 1;
+    }
+    sptFreeSparseTensor(&ref);
+    sptFreeSparseTensor(&Z);
+
+    /* On the device from upload to download, X - Y + Y and X .* Y */
+    sptDeviceSparseTensor dX, dY, dD, dS, dP;
+    sptDeviceUploadSparseTensor(&dX, &X);
+    sptDeviceUploadSparseTensor(&dY, &Y);
+    result = sptDeviceSparseTensorSub(&dD, &dX, &dY);
+    spt_CheckError(result, "device sub", NULL);
+    result = sptDeviceSparseTensorAdd(&dS, &dD, &dY);
+    spt_CheckError(result, "device add", NULL);
+    result = sptDeviceSparseTensorDotMul(&dP, &dX, &dY);
+    spt_CheckError(result, "device dotmul", NULL);
+    result = sptDeviceDownloadSparseTensor(&Z, &dS);
+    spt_CheckError(result, "download", NULL);
+    if(!same_tensor(&Z, &X, "sub then add")) {
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+    result = sptSparseTensorDotMul(&ref, &X, &Y);
+    spt_CheckError(result, "dotmul", NULL);
+    result = sptDeviceDownloadSparseTensor(&Z, &dP);
+    spt_CheckError(result, "download", NULL);
+    canonical(&ref);
+    if(!same_tensor(&Z, &ref, "dotmul")) {
+        return 1;
+    }
+    sptFreeSparseTensor(&ref);
+    sptFreeSparseTensor(&Z);
+
+    sptFreeDeviceSparseTensor(&dX);
+    sptFreeDeviceSparseTensor(&dY);
+    sptFreeDeviceSparseTensor(&dD);
+    sptFreeDeviceSparseTensor(&dS);
+    sptFreeDeviceSparseTensor(&dP);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
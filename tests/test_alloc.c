@@ -0,0 +1,215 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+#define spt_IsAligned(p) (((uintptr_t) (p)) % PARTI_VECTOR_ALIGN == 0)
+
+/* Counting allocator on top of posix_memalign */
+static size_t spt_live_bytes = 0;
+
+static void * spt_CountingAlloc(size_t bytes, void * ctx) {
+    void * ptr;
+    if(posix_memalign(&ptr, PARTI_VECTOR_ALIGN, bytes) != 0) {
+        return NULL;
+    }
+    *(size_t *) ctx += bytes;
+    return ptr;
+}
+
+static void spt_CountingRelease(void * ptr, size_t bytes, void * ctx) {
+    *(size_t *) ctx -= bytes;
+    free(ptr);
+}
+
+int main(void) {
+    {
+        /* Vectors go through a custom allocator, and return all of it */
+        sptAllocator const counting = { spt_CountingAlloc, spt_CountingRelease, &spt_live_bytes };
+        sptSetAllocator(&counting);
+        sptValueVector vec;
+        sptNewValueVector(&vec, 0, 0);
+        for(int i = 0; i < 1000; ++i) {
+            sptAppendValueVector(&vec, (sptValue) i);
+        }
+        if(spt_live_bytes < 1000 * sizeof (sptValue) || vec.data[999] != 999) {
+            printf("Custom allocator not used\n");
+            return 1;
+        }
+        sptSetAllocator(NULL);
+        /* Still released through the allocator it came from */
+        sptFreeValueVector(&vec);
+        if(spt_live_bytes != 0) {
+            printf("%lu bytes left in the custom allocator\n", (unsigned long) spt_live_bytes);
+            return 1;
+        }
+    }
+    {
+        /* An execution context's allocator is used by its thread only while it is set */
+        sptAllocator const counting = { spt_CountingAlloc, spt_CountingRelease, &spt_live_bytes };
+        sptExecContext ctx;
+        sptNewExecContext(&ctx, 2);
+        ctx.allocator = &counting;
+        sptExecContext const * const prev = sptSetExecContext(&ctx);
+        void * inside = sptMalloc(4096);
+        if(sptGetExecContext() != &ctx || sptExecThreads(0) != 2 || sptExecThreads(3) != 3 ||
+            sptMemBackingOf(inside) != SPT_MEM_CUSTOM || spt_live_bytes < 4096) {
+            printf("Execution context not applied\n");
+            return 1;
+        }
+        sptSetExecContext(prev);
+        void * outside = sptMalloc(4096);
+        if(sptGetExecContext() != NULL || sptMemBackingOf(outside) == SPT_MEM_CUSTOM) {
+            printf("Execution context not restored\n");
+            return 1;
+        }
+        sptFree(inside);
+        sptFree(outside);
+        if(spt_live_bytes != 0) {
+            printf("%lu bytes left in the context's allocator\n", (unsigned long) spt_live_bytes);
+            return 1;
+        }
+    }
+    {
+        /* Huge-page backed buffers behave like any other */
+        sptSetHugePages(SPT_MEM_HUGE_2MB);
+        size_t const n = (4 << 20) / sizeof (sptIndex);
+        sptIndex * big = sptMalloc(n * sizeof *big);
+        sptSetHugePages(SPT_MEM_DEFAULT);
+        if(big == NULL || !spt_IsAligned(big)) {
+            printf("Bad huge-page buffer\n");
+            return 1;
+        }
+        for(size_t i = 0; i < n; ++i) {
+            big[i] = (sptIndex) i;
+        }
+        if(big[n - 1] != (sptIndex) (n - 1)) {
+            printf("Huge-page buffer lost data\n");
+            return 1;
+        }
+        sptFree(big);
+    }
+    {
+        /* Tensors and matrices keep their requested backing as they grow */
+        sptIndex const ndims[] = { 1000, 1000 };
+        sptSparseTensor X;
+        int result = sptNewSparseTensorWithBacking(&X, 2, ndims, SPT_MEM_HUGE_2MB);
+        spt_CheckError(result, "new", NULL);
+        if(sptMemBackingOf(X.values.data) != SPT_MEM_DEFAULT) {
+            printf("Small buffer not on the heap\n");
+            return 1;
+        }
+        sptNnzIndex const nnz = 2 * PARTI_HUGE_PAGE_BYTES / sizeof (sptIndex);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            sptAppendIndexVector(&X.inds[0], (sptIndex) (z % 1000));
+            sptAppendIndexVector(&X.inds[1], (sptIndex) (z / 1000 % 1000));
+            sptAppendValueVector(&X.values, 1);
+        }
+        X.nnz = nnz;
+#ifdef __linux__
+        sptMemBacking const backing = sptMemBackingOf(X.inds[0].data);
+        if(backing != SPT_MEM_HUGE_2MB && backing != SPT_MEM_THP) {
+            printf("Large index array backed by %s\n", sptMemBackingString(backing));
+            return 1;
+        }
+#endif
+        sptSparseTensorStatus(&X, stdout);
+        sptFreeSparseTensor(&X);
+
+        sptMatrix U;
+        result = sptNewMatrixWithBacking(&U, 1 << 16, 16, SPT_MEM_HUGE_2MB);
+        spt_CheckError(result, "new", NULL);
+        for(sptIndex i = 0; i < 16; ++i) {
+            U.values[(U.nrows - 1) * U.stride + i] = 1;
+        }
+#ifdef __linux__
+        if(sptMemBackingOf(U.values) == SPT_MEM_DEFAULT) {
+            printf("Large matrix not on huge pages\n");
+            return 1;
+        }
+#endif
+        sptFreeMatrix(&U);
+    }
+    {
+        /* Scratch blocks may be released in any order and their space is reused */
+        char * a = spt_ScratchAlloc(100);
+        char * b = spt_ScratchAlloc(200);
+        char * c = spt_ScratchAlloc(300);
+        if(!spt_IsAligned(a) || !spt_IsAligned(b) || !spt_IsAligned(c) || a == b || b == c) {
+            printf("Bad scratch blocks\n");
+            return 1;
+        }
+        memset(a, 1, 100);
+        memset(b, 2, 200);
+        memset(c, 3, 300);
+        spt_ScratchFree(b);
+        char * d = spt_ScratchAlloc(50);
+        memset(d, 4, 50);
+        if(d == b || a[99] != 1 || c[0] != 3 || c[299] != 3) {
+            printf("Scratch block reused while live\n");
+            return 1;
+        }
+        spt_ScratchFree(a);
+        spt_ScratchFree(d);
+        spt_ScratchFree(c);
+        char * e = spt_ScratchAlloc(100);
+#if !defined(MEMCHECK_MODE)
+        if(e != a) {
+            printf("Scratch arena not reused after release\n");
+            return 1;
+        }
+#endif
+        spt_ScratchFree(e);
+        /* Larger than the arena falls back to the heap */
+        char * huge = spt_ScratchAlloc(4 * PARTI_SCRATCH_BYTES);
+        if(huge == NULL) {
+            printf("Oversized scratch failed\n");
+            return 1;
+        }
+        memset(huge, 5, 4 * PARTI_SCRATCH_BYTES);
+        spt_ScratchFree(huge);
+        sptFreeScratch();
+    }
+    {
+        /* Each thread has its own arena */
+        int bad = 0;
+        #pragma omp parallel reduction(+:bad)
+        {
+            for(int rep = 0; rep < 100; ++rep) {
+                sptIndex * mine = spt_ScratchAlloc(64 * sizeof *mine);
+                for(sptIndex i = 0; i < 64; ++i) {
+                    mine[i] = (sptIndex) rep;
+                }
+                for(sptIndex i = 0; i < 64; ++i) {
+                    bad += mine[i] != (sptIndex) rep;
+                }
+                spt_ScratchFree(mine);
+            }
+            sptFreeScratch();
+        }
+        if(bad != 0) {
+            printf("Scratch blocks shared between threads\n");
+            return 1;
+        }
+    }
+    return 0;
+}
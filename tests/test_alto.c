@@ -0,0 +1,131 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* ALTO MTTKRP must match COO MTTKRP on every mode, with 64- and 128-bit keys */
+static int check_alto(sptSparseTensor *X, unsigned nbits, int tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = 6;
+    sptSparseTensorALTO alto;
+    int result = sptSparseTensorToALTO(&alto, X, tk);
+    spt_CheckError(result, "to alto", NULL);
+    if(alto.nbits != nbits || (alto.keys_hi != NULL) != (nbits > 64)) {
+        printf("ALTO key has %u bits, expected %u\n", alto.nbits, nbits);
+        return 1;
+    }
+
+    sptIndex max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? X->ndims[m] : max_dim;
+        sptNewMatrix(mats[m], nrows, R);
+        sptRandomizeMatrix(mats[m], nrows, R);
+    }
+    sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+    sptValue * ref = malloc((size_t)max_dim * mats[0]->stride * sizeof *ref);
+
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes && !failed; ++mode) {
+        mats_order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            mats_order[i] = (mode+i) % nmodes;
+        }
+        mats[nmodes]->nrows = X->ndims[mode];
+        sptMTTKRP(X, mats, mats_order, mode);
+        memcpy(ref, mats[nmodes]->values, (size_t)X->ndims[mode] * mats[0]->stride * sizeof *ref);
+        /* Entries may cancel to near zero, rounding follows the largest */
+        double scale = 0;
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                scale = fmax(scale, fabs(ref[i * mats[0]->stride + r]));
+            }
+        }
+
+        result = sptOmpMTTKRPALTO(&alto, mats, mode, tk);
+        spt_CheckError(result, "alto mttkrp", NULL);
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptValue const a = ref[i * mats[0]->stride + r];
+                sptValue const b = mats[nmodes]->values[i * mats[0]->stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    failed = 1;
+                }
+            }
+        }
+        if(failed) {
+            printf("ALTO MTTKRP mismatch on mode %"PARTI_PRI_INDEX", tk %d\n", mode, tk);
+        }
+    }
+
+    free(ref);
+    free(mats_order);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+    sptFreeSparseTensorALTO(&alto);
+    return failed;
+}
+
+static void fill_random(sptSparseTensor *X, sptNnzIndex nnz) {
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            sptAppendIndexVector(&X->inds[m], (sptIndex) (rand() % X->ndims[m]));
+        }
+        sptAppendValueVector(&X->values, (sptValue) (rand() % 100) / 10);
+    }
+    X->nnz = nnz;
+}
+
+int main(void) {
+    /* 5 + 3 + 6 (+ 3) bits */
+    sptIndex const ndims[] = { 23, 7, 41, 5 };
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        fill_random(&X, 3000);
+        unsigned const nbits = nmodes == 3 ? 14 : 17;
+        if(check_alto(&X, nbits, 1) != 0 || check_alto(&X, nbits, 3) != 0) {
+            return 1;
+        }
+        sptFreeSparseTensor(&X);
+    }
+
+    /* Four modes of 2^16 + 1 need 68 bits */
+    sptIndex const wide_dims[] = { (1 << 16) + 1, (1 << 16) + 1, (1 << 16) + 1, (1 << 16) + 1 };
+    sptSparseTensor W;
+    int result = sptNewSparseTensor(&W, 4, wide_dims);
+    spt_CheckError(result, "new", NULL);
+    fill_random(&W, 500);
+    for(sptIndex m = 0; m < 4; ++m) {
+        W.inds[m].data[0] = wide_dims[m] - 1;
+    }
+    if(check_alto(&W, 68, 2) != 0) {
+        return 1;
+    }
+    sptFreeSparseTensor(&W);
+    return 0;
+}
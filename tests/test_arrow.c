@@ -0,0 +1,132 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+
+static struct ArrowSchema spt_Field(char const * format) {
+    struct ArrowSchema s;
+    memset(&s, 0, sizeof s);
+    s.format = format;
+    return s;
+}
+
+static struct ArrowArray spt_Column(void const ** buffers, int64_t const length) {
+    struct ArrowArray a;
+    memset(&a, 0, sizeof a);
+    a.length = length;
+    a.n_buffers = 2;
+    a.buffers = buffers;
+    return a;
+}
+
+/* Arrow batches must import in place where the types allow, converted elsewhere, with inferred sizes */
+int main(void) {
+    enum { N = 1000 };
+    uint32_t * i0 = malloc(N * sizeof *i0);
+    int64_t * i1 = malloc(N * sizeof *i1);
+    uint16_t * i2 = malloc(N * sizeof *i2);
+    double * v = malloc(N * sizeof *v);
+    for(int z = 0; z < N; ++z) {
+        i0[z] = (z * 7) % 50;
+        i1[z] = (z * 13) % 300;
+        i2[z] = (uint16_t) (z % 9);
+        v[z] = 0.5 * z - 3;
+    }
+    void const * b0[2] = { NULL, i0 }, * b1[2] = { NULL, i1 }, * b2[2] = { NULL, i2 }, * bv[2] = { NULL, v };
+    struct ArrowSchema f0 = spt_Field("I"), f1 = spt_Field("l"), f2 = spt_Field("S"), fv = spt_Field("g");
+    struct ArrowArray c0 = spt_Column(b0, N), c1 = spt_Column(b1, N), c2 = spt_Column(b2, N), cv = spt_Column(bv, N);
+    struct ArrowSchema * fields[4] = { &f0, &f1, &f2, &fv };
+    struct ArrowArray * columns[4] = { &c0, &c1, &c2, &cv };
+    struct ArrowSchema schema = spt_Field("+s");
+    schema.n_children = 4;
+    schema.children = fields;
+    void const * bs[1] = { NULL };
+    struct ArrowArray batch = spt_Column(bs, N);
+    batch.n_buffers = 1;
+    batch.n_children = 4;
+    batch.children = columns;
+
+    sptSparseTensor X;
+    int result = sptImportArrowSparseTensor(&X, &schema, &batch, 3, 0, NULL, 2);
+    spt_CheckError(result, "import", NULL);
+    if(X.nnz != N || X.ndims[0] != 50 || X.ndims[1] != 300 || X.ndims[2] != 9) {
+        printf("Inferred sizes %"PARTI_PRI_INDEX" x %"PARTI_PRI_INDEX" x %"PARTI_PRI_INDEX"\n", X.ndims[0], X.ndims[1], X.ndims[2]);
+        return 1;
+    }
+    /* Only the columns as wide as sptIndex and sptValue are used in place */
+    int const in_place0 = sizeof (sptIndex) == sizeof *i0, in_place1 = sizeof (sptIndex) == sizeof *i1;
+    int const in_place_values = sizeof (sptValue) == sizeof *v;
+    if(((void *) X.inds[0].data == (void *) i0) != in_place0 || ((void *) X.inds[1].data == (void *) i1) != in_place1 ||
+        ((void *) X.values.data == (void *) v) != in_place_values || (void *) X.inds[2].data == (void *) i2) {
+        printf("Wrong columns used in place\n");
+        return 1;
+    }
+    for(int z = 0; z < N; ++z) {
+        if(X.inds[0].data[z] != i0[z] || X.inds[1].data[z] != (sptIndex) i1[z] || X.inds[2].data[z] != i2[z] || X.values.data[z] != v[z]) {
+            printf("Mismatch at row %d\n", z);
+            return 1;
+        }
+    }
+    sptUnwrapArrowSparseTensor(&X, &batch);
+
+    /* One-based indices of a slice of the batch, given sizes, values converted from float */
+    float * vf = malloc(N * sizeof *vf);
+    for(int z = 0; z < N; ++z) {
+        vf[z] = (float) v[z];
+        i0[z] += 1;
+    }
+    void const * bf[2] = { NULL, vf };
+    struct ArrowSchema ff = spt_Field("f");
+    struct ArrowArray cf = spt_Column(bf, N);
+    fields[3] = &ff;
+    columns[3] = &cf;
+    batch.offset = 10;
+    batch.length = N - 10;
+    for(int z = 0; z < N; ++z) {
+        i1[z] += 1;
+        i2[z] += 1;
+    }
+    sptIndex const dims[] = { 60, 300, 9 };
+    result = sptImportArrowSparseTensor(&X, &schema, &batch, 3, 1, dims, 1);
+    spt_CheckError(result, "import", NULL);
+    if(X.nnz != N - 10 || X.ndims[0] != 60 || X.inds[0].data[0] != i0[10] - 1 || X.values.data[5] != v[15]) {
+        printf("One-based slice imported wrong\n");
+        return 1;
+    }
+    sptUnwrapArrowSparseTensor(&X, &batch);
+
+    /* A column past the given size is refused */
+    sptIndex const small[] = { 10, 300, 9 };
+    if(sptImportArrowSparseTensor(&X, &schema, &batch, 3, 1, small, 1) == 0) {
+        printf("Out of range index accepted\n");
+        return 1;
+    }
+
+    free(vf);
+    free(i0);
+    free(i1);
+    free(i2);
+    free(v);
+    return 0;
+}
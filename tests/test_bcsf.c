@@ -0,0 +1,116 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* B-CSF units must stay within one slice and the bound, and their fibers must rebuild the tensor */
+static int check_bcsf(sptSparseTensor *X, sptIndex mode, sptNnzIndex max_unit_nnz) {
+    sptIndex const nmodes = X->nmodes;
+    sptSparseTensorBCSF bcsf;
+    int result = sptSparseTensorToBCSF(&bcsf, X, mode, max_unit_nnz, 2);
+    spt_CheckError(result, "to bcsf", NULL);
+    if(max_unit_nnz == 0) {
+        max_unit_nnz = PARTI_BCSF_UNIT_NNZ;
+    }
+    if(bcsf.mode_order[0] != mode || bcsf.fptr.data[bcsf.nfibs] != X->nnz) {
+        printf("B-CSF of mode %"PARTI_PRI_INDEX" has the wrong root or leaf count\n", mode);
+        return 1;
+    }
+    for(sptNnzIndex u = 0; u < bcsf.nunits; ++u) {
+        sptNnzIndex const fbegin = bcsf.unit_ptr.data[u], fend = bcsf.unit_ptr.data[u+1];
+        if(fbegin >= fend || bcsf.fptr.data[fend] - bcsf.fptr.data[fbegin] > max_unit_nnz) {
+            printf("B-CSF unit %"PARTI_PRI_NNZ_INDEX" is empty or too heavy\n", u);
+            return 1;
+        }
+        for(sptNnzIndex f = fbegin; f < fend; ++f) {
+            if(bcsf.fids[0].data[f] != bcsf.fids[0].data[fbegin]) {
+                printf("B-CSF unit %"PARTI_PRI_NNZ_INDEX" spans two slices\n", u);
+                return 1;
+            }
+        }
+    }
+
+    /* Rebuild the COO tensor from the fiber paths and leaves */
+    sptSparseTensor Y;
+    result = sptNewSparseTensor(&Y, nmodes, X->ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex f = 0; f < bcsf.nfibs; ++f) {
+        for(sptNnzIndex z = bcsf.fptr.data[f]; z < bcsf.fptr.data[f+1]; ++z) {
+            for(sptIndex l = 0; l < nmodes; ++l) {
+                sptIndex const i = l + 1 < nmodes ? bcsf.fids[l].data[f] : bcsf.leaf_ids.data[z];
+                sptAppendIndexVector(&Y.inds[bcsf.mode_order[l]], i);
+            }
+            sptAppendValueVector(&Y.values, bcsf.values.data[z]);
+        }
+    }
+    Y.nnz = X->nnz;
+    sptSparseTensorSortIndex(X, 1);
+    sptSparseTensorSortIndex(&Y, 1);
+    /* Duplicates may come out in any order, so compare the sums of their values */
+    int failed = 0;
+    double xsum = 0, ysum = 0;
+    for(sptNnzIndex z = 0; z < X->nnz && !failed; ++z) {
+        int same = z + 1 < X->nnz;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            failed |= X->inds[m].data[z] != Y.inds[m].data[z];
+            same = same && X->inds[m].data[z] == X->inds[m].data[z+1];
+        }
+        xsum += X->values.data[z];
+        ysum += Y.values.data[z];
+        if(!same) {
+            failed |= fabs(xsum - ysum) > 1e-6;
+            xsum = ysum = 0;
+        }
+    }
+    if(failed) {
+        printf("B-CSF of mode %"PARTI_PRI_INDEX" does not rebuild the tensor\n", mode);
+    }
+    sptFreeSparseTensor(&Y);
+    sptFreeSparseTensorBCSF(&bcsf);
+    return failed;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 23, 7, 41, 5 };
+    for(sptIndex nmodes = 2; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 3000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                /* A heavy slice and fiber in every mode */
+                sptIndex const i = rand() % 3 == 0 ? 1 : (sptIndex) (rand() % ndims[m]);
+                sptAppendIndexVector(&X.inds[m], i);
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = 3000;
+
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            if(check_bcsf(&X, mode, 16) != 0 || check_bcsf(&X, mode, 0) != 0) {
+                return 1;
+            }
+        }
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+static int spt_CompareSparseTensors(const sptSparseTensor *a, const sptSparseTensor *b) {
+    if(a->nmodes != b->nmodes || a->nnz != b->nnz) {
+        return 1;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(a->ndims[m] != b->ndims[m] || a->sortorder[m] != b->sortorder[m]) {
+            return 1;
+        }
+        if(memcmp(a->inds[m].data, b->inds[m].data, a->nnz * sizeof (sptIndex)) != 0) {
+            return 1;
+        }
+    }
+    return memcmp(a->values.data, b->values.data, a->nnz * sizeof (sptValue)) != 0;
+}
+
+int main(void) {
+    static char bufX[] = "3\n"
+        "2 3 4\n"
+        "0 0 0 1\n"
+        "0 2 1 2\n"
+        "1 0 3 3\n"
+        "1 1 2 4\n"
+        "1 2 0 5\n";
+    FILE *stream = fmemopen(bufX, sizeof bufX - 1, "r");
+    sptSparseTensor X;
+    int result = sptLoadSparseTensor(&X, 0, stream);
+    spt_CheckError(result, "load", NULL);
+    fclose(stream);
+
+    char filename[] = "/tmp/parti_test_binary_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensorBinary(&X, stream);
+    spt_CheckError(result, "dump", NULL);
+    fclose(stream);
+
+    sptSparseTensor Y;
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptLoadSparseTensorBinary(&Y, stream);
+    spt_CheckError(result, "load binary", NULL);
+    fclose(stream);
+    if(spt_CompareSparseTensors(&X, &Y) != 0) {
+        printf("Binary load mismatch\n");
+        return 1;
+    }
+
+    sptSparseTensor Z;
+    result = sptMmapSparseTensor(&Z, filename);
+    spt_CheckError(result, "mmap", NULL);
+    if(spt_CompareSparseTensors(&X, &Z) != 0) {
+        printf("Mmap mismatch\n");
+        return 1;
+    }
+    if(sptMemBackingOf(Z.inds[0].data) != SPT_MEM_FILE || sptMemBackingOf(Z.values.data) != SPT_MEM_FILE) {
+        printf("Mapped arrays not reported as a mapped file\n");
+        return 1;
+    }
+    /* The mapping is private, in-place sorting must not touch the file */
+    sptSparseTensorSortIndexAtMode(&Z, 2, 0);
+    sptUnmapSparseTensor(&Z);
+    result = sptMmapSparseTensor(&Z, filename);
+    spt_CheckError(result, "mmap", NULL);
+    if(spt_CompareSparseTensors(&X, &Z) != 0) {
+        printf("Mmap file modified\n");
+        return 1;
+    }
+    sptUnmapSparseTensor(&Z);
+
+    /* A version 1 file, without the fingerprint, maps and loads; one mode makes its data offset differ from version 2 */
+    sptIndex const line_ndims[] = { 9 };
+    sptSparseTensor L;
+    result = sptNewSparseTensor(&L, 1, line_ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptIndex i = 0; i < 5; ++i) {
+        sptAppendIndexVector(&L.inds[0], 2 * i);
+        sptAppendValueVector(&L.values, (sptValue) i + 1);
+    }
+    L.nnz = 5;
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensorBinary(&L, stream);
+    spt_CheckError(result, "dump", NULL);
+    long const v2_size = ftell(stream);
+    fclose(stream);
+    char * v2 = malloc(v2_size);
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL || fread(v2, 1, v2_size, stream) != (size_t) v2_size, "read");
+    fclose(stream);
+    spt_SparseTensorBinaryHeader v1_header;
+    memcpy(&v1_header, v2, sizeof v1_header);
+    uint64_t const v2_offset = v1_header.data_offset;
+    v1_header.version = 1;
+    v1_header.data_offset = spt_BinaryAlignUp(spt_SparseTensorBinaryHeadBytes(1, 1));
+    if(v1_header.data_offset == v2_offset) {
+        printf("Version 1 and 2 data offsets coincide\n");
+        return 1;
+    }
+    static char const zeros[PARTI_BINARY_ALIGN] = { 0 };
+    uint64_t const v1_head = spt_SparseTensorBinaryHeadBytes(1, 1);
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    fwrite(&v1_header, sizeof v1_header, 1, stream);
+    fwrite(v2 + sizeof v1_header, 1, v1_head - sizeof v1_header, stream);
+    fwrite(zeros, 1, v1_header.data_offset - v1_head, stream);
+    fwrite(v2 + v2_offset, 1, v2_size - v2_offset, stream);
+    fclose(stream);
+    free(v2);
+    result = sptMmapSparseTensor(&Z, filename);
+    spt_CheckError(result, "mmap version 1", NULL);
+    if(spt_CompareSparseTensors(&L, &Z) != 0) {
+        printf("Version 1 mmap mismatch\n");
+        return 1;
+    }
+    sptUnmapSparseTensor(&Z);
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptLoadSparseTensorBinary(&Z, stream);
+    spt_CheckError(result, "load version 1", NULL);
+    fclose(stream);
+    if(spt_CompareSparseTensors(&L, &Z) != 0) {
+        printf("Version 1 load mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+    sptFreeSparseTensor(&L);
+
+    /* Wrapped caller arrays are used in place, sorted in place, and left to the caller */
+    sptSparseTensorSortIndex(&X, 0);
+    sptIndex * wrap_inds[3];
+    for(sptIndex m = 0; m < X.nmodes; ++m) {
+        wrap_inds[m] = malloc(X.nnz * sizeof (sptIndex));
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            wrap_inds[m][z] = X.inds[m].data[X.nnz - 1 - z];
+        }
+    }
+    sptValue * wrap_values = malloc(X.nnz * sizeof (sptValue));
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        wrap_values[z] = X.values.data[X.nnz - 1 - z];
+    }
+    result = sptWrapSparseTensor(&Z, X.nmodes, X.ndims, X.nnz, wrap_inds, wrap_values);
+    spt_CheckError(result, "wrap", NULL);
+    sptSparseTensorSortIndex(&Z, 1);
+    if(Z.inds[0].data != wrap_inds[0] || Z.values.data != wrap_values || spt_CompareSparseTensors(&X, &Z) != 0) {
+        printf("Wrapped tensor not sorted in place\n");
+        return 1;
+    }
+    sptUnwrapSparseTensor(&Z);
+    wrap_inds[0][0] = X.ndims[0];
+    if(sptWrapSparseTensor(&Z, X.nmodes, X.ndims, X.nnz, wrap_inds, wrap_values) == 0) {
+        printf("Out-of-range wrapped index accepted\n");
+        return 1;
+    }
+    for(sptIndex m = 0; m < X.nmodes; ++m) {
+        free(wrap_inds[m]);
+    }
+    free(wrap_values);
+
+    /* Narrower storage widths must convert back exactly, the values are small integers */
+    uint32_t const widths[][2] = { { 0, 4 }, { 2, 8 }, { 8, 4 } };
+    for(int w = 0; w < 3; ++w) {
+        stream = fopen(filename, "wb");
+        spt_CheckOSError(stream == NULL, "open");
+        result = sptDumpSparseTensorBinaryWidths(&X, stream, widths[w][0], widths[w][1]);
+        spt_CheckError(result, "dump widths", NULL);
+        fclose(stream);
+        stream = fopen(filename, "rb");
+        spt_CheckOSError(stream == NULL, "open");
+        result = sptLoadSparseTensorBinary(&Z, stream);
+        spt_CheckError(result, "load binary", NULL);
+        fclose(stream);
+        if(spt_CompareSparseTensors(&X, &Z) != 0) {
+            printf("Binary widths %u/%u mismatch\n", widths[w][0], widths[w][1]);
+            return 1;
+        }
+        sptFreeSparseTensor(&Z);
+    }
+
+    /* Prebuilt HiCOO tensors must reload with identical contents */
+    sptSparseTensorHiCOO hiX, hiY;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&hiX, &max_nnzb, &Y, 1, 2, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensorHiCOOBinary(&hiX, stream);
+    spt_CheckError(result, "dump hicoo", NULL);
+    fclose(stream);
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptLoadSparseTensorHiCOOBinary(&hiY, stream);
+    spt_CheckError(result, "load hicoo", NULL);
+    fclose(stream);
+
+    char *bufA = calloc(1, 4096), *bufB = calloc(1, 4096);
+    stream = fmemopen(bufA, 4095, "w");
+    sptDumpSparseTensorHiCOO(&hiX, stream);
+    fclose(stream);
+    stream = fmemopen(bufB, 4095, "w");
+    sptDumpSparseTensorHiCOO(&hiY, stream);
+    fclose(stream);
+    if(strcmp(bufA, bufB) != 0 || hiX.sb_bits != hiY.sb_bits || hiX.sk_bits != hiY.sk_bits || hiX.sc_bits != hiY.sc_bits) {
+        printf("HiCOO mismatch:\n%s\n%s", bufA, bufB);
+        return 1;
+    }
+    free(bufA);
+    free(bufB);
+    sptFreeSparseTensorHiCOO(&hiY);
+    sptFreeSparseTensorHiCOO(&hiX);
+
+    unlink(filename);
+    sptFreeSparseTensor(&Y);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+/* A calibration is plausible, survives a dump and load, and is kept in PARTI_MACHINE_PROFILE */
+int main(void) {
+    sptMachineProfile profile;
+    int result = sptCalibrateMachine(&profile, 2);
+    spt_CheckError(result, "calibrate", NULL);
+    if(profile.nthreads != 2 || !(profile.stream_bandwidth > 0) ||
+        !(profile.atomic_private > 0) || !(profile.atomic_shared > 0)) {
+        printf("missing bandwidth or atomic rates\n");
+        return 1;
+    }
+    for(int s = 0; s < SPT_PROFILE_NUM_SETS; ++s) {
+        if(!(profile.gather_latency[s] > 0)) {
+            printf("no latency for working set %d\n", s);
+            return 1;
+        }
+    }
+    if(profile.l1_bytes == 0 || profile.l1_bytes > profile.llc_bytes) {
+        printf("cache sizes %zu, %zu\n", profile.l1_bytes, profile.llc_bytes);
+        return 1;
+    }
+
+    char buf[4096];
+    FILE * stream = fmemopen(buf, sizeof buf, "w");
+    result = sptDumpMachineProfile(&profile, stream);
+    spt_CheckError(result, "dump", NULL);
+    fclose(stream);
+    stream = fmemopen(buf, strlen(buf), "r");
+    sptMachineProfile loaded;
+    result = sptLoadMachineProfile(&loaded, stream);
+    spt_CheckError(result, "load", NULL);
+    fclose(stream);
+    if(memcmp(&loaded, &profile, sizeof profile) != 0) {
+        printf("profile changed through dump and load\n");
+        return 1;
+    }
+
+    /* Lines of newer versions are skipped, a file without bandwidth is refused */
+    static char newer[] = "# ParTI! machine profile\nnthreads 3\nfuture_field 1 2 3\nstream_bandwidth 5e9\n";
+    stream = fmemopen(newer, sizeof newer - 1, "r");
+    result = sptLoadMachineProfile(&loaded, stream);
+    fclose(stream);
+    if(result != 0 || loaded.nthreads != 3 || loaded.stream_bandwidth != 5e9) {
+        printf("newer profile not read\n");
+        return 1;
+    }
+    static char empty[] = "nthreads 3\n";
+    stream = fmemopen(empty, sizeof empty - 1, "r");
+    result = sptLoadMachineProfile(&loaded, stream);
+    fclose(stream);
+    if(result == 0) {
+        printf("accepted a profile without bandwidth\n");
+        return 1;
+    }
+
+    /* The profile file is read rather than calibrated again */
+    char path[] = "/tmp/parti_profile_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) {
+        return 1;
+    }
+    FILE * fp = fdopen(fd, "w");
+    loaded = profile;
+    loaded.l1_bytes = 4096;
+    sptDumpMachineProfile(&loaded, fp);
+    fclose(fp);
+    setenv("PARTI_MACHINE_PROFILE", path, 1);
+    sptSetMachineProfile(NULL);
+    if(sptGetMachineProfile()->l1_bytes != 4096 || sptGetMachineModel()->host_bandwidth != profile.stream_bandwidth) {
+        printf("profile file not used\n");
+        return 1;
+    }
+    remove(path);
+    unsetenv("PARTI_MACHINE_PROFILE");
+    return 0;
+}
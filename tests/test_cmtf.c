@@ -0,0 +1,130 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+#define R 2
+
+/* Entries of the rank-2 factors the data are built from */
+static double spt_Truth(sptIndex const m, sptIndex const i, sptIndex const r) {
+    return 1 + ((i * (m + 2) + r * 5 + m) % 7) / 3.0;
+}
+
+/* A tensor and a side matrix of exact rank 2, coupled in mode 0, are fitted together */
+int main(void) {
+    sptIndex const ndims[] = { 6, 5, 4 };
+    sptIndex const ncols = 7;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    for(sptIndex i = 0; i < ndims[0]; ++i) {
+        for(sptIndex j = 0; j < ndims[1]; ++j) {
+            for(sptIndex k = 0; k < ndims[2]; ++k) {
+                double v = 0;
+                for(sptIndex r = 0; r < R; ++r) {
+                    v += spt_Truth(0, i, r) * spt_Truth(1, j, r) * spt_Truth(2, k, r);
+                }
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, (sptValue) v);
+                ++X.nnz;
+            }
+        }
+    }
+    sptSparseMatrix Y;
+    sptNewSparseMatrix(&Y, ndims[0], ncols);
+    for(sptIndex i = 0; i < ndims[0]; ++i) {
+        for(sptIndex j = 0; j < ncols; ++j) {
+            double v = 0;
+            for(sptIndex r = 0; r < R; ++r) {
+                v += spt_Truth(0, i, r) * spt_Truth(3, j, r);
+            }
+            sptAppendIndexVector(&Y.rowind, i);
+            sptAppendIndexVector(&Y.colind, j);
+            sptAppendValueVector(&Y.values, (sptValue) v);
+            ++Y.nnz;
+        }
+    }
+
+    /* CSR conversion, transposed too */
+    sptSparseMatrixCSR Yt;
+    result = sptSparseMatrixToCSR(&Yt, &Y, 1);
+    spt_CheckError(result, "to csr", NULL);
+    sptAssert(Yt.nrows == ncols && Yt.ncols == ndims[0] && Yt.rowptr.data[ncols] == Y.nnz);
+    for(sptIndex j = 0; j < ncols; ++j) {
+        for(sptNnzIndex p = Yt.rowptr.data[j]; p < Yt.rowptr.data[j+1]; ++p) {
+            sptNnzIndex const x = (sptNnzIndex) Yt.colind.data[p] * ncols + j;
+            sptAssert(Yt.values.data[p] == Y.values.data[x]);
+        }
+    }
+    sptFreeSparseMatrixCSR(&Yt);
+
+    sptKruskalTensor K;
+    sptMatrix V;
+    result = sptNewKruskalTensor(&K, 3, ndims, R);
+    spt_CheckError(result, "new ktensor", NULL);
+    result = sptOmpCmtfAls(&X, &Y, 0, R, 200, 1e-12, 2, &K, &V);
+    spt_CheckError(result, "cmtf als", NULL);
+
+    /* The reported fit is that of both residuals together */
+    double normsq = 0, resid = 0;
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        double model = 0;
+        for(sptIndex r = 0; r < R; ++r) {
+            double v = K.lambda[r];
+            for(sptIndex m = 0; m < 3; ++m) {
+                v *= K.factors[m]->values[X.inds[m].data[x] * K.factors[m]->stride + r];
+            }
+            model += v;
+        }
+        normsq += X.values.data[x] * X.values.data[x];
+        resid += (X.values.data[x] - model) * (X.values.data[x] - model);
+    }
+    for(sptNnzIndex x = 0; x < Y.nnz; ++x) {
+        sptIndex const i = Y.rowind.data[x], j = Y.colind.data[x];
+        double model = 0;
+        for(sptIndex r = 0; r < R; ++r) {
+            model += K.factors[0]->values[i * K.factors[0]->stride + r] * V.values[j * V.stride + r];
+        }
+        normsq += Y.values.data[x] * Y.values.data[x];
+        resid += (Y.values.data[x] - model) * (Y.values.data[x] - model);
+    }
+    double const fit = 1 - sqrt(resid) / sqrt(normsq);
+    if(fabs(fit - K.fit) > 10 * sqrt(PARTI_VALUE_EPSILON) || fit < 0.999) {
+        printf("CMTF fit %g, reported %g\n", fit, K.fit);
+        return 1;
+    }
+
+    /* The matrix rows must match the coupled mode */
+    sptKruskalTensor L;
+    sptMatrix W;
+    sptNewKruskalTensor(&L, 3, ndims, R);
+    sptAssert(sptOmpCmtfAls(&X, &Y, 1, R, 5, 1e-12, 2, &L, &W) != 0);
+    sptFreeKruskalTensor(&L);
+
+    sptFreeMatrix(&V);
+    sptFreeKruskalTensor(&K);
+    sptFreeSparseMatrix(&Y);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+static char bufX[] = "3\n"
+    "2 3 4\n"
+    "1 2 0 4\n"
+    "0 0 0 1\n"
+    "1 2 0 -1\n"
+    "0 0 0 2\n"
+    "1 1 3 5\n"
+    "1 2 0 3\n"
+    "0 2 3 -2\n"
+    "0 2 3 2\n";
+
+/* The same with zeros, which plain loading drops out of order */
+static char bufZ[] = "3\n"
+    "2 3 4\n"
+    "1 2 0 4\n"
+    "0 0 0 1\n"
+    "1 2 0 -1\n"
+    "0 1 1 0\n"
+    "0 0 0 2\n"
+    "1 1 3 5\n"
+    "1 2 0 3\n"
+    "0 2 3 -2\n"
+    "0 2 3 2\n"
+    "1 1 3 0\n";
+
+static int spt_CheckTensor(sptSparseTensor const *tsr, sptNnzIndex const nnz, sptIndex const inds[][3], sptValue const values[]) {
+    if(tsr->nnz != nnz) {
+        return 1;
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            if(tsr->inds[m].data[z] != inds[z][m]) {
+                return 1;
+            }
+        }
+        if(tsr->values.data[z] != values[z]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    sptCoalesceOp const ops[] = { SPT_COALESCE_SUM, SPT_COALESCE_MAX, SPT_COALESCE_LAST };
+    /* Sorted outputs; (0,2,3) cancels out under sum */
+    sptIndex const inds[][4][3] = {
+        { { 0, 0, 0 }, { 1, 1, 3 }, { 1, 2, 0 } },
+        { { 0, 0, 0 }, { 0, 2, 3 }, { 1, 1, 3 }, { 1, 2, 0 } },
+        { { 0, 0, 0 }, { 0, 2, 3 }, { 1, 1, 3 }, { 1, 2, 0 } },
+    };
+    sptValue const values[][4] = { { 3, 5, 6 }, { 2, 2, 5, 4 }, { 2, 2, 5, 3 } };
+    sptNnzIndex const nnz[] = { 3, 4, 4 };
+    /* On load (1,1,3) is last set to zero, which deletes it */
+    sptIndex const inds_load[][3] = { { 0, 0, 0 }, { 0, 2, 3 }, { 1, 2, 0 } };
+    sptValue const values_load[] = { 2, 2, 3 };
+    int result;
+
+    for(int o = 0; o < 3; ++o) {
+        FILE *stream = fmemopen(bufX, sizeof bufX - 1, "r");
+        sptSparseTensor X;
+        result = sptLoadSparseTensor(&X, 0, stream);
+        spt_CheckError(result, "load", NULL);
+        fclose(stream);
+        if(X.nnz != 8) {
+            printf("Plain load coalesced duplicates\n");
+            return 1;
+        }
+        result = sptSparseTensorCoalesce(&X, ops[o], 2);
+        spt_CheckError(result, "coalesce", NULL);
+        if(spt_CheckTensor(&X, nnz[o], inds[o], values[o]) != 0 || X.sortorder[0] != 0 || X.sortorder[2] != 2) {
+            printf("Coalescing %d mismatch\n", (int) ops[o]);
+            return 1;
+        }
+        sptFreeSparseTensor(&X);
+    }
+
+    /* Coalescing on load, where a zero last value deletes the coordinate */
+    result = sptSetLoadCoalesce(SPT_COALESCE_LAST);
+    spt_CheckError(result, "set load coalesce", NULL);
+    FILE *stream = fmemopen(bufZ, sizeof bufZ - 1, "r");
+    sptSparseTensor X;
+    result = sptLoadSparseTensor(&X, 0, stream);
+    spt_CheckError(result, "load", NULL);
+    fclose(stream);
+    if(spt_CheckTensor(&X, 3, inds_load, values_load) != 0) {
+        printf("Coalescing load mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&X);
+    sptSetLoadCoalesce(SPT_COALESCE_NONE);
+
+    /* Many duplicates must reduce identically with any thread count */
+    sptIndex const ndims[] = { 7, 5, 3 };
+    sptSparseTensor A, B;
+    sptNewSparseTensor(&A, 3, ndims);
+    srand(7);
+    for(int i = 0; i < 20000; ++i) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&A.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&A.values, (sptValue) (rand() % 1000) / 64 - 7);
+        ++ A.nnz;
+    }
+    for(int o = 0; o < 3; ++o) {
+        sptCopySparseTensor(&B, &A, 1);
+        result = sptSparseTensorCoalesce(&B, ops[o], 1);
+        spt_CheckError(result, "coalesce", NULL);
+        for(int tk = 2; tk <= 5; ++tk) {
+            sptSparseTensor C;
+            sptCopySparseTensor(&C, &A, 1);
+            result = sptSparseTensorCoalesce(&C, ops[o], tk);
+            spt_CheckError(result, "coalesce", NULL);
+            int bad = B.nnz != C.nnz || memcmp(B.values.data, C.values.data, B.nnz * sizeof (sptValue)) != 0;
+            for(sptIndex m = 0; m < 3 && !bad; ++m) {
+                bad = memcmp(B.inds[m].data, C.inds[m].data, B.nnz * sizeof (sptIndex)) != 0;
+            }
+            if(bad || B.nnz > 7 * 5 * 3) {
+                printf("Coalescing %d differs with %d threads\n", (int) ops[o], tk);
+                return 1;
+            }
+            sptFreeSparseTensor(&C);
+        }
+        sptFreeSparseTensor(&B);
+    }
+    sptFreeSparseTensor(&A);
+    return 0;
+}
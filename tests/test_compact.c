@@ -0,0 +1,114 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* Compacting hashed IDs gives dense, order-keeping labels, and factors map back through the inverse shuffle */
+int main(void) {
+    sptIndex const ndims[] = { 1000, 700, 50 };
+    sptIndex const rank = 3;
+    sptSparseTensor X, Y;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(41);
+    for(int n = 0; n < 3000; ++n) {
+        /* Modes 0 and 1 use only every seventh and every fifth ID */
+        sptAppendIndexVector(&X.inds[0], 7 * (rand() % (ndims[0] / 7)));
+        sptAppendIndexVector(&X.inds[1], 5 * (rand() % (ndims[1] / 5)));
+        sptAppendIndexVector(&X.inds[2], rand() % ndims[2]);
+        sptAppendValueVector(&X.values, n);
+        ++X.nnz;
+    }
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptCopySparseTensor(&Y, &X, 1);
+    spt_CheckError(result, "copy", NULL);
+
+    sptIndex * map_inds[3];
+    for(sptIndex m = 0; m < 3; ++m) {
+        map_inds[m] = malloc(ndims[m] * sizeof *map_inds[m]);
+    }
+    for(int tk = 1; tk <= 4; tk += 3) {
+        sptFreeSparseTensor(&Y);
+        sptCopySparseTensor(&Y, &X, 1);
+        result = sptSparseTensorCompactIndices(&Y, map_inds, tk);
+        spt_CheckError(result, "compact", NULL);
+        for(sptIndex m = 0; m < 3; ++m) {
+            char * hit = calloc(ndims[m], 1);
+            for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+                hit[X.inds[m].data[z]] = 1;
+                if(Y.inds[m].data[z] != map_inds[m][X.inds[m].data[z]] || Y.values.data[z] != X.values.data[z]) {
+                    printf("tk %d mode %u: nonzero %lu relabeled wrong\n", tk, (unsigned) m, (unsigned long) z);
+                    return 1;
+                }
+            }
+            sptIndex nused = 0;
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                nused += hit[i];
+            }
+            /* Used IDs numbered from 0 in order, then the unused ones */
+            sptIndex next_used = 0, next_unused = nused;
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                if(map_inds[m][i] != (hit[i] ? next_used++ : next_unused++)) {
+                    printf("tk %d mode %u: bad map at %u\n", tk, (unsigned) m, (unsigned) i);
+                    return 1;
+                }
+            }
+            if(Y.ndims[m] != nused) {
+                printf("tk %d mode %u: %u rows, expected %u\n", tk, (unsigned) m, (unsigned) Y.ndims[m], (unsigned) nused);
+                return 1;
+            }
+            free(hit);
+        }
+    }
+
+    /* Row v of a compacted factor comes back as the row of every ID mapped to v, zero if unused */
+    sptKruskalTensor K;
+    sptNewKruskalTensor(&K, 3, Y.ndims, rank);
+    K.factors = malloc(3 * sizeof *K.factors);
+    for(sptIndex m = 0; m < 3; ++m) {
+        K.factors[m] = malloc(sizeof *K.factors[m]);
+        sptNewMatrix(K.factors[m], Y.ndims[m], rank);
+        for(sptIndex v = 0; v < Y.ndims[m]; ++v) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                K.factors[m]->values[v * K.factors[m]->stride + r] = v + 1 + r * 0.5;
+            }
+        }
+    }
+    result = sptKruskalTensorExpandRows(&K, ndims);
+    spt_CheckError(result, "expand", NULL);
+    sptKruskalTensorInverseShuffleIndices(&K, map_inds);
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            sptIndex const v = map_inds[m][i];
+            sptValue const expect = v < Y.ndims[m] ? v + 1 + 0.5 : 0;
+            if(K.ndims[m] != ndims[m] || K.factors[m]->values[i * K.factors[m]->stride + 1] != expect) {
+                printf("mode %u: row %u mapped back wrong\n", (unsigned) m, (unsigned) i);
+                return 1;
+            }
+        }
+        free(map_inds[m]);
+    }
+
+    sptFreeKruskalTensor(&K);
+    sptFreeSparseTensor(&Y);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
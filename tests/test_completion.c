@@ -0,0 +1,123 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+#define R 2
+
+/* Entries of the rank-2 factors the data are built from */
+static double spt_Truth(sptIndex const m, sptIndex const i, sptIndex const r) {
+    return 0.5 + ((i * (m + 3) + r * 7 + m) % 11) / 10.0;
+}
+
+static void spt_Append(sptSparseTensor * X, sptIndex const i, sptIndex const j, sptIndex const k) {
+    double v = 0;
+    for(sptIndex r = 0; r < R; ++r) {
+        v += spt_Truth(0, i, r) * spt_Truth(1, j, r) * spt_Truth(2, k, r);
+    }
+    sptAppendIndexVector(&X->inds[0], i);
+    sptAppendIndexVector(&X->inds[1], j);
+    sptAppendIndexVector(&X->inds[2], k);
+    sptAppendValueVector(&X->values, (sptValue) v);
+    ++X->nnz;
+}
+
+/* A third of a rank-2 tensor is observed; the model must predict entries it never saw */
+int main(void) {
+    sptIndex const ndims[] = { 40, 30, 20 };
+    sptSparseTensor X, H;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    result = sptNewSparseTensor(&H, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    for(sptIndex i = 0; i < ndims[0]; ++i) {
+        for(sptIndex j = 0; j < ndims[1]; ++j) {
+            for(sptIndex k = 0; k < ndims[2]; ++k) {
+                unsigned const h = (i * 7919u + j * 104729u + k * 1299709u) % 30;
+                if(h < 10) {
+                    spt_Append(&X, i, j, k);
+                } else if(h < 12) {
+                    spt_Append(&H, i, j, k);
+                }
+            }
+        }
+    }
+
+    sptKruskalTensor K;
+    result = sptNewKruskalTensor(&K, 3, ndims, R);
+    spt_CheckError(result, "new ktensor", NULL);
+    result = sptOmpCompletionSgd(&X, &H, R, 300, 0.01, 1e-5, 1e-9, 42, 4, &K);
+    spt_CheckError(result, "completion sgd", NULL);
+
+    /* The reported fit is that of the held-out entries */
+    double normsq = 0, resid = 0;
+    for(sptNnzIndex x = 0; x < H.nnz; ++x) {
+        double model = 0;
+        for(sptIndex r = 0; r < R; ++r) {
+            double v = K.lambda[r];
+            for(sptIndex m = 0; m < 3; ++m) {
+                v *= K.factors[m]->values[H.inds[m].data[x] * K.factors[m]->stride + r];
+            }
+            model += v;
+        }
+        normsq += H.values.data[x] * H.values.data[x];
+        resid += (H.values.data[x] - model) * (H.values.data[x] - model);
+    }
+    double const fit = 1 - sqrt(resid) / sqrt(normsq);
+    if(fabs(fit - K.fit) > 1e-6 || fit < 0.99) {
+        printf("Held-out fit %g, reported %g\n", fit, K.fit);
+        return 1;
+    }
+
+    /* The same seed and thread count give the same model */
+    sptKruskalTensor L;
+    sptNewKruskalTensor(&L, 3, ndims, R);
+    result = sptOmpCompletionSgd(&X, &H, R, 20, 0.01, 1e-5, 0, 42, 4, &L);
+    spt_CheckError(result, "completion sgd", NULL);
+    sptKruskalTensor L2;
+    sptNewKruskalTensor(&L2, 3, ndims, R);
+    result = sptOmpCompletionSgd(&X, &H, R, 20, 0.01, 1e-5, 0, 42, 4, &L2);
+    spt_CheckError(result, "completion sgd", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptAssert(L.factors[m]->values[i * L.factors[m]->stride + r] == L2.factors[m]->values[i * L2.factors[m]->stride + r]);
+            }
+        }
+    }
+    sptFreeKruskalTensor(&L);
+    sptFreeKruskalTensor(&L2);
+
+    /* Held-out entries of another shape are refused */
+    sptIndex const other[] = { 40, 30, 21 };
+    sptSparseTensor W;
+    sptNewSparseTensor(&W, 3, other);
+    sptNewKruskalTensor(&L, 3, ndims, R);
+    sptAssert(sptOmpCompletionSgd(&X, &W, R, 5, 0.01, 0, 0, 1, 2, &L) != 0);
+    sptFreeKruskalTensor(&L);
+    sptFreeSparseTensor(&W);
+
+    sptFreeKruskalTensor(&K);
+    sptFreeSparseTensor(&H);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* A random tensor with time as mode 0, sorted lexicographically */
+static void RandomTensor(sptSparseTensor *X, sptIndex const ndims[], int const nnz) {
+    sptNewSparseTensor(X, 3, ndims);
+    for(int n = 0; n < nnz; ++n) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X->inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X->values, (sptValue) (rand() % 100));
+        ++X->nnz;
+    }
+    sptSparseTensorSortIndex(X, 1);
+}
+
+/* Hourly batches appended along time stay sorted and keep their nonzeros */
+int main(void) {
+    sptIndex const ndims0[] = { 24, 50, 40 };
+    sptIndex const ndims1[] = { 6, 60, 30 };
+    sptSparseTensor X, B, C;
+    srand(3);
+    RandomTensor(&X, ndims0, 5000);
+    RandomTensor(&B, ndims1, 3000);
+    sptCopySparseTensor(&C, &X, 1);
+
+    int result = sptSparseTensorConcat(&X, &B, 0, 0);
+    spt_CheckError(result, "concat", NULL);
+    if(X.nnz != 8000 || X.ndims[0] != 30 || X.ndims[1] != 60 || X.ndims[2] != 40) {
+        printf("wrong nnz or sizes\n");
+        return 1;
+    }
+    for(sptNnzIndex z = 1; z < X.nnz; ++z) {
+        sptIndex m = 0;
+        while(m < 3 && X.inds[m].data[z-1] == X.inds[m].data[z]) {
+            ++m;
+        }
+        if(m < 3 && X.inds[m].data[z-1] > X.inds[m].data[z]) {
+            printf("nonzero %lu out of order\n", (unsigned long) z);
+            return 1;
+        }
+    }
+    for(sptNnzIndex z = 0; z < B.nnz; ++z) {
+        sptNnzIndex const y = C.nnz + z;
+        if(X.inds[0].data[y] != B.inds[0].data[z] + 24 || X.inds[1].data[y] != B.inds[1].data[z] ||
+            X.inds[2].data[y] != B.inds[2].data[z] || X.values.data[y] != B.values.data[z]) {
+            printf("appended nonzero %lu wrong\n", (unsigned long) z);
+            return 1;
+        }
+    }
+    for(sptNnzIndex z = 0; z < C.nnz; ++z) {
+        if(X.inds[0].data[z] != C.inds[0].data[z] || X.values.data[z] != C.values.data[z]) {
+            printf("old nonzero %lu changed\n", (unsigned long) z);
+            return 1;
+        }
+    }
+
+    if(sptSparseTensorConcat(&X, &B, 3, 0) == 0) {
+        printf("accepted a mode out of range\n");
+        return 1;
+    }
+
+    sptFreeSparseTensor(&C);
+    sptFreeSparseTensor(&B);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
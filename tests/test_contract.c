@@ -0,0 +1,136 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+static int spt_Close(double a, double b) {
+    return fabs(a - b) <= 1e-4 * (1 + fabs(b));
+}
+
+static void spt_RandomTensor(sptSparseTensor *X, sptIndex nmodes, sptIndex const ndims[], sptNnzIndex nnz) {
+    sptNewSparseTensor(X, nmodes, ndims);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X->inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X->values, (sptValue) rand() / RAND_MAX - 0.5);
+    }
+    X->nnz = nnz;
+}
+
+/* Check Z against a dense reference with nz entries, row-major over Z's modes */
+static int spt_CheckAgainst(sptSparseTensor const *Z, double const *dense, size_t nz, int nt) {
+    sptNnzIndex touched = 0;
+    for(sptNnzIndex z = 0; z < Z->nnz; ++z) {
+        size_t lin = 0;
+        for(sptIndex m = 0; m < Z->nmodes; ++m) {
+            lin = lin * Z->ndims[m] + Z->inds[m].data[z];
+        }
+        if((z > 0 && spt_SparseTensorCompareIndices(Z, z - 1, Z, z) >= 0) ||
+            !spt_Close(Z->values.data[z], dense[lin])) {
+            printf("sptSparseTensorContract mismatch at %"PARTI_PRI_NNZ_INDEX" with %d threads\n", z, nt);
+            return 1;
+        }
+        ++touched;
+    }
+    double rest = 0;
+    for(size_t i = 0; i < nz; ++i) {
+        rest += fabs(dense[i]);
+    }
+    for(sptNnzIndex z = 0; z < Z->nnz; ++z) {
+        rest -= fabs(Z->values.data[z]);
+    }
+    if(fabs(rest) > 1e-3) {
+        printf("sptSparseTensorContract missed nonzeros with %d threads\n", nt);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    int result;
+    int const nts[] = { 1, 4 };
+    srand(7);
+
+    /* Z(i, l, m) = sum_{j, k} X(i, j, k) * Y(k, l, j, m) */
+    sptIndex const xdims[] = { 20, 8, 6 };
+    sptIndex const ydims[] = { 6, 15, 8, 4 };
+    sptSparseTensor X, Y;
+    spt_RandomTensor(&X, 3, xdims, 500);
+    spt_RandomTensor(&Y, 4, ydims, 400);
+    static double dense[20 * 15 * 4];
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        for(sptNnzIndex y = 0; y < Y.nnz; ++y) {
+            if(X.inds[1].data[x] == Y.inds[2].data[y] && X.inds[2].data[x] == Y.inds[0].data[y]) {
+                dense[(X.inds[0].data[x] * 15 + Y.inds[1].data[y]) * 4 + Y.inds[3].data[y]] +=
+                    X.values.data[x] * Y.values.data[y];
+            }
+        }
+    }
+    sptIndex const cx[] = { 1, 2 };
+    sptIndex const cy[] = { 2, 0 };
+    for(int t = 0; t < 2; ++t) {
+        sptSparseTensor Z;
+        result = sptSparseTensorContract(&Z, &X, &Y, cx, cy, 2, nts[t]);
+        spt_CheckError(result, "contract", NULL);
+        if(Z.nmodes != 3 || Z.ndims[0] != 20 || Z.ndims[1] != 15 || Z.ndims[2] != 4) {
+            printf("sptSparseTensorContract shape mismatch\n");
+            return 1;
+        }
+        if(spt_CheckAgainst(&Z, dense, 20 * 15 * 4, nts[t])) {
+            return 1;
+        }
+        sptFreeSparseTensor(&Z);
+    }
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+
+    /* A single pair leaving two free modes on each side: Z(i, k, l, n) = sum_j X(i, j, k) * Y(l, j, n) */
+    sptIndex const adims[] = { 10, 12, 7 };
+    sptIndex const bdims[] = { 9, 12, 5 };
+    spt_RandomTensor(&X, 3, adims, 300);
+    spt_RandomTensor(&Y, 3, bdims, 200);
+    static double dense2[10 * 7 * 9 * 5];
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        for(sptNnzIndex y = 0; y < Y.nnz; ++y) {
+            if(X.inds[1].data[x] == Y.inds[1].data[y]) {
+                dense2[((X.inds[0].data[x] * 7 + X.inds[2].data[x]) * 9 + Y.inds[0].data[y]) * 5 + Y.inds[2].data[y]] +=
+                    X.values.data[x] * Y.values.data[y];
+            }
+        }
+    }
+    sptIndex const ca[] = { 1 };
+    for(int t = 0; t < 2; ++t) {
+        sptSparseTensor Z;
+        result = sptSparseTensorContract(&Z, &X, &Y, ca, ca, 1, nts[t]);
+        spt_CheckError(result, "contract", NULL);
+        if(Z.nmodes != 4 || spt_CheckAgainst(&Z, dense2, 10 * 7 * 9 * 5, nts[t])) {
+            printf("sptSparseTensorContract single-pair case failed\n");
+            return 1;
+        }
+        sptFreeSparseTensor(&Z);
+    }
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
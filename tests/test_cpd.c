@@ -19,7 +19,16 @@
 #include <ParTI.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "../src/error/error.h"
+#include "cpd_fit.h"
+
+/*
+ * A fit near 1 keeps only about half the digits of sptValue, the residual
+ * being a difference of near-equal norms, and in single precision ALS stops
+ * once that fit no longer resolves its progress
+ */
+#define SPT_FIT_TOL (100 * sqrt(PARTI_VALUE_EPSILON))
 
 int main(void) {
     {
@@ -74,6 +83,113 @@ int main(void) {
         printf("%s\n", buf);
         free(buf);
 
+        /* A workspace is reusable across back-to-back decompositions */
+        sptCpdWorkspace ws;
+        result = sptNewCpdWorkspace(&ws, 3, X.ndims, 2, 2, 1);
+        spt_CheckError(result, "new workspace", NULL);
+        for(int run = 0; run < 2; ++run) {
+            sptKruskalTensor ktensor_ws;
+            result = sptNewKruskalTensor(&ktensor_ws, 3, X.ndims, 2);
+            spt_CheckError(result, "new ktensor", NULL);
+            result = sptOmpCpdAlsWorkspace(&X, 2, 5, 1e-9, &ws, &ktensor_ws);
+            spt_CheckError(result, "cpd als workspace", NULL);
+            sptFreeKruskalTensor(&ktensor_ws);
+        }
+        sptFreeCpdWorkspace(&ws);
+
+        /* A sparse fit cadence still reports the fit of the returned model */
+        result = sptNewCpdWorkspace(&ws, 3, X.ndims, 2, 1, 1);
+        spt_CheckError(result, "new workspace", NULL);
+        result = sptCpdWorkspaceSetFitEvery(&ws, 3);
+        spt_CheckError(result, "fit every", NULL);
+        {
+            sptKruskalTensor ktensor_ws;
+            result = sptNewKruskalTensor(&ktensor_ws, 3, X.ndims, 2);
+            spt_CheckError(result, "new ktensor", NULL);
+            result = sptOmpCpdAlsWorkspace(&X, 2, 7, 1e-9, &ws, &ktensor_ws);
+            spt_CheckError(result, "cpd als workspace", NULL);
+
+            /* X is fully dense, so the residual is summed over its nonzeros */
+            double normsq = 0, resid = 0;
+            for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+                double model = 0;
+                for(sptIndex r = 0; r < 2; ++r) {
+                    double v = ktensor_ws.lambda[r];
+                    for(sptIndex m = 0; m < 3; ++m) {
+                        sptMatrix const * A = ktensor_ws.factors[m];
+                        v *= A->values[X.inds[m].data[x] * A->stride + r];
+                    }
+                    model += v;
+                }
+                double const d = X.values.data[x] - model;
+                normsq += X.values.data[x] * X.values.data[x];
+                resid += d * d;
+            }
+            double const fit = 1 - sqrt(resid) / sqrt(normsq);
+            sptAssert(fabs(fit - ktensor_ws.fit) < SPT_FIT_TOL);
+            sptFreeKruskalTensor(&ktensor_ws);
+        }
+        sptAssert(sptCpdWorkspaceSetFitEvery(&ws, 0) != 0);
+        sptFreeCpdWorkspace(&ws);
+
+        /* A tensor this small takes the single-threaded path, which must recover its rank-2 structure */
+        {
+            sptKruskalTensor ktensor_small;
+            result = sptNewKruskalTensor(&ktensor_small, 3, X.ndims, 2);
+            spt_CheckError(result, "new ktensor", NULL);
+            result = sptOmpCpdAls(&X, 2, 50, 1e-12, 4, 1, &ktensor_small);
+            spt_CheckError(result, "cpd als small", NULL);
+            double normsq = 0, resid = 0;
+            for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+                double model = 0;
+                for(sptIndex r = 0; r < 2; ++r) {
+                    double v = ktensor_small.lambda[r];
+                    for(sptIndex m = 0; m < 3; ++m) {
+                        sptMatrix const * A = ktensor_small.factors[m];
+                        v *= A->values[X.inds[m].data[x] * A->stride + r];
+                    }
+                    model += v;
+                }
+                double const d = X.values.data[x] - model;
+                normsq += X.values.data[x] * X.values.data[x];
+                resid += d * d;
+            }
+            double const fit = 1 - sqrt(resid) / sqrt(normsq);
+            sptAssert(fabs(fit - ktensor_small.fit) < SPT_FIT_TOL);
+            sptAssert(fit > 1 - SPT_FIT_TOL);
+            sptFreeKruskalTensor(&ktensor_small);
+        }
+
+        /* The small path reports the fit of the model it returns, also before converging */
+        {
+            sptKruskalTensor ktensor_early;
+            result = sptNewKruskalTensor(&ktensor_early, 3, X.ndims, 1);
+            spt_CheckError(result, "new ktensor", NULL);
+            result = sptOmpCpdAls(&X, 1, 2, 0, 4, 1, &ktensor_early);
+            spt_CheckError(result, "cpd als early", NULL);
+            sptAssert(fabs(model_fit(&X, &ktensor_early) - ktensor_early.fit) < SPT_FIT_TOL);
+            sptFreeKruskalTensor(&ktensor_early);
+        }
+
+        /* A tensor without nonzeros gives zero factors instead of a Gram matrix that never factors */
+        {
+            sptSparseTensor E;
+            result = sptNewSparseTensor(&E, 3, X.ndims);
+            spt_CheckError(result, "new empty", NULL);
+            sptKruskalTensor ktensor_empty;
+            result = sptNewKruskalTensor(&ktensor_empty, 3, X.ndims, 2);
+            spt_CheckError(result, "new ktensor", NULL);
+            result = sptOmpCpdAls(&E, 2, 5, 1e-9, 4, 1, &ktensor_empty);
+            spt_CheckError(result, "cpd als empty", NULL);
+            for(sptIndex m = 0; m < 3; ++m) {
+                for(sptIndex i = 0; i < X.ndims[m]; ++i) {
+                    sptAssert(ktensor_empty.factors[m]->values[i * ktensor_empty.factors[m]->stride] == 0);
+                }
+            }
+            sptFreeKruskalTensor(&ktensor_empty);
+            sptFreeSparseTensor(&E);
+        }
+
         sptFreeKruskalTensor(&ktensor);
         sptFreeSparseTensor(&X);
     }
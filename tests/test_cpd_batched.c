@@ -0,0 +1,64 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+int main(void) {
+    sptIndex const ndims[3] = { 30, 20, 25 };
+    sptIndex const ranks[3] = { 3, 5, 2 };
+    uint64_t const seeds[3] = { 1, 2, 7 };
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 1500, SPT_GEN_UNIFORM, 0, 13, 1);
+    spt_CheckError(result, "generate", NULL);
+
+    sptKruskalTensor batch[3];
+    for(int k = 0; k < 3; ++k) {
+        sptNewKruskalTensor(&batch[k], 3, ndims, ranks[k]);
+    }
+    result = sptOmpCpdAlsBatched(&X, 3, ranks, seeds, 10, 0, 2, batch);
+    spt_CheckError(result, "cpd batched", NULL);
+    for(int k = 0; k < 3; ++k) {
+        double const fit = model_fit(&X, &batch[k]);
+        if(fabs(fit - batch[k].fit) > 10 * sqrt(PARTI_VALUE_EPSILON) || !(fit > 0)) {
+            printf("model %d: reported fit %f, model fit %f\n", k, batch[k].fit, fit);
+            return 1;
+        }
+    }
+
+    /* A model alone follows the same iterates as within the batch */
+    sptKruskalTensor alone;
+    sptNewKruskalTensor(&alone, 3, ndims, ranks[1]);
+    result = sptOmpCpdAlsBatched(&X, 1, &ranks[1], &seeds[1], 10, 0, 2, &alone);
+    spt_CheckError(result, "cpd batched alone", NULL);
+    if(fabs(alone.fit - batch[1].fit) > 1e4 * PARTI_VALUE_EPSILON) {
+        printf("alone: fit %f, in batch %f\n", alone.fit, batch[1].fit);
+        return 1;
+    }
+
+    sptFreeKruskalTensor(&alone);
+    for(int k = 0; k < 3; ++k) {
+        sptFreeKruskalTensor(&batch[k]);
+    }
+    sptFreeSparseTensor(&X);
+    return 0;
+}
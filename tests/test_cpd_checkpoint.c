@@ -0,0 +1,127 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+int main(void) {
+    char const * const path = "test_cpd_checkpoint.ckpt";
+    sptIndex const ndims[3] = { 20, 15, 10 };
+    sptIndex const rank = 3;
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 600, SPT_GEN_UNIFORM, 0, 7, 1);
+    spt_CheckError(result, "generate", NULL);
+    remove(path);
+
+    /* Four iterations, checkpointed every iteration */
+    result = sptSetCpdCheckpoint(path, 1);
+    spt_CheckError(result, "set checkpoint", NULL);
+    sptKruskalTensor first;
+    sptNewKruskalTensor(&first, 3, ndims, rank);
+    result = sptCpdAls(&X, rank, 4, 0, &first);
+    spt_CheckError(result, "cpd als", NULL);
+
+    sptKruskalTensor warm;
+    result = sptLoadCpdCheckpoint(path, &warm);
+    spt_CheckError(result, "load checkpoint", NULL);
+
+    /* Asking for ten resumes after the four */
+    sptKruskalTensor resumed;
+    sptNewKruskalTensor(&resumed, 3, ndims, rank);
+    result = sptOmpCpdAls(&X, rank, 10, 0, 1, 0, &resumed);
+    spt_CheckError(result, "resumed cpd als", NULL);
+
+    /* Six warm-started iterations from the same factors end at the same model */
+    result = sptSetCpdCheckpoint(NULL, 0);
+    spt_CheckError(result, "unset checkpoint", NULL);
+    result = sptCpdAls(&X, rank, 6, 0, &warm);
+    spt_CheckError(result, "warm cpd als", NULL);
+    if(fabs(resumed.fit - warm.fit) > 1e-6 || !(resumed.fit >= first.fit - 1e-9)) {
+        printf("resumed fit %f, warm-started fit %f, first fit %f\n", resumed.fit, warm.fit, first.fit);
+        return 1;
+    }
+
+    /* A finished run resumes to its result without iterating */
+    result = sptSetCpdCheckpoint(path, 0);
+    spt_CheckError(result, "set checkpoint", NULL);
+    sptKruskalTensor again;
+    sptNewKruskalTensor(&again, 3, ndims, rank);
+    result = sptCpdAls(&X, rank, 10, 0, &again);
+    spt_CheckError(result, "finished cpd als", NULL);
+    if(fabs(again.fit - resumed.fit) > 1e-12) {
+        printf("finished run refit to %f from %f\n", again.fit, resumed.fit);
+        return 1;
+    }
+
+    /* A checkpoint of another rank is ignored */
+    sptKruskalTensor other;
+    sptNewKruskalTensor(&other, 3, ndims, rank + 1);
+    result = sptCpdAls(&X, rank + 1, 2, 0, &other);
+    spt_CheckError(result, "other rank cpd als", NULL);
+
+    /* Nor is one of another tensor of the same shape */
+    sptSparseTensor Y;
+    result = sptGenerateSparseTensor(&Y, 3, ndims, 600, SPT_GEN_UNIFORM, 0, 8, 1);
+    spt_CheckError(result, "generate", NULL);
+    sptKruskalTensor other_tensor;
+    sptNewKruskalTensor(&other_tensor, 3, ndims, rank);
+    result = sptCpdAls(&Y, rank, 10, 0, &other_tensor);
+    spt_CheckError(result, "other tensor cpd als", NULL);
+    if(other_tensor.fit == again.fit) {
+        printf("another tensor resumed to fit %f\n", other_tensor.fit);
+        return 1;
+    }
+
+    /* An execution context's checkpoint takes the place of the thread's */
+    char const * const ctx_path = "test_cpd_checkpoint_ctx.ckpt";
+    remove(ctx_path);
+    sptSetCpdCheckpoint(path, 0);
+    remove(path);
+    sptExecContext ctx;
+    sptNewExecContext(&ctx, 0);
+    ctx.cpd_checkpoint = ctx_path;
+    sptExecContext const * const prev = sptSetExecContext(&ctx);
+    sptKruskalTensor in_ctx;
+    sptNewKruskalTensor(&in_ctx, 3, ndims, rank);
+    result = sptCpdAls(&X, rank, 2, 0, &in_ctx);
+    spt_CheckError(result, "context cpd als", NULL);
+    sptSetExecContext(prev);
+    FILE * fp = fopen(ctx_path, "rb");
+    if(fp == NULL || fopen(path, "rb") != NULL) {
+        printf("checkpoint not written to the context's path\n");
+        return 1;
+    }
+    fclose(fp);
+
+    sptSetCpdCheckpoint(NULL, 0);
+    remove(path);
+    remove(ctx_path);
+    sptFreeKruskalTensor(&in_ctx);
+    sptFreeKruskalTensor(&other_tensor);
+    sptFreeSparseTensor(&Y);
+    sptFreeKruskalTensor(&first);
+    sptFreeKruskalTensor(&warm);
+    sptFreeKruskalTensor(&resumed);
+    sptFreeKruskalTensor(&again);
+    sptFreeKruskalTensor(&other);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
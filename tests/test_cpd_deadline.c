@@ -0,0 +1,155 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMODES 3
+#define RANK 6
+
+static sptIndex calls;
+
+static int Progress(sptIndex it, double fit, double seconds, void * arg) {
+    sptIndex const cancel_at = *(sptIndex const *) arg;
+    calls = it;
+    if(!isfinite(fit) || seconds < 0) {
+        printf("progress at %"PARTI_PRI_INDEX": fit %g after %g s\n", it, fit, seconds);
+        exit(1);
+    }
+    return cancel_at != 0 && it == cancel_at;
+}
+
+/* The fit a run reports against the one of the factors it returned */
+static int CheckFit(sptSparseTensor const * X, sptKruskalTensor * K, char const * what) {
+    sptMatrix * ata[NMODES + 1];
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        ata[m] = malloc(sizeof *ata[m]);
+        sptNewMatrix(ata[m], RANK, RANK);
+        if(m < NMODES) {
+            sptOmpMatrixGram(K->factors[m], ata[m], 1);
+        }
+    }
+    sptMatrix * mats[NMODES + 1];
+    sptMatrix out;
+    sptNewMatrix(&out, X->ndims[NMODES-1], RANK);
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        mats[m] = K->factors[m];
+    }
+    mats[NMODES] = &out;
+    sptIndex const order[NMODES] = { 2, 0, 1 };
+    sptMTTKRP(X, mats, order, NMODES-1);
+    double const check = sptKruskalTensorFit(X, K->lambda, mats, ata);
+    sptFreeMatrix(&out);
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        sptFreeMatrix(ata[m]);
+        free(ata[m]);
+    }
+    if(!isfinite(K->fit) || fabs(K->fit - check) > 1e-6) {
+        printf("%s: fit %g, recomputed %g\n", what, K->fit, check);
+        return 1;
+    }
+    return 0;
+}
+
+/* A progress callback sees every iteration and can cancel; a deadline stops the run early */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 40, 50, 30 };
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, NMODES, ndims);
+    srand(3);
+    for(sptNnzIndex n = 0; n < 3000; ++n) {
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        ++X.nnz;
+    }
+    sptSparseTensorSortIndex(&X, 1);
+
+    sptIndex cancel_at = 3;
+    sptSetCpdProgress(Progress, &cancel_at);
+    sptKruskalTensor K;
+    sptNewKruskalTensor(&K, NMODES, ndims, RANK);
+    calls = 0;
+    if(sptOmpCpdAls(&X, RANK, 50, 0, 2, 1, &K) != 0 || calls != cancel_at) {
+        printf("cancelled run took %"PARTI_PRI_INDEX" iterations\n", calls);
+        return 1;
+    }
+    if(CheckFit(&X, &K, "cancelled") != 0) {
+        return 1;
+    }
+    sptFreeKruskalTensor(&K);
+
+    /* Nothing fits in a nanosecond, so the deadline ends the run after its first iteration */
+    cancel_at = 0;
+    sptSetCpdDeadline(1e-9);
+    sptNewKruskalTensor(&K, NMODES, ndims, RANK);
+    calls = 0;
+    if(sptOmpCpdAls(&X, RANK, 50, 0, 2, 1, &K) != 0 || calls != 1) {
+        printf("deadline run took %"PARTI_PRI_INDEX" iterations\n", calls);
+        return 1;
+    }
+    if(CheckFit(&X, &K, "deadline") != 0) {
+        return 1;
+    }
+    sptFreeKruskalTensor(&K);
+    if(sptSetCpdDeadline(-1) == 0) {
+        printf("accepted a negative deadline\n");
+        return 1;
+    }
+
+    /* A generous deadline leaves the run alone */
+    sptSetCpdDeadline(3600);
+    sptNewKruskalTensor(&K, NMODES, ndims, RANK);
+    calls = 0;
+    if(sptOmpCpdAls(&X, RANK, 6, 0, 2, 1, &K) != 0 || calls != 6) {
+        printf("unbounded run took %"PARTI_PRI_INDEX" iterations\n", calls);
+        return 1;
+    }
+    sptFreeKruskalTensor(&K);
+    sptSetCpdDeadline(0);
+    sptSetCpdProgress(NULL, NULL);
+
+    /* A context's callback cancels only the runs under that context */
+    sptIndex ctx_cancel_at = 2;
+    sptExecContext ctx;
+    sptNewExecContext(&ctx, 0);
+    ctx.cpd_progress = Progress;
+    ctx.cpd_progress_arg = &ctx_cancel_at;
+    sptExecContext const * const prev = sptSetExecContext(&ctx);
+    sptNewKruskalTensor(&K, NMODES, ndims, RANK);
+    calls = 0;
+    if(sptOmpCpdAls(&X, RANK, 6, 0, 2, 1, &K) != 0 || calls != ctx_cancel_at) {
+        printf("context-cancelled run took %"PARTI_PRI_INDEX" iterations\n", calls);
+        return 1;
+    }
+    sptFreeKruskalTensor(&K);
+    sptSetExecContext(prev);
+    sptNewKruskalTensor(&K, NMODES, ndims, RANK);
+    calls = 0;
+    if(sptOmpCpdAls(&X, RANK, 6, 0, 2, 1, &K) != 0 || calls != 0) {
+        printf("the context's callback ran outside it\n");
+        return 1;
+    }
+    sptFreeKruskalTensor(&K);
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+/* A dense rank-3 tensor with two nearly collinear components, the case ALS swamps on */
+int main(void) {
+    sptIndex const ndims[3] = { 12, 10, 8 };
+    sptIndex const rank = 3;
+    double factors[3][12][3];
+    srand(3);
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            double const a = (double) (rand() % 200 - 100) / 100;
+            factors[m][i][0] = a;
+            factors[m][i][1] = a + (double) (rand() % 200 - 100) / 300;
+            factors[m][i][2] = (double) (rand() % 200 - 100) / 100;
+        }
+    }
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, 3, ndims);
+    for(sptIndex i = 0; i < ndims[0]; ++i) {
+        for(sptIndex j = 0; j < ndims[1]; ++j) {
+            for(sptIndex k = 0; k < ndims[2]; ++k) {
+                double v = 0;
+                for(sptIndex r = 0; r < rank; ++r) {
+                    v += factors[0][i][r] * factors[1][j][r] * factors[2][k][r];
+                }
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, (sptValue) v);
+            }
+        }
+    }
+    X.nnz = X.values.len;
+
+    int const tks[] = { 1, 3 };
+    for(int t = 0; t < 2; ++t) {
+        sptSetRandomSeed(9);
+        sptKruskalTensor K;
+        sptNewKruskalTensor(&K, 3, ndims, rank);
+        int result = sptOmpCpdGaussNewton(&X, rank, 60, 1e-12, tks[t], &K);
+        spt_CheckError(result, "cpd gn", NULL);
+        double const fit = model_fit(&X, &K);
+        /* The fit is a difference of near-equal norms, good to about the square root of the sptValue epsilon */
+        if(fabs(fit - K.fit) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+            printf("%d threads: reported fit %f, model fit %f\n", tks[t], K.fit, fit);
+            return 1;
+        }
+        if(!(fit > 1 - 10 * sqrt(PARTI_VALUE_EPSILON))) {
+            printf("%d threads: fit %f on an exact rank-3 tensor\n", tks[t], fit);
+            return 1;
+        }
+        sptFreeKruskalTensor(&K);
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* Check the factors are non-negative and the reported fit is that of the model */
+static int check_model(sptSparseTensor const * X, sptIndex const rank, sptIndex const stride, sptValue ** vals, sptValue const * lambda, double const fit, char const * name) {
+    double normsq = 0, inner = 0, model_normsq = 0;
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                if(vals[m][i * stride + r] < 0) {
+                    printf("%s: negative factor entry in mode %"PARTI_PRI_INDEX"\n", name, m);
+                    return 1;
+                }
+            }
+        }
+    }
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        double model = 0;
+        for(sptIndex r = 0; r < rank; ++r) {
+            double v = lambda[r];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                v *= vals[m][X->inds[m].data[x] * stride + r];
+            }
+            model += v;
+        }
+        normsq += X->values.data[x] * X->values.data[x];
+        inner += X->values.data[x] * model;
+    }
+    for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex s = 0; s < rank; ++s) {
+            double v = lambda[r] * lambda[s];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                double g = 0;
+                for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+                    g += vals[m][i * stride + r] * vals[m][i * stride + s];
+                }
+                v *= g;
+            }
+            model_normsq += v;
+        }
+    }
+    double const resid = normsq + model_normsq - 2 * inner;
+    double const model_fit = 1 - sqrt(resid > 0 ? resid : 0) / sqrt(normsq);
+    if(fabs(model_fit - fit) > 1e-6 || !(fit > 0)) {
+        printf("%s: reported fit %f, model fit %f\n", name, fit, model_fit);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[3] = { 30, 20, 25 };
+    sptIndex const rank = 4;
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 1500, SPT_GEN_UNIFORM, 0, 13, 1);
+    spt_CheckError(result, "generate", NULL);
+    sptValue * vals[3];
+
+    sptKruskalTensor coo;
+    sptNewKruskalTensor(&coo, 3, ndims, rank);
+    result = sptOmpCpdNnHals(&X, rank, 15, 0, 2, &coo);
+    spt_CheckError(result, "cpd hals", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        vals[m] = coo.factors[m]->values;
+    }
+    if(check_model(&X, rank, coo.factors[0]->stride, vals, coo.lambda, coo.fit, "COO HALS") != 0) {
+        return 1;
+    }
+
+#ifdef PARTI_USE_OPENMP
+    sptSparseTensorHiCOO hitsr;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X, 3, 5, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+    sptRankKruskalTensor hi;
+    sptNewRankKruskalTensor(&hi, 3, ndims, rank);
+    result = sptOmpCpdNnHalsHiCOO(&hitsr, rank, 15, 0, 2, &hi);
+    spt_CheckError(result, "cpd hals hicoo", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        vals[m] = hi.factors[m]->values;
+    }
+    if(check_model(&X, rank, hi.factors[0]->stride, vals, hi.lambda, hi.fit, "HiCOO HALS") != 0) {
+        return 1;
+    }
+    sptFreeRankKruskalTensor(&hi);
+    sptFreeSparseTensorHiCOO(&hitsr);
+#endif
+
+    sptFreeKruskalTensor(&coo);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
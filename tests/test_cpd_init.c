@@ -0,0 +1,108 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 24
+#define J 18
+#define K 14
+#define R 3
+
+int main(void) {
+    sptIndex const ndims[3] = { I, J, K };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    /* An exact, well-conditioned rank-3 tensor, stored with every entry as a nonzero */
+    for(sptIndex i = 0; i < I; ++i) {
+        for(sptIndex j = 0; j < J; ++j) {
+            for(sptIndex k = 0; k < K; ++k) {
+                double v = 0;
+                for(int r = 0; r < R; ++r) {
+                    v += (R - r) * sin(0.7 * (r + 1) * i + r) * cos(0.5 * (r + 2) * j) * sin(0.3 * (r + 1) * k + 1);
+                }
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, v);
+                ++X.nnz;
+            }
+        }
+    }
+
+    /* Every method gives finite factors of the right shape; the bases are orthonormal */
+    for(int init = SPT_CPD_INIT_RANDOM; init <= SPT_CPD_INIT_SAMPLED; ++init) {
+        sptKruskalTensor kt;
+        sptNewKruskalTensor(&kt, 3, ndims, R);
+        result = sptCpdInitFactors(&kt, &X, R, (sptCpdInit) init, 2);
+        spt_CheckError(result, "init factors", NULL);
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptMatrix const * A = kt.factors[m];
+            if(A->nrows != ndims[m] || A->ncols != R) {
+                printf("init %d: factor %"PARTI_PRI_INDEX" has the wrong shape\n", init, m);
+                return 1;
+            }
+            for(sptIndex r = 0; r < R; ++r) {
+                for(sptIndex s = 0; s <= r; ++s) {
+                    double dot = 0;
+                    for(sptIndex i = 0; i < A->nrows; ++i) {
+                        dot += A->values[i * A->stride + r] * A->values[i * A->stride + s];
+                    }
+                    if(!isfinite(dot)) {
+                        printf("init %d: factor %"PARTI_PRI_INDEX" is not finite\n", init, m);
+                        return 1;
+                    }
+                    if((init == SPT_CPD_INIT_RANGE || init == SPT_CPD_INIT_HOSVD) && fabs(dot - (r == s)) > 1e3 * PARTI_VALUE_EPSILON) {
+                        printf("init %d: factor %"PARTI_PRI_INDEX" is not orthonormal\n", init, m);
+                        return 1;
+                    }
+                }
+            }
+        }
+        /* And a driver starts from them. The other starts depend on the clock-seeded stream,
+           the HOSVD bases do not, and from them ALS converges in a few sweeps */
+        result = sptCpdAls(&X, R, 5, 0, &kt);
+        spt_CheckError(result, "cpd als", NULL);
+        if(init == SPT_CPD_INIT_HOSVD && kt.fit < 0.99) {
+            printf("init %d: fit %f on an exact rank-3 tensor\n", init, kt.fit);
+            return 1;
+        }
+        sptFreeKruskalTensor(&kt);
+    }
+
+    /* The drivers use the chosen method when given no factors */
+    result = sptSetCpdInit(SPT_CPD_INIT_HOSVD);
+    spt_CheckError(result, "set init", NULL);
+    sptKruskalTensor kt;
+    sptNewKruskalTensor(&kt, 3, ndims, R);
+    result = sptOmpCpdAls(&X, R, 5, 0, 2, 0, &kt);
+    spt_CheckError(result, "omp cpd als", NULL);
+    if(kt.fit < 0.99) {
+        printf("HOSVD started CP-ALS fit %f on an exact rank-3 tensor\n", kt.fit);
+        return 1;
+    }
+    sptSetCpdInit(SPT_CPD_INIT_RANDOM);
+
+    sptFreeKruskalTensor(&kt);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
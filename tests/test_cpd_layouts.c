@@ -0,0 +1,170 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_Compare(sptValue const * ref, sptValue const * out, sptIndex stride, sptIndex nrows, sptIndex R) {
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue const a = ref[i * stride + r];
+            sptValue const b = out[i * stride + r];
+            if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The policy follows the budget, longest modes first, and every routed MTTKRP matches the sequential one */
+int main(void) {
+    sptIndex const ndims[] = { 600, 30, 250, 45 };
+    sptIndex const R = 13;
+    int const tk = 3;
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptGenerateSparseTensor(&X, nmodes, ndims, 4000, SPT_GEN_UNIFORM, 0, 7 + nmodes, 1);
+        spt_CheckError(result, "generate", NULL);
+
+        sptCpdLayouts full, half, none;
+        result = sptNewCpdLayouts(&full, &X, R, tk, (size_t) 1 << 30);
+        spt_CheckError(result, "per-mode layouts", NULL);
+        result = sptNewCpdLayouts(&half, &X, R, tk, full.bytes / 2);
+        spt_CheckError(result, "hybrid layouts", NULL);
+        result = sptNewCpdLayouts(&none, &X, R, tk, 1);
+        spt_CheckError(result, "shared layouts", NULL);
+        int ok = full.policy == SPT_CPD_LAYOUT_PER_MODE && half.policy == SPT_CPD_LAYOUT_HYBRID &&
+            none.policy == SPT_CPD_LAYOUT_SHARED && half.copies[0] != NULL && half.copies[1] == NULL &&
+            half.bytes <= full.bytes / 2;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            ok = ok && full.copies[m] != NULL && none.copies[m] == NULL;
+        }
+        if(!ok) {
+            printf("Layout policies: nmodes %"PARTI_PRI_INDEX", %d %d %d, %zu of %zu bytes\n", nmodes,
+                (int) full.policy, (int) half.policy, (int) none.policy, half.bytes, full.bytes);
+            return 1;
+        }
+        sptFreeCpdLayouts(&full);
+        sptFreeCpdLayouts(&half);
+        sptFreeCpdLayouts(&none);
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            mats[m] = malloc(sizeof *mats[m]);
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex const stride = mats[0]->stride;
+        sptValue * ref = malloc((size_t)nmodes * max_dim * stride * sizeof *ref);
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            mats_order[0] = mode;
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            sptMTTKRP(&X, mats, mats_order, mode);
+            memcpy(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+        }
+
+        /* Routed modes read their copies, the others fall through to the reduction */
+        size_t const budgets[] = { (size_t) 1 << 30, 0 };
+        for(int b = 0; b < 2; ++b) {
+            sptSetCpdLayoutBudget(b == 0 ? PARTI_CPD_LAYOUT_BYTES : 150000);
+            sptCpdWorkspace ws;
+            result = sptNewCpdWorkspace(&ws, nmodes, X.ndims, R, tk, 1);
+            spt_CheckError(result, "workspace", NULL);
+            result = sptCpdWorkspaceUseLayouts(&ws, &X, budgets[b]);
+            spt_CheckError(result, "workspace layouts", NULL);
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                result = sptOmpMTTKRPWorkspace(&X, mats, mode, &ws);
+                spt_CheckError(result, "workspace mttkrp", NULL);
+                if(spt_Compare(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                    printf("Layout MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", policy %d\n",
+                        nmodes, mode, (int) ws.layouts->policy);
+                    return 1;
+                }
+            }
+            sptFreeCpdWorkspace(&ws);
+        }
+        sptSetCpdLayoutBudget(PARTI_CPD_LAYOUT_BYTES);
+
+        /* HiCOO copies are decoded from the blocks and sorted like COO ones */
+        sptSparseTensor Y;
+        sptCopySparseTensor(&Y, &X, 1);
+        sptSparseTensorHiCOO H;
+        sptNnzIndex max_nnzb = 0;
+        result = sptSparseTensorToHiCOO(&H, &max_nnzb, &Y, 3, 5, tk);
+        spt_CheckError(result, "to hicoo", NULL);
+        sptCpdLayouts hl;
+        result = sptNewCpdLayoutsHiCOO(&hl, &H, R, tk, 0);
+        spt_CheckError(result, "hicoo layouts", NULL);
+        if(hl.policy != SPT_CPD_LAYOUT_PER_MODE) {
+            printf("HiCOO layout policy %d\n", (int) hl.policy);
+            return 1;
+        }
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            sptCpdWorkspace ws;
+            sptNewCpdWorkspace(&ws, nmodes, X.ndims, R, tk, 0);
+            ws.layouts = &hl;
+            result = sptOmpMTTKRPWorkspace(&X, mats, mode, &ws);
+            spt_CheckError(result, "hicoo layout mttkrp", NULL);
+            ws.layouts = NULL;
+            sptFreeCpdWorkspace(&ws);
+            if(spt_Compare(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                printf("HiCOO layout MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                return 1;
+            }
+        }
+        sptFreeCpdLayouts(&hl);
+
+        /* The drivers run with and without copies */
+        sptKruskalTensor K;
+        sptNewKruskalTensor(&K, nmodes, X.ndims, R);
+        result = sptOmpCpdAls(&X, R, 3, 0, tk, 0, &K);
+        spt_CheckError(result, "cpd als", NULL);
+        sptRankKruskalTensor HK;
+        sptNewRankKruskalTensor(&HK, nmodes, X.ndims, R);
+        result = sptOmpCpdAlsHiCOO(&H, R, 3, 0, tk, &HK);
+        spt_CheckError(result, "hicoo cpd als", NULL);
+        if(!(K.fit > -1e9) || !(HK.fit > -1e9)) {
+            printf("CPD fits %f %f\n", K.fit, HK.fit);
+            return 1;
+        }
+        sptFreeKruskalTensor(&K);
+        sptFreeRankKruskalTensor(&HK);
+
+        free(ref);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        free(mats_order);
+        sptFreeSparseTensorHiCOO(&H);
+        sptFreeSparseTensor(&Y);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+int main(void) {
+    sptIndex const ndims[3] = { 30, 20, 25 };
+    sptIndex const rank = 4;
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 1500, SPT_GEN_UNIFORM, 0, 11, 1);
+    spt_CheckError(result, "generate", NULL);
+    result = sptSetCpdLineSearch(1);
+    spt_CheckError(result, "set line search", NULL);
+
+    /* Accepted and rejected steps leave the reported fit that of the returned model */
+    sptKruskalTensor coo;
+    sptNewKruskalTensor(&coo, 3, ndims, rank);
+    result = sptCpdAls(&X, rank, 12, 0, &coo);
+    spt_CheckError(result, "cpd als", NULL);
+    double fit = model_fit(&X, &coo);
+    if(fabs(fit - coo.fit) > 1e-6) {
+        printf("COO line search reported fit %f, model fit %f\n", coo.fit, fit);
+        return 1;
+    }
+
+    sptSparseTensorHiCOO hitsr;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X, 3, 5, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+    sptRankKruskalTensor hi;
+    sptNewRankKruskalTensor(&hi, 3, ndims, rank);
+    result = sptCpdAlsHiCOO(&hitsr, rank, 12, 0, &hi);
+    spt_CheckError(result, "cpd als hicoo", NULL);
+    sptValue * vals[3];
+    for(sptIndex m = 0; m < 3; ++m) {
+        vals[m] = hi.factors[m]->values;
+    }
+    fit = model_fit_values(&X, rank, hi.factors[0]->stride, vals, hi.lambda);
+    if(fabs(fit - hi.fit) > 1e-6) {
+        printf("HiCOO line search reported fit %f, model fit %f\n", hi.fit, fit);
+        return 1;
+    }
+
+    sptSetCpdLineSearch(0);
+    sptFreeRankKruskalTensor(&hi);
+    sptFreeSparseTensorHiCOO(&hitsr);
+    sptFreeKruskalTensor(&coo);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
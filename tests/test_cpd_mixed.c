@@ -0,0 +1,82 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+/* The mixed-precision driver follows sptOmpCpdAls from the same initial factors */
+int main(void) {
+    sptIndex const ndims[3] = { 60, 50, 40 };
+    sptIndex const rank = 4;
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 20000, SPT_GEN_UNIFORM, 0, 5, 1);
+    spt_CheckError(result, "generate", NULL);
+
+    sptKruskalTensor ref, mixed;
+    sptNewKruskalTensor(&ref, 3, ndims, rank);
+    result = sptCpdInitFactors(&ref, &X, rank, SPT_CPD_INIT_RANDOM, 2);
+    spt_CheckError(result, "init factors", NULL);
+    sptNewKruskalTensor(&mixed, 3, ndims, rank);
+    result = sptCpdInitFactors(&mixed, &X, rank, SPT_CPD_INIT_RANDOM, 2);
+    spt_CheckError(result, "init factors", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        memcpy(mixed.factors[m]->values, ref.factors[m]->values, (size_t) ndims[m] * ref.factors[m]->stride * sizeof(sptValue));
+    }
+
+    result = sptOmpCpdAls(&X, rank, 8, 0, 2, 0, &ref);
+    spt_CheckError(result, "cpd als", NULL);
+    result = sptOmpCpdAlsMixed(&X, rank, 8, 0, 2, &mixed);
+    spt_CheckError(result, "mixed cpd als", NULL);
+
+    /* The reference rounds its accumulations to sptValue, so the tolerance follows its precision */
+    double const eps = PARTI_VALUE_EPSILON;
+    double const fit = model_fit(&X, &mixed);
+    if(fabs(fit - mixed.fit) > 1e4 * eps || fabs(mixed.fit - ref.fit) > 1e4 * eps) {
+        printf("mixed fit %.10f, model fit %.10f, sptOmpCpdAls fit %.10f\n", mixed.fit, fit, ref.fit);
+        return 1;
+    }
+    /* Factors are unit columns after GetFinalLambda, so they compare directly */
+    double maxdiff = 0;
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                double const d = fabs(mixed.factors[m]->values[i * mixed.factors[m]->stride + r] -
+                    ref.factors[m]->values[i * ref.factors[m]->stride + r]);
+                maxdiff = d > maxdiff ? d : maxdiff;
+            }
+        }
+    }
+    for(sptIndex r = 0; r < rank; ++r) {
+        double const d = fabs(mixed.lambda[r] - ref.lambda[r]) / fabs(ref.lambda[r]);
+        maxdiff = d > maxdiff ? d : maxdiff;
+    }
+    if(maxdiff > 1e5 * eps) {
+        printf("mixed factors differ from sptOmpCpdAls by %g\n", maxdiff);
+        return 1;
+    }
+
+    sptFreeKruskalTensor(&mixed);
+    sptFreeKruskalTensor(&ref);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 64
+#define J 48
+#define K 40
+#define R 3
+
+int main(void) {
+    sptIndex const ndims[3] = { I, J, K };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    /* An exact rank-3 tensor with smooth factors, so merged neighbours are alike */
+    for(sptIndex i = 0; i < I; ++i) {
+        for(sptIndex j = 0; j < J; ++j) {
+            for(sptIndex k = 0; k < K; ++k) {
+                double v = 0;
+                for(int r = 0; r < R; ++r) {
+                    v += (R - r) * sin(0.07 * (r + 1) * i + r) * cos(0.05 * (r + 2) * j) * sin(0.03 * (r + 1) * k + 1);
+                }
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, v);
+                ++X.nnz;
+            }
+        }
+    }
+
+    /* The coarse levels leave the full tensor little to refine; the coarsest
+       starts from its HOSVD, which unlike a random start is the same every run */
+    result = sptSetCpdInit(SPT_CPD_INIT_HOSVD);
+    spt_CheckError(result, "set init", NULL);
+    sptKruskalTensor kt;
+    sptNewKruskalTensor(&kt, 3, ndims, R);
+    result = sptOmpCpdAlsMultilevel(&X, R, 0, 20, 3, 0, 2, &kt);
+    spt_CheckError(result, "cpd multilevel", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(kt.factors[m]->nrows != ndims[m] || kt.factors[m]->ncols != R) {
+            printf("factor %"PARTI_PRI_INDEX" has the wrong shape\n", m);
+            return 1;
+        }
+    }
+    if(kt.fit < 0.99) {
+        printf("multilevel CPD fit %f on an exact rank-3 tensor\n", kt.fit);
+        return 1;
+    }
+
+    /* Given factors, it only refines them */
+    result = sptOmpCpdAlsMultilevel(&X, R, 0, 20, 2, 0, 2, &kt);
+    spt_CheckError(result, "cpd multilevel warm", NULL);
+    if(kt.fit < 0.99) {
+        printf("warm multilevel CPD fit %f\n", kt.fit);
+        return 1;
+    }
+
+    sptSetCpdInit(SPT_CPD_INIT_RANDOM);
+    sptFreeKruskalTensor(&kt);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
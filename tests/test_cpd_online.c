@@ -0,0 +1,124 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 12
+#define J 10
+#define T 30
+#define HISTORY 20
+#define R 2
+
+static double spt_Factor(int mode, int i, int r) {
+    return 1 + 0.8 * sin((0.4 + 0.9 * r) * (mode + 1) * i + 1.3 * r);
+}
+
+/* Time slices [t0, t1) of an exact rank-R tensor, time counted from t0 */
+static void spt_BuildSlices(sptSparseTensor *X, int t0, int t1) {
+    sptIndex const ndims[3] = { I, J, (sptIndex) (t1 - t0) };
+    sptAssert(sptNewSparseTensor(X, 3, ndims) == 0);
+    for(int t = t0; t < t1; ++t) {
+        for(int i = 0; i < I; ++i) {
+            for(int j = 0; j < J; ++j) {
+                double v = 0;
+                for(int r = 0; r < R; ++r) {
+                    v += spt_Factor(0, i, r) * spt_Factor(1, j, r) * spt_Factor(2, t, r);
+                }
+                sptAssert(sptAppendIndexVector(&X->inds[0], i) == 0);
+                sptAssert(sptAppendIndexVector(&X->inds[1], j) == 0);
+                sptAssert(sptAppendIndexVector(&X->inds[2], t - t0) == 0);
+                sptAssert(sptAppendValueVector(&X->values, v) == 0);
+                ++X->nnz;
+            }
+        }
+    }
+}
+
+int main(void) {
+    /* The decomposition of the history, as CP-ALS would leave it: slightly off the true factors */
+    sptIndex const ndims[3] = { I, J, HISTORY };
+    sptKruskalTensor ktensor;
+    int result = sptNewKruskalTensor(&ktensor, 3, ndims, R);
+    spt_CheckError(result, "new ktensor", NULL);
+    ktensor.factors = malloc(3 * sizeof *ktensor.factors);
+    for(sptIndex m = 0; m < 3; ++m) {
+        ktensor.factors[m] = malloc(sizeof *ktensor.factors[m]);
+        result = sptNewMatrix(ktensor.factors[m], ndims[m], R);
+        spt_CheckError(result, "new factor", NULL);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                ktensor.factors[m]->values[i * ktensor.factors[m]->stride + r] =
+                    spt_Factor((int) m, (int) i, (int) r) * (1 + 0.02 * cos(3.1 * i + r + m));
+            }
+        }
+    }
+    for(sptIndex r = 0; r < R; ++r) {
+        ktensor.lambda[r] = 1;
+    }
+
+    sptOnlineCpd state;
+    result = sptNewOnlineCpd(&state, &ktensor, 2, 1.0);
+    spt_CheckError(result, "new online cpd", NULL);
+
+    for(int t = HISTORY; t < T; t += 2) {
+        sptSparseTensor slice;
+        spt_BuildSlices(&slice, t, t + 2);
+        result = sptOnlineCpdUpdate(&state, &slice, 2, &ktensor);
+        spt_CheckError(result, "online update", NULL);
+        if(ktensor.fit < 0.97) {
+            printf("slice %d fit %f\n", t, ktensor.fit);
+            return 1;
+        }
+        sptFreeSparseTensor(&slice);
+    }
+    if(ktensor.ndims[2] != T || ktensor.factors[2]->nrows != T) {
+        printf("time factor has %u rows\n", (unsigned) ktensor.factors[2]->nrows);
+        return 1;
+    }
+
+    /* The updated model still reproduces the whole tensor */
+    sptSparseTensor X;
+    spt_BuildSlices(&X, 0, T);
+    double err = 0, norm = 0;
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        double v = 0;
+        for(sptIndex r = 0; r < R; ++r) {
+            double prod = ktensor.lambda[r];
+            for(sptIndex m = 0; m < 3; ++m) {
+                sptMatrix const * a = ktensor.factors[m];
+                prod *= a->values[X.inds[m].data[x] * a->stride + r];
+            }
+            v += prod;
+        }
+        err += (v - X.values.data[x]) * (v - X.values.data[x]);
+        norm += X.values.data[x] * X.values.data[x];
+    }
+    if(sqrt(err / norm) > 0.03) {
+        printf("overall relative error %f\n", sqrt(err / norm));
+        return 1;
+    }
+
+    sptFreeOnlineCpd(&state);
+    sptFreeKruskalTensor(&ktensor);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
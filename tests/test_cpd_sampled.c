@@ -0,0 +1,66 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+#define I 20
+#define J 16
+#define K 12
+
+int main(void) {
+    sptIndex const ndims[3] = { I, J, K };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    /* An exact rank-2 tensor, stored with every entry as a nonzero */
+    for(sptIndex i = 0; i < I; ++i) {
+        for(sptIndex j = 0; j < J; ++j) {
+            for(sptIndex k = 0; k < K; ++k) {
+                double const v = (1 + i % 5) * (1 + j % 3) * (1 + k % 4) + (1 + i % 2) * (4 - j % 4) * (1 + k % 3);
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, v);
+                ++X.nnz;
+            }
+        }
+    }
+
+    sptKruskalTensor kt;
+    sptNewKruskalTensor(&kt, 3, ndims, 2);
+    result = sptOmpCpdAlsSampled(&X, 2, 0, 20, 0, 5, 2, &kt);
+    spt_CheckError(result, "cpd sampled", NULL);
+    double const fit = model_fit(&X, &kt);
+    if(fabs(fit - kt.fit) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("reported fit %f, model fit %f\n", kt.fit, fit);
+        return 1;
+    }
+    if(fit < 0.99) {
+        printf("sampled CPD fit %f on an exact rank-2 tensor\n", fit);
+        return 1;
+    }
+
+    sptFreeKruskalTensor(&kt);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
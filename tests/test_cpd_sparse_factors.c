@@ -0,0 +1,169 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+
+/* The reported fit is that of the model, computed from scratch */
+static int check_fit(sptSparseTensor const * X, sptKruskalTensor const * k) {
+    sptIndex const rank = k->rank;
+    sptIndex const stride = k->factors[0]->stride;
+    double normsq = 0, inner = 0, model_normsq = 0;
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        double model = 0;
+        for(sptIndex r = 0; r < rank; ++r) {
+            double v = k->lambda[r];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                v *= k->factors[m]->values[X->inds[m].data[x] * stride + r];
+            }
+            model += v;
+        }
+        normsq += X->values.data[x] * X->values.data[x];
+        inner += X->values.data[x] * model;
+    }
+    for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex s = 0; s < rank; ++s) {
+            double v = k->lambda[r] * k->lambda[s];
+            for(sptIndex m = 0; m < X->nmodes; ++m) {
+                double g = 0;
+                for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+                    g += k->factors[m]->values[i * stride + r] * k->factors[m]->values[i * stride + s];
+                }
+                v *= g;
+            }
+            model_normsq += v;
+        }
+    }
+    double const resid = normsq + model_normsq - 2 * inner;
+    double const model_fit = 1 - sqrt(resid > 0 ? resid : 0) / sqrt(normsq);
+    if(fabs(model_fit - k->fit) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("reported fit %f, model fit %f\n", k->fit, model_fit);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[3] = { 30, 25, 20 };
+    sptIndex const rank = 3;
+    sptSetRandomSeed(1);
+
+    /* MTTKRP against CSR factors with zero rows and entries equals the dense one */
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 1200, SPT_GEN_UNIFORM, 0, 5, 1);
+    spt_CheckError(result, "generate", NULL);
+    sptMatrix * mats[4];
+    sptSparseMatrixCSR csr[3];
+    sptSparseMatrixCSR * factors[3] = { &csr[0], &csr[1], &csr[2] };
+    for(sptIndex m = 0; m < 3; ++m) {
+        mats[m] = malloc(sizeof(sptMatrix));
+        sptNewMatrix(mats[m], ndims[m], rank);
+        sptRandomizeMatrix(mats[m], ndims[m], rank);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                if(i % 4 == 1 || (i + r + m) % 3 == 0) {
+                    mats[m]->values[i * mats[m]->stride + r] = 0;
+                }
+            }
+        }
+        result = sptSparseMatrixCSRFromMatrix(&csr[m], mats[m], 0, 2);
+        spt_CheckError(result, "to csr", NULL);
+    }
+    mats[3] = malloc(sizeof(sptMatrix));
+    sptNewMatrix(mats[3], 30, rank);
+    sptMatrix M;
+    sptNewMatrix(&M, 30, rank);
+    sptIndex mats_order[3];
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        for(sptIndex i = 0; i < 3; ++i) {
+            mats_order[i] = (mode + i) % 3;
+        }
+        mats[3]->nrows = ndims[mode];
+        M.nrows = ndims[mode];
+        result = sptOmpMTTKRP(&X, mats, mats_order, mode, 2);
+        spt_CheckError(result, "mttkrp", NULL);
+        result = sptOmpMTTKRPSparseFactors(&X, factors, mode, &M, 2);
+        spt_CheckError(result, "mttkrp sparse factors", NULL);
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                double const a = mats[3]->values[i * M.stride + r];
+                double const b = M.values[i * M.stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + fabs(a))) {
+                    printf("mode %"PARTI_PRI_INDEX" (%"PARTI_PRI_INDEX", %"PARTI_PRI_INDEX"): dense %g, sparse factors %g\n", mode, i, r, a, b);
+                    return 1;
+                }
+            }
+        }
+    }
+    for(sptIndex m = 0; m < 4; ++m) {
+        if(m < 3) {
+            sptFreeSparseMatrixCSR(&csr[m]);
+        }
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    sptFreeMatrix(&M);
+    sptFreeSparseTensor(&X);
+
+    /* A tensor of three components with disjoint 4-element supports per mode */
+    result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex x = 0; x < 64; ++x) {
+            double v = 1 + 0.5 * r;
+            for(sptIndex m = 0; m < 3; ++m) {
+                sptIndex const i = 5 * r + (x >> (2 * m)) % 4;
+                sptAppendIndexVector(&X.inds[m], i);
+                v *= 1 + 0.1 * (i - 5 * r + m);
+            }
+            sptAppendValueVector(&X.values, v);
+            ++X.nnz;
+        }
+    }
+
+    sptKruskalTensor k;
+    sptNewKruskalTensor(&k, 3, ndims, rank);
+    result = sptOmpCpdAlsSparseFactors(&X, rank, 200, 1e-10, 1e-3, 2, &k);
+    spt_CheckError(result, "cpd sparse factors", NULL);
+    if(k.fit < 0.99) {
+        printf("fit %f on an exact sparse rank-3 tensor\n", k.fit);
+        return 1;
+    }
+    if(check_fit(&X, &k) != 0) {
+        return 1;
+    }
+    sptNnzIndex factor_nnz = 0;
+    for(sptIndex m = 0; m < 3; ++m) {
+        result = sptSparseMatrixCSRFromMatrix(&csr[0], k.factors[m], 0, 1);
+        spt_CheckError(result, "to csr", NULL);
+        factor_nnz += csr[0].nnz;
+        sptFreeSparseMatrixCSR(&csr[0]);
+    }
+    /* The true factors have 36 non-zeros out of 225 */
+    if(factor_nnz > 60) {
+        printf("%lu non-zero factor entries, the factors are not sparse\n", (unsigned long) factor_nnz);
+        return 1;
+    }
+    sptFreeKruskalTensor(&k);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
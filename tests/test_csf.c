@@ -0,0 +1,115 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* CSF MTTKRP must match COO MTTKRP on every mode for any level order */
+static int check_csf(sptSparseTensor *X, sptIndex const * mode_order, int tk) {
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = 5;
+    sptSparseTensorCSF csf;
+    int result = sptSparseTensorToCSF(&csf, X, mode_order, tk);
+    spt_CheckError(result, "to csf", NULL);
+    if(csf.nfibs[nmodes-1] != X->nnz) {
+        printf("CSF leaf count %"PARTI_PRI_NNZ_INDEX" != nnz\n", csf.nfibs[nmodes-1]);
+        return 1;
+    }
+
+    sptIndex max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? X->ndims[m] : max_dim;
+        sptNewMatrix(mats[m], nrows, R);
+        sptRandomizeMatrix(mats[m], nrows, R);
+    }
+    sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+    sptValue * ref = malloc((size_t)max_dim * mats[0]->stride * sizeof *ref);
+
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+        mats_order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            mats_order[i] = (mode+i) % nmodes;
+        }
+        mats[nmodes]->nrows = X->ndims[mode];
+        sptMTTKRP(X, mats, mats_order, mode);
+        memcpy(ref, mats[nmodes]->values, (size_t)X->ndims[mode] * mats[0]->stride * sizeof *ref);
+        /* An entry may cancel to near zero, so the rounding is bounded by the largest one */
+        double scale = 0;
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                scale = fmax(scale, fabs(ref[i * mats[0]->stride + r]));
+            }
+        }
+
+        result = sptOmpMTTKRPCSF(&csf, mats, mode, tk);
+        spt_CheckError(result, "csf mttkrp", NULL);
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptValue const a = ref[i * mats[0]->stride + r];
+                sptValue const b = mats[nmodes]->values[i * mats[0]->stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    failed = 1;
+                }
+            }
+        }
+        if(failed) {
+            printf("CSF MTTKRP mismatch on mode %"PARTI_PRI_INDEX"\n", mode);
+            break;
+        }
+    }
+
+    free(ref);
+    free(mats_order);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+    sptFreeSparseTensorCSF(&csf);
+    return failed;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 23, 7, 41, 5 };
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 3000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = 3000;
+
+        sptIndex const reversed[] = { nmodes-1, nmodes-2, nmodes-3, 0 };
+        if(check_csf(&X, NULL, 1) != 0 || check_csf(&X, NULL, 2) != 0 ||
+            check_csf(&X, reversed, 2) != 0) {
+            return 1;
+        }
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
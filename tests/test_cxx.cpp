@@ -0,0 +1,148 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.hpp>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+/* A 64^3 tensor with the nonzeros whose coordinates sum to a multiple of step */
+static parti::SparseTensor spt_StepTensor(sptIndex step) {
+    sptIndex const ndims[] = { 64, 64, 64 };
+    parti::SparseTensor X(3, ndims);
+    sptSparseTensor * x = X.get();
+    for(sptIndex i = 0; i < 64; ++i) {
+        for(sptIndex j = 0; j < 64; ++j) {
+            for(sptIndex k = 0; k < 64; ++k) {
+                if((i + j + k) % step == 0) {
+                    sptAppendIndexVector(&x->inds[0], i);
+                    sptAppendIndexVector(&x->inds[1], j);
+                    sptAppendIndexVector(&x->inds[2], k);
+                    sptAppendValueVector(&x->values, 1 + (i * 7 + j * 3 + k) % 11);
+                    ++ x->nnz;
+                }
+            }
+        }
+    }
+    return X;
+}
+
+int main() {
+    static char bufX[] = "3\n"
+        "2 3 4\n"
+        "0 0 0 1\n"
+        "0 2 1 2\n"
+        "1 0 3 3\n"
+        "1 1 2 4\n"
+        "1 2 0 5\n";
+    FILE * stream = fmemopen(bufX, sizeof bufX - 1, "r");
+    parti::SparseTensor X = parti::SparseTensor::load(stream, 0);
+    fclose(stream);
+
+    /* Moves hand the arrays over, clones copy them */
+    sptValue const * values = X.values().data();
+    parti::SparseTensor Y = std::move(X);
+    if(X || !Y || Y.values().data() != values || Y.nnz() != 5) {
+        std::printf("Move did not transfer ownership\n");
+        return 1;
+    }
+    parti::SparseTensor Z = Y.clone(1);
+    if(Z.values().data() == values || std::memcmp(Z.values().data(), values, 5 * sizeof (sptValue)) != 0) {
+        std::printf("Clone is not a deep copy\n");
+        return 1;
+    }
+
+    /* Slices point into the tensor, and wrap into C tensors without a copy */
+    sptIndex const mode_order[] = { 1, 0, 2 };
+    sptSparseTensorSortIndexCustomOrder(Y.get(), mode_order, 1);
+    parti::SparseTensorView S = Y.slice(1, 2);
+    if(S.nnz() != 2 || S.inds(1)[0] != 2 || S.inds(1)[1] != 2 || S.values().data() != Y.values().data() + S.offset()) {
+        std::printf("Slice view is wrong\n");
+        return 1;
+    }
+    parti::WrappedSparseTensor W(S);
+    if(W.get()->nnz != 2 || W.get()->values.data != S.values().data()) {
+        std::printf("Wrapped slice is wrong\n");
+        return 1;
+    }
+    try {
+        Z.slice(2, 0);
+        std::printf("Slice of an unsorted mode accepted\n");
+        return 1;
+    } catch(parti::Error const & e) {
+        if(e.code() != SPTERR_VALUE_ERROR) {
+            return 1;
+        }
+    }
+
+    /* A decomposition fills the owner's factors, and views read them in place */
+    parti::KruskalTensor K(Z.nmodes(), Z.ndims().data(), 2);
+    parti::check(sptOmpCpdAls(Z.get(), 2, 5, 1e-5, 1, 0, K.get()), "sptOmpCpdAls");
+    if(!K.has_factors() || K.factor(0).nrows() != 2 || K.factor(2).ncols() != 2 || K.lambda().size() != 2) {
+        std::printf("Kruskal tensor views are wrong\n");
+        return 1;
+    }
+    parti::Matrix A(3, 2);
+    A(2, 1) = 7;
+    parti::Matrix B = A.clone();
+    A = std::move(B);
+    if(B || A(2, 1) != 7 || A.view().row(2)[1] != 7) {
+        std::printf("Matrix move or clone is wrong\n");
+        return 1;
+    }
+
+    parti::SparseTensorHiCOO H = parti::SparseTensorHiCOO::from(Z, 1, 2, 1);
+    if(H.nnz() != 5 || H.nmodes() != 3) {
+        std::printf("HiCOO conversion is wrong\n");
+        return 1;
+    }
+
+    /* A fused expression matches the step-by-step C kernels */
+    parti::SparseTensor x = spt_StepTensor(2), y = spt_StepTensor(3), w = spt_StepTensor(5);
+    parti::SparseTensor fused = 0.5 * (x * y) + w - w / 4.0;
+    sptSparseTensor xy, ref;
+    parti::check(sptSparseTensorDotMul(&xy, x.get(), y.get()), "sptSparseTensorDotMul");
+    parti::check(sptSparseTensorMulScalar(&xy, 0.5), "sptSparseTensorMulScalar");
+    parti::SparseTensor w4 = w.clone(1);
+    parti::check(sptSparseTensorMulScalar(w4.get(), 0.75), "sptSparseTensorMulScalar");
+    parti::check(sptSparseTensorAdd(&ref, &xy, w4.get()), "sptSparseTensorAdd");
+    int same = fused.nnz() == ref.nnz;
+    for(sptNnzIndex z = 0; same && z < ref.nnz; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            same = same && fused.inds(m)[z] == ref.inds[m].data[z];
+        }
+        same = same && fused.values()[z] == ref.values.data[z];
+    }
+    sptFreeSparseTensor(&ref);
+    sptFreeSparseTensor(&xy);
+    if(!same) {
+        std::printf("Fused expression differs from the C kernels\n");
+        return 1;
+    }
+    parti::SparseTensor unsorted = spt_StepTensor(7);
+    std::swap(unsorted.inds(0)[0], unsorted.inds(0)[unsorted.nnz() - 1]);
+    try {
+        parti::SparseTensor bad = x + unsorted;
+        std::printf("Unsorted operand accepted\n");
+        return 1;
+    } catch(parti::Error const & e) {
+        if(e.code() != SPTERR_VALUE_ERROR) {
+            return 1;
+        }
+    }
+    return 0;
+}
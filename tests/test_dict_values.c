@@ -0,0 +1,165 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+
+/* Dictionary codes must round-trip exactly, and their MTTKRP and norm must equal the full ones */
+int main(void) {
+    sptIndex const ndims[] = { 40, 17, 30 };
+    sptIndex const nmodes = 3, R = 8;
+    sptValue const counts[] = { 1, 2, 3, 5, 8, -1 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(5);
+    for(sptNnzIndex z = 0; z < 4000; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, counts[rand() % 6]);
+    }
+    X.nnz = 4000;
+
+    sptDictValueVector dv;
+    result = sptNewDictValueVector(&dv, &X, 3);
+    spt_CheckError(result, "new dict", NULL);
+    if(dv.width != 8 || dv.ntable != 6 || dv.table[0] != -1 || dv.table[5] != 8) {
+        printf("width %u, table of %u from %g to %g\n", dv.width, dv.ntable, dv.table[0], dv.table[dv.ntable-1]);
+        return 1;
+    }
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        if(sptDictValueAt(&dv, z) != X.values.data[z]) {
+            printf("value %g decoded as %g\n", X.values.data[z], sptDictValueAt(&dv, z));
+            return 1;
+        }
+    }
+    double const normsq = SparseTensorFrobeniusNormSquared(&X);
+    if(fabs(sptDictValueNormSquared(&dv) - normsq) > 1e3 * PARTI_VALUE_EPSILON * normsq) {
+        printf("dictionary norm %g, tensor norm %g\n", sptDictValueNormSquared(&dv), normsq);
+        return 1;
+    }
+
+    sptMatrix * mats[4];
+    sptMatrix dense;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = malloc(sizeof(sptMatrix));
+        sptNewMatrix(mats[m], ndims[m], R);
+        sptRandomizeMatrix(mats[m], ndims[m], R);
+    }
+    mats[nmodes] = malloc(sizeof(sptMatrix));
+    sptNewMatrix(mats[nmodes], 40, R);
+    sptNewMatrix(&dense, 40, R);
+    sptIndex mats_order[3];
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+        for(sptIndex i = 0; i < nmodes; ++i) {
+            mats_order[i] = (mode + i) % nmodes;
+        }
+        mats[nmodes]->nrows = ndims[mode];
+        result = sptOmpMTTKRP(&X, mats, mats_order, mode, 2);
+        spt_CheckError(result, "mttkrp", NULL);
+        memcpy(dense.values, mats[nmodes]->values, (size_t) ndims[mode] * dense.stride * sizeof (sptValue));
+        result = sptOmpMTTKRPDict(&X, &dv, mats, mats_order, mode, 2);
+        spt_CheckError(result, "mttkrp dict", NULL);
+        /* Summed in another order; an entry may cancel, so the rounding is bounded by the largest */
+        double scale = 0;
+        for(sptIndex i = 0; i < ndims[mode] * dense.stride; ++i) {
+            scale = fmax(scale, fabs(dense.values[i]));
+        }
+        for(sptIndex i = 0; i < ndims[mode] * dense.stride; ++i) {
+            if(fabs(dense.values[i] - mats[nmodes]->values[i]) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                printf("mode %"PARTI_PRI_INDEX": MTTKRP %g, dictionary MTTKRP %g\n", mode, dense.values[i], mats[nmodes]->values[i]);
+                return 1;
+            }
+        }
+    }
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    sptFreeMatrix(&dense);
+    sptFreeDictValueVector(&dv);
+
+    /* 300 distinct values need 16-bit codes, and more than 65536 none at all */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        X.values.data[z] = (sptValue) (z % 300) / 4;
+    }
+    result = sptNewDictValueVector(&dv, &X, 2);
+    spt_CheckError(result, "new dict", NULL);
+    if(dv.width != 16 || dv.ntable != 300 || sptDictValueAt(&dv, 299) != 74.75) {
+        printf("width %u, table of %u for 300 values\n", dv.width, dv.ntable);
+        return 1;
+    }
+    sptFreeDictValueVector(&dv);
+    sptFreeSparseTensor(&X);
+
+    sptIndex const wide[] = { 70000 };
+    result = sptNewSparseTensor(&X, 1, wide);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 70000; ++z) {
+        sptAppendIndexVector(&X.inds[0], (sptIndex) z);
+        sptAppendValueVector(&X.values, (sptValue) z);
+    }
+    X.nnz = 70000;
+    if(sptNewDictValueVector(&dv, &X, 2) != SPTERR_VALUE_ERROR) {
+        printf("70000 distinct values were encoded\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&X);
+
+    /* Loading encodes a count tensor and drops its values */
+    static char buf[] = "3\n"
+        "2 3 4\n"
+        "1 1 1 2\n"
+        "1 3 2 1\n"
+        "2 1 4 2\n"
+        "2 2 3 7\n"
+        "2 3 1 1\n";
+    char filename[] = "/tmp/parti_test_dict_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    spt_CheckOSError(write(fd, buf, sizeof buf - 1) != (ssize_t) (sizeof buf - 1), "write");
+    close(fd);
+    sptSparseTensor Y;
+    result = sptOmpLoadSparseTensor(&Y, 1, filename, 2);
+    spt_CheckError(result, "load", NULL);
+    result = sptOmpLoadSparseTensorDict(&X, &dv, 1, filename, 2);
+    spt_CheckError(result, "load dict", NULL);
+    unlink(filename);
+    if(!sptSparseTensorIsPattern(&X) || dv.width != 8 || dv.ntable != 3 || dv.len != Y.nnz) {
+        printf("loaded tensor not encoded\n");
+        return 1;
+    }
+    result = sptDictDecodeValues(&X, &dv, 2);
+    spt_CheckError(result, "decode", NULL);
+    for(sptNnzIndex z = 0; z < Y.nnz; ++z) {
+        if(X.values.data[z] != Y.values.data[z]) {
+            printf("loaded value %g decoded as %g\n", Y.values.data[z], X.values.data[z]);
+            return 1;
+        }
+    }
+    sptFreeDictValueVector(&dv);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
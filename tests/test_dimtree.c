@@ -0,0 +1,102 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Dimension-tree MTTKRP must match COO MTTKRP over a sweep that updates each factor in turn */
+int main(void) {
+    sptIndex const ndims[] = { 23, 7, 41, 5, 12 };
+    sptIndex const R = 6;
+    for(sptIndex nmodes = 2; nmodes <= 5; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 4000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = 4000;
+
+        sptIndex max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptValue * ref = malloc((size_t)max_dim * mats[0]->stride * sizeof *ref);
+
+        sptMttkrpDimTree tree;
+        result = sptNewMttkrpDimTree(&tree, &X, R, 2);
+        spt_CheckError(result, "new dimtree", NULL);
+
+        for(int sweep = 0; sweep < 2; ++sweep) {
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * mats[0]->stride * sizeof *ref);
+                double scale = 0;
+                for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        scale = fmax(scale, fabs(ref[i * mats[0]->stride + r]));
+                    }
+                }
+
+                result = sptOmpMTTKRPDimTree(&tree, &X, mats, mode, 2);
+                spt_CheckError(result, "dimtree mttkrp", NULL);
+                for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue const a = ref[i * mats[0]->stride + r];
+                        sptValue const b = mats[nmodes]->values[i * mats[0]->stride + r];
+                        /* Bounded by the largest entry, as entries may cancel to near zero */
+                        if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                            printf("DimTree MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                            return 1;
+                        }
+                    }
+                }
+
+                /* What an ALS update does to the factor */
+                sptRandomizeMatrix(mats[mode], X.ndims[mode], R);
+                sptMttkrpDimTreeInvalidate(&tree, mode);
+            }
+        }
+
+        sptFreeMttkrpDimTree(&tree);
+        free(ref);
+        free(mats_order);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+static void RandomTensor(sptSparseTensor *X, sptIndex const ndims[], sptNnzIndex const nnz) {
+    sptNewSparseTensor(X, 3, ndims);
+    for(sptNnzIndex n = 0; n < nnz; ++n) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X->inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X->values, (sptValue) (rand() % 100) / 10);
+        ++X->nnz;
+    }
+}
+
+/* A host-only machine: the planner predicts and picks CPU backends, and the auto MTTKRP is exact */
+int main(void) {
+    sptMachineModel machine;
+    memset(&machine, 0, sizeof machine);
+    machine.ncores = 4;
+    machine.host_bandwidth = 20e9;
+    machine.host_cache = 32 << 20;
+    sptSetMachineModel(&machine);
+    srand(5);
+
+    /* Scattered nonzeros: one call does not pay back a HiCOO conversion */
+    sptIndex const ndims[] = { 4000, 9000, 2500 };
+    sptSparseTensor X;
+    RandomTensor(&X, ndims, 20000);
+    sptDispatchPlan plan;
+    int result = sptPlanMTTKRP(&plan, &X, 16, 0, 1, 4);
+    spt_CheckError(result, "plan", NULL);
+    if(plan.seconds[SPT_BACKEND_CUDA] != DBL_MAX || plan.seconds[SPT_BACKEND_HYBRID] != DBL_MAX) {
+        printf("predicted a device backend without a device\n");
+        return 1;
+    }
+    if(!(plan.seconds[SPT_BACKEND_OMP_COO] > 0) || !(plan.seconds[SPT_BACKEND_OMP_HICOO] < DBL_MAX)) {
+        printf("no prediction for a host backend\n");
+        return 1;
+    }
+    if(plan.backend != SPT_BACKEND_OMP_COO) {
+        printf("chose backend %d for one call on a scattered tensor\n", (int) plan.backend);
+        return 1;
+    }
+    if(plan.block_density > 2) {
+        printf("scattered tensor estimated at %g nonzeros per block\n", plan.block_density);
+        return 1;
+    }
+
+    sptMatrix * mats[4];
+    sptIndex const max_dim = sptMaxIndexArray(X.ndims, 3);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < 3 ? X.ndims[m] : max_dim;
+        sptNewMatrix(mats[m], nrows, 16);
+        sptRandomizeMatrix(mats[m], nrows, 16);
+    }
+    sptIndex const stride = mats[0]->stride;
+    sptValue * ref = malloc((size_t) max_dim * stride * sizeof *ref);
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        sptIndex const mats_order[] = { mode, (mode+1) % 3, (mode+2) % 3 };
+        sptMTTKRP(&X, mats, mats_order, mode);
+        memcpy(ref, mats[3]->values, (size_t) X.ndims[mode] * stride * sizeof *ref);
+        /* Backends sum in different orders; bound the error by the largest entry, as one may cancel to near zero */
+        double scale = 0;
+        for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < 16; ++r) {
+                scale = fmax(scale, fabs(ref[i * stride + r]));
+            }
+        }
+        result = sptMTTKRPAuto(&X, mats, mats_order, mode, 2);
+        spt_CheckError(result, "auto mttkrp", NULL);
+        for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < 16; ++r) {
+                sptValue const a = ref[i * stride + r];
+                sptValue const b = mats[3]->values[i * stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    printf("auto MTTKRP mismatch at mode %"PARTI_PRI_INDEX"\n", mode);
+                    return 1;
+                }
+            }
+        }
+    }
+    free(ref);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+
+    /* Nonzeros packed into few blocks: many calls amortize the conversion and HiCOO wins */
+    sptIndex const bdims[] = { 200, 200, 200 };
+    sptSparseTensor B;
+    RandomTensor(&B, bdims, 100000);
+    result = sptPlanMTTKRP(&plan, &B, 16, 1, 100, 4);
+    spt_CheckError(result, "plan", NULL);
+    if(plan.backend != SPT_BACKEND_OMP_HICOO) {
+        printf("chose backend %d for many calls on a blocked tensor\n", (int) plan.backend);
+        return 1;
+    }
+    /* 8 blocks hold 100000 nonzeros; the estimate comes from a sample */
+    if(plan.block_density < 6000 || plan.block_density > 25000) {
+        printf("blocked tensor estimated at %g nonzeros per block\n", plan.block_density);
+        return 1;
+    }
+
+    sptKruskalTensor ktensor;
+    result = sptNewKruskalTensor(&ktensor, 3, B.ndims, 4);
+    spt_CheckError(result, "new ktensor", NULL);
+    result = sptCpdAlsAuto(&B, 4, 5, 1e-9, 2, &plan, &ktensor);
+    spt_CheckError(result, "auto cpd", NULL);
+    if(plan.backend != SPT_BACKEND_OMP_HICOO || !isfinite(ktensor.fit)) {
+        printf("auto CPD chose backend %d, fit %g\n", (int) plan.backend, ktensor.fit);
+        return 1;
+    }
+    sptFreeKruskalTensor(&ktensor);
+
+    sptSetMachineModel(NULL);
+    sptFreeSparseTensor(&B);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Dense MTTKRP and TTM must match the sparse kernels on the same entries; CP-ALS must recover an exact rank-2 tensor */
+int main(void) {
+    sptIndex const ndims[] = { 3, 11, 5, 7 };
+    sptIndex const R = 5;
+    int result;
+    for(sptIndex nmodes = 2; nmodes <= 4; ++nmodes) {
+        sptSparseTensor S;
+        result = sptNewSparseTensor(&S, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 300; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&S.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&S.values, (sptValue) (rand() % 100) / 10);
+        }
+        S.nnz = 300;
+        sptDenseTensor X;
+        result = sptSparseTensorToDense(&X, &S);
+        spt_CheckError(result, "to dense", NULL);
+
+        sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? ndims[m] : max_dim;
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex const stride = mats[0]->stride;
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptValue * ref = malloc((size_t) max_dim * stride * sizeof *ref);
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            mats_order[0] = mode;
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            sptMTTKRP(&S, mats, mats_order, mode);
+            memcpy(ref, mats[nmodes]->values, (size_t) ndims[mode] * stride * sizeof *ref);
+            result = sptDenseMTTKRP(&X, mats, mode, 3);
+            spt_CheckError(result, "dense mttkrp", NULL);
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    sptValue const a = ref[i * stride + r];
+                    sptValue const b = mats[nmodes]->values[i * stride + r];
+                    if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                        printf("Dense MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                        return 1;
+                    }
+                }
+            }
+
+            /* TTM against the definition, summed over the expanded sparse entries */
+            sptDenseTensor Y, Z;
+            result = sptDenseTensorMulMatrix(&Y, &X, mats[mode], mode, 3);
+            spt_CheckError(result, "dense ttm", NULL);
+            sptIndex zdims[4];
+            memcpy(zdims, ndims, nmodes * sizeof *zdims);
+            zdims[mode] = R;
+            sptNewDenseTensor(&Z, nmodes, zdims);
+            for(sptNnzIndex x = 0; x < S.nnz; ++x) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    sptNnzIndex off = 0;
+                    for(sptIndex m = 0; m < nmodes; ++m) {
+                        off = off * zdims[m] + (m == mode ? r : S.inds[m].data[x]);
+                    }
+                    Z.values.data[off] += S.values.data[x] * mats[mode]->values[S.inds[mode].data[x] * stride + r];
+                }
+            }
+            for(sptNnzIndex x = 0; x < Z.values.len; ++x) {
+                if(fabs(Z.values.data[x] - Y.values.data[x]) > 1e-4 * (1 + fabs(Z.values.data[x]))) {
+                    printf("Dense TTM mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                    return 1;
+                }
+            }
+            sptFreeDenseTensor(&Y);
+            sptFreeDenseTensor(&Z);
+        }
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        free(mats_order);
+        free(ref);
+        sptFreeDenseTensor(&X);
+        sptFreeSparseTensor(&S);
+    }
+
+    /* X = a0 o b0 o c0 + a1 o b1 o c1 */
+    sptIndex const cdims[] = { 6, 5, 4 };
+    sptDenseTensor X;
+    sptNewDenseTensor(&X, 3, cdims);
+    for(sptIndex i = 0; i < cdims[0]; ++i) {
+        for(sptIndex j = 0; j < cdims[1]; ++j) {
+            for(sptIndex k = 0; k < cdims[2]; ++k) {
+                X.values.data[(i * cdims[1] + j) * cdims[2] + k] =
+                    (sptValue) (1 + i) * (2 + j) * (1 + k) + (sptValue) (i % 2 ? 2 : -3) * (j % 2 ? -1 : 2) * (k % 2 ? 3 : -1);
+            }
+        }
+    }
+    sptKruskalTensor ktensor;
+    sptNewKruskalTensor(&ktensor, 3, cdims, 2);
+    /* A fixed warm start, so that ALS cannot land in a different swamp from run to run */
+    ktensor.factors = malloc(3 * sizeof *ktensor.factors);
+    for(sptIndex m = 0; m < 3; ++m) {
+        ktensor.factors[m] = malloc(sizeof *ktensor.factors[m]);
+        sptNewMatrix(ktensor.factors[m], cdims[m], 2);
+        for(sptIndex i = 0; i < cdims[m]; ++i) {
+            for(sptIndex r = 0; r < 2; ++r) {
+                ktensor.factors[m]->values[i * ktensor.factors[m]->stride + r] = (sptValue) (1 + 0.5 * sin(3.0 * i + 7.0 * r + m));
+            }
+        }
+    }
+    result = sptDenseCpdAls(&X, 2, 200, 1e-12, 2, &ktensor);
+    spt_CheckError(result, "dense cpd", NULL);
+    if(!(ktensor.fit > 0.999)) {
+        printf("Dense CP-ALS fit %f on an exact rank-2 tensor\n", ktensor.fit);
+        return 1;
+    }
+    sptFreeKruskalTensor(&ktensor);
+    sptFreeDenseTensor(&X);
+    return 0;
+}
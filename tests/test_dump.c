@@ -0,0 +1,179 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+/* The whole contents of a temporary file, NUL-terminated */
+static char * spt_ReadBack(FILE *fp) {
+    long const len = ftell(fp);
+    rewind(fp);
+    char *text = malloc((size_t) len + 1);
+    if(fread(text, 1, (size_t) len, fp) != (size_t) len) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+int main(void) {
+    sptSparseTensor X;
+    sptIndex const ndims[] = { 300, 200, 100 };
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 200000, SPT_GEN_UNIFORM, 0, 3, 4);
+    spt_CheckError(result, "generate", NULL);
+
+    /* The parallel dump must match a sequential fprintf loop byte for byte */
+    FILE *fp = tmpfile();
+    fprintf(fp, "%"PARTI_PRI_INDEX "\n", X.nmodes);
+    fprintf(fp, "%"PARTI_PRI_INDEX " %"PARTI_PRI_INDEX " %"PARTI_PRI_INDEX "\n", X.ndims[0], X.ndims[1], X.ndims[2]);
+    for(sptNnzIndex i = 0; i < X.nnz; ++i) {
+        for(sptIndex m = 0; m < X.nmodes; ++m) {
+            fprintf(fp, "%"PARTI_PRI_INDEX "\t", X.inds[m].data[i] + 1);
+        }
+        fprintf(fp, "%"PARTI_PRI_VALUE "\n", X.values.data[i]);
+    }
+    char *expected = spt_ReadBack(fp);
+    fclose(fp);
+
+    for(int nt = 1; nt <= 5; nt += 2) {
+        sptExecContext ctx;
+        sptNewExecContext(&ctx, nt);
+        sptExecContext const * const prev = sptSetExecContext(&ctx);
+        fp = tmpfile();
+        result = sptDumpSparseTensor(&X, 1, fp);
+        spt_CheckError(result, "dump", NULL);
+        char *text = spt_ReadBack(fp);
+        fclose(fp);
+        sptSetExecContext(prev);
+        if(text == NULL || strcmp(text, expected) != 0) {
+            printf("Sparse tensor dump differs with %d threads\n", nt);
+            return 1;
+        }
+        free(text);
+    }
+    free(expected);
+
+    sptMatrix A;
+    result = sptNewMatrix(&A, 5000, 7);
+    spt_CheckError(result, "new matrix", NULL);
+    for(sptIndex i = 0; i < A.nrows; ++i) {
+        for(sptIndex j = 0; j < A.ncols; ++j) {
+            A.values[i * A.stride + j] = (sptValue) (i * 0.37 - j * 11.5);
+        }
+    }
+    fp = tmpfile();
+    fprintf(fp, "%"PARTI_PRI_INDEX " x %"PARTI_PRI_INDEX " matrix\n", A.nrows, A.ncols);
+    for(sptIndex i = 0; i < A.nrows; ++i) {
+        for(sptIndex j = 0; j < A.ncols; ++j) {
+            fprintf(fp, "%.2"PARTI_PRI_VALUE "\t", A.values[i * A.stride + j]);
+        }
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "\n");
+    expected = spt_ReadBack(fp);
+    fclose(fp);
+    fp = tmpfile();
+    result = sptDumpMatrix(&A, fp);
+    spt_CheckError(result, "dump matrix", NULL);
+    char *text = spt_ReadBack(fp);
+    fclose(fp);
+    if(text == NULL || strcmp(text, expected) != 0) {
+        printf("Matrix dump differs\n");
+        return 1;
+    }
+    free(text);
+    free(expected);
+    sptFreeMatrix(&A);
+
+    /* Kruskal tensors round-trip through the binary container */
+    sptKruskalTensor K, L;
+    sptIndex const rank = 5;
+    sptNewKruskalTensor(&K, 3, ndims, rank);
+    K.fit = 0.75;
+    K.factors = malloc(3 * sizeof *K.factors);
+    for(sptIndex m = 0; m < 3; ++m) {
+        K.factors[m] = malloc(sizeof *K.factors[m]);
+        sptNewMatrix(K.factors[m], ndims[m], rank);
+        sptRandomizeMatrix(K.factors[m], ndims[m], rank);
+    }
+    for(sptIndex r = 0; r < rank; ++r) {
+        K.lambda[r] = r + 0.5;
+    }
+    fp = tmpfile();
+    result = sptDumpKruskalTensorBinary(&K, fp);
+    spt_CheckError(result, "dump kruskal", NULL);
+    rewind(fp);
+    result = sptLoadKruskalTensorBinary(&L, fp);
+    spt_CheckError(result, "load kruskal", NULL);
+    fclose(fp);
+    if(L.nmodes != K.nmodes || L.rank != K.rank || L.fit != K.fit ||
+        memcmp(L.lambda, K.lambda, rank * sizeof (sptValue)) != 0) {
+        printf("Kruskal header mismatch\n");
+        return 1;
+    }
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            if(L.ndims[m] != K.ndims[m] || memcmp(L.factors[m]->values + i * L.factors[m]->stride,
+                K.factors[m]->values + i * K.factors[m]->stride, rank * sizeof (sptValue)) != 0) {
+                printf("Kruskal factor %"PARTI_PRI_INDEX " mismatch\n", m);
+                return 1;
+            }
+        }
+    }
+    sptFreeKruskalTensor(&L);
+
+    /* Rank Kruskal tensors write the same container */
+    sptRankKruskalTensor R;
+    sptNewRankKruskalTensor(&R, 3, ndims, (sptElementIndex) rank);
+    R.fit = K.fit;
+    memcpy(R.lambda, K.lambda, rank * sizeof (sptValue));
+    R.factors = malloc(3 * sizeof *R.factors);
+    for(sptIndex m = 0; m < 3; ++m) {
+        R.factors[m] = malloc(sizeof *R.factors[m]);
+        sptNewRankMatrix(R.factors[m], ndims[m], (sptElementIndex) rank);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            memcpy(R.factors[m]->values + i * R.factors[m]->stride,
+                K.factors[m]->values + i * K.factors[m]->stride, rank * sizeof (sptValue));
+        }
+    }
+    fp = tmpfile();
+    result = sptDumpRankKruskalTensorBinary(&R, fp);
+    spt_CheckError(result, "dump rank kruskal", NULL);
+    rewind(fp);
+    result = sptLoadKruskalTensorBinary(&L, fp);
+    spt_CheckError(result, "load rank kruskal", NULL);
+    fclose(fp);
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            if(memcmp(L.factors[m]->values + i * L.factors[m]->stride,
+                K.factors[m]->values + i * K.factors[m]->stride, rank * sizeof (sptValue)) != 0) {
+                printf("Rank Kruskal factor %"PARTI_PRI_INDEX " mismatch\n", m);
+                return 1;
+            }
+        }
+    }
+    sptFreeKruskalTensor(&L);
+    sptFreeRankKruskalTensor(&R);
+    sptFreeKruskalTensor(&K);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+
+static sptValue const * sort_vals;
+
+/* Larger magnitude first, then earlier position */
+static int compare_rank(void const * a, void const * b) {
+    sptNnzIndex const x = *(sptNnzIndex const *) a;
+    sptNnzIndex const y = *(sptNnzIndex const *) b;
+    double const vx = fabs(sort_vals[x]), vy = fabs(sort_vals[y]);
+    if(vx != vy) {
+        return vx > vy ? -1 : 1;
+    }
+    return x < y ? -1 : (x > y);
+}
+
+/* Whether Y holds, in order, the nonzeros of X flagged in keep */
+static int check_kept(sptSparseTensor const * X, sptSparseTensor const * Y, char const * keep, char const * name) {
+    sptNnzIndex out = 0;
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        if(!keep[z]) {
+            continue;
+        }
+        if(out >= Y->nnz || Y->values.data[out] != X->values.data[z]) {
+            printf("%s: nonzero %lu not kept in order\n", name, (unsigned long) z);
+            return 1;
+        }
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            if(Y->inds[m].data[out] != X->inds[m].data[z]) {
+                printf("%s: nonzero %lu kept with other indices\n", name, (unsigned long) z);
+                return 1;
+            }
+        }
+        ++out;
+    }
+    if(out != Y->nnz) {
+        printf("%s: %lu nonzeros kept, expected %lu\n", name, (unsigned long) Y->nnz, (unsigned long) out);
+        return 1;
+    }
+    return 0;
+}
+
+/* A HiCOO tensor with no empty block whose nonzeros, in order, are those of Y sorted like it */
+static int check_hicoo(sptSparseTensorHiCOO const * H, sptSparseTensor * Y, char const * name) {
+    sptNnzIndex const nb = H->bptr.len - 1;
+    if(H->nnz != Y->nnz || H->bptr.data[nb] != H->nnz || H->kptr.data[H->kptr.len - 1] != nb) {
+        printf("%s: %lu HiCOO nonzeros in %lu blocks, expected %lu\n", name, (unsigned long) H->nnz, (unsigned long) nb, (unsigned long) Y->nnz);
+        return 1;
+    }
+    for(sptNnzIndex b = 0; b < nb; ++b) {
+        if(H->bptr.data[b] >= H->bptr.data[b+1]) {
+            printf("%s: block %lu is empty\n", name, (unsigned long) b);
+            return 1;
+        }
+    }
+    /* Sum the values at each coordinate in both, as a dense array */
+    sptNnzIndex const total = (sptNnzIndex) Y->ndims[0] * Y->ndims[1] * Y->ndims[2];
+    double * dense = calloc(total, sizeof *dense);
+    for(sptNnzIndex z = 0; z < Y->nnz; ++z) {
+        dense[((sptNnzIndex) Y->inds[0].data[z] * Y->ndims[1] + Y->inds[1].data[z]) * Y->ndims[2] + Y->inds[2].data[z]] += Y->values.data[z];
+    }
+    for(sptNnzIndex k = 0; k + 1 < H->kptr.len; ++k) {
+        for(sptNnzIndex b = H->kptr.data[k]; b < H->kptr.data[k+1]; ++b) {
+            for(sptNnzIndex z = H->bptr.data[b]; z < H->bptr.data[b+1]; ++z) {
+                sptIndex i[3];
+                for(sptIndex m = 0; m < 3; ++m) {
+                    i[m] = ((sptIndex) H->binds[m].data[b] << H->sb_bits) + H->einds[m].data[z];
+                }
+                dense[((sptNnzIndex) i[0] * Y->ndims[1] + i[1]) * Y->ndims[2] + i[2]] -= H->values.data[z];
+            }
+        }
+    }
+    for(sptNnzIndex x = 0; x < total; ++x) {
+        if(dense[x] != 0) {
+            printf("%s: HiCOO differs from COO at %lu\n", name, (unsigned long) x);
+            return 1;
+        }
+    }
+    free(dense);
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[3] = { 30, 20, 25 };
+    sptIndex const k = 4;
+    sptSparseTensor X, Y;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(11);
+    for(sptNnzIndex z = 0; z < 3000; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        /* Few magnitudes, so that top-k meets ties */
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 9 - 4));
+    }
+    X.nnz = 3000;
+    char * keep = malloc(X.nnz);
+
+    /* Threshold, the reference being a serial loop */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        keep[z] = fabs(X.values.data[z]) >= 2.5;
+    }
+    for(int tk = 1; tk <= 3; ++tk) {
+        sptCopySparseTensor(&Y, &X, 1);
+        result = sptSparseTensorThreshold(&Y, 2.5, tk);
+        spt_CheckError(result, "threshold", NULL);
+        if(check_kept(&X, &Y, keep, "threshold") != 0) {
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+    }
+
+    /* Top-k of the slices of mode 1, the reference sorting each slice */
+    sptNnzIndex * ids = malloc(X.nnz * sizeof *ids);
+    sort_vals = X.values.data;
+    memset(keep, 0, X.nnz);
+    for(sptIndex s = 0; s < ndims[1]; ++s) {
+        sptNnzIndex n = 0;
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            if(X.inds[1].data[z] == s) {
+                ids[n++] = z;
+            }
+        }
+        qsort(ids, n, sizeof *ids, compare_rank);
+        for(sptNnzIndex i = 0; i < n && i < k; ++i) {
+            keep[ids[i]] = 1;
+        }
+    }
+    free(ids);
+    for(int tk = 1; tk <= 3; ++tk) {
+        sptCopySparseTensor(&Y, &X, 1);
+        result = sptSparseTensorTopK(&Y, 1, k, tk);
+        spt_CheckError(result, "top-k", NULL);
+        if(check_kept(&X, &Y, keep, "top-k") != 0) {
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+    }
+    free(keep);
+
+    /* HiCOO gives the same nonzeros, in valid blocks; distinct magnitudes keep ties out of it */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        X.values.data[z] = (sptValue) ((z % 2 ? 1.0 : -1.0) * (1 + (double) ((z * 7919) % X.nnz) / X.nnz));
+    }
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptSparseTensorCoalesce(&X, SPT_COALESCE_SUM, 1);
+    spt_CheckError(result, "coalesce", NULL);
+    for(int op = 0; op < 2; ++op) {
+        sptSparseTensorHiCOO H;
+        sptNnzIndex max_nnzb = 0;
+        sptCopySparseTensor(&Y, &X, 1);
+        result = sptSparseTensorToHiCOO(&H, &max_nnzb, &Y, 2, 4, 2);
+        spt_CheckError(result, "to hicoo", NULL);
+        if(op == 0) {
+            result = sptSparseTensorThresholdHiCOO(&H, 1.7, 2);
+            spt_CheckError(result, "threshold hicoo", NULL);
+            result = sptSparseTensorThreshold(&Y, 1.7, 2);
+        } else {
+            result = sptSparseTensorTopKHiCOO(&H, 2, 2, 2);
+            spt_CheckError(result, "top-k hicoo", NULL);
+            result = sptSparseTensorTopK(&Y, 2, 2, 2);
+        }
+        spt_CheckError(result, "filter", NULL);
+        if(check_hicoo(&H, &Y, op == 0 ? "threshold hicoo" : "top-k hicoo") != 0) {
+            return 1;
+        }
+        sptFreeSparseTensorHiCOO(&H);
+        sptFreeSparseTensor(&Y);
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+
+static int same_hicoo(sptSparseTensorHiCOO const * a, sptSparseTensorHiCOO const * b) {
+    if(a->nnz != b->nnz || a->bptr.len != b->bptr.len ||
+        memcmp(a->bptr.data, b->bptr.data, a->bptr.len * sizeof *a->bptr.data) != 0 ||
+        memcmp(a->values.data, b->values.data, a->nnz * sizeof *a->values.data) != 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(memcmp(a->binds[m].data, b->binds[m].data, (a->bptr.len - 1) * sizeof *a->binds[m].data) != 0 ||
+            memcmp(a->einds[m].data, b->einds[m].data, a->nnz * sizeof *a->einds[m].data) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 30, 20, 25 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(7);
+    for(int i = 0; i < 2000; ++i) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 1000) / 100);
+    }
+    X.nnz = X.values.len;
+
+    /* The full fingerprint ignores the order, the sampled one does not */
+    uint64_t const full = sptSparseTensorFingerprint(&X);
+    uint64_t const all = sptSparseTensorFingerprintSampled(&X, 0);
+    if(sptSparseTensorFingerprintSampled(&X, 64) != sptSparseTensorFingerprintSampled(&X, 64) ||
+        sptSparseTensorFingerprintSampled(&X, X.nnz) != all) {
+        printf("sampled fingerprint not deterministic\n");
+        return 1;
+    }
+    sptSparseTensorSortIndexAtMode(&X, 1, 1);
+    if(sptSparseTensorFingerprint(&X) != full || sptSparseTensorFingerprintSampled(&X, 0) == all) {
+        printf("fingerprints after a sort: full %d, sampled %d\n",
+            sptSparseTensorFingerprint(&X) == full, sptSparseTensorFingerprintSampled(&X, 0) == all);
+        return 1;
+    }
+    /* A changed value changes both, once the cache is dropped */
+    sptValue const saved = X.values.data[1234];
+    X.values.data[1234] += 1;
+    sptSparseTensorDropCache(&X);
+    if(sptSparseTensorFingerprint(&X) == full || sptSparseTensorFingerprintSampled(&X, 0) == sptSparseTensorFingerprintSampled(&X, 1)) {
+        printf("fingerprint misses a changed value\n");
+        return 1;
+    }
+    X.values.data[1234] = saved;
+    sptSparseTensorDropCache(&X);
+    if(sptSparseTensorFingerprint(&X) != full) {
+        printf("fingerprint not restored\n");
+        return 1;
+    }
+
+    /* Binary files store it, and loading and mapping take it from there */
+    char filename[] = "/tmp/parti_test_fingerprint_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+    FILE * stream = fopen(filename, "wb");
+    result = sptDumpSparseTensorBinary(&X, stream);
+    spt_CheckError(result, "dump", NULL);
+    fclose(stream);
+    sptSparseTensor Y;
+    result = sptMmapSparseTensor(&Y, filename);
+    spt_CheckError(result, "mmap", NULL);
+    if(sptSparseTensorFingerprint(&Y) != full) {
+        printf("mapped fingerprint differs\n");
+        return 1;
+    }
+    sptUnmapSparseTensor(&Y);
+    /* Overwrite the stored value: a loaded tensor reports it without hashing */
+    uint64_t const marker = 0x0123456789abcdefULL;
+    stream = fopen(filename, "r+b");
+    fseek(stream, 48 + 3 * (sizeof (uint64_t) + sizeof (uint32_t)), SEEK_SET);
+    fwrite(&marker, sizeof marker, 1, stream);
+    fclose(stream);
+    stream = fopen(filename, "rb");
+    result = sptLoadSparseTensorBinary(&Y, stream);
+    spt_CheckError(result, "load", NULL);
+    fclose(stream);
+    if(sptSparseTensorFingerprint(&Y) != marker) {
+        printf("loaded tensor did not keep the stored fingerprint\n");
+        return 1;
+    }
+    sptSparseTensorDropCache(&Y);
+    if(sptSparseTensorFingerprint(&Y) != full) {
+        printf("recomputed fingerprint differs\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Y);
+    unlink(filename);
+
+    /* Machine fingerprints ignore the measured rates */
+    sptMachineProfile p1, p2;
+    memset(&p1, 0, sizeof p1);
+    p1.nthreads = 4;
+    p1.llc_bytes = 1 << 20;
+    p1.stream_bandwidth = 1e10;
+    p2 = p1;
+    p2.stream_bandwidth = 1.1e10;
+    if(sptMachineProfileFingerprint(&p1) != sptMachineProfileFingerprint(&p2)) {
+        printf("machine fingerprint depends on a rate\n");
+        return 1;
+    }
+    p2.nthreads = 8;
+    if(sptMachineProfileFingerprint(&p1) == sptMachineProfileFingerprint(&p2)) {
+        printf("machine fingerprint misses the thread count\n");
+        return 1;
+    }
+
+    /* The HiCOO layout is converted once and read back from the plan cache */
+    unsetenv("PARTI_PLAN_CACHE");
+    if(sptPlanCachePath(&X, NULL, "hicoo") != NULL) {
+        printf("plan cache path without PARTI_PLAN_CACHE\n");
+        return 1;
+    }
+    char dir[] = "/tmp/parti_test_plans_XXXXXX";
+    spt_CheckOSError(mkdtemp(dir) == NULL, "mkdtemp");
+    setenv("PARTI_PLAN_CACHE", dir, 1);
+    char * path = sptPlanCachePath(&X, &p1, "plan");
+    char expected[128];
+    snprintf(expected, sizeof expected, "%s/%016" PRIx64 "-%016" PRIx64 ".plan", dir, full, sptMachineProfileFingerprint(&p1));
+    if(strcmp(path, expected) != 0) {
+        printf("plan cache path %s, expected %s\n", path, expected);
+        return 1;
+    }
+    free(path);
+
+    sptSparseTensorHiCOO converted, cached;
+    sptNnzIndex max_converted, max_cached;
+    result = sptSparseTensorToHiCOOCached(&converted, &max_converted, &X, 3, 5, 2);
+    spt_CheckError(result, "hicoo", NULL);
+    path = sptPlanCachePath(&X, NULL, "hicoo-b3-k5");
+    if(access(path, R_OK) != 0) {
+        printf("no cached layout at %s\n", path);
+        return 1;
+    }
+    result = sptSparseTensorToHiCOOCached(&cached, &max_cached, &X, 3, 5, 2);
+    spt_CheckError(result, "hicoo cached", NULL);
+    if(!same_hicoo(&converted, &cached) || max_converted != max_cached) {
+        printf("cached layout differs from the conversion\n");
+        return 1;
+    }
+    remove(path);
+    free(path);
+    rmdir(dir);
+    unsetenv("PARTI_PLAN_CACHE");
+
+    /* A HiCOO tensor fingerprints as the COO tensor it was built from */
+    if(sptSparseTensorHiCOOFingerprint(&converted) != sptSparseTensorFingerprint(&X)) {
+        printf("HiCOO fingerprint differs from COO\n");
+        return 1;
+    }
+
+    sptFreeSparseTensorHiCOO(&converted);
+    sptFreeSparseTensorHiCOO(&cached);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
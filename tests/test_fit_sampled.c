@@ -0,0 +1,153 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMODES 3
+#define RANK 5
+#define NNZ 20000
+
+static sptValue lambda[RANK];
+static sptMatrix * mats[NMODES + 1];
+static sptMatrix * ata[NMODES + 1];
+
+static double model_at(sptIndex const i[]) {
+    double v = 0;
+    for(sptIndex r = 0; r < RANK; ++r) {
+        double p = lambda[r];
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            p *= mats[m]->values[(size_t) i[m] * mats[m]->stride + r];
+        }
+        v += p;
+    }
+    return v;
+}
+
+/* The sampled fit is exact with every nonzero, and otherwise within its bound */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 50, 40, 30 };
+    srand(11);
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptNewMatrix(mats[m], m < NMODES ? ndims[m] : 1, RANK);
+        ata[m] = malloc(sizeof *ata[m]);
+        sptNewMatrix(ata[m], RANK, RANK);
+    }
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < RANK; ++r) {
+                mats[m]->values[(size_t) i * mats[m]->stride + r] = (sptValue) (rand() % 200 - 100) / 100;
+            }
+        }
+        sptOmpMatrixGram(mats[m], ata[m], 1);
+    }
+    for(sptIndex r = 0; r < RANK; ++r) {
+        lambda[r] = (sptValue) (rand() % 50 + 1) / 10;
+    }
+
+    /* The model at random places, plus noise */
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, NMODES, ndims);
+    double normsq = 0, inner = 0;
+    for(sptNnzIndex z = 0; z < NNZ; ++z) {
+        sptIndex i[NMODES];
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            i[m] = rand() % ndims[m];
+            sptAppendIndexVector(&X.inds[m], i[m]);
+        }
+        double const model = model_at(i);
+        sptValue const x = (sptValue) (model + (double) (rand() % 200 - 100) / 50);
+        sptAppendValueVector(&X.values, x);
+        normsq += (double) x * x;
+        inner += x * model;
+    }
+    X.nnz = NNZ;
+    sptSparseTensorSortIndex(&X, 1);
+    double const norm_mats = sptKruskalTensorFrobeniusNormSquared(NMODES, lambda, ata);
+    double const ref = sptKruskalTensorFitFromNorms(normsq, norm_mats, inner);
+
+    double bound;
+    double fit = sptKruskalTensorFitSampled(&X, normsq, lambda, mats, ata, NNZ, 1, &bound);
+    if(fabs(fit - ref) > 1e-9 || bound != 0) {
+        printf("full sample: fit %g, expected %g, bound %g\n", fit, ref, bound);
+        return 1;
+    }
+    fit = sptKruskalTensorFitSampled(&X, normsq, lambda, mats, ata, 2000, 3, &bound);
+    if(!(bound > 0 && bound < 0.05) || fabs(fit - ref) > 2 * bound) {
+        printf("sampled: fit %g, expected %g, bound %g\n", fit, ref, bound);
+        return 1;
+    }
+    double again;
+    if(sptKruskalTensorFitSampled(&X, normsq, lambda, mats, ata, 2000, 3, &again) != fit || again != bound) {
+        printf("the same seed gave another estimate\n");
+        return 1;
+    }
+
+    /* HiCOO, with the factors as rank matrices */
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb;
+    if(sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 5, 1) != 0) {
+        printf("HiCOO conversion failed\n");
+        return 1;
+    }
+    sptRankMatrix * rmats[NMODES + 1];
+    sptRankMatrix * rata[NMODES + 1];
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        rmats[m] = malloc(sizeof *rmats[m]);
+        sptNewRankMatrix(rmats[m], mats[m]->nrows, RANK);
+        rata[m] = malloc(sizeof *rata[m]);
+        sptNewRankMatrix(rata[m], RANK, RANK);
+        for(sptIndex i = 0; i < mats[m]->nrows; ++i) {
+            for(sptIndex r = 0; r < RANK; ++r) {
+                rmats[m]->values[(size_t) i * rmats[m]->stride + r] = mats[m]->values[(size_t) i * mats[m]->stride + r];
+            }
+        }
+        for(sptIndex r = 0; r < RANK; ++r) {
+            for(sptIndex s = 0; s < RANK; ++s) {
+                rata[m]->values[r * rata[m]->stride + s] = ata[m]->values[r * ata[m]->stride + s];
+            }
+        }
+    }
+    fit = sptKruskalTensorFitSampledHiCOO(&H, normsq, lambda, rmats, rata, NNZ, 1, &bound);
+    if(fabs(fit - ref) > 1e-9 || bound != 0) {
+        printf("HiCOO full sample: fit %g, expected %g, bound %g\n", fit, ref, bound);
+        return 1;
+    }
+    fit = sptKruskalTensorFitSampledHiCOO(&H, normsq, lambda, rmats, rata, 2000, 3, &bound);
+    if(!(bound > 0 && bound < 0.05) || fabs(fit - ref) > 2 * bound) {
+        printf("HiCOO sampled: fit %g, expected %g, bound %g\n", fit, ref, bound);
+        return 1;
+    }
+
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        sptFreeMatrix(mats[m]);
+        sptFreeMatrix(ata[m]);
+        sptFreeRankMatrix(rmats[m]);
+        sptFreeRankMatrix(rata[m]);
+        free(mats[m]);
+        free(ata[m]);
+        free(rmats[m]);
+        free(rata[m]);
+    }
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
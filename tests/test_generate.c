@@ -0,0 +1,102 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* Same shape and the same nonzeros in the same order */
+static int spt_SameTensor(const sptSparseTensor *a, const sptSparseTensor *b) {
+    if(a->nmodes != b->nmodes || a->nnz != b->nnz) {
+        return 0;
+    }
+    for(sptNnzIndex z = 0; z < a->nnz; ++z) {
+        for(sptIndex m = 0; m < a->nmodes; ++m) {
+            if(a->inds[m].data[z] != b->inds[m].data[z]) {
+                return 0;
+            }
+        }
+        if(a->values.data[z] != b->values.data[z]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Indices in range, values in (0, 1]; the share of mode-0 hits in its lowest 1/16 */
+static int spt_CheckGenerated(const sptSparseTensor *X, double *low_share) {
+    sptNnzIndex low = 0;
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            if(X->inds[m].data[z] >= X->ndims[m]) {
+                return 1;
+            }
+        }
+        if(!(X->values.data[z] > 0 && X->values.data[z] <= 1)) {
+            return 1;
+        }
+        low += X->inds[0].data[z] < X->ndims[0] / 16;
+    }
+    *low_share = (double) low / X->nnz;
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[3] = { 1000, 300, 77 };
+    sptNnzIndex const nnz = 20000;
+    sptGeneratorKind const kinds[3] = { SPT_GEN_UNIFORM, SPT_GEN_POWERLAW, SPT_GEN_KRONECKER };
+    double const params[3] = { 0, 1.5, 0.57 };
+    int result;
+
+    for(int k = 0; k < 3; ++k) {
+        sptSparseTensor X, Y, Z;
+        result = sptGenerateSparseTensor(&X, 3, ndims, nnz, kinds[k], params[k], 42, 1);
+        spt_CheckError(result, "generate", NULL);
+        result = sptGenerateSparseTensor(&Y, 3, ndims, nnz, kinds[k], params[k], 42, 4);
+        spt_CheckError(result, "generate", NULL);
+        result = sptGenerateSparseTensor(&Z, 3, ndims, nnz, kinds[k], params[k], 43, 4);
+        spt_CheckError(result, "generate", NULL);
+
+        double low_share;
+        if(X.nnz != nnz || spt_CheckGenerated(&X, &low_share) != 0) {
+            printf("kind %d: bad nonzeros\n", k);
+            return 1;
+        }
+        if(!spt_SameTensor(&X, &Y) || spt_SameTensor(&X, &Z)) {
+            printf("kind %d: not reproducible by seed\n", k);
+            return 1;
+        }
+        /* Uniform puts ~1/16 of the nonzeros there, the skewed generators far more */
+        if(kinds[k] == SPT_GEN_UNIFORM ? (low_share < 0.04 || low_share > 0.09) : low_share < 0.15) {
+            printf("kind %d: %.3f of mode 0 in its lowest 1/16\n", k, low_share);
+            return 1;
+        }
+
+        sptFreeSparseTensor(&X);
+        sptFreeSparseTensor(&Y);
+        sptFreeSparseTensor(&Z);
+    }
+
+    sptSparseTensor X;
+    if(sptGenerateSparseTensor(&X, 3, ndims, nnz, SPT_GEN_KRONECKER, 1.5, 1, 1) == 0) {
+        printf("accepted a Kronecker weight out of range\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Within rounding of sptValue, summation order differing by thread count */
+static int spt_Near(sptValue a, sptValue b) {
+    return fabs(a - b) <= 1e4 * PARTI_VALUE_EPSILON * (1 + fabs(a));
+}
+
+/* Row-parallel Gram and the fused solve-normalize-Gram must match the unfused steps */
+int main(void) {
+    sptIndex const nrows = 1000, rank = 13;
+    sptMatrix A, B, M, ref_ata;
+    sptMatrix * ata[3];
+    sptNewMatrix(&A, nrows, rank);
+    sptNewMatrix(&B, nrows, rank);
+    sptNewMatrix(&M, nrows, rank);
+    sptNewMatrix(&ref_ata, rank, rank);
+    sptIndex const stride = A.stride;
+    for(sptIndex i = 0; i < nrows * stride; ++i) {
+        A.values[i] = (sptValue) (rand() % 200 - 100) / 50;
+        M.values[i] = (sptValue) (rand() % 200 - 100) / 50;
+    }
+    for(int m = 0; m < 3; ++m) {
+        ata[m] = malloc(sizeof *ata[m]);
+        sptNewMatrix(ata[m], rank, rank);
+    }
+
+    /* Reference Gram of A, upper triangle */
+    for(sptIndex r = 0; r < rank; ++r) {
+        for(sptIndex s = r; s < rank; ++s) {
+            double g = 0;
+            for(sptIndex i = 0; i < nrows; ++i) {
+                g += A.values[i * stride + r] * A.values[i * stride + s];
+            }
+            ref_ata.values[r * stride + s] = (sptValue) g;
+        }
+    }
+    int const tks[] = { 1, 3, 8 };
+    for(int t = 0; t < 3; ++t) {
+        sptOmpMatrixGram(&A, ata[1], tks[t]);
+        for(sptIndex r = 0; r < rank; ++r) {
+            for(sptIndex s = r; s < rank; ++s) {
+                if(!spt_Near(ref_ata.values[r * stride + s], ata[1]->values[r * stride + s])) {
+                    printf("Gram mismatch with %d threads\n", tks[t]);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    /* Unfused: solve against M, normalize, Gram; ata[1] holds A^T A as the other mode */
+    sptValue lambda[13], ref_lambda[13];
+    for(int use_max = 0; use_max < 2; ++use_max) {
+        memcpy(B.values, M.values, nrows * stride * sizeof(sptValue));
+        sptMatrixSolveNormals(0, 2, ata, &B);
+        if(use_max) {
+            sptMatrixMaxNorm(&B, ref_lambda);
+        } else {
+            sptMatrix2Norm(&B, ref_lambda);
+        }
+        sptOmpMatrixGram(&B, &ref_ata, 1);
+
+        for(int t = 0; t < 3; ++t) {
+            sptMatrix X;
+            sptNewMatrix(&X, nrows, rank);
+            sptOmpMatrixSolveNormalsGram(0, 2, ata, &M, &X, lambda, use_max, tks[t]);
+            for(sptIndex r = 0; r < rank; ++r) {
+                if(!spt_Near(ref_lambda[r], lambda[r])) {
+                    printf("Fused norm mismatch, max %d, %d threads\n", use_max, tks[t]);
+                    return 1;
+                }
+                for(sptIndex s = r; s < rank; ++s) {
+                    if(!spt_Near(ref_ata.values[r * stride + s], ata[0]->values[r * stride + s])) {
+                        printf("Fused Gram mismatch, max %d, %d threads\n", use_max, tks[t]);
+                        return 1;
+                    }
+                }
+            }
+            for(sptIndex i = 0; i < nrows; ++i) {
+                for(sptIndex r = 0; r < rank; ++r) {
+                    if(!spt_Near(B.values[i * stride + r], X.values[i * stride + r])) {
+                        printf("Fused solve mismatch, max %d, %d threads\n", use_max, tks[t]);
+                        return 1;
+                    }
+                }
+            }
+            sptFreeMatrix(&X);
+        }
+    }
+
+    /* Row-block parallel solve against the LAPACK solve */
+    memcpy(B.values, M.values, nrows * stride * sizeof(sptValue));
+    sptOmpMatrixGram(&A, ata[1], 1);
+    sptMatrixSolveNormals(0, 2, ata, &B);
+    for(int t = 0; t < 3; ++t) {
+        sptMatrix X;
+        sptNewMatrix(&X, nrows, rank);
+        memcpy(X.values, M.values, nrows * stride * sizeof(sptValue));
+        sptOmpMatrixSolveNormals(0, 2, ata, &X, tks[t]);
+        for(sptIndex i = 0; i < nrows * stride; ++i) {
+            if(i % stride < rank && !spt_Near(B.values[i], X.values[i])) {
+                printf("Parallel solve mismatch, %d threads\n", tks[t]);
+                return 1;
+            }
+        }
+        sptFreeMatrix(&X);
+    }
+
+    /* The same for rank matrices */
+    sptRankMatrix * rata[3];
+    sptRankMatrix RB, RX;
+    for(int m = 0; m < 3; ++m) {
+        rata[m] = malloc(sizeof *rata[m]);
+        sptNewRankMatrix(rata[m], rank, rank);
+        for(sptIndex i = 0; i < rank * rata[m]->stride; ++i) {
+            rata[m]->values[i] = ata[m]->values[i / rata[m]->stride * stride + i % rata[m]->stride];
+        }
+    }
+    sptNewRankMatrix(&RB, nrows, rank);
+    sptNewRankMatrix(&RX, nrows, rank);
+    sptIndex const rstride = RB.stride;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < rstride; ++r) {
+            RB.values[i * rstride + r] = RX.values[i * rstride + r] = r < rank ? M.values[i * stride + r] : 0;
+        }
+    }
+    sptRankMatrixSolveNormals(0, 2, rata, &RB);
+    sptOmpRankMatrixSolveNormals(0, 2, rata, &RX, 3);
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < rank; ++r) {
+            if(!spt_Near(RB.values[i * rstride + r], RX.values[i * rstride + r])) {
+                printf("Parallel rank solve mismatch\n");
+                return 1;
+            }
+        }
+    }
+    for(int m = 0; m < 3; ++m) {
+        sptFreeRankMatrix(rata[m]);
+        free(rata[m]);
+    }
+    sptFreeRankMatrix(&RX);
+    sptFreeRankMatrix(&RB);
+
+    for(int m = 0; m < 3; ++m) {
+        sptFreeMatrix(ata[m]);
+        free(ata[m]);
+    }
+    sptFreeMatrix(&ref_ata);
+    sptFreeMatrix(&M);
+    sptFreeMatrix(&B);
+    sptFreeMatrix(&A);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define NMODES 5
+
+/* Products and sums of positive terms, so the rounding of sptValue stays relative */
+static int spt_Near(double a, double b) {
+    return fabs(a - b) <= 1e3 * PARTI_VALUE_EPSILON * (1 + fabs(a));
+}
+
+/* A random upper triangle in place of the updated Gram matrix of a mode */
+static void RandomGram(sptMatrix * ata) {
+    for(sptIndex i = 0; i < ata->nrows; ++i) {
+        for(sptIndex j = i; j < ata->ncols; ++j) {
+            ata->values[i * ata->stride + j] = (sptValue) (rand() % 200 + 1) / 100;
+        }
+    }
+}
+
+/* Form checks against sptMatrixDotMulSeqTriangle on the full matrix */
+static int CheckForm(sptGramHadamard * gh, sptIndex mode, sptMatrix ** ata, sptValue * const * ata_vals, sptValue * out) {
+    sptIndex const rank = ata[0]->ncols, stride = ata[0]->stride;
+    int result = sptGramHadamardForm(gh, mode, ata_vals, out);
+    spt_CheckError(result, "form", NULL);
+    sptMatrixDotMulSeqTriangle(mode, NMODES, ata);
+    for(sptIndex i = 0; i < rank; ++i) {
+        for(sptIndex j = 0; j < rank; ++j) {
+            if(!spt_Near(ata[NMODES]->values[i * stride + j], out[i * stride + j])) {
+                printf("product for mode %"PARTI_PRI_INDEX" differs at (%"PARTI_PRI_INDEX", %"PARTI_PRI_INDEX")\n", mode, i, j);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The running products match products from scratch in and out of step with a sweep */
+int main(void) {
+    sptIndex const rank = 11;
+    sptMatrix * ata[NMODES + 1];
+    sptValue * ata_vals[NMODES];
+    for(int m = 0; m <= NMODES; ++m) {
+        ata[m] = malloc(sizeof *ata[m]);
+        sptNewMatrix(ata[m], rank, rank);
+        if(m < NMODES) {
+            RandomGram(ata[m]);
+            ata_vals[m] = ata[m]->values;
+        }
+    }
+    sptIndex const stride = ata[0]->stride;
+    sptValue * out = malloc((size_t) rank * stride * sizeof *out);
+    sptValue lambda[11];
+    for(sptIndex r = 0; r < rank; ++r) {
+        lambda[r] = (sptValue) (rand() % 100 + 1) / 10;
+    }
+
+    sptGramHadamard gh;
+    int result = sptNewGramHadamard(&gh, NMODES, rank, stride);
+    spt_CheckError(result, "new", NULL);
+    for(int sweep = 0; sweep < 2; ++sweep) {
+        sptGramHadamardBeginSweep(&gh, ata_vals);
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            if(CheckForm(&gh, m, ata, ata_vals, out) != 0) {
+                return 1;
+            }
+            RandomGram(ata[m]);
+            sptGramHadamardAdvance(&gh, m, ata_vals);
+        }
+        double const norm = sptGramHadamardKruskalNorm(&gh, lambda, ata_vals);
+        if(!spt_Near(sptKruskalTensorFrobeniusNormSquared(NMODES, lambda, ata), norm)) {
+            printf("Kruskal norm differs after sweep %d\n", sweep);
+            return 1;
+        }
+    }
+
+    /* Out of order, e.g. a mode solved twice: products are formed from scratch until the next sweep */
+    sptGramHadamardBeginSweep(&gh, ata_vals);
+    sptIndex const order[] = { 0, 1, 1, 3, 2, 4 };
+    for(int k = 0; k < 6; ++k) {
+        if(CheckForm(&gh, order[k], ata, ata_vals, out) != 0) {
+            return 1;
+        }
+        RandomGram(ata[order[k]]);
+        sptGramHadamardAdvance(&gh, order[k], ata_vals);
+    }
+    double const norm = sptGramHadamardKruskalNorm(&gh, lambda, ata_vals);
+    if(!spt_Near(sptKruskalTensorFrobeniusNormSquared(NMODES, lambda, ata), norm)) {
+        printf("Kruskal norm differs out of order\n");
+        return 1;
+    }
+
+    /* A fit from the norms equals the fit from the Gram matrices */
+    double const normsq = 2 * norm;
+    if(!spt_Near(sptKruskalTensorFitGram(NMODES, normsq, lambda, ata), sptKruskalTensorFitFromNorms(normsq, norm, norm))) {
+        printf("fit from norms differs\n");
+        return 1;
+    }
+
+    sptFreeGramHadamard(&gh);
+    free(out);
+    for(int m = 0; m <= NMODES; ++m) {
+        sptFreeMatrix(ata[m]);
+        free(ata[m]);
+    }
+    return 0;
+}
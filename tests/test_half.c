@@ -0,0 +1,118 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* 16-bit values must round-trip within their precision, and their MTTKRP must track the full one */
+int main(void) {
+    sptIndex const ndims[] = { 40, 17, 30 };
+    sptIndex const nmodes = 3, R = 8;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 4000; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 1000 + 1) / 997);
+    }
+    X.nnz = 4000;
+
+    /* Exact in fp16, down to its largest and smallest values; bf16 lacks the mantissa of the fourth */
+    sptIndex const edims[] = { 1, 1, 1 };
+    sptValue exact[] = { 1, -2.5, 0.375, 65504, 6.103515625e-05, 5.960464477539063e-08, 0 };
+    sptIndex zeros[7] = { 0 };
+    sptIndex * einds[] = { zeros, zeros, zeros };
+    sptSparseTensor E;
+    result = sptWrapSparseTensor(&E, nmodes, edims, 7, einds, exact);
+    spt_CheckError(result, "wrap", NULL);
+
+    sptHalfFormat const formats[] = { SPT_HALF_BF16, SPT_HALF_FP16 };
+    double const eps[] = { 1.0 / 256, 1.0 / 2048 };
+    for(int f = 0; f < 2; ++f) {
+        sptHalfValueVector hv;
+        result = sptNewHalfValueVector(&hv, &E, formats[f], 1);
+        spt_CheckError(result, "new half", NULL);
+        for(sptNnzIndex z = 0; z < E.nnz; ++z) {
+            sptValue const h = sptHalfValueAt(&hv, z);
+            if(formats[f] == SPT_HALF_FP16 || z != 3 ? h != exact[z] : h != 65536) {
+                printf("Format %d: value %g stored as %g\n", f, exact[z], h);
+                return 1;
+            }
+        }
+        sptFreeHalfValueVector(&hv);
+
+        result = sptNewHalfValueVector(&hv, &X, formats[f], 2);
+        spt_CheckError(result, "new half", NULL);
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            sptValue const v = X.values.data[z];
+            sptValue const h = sptHalfValueAt(&hv, z);
+            if(fabs(h - v) > eps[f] * fabs(v)) {
+                printf("Format %d: value %g stored as %g\n", f, v, h);
+                return 1;
+            }
+        }
+
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : 40;
+            sptNewMatrix(mats[m], nrows, R);
+            for(size_t i = 0; i < (size_t) nrows * mats[m]->stride; ++i) {
+                mats[m]->values[i] = (sptValue) rand() / RAND_MAX;
+            }
+        }
+        sptIndex mats_order[3];
+        sptValue * ref = malloc((size_t) 40 * mats[0]->stride * sizeof *ref);
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            for(sptIndex i = 0; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            sptNnzIndex const len = (sptNnzIndex) X.ndims[mode] * mats[0]->stride;
+            sptMTTKRP(&X, mats, mats_order, mode);
+            memcpy(ref, mats[nmodes]->values, len * sizeof *ref);
+            for(int half_factors = 0; half_factors <= 1; ++half_factors) {
+                result = sptOmpMTTKRPHalf(&X, &hv, mats, mats_order, mode, half_factors, 3);
+                spt_CheckError(result, "half mttkrp", NULL);
+                /* Values and factors are nonnegative, so the error stays relative */
+                double const tol = (half_factors ? 4 : 2) * eps[f] + 1e-5;
+                for(sptNnzIndex i = 0; i < len; ++i) {
+                    if(fabs(mats[nmodes]->values[i] - ref[i]) > tol * fabs(ref[i])) {
+                        printf("Format %d: half MTTKRP mismatch at mode %"PARTI_PRI_INDEX"\n", f, mode);
+                        return 1;
+                    }
+                }
+            }
+        }
+        free(ref);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeHalfValueVector(&hv);
+    }
+    sptUnwrapSparseTensor(&E);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+/* Random tensor with unique coordinates in a random order; small integer values are exact in float */
+static int spt_RandomShuffledTensor(sptSparseTensor *tsr, sptIndex nmodes, const sptIndex *ndims, sptNnzIndex nnz, const sptSparseTensor *share) {
+    int result = sptNewSparseTensor(tsr, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        /* Take some coordinates from the other tensor so the inputs overlap */
+        sptNnzIndex const from = share != NULL && rand() % 2 ? (sptNnzIndex) rand() % share->nnz : (sptNnzIndex) -1;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const i = from != (sptNnzIndex) -1 ? share->inds[m].data[from] : (sptIndex) (rand() % ndims[m]);
+            sptAppendIndexVector(&tsr->inds[m], i);
+        }
+        sptAppendValueVector(&tsr->values, (sptValue) (rand() % 9 + 1));
+    }
+    tsr->nnz = nnz;
+
+    /* Drop repeated coordinates, then shuffle */
+    sptSparseTensorSortIndex(tsr, 1);
+    sptNnzIndex kept = 0;
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        if(kept > 0 && spt_SparseTensorCompareIndices(tsr, kept - 1, tsr, z) == 0) {
+            continue;
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            tsr->inds[m].data[kept] = tsr->inds[m].data[z];
+        }
+        tsr->values.data[kept++] = tsr->values.data[z];
+    }
+    tsr->nnz = kept;
+    for(sptNnzIndex z = kept; z > 1; --z) {
+        sptNnzIndex const w = (sptNnzIndex) rand() % z;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const t = tsr->inds[m].data[z - 1];
+            tsr->inds[m].data[z - 1] = tsr->inds[m].data[w];
+            tsr->inds[m].data[w] = t;
+        }
+        sptValue const t = tsr->values.data[z - 1];
+        tsr->values.data[z - 1] = tsr->values.data[w];
+        tsr->values.data[w] = t;
+    }
+    return 0;
+}
+
+/* The hash-joined H must hold the same nonzeros as the sorted-merge result S */
+static int spt_SameNonzeros(sptSparseTensor *H, const sptSparseTensor *S) {
+    if(H->nnz != S->nnz) {
+        return 1;
+    }
+    sptSparseTensorSortIndex(H, 1);
+    for(sptNnzIndex z = 0; z < S->nnz; ++z) {
+        if(spt_SparseTensorCompareIndices(H, z, S, z) != 0 || H->values.data[z] != S->values.data[z]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef int (*spt_BinaryOp)(sptSparseTensor *Z, const sptSparseTensor *X, const sptSparseTensor *Y);
+
+static int spt_CheckOps(sptIndex nmodes, const sptIndex *ndims, const char *what) {
+    sptSparseTensor X, Y, Xs, Ys;
+    spt_RandomShuffledTensor(&X, nmodes, ndims, 3000, NULL);
+    spt_RandomShuffledTensor(&Y, nmodes, ndims, 2000, &X);
+    sptCopySparseTensor(&Xs, &X, 1);
+    sptCopySparseTensor(&Ys, &Y, 1);
+    sptSparseTensorSortIndex(&Xs, 1);
+    sptSparseTensorSortIndex(&Ys, 1);
+
+    spt_BinaryOp const ops[] = { sptSparseTensorAdd, sptSparseTensorSub, sptSparseTensorDotMul, sptSparseTensorDotDiv,
+        sptOmpSparseTensorDotMul, sptOmpSparseTensorDotDiv };
+    spt_BinaryOp const refs[] = { sptSparseTensorAdd, sptSparseTensorSub, sptSparseTensorDotMul, sptSparseTensorDotDiv,
+        sptSparseTensorDotMul, sptSparseTensorDotDiv };
+    const char * const names[] = { "Add", "Sub", "DotMul", "DotDiv", "OmpDotMul", "OmpDotDiv" };
+    for(int k = 0; k < 6; ++k) {
+        sptSparseTensor H, S;
+        int result = refs[k](&S, &Xs, &Ys);
+        spt_CheckError(result, names[k], NULL);
+        result = ops[k](&H, &X, &Y);
+        spt_CheckError(result, names[k], NULL);
+        if(spt_SameNonzeros(&H, &S) != 0) {
+            printf("%s of unsorted %s tensors failed\n", names[k], what);
+            return 1;
+        }
+        sptFreeSparseTensor(&H);
+        /* Sorted inputs take the merge path */
+        result = ops[k](&H, &Xs, &Ys);
+        spt_CheckError(result, names[k], NULL);
+        if(spt_SameNonzeros(&H, &S) != 0) {
+            printf("%s of sorted %s tensors failed\n", names[k], what);
+            return 1;
+        }
+        sptFreeSparseTensor(&H);
+        sptFreeSparseTensor(&S);
+    }
+
+    /* Equal patterns in different orders */
+    sptSparseTensor H, S;
+    int result = sptSparseTensorDotMulEq(&H, &X, &Xs);
+    spt_CheckError(result, "DotMulEq", NULL);
+    sptSparseTensorDotMulEq(&S, &Xs, &Xs);
+    if(spt_SameNonzeros(&H, &S) != 0) {
+        printf("DotMulEq of reordered %s tensors failed\n", what);
+        return 1;
+    }
+    sptFreeSparseTensor(&H);
+    sptFreeSparseTensor(&S);
+
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    sptFreeSparseTensor(&Xs);
+    sptFreeSparseTensor(&Ys);
+    return 0;
+}
+
+int main(void) {
+    srand(5);
+    sptIndex const narrow[] = { 40, 30, 20, 10 };
+    if(spt_CheckOps(4, narrow, "64-bit key") != 0) {
+        return 1;
+    }
+    /* An index space beyond 2^64 takes 128-bit keys */
+    sptIndex const wide[] = { 2000000000, 1500000000, 1000000000 };
+    if(spt_CheckOps(3, wide, "128-bit key") != 0) {
+        return 1;
+    }
+    return 0;
+}
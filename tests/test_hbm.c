@@ -0,0 +1,130 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+int main(void) {
+    /* Without high-bandwidth memory everything falls back to the heap */
+    sptMemBacking const hbm = sptHbmAvailable() ? SPT_MEM_HBM : SPT_MEM_DEFAULT;
+    size_t const big = (size_t) 4 << 20;
+
+    char * buf = sptMallocBacked(big, SPT_MEM_HBM);
+    if(buf == NULL || (uintptr_t) buf % PARTI_VECTOR_ALIGN != 0 || sptMemBackingOf(buf) != hbm ||
+        spt_MemRequestOf(buf) != SPT_MEM_HBM) {
+        printf("SPT_MEM_HBM buffer got %s\n", buf != NULL ? sptMemBackingString(sptMemBackingOf(buf)) : "nothing");
+        return 1;
+    }
+    memset(buf, 1, big);
+    if(hbm == SPT_MEM_HBM && sptHbmBytesInUse() < big) {
+        printf("High-bandwidth memory in use not counted\n");
+        return 1;
+    }
+    /* Regrowing keeps the request */
+    buf = spt_Realloc(buf, big, 2 * big, SPT_MEM_DEFAULT);
+    if(buf == NULL || buf[big - 1] != 1 || sptMemBackingOf(buf) != hbm) {
+        printf("Regrown SPT_MEM_HBM buffer lost its backing or contents\n");
+        return 1;
+    }
+    sptFree(buf);
+    if(sptHbmBytesInUse() != 0) {
+        printf("%lu bytes of high-bandwidth memory left after freeing\n", (unsigned long) sptHbmBytesInUse());
+        return 1;
+    }
+
+    /* The policy: off, too small, and streamed data leaving a reserve */
+    sptSetHbmPlacement(0);
+    if(spt_HbmBacking(big, 0) != SPT_MEM_DEFAULT) {
+        printf("Placement turned off still picks high-bandwidth memory\n");
+        return 1;
+    }
+    sptSetHbmPlacement(8 * big);
+    if(spt_HbmBacking(PARTI_HBM_MIN_BYTES / 2, 0) != SPT_MEM_DEFAULT || spt_HbmBacking(big, 0) != hbm ||
+        spt_HbmBacking(7 * big, 0) != hbm || spt_HbmBacking(7 * big, 1) != SPT_MEM_DEFAULT ||
+        spt_HbmBacking(9 * big, 0) != SPT_MEM_DEFAULT) {
+        printf("Placement policy picked the wrong backing\n");
+        return 1;
+    }
+
+    /* Factor matrices follow the policy and behave as before */
+    sptRankMatrix A;
+    sptIndex const nrows = 40000;
+    int result = sptNewRankMatrix(&A, nrows, 16);
+    spt_CheckError(result, "new rank matrix", NULL);
+    if(sptMemBackingOf(A.values) != hbm || (uintptr_t) A.values % (8 * sizeof (sptValue)) != 0 || A.values[nrows * A.stride - 1] != 0) {
+        printf("Rank matrix placed in %s\n", sptMemBackingString(sptMemBackingOf(A.values)));
+        return 1;
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        A.values[i * A.stride] = (sptValue) i;
+    }
+    sptIndex * map = malloc(nrows * sizeof *map);
+    for(sptIndex i = 0; i < nrows; ++i) {
+        map[i] = nrows - 1 - i;
+    }
+    sptRankMatrixInverseShuffleIndices(&A, map);
+    if(A.values[0] != (sptValue) (nrows - 1) || sptMemBackingOf(A.values) != hbm) {
+        printf("Shuffled rank matrix is wrong\n");
+        return 1;
+    }
+    free(map);
+    sptMatrix B;
+    result = sptNewMatrix(&B, nrows, 8);
+    spt_CheckError(result, "new matrix", NULL);
+    if(sptMemBackingOf(B.values) != hbm) {
+        printf("Matrix placed in %s\n", sptMemBackingString(sptMemBackingOf(B.values)));
+        return 1;
+    }
+    sptFreeMatrix(&B);
+    sptFreeRankMatrix(&A);
+
+    /* Element indices of HiCOO go to what is left */
+    sptIndex const ndims[] = { 300, 300, 300 };
+    sptSparseTensor X;
+    result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(7);
+    for(sptNnzIndex z = 0; z < 400000; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, 1);
+    }
+    X.nnz = 400000;
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 6, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(sptMemBackingOf(H.einds[m].data) != hbm || sptMemBackingOf(H.values.data) == SPT_MEM_HBM) {
+            printf("HiCOO mode %u element indices placed in %s\n", (unsigned) m, sptMemBackingString(sptMemBackingOf(H.einds[m].data)));
+            return 1;
+        }
+    }
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    if(sptHbmBytesInUse() != 0) {
+        printf("High-bandwidth memory leaked\n");
+        return 1;
+    }
+    return 0;
+}
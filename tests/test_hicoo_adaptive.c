@@ -0,0 +1,159 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+static int spt_SameRows(sptValue const * ref, sptRankMatrix const * M, sptIndex const nrows, const char *name, sptIndex const mode) {
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < M->ncols; ++r) {
+            sptValue const a = ref[i * M->stride + r];
+            sptValue const b = M->values[i * M->stride + r];
+            if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                printf("%s: mode %u row %u differs\n", name, (unsigned) mode, (unsigned) i);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* A dense corner in sparse surroundings, so kernels pick different block sizes */
+static int spt_CheckAdaptive(sptIndex const nmodes, sptIndex const ndims[]) {
+    sptSparseTensor X, Y;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 6000; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex const i = z % 2 == 0 ? (sptIndex) (rand() % 6) : (sptIndex) (rand() % ndims[m]);
+            sptAppendIndexVector(&X.inds[m], i);
+        }
+        sptAppendValueVector(&X.values, (sptValue) rand() / RAND_MAX - 0.5);
+    }
+    X.nnz = 6000;
+    sptCopySparseTensor(&Y, &X, 1);
+
+    sptSparseTensorHiCOO uniform, adaptive;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&uniform, &max_nnzb, &X, 2, 6, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    result = sptSparseTensorToHiCOOAdaptive(&adaptive, &max_nnzb, &Y, 2, 6, 6, 4, 3);
+    spt_CheckError(result, "to adaptive hicoo", NULL);
+
+    sptNnzIndex const nk = adaptive.kptr.len - 1;
+    int small = 0, large = 0;
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        small |= adaptive.kbits.data[k] == 2;
+        large |= adaptive.kbits.data[k] > 2;
+    }
+    if(adaptive.kbits.len != nk || !small || !large || adaptive.nnz != uniform.nnz ||
+        adaptive.bptr.len >= uniform.bptr.len || adaptive.bptr.data[adaptive.bptr.len - 1] != adaptive.nnz) {
+        printf("%u-D adaptive HiCOO: %"PARTI_PRI_NNZ_INDEX" blocks against %"PARTI_PRI_NNZ_INDEX" uniform\n",
+            (unsigned) nmodes, adaptive.bptr.len - 1, uniform.bptr.len - 1);
+        return 1;
+    }
+    /* Every nonzero is inside its kernel's block size */
+    for(sptNnzIndex k = 0; k < nk; ++k) {
+        for(sptNnzIndex b = adaptive.kptr.data[k]; b < adaptive.kptr.data[k+1]; ++b) {
+            for(sptNnzIndex z = adaptive.bptr.data[b]; z < adaptive.bptr.data[b+1]; ++z) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    if(adaptive.einds[m].data[z] >> adaptive.kbits.data[k] != 0) {
+                        printf("Element index out of its block\n");
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    sptIndex const R = 8;
+    sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+    sptRankMatrix ** mats = malloc((nmodes + 1) * sizeof *mats);
+    sptRankMatrix ** copy_mats = malloc(3 * sizeof *copy_mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? ndims[m] : max_dim;
+        sptNewRankMatrix(mats[m], nrows, R);
+        sptRandomizeRankMatrix(mats[m], nrows, R);
+    }
+    for(int t = 0; t < 3; ++t) {
+        copy_mats[t] = malloc(sizeof *copy_mats[t]);
+        sptNewRankMatrix(copy_mats[t], max_dim, R);
+    }
+    sptValue * ref = malloc((size_t) max_dim * mats[0]->stride * sizeof *ref);
+    sptIndex mats_order[4];
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes && !failed; ++mode) {
+        mats_order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            mats_order[i] = (mode + i) % nmodes;
+        }
+        sptOmpMTTKRPHiCOO_MatrixTiling(&uniform, mats, mats_order, mode, 2);
+        memcpy(ref, mats[nmodes]->values, (size_t) ndims[mode] * mats[0]->stride * sizeof *ref);
+
+        sptOmpMTTKRPHiCOO_MatrixTiling(&adaptive, mats, mats_order, mode, 3);
+        failed |= spt_SameRows(ref, mats[nmodes], ndims[mode], "sptOmpMTTKRPHiCOO_MatrixTiling", mode);
+        sptMTTKRPHiCOO_MatrixTiling(&adaptive, mats, mats_order, mode);
+        failed |= spt_SameRows(ref, mats[nmodes], ndims[mode], "sptMTTKRPHiCOO_MatrixTiling", mode);
+        sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&adaptive, mats, mats_order, mode, 3);
+        failed |= spt_SameRows(ref, mats[nmodes], ndims[mode], "sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled", mode);
+        sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce(&adaptive, mats, copy_mats, mats_order, mode, 3);
+        failed |= spt_SameRows(ref, mats[nmodes], ndims[mode], "sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled_Reduce", mode);
+    }
+
+    /* Kernels assuming one block size refuse it */
+    sptSemiSparseTensor out;
+    sptMatrix U;
+    sptNewMatrix(&U, ndims[0], 4);
+    if(sptOmpSparseTensorMulMatrixHiCOO(&out, &adaptive, &U, 0, 2) == 0) {
+        printf("HiCOO TTM accepted per-kernel block sizes\n");
+        failed = 1;
+    }
+    sptFreeMatrix(&U);
+
+    free(ref);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeRankMatrix(mats[m]);
+        free(mats[m]);
+    }
+    for(int t = 0; t < 3; ++t) {
+        sptFreeRankMatrix(copy_mats[t]);
+        free(copy_mats[t]);
+    }
+    free(mats);
+    free(copy_mats);
+    sptFreeSparseTensorHiCOO(&uniform);
+    sptFreeSparseTensorHiCOO(&adaptive);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return failed;
+}
+
+int main(void) {
+    srand(23);
+    sptIndex const ndims3[] = { 300, 250, 200 };
+    sptIndex const ndims4[] = { 120, 90, 100, 80 };
+    if(spt_CheckAdaptive(3, ndims3) || spt_CheckAdaptive(4, ndims4)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+/* The streamed HiCOO must equal the converted one array for array */
+static int spt_SameHiCOO(sptSparseTensorHiCOO const * a, sptSparseTensorHiCOO const * b) {
+    if(a->nnz != b->nnz || a->kptr.len != b->kptr.len || a->bptr.len != b->bptr.len ||
+        a->cptr.len != b->cptr.len) {
+        return 0;
+    }
+    sptNnzIndex const nb = a->bptr.len - 1;
+    if(memcmp(a->kptr.data, b->kptr.data, a->kptr.len * sizeof *a->kptr.data) != 0 ||
+        memcmp(a->bptr.data, b->bptr.data, a->bptr.len * sizeof *a->bptr.data) != 0 ||
+        memcmp(a->cptr.data, b->cptr.data, a->cptr.len * sizeof *a->cptr.data) != 0 ||
+        memcmp(a->values.data, b->values.data, a->nnz * sizeof *a->values.data) != 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(a->nkiters[m] != b->nkiters[m] ||
+            memcmp(a->binds[m].data, b->binds[m].data, nb * sizeof *a->binds[m].data) != 0 ||
+            memcmp(a->einds[m].data, b->einds[m].data, a->nnz * sizeof *a->einds[m].data) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 70, 40, 50, 20 };
+    sptIndex const nmodes = 4;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(11);
+    /* Distinct coordinates, so the order of duplicates cannot differ */
+    sptIndex c[4];
+    for(c[0] = 0; c[0] < ndims[0]; ++c[0])
+    for(c[1] = 0; c[1] < ndims[1]; ++c[1])
+    for(c[2] = 0; c[2] < ndims[2]; ++c[2])
+    for(c[3] = 0; c[3] < ndims[3]; ++c[3]) {
+        if(rand() % 200 == 0) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], c[m]);
+            }
+            sptAppendValueVector(&X.values, (sptValue) rand() / RAND_MAX + 0.5);
+            ++X.nnz;
+        }
+    }
+    /* Stream the nonzeros in a shuffled order */
+    sptNnzIndex * perm = malloc(X.nnz * sizeof *perm);
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        perm[z] = z;
+    }
+    for(sptNnzIndex z = X.nnz; z > 1; --z) {
+        sptNnzIndex const j = (sptNnzIndex) rand() % z;
+        sptNnzIndex const t = perm[z-1];
+        perm[z-1] = perm[j];
+        perm[j] = t;
+    }
+
+    sptElementIndex const sbs[] = { 2, 3 };
+    sptElementIndex const sks[] = { 4, 9 };
+    for(int t = 0; t < 2; ++t) {
+        sptHiCOOBuilder bld;
+        result = sptNewHiCOOBuilder(&bld, nmodes, ndims, sbs[t], sks[t], 100);
+        spt_CheckError(result, "new builder", NULL);
+        for(sptNnzIndex i = 0; i < X.nnz; ++i) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                c[m] = X.inds[m].data[perm[i]];
+            }
+            result = sptHiCOOBuilderAppend(&bld, c, X.values.data[perm[i]]);
+            spt_CheckError(result, "append", NULL);
+        }
+        sptSparseTensorHiCOO streamed, converted;
+        sptNnzIndex max_streamed = 0, max_converted = 0;
+        result = sptHiCOOBuilderFinish(&streamed, &max_streamed, &bld, 3);
+        spt_CheckError(result, "finish", NULL);
+        sptFreeHiCOOBuilder(&bld);
+
+        sptSparseTensor Y;
+        sptCopySparseTensor(&Y, &X, 1);
+        result = sptSparseTensorToHiCOO(&converted, &max_converted, &Y, sbs[t], sks[t], 2);
+        spt_CheckError(result, "to hicoo", NULL);
+        if(!spt_SameHiCOO(&streamed, &converted) || max_streamed != max_converted) {
+            printf("Streamed HiCOO differs from the converted one (sb %d, sk %d)\n", (int) sbs[t], (int) sks[t]);
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+        sptFreeSparseTensorHiCOO(&streamed);
+        sptFreeSparseTensorHiCOO(&converted);
+    }
+
+    /* Text loading goes through the builder */
+    FILE * fp = tmpfile();
+    sptDumpSparseTensor(&X, 1, fp);
+    rewind(fp);
+    sptSparseTensorHiCOO loaded, converted;
+    sptNnzIndex max_nnzb = 0;
+    result = sptLoadSparseTensorHiCOO(&loaded, &max_nnzb, 1, fp, 3, 7, 2);
+    spt_CheckError(result, "load", NULL);
+    fclose(fp);
+    result = sptSparseTensorToHiCOO(&converted, &max_nnzb, &X, 3, 7, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    if(loaded.nnz != converted.nnz || loaded.bptr.len != converted.bptr.len ||
+        memcmp(loaded.bptr.data, converted.bptr.data, loaded.bptr.len * sizeof *loaded.bptr.data) != 0) {
+        printf("sptLoadSparseTensorHiCOO differs from the converted tensor\n");
+        return 1;
+    }
+
+    sptFreeSparseTensorHiCOO(&loaded);
+    sptFreeSparseTensorHiCOO(&converted);
+    sptFreeSparseTensor(&X);
+    free(perm);
+    return 0;
+}
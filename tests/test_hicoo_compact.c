@@ -0,0 +1,113 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_Compare(sptValue const * ref, sptValue const * out, sptIndex stride, sptIndex nrows, sptIndex R) {
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue const a = ref[i * stride + r];
+            sptValue const b = out[i * stride + r];
+            if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Compact HiCOO MTTKRP must match the sequential COO one for one- and two-byte element indices */
+int main(void) {
+    sptIndex const ndims[] = { 5000, 300, 7000, 64 };
+    sptIndex const R = 16;
+    sptElementIndex const sb_bits[] = { 3, 8, 12 };
+    sptNnzIndex const nnz = 3001;
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = nnz;
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            mats[m] = malloc(sizeof *mats[m]);
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex const stride = mats[0]->stride;
+        sptValue * ref = malloc((size_t)nmodes * max_dim * stride * sizeof *ref);
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            mats_order[0] = mode;
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            sptMTTKRP(&X, mats, mats_order, mode);
+            memcpy(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+        }
+
+        for(int s = 0; s < 3; ++s) {
+            sptCompactHiCOO ch;
+            sptNnzIndex max_nnzb;
+            result = sptSparseTensorToCompactHiCOO(&ch, &max_nnzb, &X, sb_bits[s], 16, 3);
+            spt_CheckError(result, "compact hicoo", NULL);
+            if(ch.ewidth != (sb_bits[s] <= 8 ? 1 : 2) || ch.bptr.data[ch.bptr.len - 1] != nnz || max_nnzb < 1) {
+                printf("Compact HiCOO layout mismatch: nmodes %"PARTI_PRI_INDEX", sb_bits %d\n", nmodes, (int) sb_bits[s]);
+                return 1;
+            }
+            printf("nmodes %"PARTI_PRI_INDEX", sb_bits %d: %zu index bytes for %"PARTI_PRI_NNZ_INDEX" blocks\n",
+                nmodes, (int) sb_bits[s], sptCompactHiCOOIndexBytes(&ch), ch.bptr.len - 1);
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                result = sptOmpMTTKRPCompactHiCOO(&ch, mats, mats_order, mode, 3);
+                spt_CheckError(result, "compact hicoo mttkrp", NULL);
+                if(spt_Compare(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                    printf("Compact HiCOO MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", sb_bits %d\n", nmodes, mode, (int) sb_bits[s]);
+                    return 1;
+                }
+            }
+            sptFreeCompactHiCOO(&ch);
+        }
+
+        free(ref);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        free(mats_order);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
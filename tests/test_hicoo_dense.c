@@ -0,0 +1,167 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* HiCOO MTTKRP of the sparse part plus the dense blocks must match plain HiCOO MTTKRP */
+static int check_dense(sptSparseTensor *X, sptNnzIndex min_dense_blocks) {
+    sptIndex const nmodes = X->nmodes;
+    sptIndex const R = 10;
+    sptSparseTensor Y;
+    int result = sptCopySparseTensor(&Y, X, 1);
+    spt_CheckError(result, "copy", NULL);
+
+    sptSparseTensorHiCOO full, sparse;
+    sptHiCOODenseBlocks dense;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&full, &max_nnzb, X, 3, 5, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+    result = sptSparseTensorToHiCOODense(&sparse, &dense, &max_nnzb, &Y, 3, 5, 0, 2);
+    spt_CheckError(result, "to hicoo dense", NULL);
+    if(dense.nblocks < min_dense_blocks || sparse.nnz + dense.nnz != X->nnz) {
+        printf("Dense HiCOO: %"PARTI_PRI_NNZ_INDEX" dense blocks, %"PARTI_PRI_NNZ_INDEX" + %"PARTI_PRI_NNZ_INDEX" nonzeros\n",
+            dense.nblocks, sparse.nnz, dense.nnz);
+        return 1;
+    }
+
+    sptIndex const max_dim = sptMaxIndexArray(X->ndims, nmodes);
+    sptRankMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? X->ndims[m] : max_dim;
+        sptNewRankMatrix(mats[m], nrows, R);
+        sptRandomizeRankMatrix(mats[m], nrows, R);
+    }
+    sptIndex const stride = mats[0]->stride;
+    sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+    sptValue * ref = malloc((size_t)max_dim * stride * sizeof *ref);
+
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes && !failed; ++mode) {
+        mats_order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            mats_order[i] = (mode+i) % nmodes;
+        }
+        result = sptMTTKRPHiCOO_MatrixTiling(&full, mats, mats_order, mode);
+        spt_CheckError(result, "mttkrp", NULL);
+        memcpy(ref, mats[nmodes]->values, (size_t)X->ndims[mode] * stride * sizeof *ref);
+        /* The rounding of an entry follows the largest one, entries cancelling to near zero */
+        double scale = 0;
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                scale = fmax(scale, fabs(ref[i * stride + r]));
+            }
+        }
+
+        result = sptMTTKRPHiCOO_MatrixTiling(&sparse, mats, mats_order, mode);
+        spt_CheckError(result, "sparse mttkrp", NULL);
+        result = sptOmpMTTKRPHiCOODense(&dense, mats, mode, 3);
+        spt_CheckError(result, "dense mttkrp", NULL);
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptValue const a = ref[i * stride + r];
+                sptValue const b = mats[nmodes]->values[i * stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    failed = 1;
+                }
+            }
+        }
+        if(failed) {
+            printf("Dense HiCOO MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+        }
+    }
+
+    free(ref);
+    free(mats_order);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeRankMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+    sptFreeHiCOODenseBlocks(&dense);
+    sptFreeSparseTensorHiCOO(&sparse);
+    sptFreeSparseTensorHiCOO(&full);
+    sptFreeSparseTensor(&Y);
+    return failed;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 45, 30, 21, 13 };
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        /* A full 8^N block at the origin, a clipped one at the far corner, and scattered nonzeros */
+        sptNnzIndex nnz = 0;
+        for(int corner = 0; corner < 2; ++corner) {
+            sptIndex idx[4] = { 0, 0, 0, 0 };
+            sptIndex base[4], ext[4];
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                base[m] = corner ? (ndims[m] - 1) / 8 * 8 : 0;
+                ext[m] = corner ? ndims[m] - base[m] : 8;
+            }
+            for(;;) {
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    sptAppendIndexVector(&X.inds[m], base[m] + idx[m]);
+                }
+                sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+                ++nnz;
+                sptIndex m = nmodes;
+                while(m-- > 0 && ++idx[m] == ext[m]) {
+                    idx[m] = 0;
+                }
+                if(m == (sptIndex) -1) break;
+            }
+        }
+        for(sptNnzIndex z = 0; z < 2000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+            ++nnz;
+        }
+        X.nnz = nnz;
+        if(check_dense(&X, 2) != 0) {
+            return 1;
+        }
+        sptFreeSparseTensor(&X);
+    }
+
+    /* Every block dense, nothing left for the sparse part */
+    sptIndex const small[] = { 4, 4, 3 };
+    sptSparseTensor D;
+    int result = sptNewSparseTensor(&D, 3, small);
+    spt_CheckError(result, "new", NULL);
+    for(sptIndex i = 0; i < 4 * 4 * 3; ++i) {
+        sptAppendIndexVector(&D.inds[0], i / 12);
+        sptAppendIndexVector(&D.inds[1], i / 3 % 4);
+        sptAppendIndexVector(&D.inds[2], i % 3);
+        sptAppendValueVector(&D.values, (sptValue) (i + 1));
+    }
+    D.nnz = 4 * 4 * 3;
+    if(check_dense(&D, 1) != 0) {
+        return 1;
+    }
+    sptFreeSparseTensor(&D);
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+/* MTTKRP of the mutable tensor in every mode against HiCOO MTTKRP of all the nonzeros */
+static int check_mttkrp(sptMutableHiCOO const * mh, sptSparseTensorHiCOO const * full, sptRankMatrix ** mats, const char *when) {
+    sptIndex const nmodes = full->nmodes;
+    sptIndex const stride = mats[0]->stride;
+    sptIndex const R = mats[0]->ncols;
+    sptIndex mats_order[4];
+    sptValue * ref = malloc((size_t) mats[nmodes]->nrows * stride * sizeof *ref);
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes && !failed; ++mode) {
+        mats_order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            mats_order[i] = (mode + i) % nmodes;
+        }
+        sptOmpMTTKRPHiCOO_MatrixTiling(full, mats, mats_order, mode, 2);
+        memcpy(ref, mats[nmodes]->values, (size_t) full->ndims[mode] * stride * sizeof *ref);
+        int result = sptOmpMTTKRPMutableHiCOO(mh, mats, mats_order, mode, 3);
+        spt_CheckError(result, "mutable mttkrp", NULL);
+        for(sptIndex i = 0; i < full->ndims[mode] && !failed; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptValue const a = ref[i * stride + r];
+                sptValue const b = mats[nmodes]->values[i * stride + r];
+                if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                    printf("Mutable HiCOO MTTKRP %s: mode %u row %u differs\n", when, (unsigned) mode, (unsigned) i);
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+    }
+    free(ref);
+    return failed;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 60, 35, 50, 24 };
+    sptIndex const nmodes = 4;
+    sptNnzIndex const nbase = 4000, nupdates = 1500;
+    sptSparseTensor X, Xfull;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(17);
+    for(sptNnzIndex z = 0; z < nbase; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) rand() / RAND_MAX - 0.5);
+    }
+    X.nnz = nbase;
+    result = sptCopySparseTensor(&Xfull, &X, 1);
+    spt_CheckError(result, "copy", NULL);
+
+    sptSparseTensorHiCOO H, full;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    sptMutableHiCOO mh;
+    result = sptNewMutableHiCOO(&mh, &H, max_nnzb, 0, 2);
+    spt_CheckError(result, "new mutable", NULL);
+
+    /* Updates in a corner of the tensor, so most kernels stay untouched; a third hit old nonzeros */
+    sptIndex c[4];
+    for(sptNnzIndex u = 0; u < nupdates; ++u) {
+        sptValue const v = (sptValue) rand() / RAND_MAX;
+        if(u % 3 == 0) {
+            sptNnzIndex const z = (sptNnzIndex) rand() % nbase;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                c[m] = Xfull.inds[m].data[z];
+            }
+        } else {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                c[m] = (sptIndex) (rand() % (ndims[m] / 2));
+            }
+        }
+        result = sptMutableHiCOOAdd(&mh, c, v);
+        spt_CheckError(result, "add", NULL);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&Xfull.inds[m], c[m]);
+        }
+        sptAppendValueVector(&Xfull.values, v);
+        ++Xfull.nnz;
+    }
+    result = sptSparseTensorToHiCOO(&full, &max_nnzb, &Xfull, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+
+    sptIndex const R = 8;
+    sptIndex const max_dim = sptMaxIndexArray(ndims, nmodes);
+    sptRankMatrix ** mats = malloc((nmodes + 1) * sizeof *mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? ndims[m] : max_dim;
+        sptNewRankMatrix(mats[m], nrows, R);
+        sptRandomizeRankMatrix(mats[m], nrows, R);
+    }
+
+    if(check_mttkrp(&mh, &full, mats, "with a delta")) {
+        return 1;
+    }
+    sptNnzIndex const old_nk = mh.base.kptr.len - 1;
+    result = sptMutableHiCOOCompact(&mh, 3);
+    spt_CheckError(result, "compact", NULL);
+    if(mh.delta.nnz != 0 || mh.base.nnz > full.nnz || mh.base.kptr.len - 1 < old_nk ||
+        mh.base.bptr.data[mh.base.bptr.len - 1] != mh.base.nnz) {
+        printf("Compaction left an inconsistent tensor\n");
+        return 1;
+    }
+    if(check_mttkrp(&mh, &full, mats, "after compaction")) {
+        return 1;
+    }
+    /* Compaction keeps blocks Morton-ordered inside kernels like a fresh conversion, duplicates summed */
+    sptSparseTensorHiCOO converted;
+    sptSparseTensor Y;
+    sptCopySparseTensor(&Y, &Xfull, 1);
+    sptSparseTensorSortIndex(&Y, 1);
+    sptNnzIndex w = 0;
+    for(sptNnzIndex z = 0; z < Y.nnz; ++z) {
+        int same = w > 0;
+        for(sptIndex m = 0; m < nmodes && same; ++m) {
+            same = Y.inds[m].data[z] == Y.inds[m].data[w-1];
+        }
+        if(same) {
+            Y.values.data[w-1] += Y.values.data[z];
+            continue;
+        }
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            Y.inds[m].data[w] = Y.inds[m].data[z];
+        }
+        Y.values.data[w++] = Y.values.data[z];
+    }
+    Y.nnz = w;
+    Y.values.len = w;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        Y.inds[m].len = w;
+    }
+    result = sptSparseTensorToHiCOO(&converted, &max_nnzb, &Y, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    if(converted.nnz != mh.base.nnz || converted.bptr.len != mh.base.bptr.len ||
+        memcmp(converted.kptr.data, mh.base.kptr.data, converted.kptr.len * sizeof *converted.kptr.data) != 0 ||
+        memcmp(converted.bptr.data, mh.base.bptr.data, converted.bptr.len * sizeof *converted.bptr.data) != 0 ||
+        memcmp(converted.cptr.data, mh.base.cptr.data, converted.cptr.len * sizeof *converted.cptr.data) != 0 ||
+        max_nnzb != mh.max_nnzb) {
+        printf("Compacted HiCOO differs from a fresh conversion\n");
+        return 1;
+    }
+
+    /* A threshold compacts on its own */
+    mh.compact_nnz = 10;
+    for(sptNnzIndex u = 0; u < 25; ++u) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            c[m] = (sptIndex) (rand() % ndims[m]);
+        }
+        sptMutableHiCOOAdd(&mh, c, 1);
+    }
+    if(mh.delta.nnz != 5) {
+        printf("Threshold compaction left %"PARTI_PRI_NNZ_INDEX" pending nonzeros\n", mh.delta.nnz);
+        return 1;
+    }
+
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        sptFreeRankMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+    sptFreeMutableHiCOO(&mh);
+    sptFreeSparseTensorHiCOO(&full);
+    sptFreeSparseTensorHiCOO(&converted);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Xfull);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+static int spt_Close(double a, double b) {
+    return fabs(a - b) <= 1e-4 * (1 + fabs(b));
+}
+
+/* Sum the fibers of a semi-sparse tensor into a dense row-major array */
+static double * spt_SemiToDense(sptSemiSparseTensor const * Y) {
+    sptNnzIndex total = 1;
+    for(sptIndex m = 0; m < Y->nmodes; ++m) {
+        total *= Y->ndims[m];
+    }
+    double * dense = calloc(total, sizeof *dense);
+    for(sptNnzIndex f = 0; f < Y->nnz; ++f) {
+        for(sptIndex c = 0; c < Y->ndims[Y->mode]; ++c) {
+            sptNnzIndex off = 0;
+            for(sptIndex m = 0; m < Y->nmodes; ++m) {
+                off = off * Y->ndims[m] + (m == Y->mode ? c : Y->inds[m].data[f]);
+            }
+            dense[off] += Y->values.values[f * Y->stride + c];
+        }
+    }
+    return dense;
+}
+
+static int spt_CompareSemi(sptSemiSparseTensor const * A, sptSemiSparseTensor const * B, const char *name) {
+    sptNnzIndex total = 1;
+    for(sptIndex m = 0; m < A->nmodes; ++m) {
+        total *= A->ndims[m];
+    }
+    double * a = spt_SemiToDense(A);
+    double * b = spt_SemiToDense(B);
+    int failed = A->nnz != B->nnz;
+    for(sptNnzIndex i = 0; i < total && !failed; ++i) {
+        failed = !spt_Close(a[i], b[i]);
+    }
+    if(failed) {
+        printf("%s mismatch\n", name);
+    }
+    free(a);
+    free(b);
+    return failed;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 30, 12, 25, 9 };
+    sptIndex const nmodes = 4;
+    sptSparseTensor X, X2;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(5);
+    for(sptNnzIndex z = 0; z < 5000; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) rand() / RAND_MAX - 0.5);
+    }
+    X.nnz = 5000;
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptCopySparseTensor(&X2, &X, 1);
+    spt_CheckError(result, "copy", NULL);
+    for(sptNnzIndex z = 0; z < X2.nnz; ++z) {
+        X2.values.data[z] = (sptValue) rand() / RAND_MAX + 0.5;
+    }
+
+    sptSparseTensorHiCOO H, H2;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    result = sptSparseTensorToHiCOO(&H2, &max_nnzb, &X2, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+
+    /* TTM and TTV in every mode, against the COO versions */
+    int failed = 0;
+    for(sptIndex mode = 0; mode < nmodes && !failed; ++mode) {
+        sptMatrix U;
+        sptNewMatrix(&U, ndims[mode], 5);
+        sptRandomizeMatrix(&U, ndims[mode], 5);
+        sptSemiSparseTensor ref, out;
+        result = sptSparseTensorMulMatrix(&ref, &X, &U, mode);
+        spt_CheckError(result, "ttm", NULL);
+        result = sptOmpSparseTensorMulMatrixHiCOO(&out, &H, &U, mode, 3);
+        spt_CheckError(result, "hicoo ttm", NULL);
+        failed |= spt_CompareSemi(&out, &ref, "sptOmpSparseTensorMulMatrixHiCOO");
+        sptFreeSemiSparseTensor(&ref);
+        sptFreeSemiSparseTensor(&out);
+        sptFreeMatrix(&U);
+
+        sptValueVector V;
+        sptNewValueVector(&V, ndims[mode], ndims[mode]);
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            V.data[i] = (sptValue) rand() / RAND_MAX;
+        }
+        result = sptSparseTensorMulVector(&ref, &X, &V, mode);
+        spt_CheckError(result, "ttv", NULL);
+        result = sptOmpSparseTensorMulVectorHiCOO(&out, &H, &V, mode, 3);
+        spt_CheckError(result, "hicoo ttv", NULL);
+        failed |= spt_CompareSemi(&out, &ref, "sptOmpSparseTensorMulVectorHiCOO");
+        sptFreeSemiSparseTensor(&ref);
+        sptFreeSemiSparseTensor(&out);
+        sptFreeValueVector(&V);
+    }
+    if(failed) {
+        return 1;
+    }
+
+    /* Same-pattern element-wise operations work on the values in place of the nonzeros */
+    sptSparseTensorHiCOO Z;
+    result = sptOmpSparseTensorDotMulEqHiCOO(&Z, &H, &H2);
+    spt_CheckError(result, "dotmul", NULL);
+    for(sptNnzIndex z = 0; z < H.nnz; ++z) {
+        if(!spt_Close(Z.values.data[z], H.values.data[z] * H2.values.data[z])) {
+            printf("sptOmpSparseTensorDotMulEqHiCOO mismatch at %"PARTI_PRI_NNZ_INDEX"\n", z);
+            return 1;
+        }
+    }
+    sptFreeSparseTensorHiCOO(&Z);
+    result = sptOmpSparseTensorSubEqHiCOO(&Z, &H, &H2);
+    spt_CheckError(result, "sub", NULL);
+    for(sptNnzIndex z = 0; z < H.nnz; ++z) {
+        if(!spt_Close(Z.values.data[z], H.values.data[z] - H2.values.data[z])) {
+            printf("sptOmpSparseTensorSubEqHiCOO mismatch at %"PARTI_PRI_NNZ_INDEX"\n", z);
+            return 1;
+        }
+    }
+
+    /* Scalars: the norm scales with the square */
+    double const norm = sptSparseTensorFrobeniusNormSquaredHiCOO(&Z);
+    sptOmpSparseTensorMulScalarHiCOO(&Z, 3);
+    sptOmpSparseTensorDivScalarHiCOO(&Z, 2);
+    if(!spt_Close(sptSparseTensorFrobeniusNormSquaredHiCOO(&Z), 2.25 * norm)) {
+        printf("HiCOO scalar operations mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensorHiCOO(&Z);
+
+    /* Another pattern is refused */
+    sptSparseTensor X3;
+    sptSparseTensorHiCOO H3;
+    sptCopySparseTensor(&X3, &X, 1);
+    X3.nnz -= 1;
+    X3.values.len -= 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        X3.inds[m].len -= 1;
+    }
+    result = sptSparseTensorToHiCOO(&H3, &max_nnzb, &X3, 3, 5, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    if(sptOmpSparseTensorAddEqHiCOO(&Z, &H, &H3) == 0) {
+        printf("sptOmpSparseTensorAddEqHiCOO accepted another pattern\n");
+        return 1;
+    }
+
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensorHiCOO(&H2);
+    sptFreeSparseTensorHiCOO(&H3);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&X2);
+    sptFreeSparseTensor(&X3);
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+static sptNnzIndex spt_KernelNnz(sptSparseTensorHiCOO const * H, sptIndex const k) {
+    return H->bptr.data[H->kptr.data[k+1]] - H->bptr.data[H->kptr.data[k]];
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 200, 160, 120 };
+    sptIndex const nmodes = 3;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(31);
+    /* Skewed in the last mode, so kernels of a row differ in weight */
+    for(sptNnzIndex z = 0; z < 20000; ++z) {
+        sptIndex const last = (sptIndex) (rand() % ndims[2]);
+        sptAppendIndexVector(&X.inds[0], (sptIndex) (rand() % ndims[0]));
+        sptAppendIndexVector(&X.inds[1], (sptIndex) (rand() % ndims[1]));
+        sptAppendIndexVector(&X.inds[2], (sptIndex) (rand() % (last + 1)));
+        sptAppendValueVector(&X.values, 1);
+    }
+    X.nnz = 20000;
+
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 2, 5, 3);
+    spt_CheckError(result, "to hicoo", NULL);
+
+    sptNnzIndex const nk = H.kptr.len - 1;
+    sptIndex const sk = (sptIndex)1 << H.sk_bits;
+    char * seen = malloc(nk);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptIndex const kernel_ndim = (ndims[m] + sk - 1) / sk;
+        sptIndex longest = 0;
+        for(sptNnzIndex k = 0; k < nk; ++k) {
+            seen[k] = 0;
+        }
+        sptNnzIndex * balanced = calloc(H.nkiters[m] + 1, sizeof *balanced);
+        sptNnzIndex * in_order = calloc(H.nkiters[m] + 1, sizeof *in_order);
+        for(sptIndex r = 0; r < kernel_ndim; ++r) {
+            sptIndexVector const * row = &H.kschr[m][r];
+            if(longest < row->len) {
+                longest = row->len;
+            }
+            /* Kernels of a row in kernel order, as built before balancing */
+            sptIndex j = 0;
+            for(sptNnzIndex k = 0; k < nk; ++k) {
+                if(H.binds[m].data[H.kptr.data[k]] >> (H.sk_bits - H.sb_bits) == r) {
+                    in_order[j++] += spt_KernelNnz(&H, (sptIndex) k);
+                }
+            }
+            for(sptIndex i = 0; i < row->len; ++i) {
+                sptIndex const k = row->data[i];
+                if(k >= nk || seen[k] || H.binds[m].data[H.kptr.data[k]] >> (H.sk_bits - H.sb_bits) != r) {
+                    printf("Mode %u row %u schedules kernel %u wrongly\n", (unsigned) m, (unsigned) r, (unsigned) k);
+                    return 1;
+                }
+                seen[k] = 1;
+                balanced[i] += spt_KernelNnz(&H, k);
+            }
+            if(j != row->len) {
+                printf("Mode %u row %u lost kernels\n", (unsigned) m, (unsigned) r);
+                return 1;
+            }
+        }
+        for(sptNnzIndex k = 0; k < nk; ++k) {
+            if(!seen[k]) {
+                printf("Mode %u does not schedule kernel %u\n", (unsigned) m, (unsigned) k);
+                return 1;
+            }
+        }
+        /* As few rounds as the longest row, and no heavier a heaviest round */
+        sptNnzIndex max_balanced = 0, max_in_order = 0;
+        for(sptIndex i = 0; i < H.nkiters[m]; ++i) {
+            max_balanced = balanced[i] > max_balanced ? balanced[i] : max_balanced;
+            max_in_order = in_order[i] > max_in_order ? in_order[i] : max_in_order;
+        }
+        if(longest != H.nkiters[m] || max_balanced > max_in_order) {
+            printf("Mode %u: %u rounds for rows of %u, heaviest round %lu against %lu\n", (unsigned) m,
+                (unsigned) H.nkiters[m], (unsigned) longest, (unsigned long) max_balanced, (unsigned long) max_in_order);
+            return 1;
+        }
+        free(balanced);
+        free(in_order);
+    }
+
+    free(seen);
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
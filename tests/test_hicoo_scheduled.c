@@ -0,0 +1,106 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Scheduled HiCOO MTTKRP on a skewed tensor must match the sequential one for any thread count */
+int main(void) {
+    sptIndex const ndims[] = { 400, 90, 257, 33 };
+    sptIndex const R = 16;
+    sptNnzIndex const nnz = 6000;
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                /* Half of the nonzeros crowd into the first kernel rows */
+                sptIndex const n = (z % 2 == 0) ? 8 : ndims[m];
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % n));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = nnz;
+
+        sptSparseTensorHiCOO hitsr;
+        sptNnzIndex max_nnzb = 0;
+        result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X, 3, 5, 1);
+        spt_CheckError(result, "to hicoo", NULL);
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptRankMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            sptNewRankMatrix(mats[m], nrows, R);
+            sptRandomizeRankMatrix(mats[m], nrows, R);
+        }
+        sptIndex const stride = mats[0]->stride;
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptValue * ref = malloc((size_t)max_dim * stride * sizeof *ref);
+
+        int const tks[] = { 1, 3, 8 };
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            mats_order[0] = mode;
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            result = sptMTTKRPHiCOO_MatrixTiling(&hitsr, mats, mats_order, mode);
+            spt_CheckError(result, "mttkrp", NULL);
+            memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+            /* Rounding follows the largest entry; one may cancel to near zero */
+            double scale = 0;
+            for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    scale = fmax(scale, fabs(ref[i * stride + r]));
+                }
+            }
+
+            for(int k = 0; k < 3; ++k) {
+                result = sptOmpMTTKRPHiCOO_MatrixTiling_Scheduled(&hitsr, mats, mats_order, mode, tks[k]);
+                spt_CheckError(result, "scheduled mttkrp", NULL);
+                for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue const a = ref[i * stride + r];
+                        sptValue const b = mats[nmodes]->values[i * stride + r];
+                        if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                            printf("Scheduled MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", tk %d\n", nmodes, mode, tks[k]);
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+
+        free(ref);
+        free(mats_order);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeRankMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeSparseTensorHiCOO(&hitsr);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NMODES 3
+#define NNZ 12000
+#define NPARTS 4
+
+/* Partitions stay balanced and cut fewer rows than a block distribution, and their files round-trip */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 80, 120, 60 };
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, NMODES, ndims);
+    srand(23);
+    /* Clusters of rows, one per rank, with a tenth of the nonzeros anywhere */
+    for(sptNnzIndex n = 0; n < NNZ; ++n) {
+        int const c = rand() % NPARTS;
+        int const noise = rand() % 10 == 0;
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            sptIndex const span = ndims[m] / NPARTS;
+            sptAppendIndexVector(&X.inds[m], noise ? rand() % ndims[m] : c * span + rand() % span);
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        ++X.nnz;
+    }
+
+    int * part = malloc(NNZ * sizeof *part);
+    sptRowOwnership own;
+    double const imbalance = 0.05;
+    if(sptHypergraphPartition(part, &own, &X, NPARTS, imbalance) != 0) {
+        printf("partitioning failed\n");
+        return 1;
+    }
+    sptNnzIndex loads[NPARTS] = { 0 };
+    for(sptNnzIndex z = 0; z < NNZ; ++z) {
+        if(part[z] < 0 || part[z] >= NPARTS) {
+            printf("nonzero %lu in part %d\n", (unsigned long) z, part[z]);
+            return 1;
+        }
+        ++loads[part[z]];
+    }
+    for(int p = 0; p < NPARTS; ++p) {
+        if(loads[p] > NNZ / NPARTS * (1 + imbalance) + 1) {
+            printf("part %d holds %lu nonzeros\n", p, (unsigned long) loads[p]);
+            return 1;
+        }
+    }
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            if(own.owner[m][i] < 0 || own.owner[m][i] >= NPARTS) {
+                printf("mode %"PARTI_PRI_INDEX", row %"PARTI_PRI_INDEX" owned by %d\n", m, i, own.owner[m][i]);
+                return 1;
+            }
+        }
+    }
+
+    /* Consecutive nonzeros to each rank and rows in blocks */
+    int * block = malloc(NNZ * sizeof *block);
+    for(sptNnzIndex z = 0; z < NNZ; ++z) {
+        block[z] = (int) (z * NPARTS / NNZ);
+    }
+    sptRowOwnership block_own;
+    sptNewRowOwnershipBlock(&block_own, NMODES, ndims, NPARTS);
+    sptNnzIndex const volume = sptRowOwnershipVolume(&own, &X, part);
+    sptNnzIndex const block_volume = sptRowOwnershipVolume(&block_own, &X, block);
+    if(volume >= block_volume) {
+        printf("partition moves %lu rows, the block distribution %lu\n", (unsigned long) volume, (unsigned long) block_volume);
+        return 1;
+    }
+    free(block);
+    sptFreeRowOwnership(&block_own);
+
+    char prefix[] = "/tmp/parti_partition_XXXXXX";
+    int fd = mkstemp(prefix);
+    if(fd < 0) {
+        return 1;
+    }
+    close(fd);
+    if(sptDumpPartitionedSparseTensor(&X, part, &own, prefix) != 0) {
+        printf("dumping the partition failed\n");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof path, "%s.owner.bin", prefix);
+    FILE * fp = fopen(path, "rb");
+    sptRowOwnership loaded;
+    if(fp == NULL || sptLoadRowOwnership(&loaded, fp) != 0) {
+        printf("loading the ownership failed\n");
+        return 1;
+    }
+    fclose(fp);
+    remove(path);
+    if(loaded.nmodes != NMODES || loaded.nparts != NPARTS) {
+        printf("ownership shape changed\n");
+        return 1;
+    }
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        if(loaded.ndims[m] != ndims[m] || memcmp(loaded.owner[m], own.owner[m], ndims[m] * sizeof *own.owner[m]) != 0) {
+            printf("mode %"PARTI_PRI_INDEX": ownership changed\n", m);
+            return 1;
+        }
+    }
+    sptFreeRowOwnership(&loaded);
+
+    double total = 0, parts_total = 0;
+    for(sptNnzIndex z = 0; z < NNZ; ++z) {
+        total += X.values.data[z];
+    }
+    for(int p = 0; p < NPARTS; ++p) {
+        snprintf(path, sizeof path, "%s.%d.bin", prefix, p);
+        fp = fopen(path, "rb");
+        sptSparseTensor local;
+        if(fp == NULL || sptLoadSparseTensorBinary(&local, fp) != 0) {
+            printf("loading part %d failed\n", p);
+            return 1;
+        }
+        fclose(fp);
+        remove(path);
+        if(local.nnz != loads[p] || local.ndims[0] != ndims[0] || local.ndims[NMODES-1] != ndims[NMODES-1]) {
+            printf("part %d: %lu nonzeros\n", p, (unsigned long) local.nnz);
+            return 1;
+        }
+        for(sptNnzIndex z = 0; z < local.nnz; ++z) {
+            parts_total += local.values.data[z];
+        }
+        sptFreeSparseTensor(&local);
+    }
+    remove(prefix);
+    if(parts_total < total - 1e-6 || parts_total > total + 1e-6) {
+        printf("parts sum to %g, the tensor to %g\n", parts_total, total);
+        return 1;
+    }
+
+    sptFreeRowOwnership(&own);
+    free(part);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
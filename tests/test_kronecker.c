@@ -0,0 +1,141 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+
+static void spt_RandomTensor(sptSparseTensor *X, sptIndex nmodes, sptIndex const ndims[], sptNnzIndex nnz) {
+    sptNewSparseTensor(X, nmodes, ndims);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X->inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X->values, (sptValue) (rand() % 100) / 10 + 1);
+    }
+    X->nnz = nnz;
+}
+
+/* Entries summed per coordinate, so that the order of duplicates does not matter */
+static int spt_SameEntries(sptSparseTensor const *Y, sptDenseTensor const *ref) {
+    sptDenseTensor D;
+    if(sptSparseTensorToDense(&D, Y) != 0 || D.values.len != ref->values.len) {
+        return 0;
+    }
+    for(sptNnzIndex x = 0; x < D.values.len; ++x) {
+        if(fabs(D.values.data[x] - ref->values.data[x]) > 1e-6 * (1 + fabs(ref->values.data[x]))) {
+            return 0;
+        }
+    }
+    sptFreeDenseTensor(&D);
+    return 1;
+}
+
+/* Serial and parallel Kronecker and Khatri-Rao products must match their definitions, with exactly sized outputs */
+int main(void) {
+    int result;
+    sptIndex const adims[] = { 4, 5, 6 };
+    sptIndex const bdims[] = { 3, 2, 6 };
+    sptSparseTensor A, B, Y;
+    spt_RandomTensor(&A, 3, adims, 30);
+    spt_RandomTensor(&B, 3, bdims, 40);
+
+    /* Kronecker: every pair of nonzeros */
+    sptIndex const kdims[] = { 12, 10, 36 };
+    sptDenseTensor ref;
+    sptNewDenseTensor(&ref, 3, kdims);
+    for(sptNnzIndex i = 0; i < A.nnz; ++i) {
+        for(sptNnzIndex j = 0; j < B.nnz; ++j) {
+            sptNnzIndex off = 0;
+            for(sptIndex m = 0; m < 3; ++m) {
+                off = off * kdims[m] + A.inds[m].data[i] * bdims[m] + B.inds[m].data[j];
+            }
+            ref.values.data[off] += A.values.data[i] * B.values.data[j];
+        }
+    }
+    for(int parallel = 0; parallel <= 1; ++parallel) {
+        result = parallel ? sptOmpSparseTensorKroneckerMul(&Y, &A, &B, 3) : sptSparseTensorKroneckerMul(&Y, &A, &B);
+        spt_CheckError(result, "kronecker", NULL);
+        if(Y.nnz != A.nnz * B.nnz || !spt_SameEntries(&Y, &ref)) {
+            printf("Kronecker mismatch, parallel %d\n", parallel);
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+    }
+    sptFreeDenseTensor(&ref);
+
+    /* Khatri-Rao: pairs sharing the last index */
+    sptIndex const rdims[] = { 12, 10, 6 };
+    sptNewDenseTensor(&ref, 3, rdims);
+    sptNnzIndex npairs = 0;
+    for(sptNnzIndex i = 0; i < A.nnz; ++i) {
+        for(sptNnzIndex j = 0; j < B.nnz; ++j) {
+            if(A.inds[2].data[i] != B.inds[2].data[j]) {
+                continue;
+            }
+            sptNnzIndex const off = ((A.inds[0].data[i] * bdims[0] + B.inds[0].data[j]) * rdims[1] +
+                A.inds[1].data[i] * bdims[1] + B.inds[1].data[j]) * rdims[2] + A.inds[2].data[i];
+            ref.values.data[off] += A.values.data[i] * B.values.data[j];
+            ++npairs;
+        }
+    }
+    for(int parallel = 0; parallel <= 1; ++parallel) {
+        result = parallel ? sptOmpSparseTensorKhatriRaoMul(&Y, &A, &B, 3) : sptSparseTensorKhatriRaoMul(&Y, &A, &B);
+        spt_CheckError(result, "khatri-rao", NULL);
+        if(Y.nnz != npairs || !spt_SameEntries(&Y, &ref)) {
+            printf("Khatri-Rao mismatch, parallel %d\n", parallel);
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+    }
+    sptFreeDenseTensor(&ref);
+    sptFreeSparseTensor(&A);
+    sptFreeSparseTensor(&B);
+
+    /* Dense Khatri-Rao */
+    sptMatrix U, V, W;
+    sptNewMatrix(&U, 7, 11);
+    sptNewMatrix(&V, 5, 11);
+    sptRandomizeMatrix(&U, 7, 11);
+    sptRandomizeMatrix(&V, 5, 11);
+    result = sptMatrixKhatriRaoMul(&W, &U, &V, 3);
+    spt_CheckError(result, "dense khatri-rao", NULL);
+    if(W.nrows != 35 || W.ncols != 11) {
+        printf("Dense Khatri-Rao shape mismatch\n");
+        return 1;
+    }
+    for(sptIndex i = 0; i < 7; ++i) {
+        for(sptIndex j = 0; j < 5; ++j) {
+            for(sptIndex r = 0; r < 11; ++r) {
+                sptValue const a = U.values[i * U.stride + r] * V.values[j * V.stride + r];
+                if(fabs(W.values[(i * 5 + j) * W.stride + r] - a) > 1e-6) {
+                    printf("Dense Khatri-Rao mismatch\n");
+                    return 1;
+                }
+            }
+        }
+    }
+    sptFreeMatrix(&U);
+    sptFreeMatrix(&V);
+    sptFreeMatrix(&W);
+    return 0;
+}
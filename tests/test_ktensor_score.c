@@ -0,0 +1,91 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMODES 4
+#define RANK 13
+#define NQUERIES 5000
+
+/* Batched scoring matches the sum over the rank, for every thread count and order */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 60, 80, 30, 70 };
+    srand(5);
+    for(sptIndex nmodes = 1; nmodes <= NMODES; ++nmodes) {
+        sptKruskalTensor K;
+        sptNewKruskalTensor(&K, nmodes, ndims, RANK);
+        K.factors = malloc(nmodes * sizeof *K.factors);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            K.factors[m] = malloc(sizeof *K.factors[m]);
+            sptNewMatrix(K.factors[m], ndims[m], RANK);
+            sptRandomizeMatrix(K.factors[m], ndims[m], RANK);
+        }
+        for(sptIndex r = 0; r < RANK; ++r) {
+            K.lambda[r] = (sptValue) (rand() % 100 + 1) / 10;
+        }
+
+        sptIndex * coords[NMODES];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            coords[m] = malloc(NQUERIES * sizeof *coords[m]);
+            for(sptNnzIndex q = 0; q < NQUERIES; ++q) {
+                coords[m][q] = rand() % ndims[m];
+            }
+        }
+        sptValue * out = malloc(NQUERIES * sizeof *out);
+        int const tks[] = { 1, 3 };
+        for(int t = 0; t < 2; ++t) {
+            if(sptKruskalTensorScore(&K, coords, NQUERIES, out, tks[t]) != 0) {
+                printf("scoring failed\n");
+                return 1;
+            }
+            for(sptNnzIndex q = 0; q < NQUERIES; ++q) {
+                /* The rounding of sptValue grows with the terms, whose sum may cancel */
+                double ref = 0, mag = 0;
+                for(sptIndex r = 0; r < RANK; ++r) {
+                    double p = K.lambda[r];
+                    for(sptIndex m = 0; m < nmodes; ++m) {
+                        p *= K.factors[m]->values[coords[m][q] * K.factors[m]->stride + r];
+                    }
+                    ref += p;
+                    mag += fabs(p);
+                }
+                if(fabs(ref - out[q]) > 1e3 * PARTI_VALUE_EPSILON * (1 + mag)) {
+                    printf("order %"PARTI_PRI_INDEX", %d threads: query %lu scored %g, expected %g\n",
+                        nmodes, tks[t], (unsigned long) q, out[q], ref);
+                    return 1;
+                }
+            }
+        }
+
+        coords[nmodes-1][NQUERIES-1] = ndims[nmodes-1];
+        if(sptKruskalTensorScore(&K, coords, NQUERIES, out, 2) == 0) {
+            printf("accepted a coordinate out of range\n");
+            return 1;
+        }
+
+        free(out);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            free(coords[m]);
+        }
+        sptFreeKruskalTensor(&K);
+    }
+    return 0;
+}
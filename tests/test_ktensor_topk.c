@@ -0,0 +1,117 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMODES 3
+#define RANK 8
+#define K 25
+
+/* The exact top k matches a full scan; a probed top k is sorted and scored right */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 40, 6000, 30 };
+    sptIndex const mode = 1;
+    sptKruskalTensor K_;
+    sptNewKruskalTensor(&K_, NMODES, ndims, RANK);
+    K_.factors = malloc(NMODES * sizeof *K_.factors);
+    srand(9);
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        K_.factors[m] = malloc(sizeof *K_.factors[m]);
+        sptNewMatrix(K_.factors[m], ndims[m], RANK);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < RANK; ++r) {
+                K_.factors[m]->values[i * K_.factors[m]->stride + r] = (sptValue) (rand() % 2000 - 1000) / 1000;
+            }
+        }
+    }
+    /* Factor entries are at most 1, so a score sums terms of at most lambda[r]; its rounding scales with their sum */
+    double mag = 0;
+    for(sptIndex r = 0; r < RANK; ++r) {
+        K_.lambda[r] = (sptValue) (rand() % 100 + 1) / 10;
+        mag += K_.lambda[r];
+    }
+    double const tol = 1e3 * PARTI_VALUE_EPSILON * (1 + mag);
+
+    sptKruskalIndex idx;
+    if(sptNewKruskalIndex(&idx, &K_, mode, 77, 3, 3) != 0) {
+        printf("index build failed\n");
+        return 1;
+    }
+
+    /* Every row's score at the query, via the batched scoring */
+    sptIndex * coords[NMODES];
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        coords[m] = malloc(ndims[mode] * sizeof *coords[m]);
+    }
+    sptValue * all = malloc(ndims[mode] * sizeof *all);
+    sptIndex top_inds[K];
+    sptValue top_vals[K];
+    for(int t = 0; t < 20; ++t) {
+        sptIndex query[NMODES] = { rand() % ndims[0], 0, rand() % ndims[2] };
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            coords[0][i] = query[0];
+            coords[1][i] = i;
+            coords[2][i] = query[2];
+        }
+        sptKruskalTensorScore(&K_, coords, ndims[mode], all, 1);
+
+        for(sptIndex nprobe = 0; nprobe < 3; nprobe += 2) {
+            if(sptKruskalIndexTopK(&idx, &K_, query, K, nprobe, top_inds, top_vals) != 0) {
+                printf("query failed\n");
+                return 1;
+            }
+            for(sptIndex j = 0; j < K; ++j) {
+                if(fabs(all[top_inds[j]] - top_vals[j]) > tol
+                    || (j > 0 && top_vals[j] > top_vals[j - 1])) {
+                    printf("nprobe %"PARTI_PRI_INDEX": entry %"PARTI_PRI_INDEX" wrong or out of order\n", nprobe, j);
+                    return 1;
+                }
+            }
+            if(nprobe != 0) {
+                continue;
+            }
+            /* Exact: nothing outside the result beats its last entry, up to the rounding of the two dot orders */
+            sptValue const kth = top_vals[K - 1] + tol;
+            sptIndex better = 0;
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                better += all[i] > kth;
+            }
+            if(better > K - 1) {
+                printf("query %d: %"PARTI_PRI_INDEX" rows beat the k-th score\n", t, better);
+                return 1;
+            }
+        }
+    }
+
+    sptIndex bad_query[NMODES] = { ndims[0], 0, 0 };
+    if(sptKruskalIndexTopK(&idx, &K_, bad_query, K, 0, top_inds, top_vals) == 0) {
+        printf("accepted a coordinate out of range\n");
+        return 1;
+    }
+
+    free(all);
+    for(sptIndex m = 0; m < NMODES; ++m) {
+        free(coords[m]);
+    }
+    sptFreeKruskalIndex(&idx);
+    sptFreeKruskalTensor(&K_);
+    return 0;
+}
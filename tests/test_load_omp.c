@@ -0,0 +1,74 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+
+int main(void) {
+    static char bufX[] = "3\n"
+        "2 3 4\n"
+        "1 1 1 1.5\n"
+        "1 3 2 -2.25e1\n"
+        "\n"
+        "2 1 4 0.000123456789\n"
+        "2 2 3  4\r\n"
+        "2 3 1\t0.1234567890123456789012\n"
+        "1 2 2 0\n"
+        "2 3 4 6.02214076e23";
+    char filename[] = "/tmp/parti_test_load_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    spt_CheckOSError(write(fd, bufX, sizeof bufX - 1) != (ssize_t) (sizeof bufX - 1), "write");
+    close(fd);
+
+    FILE *stream = fopen(filename, "r");
+    sptSparseTensor X;
+    int result = sptLoadSparseTensor(&X, 1, stream);
+    spt_CheckError(result, "load", NULL);
+    fclose(stream);
+
+    for(int tk = 1; tk <= 5; ++tk) {
+        sptSparseTensor Y;
+        result = sptOmpLoadSparseTensor(&Y, 1, filename, tk);
+        spt_CheckError(result, "omp load", NULL);
+        if(X.nmodes != Y.nmodes || X.nnz != Y.nnz) {
+            printf("Shape mismatch with %d threads\n", tk);
+            return 1;
+        }
+        for(sptIndex m = 0; m < X.nmodes; ++m) {
+            if(X.ndims[m] != Y.ndims[m] ||
+                memcmp(X.inds[m].data, Y.inds[m].data, X.nnz * sizeof (sptIndex)) != 0) {
+                printf("Index mismatch with %d threads\n", tk);
+                return 1;
+            }
+        }
+        if(memcmp(X.values.data, Y.values.data, X.nnz * sizeof (sptValue)) != 0) {
+            printf("Value mismatch with %d threads\n", tk);
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+    }
+
+    unlink(filename);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
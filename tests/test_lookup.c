@@ -0,0 +1,122 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* The first stored nonzero at coords, by a linear scan */
+static sptNnzIndex spt_ScanFind(sptSparseTensor const *X, sptIndex const coords[]) {
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        sptIndex m = 0;
+        while(m < X->nmodes && X->inds[m].data[z] == coords[m]) {
+            ++m;
+        }
+        if(m == X->nmodes) {
+            return z;
+        }
+    }
+    return PARTI_NOT_FOUND;
+}
+
+/* Point queries agree with a scan, and box queries find every nonzero in the box in coordinate order */
+int main(void) {
+    sptIndex const ndims[] = { 40, 25, 30 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(29);
+    for(int n = 0; n < 4000; ++n) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X.values, 1 + rand() % 9);
+        ++X.nnz;
+    }
+
+    sptSparseTensorLookup lk;
+    result = sptNewSparseTensorLookup(&lk, &X, 4);
+    spt_CheckError(result, "new lookup", NULL);
+
+    /* Every coordinate present, duplicates resolving to the first stored, and random probes */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        sptIndex const coords[] = { X.inds[0].data[z], X.inds[1].data[z], X.inds[2].data[z] };
+        if(sptSparseTensorLookupFind(&lk, coords) != spt_ScanFind(&X, coords)) {
+            printf("find of nonzero %lu\n", (unsigned long) z);
+            return 1;
+        }
+    }
+    for(int q = 0; q < 2000; ++q) {
+        sptIndex const coords[] = { rand() % ndims[0], rand() % ndims[1], rand() % ndims[2] };
+        if(sptSparseTensorLookupFind(&lk, coords) != spt_ScanFind(&X, coords)) {
+            printf("find of probe %d\n", q);
+            return 1;
+        }
+    }
+
+    /* Boxes, including empty ones and ones reaching past the mode sizes */
+    for(int q = 0; q < 200; ++q) {
+        sptIndex lo[3], hi[3];
+        for(sptIndex m = 0; m < 3; ++m) {
+            lo[m] = rand() % (ndims[m] + 2);
+            hi[m] = lo[m] + rand() % (ndims[m] / 2 + 1);
+        }
+        sptNnzIndexVector found;
+        sptNewNnzIndexVector(&found, 0, 0);
+        result = sptSparseTensorLookupRange(&found, &lk, lo, hi);
+        spt_CheckError(result, "range", NULL);
+        sptNnzIndex expect = 0;
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            sptIndex m = 0;
+            while(m < 3 && X.inds[m].data[z] >= lo[m] && X.inds[m].data[z] < hi[m]) {
+                ++m;
+            }
+            expect += m == 3;
+        }
+        if(found.len != expect) {
+            printf("range %d: %lu nonzeros, expected %lu\n", q, (unsigned long) found.len, (unsigned long) expect);
+            return 1;
+        }
+        for(sptNnzIndex k = 0; k < found.len; ++k) {
+            sptNnzIndex const z = found.data[k];
+            for(sptIndex m = 0; m < 3; ++m) {
+                if(X.inds[m].data[z] < lo[m] || X.inds[m].data[z] >= hi[m]) {
+                    printf("range %d: nonzero %lu outside\n", q, (unsigned long) z);
+                    return 1;
+                }
+            }
+            if(k > 0) {
+                sptNnzIndex const y = found.data[k-1];
+                int order = 0;
+                for(sptIndex m = 0; m < 3 && order == 0; ++m) {
+                    order = (X.inds[m].data[z] > X.inds[m].data[y]) - (X.inds[m].data[z] < X.inds[m].data[y]);
+                }
+                if(order < 0 || (order == 0 && z < y)) {
+                    printf("range %d: out of order at %lu\n", q, (unsigned long) k);
+                    return 1;
+                }
+            }
+        }
+        sptFreeNnzIndexVector(&found);
+    }
+
+    sptFreeSparseTensorLookup(&lk);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
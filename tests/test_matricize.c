@@ -0,0 +1,161 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+
+/* The parallel CSR matricization must hold the entries of the COO one, and the SpMM paths must match MTTKRP and TTM */
+int main(void) {
+    sptIndex const ndims[] = { 13, 6, 4 };
+    sptIndex const R = 5;
+    int result;
+    sptSparseTensor X;
+    result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 400; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+    }
+    X.nnz = 400;
+
+    sptMatrix * mats[4];
+    for(sptIndex m = 0; m <= 3; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < 3 ? ndims[m] : 13 * 6;
+        sptNewMatrix(mats[m], nrows, R);
+        sptRandomizeMatrix(mats[m], nrows, R);
+    }
+    sptIndex const stride = mats[0]->stride;
+    sptValue * ref = malloc((size_t) 13 * 6 * stride * sizeof *ref);
+
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        for(int transpose = 0; transpose <= 1; ++transpose) {
+            sptSparseMatrix coo;
+            sptSparseMatrixCSR csr;
+            result = sptMatricize(&X, mode, &coo, transpose);
+            spt_CheckError(result, "matricize", NULL);
+            result = sptMatricizeCSR(&X, mode, &csr, transpose, 3);
+            spt_CheckError(result, "matricize csr", NULL);
+            if(csr.nrows != coo.nrows || csr.ncols != coo.ncols || csr.nnz != X.nnz || csr.rowptr.data[csr.nrows] != X.nnz) {
+                printf("CSR shape mismatch: mode %"PARTI_PRI_INDEX", transpose %d\n", mode, transpose);
+                return 1;
+            }
+            /* Stable order by (row, column) keeps the COO order within equal coordinates */
+            char * used = calloc(X.nnz, sizeof *used);
+            for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+                sptIndex const row = coo.rowind.data[x];
+                sptNnzIndex p = csr.rowptr.data[row];
+                while(p < csr.rowptr.data[row+1] && (csr.colind.data[p] != coo.colind.data[x] || used[p])) {
+                    ++p;
+                }
+                if(p == csr.rowptr.data[row+1] || csr.values.data[p] != coo.values.data[x]) {
+                    printf("CSR entry missing: mode %"PARTI_PRI_INDEX", transpose %d\n", mode, transpose);
+                    return 1;
+                }
+                used[p] = 1;
+            }
+            for(sptIndex i = 0; i < csr.nrows; ++i) {
+                for(sptNnzIndex p = csr.rowptr.data[i] + 1; p < csr.rowptr.data[i+1]; ++p) {
+                    if(csr.colind.data[p-1] > csr.colind.data[p]) {
+                        printf("CSR columns unsorted: mode %"PARTI_PRI_INDEX", transpose %d\n", mode, transpose);
+                        return 1;
+                    }
+                }
+            }
+            free(used);
+
+            if(transpose == 1) {
+                sptIndex mats_order[3] = { mode, (mode+1) % 3, (mode+2) % 3 };
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref, mats[3]->values, (size_t) ndims[mode] * stride * sizeof *ref);
+                result = sptMTTKRPMatricized(&X, &csr, mats, mode, 3);
+                spt_CheckError(result, "matricized mttkrp", NULL);
+                for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue const a = ref[i * stride + r];
+                        sptValue const b = mats[3]->values[i * stride + r];
+                        if(fabs(a - b) > 1e-4 * (1 + fabs(a))) {
+                            printf("Matricized MTTKRP mismatch: mode %"PARTI_PRI_INDEX"\n", mode);
+                            return 1;
+                        }
+                    }
+                }
+
+                /* SpMV against the COO entries */
+                sptValueVector x, y;
+                sptNewValueVector(&x, csr.ncols, csr.ncols);
+                sptNewValueVector(&y, csr.nrows, csr.nrows);
+                for(sptIndex j = 0; j < csr.ncols; ++j) {
+                    x.data[j] = (sptValue) (j % 7) - 3;
+                }
+                result = sptSparseMatrixCSRSpMV(&y, &csr, &x, 3);
+                spt_CheckError(result, "spmv", NULL);
+                for(sptIndex i = 0; i < csr.nrows; ++i) {
+                    double sum = 0;
+                    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+                        if(coo.rowind.data[z] == i) {
+                            sum += coo.values.data[z] * x.data[coo.colind.data[z]];
+                        }
+                    }
+                    if(fabs(sum - y.data[i]) > 1e-4 * (1 + fabs(sum))) {
+                        printf("SpMV mismatch: mode %"PARTI_PRI_INDEX"\n", mode);
+                        return 1;
+                    }
+                }
+                sptFreeValueVector(&x);
+                sptFreeValueVector(&y);
+            } else {
+                /* TTM: row f of the product is the fiber f of X times mats[mode] */
+                result = sptSparseMatrixCSRSpMM(mats[3], &csr, mats[mode], 3);
+                spt_CheckError(result, "spmm ttm", NULL);
+                memset(ref, 0, (size_t) csr.nrows * stride * sizeof *ref);
+                for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        ref[coo.rowind.data[z] * stride + r] += coo.values.data[z] * mats[mode]->values[coo.colind.data[z] * stride + r];
+                    }
+                }
+                for(sptIndex i = 0; i < csr.nrows; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue const a = ref[i * stride + r];
+                        if(fabs(a - mats[3]->values[i * stride + r]) > 1e-4 * (1 + fabs(a))) {
+                            printf("Matricized TTM mismatch: mode %"PARTI_PRI_INDEX"\n", mode);
+                            return 1;
+                        }
+                    }
+                }
+            }
+            sptFreeSparseMatrix(&coo);
+            sptFreeSparseMatrixCSR(&csr);
+        }
+    }
+
+    for(sptIndex m = 0; m <= 3; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(ref);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/hicoo/hicoo.h"
+
+static int spt_Summed(sptMemoryEstimate const * est) {
+    return est->peak == est->tensor + est->factors + est->scratch + est->privatized;
+}
+
+int main(void) {
+    sptIndex const ndims[3] = { 200, 150, 100 };
+    sptIndex const rank = 16;
+    int const tk = 4;
+    /* The estimates below are of runs sharing the input layout, see test_cpd_layouts.c */
+    sptSetCpdLayoutBudget(0);
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 5000, SPT_GEN_UNIFORM, 0, 11, 1);
+    spt_CheckError(result, "generate", NULL);
+
+    /* Privatization costs memory, atomics none, and the parts add up */
+    sptMemoryEstimate atomic, reduce, locks;
+    result = sptEstimateCpdMemory(&atomic, &X, rank, tk, 0);
+    spt_CheckError(result, "estimate", NULL);
+    result = sptEstimateCpdMemory(&reduce, &X, rank, tk, 1);
+    spt_CheckError(result, "estimate", NULL);
+    result = sptEstimateCpdMemory(&locks, &X, rank, tk, 2);
+    spt_CheckError(result, "estimate", NULL);
+    size_t const full_copies = (size_t)tk * ndims[0] * 16 * sizeof(sptValue);
+    if(!spt_Summed(&atomic) || !spt_Summed(&reduce) || !spt_Summed(&locks) || atomic.privatized != 0 ||
+        reduce.privatized < full_copies || locks.privatized == 0 || atomic.tensor != reduce.tensor ||
+        atomic.tensor < X.nnz * (3 * sizeof(sptIndex) + sizeof(sptValue))) {
+        printf("CPD estimates: atomic %zu, reduce %zu, locks %zu\n", atomic.peak, reduce.peak, locks.peak);
+        return 1;
+    }
+
+    /* Below the bare run nothing fits; a budget between the two runs with fewer private rows */
+    sptKruskalTensor ktensor;
+    sptNewKruskalTensor(&ktensor, 3, ndims, rank);
+    if(sptOmpCpdAlsBudget(&X, rank, 2, 0, tk, atomic.peak - 1, &ktensor) == 0) {
+        printf("A budget below the estimate was accepted\n");
+        return 1;
+    }
+    size_t const budgets[] = { atomic.peak, (atomic.peak + reduce.peak) / 2, reduce.peak * 2 };
+    for(int b = 0; b < 3; ++b) {
+        sptKruskalTensor K;
+        sptNewKruskalTensor(&K, 3, ndims, rank);
+        result = sptOmpCpdAlsBudget(&X, rank, 3, 0, tk, budgets[b], &K);
+        spt_CheckError(result, "budget cpd als", NULL);
+        if(!(K.fit > -1e9) || K.fit != K.fit) {
+            printf("Budget %zu gave fit %f\n", budgets[b], K.fit);
+            return 1;
+        }
+        sptFreeKruskalTensor(&K);
+    }
+    sptFreeKruskalTensor(&ktensor);
+
+    /* The conversion estimate covers the tensor it builds */
+    sptSparseTensor Y;
+    sptCopySparseTensor(&Y, &X, 1);
+    sptMemoryEstimate conv;
+    result = sptEstimateHiCOOMemory(&conv, &Y, 3, 5, tk);
+    spt_CheckError(result, "estimate hicoo", NULL);
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &Y, 3, 5, tk);
+    spt_CheckError(result, "to hicoo", NULL);
+    size_t const hicoo_bytes = spt_SparseTensorHiCOOBytes(&H);
+    if(!spt_Summed(&conv) || conv.tensor < atomic.tensor + hicoo_bytes || conv.scratch == 0) {
+        printf("HiCOO conversion estimate %zu does not cover %zu bytes\n", conv.tensor, hicoo_bytes);
+        return 1;
+    }
+
+    sptMemoryEstimate hi;
+    result = sptEstimateCpdMemoryHiCOO(&hi, &H, rank, tk);
+    spt_CheckError(result, "estimate hicoo cpd", NULL);
+    if(!spt_Summed(&hi) || hi.tensor != hicoo_bytes) {
+        printf("HiCOO CPD estimate %zu\n", hi.peak);
+        return 1;
+    }
+    sptRankKruskalTensor hk;
+    sptNewRankKruskalTensor(&hk, 3, ndims, rank);
+    if(sptOmpCpdAlsHiCOOBudget(&H, rank, 2, 0, tk, hi.peak - hi.privatized - 1, &hk) == 0) {
+        printf("A HiCOO budget below the estimate was accepted\n");
+        return 1;
+    }
+    result = sptOmpCpdAlsHiCOOBudget(&H, rank, 2, 0, tk, hi.peak - hi.privatized, &hk);
+    spt_CheckError(result, "budget hicoo cpd als", NULL);
+    sptFreeRankKruskalTensor(&hk);
+
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Owner-partitioned and hot-row MTTKRP must match the sequential one, including heavy rows split between threads */
+int main(void) {
+    sptIndex const ndims[] = { 40, 17, 9, 30 };
+    sptIndex const R = 7;
+    for(sptIndex nmodes = 2; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 5000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                /* Half of the nonzeros fall into index 0 of every mode */
+                sptIndex const i = rand() % 2 == 0 ? 0 : (sptIndex) (rand() % ndims[m]);
+                sptAppendIndexVector(&X.inds[m], i);
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = 5000;
+
+        sptIndex max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptValue * ref = malloc((size_t)max_dim * mats[0]->stride * sizeof *ref);
+
+        int const tks[] = { 1, 3, 7 };
+        for(int k = 0; k < 3; ++k) {
+            sptMttkrpRowPartition part;
+            result = sptNewMttkrpRowPartition(&part, &X, R, tks[k]);
+            spt_CheckError(result, "new row partition", NULL);
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * mats[0]->stride * sizeof *ref);
+                /* Entries may cancel to near zero, so bound the rounding by the largest one */
+                double scale = 0;
+                for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        scale = fmax(scale, fabs(ref[i * mats[0]->stride + r]));
+                    }
+                }
+
+                result = sptOmpMTTKRP_Owner(&X, mats, mats_order, mode, &part);
+                spt_CheckError(result, "owner mttkrp", NULL);
+                for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                    for(sptIndex r = 0; r < R; ++r) {
+                        sptValue const a = ref[i * mats[0]->stride + r];
+                        sptValue const b = mats[nmodes]->values[i * mats[0]->stride + r];
+                        if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                            printf("Owner MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", tk %d\n", nmodes, mode, tks[k]);
+                            return 1;
+                        }
+                    }
+                }
+            }
+            sptFreeMttkrpRowPartition(&part);
+
+            /* A budget of a few rows leaves most of every mode to atomics */
+            size_t const budgets[] = { (size_t)tks[k] * mats[0]->stride * sizeof (sptValue) * 3, 1 << 30 };
+            for(int b = 0; b < 2; ++b) {
+                sptMttkrpHotRows hot;
+                result = sptNewMttkrpHotRows(&hot, &X, R, tks[k], budgets[b]);
+                spt_CheckError(result, "new hot rows", NULL);
+                for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                    if(hot.nhot[mode] != (b == 0 ? 3 : X.ndims[mode]) || hot.rows[mode].data[0] != 0) {
+                        printf("Hot rows: mode %"PARTI_PRI_INDEX" has %"PARTI_PRI_INDEX" private rows\n", mode, hot.nhot[mode]);
+                        return 1;
+                    }
+                    mats_order[0] = mode;
+                    for(sptIndex i = 1; i < nmodes; ++i) {
+                        mats_order[i] = (mode+i) % nmodes;
+                    }
+                    sptMTTKRP(&X, mats, mats_order, mode);
+                    memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * mats[0]->stride * sizeof *ref);
+                    double scale = 0;
+                    for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                        for(sptIndex r = 0; r < R; ++r) {
+                            scale = fmax(scale, fabs(ref[i * mats[0]->stride + r]));
+                        }
+                    }
+
+                    result = sptOmpMTTKRP_HotRows(&X, mats, mats_order, mode, &hot);
+                    spt_CheckError(result, "hot row mttkrp", NULL);
+                    for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                        for(sptIndex r = 0; r < R; ++r) {
+                            sptValue const a = ref[i * mats[0]->stride + r];
+                            sptValue const v = mats[nmodes]->values[i * mats[0]->stride + r];
+                            if(fabs(a - v) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                                printf("Hot row MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", tk %d\n", nmodes, mode, tks[k]);
+                                return 1;
+                            }
+                        }
+                    }
+                }
+                sptFreeMttkrpHotRows(&hot);
+            }
+        }
+
+        free(ref);
+        free(mats_order);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
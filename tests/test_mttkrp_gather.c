@@ -0,0 +1,122 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Rounding grows with the terms summed, and an entry may cancel to near zero, so the bound follows the largest entry */
+static int spt_Compare(sptValue const * ref, sptValue const * out, sptIndex stride, sptIndex nrows, sptIndex R) {
+    double scale = 0;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            scale = fmax(scale, fabs(ref[i * stride + r]));
+        }
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue const a = ref[i * stride + r];
+            sptValue const b = out[i * stride + r];
+            if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The two-stage gather MTTKRP, and the OpenMP MTTKRP with and without prefetching, must match the sequential one */
+int main(void) {
+    sptIndex const ndims[] = { 40, 900, 25, 60 };
+    sptIndex const ranks[] = { 8, 16, 13 };
+    sptIndex const distances[] = { 0, 1, 8, 5000 };
+    /* More nonzeros than a gather batch, and a count that is not a multiple of it */
+    sptNnzIndex const nnz = 3001;
+    if(sptSetMTTKRPPrefetchDistance(1u << 24) == 0) {
+        printf("An absurd prefetch distance was accepted\n");
+        return 1;
+    }
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = nnz;
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        for(int t = 0; t < 3; ++t) {
+            sptIndex const R = ranks[t];
+            sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+                mats[m] = malloc(sizeof *mats[m]);
+                sptNewMatrix(mats[m], nrows, R);
+                sptRandomizeMatrix(mats[m], nrows, R);
+            }
+            sptIndex const stride = mats[0]->stride;
+            sptValue * ref = malloc((size_t)max_dim * stride * sizeof *ref);
+
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+
+                for(int d = 0; d < 4; ++d) {
+                    result = sptSetMTTKRPPrefetchDistance(distances[d]);
+                    spt_CheckError(result, "prefetch distance", NULL);
+
+                    result = sptOmpMTTKRP(&X, mats, mats_order, mode, 3);
+                    spt_CheckError(result, "omp mttkrp", NULL);
+                    if(spt_Compare(ref, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                        printf("OpenMP MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX", distance %"PARTI_PRI_INDEX"\n", nmodes, mode, R, distances[d]);
+                        return 1;
+                    }
+
+                    result = sptOmpMTTKRP_Gather(&X, mats, mats_order, mode, 3);
+                    spt_CheckError(result, "gather mttkrp", NULL);
+                    if(spt_Compare(ref, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                        printf("Gather MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX", distance %"PARTI_PRI_INDEX"\n", nmodes, mode, R, distances[d]);
+                        return 1;
+                    }
+                }
+            }
+
+            free(ref);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptFreeMatrix(mats[m]);
+                free(mats[m]);
+            }
+            free(mats);
+        }
+        free(mats_order);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
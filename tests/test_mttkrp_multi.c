@@ -0,0 +1,169 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+#define NMODES 4
+#define RANK 10
+
+/* outs[k] against the single-mode MTTKRP of modes[k] */
+static int CheckOutputs(sptSparseTensor const * X, sptMatrix ** mats, sptIndex nout, sptIndex const * modes, sptMatrix ** outs, char const * what) {
+    sptIndex const stride = mats[0]->stride;
+    for(sptIndex k = 0; k < nout; ++k) {
+        sptIndex const mode = modes[k];
+        sptIndex mats_order[NMODES];
+        for(sptIndex i = 0; i < NMODES; ++i) {
+            mats_order[i] = (mode + i) % NMODES;
+        }
+        sptMTTKRP(X, mats, mats_order, mode);
+        /* Entries may cancel to near zero, so the rounding is bounded by the largest one */
+        double scale = 0;
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < RANK; ++r) {
+                scale = fmax(scale, fabs(mats[NMODES]->values[i * stride + r]));
+            }
+        }
+        for(sptIndex i = 0; i < X->ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < RANK; ++r) {
+                sptValue const a = mats[NMODES]->values[i * stride + r];
+                sptValue const b = outs[k]->values[i * stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    printf("%s: mode %"PARTI_PRI_INDEX" differs at row %"PARTI_PRI_INDEX"\n", what, mode, i);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* The single-pass MTTKRP of any set of modes matches one MTTKRP per mode, on COO and HiCOO */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 70, 50, 90, 40 };
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, NMODES, ndims);
+    srand(11);
+    for(sptNnzIndex n = 0; n < 6000; ++n) {
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        ++X.nnz;
+    }
+    sptSparseTensorSortIndex(&X, 1);
+
+    sptMatrix * mats[NMODES + 1];
+    sptMatrix * outs[NMODES];
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < NMODES ? ndims[m] : 90;
+        sptNewMatrix(mats[m], nrows, RANK);
+        sptRandomizeMatrix(mats[m], nrows, RANK);
+        if(m < NMODES) {
+            outs[m] = malloc(sizeof *outs[m]);
+            sptNewMatrix(outs[m], nrows, RANK);
+        }
+    }
+
+    sptIndex const all[NMODES] = { 0, 1, 2, 3 };
+    sptIndex const some[2] = { 2, 0 };
+    sptIndex const last[1] = { 3 };
+    sptMatrix * some_outs[2] = { outs[2], outs[0] };
+    sptMatrix * last_outs[1] = { outs[3] };
+    int const tks[] = { 1, 3 };
+    for(int t = 0; t < 2; ++t) {
+        int result = sptOmpMTTKRPMulti(&X, mats, NMODES, all, outs, tks[t]);
+        spt_CheckError(result, "multi", NULL);
+        if(CheckOutputs(&X, mats, NMODES, all, outs, "COO all modes") != 0) {
+            return 1;
+        }
+        sptOmpMTTKRPMulti(&X, mats, 2, some, some_outs, tks[t]);
+        if(CheckOutputs(&X, mats, 2, some, some_outs, "COO two modes") != 0) {
+            return 1;
+        }
+        sptOmpMTTKRPMulti(&X, mats, 1, last, last_outs, tks[t]);
+        if(CheckOutputs(&X, mats, 1, last, last_outs, "COO last mode") != 0) {
+            return 1;
+        }
+    }
+    sptIndex const twice[2] = { 1, 1 };
+    if(sptOmpMTTKRPMulti(&X, mats, 2, twice, outs, 1) == 0) {
+        printf("accepted a mode twice\n");
+        return 1;
+    }
+
+    sptSparseTensorHiCOO hitsr;
+    sptNnzIndex max_nnzb;
+    int result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X, 3, 5, 1);
+    spt_CheckError(result, "hicoo", NULL);
+    for(int t = 0; t < 2; ++t) {
+        result = sptOmpMTTKRPHiCOOMulti(&hitsr, mats, NMODES, all, outs, tks[t]);
+        spt_CheckError(result, "hicoo multi", NULL);
+        if(CheckOutputs(&X, mats, NMODES, all, outs, "HiCOO all modes") != 0) {
+            return 1;
+        }
+        sptOmpMTTKRPHiCOOMulti(&hitsr, mats, 2, some, some_outs, tks[t]);
+        if(CheckOutputs(&X, mats, 2, some, some_outs, "HiCOO two modes") != 0) {
+            return 1;
+        }
+    }
+    sptFreeSparseTensorHiCOO(&hitsr);
+
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+        if(m < NMODES) {
+            sptFreeMatrix(outs[m]);
+            free(outs[m]);
+        }
+    }
+
+    /* Jacobi ALS on the same tensor returns the fit of the factors it returns */
+    sptKruskalTensor ktensor;
+    sptNewKruskalTensor(&ktensor, NMODES, ndims, 4);
+    result = sptOmpCpdAlsJacobi(&X, 4, 8, 1e-9, 2, &ktensor);
+    spt_CheckError(result, "jacobi", NULL);
+    double const fit = ktensor.fit;
+    sptMatrix * ata[NMODES + 1];
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        ata[m] = malloc(sizeof *ata[m]);
+        sptNewMatrix(ata[m], 4, 4);
+        if(m < NMODES) {
+            sptOmpMatrixGram(ktensor.factors[m], ata[m], 1);
+        }
+    }
+    sptIndex const last_order[NMODES] = { 3, 0, 1, 2 };
+    sptMTTKRP(&X, ktensor.factors, last_order, 3);
+    double const check = sptKruskalTensorFit(&X, ktensor.lambda, ktensor.factors, ata);
+    if(!isfinite(fit) || fabs(fit - check) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("Jacobi fit %g, recomputed %g\n", fit, check);
+        return 1;
+    }
+    for(sptIndex m = 0; m <= NMODES; ++m) {
+        sptFreeMatrix(ata[m]);
+        free(ata[m]);
+    }
+    sptFreeKruskalTensor(&ktensor);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
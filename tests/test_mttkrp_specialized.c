@@ -0,0 +1,125 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_Compare(sptValue const * ref, sptIndex ref_stride, sptValue const * out, sptIndex out_stride, sptIndex nrows, sptIndex R) {
+    /* Entries may cancel to near zero, so the rounding is bounded by the largest one */
+    double scale = 0;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            scale = fmax(scale, fabs(ref[i * ref_stride + r]));
+        }
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue const a = ref[i * ref_stride + r];
+            sptValue const b = out[i * out_stride + r];
+            if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The rank-specialized COO and HiCOO OpenMP MTTKRP must match the sequential one, as must the generic fallback */
+int main(void) {
+    sptIndex const ndims[] = { 50, 33, 70, 21 };
+    sptIndex const ranks[] = { 8, 16, 32, 64, 128, 12 };
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 2000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = 2000;
+
+        sptSparseTensorHiCOO hitsr;
+        sptNnzIndex max_nnzb = 0;
+        result = sptSparseTensorToHiCOO(&hitsr, &max_nnzb, &X, 3, 5, 1);
+        spt_CheckError(result, "to hicoo", NULL);
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        for(int t = 0; t < 6; ++t) {
+            sptIndex const R = ranks[t];
+            sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+            sptRankMatrix ** rank_mats = malloc((nmodes+1) * sizeof *rank_mats);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+                mats[m] = malloc(sizeof *mats[m]);
+                sptNewMatrix(mats[m], nrows, R);
+                sptRandomizeMatrix(mats[m], nrows, R);
+                rank_mats[m] = malloc(sizeof *rank_mats[m]);
+                sptNewRankMatrix(rank_mats[m], nrows, (sptElementIndex) R);
+                for(sptIndex i = 0; i < nrows; ++i) {
+                    memcpy(rank_mats[m]->values + (size_t)i * rank_mats[m]->stride, mats[m]->values + (size_t)i * mats[m]->stride, R * sizeof(sptValue));
+                }
+            }
+            sptIndex const stride = mats[0]->stride;
+            sptValue * ref = malloc((size_t)max_dim * stride * sizeof *ref);
+
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+
+                result = sptOmpMTTKRP(&X, mats, mats_order, mode, 2);
+                spt_CheckError(result, "omp mttkrp", NULL);
+                if(spt_Compare(ref, stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                    printf("COO MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX"\n", nmodes, mode, R);
+                    return 1;
+                }
+
+                result = sptOmpMTTKRPHiCOO_MatrixTiling(&hitsr, rank_mats, mats_order, mode, 2);
+                spt_CheckError(result, "hicoo mttkrp", NULL);
+                if(spt_Compare(ref, stride, rank_mats[nmodes]->values, rank_mats[0]->stride, X.ndims[mode], R)) {
+                    printf("HiCOO MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX"\n", nmodes, mode, R);
+                    return 1;
+                }
+            }
+
+            free(ref);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptFreeMatrix(mats[m]);
+                free(mats[m]);
+                sptFreeRankMatrix(rank_mats[m]);
+                free(rank_mats[m]);
+            }
+            free(mats);
+            free(rank_mats);
+        }
+        free(mats_order);
+        sptFreeSparseTensorHiCOO(&hitsr);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+/* Rounding grows with the terms summed, and an entry may cancel to near zero, so the bound follows the largest entry */
+static int spt_Compare(sptValue const * ref, sptValue const * out, sptIndex stride, sptIndex nrows, sptIndex R) {
+    double scale = 0;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            scale = fmax(scale, fabs(ref[i * stride + r]));
+        }
+    }
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex r = 0; r < R; ++r) {
+            sptValue const a = ref[i * stride + r];
+            sptValue const b = out[i * stride + r];
+            if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The tiled MTTKRP must match the sequential one for any tile size, called directly and through a workspace */
+int main(void) {
+    sptIndex const ndims[] = { 40, 900, 25, 60 };
+    sptIndex const ranks[] = { 8, 16, 13 };
+    /* 0 picks the tile size; 1 makes nearly every nonzero its own tile, 12 makes one tile */
+    sptElementIndex const bits[] = { 0, 1, 3, 6, 12 };
+    sptNnzIndex const nnz = 3001;
+    for(sptIndex nmodes = 3; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < nnz; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+        }
+        X.nnz = nnz;
+
+        sptIndex const max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        for(int t = 0; t < 3; ++t) {
+            sptIndex const R = ranks[t];
+            sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+                mats[m] = malloc(sizeof *mats[m]);
+                sptNewMatrix(mats[m], nrows, R);
+                sptRandomizeMatrix(mats[m], nrows, R);
+            }
+            sptIndex const stride = mats[0]->stride;
+            sptValue * ref = malloc((size_t)nmodes * max_dim * stride * sizeof *ref);
+
+            /* The references, before the tilings reorder X */
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                mats_order[0] = mode;
+                for(sptIndex i = 1; i < nmodes; ++i) {
+                    mats_order[i] = (mode+i) % nmodes;
+                }
+                sptMTTKRP(&X, mats, mats_order, mode);
+                memcpy(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, (size_t)X.ndims[mode] * stride * sizeof *ref);
+            }
+
+            for(int b = 0; b < 5; ++b) {
+                sptMttkrpTiling tl;
+                result = sptNewMttkrpTiling(&tl, &X, R, bits[b], 3);
+                spt_CheckError(result, "tiling", NULL);
+                for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                    mats_order[0] = mode;
+                    for(sptIndex i = 1; i < nmodes; ++i) {
+                        mats_order[i] = (mode+i) % nmodes;
+                    }
+                    result = sptOmpMTTKRP_Tiled(&X, mats, mats_order, mode, &tl, 3);
+                    spt_CheckError(result, "tiled mttkrp", NULL);
+                    if(spt_Compare(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                        printf("Tiled MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX", tile bits %d\n", nmodes, mode, R, (int) tl.tile_bits);
+                        return 1;
+                    }
+                }
+                sptFreeMttkrpTiling(&tl);
+            }
+
+            sptCpdWorkspace ws;
+            result = sptNewCpdWorkspace(&ws, nmodes, X.ndims, R, 3, 1);
+            spt_CheckError(result, "workspace", NULL);
+            result = sptCpdWorkspaceUseTiling(&ws, &X, 0);
+            spt_CheckError(result, "workspace tiling", NULL);
+            for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                result = sptOmpMTTKRPWorkspace(&X, mats, mode, &ws);
+                spt_CheckError(result, "workspace mttkrp", NULL);
+                if(spt_Compare(ref + (size_t)mode * max_dim * stride, mats[nmodes]->values, stride, X.ndims[mode], R)) {
+                    printf("Workspace tiled MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX", R %"PARTI_PRI_INDEX"\n", nmodes, mode, R);
+                    return 1;
+                }
+            }
+            sptFreeCpdWorkspace(&ws);
+
+            free(ref);
+            for(sptIndex m = 0; m <= nmodes; ++m) {
+                sptFreeMatrix(mats[m]);
+                free(mats[m]);
+            }
+            free(mats);
+        }
+        free(mats_order);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
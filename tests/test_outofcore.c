@@ -0,0 +1,122 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "../src/error/error.h"
+
+/* Out-of-core factor matrices give the same MTTKRP as matrices in memory */
+int main(void) {
+    sptIndex const ndims[] = { 5000, 300, 70 };
+    sptIndex const R = 10;
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 40000, SPT_GEN_POWERLAW, 1.0, 7, 2);
+    spt_CheckError(result, "generate", NULL);
+
+    char path[] = "/tmp/parti_test_outofcore_XXXXXX";
+    int fd = mkstemp(path);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+
+    sptMatrix * mem[4], * ooc[4];
+    for(sptIndex m = 0; m < 3; ++m) {
+        mem[m] = malloc(sizeof *mem[m]);
+        ooc[m] = malloc(sizeof *ooc[m]);
+        sptNewMatrix(mem[m], ndims[m], R);
+        result = sptNewMatrixOutOfCore(ooc[m], ndims[m], R, m == 0 ? path : NULL);
+        spt_CheckError(result, "new out-of-core matrix", NULL);
+        if(sptMemBackingOf(ooc[m]->values) != SPT_MEM_FILE) {
+            printf("Out-of-core matrix is not file-backed\n");
+            return 1;
+        }
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                mem[m]->values[i * mem[m]->stride + r] = ooc[m]->values[i * ooc[m]->stride + r] = (sptValue) ((i * 5 + r * 3 + m) % 13) / 13;
+            }
+        }
+    }
+    mem[3] = malloc(sizeof *mem[3]);
+    ooc[3] = malloc(sizeof *ooc[3]);
+
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        sptIndex mats_order[3];
+        for(sptIndex i = 0; i < 3; ++i) {
+            mats_order[i] = (mode + i) % 3;
+        }
+        sptNewMatrix(mem[3], ndims[mode], R);
+        sptNewMatrixOutOfCore(ooc[3], ndims[mode], R, NULL);
+        result = sptOmpMTTKRPOutOfCore(&X, ooc, mats_order, mode, 16, 2);
+        if(mode != 0 && result == 0) {
+            printf("Unsorted tensor accepted at mode %"PARTI_PRI_INDEX "\n", mode);
+            return 1;
+        }
+        sptSparseTensorSortIndexCustomOrder(&X, mats_order, 1);
+        result = sptOmpMTTKRPOutOfCore(&X, ooc, mats_order, mode, 16, 2);
+        spt_CheckError(result, "out-of-core mttkrp", NULL);
+        result = sptOmpMTTKRP(&X, mem, mats_order, mode, 2);
+        spt_CheckError(result, "mttkrp", NULL);
+        /* Evicted rows read back from the file */
+        result = sptMatrixEvictRows(ooc[3], 0, ndims[mode]);
+        spt_CheckError(result, "evict", NULL);
+        /* The two sum in their own orders; bound the rounding by the largest entry, as one may cancel */
+        double scale = 0;
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                scale = fmax(scale, fabs(mem[3]->values[i * mem[3]->stride + r]));
+            }
+        }
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            for(sptIndex r = 0; r < R; ++r) {
+                sptValue const a = mem[3]->values[i * mem[3]->stride + r];
+                sptValue const b = ooc[3]->values[i * ooc[3]->stride + r];
+                if(fabs(a - b) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    printf("Mode %"PARTI_PRI_INDEX " row %"PARTI_PRI_INDEX " differs: %g vs %g\n", mode, i, a, b);
+                    return 1;
+                }
+            }
+        }
+        sptFreeMatrix(mem[3]);
+        sptFreeMatrix(ooc[3]);
+    }
+
+    /* A named backing file keeps the values once the matrix is released */
+    sptIndex const stride = ooc[0]->stride;
+    sptFreeMatrix(ooc[0]);
+    struct stat st;
+    if(stat(path, &st) != 0 || (size_t) st.st_size < (size_t) ndims[0] * stride * sizeof (sptValue)) {
+        printf("Backing file missing or short\n");
+        return 1;
+    }
+    unlink(path);
+
+    for(sptIndex m = 0; m < 3; ++m) {
+        sptFreeMatrix(mem[m]);
+        if(m != 0) sptFreeMatrix(ooc[m]);
+        free(mem[m]);
+        free(ooc[m]);
+    }
+    free(mem[3]);
+    free(ooc[3]);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,180 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_CompareSparseTensors(const sptSparseTensor *a, const sptSparseTensor *b) {
+    if(a->nmodes != b->nmodes || a->nnz != b->nnz) {
+        return 1;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(a->ndims[m] != b->ndims[m] || a->sortorder[m] != b->sortorder[m]) {
+            return 1;
+        }
+        if(memcmp(a->inds[m].data, b->inds[m].data, a->nnz * sizeof (sptIndex)) != 0) {
+            return 1;
+        }
+    }
+    return memcmp(a->values.data, b->values.data, a->nnz * sizeof (sptValue)) != 0;
+}
+
+/* Packed tensors must decode, reload, multiply and stream exactly like their COO source */
+int main(void) {
+    sptIndex const ndims[] = { 300, 2000000000, 70 };
+    sptIndex const R = 6;
+    sptSparseTensor X;
+    /* Mode 1 spans nearly all of sptIndex, so its deltas need the widest words */
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 5000, SPT_GEN_POWERLAW, 1.5, 42, 2);
+    spt_CheckError(result, "generate", NULL);
+    sptSparseTensorSortIndex(&X, 1);
+    X.inds[1].data[17] = ndims[1] - 1;
+    X.inds[1].data[18] = 0;
+
+    sptPackedSparseTensor P;
+    result = sptNewPackedSparseTensor(&P, &X, 3);
+    spt_CheckError(result, "pack", NULL);
+    if(P.offsets[P.nblocks] * sizeof (uint64_t) >= X.nnz * X.nmodes * sizeof (sptIndex)) {
+        printf("Packed indices not smaller\n");
+        return 1;
+    }
+    sptSparseTensor Y;
+    result = sptUnpackSparseTensor(&Y, &P, 2);
+    spt_CheckError(result, "unpack", NULL);
+    if(spt_CompareSparseTensors(&X, &Y) != 0) {
+        printf("Unpack mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Y);
+
+    char filename[] = "/tmp/parti_test_packed_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+    FILE *stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpPackedSparseTensor(&P, stream);
+    spt_CheckError(result, "dump packed", NULL);
+    fclose(stream);
+    sptPackedSparseTensor Q;
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptLoadPackedSparseTensor(&Q, stream);
+    spt_CheckError(result, "load packed", NULL);
+    fclose(stream);
+    result = sptUnpackSparseTensor(&Y, &Q, 1);
+    spt_CheckError(result, "unpack", NULL);
+    if(spt_CompareSparseTensors(&X, &Y) != 0) {
+        printf("Reloaded packed tensor mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Y);
+
+    sptMatrix ** mats = malloc(4 * sizeof *mats);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < 3 ? (m == 1 ? 1 : ndims[m]) : 300;
+        sptNewMatrix(mats[m], nrows, R);
+        sptRandomizeMatrix(mats[m], nrows, R);
+    }
+    /* A tall factor for mode 1 would be 96 GB, so compare modes 0 and 2 on a tensor squeezed in mode 1 */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        X.inds[1].data[z] = 0;
+    }
+    X.ndims[1] = 1;
+    sptFreePackedSparseTensor(&Q);
+    result = sptNewPackedSparseTensor(&Q, &X, 2);
+    spt_CheckError(result, "pack", NULL);
+    sptValue * ref = malloc((size_t) 300 * mats[0]->stride * sizeof *ref);
+    sptIndex const modes[] = { 0, 2 };
+    for(int k = 0; k < 2; ++k) {
+        sptIndex const mode = modes[k];
+        sptIndex mats_order[3];
+        for(sptIndex i = 0; i < 3; ++i) {
+            mats_order[i] = (mode + i) % 3;
+        }
+        sptNnzIndex const len = (sptNnzIndex) ndims[mode] * mats[0]->stride;
+        sptMTTKRP(&X, mats, mats_order, mode);
+        memcpy(ref, mats[3]->values, len * sizeof *ref);
+        /* Rounding follows the largest entry, not each one, which may cancel to near zero */
+        double scale = 0;
+        for(sptNnzIndex i = 0; i < len; ++i) {
+            scale = fmax(scale, fabs(ref[i]));
+        }
+        result = sptOmpMTTKRPPacked(&Q, mats, mats_order, mode, 3);
+        spt_CheckError(result, "packed mttkrp", NULL);
+        for(sptNnzIndex i = 0; i < len; ++i) {
+            if(fabs(mats[3]->values[i] - ref[i]) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                printf("Packed MTTKRP mismatch at mode %"PARTI_PRI_INDEX"\n", mode);
+                return 1;
+            }
+        }
+    }
+    free(ref);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+
+    /* Streaming CPD must take packed files in shards that split blocks' worth of nonzeros */
+    sptSparseTensor S;
+    sptIndex const sdims[] = { 30, 20, 10 };
+    result = sptGenerateSparseTensor(&S, 3, sdims, 2000, SPT_GEN_UNIFORM, 0, 7, 1);
+    spt_CheckError(result, "generate", NULL);
+    sptSparseTensorSortIndex(&S, 1);
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensorBinary(&S, stream);
+    spt_CheckError(result, "dump binary", NULL);
+    fclose(stream);
+    sptKruskalTensor kcoo, kpacked;
+    sptSetRandomSeed(5);
+    result = sptCpdAlsStream(filename, 4, 5, 0, 300, 2, &kcoo);
+    spt_CheckError(result, "stream cpd", NULL);
+    sptPackedSparseTensor PS;
+    result = sptNewPackedSparseTensor(&PS, &S, 1);
+    spt_CheckError(result, "pack", NULL);
+    stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpPackedSparseTensor(&PS, stream);
+    spt_CheckError(result, "dump packed", NULL);
+    fclose(stream);
+    sptSetRandomSeed(5);
+    result = sptCpdAlsStream(filename, 4, 5, 0, 300, 2, &kpacked);
+    spt_CheckError(result, "stream packed cpd", NULL);
+    if(fabs(kcoo.fit - kpacked.fit) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("Packed streaming fit %g differs from %g\n", kpacked.fit, kcoo.fit);
+        return 1;
+    }
+    sptFreeKruskalTensor(&kpacked);
+    sptFreeKruskalTensor(&kcoo);
+    sptFreePackedSparseTensor(&PS);
+    sptFreeSparseTensor(&S);
+
+    unlink(filename);
+    sptFreePackedSparseTensor(&Q);
+    sptFreePackedSparseTensor(&P);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_CompareRows(sptValue const *a, sptValue const *b, sptNnzIndex const n) {
+    for(sptNnzIndex i = 0; i < n; ++i) {
+        if(fabs(a[i] - b[i]) > 1e-4 * (1 + fabs(a[i]))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Pattern tensors must give what the same tensor with values of 1 gives */
+int main(void) {
+    sptIndex const ndims[] = { 40, 17, 9, 30 };
+    sptIndex const R = 7;
+    for(sptIndex nmodes = 2; nmodes <= 4; ++nmodes) {
+        sptSparseTensor X, P;
+        int result = sptNewSparseTensor(&X, nmodes, ndims);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex z = 0; z < 3000; ++z) {
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, 1);
+        }
+        X.nnz = 3000;
+
+        X.values.data[7] = 2;
+        sptCopySparseTensor(&P, &X, 1);
+        if(sptSparseTensorDropValues(&P) == 0 || sptSparseTensorIsPattern(&P)) {
+            printf("Values other than 1 dropped\n");
+            return 1;
+        }
+        sptFreeSparseTensor(&P);
+        X.values.data[7] = 1;
+        sptCopySparseTensor(&P, &X, 1);
+        result = sptSparseTensorDropValues(&P);
+        spt_CheckError(result, "drop values", NULL);
+        if(!sptSparseTensorIsPattern(&P) || sptSparseTensorIsPattern(&X)) {
+            printf("Pattern flag mismatch\n");
+            return 1;
+        }
+        if(SparseTensorFrobeniusNormSquared(&P) != X.nnz || sptSparseTensorFingerprint(&P) != sptSparseTensorFingerprint(&X)) {
+            printf("Pattern norm or fingerprint mismatch\n");
+            return 1;
+        }
+
+        sptIndex max_dim = sptMaxIndexArray(X.ndims, nmodes);
+        sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? X.ndims[m] : max_dim;
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptIndex * mats_order = malloc(nmodes * sizeof *mats_order);
+        sptValue * ref = malloc((size_t)max_dim * mats[0]->stride * sizeof *ref);
+
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            mats_order[0] = mode;
+            for(sptIndex i = 1; i < nmodes; ++i) {
+                mats_order[i] = (mode+i) % nmodes;
+            }
+            sptNnzIndex const len = (sptNnzIndex) X.ndims[mode] * mats[0]->stride;
+            sptMTTKRP(&X, mats, mats_order, mode);
+            memcpy(ref, mats[nmodes]->values, len * sizeof *ref);
+            sptMTTKRP(&P, mats, mats_order, mode);
+            if(spt_CompareRows(ref, mats[nmodes]->values, len) != 0) {
+                printf("Pattern MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                return 1;
+            }
+            result = sptOmpMTTKRP(&P, mats, mats_order, mode, 3);
+            spt_CheckError(result, "omp mttkrp", NULL);
+            if(spt_CompareRows(ref, mats[nmodes]->values, len) != 0) {
+                printf("Pattern OMP MTTKRP mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                return 1;
+            }
+
+            sptSemiSparseTensor YX, YP;
+            sptMatrix U;
+            sptNewMatrix(&U, X.ndims[mode], R);
+            sptRandomizeMatrix(&U, X.ndims[mode], R);
+            result = sptSparseTensorMulMatrix(&YX, &X, &U, mode);
+            spt_CheckError(result, "ttm", NULL);
+            result = sptOmpSparseTensorMulMatrix(&YP, &P, &U, mode);
+            spt_CheckError(result, "omp ttm", NULL);
+            if(YX.nnz != YP.nnz || spt_CompareRows(YX.values.values, YP.values.values, YX.nnz * YX.stride) != 0) {
+                printf("Pattern TTM mismatch: nmodes %"PARTI_PRI_INDEX", mode %"PARTI_PRI_INDEX"\n", nmodes, mode);
+                return 1;
+            }
+            sptFreeSemiSparseTensor(&YP);
+            sptFreeSemiSparseTensor(&YX);
+            sptFreeMatrix(&U);
+        }
+
+        result = sptSparseTensorRestoreValues(&P);
+        spt_CheckError(result, "restore values", NULL);
+        if(sptSparseTensorIsPattern(&P) || sptSparseTensorFingerprint(&P) != sptSparseTensorFingerprint(&X)) {
+            printf("Restored values mismatch\n");
+            return 1;
+        }
+
+        free(ref);
+        free(mats_order);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeSparseTensor(&P);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 40
+#define J 30
+#define K 20
+#define L 10
+
+/* Value of the nonzero at new coordinates c, looked up at the old ones */
+static sptValue OldValue(sptValue const *dense, sptIndex const perm[], sptIndex const c[]) {
+    sptIndex old[4];
+    for(sptIndex m = 0; m < 4; ++m) {
+        old[perm[m]] = c[m];
+    }
+    return dense[((old[0] * J + old[1]) * K + old[2]) * L + old[3]];
+}
+
+/* Permuting the modes keeps every nonzero, sorts in the new order on request, and renames HiCOO in place */
+int main(void) {
+    sptIndex const ndims[] = { I, J, K, L };
+    sptIndex const perm[] = { 2, 0, 3, 1 };
+    static sptValue dense[I * J * K * L];
+    sptSparseTensor X, Z;
+    int result = sptNewSparseTensor(&X, 4, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(11);
+    for(int n = 0; n < 20000; ++n) {
+        sptIndex const c[] = { rand() % I, rand() % J, rand() % K, rand() % L };
+        sptValue * const v = &dense[((c[0] * J + c[1]) * K + c[2]) * L + c[3]];
+        if(*v != 0) {
+            continue;
+        }
+        *v = (sptValue) (n + 1);
+        for(sptIndex m = 0; m < 4; ++m) {
+            sptAppendIndexVector(&X.inds[m], c[m]);
+        }
+        sptAppendValueVector(&X.values, *v);
+        ++X.nnz;
+    }
+    sptCopySparseTensor(&Z, &X, 1);
+    sptNnzIndex const nnz = X.nnz;
+
+    result = sptSparseTensorPermuteModes(&X, perm, 1, 0);
+    spt_CheckError(result, "permute", NULL);
+    for(sptIndex m = 0; m < 4; ++m) {
+        if(X.ndims[m] != ndims[perm[m]] || X.sortorder[m] != m) {
+            printf("mode %u: wrong size or sort order\n", (unsigned) m);
+            return 1;
+        }
+    }
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptIndex const c[] = { X.inds[0].data[z], X.inds[1].data[z], X.inds[2].data[z], X.inds[3].data[z] };
+        if(X.values.data[z] != OldValue(dense, perm, c)) {
+            printf("nonzero %lu moved wrong\n", (unsigned long) z);
+            return 1;
+        }
+        sptIndex m = 0;
+        while(z > 0 && m < 4 && X.inds[m].data[z-1] == c[m]) {
+            ++m;
+        }
+        if(z > 0 && (m == 4 || X.inds[m].data[z-1] > c[m])) {
+            printf("nonzero %lu out of order\n", (unsigned long) z);
+            return 1;
+        }
+    }
+
+    /* A lazy permutation keeps the data and records its order in the new modes */
+    sptSparseTensorSortIndex(&Z, 1);
+    result = sptSparseTensorPermuteModes(&Z, perm, 0, 0);
+    spt_CheckError(result, "lazy permute", NULL);
+    for(sptIndex m = 0; m < 4; ++m) {
+        if(Z.sortorder[perm[m]] != m) {
+            printf("lazy: sort order of mode %u wrong\n", (unsigned) m);
+            return 1;
+        }
+    }
+    sptSparseTensorSortIndex(&Z, 0);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < 4; ++m) {
+            if(Z.inds[m].data[z] != X.inds[m].data[z]) {
+                printf("lazy: nonzero %lu differs after sorting\n", (unsigned long) z);
+                return 1;
+            }
+        }
+    }
+
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    sptIndex const back[] = { 1, 3, 0, 2 };
+    result = sptSparseTensorPermuteModes(&Z, back, 1, 0);
+    spt_CheckError(result, "permute back", NULL);
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &Z, 3, 5, 1);
+    spt_CheckError(result, "to HiCOO", NULL);
+    result = sptSparseTensorHiCOOPermuteModes(&H, perm);
+    spt_CheckError(result, "HiCOO permute", NULL);
+    for(sptNnzIndex b = 0; b + 1 < H.bptr.len; ++b) {
+        for(sptNnzIndex z = H.bptr.data[b]; z < H.bptr.data[b+1]; ++z) {
+            sptIndex c[4];
+            for(sptIndex m = 0; m < 4; ++m) {
+                c[m] = ((sptIndex) H.binds[m].data[b] << H.sb_bits) + H.einds[m].data[z];
+            }
+            if(H.values.data[z] != OldValue(dense, perm, c)) {
+                printf("HiCOO: nonzero %lu renamed wrong\n", (unsigned long) z);
+                return 1;
+            }
+        }
+    }
+
+    sptIndex const repeated[] = { 0, 1, 1, 2 };
+    if(sptSparseTensorPermuteModes(&X, repeated, 0, 0) == 0) {
+        printf("accepted a repeated mode\n");
+        return 1;
+    }
+
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&Z);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+
+static int spt_SameHiCOO(sptSparseTensorHiCOO const * a, sptSparseTensorHiCOO const * b) {
+    if(a->nnz != b->nnz || a->kptr.len != b->kptr.len || a->bptr.len != b->bptr.len) {
+        return 0;
+    }
+    sptNnzIndex const nb = a->bptr.len - 1;
+    if(memcmp(a->kptr.data, b->kptr.data, a->kptr.len * sizeof *a->kptr.data) != 0 ||
+        memcmp(a->bptr.data, b->bptr.data, a->bptr.len * sizeof *a->bptr.data) != 0 ||
+        memcmp(a->values.data, b->values.data, a->nnz * sizeof *a->values.data) != 0) {
+        return 0;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(memcmp(a->binds[m].data, b->binds[m].data, nb * sizeof *a->binds[m].data) != 0 ||
+            memcmp(a->einds[m].data, b->einds[m].data, a->nnz * sizeof *a->einds[m].data) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    /* More nonzeros than one parser batch, 1-based, with blank lines and zeros */
+    char filename[] = "/tmp/parti_test_pipeline_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    FILE * fp = fdopen(fd, "w");
+    fprintf(fp, "3\n60 50 40\n\n");
+    for(unsigned i = 0; i < 60; ++i)
+    for(unsigned j = 0; j < 50; ++j)
+    for(unsigned k = 0; k < 40; ++k) {
+        if((i * 7 + j * 3 + k) % 3 == 0) {
+            fprintf(fp, "%u %u %u %.17g\n", i + 1, j + 1, k + 1, (i * 31 + j * 17 + k) % 13 * 0.25);
+        }
+    }
+    fclose(fp);
+
+    sptCpdPipeline pipe;
+    int result = sptStartCpdAlsHiCOOPipeline(&pipe, filename, 1, 2, 4, 4, 3, 1e-5, 2);
+    spt_CheckError(result, "start", NULL);
+    sptPipelineStage stage = sptCpdPipelineStage(pipe);
+    if(stage > SPT_PIPELINE_DONE) {
+        printf("Bad stage %d\n", (int) stage);
+        return 1;
+    }
+    sptSparseTensorHiCOO hitsr;
+    sptRankKruskalTensor ktensor;
+    result = sptWaitCpdPipeline(pipe, &hitsr, &ktensor);
+    spt_CheckError(result, "wait", NULL);
+
+    /* The same tensor as loading and converting one after the other */
+    sptSparseTensor X;
+    fp = fopen(filename, "r");
+    result = sptLoadSparseTensor(&X, 1, fp);
+    spt_CheckError(result, "load", NULL);
+    fclose(fp);
+    sptSparseTensorHiCOO hiX;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&hiX, &max_nnzb, &X, 2, 4, 2);
+    spt_CheckError(result, "to hicoo", NULL);
+    if(!spt_SameHiCOO(&hitsr, &hiX)) {
+        printf("Pipelined HiCOO differs from the converted one\n");
+        return 1;
+    }
+    if(ktensor.factors == NULL || ktensor.rank != 4 || !(ktensor.fit > 0 && ktensor.fit <= 1)) {
+        printf("Pipelined CP-ALS gave no decomposition, fit %g\n", ktensor.fit);
+        return 1;
+    }
+    sptFreeRankKruskalTensor(&ktensor);
+    sptFreeSparseTensorHiCOO(&hiX);
+    sptFreeSparseTensorHiCOO(&hitsr);
+    sptFreeSparseTensor(&X);
+
+    /* A malformed line fails the pipeline, after the threads are joined */
+    fp = fopen(filename, "w");
+    fprintf(fp, "3\n4 4 4\n1 1 1 1.0\n1 x 2 2.0\n");
+    fclose(fp);
+    result = sptStartCpdAlsHiCOOPipeline(&pipe, filename, 1, 1, 2, 2, 3, 1e-5, 1);
+    spt_CheckError(result, "start", NULL);
+    if(sptWaitCpdPipeline(pipe, NULL, &ktensor) == 0) {
+        printf("Malformed file accepted\n");
+        return 1;
+    }
+    unlink(filename);
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+static double uniform(void) {
+    return (double) (rand() % 2000 - 1000) / 1000;
+}
+
+/* A dense 10 x 9 x 8 tensor, 10 a o b o c with unit a, b, c plus small noise */
+static void rank1_plus_noise(sptSparseTensor * X) {
+    sptIndex const ndims[3] = { 10, 9, 8 };
+    double vecs[3][10];
+    for(sptIndex m = 0; m < 3; ++m) {
+        double norm = 0;
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            vecs[m][i] = uniform();
+            norm += vecs[m][i] * vecs[m][i];
+        }
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            vecs[m][i] /= sqrt(norm);
+        }
+    }
+    sptNewSparseTensor(X, 3, ndims);
+    for(sptIndex i = 0; i < ndims[0]; ++i) {
+        for(sptIndex j = 0; j < ndims[1]; ++j) {
+            for(sptIndex k = 0; k < ndims[2]; ++k) {
+                sptAppendIndexVector(&X->inds[0], i);
+                sptAppendIndexVector(&X->inds[1], j);
+                sptAppendIndexVector(&X->inds[2], k);
+                sptAppendValueVector(&X->values, (sptValue) (10 * vecs[0][i] * vecs[1][j] * vecs[2][k] + 0.01 * uniform()));
+            }
+        }
+    }
+    X->nnz = X->values.len;
+}
+
+/* X times the vectors in every mode */
+static double full_product(sptSparseTensor const * X, sptValue * const x[]) {
+    double sum = 0;
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        double v = X->values.data[z];
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            v *= x[m][X->inds[m].data[z]];
+        }
+        sum += v;
+    }
+    return sum;
+}
+
+int main(void) {
+    srand(5);
+    sptSparseTensor X;
+    rank1_plus_noise(&X);
+    sptIndex const nmodes = X.nmodes;
+
+    /* The fused TTV against a direct loop, in every mode */
+    sptValueVector V[3];
+    sptValueVector const * Vp[3];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptNewValueVector(&V[m], X.ndims[m], X.ndims[m]);
+        for(sptIndex i = 0; i < X.ndims[m]; ++i) {
+            V[m].data[i] = (sptValue) uniform();
+        }
+        Vp[m] = &V[m];
+    }
+    int const tks[] = { 1, 3 };
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+        /* The sums may cancel, so rounding is bounded by the magnitude of their terms */
+        double expected[10] = { 0 }, magnitude[10] = { 0 };
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            double v = X.values.data[z];
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                if(m != mode) {
+                    v *= V[m].data[X.inds[m].data[z]];
+                }
+            }
+            expected[X.inds[mode].data[z]] += v;
+            magnitude[X.inds[mode].data[z]] += fabs(v);
+        }
+        for(int t = 0; t < 2; ++t) {
+            sptValueVector y;
+            sptNewValueVector(&y, X.ndims[mode], X.ndims[mode]);
+            int result = sptSparseTensorMulVectorsExcept(&y, &X, Vp, mode, tks[t]);
+            spt_CheckError(result, "ttv except", NULL);
+            for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                if(fabs(y.data[i] - expected[i]) > 1e3 * PARTI_VALUE_EPSILON * (1 + magnitude[i])) {
+                    printf("mode %"PARTI_PRI_INDEX", %d threads: y[%"PARTI_PRI_INDEX"] = %f, expected %f\n", mode, tks[t], i, y.data[i], expected[i]);
+                    return 1;
+                }
+            }
+            sptFreeValueVector(&y);
+        }
+    }
+
+    /* HOPM finds the dominant rank-1 term, and lambda is X times the final vectors */
+    for(int t = 0; t < 2; ++t) {
+        sptValueVector * xp[3];
+        sptValue * xs[3];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            for(sptIndex i = 0; i < X.ndims[m]; ++i) {
+                V[m].data[i] = 1;
+            }
+            xp[m] = &V[m];
+            xs[m] = V[m].data;
+        }
+        sptValue lambda;
+        int result = sptSparseTensorPowerMethod(&lambda, xp, &X, 0, 0, 100, 1e-12, tks[t]);
+        spt_CheckError(result, "hopm", NULL);
+        double const product = full_product(&X, xs);
+        if(fabs(fabs(lambda) - 10) > 0.1 || fabs(lambda - product) > 1e3 * PARTI_VALUE_EPSILON * (1 + fabs(product))) {
+            printf("hopm, %d threads: lambda %f, X times the vectors %f\n", tks[t], lambda, product);
+            return 1;
+        }
+    }
+    sptFreeSparseTensor(&X);
+
+    /* S-HOPM on the symmetric 5 a o a o a, with and without a shift */
+    sptIndex const sdims[3] = { 6, 6, 6 };
+    double a[6], anorm = 0;
+    for(sptIndex i = 0; i < 6; ++i) {
+        a[i] = uniform();
+        anorm += a[i] * a[i];
+    }
+    for(sptIndex i = 0; i < 6; ++i) {
+        a[i] /= sqrt(anorm);
+    }
+    sptNewSparseTensor(&X, 3, sdims);
+    for(sptIndex i = 0; i < 6; ++i) {
+        for(sptIndex j = 0; j < 6; ++j) {
+            for(sptIndex k = 0; k < 6; ++k) {
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, (sptValue) (5 * a[i] * a[j] * a[k]));
+            }
+        }
+    }
+    X.nnz = X.values.len;
+    sptValue const shifts[] = { 0, 1 };
+    for(int s = 0; s < 2; ++s) {
+        sptValueVector x;
+        sptNewValueVector(&x, 6, 6);
+        for(sptIndex i = 0; i < 6; ++i) {
+            x.data[i] = (sptValue) (a[i] + 0.3 * uniform());
+        }
+        sptValueVector * xp[3] = { &x, &x, &x };
+        sptValue lambda;
+        int result = sptSparseTensorPowerMethod(&lambda, xp, &X, shifts[s], 1, 200, 1e-14, 2);
+        spt_CheckError(result, "s-hopm", NULL);
+        double dot = 0;
+        for(sptIndex i = 0; i < 6; ++i) {
+            dot += x.data[i] * a[i];
+        }
+        if(fabs(lambda - 5) > 1e4 * PARTI_VALUE_EPSILON || fabs(fabs(dot) - 1) > 1e4 * PARTI_VALUE_EPSILON) {
+            printf("s-hopm, shift %f: lambda %f, <x, a> = %f\n", shifts[s], lambda, dot);
+            return 1;
+        }
+        sptFreeValueVector(&x);
+    }
+    sptFreeSparseTensor(&X);
+
+    /* The batched method matches the single runs column by column */
+    rank1_plus_noise(&X);
+    sptIndex const nvecs = 3;
+    sptMatrix B[3];
+    sptMatrix * Bp[3];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptNewMatrix(&B[m], X.ndims[m], nvecs);
+        for(sptIndex i = 0; i < X.ndims[m]; ++i) {
+            for(sptIndex j = 0; j < nvecs; ++j) {
+                B[m].values[i * B[m].stride + j] = (sptValue) uniform();
+            }
+        }
+        Bp[m] = &B[m];
+    }
+    sptValue single[3];
+    for(sptIndex j = 0; j < nvecs; ++j) {
+        sptValueVector * xp[3];
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            for(sptIndex i = 0; i < X.ndims[m]; ++i) {
+                V[m].data[i] = B[m].values[i * B[m].stride + j];
+            }
+            xp[m] = &V[m];
+        }
+        int result = sptSparseTensorPowerMethod(&single[j], xp, &X, 0.5, 0, 8, 0, 1);
+        spt_CheckError(result, "hopm", NULL);
+    }
+    sptValue batched[3];
+    int result = sptSparseTensorPowerMethodBatched(batched, Bp, &X, 0.5, 0, 8, 0, 3);
+    spt_CheckError(result, "hopm batched", NULL);
+    for(sptIndex j = 0; j < nvecs; ++j) {
+        if(fabs(batched[j] - single[j]) > 1e3 * PARTI_VALUE_EPSILON * (1 + fabs(single[j]))) {
+            printf("column %"PARTI_PRI_INDEX": batched lambda %f, single %f\n", j, batched[j], single[j]);
+            return 1;
+        }
+    }
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptFreeMatrix(&B[m]);
+        sptFreeValueVector(&V[m]);
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
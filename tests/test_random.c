@@ -0,0 +1,113 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+
+/* The random fills and shuffles depend on the seed only, not on the thread count */
+int main(void) {
+    sptIndex const nrows = 1000, ncols = 7;
+    sptMatrix A[2];
+    sptSparseTensor X[2];
+    sptIndex const ndims[3] = { 40, 30, 20 };
+    sptIndex * maps[2][3];
+    for(int t = 0; t < 2; ++t) {
+        sptExecContext ctx;
+        sptNewExecContext(&ctx, t == 0 ? 1 : 4);
+        sptExecContext const * const prev = sptSetExecContext(&ctx);
+        sptSetRandomSeed(42);
+        sptNewMatrix(&A[t], nrows, ncols);
+        sptRandomizeMatrix(&A[t], nrows, ncols);
+
+        int result = sptGenerateSparseTensor(&X[t], 3, ndims, 5000, SPT_GEN_UNIFORM, 0, 3, 1);
+        spt_CheckError(result, "generate", NULL);
+        sptGetRandomShuffleElements(&X[t]);
+        for(sptIndex m = 0; m < 3; ++m) {
+            maps[t][m] = malloc(ndims[m] * sizeof *maps[t][m]);
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                maps[t][m][i] = i;
+            }
+        }
+        sptGetRandomShuffledIndices(&X[t], maps[t]);
+        sptSetExecContext(prev);
+    }
+
+    sptIndex negative = 0;
+    for(sptIndex i = 0; i < nrows; ++i) {
+        for(sptIndex j = 0; j < ncols; ++j) {
+            sptValue const v = A[0].values[i * A[0].stride + j];
+            if(v != A[1].values[i * A[1].stride + j] || v < -3 || v > 3) {
+                printf("random matrix differs at (%"PARTI_PRI_INDEX", %"PARTI_PRI_INDEX")\n", i, j);
+                return 1;
+            }
+            negative += v < 0;
+        }
+    }
+    if(negative < nrows * ncols / 3 || negative > 2 * nrows * ncols / 3) {
+        printf("%"PARTI_PRI_INDEX" of the random values are negative\n", negative);
+        return 1;
+    }
+
+    /* The shuffle is the same, and only moves nonzeros */
+    sptSparseTensor Y;
+    int result = sptGenerateSparseTensor(&Y, 3, ndims, 5000, SPT_GEN_UNIFORM, 0, 3, 1);
+    spt_CheckError(result, "generate", NULL);
+    sptNnzIndex moved = 0;
+    double sum[2] = { 0, 0 };
+    for(sptNnzIndex x = 0; x < Y.nnz; ++x) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            if(X[0].inds[m].data[x] != X[1].inds[m].data[x]) {
+                printf("shuffled nonzero %"PARTI_PRI_NNZ_INDEX" differs\n", x);
+                return 1;
+            }
+        }
+        moved += X[0].inds[0].data[x] != Y.inds[0].data[x] || X[0].inds[1].data[x] != Y.inds[1].data[x];
+        sum[0] += X[0].values.data[x] * (1 + X[0].inds[0].data[x] + 40 * X[0].inds[2].data[x]);
+        sum[1] += Y.values.data[x] * (1 + Y.inds[0].data[x] + 40 * Y.inds[2].data[x]);
+    }
+    if(moved < Y.nnz / 2 || fabs(sum[0] - sum[1]) > 1e-6 * fabs(sum[1])) {
+        printf("the shuffle moved %"PARTI_PRI_NNZ_INDEX" nonzeros, or changed them\n", moved);
+        return 1;
+    }
+
+    /* The index maps are the same permutations */
+    for(sptIndex m = 0; m < 3; ++m) {
+        char * seen = calloc(ndims[m], 1);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            if(maps[0][m][i] != maps[1][m][i] || maps[0][m][i] >= ndims[m] || seen[maps[0][m][i]]) {
+                printf("shuffled index map of mode %"PARTI_PRI_INDEX" is wrong\n", m);
+                return 1;
+            }
+            seen[maps[0][m][i]] = 1;
+        }
+        free(seen);
+        free(maps[0][m]);
+        free(maps[1][m]);
+    }
+
+    for(int t = 0; t < 2; ++t) {
+        sptFreeMatrix(&A[t]);
+        sptFreeSparseTensor(&X[t]);
+    }
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
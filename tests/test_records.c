@@ -0,0 +1,159 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+
+/* Semi sparse results must match fiber for fiber */
+static int spt_CompareSemi(const sptSemiSparseTensor *a, const sptSemiSparseTensor *b, sptIndex const ncols) {
+    if(a->nnz != b->nnz) {
+        return 1;
+    }
+    for(sptNnzIndex f = 0; f < a->nnz; ++f) {
+        for(sptIndex m = 0; m < a->nmodes; ++m) {
+            if(m != a->mode && a->inds[m].data[f] != b->inds[m].data[f]) {
+                return 1;
+            }
+        }
+        for(sptIndex k = 0; k < ncols; ++k) {
+            sptValue const x = a->values.values[f * a->stride + k], y = b->values.values[f * b->stride + k];
+            if(fabs(x - y) > 1e4 * PARTI_VALUE_EPSILON * (1 + fabs(y))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Record tensors must convert back exactly and multiply like their COO source, in records of the smallest power of two from 16 bytes */
+int main(void) {
+    sptIndex const ndims[] = { 40, 30, 20, 10 };
+    sptIndex const R = 5;
+    for(sptIndex nmodes = 2; nmodes <= 4; nmodes += 2) {
+        sptSparseTensor X;
+        int result = sptGenerateSparseTensor(&X, nmodes, ndims, 3000, SPT_GEN_UNIFORM, 0, 11, 2);
+        spt_CheckError(result, "generate", NULL);
+        sptGetRandomShuffleElements(&X);
+        sptRecordSparseTensor T;
+        result = sptNewRecordSparseTensor(&T, &X, 3);
+        spt_CheckError(result, "records", NULL);
+        size_t record_bytes = 16;
+        while(record_bytes < sizeof (sptValue) + nmodes * sizeof (sptIndex)) {
+            record_bytes *= 2;
+        }
+        if(T.record_bytes != record_bytes) {
+            printf("%"PARTI_PRI_INDEX"-mode records of %zu bytes\n", nmodes, T.record_bytes);
+            return 1;
+        }
+        sptSparseTensor Y;
+        result = sptSparseTensorFromRecords(&Y, &T, 2);
+        spt_CheckError(result, "from records", NULL);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            if(memcmp(X.inds[m].data, Y.inds[m].data, X.nnz * sizeof (sptIndex)) != 0) {
+                printf("Index mismatch after the round trip\n");
+                return 1;
+            }
+        }
+        if(memcmp(X.values.data, Y.values.data, X.nnz * sizeof (sptValue)) != 0) {
+            printf("Value mismatch after the round trip\n");
+            return 1;
+        }
+        sptFreeSparseTensor(&Y);
+
+        sptMatrix ** mats = malloc((nmodes + 1) * sizeof *mats);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            mats[m] = malloc(sizeof *mats[m]);
+            sptIndex const nrows = m < nmodes ? ndims[m] : ndims[0];
+            sptNewMatrix(mats[m], nrows, R);
+            sptRandomizeMatrix(mats[m], nrows, R);
+        }
+        sptValue * ref = malloc((size_t) ndims[0] * mats[0]->stride * sizeof *ref);
+        for(sptIndex mode = 0; mode < nmodes; ++mode) {
+            sptIndex mats_order[4];
+            for(sptIndex i = 0; i < nmodes; ++i) {
+                mats_order[i] = (mode + i) % nmodes;
+            }
+            sptNnzIndex const len = (sptNnzIndex) ndims[mode] * mats[0]->stride;
+            sptMTTKRP(&X, mats, mats_order, mode);
+            memcpy(ref, mats[nmodes]->values, len * sizeof *ref);
+            result = sptOmpMTTKRPRecords(&T, mats, mats_order, mode, 3);
+            spt_CheckError(result, "records mttkrp", NULL);
+            for(sptNnzIndex i = 0; i < len; ++i) {
+                if(fabs(mats[nmodes]->values[i] - ref[i]) > 1e4 * PARTI_VALUE_EPSILON * (1 + fabs(ref[i]))) {
+                    printf("Record MTTKRP mismatch at mode %"PARTI_PRI_INDEX"\n", mode);
+                    return 1;
+                }
+            }
+
+            /* Shuffled records go through the sort by fiber, records sorted at mode in place */
+            sptValueVector V;
+            sptNewValueVector(&V, ndims[mode], ndims[mode]);
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                V.data[i] = mats[mode]->values[(size_t) i * mats[0]->stride];
+            }
+            for(int sorted = 0; sorted < 2; ++sorted) {
+                sptRecordSparseTensor S;
+                sptSparseTensor Xs;
+                sptCopySparseTensor(&Xs, &X, 1);
+                if(sorted) {
+                    sptSparseTensorSortIndexAtMode(&Xs, mode, 1);
+                }
+                result = sptNewRecordSparseTensor(&S, &Xs, 2);
+                spt_CheckError(result, "records", NULL);
+                sptSemiSparseTensor Yc, Yr;
+                result = sptSparseTensorMulMatrix(&Yc, &Xs, mats[mode], mode);
+                spt_CheckError(result, "ttm", NULL);
+                result = sptOmpRecordSparseTensorMulMatrix(&Yr, &S, mats[mode], mode, 3);
+                spt_CheckError(result, "records ttm", NULL);
+                if(spt_CompareSemi(&Yr, &Yc, R) != 0) {
+                    printf("Record TTM mismatch at mode %"PARTI_PRI_INDEX", sorted %d\n", mode, sorted);
+                    return 1;
+                }
+                sptFreeSemiSparseTensor(&Yr);
+                sptFreeSemiSparseTensor(&Yc);
+                result = sptSparseTensorMulVector(&Yc, &Xs, &V, mode);
+                spt_CheckError(result, "ttv", NULL);
+                result = sptOmpRecordSparseTensorMulVector(&Yr, &S, &V, mode, 3);
+                spt_CheckError(result, "records ttv", NULL);
+                if(spt_CompareSemi(&Yr, &Yc, 1) != 0) {
+                    printf("Record TTV mismatch at mode %"PARTI_PRI_INDEX", sorted %d\n", mode, sorted);
+                    return 1;
+                }
+                sptFreeSemiSparseTensor(&Yr);
+                sptFreeSemiSparseTensor(&Yc);
+                sptFreeRecordSparseTensor(&S);
+                sptFreeSparseTensor(&Xs);
+            }
+            sptFreeValueVector(&V);
+        }
+        free(ref);
+        for(sptIndex m = 0; m <= nmodes; ++m) {
+            sptFreeMatrix(mats[m]);
+            free(mats[m]);
+        }
+        free(mats);
+        sptFreeRecordSparseTensor(&T);
+        sptFreeSparseTensor(&X);
+    }
+    return 0;
+}
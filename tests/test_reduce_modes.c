@@ -0,0 +1,136 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 30
+#define J 20
+#define K 10
+
+/* Y against a dense reduction of X over the modes not in keep, entries the op leaves at zero absent */
+static int spt_CheckReduced(sptSparseTensor const *X, sptSparseTensor const *Y, int const keep[3], sptReduceOp const op) {
+    static double dense[I * J * K];
+    static int seen[I * J * K];
+    for(size_t p = 0; p < I * J * K; ++p) {
+        dense[p] = 0;
+        seen[p] = 0;
+    }
+    sptIndex const dims[3] = { I, J, K };
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        size_t p = 0;
+        for(sptIndex m = 0; m < 3; ++m) {
+            p = p * dims[m] + (keep[m] ? X->inds[m].data[z] : 0);
+        }
+        double const v = X->values.data[z];
+        if(op == SPT_REDUCE_COUNT) {
+            dense[p] += 1;
+        } else if(op == SPT_REDUCE_SUM || !seen[p]) {
+            dense[p] = op == SPT_REDUCE_SUM ? dense[p] + v : v;
+        } else {
+            dense[p] = op == SPT_REDUCE_MAX ? (v > dense[p] ? v : dense[p]) : (v < dense[p] ? v : dense[p]);
+        }
+        seen[p] = 1;
+    }
+    sptNnzIndex expect = 0;
+    for(size_t p = 0; p < I * J * K; ++p) {
+        expect += dense[p] != 0;
+    }
+    if(Y->nnz != expect) {
+        printf("op %d: %lu nonzeros, expected %lu\n", (int) op, (unsigned long) Y->nnz, (unsigned long) expect);
+        return 1;
+    }
+    for(sptNnzIndex z = 0; z < Y->nnz; ++z) {
+        size_t p = 0;
+        sptIndex i = 0;
+        for(sptIndex m = 0; m < 3; ++m) {
+            p = p * dims[m] + (keep[m] ? Y->inds[i++].data[z] : 0);
+        }
+        if(Y->values.data[z] != dense[p]) {
+            printf("op %d: value %g, expected %g\n", (int) op, Y->values.data[z], dense[p]);
+            return 1;
+        }
+        if(z > 0) {
+            /* Sorted by the kept modes */
+            int order = 0;
+            for(sptIndex m = 0; m < Y->nmodes && order == 0; ++m) {
+                order = (Y->inds[m].data[z] > Y->inds[m].data[z-1]) - (Y->inds[m].data[z] < Y->inds[m].data[z-1]);
+            }
+            if(order <= 0) {
+                printf("op %d: output not sorted at %lu\n", (int) op, (unsigned long) z);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Collapsing modes with every reduction matches a dense reference, at one and several threads */
+int main(void) {
+    sptIndex const ndims[] = { I, J, K };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(13);
+    for(int n = 0; n < 3000; ++n) {
+        sptAppendIndexVector(&X.inds[0], rand() % I);
+        sptAppendIndexVector(&X.inds[1], rand() % J);
+        sptAppendIndexVector(&X.inds[2], rand() % K);
+        /* Small integers so sums are exact and some cancel to zero */
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 7 - 3));
+        ++X.nnz;
+    }
+
+    sptIndex const time_mode[] = { 2 };
+    sptIndex const outer_modes[] = { 2, 0 };
+    int const keep_time[3] = { 1, 1, 0 };
+    int const keep_outer[3] = { 0, 1, 0 };
+    sptReduceOp const ops[] = { SPT_REDUCE_SUM, SPT_REDUCE_MAX, SPT_REDUCE_MIN, SPT_REDUCE_COUNT };
+    for(int tk = 1; tk <= 4; tk += 3) {
+        for(int o = 0; o < 4; ++o) {
+            sptSparseTensor Y;
+            result = sptSparseTensorReduceModes(&Y, &X, 1, time_mode, ops[o], tk);
+            spt_CheckError(result, "reduce", NULL);
+            if(Y.nmodes != 2 || Y.ndims[0] != I || Y.ndims[1] != J || spt_CheckReduced(&X, &Y, keep_time, ops[o])) {
+                return 1;
+            }
+            sptFreeSparseTensor(&Y);
+
+            result = sptSparseTensorReduceModes(&Y, &X, 2, outer_modes, ops[o], tk);
+            spt_CheckError(result, "reduce", NULL);
+            if(Y.nmodes != 1 || Y.ndims[0] != J || spt_CheckReduced(&X, &Y, keep_outer, ops[o])) {
+                return 1;
+            }
+            sptFreeSparseTensor(&Y);
+        }
+    }
+
+    /* At least one mode stays, and each reduced mode is named once */
+    sptIndex const all_modes[] = { 0, 1, 2 };
+    sptIndex const twice[] = { 1, 1 };
+    sptSparseTensor Y;
+    if(sptSparseTensorReduceModes(&Y, &X, 3, all_modes, SPT_REDUCE_SUM, 1) == 0 ||
+       sptSparseTensorReduceModes(&Y, &X, 2, twice, SPT_REDUCE_SUM, 1) == 0) {
+        return 1;
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+static int spt_CompareKey(const void *a, const void *b) {
+    sptNnzIndex const ka = *(const sptNnzIndex *) a;
+    sptNnzIndex const kb = *(const sptNnzIndex *) b;
+    return ka < kb ? -1 : ka > kb;
+}
+
+/* Number of distinct 2^bits-wide blocks holding nonzeros of a 3-mode tensor */
+static sptNnzIndex spt_CountBlocks(const sptSparseTensor *tsr, int bits) {
+    sptNnzIndex * keys = malloc(tsr->nnz * sizeof *keys);
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        keys[z] = 0;
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            keys[z] = (keys[z] << 20) | (tsr->inds[m].data[z] >> bits);
+        }
+    }
+    qsort(keys, tsr->nnz, sizeof *keys, spt_CompareKey);
+    sptNnzIndex nblocks = tsr->nnz > 0;
+    for(sptNnzIndex z = 1; z < tsr->nnz; ++z) {
+        nblocks += keys[z] != keys[z - 1];
+    }
+    free(keys);
+    return nblocks;
+}
+
+/* Check that map_inds is a permutation of each mode, that factors can follow it back, and count blocks after it */
+static int spt_CheckMap(const sptSparseTensor *X, sptIndex ** map_inds, sptNnzIndex *nblocks) {
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        char * hit = calloc(X->ndims[m], 1);
+        for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+            if(map_inds[m][i] >= X->ndims[m] || hit[map_inds[m][i]]) {
+                free(hit);
+                return 1;
+            }
+            hit[map_inds[m][i]] = 1;
+        }
+        free(hit);
+
+        sptMatrix U;
+        int result = sptNewMatrix(&U, X->ndims[m], 1);
+        spt_CheckError(result, "matrix", NULL);
+        for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+            U.values[map_inds[m][i] * U.stride] = (sptValue) i;
+        }
+        sptMatrixInverseShuffleIndices(&U, map_inds[m]);
+        for(sptIndex i = 0; i < X->ndims[m]; ++i) {
+            if(U.values[i * U.stride] != (sptValue) i) {
+                sptFreeMatrix(&U);
+                return 1;
+            }
+        }
+        sptFreeMatrix(&U);
+    }
+
+    sptSparseTensor Y;
+    int result = sptCopySparseTensor(&Y, X, 1);
+    spt_CheckError(result, "copy", NULL);
+    sptSparseTensorShuffleIndices(&Y, map_inds);
+    *nblocks = spt_CountBlocks(&Y, 3);
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
+
+int main(void) {
+    sptIndex const nmodes = 3;
+    sptIndex const ndims[] = { 256, 256, 256 };
+    sptNnzIndex const nnz = 6000;
+
+    /* Nonzeros in 32 diagonal blocks of 8^3, hidden by a random relabeling */
+    srand(5);
+    sptIndex * hide[3];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        hide[m] = malloc(ndims[m] * sizeof *hide[m]);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            hide[m][i] = i;
+        }
+        for(sptIndex i = ndims[m] - 1; i > 0; --i) {
+            sptIndex const j = (sptIndex) (rand() % (i + 1));
+            sptIndex const tmp = hide[m][i];
+            hide[m][i] = hide[m][j];
+            hide[m][j] = tmp;
+        }
+    }
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        sptIndex const b = (sptIndex) (rand() % 32);
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], hide[m][b * 8 + rand() % 8]);
+        }
+        sptAppendValueVector(&X.values, 1);
+    }
+    X.nnz = nnz;
+    sptNnzIndex const shuffled = spt_CountBlocks(&X, 3);
+
+    sptIndex * map_inds[3];
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        map_inds[m] = malloc(ndims[m] * sizeof *map_inds[m]);
+    }
+
+    sptNnzIndex nblocks;
+    result = sptGetLexiOrderShuffledIndices(&X, map_inds, 3);
+    spt_CheckError(result, "lexi", NULL);
+    if(spt_CheckMap(&X, map_inds, &nblocks) != 0 || nblocks * 4 > shuffled) {
+        printf("Lexi-Order failed: %llu blocks, %llu shuffled\n", (unsigned long long) nblocks, (unsigned long long) shuffled);
+        return 1;
+    }
+
+    for(int reverse = 0; reverse < 2; ++reverse) {
+        result = sptGetBfsShuffledIndices(&X, map_inds, reverse);
+        spt_CheckError(result, "bfs", NULL);
+        if(spt_CheckMap(&X, map_inds, &nblocks) != 0 || nblocks * 4 > shuffled) {
+            printf("BFS (reverse %d) failed: %llu blocks, %llu shuffled\n", reverse, (unsigned long long) nblocks, (unsigned long long) shuffled);
+            return 1;
+        }
+    }
+
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        free(map_inds[m]);
+        free(hide[m]);
+    }
+    sptFreeSparseTensor(&X);
+    return 0;
+}
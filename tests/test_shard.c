@@ -0,0 +1,110 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMODES 3
+#define NNZ 20000
+
+/* Shards cover the tensor in balanced ranges of whole slices, and views share its nonzeros */
+int main(void) {
+    sptIndex const ndims[NMODES] = { 50, 200, 40 };
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, NMODES, ndims);
+    srand(17);
+    double total = 0;
+    for(sptNnzIndex n = 0; n < NNZ; ++n) {
+        for(sptIndex m = 0; m < NMODES; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % ndims[m]);
+        }
+        sptValue const v = (sptValue) (rand() % 100) / 10;
+        sptAppendValueVector(&X.values, v);
+        total += v;
+        ++X.nnz;
+    }
+
+    for(sptIndex mode = 0; mode < NMODES; ++mode) {
+        sptIndex const nshards_all[] = { 1, 4, 7 };
+        for(int k = 0; k < 3; ++k) {
+            sptIndex const nshards = nshards_all[k];
+            sptSparseTensorSharding sh;
+            if(sptNewSparseTensorSharding(&sh, &X, mode, nshards) != 0) {
+                printf("sharding failed\n");
+                return 1;
+            }
+            if(sh.slice_ptr[0] != 0 || sh.slice_ptr[nshards] != ndims[mode] || sh.nnz_ptr[0] != 0 || sh.nnz_ptr[nshards] != NNZ) {
+                printf("mode %"PARTI_PRI_INDEX": shards do not cover the tensor\n", mode);
+                return 1;
+            }
+            /* No shard exceeds its share by more than one slice */
+            sptNnzIndex max_slice = 0;
+            sptNnzIndex * counts = calloc(ndims[mode], sizeof *counts);
+            for(sptNnzIndex z = 0; z < NNZ; ++z) {
+                ++counts[X.inds[mode].data[z]];
+            }
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                max_slice = counts[i] > max_slice ? counts[i] : max_slice;
+            }
+            free(counts);
+
+            double sum = 0;
+            for(sptIndex s = 0; s < nshards; ++s) {
+                sptSparseTensor view;
+                sptSparseTensorShardView(&view, &X, &sh, s);
+                if(view.nnz != sh.nnz_ptr[s+1] - sh.nnz_ptr[s] || view.nnz > NNZ / nshards + max_slice) {
+                    printf("mode %"PARTI_PRI_INDEX", shard %"PARTI_PRI_INDEX": %lu nonzeros\n", mode, s, (unsigned long) view.nnz);
+                    return 1;
+                }
+                if(view.values.data != X.values.data + sh.nnz_ptr[s] || view.inds[mode].data != X.inds[mode].data + sh.nnz_ptr[s]) {
+                    printf("shard view copies the nonzeros\n");
+                    return 1;
+                }
+                for(sptNnzIndex z = 0; z < view.nnz; ++z) {
+                    sptIndex const i = view.inds[mode].data[z];
+                    if(i < sh.slice_ptr[s] || i >= sh.slice_ptr[s+1]) {
+                        printf("mode %"PARTI_PRI_INDEX", shard %"PARTI_PRI_INDEX": slice %"PARTI_PRI_INDEX" out of its range\n", mode, s, i);
+                        return 1;
+                    }
+                    sum += view.values.data[z];
+                }
+                /* A view works with the kernels, here the norm */
+                if(view.nnz != 0 && !(SparseTensorFrobeniusNormSquared(&view) > 0)) {
+                    printf("norm of a shard failed\n");
+                    return 1;
+                }
+                sptFreeSparseTensorShardView(&view);
+            }
+            if(fabs(sum - total) > 1e-9 * total) {
+                printf("mode %"PARTI_PRI_INDEX": shards sum to %g, expected %g\n", mode, sum, total);
+                return 1;
+            }
+            sptFreeSparseTensorSharding(&sh);
+        }
+    }
+
+    sptSparseTensorSharding sh;
+    if(sptNewSparseTensorSharding(&sh, &X, NMODES, 2) == 0 || sptNewSparseTensorSharding(&sh, &X, 0, 0) == 0) {
+        printf("accepted a bad mode or shard count\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/wait.h>
+#include "../src/error/error.h"
+
+static sptIndex const ndims[] = { 40, 30, 20 };
+static sptIndex const R = 8;
+
+/* MTTKRP of every mode on X, or on H when it is not NULL, into out */
+static int spt_AllModes(sptSparseTensor const *X, sptSparseTensorHiCOO const *H, sptMatrix **mats, sptValue *out) {
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        sptIndex mats_order[3];
+        for(sptIndex i = 0; i < 3; ++i) {
+            mats_order[i] = (mode + i) % 3;
+        }
+        sptNewMatrix(mats[3], ndims[mode], R);
+        int result = H != NULL ? sptOmpMTTKRPHiCOO(H, mats, mats_order, mode, 2) : sptOmpMTTKRP(X, mats, mats_order, mode, 2);
+        spt_CheckError(result, "mttkrp", NULL);
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            memcpy(out + (size_t) i * R, mats[3]->values + (size_t) i * mats[3]->stride, R * sizeof *out);
+        }
+        out += (size_t) ndims[mode] * R;
+        sptFreeMatrix(mats[3]);
+    }
+    return 0;
+}
+
+/* Factor matrices both processes build the same way */
+static sptMatrix ** spt_Factors(void) {
+    sptMatrix ** mats = malloc(4 * sizeof *mats);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        if(m < 3) {
+            sptNewMatrix(mats[m], ndims[m], R);
+            for(sptIndex i = 0; i < ndims[m]; ++i) {
+                for(sptIndex r = 0; r < R; ++r) {
+                    mats[m]->values[i * mats[m]->stride + r] = (sptValue) ((i * 7 + r * 3 + m) % 11) / 11;
+                }
+            }
+        }
+    }
+    return mats;
+}
+
+static int spt_Close(sptValue const *a, sptValue const *b, size_t n) {
+    for(size_t i = 0; i < n; ++i) {
+        if(fabs(a[i] - b[i]) > 1e4 * PARTI_VALUE_EPSILON * (1 + fabs(a[i]))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * The attaching process, started fresh rather than forked, since an OpenMP
+ * runtime does not survive fork. Both formats of the tensor must agree.
+ */
+static int spt_AttachChild(const char *coo_name, const char *hicoo_name) {
+    sptSparseTensor Y;
+    sptSparseTensorHiCOO G;
+    if(sptAttachSparseTensor(&Y, coo_name) != 0 || sptAttachSparseTensorHiCOO(&G, hicoo_name) != 0) {
+        return 2;
+    }
+    if(sptMemBackingOf(Y.values.data) != SPT_MEM_FILE) {
+        return 3;
+    }
+    sptMatrix ** mats = spt_Factors();
+    size_t const total = (size_t) (ndims[0] + ndims[1] + ndims[2]) * R;
+    sptValue * coo = malloc(total * sizeof *coo);
+    sptValue * hicoo = malloc(total * sizeof *hicoo);
+    spt_AllModes(&Y, NULL, mats, coo);
+    spt_AllModes(NULL, &G, mats, hicoo);
+    if(!spt_Close(coo, hicoo, total)) {
+        return 4;
+    }
+    double const normsq = SparseTensorFrobeniusNormSquared(&Y);
+    if(fabs(normsq - sptSparseTensorFrobeniusNormSquaredHiCOO(&G)) > 1e4 * PARTI_VALUE_EPSILON * (1 + normsq)) {
+        return 5;
+    }
+    sptDetachSparseTensorHiCOO(&G);
+    sptUnmapSparseTensor(&Y);
+    return 0;
+}
+
+/* Published tensors attach in another process, with no copy, and multiply like the original */
+int main(int argc, char *argv[]) {
+    if(argc == 3) {
+        return spt_AttachChild(argv[1], argv[2]);
+    }
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 3000, SPT_GEN_UNIFORM, 0, 11, 2);
+    spt_CheckError(result, "generate", NULL);
+    sptSparseTensorSortIndex(&X, 1);
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 3, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+
+    sptMatrix ** mats = spt_Factors();
+    size_t const total = (size_t) (ndims[0] + ndims[1] + ndims[2]) * R;
+    sptValue * ref = malloc(total * sizeof *ref);
+    sptValue * got = malloc(total * sizeof *got);
+    spt_AllModes(&X, NULL, mats, ref);
+
+    char coo_name[64], hicoo_name[64], file_name[] = "/tmp/parti_test_shared_XXXXXX";
+    snprintf(coo_name, sizeof coo_name, "/parti_test_coo_%d", (int) getpid());
+    snprintf(hicoo_name, sizeof hicoo_name, "/parti_test_hicoo_%d", (int) getpid());
+    int fd = mkstemp(file_name);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+    unlink(file_name);
+    result = sptPublishSparseTensor(&X, coo_name);
+    spt_CheckError(result, "publish", NULL);
+    result = sptPublishSparseTensorHiCOO(&H, hicoo_name);
+    spt_CheckError(result, "publish hicoo", NULL);
+    result = sptPublishSparseTensorHiCOO(&H, file_name);
+    spt_CheckError(result, "publish hicoo file", NULL);
+    if(sptPublishSparseTensor(&X, coo_name) == 0) {
+        printf("Publishing over an existing name succeeded\n");
+        return 1;
+    }
+
+    pid_t const child = fork();
+    if(child == 0) {
+        execl("/proc/self/exe", argv[0], coo_name, hicoo_name, (char *) NULL);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("Attached tensors failed in the child process, status %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return 1;
+    }
+
+    /* Attached tensors match the original; file-backed segments attach the same way */
+    sptSparseTensor Y;
+    result = sptAttachSparseTensor(&Y, coo_name);
+    spt_CheckError(result, "attach", NULL);
+    spt_AllModes(&Y, NULL, mats, got);
+    sptUnmapSparseTensor(&Y);
+    if(!spt_Close(ref, got, total)) {
+        printf("Attached MTTKRP mismatch\n");
+        return 1;
+    }
+    sptSparseTensorHiCOO G;
+    result = sptAttachSparseTensorHiCOO(&G, file_name);
+    spt_CheckError(result, "attach hicoo file", NULL);
+    spt_AllModes(NULL, &G, mats, got);
+    sptDetachSparseTensorHiCOO(&G);
+    if(!spt_Close(ref, got, total)) {
+        printf("File-backed HiCOO MTTKRP mismatch\n");
+        return 1;
+    }
+
+    /* Sorting a copy-on-write view leaves the segment alone */
+    result = sptAttachSparseTensor(&Y, coo_name);
+    spt_CheckError(result, "attach", NULL);
+    sptSparseTensorSortIndexAtMode(&Y, 2, 0);
+    sptUnmapSparseTensor(&Y);
+    result = sptAttachSparseTensor(&Y, coo_name);
+    spt_CheckError(result, "attach", NULL);
+    if(memcmp(Y.inds[2].data, X.inds[2].data, X.nnz * sizeof (sptIndex)) != 0) {
+        printf("Segment modified through an attached tensor\n");
+        return 1;
+    }
+    sptUnmapSparseTensor(&Y);
+
+    sptUnpublishTensor(coo_name);
+    sptUnpublishTensor(hicoo_name);
+    sptUnpublishTensor(file_name);
+    if(sptAttachSparseTensor(&Y, coo_name) == 0) {
+        printf("Unpublished tensor still attaches\n");
+        return 1;
+    }
+
+    free(got);
+    free(ref);
+    for(sptIndex m = 0; m < 3; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats[3]);
+    free(mats);
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
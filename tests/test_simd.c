@@ -0,0 +1,118 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/matrix/simd.h"
+
+static int spt_Differ(sptValue const * a, sptValue const * b, sptIndex n) {
+    for(sptIndex i = 0; i < n; ++i) {
+        if(fabs(a[i] - b[i]) > 1e-5 * (1 + fabs(a[i]))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The vector kernels picked for this CPU must match plain loops for every tail length, and leave the rest of the row alone;
+   the indexed ones must add every repeated index once */
+int main(void) {
+    spt_SimdKernels const * const simd = spt_Simd();
+    printf("SIMD kernels: %s\n", simd->name);
+    enum { N = 70, PAD = 4 };
+    sptValue x[N], d[N], y[N + PAD], ref[N + PAD];
+    for(sptIndex i = 0; i < N; ++i) {
+        x[i] = (sptValue) (rand() % 200 - 100) / 10;
+        d[i] = (sptValue) (rand() % 100 + 1) / 10;
+    }
+    for(sptIndex n = 0; n <= N - PAD; ++n) {
+        for(int k = 0; k < 7; ++k) {
+            for(sptIndex i = 0; i < n + PAD; ++i) {
+                y[i] = ref[i] = (sptValue) (rand() % 200 - 100) / 10;
+            }
+            sptValue const a = (sptValue) 1.5;
+            switch(k) {
+            case 0:
+                simd->mul(y, x, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] *= x[i];
+                break;
+            case 1:
+                simd->scale(y, a, x, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] = a * x[i];
+                break;
+            case 2:
+                simd->sqacc(y, x, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] += x[i] * x[i];
+                break;
+            case 3:
+                simd->maxacc(y, x, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] = x[i] > ref[i] ? x[i] : ref[i];
+                break;
+            case 4:
+                simd->div(y, d, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] /= d[i];
+                break;
+            case 5:
+                simd->axpy(y, a, x, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] += a * x[i];
+                break;
+            case 6:
+                simd->hadamard(y, x, d, n);
+                for(sptIndex i = 0; i < n; ++i) ref[i] = x[i] * d[i];
+                break;
+            }
+            if(spt_Differ(ref, y, n + PAD)) {
+                printf("SIMD kernel %d mismatch at length %"PARTI_PRI_INDEX"\n", k, n);
+                return 1;
+            }
+        }
+    }
+
+    /* The indexed kernels, with few distinct rows so that vectors repeat indices */
+    enum { ROWS = 6, STRIDE = 3 };
+    sptIndex idx[N];
+    sptValue v[ROWS * STRIDE], out[ROWS * STRIDE], out_ref[ROWS * STRIDE];
+    for(sptIndex i = 0; i < ROWS * STRIDE; ++i) {
+        v[i] = (sptValue) (rand() % 200 - 100) / 10;
+    }
+    for(sptIndex n = 0; n <= N; ++n) {
+        for(sptIndex k = 0; k < n; ++k) {
+            idx[k] = (sptIndex) (rand() % ROWS);
+            y[k] = ref[k] = x[k];
+        }
+        for(sptIndex i = 0; i < ROWS * STRIDE; ++i) {
+            out[i] = out_ref[i] = (sptValue) i;
+        }
+        simd->scatter_add(out + 1, STRIDE, idx, x, n);
+        simd->gather_mul(y, v + 2, STRIDE, idx, n);
+        sptValue const dot = simd->gather_dot(x, v, idx, n);
+        sptValue dot_ref = 0;
+        for(sptIndex k = 0; k < n; ++k) {
+            out_ref[idx[k] * STRIDE + 1] += x[k];
+            ref[k] *= v[idx[k] * STRIDE + 2];
+            dot_ref += x[k] * v[idx[k]];
+        }
+        if(spt_Differ(out_ref, out, ROWS * STRIDE) || spt_Differ(ref, y, n) || spt_Differ(&dot_ref, &dot, 1)) {
+            printf("SIMD indexed kernels mismatch at length %"PARTI_PRI_INDEX"\n", n);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+/* Compare sub against the in-box nonzeros of X, taken in order */
+static int spt_CheckSub(const sptSparseTensor *sub, const sptSparseTensor *X, const sptIndex *low, const sptIndex *high) {
+    sptNnzIndex k = 0;
+    for(sptNnzIndex z = 0; z < X->nnz; ++z) {
+        int inside = 1;
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            inside = inside && X->inds[m].data[z] >= low[m] && X->inds[m].data[z] < high[m];
+        }
+        if(!inside) {
+            continue;
+        }
+        if(k >= sub->nnz || sub->values.data[k] != X->values.data[z]) {
+            return 1;
+        }
+        for(sptIndex m = 0; m < X->nmodes; ++m) {
+            if(sub->inds[m].data[k] != X->inds[m].data[z]) {
+                return 1;
+            }
+        }
+        ++k;
+    }
+    for(sptIndex m = 0; m < X->nmodes; ++m) {
+        if(sub->inds[m].len != k) {
+            return 1;
+        }
+    }
+    return k != sub->nnz || sub->values.len != k;
+}
+
+static int spt_TrySub(const sptSparseTensor *X, const sptIndex *low, const sptIndex *high, const char *name) {
+    sptSparseTensor sub;
+    int result = spt_GetSubSparseTensor(&sub, X, low, high);
+    spt_CheckError(result, "sub", NULL);
+    int bad = spt_CheckSub(&sub, X, low, high);
+    if(bad) {
+        printf("spt_GetSubSparseTensor failed: %s\n", name);
+    }
+    sptFreeSparseTensor(&sub);
+    return bad;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 200, 30, 500 };
+    sptIndex const nmodes = 3;
+    sptNnzIndex const nnz = 40000;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+
+    srand(11);
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) z);
+    }
+    X.nnz = nnz;
+
+    sptIndex const window_low[] = { 40, 0, 0 };
+    sptIndex const window_high[] = { 90, 30, 500 };
+    sptIndex const box_low[] = { 40, 5, 100 };
+    sptIndex const box_high[] = { 90, 20, 300 };
+    sptIndex const empty_low[] = { 40, 0, 0 };
+    sptIndex const empty_high[] = { 40, 30, 500 };
+
+    /* Unsorted, although X claims the natural order */
+    if(spt_TrySub(&X, window_low, window_high, "unsorted window") ||
+       spt_TrySub(&X, box_low, box_high, "unsorted box")) {
+        return 1;
+    }
+
+    sptSparseTensorSortIndex(&X, 1);
+    if(spt_TrySub(&X, window_low, window_high, "sorted window") ||
+       spt_TrySub(&X, box_low, box_high, "sorted box") ||
+       spt_TrySub(&X, empty_low, empty_high, "sorted empty")) {
+        return 1;
+    }
+
+    /* Mode 1 leads now, so the window is no longer a single segment */
+    sptSparseTensorSortIndexAtMode(&X, 0, 1);
+    sptIndex const sub1_low[] = { 0, 3, 0 };
+    sptIndex const sub1_high[] = { 200, 4, 500 };
+    if(spt_TrySub(&X, window_low, window_high, "mode-0 window") ||
+       spt_TrySub(&X, box_low, box_high, "mode-0 box") ||
+       spt_TrySub(&X, sub1_low, sub1_high, "mode-0 slab")) {
+        return 1;
+    }
+
+    /* Cached slice pointers count each slice, and locate it once its mode leads */
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        sptNnzIndex const * sp = spt_SparseTensorSlicePtr(&X, m);
+        sptNnzIndex z = 0;
+        for(sptIndex i = 0; sp != NULL && i < ndims[m]; ++i) {
+            for(sptNnzIndex k = sp[i]; k < sp[i+1]; ++k) {
+                z += m != 1 || X.inds[1].data[k] == i;
+            }
+        }
+        if(sp == NULL || sp[0] != 0 || z != nnz || spt_SparseTensorSlicePtr(&X, m) != sp) {
+            printf("spt_SparseTensorSlicePtr: mode %u\n", (unsigned) m);
+            return 1;
+        }
+    }
+    if(!spt_SparseTensorIsSliceSorted(&X, 1) || spt_SparseTensorIsSliceSorted(&X, 0)) {
+        printf("spt_SparseTensorIsSliceSorted after sorting at mode 0\n");
+        return 1;
+    }
+    sptSparseTensorSortIndex(&X, 1);
+    if(!spt_SparseTensorIsSliceSorted(&X, 0) || spt_SparseTensorIsSliceSorted(&X, 1)) {
+        printf("spt_SparseTensorIsSliceSorted kept across a sort\n");
+        return 1;
+    }
+
+    /* Work units of the mode-0 slices: one heavy slice, an empty one and light ones */
+    sptNnzIndex const ptr[] = { 0, 3, 3, 1000, 1001, 1040 };
+    sptNnzIndexVector unit_seg, unit_ptr;
+    result = spt_SplitHeavySegments(&unit_seg, &unit_ptr, ptr, 5, 64);
+    spt_CheckError(result, "split", NULL);
+    sptNnzIndex covered = 0;
+    for(sptNnzIndex u = 0; u < unit_seg.len; ++u) {
+        sptNnzIndex const s = unit_seg.data[u];
+        sptNnzIndex const len = unit_ptr.data[u+1] - unit_ptr.data[u];
+        if(len == 0 || len > 64 || unit_ptr.data[u] < ptr[s] || unit_ptr.data[u+1] > ptr[s+1]) {
+            printf("spt_SplitHeavySegments: bad unit %lu\n", (unsigned long) u);
+            return 1;
+        }
+        covered += len;
+    }
+    /* 1 + 16 + 1 + 1 units */
+    if(unit_seg.len != 19 || unit_ptr.len != 20 || covered != ptr[5]) {
+        printf("spt_SplitHeavySegments: %lu units cover %lu nonzeros\n", (unsigned long) unit_seg.len, (unsigned long) covered);
+        return 1;
+    }
+    sptFreeNnzIndexVector(&unit_seg);
+    sptFreeNnzIndexVector(&unit_ptr);
+
+    /* Balanced parts keep segments whole and stray from the share by less than a segment */
+    sptNnzIndex even[11];
+    for(int s = 0; s <= 10; ++s) {
+        even[s] = 10 * s;
+    }
+    sptNnzIndex bounds[5];
+    result = spt_PartitionSegments(bounds, even, 10, 4);
+    spt_CheckError(result, "partition", NULL);
+    for(int t = 0; t < 4; ++t) {
+        sptNnzIndex const part = even[bounds[t+1]] - even[bounds[t]];
+        if(bounds[t] > bounds[t+1] || part < 25 - 10 || part > 25 + 10) {
+            printf("spt_PartitionSegments: part %d has %lu nonzeros\n", t, (unsigned long) part);
+            return 1;
+        }
+    }
+    result = spt_PartitionSegments(bounds, ptr, 5, 3);
+    spt_CheckError(result, "partition", NULL);
+    if(bounds[0] != 0 || bounds[1] != 2 || bounds[2] != 3 || bounds[3] != 5) {
+        printf("spt_PartitionSegments: bad cuts around the heavy segment\n");
+        return 1;
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* Lexicographic comparison of nonzeros x and y over modes[0..nkeys), after a right shift */
+static int spt_CompareKeys(const sptSparseTensor *tsr, sptNnzIndex x, sptNnzIndex y, sptIndex nkeys, const sptIndex *modes, int shift) {
+    for(sptIndex k = 0; k < nkeys; ++k) {
+        sptIndex a = tsr->inds[modes[k]].data[x] >> shift;
+        sptIndex b = tsr->inds[modes[k]].data[y] >> shift;
+        if(a != b) {
+            return a < b ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int spt_CheckSorted(const sptSparseTensor *tsr, sptIndex nkeys, const sptIndex *modes, int shift, double checksum) {
+    double sum = 0;
+    for(sptNnzIndex z = 0; z < tsr->nnz; ++z) {
+        if(z > 0 && spt_CompareKeys(tsr, z - 1, z, nkeys, modes, shift) > 0) {
+            return 1;
+        }
+        /* Values must travel with their coordinates, rounded to sptValue as stored */
+        double key = 0;
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            key = key * 1000 + tsr->inds[m].data[z];
+        }
+        if(tsr->values.data[z] != (sptValue) key) {
+            return 1;
+        }
+        sum += tsr->values.data[z];
+    }
+    return sum != checksum;
+}
+
+/* Number of times the 2^bits block changes along the nonzero order */
+static sptNnzIndex spt_CountBlockChanges(const sptSparseTensor *tsr, int bits) {
+    sptNnzIndex changes = 0;
+    for(sptNnzIndex z = 1; z < tsr->nnz; ++z) {
+        for(sptIndex m = 0; m < tsr->nmodes; ++m) {
+            if((tsr->inds[m].data[z-1] >> bits) != (tsr->inds[m].data[z] >> bits)) {
+                ++changes;
+                break;
+            }
+        }
+    }
+    return changes;
+}
+
+/* Curve orders must keep every aligned block contiguous, at every block size */
+static int spt_CheckBlocksContiguous(sptSparseTensor *tsr) {
+    sptSparseTensor lex;
+    sptCopySparseTensor(&lex, tsr, 1);
+    for(int bits = 1; bits <= 4; ++bits) {
+        sptNnzIndex curve_changes = spt_CountBlockChanges(tsr, bits);
+        sptSparseTensorSortIndexRowBlock(&lex, 1, 0, lex.nnz, bits, 1);
+        if(curve_changes != spt_CountBlockChanges(&lex, bits)) {
+            sptFreeSparseTensor(&lex);
+            return 1;
+        }
+    }
+    sptFreeSparseTensor(&lex);
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 300, 7, 1000, 45 };
+    sptIndex const nmodes = 4;
+    sptNnzIndex const nnz = 50000;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+
+    srand(7);
+    double checksum = 0;
+    for(sptNnzIndex z = 0; z < nnz; ++z) {
+        double key = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptIndex i = (sptIndex) (rand() % ndims[m]);
+            sptAppendIndexVector(&X.inds[m], i);
+            key = key * 1000 + i;
+        }
+        sptAppendValueVector(&X.values, key);
+        checksum += (sptValue) key;
+    }
+    X.nnz = nnz;
+
+    sptIndex const lex[] = { 0, 1, 2, 3 };
+    sptSparseTensorSortIndex(&X, 1);
+    if(spt_CheckSorted(&X, 4, lex, 0, checksum) != 0) {
+        printf("sptSparseTensorSortIndex failed\n");
+        return 1;
+    }
+
+    sptIndex const at_mode[] = { 0, 2, 3, 1 };
+    sptSparseTensorSortIndexAtMode(&X, 1, 1);
+    if(spt_CheckSorted(&X, 4, at_mode, 0, checksum) != 0) {
+        printf("sptSparseTensorSortIndexAtMode failed\n");
+        return 1;
+    }
+
+    sptIndex const single[] = { 2 };
+    sptSparseTensorSortIndexSingleMode(&X, 1, 2);
+    if(spt_CheckSorted(&X, 1, single, 0, checksum) != 0) {
+        printf("sptSparseTensorSortIndexSingleMode failed\n");
+        return 1;
+    }
+
+    sptIndex except[] = { 3, 0, 2, 1 };
+    sptSparseTensorSortIndexExceptSingleMode(&X, 1, except, 2);
+    if(spt_CheckSorted(&X, 3, except, 0, checksum) != 0) {
+        printf("sptSparseTensorSortIndexExceptSingleMode failed\n");
+        return 1;
+    }
+
+    sptSparseTensorSortIndexRowBlock(&X, 1, 0, nnz, 3, 2);
+    if(spt_CheckSorted(&X, 4, lex, 3, checksum) != 0) {
+        printf("sptSparseTensorSortIndexRowBlock failed\n");
+        return 1;
+    }
+
+    sptFreeSparseTensor(&X);
+
+    /* Morton and Hilbert orders for a 5th-order tensor */
+    sptIndex const ndims5[] = { 40, 17, 64, 9, 33 };
+    sptSparseTensor Y;
+    result = sptNewSparseTensor(&Y, 5, ndims5);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 20000; ++z) {
+        for(sptIndex m = 0; m < 5; ++m) {
+            sptAppendIndexVector(&Y.inds[m], (sptIndex) (rand() % ndims5[m]));
+        }
+        sptAppendValueVector(&Y.values, (sptValue) z);
+    }
+    Y.nnz = 20000;
+
+    sptSparseTensorSortIndexMorton(&Y, 1, 0, Y.nnz, 2);
+    for(sptNnzIndex z = 1; z < Y.nnz; ++z) {
+        /* Compare interleaved keys from the most significant bit level down */
+        int cmp = 0;
+        for(int b = 5; b >= 0 && cmp == 0; --b) {
+            for(int m = 4; m >= 0 && cmp == 0; --m) {
+                int x = (Y.inds[m].data[z-1] >> b) & 1, y = (Y.inds[m].data[z] >> b) & 1;
+                cmp = x - y;
+            }
+        }
+        if(cmp > 0) {
+            printf("Morton order violated at %"PARTI_PRI_NNZ_INDEX"\n", z);
+            return 1;
+        }
+    }
+    if(spt_CheckBlocksContiguous(&Y) != 0) {
+        printf("Morton blocks are not contiguous\n");
+        return 1;
+    }
+
+    result = sptSparseTensorSortIndexHilbert(&Y, 1, 0, Y.nnz, 2);
+    spt_CheckError(result, "hilbert", NULL);
+    if(spt_CheckBlocksContiguous(&Y) != 0) {
+        printf("Hilbert blocks are not contiguous\n");
+        return 1;
+    }
+
+    sptFreeSparseTensor(&Y);
+    return 0;
+}
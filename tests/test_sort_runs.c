@@ -0,0 +1,111 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#include <string.h>
+
+#define NRUNS 6
+#define RUN_NNZ 3000
+
+/* A tensor made of nruns sorted chunks, values tied to their coordinates */
+static void spt_MakeRuns(sptSparseTensor *X, sptIndex const ndims[], int const nruns) {
+    sptNewSparseTensor(X, 3, ndims);
+    for(int r = 0; r < nruns; ++r) {
+        sptSparseTensor chunk;
+        sptGenerateSparseTensor(&chunk, 3, ndims, RUN_NNZ, SPT_GEN_UNIFORM, 0, 100 + r, 1);
+        sptSparseTensorSortIndex(&chunk, 1);
+        for(sptNnzIndex z = 0; z < chunk.nnz; ++z) {
+            for(sptIndex m = 0; m < 3; ++m) {
+                sptAppendIndexVector(&X->inds[m], chunk.inds[m].data[z]);
+            }
+            sptAppendValueVector(&X->values, chunk.inds[0].data[z] * 1e6 + chunk.inds[1].data[z] * 1e3 + chunk.inds[2].data[z]);
+            ++X->nnz;
+        }
+        sptFreeSparseTensor(&chunk);
+    }
+}
+
+static int spt_SameTensor(sptSparseTensor const *A, sptSparseTensor const *B) {
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(memcmp(A->inds[m].data, B->inds[m].data, A->nnz * sizeof (sptIndex)) != 0) {
+            return 0;
+        }
+    }
+    return memcmp(A->values.data, B->values.data, A->nnz * sizeof (sptValue)) == 0;
+}
+
+/* Concatenated sorted runs are merged into the order a full sort gives, with any thread count */
+int main(void) {
+    sptIndex const ndims[3] = { 50, 40, 30 };
+    for(int nruns = 1; nruns <= 2 * NRUNS; nruns += NRUNS - 1) {
+        sptSparseTensor ref;
+        spt_MakeRuns(&ref, ndims, nruns);
+        sptSetSortAdaptive(0);
+        sptSparseTensorSortIndex(&ref, 1);
+        sptSetSortAdaptive(1);
+        for(int nt = 1; nt <= 4; nt += 3) {
+            sptExecContext ctx;
+            sptNewExecContext(&ctx, nt);
+            sptExecContext const * const prev = sptSetExecContext(&ctx);
+            sptSparseTensor X;
+            spt_MakeRuns(&X, ndims, nruns);
+            sptSparseTensorSortIndex(&X, 1);
+            if(!spt_SameTensor(&X, &ref)) {
+                printf("%d runs merged with %d threads differ from the full sort\n", nruns, nt);
+                return 1;
+            }
+            /* Sorting again finds one run and leaves it */
+            sptSparseTensorSortIndex(&X, 1);
+            if(!spt_SameTensor(&X, &ref)) {
+                printf("re-sorting a sorted tensor changed it\n");
+                return 1;
+            }
+            /* Other key orders go through the same check */
+            sptIndex const order[3] = { 2, 0, 1 };
+            sptSparseTensorSortIndexCustomOrder(&X, order, 1);
+            for(sptNnzIndex z = 1; z < X.nnz; ++z) {
+                sptIndex const * a = &X.inds[2].data[z-1], * b = &X.inds[2].data[z];
+                if(*a > *b || (*a == *b && X.inds[0].data[z-1] > X.inds[0].data[z])) {
+                    printf("custom order not sorted at %"PARTI_PRI_NNZ_INDEX"\n", z);
+                    return 1;
+                }
+            }
+            sptSetExecContext(prev);
+            sptFreeSparseTensor(&X);
+        }
+        sptFreeSparseTensor(&ref);
+    }
+
+    /* Past the run limit the full sort takes over */
+    sptSparseTensor X;
+    spt_MakeRuns(&X, ndims, 100);
+    sptSparseTensorSortIndex(&X, 1);
+    for(sptNnzIndex z = 1; z < X.nnz; ++z) {
+        if(X.values.data[z-1] > X.values.data[z]) {
+            printf("many runs not sorted at %"PARTI_PRI_NNZ_INDEX"\n", z);
+            return 1;
+        }
+    }
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 40
+#define J 30
+#define K 20
+
+/* Sparse to semi sparse sorts and merges duplicate fibers, and the way back prunes by epsilon */
+int main(void) {
+    sptIndex const ndims[] = { I, J, K };
+    static double dense[I * J * K];
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(17);
+    for(int n = 0; n < 5000; ++n) {
+        sptIndex const i = rand() % I, j = rand() % J, k = rand() % K;
+        /* Small integers so sums are exact and some cancel to zero */
+        sptValue const v = (sptValue) (rand() % 7 - 3);
+        sptAppendIndexVector(&X.inds[0], i);
+        sptAppendIndexVector(&X.inds[1], j);
+        sptAppendIndexVector(&X.inds[2], k);
+        sptAppendValueVector(&X.values, v);
+        ++X.nnz;
+        dense[(i * J + j) * K + k] += v;
+    }
+
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        sptSemiSparseTensor Y;
+        result = sptSparseTensorToSemiSparseTensor(&Y, &X, mode);
+        spt_CheckError(result, "to semi sparse", NULL);
+        sptIndex const a = mode == 0 ? 1 : 0, b = mode == 2 ? 1 : 2;
+        for(sptNnzIndex f = 0; f < Y.nnz; ++f) {
+            if(f > 0 && (Y.inds[a].data[f] < Y.inds[a].data[f-1] ||
+                (Y.inds[a].data[f] == Y.inds[a].data[f-1] && Y.inds[b].data[f] <= Y.inds[b].data[f-1]))) {
+                printf("mode %u: fiber %lu out of order or repeated\n", (unsigned) mode, (unsigned long) f);
+                return 1;
+            }
+            for(sptIndex d = 0; d < ndims[mode]; ++d) {
+                sptIndex c[3];
+                c[a] = Y.inds[a].data[f];
+                c[b] = Y.inds[b].data[f];
+                c[mode] = d;
+                if(Y.values.values[f * Y.stride + d] != dense[(c[0] * J + c[1]) * K + c[2]]) {
+                    printf("mode %u: fiber %lu value %u merged wrong\n", (unsigned) mode, (unsigned long) f, (unsigned) d);
+                    return 1;
+                }
+            }
+        }
+
+        sptSparseTensor Z;
+        result = sptSemiSparseTensorToSparseTensor(&Z, &Y, 1e-6);
+        spt_CheckError(result, "to sparse", NULL);
+        sptNnzIndex expect = 0;
+        for(size_t p = 0; p < I * J * K; ++p) {
+            expect += dense[p] != 0;
+        }
+        if(Z.nnz != expect) {
+            printf("mode %u: %lu nonzeros, expected %lu\n", (unsigned) mode, (unsigned long) Z.nnz, (unsigned long) expect);
+            return 1;
+        }
+        for(sptNnzIndex z = 0; z < Z.nnz; ++z) {
+            size_t const p = ((size_t) Z.inds[0].data[z] * J + Z.inds[1].data[z]) * K + Z.inds[2].data[z];
+            if(Z.values.data[z] != dense[p]) {
+                printf("mode %u: nonzero %lu converted wrong\n", (unsigned) mode, (unsigned long) z);
+                return 1;
+            }
+        }
+        sptFreeSparseTensor(&Z);
+        sptFreeSemiSparseTensor(&Y);
+    }
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../src/error/error.h"
+
+static int spt_Near(double a, double b, double tol) {
+    return fabs(a - b) <= tol * (fabs(b) + 1);
+}
+
+/* Exact statistics of a dense cube, sampled ones close to them, and the format each shape calls for */
+int main(void) {
+    sptIndex const ndims[] = { 64, 64, 64 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    /* A dense 16^3 cube at an offset aligned to 16 */
+    for(sptIndex i = 0; i < 16; ++i) {
+        for(sptIndex j = 0; j < 16; ++j) {
+            for(sptIndex k = 0; k < 16; ++k) {
+                sptAppendIndexVector(&X.inds[0], 16 + i);
+                sptAppendIndexVector(&X.inds[1], 32 + j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, 1);
+            }
+        }
+    }
+    X.nnz = 4096;
+
+    sptSparseTensorStats st;
+    result = sptSparseTensorStatistics(&st, &X, 0, 3);
+    spt_CheckError(result, "stats", NULL);
+    sptSparseTensorStatsPrint(&st, stdout);
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(st.nslices[m] != 16 || st.max_slice[m] != 256 || !spt_Near(st.slice_skew[m], 1, 1e-9) ||
+            st.nfibers[m] != 256 || st.slice_hist[m * SPT_STATS_BINS + 8] != 16 || st.fiber_hist[m * SPT_STATS_BINS + 4] != 256) {
+            printf("Cube slice or fiber statistics wrong in mode %"PARTI_PRI_INDEX"\n", m);
+            return 1;
+        }
+    }
+    /* Row-major storage: the last mode moves by one, the first mostly stays */
+    if(!spt_Near(st.reuse[0], 4080.0 / 4095, 1e-9) || st.reuse[2] != 0 || st.near[2] != 1 ||
+        !spt_Near(st.block_fill[0], 1, 1e-9) || !spt_Near(st.block_fill[4], 4096, 1e-9) || !spt_Near(st.block_fill[2], 64, 1e-9)) {
+        printf("Cube locality or block fill wrong\n");
+        return 1;
+    }
+    sptFormatAdvice advice;
+    result = sptRecommendFormat(&advice, &st, 4);
+    spt_CheckError(result, "recommend", NULL);
+    if(advice.format != SPT_FORMAT_HICOO || advice.sb_bits != 4 || advice.sk_bits < advice.sb_bits) {
+        printf("A dense cube should go to HiCOO with 16^3 blocks\n");
+        return 1;
+    }
+    sptFreeFormatAdvice(&advice);
+
+    /* A sample of a tenth estimates the counts */
+    sptSparseTensorStats sampled;
+    result = sptSparseTensorStatistics(&sampled, &X, 400, 3);
+    spt_CheckError(result, "sampled stats", NULL);
+    if(sampled.nsampled < 200 || sampled.nsampled > 400) {
+        printf("Sample of %"PARTI_PRI_NNZ_INDEX" nonzeros\n", sampled.nsampled);
+        return 1;
+    }
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(!spt_Near(sampled.nslices[m], st.nslices[m], 0.25) || !spt_Near(sampled.max_slice[m], st.max_slice[m], 0.25)) {
+            printf("Sampled slices off in mode %"PARTI_PRI_INDEX": %.1f of %.1f, largest %.1f\n", m, sampled.nslices[m], st.nslices[m], sampled.max_slice[m]);
+            return 1;
+        }
+    }
+    sptFreeSparseTensorStats(&sampled);
+    sptFreeSparseTensorStats(&st);
+    sptFreeSparseTensor(&X);
+
+    /* Scattered nonzeros share no blocks or fibers: plain COO */
+    sptIndex const wide[] = { 1000000, 1000000, 1000000 };
+    result = sptNewSparseTensor(&X, 3, wide);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 3001; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) ((rand() * 7919ULL) % wide[m]));
+        }
+        sptAppendValueVector(&X.values, 1);
+    }
+    X.nnz = 3001;
+    result = sptSparseTensorStatistics(&st, &X, 0, 3);
+    spt_CheckError(result, "stats", NULL);
+    result = sptRecommendFormat(&advice, &st, 4);
+    spt_CheckError(result, "recommend", NULL);
+    if(advice.format != SPT_FORMAT_COO) {
+        printf("Hypersparse scattered nonzeros should stay COO, got format %d\n", (int) advice.format);
+        return 1;
+    }
+    sptFreeFormatAdvice(&advice);
+    sptFreeSparseTensorStats(&st);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
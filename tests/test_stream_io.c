@@ -0,0 +1,122 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+
+/* Read odd ranges of the file through an async reader and compare them with the contents */
+static int spt_CheckReader(char const * filename, unsigned char const * contents, size_t const size) {
+    spt_AsyncReader * r;
+    int result = spt_AsyncReaderOpen(&r, filename, 2);
+    spt_CheckError(result, "open reader", NULL);
+    size_t const starts[] = { 0, 1, 4095, 4097, 1 << 20, size / 3 };
+    size_t const nstarts = sizeof starts / sizeof starts[0];
+    unsigned char * buf = malloc(size * 2);
+    spt_CheckOSError(buf == NULL, "malloc");
+    for(size_t i = 0; i < nstarts; ++i) {
+        size_t const a = starts[i], b = (size - a) / 2, c = size - a - b;
+        result = spt_AsyncReaderSubmit(r, 0, buf, b, a);
+        spt_CheckError(result, "submit", NULL);
+        result = spt_AsyncReaderSubmit(r, 1, buf + size, c, a + b);
+        spt_CheckError(result, "submit", NULL);
+        result = spt_AsyncReaderWait(r, 1);
+        spt_CheckError(result, "wait", NULL);
+        result = spt_AsyncReaderWait(r, 0);
+        spt_CheckError(result, "wait", NULL);
+        if(memcmp(buf, contents + a, b) != 0 || memcmp(buf + size, contents + a + b, c) != 0) {
+            printf("Async read from %zu differs (io_uring %d)\n", a, spt_AsyncReaderUsesUring(r));
+            return 1;
+        }
+    }
+    free(buf);
+    spt_AsyncReaderClose(r);
+    return 0;
+}
+
+int main(void) {
+    sptSparseTensor X;
+    sptIndex const dims[] = { 200, 150, 100 };
+    int result = sptGenerateSparseTensor(&X, 3, dims, 300000, SPT_GEN_UNIFORM, 0, 11, 1);
+    spt_CheckError(result, "generate", NULL);
+    char filename[] = "/tmp/parti_test_stream_io_XXXXXX";
+    int fd = mkstemp(filename);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+    FILE *stream = fopen(filename, "wb");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensorBinary(&X, stream);
+    spt_CheckError(result, "dump binary", NULL);
+    fclose(stream);
+
+    /* The reader must return the file's bytes at any alignment, through either backend */
+    stream = fopen(filename, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    fseek(stream, 0, SEEK_END);
+    size_t const size = (size_t) ftell(stream);
+    rewind(stream);
+    unsigned char * contents = malloc(size);
+    spt_CheckOSError(contents == NULL, "malloc");
+    if(fread(contents, 1, size, stream) != size) {
+        printf("Short read of %s\n", filename);
+        return 1;
+    }
+    fclose(stream);
+    for(int uring = 1; uring >= 0; --uring) {
+        sptSetStreamIoUring(uring);
+        sptSetStreamQueueDepth(uring ? 8 : 3);
+        if(spt_CheckReader(filename, contents, size) != 0) {
+            return 1;
+        }
+    }
+    free(contents);
+
+    /* Streaming CPD must not depend on the backend, the queue depth or the prefetch distance */
+    struct { int uring, depth; sptIndex distance; } const configs[] = {
+        { 1, 32, 1 }, { 0, 4, 1 }, { 1, 1, 0 }, { 0, 2, 3 }, { 1, 16, 5 },
+    };
+    double ref = 0;
+    for(size_t c = 0; c < sizeof configs / sizeof configs[0]; ++c) {
+        sptSetStreamIoUring(configs[c].uring);
+        sptSetStreamQueueDepth(configs[c].depth);
+        sptSetStreamPrefetchDistance(configs[c].distance);
+        sptKruskalTensor K;
+        sptSetRandomSeed(3);
+        result = sptCpdAlsStream(filename, 4, 3, 0, 70000, 1, &K);
+        spt_CheckError(result, "stream cpd", NULL);
+        if(c == 0) {
+            ref = K.fit;
+        } else if(fabs(K.fit - ref) > 1e-9) {
+            printf("Streaming fit %g differs from %g (io_uring %d, depth %d, distance %u)\n",
+                K.fit, ref, configs[c].uring, configs[c].depth, (unsigned) configs[c].distance);
+            return 1;
+        }
+        sptFreeKruskalTensor(&K);
+    }
+
+    unlink(filename);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "cpd_fit.h"
+
+#define N 10
+
+/* Compare the symmetric MTTKRP of S with the COO MTTKRP of its expansion X */
+static int check_mttkrp(sptSymmSparseTensor const * S, sptSparseTensor * X, sptIndex const rank) {
+    sptIndex const nmodes = S->nmodes;
+    sptMatrix U, M;
+    sptNewMatrix(&U, S->ndim, rank);
+    sptRandomizeMatrix(&U, S->ndim, rank);
+    sptNewMatrix(&M, S->ndim, rank);
+    int result = sptOmpSymmMTTKRP(S, &U, &M, 2);
+    spt_CheckError(result, "symm mttkrp", NULL);
+
+    sptMatrix ** mats = malloc((nmodes + 1) * sizeof *mats);
+    sptIndex * order = malloc(nmodes * sizeof *order);
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        mats[m] = &U;
+        order[m] = m;
+    }
+    sptMatrix out;
+    sptNewMatrix(&out, S->ndim, rank);
+    mats[nmodes] = &out;
+    int bad = 0;
+    for(sptIndex mode = 0; mode < nmodes; ++mode) {
+        order[0] = mode;
+        for(sptIndex i = 1; i < nmodes; ++i) {
+            order[i] = (mode + i) % nmodes;
+        }
+        sptConstantMatrix(&out, 0);
+        result = sptOmpMTTKRP(X, mats, order, mode, 1);
+        spt_CheckError(result, "mttkrp", NULL);
+        /* Entries may cancel to near zero; rounding is bounded by the largest */
+        double scale = 0;
+        for(sptIndex i = 0; i < S->ndim; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                scale = fmax(scale, fabs(out.values[i * out.stride + r]));
+            }
+        }
+        for(sptIndex i = 0; i < S->ndim; ++i) {
+            for(sptIndex r = 0; r < rank; ++r) {
+                double const want = out.values[i * out.stride + r], got = M.values[i * M.stride + r];
+                if(fabs(want - got) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+                    printf("mode %"PARTI_PRI_INDEX" row %"PARTI_PRI_INDEX" column %"PARTI_PRI_INDEX": symmetric MTTKRP %g, COO %g\n", mode, i, r, got, want);
+                    bad = 1;
+                }
+            }
+        }
+    }
+    free(mats);
+    free(order);
+    sptFreeMatrix(&out);
+    sptFreeMatrix(&U);
+    sptFreeMatrix(&M);
+    return bad;
+}
+
+int main(void) {
+    /* A sparse 4th-order symmetric tensor, its coordinates given unsorted and with repeats */
+    sptSymmSparseTensor S;
+    int result = sptNewSymmSparseTensor(&S, 4, N);
+    spt_CheckError(result, "new", NULL);
+    srand(7);
+    for(int e = 0; e < 40; ++e) {
+        sptIndex c[4];
+        for(int m = 0; m < 4; ++m) {
+            c[m] = rand() % (e % 3 == 0 ? 3 : N);
+        }
+        result = sptAppendSymmSparseTensor(&S, c, (sptValue) (rand() % 19 - 9) / 4);
+        spt_CheckError(result, "append", NULL);
+    }
+    for(sptNnzIndex z = 0; z < S.nnz; ++z) {
+        for(sptIndex m = 1; m < 4; ++m) {
+            if(S.inds[m-1].data[z] > S.inds[m].data[z]) {
+                printf("entry %lu is not sorted\n", (unsigned long) z);
+                return 1;
+            }
+        }
+    }
+
+    /* Expansion holds every permutation, and compressing it gives S back */
+    sptSparseTensor X;
+    result = sptSparseTensorFromSymmSparseTensor(&X, &S, 2);
+    spt_CheckError(result, "expand", NULL);
+    double normsq = 0;
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        normsq += X.values.data[x] * X.values.data[x];
+    }
+    if(fabs(normsq - sptSymmSparseTensorNormSquared(&S, 2)) > 1e3 * PARTI_VALUE_EPSILON * normsq) {
+        printf("norm of the expansion %g, symmetric norm %g\n", normsq, sptSymmSparseTensorNormSquared(&S, 2));
+        return 1;
+    }
+    sptSymmSparseTensor T;
+    result = sptSymmSparseTensorFromSparseTensor(&T, &X, 2);
+    spt_CheckError(result, "compress", NULL);
+    if(T.nnz != S.nnz) {
+        printf("compressed %lu entries back to %lu\n", (unsigned long) S.nnz, (unsigned long) T.nnz);
+        return 1;
+    }
+    sptFreeSymmSparseTensor(&T);
+
+    if(check_mttkrp(&S, &X, 5)) {
+        return 1;
+    }
+
+    /* TTV is the rank-1 MTTKRP */
+    sptValueVector v, y;
+    sptNewValueVector(&v, N, N);
+    sptNewValueVector(&y, N, N);
+    for(sptIndex i = 0; i < N; ++i) {
+        v.data[i] = (sptValue) (i % 4) - 1.5;
+    }
+    result = sptOmpSymmTTV(&S, &v, &y, 2);
+    spt_CheckError(result, "ttv", NULL);
+    for(sptIndex i = 0; i < N; ++i) {
+        double want = 0, magnitude = 0;
+        for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+            if(X.inds[0].data[x] == i) {
+                double const t = X.values.data[x] * v.data[X.inds[1].data[x]] * v.data[X.inds[2].data[x]] * v.data[X.inds[3].data[x]];
+                want += t;
+                magnitude += fabs(t);
+            }
+        }
+        if(fabs(want - y.data[i]) > 1e3 * PARTI_VALUE_EPSILON * (1 + magnitude)) {
+            printf("TTV row %"PARTI_PRI_INDEX": %g, expected %g\n", i, y.data[i], want);
+            return 1;
+        }
+    }
+    sptFreeValueVector(&v);
+    sptFreeValueVector(&y);
+    sptFreeSparseTensor(&X);
+    sptFreeSymmSparseTensor(&S);
+
+    /* An exact symmetric rank-2 third-order tensor, one weight negative */
+    result = sptNewSymmSparseTensor(&S, 3, N);
+    spt_CheckError(result, "new", NULL);
+    for(sptIndex i = 0; i < N; ++i) {
+        for(sptIndex j = i; j < N; ++j) {
+            for(sptIndex k = j; k < N; ++k) {
+                sptIndex const c[3] = { k, i, j };
+                double const v = 2.0 * (1 + i % 3) * (1 + j % 3) * (1 + k % 3) - 8.0 * (i % 4 - 1.5) * (j % 4 - 1.5) * (k % 4 - 1.5);
+                sptAppendSymmSparseTensor(&S, c, v);
+            }
+        }
+    }
+    result = sptSparseTensorFromSymmSparseTensor(&X, &S, 1);
+    spt_CheckError(result, "expand", NULL);
+    if(X.nnz != N * N * N) {
+        printf("expanded to %lu entries\n", (unsigned long) X.nnz);
+        return 1;
+    }
+    if(check_mttkrp(&S, &X, 3)) {
+        return 1;
+    }
+
+    sptIndex const ndims[3] = { N, N, N };
+    sptKruskalTensor kt;
+    sptNewKruskalTensor(&kt, 3, ndims, 2);
+    sptSetRandomSeed(1);
+    result = sptCpdAlsSymmetric(&S, 2, 50, 1e-10, 2, &kt);
+    spt_CheckError(result, "symmetric cpd", NULL);
+    double const fit = model_fit(&X, &kt);
+    if(fabs(fit - kt.fit) > 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("reported fit %f, model fit %f\n", kt.fit, fit);
+        return 1;
+    }
+    if(fit < 0.99) {
+        printf("symmetric CPD fit %f on an exact rank-2 tensor\n", fit);
+        return 1;
+    }
+
+    sptFreeKruskalTensor(&kt);
+    sptFreeSparseTensor(&X);
+    sptFreeSymmSparseTensor(&S);
+    return 0;
+}
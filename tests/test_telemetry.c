@@ -0,0 +1,149 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+static void spt_CountSamples(char const * name, sptTelemetryKind kind, double value, void * ctx) {
+    (void) name;
+    (void) kind;
+    (void) value;
+    #pragma omp atomic
+    ++ *(int *) ctx;
+}
+
+static sptTelemetryRecord const * spt_FindRecord(sptTelemetryRecord const * records, size_t n, char const * name) {
+    for(size_t i = 0; i < n; ++i) {
+        if(strcmp(records[i].name, name) == 0) {
+            return &records[i];
+        }
+    }
+    return NULL;
+}
+
+int main(void) {
+    sptSetTelemetryPrint(0);
+    int hooked = 0;
+    sptSetTelemetryHook(spt_CountSamples, &hooked);
+
+    #pragma omp parallel for
+    for(int i = 0; i < 100; ++i) {
+        sptTelemetryRecordTime("test phase", 0.5 + i);
+        sptTelemetryAddCounter("test bytes", 8);
+    }
+    /* A name in a reused buffer must not alias the previous one */
+    char name[16];
+    strcpy(name, "test a");
+    sptTelemetryAddCounter(name, 1);
+    strcpy(name, "test b");
+    sptTelemetryAddCounter(name, 2);
+
+    sptTimer timer;
+    sptNewTimer(&timer, 0);
+    sptStartTimer(timer);
+    sptStopTimer(timer);
+    double const elapsed = sptPrintElapsedTime(timer, "test timer");
+    sptFreeTimer(timer);
+
+    sptTelemetryRecord records[16];
+    size_t const n = sptTelemetrySnapshot(records, 16);
+    sptTelemetryRecord const * phase = spt_FindRecord(records, n, "test phase");
+    sptTelemetryRecord const * bytes = spt_FindRecord(records, n, "test bytes");
+    sptTelemetryRecord const * a = spt_FindRecord(records, n, "test a");
+    sptTelemetryRecord const * b = spt_FindRecord(records, n, "test b");
+    sptTelemetryRecord const * t = spt_FindRecord(records, n, "test timer");
+    if(n != 5 || !phase || !bytes || !a || !b || !t) {
+        printf("snapshot is missing entries\n");
+        return 1;
+    }
+    if(phase->kind != SPT_TELEMETRY_TIMER || phase->count != 100 || phase->total != 5000 || phase->min != 0.5 || phase->max != 99.5) {
+        printf("timer aggregate is wrong\n");
+        return 1;
+    }
+    if(bytes->kind != SPT_TELEMETRY_COUNTER || bytes->count != 100 || bytes->total != 800) {
+        printf("counter aggregate is wrong\n");
+        return 1;
+    }
+    if(a->total != 1 || b->total != 2 || t->count != 1 || t->total != elapsed) {
+        printf("entries are mixed up\n");
+        return 1;
+    }
+    if(hooked != 203) {
+        printf("hook saw %d samples\n", hooked);
+        return 1;
+    }
+
+    char buf[4096];
+    FILE * fp = tmpfile();
+    sptAssert(fp != NULL);
+    sptAssert(sptTelemetryExport(fp, SPT_TELEMETRY_JSON) == 0);
+    rewind(fp);
+    size_t len = fread(buf, 1, sizeof buf - 1, fp);
+    buf[len] = '\0';
+    if(buf[0] != '[' || strstr(buf, "{\"name\": \"test phase\", \"kind\": \"timer\", \"count\": 100, \"total\": 5000,") == NULL) {
+        printf("JSON export is wrong:\n%s", buf);
+        return 1;
+    }
+    fclose(fp);
+
+    fp = tmpfile();
+    sptAssert(fp != NULL);
+    sptAssert(sptTelemetryExport(fp, SPT_TELEMETRY_CSV) == 0);
+    rewind(fp);
+    len = fread(buf, 1, sizeof buf - 1, fp);
+    buf[len] = '\0';
+    if(strncmp(buf, "name,kind,count,total,min,max\n", 30) != 0 || strstr(buf, "\n\"test bytes\",counter,100,800,8,8\n") == NULL) {
+        printf("CSV export is wrong:\n%s", buf);
+        return 1;
+    }
+    fclose(fp);
+
+    sptTelemetryReset();
+    sptSetTelemetryHook(NULL, NULL);
+    if(sptTelemetrySnapshot(records, 16) != 5 || records[0].count != 0 || records[0].total != 0) {
+        printf("reset failed\n");
+        return 1;
+    }
+
+    /* A probed kernel reports its model, with or without hardware events */
+    sptSetHardwareCounters(1);
+    sptIndex const ndims[] = { 100, 100 };
+    sptSparseTensor X;
+    sptAssert(sptNewSparseTensor(&X, 2, ndims) == 0);
+    for(sptNnzIndex z = 0; z < 10000; ++z) {
+        sptAppendIndexVector(&X.inds[0], (sptIndex) (z * 7919 % 100));
+        sptAppendIndexVector(&X.inds[1], (sptIndex) (z % 100));
+        sptAppendValueVector(&X.values, 1);
+    }
+    X.nnz = 10000;
+    sptSparseTensorSortIndex(&X, 1);
+    sptSetHardwareCounters(0);
+    sptFreeSparseTensor(&X);
+    sptTelemetryRecord many[64];
+    size_t const nmany = sptTelemetrySnapshot(many, 64);
+    sptTelemetryRecord const * sort_time = spt_FindRecord(many, nmany, "CPU  SpTns Radix Sort");
+    sptTelemetryRecord const * sort_bytes = spt_FindRecord(many, nmany, "CPU  SpTns Radix Sort bytes");
+    if(!sort_time || sort_time->count != 1 || !sort_bytes || sort_bytes->total != 2.0 * 10000 * (2 * sizeof (sptIndex) + sizeof (sptValue))) {
+        printf("probed sort was not recorded\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+/* ||X - TT|| / ||X|| over every element of a small tensor */
+static double dense_fit(sptSparseTensor const * X, sptTensorTrain const * tt) {
+    sptIndex const nmodes = X->nmodes;
+    sptNnzIndex total = 1;
+    for(sptIndex m = 0; m < nmodes; ++m) {
+        total *= X->ndims[m];
+    }
+    double * dense = calloc(total, sizeof *dense);
+    for(sptNnzIndex x = 0; x < X->nnz; ++x) {
+        sptNnzIndex lin = 0;
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            lin = lin * X->ndims[m] + X->inds[m].data[x];
+        }
+        dense[lin] += X->values.data[x];
+    }
+    double normsq = 0, residsq = 0;
+    sptIndex inds[8];
+    for(sptNnzIndex lin = 0; lin < total; ++lin) {
+        sptNnzIndex rest = lin;
+        for(sptIndex m = nmodes; m-- > 0; ) {
+            inds[m] = rest % X->ndims[m];
+            rest /= X->ndims[m];
+        }
+        double const d = dense[lin] - sptTensorTrainValue(tt, inds);
+        normsq += dense[lin] * dense[lin];
+        residsq += d * d;
+    }
+    free(dense);
+    return 1 - sqrt(residsq / normsq);
+}
+
+int main(void) {
+    /* A 6th-order sum of two sparse rank-1 tensors, of TT rank 2 */
+    sptIndex const ndims[6] = { 8, 7, 9, 6, 8, 7 };
+    sptIndex const max_ranks[5] = { 4, 4, 4, 4, 4 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 6, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(int t = 0; t < 2; ++t) {
+        for(sptNnzIndex x = 0; x < 729; ++x) {
+            sptNnzIndex rest = x;
+            double v = t == 0 ? 1.5 : -0.75;
+            for(sptIndex m = 0; m < 6; ++m) {
+                sptIndex const j = rest % 3;
+                rest /= 3;
+                /* Supports {0, 2, 4} and {1, 2, 5} per mode */
+                sptIndex const i = t == 0 ? 2 * j : (j == 0 ? 1 : j == 1 ? 2 : 5);
+                sptAppendIndexVector(&X.inds[m], i);
+                v *= 1 + (double) (i + m) / 4;
+            }
+            sptAppendValueVector(&X.values, v);
+            ++X.nnz;
+        }
+    }
+    /* The two terms overlap on some elements, which must be summed */
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptSparseTensorCoalesce(&X, SPT_COALESCE_SUM, 1);
+    spt_CheckError(result, "coalesce", NULL);
+
+    sptTensorTrain tt;
+    result = sptNewTensorTrain(&tt, 6, ndims, max_ranks);
+    spt_CheckError(result, "new tt", NULL);
+    result = sptOmpTensorTrainSvd(&X, 1e-8, 2, &tt);
+    spt_CheckError(result, "tt-svd", NULL);
+    for(sptIndex m = 1; m < 6; ++m) {
+        if(tt.ranks[m] != 2) {
+            printf("TT rank %"PARTI_PRI_INDEX" is %"PARTI_PRI_INDEX", expected 2\n", m, tt.ranks[m]);
+            return 1;
+        }
+    }
+    if(tt.fit < 1 - 10 * sqrt(PARTI_VALUE_EPSILON)) {
+        printf("TT fit %f on an exact TT-rank-2 tensor\n", tt.fit);
+        return 1;
+    }
+    /* An element is a sum of products along the train, its rounding bounded by the largest element */
+    double scale = 0;
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        scale = fmax(scale, fabs(X.values.data[x]));
+    }
+    for(sptNnzIndex x = 0; x < X.nnz; ++x) {
+        sptIndex inds[6];
+        for(sptIndex m = 0; m < 6; ++m) {
+            inds[m] = X.inds[m].data[x];
+        }
+        double const v = sptTensorTrainValue(&tt, inds);
+        if(fabs(v - X.values.data[x]) > 1e4 * PARTI_VALUE_EPSILON * (1 + scale)) {
+            printf("element %lu: TT %g, tensor %g\n", (unsigned long) x, v, X.values.data[x]);
+            return 1;
+        }
+    }
+    sptFreeTensorTrain(&tt);
+    sptFreeSparseTensor(&X);
+
+    /* A random 4th-order tensor truncated to rank 3: the reported fit is the true one */
+    sptIndex const small[4] = { 5, 6, 4, 5 };
+    sptIndex const small_ranks[3] = { 3, 3, 3 };
+    result = sptNewSparseTensor(&X, 4, small);
+    spt_CheckError(result, "new", NULL);
+    srand(3);
+    for(int e = 0; e < 150; ++e) {
+        for(sptIndex m = 0; m < 4; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % small[m]);
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10 - 5);
+        ++X.nnz;
+    }
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptSparseTensorCoalesce(&X, SPT_COALESCE_SUM, 1);
+    spt_CheckError(result, "coalesce", NULL);
+    result = sptNewTensorTrain(&tt, 4, small, small_ranks);
+    spt_CheckError(result, "new tt", NULL);
+    result = sptOmpTensorTrainSvd(&X, 0, 2, &tt);
+    spt_CheckError(result, "tt-svd", NULL);
+    double const fit = dense_fit(&X, &tt);
+    if(fabs(fit - tt.fit) > 10 * sqrt(PARTI_VALUE_EPSILON) || fit <= 0) {
+        printf("reported fit %f, dense fit %f\n", tt.fit, fit);
+        return 1;
+    }
+    sptFreeTensorTrain(&tt);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+
+int main(void) {
+    /* Without a capacity tier everything falls back to the heap */
+    sptMemBacking const tier = sptCapacityTierAvailable() ? SPT_MEM_CAPACITY : SPT_MEM_DEFAULT;
+    size_t const big = (size_t) 4 << 20;
+
+    char * buf = sptMallocBacked(big, SPT_MEM_CAPACITY);
+    if(buf == NULL || sptMemBackingOf(buf) != tier || spt_MemRequestOf(buf) != SPT_MEM_CAPACITY) {
+        printf("SPT_MEM_CAPACITY buffer got %s\n", buf != NULL ? sptMemBackingString(sptMemBackingOf(buf)) : "nothing");
+        return 1;
+    }
+    memset(buf, 1, big);
+    buf = spt_Realloc(buf, big, 2 * big, SPT_MEM_DEFAULT);
+    if(buf == NULL || buf[big - 1] != 1 || sptMemBackingOf(buf) != tier) {
+        printf("Regrown SPT_MEM_CAPACITY buffer lost its backing or contents\n");
+        return 1;
+    }
+    if(tier == SPT_MEM_CAPACITY && sptCapacityBytesInUse() < 2 * big) {
+        printf("Capacity-tier memory in use not counted\n");
+        return 1;
+    }
+    sptFree(buf);
+
+    /* By default tensor data goes to the tier, matrices stay in DRAM */
+    if(sptDataPlacement(SPT_DATA_COO_INDICES) != tier || sptDataPlacement(SPT_DATA_HICOO_VALUES) != tier ||
+        sptDataPlacement(SPT_DATA_MATRICES) != SPT_MEM_DEFAULT) {
+        printf("Default placement is wrong\n");
+        return 1;
+    }
+    if(sptSetDataPlacement(SPT_NDATA_CLASSES, SPT_MEM_CAPACITY) == 0) {
+        printf("Unknown data class accepted\n");
+        return 1;
+    }
+
+    /* Tensors created under the policy keep their arrays' request as they grow */
+    sptSetDataPlacement(SPT_DATA_COO_INDICES, SPT_MEM_CAPACITY);
+    sptSetDataPlacement(SPT_DATA_COO_VALUES, SPT_MEM_CAPACITY);
+    sptSetDataPlacement(SPT_DATA_HICOO_INDICES, SPT_MEM_CAPACITY);
+    sptSetDataPlacement(SPT_DATA_HICOO_VALUES, SPT_MEM_DEFAULT);
+    sptIndex const ndims[] = { 120, 90, 60 };
+    sptSparseTensor X;
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 50000, SPT_GEN_UNIFORM, 0, 5, 1);
+    spt_CheckError(result, "generate", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(spt_MemRequestOf(X.inds[m].data) != SPT_MEM_CAPACITY || sptMemBackingOf(X.inds[m].data) != tier) {
+            printf("Mode %u indices placed in %s\n", (unsigned) m, sptMemBackingString(sptMemBackingOf(X.inds[m].data)));
+            return 1;
+        }
+    }
+    if(spt_MemRequestOf(X.values.data) != SPT_MEM_CAPACITY) {
+        printf("Values not placed by the policy\n");
+        return 1;
+    }
+
+    /* MTTKRP gives the same result with the tensor in either place */
+    sptMatrix * mats[4];
+    for(sptIndex m = 0; m <= 3; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        result = sptNewMatrix(mats[m], m < 3 ? ndims[m] : ndims[0], 8);
+        spt_CheckError(result, "new matrix", NULL);
+        if(spt_MemRequestOf(mats[m]->values) == SPT_MEM_CAPACITY) {
+            printf("Matrix placed in the capacity tier\n");
+            return 1;
+        }
+        if(m < 3) {
+            sptSetRandomSeed(m);
+            sptRandomizeMatrix(mats[m], ndims[m], 8);
+        }
+    }
+    sptIndex const order[] = { 0, 1, 2 };
+    sptSparseTensorSortIndex(&X, 1);
+    result = sptOmpMTTKRP(&X, mats, order, 0, 1);
+    spt_CheckError(result, "mttkrp", NULL);
+    size_t const out_bytes = (size_t) ndims[0] * mats[3]->stride * sizeof (sptValue);
+    sptValue * ref = malloc(out_bytes);
+    memcpy(ref, mats[3]->values, out_bytes);
+    sptSetDataPlacement(SPT_DATA_COO_INDICES, SPT_MEM_DEFAULT);
+    sptSetDataPlacement(SPT_DATA_COO_VALUES, SPT_MEM_DEFAULT);
+    result = sptPlaceSparseTensor(&X, SPT_MEM_DEFAULT);
+    spt_CheckError(result, "place", NULL);
+    result = sptPlaceMatrix(mats[1], SPT_MEM_CAPACITY);
+    spt_CheckError(result, "place matrix", NULL);
+    if(spt_MemRequestOf(X.inds[0].data) == SPT_MEM_CAPACITY || spt_MemRequestOf(mats[1]->values) != SPT_MEM_CAPACITY) {
+        printf("Arrays did not move\n");
+        return 1;
+    }
+    result = sptOmpMTTKRP(&X, mats, order, 0, 1);
+    spt_CheckError(result, "mttkrp", NULL);
+    if(memcmp(ref, mats[3]->values, out_bytes) != 0) {
+        printf("MTTKRP changed after moving the tensor\n");
+        return 1;
+    }
+    free(ref);
+    for(sptIndex m = 0; m <= 3; ++m) {
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+
+    /* HiCOO indices and values follow their own classes */
+    sptSparseTensorHiCOO H;
+    sptNnzIndex max_nnzb = 0;
+    result = sptSparseTensorToHiCOO(&H, &max_nnzb, &X, 3, 6, 1);
+    spt_CheckError(result, "to hicoo", NULL);
+    for(sptIndex m = 0; m < 3; ++m) {
+        if(spt_MemRequestOf(H.binds[m].data) != SPT_MEM_CAPACITY || spt_MemRequestOf(H.einds[m].data) != SPT_MEM_CAPACITY) {
+            printf("HiCOO mode %u indices not placed by the policy\n", (unsigned) m);
+            return 1;
+        }
+    }
+    if(spt_MemRequestOf(H.values.data) == SPT_MEM_CAPACITY) {
+        printf("HiCOO values placed in the capacity tier\n");
+        return 1;
+    }
+    sptElementIndex const e0 = H.einds[0].data[H.nnz - 1];
+    result = sptPlaceSparseTensorHiCOO(&H, SPT_MEM_CAPACITY);
+    spt_CheckError(result, "place hicoo", NULL);
+    if(spt_MemRequestOf(H.values.data) != SPT_MEM_CAPACITY || H.einds[0].data[H.nnz - 1] != e0) {
+        printf("HiCOO tensor did not move\n");
+        return 1;
+    }
+    sptFreeSparseTensorHiCOO(&H);
+    sptFreeSparseTensor(&X);
+    if(sptCapacityBytesInUse() != 0) {
+        printf("Capacity-tier memory leaked\n");
+        return 1;
+    }
+    return 0;
+}
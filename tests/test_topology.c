@@ -0,0 +1,110 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Whether list is a permutation of the topology's CPUs */
+static int spt_IsPermutation(sptTopology const * topo, int const * list, int const n) {
+    if(list == NULL || n != topo->ncpus) {
+        return 0;
+    }
+    for(int i = 0; i < n; ++i) {
+        int found = 0;
+        for(int j = 0; j < n; ++j) {
+            found += list[j] == topo->cpus[i];
+        }
+        if(found != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void) {
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof allowed, &allowed);
+    sptTopology const * const topo = sptGetTopology();
+    if(topo == NULL || topo->ncpus != CPU_COUNT(&allowed) || topo->ncores < topo->nsockets || topo->nsockets < 1 ||
+        topo->socket_begin[0] != 0 || topo->socket_begin[topo->nsockets] != topo->ncpus) {
+        printf("Bad topology\n");
+        return 1;
+    }
+    for(int i = 1; i < topo->ncpus; ++i) {
+        if(topo->socket_of[i] < topo->socket_of[i-1]) {
+            printf("CPUs not grouped by socket\n");
+            return 1;
+        }
+    }
+
+    int n = 0;
+    int const * compact = sptPinOrder(SPT_PIN_COMPACT, 0, &n);
+    if(!spt_IsPermutation(topo, compact, n)) {
+        printf("Compact order is not a permutation of the CPUs\n");
+        return 1;
+    }
+    int const * scatter = sptPinOrder(SPT_PIN_SCATTER, 0, &n);
+    if(!spt_IsPermutation(topo, scatter, n)) {
+        printf("Scatter order is not a permutation of the CPUs\n");
+        return 1;
+    }
+    /* Scatter puts the first thread of every socket before any socket's second */
+    for(int i = 0; i < topo->nsockets; ++i) {
+        int const * socket = sptPinOrder(SPT_PIN_SOCKET, i, &n);
+        if(socket == NULL || n != topo->socket_begin[i + 1] - topo->socket_begin[i] || socket[0] != topo->cpus[topo->socket_begin[i]]) {
+            printf("Socket %d order is wrong\n", i);
+            return 1;
+        }
+        int seen = 0;
+        for(int j = 0; j < topo->nsockets; ++j) {
+            seen |= scatter[j] == socket[0];
+        }
+        if(!seen) {
+            printf("Scatter does not start on socket %d\n", i);
+            return 1;
+        }
+    }
+    if(sptPinOrder(SPT_PIN_NONE, 0, &n) != NULL || n != 0 || sptSetPinPolicy((sptPinPolicy) 9) == 0) {
+        printf("SPT_PIN_NONE pins or a bad policy is taken\n");
+        return 1;
+    }
+
+    /* Drivers pin their team while they run, and put the affinity back */
+    sptSetPinPolicy(SPT_PIN_COMPACT);
+    sptExecContext scope;
+    sptExecContext const * const caller = spt_ExecPushThreads(&scope, 2);
+    int misplaced = 0;
+    #pragma omp parallel num_threads(2) reduction(+:misplaced)
+    {
+        cpu_set_t mine;
+        sched_getaffinity(0, sizeof mine, &mine);
+        misplaced += CPU_COUNT(&mine) != 1 || !CPU_ISSET(compact[omp_get_thread_num() % topo->ncpus], &mine);
+    }
+    sptSetExecContext(caller);
+    cpu_set_t after;
+    sched_getaffinity(0, sizeof after, &after);
+    if(misplaced != 0 || !CPU_EQUAL(&after, &allowed)) {
+        printf("Pinned team misplaced or affinity not restored\n");
+        return 1;
+    }
+    sptSetPinPolicy(SPT_PIN_NONE);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+
+/* The trace as one string */
+static char * spt_ExportTrace(void) {
+    FILE * fp = tmpfile();
+    sptAssert(fp != NULL);
+    sptAssert(sptTraceExport(fp) == 0);
+    long const len = ftell(fp);
+    rewind(fp);
+    char * buf = malloc(len + 1);
+    size_t const got = fread(buf, 1, len, fp);
+    buf[got] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static int spt_CountOf(char const * s, char const * what) {
+    int n = 0;
+    for(s = strstr(s, what); s != NULL; s = strstr(s + 1, what)) {
+        ++n;
+    }
+    return n;
+}
+
+/* Events land on the recording thread's row, library phases included, and export as Chrome trace JSON */
+int main(void) {
+    sptSetTelemetryPrint(0);
+
+    /* Off: nothing is recorded */
+    sptSetTracing(0);
+    sptTraceEnd("test off", -1, sptTraceBegin());
+    char * buf = spt_ExportTrace();
+    if(strstr(buf, "test off") != NULL) {
+        printf("recorded while off\n");
+        return 1;
+    }
+    free(buf);
+
+    sptSetTracing(1);
+    #pragma omp parallel num_threads(3)
+    {
+        double const begin = sptTraceBegin();
+        sptTraceEnd("test \"worker\"", 7, begin);
+    }
+    spt_TraceSpan("test track", "test device", -1, spt_TraceNow(), 5);
+
+    sptIndex const ndims[] = { 30, 20, 25 };
+    sptSparseTensor X;
+    sptAssert(sptNewSparseTensor(&X, 3, ndims) == 0);
+    srand(1);
+    for(sptNnzIndex z = 0; z < 20000; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], rand() % ndims[m]);
+        }
+        sptAppendValueVector(&X.values, 1 + rand() % 5);
+    }
+    X.nnz = 20000;  /* above PARTI_CPD_SMALL_NNZ, so the general ALS loop runs */
+    sptSparseTensorSortIndex(&X, 1);
+    sptKruskalTensor ktensor;
+    sptAssert(sptNewKruskalTensor(&ktensor, 3, ndims, 4) == 0);
+    sptAssert(sptOmpCpdAls(&X, 4, 2, 0, 2, 0, &ktensor) == 0);
+
+    buf = spt_ExportTrace();
+    if(strncmp(buf, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", 42) != 0 || strcmp(buf + strlen(buf) - 4, "\n]}\n") != 0) {
+        printf("not a Chrome trace:\n%s", buf);
+        return 1;
+    }
+    if(spt_CountOf(buf, "{\"name\": \"test \\\"worker\\\"\", \"ph\": \"X\"") != 3 || spt_CountOf(buf, "\"args\": {\"arg\": 7}") != 3) {
+        printf("worker events are missing or unescaped:\n%s", buf);
+        return 1;
+    }
+    if(strstr(buf, "\"args\": {\"name\": \"test track\"}") == NULL || strstr(buf, "\"name\": \"test device\", \"ph\": \"X\"") == NULL) {
+        printf("track event is missing\n");
+        return 1;
+    }
+    /* Two iterations of three modes, and the timers the library already keeps */
+    if(spt_CountOf(buf, "\"name\": \"CPD MTTKRP\"") != 6 || spt_CountOf(buf, "\"name\": \"CPD iteration\"") != 2
+        || strstr(buf, "\"name\": \"Sort\"") == NULL || strstr(buf, "\"name\": \"CPU  SpTns CPD-ALS\"") == NULL) {
+        printf("library phases are missing:\n%s", buf);
+        return 1;
+    }
+    free(buf);
+
+    sptTraceReset();
+    buf = spt_ExportTrace();
+    if(strstr(buf, "\"ph\": \"X\"") != NULL || strstr(buf, "test track") == NULL) {
+        printf("reset failed\n");
+        return 1;
+    }
+    free(buf);
+    sptSetTracing(0);
+
+    sptFreeKruskalTensor(&ktensor);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
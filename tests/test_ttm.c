@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../src/error/error.h"
+#include "../src/ssptensor/ssptensor.h"
+#include "../src/sptensor/sptensor.h"
 
 static int spt_LoadMatrixTranspose(sptMatrix *X, FILE *f) {
     int result = 0;
@@ -100,10 +102,175 @@ int main(void) {
         }
         free(bufY);
 
+        /* The block view aliases Y's fibers, rows numbered over modes 1 and 2 */
+        spt_SemiSparseBlockView view;
+        result = spt_SemiSparseTensorToBlockView(&view, &Y);
+        spt_CheckError(result, "block view", NULL);
+        if(view.values != Y.values.values || view.ld != Y.stride || view.nrows != 4 ||
+            view.ncols != 2 || view.nmatrows != 4) {
+            printf("Block view shape mismatch\n");
+            return 1;
+        }
+        for(sptNnzIndex r = 0; r < view.nrows; ++r) {
+            if(view.rowind[r] != Y.inds[1].data[r] * 2 + Y.inds[2].data[r]) {
+                printf("Block view row index mismatch\n");
+                return 1;
+            }
+        }
+        spt_FreeSemiSparseBlockView(&view);
+
+        /* Semi-sparse TTM on the dense mode is one GEMM over the fibers */
+        sptSemiSparseTensor Z;
+        result = sptSemiSparseTensorMulMatrix(&Z, &Y, &U, 0);
+        spt_CheckError(result, "semi-sparse ttm", NULL);
+        if(Z.nnz != Y.nnz) {
+            printf("Semi-sparse TTM fiber count mismatch\n");
+            return 1;
+        }
+        for(sptNnzIndex f = 0; f < Z.nnz; ++f) {
+            for(sptIndex k = 0; k < U.ncols; ++k) {
+                sptValue ref = 0;
+                for(sptIndex r = 0; r < U.nrows; ++r) {
+                    ref += Y.values.values[f * Y.stride + r] * U.values[r * U.stride + k];
+                }
+                if(Z.values.values[f * Z.stride + k] != ref) {
+                    printf("Semi-sparse TTM value mismatch\n");
+                    return 1;
+                }
+            }
+        }
+        sptFreeSemiSparseTensor(&Z);
+
         sptFreeSparseTensor(&spY);
         sptFreeSemiSparseTensor(&Y);
         sptFreeMatrix(&U);
         sptFreeSparseTensor(&X);
     }
+    {
+        /* Repeated TTMs on the last mode of an unsorted tensor reuse the cached fiber index */
+        sptIndex const ndims[] = { 6, 5, 7 };
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, 3, ndims);
+        spt_CheckError(result, "new", NULL);
+        srand(5);
+        for(sptNnzIndex z = 0; z < 80; ++z) {
+            for(sptIndex m = 0; m < 3; ++m) {
+                sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+            }
+            sptAppendValueVector(&X.values, (sptValue) (rand() % 10));
+        }
+        X.nnz = 80;
+        sptMatrix U;
+        sptNewMatrix(&U, 7, 3);
+        for(sptIndex i = 0; i < 7; ++i) {
+            for(sptIndex r = 0; r < 3; ++r) {
+                U.values[i * U.stride + r] = (sptValue) (i + r);
+            }
+        }
+        static sptValue dense[6 * 5 * 3];
+        for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+            for(sptIndex r = 0; r < 3; ++r) {
+                dense[(X.inds[0].data[z] * 5 + X.inds[1].data[z]) * 3 + r] +=
+                    X.values.data[z] * U.values[X.inds[2].data[z] * U.stride + r];
+            }
+        }
+        for(int rep = 0; rep < 2; ++rep) {
+            sptSemiSparseTensor Y;
+            result = sptOmpSparseTensorMulMatrix(&Y, &X, &U, 2);
+            spt_CheckError(result, "omp ttm", NULL);
+            if(X.cache == NULL || X.cache->fibermode != 2) {
+                printf("Fiber index not cached\n");
+                return 1;
+            }
+            sptNnzIndex nonempty = 0;
+            for(sptIndex i = 0; i < 6 * 5; ++i) {
+                nonempty += dense[i * 3] != 0 || dense[i * 3 + 1] != 0 || dense[i * 3 + 2] != 0;
+            }
+            for(sptNnzIndex f = 0; f < Y.nnz; ++f) {
+                for(sptIndex r = 0; r < 3; ++r) {
+                    if(Y.values.values[f * Y.stride + r] != dense[(Y.inds[0].data[f] * 5 + Y.inds[1].data[f]) * 3 + r]) {
+                        printf("Cached TTM mismatch on pass %d\n", rep);
+                        return 1;
+                    }
+                }
+            }
+            if(Y.nnz < nonempty) {
+                printf("Cached TTM fiber count mismatch on pass %d\n", rep);
+                return 1;
+            }
+            sptFreeSemiSparseTensor(&Y);
+        }
+        sptSparseTensorSortIndexAtMode(&X, 0, 0);
+        if(X.cache != NULL && X.cache->fibermode != X.nmodes) {
+            printf("Fiber index kept after a re-sort\n");
+            return 1;
+        }
+        sptFreeMatrix(&U);
+        sptFreeSparseTensor(&X);
+    }
+    {
+        /* TTMs alternating modes on a tensor with kept sorted copies leave it in its order */
+        sptIndex const ndims[] = { 4, 5, 6 };
+        sptSparseTensor X;
+        int result = sptNewSparseTensor(&X, 3, ndims);
+        spt_CheckError(result, "new", NULL);
+        static sptValue dense[4][5][6];
+        srand(9);
+        for(sptNnzIndex z = 0; z < 50; ++z) {
+            sptIndex const i = rand() % 4, j = rand() % 5, k = rand() % 6;
+            sptValue const v = (sptValue) (rand() % 10);
+            sptAppendIndexVector(&X.inds[0], i);
+            sptAppendIndexVector(&X.inds[1], j);
+            sptAppendIndexVector(&X.inds[2], k);
+            sptAppendValueVector(&X.values, v);
+            dense[i][j][k] += v;
+        }
+        X.nnz = 50;
+        sptIndex const first = X.inds[0].data[0];
+        result = sptSparseTensorKeepSortedCopies(&X, 1);
+        spt_CheckError(result, "keep copies", NULL);
+        sptIndex const modes[] = { 0, 2, 0 };
+        for(int pass = 0; pass < 3; ++pass) {
+            sptIndex const mode = modes[pass];
+            sptMatrix U;
+            sptNewMatrix(&U, ndims[mode], 2);
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                U.values[i * U.stride] = (sptValue) (i + 1);
+                U.values[i * U.stride + 1] = (sptValue) (pass - (int) i);
+            }
+            sptSemiSparseTensor Y;
+            result = sptSparseTensorMulMatrix(&Y, &X, &U, mode);
+            spt_CheckError(result, "ttm", NULL);
+            if(X.inds[0].data[0] != first || X.cache->copies[mode] == NULL) {
+                printf("Sorted copy not kept for mode %u\n", (unsigned) mode);
+                return 1;
+            }
+            for(sptNnzIndex f = 0; f < Y.nnz; ++f) {
+                sptIndex at[3];
+                for(sptIndex m = 0; m < 3; ++m) {
+                    at[m] = m == mode ? 0 : Y.inds[m].data[f];
+                }
+                for(sptIndex r = 0; r < 2; ++r) {
+                    sptValue expect = 0;
+                    for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                        at[mode] = i;
+                        expect += dense[at[0]][at[1]][at[2]] * U.values[i * U.stride + r];
+                    }
+                    if(Y.values.values[f * Y.stride + r] != expect) {
+                        printf("TTM on kept copy mismatch for mode %u\n", (unsigned) mode);
+                        return 1;
+                    }
+                }
+            }
+            sptFreeSemiSparseTensor(&Y);
+            sptFreeMatrix(&U);
+        }
+        sptSparseTensorMulScalar(&X, 2);
+        if(X.cache->copies[0] != NULL || X.cache->copies[2] != NULL) {
+            printf("Sorted copies kept after a value change\n");
+            return 1;
+        }
+        sptFreeSparseTensor(&X);
+    }
     return 0;
 }
@@ -0,0 +1,114 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define I 12
+#define J 9
+#define K 7
+#define L 5
+#define R1 3
+#define R2 4
+
+/* Entry (i, p, q, l) of a general semi sparse tensor with dense modes 1 then 2, or 0 if its block is absent */
+static sptValue GetEntry(const sptSemiSparseTensorGeneral *Y, sptIndex i, sptIndex l, sptIndex p, sptIndex q) {
+    for(sptNnzIndex b = 0; b < Y->nnz; ++b) {
+        if(Y->inds[0].data[b] == i && Y->inds[1].data[b] == l) {
+            return Y->values.values[b * Y->values.stride + p * Y->strides[1] + q];
+        }
+    }
+    return 0;
+}
+
+/* Two modes multiplied at once, and one after the other through the general semi sparse form, match a dense TTM */
+int main(void) {
+    sptIndex const ndims[] = { I, J, K, L };
+    static sptValue dense[I][J][K][L];
+    static sptValue expect[I][R1][R2][L];
+    sptSparseTensor X;
+    sptMatrix U1, U2;
+    int result = sptNewSparseTensor(&X, 4, ndims);
+    spt_CheckError(result, "new tensor", NULL);
+    srand(5);
+    for(int n = 0; n < 300; ++n) {
+        sptIndex const i = rand() % I, j = rand() % J, k = rand() % K, l = rand() % L;
+        sptValue const v = (sptValue) (rand() % 9 - 4);
+        sptAppendIndexVector(&X.inds[0], i);
+        sptAppendIndexVector(&X.inds[1], j);
+        sptAppendIndexVector(&X.inds[2], k);
+        sptAppendIndexVector(&X.inds[3], l);
+        sptAppendValueVector(&X.values, v);
+        ++X.nnz;
+        dense[i][j][k][l] += v;
+    }
+    sptNewMatrix(&U1, J, R1);
+    sptNewMatrix(&U2, K, R2);
+    for(sptIndex j = 0; j < J; ++j) {
+        for(sptIndex r = 0; r < R1; ++r) {
+            U1.values[j * U1.stride + r] = (sptValue) ((j + 2 * r) % 5) - 2;
+        }
+    }
+    for(sptIndex k = 0; k < K; ++k) {
+        for(sptIndex r = 0; r < R2; ++r) {
+            U2.values[k * U2.stride + r] = (sptValue) ((3 * k + r) % 7) - 3;
+        }
+    }
+    for(sptIndex i = 0; i < I; ++i)
+        for(sptIndex j = 0; j < J; ++j)
+            for(sptIndex k = 0; k < K; ++k)
+                for(sptIndex l = 0; l < L; ++l)
+                    for(sptIndex p = 0; p < R1; ++p)
+                        for(sptIndex q = 0; q < R2; ++q)
+                            expect[i][p][q][l] += dense[i][j][k][l] * U1.values[j * U1.stride + p] * U2.values[k * U2.stride + q];
+
+    sptMatrix * const U[] = { &U1, &U2 };
+    sptIndex const modes[] = { 1, 2 };
+    sptSemiSparseTensorGeneral Y;
+    result = sptSparseTensorMulMatrices(&Y, &X, 2, U, modes, 1);
+    spt_CheckError(result, "fused TTM", NULL);
+
+    /* Chained: the first TTM makes mode 1 dense, the second adds mode 2 */
+    sptSemiSparseTensorGeneral Y1, Y2;
+    result = sptSparseTensorMulMatrices(&Y1, &X, 1, U, modes, 2);
+    spt_CheckError(result, "first TTM", NULL);
+    result = sptSemiSparseTensorGeneralMulMatrix(&Y2, &Y1, &U2, 2, 2);
+    spt_CheckError(result, "second TTM", NULL);
+
+    for(sptIndex i = 0; i < I; ++i)
+        for(sptIndex l = 0; l < L; ++l)
+            for(sptIndex p = 0; p < R1; ++p)
+                for(sptIndex q = 0; q < R2; ++q) {
+                    sptValue const want = expect[i][p][q][l];
+                    if(fabs(GetEntry(&Y, i, l, p, q) - want) > 1e-9 || fabs(GetEntry(&Y2, i, l, p, q) - want) > 1e-9) {
+                        printf("entry (%u, %u, %u, %u) wrong\n", (unsigned) i, (unsigned) p, (unsigned) q, (unsigned) l);
+                        return 1;
+                    }
+                }
+
+    sptFreeSemiSparseTensorGeneral(&Y2);
+    sptFreeSemiSparseTensorGeneral(&Y1);
+    sptFreeSemiSparseTensorGeneral(&Y);
+    sptFreeMatrix(&U2);
+    sptFreeMatrix(&U1);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
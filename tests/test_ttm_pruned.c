@@ -0,0 +1,140 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+
+/* Whether entry a of a fiber ranks above entry b: larger magnitude, or the same at a lower column */
+static int ranks_above(sptValue const * fiber, sptIndex a, sptIndex b) {
+    double const x = fabs(fiber[a]), y = fabs(fiber[b]);
+    return x > y || (x == y && a < b);
+}
+
+/* Whether Y holds exactly the entries of the dense TTM D that pass epsilon and the per-fiber top k */
+static int check_pruned(sptSparseTensor const *Y, sptSemiSparseTensor const *D, sptIndex mode,
+    sptValue epsilon, sptIndex topk, char const *name)
+{
+    sptIndex const ncols = Y->ndims[mode];
+    sptNnzIndex z = 0;
+    for(sptNnzIndex f = 0; f < D->nnz; ++f) {
+        sptValue const * const fiber = D->values.values + f * D->stride;
+        for(sptIndex j = 0; j < ncols; ++j) {
+            int keep = fiber[j] != 0 && fabs(fiber[j]) >= epsilon;
+            if(keep && topk != 0) {
+                sptIndex above = 0;
+                for(sptIndex i = 0; i < ncols; ++i) {
+                    above += fiber[i] != 0 && fabs(fiber[i]) >= epsilon && ranks_above(fiber, i, j);
+                }
+                keep = above < topk;
+            }
+            if(!keep) {
+                continue;
+            }
+            int same = z < Y->nnz && Y->inds[mode].data[z] == j && Y->values.data[z] == fiber[j];
+            for(sptIndex m = 0; m < Y->nmodes && same; ++m) {
+                same = m == mode || Y->inds[m].data[z] == D->inds[m].data[f];
+            }
+            if(!same) {
+                printf("%s: entry %lu differs\n", name, (unsigned long) z);
+                return 1;
+            }
+            ++z;
+        }
+    }
+    if(z != Y->nnz) {
+        printf("%s: %lu entries, expected %lu\n", name, (unsigned long) Y->nnz, (unsigned long) z);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 7, 9, 12 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(11);
+    for(sptNnzIndex z = 0; z < 200; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 7 - 3));
+    }
+    X.nnz = 200;
+
+    sptValue const epsilons[] = { 0, 4, 10 };
+    sptIndex const topks[] = { 0, 1, 3 };
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        /* Small integers, so that ties and exact cancellations occur */
+        sptMatrix U;
+        sptNewMatrix(&U, ndims[mode], 6);
+        for(sptIndex i = 0; i < ndims[mode]; ++i) {
+            for(sptIndex j = 0; j < 6; ++j) {
+                U.values[i * U.stride + j] = (sptValue) (rand() % 5 - 2);
+            }
+        }
+        sptSemiSparseTensor D;
+        result = sptSparseTensorMulMatrix(&D, &X, &U, mode);
+        spt_CheckError(result, "dense ttm", NULL);
+        for(int e = 0; e < 3; ++e) {
+            for(int k = 0; k < 3; ++k) {
+                for(int tk = 1; tk <= 3; tk += 2) {
+                    sptSparseTensor Y;
+                    result = sptOmpSparseTensorMulMatrixPruned(&Y, &X, &U, mode, epsilons[e], topks[k], tk);
+                    spt_CheckError(result, "pruned ttm", NULL);
+                    if(Y.ndims[mode] != 6 || check_pruned(&Y, &D, mode, epsilons[e], topks[k], "pruned")) {
+                        printf("mode %u, epsilon %g, top %u, %d threads\n",
+                            (unsigned) mode, (double) epsilons[e], (unsigned) topks[k], tk);
+                        return 1;
+                    }
+                    sptFreeSparseTensor(&Y);
+                }
+            }
+        }
+        /* With epsilon alone it is the semi-sparse TTM converted afterwards */
+        sptSparseTensor S, Y;
+        result = sptSemiSparseTensorToSparseTensor(&S, &D, 4);
+        spt_CheckError(result, "convert", NULL);
+        result = sptOmpSparseTensorMulMatrixPruned(&Y, &X, &U, mode, 4, 0, 0);
+        spt_CheckError(result, "pruned ttm", NULL);
+        if(S.nnz != Y.nnz) {
+            printf("Pruned TTM disagrees with the conversion on mode %u\n", (unsigned) mode);
+            return 1;
+        }
+        sptFreeSparseTensor(&S);
+        sptFreeSparseTensor(&Y);
+        sptFreeSemiSparseTensor(&D);
+        sptFreeMatrix(&U);
+    }
+
+    sptSparseTensor Y;
+    sptMatrix U;
+    sptNewMatrix(&U, ndims[0], 2);
+    if(sptOmpSparseTensorMulMatrixPruned(&Y, &X, &U, 1, 0, 0, 1) != SPTERR_SHAPE_MISMATCH ||
+        sptOmpSparseTensorMulMatrixPruned(&Y, &X, &U, 0, -1, 0, 1) != SPTERR_VALUE_ERROR) {
+        printf("Bad arguments not reported\n");
+        return 1;
+    }
+    sptFreeMatrix(&U);
+    sptFreeSparseTensor(&X);
+    return 0;
+}
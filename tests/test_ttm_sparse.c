@@ -0,0 +1,157 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+
+/* Whether the sparse TTM Y matches the dense TTM D of the same tensor, entry for entry */
+static int check_ttm(sptSparseTensor const *Y, sptSemiSparseTensor const *D, sptIndex mode, char const *name) {
+    sptIndex const nmodes = Y->nmodes;
+    sptNnzIndex f = 0, prevf = D->nnz, nonzeros = 0;
+    for(sptNnzIndex z = 0; z < Y->nnz; ++z) {
+        for(;;) {
+            if(f >= D->nnz) {
+                printf("%s: entry %lu outside the dense fibers\n", name, (unsigned long) z);
+                return 1;
+            }
+            int same = 1;
+            for(sptIndex m = 0; m < nmodes; ++m) {
+                same &= m == mode || Y->inds[m].data[z] == D->inds[m].data[f];
+            }
+            if(same) {
+                break;
+            }
+            ++f;
+        }
+        sptIndex const j = Y->inds[mode].data[z];
+        if(f == prevf && Y->inds[mode].data[z-1] >= j) {
+            printf("%s: columns out of order\n", name);
+            return 1;
+        }
+        prevf = f;
+        if(fabs(Y->values.data[z] - D->values.values[f * D->stride + j]) > 1e-9) {
+            printf("%s: value mismatch at %lu\n", name, (unsigned long) z);
+            return 1;
+        }
+    }
+    for(sptNnzIndex g = 0; g < D->nnz; ++g) {
+        for(sptIndex j = 0; j < Y->ndims[mode]; ++j) {
+            nonzeros += D->values.values[g * D->stride + j] != 0;
+        }
+    }
+    if(nonzeros != Y->nnz) {
+        printf("%s: %lu entries, the dense TTM has %lu\n", name, (unsigned long) Y->nnz, (unsigned long) nonzeros);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 8, 6, 10 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 3, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(3);
+    for(sptNnzIndex z = 0; z < 150; ++z) {
+        for(sptIndex m = 0; m < 3; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (1 + rand() % 9));
+    }
+    X.nnz = 150;
+
+    for(sptIndex mode = 0; mode < 3; ++mode) {
+        /* A random projection of about a quarter density, and an aggregation map of i to i % 3 */
+        for(int kind = 0; kind < 2; ++kind) {
+            sptIndex const ncols = kind == 0 ? 5 : 3;
+            sptMatrix U;
+            sptNewMatrix(&U, ndims[mode], ncols);
+            for(sptIndex i = 0; i < ndims[mode]; ++i) {
+                for(sptIndex j = 0; j < ncols; ++j) {
+                    sptValue v = 0;
+                    if(kind == 0) {
+                        v = rand() % 4 == 0 ? (sptValue) (1 + rand() % 5) : 0;
+                    } else {
+                        v = j == i % 3;
+                    }
+                    U.values[i * U.stride + j] = v;
+                }
+            }
+            sptSparseMatrixCSR C;
+            result = sptSparseMatrixCSRFromMatrix(&C, &U, 0, 1);
+            spt_CheckError(result, "csr", NULL);
+
+            sptSemiSparseTensor D;
+            result = sptSparseTensorMulMatrix(&D, &X, &U, mode);
+            spt_CheckError(result, "dense ttm", NULL);
+            for(int tk = 1; tk <= 2; ++tk) {
+                sptSparseTensor Y;
+                result = sptOmpSparseTensorMulSparseMatrix(&Y, &X, &C, mode, tk);
+                spt_CheckError(result, "sparse ttm", NULL);
+                if(Y.ndims[mode] != ncols || check_ttm(&Y, &D, mode, kind == 0 ? "projection" : "aggregation")) {
+                    return 1;
+                }
+                sptFreeSparseTensor(&Y);
+            }
+            sptFreeSemiSparseTensor(&D);
+            sptFreeSparseMatrixCSR(&C);
+            sptFreeMatrix(&U);
+        }
+    }
+
+    /* A pattern tensor counts its nonzeros: aggregating the last mode counts each fiber's indices by class */
+    sptSparseTensorDropValues(&X);
+    sptMatrix U;
+    sptNewMatrix(&U, ndims[2], 3);
+    for(sptIndex i = 0; i < ndims[2]; ++i) {
+        for(sptIndex j = 0; j < 3; ++j) {
+            U.values[i * U.stride + j] = j == i % 3;
+        }
+    }
+    sptSparseMatrixCSR C;
+    result = sptSparseMatrixCSRFromMatrix(&C, &U, 0, 1);
+    spt_CheckError(result, "csr", NULL);
+    sptSemiSparseTensor D;
+    result = sptSparseTensorMulMatrix(&D, &X, &U, 2);
+    spt_CheckError(result, "dense ttm", NULL);
+    sptSparseTensor Y;
+    result = sptOmpSparseTensorMulSparseMatrix(&Y, &X, &C, 2, 0);
+    spt_CheckError(result, "sparse ttm", NULL);
+    if(check_ttm(&Y, &D, 2, "pattern")) {
+        return 1;
+    }
+    sptFreeSparseTensor(&Y);
+    sptFreeSemiSparseTensor(&D);
+    sptFreeSparseMatrixCSR(&C);
+    sptFreeMatrix(&U);
+
+    /* Shapes must agree */
+    sptNewSparseMatrixCSR(&C, ndims[1] + 1, 2, 0);
+    if(sptOmpSparseTensorMulSparseMatrix(&Y, &X, &C, 1, 1) != SPTERR_SHAPE_MISMATCH) {
+        printf("Shape mismatch not reported\n");
+        return 1;
+    }
+    sptFreeSparseMatrixCSR(&C);
+
+    sptFreeSparseTensor(&X);
+    return 0;
+}
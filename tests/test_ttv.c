@@ -0,0 +1,111 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+static int spt_Close(double a, double b) {
+    return fabs(a - b) <= 1e-4 * (1 + fabs(b));
+}
+
+int main(void) {
+    sptIndex const ndims[] = { 30, 12, 25, 9 };
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, 4, ndims);
+    spt_CheckError(result, "new", NULL);
+    srand(3);
+    for(sptNnzIndex z = 0; z < 6000; ++z) {
+        for(sptIndex m = 0; m < 4; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) rand() / RAND_MAX - 0.5);
+    }
+    X.nnz = 6000;
+
+    sptValueVector V[4];
+    for(sptIndex m = 0; m < 4; ++m) {
+        sptNewValueVector(&V[m], ndims[m], ndims[m]);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            V[m].data[i] = (sptValue) rand() / RAND_MAX;
+        }
+    }
+
+    /* Single-mode TTV, serial against OpenMP */
+    sptSemiSparseTensor S, P;
+    result = sptSparseTensorMulVector(&S, &X, &V[2], 2);
+    spt_CheckError(result, "ttv", NULL);
+    result = sptOmpSparseTensorMulVector(&P, &X, &V[2], 2);
+    spt_CheckError(result, "omp ttv", NULL);
+    if(S.nnz != P.nnz) {
+        printf("sptOmpSparseTensorMulVector fiber count mismatch\n");
+        return 1;
+    }
+    for(sptNnzIndex i = 0; i < S.nnz; ++i) {
+        if(!spt_Close(P.values.values[i * P.stride], S.values.values[i * S.stride])) {
+            printf("sptOmpSparseTensorMulVector value mismatch at %"PARTI_PRI_NNZ_INDEX"\n", i);
+            return 1;
+        }
+    }
+
+    /* Multi-TTV over modes 3 and 1, against a dense reference over modes 0 and 2 */
+    static double dense[30 * 25];
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        dense[X.inds[0].data[z] * 25 + X.inds[2].data[z]] +=
+            X.values.data[z] * V[3].data[X.inds[3].data[z]] * V[1].data[X.inds[1].data[z]];
+    }
+    sptIndex const modes[] = { 3, 1 };
+    const sptValueVector * const vecs[] = { &V[3], &V[1] };
+    int const nts[] = { 1, 4 };
+    for(int t = 0; t < 2; ++t) {
+        sptSparseTensor Y;
+        result = sptSparseTensorMulVectors(&Y, &X, vecs, modes, 2, nts[t]);
+        spt_CheckError(result, "multi ttv", NULL);
+        if(Y.nmodes != 2 || Y.ndims[0] != 30 || Y.ndims[1] != 25) {
+            printf("sptSparseTensorMulVectors shape mismatch\n");
+            return 1;
+        }
+        sptNnzIndex nonempty = 0;
+        for(sptIndex i = 0; i < 30 * 25; ++i) {
+            nonempty += dense[i] != 0;
+        }
+        if(Y.nnz != nonempty) {
+            printf("sptSparseTensorMulVectors nnz mismatch with %d threads\n", nts[t]);
+            return 1;
+        }
+        for(sptNnzIndex z = 0; z < Y.nnz; ++z) {
+            if((z > 0 && spt_SparseTensorCompareIndices(&Y, z - 1, &Y, z) >= 0) ||
+                !spt_Close(Y.values.data[z], dense[Y.inds[0].data[z] * 25 + Y.inds[1].data[z]])) {
+                printf("sptSparseTensorMulVectors value mismatch with %d threads\n", nts[t]);
+                return 1;
+            }
+        }
+        sptFreeSparseTensor(&Y);
+    }
+
+    sptFreeSemiSparseTensor(&S);
+    sptFreeSemiSparseTensor(&P);
+    for(sptIndex m = 0; m < 4; ++m) {
+        sptFreeValueVector(&V[m]);
+    }
+    sptFreeSparseTensor(&X);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/error/error.h"
+#include "../src/sptensor/sptensor.h"
+
+static int spt_Close(double a, double b) {
+    return fabs(a - b) <= 1e-4 * (1 + fabs(b));
+}
+
+static sptValue spt_Rand(void) {
+    return (sptValue) rand() / RAND_MAX - 0.5;
+}
+
+int main(void) {
+    int result;
+    srand(11);
+
+    /* Fused TTM chain against a dense reference, leaving out mode 1 */
+    sptIndex const ndims[] = { 9, 7, 6, 5 };
+    sptIndex const rs[] = { 3, 2, 4, 2 };
+    sptSparseTensor X;
+    sptNewSparseTensor(&X, 4, ndims);
+    for(sptNnzIndex z = 0; z < 400; ++z) {
+        for(sptIndex m = 0; m < 4; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, spt_Rand());
+    }
+    X.nnz = 400;
+    sptMatrix mats[4];
+    sptMatrix * U[4];
+    for(sptIndex m = 0; m < 4; ++m) {
+        sptNewMatrix(&mats[m], ndims[m], rs[m]);
+        for(sptIndex i = 0; i < ndims[m]; ++i) {
+            for(sptIndex r = 0; r < rs[m]; ++r) {
+                mats[m].values[i * mats[m].stride + r] = spt_Rand();
+            }
+        }
+        U[m] = &mats[m];
+    }
+    static double dense[7 * 3 * 4 * 2];
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        sptIndex const i0 = X.inds[0].data[z], i1 = X.inds[1].data[z], i2 = X.inds[2].data[z], i3 = X.inds[3].data[z];
+        for(sptIndex a = 0; a < 3; ++a) {
+            for(sptIndex b = 0; b < 4; ++b) {
+                for(sptIndex c = 0; c < 2; ++c) {
+                    dense[i1 * 24 + (a * 4 + b) * 2 + c] += X.values.data[z] *
+                        mats[0].values[i0 * mats[0].stride + a] *
+                        mats[2].values[i2 * mats[2].stride + b] *
+                        mats[3].values[i3 * mats[3].stride + c];
+                }
+            }
+        }
+    }
+    int const nts[] = { 1, 4 };
+    for(int t = 0; t < 2; ++t) {
+        sptMatrix Y;
+        result = sptSparseTensorMulMatricesExcept(&Y, &X, U, 1, nts[t]);
+        spt_CheckError(result, "ttm chain", NULL);
+        if(Y.nrows != 7 || Y.ncols != 24) {
+            printf("sptSparseTensorMulMatricesExcept shape mismatch\n");
+            return 1;
+        }
+        for(sptIndex i = 0; i < 7; ++i) {
+            for(sptIndex c = 0; c < 24; ++c) {
+                if(!spt_Close(Y.values[i * Y.stride + c], dense[i * 24 + c])) {
+                    printf("sptSparseTensorMulMatricesExcept mismatch with %d threads\n", nts[t]);
+                    return 1;
+                }
+            }
+        }
+        sptFreeMatrix(&Y);
+    }
+    for(sptIndex m = 0; m < 4; ++m) {
+        sptFreeMatrix(&mats[m]);
+    }
+    sptFreeSparseTensor(&X);
+
+    /* HOOI recovers a tensor of exact multilinear rank (2, 3, 2), using both Gram sides */
+    sptIndex const tdims[] = { 4, 9, 8 };
+    sptIndex const ranks[] = { 2, 3, 2 };
+    double core[2 * 3 * 2], fac[3][9 * 3];
+    for(sptIndex i = 0; i < 12; ++i) {
+        core[i] = spt_Rand();
+    }
+    for(sptIndex m = 0; m < 3; ++m) {
+        for(sptIndex i = 0; i < tdims[m] * ranks[m]; ++i) {
+            fac[m][i] = spt_Rand();
+        }
+    }
+    sptNewSparseTensor(&X, 3, tdims);
+    for(sptIndex i = 0; i < tdims[0]; ++i) {
+        for(sptIndex j = 0; j < tdims[1]; ++j) {
+            for(sptIndex k = 0; k < tdims[2]; ++k) {
+                double v = 0;
+                for(sptIndex a = 0; a < 2; ++a) {
+                    for(sptIndex b = 0; b < 3; ++b) {
+                        for(sptIndex c = 0; c < 2; ++c) {
+                            v += core[(a * 3 + b) * 2 + c] * fac[0][i * 2 + a] * fac[1][j * 3 + b] * fac[2][k * 2 + c];
+                        }
+                    }
+                }
+                sptAppendIndexVector(&X.inds[0], i);
+                sptAppendIndexVector(&X.inds[1], j);
+                sptAppendIndexVector(&X.inds[2], k);
+                sptAppendValueVector(&X.values, (sptValue) v);
+            }
+        }
+    }
+    X.nnz = tdims[0] * tdims[1] * tdims[2];
+    sptTuckerTensor T;
+    sptNewTuckerTensor(&T, 3, tdims, ranks);
+    result = sptOmpTuckerHooi(&X, 20, 1e-8, 2, &T);
+    spt_CheckError(result, "hooi", NULL);
+    if(T.fit < 0.999) {
+        printf("sptTuckerHooi fit %f on an exact low-rank tensor\n", T.fit);
+        return 1;
+    }
+    /* Reconstruct from the core and the factors */
+    for(sptNnzIndex z = 0; z < X.nnz; ++z) {
+        double v = 0;
+        for(sptIndex a = 0; a < 2; ++a) {
+            for(sptIndex b = 0; b < 3; ++b) {
+                for(sptIndex c = 0; c < 2; ++c) {
+                    v += T.core[(a * 3 + b) * 2 + c] *
+                        T.factors[0]->values[X.inds[0].data[z] * T.factors[0]->stride + a] *
+                        T.factors[1]->values[X.inds[1].data[z] * T.factors[1]->stride + b] *
+                        T.factors[2]->values[X.inds[2].data[z] * T.factors[2]->stride + c];
+                }
+            }
+        }
+        if(fabs(v - X.values.data[z]) > 1e-3) {
+            printf("sptTuckerHooi reconstruction mismatch\n");
+            return 1;
+        }
+    }
+    sptFreeTuckerTensor(&T);
+    sptFreeSparseTensor(&X);
+
+    /* Randomized range finder against the exact eigensolve on a rank-5 matrix plus noise */
+    sptMatrix A, Ue, Ur;
+    sptNewMatrix(&A, 300, 200);
+    sptNewMatrix(&Ue, 300, 5);
+    sptNewMatrix(&Ur, 300, 5);
+    double left[300 * 5], right[200 * 5];
+    for(sptIndex i = 0; i < 300 * 5; ++i) {
+        left[i] = spt_Rand();
+    }
+    for(sptIndex i = 0; i < 200 * 5; ++i) {
+        right[i] = spt_Rand();
+    }
+    for(sptIndex i = 0; i < 300; ++i) {
+        for(sptIndex j = 0; j < 200; ++j) {
+            double v = 1e-3 * spt_Rand();
+            for(sptIndex r = 0; r < 5; ++r) {
+                v += (5 - r) * left[i * 5 + r] * right[j * 5 + r];
+            }
+            A.values[i * A.stride + j] = (sptValue) v;
+        }
+    }
+    double exact = 0, randomized = 0;
+    result = spt_MatrixLeadingLeftVectors(&A, &Ue, &exact, 0);
+    spt_CheckError(result, "exact vectors", NULL);
+    result = spt_MatrixLeadingLeftVectors(&A, &Ur, &randomized, 1);
+    spt_CheckError(result, "randomized vectors", NULL);
+    if(!spt_Close(randomized, exact)) {
+        printf("spt_MatrixLeadingLeftVectors energies differ: %f vs %f\n", randomized, exact);
+        return 1;
+    }
+    /* Both bases span the same subspace: ||Ue^T Ur||_F^2 = rank */
+    double overlap = 0;
+    for(sptIndex r = 0; r < 5; ++r) {
+        for(sptIndex s = 0; s < 5; ++s) {
+            double dot = 0;
+            for(sptIndex i = 0; i < 300; ++i) {
+                dot += Ue.values[i * Ue.stride + r] * Ur.values[i * Ur.stride + s];
+            }
+            overlap += dot * dot;
+        }
+    }
+    if(fabs(overlap - 5) > 1e-3) {
+        printf("spt_MatrixLeadingLeftVectors subspaces differ: %f\n", overlap);
+        return 1;
+    }
+    sptFreeMatrix(&A);
+    sptFreeMatrix(&Ue);
+    sptFreeMatrix(&Ur);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ParTI.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/error/error.h"
+
+#define spt_IsAligned(p) (((uintptr_t) (p)) % PARTI_VECTOR_ALIGN == 0)
+
+int main(void) {
+    int result;
+    {
+        /* Appends keep the buffer aligned and grow geometrically */
+        sptIndexVector vec;
+        result = sptNewIndexVector(&vec, 0, 0);
+        spt_CheckError(result, "new", NULL);
+        int reallocs = 0;
+        for(sptIndex i = 0; i < 10000; ++i) {
+            sptIndex *before = vec.data;
+            result = sptAppendIndexVector(&vec, i);
+            spt_CheckError(result, "append", NULL);
+            reallocs += vec.data != before;
+            if(!spt_IsAligned(vec.data)) {
+                printf("Unaligned index vector after %u appends\n", (unsigned) i + 1);
+                return 1;
+            }
+        }
+#ifndef MEMCHECK_MODE
+        if(reallocs > 30) {
+            printf("%d reallocations for 10000 appends\n", reallocs);
+            return 1;
+        }
+#else
+        (void) reallocs;
+#endif
+        for(sptIndex i = 0; i < 10000; ++i) {
+            if(vec.data[i] != i) {
+                printf("Index vector lost value %u\n", (unsigned) i);
+                return 1;
+            }
+        }
+        sptFreeIndexVector(&vec);
+    }
+    {
+        /* Reserve, then bulk append values and uninitialized slots without reallocating */
+        sptValueVector vec, more;
+        result = sptNewValueVector(&vec, 0, 0);
+        spt_CheckError(result, "new", NULL);
+        result = sptReserveValueVector(&vec, 100);
+        spt_CheckError(result, "reserve", NULL);
+        sptValue *reserved = vec.data;
+        if(vec.cap != 100 || vec.len != 0 || !spt_IsAligned(vec.data)) {
+            printf("Bad reserve\n");
+            return 1;
+        }
+        sptValue const values[] = { 1, 2, 3 };
+        result = sptAppendValueVectorN(&vec, values, 3);
+        spt_CheckError(result, "append n", NULL);
+        result = sptAppendValueVectorN(&vec, NULL, 7);
+        spt_CheckError(result, "append n", NULL);
+        for(sptNnzIndex i = 3; i < 10; ++i) {
+            vec.data[i] = (sptValue) (i + 1);
+        }
+        result = sptNewValueVector(&more, 90, 90);
+        spt_CheckError(result, "new", NULL);
+        for(sptNnzIndex i = 0; i < 90; ++i) {
+            more.data[i] = (sptValue) (i + 11);
+        }
+        result = sptAppendValueVectorWithVector(&vec, &more);
+        spt_CheckError(result, "append vector", NULL);
+        if(vec.data != reserved || vec.len != 100) {
+            printf("Appends within the reserve reallocated\n");
+            return 1;
+        }
+        result = sptAppendValueVector(&vec, 101);
+        spt_CheckError(result, "append", NULL);
+        result = sptReserveValueVector(&vec, 10);
+        spt_CheckError(result, "reserve", NULL);
+#ifndef MEMCHECK_MODE
+        if(vec.cap < 150) {
+            printf("Growth past the reserve not geometric\n");
+            return 1;
+        }
+#endif
+        if(vec.cap < 101 || !spt_IsAligned(vec.data)) {
+            printf("Reserve shrunk the vector\n");
+            return 1;
+        }
+        result = sptResizeValueVector(&vec, 50);
+        spt_CheckError(result, "resize", NULL);
+        if(vec.cap != 50 || !spt_IsAligned(vec.data)) {
+            printf("Bad resize\n");
+            return 1;
+        }
+        for(sptNnzIndex i = 0; i < vec.len; ++i) {
+            if(vec.data[i] != (sptValue) (i + 1)) {
+                printf("Value vector lost value %lu\n", (unsigned long) i);
+                return 1;
+            }
+        }
+        sptFreeValueVector(&more);
+        sptFreeValueVector(&vec);
+    }
+    {
+        /* The other vector types share the policy */
+        sptElementIndexVector evec;
+        sptBlockIndexVector bvec;
+        sptNnzIndexVector nvec;
+        result = sptNewElementIndexVector(&evec, 0, 0);
+        spt_CheckError(result, "new", NULL);
+        result = sptNewBlockIndexVector(&bvec, 0, 0);
+        spt_CheckError(result, "new", NULL);
+        result = sptNewNnzIndexVector(&nvec, 0, 0);
+        spt_CheckError(result, "new", NULL);
+        for(int i = 0; i < 1000; ++i) {
+            sptAppendElementIndexVector(&evec, (sptElementIndex) i);
+            sptAppendBlockIndexVector(&bvec, (sptBlockIndex) i);
+            sptAppendNnzIndexVector(&nvec, (sptNnzIndex) i);
+        }
+        sptNnzIndex head[500];
+        for(int i = 0; i < 500; ++i) {
+            head[i] = (sptNnzIndex) i;
+        }
+        result = sptAppendNnzIndexVectorN(&nvec, head, 500);
+        spt_CheckError(result, "append n", NULL);
+        if(!spt_IsAligned(evec.data) || !spt_IsAligned(bvec.data) || !spt_IsAligned(nvec.data) ||
+            evec.data[999] != (sptElementIndex) 999 || bvec.data[999] != 999 || nvec.len != 1500 || nvec.data[1499] != 499) {
+            printf("Bad element, block or nnz index vector\n");
+            return 1;
+        }
+        sptFreeElementIndexVector(&evec);
+        sptFreeBlockIndexVector(&bvec);
+        sptFreeNnzIndexVector(&nvec);
+    }
+    return 0;
+}
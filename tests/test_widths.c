@@ -0,0 +1,134 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "../src/error/error.h"
+
+/* Every (index width, value width) MTTKRP of a width tensor must match the sequential sptMTTKRP, whatever widths the file stored */
+int main(void) {
+    sptIndex const ndims[] = { 40, 17, 9 };
+    sptIndex const nmodes = 3;
+    sptIndex const R = 5;
+    sptSparseTensor X;
+    int result = sptNewSparseTensor(&X, nmodes, ndims);
+    spt_CheckError(result, "new", NULL);
+    for(sptNnzIndex z = 0; z < 3000; ++z) {
+        for(sptIndex m = 0; m < nmodes; ++m) {
+            sptAppendIndexVector(&X.inds[m], (sptIndex) (rand() % ndims[m]));
+        }
+        sptAppendValueVector(&X.values, (sptValue) (rand() % 100) / 10);
+    }
+    X.nnz = 3000;
+
+    sptMatrix ** mats = malloc((nmodes+1) * sizeof *mats);
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        mats[m] = malloc(sizeof *mats[m]);
+        sptIndex const nrows = m < nmodes ? X.ndims[m] : ndims[0];
+        sptNewMatrix(mats[m], nrows, R);
+        sptRandomizeMatrix(mats[m], nrows, R);
+    }
+    sptIndex const stride = mats[0]->stride;
+    sptIndex mats_order[3];
+    sptValue * ref = malloc((size_t) ndims[0] * stride * sizeof *ref);
+    double * wmats[4];
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        wmats[m] = malloc((size_t) mats[m]->nrows * stride * sizeof(double));
+    }
+
+    uint32_t const stored_index_widths[] = { 2, 4 };
+    uint32_t const index_widths[] = { 0, 2, 4, 8 };
+    uint32_t const value_widths[] = { 4, 8 };
+    for(int s = 0; s < 2; ++s) {
+        for(int v = 0; v < 2; ++v) {
+            FILE * fp = tmpfile();
+            spt_CheckOSError(fp == NULL, "tmpfile");
+            result = sptDumpSparseTensorBinaryWidths(&X, fp, stored_index_widths[s], value_widths[v]);
+            spt_CheckError(result, "dump", NULL);
+            for(int w = 0; w < 4; ++w) {
+                rewind(fp);
+                sptWidthSparseTensor W;
+                result = sptLoadWidthSparseTensorBinary(&W, fp, index_widths[w]);
+                spt_CheckError(result, "width load", NULL);
+                /* Every mode is below 2^16, so 0 picks 16-bit indices */
+                if(W.index_width != (index_widths[w] == 0 ? 2 : index_widths[w]) || W.value_width != value_widths[v]) {
+                    printf("Width load: index width %u, value width %u\n", W.index_width, W.value_width);
+                    return 1;
+                }
+
+                /* Factors at the tensor's value width, from the same values the reference reads */
+                for(sptIndex m = 0; m < nmodes; ++m) {
+                    for(size_t k = 0; k < (size_t) mats[m]->nrows * stride; ++k) {
+                        if(W.value_width == 4) {
+                            ((float *) wmats[m])[k] = (float) mats[m]->values[k];
+                        } else {
+                            wmats[m][k] = (double) mats[m]->values[k];
+                        }
+                    }
+                }
+                double const eps = fmax(W.value_width == 4 ? FLT_EPSILON : DBL_EPSILON, PARTI_VALUE_EPSILON);
+                for(sptIndex mode = 0; mode < nmodes; ++mode) {
+                    mats_order[0] = mode;
+                    for(sptIndex i = 1; i < nmodes; ++i) {
+                        mats_order[i] = (mode+i) % nmodes;
+                    }
+                    mats[nmodes]->nrows = X.ndims[mode];
+                    sptMTTKRP(&X, mats, mats_order, mode);
+                    memcpy(ref, mats[nmodes]->values, (size_t) X.ndims[mode] * stride * sizeof *ref);
+                    /* Entries may cancel to near zero, so bound the rounding by the largest one */
+                    double scale = 0;
+                    for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                        for(sptIndex r = 0; r < R; ++r) {
+                            scale = fmax(scale, fabs(ref[i * stride + r]));
+                        }
+                    }
+
+                    result = sptOmpWidthMTTKRP(&W, (void * const *) wmats, stride, R, mode, 3);
+                    spt_CheckError(result, "width mttkrp", NULL);
+                    for(sptIndex i = 0; i < X.ndims[mode]; ++i) {
+                        for(sptIndex r = 0; r < R; ++r) {
+                            double const a = ref[i * stride + r];
+                            double const b = W.value_width == 4 ? ((float *) wmats[nmodes])[i * stride + r] : wmats[nmodes][i * stride + r];
+                            if(fabs(a - b) > 1e4 * eps * (1 + scale)) {
+                                printf("Width MTTKRP mismatch: index width %u, value width %u, mode %"PARTI_PRI_INDEX"\n", W.index_width, W.value_width, mode);
+                                return 1;
+                            }
+                        }
+                    }
+                }
+                sptFreeWidthSparseTensor(&W);
+            }
+            fclose(fp);
+        }
+    }
+
+    for(sptIndex m = 0; m <= nmodes; ++m) {
+        free(wmats[m]);
+        sptFreeMatrix(mats[m]);
+        free(mats[m]);
+    }
+    free(mats);
+    free(ref);
+    sptFreeSparseTensor(&X);
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+    This file is part of ParTI!.
+
+    ParTI! is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    ParTI! is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with ParTI!.
+    If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ParTI.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/error/error.h"
+#ifdef PARTI_USE_ZSTD
+#include <zstd.h>
+#endif
+
+static int spt_CompareSparseTensors(const sptSparseTensor *a, const sptSparseTensor *b) {
+    if(a->nmodes != b->nmodes || a->nnz != b->nnz) {
+        return 1;
+    }
+    for(sptIndex m = 0; m < a->nmodes; ++m) {
+        if(a->ndims[m] != b->ndims[m] ||
+            memcmp(a->inds[m].data, b->inds[m].data, a->nnz * sizeof (sptIndex)) != 0) {
+            return 1;
+        }
+    }
+    return memcmp(a->values.data, b->values.data, a->nnz * sizeof (sptValue)) != 0;
+}
+
+int main(void) {
+    char plain[] = "/tmp/parti_test_zstd_XXXXXX";
+    int fd = mkstemp(plain);
+    spt_CheckOSError(fd < 0, "mkstemp");
+    close(fd);
+    char packed[sizeof plain + 4];
+    snprintf(packed, sizeof packed, "%s.zst", plain);
+
+    FILE *stream = sptOpenZstdStream(packed, "w", 0);
+    if(stream == NULL) {
+        unlink(plain);
+        if(errno == ENOTSUP) {
+            printf("Built without zstd, skipped\n");
+            return 0;
+        }
+        spt_CheckOSError(1, "open zstd");
+    }
+    fclose(stream);
+
+    /* Large enough to span several frames and parse chunks */
+    sptSparseTensor X;
+    sptIndex const ndims[] = { 5000, 3000, 2000 };
+    int result = sptGenerateSparseTensor(&X, 3, ndims, 1200000, SPT_GEN_UNIFORM, 0, 7, 4);
+    spt_CheckError(result, "generate", NULL);
+
+    stream = fopen(plain, "w");
+    spt_CheckOSError(stream == NULL, "open");
+    result = sptDumpSparseTensor(&X, 1, stream);
+    spt_CheckError(result, "dump", NULL);
+    fclose(stream);
+    sptSparseTensor Y;
+    result = sptOmpLoadSparseTensor(&Y, 1, plain, 4);
+    spt_CheckError(result, "omp load", NULL);
+
+    /* Frames written through the stream decompress in parallel */
+    stream = sptOpenZstdStream(packed, "w", 1);
+    spt_CheckOSError(stream == NULL, "open zstd");
+    result = sptDumpSparseTensor(&X, 1, stream);
+    spt_CheckError(result, "dump zstd", NULL);
+    spt_CheckOSError(fclose(stream) != 0, "close zstd");
+    for(int tk = 1; tk <= 4; tk += 3) {
+        sptSparseTensor Z;
+        result = sptLoadSparseTensorZstd(&Z, 1, packed, tk);
+        spt_CheckError(result, "load zstd", NULL);
+        if(spt_CompareSparseTensors(&Y, &Z) != 0) {
+            printf("Multi-frame load mismatch with %d threads\n", tk);
+            return 1;
+        }
+        sptFreeSparseTensor(&Z);
+    }
+
+#ifdef PARTI_USE_ZSTD
+    /* A single frame of unknown size, as `zstd` writes from a pipe, streams */
+    stream = fopen(plain, "rb");
+    spt_CheckOSError(stream == NULL, "open");
+    fseek(stream, 0, SEEK_END);
+    size_t const text_len = (size_t) ftell(stream);
+    rewind(stream);
+    char *text = malloc(text_len);
+    spt_CheckOSError(fread(text, 1, text_len, stream) != text_len, "read");
+    fclose(stream);
+    size_t const cap = ZSTD_compressBound(text_len);
+    char *frame = malloc(cap);
+    ZSTD_CStream *zcs = ZSTD_createCStream();
+    ZSTD_initCStream(zcs, 1);
+    ZSTD_inBuffer in = { text, text_len, 0 };
+    ZSTD_outBuffer out = { frame, cap, 0 };
+    while(in.pos < in.size) {
+        spt_CheckError(ZSTD_isError(ZSTD_compressStream(zcs, &out, &in)) ? SPTERR_UNKNOWN : 0, "compress", NULL);
+    }
+    spt_CheckError(ZSTD_endStream(zcs, &out) != 0 ? SPTERR_UNKNOWN : 0, "compress", NULL);
+    ZSTD_freeCStream(zcs);
+    stream = fopen(packed, "wb");
+    spt_CheckOSError(stream == NULL || fwrite(frame, 1, out.pos, stream) != out.pos, "write");
+    fclose(stream);
+    sptSparseTensor Z;
+    result = sptLoadSparseTensorZstd(&Z, 1, packed, 4);
+    spt_CheckError(result, "load zstd", NULL);
+    if(spt_CompareSparseTensors(&Y, &Z) != 0) {
+        printf("Streamed load mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&Z);
+
+    /* A truncated archive must fail rather than load part of the tensor */
+    stream = fopen(packed, "wb");
+    spt_CheckOSError(stream == NULL || fwrite(frame, 1, out.pos / 2, stream) != out.pos / 2, "write");
+    fclose(stream);
+    if(sptLoadSparseTensorZstd(&Z, 1, packed, 4) == 0) {
+        printf("Truncated archive accepted\n");
+        return 1;
+    }
+    free(frame);
+    free(text);
+#endif
+
+    /* The binary format goes through the stream unchanged */
+    stream = sptOpenZstdStream(packed, "wb", 3);
+    spt_CheckOSError(stream == NULL, "open zstd");
+    result = sptDumpSparseTensorBinary(&X, stream);
+    spt_CheckError(result, "dump binary zstd", NULL);
+    spt_CheckOSError(fclose(stream) != 0, "close zstd");
+    stream = sptOpenZstdStream(packed, "rb", 0);
+    spt_CheckOSError(stream == NULL, "open zstd");
+    sptSparseTensor B;
+    result = sptLoadSparseTensorBinary(&B, stream);
+    spt_CheckError(result, "load binary zstd", NULL);
+    fclose(stream);
+    if(spt_CompareSparseTensors(&X, &B) != 0) {
+        printf("Binary zstd mismatch\n");
+        return 1;
+    }
+    sptFreeSparseTensor(&B);
+
+    unlink(packed);
+    unlink(plain);
+    sptFreeSparseTensor(&Y);
+    sptFreeSparseTensor(&X);
+    return 0;
+}